@@ -60,6 +60,13 @@ struct _CalendarWindowPrivate {
 	GtkWidget *locations_list;
 
 	GSettings  *settings;
+
+	/* year * 12 + month -> the days marked in the month, one bit per
+	 * day, for the months already shown */
+	GHashTable *month_marks;
+	/* today, when the marks were computed: they all depend on it */
+	int         marks_year;
+	int         marks_yday;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (CalendarWindow, calendar_window, GTK_TYPE_WINDOW)
@@ -84,33 +91,70 @@ static GtkWidget * create_hig_frame 		  (CalendarWindow *calwin,
 		  				   const char *key,
                   				   GCallback   callback);
 
-static void calendar_mark_today(GtkCalendar *calendar)
+static guint32
+calendar_window_compute_month_marks (CalendarWindow *calwin,
+				     guint           year,
+				     guint           month)
 {
-	time_t now;
 	struct tm tm1;
-	guint year, month, day;
+	guint32   marks = 0;
 
-	gtk_calendar_get_date(calendar, &year, &month, &day);
-	time(&now);
-	localtime_r (&now, &tm1);
-	if ((tm1.tm_mon == (int) month) && (tm1.tm_year + 1900 == (int) year)) {
-		gtk_calendar_mark_day (GTK_CALENDAR (calendar), (guint) tm1.tm_mday);
-	} else {
-		gtk_calendar_unmark_day (GTK_CALENDAR (calendar), (guint) tm1.tm_mday);
+	localtime_r (calwin->priv->current_time, &tm1);
+	if (tm1.tm_mon == (int) month && tm1.tm_year + 1900 == (int) year)
+		marks |= 1u << tm1.tm_mday;
+
+	return marks;
+}
+
+static guint32
+calendar_window_get_month_marks (CalendarWindow *calwin,
+				 guint           year,
+				 guint           month)
+{
+	struct tm  tm1;
+	gpointer   key;
+	gpointer   marks;
+
+	localtime_r (calwin->priv->current_time, &tm1);
+	if (tm1.tm_year != calwin->priv->marks_year ||
+	    tm1.tm_yday != calwin->priv->marks_yday) {
+		g_hash_table_remove_all (calwin->priv->month_marks);
+		calwin->priv->marks_year = tm1.tm_year;
+		calwin->priv->marks_yday = tm1.tm_yday;
 	}
+
+	key = GUINT_TO_POINTER (year * 12 + month);
+	if (g_hash_table_lookup_extended (calwin->priv->month_marks, key, NULL, &marks))
+		return GPOINTER_TO_UINT (marks);
+
+	marks = GUINT_TO_POINTER (calendar_window_compute_month_marks (calwin, year, month));
+	g_hash_table_insert (calwin->priv->month_marks, key, marks);
+
+	return GPOINTER_TO_UINT (marks);
 }
 
-static gboolean calendar_update(gpointer user_data)
+/* Cheap enough to run in the month-changed handler: flipping through the
+ * months does not queue anything, and a month shown before is not
+ * computed again */
+static void
+calendar_window_update_marks (CalendarWindow *calwin)
 {
-	GtkCalendar *calendar = user_data;
-	calendar_mark_today(calendar);
-	return G_SOURCE_REMOVE;
+	GtkCalendar *calendar = GTK_CALENDAR (calwin->priv->calendar);
+	guint        year, month, day;
+	guint32      marks;
+
+	gtk_calendar_get_date (calendar, &year, &month, &day);
+	marks = calendar_window_get_month_marks (calwin, year, month);
+
+	gtk_calendar_clear_marks (calendar);
+	for (day = 1; day <= 31; day++)
+		if (marks & (1u << day))
+			gtk_calendar_mark_day (calendar, day);
 }
 
 static void calendar_month_changed_cb(GtkCalendar *calendar, gpointer user_data)
 {
-	gtk_calendar_clear_marks(calendar);
-	g_idle_add_full (G_PRIORITY_DEFAULT_IDLE, calendar_update, user_data, NULL);
+	calendar_window_update_marks (CALENDAR_WINDOW (user_data));
 }
 
 static GtkWidget *
@@ -133,10 +177,9 @@ calendar_window_create_calendar (CalendarWindow *calwin)
 	gtk_calendar_select_month (GTK_CALENDAR (calendar),
 				   (guint) tm1.tm_mon, (guint) (tm1.tm_year + 1900));
 	gtk_calendar_select_day (GTK_CALENDAR (calendar), (guint) tm1.tm_mday);
-	calendar_mark_today (GTK_CALENDAR(calendar));
 
 	g_signal_connect(calendar, "month-changed",
-			 G_CALLBACK(calendar_month_changed_cb), calendar);
+			 G_CALLBACK(calendar_month_changed_cb), calwin);
 
 	return calendar;
 }
@@ -285,6 +328,7 @@ calendar_window_fill (CalendarWindow *calwin)
         gtk_widget_show (vbox);
 
 	calwin->priv->calendar = calendar_window_create_calendar (calwin);
+	calendar_window_update_marks (calwin);
         gtk_widget_show (calwin->priv->calendar);
 
 	if (!calwin->priv->invert_order) {
@@ -409,6 +453,8 @@ calendar_window_dispose (GObject *object)
 		g_object_unref (calwin->priv->settings);
 	calwin->priv->settings = NULL;
 
+	g_clear_pointer (&calwin->priv->month_marks, g_hash_table_destroy);
+
 	G_OBJECT_CLASS (calendar_window_parent_class)->dispose (object);
 }
 
@@ -475,6 +521,9 @@ calendar_window_init (CalendarWindow *calwin)
 
 	calwin->priv = calendar_window_get_instance_private (calwin);
 
+	calwin->priv->month_marks = g_hash_table_new (NULL, NULL);
+	calwin->priv->marks_year = -1;
+
 	window = GTK_WINDOW (calwin);
 	gtk_window_set_type_hint (window, GDK_WINDOW_TYPE_HINT_DOCK);
 	gtk_window_set_decorated (window, FALSE);
@@ -506,6 +555,10 @@ void
 calendar_window_refresh (CalendarWindow *calwin)
 {
 	g_return_if_fail (CALENDAR_IS_WINDOW (calwin));
+
+	/* today may have changed while the window was hidden */
+	if (calwin->priv->calendar)
+		calendar_window_update_marks (calwin);
 }
 
 gboolean
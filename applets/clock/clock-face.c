@@ -20,6 +20,14 @@
 #include "clock-location.h"
 #include "clock-utils.h"
 
+/* The face is painted once to a surface similar to the window it is
+ * shown in, kept with the pixbuf and shared by the faces using it. On
+ * each tick, only the area of the hands is redrawn. */
+#define CLOCK_FACE_SURFACE_KEY "clock-face-surface"
+
+/* the hands are 1 pixel wide, antialiased */
+#define CLOCK_FACE_HANDS_MARGIN 2
+
 static GHashTable *pixbuf_cache = NULL;
 
 static void     clock_face_finalize             (GObject *);
@@ -34,10 +42,12 @@ static void     clock_face_get_preferred_height (GtkWidget      *this,
 static void     clock_face_size_allocate        (GtkWidget      *clock,
                                                  GtkAllocation  *allocation);
 
-static void update_time_and_face  (ClockFace      *this,
-                                   gboolean        force_face_loading);
-static void clock_face_load_face  (ClockFace      *this,
-                                   gint width, gint height);
+static gboolean update_time_and_face  (ClockFace      *this,
+                                       gboolean        force_face_loading);
+static void     clock_face_load_face  (ClockFace      *this,
+                                       gint width, gint height);
+static void     clock_face_scale_factor_changed (ClockFace  *this,
+                                                 GParamSpec *pspec);
 
 typedef struct _ClockFacePrivate ClockFacePrivate;
 
@@ -58,9 +68,18 @@ struct _ClockFacePrivate
     ClockFaceTimeOfDay timeofday;
     ClockLocation *location;
     GdkPixbuf *face_pixbuf;
+    int face_scale; /* the scale the face pixbuf is loaded at */
     GtkWidget *size_widget;
 };
 
+typedef struct {
+    double x, y; /* the center */
+    double hour_x, hour_y;
+    double min_x, min_y;
+    double sec_x, sec_y;
+    gboolean has_seconds;
+} ClockFaceHands;
+
 G_DEFINE_TYPE_WITH_PRIVATE (ClockFace, clock_face, GTK_TYPE_WIDGET)
 
 static void
@@ -91,26 +110,27 @@ clock_face_init (ClockFace *this)
     priv->timeofday = CLOCK_FACE_INVALID;
     priv->location = NULL;
     priv->size_widget = NULL;
+    priv->face_scale = 1;
 
     gtk_widget_set_has_window (GTK_WIDGET (this), FALSE);
+
+    g_signal_connect (this, "notify::scale-factor",
+                      G_CALLBACK (clock_face_scale_factor_changed), NULL);
 }
 
-static gboolean
-clock_face_draw (GtkWidget *this, cairo_t *cr)
+static void
+clock_face_get_hands (ClockFace      *this,
+                      ClockFaceHands *hands)
 {
     ClockFacePrivate *priv;
     int width, height;
-    double x, y;
     double radius;
     int hours, minutes, seconds;
 
     /* Hand lengths as a multiple of the clock radius */
     double hour_length, min_length, sec_length;
 
-    priv = clock_face_get_instance_private (CLOCK_FACE(this));
-
-    if (GTK_WIDGET_CLASS (clock_face_parent_class)->draw)
-        GTK_WIDGET_CLASS (clock_face_parent_class)->draw (this, cr);
+    priv = clock_face_get_instance_private (this);
 
     if (priv->size == CLOCK_FACE_LARGE) {
             hour_length = 0.45;
@@ -122,56 +142,141 @@ clock_face_draw (GtkWidget *this, cairo_t *cr)
             sec_length = 0.8;   /* not drawn currently */
     }
 
-    width = gtk_widget_get_allocated_width (this);
-    height = gtk_widget_get_allocated_width (this);
-    x = width / 2;
-    y = height / 2;
+    width = gtk_widget_get_allocated_width (GTK_WIDGET (this));
+    height = gtk_widget_get_allocated_width (GTK_WIDGET (this));
+    hands->x = width / 2;
+    hands->y = height / 2;
     radius = MIN (width / 2, height / 2) - 5;
 
-    /* clock back */
-    if (priv->face_pixbuf) {
-            cairo_save (cr);
-            gdk_cairo_set_source_pixbuf (cr, priv->face_pixbuf, 0, 0);
-            cairo_paint (cr);
-            cairo_restore (cr);
-    }
-
-    /* clock hands */
     hours = priv->time.tm_hour;
     minutes = priv->time.tm_min + priv->minute_offset;
     seconds = priv->time.tm_sec;
 
-    cairo_set_line_width (cr, 1);
-
     /* hour hand:
      * the hour hand is rotated 30 degrees (pi/6 r) per hour +
      * 1/2 a degree (pi/360 r) per minute
      */
-    cairo_save (cr);
-    cairo_move_to (cr, x, y);
-    cairo_line_to (cr, x + radius * hour_length * sin (M_PI / 6 * hours +
-                                                       M_PI / 360 * minutes),
-                       y + radius * hour_length * -cos (M_PI / 6 * hours +
-                                                        M_PI / 360 * minutes));
-    cairo_stroke (cr);
-    cairo_restore (cr);
+    hands->hour_x = hands->x + radius * hour_length * sin (M_PI / 6 * hours +
+                                                           M_PI / 360 * minutes);
+    hands->hour_y = hands->y + radius * hour_length * -cos (M_PI / 6 * hours +
+                                                            M_PI / 360 * minutes);
+
     /* minute hand:
      * the minute hand is rotated 6 degrees (pi/30 r) per minute
      */
-    cairo_move_to (cr, x, y);
-    cairo_line_to (cr, x + radius * min_length * sin (M_PI / 30 * minutes),
-                       y + radius * min_length * -cos (M_PI / 30 * minutes));
-    cairo_stroke (cr);
+    hands->min_x = hands->x + radius * min_length * sin (M_PI / 30 * minutes);
+    hands->min_y = hands->y + radius * min_length * -cos (M_PI / 30 * minutes);
 
     /* seconds hand:
      * operates identically to the minute hand
      */
-    if (priv->size == CLOCK_FACE_LARGE) {
+    hands->has_seconds = priv->size == CLOCK_FACE_LARGE;
+    hands->sec_x = hands->x + radius * sec_length * sin (M_PI / 30 * seconds);
+    hands->sec_y = hands->y + radius * sec_length * -cos (M_PI / 30 * seconds);
+}
+
+/* The area covered by the hands, in widget coordinates */
+static void
+clock_face_get_hands_area (ClockFace    *this,
+                           GdkRectangle *area)
+{
+    ClockFaceHands hands;
+    double x1, y1, x2, y2;
+
+    clock_face_get_hands (this, &hands);
+
+    x1 = MIN (hands.x, MIN (hands.hour_x, hands.min_x));
+    y1 = MIN (hands.y, MIN (hands.hour_y, hands.min_y));
+    x2 = MAX (hands.x, MAX (hands.hour_x, hands.min_x));
+    y2 = MAX (hands.y, MAX (hands.hour_y, hands.min_y));
+
+    if (hands.has_seconds) {
+            x1 = MIN (x1, hands.sec_x);
+            y1 = MIN (y1, hands.sec_y);
+            x2 = MAX (x2, hands.sec_x);
+            y2 = MAX (y2, hands.sec_y);
+    }
+
+    area->x = floor (x1) - CLOCK_FACE_HANDS_MARGIN;
+    area->y = floor (y1) - CLOCK_FACE_HANDS_MARGIN;
+    area->width = ceil (x2) + CLOCK_FACE_HANDS_MARGIN - area->x;
+    area->height = ceil (y2) + CLOCK_FACE_HANDS_MARGIN - area->y;
+}
+
+static cairo_surface_t *
+clock_face_get_face_surface (ClockFace *this)
+{
+    ClockFacePrivate *priv = clock_face_get_instance_private (this);
+    cairo_surface_t *surface;
+    GdkWindow *window;
+    cairo_t *cr;
+
+    surface = g_object_get_data (G_OBJECT (priv->face_pixbuf),
+                                 CLOCK_FACE_SURFACE_KEY);
+    if (surface)
+            return surface;
+
+    window = gtk_widget_get_window (GTK_WIDGET (this));
+    if (!window)
+            return clock_utils_pixbuf_get_surface (priv->face_pixbuf);
+
+    /* the faces sharing the pixbuf have the same scale, see
+     * clock_face_load_face() */
+    surface = gdk_window_create_similar_surface (window,
+                                                 CAIRO_CONTENT_COLOR_ALPHA,
+                                                 gdk_pixbuf_get_width (priv->face_pixbuf) / priv->face_scale,
+                                                 gdk_pixbuf_get_height (priv->face_pixbuf) / priv->face_scale);
+
+    cr = cairo_create (surface);
+    cairo_scale (cr, 1.0 / priv->face_scale, 1.0 / priv->face_scale);
+    gdk_cairo_set_source_pixbuf (cr, priv->face_pixbuf, 0, 0);
+    cairo_paint (cr);
+    cairo_destroy (cr);
+
+    g_object_set_data_full (G_OBJECT (priv->face_pixbuf),
+                            CLOCK_FACE_SURFACE_KEY,
+                            surface, (GDestroyNotify) cairo_surface_destroy);
+
+    return surface;
+}
+
+static gboolean
+clock_face_draw (GtkWidget *this, cairo_t *cr)
+{
+    ClockFacePrivate *priv;
+    ClockFaceHands hands;
+
+    priv = clock_face_get_instance_private (CLOCK_FACE(this));
+
+    if (GTK_WIDGET_CLASS (clock_face_parent_class)->draw)
+        GTK_WIDGET_CLASS (clock_face_parent_class)->draw (this, cr);
+
+    /* clock back */
+    if (priv->face_pixbuf) {
+            cairo_save (cr);
+            cairo_set_source_surface (cr, clock_face_get_face_surface (CLOCK_FACE (this)), 0, 0);
+            cairo_paint (cr);
+            cairo_restore (cr);
+    }
+
+    /* clock hands */
+    clock_face_get_hands (CLOCK_FACE (this), &hands);
+
+    cairo_set_line_width (cr, 1);
+
+    cairo_move_to (cr, hands.x, hands.y);
+    cairo_line_to (cr, hands.hour_x, hands.hour_y);
+    cairo_stroke (cr);
+
+    cairo_move_to (cr, hands.x, hands.y);
+    cairo_line_to (cr, hands.min_x, hands.min_y);
+    cairo_stroke (cr);
+
+    if (hands.has_seconds) {
             cairo_save (cr);
             cairo_set_source_rgb (cr, 0.937, 0.161, 0.161); /* tango red */
-            cairo_move_to (cr, x, y);
-            cairo_line_to (cr, x + radius * sec_length * sin (M_PI / 30 * seconds),
-                           y + radius * sec_length * -cos (M_PI / 30 * seconds));
+            cairo_move_to (cr, hands.x, hands.y);
+            cairo_line_to (cr, hands.sec_x, hands.sec_y);
             cairo_stroke (cr);
             cairo_restore (cr);
     }
@@ -207,7 +312,7 @@ clock_face_get_preferred_width (GtkWidget *this,
             *natural_width = child_natural_height + child_natural_height / 8;
     } else if (priv->face_pixbuf != NULL) {
             /* Use the size of the current pixbuf */
-            *minimal_width = *natural_width = gdk_pixbuf_get_width (GDK_PIXBUF (priv->face_pixbuf));
+            *minimal_width = *natural_width = gdk_pixbuf_get_width (GDK_PIXBUF (priv->face_pixbuf)) / priv->face_scale;
     } else {
             /* we don't know anything, so use known dimensions for the svg
              * files */
@@ -240,7 +345,7 @@ clock_face_get_preferred_height (GtkWidget *this,
             *natural_height = child_natural_height + child_natural_height / 8;
     } else if (priv->face_pixbuf != NULL) {
             /* Use the size of the current pixbuf */
-            *minimal_height = *natural_height = gdk_pixbuf_get_height (GDK_PIXBUF (priv->face_pixbuf));
+            *minimal_height = *natural_height = gdk_pixbuf_get_height (GDK_PIXBUF (priv->face_pixbuf)) / priv->face_scale;
     } else {
             /* we don't know anything, so use known dimensions for the svg
              * files */
@@ -274,7 +379,8 @@ clock_face_size_allocate (GtkWidget     *this,
     update_time_and_face (CLOCK_FACE (this), TRUE);
 }
 
-static void
+/* Returns TRUE when the face was reloaded */
+static gboolean
 update_time_and_face (ClockFace *this,
                       gboolean   force_face_loading)
 {
@@ -326,14 +432,51 @@ update_time_and_face (ClockFace *this,
              * Note that 1x1 is not really some space... */
             if (width > 1 && height > 1)
                     clock_face_load_face (this, width, height);
+
+            return TRUE;
     }
+
+    return FALSE;
+}
+
+static void
+clock_face_scale_factor_changed (ClockFace  *this,
+                                 GParamSpec *pspec)
+{
+    /* Reload the face at the new scale */
+    update_time_and_face (this, TRUE);
+    clock_face_redraw_canvas (this);
 }
 
 gboolean
 clock_face_refresh (ClockFace *this)
 {
-    update_time_and_face (this, FALSE);
-    clock_face_redraw_canvas (this);
+    ClockFacePrivate *priv = clock_face_get_instance_private (this);
+    GdkRectangle old_area;
+    GdkRectangle area;
+    struct tm old_time;
+
+    old_time = priv->time;
+    clock_face_get_hands_area (this, &old_area);
+
+    if (update_time_and_face (this, FALSE)) {
+            clock_face_redraw_canvas (this);
+            return TRUE;
+    }
+
+    /* the same hands at the same place */
+    if (old_time.tm_hour == priv->time.tm_hour &&
+        old_time.tm_min == priv->time.tm_min &&
+        (priv->size != CLOCK_FACE_LARGE ||
+         old_time.tm_sec == priv->time.tm_sec))
+            return TRUE;
+
+    /* only the hands move over the face: redraw where they were and
+     * where they go, the face is repainted from its surface there */
+    clock_face_get_hands_area (this, &area);
+    gdk_rectangle_union (&old_area, &area, &area);
+    gtk_widget_queue_draw_area (GTK_WIDGET (this),
+                                area.x, area.y, area.width, area.height);
 
     return TRUE; /* keep running this event */
 }
@@ -397,6 +540,7 @@ clock_face_load_face (ClockFace *this, gint width, gint height)
     const gchar *daytime_string[4] = { "morning", "day", "evening", "night" };
     gchar *cache_name;
     gchar *name;
+    gint scale;
 
     if (!pixbuf_cache)
             pixbuf_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
@@ -410,10 +554,14 @@ clock_face_load_face (ClockFace *this, gint width, gint height)
             priv->face_pixbuf = NULL;
     }
 
+    /* The pixbuf is loaded at the size of the device pixels */
+    scale = gtk_widget_get_scale_factor (GTK_WIDGET (this));
+    priv->face_scale = scale;
+
     /* Look for the pixbuf in the process-wide cache first */
-    cache_name = g_strdup_printf ("%d-%d-%d-%d",
+    cache_name = g_strdup_printf ("%d-%d-%d-%d-%d",
                                   priv->size, priv->timeofday,
-                                  width, height);
+                                  width, height, scale);
 
     priv->face_pixbuf = g_hash_table_lookup (pixbuf_cache, cache_name);
     if (priv->face_pixbuf) {
@@ -427,14 +575,14 @@ clock_face_load_face (ClockFace *this, gint width, gint height)
                         "clock-face-", size_string[priv->size],
                         "-", daytime_string[priv->timeofday], ".svg",
                         NULL);
-    priv->face_pixbuf = gdk_pixbuf_new_from_resource_at_scale (name, width, height, TRUE, NULL);
+    priv->face_pixbuf = gdk_pixbuf_new_from_resource_at_scale (name, width * scale, height * scale, TRUE, NULL);
     g_free (name);
 
     if (!priv->face_pixbuf) {
             name = g_strconcat (CLOCK_RESOURCE_PATH "icons/",
                                 "clock-face-", size_string[priv->size], ".svg",
                                 NULL);
-            priv->face_pixbuf = gdk_pixbuf_new_from_resource_at_scale (name, width, height, TRUE, NULL);
+            priv->face_pixbuf = gdk_pixbuf_new_from_resource_at_scale (name, width * scale, height * scale, TRUE, NULL);
             g_free (name);
     }
 
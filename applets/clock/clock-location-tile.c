@@ -186,13 +186,29 @@ make_current_cb (gpointer data, GError *error)
         }
 }
 
+/* called however the call ends, even when there was nothing to do */
+static void
+make_current_done (gpointer data)
+{
+        ClockLocationTile *tile = data;
+        ClockLocationTilePrivate *priv = clock_location_tile_get_instance_private (tile);
+
+        gtk_widget_set_sensitive (priv->current_button, TRUE);
+        g_object_unref (tile);
+}
+
 static void
 make_current (GtkWidget *widget, ClockLocationTile *tile)
 {
         ClockLocationTilePrivate *priv = clock_location_tile_get_instance_private (tile);
 
+        /* until the mechanism answers, which can take a password prompt */
+        gtk_widget_set_sensitive (priv->current_button, FALSE);
+
         clock_location_make_current (priv->location,
-                                     (GFunc)make_current_cb, tile, NULL);
+                                     (GFunc)make_current_cb,
+                                     g_object_ref (tile),
+                                     make_current_done);
 }
 
 static gboolean
@@ -513,6 +529,16 @@ convert_time_to_str (time_t now, ClockFormat clock_format)
         return g_locale_to_utf8 (buf, -1, NULL, NULL, NULL);
 }
 
+/* Setting the same markup again still reparses it and relayouts the label */
+static void
+label_set_markup_if_changed (GtkLabel *label, const char *markup)
+{
+        if (g_strcmp0 (gtk_label_get_label (label), markup) == 0)
+                return;
+
+        gtk_label_set_markup (label, markup);
+}
+
 void
 clock_location_tile_refresh (ClockLocationTile *this, gboolean force_refresh)
 {
@@ -553,7 +579,7 @@ clock_location_tile_refresh (ClockLocationTile *this, gboolean force_refresh)
 
         tmp = g_strdup_printf ("<big><b>%s</b></big>",
                                clock_location_get_display_name (priv->location));
-        gtk_label_set_markup (GTK_LABEL (priv->city_label), tmp);
+        label_set_markup_if_changed (GTK_LABEL (priv->city_label), tmp);
         g_free (tmp);
 
         g_signal_emit (this, signals[NEED_CLOCK_FORMAT], 0, &format);
@@ -562,34 +588,53 @@ clock_location_tile_refresh (ClockLocationTile *this, gboolean force_refresh)
 
         tmp = format_time (&now, tzname, format, offset);
 
-        gtk_label_set_markup (GTK_LABEL (priv->time_label), tmp);
+        label_set_markup_if_changed (GTK_LABEL (priv->time_label), tmp);
 
         g_free (tmp);
 }
 
-void
-weather_info_setup_tooltip (WeatherInfo *info, ClockLocation *location, GtkTooltip *tooltip,
-                            ClockFormat clock_format)
+/* The weather tooltip of a location is formatted when the weather is
+ * updated, not each time the tooltip shows up */
+typedef struct {
+        ClockFormat  clock_format;
+        gint         icon_scale;
+        gchar       *markup;
+        GdkPixbuf   *icon;
+} WeatherTooltip;
+
+static void
+weather_tooltip_clear (WeatherTooltip *wt)
+{
+        g_clear_pointer (&wt->markup, g_free);
+        g_clear_object (&wt->icon);
+}
+
+static void
+weather_tooltip_free (WeatherTooltip *wt)
+{
+        weather_tooltip_clear (wt);
+        g_free (wt);
+}
+
+static void
+weather_tooltip_fill (WeatherTooltip *wt, WeatherInfo *info, ClockLocation *location)
 {
-        GdkPixbuf *pixbuf = NULL;
         GtkIconTheme *theme = NULL;
         const gchar *conditions, *wind;
         gchar *temp, *apparent;
-        gchar *line1, *line2, *line3, *line4, *tip;
+        gchar *line1, *line2, *line3, *line4;
         const gchar *icon_name;
         const gchar *sys_timezone;
         time_t sunrise_time, sunset_time;
         gchar *sunrise_str, *sunset_str;
-        gint icon_scale;
+
+        weather_tooltip_clear (wt);
 
         theme = gtk_icon_theme_get_default ();
         icon_name = weather_info_get_icon_name (info);
-        icon_scale = gdk_window_get_scale_factor (gdk_get_default_root_window ());
 
-        pixbuf = gtk_icon_theme_load_icon_for_scale (theme, icon_name, 48, icon_scale,
-                                                     GTK_ICON_LOOKUP_GENERIC_FALLBACK, NULL);
-        if (pixbuf)
-                gtk_tooltip_set_icon (tooltip, pixbuf);
+        wt->icon = gtk_icon_theme_load_icon_for_scale (theme, icon_name, 48, wt->icon_scale,
+                                                       GTK_ICON_LOOKUP_GENERIC_FALLBACK, NULL);
 
         conditions = weather_info_get_conditions (info);
         if (strcmp (conditions, "-") != 0)
@@ -623,11 +668,11 @@ weather_info_setup_tooltip (WeatherInfo *info, ClockLocation *location, GtkToolt
         setenv ("TZ", clock_location_get_timezone (location), 1);
         tzset ();
         if (weather_info_get_value_sunrise (info, &sunrise_time))
-                sunrise_str = convert_time_to_str (sunrise_time, clock_format);
+                sunrise_str = convert_time_to_str (sunrise_time, wt->clock_format);
         else
                 sunrise_str = g_strdup ("???");
         if (weather_info_get_value_sunset (info, &sunset_time))
-                sunset_str = convert_time_to_str (sunset_time, clock_format);
+                sunset_str = convert_time_to_str (sunset_time, wt->clock_format);
         else
                 sunset_str = g_strdup ("???");
         line4 = g_strdup_printf (_("Sunrise: %s / Sunset: %s"),
@@ -641,13 +686,56 @@ weather_info_setup_tooltip (WeatherInfo *info, ClockLocation *location, GtkToolt
                 unsetenv ("TZ");
         tzset ();
 
-        tip = g_strdup_printf ("<b>%s</b>\n%s\n%s%s", line1, line2, line3, line4);
-        gtk_tooltip_set_markup (tooltip, tip);
+        wt->markup = g_strdup_printf ("<b>%s</b>\n%s\n%s%s", line1, line2, line3, line4);
         g_free (line1);
         g_free (line2);
         g_free (line3);
         g_free (line4);
-        g_free (tip);
+}
+
+static void
+weather_tooltip_weather_updated (ClockLocation *location, WeatherInfo *info, gpointer data)
+{
+        WeatherTooltip *wt;
+
+        wt = g_object_get_data (G_OBJECT (location), "clock-weather-tooltip");
+        g_assert (wt != NULL);
+
+        if (info && weather_info_is_valid (info))
+                weather_tooltip_fill (wt, info, location);
+        else
+                weather_tooltip_clear (wt);
+}
+
+void
+weather_info_setup_tooltip (WeatherInfo *info, ClockLocation *location, GtkTooltip *tooltip,
+                            ClockFormat clock_format)
+{
+        WeatherTooltip *wt;
+        gint icon_scale;
+
+        icon_scale = gdk_window_get_scale_factor (gdk_get_default_root_window ());
+
+        wt = g_object_get_data (G_OBJECT (location), "clock-weather-tooltip");
+        if (!wt) {
+                wt = g_new0 (WeatherTooltip, 1);
+                g_object_set_data_full (G_OBJECT (location), "clock-weather-tooltip",
+                                        wt, (GDestroyNotify) weather_tooltip_free);
+                g_signal_connect (location, "weather-updated",
+                                  G_CALLBACK (weather_tooltip_weather_updated), NULL);
+        }
+
+        if (!wt->markup ||
+            wt->clock_format != clock_format ||
+            wt->icon_scale != icon_scale) {
+                wt->clock_format = clock_format;
+                wt->icon_scale = icon_scale;
+                weather_tooltip_fill (wt, info, location);
+        }
+
+        if (wt->icon)
+                gtk_tooltip_set_icon (tooltip, wt->icon);
+        gtk_tooltip_set_markup (tooltip, wt->markup);
 }
 
 static gboolean
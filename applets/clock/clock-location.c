@@ -29,6 +29,7 @@ typedef struct {
         SystemTimezone *systz;
 
         gchar *timezone;
+        GTimeZone *tz;
 
         gchar *tzname;
 
@@ -36,9 +37,7 @@ typedef struct {
         gfloat longitude;
 
         gchar *weather_code;
-        WeatherInfo *weather_info;
-        guint weather_timeout;
-        guint weather_retry_time;
+        struct _WeatherSource *weather_source;
 
         TempUnit temperature_unit;
         SpeedUnit speed_unit;
@@ -48,8 +47,37 @@ G_DEFINE_TYPE_WITH_PRIVATE (ClockLocation, clock_location, G_TYPE_OBJECT)
 
 #define WEATHER_TIMEOUT_BASE 30
 #define WEATHER_TIMEOUT_MAX  1800
+#define WEATHER_STAGGER      2
 #define WEATHER_EMPTY_CODE   "-"
 
+/* Weather data is shared by all the locations (of all the clock applets
+ * in this process) asking for the same station with the same units, and
+ * all the fetches go through one queue so that they are spread over time
+ * instead of all hitting the network at once. */
+typedef struct _WeatherSource {
+        gchar       *key;
+        guint        ref_count;
+
+        /* NULL until the first fetch leaves the queue, location until then */
+        WeatherInfo     *info;
+        WeatherLocation *location;
+        gboolean     has_data;
+        GSList      *locations;
+
+        TempUnit     temperature_unit;
+        SpeedUnit    speed_unit;
+
+        guint        timeout;
+        guint        retry_time;
+        gboolean     queued;
+} WeatherSource;
+
+static GHashTable *weather_sources = NULL;
+static GQueue      weather_queue = G_QUEUE_INIT;
+static guint       weather_queue_id = 0;
+/* how much longer than WEATHER_TIMEOUT_MAX to wait between updates */
+static guint       weather_interval_scale = 1;
+
 enum {
         WEATHER_UPDATED,
         SET_CURRENT,
@@ -59,10 +87,9 @@ enum {
 static guint location_signals[LAST_SIGNAL] = { 0 };
 
 static void clock_location_finalize (GObject *);
-static void clock_location_set_tz (ClockLocation *this);
-static void clock_location_unset_tz (ClockLocation *this);
-static gboolean update_weather_info (gpointer data);
+static void clock_location_update_tz (ClockLocation *this);
 static void setup_weather_updates (ClockLocation *loc);
+static void detach_weather_source (ClockLocation *loc);
 
 static gchar *clock_location_get_valid_weather_code (const gchar *code);
 
@@ -113,9 +140,8 @@ clock_location_new (const gchar *name, const gchar *city,
         priv->city = g_strdup (city);
         priv->timezone = g_strdup (timezone);
 
-        /* initialize priv->tzname */
-        clock_location_set_tz (this);
-        clock_location_unset_tz (this);
+        /* initialize priv->tz and priv->tzname */
+        clock_location_update_tz (this);
 
         priv->latitude = latitude;
         priv->longitude = longitude;
@@ -160,24 +186,10 @@ clock_location_class_init (ClockLocationClass *this_class)
                               G_TYPE_NONE, 0);
 }
 
-static void
-network_changed (GNetworkMonitor *monitor,
-                 gboolean         available,
-                 ClockLocation   *loc)
-{
-        ClockLocationPrivate *priv = clock_location_get_instance_private (loc);
-
-        if (available) {
-                priv->weather_retry_time = WEATHER_TIMEOUT_BASE;
-                update_weather_info (loc);
-        }
-}
-
 static void
 clock_location_init (ClockLocation *this)
 {
         ClockLocationPrivate *priv = clock_location_get_instance_private (this);
-        GNetworkMonitor *monitor;
 
         priv->name = NULL;
         priv->city = NULL;
@@ -185,16 +197,13 @@ clock_location_init (ClockLocation *this)
         priv->systz = system_timezone_new ();
 
         priv->timezone = NULL;
+        priv->tz = NULL;
 
         priv->tzname = NULL;
 
         priv->latitude = 0;
         priv->longitude = 0;
 
-        monitor = g_network_monitor_get_default();
-        g_signal_connect (monitor, "network-changed",
-                          G_CALLBACK (network_changed), this);
-
         priv->temperature_unit = TEMP_UNIT_CENTIGRADE;
         priv->speed_unit = SPEED_UNIT_MS;
 }
@@ -203,12 +212,8 @@ static void
 clock_location_finalize (GObject *g_obj)
 {
         ClockLocationPrivate *priv = clock_location_get_instance_private (CLOCK_LOCATION(g_obj));
-        GNetworkMonitor      *monitor;
 
-        monitor = g_network_monitor_get_default ();
-        g_signal_handlers_disconnect_by_func (monitor,
-                                              G_CALLBACK (network_changed),
-                                              CLOCK_LOCATION (g_obj));
+        detach_weather_source (CLOCK_LOCATION (g_obj));
 
         g_clear_pointer (&priv->name, g_free);
         g_clear_pointer (&priv->city, g_free);
@@ -216,19 +221,10 @@ clock_location_finalize (GObject *g_obj)
         g_clear_object (&priv->systz);
 
         g_clear_pointer (&priv->timezone, g_free);
+        g_clear_pointer (&priv->tz, g_time_zone_unref);
         g_clear_pointer (&priv->tzname, g_free);
         g_clear_pointer (&priv->weather_code, g_free);
 
-        if (priv->weather_info) {
-                weather_info_free (priv->weather_info);
-                priv->weather_info = NULL;
-        }
-
-        if (priv->weather_timeout) {
-                g_source_remove (priv->weather_timeout);
-                priv->weather_timeout = 0;
-        }
-
         G_OBJECT_CLASS (clock_location_parent_class)->finalize (g_obj);
 }
 
@@ -292,6 +288,8 @@ clock_location_set_timezone (ClockLocation *loc, const gchar *timezone)
 
         g_free (priv->timezone);
         priv->timezone = g_strdup (timezone);
+
+        clock_location_update_tz (loc);
 }
 
 gchar *
@@ -338,62 +336,92 @@ clock_location_set_tzname (ClockLocation *this, const char *tzname)
         }
 }
 
-static void
-clock_location_set_tz (ClockLocation *this)
+/* Zoneinfo data is shared by every location (and every clock applet
+ * living in this process) using the same tzid: GLib maps the zoneinfo
+ * file once and answers offset/transition queries from it, so we never
+ * need to touch TZ and call tzset() to compute a location's time. */
+static GHashTable *timezone_cache = NULL;
+
+static GTimeZone *
+clock_location_lookup_tz (const gchar *tzid)
 {
-        ClockLocationPrivate *priv = clock_location_get_instance_private (this);
+        GTimeZone *tz;
 
-        time_t now_t;
-        struct tm now;
+        if (timezone_cache == NULL)
+                timezone_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                        g_free,
+                                                        (GDestroyNotify) g_time_zone_unref);
 
-        if (priv->timezone == NULL) {
-                return;
+        tz = g_hash_table_lookup (timezone_cache, tzid);
+        if (tz == NULL) {
+                tz = g_time_zone_new (tzid);
+                g_hash_table_insert (timezone_cache, g_strdup (tzid), tz);
         }
 
-        setenv ("TZ", priv->timezone, 1);
-        tzset();
+        return g_time_zone_ref (tz);
+}
 
-        now_t = time (NULL);
-        localtime_r (&now_t, &now);
+static GDateTime *
+clock_location_now (ClockLocation *this)
+{
+        ClockLocationPrivate *priv = clock_location_get_instance_private (this);
 
-        if (now.tm_isdst > 0) {
-                clock_location_set_tzname (this, tzname[1]);
-        } else {
-                clock_location_set_tzname (this, tzname[0]);
-        }
+        if (priv->tz == NULL)
+                return g_date_time_new_now_local ();
+
+        return g_date_time_new_now (priv->tz);
 }
 
 static void
-clock_location_unset_tz (ClockLocation *this)
+clock_location_update_tzname (ClockLocation *this, GDateTime *now)
 {
         ClockLocationPrivate *priv = clock_location_get_instance_private (this);
-        const char *env_timezone;
 
-        if (priv->timezone == NULL) {
+        if (priv->tz == NULL)
                 return;
-        }
 
-        env_timezone = system_timezone_get_env (priv->systz);
+        clock_location_set_tzname (this, g_date_time_get_timezone_abbreviation (now));
+}
 
-        if (env_timezone) {
-                setenv ("TZ", env_timezone, 1);
-        } else {
-                unsetenv ("TZ");
-        }
-        tzset();
+static void
+clock_location_update_tz (ClockLocation *this)
+{
+        ClockLocationPrivate *priv = clock_location_get_instance_private (this);
+        GDateTime *now;
+
+        g_clear_pointer (&priv->tz, g_time_zone_unref);
+
+        if (priv->timezone == NULL)
+                return;
+
+        priv->tz = clock_location_lookup_tz (priv->timezone);
+
+        now = clock_location_now (this);
+        clock_location_update_tzname (this, now);
+        g_date_time_unref (now);
 }
 
 void
 clock_location_localtime (ClockLocation *loc, struct tm *tm)
 {
-        time_t now;
+        GDateTime *now;
 
-        clock_location_set_tz (loc);
+        now = clock_location_now (loc);
 
-        time (&now);
-        localtime_r (&now, tm);
+        memset (tm, 0, sizeof (struct tm));
+        tm->tm_sec = g_date_time_get_second (now);
+        tm->tm_min = g_date_time_get_minute (now);
+        tm->tm_hour = g_date_time_get_hour (now);
+        tm->tm_mday = g_date_time_get_day_of_month (now);
+        tm->tm_mon = g_date_time_get_month (now) - 1;
+        tm->tm_year = g_date_time_get_year (now) - 1900;
+        tm->tm_wday = g_date_time_get_day_of_week (now) % 7;
+        tm->tm_yday = g_date_time_get_day_of_year (now) - 1;
+        tm->tm_isdst = g_date_time_is_daylight_savings (now) ? 1 : 0;
 
-        clock_location_unset_tz (loc);
+        clock_location_update_tzname (loc, now);
+
+        g_date_time_unref (now);
 }
 
 gboolean
@@ -438,32 +466,22 @@ glong
 clock_location_get_offset (ClockLocation *loc)
 {
         ClockLocationPrivate *priv = clock_location_get_instance_private (loc);
-        glong sys_timezone, local_timezone;
+        GDateTime *sys_now, *loc_now;
         glong offset;
-        time_t t;
-        struct tm *tm;
-
-        t = time (NULL);
 
-        unsetenv ("TZ");
-        tm = localtime (&t);
-        sys_timezone = timezone;
+        if (priv->tz == NULL)
+                return 0;
 
-        if (tm->tm_isdst > 0) {
-                sys_timezone -= 3600;
-        }
+        /* both offsets are taken at the same instant, so a transition
+         * happening in between can not skew the result */
+        sys_now = g_date_time_new_now_local ();
+        loc_now = g_date_time_to_timezone (sys_now, priv->tz);
 
-        setenv ("TZ", priv->timezone, 1);
-        tm = localtime (&t);
-        local_timezone = timezone;
-
-        if (tm->tm_isdst > 0) {
-                local_timezone -= 3600;
-        }
+        offset = (g_date_time_get_utc_offset (sys_now) -
+                  g_date_time_get_utc_offset (loc_now)) / G_TIME_SPAN_SECOND;
 
-        offset = local_timezone - sys_timezone;
-
-        clock_location_unset_tz (loc);
+        g_date_time_unref (loc_now);
+        g_date_time_unref (sys_now);
 
         return offset;
 }
@@ -548,6 +566,7 @@ clock_location_make_current (ClockLocation *loc,
 
         filename = g_build_filename (SYSTEM_ZONEINFODIR, priv->timezone, NULL);
         set_system_timezone_async (filename,
+                                   NULL,
                                    (GFunc)make_current_cb,
                                    mcdata,
                                    free_make_current_data);
@@ -587,54 +606,64 @@ clock_location_get_weather_info (ClockLocation *loc)
 {
         ClockLocationPrivate *priv = clock_location_get_instance_private (loc);
 
-        return priv->weather_info;
+        if (priv->weather_source == NULL)
+                return NULL;
+
+        return priv->weather_source->info;
+}
+
+static WeatherSource *
+weather_source_ref (WeatherSource *source)
+{
+        source->ref_count++;
+
+        return source;
 }
 
 static void
-set_weather_update_timeout (ClockLocation *loc)
+weather_source_unref (WeatherSource *source)
 {
-        ClockLocationPrivate *priv = clock_location_get_instance_private (loc);
-        guint timeout;
+        if (--source->ref_count > 0)
+                return;
 
-        if (!weather_info_network_error (priv->weather_info)) {
-                /* The last update succeeded; set the next update to
-                 * happen in half an hour, and reset the retry timer.
-                 */
-                timeout = WEATHER_TIMEOUT_MAX;
-                priv->weather_retry_time = WEATHER_TIMEOUT_BASE;
-        } else {
-                /* The last update failed; set the next update
-                 * according to the retry timer, and exponentially
-                 * back off the retry timer.
-                 */
-                timeout = priv->weather_retry_time;
-                priv->weather_retry_time *= 2;
-                if (priv->weather_retry_time > WEATHER_TIMEOUT_MAX)
-                        priv->weather_retry_time = WEATHER_TIMEOUT_MAX;
-        }
+        if (source->timeout)
+                g_source_remove (source->timeout);
 
-        if (priv->weather_timeout)
-                g_source_remove (priv->weather_timeout);
-        priv->weather_timeout =
-                g_timeout_add_seconds (timeout, update_weather_info, loc);
+        if (source->info != NULL)
+                weather_info_free (source->info);
+        if (source->location != NULL)
+                weather_location_free (source->location);
+        g_free (source->key);
+        g_free (source);
 }
 
+static void set_weather_update_timeout (WeatherSource *source);
+
 static void
 weather_info_updated (WeatherInfo *info, gpointer data)
 {
-        ClockLocation *loc = data;
-        ClockLocationPrivate *priv = clock_location_get_instance_private (loc);
+        WeatherSource *source = data;
+        GSList *locations, *l;
+
+        source->has_data = TRUE;
+        set_weather_update_timeout (source);
+
+        /* handlers might drop locations, and with them the source */
+        weather_source_ref (source);
+        locations = g_slist_copy_deep (source->locations,
+                                       (GCopyFunc) g_object_ref, NULL);
 
-        set_weather_update_timeout (loc);
-        g_signal_emit (loc, location_signals[WEATHER_UPDATED],
-                       0, priv->weather_info);
+        for (l = locations; l; l = l->next)
+                g_signal_emit (l->data, location_signals[WEATHER_UPDATED],
+                               0, source->info);
+
+        g_slist_free_full (locations, g_object_unref);
+        weather_source_unref (source);
 }
 
-static gboolean
-update_weather_info (gpointer data)
+static void
+update_weather_info (WeatherSource *source)
 {
-        ClockLocation *loc = (ClockLocation *) data;
-        ClockLocationPrivate *priv = clock_location_get_instance_private (loc);
         WeatherPrefs prefs = {
                 FORECAST_STATE,
                 FALSE,
@@ -648,16 +677,161 @@ update_weather_info (gpointer data)
         /* set temperature and speed units only if different from
          * invalid/default
          */
-        if (priv->temperature_unit > TEMP_UNIT_DEFAULT)
-                prefs.temperature_unit = priv->temperature_unit;
-        if (priv->speed_unit > SPEED_UNIT_DEFAULT)
-                prefs.speed_unit = priv->speed_unit;
+        if (source->temperature_unit > TEMP_UNIT_DEFAULT)
+                prefs.temperature_unit = source->temperature_unit;
+        if (source->speed_unit > SPEED_UNIT_DEFAULT)
+                prefs.speed_unit = source->speed_unit;
+
+        if (source->info == NULL) {
+                /* this starts the first update right away */
+                source->info = weather_info_new (source->location, &prefs,
+                                                 weather_info_updated, source);
+                g_clear_pointer (&source->location, weather_location_free);
+
+                set_weather_update_timeout (source);
+                return;
+        }
 
-        weather_info_abort (priv->weather_info);
-        weather_info_update (priv->weather_info,
-                             &prefs, weather_info_updated, loc);
+        weather_info_abort (source->info);
+        weather_info_update (source->info,
+                             &prefs, weather_info_updated, source);
+}
 
-        return TRUE;
+static gboolean
+weather_queue_dispatch (gpointer data)
+{
+        WeatherSource *source;
+
+        weather_queue_id = 0;
+
+        source = g_queue_pop_head (&weather_queue);
+        if (source != NULL) {
+                source->queued = FALSE;
+                /* nobody is interested anymore */
+                if (source->locations != NULL)
+                        update_weather_info (source);
+                weather_source_unref (source);
+        }
+
+        if (!g_queue_is_empty (&weather_queue))
+                weather_queue_id = g_timeout_add_seconds (WEATHER_STAGGER,
+                                                          weather_queue_dispatch,
+                                                          NULL);
+
+        return G_SOURCE_REMOVE;
+}
+
+static void
+weather_source_queue_update (WeatherSource *source)
+{
+        if (source->queued)
+                return;
+
+        source->queued = TRUE;
+        g_queue_push_tail (&weather_queue, weather_source_ref (source));
+
+        if (weather_queue_id == 0)
+                weather_queue_id = g_idle_add (weather_queue_dispatch, NULL);
+}
+
+static gboolean
+weather_source_timeout (gpointer data)
+{
+        WeatherSource *source = data;
+
+        weather_source_queue_update (source);
+
+        /* keep polling at this pace until the update comes back and
+         * reschedules us */
+        return G_SOURCE_CONTINUE;
+}
+
+static void
+set_weather_update_timeout (WeatherSource *source)
+{
+        guint timeout;
+
+        if (!weather_info_network_error (source->info)) {
+                /* The last update succeeded; set the next update to
+                 * happen in half an hour, and reset the retry timer.
+                 */
+                timeout = WEATHER_TIMEOUT_MAX * weather_interval_scale;
+                source->retry_time = WEATHER_TIMEOUT_BASE;
+        } else {
+                /* The last update failed; set the next update
+                 * according to the retry timer, and exponentially
+                 * back off the retry timer.
+                 */
+                timeout = source->retry_time;
+                source->retry_time *= 2;
+                if (source->retry_time > WEATHER_TIMEOUT_MAX)
+                        source->retry_time = WEATHER_TIMEOUT_MAX;
+        }
+
+        if (source->timeout)
+                g_source_remove (source->timeout);
+        source->timeout =
+                g_timeout_add_seconds (timeout, weather_source_timeout, source);
+}
+
+/* Stretches the polling of the weather, for the power profiles that wake
+ * the computer up less often. Applies from the next update on. */
+void
+clock_location_set_weather_interval_scale (guint scale)
+{
+        weather_interval_scale = MAX (scale, 1);
+}
+
+static void
+network_changed (GNetworkMonitor *monitor,
+                 gboolean         available,
+                 gpointer         data)
+{
+        GHashTableIter iter;
+        gpointer value;
+
+        if (!available)
+                return;
+
+        g_hash_table_iter_init (&iter, weather_sources);
+        while (g_hash_table_iter_next (&iter, NULL, &value)) {
+                WeatherSource *source = value;
+
+                /* data fetched successfully is still current, its own
+                 * timeout will refresh it */
+                if (source->has_data &&
+                    !weather_info_network_error (source->info))
+                        continue;
+
+                source->retry_time = WEATHER_TIMEOUT_BASE;
+                weather_source_queue_update (source);
+        }
+}
+
+static void
+detach_weather_source (ClockLocation *loc)
+{
+        ClockLocationPrivate *priv = clock_location_get_instance_private (loc);
+        WeatherSource *source = priv->weather_source;
+
+        if (source == NULL)
+                return;
+
+        priv->weather_source = NULL;
+        source->locations = g_slist_remove (source->locations, loc);
+
+        if (source->locations != NULL)
+                return;
+
+        /* the table owns the reference of the source */
+        g_hash_table_remove (weather_sources, source->key);
+
+        if (g_hash_table_size (weather_sources) == 0) {
+                g_signal_handlers_disconnect_by_func (g_network_monitor_get_default (),
+                                                      G_CALLBACK (network_changed),
+                                                      NULL);
+                g_clear_pointer (&weather_sources, g_hash_table_destroy);
+        }
 }
 
 static gchar *
@@ -679,50 +853,83 @@ rad2dms (gfloat lat, gfloat lon)
                                 (int)deg2, (int)min2, h2);
 }
 
+static gboolean
+emit_weather_updated (gpointer data)
+{
+        ClockLocation *loc = data;
+        WeatherInfo *info;
+
+        info = clock_location_get_weather_info (loc);
+        if (info != NULL)
+                g_signal_emit (loc, location_signals[WEATHER_UPDATED],
+                               0, info);
+
+        return G_SOURCE_REMOVE;
+}
+
 static void
 setup_weather_updates (ClockLocation *loc)
 {
         ClockLocationPrivate *priv = clock_location_get_instance_private (loc);
-        WeatherLocation *wl;
-        WeatherPrefs prefs = {
-                FORECAST_STATE,
-                FALSE,
-                NULL,
-                TEMP_UNIT_CENTIGRADE,
-                SPEED_UNIT_MS,
-                PRESSURE_UNIT_MB,
-                DISTANCE_UNIT_KM
-        };
-
+        WeatherSource *source;
         gchar *dms;
+        gchar *key;
 
-        prefs.temperature_unit = priv->temperature_unit;
-        prefs.speed_unit = priv->speed_unit;
-
-        if (priv->weather_info) {
-                weather_info_free (priv->weather_info);
-                priv->weather_info = NULL;
-        }
-
-        if (priv->weather_timeout) {
-                g_source_remove (priv->weather_timeout);
-                priv->weather_timeout = 0;
-        }
+        detach_weather_source (loc);
 
         if (!priv->weather_code ||
             strcmp (priv->weather_code, WEATHER_EMPTY_CODE) == 0)
                 return;
 
         dms = rad2dms (priv->latitude, priv->longitude);
-        wl = weather_location_new (priv->city, priv->weather_code,
-                                   NULL, NULL, dms, NULL, NULL);
+        key = g_strdup_printf ("%s\n%s\n%s\n%d\n%d",
+                               priv->weather_code,
+                               priv->city ? priv->city : "",
+                               dms,
+                               priv->temperature_unit,
+                               priv->speed_unit);
+
+        if (weather_sources == NULL) {
+                weather_sources = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                         NULL,
+                                                         (GDestroyNotify) weather_source_unref);
+                g_signal_connect (g_network_monitor_get_default (), "network-changed",
+                                  G_CALLBACK (network_changed), NULL);
+        }
+
+        source = g_hash_table_lookup (weather_sources, key);
 
-        priv->weather_info =
-                weather_info_new (wl, &prefs, weather_info_updated, loc);
+        if (source != NULL) {
+                g_free (key);
+
+                /* the data is already there: tell the new location about
+                 * it once its owner had a chance to connect to us */
+                if (source->has_data)
+                        g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+                                         emit_weather_updated,
+                                         g_object_ref (loc),
+                                         g_object_unref);
+        } else {
+                source = g_new0 (WeatherSource, 1);
+                source->key = key;
+                source->ref_count = 1;
+                source->temperature_unit = priv->temperature_unit;
+                source->speed_unit = priv->speed_unit;
+                source->retry_time = WEATHER_TIMEOUT_BASE;
+
+                g_hash_table_insert (weather_sources, source->key, source);
+
+                /* the first fetch waits for its turn like the others */
+                source->location = weather_location_new (priv->city,
+                                                         priv->weather_code,
+                                                         NULL, NULL, dms,
+                                                         NULL, NULL);
+                weather_source_queue_update (source);
+        }
 
-        set_weather_update_timeout (loc);
+        source->locations = g_slist_prepend (source->locations, loc);
+        priv->weather_source = source;
 
-        weather_location_free (wl);
         g_free (dms);
 }
 
@@ -732,9 +939,13 @@ clock_location_set_weather_prefs (ClockLocation *loc,
 {
         ClockLocationPrivate *priv = clock_location_get_instance_private (loc);
 
+        if (priv->temperature_unit == prefs->temperature_unit &&
+            priv->speed_unit == prefs->speed_unit)
+                return;
+
         priv->temperature_unit = prefs->temperature_unit;
         priv->speed_unit = prefs->speed_unit;
 
-        update_weather_info (loc);
+        /* move to the source using the new units */
+        setup_weather_updates (loc);
 }
-
@@ -80,6 +80,8 @@ void         clock_location_set_weather_prefs (ClockLocation *loc,
 
 glong clock_location_get_offset (ClockLocation *loc);
 
+void  clock_location_set_weather_interval_scale (guint scale);
+
 #ifdef __cplusplus
 }
 #endif
@@ -10,6 +10,7 @@
 #include "clock.h"
 #include "clock-map.h"
 #include "clock-sunpos.h"
+#include "clock-utils.h"
 #include "clock-marshallers.h"
 
 enum {
@@ -50,6 +51,19 @@ typedef struct {
 
         /* The map with the shadow composited onto it */
         GdkPixbuf *shadow_map_pixbuf;
+
+        /* cos/sin of the latitude of each row and of the longitude of
+         * each column of the shadow */
+        gdouble *row_cos;
+        gdouble *row_sin;
+        gdouble *column_cos;
+        gdouble *column_sin;
+        gdouble *column_dot;
+
+        /* position of the sun when the shadow was last rendered */
+        gboolean shadow_valid;
+        gdouble  shadow_sun_lat;
+        gdouble  shadow_sun_lon;
 } ClockMapPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (ClockMap, clock_map, GTK_TYPE_WIDGET)
@@ -160,6 +174,12 @@ clock_map_finalize (GObject *g_obj)
         g_clear_object (&priv->shadow_pixbuf);
         g_clear_object (&priv->shadow_map_pixbuf);
 
+        g_clear_pointer (&priv->row_cos, g_free);
+        g_clear_pointer (&priv->row_sin, g_free);
+        g_clear_pointer (&priv->column_cos, g_free);
+        g_clear_pointer (&priv->column_sin, g_free);
+        g_clear_pointer (&priv->column_dot, g_free);
+
         G_OBJECT_CLASS (clock_map_parent_class)->finalize (g_obj);
 }
 
@@ -220,7 +240,8 @@ clock_map_draw (GtkWidget *this, cairo_t *cr)
 	width = gdk_pixbuf_get_width (priv->shadow_map_pixbuf);
 	height = gdk_pixbuf_get_height (priv->shadow_map_pixbuf);
 
-	gdk_cairo_set_source_pixbuf (cr, priv->shadow_map_pixbuf, 0, 0);
+	/* the map is drawn far more often than the shadow moves */
+	cairo_set_source_surface (cr, clock_utils_pixbuf_get_surface (priv->shadow_map_pixbuf), 0, 0);
 	cairo_rectangle (cr, 0, 0, width, height);
 	cairo_paint (cr);
 
@@ -455,79 +476,89 @@ clock_map_place_locations (ClockMap *this)
 #endif
 }
 
+/* The sun lights a point of the map when the dot product of the vectors
+ * pointing from the center of the earth to the point and to the sun is
+ * positive. Developed, it is:
+ *
+ *   cos(lat) cos(sun_lat) cos(lon - sun_lon) + sin(lat) sin(sun_lat)
+ *
+ * The latitude only depends on the row and the longitude on the column, so
+ * the trigonometry is done once per row and column rather than per pixel,
+ * leaving a multiply-add per pixel.
+ */
 static void
-clock_map_compute_vector (gdouble lat, gdouble lon, gdouble *vec)
+clock_map_compute_tables (ClockMapPrivate *priv)
 {
-        gdouble lat_rad, lon_rad;
-        lat_rad = lat * (M_PI/180.0);
-        lon_rad = lon * (M_PI/180.0);
-
-        vec[0] = sin(lon_rad) * cos(lat_rad);
-        vec[1] = sin(lat_rad);
-        vec[2] = cos(lon_rad) * cos(lat_rad);
-}
-
-static guchar
-clock_map_is_sunlit (gdouble pos_lat, gdouble pos_long,
-                         gdouble sun_lat, gdouble sun_long)
-{
-        gdouble pos_vec[3];
-        gdouble sun_vec[3];
-        gdouble dot;
+        int x, y;
 
-        /* twilight */
-        gdouble epsilon = 0.01;
+        g_free (priv->row_cos);
+        g_free (priv->row_sin);
+        g_free (priv->column_cos);
+        g_free (priv->column_sin);
+        g_free (priv->column_dot);
 
-        clock_map_compute_vector (pos_lat, pos_long, pos_vec);
-        clock_map_compute_vector (sun_lat, sun_long, sun_vec);
+        priv->row_cos = g_new (gdouble, priv->height);
+        priv->row_sin = g_new (gdouble, priv->height);
+        priv->column_cos = g_new (gdouble, priv->width);
+        priv->column_sin = g_new (gdouble, priv->width);
+        priv->column_dot = g_new (gdouble, priv->width);
 
-        /* compute the dot product of the two */
-        dot = pos_vec[0]*sun_vec[0] + pos_vec[1]*sun_vec[1]
-                + pos_vec[2]*sun_vec[2];
+        for (y = 0; y < priv->height; y++) {
+                gdouble lat = (priv->height / 2.0 - y) / (priv->height / 2.0) * 90.0;
 
-        if (dot > epsilon) {
-                return 0x00;
+                priv->row_cos[y] = cos (lat * (M_PI/180.0));
+                priv->row_sin[y] = sin (lat * (M_PI/180.0));
         }
 
-        if (dot < -epsilon) {
-                return 0xFF;
-        }
+        for (x = 0; x < priv->width; x++) {
+                gdouble lon = (x - priv->width / 2.0) / (priv->width / 2.0) * 180.0;
 
-        return (guchar)(-128 * ((dot / epsilon) - 1));
+                priv->column_cos[x] = cos (lon * (M_PI/180.0));
+                priv->column_sin[x] = sin (lon * (M_PI/180.0));
+        }
 }
 
 static void
-clock_map_render_shadow_pixbuf (GdkPixbuf *pixbuf)
+clock_map_render_shadow_pixbuf (ClockMapPrivate *priv,
+                                gdouble          sun_lat,
+                                gdouble          sun_lon)
 {
         int x, y;
-        int height, width;
         int n_channels, rowstride;
-        guchar *pixels, *p;
-        gdouble sun_lat, sun_lon;
-        time_t now = time (NULL);
-
-        n_channels = gdk_pixbuf_get_n_channels (pixbuf);
-        rowstride = gdk_pixbuf_get_rowstride (pixbuf);
-        pixels = gdk_pixbuf_get_pixels (pixbuf);
-
-        width = gdk_pixbuf_get_width (pixbuf);
-        height = gdk_pixbuf_get_height (pixbuf);
-
-        sun_position (now, &sun_lat, &sun_lon);
+        guchar *pixels;
+        gdouble sun_lat_cos, sun_lat_sin;
+        gdouble sun_lon_cos, sun_lon_sin;
 
-        for (y = 0; y < height; y++) {
-                gdouble lat = (height / 2.0 - y) / (height / 2.0) * 90.0;
-
-                for (x = 0; x < width; x++) {
-                        guchar shade;
-                        gdouble lon =
-                                (x - width / 2.0) / (width / 2.0) * 180.0;
-
-                        shade = clock_map_is_sunlit (lat, lon,
-                                                         sun_lat, sun_lon);
-
-                        p = pixels + y * rowstride + x * n_channels;
-                        p[3] = shade;
+        /* twilight */
+        const gdouble epsilon = 0.01;
+
+        n_channels = gdk_pixbuf_get_n_channels (priv->shadow_pixbuf);
+        rowstride = gdk_pixbuf_get_rowstride (priv->shadow_pixbuf);
+        pixels = gdk_pixbuf_get_pixels (priv->shadow_pixbuf);
+
+        sun_lat_cos = cos (sun_lat * (M_PI/180.0));
+        sun_lat_sin = sin (sun_lat * (M_PI/180.0));
+        sun_lon_cos = cos (sun_lon * (M_PI/180.0));
+        sun_lon_sin = sin (sun_lon * (M_PI/180.0));
+
+        /* cos(lon - sun_lon) for each column */
+        for (x = 0; x < priv->width; x++)
+                priv->column_dot[x] = priv->column_cos[x] * sun_lon_cos +
+                                      priv->column_sin[x] * sun_lon_sin;
+
+        for (y = 0; y < priv->height; y++) {
+                const gdouble *column_dot = priv->column_dot;
+                gdouble a = priv->row_cos[y] * sun_lat_cos;
+                gdouble b = priv->row_sin[y] * sun_lat_sin;
+                guchar *p = pixels + y * rowstride + 3;
+
+                /* no branches, so that the compiler can vectorize it:
+                 * fully lit above epsilon, fully dark below -epsilon */
+                for (x = 0; x < priv->width; x++) {
+                        gdouble dot = a * column_dot[x] + b;
+                        gdouble shade = -128.0 * (dot / epsilon - 1.0);
+
+                        p[x * n_channels] = (guchar) CLAMP (shade, 0.0, 255.0);
                 }
         }
 }
@@ -536,28 +567,54 @@ static void
 clock_map_render_shadow (ClockMap *this)
 {
         ClockMapPrivate *priv = clock_map_get_instance_private (this);
+        gdouble sun_lat, sun_lon;
 
-        if (priv->shadow_pixbuf) {
-                g_object_unref (priv->shadow_pixbuf);
-        }
+        if (!priv->location_map_pixbuf)
+                return;
 
-        priv->shadow_pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8,
-                                              priv->width, priv->height);
+        if (!priv->shadow_pixbuf ||
+            gdk_pixbuf_get_width (priv->shadow_pixbuf) != priv->width ||
+            gdk_pixbuf_get_height (priv->shadow_pixbuf) != priv->height) {
+                g_clear_object (&priv->shadow_pixbuf);
+                g_clear_object (&priv->shadow_map_pixbuf);
 
-        /* Initialize to all shadow */
-        gdk_pixbuf_fill (priv->shadow_pixbuf, 0x6d9ccdff);
+                priv->shadow_pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8,
+                                                      priv->width, priv->height);
 
-        clock_map_render_shadow_pixbuf (priv->shadow_pixbuf);
+                /* Initialize to all shadow */
+                gdk_pixbuf_fill (priv->shadow_pixbuf, 0x6d9ccdff);
 
-        if (priv->shadow_map_pixbuf) {
-                g_object_unref (priv->shadow_map_pixbuf);
+                priv->shadow_map_pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB,
+                                                          gdk_pixbuf_get_has_alpha (priv->location_map_pixbuf),
+                                                          8, priv->width, priv->height);
+
+                clock_map_compute_tables (priv);
+                priv->shadow_valid = FALSE;
         }
 
-        priv->shadow_map_pixbuf = gdk_pixbuf_copy (priv->location_map_pixbuf);
+        sun_position (time (NULL), &sun_lat, &sun_lon);
+
+        /* The terminator moves by about a quarter of a degree per minute:
+         * only render it again once it moved by half a pixel */
+        if (!priv->shadow_valid ||
+            fabs (sun_lat - priv->shadow_sun_lat) >= 90.0 / priv->height ||
+            fabs (sun_lon - priv->shadow_sun_lon) >= 180.0 / priv->width) {
+                clock_map_render_shadow_pixbuf (priv, sun_lat, sun_lon);
+
+                priv->shadow_valid = TRUE;
+                priv->shadow_sun_lat = sun_lat;
+                priv->shadow_sun_lon = sun_lon;
+        }
+
+        gdk_pixbuf_copy_area (priv->location_map_pixbuf,
+                              0, 0, priv->width, priv->height,
+                              priv->shadow_map_pixbuf, 0, 0);
 
         gdk_pixbuf_composite (priv->shadow_pixbuf, priv->shadow_map_pixbuf,
                               0, 0, priv->width, priv->height,
                               0, 0, 1, 1, GDK_INTERP_NEAREST, 0x66);
+
+        clock_utils_pixbuf_changed (priv->shadow_map_pixbuf);
 }
 
 static void
@@ -120,12 +120,12 @@ greenwich_sidereal_time (gdouble unix_time)
   return T0;
 }
 
-/* Calculate the position of the sun at a given time.  pages 89-91 */
-void
-sun_position (time_t unix_time, gdouble *lat, gdouble *lon)
+/* Calculate the equatorial coordinates of the sun at a given time.
+ * pages 89-91 */
+static void
+compute_equatorial_position (time_t unix_time, gdouble *ra, gdouble *dec)
 {
   gdouble jd, D, N, M, E, x, v, lambda;
-  gdouble ra, dec;
   jd = unix_time_to_julian_date (unix_time);
 
   /* Calculate number of days since the epoch */
@@ -158,8 +158,39 @@ sun_position (time_t unix_time, gdouble *lat, gdouble *lon)
   NORMALIZE (lambda);
 
   /* convert the ecliptic longitude to right ascension and declination */
-  ecliptic_to_equatorial (DEG_TO_RADS (lambda), 0.0, &ra, &dec);
+  ecliptic_to_equatorial (DEG_TO_RADS (lambda), 0.0, ra, dec);
+}
+
+/* The right ascension and declination of the sun move by less than an
+ * arc second per minute: the series is evaluated once per minute and
+ * shared by all the callers of the process. */
+void
+sun_equatorial_position (time_t unix_time, gdouble *ra, gdouble *dec)
+{
+  static time_t  cached_minute = -1;
+  static gdouble cached_ra, cached_dec;
+  time_t minute;
+
+  minute = unix_time / 60;
+  if (minute != cached_minute)
+    {
+      compute_equatorial_position (minute * 60, &cached_ra, &cached_dec);
+      cached_minute = minute;
+    }
+
+  *ra = cached_ra;
+  *dec = cached_dec;
+}
+
+/* Calculate the position of the sun at a given time.  pages 89-91 */
+void
+sun_position (time_t unix_time, gdouble *lat, gdouble *lon)
+{
+  gdouble ra, dec;
+
+  sun_equatorial_position (unix_time, &ra, &dec);
 
+  /* only the rotation of the earth needs the exact time */
   ra = ra - (G_PI/12) * greenwich_sidereal_time (unix_time);
   ra = RADS_TO_DEG (ra);
   dec = RADS_TO_DEG (dec);
@@ -3,6 +3,8 @@
 
 #include <glib.h>
 
+/* right ascension and declination of the sun, in radians */
+void sun_equatorial_position(time_t unix_time, gdouble *ra, gdouble *dec);
 void sun_position(time_t unix_time, gdouble *lat, gdouble *lon);
 
 #endif
@@ -0,0 +1,199 @@
+/*
+ * clock-ticker.c: wakes up all the clocks of the process at once
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/* All the clocks in the process share a single timeout, armed for the
+ * next wall-clock second or minute boundary depending on what the
+ * subscribers need. Each subscriber is called once per boundary of its
+ * own granularity.
+ */
+
+#include <config.h>
+
+#include "clock-ticker.h"
+
+/* wake up slightly after the boundary, so that time() already returns
+ * the new value */
+#define CLOCK_TICKER_SLACK_MS 2
+
+typedef struct {
+        guint                id;
+        ClockTickGranularity granularity;
+        ClockTickFunc        func;
+        gpointer             user_data;
+        gint64               last_period;
+} ClockTicker;
+
+static GList *tickers = NULL;
+static guint  next_id = 1;
+static guint  source_id = 0;
+
+static void clock_ticker_arm (void);
+
+static gint64
+granularity_to_seconds (ClockTickGranularity granularity)
+{
+        return granularity == CLOCK_TICK_SECOND ? 1 : 60;
+}
+
+static gint64
+get_period (ClockTicker *ticker,
+            gint64       now)
+{
+        return now / G_USEC_PER_SEC / granularity_to_seconds (ticker->granularity);
+}
+
+static ClockTicker *
+find_ticker (guint id)
+{
+        GList *l;
+
+        for (l = tickers; l; l = l->next) {
+                ClockTicker *ticker = l->data;
+
+                if (ticker->id == id)
+                        return ticker;
+        }
+
+        return NULL;
+}
+
+static gboolean
+clock_ticker_timeout (gpointer data)
+{
+        GList  *ids, *l;
+        gint64  now;
+
+        source_id = 0;
+
+        now = g_get_real_time ();
+
+        /* subscribers can (un)subscribe from their callback */
+        ids = NULL;
+        for (l = tickers; l; l = l->next)
+                ids = g_list_prepend (ids, GUINT_TO_POINTER (((ClockTicker *) l->data)->id));
+        ids = g_list_reverse (ids);
+
+        for (l = ids; l; l = l->next) {
+                ClockTicker *ticker;
+                gint64       period;
+
+                ticker = find_ticker (GPOINTER_TO_UINT (l->data));
+                if (!ticker)
+                        continue;
+
+                period = get_period (ticker, now);
+                if (period == ticker->last_period)
+                        continue;
+
+                ticker->last_period = period;
+                ticker->func (ticker->user_data);
+        }
+
+        g_list_free (ids);
+
+        if (source_id == 0)
+                clock_ticker_arm ();
+
+        return FALSE;
+}
+
+static void
+clock_ticker_arm (void)
+{
+        ClockTickGranularity granularity = CLOCK_TICK_MINUTE;
+        GList  *l;
+        gint64  now;
+        gint64  period;
+        gint64  next;
+        guint   delay;
+
+        if (source_id)
+                g_source_remove (source_id);
+        source_id = 0;
+
+        if (!tickers)
+                return;
+
+        for (l = tickers; l; l = l->next) {
+                ClockTicker *ticker = l->data;
+
+                if (ticker->granularity == CLOCK_TICK_SECOND)
+                        granularity = CLOCK_TICK_SECOND;
+        }
+
+        now = g_get_real_time ();
+        period = granularity_to_seconds (granularity) * G_USEC_PER_SEC;
+        next = (now / period + 1) * period;
+        delay = (next - now + 999) / 1000 + CLOCK_TICKER_SLACK_MS;
+
+        source_id = g_timeout_add (delay, clock_ticker_timeout, NULL);
+        g_source_set_name_by_id (source_id, "[clock] clock_ticker_timeout");
+}
+
+guint
+clock_ticker_subscribe (ClockTickGranularity  granularity,
+                        ClockTickFunc         func,
+                        gpointer              user_data)
+{
+        ClockTicker *ticker;
+
+        g_return_val_if_fail (func != NULL, 0);
+
+        ticker = g_new0 (ClockTicker, 1);
+        ticker->id = next_id++;
+        ticker->granularity = granularity;
+        ticker->func = func;
+        ticker->user_data = user_data;
+        ticker->last_period = get_period (ticker, g_get_real_time ());
+
+        tickers = g_list_append (tickers, ticker);
+
+        clock_ticker_arm ();
+
+        return ticker->id;
+}
+
+void
+clock_ticker_unsubscribe (guint id)
+{
+        ClockTicker *ticker;
+
+        ticker = find_ticker (id);
+        if (!ticker)
+                return;
+
+        tickers = g_list_remove (tickers, ticker);
+        g_free (ticker);
+
+        if (!tickers && source_id) {
+                g_source_remove (source_id);
+                source_id = 0;
+        }
+}
+
+/* Timeouts use the monotonic clock: call this when the wall clock jumped
+ * (time change, resume from suspend) to wake up at the right time again.
+ */
+void
+clock_ticker_resync (void)
+{
+        clock_ticker_arm ();
+}
@@ -0,0 +1,48 @@
+/*
+ * clock-ticker.h
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __CLOCK_TICKER_H__
+#define __CLOCK_TICKER_H__
+
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	CLOCK_TICK_SECOND,
+	CLOCK_TICK_MINUTE
+} ClockTickGranularity;
+
+typedef void (*ClockTickFunc) (gpointer user_data);
+
+guint clock_ticker_subscribe   (ClockTickGranularity  granularity,
+				ClockTickFunc         func,
+				gpointer              user_data);
+void  clock_ticker_unsubscribe (guint                 id);
+void  clock_ticker_resync      (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CLOCK_TICKER_H__ */
@@ -124,3 +124,29 @@ clock_utils_display_help (GtkWidget  *widget,
 		gtk_widget_show (dialog);
 	}
 }
+
+#define CLOCK_UTILS_SURFACE_KEY "clock-utils-surface"
+
+/* The surface a pixbuf painted over and over converts to, made once and
+ * kept with the pixbuf until clock_utils_pixbuf_changed() is called */
+cairo_surface_t *
+clock_utils_pixbuf_get_surface (GdkPixbuf *pixbuf)
+{
+	cairo_surface_t *surface;
+
+	surface = g_object_get_data (G_OBJECT (pixbuf), CLOCK_UTILS_SURFACE_KEY);
+	if (surface)
+		return surface;
+
+	surface = gdk_cairo_surface_create_from_pixbuf (pixbuf, 1, NULL);
+	g_object_set_data_full (G_OBJECT (pixbuf), CLOCK_UTILS_SURFACE_KEY,
+				surface, (GDestroyNotify) cairo_surface_destroy);
+
+	return surface;
+}
+
+void
+clock_utils_pixbuf_changed (GdkPixbuf *pixbuf)
+{
+	g_object_set_data (G_OBJECT (pixbuf), CLOCK_UTILS_SURFACE_KEY, NULL);
+}
@@ -50,6 +50,9 @@ void clock_utils_display_help (GtkWidget  *widget,
 			       const char *doc_id,
 			       const char *link_id);
 
+cairo_surface_t *clock_utils_pixbuf_get_surface (GdkPixbuf *pixbuf);
+void             clock_utils_pixbuf_changed     (GdkPixbuf *pixbuf);
+
 #ifdef __cplusplus
 }
 #endif
@@ -70,6 +70,7 @@
 #include "clock-location.h"
 #include "clock-location-tile.h"
 #include "clock-map.h"
+#include "clock-ticker.h"
 #include "clock-utils.h"
 #include "set-timezone.h"
 #include "system-timezone.h"
@@ -127,6 +128,7 @@ struct _ClockData {
 
         GtkWidget *props;
         GtkWidget *calendar_popup;
+        guint      calendar_prewarm_id;
 
         GtkWidget *clock_vbox;
         GtkSizeGroup *clock_group;
@@ -153,11 +155,14 @@ struct _ClockData {
 
         GtkListStore *cities_store;
         GtkWidget *cities_section;
+        GtkWidget *cities_box;
         GtkWidget *map_widget;
 
         /* Window to set the time */
         GtkWidget *set_time_window;
         GtkWidget *current_time_label;
+        /* set while the time is being set */
+        GCancellable *set_time_cancellable;
 
         /* preferences */
         ClockFormat  format;
@@ -178,7 +183,10 @@ struct _ClockData {
         /* runtime data */
         time_t             current_time;
         char              *timeformat;
+        char              *clock_text;        /* what clockw shows */
         guint              timeout;
+        guint              ticker;
+        ClockTickGranularity ticker_granularity;
         MatePanelAppletOrient  orient;
         int                size;
         GtkAllocation      old_allocation;
@@ -188,6 +196,14 @@ struct _ClockData {
         int fixed_width;
         int fixed_height;
 
+        /* text extents measured for the current style of panel_button,
+         * see calculate_minimum_width() and calculate_minimum_height() */
+        GtkStateFlags         extents_state;
+        char                 *min_width_text;
+        int                   min_width;
+        MatePanelAppletOrient min_height_orient;
+        int                   min_height;
+
         GtkWidget *showseconds_check;
         GtkWidget *showdate_check;
         GtkWidget *showweeks_check;
@@ -212,9 +228,11 @@ static int clock_numbers = 0;
 */
 
 static void  update_clock (ClockData * cd);
+static void  update_clock_full (ClockData *cd, gboolean force);
 static void  update_tooltip (ClockData * cd);
 static void  update_panel_weather (ClockData *cd);
 static int   clock_timeout_callback (gpointer data);
+static void  clock_tick             (ClockData *cd);
 static float get_itime    (time_t current_time);
 
 static void set_atk_name_description (GtkWidget *widget,
@@ -268,9 +286,30 @@ unfix_size (ClockData *cd)
         gtk_widget_queue_resize (cd->panel_button);
 }
 
+/* The font, the scale and the padding all come from the style of the
+ * button: drop the measurements when it changes */
+static void
+clock_invalidate_extents (ClockData *cd)
+{
+        g_clear_pointer (&cd->min_width_text, g_free);
+        cd->min_height = -1;
+}
+
+static void
+clock_check_extents_state (ClockData *cd)
+{
+        GtkStateFlags state;
+
+        state = gtk_widget_get_state_flags (cd->panel_button);
+        if (state != cd->extents_state) {
+                clock_invalidate_extents (cd);
+                cd->extents_state = state;
+        }
+}
+
 static int
-calculate_minimum_width (GtkWidget   *widget,
-                         const gchar *text)
+measure_minimum_width (GtkWidget   *widget,
+                       const gchar *text)
 {
         PangoContext    *pango_context;
         PangoLayout     *layout;
@@ -296,14 +335,31 @@ calculate_minimum_width (GtkWidget   *widget,
         return width;
 }
 
+static void
+clock_unset_timeout (ClockData *cd)
+{
+        if (cd->timeout)
+                g_source_remove (cd->timeout);
+        cd->timeout = 0;
+
+        if (cd->ticker)
+                clock_ticker_unsubscribe (cd->ticker);
+        cd->ticker = 0;
+}
+
 static void
 clock_set_timeout (ClockData *cd,
                    time_t     now)
 {
-        int timeouttime;
+        ClockTickGranularity granularity;
 
         if (cd->format == CLOCK_FORMAT_INTERNET) {
                 int itime_ms;
+                int timeouttime;
+
+                if (cd->ticker)
+                        clock_ticker_unsubscribe (cd->ticker);
+                cd->ticker = 0;
 
                 itime_ms = ((unsigned int) (get_itime (now) * 1000));
 
@@ -315,28 +371,38 @@ clock_set_timeout (ClockData *cd,
                         itime_ms += (tv.tv_usec * 86.4) / 1000;
                         timeouttime = ((999 - itime_ms % 1000) * 86.4) / 100 + 1;
                 }
-        } else {
-                 struct timeval tv;
 
-                gettimeofday (&tv, NULL);
-                 timeouttime = (G_USEC_PER_SEC - tv.tv_usec)/1000+20;
+                cd->timeout = g_timeout_add (timeouttime,
+                                             clock_timeout_callback,
+                                             cd);
+                return;
+        }
+
+        /* Other formats follow the wall clock: share the ticks of all the
+         * clocks of the process, once per minute if we don't care about
+         * the seconds */
+        if (cd->format != CLOCK_FORMAT_UNIX &&
+            !cd->showseconds &&
+            (!cd->set_time_window || !gtk_widget_get_visible (cd->set_time_window)))
+                granularity = CLOCK_TICK_MINUTE;
+        else
+                granularity = CLOCK_TICK_SECOND;
 
-                /* timeout of one minute if we don't care about the seconds */
-                 if (cd->format != CLOCK_FORMAT_UNIX &&
-                    !cd->showseconds &&
-                    (!cd->set_time_window || !gtk_widget_get_visible (cd->set_time_window)))
-                         timeouttime += 1000 * (59 - now % 60);
-         }
+        if (cd->ticker && cd->ticker_granularity == granularity)
+                return;
 
-        cd->timeout = g_timeout_add (timeouttime,
-                                     clock_timeout_callback,
-                                     cd);
+        if (cd->ticker)
+                clock_ticker_unsubscribe (cd->ticker);
+
+        cd->ticker_granularity = granularity;
+        cd->ticker = clock_ticker_subscribe (granularity,
+                                             (ClockTickFunc) clock_tick,
+                                             cd);
 }
 
-static int
-clock_timeout_callback (gpointer data)
+static void
+clock_tick (ClockData *cd)
 {
-        ClockData *cd = data;
         time_t new_time;
 
         time (&new_time);
@@ -348,17 +414,26 @@ clock_timeout_callback (gpointer data)
                 if (cd->format == CLOCK_FORMAT_INTERNET &&
                     (unsigned int)get_itime (new_time) !=
                     (unsigned int)get_itime (cd->current_time)) {
-                        update_clock (cd);
+                        update_clock_full (cd, FALSE);
                 } else if ((cd->format == CLOCK_FORMAT_12 ||
                             cd->format == CLOCK_FORMAT_24) &&
                            new_time / 60 != cd->current_time / 60) {
-                        update_clock (cd);
+                        update_clock_full (cd, FALSE);
                 }
         } else {
-                update_clock (cd);
+                update_clock_full (cd, FALSE);
         }
 
         clock_set_timeout (cd, new_time);
+}
+
+static int
+clock_timeout_callback (gpointer data)
+{
+        ClockData *cd = data;
+
+        cd->timeout = 0;
+        clock_tick (cd);
 
         return FALSE;
 }
@@ -378,10 +453,25 @@ get_itime (time_t current_time)
         return itime;
 }
 
+static int
+calculate_minimum_width (ClockData   *cd,
+                         const gchar *text)
+{
+        clock_check_extents_state (cd);
+
+        if (g_strcmp0 (text, cd->min_width_text) != 0) {
+                g_free (cd->min_width_text);
+                cd->min_width_text = g_strdup (text);
+                cd->min_width = measure_minimum_width (cd->panel_button, text);
+        }
+
+        return cd->min_width;
+}
+
 /* adapted from panel-toplevel.c */
 static int
-calculate_minimum_height (GtkWidget        *widget,
-                          MatePanelAppletOrient orientation)
+measure_minimum_height (GtkWidget            *widget,
+                        MatePanelAppletOrient orientation)
 {
         GtkStateFlags    state;
         GtkStyleContext *style_context;
@@ -420,10 +510,24 @@ calculate_minimum_height (GtkWidget        *widget,
         return PANGO_PIXELS (ascent + descent) + thickness;
 }
 
+static int
+calculate_minimum_height (ClockData *cd)
+{
+        clock_check_extents_state (cd);
+
+        if (cd->min_height < 0 || cd->min_height_orient != cd->orient) {
+                cd->min_height = measure_minimum_height (cd->panel_button,
+                                                         cd->orient);
+                cd->min_height_orient = cd->orient;
+        }
+
+        return cd->min_height;
+}
+
 static gboolean
 use_two_line_format (ClockData *cd)
 {
-        if (cd->size >= 2 * calculate_minimum_height (cd->panel_button, cd->orient))
+        if (cd->size >= 2 * calculate_minimum_height (cd))
                 return TRUE;
 
         return FALSE;
@@ -516,13 +620,20 @@ update_timeformat (ClockData *cd)
         cd->timeformat = get_updated_timeformat (cd);
 }
 
-/* sets accessible name and description for the widget */
+/* sets accessible name and description for the widget, unless no
+ * assistive technology would read them: a11y_enabled_changed() sets
+ * them once one shows up */
 static void
 set_atk_name_description (GtkWidget  *widget,
                           const char *name,
                           const char *desc)
 {
         AtkObject *obj;
+
+        if (MATE_PANEL_IS_APPLET (widget) &&
+            !mate_panel_applet_get_a11y_enabled (MATE_PANEL_APPLET (widget)))
+                return;
+
         obj = gtk_widget_get_accessible (widget);
 
         /* return if gail is not loaded */
@@ -608,8 +719,10 @@ format_time_24 (ClockData *cd)
         return g_locale_to_utf8 (buf, -1, NULL, NULL, NULL);
 }
 
+/* When @force is FALSE the panel label, its accessible name and the
+ * tooltip are only touched if the rendered string changed */
 static void
-update_clock (ClockData * cd)
+update_clock_full (ClockData *cd, gboolean force)
 {
         gboolean use_markup;
         char *utf8, *text;
@@ -617,30 +730,44 @@ update_clock (ClockData * cd)
         time (&cd->current_time);
         utf8 = format_time (cd);
 
-        use_markup = FALSE;
-        if (pango_parse_markup (utf8, -1, 0, NULL, &text, NULL, NULL))
-                use_markup = TRUE;
-        else
-                text = g_strdup (utf8);
+        if (!force && g_strcmp0 (utf8, cd->clock_text) == 0) {
+                g_free (utf8);
 
-        if (use_markup)
-                gtk_label_set_markup (GTK_LABEL (cd->clockw), utf8);
-        else
-                gtk_label_set_text (GTK_LABEL (cd->clockw), utf8);
+                /* the date in the tooltip is not necessarily in the label */
+                if (!cd->showdate)
+                        update_tooltip (cd);
+        } else {
+                use_markup = FALSE;
+                if (pango_parse_markup (utf8, -1, 0, NULL, &text, NULL, NULL))
+                        use_markup = TRUE;
+                else
+                        text = g_strdup (utf8);
 
-        set_atk_name_description (cd->applet, text, NULL);
+                if (use_markup)
+                        gtk_label_set_markup (GTK_LABEL (cd->clockw), utf8);
+                else
+                        gtk_label_set_text (GTK_LABEL (cd->clockw), utf8);
 
-        g_free (utf8);
-        g_free (text);
+                set_atk_name_description (cd->applet, text, NULL);
 
-        update_orient (cd);
-        gtk_widget_queue_resize (cd->panel_button);
+                g_free (cd->clock_text);
+                cd->clock_text = utf8;
+                g_free (text);
 
-        update_tooltip (cd);
-        update_location_tiles (cd);
+                update_orient (cd);
+                gtk_widget_queue_resize (cd->panel_button);
+
+                update_tooltip (cd);
+        }
 
-        if (cd->map_widget && cd->calendar_popup && gtk_widget_get_visible (cd->calendar_popup))
-                clock_map_update_time (CLOCK_MAP (cd->map_widget));
+        /* the popup is kept around when hidden: only keep it up to date
+         * while it is shown */
+        if (cd->calendar_popup && gtk_widget_get_visible (cd->calendar_popup)) {
+                update_location_tiles (cd);
+
+                if (cd->map_widget)
+                        clock_map_update_time (CLOCK_MAP (cd->map_widget));
+        }
 
         if (cd->current_time_label &&
             gtk_widget_get_visible (cd->current_time_label)) {
@@ -650,6 +777,12 @@ update_clock (ClockData * cd)
         }
 }
 
+static void
+update_clock (ClockData * cd)
+{
+        update_clock_full (cd, TRUE);
+}
+
 static void
 update_tooltip (ClockData * cd)
 {
@@ -696,7 +829,7 @@ update_tooltip (ClockData * cd)
 
                 g_free (utf8);
         } else {
-                if (cd->calendar_popup)
+                if (cd->calendar_popup && gtk_widget_get_visible (cd->calendar_popup))
                         tip = _("Click to hide month calendar");
                 else
                         tip = _("Click to view month calendar");
@@ -727,8 +860,7 @@ refresh_clock_timeout(ClockData *cd)
 
         update_timeformat (cd);
 
-        if (cd->timeout)
-                g_source_remove (cd->timeout);
+        clock_unset_timeout (cd);
 
         update_clock (cd);
 
@@ -742,9 +874,8 @@ refresh_clock_timeout(ClockData *cd)
 static void
 refresh_click_timeout_time_only (ClockData *cd)
 {
-        if (cd->timeout)
-                g_source_remove (cd->timeout);
-        clock_timeout_callback (cd);
+        clock_unset_timeout (cd);
+        clock_tick (cd);
 }
 
 static void
@@ -780,9 +911,16 @@ destroy_clock (GtkWidget * widget, ClockData *cd)
                 g_object_unref (cd->settings);
         cd->settings = NULL;
 
-        if (cd->timeout)
-                g_source_remove (cd->timeout);
-        cd->timeout = 0;
+        clock_unset_timeout (cd);
+
+        /* the callback does not touch cd once cancelled */
+        if (cd->set_time_cancellable)
+                g_cancellable_cancel (cd->set_time_cancellable);
+        g_clear_object (&cd->set_time_cancellable);
+
+        if (cd->calendar_prewarm_id)
+                g_source_remove (cd->calendar_prewarm_id);
+        cd->calendar_prewarm_id = 0;
 
         if (cd->props)
                 gtk_widget_destroy (cd->props);
@@ -793,6 +931,8 @@ destroy_clock (GtkWidget * widget, ClockData *cd)
         cd->calendar_popup = NULL;
 
         g_free (cd->timeformat);
+        g_free (cd->clock_text);
+        g_free (cd->min_width_text);
 
         g_free (cd->custom_format);
 
@@ -1119,16 +1259,80 @@ create_clock_window (ClockData *cd)
                                cd->clock_group);
 }
 
+/* The sort keys of a location, computed once before sorting instead of
+ * in the comparisons, where the local time of a location would be asked
+ * for O(n log n) times */
+typedef struct {
+        ClockLocation *location;
+        gint64         time;  /* local time, as YYYYMMDDhhmmss */
+        const char    *name;
+} LocationSortKey;
+
+static gint
+sort_locations_by_name (gconstpointer a, gconstpointer b, gpointer data)
+{
+        const LocationSortKey *key_a = a;
+        const LocationSortKey *key_b = b;
+
+        return strcmp (key_a->name, key_b->name);
+}
+
 static gint
-sort_locations_by_name (gconstpointer a, gconstpointer b)
+sort_locations_by_time_reverse_and_name (gconstpointer a, gconstpointer b, gpointer data)
 {
-        ClockLocation *loc_a = (ClockLocation *) a;
-        ClockLocation *loc_b = (ClockLocation *) b;
+        const LocationSortKey *key_a = a;
+        const LocationSortKey *key_b = b;
+
+        if (key_a->time != key_b->time)
+                return key_a->time < key_b->time ? 1 : -1;
+
+        return g_strcmp0 (key_a->name, key_b->name);
+}
+
+/* Returns a sorted copy of locations. by_time sorts the latest local time
+ * first, then by city; otherwise, by display name. */
+static GSList *
+sort_locations (GSList   *locations,
+                gboolean  by_time)
+{
+        LocationSortKey *keys;
+        GSList          *l;
+        GSList          *sorted = NULL;
+        gint             n, i;
+
+        n = g_slist_length (locations);
+        keys = g_new (LocationSortKey, n);
+
+        for (l = locations, i = 0; l; l = l->next, i++) {
+                ClockLocation *loc = l->data;
+
+                keys[i].location = loc;
+                if (by_time) {
+                        struct tm tm;
+
+                        clock_location_localtime (loc, &tm);
+                        keys[i].time = (((((gint64) tm.tm_year * 100 + tm.tm_mon) * 100 +
+                                          tm.tm_mday) * 100 + tm.tm_hour) * 100 +
+                                        tm.tm_min) * 100 + tm.tm_sec;
+                        keys[i].name = clock_location_get_city (loc);
+                } else {
+                        keys[i].time = 0;
+                        keys[i].name = clock_location_get_display_name (loc);
+                }
+        }
+
+        /* stable, like the g_slist_sort() this replaces */
+        g_qsort_with_data (keys, n, sizeof (LocationSortKey),
+                           by_time ? sort_locations_by_time_reverse_and_name :
+                                     sort_locations_by_name,
+                           NULL);
+
+        for (i = n - 1; i >= 0; i--)
+                sorted = g_slist_prepend (sorted, keys[i].location);
 
-        const char *name_a = clock_location_get_display_name (loc_a);
-        const char *name_b = clock_location_get_display_name (loc_b);
+        g_free (keys);
 
-        return strcmp (name_a, name_b);
+        return sorted;
 }
 
 static void
@@ -1150,8 +1354,7 @@ create_cities_store (ClockData *cd)
                                                G_TYPE_STRING,                /* COL_CITY_TZ */
                                                CLOCK_LOCATION_TYPE);         /* COL_CITY_LOC */
 
-        list = g_slist_copy (cities);
-        list = g_slist_sort (list, sort_locations_by_name);
+        list = sort_locations (cities, FALSE);
 
         for (l = list; l; l = l->next) {
                 ClockLocation *loc = CLOCK_LOCATION (l->data);
@@ -1173,56 +1376,6 @@ create_cities_store (ClockData *cd)
         }
 }
 
-static gint
-sort_locations_by_time (gconstpointer a, gconstpointer b)
-{
-        ClockLocation *loc_a = (ClockLocation *) a;
-        ClockLocation *loc_b = (ClockLocation *) b;
-
-        struct tm tm_a;
-        struct tm tm_b;
-        gint ret;
-
-        clock_location_localtime (loc_a, &tm_a);
-        clock_location_localtime (loc_b, &tm_b);
-
-        ret = tm_a.tm_year - tm_b.tm_year;
-        if (! ret)
-                ret = tm_a.tm_mon - tm_b.tm_mon;
-        if (! ret)
-                ret = tm_a.tm_mday - tm_b.tm_mday;
-        if (! ret)
-                ret = tm_a.tm_hour - tm_b.tm_hour;
-        if (! ret)
-                ret = tm_a.tm_min - tm_b.tm_min;
-        if (! ret)
-                ret = tm_a.tm_sec - tm_b.tm_sec;
-
-        return ret;
-}
-
-static gint
-sort_locations_by_time_reverse (gconstpointer a, gconstpointer b)
-{
-        return sort_locations_by_time (b, a);
-}
-
-static gint
-sort_locations_by_time_reverse_and_name (gconstpointer a, gconstpointer b)
-{
-        gint ret;
-
-        ret = sort_locations_by_time_reverse (a, b);
-        if (ret == 0) {
-                ClockLocation *loc_a = (ClockLocation *) a;
-                ClockLocation *loc_b = (ClockLocation *) b;
-
-                ret = g_strcmp0 (clock_location_get_city (loc_a),
-                                 clock_location_get_city (loc_b));
-        }
-        return ret;
-}
-
 static void
 location_tile_pressed_cb (ClockLocationTile *tile, gpointer data)
 {
@@ -1247,68 +1400,91 @@ location_tile_need_clock_format_cb(ClockLocationTile *tile, gpointer data)
 static void
 create_cities_section (ClockData *cd)
 {
-        GtkWidget *cities_box;
+        GHashTable *tiles;
+        GHashTableIter iter;
+        gpointer tile;
         GSList *node;
-        GSList *cities;
         GSList *l;
+        gint position;
 
-        if (cd->cities_section) {
-                gtk_widget_destroy (cd->cities_section);
-                cd->cities_section = NULL;
-        }
+        if (!cd->cities_section) {
+                cd->cities_section = gtk_scrolled_window_new (NULL, NULL);
+                gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (cd->cities_section),
+                                                GTK_POLICY_NEVER,
+                                                GTK_POLICY_AUTOMATIC);
+                gtk_scrolled_window_set_shadow_type (GTK_SCROLLED_WINDOW (cd->cities_section),
+                                                     GTK_SHADOW_NONE);
+                gtk_scrolled_window_set_propagate_natural_height (GTK_SCROLLED_WINDOW (cd->cities_section),
+                                                                  TRUE);
 
-        if (cd->location_tiles)
-                g_slist_free (cd->location_tiles);
-        cd->location_tiles = NULL;
+                cd->cities_box = gtk_box_new (GTK_ORIENTATION_VERTICAL, 6);
 
-        cd->cities_section = gtk_scrolled_window_new (NULL, NULL);
-        gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (cd->cities_section),
-                                        GTK_POLICY_NEVER,
-                                        GTK_POLICY_AUTOMATIC);
-        gtk_scrolled_window_set_shadow_type (GTK_SCROLLED_WINDOW (cd->cities_section),
-                                             GTK_SHADOW_NONE);
-        gtk_scrolled_window_set_propagate_natural_height (GTK_SCROLLED_WINDOW (cd->cities_section),
-                                                          TRUE);
+                gtk_container_add (GTK_CONTAINER (cd->cities_section), cd->cities_box);
 
-        cities_box = gtk_box_new (GTK_ORIENTATION_VERTICAL, 6);
-
-        cities = cd->locations;
-        if (g_slist_length (cities) == 0) {
-                /* if the list is empty, don't bother showing the
-                   cities section */
-                gtk_widget_hide (cd->cities_section);
-                return;
+                gtk_box_pack_end (GTK_BOX (cd->clock_vbox),
+                                  cd->cities_section, FALSE, FALSE, 0);
         }
 
-        /* Copy the existing list, so we can sort it nondestructively */
-        node = g_slist_copy (cities);
-        node = g_slist_sort (node, sort_locations_by_time_reverse_and_name);
+        /* Tiles are kept across changes of the list, keyed by their
+         * location: only the tiles of new locations get created */
+        tiles = g_hash_table_new (NULL, NULL);
+        for (l = cd->location_tiles; l; l = l->next)
+                g_hash_table_insert (tiles,
+                                     clock_location_tile_get_location (l->data),
+                                     l->data);
+
+        g_slist_free (cd->location_tiles);
+        cd->location_tiles = NULL;
+
+        node = sort_locations (cd->locations, TRUE);
 
+        position = 0;
         for (l = node; l; l = g_slist_next (l)) {
                 ClockLocation *loc = l->data;
-                ClockLocationTile *city = clock_location_tile_new (loc, CLOCK_FACE_SMALL);
-                g_signal_connect (city, "tile-pressed",
-                                  G_CALLBACK (location_tile_pressed_cb), cd);
-                g_signal_connect (city, "need-clock-format",
-                                  G_CALLBACK (location_tile_need_clock_format_cb), cd);
+                ClockLocationTile *city;
 
-                gtk_box_pack_start (GTK_BOX (cities_box),
-                                    GTK_WIDGET (city),
-                                    FALSE, FALSE, 0);
+                city = g_hash_table_lookup (tiles, loc);
+
+                if (city) {
+                        g_hash_table_remove (tiles, loc);
+                } else {
+                        city = clock_location_tile_new (loc, CLOCK_FACE_SMALL);
+                        g_signal_connect (city, "tile-pressed",
+                                          G_CALLBACK (location_tile_pressed_cb), cd);
+                        g_signal_connect (city, "need-clock-format",
+                                          G_CALLBACK (location_tile_need_clock_format_cb), cd);
+
+                        gtk_box_pack_start (GTK_BOX (cd->cities_box),
+                                            GTK_WIDGET (city),
+                                            FALSE, FALSE, 0);
+                        gtk_widget_show_all (GTK_WIDGET (city));
+                }
+
+                gtk_box_reorder_child (GTK_BOX (cd->cities_box),
+                                       GTK_WIDGET (city), position++);
 
                 cd->location_tiles = g_slist_prepend (cd->location_tiles, city);
 
+                /* the labels are only touched if their content changed */
                 clock_location_tile_refresh (city, TRUE);
         }
 
         g_slist_free (node);
 
-        gtk_container_add (GTK_CONTAINER (cd->cities_section), cities_box);
+        /* what is left belongs to locations that are gone */
+        g_hash_table_iter_init (&iter, tiles);
+        while (g_hash_table_iter_next (&iter, NULL, &tile))
+                gtk_widget_destroy (GTK_WIDGET (tile));
+        g_hash_table_destroy (tiles);
 
-        gtk_box_pack_end (GTK_BOX (cd->clock_vbox),
-                          cd->cities_section, FALSE, FALSE, 0);
-
-        gtk_widget_show_all (cd->cities_section);
+        if (cd->locations == NULL) {
+                /* if the list is empty, don't bother showing the
+                   cities section */
+                gtk_widget_hide (cd->cities_section);
+        } else {
+                gtk_widget_show (cd->cities_box);
+                gtk_widget_show (cd->cities_section);
+        }
 }
 
 static GSList *
@@ -1344,42 +1520,91 @@ create_map_section (ClockData *cd)
         gtk_widget_show (cd->map_widget);
 }
 
+static void
+destroy_calendar_popup (ClockData *cd)
+{
+        if (!cd->calendar_popup)
+                return;
+
+        gtk_widget_destroy (cd->calendar_popup);
+        cd->calendar_popup = NULL;
+        cd->cities_section = NULL;
+        cd->cities_box = NULL;
+        cd->map_widget = NULL;
+        cd->clock_vbox = NULL;
+
+        if (cd->location_tiles)
+                g_slist_free (cd->location_tiles);
+        cd->location_tiles = NULL;
+}
+
+/* The popup is built on first use (or when the applet is idle, see
+ * prewarm_calendar_popup()) and then only hidden, so that showing it again
+ * does not have to rebuild the calendar, the cities and the map. */
+static void
+ensure_calendar_popup (ClockData *cd)
+{
+        /* the content of the window can not be reordered once built */
+        if (cd->calendar_popup &&
+            calendar_window_get_invert_order (CALENDAR_WINDOW (cd->calendar_popup)) !=
+            (cd->orient == MATE_PANEL_APPLET_ORIENT_UP))
+                destroy_calendar_popup (cd);
+
+        if (cd->calendar_popup)
+                return;
+
+        cd->calendar_popup = create_calendar (cd);
+        g_object_add_weak_pointer (G_OBJECT (cd->calendar_popup),
+                                   (gpointer *) &cd->calendar_popup);
+
+        create_clock_window (cd);
+        create_cities_store (cd);
+        create_cities_section (cd);
+        create_map_section (cd);
+}
+
+static gboolean
+prewarm_calendar_popup (gpointer data)
+{
+        ClockData *cd = data;
+
+        cd->calendar_prewarm_id = 0;
+
+        ensure_calendar_popup (cd);
+        gtk_widget_realize (cd->calendar_popup);
+
+        return G_SOURCE_REMOVE;
+}
+
 static void
 update_calendar_popup (ClockData *cd)
 {
         if (!gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (cd->panel_button))) {
-                if (cd->calendar_popup) {
-                        gtk_widget_destroy (cd->calendar_popup);
-                        cd->calendar_popup = NULL;
-                        cd->cities_section = NULL;
-                        cd->map_widget = NULL;
-                        cd->clock_vbox = NULL;
-
-                        if (cd->location_tiles)
-                                g_slist_free (cd->location_tiles);
-                        cd->location_tiles = NULL;
-                }
+                if (cd->calendar_popup)
+                        gtk_widget_hide (cd->calendar_popup);
                 update_tooltip (cd);
                 return;
         }
 
-        if (!cd->calendar_popup) {
-                cd->calendar_popup = create_calendar (cd);
-                g_object_add_weak_pointer (G_OBJECT (cd->calendar_popup),
-                                           (gpointer *) &cd->calendar_popup);
-                update_tooltip (cd);
-
-                create_clock_window (cd);
-                create_cities_store (cd);
-                create_cities_section (cd);
-                create_map_section (cd);
+        if (cd->calendar_prewarm_id) {
+                g_source_remove (cd->calendar_prewarm_id);
+                cd->calendar_prewarm_id = 0;
         }
 
-        if (cd->calendar_popup && gtk_widget_get_realized (cd->panel_button)) {
+        ensure_calendar_popup (cd);
+
+        if (gtk_widget_get_realized (cd->panel_button)) {
+                /* the content was not updated while hidden */
+                update_location_tiles (cd);
+                if (cd->map_widget)
+                        clock_map_update_time (CLOCK_MAP (cd->map_widget));
+
                 calendar_window_refresh (CALENDAR_WINDOW (cd->calendar_popup));
                 position_calendar_popup (cd);
                 gtk_window_present (GTK_WINDOW (cd->calendar_popup));
         }
+
+        update_tooltip (cd);
 }
 
 static void
@@ -1532,6 +1757,10 @@ create_clock_widget (ClockData *cd)
         g_signal_connect (cd->panel_button, "destroy",
                           G_CALLBACK (destroy_clock),
                           cd);
+        g_signal_connect_swapped (cd->panel_button, "style-updated",
+                                  G_CALLBACK (clock_invalidate_extents), cd);
+        g_signal_connect_swapped (cd->panel_button, "notify::scale-factor",
+                                  G_CALLBACK (clock_invalidate_extents), cd);
         gtk_widget_show (cd->panel_button);
 
         /* Main orientable box */
@@ -1591,7 +1820,7 @@ update_orient (ClockData *cd)
         gdouble        angle;
 
         text = gtk_label_get_text (GTK_LABEL (cd->clockw));
-        min_width = calculate_minimum_width (cd->panel_button, text);
+        min_width = calculate_minimum_width (cd, text);
         gtk_widget_get_allocation (cd->panel_button, &allocation);
 
         if (cd->orient == MATE_PANEL_APPLET_ORIENT_LEFT &&
@@ -1792,7 +2021,8 @@ update_set_time_button (ClockData *cd)
                 gtk_widget_set_sensitive (cd->time_settings_button, can_set);
 
         if (cd->set_time_button) {
-                gtk_widget_set_sensitive (cd->set_time_button, can_set != 0);
+                gtk_widget_set_sensitive (cd->set_time_button,
+                                          can_set != 0 && !cd->set_time_cancellable);
                 gtk_button_set_label (GTK_BUTTON (cd->set_time_button),
                                       can_set == 1 ?
                                         _("Set System Time...") :
@@ -1800,11 +2030,42 @@ update_set_time_button (ClockData *cd)
         }
 }
 
+/* The mechanism can take long to answer, while it asks for the password:
+ * the window stays responsive and shows that it is working */
+static void
+set_time_show_progress (ClockData *cd,
+                        gboolean   in_progress)
+{
+        GtkWidget *spinner = NULL;
+
+        if (in_progress) {
+                spinner = gtk_spinner_new ();
+                gtk_spinner_start (GTK_SPINNER (spinner));
+        }
+
+        gtk_button_set_image (GTK_BUTTON (cd->set_time_button), spinner);
+        gtk_button_set_always_show_image (GTK_BUTTON (cd->set_time_button), in_progress);
+
+        gtk_widget_set_sensitive (cd->calendar, !in_progress);
+        gtk_widget_set_sensitive (cd->hours_spin, !in_progress);
+        gtk_widget_set_sensitive (cd->minutes_spin, !in_progress);
+        gtk_widget_set_sensitive (cd->seconds_spin, !in_progress);
+
+        update_set_time_button (cd);
+}
+
 static void
 set_time_callback (ClockData *cd, GError *error)
 {
         GtkWidget *window;
 
+        /* cancelled from the window or because the applet is going away */
+        if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+                return;
+
+        g_clear_object (&cd->set_time_cancellable);
+        set_time_show_progress (cd, FALSE);
+
         if (error) {
                 GtkWidget *dialog = gtk_message_dialog_new (NULL,
                                                             0,
@@ -1831,6 +2092,9 @@ set_time (GtkWidget *widget, ClockData *cd)
         time_t tim;
         guint year, month, day;
 
+        if (cd->set_time_cancellable)
+                return;
+
         time (&tim);
         /* sets t.isdst -- we could set it to -1 to have mktime() guess the
          * right value , but we don't know if this works with all libc */
@@ -1846,12 +2110,22 @@ set_time (GtkWidget *widget, ClockData *cd)
 
         tim = mktime (&t);
 
-        set_system_time_async (tim, (GFunc)set_time_callback, cd, NULL);
+        cd->set_time_cancellable = g_cancellable_new ();
+        set_time_show_progress (cd, TRUE);
+
+        set_system_time_async (tim, cd->set_time_cancellable,
+                               (GFunc)set_time_callback, cd, NULL);
 }
 
 static void
 cancel_time_settings (GtkWidget *button, ClockData *cd)
 {
+        if (cd->set_time_cancellable) {
+                g_cancellable_cancel (cd->set_time_cancellable);
+                g_clear_object (&cd->set_time_cancellable);
+                set_time_show_progress (cd, FALSE);
+        }
+
         gtk_widget_hide (cd->set_time_window);
 
         refresh_click_timeout_time_only (cd);
@@ -2044,15 +2318,69 @@ format_changed (GSettings    *settings,
 
 }
 
+/* The low-power profile ticks once a minute, without the seconds */
+static void
+update_show_seconds (ClockData *cd)
+{
+        cd->showseconds = g_settings_get_boolean (cd->settings, KEY_SHOW_SECONDS) &&
+                mate_panel_applet_get_power_profile (MATE_PANEL_APPLET (cd->applet)) !=
+                MATE_PANEL_APPLET_POWER_PROFILE_LOW_POWER;
+}
+
 static void
 show_seconds_changed (GSettings    *settings,
                       gchar        *key,
                       ClockData    *clock)
 {
-        clock->showseconds = g_settings_get_boolean (settings, key);
+        update_show_seconds (clock);
         refresh_clock_timeout (clock);
 }
 
+/* The weather is polled less often by the other profiles */
+static void
+update_weather_interval (ClockData *cd)
+{
+        switch (mate_panel_applet_get_power_profile (MATE_PANEL_APPLET (cd->applet))) {
+        case MATE_PANEL_APPLET_POWER_PROFILE_LOW_POWER:
+                clock_location_set_weather_interval_scale (4);
+                break;
+        case MATE_PANEL_APPLET_POWER_PROFILE_BALANCED:
+                clock_location_set_weather_interval_scale (2);
+                break;
+        default:
+                clock_location_set_weather_interval_scale (1);
+                break;
+        }
+}
+
+static void
+power_profile_changed (MatePanelApplet *applet,
+                       GParamSpec      *pspec,
+                       ClockData       *cd)
+{
+        update_weather_interval (cd);
+        update_show_seconds (cd);
+        refresh_clock_timeout (cd);
+}
+
+static void
+a11y_enabled_changed (MatePanelApplet *applet,
+                      GParamSpec      *pspec,
+                      ClockData       *cd)
+{
+        char *text = NULL;
+
+        if (!mate_panel_applet_get_a11y_enabled (applet))
+                return;
+
+        if (cd->clock_text &&
+            !pango_parse_markup (cd->clock_text, -1, 0, NULL, &text, NULL, NULL))
+                text = g_strdup (cd->clock_text);
+
+        set_atk_name_description (cd->applet, text, _("Computer Clock"));
+        g_free (text);
+}
+
 static void
 show_date_changed (GSettings    *settings,
                    gchar        *key,
@@ -2553,7 +2881,8 @@ load_gsettings (ClockData *cd)
                 cd->format = clock_locale_format ();
 
         cd->custom_format = g_settings_get_string (cd->settings, KEY_CUSTOM_FORMAT);
-        cd->showseconds = g_settings_get_boolean (cd->settings, KEY_SHOW_SECONDS);
+        update_show_seconds (cd);
+        update_weather_interval (cd);
         cd->showdate = g_settings_get_boolean (cd->settings, KEY_SHOW_DATE);
         cd->show_weather = g_settings_get_boolean (cd->settings, KEY_SHOW_WEATHER);
         cd->show_temperature = g_settings_get_boolean (cd->settings, KEY_SHOW_TEMPERATURE);
@@ -2617,6 +2946,7 @@ system_manager_signal_cb (GDBusProxy *proxy,
                  */
                 if (active == FALSE)
                 {
+                        clock_ticker_resync ();
                         update_clock (cd);
                         update_weather_locations (cd);
                 }
@@ -2671,6 +3001,7 @@ fill_clock_applet (MatePanelApplet *applet)
         cd = g_new0 (ClockData, 1);
         cd->fixed_width = -1;
         cd->fixed_height = -1;
+        cd->min_height = -1;
 
         cd->applet = GTK_WIDGET (applet);
 
@@ -2696,6 +3027,14 @@ fill_clock_applet (MatePanelApplet *applet)
                           G_CALLBACK (applet_change_orient),
                           cd);
 
+        g_signal_connect (cd->applet, "notify::power-profile",
+                          G_CALLBACK (power_profile_changed),
+                          cd);
+
+        g_signal_connect (cd->applet, "notify::a11y-enabled",
+                          G_CALLBACK (a11y_enabled_changed),
+                          cd);
+
         g_signal_connect (cd->panel_button, "size-allocate",
                           G_CALLBACK (panel_button_change_pixel_size),
                           cd);
@@ -2737,6 +3076,10 @@ fill_clock_applet (MatePanelApplet *applet)
          * hibernate). */
         setup_monitor_for_resume (cd);
 
+        cd->calendar_prewarm_id = g_idle_add_full (G_PRIORITY_LOW,
+                                                   prewarm_calendar_popup,
+                                                   cd, NULL);
+
         return TRUE;
 }
 
@@ -35,46 +35,99 @@
 #define DATETIME_DBUS_NAME "org.mate.SettingsDaemon.DateTimeMechanism"
 #define DATETIME_DBUS_PATH "/"
 
-static GDBusProxy *
-get_bus_proxy (void)
+typedef void (*ProxyReadyFunc) (GDBusProxy *proxy, gpointer data);
+
+typedef struct {
+	ProxyReadyFunc func;
+	gpointer       data;
+} PendingProxyCall;
+
+static GDBusProxy *bus_proxy = NULL;
+static gboolean    bus_proxy_requested = FALSE;
+/* PendingProxyCall, waiting for the proxy to be created */
+static GSList     *bus_proxy_pending = NULL;
+
+static void
+bus_proxy_ready (GObject      *source_object,
+                 GAsyncResult *res,
+                 gpointer      user_data)
 {
-	GError            *error = NULL;
-	static GDBusProxy *proxy = NULL;
-	if (proxy == NULL) {
-		proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-						       G_DBUS_PROXY_FLAGS_NONE,
-						       NULL,
-						       DATETIME_DBUS_NAME,
-						       DATETIME_DBUS_PATH,
-						       DATETIME_DBUS_NAME,
-						       NULL,
-						       &error);
-		if (proxy == NULL) {
-			g_warning ("Unable to contact datetime settings daemon: %s\n", error->message);
-			g_error_free (error);
-		}
+	GError *error = NULL;
+	GSList *pending, *l;
+
+	bus_proxy = g_dbus_proxy_new_for_bus_finish (res, &error);
+	if (bus_proxy == NULL) {
+		g_warning ("Unable to contact datetime settings daemon: %s\n", error->message);
+		g_error_free (error);
+		/* tried again the next time it is needed */
+		bus_proxy_requested = FALSE;
+	}
+
+	pending = g_slist_reverse (bus_proxy_pending);
+	bus_proxy_pending = NULL;
+
+	for (l = pending; l != NULL; l = l->next) {
+		PendingProxyCall *call = l->data;
+
+		call->func (bus_proxy, call->data);
+		g_free (call);
+	}
+	g_slist_free (pending);
+}
+
+/* Calls func with the proxy, or with NULL if the daemon cannot be
+ * reached. Creating the proxy takes a round trip on the system bus,
+ * which is not done synchronously: a slow bus would freeze the clock. */
+static void
+with_bus_proxy (ProxyReadyFunc func,
+                gpointer       data)
+{
+	PendingProxyCall *call;
+
+	if (bus_proxy != NULL) {
+		func (bus_proxy, data);
+		return;
 	}
-	return proxy;
+
+	call = g_new (PendingProxyCall, 1);
+	call->func = func;
+	call->data = data;
+	bus_proxy_pending = g_slist_prepend (bus_proxy_pending, call);
+
+	if (bus_proxy_requested)
+		return;
+	bus_proxy_requested = TRUE;
+
+	g_dbus_proxy_new_for_bus (G_BUS_TYPE_SYSTEM,
+				  G_DBUS_PROXY_FLAGS_NONE,
+				  NULL,
+				  DATETIME_DBUS_NAME,
+				  DATETIME_DBUS_PATH,
+				  DATETIME_DBUS_NAME,
+				  NULL,
+				  bus_proxy_ready,
+				  NULL);
 }
 
 #define CACHE_VALIDITY_SEC 2
 
 typedef  void (*CanDoFunc) (gint value);
 
+static void update_can_settimezone (gint res);
+static void update_can_settime     (gint res);
+
 static void
 notify_can_do (GObject *source_object,
                GAsyncResult *res,
                gpointer user_data)
 {
-	GDBusProxy *proxy;
 	GVariant   *variant;
 	GError     *error = NULL;
 	gint32      value;
 
 	CanDoFunc callback = user_data;
 
-	proxy = get_bus_proxy ();
-	variant = g_dbus_proxy_call_finish (proxy, res, &error);
+	variant = g_dbus_proxy_call_finish (G_DBUS_PROXY (source_object), res, &error);
 	if (variant == NULL) {
 		g_warning ("Call can set time zone dbus method: %s", error->message);
 		g_error_free (error);
@@ -86,14 +139,19 @@ notify_can_do (GObject *source_object,
 }
 
 static void
-refresh_can_do (const gchar *action, CanDoFunc callback)
+call_can_do (GDBusProxy *proxy, gpointer data)
 {
-	GDBusProxy *proxy;
+	const gchar *action = data;
+	CanDoFunc    callback;
 
-	proxy = get_bus_proxy ();
 	if (proxy == NULL)
 		return;
 
+	if (strcmp (action, "CanSetTimezone") == 0)
+		callback = update_can_settimezone;
+	else
+		callback = update_can_settime;
+
 	g_dbus_proxy_call (proxy,
 			   action,
 			   g_variant_new ("()"),
@@ -104,6 +162,12 @@ refresh_can_do (const gchar *action, CanDoFunc callback)
 			   callback);
 }
 
+static void
+refresh_can_do (const gchar *action)
+{
+	with_bus_proxy (call_can_do, (gpointer) action);
+}
+
 static gint   settimezone_cache = 0;
 static time_t settimezone_stamp = 0;
 
@@ -121,7 +185,7 @@ can_set_system_timezone (void)
 
 	time (&now);
 	if (ABS (now - settimezone_stamp) > CACHE_VALIDITY_SEC) {
-		refresh_can_do ("CanSetTimezone", update_can_settimezone);
+		refresh_can_do ("CanSetTimezone");
 		settimezone_stamp = now;
 	}
 
@@ -145,7 +209,7 @@ can_set_system_time (void)
 
 	time (&now);
 	if (ABS (now - settime_stamp) > CACHE_VALIDITY_SEC) {
-		refresh_can_do ("CanSetTime", update_can_settime);
+		refresh_can_do ("CanSetTime");
 		settime_stamp = now;
 	}
 
@@ -153,27 +217,32 @@ can_set_system_time (void)
 }
 
 typedef struct {
-	gint ref_count;
-        gchar *call;
+	gchar *call;
 	gint64 time;
 	gchar *filename;
+	GCancellable *cancellable;
 	GFunc callback;
 	gpointer data;
 	GDestroyNotify notify;
 } SetTimeCallbackData;
 
 static void
-free_data (gpointer d)
+free_data (SetTimeCallbackData *data)
 {
-	SetTimeCallbackData *data = d;
+	if (data->notify)
+		data->notify (data->data);
+	g_clear_object (&data->cancellable);
+	g_free (data->filename);
+	g_free (data);
+}
 
-	data->ref_count--;
-	if (data->ref_count == 0) {
-		if (data->notify)
-			data->notify (data->data);
-		g_free (data->filename);
-		g_free (data);
-	}
+static void
+set_time_finish (SetTimeCallbackData *data,
+                 GError              *error)
+{
+	if (data->callback)
+		data->callback (data->data, error);
+	free_data (data);
 }
 
 static void
@@ -183,45 +252,41 @@ set_time_notify (GObject *source_object,
 {
 	SetTimeCallbackData *data  = user_data;
 	GError              *error = NULL;
-	GDBusProxy          *proxy;
 	GVariant            *variant;
 
-	proxy = get_bus_proxy ();
-	variant = g_dbus_proxy_call_finish (proxy, res, &error);
-	if (variant == NULL) {
-		if (error != NULL) {
-			if (data->callback)
-				data->callback (data->data, error);
-			g_error_free (error);
-		} else {
-			if (data->callback)
-				data->callback (data->data, NULL);
-		}
-	} else {
+	variant = g_dbus_proxy_call_finish (G_DBUS_PROXY (source_object), res, &error);
+	if (variant != NULL)
 		g_variant_unref (variant);
-		if (data->callback)
-			data->callback (data->data, NULL);
-	}
-	free_data (data);
+
+	set_time_finish (data, error);
+	g_clear_error (&error);
 }
 
 static void
-set_time_async (SetTimeCallbackData *data)
+call_set_time (GDBusProxy *proxy, gpointer d)
 {
-	GDBusProxy *proxy;
+	SetTimeCallbackData *data = d;
+	GError              *error = NULL;
 
-	proxy = get_bus_proxy ();
-	if (proxy == NULL)
+	if (g_cancellable_set_error_if_cancelled (data->cancellable, &error) ||
+	    proxy == NULL) {
+		if (error == NULL)
+			error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_FAILED,
+						     "Unable to contact datetime settings daemon");
+		set_time_finish (data, error);
+		g_error_free (error);
 		return;
+	}
 
-	data->ref_count++;
+	/* the mechanism can wait for the user to authenticate: no timeout,
+	 * the caller cancels instead */
 	if (strcmp (data->call, "SetTime") == 0)
 		g_dbus_proxy_call (proxy,
 				   "SetTime",
 				   g_variant_new ("(x)", data->time),
 				   G_DBUS_CALL_FLAGS_NONE,
 				   G_MAXINT,
-				   NULL,
+				   data->cancellable,
 				   set_time_notify,
 				   data);
 	else
@@ -230,55 +295,82 @@ set_time_async (SetTimeCallbackData *data)
 				   g_variant_new ("(s)", data->filename),
 				   G_DBUS_CALL_FLAGS_NONE,
 				   G_MAXINT,
-				   NULL,
+				   data->cancellable,
 				   set_time_notify,
 				   data);
 }
 
+static SetTimeCallbackData *
+set_time_data_new (const gchar    *call,
+                   GCancellable   *cancellable,
+                   GFunc           callback,
+                   gpointer        d,
+                   GDestroyNotify  notify)
+{
+	SetTimeCallbackData *data;
+
+	data = g_new0 (SetTimeCallbackData, 1);
+	data->call = (gchar *) call;
+	data->time = -1;
+	data->cancellable = cancellable ? g_object_ref (cancellable) : NULL;
+	data->callback = callback;
+	data->data = d;
+	data->notify = notify;
+
+	return data;
+}
+
+/* callback is always called once, with a G_IO_ERROR_CANCELLED error when
+ * cancellable is cancelled before the call completes */
 void
 set_system_time_async (gint64         time,
+		       GCancellable  *cancellable,
 		       GFunc          callback,
 		       gpointer       d,
 		       GDestroyNotify notify)
 {
 	SetTimeCallbackData *data;
 
-	if (time == -1)
+	data = set_time_data_new ("SetTime", cancellable, callback, d, notify);
+
+	/* what mktime() returns for a time it cannot represent */
+	if (time == -1) {
+		GError *error;
+
+		error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+					     "Invalid time");
+		set_time_finish (data, error);
+		g_error_free (error);
 		return;
+	}
 
-	data = g_new0 (SetTimeCallbackData, 1);
-	data->ref_count = 1;
-	data->call = "SetTime";
 	data->time = time;
-	data->filename = NULL;
-	data->callback = callback;
-	data->data = d;
-	data->notify = notify;
 
-	set_time_async (data);
-	free_data (data);
+	with_bus_proxy (call_set_time, data);
 }
 
 void
 set_system_timezone_async (const gchar    *filename,
+			   GCancellable   *cancellable,
 			   GFunc           callback,
 			   gpointer        d,
 			   GDestroyNotify  notify)
 {
 	SetTimeCallbackData *data;
 
-	if (filename == NULL)
+	data = set_time_data_new ("SetTimezone", cancellable, callback, d, notify);
+
+	if (filename == NULL) {
+		GError *error;
+
+		error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+					     "No timezone");
+		set_time_finish (data, error);
+		g_error_free (error);
 		return;
+	}
 
-	data = g_new0 (SetTimeCallbackData, 1);
-	data->ref_count = 1;
-	data->call = "SetTimezone";
-	data->time = -1;
 	data->filename = g_strdup (filename);
-	data->callback = callback;
-	data->data = d;
-	data->notify = notify;
 
-	set_time_async (data);
-	free_data (data);
+	with_bus_proxy (call_set_time, data);
 }
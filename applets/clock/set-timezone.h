@@ -20,7 +20,7 @@
 
 #ifndef __SET_SYSTEM_TIMEZONE_H__
 
-#include <glib.h>
+#include <gio/gio.h>
 #include <time.h>
 
 gint     can_set_system_timezone (void);
@@ -28,11 +28,13 @@ gint     can_set_system_timezone (void);
 gint     can_set_system_time     (void);
 
 void     set_system_time_async   (gint64         time,
+                                  GCancellable  *cancellable,
                                   GFunc          callback,
                                   gpointer       data,
                                   GDestroyNotify notify);
 
 void     set_system_timezone_async   (const gchar    *filename,
+                                      GCancellable   *cancellable,
                                       GFunc           callback,
                                       gpointer        data,
                                       GDestroyNotify  notify);
@@ -45,6 +45,7 @@
  * in some cases: eg, in tzdata2008b, Asia/Calcutta got renamed to
  * Asia/Kolkata and the old name is not in zone.tab. */
 
+#include <errno.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -66,6 +67,15 @@
 /* The first 4 characters in a timezone file, from tzfile.h */
 #define TZ_MAGIC "TZif"
 
+/* Content hash -> timezone index of SYSTEM_ZONEINFODIR, kept in the user
+ * cache directory. A copied /etc/localtime that matches no timezone is
+ * kept in it with an empty timezone, so that the database is only walked
+ * again once it changes. */
+#define ZONEINFO_INDEX_FILE         "zoneinfo.index"
+#define ZONEINFO_INDEX_VERSION      2
+/* (version, zoneinfo mtime, [(sha256 of the file, timezone)]) */
+#define ZONEINFO_INDEX_VARIANT_TYPE "(uxa(ss))"
+
 static char *files_to_check[CHECK_NB] = {
         ETC_TIMEZONE,
         ETC_TIMEZONE_MAJ,
@@ -76,6 +86,29 @@ static char *files_to_check[CHECK_NB] = {
 
 static GObject *systz_singleton = NULL;
 
+/* Only set by system_timezone_find_in_root(): the system files are then
+ * looked for under it, and the files opened are counted */
+static const char *system_root = NULL;
+static guint       system_files_opened = 0;
+
+/* Returns @path under the system root, when there is one. The rooted paths
+ * are interned: there are only a few of them for each root. */
+static const char *
+system_timezone_path (const char *path)
+{
+        char       *rooted;
+        const char *retval;
+
+        if (!system_root)
+                return path;
+
+        rooted = g_build_filename (system_root, path, NULL);
+        retval = g_intern_string (rooted);
+        g_free (rooted);
+
+        return retval;
+}
+
 typedef struct {
         char *tz;
         char *env_tz;
@@ -317,9 +350,10 @@ system_timezone_read_etc_timezone (void)
         GString *reading;
         int      c;
 
-        etc_timezone = g_fopen (ETC_TIMEZONE, "r");
+        etc_timezone = g_fopen (system_timezone_path (ETC_TIMEZONE), "r");
         if (!etc_timezone)
                 return NULL;
+        system_files_opened++;
 
         reading = g_string_new ("");
 
@@ -379,12 +413,15 @@ system_timezone_read_key_file (const char *filename,
         char       *line;
         char       *retval;
 
+        filename = system_timezone_path (filename);
+
         if (!g_file_test (filename, G_FILE_TEST_IS_REGULAR))
                 return NULL;
 
         channel = g_io_channel_new_file (filename, "r", NULL);
         if (!channel)
                 return NULL;
+        system_files_opened++;
 
         key_eq = g_strdup_printf ("%s=", key);
         retval = NULL;
@@ -593,43 +630,63 @@ system_timezone_write_etc_rc_conf (const char  *tz,
 static char *
 system_timezone_strip_path_if_valid (const char *filename)
 {
-        int skip;
+        const char *zoneinfo_dir;
+        const char *tz;
+        gsize       len;
 
-        if (!filename || !g_str_has_prefix (filename, SYSTEM_ZONEINFODIR"/"))
+        zoneinfo_dir = system_timezone_path (SYSTEM_ZONEINFODIR);
+        len = strlen (zoneinfo_dir);
+
+        if (!filename ||
+            strncmp (filename, zoneinfo_dir, len) != 0 || filename[len] != '/')
                 return NULL;
 
+        tz = filename + len + 1;
+
         /* Timezone data files also live under posix/ and right/ for some
          * reason.
          * FIXME: make sure accepting those files is valid. I think "posix" is
          * okay, not sure about "right" */
-        if (g_str_has_prefix (filename, SYSTEM_ZONEINFODIR"/posix/"))
-                skip = strlen (SYSTEM_ZONEINFODIR"/posix/");
-        else if (g_str_has_prefix (filename, SYSTEM_ZONEINFODIR"/right/"))
-                skip = strlen (SYSTEM_ZONEINFODIR"/right/");
-        else
-                skip = strlen (SYSTEM_ZONEINFODIR"/");
+        if (g_str_has_prefix (tz, "posix/"))
+                tz += strlen ("posix/");
+        else if (g_str_has_prefix (tz, "right/"))
+                tz += strlen ("right/");
 
-        return g_strdup (filename + skip);
+        return g_strdup (tz);
 }
 
 /* Read the soft symlink from /etc/localtime */
 static char *
 system_timezone_read_etc_localtime_softlink (void)
 {
-        char *file;
-        char *tz;
+        const char *localtime;
+        char       *file;
+        char       *tz;
+
+        localtime = system_timezone_path (ETC_LOCALTIME);
+
+        if (!g_file_test (localtime, G_FILE_TEST_IS_SYMLINK))
+                return NULL;
 
-        if (!g_file_test (ETC_LOCALTIME, G_FILE_TEST_IS_SYMLINK))
+        file = g_file_read_link (localtime, NULL);
+        if (!file)
                 return NULL;
 
-        file = g_file_read_link (ETC_LOCALTIME, NULL);
+        if (g_path_is_absolute (file)) {
+                /* the link points to the system files, under the root */
+                if (system_root) {
+                        char *rooted;
 
-        if (!g_path_is_absolute (file)) {
+                        rooted = g_build_filename (system_root, file, NULL);
+                        g_free (file);
+                        file = rooted;
+                }
+        } else {
                 GFile *gf1;
                 GFile *gf2;
 
                 /* Resolve relative path. */
-                gf1 = g_file_new_for_path (ETC_LOCALTIME);
+                gf1 = g_file_new_for_path (localtime);
                 gf2 = g_file_get_parent (gf1);
                 g_object_unref (gf1);
                 gf1 = g_file_resolve_relative_path (gf2, file);
@@ -681,6 +738,7 @@ recursive_compare (struct stat  *localtime_stat,
                 dir = g_dir_open (file, 0, NULL);
                 if (dir == NULL)
                         return NULL;
+                system_files_opened++;
 
                 while ((subfile = g_dir_read_name (dir)) != NULL) {
                         subpath = g_build_filename (file, subfile, NULL);
@@ -722,7 +780,7 @@ system_timezone_read_etc_localtime_hardlink (void)
 {
         struct stat stat_localtime;
 
-        if (g_stat (ETC_LOCALTIME, &stat_localtime) != 0)
+        if (g_stat (system_timezone_path (ETC_LOCALTIME), &stat_localtime) != 0)
                 return NULL;
 
         if (!S_ISREG (stat_localtime.st_mode))
@@ -731,37 +789,262 @@ system_timezone_read_etc_localtime_hardlink (void)
         return recursive_compare (&stat_localtime,
                                   NULL,
                                   0,
-                                  SYSTEM_ZONEINFODIR,
+                                  (char *) system_timezone_path (SYSTEM_ZONEINFODIR),
                                   files_are_identical_inode);
 }
 
-static gboolean
-files_are_identical_content (struct stat *a_stat,
-                             struct stat *b_stat,
-                             const char  *a_content,
-                             gsize        a_content_len,
-                             const char  *b_filename)
+/* The most recent modification time of the timezone database: updates of
+ * tzdata touch the directory itself or one of those files. */
+static gint64
+zoneinfo_get_mtime (void)
 {
-        char  *b_content = NULL;
-        gsize  b_content_len = -1;
-        int    cmp;
+        static const char *stamps[] = {
+                SYSTEM_ZONEINFODIR,
+                SYSTEM_ZONEINFODIR"/zone.tab",
+                SYSTEM_ZONEINFODIR"/zone1970.tab",
+                SYSTEM_ZONEINFODIR"/tzdata.zi",
+                NULL
+        };
+        struct stat stamp_stat;
+        gint64      mtime = 0;
+        int         i;
+
+        for (i = 0; stamps[i] != NULL; i++) {
+                if (g_stat (system_timezone_path (stamps[i]), &stamp_stat) == 0)
+                        mtime = MAX (mtime, (gint64) stamp_stat.st_mtime);
+        }
 
-        if (a_stat->st_size != b_stat->st_size)
-                return FALSE;
+        return mtime;
+}
 
-        if (!g_file_get_contents (b_filename,
-                                  &b_content, &b_content_len, NULL))
-                return FALSE;
+static char *
+zoneinfo_index_get_filename (void)
+{
+        /* not mixed with the index of the system */
+        if (system_root)
+                return g_build_filename (system_root, "cache",
+                                         ZONEINFO_INDEX_FILE, NULL);
 
-        if (a_content_len != b_content_len) {
-                g_free (b_content);
-                return FALSE;
+        return g_build_filename (g_get_user_cache_dir (), "mate-panel",
+                                 ZONEINFO_INDEX_FILE, NULL);
+}
+
+static void
+zoneinfo_index_build_recursive (GHashTable *index,
+                                const char *file)
+{
+        struct stat file_stat;
+
+        if (g_stat (file, &file_stat) != 0)
+                return;
+
+        if (S_ISREG (file_stat.st_mode)) {
+                char  *content = NULL;
+                gsize  content_len = 0;
+                char  *checksum;
+                char  *tz;
+
+                if (file_stat.st_size < (off_t) strlen (TZ_MAGIC))
+                        return;
+
+                if (!g_file_get_contents (file, &content, &content_len, NULL))
+                        return;
+                system_files_opened++;
+
+                if (content_len < strlen (TZ_MAGIC) ||
+                    memcmp (content, TZ_MAGIC, strlen (TZ_MAGIC)) != 0) {
+                        g_free (content);
+                        return;
+                }
+
+                checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA256,
+                                                        (const guchar *) content,
+                                                        content_len);
+                g_free (content);
+
+                /* like the recursive comparison did, the first file found
+                 * wins when several timezones share the same data */
+                if (g_hash_table_contains (index, checksum) ||
+                    (tz = system_timezone_strip_path_if_valid (file)) == NULL) {
+                        g_free (checksum);
+                        return;
+                }
+
+                g_hash_table_insert (index, checksum, tz);
+        } else if (S_ISDIR (file_stat.st_mode)) {
+                GDir       *dir;
+                const char *subfile;
+
+                dir = g_dir_open (file, 0, NULL);
+                if (dir == NULL)
+                        return;
+                system_files_opened++;
+
+                while ((subfile = g_dir_read_name (dir)) != NULL) {
+                        char *subpath;
+
+                        subpath = g_build_filename (file, subfile, NULL);
+                        zoneinfo_index_build_recursive (index, subpath);
+                        g_free (subpath);
+                }
+
+                g_dir_close (dir);
+        }
+}
+
+static GHashTable *
+zoneinfo_index_load (gint64 mtime)
+{
+        GMappedFile  *mapped;
+        GBytes       *bytes;
+        GVariant     *variant;
+        GVariantIter *entries;
+        GHashTable   *index = NULL;
+        char         *filename;
+        const char   *checksum;
+        const char   *tz;
+        guint32       version;
+        gint64        index_mtime;
+
+        filename = zoneinfo_index_get_filename ();
+        mapped = g_mapped_file_new (filename, FALSE, NULL);
+        g_free (filename);
+
+        if (!mapped)
+                return NULL;
+        system_files_opened++;
+
+        bytes = g_mapped_file_get_bytes (mapped);
+        g_mapped_file_unref (mapped);
+
+        variant = g_variant_new_from_bytes (G_VARIANT_TYPE (ZONEINFO_INDEX_VARIANT_TYPE),
+                                            bytes, FALSE);
+        g_variant_ref_sink (variant);
+        g_bytes_unref (bytes);
+
+        g_variant_get (variant, ZONEINFO_INDEX_VARIANT_TYPE,
+                       &version, &index_mtime, &entries);
+
+        if (version == ZONEINFO_INDEX_VERSION && index_mtime == mtime) {
+                index = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                               g_free, g_free);
+
+                while (g_variant_iter_next (entries, "(&s&s)", &checksum, &tz))
+                        g_hash_table_insert (index,
+                                             g_strdup (checksum),
+                                             g_strdup (tz));
+        }
+
+        g_variant_iter_free (entries);
+        g_variant_unref (variant);
+
+        return index;
+}
+
+static void
+zoneinfo_index_save (GHashTable *index,
+                     gint64      mtime)
+{
+        GVariantBuilder  entries;
+        GVariant        *variant;
+        GHashTableIter   iter;
+        gpointer         checksum, tz;
+        GError          *error = NULL;
+        char            *filename;
+        char            *dirname;
+
+        g_variant_builder_init (&entries, G_VARIANT_TYPE ("a(ss)"));
+
+        g_hash_table_iter_init (&iter, index);
+        while (g_hash_table_iter_next (&iter, &checksum, &tz))
+                g_variant_builder_add (&entries, "(ss)", checksum, tz);
+
+        variant = g_variant_new (ZONEINFO_INDEX_VARIANT_TYPE,
+                                 ZONEINFO_INDEX_VERSION, mtime, &entries);
+        g_variant_ref_sink (variant);
+
+        filename = zoneinfo_index_get_filename ();
+        dirname = g_path_get_dirname (filename);
+
+        if (g_mkdir_with_parents (dirname, 0700) != 0 ||
+            !g_file_set_contents (filename,
+                                  g_variant_get_data (variant),
+                                  g_variant_get_size (variant),
+                                  &error)) {
+                g_debug ("Cannot write timezone index %s: %s", filename,
+                         error ? error->message : g_strerror (errno));
+                g_clear_error (&error);
+        }
+
+        g_free (dirname);
+        g_free (filename);
+        g_variant_unref (variant);
+}
+
+static GHashTable *zoneinfo_index = NULL;
+static gint64      zoneinfo_index_mtime = 0;
+static gboolean    zoneinfo_index_built = FALSE;
+
+/* Returns the index of the timezone database, loading it from the cache or
+ * building it (the expensive part: every zoneinfo file is read) when the
+ * cache is missing or older than the database. @built tells whether the
+ * index was built by this process, and so can be trusted. */
+static GHashTable *
+zoneinfo_index_get (gboolean  rebuild,
+                    gboolean *built)
+{
+        gint64 mtime;
+
+        mtime = zoneinfo_get_mtime ();
+
+        if (!rebuild && zoneinfo_index != NULL && zoneinfo_index_mtime == mtime) {
+                *built = zoneinfo_index_built;
+                return zoneinfo_index;
+        }
+
+        g_clear_pointer (&zoneinfo_index, g_hash_table_destroy);
+        zoneinfo_index_built = FALSE;
+
+        if (!rebuild)
+                zoneinfo_index = zoneinfo_index_load (mtime);
+
+        if (zoneinfo_index == NULL) {
+                zoneinfo_index = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                        g_free, g_free);
+                zoneinfo_index_build_recursive (zoneinfo_index,
+                                                system_timezone_path (SYSTEM_ZONEINFODIR));
+                zoneinfo_index_save (zoneinfo_index, mtime);
+                zoneinfo_index_built = TRUE;
         }
 
-        cmp = memcmp (a_content, b_content, a_content_len);
-        g_free (b_content);
+        zoneinfo_index_mtime = mtime;
+        *built = zoneinfo_index_built;
 
-        return (cmp == 0);
+        return zoneinfo_index;
+}
+
+static gboolean
+zoneinfo_file_has_content (const char *tz,
+                           const char *content,
+                           gsize       content_len)
+{
+        char     *filename;
+        char     *tz_content = NULL;
+        gsize     tz_content_len = 0;
+        gboolean  retval;
+
+        filename = g_build_filename (system_timezone_path (SYSTEM_ZONEINFODIR),
+                                     tz, NULL);
+        retval = FALSE;
+        if (g_file_get_contents (filename, &tz_content, &tz_content_len, NULL)) {
+                system_files_opened++;
+                retval = tz_content_len == content_len &&
+                         memcmp (tz_content, content, content_len) == 0;
+        }
+        g_free (tz_content);
+        g_free (filename);
+
+        return retval;
 }
 
 /* Determine if /etc/localtime is a copy of a timezone file */
@@ -771,29 +1054,57 @@ system_timezone_read_etc_localtime_content (void)
         struct stat  stat_localtime;
         char        *localtime_content = NULL;
         gsize        localtime_content_len = -1;
-        char        *retval;
+        char        *checksum;
+        GHashTable  *index;
+        const char  *tz;
+        gboolean     built;
 
-        if (g_stat (ETC_LOCALTIME, &stat_localtime) != 0)
+        if (g_stat (system_timezone_path (ETC_LOCALTIME), &stat_localtime) != 0)
                 return NULL;
 
         if (!S_ISREG (stat_localtime.st_mode))
                 return NULL;
 
-        if (!g_file_get_contents (ETC_LOCALTIME,
+        if (!g_file_get_contents (system_timezone_path (ETC_LOCALTIME),
                                   &localtime_content,
                                   &localtime_content_len,
                                   NULL))
                 return NULL;
+        system_files_opened++;
+
+        checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA256,
+                                                (const guchar *) localtime_content,
+                                                localtime_content_len);
+
+        index = zoneinfo_index_get (FALSE, &built);
+        tz = g_hash_table_lookup (index, checksum);
+
+        if (tz != NULL && tz[0] == '\0') {
+                /* already known to match nothing in this database */
+                tz = NULL;
+        } else {
+                /* an index coming from the cache might be stale if the
+                 * database was modified without its mtime changing: check
+                 * the match, and rebuild the index once if it does not
+                 * hold */
+                if (!built &&
+                    (tz == NULL || !zoneinfo_file_has_content (tz,
+                                                               localtime_content,
+                                                               localtime_content_len))) {
+                        index = zoneinfo_index_get (TRUE, &built);
+                        tz = g_hash_table_lookup (index, checksum);
+                }
 
-        retval = recursive_compare (&stat_localtime,
-                                   localtime_content,
-                                   localtime_content_len,
-                                   SYSTEM_ZONEINFODIR,
-                                   files_are_identical_content);
+                if (tz == NULL) {
+                        g_hash_table_insert (index, g_strdup (checksum), g_strdup (""));
+                        zoneinfo_index_save (index, zoneinfo_index_mtime);
+                }
+        }
 
+        g_free (checksum);
         g_free (localtime_content);
 
-        return retval;
+        return g_strdup (tz);
 }
 
 typedef char * (*GetSystemTimezone) (void);
@@ -811,7 +1122,8 @@ static GetSystemTimezone get_system_timezone_methods[] = {
         /* reading deprecated config files */
         system_timezone_read_etc_conf_d_clock,
         /* reading /etc/timezone directly. Expensive since we have to stat
-         * many files */
+         * many files, though comparing the content goes through a cached
+         * index */
         system_timezone_read_etc_localtime_hardlink,
         system_timezone_read_etc_localtime_content,
         NULL
@@ -851,6 +1163,43 @@ system_timezone_find (void)
         return g_strdup ("UTC");
 }
 
+/**
+ * system_timezone_find_in_root:
+ * @root: a directory mirroring the system files
+ * @files_opened: (out) (allow-none): the number of files and directories
+ * the detection opened
+ *
+ * Finds the timezone like system_timezone_new() does, with the files under
+ * @root instead of the system ones, and without the index of the timezone
+ * database loaded in memory: the one cached under @root is used. This is
+ * for test-system-timezone, to run the detection on fixtures.
+ *
+ * Returns: the timezone.
+ */
+char *
+system_timezone_find_in_root (const char *root,
+                              guint      *files_opened)
+{
+        char *tz;
+
+        g_return_val_if_fail (root != NULL, NULL);
+
+        system_root = root;
+        system_files_opened = 0;
+        g_clear_pointer (&zoneinfo_index, g_hash_table_destroy);
+
+        tz = system_timezone_find ();
+
+        if (files_opened)
+                *files_opened = system_files_opened;
+
+        /* the index was the one of @root */
+        g_clear_pointer (&zoneinfo_index, g_hash_table_destroy);
+        system_root = NULL;
+
+        return tz;
+}
+
 /*
  *
  * Now, setting the timezone.
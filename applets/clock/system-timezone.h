@@ -62,6 +62,10 @@ SystemTimezone *system_timezone_new (void);
 const char *system_timezone_get (SystemTimezone *systz);
 const char *system_timezone_get_env (SystemTimezone *systz);
 
+/* The detection on a copy of the system files, for the tests */
+char *system_timezone_find_in_root (const char *root,
+                                    guint      *files_opened);
+
 /* Functions to set the timezone. They won't be used by the applet, but
  * by a program with more privileges */
 
@@ -19,9 +19,45 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+/* With --benchmark, the timezone detection runs against fixture trees
+ * built in a temporary directory, one for each way a system can tell its
+ * timezone, and each detection is timed:
+ *
+ *   timezone strategy=symlink result=Area07/City041 first_us=... avg_us=...
+ *            max_us=... files_opened_first=... files_opened=... ok=1
+ *
+ * The first detection of a tree has nothing cached, which matters for the
+ * content comparison: it builds the index of the timezone database. The
+ * program fails when a detection finds the wrong timezone, or when the
+ * average time of the detections of a tree goes over the budget. */
+
+#include <errno.h>
+#include <unistd.h>
+
 #include <glib.h>
+#include <glib/gstdio.h>
 #include "system-timezone.h"
 
+#define BENCHMARK_ZONES_PER_AREA 50
+#define BENCHMARK_ZONE_SIZE      2048 /* about the size of a real one */
+
+typedef enum {
+	BENCHMARK_ETC_TIMEZONE,
+	BENCHMARK_SYSCONFIG,
+	BENCHMARK_SYMLINK,
+	BENCHMARK_HARDLINK,
+	BENCHMARK_CONTENT,
+	BENCHMARK_N_STRATEGIES
+} BenchmarkStrategy;
+
+static const char *benchmark_strategies[BENCHMARK_N_STRATEGIES] = {
+	"etc-timezone",
+	"sysconfig",
+	"symlink",
+	"hardlink",
+	"content"
+};
+
 static void
 timezone_print (void)
 {
@@ -72,6 +108,241 @@ timezone_monitor (void)
 	g_object_unref (systz);
 }
 
+static char *
+benchmark_zone_name (int i)
+{
+	return g_strdup_printf ("Area%02d/City%03d",
+				i / BENCHMARK_ZONES_PER_AREA,
+				i % BENCHMARK_ZONES_PER_AREA);
+}
+
+static gboolean
+benchmark_write (const char  *root,
+		 const char  *path,
+		 const char  *content,
+		 gssize       len,
+		 GError     **error)
+{
+	char     *filename;
+	char     *dirname;
+	gboolean  retval;
+
+	filename = g_build_filename (root, path, NULL);
+	dirname = g_path_get_dirname (filename);
+
+	g_mkdir_with_parents (dirname, 0755);
+	retval = g_file_set_contents (filename, content, len, error);
+
+	g_free (dirname);
+	g_free (filename);
+
+	return retval;
+}
+
+static void
+benchmark_remove_tree (const char *path)
+{
+	GDir       *dir;
+	const char *name;
+
+	dir = g_file_test (path, G_FILE_TEST_IS_SYMLINK) ? NULL : g_dir_open (path, 0, NULL);
+	if (dir) {
+		while ((name = g_dir_read_name (dir)) != NULL) {
+			char *child;
+
+			child = g_build_filename (path, name, NULL);
+			benchmark_remove_tree (child);
+			g_free (child);
+		}
+		g_dir_close (dir);
+	}
+
+	g_remove (path);
+}
+
+/* A zoneinfo directory of @n_zones distinct files, and the way of telling
+ * that the timezone is the last of them that @strategy is about */
+static char *
+benchmark_build_fixture (BenchmarkStrategy   strategy,
+			 int                 n_zones,
+			 char              **expected,
+			 GError            **error)
+{
+	char    *root;
+	char    *zone = NULL;
+	char    *zone_file = NULL;
+	char    *localtime_file;
+	char    *content;
+	GString *data;
+	int      i;
+
+	root = g_dir_make_tmp ("test-system-timezone-XXXXXX", error);
+	if (!root)
+		return NULL;
+
+	data = g_string_sized_new (BENCHMARK_ZONE_SIZE);
+
+	for (i = 0; i < n_zones; i++) {
+		g_free (zone);
+		zone = benchmark_zone_name (i);
+
+		g_string_assign (data, "TZif2");
+		while (data->len < BENCHMARK_ZONE_SIZE)
+			g_string_append_printf (data, " %s", zone);
+
+		g_free (zone_file);
+		zone_file = g_build_filename (SYSTEM_ZONEINFODIR, zone, NULL);
+
+		if (!benchmark_write (root, zone_file, data->str, data->len, error))
+			goto error;
+	}
+
+	if (!benchmark_write (root, SYSTEM_ZONEINFODIR"/zone.tab",
+			      "# fixture\n", -1, error))
+		goto error;
+
+	content = g_build_filename (root, "etc", NULL);
+	g_mkdir_with_parents (content, 0755);
+	g_free (content);
+
+	localtime_file = g_build_filename (root, "etc", "localtime", NULL);
+
+	switch (strategy) {
+	case BENCHMARK_ETC_TIMEZONE:
+		content = g_strdup_printf ("%s\n", zone);
+		if (!benchmark_write (root, "etc/timezone", content, -1, error)) {
+			g_free (content);
+			goto error_localtime;
+		}
+		g_free (content);
+		break;
+	case BENCHMARK_SYSCONFIG:
+		content = g_strdup_printf ("ZONE=\"%s\"\n", zone);
+		if (!benchmark_write (root, "etc/sysconfig/clock", content, -1, error)) {
+			g_free (content);
+			goto error_localtime;
+		}
+		g_free (content);
+		break;
+	case BENCHMARK_SYMLINK:
+		/* like on a system: the link is resolved under the root */
+		if (symlink (zone_file, localtime_file) != 0)
+			goto error_errno;
+		break;
+	case BENCHMARK_HARDLINK:
+		content = g_build_filename (root, zone_file, NULL);
+		if (link (content, localtime_file) != 0) {
+			g_free (content);
+			goto error_errno;
+		}
+		g_free (content);
+		break;
+	case BENCHMARK_CONTENT:
+		if (!benchmark_write (root, "etc/localtime", data->str, data->len, error))
+			goto error_localtime;
+		break;
+	default:
+		g_assert_not_reached ();
+	}
+
+	g_free (localtime_file);
+	g_free (zone_file);
+	g_string_free (data, TRUE);
+	*expected = zone;
+
+	return root;
+
+error_errno:
+	g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+		     "Cannot link %s: %s", localtime_file, g_strerror (errno));
+error_localtime:
+	g_free (localtime_file);
+error:
+	g_free (zone_file);
+	g_free (zone);
+	g_string_free (data, TRUE);
+	benchmark_remove_tree (root);
+	g_free (root);
+
+	return NULL;
+}
+
+static int
+timezone_benchmark (int n_zones,
+		    int iterations,
+		    int budget_ms)
+{
+	BenchmarkStrategy strategy;
+	guint             n_failed = 0;
+
+	for (strategy = 0; strategy < BENCHMARK_N_STRATEGIES; strategy++) {
+		GError  *error = NULL;
+		char    *root;
+		char    *expected = NULL;
+		char    *tz = NULL;
+		gint64   total = 0, first = 0, max = 0;
+		guint    opened_first = 0, opened = 0;
+		gboolean ok = TRUE;
+		int      i;
+
+		root = benchmark_build_fixture (strategy, n_zones, &expected, &error);
+		if (!root) {
+			g_printerr ("Cannot build the %s fixture: %s\n",
+				    benchmark_strategies[strategy], error->message);
+			g_error_free (error);
+			n_failed++;
+			continue;
+		}
+
+		for (i = 0; i < iterations; i++) {
+			gint64 start, elapsed;
+
+			g_free (tz);
+
+			start = g_get_monotonic_time ();
+			tz = system_timezone_find_in_root (root, &opened);
+			elapsed = g_get_monotonic_time () - start;
+
+			if (i == 0) {
+				first = elapsed;
+				opened_first = opened;
+			}
+			total += elapsed;
+			max = MAX (max, elapsed);
+
+			if (g_strcmp0 (tz, expected) != 0)
+				ok = FALSE;
+		}
+
+		if (total / iterations > (gint64) budget_ms * 1000)
+			ok = FALSE;
+
+		g_print ("timezone strategy=%s result=%s"
+			 " first_us=%" G_GINT64_FORMAT
+			 " avg_us=%" G_GINT64_FORMAT
+			 " max_us=%" G_GINT64_FORMAT
+			 " files_opened_first=%u files_opened=%u"
+			 " budget_us=%" G_GINT64_FORMAT " ok=%d\n",
+			 benchmark_strategies[strategy], tz,
+			 first, total / iterations, max,
+			 opened_first, opened,
+			 (gint64) budget_ms * 1000, ok);
+
+		if (!ok)
+			n_failed++;
+
+		benchmark_remove_tree (root);
+		g_free (root);
+		g_free (expected);
+		g_free (tz);
+	}
+
+	g_print ("timezones strategies=%d failed=%u\n",
+		 BENCHMARK_N_STRATEGIES, n_failed);
+
+	return n_failed > 0 ? 1 : 0;
+}
+
 int
 main (int    argc,
       char **argv)
@@ -80,6 +351,10 @@ main (int    argc,
 
 	gboolean  get = FALSE;
 	gboolean  monitor = FALSE;
+	gboolean  benchmark = FALSE;
+	int       zones = 600;
+	int       iterations = 20;
+	int       budget = 50;
 	char     *tz_set = NULL;
 
 	GError         *error;
@@ -88,6 +363,10 @@ main (int    argc,
                 { "get", 'g', 0, G_OPTION_ARG_NONE, &get, "Get the current timezone", NULL },
                 { "set", 's', 0, G_OPTION_ARG_STRING, &tz_set, "Set the timezone to TIMEZONE", "TIMEZONE" },
                 { "monitor", 'm', 0, G_OPTION_ARG_NONE, &monitor, "Monitor timezone changes", NULL },
+                { "benchmark", 'b', 0, G_OPTION_ARG_NONE, &benchmark, "Time the detection on fixtures", NULL },
+                { "zones", 0, 0, G_OPTION_ARG_INT, &zones, "Number of timezones in the fixtures", "N" },
+                { "iterations", 0, 0, G_OPTION_ARG_INT, &iterations, "Detections on each fixture", "N" },
+                { "budget", 0, 0, G_OPTION_ARG_INT, &budget, "Average time allowed for a detection", "MS" },
                 { NULL, 0, 0, 0, NULL, NULL, NULL }
         };
 
@@ -107,7 +386,14 @@ main (int    argc,
 
 	g_option_context_free (context);
 
-	if (get || (!tz_set && !monitor))
+	if (benchmark && (zones < 1 || iterations < 1 || budget < 0)) {
+		g_printerr ("--zones and --iterations must be positive, --budget must not be negative\n");
+		return 1;
+	}
+
+	if (benchmark)
+		retval = timezone_benchmark (zones, iterations, budget);
+	else if (get || (!tz_set && !monitor))
 		timezone_print ();
 	else if (tz_set)
 		retval = timezone_set (tz_set);
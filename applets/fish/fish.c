@@ -57,9 +57,36 @@
 #define FISH_SPEED_KEY   "speed"
 #define FISH_ROTATE_KEY  "rotate"
 
+/* the frames of the last sizes the applet had, to go back to them */
+#define FISH_FRAMES_CACHE_SIZE 4
+
 #define LOCKDOWN_SCHEMA                       "org.mate.lockdown"
 #define LOCKDOWN_DISABLE_COMMAND_LINE_KEY     "disable-command-line"
 
+/* the fortune dialog keeps the end of long outputs only */
+#define FISH_FORTUNE_MAX_CHARS (256 * 1024)
+#define FISH_FORTUNE_READ_SIZE 4096
+
+#define PRESENCE_DBUS_NAME      "org.gnome.SessionManager"
+#define PRESENCE_DBUS_PATH      "/org/gnome/SessionManager/Presence"
+#define PRESENCE_DBUS_INTERFACE "org.gnome.SessionManager.Presence"
+#define PRESENCE_STATUS_IDLE    3
+
+/* The animation, sliced into one surface per frame, for one image at one
+ * size: a tick only paints a frame. */
+typedef struct {
+	char                   *image;
+	int                     width;
+	int                     height;
+	int                     scale;
+	int                     n_frames;
+	MatePanelAppletOrient   orientation;
+	gboolean                rotate;
+	gboolean                april_fools;
+
+	cairo_surface_t       **surfaces;
+} FishFrames;
+
 typedef struct {
 	MatePanelApplet        applet;
 
@@ -79,15 +106,23 @@ typedef struct {
 	GtkWidget         *drawing_area;
 	GtkRequisition     requisition;
 	GdkRectangle       prev_allocation;
-	cairo_surface_t   *surface;
-	gint               surface_width;
-	gint               surface_height;
+	FishFrames        *frames;
+	GList             *frames_cache;
 
 	guint              timeout;
 	int                current_frame;
 	gboolean           in_applet;
 
+	/* the animation only runs while it can be seen */
+	gboolean           obscured;
+	gboolean           session_idle;
+	GDBusProxy        *presence;
+	GCancellable      *presence_cancellable;
+	guint              fools_timeout;
+
 	GdkPixbuf         *pixbuf;
+	/* fish->pixbuf converted once, for the strip renders */
+	cairo_surface_t   *pixbuf_surface;
 
 	GtkWidget         *preferences_dialog;
 	GtkWidget         *name_entry;
@@ -108,6 +143,11 @@ typedef struct {
 	unsigned int       source_id;
 	GIOChannel        *io_channel;
 
+	/* output read, but not yet shown in the fortune view */
+	GByteArray        *fortune_partial;
+	GString           *fortune_pending;
+	guint              fortune_tick_id;
+
 	gboolean           april_fools;
 } FishApplet;
 
@@ -116,6 +156,7 @@ typedef struct {
 } FishAppletClass;
 
 static gboolean load_fish_image          (FishApplet *fish);
+static void     clear_frames             (FishApplet *fish);
 static void     update_pixmap            (FishApplet *fish);
 static void     something_fishy_going_on (FishApplet *fish, const char *message);
 static void     display_fortune_dialog   (FishApplet *fish);
@@ -575,6 +616,10 @@ static void set_ally_name_desc(GtkWidget* widget, FishApplet* fish)
 	AtkObject  *obj;
 	char       *desc, *name;
 
+	/* a11y_enabled_changed() catches up once something listens */
+	if (!mate_panel_applet_get_a11y_enabled (MATE_PANEL_APPLET (fish)))
+		return;
+
 	obj = gtk_widget_get_accessible (widget);
 	/* Return immediately if GAIL is not loaded */
 	if (!GTK_IS_ACCESSIBLE (obj))
@@ -692,24 +737,48 @@ static void update_fortune_dialog(FishApplet* fish)
 	set_ally_name_desc (fish->fortune_view, fish);
 }
 
-static void insert_fortune_text(FishApplet* fish, const char* text)
+static void insert_fortune_text(FishApplet* fish, const char* text, gssize len)
 {
 	GtkTextIter iter;
+	GtkTextIter start;
+	gint        excess;
 
-	gtk_text_buffer_get_iter_at_offset (fish->fortune_buffer, &iter, -1);
+	gtk_text_buffer_get_end_iter (fish->fortune_buffer, &iter);
 
 	gtk_text_buffer_insert_with_tags_by_name (fish->fortune_buffer, &iter,
-						  text, -1, "monospace_tag",
+						  text, len, "monospace_tag",
 						  NULL);
 
-	while (gtk_events_pending ())
-	  gtk_main_iteration ();
+	/* drop the oldest lines, after the empty first one */
+	excess = gtk_text_buffer_get_char_count (fish->fortune_buffer) - FISH_FORTUNE_MAX_CHARS;
+	if (excess > 0) {
+		gtk_text_buffer_get_iter_at_offset (fish->fortune_buffer, &start, 1);
+		gtk_text_buffer_get_iter_at_offset (fish->fortune_buffer, &iter, excess + 1);
+		if (!gtk_text_iter_starts_line (&iter))
+			gtk_text_iter_forward_line (&iter);
+		gtk_text_buffer_delete (fish->fortune_buffer, &start, &iter);
+	}
+}
+
+static void clear_pending_fortune_text(FishApplet* fish)
+{
+	if (fish->fortune_tick_id && fish->fortune_view)
+		gtk_widget_remove_tick_callback (fish->fortune_view,
+						 fish->fortune_tick_id);
+	fish->fortune_tick_id = 0;
+
+	if (fish->fortune_partial)
+		g_byte_array_set_size (fish->fortune_partial, 0);
+	if (fish->fortune_pending)
+		g_string_truncate (fish->fortune_pending, 0);
 }
 
 static void clear_fortune_text(FishApplet* fish)
 {
 	GtkTextIter begin, end;
 
+	clear_pending_fortune_text (fish);
+
 	gtk_text_buffer_get_iter_at_offset (fish->fortune_buffer, &begin, 0);
 	gtk_text_buffer_get_iter_at_offset (fish->fortune_buffer, &end, -1);
 
@@ -718,12 +787,125 @@ static void clear_fortune_text(FishApplet* fish)
 					    "monospace_tag", &begin, &end);
 
 	/* insert an empty line */
-	insert_fortune_text (fish, "\n");
+	insert_fortune_text (fish, "\n", -1);
+}
+
+/* The text read since the last frame is inserted at once: a command
+ * writing a lot does not cost one insertion per read */
+static gboolean flush_fortune_text(GtkWidget* widget, GdkFrameClock* frame_clock, gpointer data)
+{
+	FishApplet *fish = (FishApplet *) data;
+
+	fish->fortune_tick_id = 0;
+
+	if (fish->fortune_pending->len > 0) {
+		insert_fortune_text (fish, fish->fortune_pending->str,
+				     fish->fortune_pending->len);
+		g_string_truncate (fish->fortune_pending, 0);
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+static void queue_fortune_text(FishApplet* fish, const char* text, gsize len)
+{
+	GString *pending = fish->fortune_pending;
+
+	g_string_append_len (pending, text, len);
+
+	/* what would be dropped from the view anyway is not kept */
+	if (pending->len > FISH_FORTUNE_MAX_CHARS * 4) {
+		const char *keep;
+
+		keep = g_utf8_find_next_char (pending->str + pending->len - FISH_FORTUNE_MAX_CHARS * 4 - 1,
+					      NULL);
+		g_string_erase (pending, 0, keep - pending->str);
+	}
+
+	if (!fish->fortune_tick_id)
+		fish->fortune_tick_id = gtk_widget_add_tick_callback (fish->fortune_view,
+								      flush_fortune_text,
+								      fish, NULL);
+}
+
+/* The output is not guarantied to be in UTF-8 format, most likely it's
+ * just in ASCII-7 or in the user locale. A character read in part is
+ * kept for the next read; what cannot be converted is replaced. */
+static void decode_fortune_output(FishApplet* fish, const char* data, gsize len)
+{
+	GByteArray *partial = fish->fortune_partial;
+	const char *p;
+	gsize       remaining;
+	gboolean    is_utf8;
+
+	g_byte_array_append (partial, (const guint8 *) data, len);
+
+	is_utf8 = g_get_charset (NULL);
+	p = (const char *) partial->data;
+	remaining = partial->len;
+
+	while (remaining > 0) {
+		const char *end;
+		gsize       valid;
+		gboolean    incomplete;
+
+		if (is_utf8) {
+			g_utf8_validate (p, remaining, &end);
+			valid = end - p;
+			if (valid > 0)
+				queue_fortune_text (fish, p, valid);
+
+			incomplete = (remaining - valid < 4 &&
+				      g_utf8_get_char_validated (end, remaining - valid) == (gunichar) -2);
+		} else {
+			GError *error = NULL;
+			char   *utf8;
+			gsize   bytes_read = 0;
+			gsize   bytes_written = 0;
+
+			/* a character cut at the end is not an error, it is
+			 * not counted in bytes_read */
+			utf8 = g_locale_to_utf8 (p, remaining, &bytes_read,
+						 &bytes_written, &error);
+			valid = bytes_read;
+			incomplete = (utf8 != NULL);
+
+			if (!utf8 && valid > 0)
+				utf8 = g_locale_to_utf8 (p, valid, NULL,
+							 &bytes_written, NULL);
+			if (utf8)
+				queue_fortune_text (fish, utf8, bytes_written);
+			g_free (utf8);
+
+			if (error &&
+			    !g_error_matches (error, G_CONVERT_ERROR,
+					      G_CONVERT_ERROR_ILLEGAL_SEQUENCE)) {
+				/* nothing can be converted */
+				g_error_free (error);
+				remaining = 0;
+				break;
+			}
+			g_clear_error (&error);
+		}
+
+		p += valid;
+		remaining -= valid;
+
+		/* the start of a character that the next read completes */
+		if (remaining == 0 || incomplete)
+			break;
+
+		queue_fortune_text (fish, "\xef\xbf\xbd", 3);
+		p++;
+		remaining--;
+	}
+
+	g_byte_array_remove_range (partial, 0, partial->len - remaining);
 }
 
 static gboolean fish_read_output(GIOChannel* source, GIOCondition condition, gpointer data)
 {
-	char        output[4096];
+	char        output[FISH_FORTUNE_READ_SIZE];
 	gsize       bytes_read;
 	GError     *error = NULL;
 	GIOStatus   status;
@@ -737,8 +919,8 @@ static gboolean fish_read_output(GIOChannel* source, GIOCondition condition, gpo
 		return FALSE;
 	}
 
-	status = g_io_channel_read_chars (source, output, 4096, &bytes_read,
-					  &error);
+	status = g_io_channel_read_chars (source, output, sizeof (output),
+					  &bytes_read, &error);
 
 	if (error) {
 		char *message;
@@ -756,23 +938,8 @@ static gboolean fish_read_output(GIOChannel* source, GIOCondition condition, gpo
 	if (status == G_IO_STATUS_AGAIN)
 		return TRUE;
 
-	if (bytes_read > 0) {
-		char *utf8_output;
-
-		/* The output is not guarantied to be in UTF-8 format, most
-		 * likely it's just in ASCII-7 or in the user locale
-		 */
-		if (!g_utf8_validate (output, -1, NULL))
-			utf8_output = g_locale_to_utf8 (output, bytes_read,
-							NULL, NULL, NULL);
-		else
-			utf8_output = g_strndup (output, bytes_read);
-
-		if (utf8_output)
-			insert_fortune_text (fish, utf8_output);
-
-		g_free (utf8_output);
-	}
+	if (bytes_read > 0)
+		decode_fortune_output (fish, output, bytes_read);
 
 	if (status == G_IO_STATUS_EOF) {
 		fish->source_id = 0;
@@ -815,7 +982,6 @@ static void display_fortune_dialog(FishApplet* fish)
 	GError      *error = NULL;
 	gboolean     user_command;
 	int          output;
-	const char  *charset;
 	int          argc;
 	char       **argv;
 	GdkDisplay  *display;
@@ -965,9 +1131,8 @@ static void display_fortune_dialog(FishApplet* fish)
 	}
 
 	fish->io_channel = g_io_channel_unix_new (output);
-	/* set the correct encoding if the locale is not using UTF-8 */
-	if (!g_get_charset (&charset))
-		g_io_channel_set_encoding(fish->io_channel, charset, &error);
+	/* read as bytes: decode_fortune_output() converts them */
+	g_io_channel_set_encoding (fish->io_channel, NULL, &error);
 	if (error) {
 		char *message;
 
@@ -1165,55 +1330,215 @@ static void init_fools_day(void)
 		}
 }
 
+static gboolean is_fools_time(struct tm *tm)
+{
+	return tm->tm_mon  == fools_month      &&
+	       tm->tm_mday == fools_day        &&
+	       tm->tm_hour >= fools_hour_start &&
+	       tm->tm_hour <  fools_hour_end;
+}
+
+/* The next time is_fools_time() can change: when the jokes start or
+ * stop on fools day, else the next midnight */
+static guint seconds_to_fools_change(time_t now, struct tm *tm)
+{
+	struct tm next = *tm;
+	time_t    then;
+
+	next.tm_min   = 0;
+	next.tm_sec   = 0;
+	next.tm_isdst = -1;
+
+	if (tm->tm_mon == fools_month && tm->tm_mday == fools_day &&
+	    tm->tm_hour < fools_hour_start)
+		next.tm_hour = fools_hour_start;
+	else if (tm->tm_mon == fools_month && tm->tm_mday == fools_day &&
+		 tm->tm_hour < fools_hour_end)
+		next.tm_hour = fools_hour_end;
+	else {
+		next.tm_mday++;
+		next.tm_hour = 0;
+	}
+
+	then = mktime (&next);
+	if (then <= now)
+		return 60;
+
+	/* a clock set forward is caught up within the hour */
+	return MIN (then - now, 60 * 60);
+}
+
+static void update_timeout(FishApplet* fish);
+
+static gboolean fools_timeout_handler(gpointer data);
+
 static void check_april_fools(FishApplet* fish)
 {
-	struct tm *tm;
-	time_t     now;
+	struct tm tm;
+	time_t    now;
+	gboolean  april_fools;
 
 	time (&now);
-	tm = localtime (&now);
+	localtime_r (&now, &tm);
 
-	if (fish->april_fools &&
-	    (tm->tm_mon  != fools_month ||
-	     tm->tm_mday != fools_day   ||
-	     tm->tm_hour >= fools_hour_end)) {
-		fish->april_fools = FALSE;
-		update_pixmap (fish);
-	} else if (tm->tm_mon  == fools_month    &&
-		 tm->tm_mday == fools_day        &&
-		 tm->tm_hour >= fools_hour_start &&
-		 tm->tm_hour <= fools_hour_end) {
-		fish->april_fools = TRUE;
-		update_pixmap (fish);
-	}
+	april_fools = is_fools_time (&tm);
+
+	if (fish->fools_timeout)
+		g_source_remove (fish->fools_timeout);
+	fish->fools_timeout = g_timeout_add_seconds (seconds_to_fools_change (now, &tm),
+						     fools_timeout_handler,
+						     fish);
+
+	if (fish->april_fools == april_fools)
+		return;
+
+	fish->april_fools = april_fools;
+	update_pixmap (fish);
+	update_timeout (fish);
+	gtk_widget_queue_draw (fish->drawing_area);
 }
 
-static gboolean timeout_handler(gpointer data)
+static gboolean fools_timeout_handler(gpointer data)
 {
 	FishApplet *fish = (FishApplet *) data;
 
+	fish->fools_timeout = 0;
 	check_april_fools (fish);
 
-	if (fish->april_fools)
-		return TRUE;
+	return FALSE;
+}
+
+static gboolean timeout_handler(gpointer data)
+{
+	FishApplet *fish = (FishApplet *) data;
 
 	fish->current_frame++;
 	if (fish->current_frame >= fish->n_frames)
 		fish->current_frame = 0;
 
+	/* painted on the next frame of the frame clock */
 	gtk_widget_queue_draw (fish->drawing_area);
 
 	return TRUE;
 }
 
+/* Nobody looks at a fish that is not mapped, hidden behind something,
+ * on a hidden panel or in an idle session: it does not wake up then */
+static gboolean animation_is_visible(FishApplet* fish)
+{
+	return fish->drawing_area != NULL &&
+	       gtk_widget_get_mapped (fish->drawing_area) &&
+	       !fish->obscured &&
+	       !fish->session_idle &&
+	       !fish->april_fools &&
+	       fish->speed > 0;
+}
+
+/* The low-power profile keeps the fish still, the balanced one swims at
+ * half the pace */
+static guint animation_interval(FishApplet* fish)
+{
+	switch (mate_panel_applet_get_power_profile (MATE_PANEL_APPLET (fish))) {
+	case MATE_PANEL_APPLET_POWER_PROFILE_LOW_POWER:
+		return 0;
+	case MATE_PANEL_APPLET_POWER_PROFILE_BALANCED:
+		return fish->speed * 2000;
+	default:
+		return fish->speed * 1000;
+	}
+}
+
+static void update_timeout(FishApplet* fish)
+{
+	guint interval;
+
+	interval = animation_interval (fish);
+
+	if (animation_is_visible (fish) && interval > 0) {
+		if (!fish->timeout)
+			fish->timeout = g_timeout_add (interval,
+						       timeout_handler,
+						       fish);
+	} else if (fish->timeout) {
+		g_source_remove (fish->timeout);
+		fish->timeout = 0;
+	}
+}
+
+static void a11y_enabled_changed(FishApplet* fish)
+{
+	set_ally_name_desc (GTK_WIDGET (fish), fish);
+
+	if (fish->fortune_view)
+		set_ally_name_desc (fish->fortune_view, fish);
+}
+
 static void setup_timeout(FishApplet *fish)
 {
 	if (fish->timeout)
 		g_source_remove (fish->timeout);
+	fish->timeout = 0;
+
+	update_timeout (fish);
+}
 
-	fish->timeout = g_timeout_add (fish->speed * 1000,
-				       timeout_handler,
-				       fish);
+static void presence_status_changed(FishApplet* fish, guint status)
+{
+	fish->session_idle = (status == PRESENCE_STATUS_IDLE);
+	update_timeout (fish);
+}
+
+static void presence_signal(GDBusProxy* proxy, gchar* sender_name, gchar* signal_name, GVariant* parameters, FishApplet* fish)
+{
+	guint status;
+
+	if (g_strcmp0 (signal_name, "StatusChanged") != 0 ||
+	    !g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(u)")))
+		return;
+
+	g_variant_get (parameters, "(u)", &status);
+	presence_status_changed (fish, status);
+}
+
+static void presence_proxy_ready(GObject* source, GAsyncResult* result, gpointer data)
+{
+	GDBusProxy *proxy;
+	GVariant   *status;
+	FishApplet *fish;
+
+	/* no session manager: the session is never idle */
+	proxy = g_dbus_proxy_new_for_bus_finish (result, NULL);
+	if (!proxy)
+		return;
+
+	fish = FISH_APPLET (data);
+	fish->presence = proxy;
+	g_clear_object (&fish->presence_cancellable);
+
+	g_signal_connect (proxy, "g-signal",
+			  G_CALLBACK (presence_signal), fish);
+
+	status = g_dbus_proxy_get_cached_property (proxy, "status");
+	if (status) {
+		if (g_variant_is_of_type (status, G_VARIANT_TYPE_UINT32))
+			presence_status_changed (fish, g_variant_get_uint32 (status));
+		g_variant_unref (status);
+	}
+}
+
+static void setup_presence(FishApplet* fish)
+{
+	fish->presence_cancellable = g_cancellable_new ();
+
+	g_dbus_proxy_new_for_bus (G_BUS_TYPE_SESSION,
+				  G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START,
+				  NULL,
+				  PRESENCE_DBUS_NAME,
+				  PRESENCE_DBUS_PATH,
+				  PRESENCE_DBUS_INTERFACE,
+				  fish->presence_cancellable,
+				  presence_proxy_ready,
+				  fish);
 }
 
 static void speed_changed_notify(GSettings* settings, gchar* key, FishApplet* fish)
@@ -1324,6 +1649,10 @@ static gboolean load_fish_image(FishApplet* fish)
 	if (fish->pixbuf)
 		g_object_unref (fish->pixbuf);
 	fish->pixbuf = pixbuf;
+	g_clear_pointer (&fish->pixbuf_surface, cairo_surface_destroy);
+
+	/* the file may have changed since the frames were made */
+	clear_frames (fish);
 
 	if (fish->preview_image)
 		gtk_image_set_from_pixbuf (GTK_IMAGE (fish->preview_image),
@@ -1341,6 +1670,181 @@ update_pixmap_in_idle (gpointer data)
 	return FALSE;
 }
 
+static void fish_frames_free(FishFrames* frames)
+{
+	int i;
+
+	for (i = 0; i < frames->n_frames; i++)
+		cairo_surface_destroy (frames->surfaces[i]);
+	g_free (frames->surfaces);
+	g_free (frames->image);
+	g_free (frames);
+}
+
+static void clear_frames(FishApplet* fish)
+{
+	g_list_free_full (fish->frames_cache, (GDestroyNotify) fish_frames_free);
+	fish->frames_cache = NULL;
+	fish->frames = NULL;
+}
+
+static FishFrames* lookup_frames(FishApplet* fish, int width, int height, int scale, gboolean rotate)
+{
+	GList *l;
+
+	for (l = fish->frames_cache; l; l = l->next) {
+		FishFrames *frames = l->data;
+
+		if (frames->width == width &&
+		    frames->height == height &&
+		    frames->scale == scale &&
+		    frames->n_frames == fish->n_frames &&
+		    frames->orientation == fish->orientation &&
+		    frames->rotate == rotate &&
+		    frames->april_fools == fish->april_fools &&
+		    g_strcmp0 (frames->image, fish->image) == 0) {
+			/* most recently used first */
+			fish->frames_cache = g_list_remove_link (fish->frames_cache, l);
+			fish->frames_cache = g_list_concat (l, fish->frames_cache);
+			return frames;
+		}
+	}
+
+	return NULL;
+}
+
+/* The image is a strip of frames: the strip is drawn once at the size of
+ * the applet, then cut into the frames. */
+static cairo_surface_t* render_strip(FishApplet* fish, int width, int height, gboolean rotate)
+{
+	cairo_surface_t *surface;
+	cairo_t         *cr;
+	cairo_matrix_t   matrix;
+	cairo_pattern_t *pattern;
+	int              pixbuf_width;
+	int              pixbuf_height;
+
+	pixbuf_width  = gdk_pixbuf_get_width  (fish->pixbuf);
+	pixbuf_height = gdk_pixbuf_get_height (fish->pixbuf);
+
+	surface = gdk_window_create_similar_surface (gtk_widget_get_window (fish->drawing_area),
+						     CAIRO_CONTENT_COLOR_ALPHA,
+						     width, height);
+
+	cr = cairo_create (surface);
+
+	cairo_set_source_rgb (cr, 1, 1, 1);
+	cairo_paint (cr);
+
+	if (!fish->pixbuf_surface)
+		fish->pixbuf_surface = gdk_cairo_surface_create_from_pixbuf (fish->pixbuf, 1, NULL);
+
+	cairo_set_source_surface (cr, fish->pixbuf_surface, 0, 0);
+	pattern = cairo_get_source (cr);
+	cairo_pattern_set_filter (pattern, CAIRO_FILTER_BEST);
+
+	cairo_matrix_init_identity (&matrix);
+
+	if (fish->april_fools) {
+		cairo_matrix_translate (&matrix,
+					pixbuf_width - 1, pixbuf_height - 1);
+		cairo_matrix_rotate (&matrix, G_PI);
+	}
+
+	if (rotate) {
+		if (fish->orientation == MATE_PANEL_APPLET_ORIENT_RIGHT) {
+			cairo_matrix_translate (&matrix, pixbuf_width - 1, 0);
+			cairo_matrix_rotate (&matrix, G_PI_2);
+		} else {
+			cairo_matrix_translate (&matrix, 0, pixbuf_height - 1);
+			cairo_matrix_rotate (&matrix, G_PI * 1.5);
+		}
+		cairo_matrix_scale (&matrix,
+				    (double) (pixbuf_height - 1) / width,
+				    (double) (pixbuf_width - 1) / height);
+	} else {
+		cairo_matrix_scale (&matrix,
+				    (double) (pixbuf_width - 1) / width,
+				    (double) (pixbuf_height - 1) / height);
+	}
+
+	cairo_pattern_set_matrix (pattern, &matrix);
+
+	cairo_rectangle (cr, 0, 0, width, height);
+	cairo_fill (cr);
+
+	if (fish->april_fools) {
+		cairo_set_source_rgb (cr, 1, 0.5, 0);
+		cairo_paint_with_alpha (cr, 0.25);
+	}
+
+	cairo_destroy (cr);
+
+	return surface;
+}
+
+static FishFrames* render_frames(FishApplet* fish, int width, int height, int scale, gboolean rotate)
+{
+	FishFrames      *frames;
+	cairo_surface_t *strip;
+	GList           *last;
+	int              frame_width;
+	int              frame_height;
+	int              i;
+
+	strip = render_strip (fish, width, height, rotate);
+
+	frames = g_new0 (FishFrames, 1);
+	frames->image       = g_strdup (fish->image);
+	frames->width       = width;
+	frames->height      = height;
+	frames->scale       = scale;
+	frames->n_frames    = fish->n_frames;
+	frames->orientation = fish->orientation;
+	frames->rotate      = rotate;
+	frames->april_fools = fish->april_fools;
+	frames->surfaces    = g_new0 (cairo_surface_t *, fish->n_frames);
+
+	frame_width  = rotate ? width : MAX (1, width / fish->n_frames);
+	frame_height = rotate ? MAX (1, height / fish->n_frames) : height;
+
+	for (i = 0; i < fish->n_frames; i++) {
+		cairo_t *cr;
+		int      src_x = 0;
+		int      src_y = 0;
+
+		/* turned to the right, the strip goes upwards */
+		if (!rotate)
+			src_x = (width * i) / fish->n_frames;
+		else if (fish->orientation == MATE_PANEL_APPLET_ORIENT_RIGHT)
+			src_y = (height * (fish->n_frames - 1 - i)) / fish->n_frames;
+		else
+			src_y = (height * i) / fish->n_frames;
+
+		frames->surfaces[i] = cairo_surface_create_similar (strip,
+								    CAIRO_CONTENT_COLOR_ALPHA,
+								    frame_width, frame_height);
+
+		cr = cairo_create (frames->surfaces[i]);
+		cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+		cairo_set_source_surface (cr, strip, -src_x, -src_y);
+		cairo_paint (cr);
+		cairo_destroy (cr);
+	}
+
+	cairo_surface_destroy (strip);
+
+	fish->frames_cache = g_list_prepend (fish->frames_cache, frames);
+
+	if (g_list_length (fish->frames_cache) > FISH_FRAMES_CACHE_SIZE) {
+		last = g_list_last (fish->frames_cache);
+		fish_frames_free (last->data);
+		fish->frames_cache = g_list_delete_link (fish->frames_cache, last);
+	}
+
+	return frames;
+}
+
 static void update_pixmap(FishApplet* fish)
 {
 	GtkWidget     *widget = fish->drawing_area;
@@ -1350,10 +1854,8 @@ static void update_pixmap(FishApplet* fish)
 	int            height = -1;
 	int            pixbuf_width = -1;
 	int            pixbuf_height = -1;
+	int            scale;
 	gboolean       rotate = FALSE;
-	cairo_t       *cr;
-	cairo_matrix_t matrix;
-	cairo_pattern_t *pattern;
 
 	gtk_widget_get_allocation (widget, &allocation);
 
@@ -1407,91 +1909,25 @@ static void update_pixmap(FishApplet* fish)
 	if (width == 0 || height == 0)
 		return;
 
-	if (fish->surface)
-		cairo_surface_destroy (fish->surface);
-	fish->surface = gdk_window_create_similar_surface (gtk_widget_get_window (widget),
-													   CAIRO_CONTENT_COLOR_ALPHA,
-													   width, height);
-	fish->surface_width = width;
-	fish->surface_height = height;
-
-	gtk_widget_queue_resize (widget);
-
-	g_assert (pixbuf_width != -1 && pixbuf_height != -1);
+	scale = gtk_widget_get_scale_factor (widget);
 
-	cr = cairo_create (fish->surface);
+	fish->frames = lookup_frames (fish, width, height, scale, rotate);
+	if (!fish->frames)
+		fish->frames = render_frames (fish, width, height, scale, rotate);
 
-	cairo_set_source_rgb (cr, 1, 1, 1);
-	cairo_paint (cr);
-
-	gdk_cairo_set_source_pixbuf (cr, fish->pixbuf, 0, 0);
-	pattern = cairo_get_source (cr);
-	cairo_pattern_set_filter (pattern, CAIRO_FILTER_BEST);
-
-	cairo_matrix_init_identity (&matrix);
-
-	if (fish->april_fools) {
-		cairo_matrix_translate (&matrix,
-					pixbuf_width - 1, pixbuf_height - 1);
-		cairo_matrix_rotate (&matrix, G_PI);
-	}
-
-	if (rotate) {
-		if (fish->orientation == MATE_PANEL_APPLET_ORIENT_RIGHT) {
-			cairo_matrix_translate (&matrix, pixbuf_width - 1, 0);
-			cairo_matrix_rotate (&matrix, G_PI_2);
-		} else {
-			cairo_matrix_translate (&matrix, 0, pixbuf_height - 1);
-			cairo_matrix_rotate (&matrix, G_PI * 1.5);
-		}
-		cairo_matrix_scale (&matrix,
-				    (double) (pixbuf_height - 1) / width,
-				    (double) (pixbuf_width - 1) / height);
-	} else {
-		cairo_matrix_scale (&matrix,
-				    (double) (pixbuf_width - 1) / width,
-				    (double) (pixbuf_height - 1) / height);
-	}
-
-	cairo_pattern_set_matrix (pattern, &matrix);
-
-	cairo_rectangle (cr, 0, 0, width, height);
-	cairo_fill (cr);
-
-	if (fish->april_fools) {
-		cairo_set_source_rgb (cr, 1, 0.5, 0);
-		cairo_paint_with_alpha (cr, 0.25);
-	}
-
-	cairo_destroy (cr);
+	gtk_widget_queue_resize (widget);
 }
 
 static gboolean fish_applet_draw(GtkWidget* widget, cairo_t *cr, FishApplet* fish)
 {
-	int width, height;
-	int src_x, src_y;
-
-	g_return_val_if_fail (fish->surface != NULL, FALSE);
-
-	g_assert (fish->n_frames > 0);
+	g_return_val_if_fail (fish->frames != NULL, FALSE);
 
-	width = fish->surface_width;
-	height = fish->surface_height;
-	src_x = 0;
-	src_y = 0;
-
-	if (fish->rotate) {
-		if (fish->orientation == MATE_PANEL_APPLET_ORIENT_RIGHT)
-			src_y += ((height * (fish->n_frames - 1 - fish->current_frame)) / fish->n_frames);
-		else if (fish->orientation == MATE_PANEL_APPLET_ORIENT_LEFT)
-			src_y += ((height * fish->current_frame) / fish->n_frames);
-		else
-			src_x += ((width * fish->current_frame) / fish->n_frames);
-	} else
-		src_x += ((width * fish->current_frame) / fish->n_frames);
+	g_assert (fish->frames->n_frames > 0);
 
 	cairo_save (cr);
-	cairo_set_source_surface (cr, fish->surface, -src_x, -src_y);
+	cairo_set_source_surface (cr,
+				  fish->frames->surfaces[fish->current_frame % fish->frames->n_frames],
+				  0, 0);
 	cairo_paint (cr);
 	cairo_restore (cr);
 
@@ -1508,19 +1944,37 @@ static void fish_applet_size_allocate(GtkWidget* widget, GtkAllocation* allocati
 	g_idle_add (update_pixmap_in_idle, fish);
 }
 
+/* Moved to a monitor with another scale: the frames of the previous one
+ * stay in the cache, for when the applet comes back */
+static void fish_applet_scale_factor_changed(GtkWidget* widget, GParamSpec* pspec, FishApplet* fish)
+{
+	if (fish->frames)
+		g_idle_add (update_pixmap_in_idle, fish);
+}
+
 static void fish_applet_realize(GtkWidget* widget, FishApplet* fish)
 {
-	if (!fish->surface)
+	if (!fish->frames)
 		update_pixmap (fish);
 }
 
+static void fish_applet_map_changed(GtkWidget* widget, FishApplet* fish)
+{
+	update_timeout (fish);
+}
+
+static gboolean fish_applet_visibility_notify(GtkWidget* widget, GdkEventVisibility* event, FishApplet* fish)
+{
+	fish->obscured = (event->state == GDK_VISIBILITY_FULLY_OBSCURED);
+	update_timeout (fish);
+
+	return FALSE;
+}
+
 static void fish_applet_unrealize(GtkWidget* widget, FishApplet* fish)
 {
-	if (fish->surface)
-		cairo_surface_destroy (fish->surface);
-	fish->surface = NULL;
-	fish->surface_width = 0;
-	fish->surface_height = 0;
+	/* the frames are made for the window */
+	clear_frames (fish);
 }
 
 static void fish_applet_change_orient(MatePanelApplet* applet, MatePanelAppletOrient orientation)
@@ -1532,7 +1986,7 @@ static void fish_applet_change_orient(MatePanelApplet* applet, MatePanelAppletOr
 
 	fish->orientation = orientation;
 
-	if (fish->surface)
+	if (fish->frames)
 		update_pixmap (fish);
 }
 
@@ -1652,8 +2106,19 @@ static void setup_fish_widget(FishApplet* fish)
 			  G_CALLBACK (fish_applet_unrealize), fish);
 	g_signal_connect (fish->drawing_area, "size-allocate",
 			  G_CALLBACK (fish_applet_size_allocate), fish);
+	g_signal_connect (fish->drawing_area, "notify::scale-factor",
+			  G_CALLBACK (fish_applet_scale_factor_changed), fish);
 	g_signal_connect (fish->drawing_area, "draw",
 			  G_CALLBACK (fish_applet_draw), fish);
+	g_signal_connect_after (fish->drawing_area, "map",
+				G_CALLBACK (fish_applet_map_changed), fish);
+	g_signal_connect_after (fish->drawing_area, "unmap",
+				G_CALLBACK (fish_applet_map_changed), fish);
+
+	/* an auto-hidden panel moves the applet off the screen */
+	gtk_widget_add_events (fish->drawing_area, GDK_VISIBILITY_NOTIFY_MASK);
+	g_signal_connect (fish->drawing_area, "visibility-notify-event",
+			  G_CALLBACK (fish_applet_visibility_notify), fish);
 
 	gtk_widget_add_events (widget, GDK_ENTER_NOTIFY_MASK |
 				       GDK_LEAVE_NOTIFY_MASK |
@@ -1672,15 +2137,22 @@ static void setup_fish_widget(FishApplet* fish)
 
 	load_fish_image (fish);
 
+	check_april_fools (fish);
+
 	update_pixmap (fish);
 
 	setup_timeout (fish);
+	setup_presence (fish);
 
 	set_tooltip (fish);
 	set_ally_name_desc (GTK_WIDGET (fish), fish);
 
 	g_signal_connect (fish, "key-press-event",
 			  G_CALLBACK (handle_keypress), fish);
+	g_signal_connect_swapped (fish, "notify::power-profile",
+				  G_CALLBACK (setup_timeout), fish);
+	g_signal_connect_swapped (fish, "notify::a11y-enabled",
+				  G_CALLBACK (a11y_enabled_changed), fish);
 
 	gtk_widget_show_all (widget);
 }
@@ -1780,27 +2252,47 @@ static void fish_applet_dispose (GObject *object)
 		g_source_remove (fish->timeout);
 	fish->timeout = 0;
 
+	if (fish->fools_timeout)
+		g_source_remove (fish->fools_timeout);
+	fish->fools_timeout = 0;
+
+	if (fish->presence_cancellable)
+		g_cancellable_cancel (fish->presence_cancellable);
+	g_clear_object (&fish->presence_cancellable);
+
+	if (fish->presence)
+		g_signal_handlers_disconnect_by_data (fish->presence, fish);
+	g_clear_object (&fish->presence);
+
 	g_clear_object (&fish->settings);
 	g_clear_object (&fish->lockdown_settings);
 	g_clear_pointer (&fish->name, g_free);
 	g_clear_pointer (&fish->image, g_free);
 	g_clear_pointer (&fish->command, g_free);
 
-	if (fish->surface)
-		cairo_surface_destroy (fish->surface);
-	fish->surface = NULL;
-	fish->surface_width = 0;
-	fish->surface_height = 0;
+	clear_frames (fish);
 
 	g_clear_object (&fish->pixbuf);
+	g_clear_pointer (&fish->pixbuf_surface, cairo_surface_destroy);
 
 	if (fish->preferences_dialog)
 		gtk_widget_destroy (fish->preferences_dialog);
 	fish->preferences_dialog = NULL;
 
+	clear_pending_fortune_text (fish);
+
 	if (fish->fortune_dialog)
 		gtk_widget_destroy (fish->fortune_dialog);
 	fish->fortune_dialog = NULL;
+	fish->fortune_view = NULL;
+
+	if (fish->fortune_partial)
+		g_byte_array_unref (fish->fortune_partial);
+	fish->fortune_partial = NULL;
+
+	if (fish->fortune_pending)
+		g_string_free (fish->fortune_pending, TRUE);
+	fish->fortune_pending = NULL;
 
 	if (fish->source_id)
 		g_source_remove (fish->source_id);
@@ -1824,10 +2316,14 @@ static void fish_applet_instance_init(FishApplet* fish, FishAppletClass* klass)
 
 	fish->frame         = NULL;
 	fish->drawing_area  = NULL;
-	fish->surface       = NULL;
+	fish->frames        = NULL;
+	fish->frames_cache  = NULL;
 	fish->timeout       = 0;
 	fish->current_frame = 0;
 	fish->in_applet     = FALSE;
+	fish->obscured      = FALSE;
+	fish->session_idle  = FALSE;
+	fish->fools_timeout = 0;
 
 	fish->requisition.width  = -1;
 	fish->requisition.height = -1;
@@ -1838,6 +2334,7 @@ static void fish_applet_instance_init(FishApplet* fish, FishAppletClass* klass)
 	fish->prev_allocation.height = -1;
 
 	fish->pixbuf = NULL;
+	fish->pixbuf_surface = NULL;
 
 	fish->preferences_dialog = NULL;
 	fish->name_entry         = NULL;
@@ -1858,6 +2355,10 @@ static void fish_applet_instance_init(FishApplet* fish, FishAppletClass* klass)
 	fish->source_id  = 0;
 	fish->io_channel = NULL;
 
+	fish->fortune_partial = g_byte_array_new ();
+	fish->fortune_pending = g_string_new (NULL);
+	fish->fortune_tick_id = 0;
+
 	fish->april_fools = FALSE;
 
 	mate_panel_applet_set_flags (MATE_PANEL_APPLET (fish), MATE_PANEL_APPLET_EXPAND_MINOR);
@@ -25,8 +25,13 @@ struct _GfSnWatcherV0
 
   guint                     bus_name_id;
 
-  GSList                   *hosts;
-  GSList                   *items;
+  /* bus name + object path -> GfWatch */
+  GHashTable               *hosts;
+  GHashTable               *items;
+
+  /* the items in registration order, for RegisteredItems */
+  GQueue                    item_queue;
+  guint                     update_items_id;
 };
 
 typedef enum
@@ -44,6 +49,10 @@ typedef struct
   gchar         *bus_name;
   gchar         *object_path;
   guint          watch_id;
+
+  /* bus_name and object_path together, as items are announced */
+  gchar         *key;
+  GList         *link;
 } GfWatch;
 
 static void gf_sn_watcher_v0_gen_init (GfSnWatcherV0GenIface *iface);
@@ -51,34 +60,36 @@ static void gf_sn_watcher_v0_gen_init (GfSnWatcherV0GenIface *iface);
 G_DEFINE_TYPE_WITH_CODE (GfSnWatcherV0, gf_sn_watcher_v0, GF_TYPE_SN_WATCHER_V0_GEN_SKELETON,
                          G_IMPLEMENT_INTERFACE (GF_TYPE_SN_WATCHER_V0_GEN, gf_sn_watcher_v0_gen_init))
 
-static void
-update_registered_items (GfSnWatcherV0 *v0)
+static gboolean
+update_registered_items_cb (gpointer user_data)
 {
-  GVariantBuilder builder;
-  GSList *l;
-  GVariant *variant;
+  GfSnWatcherV0 *v0;
   const gchar **items;
+  GList *l;
+  guint i;
 
-  g_variant_builder_init (&builder, G_VARIANT_TYPE ("as"));
-
-  for (l = v0->items; l != NULL; l = g_slist_next (l))
-    {
-      GfWatch *watch;
-      gchar *item;
-
-      watch = (GfWatch *) l->data;
+  v0 = GF_SN_WATCHER_V0 (user_data);
+  v0->update_items_id = 0;
 
-      item = g_strdup_printf ("%s%s", watch->bus_name, watch->object_path);
-      g_variant_builder_add (&builder, "s", item);
-      g_free (item);
-    }
+  items = g_new (const gchar *, v0->item_queue.length + 1);
 
-  variant = g_variant_builder_end (&builder);
-  items = g_variant_get_strv (variant, NULL);
+  for (l = v0->item_queue.head, i = 0; l != NULL; l = l->next, i++)
+    items[i] = ((GfWatch *) l->data)->key;
+  items[i] = NULL;
 
   gf_sn_watcher_v0_gen_set_registered_items (GF_SN_WATCHER_V0_GEN (v0), items);
-  g_variant_unref (variant);
   g_free (items);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Items tend to come and go in bursts, when a session starts or a bus
+ * connection drops: build the list once for all of them */
+static void
+update_registered_items (GfSnWatcherV0 *v0)
+{
+  if (v0->update_items_id == 0)
+    v0->update_items_id = g_idle_add (update_registered_items_cb, v0);
 }
 
 static void
@@ -94,6 +105,7 @@ gf_watch_free (gpointer data)
   g_free (watch->service);
   g_free (watch->bus_name);
   g_free (watch->object_path);
+  g_free (watch->key);
 
   g_free (watch);
 }
@@ -113,9 +125,9 @@ name_vanished_cb (GDBusConnection *connection,
 
   if (watch->type == GF_WATCH_TYPE_HOST)
     {
-      v0->hosts = g_slist_remove (v0->hosts, watch);
+      g_hash_table_steal (v0->hosts, watch->key);
 
-      if (v0->hosts == NULL)
+      if (g_hash_table_size (v0->hosts) == 0)
         {
           gf_sn_watcher_v0_gen_set_is_host_registered (gen, FALSE);
           gf_sn_watcher_v0_gen_emit_host_registered (gen);
@@ -123,15 +135,12 @@ name_vanished_cb (GDBusConnection *connection,
     }
   else if (watch->type == GF_WATCH_TYPE_ITEM)
     {
-      gchar *tmp;
-
-      v0->items = g_slist_remove (v0->items, watch);
+      g_hash_table_steal (v0->items, watch->key);
+      g_queue_delete_link (&v0->item_queue, watch->link);
 
       update_registered_items (v0);
 
-      tmp = g_strdup_printf ("%s%s", watch->bus_name, watch->object_path);
-      gf_sn_watcher_v0_gen_emit_item_unregistered (gen, tmp);
-      g_free (tmp);
+      gf_sn_watcher_v0_gen_emit_item_unregistered (gen, watch->key);
     }
   else
     {
@@ -158,6 +167,7 @@ gf_watch_new (GfSnWatcherV0 *v0,
   watch->service = g_strdup (service);
   watch->bus_name = g_strdup (bus_name);
   watch->object_path = g_strdup (object_path);
+  watch->key = g_strconcat (bus_name, object_path, NULL);
   watch->watch_id = g_bus_watch_name (G_BUS_TYPE_SESSION, bus_name,
                                       G_BUS_NAME_WATCHER_FLAGS_NONE, NULL,
                                       name_vanished_cb, watch, NULL);
@@ -166,26 +176,18 @@ gf_watch_new (GfSnWatcherV0 *v0,
 }
 
 static GfWatch *
-gf_watch_find (GSList      *list,
+gf_watch_find (GHashTable  *table,
                const gchar *bus_name,
                const gchar *object_path)
 {
-  GSList *l;
-
-  for (l = list; l != NULL; l = g_slist_next (l))
-    {
-      GfWatch *watch;
-
-      watch = (GfWatch *) l->data;
+  GfWatch *watch;
+  gchar *key;
 
-      if (g_strcmp0 (watch->bus_name, bus_name) == 0 &&
-          g_strcmp0 (watch->object_path, object_path) == 0)
-        {
-          return watch;
-        }
-    }
+  key = g_strconcat (bus_name, object_path, NULL);
+  watch = g_hash_table_lookup (table, key);
+  g_free (key);
 
-  return NULL;
+  return watch;
 }
 
 static gboolean
@@ -234,7 +236,7 @@ gf_sn_watcher_v0_handle_register_host (GfSnWatcherV0Gen      *object,
     }
 
   watch = gf_watch_new (v0, GF_WATCH_TYPE_HOST, service, bus_name, object_path);
-  v0->hosts = g_slist_prepend (v0->hosts, watch);
+  g_hash_table_insert (v0->hosts, watch->key, watch);
 
   if (!gf_sn_watcher_v0_gen_get_is_host_registered (object))
     {
@@ -256,7 +258,6 @@ gf_sn_watcher_v0_handle_register_item (GfSnWatcherV0Gen      *object,
   const gchar *bus_name;
   const gchar *object_path;
   GfWatch *watch;
-  gchar *tmp;
 
   v0 = GF_SN_WATCHER_V0 (object);
 
@@ -308,13 +309,13 @@ gf_sn_watcher_v0_handle_register_item (GfSnWatcherV0Gen      *object,
     }
 
   watch = gf_watch_new (v0, GF_WATCH_TYPE_ITEM, service, bus_name, object_path);
-  v0->items = g_slist_prepend (v0->items, watch);
+  g_hash_table_insert (v0->items, watch->key, watch);
+  g_queue_push_head (&v0->item_queue, watch);
+  watch->link = v0->item_queue.head;
 
   update_registered_items (v0);
 
-  tmp = g_strdup_printf ("%s%s", bus_name, object_path);
-  gf_sn_watcher_v0_gen_emit_item_registered (object, tmp);
-  g_free (tmp);
+  gf_sn_watcher_v0_gen_emit_item_registered (object, watch->key);
 
   gf_sn_watcher_v0_gen_complete_register_item (object, invocation);
 
@@ -365,17 +366,15 @@ gf_sn_watcher_v0_dispose (GObject *object)
       v0->bus_name_id = 0;
     }
 
-  if (v0->hosts != NULL)
+  if (v0->update_items_id > 0)
     {
-      g_slist_free_full (v0->hosts, gf_watch_free);
-      v0->hosts = NULL;
+      g_source_remove (v0->update_items_id);
+      v0->update_items_id = 0;
     }
 
-  if (v0->items != NULL)
-    {
-      g_slist_free_full (v0->items, gf_watch_free);
-      v0->items = NULL;
-    }
+  g_queue_clear (&v0->item_queue);
+  g_clear_pointer (&v0->hosts, g_hash_table_destroy);
+  g_clear_pointer (&v0->items, g_hash_table_destroy);
 
   G_OBJECT_CLASS (gf_sn_watcher_v0_parent_class)->dispose (object);
 }
@@ -395,6 +394,12 @@ gf_sn_watcher_v0_init (GfSnWatcherV0 *v0)
 {
   GBusNameOwnerFlags flags;
 
+  v0->hosts = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                     NULL, gf_watch_free);
+  v0->items = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                     NULL, gf_watch_free);
+  g_queue_init (&v0->item_queue);
+
   flags = G_BUS_NAME_OWNER_FLAGS_ALLOW_REPLACEMENT |
           G_BUS_NAME_OWNER_FLAGS_REPLACE;
 
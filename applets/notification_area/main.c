@@ -38,6 +38,8 @@
 
 #include "main.h"
 #include "na-grid.h"
+#include "status-notifier/sn-item-v0.h"
+#include "system-tray/na-tray-child.h"
 
 #ifdef PROVIDE_WATCHER_SERVICE
 # include "libstatus-notifier-watcher/gf-status-notifier-watcher.h"
@@ -460,6 +462,32 @@ na_tray_applet_class_init (NaTrayAppletClass *class)
   gtk_widget_class_set_css_name (widget_class, "na-tray-applet");
 }
 
+/* Icons that animate or keep changing are repainted less often in the
+ * balanced profile, and even less in the low-power one */
+static void
+na_tray_applet_power_profile_changed (MatePanelApplet *applet,
+                                      GParamSpec      *pspec,
+                                      gpointer         user_data)
+{
+  guint scale;
+
+  switch (mate_panel_applet_get_power_profile (applet))
+    {
+    case MATE_PANEL_APPLET_POWER_PROFILE_LOW_POWER:
+      scale = 4;
+      break;
+    case MATE_PANEL_APPLET_POWER_PROFILE_BALANCED:
+      scale = 2;
+      break;
+    default:
+      scale = 1;
+      break;
+    }
+
+  na_tray_child_set_paint_interval_scale (scale);
+  sn_item_v0_set_refresh_scale (scale);
+}
+
 static void
 na_tray_applet_init (NaTrayApplet *applet)
 {
@@ -483,6 +511,9 @@ na_tray_applet_init (NaTrayApplet *applet)
 
   mate_panel_applet_set_flags (MATE_PANEL_APPLET (applet),
                           MATE_PANEL_APPLET_HAS_HANDLE|MATE_PANEL_APPLET_EXPAND_MINOR);
+
+  g_signal_connect (applet, "notify::power-profile",
+                    G_CALLBACK (na_tray_applet_power_profile_changed), NULL);
 }
 
 static gboolean
@@ -34,12 +34,14 @@
 
 #define MIN_ICON_SIZE_DEFAULT 24
 
+/* An item and the cell it is attached to, so that placing the items does
+ * not have to ask the grid */
 typedef struct
 {
-  GtkOrientation  orientation;
-  gint            index;
-  NaGrid         *grid;
-} SortData;
+  NaItem *item;
+  gint    col;
+  gint    row;
+} NaGridSlot;
 
 struct _NaGrid
 {
@@ -51,10 +53,10 @@ struct _NaGrid
   gint       min_icon_size;
   gint       cols;
   gint       rows;
-  gint       length;
+  GtkOrientation orientation;
 
   GSList    *hosts;
-  GSList    *items;
+  GArray    *slots; /* sorted with compare_items () */
 };
 
 enum
@@ -94,46 +96,61 @@ compare_items (gconstpointer a,
   return g_strcmp0 (id1, id2);
 }
 
+/* Moves the items from @first on to their cell, if they are not already
+ * there: the items before it have not moved. */
 static void
-sort_items (GtkWidget *item,
-            SortData  *data)
+place_items (NaGrid *self,
+             guint   first)
 {
-  gint col, row, left_attach, top_attach;
-
-  /* row / col number depends on whether we are horizontal or vertical */
-  if (data->orientation == GTK_ORIENTATION_HORIZONTAL)
-    {
-      col = data->index / data->grid->rows;
-      row = data->index % data->grid->rows;
-    }
-  else
-    {
-      row = data->index / data->grid->cols;
-      col = data->index % data->grid->cols;
-    }
-
-  /* only update item position if it has changed from current */
-  gtk_container_child_get (GTK_CONTAINER (data->grid),
-                           item,
-                           "left-attach", &left_attach,
-                           "top-attach", &top_attach,
-                           NULL);
+  GSList *moved = NULL;
+  GSList *l;
+  guint i;
 
-  if (left_attach != col || top_attach != row)
+  for (i = first; i < self->slots->len; i++)
     {
-      gtk_container_child_set (GTK_CONTAINER (data->grid),
-                               item,
+      NaGridSlot *slot;
+      gint col, row;
+
+      slot = &g_array_index (self->slots, NaGridSlot, i);
+
+      /* row / col number depends on whether we are horizontal or vertical */
+      if (self->orientation == GTK_ORIENTATION_HORIZONTAL)
+        {
+          col = i / self->rows;
+          row = i % self->rows;
+        }
+      else
+        {
+          row = i / self->cols;
+          col = i % self->cols;
+        }
+
+      if (slot->col == col && slot->row == row)
+        continue;
+
+      /* notify the new attach points once everything has moved */
+      gtk_widget_freeze_child_notify (GTK_WIDGET (slot->item));
+      moved = g_slist_prepend (moved, slot->item);
+
+      gtk_container_child_set (GTK_CONTAINER (self),
+                               GTK_WIDGET (slot->item),
                                "left-attach", col,
                                "top-attach", row,
                                NULL);
+      slot->col = col;
+      slot->row = row;
     }
 
-  /* increment to index of next item */
-  data->index++;
+  for (l = moved; l != NULL; l = l->next)
+    gtk_widget_thaw_child_notify (l->data);
+  g_slist_free (moved);
 }
 
+/* @first_changed is the index of the first item that was inserted or
+ * removed, or the number of items if the list did not change */
 static void
-refresh_grid (NaGrid *self)
+refresh_grid (NaGrid *self,
+              guint   first_changed)
 {
   GtkOrientation orientation;
   GtkAllocation allocation;
@@ -141,7 +158,7 @@ refresh_grid (NaGrid *self)
 
   orientation = gtk_orientable_get_orientation (GTK_ORIENTABLE (self));
   gtk_widget_get_allocation (GTK_WIDGET (self), &allocation);
-  length = g_slist_length (self->items);
+  length = self->slots->len;
 
   if (orientation == GTK_ORIENTATION_HORIZONTAL)
     {
@@ -162,21 +179,18 @@ refresh_grid (NaGrid *self)
         rows++;
     }
 
-  if (self->cols != cols || self->rows != rows || self->length != length)
+  /* a new layout can move any item, otherwise only the ones after the
+   * change shift by one cell */
+  if (self->cols != cols || self->rows != rows ||
+      self->orientation != orientation)
     {
       self->cols = cols;
       self->rows = rows;
-      self->length = length;
-
-      SortData data;
-      data.orientation = gtk_orientable_get_orientation (GTK_ORIENTABLE (self));
-      data.index = 0;
-      data.grid = self;
-
-      g_slist_foreach (self->items,
-                       (GFunc) sort_items,
-                       &data);
+      self->orientation = orientation;
+      first_changed = 0;
     }
+
+  place_items (self, first_changed);
 }
 
 void
@@ -187,7 +201,7 @@ na_grid_set_min_icon_size (NaGrid *grid,
 
   grid->min_icon_size = min_icon_size;
 
-  refresh_grid (grid);
+  refresh_grid (grid, grid->slots->len);
 }
 
 static void
@@ -195,6 +209,9 @@ item_added_cb (NaHost *host,
                NaItem *item,
                NaGrid *self)
 {
+  NaGridSlot slot;
+  guint low, high;
+
   g_return_if_fail (NA_IS_HOST (host));
   g_return_if_fail (NA_IS_ITEM (item));
   g_return_if_fail (NA_IS_GRID (self));
@@ -203,18 +220,34 @@ item_added_cb (NaHost *host,
                           item, "orientation",
                           G_BINDING_SYNC_CREATE);
 
-  self->items = g_slist_prepend (self->items, item);
+  /* insert after the items sorting before or alongside it */
+  low = 0;
+  high = self->slots->len;
+  while (low < high)
+    {
+      guint middle = low + (high - low) / 2;
+
+      if (compare_items (g_array_index (self->slots, NaGridSlot, middle).item,
+                         item) <= 0)
+        low = middle + 1;
+      else
+        high = middle;
+    }
+
+  slot.item = item;
+  slot.col = self->cols - 1;
+  slot.row = self->rows - 1;
+  g_array_insert_val (self->slots, low, slot);
 
   gtk_widget_set_hexpand (GTK_WIDGET (item), TRUE);
   gtk_widget_set_vexpand (GTK_WIDGET (item), TRUE);
   gtk_grid_attach (GTK_GRID (self),
                    GTK_WIDGET (item),
-                   self->cols - 1,
-                   self->rows - 1,
+                   slot.col,
+                   slot.row,
                    1, 1);
 
-  self->items = g_slist_sort (self->items, compare_items);
-  refresh_grid (self);
+  refresh_grid (self, low);
 }
 
 static void
@@ -222,13 +255,23 @@ item_removed_cb (NaHost *host,
                  NaItem *item,
                  NaGrid *self)
 {
+  guint i;
+
   g_return_if_fail (NA_IS_HOST (host));
   g_return_if_fail (NA_IS_ITEM (item));
   g_return_if_fail (NA_IS_GRID (self));
 
   gtk_container_remove (GTK_CONTAINER (self), GTK_WIDGET (item));
-  self->items = g_slist_remove (self->items, item);
-  refresh_grid (self);
+
+  for (i = 0; i < self->slots->len; i++)
+    {
+      if (g_array_index (self->slots, NaGridSlot, i).item == item)
+        {
+          g_array_remove_index (self->slots, i);
+          refresh_grid (self, i);
+          return;
+        }
+    }
 }
 
 static void
@@ -240,10 +283,10 @@ na_grid_init (NaGrid *self)
   self->min_icon_size = MIN_ICON_SIZE_DEFAULT;
   self->cols = 1;
   self->rows = 1;
-  self->length = 0;
+  self->orientation = GTK_ORIENTATION_HORIZONTAL;
 
   self->hosts = NULL;
-  self->items = NULL;
+  self->slots = g_array_new (FALSE, FALSE, sizeof (NaGridSlot));
 
   gtk_grid_set_row_homogeneous (GTK_GRID (self), TRUE);
   gtk_grid_set_column_homogeneous (GTK_GRID (self), TRUE);
@@ -354,7 +397,7 @@ na_grid_unrealize (GtkWidget *widget)
       self->hosts = NULL;
     }
 
-  g_clear_pointer (&self->items, g_slist_free);
+  g_array_set_size (self->slots, 0);
 
   GTK_WIDGET_CLASS (na_grid_parent_class)->unrealize (widget);
 }
@@ -363,8 +406,10 @@ static void
 na_grid_size_allocate (GtkWidget     *widget,
                        GtkAllocation *allocation)
 {
+  NaGrid *self = NA_GRID (widget);
+
   GTK_WIDGET_CLASS (na_grid_parent_class)->size_allocate (widget, allocation);
-  refresh_grid (NA_GRID (widget));
+  refresh_grid (self, self->slots->len);
 }
 
 static void
@@ -415,12 +460,23 @@ na_grid_set_property (GObject      *object,
     }
 }
 
+static void
+na_grid_finalize (GObject *object)
+{
+  NaGrid *self = NA_GRID (object);
+
+  g_array_free (self->slots, TRUE);
+
+  G_OBJECT_CLASS (na_grid_parent_class)->finalize (object);
+}
+
 static void
 na_grid_class_init (NaGridClass *klass)
 {
   GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
   GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
 
+  gobject_class->finalize = na_grid_finalize;
   gobject_class->get_property = na_grid_get_property;
   gobject_class->set_property = na_grid_set_property;
 
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2021 MATE Developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Per item counters, to find out which application keeps the notification
+ * area busy. They are kept by item id, so that they survive the item
+ * coming back on a new bus name, and written as a key file with one group
+ * per id to the file named by MATE_NOTIFICATION_AREA_STATS, at most every
+ * NA_STATS_WRITE_INTERVAL seconds while they change.
+ */
+
+#include <config.h>
+
+#include "na-stats.h"
+
+#define NA_STATS_WRITE_INTERVAL 5
+
+typedef struct
+{
+  guint64 counters[NA_STATS_N_COUNTERS];
+  gint64  update_time;
+} NaStatsEntry;
+
+static const gchar *counter_keys[NA_STATS_N_COUNTERS] =
+{
+  "PropertyChanges",
+  "DBusCalls",
+  "IconDecodes",
+  "Redraws"
+};
+
+static gboolean    initialized = FALSE;
+static gchar      *filename = NULL;
+static GHashTable *entries = NULL;
+static guint       write_id = 0;
+
+gboolean
+na_stats_enabled (void)
+{
+  if (!initialized)
+    {
+      const gchar *env;
+
+      initialized = TRUE;
+
+      env = g_getenv (NA_STATS_ENV);
+      if (env != NULL && *env != '\0')
+        {
+          filename = g_strdup (env);
+          entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                           g_free, g_free);
+        }
+    }
+
+  return filename != NULL;
+}
+
+static gboolean
+write_cb (gpointer user_data)
+{
+  GKeyFile *key_file;
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+  GError *error;
+
+  write_id = 0;
+
+  key_file = g_key_file_new ();
+
+  g_hash_table_iter_init (&iter, entries);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      NaStatsEntry *entry;
+      guint i;
+
+      entry = value;
+
+      for (i = 0; i < NA_STATS_N_COUNTERS; i++)
+        g_key_file_set_uint64 (key_file, key, counter_keys[i],
+                               entry->counters[i]);
+
+      /* in milliseconds, like the other statistics files */
+      g_key_file_set_double (key_file, key, "UpdateTime",
+                             entry->update_time / 1000.0);
+    }
+
+  error = NULL;
+  if (!g_key_file_save_to_file (key_file, filename, &error))
+    {
+      g_warning ("Could not write the notification area statistics: %s",
+                 error->message);
+      g_error_free (error);
+    }
+
+  g_key_file_free (key_file);
+
+  return G_SOURCE_REMOVE;
+}
+
+static NaStatsEntry *
+get_entry (NaItem *item)
+{
+  const gchar *id;
+  NaStatsEntry *entry;
+
+  id = na_item_get_id (item);
+  if (id == NULL || *id == '\0')
+    id = "unknown";
+
+  entry = g_hash_table_lookup (entries, id);
+  if (entry == NULL)
+    {
+      entry = g_new0 (NaStatsEntry, 1);
+      g_hash_table_insert (entries, g_strdup (id), entry);
+    }
+
+  if (write_id == 0)
+    write_id = g_timeout_add_seconds (NA_STATS_WRITE_INTERVAL, write_cb, NULL);
+
+  return entry;
+}
+
+void
+na_stats_count (NaItem         *item,
+                NaStatsCounter  counter)
+{
+  g_return_if_fail (NA_IS_ITEM (item));
+  g_return_if_fail (counter < NA_STATS_N_COUNTERS);
+
+  if (!na_stats_enabled ())
+    return;
+
+  get_entry (item)->counters[counter]++;
+}
+
+void
+na_stats_add_time (NaItem *item,
+                   gint64  usec)
+{
+  g_return_if_fail (NA_IS_ITEM (item));
+
+  if (!na_stats_enabled ())
+    return;
+
+  get_entry (item)->update_time += usec;
+}
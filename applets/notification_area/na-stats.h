@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2021 MATE Developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NA_STATS_H
+#define NA_STATS_H
+
+#include "na-item.h"
+
+G_BEGIN_DECLS
+
+/* Name of the environment variable giving the file the statistics are
+ * written to; nothing is counted when it is not set */
+#define NA_STATS_ENV "MATE_NOTIFICATION_AREA_STATS"
+
+typedef enum
+{
+  NA_STATS_PROPERTY_CHANGES,
+  NA_STATS_DBUS_CALLS,
+  NA_STATS_ICON_DECODES,
+  NA_STATS_REDRAWS,
+
+  NA_STATS_N_COUNTERS
+} NaStatsCounter;
+
+gboolean na_stats_enabled  (void);
+
+void     na_stats_count    (NaItem         *item,
+                            NaStatsCounter  counter);
+
+void     na_stats_add_time (NaItem         *item,
+                            gint64          usec);
+
+G_END_DECLS
+
+#endif
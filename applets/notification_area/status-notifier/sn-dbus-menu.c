@@ -21,12 +21,20 @@
 #include "sn-dbus-menu-gen.h"
 #include "sn-dbus-menu-item.h"
 
+/* The layout is fetched one level at a time: the children of a menu are
+ * asked for when it is about to be shown and the cached ones are stale,
+ * and a new layout is applied to the existing items instead of building
+ * everything again. */
 struct _SnDBusMenu
 {
   GtkMenu        parent;
 
   GHashTable    *items;
 
+  GHashTable    *stale;     /* ids of the menus whose children are outdated */
+  GHashTable    *fetching;  /* ids of the menus being fetched */
+  GHashTable    *revisions; /* id -> revision of the last fetched layout */
+
   GCancellable  *cancellable;
 
   gchar         *bus_name;
@@ -82,49 +90,183 @@ activate_cb (GtkWidget  *widget,
                                     gtk_get_current_event_time (), NULL, NULL);
 }
 
+typedef struct
+{
+  SnDBusMenu *menu;
+  gint        id;
+} SnDBusMenuRequest;
+
+static SnDBusMenuRequest *
+sn_dbus_menu_request_new (SnDBusMenu *menu,
+                          gint        id)
+{
+  SnDBusMenuRequest *request;
+
+  request = g_new0 (SnDBusMenuRequest, 1);
+  request->menu = menu;
+  request->id = id;
+
+  return request;
+}
+
+static void fetch_layout (SnDBusMenu *menu,
+                          gint        id);
+
 static GtkMenu *
-layout_update_item (SnDBusMenu *menu,
-                    GtkMenu    *gtk_menu,
-                    guint       id,
-                    GVariant   *props)
+get_gtk_menu (SnDBusMenu *menu,
+              gint        id)
 {
   SnDBusMenuItem *item;
 
   if (id == 0)
-    return gtk_menu;
+    return GTK_MENU (menu);
+
+  item = g_hash_table_lookup (menu->items, GINT_TO_POINTER (id));
+
+  return item != NULL ? item->submenu : NULL;
+}
 
-  item = g_hash_table_lookup (menu->items, GUINT_TO_POINTER (id));
+static gint
+get_item_id (GtkWidget *widget)
+{
+  return GPOINTER_TO_INT (g_object_get_data (G_OBJECT (widget), "item-id"));
+}
+
+static void
+remove_item (SnDBusMenu *menu,
+             gint        id)
+{
+  SnDBusMenuItem *item;
+
+  item = g_hash_table_lookup (menu->items, GINT_TO_POINTER (id));
+  if (item == NULL)
+    return;
+
+  if (item->submenu != NULL)
+    {
+      GList *children;
+      GList *l;
+
+      children = gtk_container_get_children (GTK_CONTAINER (item->submenu));
+      for (l = children; l != NULL; l = l->next)
+        remove_item (menu, get_item_id (l->data));
+      g_list_free (children);
+    }
+
+  g_hash_table_remove (menu->stale, GINT_TO_POINTER (id));
+  g_hash_table_remove (menu->revisions, GINT_TO_POINTER (id));
+  g_hash_table_remove (menu->items, GINT_TO_POINTER (id));
+}
+
+static void
+about_to_show_cb (GObject      *source_object,
+                  GAsyncResult *res,
+                  gpointer      user_data)
+{
+  SnDBusMenuRequest *request;
+  gboolean need_update;
+  GError *error;
+
+  request = user_data;
+
+  error = NULL;
+  sn_dbus_menu_gen_call_about_to_show_finish (SN_DBUS_MENU_GEN (source_object),
+                                              &need_update, res, &error);
+
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      g_error_free (error);
+      g_free (request);
+      return;
+    }
+
+  /* not every application implements it: rely on the cache then */
+  if (error != NULL)
+    {
+      need_update = FALSE;
+      g_error_free (error);
+    }
+
+  if (need_update ||
+      g_hash_table_contains (request->menu->stale, GINT_TO_POINTER (request->id)))
+    fetch_layout (request->menu, request->id);
+
+  g_free (request);
+}
+
+static void
+about_to_show (SnDBusMenu *menu,
+               gint        id)
+{
+  if (menu->proxy == NULL)
+    return;
+
+  sn_dbus_menu_gen_call_about_to_show (menu->proxy, id, menu->cancellable,
+                                       about_to_show_cb,
+                                       sn_dbus_menu_request_new (menu, id));
+}
+
+static void
+submenu_map_cb (GtkWidget  *widget,
+                SnDBusMenu *menu)
+{
+  about_to_show (menu, get_item_id (widget));
+}
+
+static SnDBusMenuItem *
+layout_update_item (SnDBusMenu *menu,
+                    gint        id,
+                    GVariant   *props)
+{
+  SnDBusMenuItem *item;
+
+  item = g_hash_table_lookup (menu->items, GINT_TO_POINTER (id));
 
   if (item == NULL)
     {
       item = sn_dbus_menu_item_new (props);
 
-      g_object_set_data (G_OBJECT (item->item), "item-id", GUINT_TO_POINTER (id));
-      gtk_menu_shell_append (GTK_MENU_SHELL (gtk_menu), item->item);
+      g_object_set_data (G_OBJECT (item->item), "item-id", GINT_TO_POINTER (id));
 
       item->activate_id = g_signal_connect (item->item, "activate",
                                             G_CALLBACK (activate_cb), menu);
 
-      g_hash_table_replace (menu->items, GUINT_TO_POINTER (id), item);
+      if (item->submenu != NULL)
+        {
+          /* its children come when it opens */
+          g_object_set_data (G_OBJECT (item->submenu), "item-id",
+                             GINT_TO_POINTER (id));
+          g_signal_connect (item->submenu, "map",
+                            G_CALLBACK (submenu_map_cb), menu);
+          g_hash_table_add (menu->stale, GINT_TO_POINTER (id));
+        }
+
+      g_hash_table_replace (menu->items, GINT_TO_POINTER (id), item);
     }
   else
     {
       sn_dbus_menu_item_update_props (item, props);
     }
-  return item->submenu;
+
+  return item;
 }
 
+/* Applies the layout of a menu and of its direct children, as returned
+ * by a GetLayout of depth 1, to the existing items */
 static void
 layout_parse (SnDBusMenu *menu,
-              GVariant   *layout,
-              GtkMenu    *gtk_menu)
+              GVariant   *layout)
 {
-  guint id;
+  gint id;
   GVariant *props;
   GVariant *items;
-  GtkMenu *submenu;
+  GtkMenu *gtk_menu;
   GVariantIter iter;
   GVariant *child;
+  GHashTable *seen;
+  GList *children;
+  GList *l;
+  gint position;
 
   if (!g_variant_is_of_type (layout, G_VARIANT_TYPE ("(ia{sv}av)")))
     {
@@ -137,23 +279,77 @@ layout_parse (SnDBusMenu *menu,
 
   g_variant_get (layout, "(i@a{sv}@av)", &id, &props, &items);
 
-  submenu = layout_update_item (menu, gtk_menu, id, props);
+  if (id != 0)
+    layout_update_item (menu, id, props);
   g_variant_unref (props);
 
+  gtk_menu = get_gtk_menu (menu, id);
+  if (gtk_menu == NULL)
+    {
+      g_variant_unref (items);
+      return;
+    }
+
+  seen = g_hash_table_new (NULL, NULL);
+  position = 0;
+
   g_variant_iter_init (&iter, items);
   while ((child = g_variant_iter_next_value (&iter)))
     {
       GVariant *value;
+      gint child_id;
+      GVariant *child_props;
+      SnDBusMenuItem *item;
+      GtkWidget *parent;
 
       value = g_variant_get_variant (child);
+      g_variant_unref (child);
 
-      layout_parse (menu, value, submenu);
+      if (!g_variant_is_of_type (value, G_VARIANT_TYPE ("(ia{sv}av)")))
+        {
+          g_variant_unref (value);
+          continue;
+        }
+
+      g_variant_get (value, "(i@a{sv}@av)", &child_id, &child_props, NULL);
       g_variant_unref (value);
 
-      g_variant_unref (child);
+      item = layout_update_item (menu, child_id, child_props);
+      g_variant_unref (child_props);
+
+      g_hash_table_add (seen, GINT_TO_POINTER (child_id));
+
+      /* move the item only if it is not already where it belongs */
+      parent = gtk_widget_get_parent (item->item);
+      if (parent != GTK_WIDGET (gtk_menu))
+        {
+          if (parent != NULL)
+            gtk_container_remove (GTK_CONTAINER (parent), item->item);
+          gtk_menu_shell_insert (GTK_MENU_SHELL (gtk_menu), item->item, position);
+        }
+      else
+        {
+          gtk_menu_reorder_child (gtk_menu, item->item, position);
+        }
+
+      position++;
     }
 
   g_variant_unref (items);
+
+  /* and drop the items that are gone */
+  children = gtk_container_get_children (GTK_CONTAINER (gtk_menu));
+  for (l = children; l != NULL; l = l->next)
+    {
+      gint child_id;
+
+      child_id = get_item_id (l->data);
+      if (!g_hash_table_contains (seen, GINT_TO_POINTER (child_id)))
+        remove_item (menu, child_id);
+    }
+  g_list_free (children);
+
+  g_hash_table_destroy (seen);
 }
 
 static void
@@ -161,10 +357,14 @@ get_layout_cb (GObject      *source_object,
                GAsyncResult *res,
                gpointer      user_data)
 {
+  SnDBusMenuRequest *request;
   GVariant *layout;
   guint revision;
   GError *error;
   SnDBusMenu *menu;
+  GtkMenu *gtk_menu;
+
+  request = user_data;
 
   error = NULL;
   sn_dbus_menu_gen_call_get_layout_finish (SN_DBUS_MENU_GEN (source_object),
@@ -173,40 +373,56 @@ get_layout_cb (GObject      *source_object,
   if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
     {
       g_error_free (error);
+      g_free (request);
       return;
     }
 
-  menu = SN_DBUS_MENU (user_data);
+  menu = request->menu;
+  g_hash_table_remove (menu->fetching, GINT_TO_POINTER (request->id));
 
   if (error != NULL)
     {
       g_warning ("%s", error->message);
       g_error_free (error);
+      g_free (request);
       return;
     }
 
-  g_hash_table_remove_all (menu->items);
-  layout_parse (menu, layout, GTK_MENU (menu));
+  g_hash_table_replace (menu->revisions, GINT_TO_POINTER (request->id),
+                        GUINT_TO_POINTER (revision));
+  layout_parse (menu, layout);
+  g_variant_unref (layout);
 
-  /* Reposition menu to accomodate any size changes   */
-  /* Menu size never changes with GTK 3.20 or earlier */
-  gtk_menu_reposition(GTK_MENU(menu));
+  gtk_menu = get_gtk_menu (menu, request->id);
+  if (gtk_menu != NULL && gtk_widget_get_mapped (GTK_WIDGET (gtk_menu)))
+    {
+      /* Reposition menu to accomodate any size changes   */
+      /* Menu size never changes with GTK 3.20 or earlier */
+      gtk_menu_reposition (gtk_menu);
 
-  g_variant_unref (layout);
+      /* it changed again while we were fetching it */
+      if (g_hash_table_contains (menu->stale, GINT_TO_POINTER (request->id)))
+        fetch_layout (menu, request->id);
+    }
+
+  g_free (request);
 }
 
 static void
-update_layout (SnDBusMenu *menu,
-               gint        parent)
+fetch_layout (SnDBusMenu *menu,
+              gint        id)
 {
-  gint depth;
+  if (menu->proxy == NULL ||
+      g_hash_table_contains (menu->fetching, GINT_TO_POINTER (id)))
+    return;
 
-  parent = 0;
-  depth = -1;
+  g_hash_table_remove (menu->stale, GINT_TO_POINTER (id));
+  g_hash_table_add (menu->fetching, GINT_TO_POINTER (id));
 
-  sn_dbus_menu_gen_call_get_layout (menu->proxy, parent, depth,
+  sn_dbus_menu_gen_call_get_layout (menu->proxy, id, 1,
                                     property_names, menu->cancellable,
-                                    get_layout_cb, menu);
+                                    get_layout_cb,
+                                    sn_dbus_menu_request_new (menu, id));
 }
 
 static void
@@ -216,14 +432,14 @@ items_properties_updated_cb (SnDBusMenuGen *proxy,
                              SnDBusMenu    *menu)
 {
   GVariantIter iter;
-  guint id;
+  gint id;
   GVariant *props;
   SnDBusMenuItem *item;
 
   g_variant_iter_init (&iter, updated_props);
   while (g_variant_iter_next (&iter, "(i@a{sv})", &id, &props))
     {
-      item = g_hash_table_lookup (menu->items, GUINT_TO_POINTER (id));
+      item = g_hash_table_lookup (menu->items, GINT_TO_POINTER (id));
 
       if (item != NULL)
         sn_dbus_menu_item_update_props (item, props);
@@ -234,7 +450,7 @@ items_properties_updated_cb (SnDBusMenuGen *proxy,
   g_variant_iter_init (&iter, removed_props);
   while (g_variant_iter_next (&iter, "(i@as)", &id, &props))
     {
-      item = g_hash_table_lookup (menu->items, GUINT_TO_POINTER (id));
+      item = g_hash_table_lookup (menu->items, GINT_TO_POINTER (id));
 
       if (item != NULL)
         sn_dbus_menu_item_remove_props (item, props);
@@ -243,13 +459,55 @@ items_properties_updated_cb (SnDBusMenuGen *proxy,
     }
 }
 
+/* LayoutUpdated covers the whole subtree of its parent: the submenus
+ * below it are outdated too, and the shown ones are fetched again */
+static void
+mark_stale (SnDBusMenu *menu,
+            gint        id)
+{
+  GtkMenu *gtk_menu;
+  GList *children;
+  GList *l;
+
+  g_hash_table_add (menu->stale, GINT_TO_POINTER (id));
+
+  gtk_menu = get_gtk_menu (menu, id);
+  if (gtk_menu == NULL)
+    return;
+
+  children = gtk_container_get_children (GTK_CONTAINER (gtk_menu));
+  for (l = children; l != NULL; l = l->next)
+    {
+      SnDBusMenuItem *item;
+      gint child_id;
+
+      child_id = get_item_id (l->data);
+      item = g_hash_table_lookup (menu->items, GINT_TO_POINTER (child_id));
+      if (item != NULL && item->submenu != NULL)
+        mark_stale (menu, child_id);
+    }
+  g_list_free (children);
+
+  /* a menu that is not shown is only fetched when it opens */
+  if (gtk_widget_get_mapped (GTK_WIDGET (gtk_menu)))
+    fetch_layout (menu, id);
+}
+
 static void
 layout_updated_cb (SnDBusMenuGen *proxy,
                    guint          revision,
                    gint           parent,
                    SnDBusMenu    *menu)
 {
-  update_layout (menu, parent);
+  gpointer fetched;
+
+  /* already have this one */
+  if (g_hash_table_lookup_extended (menu->revisions, GINT_TO_POINTER (parent),
+                                    NULL, &fetched) &&
+      revision <= GPOINTER_TO_UINT (fetched))
+    return;
+
+  mark_stale (menu, parent);
 }
 
 static void
@@ -265,20 +523,14 @@ static void
 map_cb (GtkWidget  *widget,
         SnDBusMenu *menu)
 {
-  gboolean need_update;
-
-  sn_dbus_menu_gen_call_event_sync (menu->proxy, 0, "opened",
-                                    g_variant_new ("v", g_variant_new_int32 (0)),
-                                    gtk_get_current_event_time (),
-                                    NULL, NULL);
-
-  sn_dbus_menu_gen_call_about_to_show_sync (menu->proxy, 0, &need_update,
-                                            NULL, NULL);
-
-  if (need_update)
-    {
-      update_layout (menu, 0);
-    }
+  /* the menu shows its cached items right away, and is updated once the
+   * application answers */
+  sn_dbus_menu_gen_call_event (menu->proxy, 0, "opened",
+                               g_variant_new ("v", g_variant_new_int32 (0)),
+                               gtk_get_current_event_time (),
+                               menu->cancellable, NULL, NULL);
+
+  about_to_show (menu, 0);
 }
 
 static void
@@ -331,7 +583,8 @@ proxy_ready_cb (GObject      *source_object,
   g_signal_connect (menu, "map", G_CALLBACK (map_cb), menu);
   g_signal_connect (menu, "unmap", G_CALLBACK (unmap_cb), menu);
 
-  update_layout (menu, 0);
+  /* the first level is fetched ahead, the submenus when they open */
+  fetch_layout (menu, 0);
 }
 
 static void
@@ -359,6 +612,10 @@ name_vanished_cb (GDBusConnection *connection,
   menu = SN_DBUS_MENU (user_data);
 
   g_clear_object (&menu->proxy);
+
+  /* whoever owns the name next starts from scratch */
+  g_hash_table_remove_all (menu->fetching);
+  g_hash_table_remove_all (menu->revisions);
 }
 
 static void
@@ -404,6 +661,9 @@ sn_dbus_menu_dispose (GObject *object)
     }
 
   g_clear_pointer (&menu->items, g_hash_table_destroy);
+  g_clear_pointer (&menu->stale, g_hash_table_destroy);
+  g_clear_pointer (&menu->fetching, g_hash_table_destroy);
+  g_clear_pointer (&menu->revisions, g_hash_table_destroy);
 
   g_cancellable_cancel (menu->cancellable);
   g_clear_object (&menu->cancellable);
@@ -486,6 +746,9 @@ static void
 sn_dbus_menu_init (SnDBusMenu *menu)
 {
   menu->items = g_hash_table_new_full (NULL, NULL, NULL, sn_dbus_menu_item_free);
+  menu->stale = g_hash_table_new (NULL, NULL);
+  menu->fetching = g_hash_table_new (NULL, NULL);
+  menu->revisions = g_hash_table_new (NULL, NULL);
   menu->cancellable = g_cancellable_new ();
 }
 
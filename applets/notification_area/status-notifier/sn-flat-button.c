@@ -39,13 +39,17 @@ sn_flat_button_draw (GtkWidget *widget,
   if (child)
     gtk_container_propagate_draw (GTK_CONTAINER (widget), child, cr);
 
+  /* Nothing else is drawn: a hover only repaints the child, and only if
+   * its style changes with the state of the button.  The focus goes
+   * around the whole button, not around the area being repainted, or a
+   * partial repaint would draw it in the middle of the button. */
   if (gtk_widget_is_drawable (widget) && gtk_widget_has_focus (widget))
     {
       GtkStyleContext *context = gtk_widget_get_style_context (widget);
-      gdouble x1, y1, x2, y2;
 
-      cairo_clip_extents (cr, &x1, &y1, &x2, &y2);
-      gtk_render_focus (context, cr, x1, y1, x2 - x1, y2 - y1);
+      gtk_render_focus (context, cr, 0, 0,
+                        gtk_widget_get_allocated_width (widget),
+                        gtk_widget_get_allocated_height (widget));
     }
 
   return child != NULL;
@@ -17,6 +17,8 @@
 
 #include <config.h>
 
+#include <string.h>
+
 #include "sn-host-v0.h"
 #include "sn-item-v0.h"
 #include "sn-watcher-v0-gen.h"
@@ -27,6 +29,12 @@
 #define SN_WATCHER_BUS_NAME "org.kde.StatusNotifierWatcher"
 #define SN_WATCHER_OBJECT_PATH "/StatusNotifierWatcher"
 
+/* The items registered before the host are loaded a few at a time, and
+ * shown together once they are all ready, or after the timeout for the
+ * ones that do not answer. */
+#define SN_HOST_MAX_LOADING 8
+#define SN_HOST_BATCH_TIMEOUT 3 /* s */
+
 struct _SnHostV0
 {
   SnHostV0GenSkeleton  parent;
@@ -40,7 +48,15 @@ struct _SnHostV0
   guint                watcher_id;
   SnWatcherV0Gen      *watcher;
 
-  GSList              *items;
+  /* service, as sent by the watcher -> SnItem */
+  GHashTable          *items;
+
+  /* while the first items load: the services waiting to be loaded, the
+   * items loading, and the ready ones waiting for the others */
+  guint                batch_id;
+  GQueue               batch_queued;
+  GHashTable          *batch_loading;
+  GQueue               batch_ready;
 
   gint                 icon_padding;
   gint                 icon_size;
@@ -83,17 +99,11 @@ get_bus_name_and_object_path (const gchar  *service,
   g_assert (*bus_name == NULL);
   g_assert (*object_path == NULL);
 
-  tmp = g_strstr_len (service, -1, "/");
+  tmp = strchr (service, '/');
   if (tmp != NULL)
     {
-      gchar **strings;
-
-      strings = g_strsplit (service, "/", 2);
-
-      *bus_name = g_strdup (strings[0]);
+      *bus_name = g_strndup (service, tmp - service);
       *object_path = g_strdup (tmp);
-
-      g_strfreev (strings);
     }
   else
     {
@@ -102,16 +112,25 @@ get_bus_name_and_object_path (const gchar  *service,
     }
 }
 
+static void load_batch (SnHostV0 *v0);
+
 static void
 ready_cb (SnItem   *item,
           SnHostV0 *v0)
 {
+  if (g_hash_table_remove (v0->batch_loading, item))
+    {
+      g_queue_push_tail (&v0->batch_ready, item);
+      load_batch (v0);
+      return;
+    }
+
   na_host_emit_item_added (NA_HOST (v0), NA_ITEM (item));
 }
 
 static void
-add_registered_item (SnHostV0    *v0,
-                     const gchar *service)
+create_item (SnHostV0    *v0,
+             const gchar *service)
 {
   gchar *bus_name;
   gchar *object_path;
@@ -130,13 +149,107 @@ add_registered_item (SnHostV0    *v0,
   g_object_bind_property (v0, "icon-size", item, "icon-size",
                           G_BINDING_DEFAULT | G_BINDING_SYNC_CREATE);
 
-  v0->items = g_slist_prepend (v0->items, item);
+  g_hash_table_insert (v0->items, g_strdup (service), item);
   g_signal_connect (item, "ready", G_CALLBACK (ready_cb), v0);
 
+  if (v0->batch_id != 0)
+    g_hash_table_add (v0->batch_loading, item);
+
   g_free (bus_name);
   g_free (object_path);
 }
 
+static void
+clear_batch (SnHostV0 *v0)
+{
+  if (v0->batch_id != 0)
+    {
+      g_source_remove (v0->batch_id);
+      v0->batch_id = 0;
+    }
+
+  g_queue_foreach (&v0->batch_queued, (GFunc) g_free, NULL);
+  g_queue_clear (&v0->batch_queued);
+  g_hash_table_remove_all (v0->batch_loading);
+  g_queue_clear (&v0->batch_ready);
+}
+
+/* shows the ready items at once, and loads the remaining ones without
+ * waiting for them any more */
+static void
+end_batch (SnHostV0 *v0)
+{
+  GQueue queued;
+  GQueue ready;
+  gchar *service;
+  SnItem *item;
+
+  queued = v0->batch_queued;
+  ready = v0->batch_ready;
+  g_queue_init (&v0->batch_queued);
+  g_queue_init (&v0->batch_ready);
+  clear_batch (v0);
+
+  while ((item = g_queue_pop_head (&ready)) != NULL)
+    na_host_emit_item_added (NA_HOST (v0), NA_ITEM (item));
+
+  while ((service = g_queue_pop_head (&queued)) != NULL)
+    {
+      create_item (v0, service);
+      g_free (service);
+    }
+}
+
+static gboolean
+batch_timeout_cb (gpointer user_data)
+{
+  SnHostV0 *v0;
+
+  v0 = SN_HOST_V0 (user_data);
+  v0->batch_id = 0;
+
+  end_batch (v0);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+load_batch (SnHostV0 *v0)
+{
+  while (g_hash_table_size (v0->batch_loading) < SN_HOST_MAX_LOADING &&
+         !g_queue_is_empty (&v0->batch_queued))
+    {
+      gchar *service;
+
+      service = g_queue_pop_head (&v0->batch_queued);
+      create_item (v0, service);
+      g_free (service);
+    }
+
+  if (g_hash_table_size (v0->batch_loading) == 0)
+    end_batch (v0);
+}
+
+static void
+add_registered_item (SnHostV0    *v0,
+                     const gchar *service)
+{
+  /* the watcher may tell us about an item both in RegisteredItems and
+   * with ItemRegistered */
+  if (g_hash_table_contains (v0->items, service))
+    return;
+
+  if (v0->batch_id != 0)
+    {
+      if (!g_queue_find_custom (&v0->batch_queued, service,
+                                (GCompareFunc) g_strcmp0))
+        g_queue_push_tail (&v0->batch_queued, g_strdup (service));
+      return;
+    }
+
+  create_item (v0, service);
+}
+
 static void
 item_registered_cb (SnWatcherV0Gen *watcher,
                     const gchar    *service,
@@ -150,39 +263,36 @@ item_unregistered_cb (SnWatcherV0Gen *watcher,
                       const gchar    *service,
                       SnHostV0       *v0)
 {
-  GSList *l;
+  SnItem *item;
+  GList *link;
 
-  for (l = v0->items; l != NULL; l = g_slist_next (l))
+  link = g_queue_find_custom (&v0->batch_queued, service,
+                              (GCompareFunc) g_strcmp0);
+  if (link != NULL)
     {
-      SnItem *item;
-      gboolean found;
-      gchar *bus_name;
-      gchar *object_path;
-
-      item = SN_ITEM (l->data);
-
-      found = FALSE;
-      bus_name = NULL;
-      object_path = NULL;
-
-      get_bus_name_and_object_path (service, &bus_name, &object_path);
-
-      if (g_strcmp0 (sn_item_get_bus_name (item), bus_name) == 0 &&
-          g_strcmp0 (sn_item_get_object_path (item), object_path) == 0)
-        {
-          v0->items = g_slist_remove (v0->items, item);
-          na_host_emit_item_removed (NA_HOST (v0), NA_ITEM (item));
-          g_object_unref (item);
+      g_free (link->data);
+      g_queue_delete_link (&v0->batch_queued, link);
+      return;
+    }
 
-          found = TRUE;
-        }
+  item = g_hash_table_lookup (v0->items, service);
+  if (item == NULL)
+    return;
 
-      g_free (bus_name);
-      g_free (object_path);
+  g_object_ref (item);
+  g_hash_table_remove (v0->items, service);
 
-      if (found)
-        break;
+  /* not shown yet */
+  if (g_hash_table_remove (v0->batch_loading, item) ||
+      g_queue_remove (&v0->batch_ready, item))
+    {
+      if (v0->batch_id != 0)
+        load_batch (v0);
     }
+  else
+    na_host_emit_item_removed (NA_HOST (v0), NA_ITEM (item));
+
+  g_object_unref (item);
 }
 
 static void
@@ -222,10 +332,17 @@ register_host_cb (GObject      *source_object,
 
   items = sn_watcher_v0_gen_dup_registered_items (v0->watcher);
 
-  if (items) {
-    for (gint i = 0; items[i] != NULL; i++)
-      add_registered_item (v0, items[i]);
-  }
+  if (items != NULL && items[0] != NULL)
+    {
+      v0->batch_id = g_timeout_add_seconds (SN_HOST_BATCH_TIMEOUT,
+                                            batch_timeout_cb, v0);
+      g_source_set_name_by_id (v0->batch_id, "[notification-area] sn-host batch");
+
+      for (gint i = 0; items[i] != NULL; i++)
+        add_registered_item (v0, items[i]);
+
+      load_batch (v0);
+    }
 
   g_strfreev (items);
 }
@@ -282,10 +399,11 @@ name_appeared_cb (GDBusConnection *connection,
 }
 
 static void
-emit_item_removed_signal (gpointer data,
+emit_item_removed_signal (gpointer key,
+                          gpointer value,
                           gpointer user_data)
 {
-  na_host_emit_item_removed (NA_HOST (user_data), NA_ITEM (data));
+  na_host_emit_item_removed (NA_HOST (user_data), NA_ITEM (value));
 }
 
 static void
@@ -302,11 +420,12 @@ name_vanished_cb (GDBusConnection *connection,
 
   g_clear_object (&v0->watcher);
 
+  clear_batch (v0);
+
   if (v0->items)
     {
-      g_slist_foreach (v0->items, emit_item_removed_signal, v0);
-      g_slist_free_full (v0->items, g_object_unref);
-      v0->items = NULL;
+      g_hash_table_foreach (v0->items, emit_item_removed_signal, v0);
+      g_hash_table_remove_all (v0->items);
     }
 }
 
@@ -424,11 +543,13 @@ sn_host_v0_dispose (GObject *object)
 
   g_clear_object (&v0->watcher);
 
+  if (v0->batch_loading)
+    clear_batch (v0);
+
   if (v0->items)
     {
-      g_slist_foreach (v0->items, emit_item_removed_signal, v0);
-      g_slist_free_full (v0->items, g_object_unref);
-      v0->items = NULL;
+      g_hash_table_foreach (v0->items, emit_item_removed_signal, v0);
+      g_hash_table_remove_all (v0->items);
     }
 
   G_OBJECT_CLASS (sn_host_v0_parent_class)->dispose (object);
@@ -443,6 +564,8 @@ sn_host_v0_finalize (GObject *object)
 
   g_clear_pointer (&v0->bus_name, g_free);
   g_clear_pointer (&v0->object_path, g_free);
+  g_clear_pointer (&v0->items, g_hash_table_destroy);
+  g_clear_pointer (&v0->batch_loading, g_hash_table_destroy);
 
   G_OBJECT_CLASS (sn_host_v0_parent_class)->finalize (object);
 }
@@ -477,6 +600,13 @@ sn_host_v0_init (SnHostV0 *v0)
   v0->bus_name_id = g_bus_own_name (G_BUS_TYPE_SESSION, v0->bus_name, flags,
                                     bus_acquired_cb, NULL, NULL, v0, NULL);
 
+  v0->items = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                     g_free, g_object_unref);
+
+  g_queue_init (&v0->batch_queued);
+  v0->batch_loading = g_hash_table_new (NULL, NULL);
+  g_queue_init (&v0->batch_ready);
+
   v0->icon_size = 16;
   v0->icon_padding = 0;
 }
@@ -20,12 +20,56 @@
 
 #include <math.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "na-stats.h"
 #include "sn-item.h"
 #include "sn-item-v0.h"
 #include "sn-item-v0-gen.h"
 
 #define SN_ITEM_INTERFACE "org.kde.StatusNotifierItem"
 
+/* Signals arriving within REFRESH_DELAY are answered by a single GetAll,
+ * and an item is refreshed at most every REFRESH_MIN_INTERVAL; this grows
+ * up to REFRESH_MAX_INTERVAL while it keeps sending signals. All in ms. */
+#define REFRESH_DELAY 25
+#define REFRESH_MIN_INTERVAL 100
+#define REFRESH_MAX_INTERVAL 2000
+
+/* stretches the delays above, for the power profiles */
+static guint refresh_scale = 1;
+
+/* the properties that the New* signals tell us to fetch again */
+typedef enum
+{
+  SN_REFRESH_TITLE,
+  SN_REFRESH_ICON_NAME,
+  SN_REFRESH_ICON_PIXMAP,
+  SN_REFRESH_OVERLAY_ICON_NAME,
+  SN_REFRESH_OVERLAY_ICON_PIXMAP,
+  SN_REFRESH_ATTENTION_ICON_NAME,
+  SN_REFRESH_ATTENTION_ICON_PIXMAP,
+  SN_REFRESH_TOOLTIP,
+
+  SN_REFRESH_N_PROPERTIES
+} SnRefreshProperty;
+
+static const gchar *refresh_property_names[SN_REFRESH_N_PROPERTIES] =
+{
+  "Title",
+  "IconName",
+  "IconPixmap",
+  "OverlayIconName",
+  "OverlayIconPixmap",
+  "AttentionIconName",
+  "AttentionIconPixmap",
+  "ToolTip"
+};
+
 typedef struct
 {
   cairo_surface_t *surface;
@@ -61,10 +105,12 @@ struct _SnItemV0
   gchar         *icon_name;
   gchar         *label;
   SnIconPixmap **icon_pixmap;
+  GSList        *icon_pixmap_cache;
   gchar         *overlay_icon_name;
   SnIconPixmap **overlay_icon_pixmap;
   gchar         *attention_icon_name;
   SnIconPixmap **attention_icon_pixmap;
+  GSList        *attention_icon_pixmap_cache;
   gchar         *attention_movie_name;
   SnTooltip     *tooltip;
   gchar         *icon_theme_path;
@@ -72,6 +118,13 @@ struct _SnItemV0
   gboolean       item_is_menu;
 
   guint          update_id;
+
+  guint          refresh_id;
+  guint          refresh_pending;
+  guint          refresh_requested;
+  gint64         last_refresh;
+  gint64         refresh_interval;
+  GVariant      *refresh_values[SN_REFRESH_N_PROPERTIES];
 };
 
 enum
@@ -91,7 +144,8 @@ G_DEFINE_TYPE (SnItemV0, sn_item_v0, SN_TYPE_ITEM)
 static cairo_surface_t *
 scale_surface (SnIconPixmap   *pixmap,
                GtkOrientation  orientation,
-               gint            size)
+               gint            size,
+               gint            scale)
 {
   gdouble ratio;
   gdouble new_width;
@@ -109,12 +163,12 @@ scale_surface (SnIconPixmap   *pixmap,
   ratio = pixmap->width / (gdouble) pixmap->height;
   if (orientation == GTK_ORIENTATION_HORIZONTAL)
     {
-      new_height = (gdouble) size;
+      new_height = (gdouble) size * scale;
       new_width = new_height * ratio;
     }
   else
     {
-      new_width = (gdouble) size;
+      new_width = (gdouble) size * scale;
       new_height = new_width * ratio;
     }
 
@@ -133,83 +187,165 @@ scale_surface (SnIconPixmap   *pixmap,
   cairo_paint (cr);
 
   cairo_destroy (cr);
+
+  cairo_surface_set_device_scale (scaled, scale, scale);
   return scaled;
 }
 
-static gint
-compare_size (gconstpointer a,
-              gconstpointer b,
-              gpointer      user_data)
+static cairo_surface_t *
+get_surface (SnIconPixmap  **icon_pixmap,
+             GtkOrientation  orientation,
+             gint            size,
+             gint            scale)
 {
-  SnIconPixmap *p1;
-  SnIconPixmap *p2;
-  GtkOrientation orientation;
+  gint i;
+  gint device_size;
+  SnIconPixmap *pixmap;
 
-  p1 = (SnIconPixmap *) a;
-  p2 = (SnIconPixmap *) b;
-  orientation = GPOINTER_TO_UINT (user_data);
+  g_assert (icon_pixmap != NULL && icon_pixmap[0] != NULL);
 
-  if (orientation == GTK_ORIENTATION_HORIZONTAL)
-    return p1->height - p2->height;
+  /* the pixmaps are sorted by size: take the largest one that still fits */
+  device_size = size * scale;
+  pixmap = icon_pixmap[0];
+  for (i = 1; icon_pixmap[i] != NULL; i++)
+    {
+      SnIconPixmap *p = icon_pixmap[i];
+
+      if (p->height > device_size && p->width > device_size)
+        break;
+
+      pixmap = p;
+    }
+
+  if (pixmap->surface == NULL)
+    return NULL;
+  else if (pixmap->height > device_size || pixmap->width > device_size)
+    return scale_surface (pixmap, orientation, size, scale);
   else
-    return p1->width - p2->width;
+    return cairo_surface_reference (pixmap->surface);
 }
 
-static cairo_surface_t *
-get_surface (SnIconPixmap  **icon_pixmap,
-             GtkOrientation  orientation,
-             gint            size)
+/* Scaling the pixmaps is expensive, and the same sizes are asked for again
+ * and again: keep the last few results of each pixmap set, until it
+ * changes. */
+#define ICON_CACHE_MAX_ENTRIES 4
+
+typedef struct
 {
-  gint i;
-  GList *pixmaps = NULL;
-  SnIconPixmap *pixmap = NULL;
-  GList *l;
+  gint             size;
+  GtkOrientation   orientation;
+  gint             scale;
+  cairo_surface_t *surface;
+} SnIconCacheEntry;
 
-  g_assert (icon_pixmap != NULL && icon_pixmap[0] != NULL);
+static void
+icon_cache_entry_free (SnIconCacheEntry *entry)
+{
+  cairo_surface_destroy (entry->surface);
+  g_free (entry);
+}
 
-  for (i = 0; icon_pixmap[i] != NULL; i++)
-    pixmaps = g_list_prepend (pixmaps, icon_pixmap[i]);
+static void
+icon_cache_clear (GSList **cache)
+{
+  g_slist_free_full (*cache, (GDestroyNotify) icon_cache_entry_free);
+  *cache = NULL;
+}
 
-  pixmaps = g_list_sort_with_data (pixmaps, compare_size,
-                                   GUINT_TO_POINTER (orientation));
+static cairo_surface_t *
+get_cached_surface (SnIconPixmap  **icon_pixmap,
+                    GSList        **cache,
+                    GtkOrientation  orientation,
+                    gint            size,
+                    gint            scale)
+{
+  SnIconCacheEntry *entry;
+  cairo_surface_t *surface;
+  GSList *l;
 
-  pixmap = (SnIconPixmap *) pixmaps->data;
-  for (l = pixmaps; l != NULL; l = l->next)
+  for (l = *cache; l != NULL; l = l->next)
     {
-      SnIconPixmap *p = (SnIconPixmap *) l->data;
+      entry = l->data;
 
-      if (p->height > size && p->width > size)
+      if (entry->size == size &&
+          entry->orientation == orientation &&
+          entry->scale == scale)
         {
-          break;
+          /* most recently used first */
+          *cache = g_slist_remove_link (*cache, l);
+          *cache = g_slist_concat (l, *cache);
+
+          return cairo_surface_reference (entry->surface);
         }
-      pixmap = p;
     }
 
-  g_list_free (pixmaps);
-
-  if (pixmap == NULL || pixmap->surface == NULL)
+  surface = get_surface (icon_pixmap, orientation, size, scale);
+  if (surface == NULL)
     return NULL;
-  else if (pixmap->height > size || pixmap->width > size)
-    return scale_surface (pixmap, orientation, size);
-  else
-    return cairo_surface_reference (pixmap->surface);
+
+  l = g_slist_nth (*cache, ICON_CACHE_MAX_ENTRIES - 1);
+  if (l != NULL)
+    {
+      icon_cache_entry_free (l->data);
+      *cache = g_slist_delete_link (*cache, l);
+    }
+
+  entry = g_new0 (SnIconCacheEntry, 1);
+  entry->size = size;
+  entry->orientation = orientation;
+  entry->scale = scale;
+  entry->surface = cairo_surface_reference (surface);
+  *cache = g_slist_prepend (*cache, entry);
+
+  return surface;
 }
 
-static cairo_surface_t *
-get_icon_by_name (const gchar *icon_name,
-                  gint         requested_size,
-                  gint         scale)
+/* Icons looked up by name, shared by all the items: blinking between a
+ * few names, or many items using the same icon, costs a hash lookup. The
+ * search paths of the items all go to the default theme, which tells when
+ * they or the theme change. */
+#define ICON_NAME_CACHE_MAX_ENTRIES 128
+#define ICON_THEME_RESCAN_INTERVAL G_USEC_PER_SEC
+
+static GHashTable *icon_name_cache = NULL;
+
+static void
+icon_theme_changed_cb (GtkIconTheme *icon_theme,
+                       gpointer      user_data)
+{
+  g_hash_table_remove_all (icon_name_cache);
+}
+
+static void
+add_icon_theme_path (const gchar *icon_theme_path)
 {
   GtkIconTheme *icon_theme;
-  gint *sizes;
+  gchar **paths;
+  gint n_paths;
   gint i;
-  gint chosen_size = 0;
-
-  g_return_val_if_fail (icon_name != NULL && icon_name[0] != '\0', NULL);
-  g_return_val_if_fail (requested_size > 0, NULL);
 
   icon_theme = gtk_icon_theme_get_default ();
-  gtk_icon_theme_rescan_if_needed (icon_theme);
+
+  /* appending a path the theme already has would only rescan it */
+  gtk_icon_theme_get_search_path (icon_theme, &paths, &n_paths);
+  for (i = 0; i < n_paths; i++)
+    if (g_strcmp0 (paths[i], icon_theme_path) == 0)
+      break;
+  g_strfreev (paths);
+
+  if (i == n_paths)
+    gtk_icon_theme_append_search_path (icon_theme, icon_theme_path);
+}
+
+static cairo_surface_t *
+load_icon_by_name (GtkIconTheme *icon_theme,
+                   const gchar  *icon_name,
+                   gint          requested_size,
+                   gint          scale)
+{
+  gint *sizes;
+  gint i;
+  gint chosen_size = 0;
 
   sizes = gtk_icon_theme_get_icon_sizes (icon_theme, icon_name);
   for (i = 0; sizes[i] != 0; i++)
@@ -234,6 +370,65 @@ get_icon_by_name (const gchar *icon_name,
                                       NULL, GTK_ICON_LOOKUP_FORCE_SIZE, NULL);
 }
 
+static cairo_surface_t *
+get_icon_by_name (const gchar *icon_name,
+                  gint         requested_size,
+                  gint         scale)
+{
+  static gint64 last_rescan = 0;
+  GtkIconTheme *icon_theme;
+  cairo_surface_t *surface;
+  gint64 now;
+  gchar *key;
+
+  g_return_val_if_fail (icon_name != NULL && icon_name[0] != '\0', NULL);
+  g_return_val_if_fail (requested_size > 0, NULL);
+
+  icon_theme = gtk_icon_theme_get_default ();
+
+  if (icon_name_cache == NULL)
+    {
+      icon_name_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                               (GDestroyNotify) cairo_surface_destroy);
+      g_signal_connect (icon_theme, "changed",
+                        G_CALLBACK (icon_theme_changed_cb), NULL);
+    }
+
+  /* this empties the cache when icons were installed or removed */
+  now = g_get_monotonic_time ();
+  if (now - last_rescan >= ICON_THEME_RESCAN_INTERVAL)
+    {
+      gtk_icon_theme_rescan_if_needed (icon_theme);
+      last_rescan = now;
+    }
+
+  key = g_strdup_printf ("%s:%d:%d", icon_name, requested_size, scale);
+
+  surface = g_hash_table_lookup (icon_name_cache, key);
+  if (surface != NULL)
+    {
+      g_free (key);
+      return cairo_surface_reference (surface);
+    }
+
+  surface = load_icon_by_name (icon_theme, icon_name, requested_size, scale);
+
+  /* names that are not found are not kept: they may be files, which are
+   * loaded by the caller, or icons about to be installed */
+  if (surface == NULL)
+    {
+      g_free (key);
+      return NULL;
+    }
+
+  if (g_hash_table_size (icon_name_cache) >= ICON_NAME_CACHE_MAX_ENTRIES)
+    g_hash_table_remove_all (icon_name_cache);
+
+  g_hash_table_insert (icon_name_cache, key, cairo_surface_reference (surface));
+
+  return surface;
+}
+
 #define ICON_NAME_VALID(icon_name) (icon_name && icon_name[0] != '\0')
 #define ICON_PIXMAP_VALID(icon_pixmap) (icon_pixmap && icon_pixmap[0] != NULL)
 
@@ -246,9 +441,14 @@ update (SnItemV0 *v0)
   gint icon_size;
   const gchar *icon_name;
   SnIconPixmap **icon_pixmap;
+  GSList **icon_pixmap_cache;
+  gint64 start_time;
 
   g_return_if_fail (SN_IS_ITEM_V0 (v0));
 
+  start_time = na_stats_enabled () ? g_get_monotonic_time () : 0;
+  na_stats_count (NA_ITEM (v0), NA_STATS_REDRAWS);
+
   image = GTK_IMAGE (v0->image);
 
   if (v0->icon_size > 0)
@@ -264,11 +464,13 @@ update (SnItemV0 *v0)
     {
       icon_name = v0->attention_icon_name;
       icon_pixmap = v0->attention_icon_pixmap;
+      icon_pixmap_cache = &v0->attention_icon_pixmap_cache;
     }
   else
     {
       icon_name = v0->icon_name;
       icon_pixmap = v0->icon_pixmap;
+      icon_pixmap_cache = &v0->icon_pixmap_cache;
     }
 
   if (ICON_NAME_VALID (icon_name))
@@ -310,9 +512,10 @@ update (SnItemV0 *v0)
     {
       cairo_surface_t *surface;
 
-      surface = get_surface (icon_pixmap,
-                             gtk_orientable_get_orientation (GTK_ORIENTABLE (v0)),
-                             icon_size);
+      surface = get_cached_surface (icon_pixmap, icon_pixmap_cache,
+                                    gtk_orientable_get_orientation (GTK_ORIENTABLE (v0)),
+                                    icon_size,
+                                    gtk_widget_get_scale_factor (GTK_WIDGET (image)));
       if (surface != NULL)
         {
           gtk_image_set_from_surface (image, surface);
@@ -371,6 +574,9 @@ update (SnItemV0 *v0)
     }
   else
   gtk_widget_set_visible (GTK_WIDGET (v0), TRUE);
+
+  if (start_time != 0)
+    na_stats_add_time (NA_ITEM (v0), g_get_monotonic_time () - start_time);
 }
 
 static gboolean
@@ -396,49 +602,91 @@ queue_update (SnItemV0 *v0)
   g_source_set_name_by_id (v0->update_id, "[status-notifier] update_cb");
 }
 
-static cairo_surface_t *
-surface_from_variant (GVariant *variant,
-                      gint      width,
-                      gint      height)
+/* c * a / 255, rounded, without a division */
+static inline guint8
+premultiply (guint8 c,
+             guint8 a)
 {
-  cairo_format_t format;
-  gint stride;
-  guint32 *data;
-  gint x;
-  gint y;
-  guchar *p;
+  guint t = c * a + 128;
 
-  format = CAIRO_FORMAT_ARGB32;
-  stride = cairo_format_stride_for_width (format, width);
-  data = (guint32 *) g_variant_get_data (variant);
+  return (t + (t >> 8)) >> 8;
+}
 
-#if G_BYTE_ORDER == G_LITTLE_ENDIAN
-  {
-    gint i;
+/* Converts IconPixmap data, big-endian non-premultiplied ARGB, to Cairo's
+ * native-endian premultiplied ARGB32, in one pass */
+static void
+convert_pixels (guint32      *dest,
+                const guint8 *src,
+                gint          n_pixels)
+{
+  gint i = 0;
 
-    for (i = 0; i < width * height; i++)
-      data[i] = GUINT32_FROM_BE (data[i]);
+#if defined(__SSE2__)
+  {
+    const __m128i zero = _mm_setzero_si128 ();
+    const __m128i half = _mm_set1_epi16 (128);
+    /* lanes 3 and 7 hold alpha after the reordering, multiplied by 255 */
+    const __m128i color_mask = _mm_set_epi16 (0, -1, -1, -1, 0, -1, -1, -1);
+    const __m128i alpha_one = _mm_set_epi16 (255, 0, 0, 0, 255, 0, 0, 0);
+
+    for (; i + 4 <= n_pixels; i += 4)
+      {
+        __m128i v = _mm_loadu_si128 ((const __m128i *) (src + i * 4));
+        __m128i halves[2];
+        gint h;
+
+        halves[0] = _mm_unpacklo_epi8 (v, zero);
+        halves[1] = _mm_unpackhi_epi8 (v, zero);
+
+        for (h = 0; h < 2; h++)
+          {
+            __m128i x, alpha, t;
+
+            /* A R G B to B G R A, which is ARGB32 in memory */
+            x = _mm_shufflelo_epi16 (halves[h], _MM_SHUFFLE (0, 1, 2, 3));
+            x = _mm_shufflehi_epi16 (x, _MM_SHUFFLE (0, 1, 2, 3));
+
+            alpha = _mm_shufflelo_epi16 (x, _MM_SHUFFLE (3, 3, 3, 3));
+            alpha = _mm_shufflehi_epi16 (alpha, _MM_SHUFFLE (3, 3, 3, 3));
+            alpha = _mm_or_si128 (_mm_and_si128 (alpha, color_mask), alpha_one);
+
+            t = _mm_add_epi16 (_mm_mullo_epi16 (x, alpha), half);
+            halves[h] = _mm_srli_epi16 (_mm_add_epi16 (t, _mm_srli_epi16 (t, 8)), 8);
+          }
+
+        _mm_storeu_si128 ((__m128i *) (dest + i),
+                          _mm_packus_epi16 (halves[0], halves[1]));
+      }
   }
-#endif
-
-  p = (guchar *) data;
-  /* premultiply alpha for Cairo */
-  for (y = 0; y < height; y++)
+#elif defined(__ARM_NEON) && G_BYTE_ORDER == G_LITTLE_ENDIAN
+  for (; i + 8 <= n_pixels; i += 8)
     {
-      for (x = 0; x < width; x++)
+      uint8x8x4_t in = vld4_u8 (src + i * 4);
+      uint8x8x4_t out;
+      gint c;
+
+      /* in: A R G B, out: B G R A, which is ARGB32 in memory */
+      for (c = 1; c < 4; c++)
         {
-          guchar alpha = p[x * 4 + 3];
+          uint16x8_t t = vmull_u8 (in.val[c], in.val[0]);
 
-          p[x * 4 + 0] = (p[x * 4 + 0] * alpha) / 255;
-          p[x * 4 + 1] = (p[x * 4 + 1] * alpha) / 255;
-          p[x * 4 + 2] = (p[x * 4 + 2] * alpha) / 255;
+          out.val[3 - c] = vraddhn_u16 (t, vrshrq_n_u16 (t, 8));
         }
+      out.val[3] = in.val[0];
 
-      p += stride;
+      vst4_u8 ((uint8_t *) (dest + i), out);
     }
+#endif
 
-  return cairo_image_surface_create_for_data ((guchar *) data, format,
-                                              width, height, stride);
+  for (; i < n_pixels; i++)
+    {
+      const guint8 *p = src + i * 4;
+
+      dest[i] = ((guint32) p[0] << 24) |
+                ((guint32) premultiply (p[1], p[0]) << 16) |
+                ((guint32) premultiply (p[2], p[0]) << 8) |
+                (guint32) premultiply (p[3], p[0]);
+    }
 }
 
 static cairo_surface_t *
@@ -447,37 +695,60 @@ icon_surface_new (GVariant *variant,
                   gint      height)
 {
   cairo_surface_t *surface;
-  cairo_surface_t *tmp;
-  cairo_t *cr;
+  const guint8 *src;
+  guchar *dest;
+  gint stride;
+  gint y;
 
-  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
-  if (cairo_surface_status (surface) != CAIRO_STATUS_SUCCESS)
+  if (width <= 0 || height <= 0)
     return NULL;
 
-  tmp = surface_from_variant (variant, width, height);
-  if (cairo_surface_status (tmp) != CAIRO_STATUS_SUCCESS)
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+  if (cairo_surface_status (surface) != CAIRO_STATUS_SUCCESS)
     {
       cairo_surface_destroy (surface);
       return NULL;
     }
 
-  cr = cairo_create (surface);
-  if (cairo_status (cr) != CAIRO_STATUS_SUCCESS)
+  if (g_variant_get_size (variant) < (gsize) width * height * 4)
     {
+      g_warning ("IconPixmap data is too short for %dx%d pixels",
+                 width, height);
       cairo_surface_destroy (surface);
-      cairo_surface_destroy (tmp);
       return NULL;
     }
 
-  cairo_set_source_surface (cr, tmp, 0, 0);
-  cairo_paint (cr);
+  /* the pixels are converted straight into the surface, leaving the
+   * message data alone */
+  src = g_variant_get_data (variant);
+  dest = cairo_image_surface_get_data (surface);
+  stride = cairo_image_surface_get_stride (surface);
 
-  cairo_surface_destroy (tmp);
-  cairo_destroy (cr);
+  cairo_surface_flush (surface);
+  for (y = 0; y < height; y++)
+    convert_pixels ((guint32 *) (dest + y * stride),
+                    src + (gsize) y * width * 4, width);
+  cairo_surface_mark_dirty (surface);
 
   return surface;
 }
 
+static gint
+compare_size (gconstpointer a,
+              gconstpointer b)
+{
+  const SnIconPixmap *p1;
+  const SnIconPixmap *p2;
+
+  p1 = *(SnIconPixmap * const *) a;
+  p2 = *(SnIconPixmap * const *) b;
+
+  if (MAX (p1->width, p1->height) != MAX (p2->width, p2->height))
+    return MAX (p1->width, p1->height) - MAX (p2->width, p2->height);
+
+  return MIN (p1->width, p1->height) - MIN (p2->width, p2->height);
+}
+
 static SnIconPixmap **
 icon_pixmap_new (GVariant *variant)
 {
@@ -518,6 +789,9 @@ icon_pixmap_new (GVariant *variant)
         }
     }
 
+  /* sorted once here, so that picking a size does not have to */
+  g_ptr_array_sort (array, compare_size);
+
   g_ptr_array_add (array, NULL);
   return (SnIconPixmap **) g_ptr_array_free (array, FALSE);
 }
@@ -588,275 +862,284 @@ sn_tooltip_free (SnTooltip *tooltip)
   g_free (tooltip);
 }
 
-static GVariant *
-get_property (GObject      *source_object,
-              GAsyncResult *res,
-              gpointer      user_data,
-              gboolean     *cancelled)
+static void
+set_refresh_property (SnItemV0          *v0,
+                      SnRefreshProperty  property,
+                      GVariant          *value)
 {
-  GVariant *variant;
-  GError *error;
-  GVariant *property;
+  switch (property)
+    {
+      case SN_REFRESH_TITLE:
+        g_free (v0->title);
+        v0->title = value ? g_variant_dup_string (value, NULL) : NULL;
+        break;
 
-  error = NULL;
-  variant = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object),
-                                           res, &error);
+      case SN_REFRESH_ICON_NAME:
+        g_free (v0->icon_name);
+        v0->icon_name = value ? g_variant_dup_string (value, NULL) : NULL;
+        break;
 
-  *cancelled = FALSE;
-  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
-    {
-      *cancelled = TRUE;
-      g_error_free (error);
-      return NULL;
-    }
+      case SN_REFRESH_ICON_PIXMAP:
+        icon_pixmap_free (v0->icon_pixmap);
+        v0->icon_pixmap = icon_pixmap_new (value);
+        icon_cache_clear (&v0->icon_pixmap_cache);
+        na_stats_count (NA_ITEM (v0), NA_STATS_ICON_DECODES);
+        break;
 
-  if (g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS))
-    {
-      g_error_free (error);
-      return NULL;
-    }
+      case SN_REFRESH_OVERLAY_ICON_NAME:
+        g_free (v0->overlay_icon_name);
+        v0->overlay_icon_name = value ? g_variant_dup_string (value, NULL) : NULL;
+        break;
 
-  if (error)
-    {
-      g_warning ("%s", error->message);
-      g_error_free (error);
-      return NULL;
-    }
+      case SN_REFRESH_OVERLAY_ICON_PIXMAP:
+        icon_pixmap_free (v0->overlay_icon_pixmap);
+        v0->overlay_icon_pixmap = icon_pixmap_new (value);
+        na_stats_count (NA_ITEM (v0), NA_STATS_ICON_DECODES);
+        break;
 
-  g_variant_get (variant, "(v)", &property);
-  g_variant_unref (variant);
+      case SN_REFRESH_ATTENTION_ICON_NAME:
+        g_free (v0->attention_icon_name);
+        v0->attention_icon_name = value ? g_variant_dup_string (value, NULL) : NULL;
+        break;
+
+      case SN_REFRESH_ATTENTION_ICON_PIXMAP:
+        icon_pixmap_free (v0->attention_icon_pixmap);
+        v0->attention_icon_pixmap = icon_pixmap_new (value);
+        icon_cache_clear (&v0->attention_icon_pixmap_cache);
+        na_stats_count (NA_ITEM (v0), NA_STATS_ICON_DECODES);
+        break;
+
+      case SN_REFRESH_TOOLTIP:
+        sn_tooltip_free (v0->tooltip);
+        v0->tooltip = sn_tooltip_new (value);
+        break;
 
-  return property;
+      case SN_REFRESH_N_PROPERTIES:
+      default:
+        g_assert_not_reached ();
+        break;
+    }
 }
 
-static void
-update_property (SnItemV0            *v0,
-                 const gchar         *property,
-                 GAsyncReadyCallback  callback)
+static gint
+find_refresh_property (const gchar *name)
 {
-  GDBusProxy *proxy;
-  SnItem *item;
+  gint i;
 
-  proxy = G_DBUS_PROXY (v0->proxy);
-  item = SN_ITEM (v0);
+  for (i = 0; i < SN_REFRESH_N_PROPERTIES; i++)
+    if (g_strcmp0 (refresh_property_names[i], name) == 0)
+      return i;
 
-  g_dbus_connection_call (g_dbus_proxy_get_connection (proxy),
-                          sn_item_get_bus_name (item),
-                          sn_item_get_object_path (item),
-                          "org.freedesktop.DBus.Properties", "Get",
-                          g_variant_new ("(ss)", SN_ITEM_INTERFACE, property),
-                          G_VARIANT_TYPE ("(v)"),
-                          G_DBUS_CALL_FLAGS_NONE, -1,
-                          v0->cancellable, callback, v0);
+  return -1;
 }
 
+/* Remembers the value a refreshed property was last set from, so that
+ * the next refresh only applies the properties that really changed */
 static void
-update_title (GObject      *source_object,
-              GAsyncResult *res,
-              gpointer      user_data)
+remember_refresh_property (SnItemV0    *v0,
+                           const gchar *name,
+                           GVariant    *value)
 {
-  SnItemV0 *v0;
-  GVariant *variant;
-  gboolean cancelled;
+  gint property;
 
-  variant = get_property (source_object, res, user_data, &cancelled);
-  if (cancelled)
+  property = find_refresh_property (name);
+  if (property < 0)
     return;
 
-  v0 = SN_ITEM_V0 (user_data);
-
-  g_free (v0->title);
-  v0->title = g_variant_dup_string (variant, NULL);
-  g_clear_pointer (&variant, g_variant_unref);
-
-  queue_update (v0);
+  g_clear_pointer (&v0->refresh_values[property], g_variant_unref);
+  v0->refresh_values[property] = g_variant_ref (value);
 }
 
-static void
-new_title_cb (SnItemV0 *v0)
-{
-  update_property (v0, "Title", update_title);
-}
+static void schedule_refresh (SnItemV0 *v0);
 
 static void
-update_icon_name (GObject      *source_object,
-                  GAsyncResult *res,
-                  gpointer      user_data)
+refresh_cb (GObject      *source_object,
+            GAsyncResult *res,
+            gpointer      user_data)
 {
   SnItemV0 *v0;
-  GVariant *variant;
-  gboolean cancelled;
+  GVariant *properties;
+  GError *error;
+  GVariantIter *iter;
+  gchar *key;
+  GVariant *value;
+  guint requested;
+  guint seen;
+  gboolean changed;
+  gint i;
 
-  variant = get_property (source_object, res, user_data, &cancelled);
-  if (cancelled)
-    return;
+  error = NULL;
+  properties = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object),
+                                              res, &error);
+
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      g_error_free (error);
+      return;
+    }
 
   v0 = SN_ITEM_V0 (user_data);
 
-  g_free (v0->icon_name);
-  v0->icon_name = g_variant_dup_string (variant, NULL);
-  g_clear_pointer (&variant, g_variant_unref);
+  requested = v0->refresh_requested;
+  v0->refresh_requested = 0;
 
-  queue_update (v0);
-}
+  if (error)
+    {
+      g_warning ("%s", error->message);
+      g_error_free (error);
 
-static void
-update_icon_pixmap (GObject      *source_object,
-                    GAsyncResult *res,
-                    gpointer      user_data)
-{
-  SnItemV0 *v0;
-  GVariant *variant;
-  gboolean cancelled;
+      if (v0->refresh_pending != 0)
+        schedule_refresh (v0);
+      return;
+    }
 
-  variant = get_property (source_object, res, user_data, &cancelled);
-  if (cancelled)
-    return;
+  seen = 0;
+  changed = FALSE;
 
-  v0 = SN_ITEM_V0 (user_data);
+  g_variant_get (properties, "(a{sv})", &iter);
+  while (g_variant_iter_next (iter, "{sv}", &key, &value))
+    {
+      gint property;
 
-  g_clear_pointer (&v0->icon_pixmap, icon_pixmap_free);
-  v0->icon_pixmap = icon_pixmap_new (variant);
-  g_clear_pointer (&variant, g_variant_unref);
+      property = find_refresh_property (key);
+      if (property >= 0 && (requested & (1 << property)) != 0)
+        {
+          seen |= 1 << property;
 
-  queue_update (v0);
-}
+          if (v0->refresh_values[property] == NULL ||
+              !g_variant_equal (v0->refresh_values[property], value))
+            {
+              remember_refresh_property (v0, key, value);
+              set_refresh_property (v0, property, value);
+              changed = TRUE;
+            }
+        }
 
-static void
-new_icon_cb (SnItemV0 *v0)
-{
-  update_property (v0, "IconName", update_icon_name);
-  update_property (v0, "IconPixmap", update_icon_pixmap);
-}
+      g_variant_unref (value);
+      g_free (key);
+    }
 
-static void
-update_overlay_icon_name (GObject      *source_object,
-                          GAsyncResult *res,
-                          gpointer      user_data)
-{
-  SnItemV0 *v0;
-  GVariant *variant;
-  gboolean cancelled;
+  g_variant_iter_free (iter);
+  g_variant_unref (properties);
 
-  variant = get_property (source_object, res, user_data, &cancelled);
-  if (cancelled)
-    return;
+  /* the item does not have these anymore */
+  for (i = 0; i < SN_REFRESH_N_PROPERTIES; i++)
+    {
+      if ((requested & ~seen & (1 << i)) == 0 || v0->refresh_values[i] == NULL)
+        continue;
 
-  v0 = SN_ITEM_V0 (user_data);
+      g_clear_pointer (&v0->refresh_values[i], g_variant_unref);
+      set_refresh_property (v0, i, NULL);
+      changed = TRUE;
+    }
 
-  g_free (v0->overlay_icon_name);
-  v0->overlay_icon_name = g_variant_dup_string (variant, NULL);
-  g_clear_pointer (&variant, g_variant_unref);
+  if (changed)
+    queue_update (v0);
 
-  queue_update (v0);
+  /* signals received while waiting for the answer */
+  if (v0->refresh_pending != 0)
+    schedule_refresh (v0);
 }
 
-static void
-update_overlay_icon_pixmap (GObject      *source_object,
-                            GAsyncResult *res,
-                            gpointer      user_data)
+static gboolean
+refresh_timeout_cb (gpointer user_data)
 {
   SnItemV0 *v0;
-  GVariant *variant;
-  gboolean cancelled;
-
-  variant = get_property (source_object, res, user_data, &cancelled);
-  if (cancelled)
-    return;
+  GDBusProxy *proxy;
+  SnItem *item;
 
   v0 = SN_ITEM_V0 (user_data);
+  proxy = G_DBUS_PROXY (v0->proxy);
+  item = SN_ITEM (v0);
 
-  g_clear_pointer (&v0->overlay_icon_pixmap, icon_pixmap_free);
-  v0->overlay_icon_pixmap = icon_pixmap_new (variant);
-  g_clear_pointer (&variant, g_variant_unref);
+  v0->refresh_id = 0;
+  v0->refresh_requested = v0->refresh_pending;
+  v0->refresh_pending = 0;
+  v0->last_refresh = g_get_monotonic_time ();
 
-  queue_update (v0);
-}
+  /* one GetAll answers the whole burst of signals */
+  na_stats_count (NA_ITEM (v0), NA_STATS_DBUS_CALLS);
+  g_dbus_connection_call (g_dbus_proxy_get_connection (proxy),
+                          sn_item_get_bus_name (item),
+                          sn_item_get_object_path (item),
+                          "org.freedesktop.DBus.Properties", "GetAll",
+                          g_variant_new ("(s)", SN_ITEM_INTERFACE),
+                          G_VARIANT_TYPE ("(a{sv})"),
+                          G_DBUS_CALL_FLAGS_NONE, -1,
+                          v0->cancellable, refresh_cb, v0);
 
-static void
-new_overlay_icon_cb (SnItemV0 *v0)
-{
-  update_property (v0, "OverlayIconName", update_overlay_icon_name);
-  update_property (v0, "OverlayIconPixmap", update_overlay_icon_pixmap);
+  return G_SOURCE_REMOVE;
 }
 
 static void
-update_attention_icon_name (GObject      *source_object,
-                            GAsyncResult *res,
-                            gpointer      user_data)
+schedule_refresh (SnItemV0 *v0)
 {
-  SnItemV0 *v0;
-  GVariant *variant;
-  gboolean cancelled;
+  gint64 since;
+  guint delay;
 
-  variant = get_property (source_object, res, user_data, &cancelled);
-  if (cancelled)
+  if (v0->refresh_id != 0 || v0->refresh_requested != 0)
     return;
 
-  v0 = SN_ITEM_V0 (user_data);
+  since = (g_get_monotonic_time () - v0->last_refresh) / 1000;
+  delay = REFRESH_DELAY;
 
-  g_free (v0->attention_icon_name);
-  v0->attention_icon_name = g_variant_dup_string (variant, NULL);
-  g_clear_pointer (&variant, g_variant_unref);
+  /* an item asking again right after a refresh is flapping: refresh it
+   * less and less often, until it calms down */
+  if (since > 2 * v0->refresh_interval)
+    {
+      v0->refresh_interval = REFRESH_MIN_INTERVAL;
+    }
+  else if (since < v0->refresh_interval)
+    {
+      delay = MAX (delay, (guint) (v0->refresh_interval - since));
+      v0->refresh_interval = MIN (v0->refresh_interval * 2,
+                                  REFRESH_MAX_INTERVAL);
+    }
 
-  queue_update (v0);
+  v0->refresh_id = g_timeout_add (delay * refresh_scale, refresh_timeout_cb, v0);
+  g_source_set_name_by_id (v0->refresh_id,
+                           "[status-notifier] refresh_timeout_cb");
 }
 
 static void
-update_attention_icon_pixmap (GObject      *source_object,
-                              GAsyncResult *res,
-                              gpointer      user_data)
+queue_refresh (SnItemV0 *v0,
+               guint     properties)
 {
-  SnItemV0 *v0;
-  GVariant *variant;
-  gboolean cancelled;
-
-  variant = get_property (source_object, res, user_data, &cancelled);
-  if (cancelled)
-    return;
-
-  v0 = SN_ITEM_V0 (user_data);
-
-  icon_pixmap_free (v0->attention_icon_pixmap);
-  v0->attention_icon_pixmap = icon_pixmap_new (variant);
-  g_clear_pointer (&variant, g_variant_unref);
-
-  queue_update (v0);
+  v0->refresh_pending |= properties;
+  schedule_refresh (v0);
 }
 
 static void
-new_attention_icon_cb (SnItemV0 *v0)
+new_title_cb (SnItemV0 *v0)
 {
-  update_property (v0, "AttentionIconName", update_attention_icon_name);
-  update_property (v0, "AttentionIconPixmap", update_attention_icon_pixmap);
+  queue_refresh (v0, 1 << SN_REFRESH_TITLE);
 }
 
 static void
-update_tooltip (GObject      *source_object,
-                GAsyncResult *res,
-                gpointer      user_data)
+new_icon_cb (SnItemV0 *v0)
 {
-  SnItemV0 *v0;
-  GVariant *variant;
-  gboolean cancelled;
-
-  variant = get_property (source_object, res, user_data, &cancelled);
-  if (cancelled)
-    return;
-
-  v0 = SN_ITEM_V0 (user_data);
+  queue_refresh (v0, (1 << SN_REFRESH_ICON_NAME) |
+                     (1 << SN_REFRESH_ICON_PIXMAP));
+}
 
-  sn_tooltip_free (v0->tooltip);
-  v0->tooltip = sn_tooltip_new (variant);
-  g_clear_pointer (&variant, g_variant_unref);
+static void
+new_overlay_icon_cb (SnItemV0 *v0)
+{
+  queue_refresh (v0, (1 << SN_REFRESH_OVERLAY_ICON_NAME) |
+                     (1 << SN_REFRESH_OVERLAY_ICON_PIXMAP));
+}
 
-  queue_update (v0);
+static void
+new_attention_icon_cb (SnItemV0 *v0)
+{
+  queue_refresh (v0, (1 << SN_REFRESH_ATTENTION_ICON_NAME) |
+                     (1 << SN_REFRESH_ATTENTION_ICON_PIXMAP));
 }
 
 static void
 new_tooltip_cb (SnItemV0 *v0)
 {
-  update_property (v0, "ToolTip", update_tooltip);
+  queue_refresh (v0, 1 << SN_REFRESH_TOOLTIP);
 }
 
 static void
@@ -902,13 +1185,7 @@ new_icon_theme_path_cb (SnItemV0 *v0,
   g_variant_unref (variant);
 
   if (v0->icon_theme_path != NULL)
-    {
-      GtkIconTheme *icon_theme;
-
-      icon_theme = gtk_icon_theme_get_default ();
-
-      gtk_icon_theme_append_search_path (icon_theme, v0->icon_theme_path);
-    }
+    add_icon_theme_path (v0->icon_theme_path);
 
   queue_update (v0);
 }
@@ -921,6 +1198,8 @@ g_properties_changed_cb (GDBusProxy *proxy,
 {
   gchar *debug;
 
+  na_stats_count (NA_ITEM (v0), NA_STATS_PROPERTY_CHANGES);
+
   debug = g_variant_print (changed_properties, FALSE);
   g_debug ("g_properties_changed_cb: %s", debug);
   g_free (debug);
@@ -933,6 +1212,8 @@ g_signal_cb (GDBusProxy *proxy,
              GVariant   *parameters,
              SnItemV0   *v0)
 {
+  na_stats_count (NA_ITEM (v0), NA_STATS_PROPERTY_CHANGES);
+
   if (g_strcmp0 (signal_name, "NewTitle") == 0)
     new_title_cb (v0);
   else if (g_strcmp0 (signal_name, "NewIcon") == 0)
@@ -987,6 +1268,8 @@ get_all_cb (GObject      *source_object,
   g_variant_get (properties, "(a{sv})", &iter);
   while (g_variant_iter_next (iter, "{sv}", &key, &value))
     {
+      remember_refresh_property (v0, key, value);
+
       if (g_strcmp0 (key, "Category") == 0)
         v0->category = g_variant_dup_string (value, NULL);
       else if (g_strcmp0 (key, "Id") == 0)
@@ -1048,13 +1331,7 @@ get_all_cb (GObject      *source_object,
     }
 
   if (v0->icon_theme_path != NULL)
-    {
-      GtkIconTheme *icon_theme;
-
-      icon_theme = gtk_icon_theme_get_default ();
-
-      gtk_icon_theme_append_search_path (icon_theme, v0->icon_theme_path);
-    }
+    add_icon_theme_path (v0->icon_theme_path);
 
   g_signal_connect (v0->proxy, "g-properties-changed",
                     G_CALLBACK (g_properties_changed_cb), v0);
@@ -1094,6 +1371,7 @@ proxy_ready_cb (GObject      *source_object,
       return;
     }
 
+  na_stats_count (NA_ITEM (v0), NA_STATS_DBUS_CALLS);
   g_dbus_connection_call (g_dbus_proxy_get_connection (G_DBUS_PROXY (proxy)),
                           sn_item_get_bus_name (SN_ITEM (v0)),
                           sn_item_get_object_path (SN_ITEM (v0)),
@@ -1141,6 +1419,12 @@ sn_item_v0_dispose (GObject *object)
       v0->update_id = 0;
     }
 
+  if (v0->refresh_id != 0)
+    {
+      g_source_remove (v0->refresh_id);
+      v0->refresh_id = 0;
+    }
+
   G_OBJECT_CLASS (sn_item_v0_parent_class)->dispose (object);
 }
 
@@ -1148,9 +1432,13 @@ static void
 sn_item_v0_finalize (GObject *object)
 {
   SnItemV0 *v0;
+  gint i;
 
   v0 = SN_ITEM_V0 (object);
 
+  for (i = 0; i < SN_REFRESH_N_PROPERTIES; i++)
+    g_clear_pointer (&v0->refresh_values[i], g_variant_unref);
+
   g_clear_pointer (&v0->id, g_free);
   g_clear_pointer (&v0->category, g_free);
   g_clear_pointer (&v0->status, g_free);
@@ -1159,10 +1447,12 @@ sn_item_v0_finalize (GObject *object)
   g_clear_pointer (&v0->icon_name, g_free);
   g_clear_pointer (&v0->label, g_free);
   g_clear_pointer (&v0->icon_pixmap, icon_pixmap_free);
+  icon_cache_clear (&v0->icon_pixmap_cache);
   g_clear_pointer (&v0->overlay_icon_name, g_free);
   g_clear_pointer (&v0->overlay_icon_pixmap, icon_pixmap_free);
   g_clear_pointer (&v0->attention_icon_name, g_free);
   g_clear_pointer (&v0->attention_icon_pixmap, icon_pixmap_free);
+  icon_cache_clear (&v0->attention_icon_pixmap_cache);
   g_clear_pointer (&v0->attention_movie_name, g_free);
   g_clear_pointer (&v0->tooltip, sn_tooltip_free);
   g_clear_pointer (&v0->icon_theme_path, g_free);
@@ -1222,6 +1512,7 @@ sn_item_v0_context_menu (SnItem *item,
 
   v0 = SN_ITEM_V0 (item);
 
+  na_stats_count (NA_ITEM (v0), NA_STATS_DBUS_CALLS);
   sn_item_v0_gen_call_context_menu (v0->proxy, x, y, NULL,
                                     context_menu_cb, v0);
 }
@@ -1247,6 +1538,7 @@ sn_item_v0_activate (SnItem *item,
 
   v0 = SN_ITEM_V0 (item);
 
+  na_stats_count (NA_ITEM (v0), NA_STATS_DBUS_CALLS);
   sn_item_v0_gen_call_activate (v0->proxy, x, y, NULL,
                                 activate_cb, v0);
 }
@@ -1272,6 +1564,7 @@ sn_item_v0_secondary_activate (SnItem *item,
 
   v0 = SN_ITEM_V0 (item);
 
+  na_stats_count (NA_ITEM (v0), NA_STATS_DBUS_CALLS);
   sn_item_v0_gen_call_secondary_activate (v0->proxy, x, y, NULL,
                                           secondary_activate_cb, v0);
 }
@@ -1310,9 +1603,20 @@ sn_item_v0_scroll (SnItem            *item,
         break;
     }
 
+  na_stats_count (NA_ITEM (v0), NA_STATS_DBUS_CALLS);
   sn_item_v0_gen_call_scroll (v0->proxy, delta, tmp, NULL, scroll_cb, v0);
 }
 
+/* the icons of the previous scale stay in the caches, for when the panel
+ * goes back to its monitor */
+static void
+scale_factor_changed_cb (SnItemV0   *v0,
+                         GParamSpec *pspec,
+                         gpointer    user_data)
+{
+  queue_update (v0);
+}
+
 static void
 sn_item_v0_size_allocate (GtkWidget      *widget,
                           GtkAllocation  *allocation)
@@ -1441,9 +1745,13 @@ sn_item_v0_init (SnItemV0 *v0)
 {
   v0->icon_size = 16;
   v0->effective_icon_size = 0;
+  v0->refresh_interval = REFRESH_MIN_INTERVAL;
   v0->image = gtk_image_new ();
   gtk_button_set_image (GTK_BUTTON (v0), v0->image);
   gtk_widget_show (v0->image);
+
+  g_signal_connect (v0, "notify::scale-factor",
+                    G_CALLBACK (scale_factor_changed_cb), NULL);
 }
 
 SnItem *
@@ -1518,3 +1826,10 @@ sn_item_v0_set_icon_size (SnItemV0 *v0,
         queue_update (v0);
     }
 }
+
+/* The items of the process wait scale times longer before a refresh */
+void
+sn_item_v0_set_refresh_scale (guint scale)
+{
+  refresh_scale = MAX (scale, 1);
+}
@@ -46,6 +46,8 @@ gint sn_item_v0_get_icon_size (SnItemV0 *v0);
 void sn_item_v0_set_icon_size (SnItemV0 *v0,
                                gint size);
 
+void sn_item_v0_set_refresh_scale (guint scale);
+
 G_END_DECLS
 
 #endif
@@ -25,6 +25,7 @@
 #error file should only be built when HAVE_X11 is enabled
 #endif
 
+#include <stdlib.h>
 #include <string.h>
 
 #include "na-tray-child.h"
@@ -34,8 +35,11 @@
 #include <gdk/gdk.h>
 #include <gdk/gdkx.h>
 #include <X11/Xatom.h>
+#include <X11/Xlib-xcb.h>
+#include <xcb/xcb.h>
 
 #include "na-item.h"
+#include "na-stats.h"
 
 enum
 {
@@ -43,7 +47,21 @@ enum
   PROP_ORIENTATION
 };
 
+/* An icon animating faster than this is shown from its last painted frame
+ * in between, so that it cannot keep the whole tray busy. */
+#define NA_TRAY_CHILD_MIN_PAINT_INTERVAL (G_USEC_PER_SEC / 30)
+
+/* in 32 bit units, more than any title or class */
+#define NA_TRAY_CHILD_PROPERTY_LENGTH 1024
+
+/* stretches NA_TRAY_CHILD_MIN_PAINT_INTERVAL, for the power profiles */
+static guint paint_interval_scale = 1;
+
 static void na_item_init (NaItemInterface *iface);
+static void na_tray_child_plug_added (GtkSocket *socket);
+static GdkFilterReturn na_tray_child_property_filter (GdkXEvent *xevent,
+                                                      GdkEvent  *event,
+                                                      gpointer   data);
 
 G_DEFINE_TYPE_WITH_CODE (NaTrayChild, na_tray_child, GTK_TYPE_SOCKET,
                          G_IMPLEMENT_INTERFACE (GTK_TYPE_ORIENTABLE, NULL)
@@ -55,6 +73,20 @@ na_tray_child_finalize (GObject *object)
   NaTrayChild *child = NA_TRAY_CHILD (object);
 
   g_clear_pointer (&child->id, g_free);
+  g_clear_pointer (&child->title, g_free);
+  g_clear_pointer (&child->res_name, g_free);
+  g_clear_pointer (&child->res_class, g_free);
+  g_clear_pointer (&child->paint_cache, cairo_surface_destroy);
+
+  if (child->property_window)
+    {
+      gdk_window_remove_filter (child->property_window,
+                                na_tray_child_property_filter, child);
+      g_clear_object (&child->property_window);
+    }
+
+  if (child->paint_throttle_id != 0)
+    g_source_remove (child->paint_throttle_id);
 
   G_OBJECT_CLASS (na_tray_child_parent_class)->finalize (object);
 }
@@ -204,6 +236,102 @@ na_tray_child_draw (GtkWidget *widget,
   return FALSE;
 }
 
+static void
+na_tray_child_get_allocation_on_parent (NaTrayChild   *child,
+                                        GtkWidget     *parent,
+                                        GtkAllocation *allocation)
+{
+  GtkAllocation parent_allocation = { 0 };
+
+  /* if the parent doesn't have a window, our allocation is not relative to
+   * the context coordinates but to the parent's allocation */
+  if (! gtk_widget_get_has_window (parent))
+    gtk_widget_get_allocation (parent, &parent_allocation);
+
+  gtk_widget_get_allocation (GTK_WIDGET (child), allocation);
+  allocation->x -= parent_allocation.x;
+  allocation->y -= parent_allocation.y;
+}
+
+static gboolean
+na_tray_child_paint_throttle_cb (gpointer user_data)
+{
+  NaTrayChild *child = user_data;
+  GtkWidget *parent;
+
+  child->paint_throttle_id = 0;
+
+  parent = gtk_widget_get_parent (GTK_WIDGET (child));
+  if (parent)
+    {
+      GtkAllocation allocation;
+
+      /* paint the frames we skipped, only where the icon is */
+      na_tray_child_get_allocation_on_parent (child, parent, &allocation);
+      gtk_widget_queue_draw_area (parent, allocation.x, allocation.y,
+                                  allocation.width, allocation.height);
+    }
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Keeps a copy of what the icon window shows, refreshed at most every
+ * NA_TRAY_CHILD_MIN_PAINT_INTERVAL: the parent is redrawn each time the
+ * icon changes, but also when anything else in the tray does. */
+static cairo_surface_t *
+na_tray_child_get_paint_source (NaTrayChild *child,
+                                int          width,
+                                int          height)
+{
+  GdkWindow *window;
+  gboolean size_changed;
+  gint64 now;
+  cairo_t *cr;
+  int scale;
+
+  now = g_get_monotonic_time ();
+  scale = gtk_widget_get_scale_factor (GTK_WIDGET (child));
+
+  size_changed = (!child->paint_cache ||
+                  cairo_image_surface_get_width (child->paint_cache) != width * scale ||
+                  cairo_image_surface_get_height (child->paint_cache) != height * scale);
+
+  if (!size_changed &&
+      now - child->last_paint_time < NA_TRAY_CHILD_MIN_PAINT_INTERVAL * paint_interval_scale)
+    {
+      /* too soon: reuse the last frame, and come back for the next one */
+      if (child->paint_throttle_id == 0)
+        child->paint_throttle_id =
+          g_timeout_add ((NA_TRAY_CHILD_MIN_PAINT_INTERVAL * paint_interval_scale -
+                          (now - child->last_paint_time)) / 1000 + 1,
+                         na_tray_child_paint_throttle_cb, child);
+
+      return child->paint_cache;
+    }
+
+  window = gtk_widget_get_window (GTK_WIDGET (child));
+
+  if (size_changed)
+    {
+      g_clear_pointer (&child->paint_cache, cairo_surface_destroy);
+      child->paint_cache = gdk_window_create_similar_image_surface (window,
+                                                                    CAIRO_FORMAT_ARGB32,
+                                                                    width, height,
+                                                                    scale);
+    }
+
+  cr = cairo_create (child->paint_cache);
+  cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+  gdk_cairo_set_source_window (cr, window, 0, 0);
+  cairo_paint (cr);
+  cairo_destroy (cr);
+
+  child->last_paint_time = now;
+  na_stats_count (NA_ITEM (child), NA_STATS_REDRAWS);
+
+  return child->paint_cache;
+}
+
 /* Children with alpha channels have been set to be composited by calling
  * gdk_window_set_composited(). We need to paint these children ourselves.
  *
@@ -214,26 +342,27 @@ na_tray_child_draw_on_parent (NaItem    *item,
                               GtkWidget *parent,
                               cairo_t   *parent_cr)
 {
-  if (na_tray_child_has_alpha (NA_TRAY_CHILD (item)))
+  NaTrayChild *child = NA_TRAY_CHILD (item);
+
+  if (na_tray_child_has_alpha (child))
     {
-      GtkWidget    *widget = GTK_WIDGET (item);
-      GtkAllocation parent_allocation = { 0 };
       GtkAllocation allocation;
+      GdkRectangle clip_rect;
+      cairo_surface_t *source;
 
-      /* if the parent doesn't have a window, our allocation is not relative to
-       * the context coordinates but to the parent's allocation */
-      if (! gtk_widget_get_has_window (parent))
-	gtk_widget_get_allocation (parent, &parent_allocation);
+      na_tray_child_get_allocation_on_parent (child, parent, &allocation);
 
-      gtk_widget_get_allocation (widget, &allocation);
-      allocation.x -= parent_allocation.x;
-      allocation.y -= parent_allocation.y;
+      /* only the damaged icons need to be painted again */
+      if (!gdk_cairo_get_clip_rectangle (parent_cr, &clip_rect) ||
+          !gdk_rectangle_intersect (&clip_rect, &allocation, NULL))
+        return TRUE;
+
+      source = na_tray_child_get_paint_source (child,
+                                               allocation.width,
+                                               allocation.height);
 
       cairo_save (parent_cr);
-      gdk_cairo_set_source_window (parent_cr,
-                                   gtk_widget_get_window (widget),
-                                   allocation.x,
-                                   allocation.y);
+      cairo_set_source_surface (parent_cr, source, allocation.x, allocation.y);
       cairo_rectangle (parent_cr, allocation.x, allocation.y, allocation.width, allocation.height);
       cairo_clip (parent_cr);
       cairo_paint (parent_cr);
@@ -372,9 +501,11 @@ na_tray_child_class_init (NaTrayChildClass *klass)
 {
   GObjectClass *gobject_class;
   GtkWidgetClass *widget_class;
+  GtkSocketClass *socket_class;
 
   gobject_class = (GObjectClass *)klass;
   widget_class = (GtkWidgetClass *)klass;
+  socket_class = (GtkSocketClass *)klass;
 
   gobject_class->finalize = na_tray_child_finalize;
   gobject_class->get_property = na_tray_child_get_property;
@@ -388,28 +519,201 @@ na_tray_child_class_init (NaTrayChildClass *klass)
 #endif
   widget_class->draw = na_tray_child_draw;
 
+  socket_class->plug_added = na_tray_child_plug_added;
+
   /* we don't really care actually */
   g_object_class_override_property (gobject_class, PROP_ORIENTATION, "orientation");
 }
 
+/* from libwnck/xutils.c, comes as LGPLv2+ */
+static char *
+latin1_to_utf8 (const char *latin1)
+{
+  GString *str;
+  const char *p;
+
+  str = g_string_new (NULL);
+
+  p = latin1;
+  while (*p)
+    {
+      g_string_append_unichar (str, (gunichar) *p);
+      ++p;
+    }
+
+  return g_string_free (str, FALSE);
+}
+
+static xcb_get_property_cookie_t
+na_tray_child_request_title (GdkDisplay *display,
+                             Window      icon_window)
+{
+  Atom utf8_string, atom;
+
+  utf8_string = gdk_x11_get_xatom_by_name_for_display (display, "UTF8_STRING");
+  atom = gdk_x11_get_xatom_by_name_for_display (display, "_NET_WM_NAME");
+
+  return xcb_get_property (XGetXCBConnection (GDK_DISPLAY_XDISPLAY (display)),
+                           FALSE, icon_window, atom, utf8_string,
+                           0, NA_TRAY_CHILD_PROPERTY_LENGTH);
+}
+
+static xcb_get_property_cookie_t
+na_tray_child_request_wm_class (GdkDisplay *display,
+                                Window      icon_window)
+{
+  return xcb_get_property (XGetXCBConnection (GDK_DISPLAY_XDISPLAY (display)),
+                           FALSE, icon_window, XA_WM_CLASS, XA_STRING,
+                           0, NA_TRAY_CHILD_PROPERTY_LENGTH);
+}
+
+/* A window that is already gone gets an error, which is returned here
+ * rather than going to the error handler: no error trap is needed */
+static void
+na_tray_child_take_title (NaTrayChild               *child,
+                          xcb_get_property_cookie_t  cookie)
+{
+  GdkDisplay *display;
+  xcb_get_property_reply_t *reply;
+  Atom utf8_string;
+
+  display = gtk_widget_get_display (GTK_WIDGET (child));
+  utf8_string = gdk_x11_get_xatom_by_name_for_display (display, "UTF8_STRING");
+
+  g_clear_pointer (&child->title, g_free);
+  child->title_valid = TRUE;
+
+  reply = xcb_get_property_reply (XGetXCBConnection (GDK_DISPLAY_XDISPLAY (display)),
+                                  cookie, NULL);
+  if (!reply)
+    return;
+
+  if (reply->type == utf8_string &&
+      reply->format == 8 &&
+      xcb_get_property_value_length (reply) > 0)
+    {
+      const char *val = xcb_get_property_value (reply);
+      int len = xcb_get_property_value_length (reply);
+
+      if (g_utf8_validate (val, len, NULL))
+        child->title = g_strndup (val, len);
+    }
+
+  free (reply);
+}
+
+/* WM_CLASS holds the name and the class, each one nul-terminated */
+static void
+na_tray_child_take_wm_class (NaTrayChild               *child,
+                             xcb_get_property_cookie_t  cookie)
+{
+  GdkDisplay *display;
+  xcb_get_property_reply_t *reply;
+
+  display = gtk_widget_get_display (GTK_WIDGET (child));
+
+  g_clear_pointer (&child->res_name, g_free);
+  g_clear_pointer (&child->res_class, g_free);
+  child->wm_class_valid = TRUE;
+
+  reply = xcb_get_property_reply (XGetXCBConnection (GDK_DISPLAY_XDISPLAY (display)),
+                                  cookie, NULL);
+  if (!reply)
+    return;
+
+  if (reply->type == XA_STRING &&
+      reply->format == 8 &&
+      xcb_get_property_value_length (reply) > 0)
+    {
+      const char *val = xcb_get_property_value (reply);
+      int len = xcb_get_property_value_length (reply);
+      int name_len;
+      char *str;
+
+      str = g_strndup (val, len);
+      child->res_name = latin1_to_utf8 (str);
+      g_free (str);
+
+      name_len = strnlen (val, len);
+      if (name_len + 1 < len)
+        {
+          str = g_strndup (val + name_len + 1, len - name_len - 1);
+          child->res_class = latin1_to_utf8 (str);
+          g_free (str);
+        }
+    }
+
+  free (reply);
+}
+
+static GdkFilterReturn
+na_tray_child_property_filter (GdkXEvent *gdk_xevent,
+                               GdkEvent  *event,
+                               gpointer   data)
+{
+  NaTrayChild *child = data;
+  XEvent *xevent = (XEvent *) gdk_xevent;
+  GdkDisplay *display;
+
+  if (xevent->type != PropertyNotify ||
+      xevent->xproperty.window != child->icon_window)
+    return GDK_FILTER_CONTINUE;
+
+  display = gtk_widget_get_display (GTK_WIDGET (child));
+
+  /* fetched again the next time they are asked for */
+  if (xevent->xproperty.atom == XA_WM_CLASS)
+    child->wm_class_valid = FALSE;
+  else if (xevent->xproperty.atom ==
+           gdk_x11_get_xatom_by_name_for_display (display, "_NET_WM_NAME"))
+    child->title_valid = FALSE;
+
+  return GDK_FILTER_CONTINUE;
+}
+
+/* GtkSocket selects the property changes of the plug window already */
+static void
+na_tray_child_plug_added (GtkSocket *socket)
+{
+  NaTrayChild *child = NA_TRAY_CHILD (socket);
+  GdkWindow *plug_window;
+
+  if (GTK_SOCKET_CLASS (na_tray_child_parent_class)->plug_added)
+    GTK_SOCKET_CLASS (na_tray_child_parent_class)->plug_added (socket);
+
+  plug_window = gtk_socket_get_plug_window (socket);
+  if (!plug_window || plug_window == child->property_window)
+    return;
+
+  if (child->property_window)
+    {
+      gdk_window_remove_filter (child->property_window,
+                                na_tray_child_property_filter, child);
+      g_object_unref (child->property_window);
+    }
+
+  child->property_window = g_object_ref (plug_window);
+  gdk_window_add_filter (plug_window, na_tray_child_property_filter, child);
+}
+
 GtkWidget *
 na_tray_child_new (GdkScreen *screen,
                    Window     icon_window)
 {
-  XWindowAttributes window_attributes;
-  Display *xdisplay;
+  xcb_connection_t *connection;
+  xcb_get_window_attributes_cookie_t attributes_cookie;
+  xcb_get_window_attributes_reply_t *attributes;
+  xcb_get_property_cookie_t title_cookie;
+  xcb_get_property_cookie_t wm_class_cookie;
   GdkDisplay *display;
   NaTrayChild *child;
   GdkVisual *visual;
   gboolean visual_has_alpha;
   int red_prec, green_prec, blue_prec, depth;
-  int result;
 
   g_return_val_if_fail (GDK_IS_SCREEN (screen), NULL);
   g_return_val_if_fail (icon_window != None, NULL);
 
-  xdisplay = GDK_SCREEN_XDISPLAY (screen);
-
   /* We need to determine the visual of the window we are embedding and create
    * the socket in the same visual.
    */
@@ -419,22 +723,36 @@ na_tray_child_new (GdkScreen *screen,
     g_warning ("na_tray only works on X11");
     return NULL;
   }
-  gdk_x11_display_error_trap_push (display);
-  result = XGetWindowAttributes (xdisplay, icon_window,
-                                 &window_attributes);
-  gdk_x11_display_error_trap_pop_ignored (display);
 
-  if (!result) /* Window already gone */
-    return NULL;
+  /* The properties the tray sorts and labels the icon with are asked for
+   * along with the visual: a new icon costs a single round trip, which
+   * matters with many icons on a remote display. */
+  connection = XGetXCBConnection (GDK_DISPLAY_XDISPLAY (display));
+  attributes_cookie = xcb_get_window_attributes (connection, icon_window);
+  title_cookie = na_tray_child_request_title (display, icon_window);
+  wm_class_cookie = na_tray_child_request_wm_class (display, icon_window);
+
+  attributes = xcb_get_window_attributes_reply (connection, attributes_cookie, NULL);
+  visual = NULL;
+  if (attributes) /* else window already gone */
+    {
+      visual = gdk_x11_screen_lookup_visual (screen, attributes->visual);
+      free (attributes);
+    }
 
-  visual = gdk_x11_screen_lookup_visual (screen,
-                                         window_attributes.visual->visualid);
   if (!visual) /* Icon window is on another screen? */
-    return NULL;
+    {
+      xcb_discard_reply (connection, title_cookie.sequence);
+      xcb_discard_reply (connection, wm_class_cookie.sequence);
+      return NULL;
+    }
 
   child = g_object_new (NA_TYPE_TRAY_CHILD, NULL);
   child->icon_window = icon_window;
 
+  na_tray_child_take_title (child, title_cookie);
+  na_tray_child_take_wm_class (child, wm_class_cookie);
+
   gtk_widget_set_visual (GTK_WIDGET (child), visual);
 
   /* We have alpha if the visual has something other than red, green,
@@ -456,55 +774,14 @@ na_tray_child_new (GdkScreen *screen,
 char *
 na_tray_child_get_title (NaTrayChild *child)
 {
-  char *retval = NULL;
-  GdkDisplay *display;
-  Atom utf8_string, atom, type;
-  int result;
-  int format;
-  gulong nitems;
-  gulong bytes_after;
-  gchar *val;
-
   g_return_val_if_fail (NA_IS_TRAY_CHILD (child), NULL);
 
-  display = gtk_widget_get_display (GTK_WIDGET (child));
-
-  utf8_string = gdk_x11_get_xatom_by_name_for_display (display, "UTF8_STRING");
-  atom = gdk_x11_get_xatom_by_name_for_display (display, "_NET_WM_NAME");
-
-  gdk_x11_display_error_trap_push (display);
-
-  result = XGetWindowProperty (GDK_DISPLAY_XDISPLAY (display),
-                               child->icon_window,
-                               atom,
-                               0, G_MAXLONG,
-                               False, utf8_string,
-                               &type, &format, &nitems,
-                               &bytes_after, (guchar **)&val);
-
-  if (gdk_x11_display_error_trap_pop (display) || result != Success)
-    return NULL;
-
-  if (type != utf8_string ||
-      format != 8 ||
-      nitems == 0)
-    {
-      if (val)
-        XFree (val);
-      return NULL;
-    }
+  if (!child->title_valid)
+    na_tray_child_take_title (child,
+                              na_tray_child_request_title (gtk_widget_get_display (GTK_WIDGET (child)),
+                                                           child->icon_window));
 
-  if (!g_utf8_validate (val, nitems, NULL))
-    {
-      XFree (val);
-      return NULL;
-    }
-
-  retval = g_strndup (val, nitems);
-
-  XFree (val);
-
-  return retval;
+  return g_strdup (child->title);
 }
 
 /**
@@ -566,8 +843,28 @@ na_tray_child_force_redraw (gpointer key,
   NaTrayChild *child = key;
   GtkWidget *widget = GTK_WIDGET (child);
 
-  if (gtk_widget_get_mapped (widget))
+  if (!gtk_widget_get_mapped (widget))
+    return;
+
+  if (na_tray_child_has_alpha (child))
     {
+      GtkWidget *parent = gtk_widget_get_parent (widget);
+
+      /* Composited icons are painted by their parent over the background:
+       * repainting them there is enough, and happens on the next frame. */
+      if (parent)
+        {
+          GtkAllocation allocation;
+
+          na_tray_child_get_allocation_on_parent (child, parent, &allocation);
+          gtk_widget_queue_draw_area (parent, allocation.x, allocation.y,
+                                      allocation.width, allocation.height);
+        }
+    }
+  else
+    {
+    na_stats_count (NA_ITEM (child), NA_STATS_REDRAWS);
+
     /* Hiding and showing is the safe way to do it, but can result in more
      * flickering.
      */
@@ -576,66 +873,6 @@ na_tray_child_force_redraw (gpointer key,
     }
 }
 
-/* from libwnck/xutils.c, comes as LGPLv2+ */
-static char *
-latin1_to_utf8 (const char *latin1)
-{
-  GString *str;
-  const char *p;
-
-  str = g_string_new (NULL);
-
-  p = latin1;
-  while (*p)
-    {
-      g_string_append_unichar (str, (gunichar) *p);
-      ++p;
-    }
-
-  return g_string_free (str, FALSE);
-}
-
-/* derived from libwnck/xutils.c, comes as LGPLv2+ */
-static void
-_get_wmclass (Display *xdisplay,
-              Window   xwindow,
-              char   **res_class,
-              char   **res_name)
-{
-  GdkDisplay *display;
-  XClassHint ch;
-
-  ch.res_name = NULL;
-  ch.res_class = NULL;
-
-  display = gdk_display_get_default ();
-  gdk_x11_display_error_trap_push (display);
-  XGetClassHint (xdisplay, xwindow, &ch);
-  gdk_x11_display_error_trap_pop_ignored (display);
-
-  if (res_class)
-    *res_class = NULL;
-
-  if (res_name)
-    *res_name = NULL;
-
-  if (ch.res_name)
-    {
-      if (res_name)
-        *res_name = latin1_to_utf8 (ch.res_name);
-
-      XFree (ch.res_name);
-    }
-
-  if (ch.res_class)
-    {
-      if (res_class)
-        *res_class = latin1_to_utf8 (ch.res_class);
-
-      XFree (ch.res_class);
-    }
-}
-
 /**
  * na_tray_child_get_wm_class;
  * @child: a #NaTrayChild
@@ -651,14 +888,24 @@ na_tray_child_get_wm_class (NaTrayChild  *child,
                             char        **res_name,
                             char        **res_class)
 {
-  GdkDisplay *display;
-
   g_return_if_fail (NA_IS_TRAY_CHILD (child));
 
-  display = gtk_widget_get_display (GTK_WIDGET (child));
+  if (!child->wm_class_valid)
+    na_tray_child_take_wm_class (child,
+                                 na_tray_child_request_wm_class (gtk_widget_get_display (GTK_WIDGET (child)),
+                                                                 child->icon_window));
 
-  _get_wmclass (GDK_DISPLAY_XDISPLAY (display),
-                child->icon_window,
-                res_class,
-                res_name);
+  if (res_name)
+    *res_name = g_strdup (child->res_name);
+
+  if (res_class)
+    *res_class = g_strdup (child->res_class);
+}
+
+/* The icons of all the trays of the process are repainted at most every
+ * scale times NA_TRAY_CHILD_MIN_PAINT_INTERVAL */
+void
+na_tray_child_set_paint_interval_scale (guint scale)
+{
+  paint_interval_scale = MAX (scale, 1);
 }
@@ -58,6 +58,19 @@ struct _NaTrayChild
   guint parent_relative_bg : 1;
 
   gchar *id;
+
+  /* the properties of icon_window, fetched with the visual and then
+   * again when a PropertyNotify says they changed */
+  gchar *title;
+  gchar *res_name;
+  gchar *res_class;
+  guint title_valid : 1;
+  guint wm_class_valid : 1;
+  GdkWindow *property_window;
+
+  cairo_surface_t *paint_cache;
+  gint64 last_paint_time;
+  guint paint_throttle_id;
 };
 
 struct _NaTrayChildClass
@@ -80,6 +93,8 @@ void            na_tray_child_get_wm_class   (NaTrayChild  *child,
 					      char        **res_name,
 					      char        **res_class);
 
+void            na_tray_child_set_paint_interval_scale (guint scale);
+
 #ifdef __cplusplus
 }
 #endif
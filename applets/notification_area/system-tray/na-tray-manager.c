@@ -54,6 +54,9 @@ enum {
   PROP_ORIENTATION
 };
 
+/* A balloon message being received. Its data comes in chunks of 20 bytes
+ * that only name the window, so each window has at most one message being
+ * assembled: the one it began last. */
 typedef struct
 {
   long id, len;
@@ -93,11 +96,20 @@ static void na_tray_manager_unmanage (NaTrayManager *manager);
 
 G_DEFINE_TYPE (NaTrayManager, na_tray_manager, G_TYPE_OBJECT)
 
+static void
+pending_message_free (PendingMessage *message)
+{
+  g_free (message->str);
+  g_free (message);
+}
+
 static void
 na_tray_manager_init (NaTrayManager *manager)
 {
   manager->invisible = NULL;
   manager->socket_table = g_hash_table_new (NULL, NULL);
+  manager->messages = g_hash_table_new_full (NULL, NULL, NULL,
+                                             (GDestroyNotify) pending_message_free);
 
   manager->padding = 0;
   manager->icon_size = 0;
@@ -207,7 +219,7 @@ na_tray_manager_finalize (GObject *object)
 
   na_tray_manager_unmanage (manager);
 
-  g_list_free (manager->messages);
+  g_hash_table_destroy (manager->messages);
   g_hash_table_destroy (manager->socket_table);
 
   G_OBJECT_CLASS (na_tray_manager_parent_class)->finalize (object);
@@ -324,52 +336,38 @@ na_tray_manager_handle_dock_request (NaTrayManager       *manager,
   gtk_widget_show (child);
 }
 
-static void
-pending_message_free (PendingMessage *message)
-{
-  g_free (message->str);
-  g_free (message);
-}
-
 static void
 na_tray_manager_handle_message_data (NaTrayManager *manager,
                                      XClientMessageEvent *xevent)
 {
-  GList               *p;
-  int                  len;
-
-  /* Try to see if we can find the pending message in the list */
-  for (p = manager->messages; p; p = p->next)
-    {
-      PendingMessage *msg = p->data;
+  PendingMessage *msg;
+  int             len;
 
-      if (xevent->window == msg->window)
-	{
-	  /* Append the message */
-	  len = MIN (msg->remaining_len, 20);
+  msg = g_hash_table_lookup (manager->messages,
+                             GINT_TO_POINTER (xevent->window));
+  if (!msg)
+    return;
 
-	  memcpy ((msg->str + msg->len - msg->remaining_len),
-		  &xevent->data, len);
-	  msg->remaining_len -= len;
+  /* Append the message */
+  len = MIN (msg->remaining_len, 20);
 
-	  if (msg->remaining_len == 0)
-	    {
-	      GtkSocket *socket;
+  memcpy ((msg->str + msg->len - msg->remaining_len),
+          &xevent->data, len);
+  msg->remaining_len -= len;
 
-	      socket = g_hash_table_lookup (manager->socket_table,
-                                            GINT_TO_POINTER (msg->window));
+  if (msg->remaining_len == 0)
+    {
+      GtkSocket *socket;
 
-	      if (socket)
-		  g_signal_emit (manager, manager_signals[MESSAGE_SENT], 0,
-				 socket, msg->str, msg->id, msg->timeout);
+      socket = g_hash_table_lookup (manager->socket_table,
+                                    GINT_TO_POINTER (msg->window));
 
-	      pending_message_free (msg);
-	      manager->messages = g_list_remove_link (manager->messages, p);
-              g_list_free_1 (p);
-	    }
+      if (socket)
+        g_signal_emit (manager, manager_signals[MESSAGE_SENT], 0,
+                       socket, msg->str, msg->id, msg->timeout);
 
-          break;
-	}
+      g_hash_table_remove (manager->messages,
+                           GINT_TO_POINTER (xevent->window));
     }
 }
 
@@ -378,7 +376,6 @@ na_tray_manager_handle_begin_message (NaTrayManager       *manager,
 				      XClientMessageEvent *xevent)
 {
   GtkSocket      *socket;
-  GList          *p;
   PendingMessage *msg;
   long            timeout;
   long            len;
@@ -394,21 +391,12 @@ na_tray_manager_handle_begin_message (NaTrayManager       *manager,
   len     = xevent->data.l[3];
   id      = xevent->data.l[4];
 
-  /* Check if the same message is already in the queue and remove it if so */
-  for (p = manager->messages; p; p = p->next)
-    {
-      PendingMessage *pmsg = p->data;
-
-      if (xevent->window == pmsg->window &&
-	  id == pmsg->id)
-	{
-	  /* Hmm, we found it, now remove it */
-	  pending_message_free (pmsg);
-	  manager->messages = g_list_remove_link (manager->messages, p);
-          g_list_free_1 (p);
-	  break;
-	}
-    }
+  /* A message still being received from this window, whether it is the
+   * same one or not, will never get the rest of its data: drop it */
+  g_hash_table_remove (manager->messages, GINT_TO_POINTER (xevent->window));
+
+  if (len < 0)
+    return;
 
   if (len == 0)
     {
@@ -417,16 +405,22 @@ na_tray_manager_handle_begin_message (NaTrayManager       *manager,
     }
   else
     {
-      /* Now add the new message to the queue */
+      /* Now add the new message, with room for all of it */
       msg = g_new0 (PendingMessage, 1);
       msg->window = xevent->window;
       msg->timeout = timeout;
       msg->len = len;
       msg->id = id;
       msg->remaining_len = msg->len;
-      msg->str = g_malloc (msg->len + 1);
+      msg->str = g_try_malloc (msg->len + 1);
+      if (!msg->str)
+        {
+          g_free (msg);
+          return;
+        }
       msg->str[msg->len] = '\0';
-      manager->messages = g_list_prepend (manager->messages, msg);
+      g_hash_table_insert (manager->messages,
+                           GINT_TO_POINTER (msg->window), msg);
     }
 }
 
@@ -434,26 +428,17 @@ static void
 na_tray_manager_handle_cancel_message (NaTrayManager       *manager,
 				       XClientMessageEvent *xevent)
 {
-  GList     *p;
-  GtkSocket *socket;
-  long       id;
+  PendingMessage *msg;
+  GtkSocket      *socket;
+  long            id;
 
   id = xevent->data.l[2];
 
-  /* Check if the message is in the queue and remove it if so */
-  for (p = manager->messages; p; p = p->next)
-    {
-      PendingMessage *msg = p->data;
-
-      if (xevent->window == msg->window &&
-	  id == msg->id)
-	{
-	  pending_message_free (msg);
-	  manager->messages = g_list_remove_link (manager->messages, p);
-          g_list_free_1 (p);
-	  break;
-	}
-    }
+  /* Check if the message is being received and drop it if so */
+  msg = g_hash_table_lookup (manager->messages,
+                             GINT_TO_POINTER (xevent->window));
+  if (msg && msg->id == id)
+    g_hash_table_remove (manager->messages, GINT_TO_POINTER (xevent->window));
 
   socket = g_hash_table_lookup (manager->socket_table,
                                 GINT_TO_POINTER (xevent->window));
@@ -472,49 +457,53 @@ na_tray_manager_window_filter (GdkXEvent *xev,
 {
   XEvent        *xevent = (GdkXEvent *)xev;
   NaTrayManager *manager = data;
+  XClientMessageEvent *xclient;
 
-  if (xevent->type == ClientMessage)
-    {
-      /* We handle this client message here. See comment in
-       * na_tray_manager_handle_client_message_opcode() for details */
-      if (xevent->xclient.message_type == manager->opcode_atom &&
-          xevent->xclient.data.l[1]    == SYSTEM_TRAY_REQUEST_DOCK)
-	{
-          na_tray_manager_handle_dock_request (manager,
-                                               (XClientMessageEvent *) xevent);
-          return GDK_FILTER_REMOVE;
-	}
-      /* _NET_SYSTEM_TRAY_OPCODE: SYSTEM_TRAY_BEGIN_MESSAGE */
-      else if (xevent->xclient.message_type == manager->opcode_atom &&
-               xevent->xclient.data.l[1] == SYSTEM_TRAY_BEGIN_MESSAGE)
-        {
-          na_tray_manager_handle_begin_message (manager,
-                                                (XClientMessageEvent *) event);
-          return GDK_FILTER_REMOVE;
-        }
-      /* _NET_SYSTEM_TRAY_OPCODE: SYSTEM_TRAY_CANCEL_MESSAGE */
-      else if (xevent->xclient.message_type == manager->opcode_atom &&
-               xevent->xclient.data.l[1] == SYSTEM_TRAY_CANCEL_MESSAGE)
-        {
-          na_tray_manager_handle_cancel_message (manager,
-                                                 (XClientMessageEvent *) event);
-          return GDK_FILTER_REMOVE;
-        }
-      /* _NET_SYSTEM_TRAY_MESSAGE_DATA */
-      else if (xevent->xclient.message_type == manager->message_data_atom)
-        {
-          na_tray_manager_handle_message_data (manager,
-                                               (XClientMessageEvent *) event);
-          return GDK_FILTER_REMOVE;
-        }
-    }
-  else if (xevent->type == SelectionClear)
+  /* Everything sent to the manager window goes through here: leave as
+   * soon as possible what is not for us */
+  if (xevent->type == SelectionClear)
     {
       g_signal_emit (manager, manager_signals[LOST_SELECTION], 0);
       na_tray_manager_unmanage (manager);
+      return GDK_FILTER_CONTINUE;
+    }
+
+  if (xevent->type != ClientMessage)
+    return GDK_FILTER_CONTINUE;
+
+  xclient = (XClientMessageEvent *) xevent;
+
+  /* _NET_SYSTEM_TRAY_MESSAGE_DATA, the most frequent one */
+  if (xclient->message_type == manager->message_data_atom)
+    {
+      na_tray_manager_handle_message_data (manager, xclient);
+      return GDK_FILTER_REMOVE;
     }
 
-  return GDK_FILTER_CONTINUE;
+  if (xclient->message_type != manager->opcode_atom)
+    return GDK_FILTER_CONTINUE;
+
+  switch (xclient->data.l[1])
+    {
+    /* We handle this client message here. See comment in
+     * na_tray_manager_handle_client_message_opcode() for details */
+    case SYSTEM_TRAY_REQUEST_DOCK:
+      na_tray_manager_handle_dock_request (manager, xclient);
+      return GDK_FILTER_REMOVE;
+
+    /* _NET_SYSTEM_TRAY_OPCODE: SYSTEM_TRAY_BEGIN_MESSAGE */
+    case SYSTEM_TRAY_BEGIN_MESSAGE:
+      na_tray_manager_handle_begin_message (manager, xclient);
+      return GDK_FILTER_REMOVE;
+
+    /* _NET_SYSTEM_TRAY_OPCODE: SYSTEM_TRAY_CANCEL_MESSAGE */
+    case SYSTEM_TRAY_CANCEL_MESSAGE:
+      na_tray_manager_handle_cancel_message (manager, xclient);
+      return GDK_FILTER_REMOVE;
+
+    default:
+      return GDK_FILTER_CONTINUE;
+    }
 }
 
 #if 0
@@ -63,7 +63,7 @@ struct _NaTrayManager
   GdkRGBA warning;
   GdkRGBA success;
 
-  GList *messages;
+  GHashTable *messages;
   GHashTable *socket_table;
 };
 
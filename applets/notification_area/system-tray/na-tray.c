@@ -41,6 +41,10 @@ typedef struct
   GSList        *all_trays;
   GHashTable    *icon_table;
   GHashTable    *tip_table;
+
+  /* rate limit of the messages, for all the icons of the screen */
+  gint64         messages_period_start;
+  guint          n_messages_in_period;
 } TraysScreen;
 
 struct _NaTrayPrivate
@@ -69,9 +73,20 @@ typedef struct
   GtkWidget  *fixedtip;
   guint       source_id;
   glong       id;        /* id of the current message */
-  GSList     *buffer;    /* buffered messages */
+  char       *text;      /* text of the current message */
+  GQueue      buffer;    /* buffered messages, of at most ICON_TIP_MAX_BUFFERED */
+  GHashTable *buffer_ids; /* id -> link in buffer */
 } IconTip;
 
+/* An icon flooding the tray with messages only gets its latest ones
+ * queued, and only so many messages are accepted per period from all
+ * the icons together */
+#define ICON_TIP_MAX_BUFFERED      8
+#define ICON_TIP_RATE_PERIOD       (10 * G_USEC_PER_SEC)
+#define ICON_TIP_RATE_MAX_MESSAGES 20
+
+#define ICON_TIP_ID_KEY(id) ((gpointer) (glong) (id))
+
 enum
 {
   PROP_0,
@@ -158,11 +173,8 @@ tray_removed (NaTrayManager *manager,
 }
 
 static void
-icon_tip_buffer_free (gpointer data,
-                      gpointer userdata)
+icon_tip_buffer_free (IconTipBuffer *buffer)
 {
-  IconTipBuffer *buffer = data;
-
   g_free (buffer->text);
   g_free (buffer);
 }
@@ -185,27 +197,64 @@ icon_tip_free (gpointer data)
     g_source_remove (icontip->source_id);
   icontip->source_id = 0;
 
-  if (icontip->buffer != NULL)
+  g_hash_table_destroy (icontip->buffer_ids);
+  g_queue_foreach (&icontip->buffer, (GFunc) icon_tip_buffer_free, NULL);
+  g_queue_clear (&icontip->buffer);
+
+  g_free (icontip->text);
+  g_free (icontip);
+}
+
+static void
+icon_tip_buffer_remove (IconTip *icontip,
+                        GList   *link)
+{
+  IconTipBuffer *buffer = link->data;
+
+  g_hash_table_remove (icontip->buffer_ids, ICON_TIP_ID_KEY (buffer->id));
+  g_queue_delete_link (&icontip->buffer, link);
+  icon_tip_buffer_free (buffer);
+}
+
+/* The queue is short: looking at all of it stays cheap */
+static gboolean
+icon_tip_has_text (IconTip    *icontip,
+                   const char *text)
+{
+  GList *l;
+
+  if (g_strcmp0 (icontip->text, text) == 0)
+    return TRUE;
+
+  for (l = icontip->buffer.head; l; l = l->next)
     {
-      g_slist_foreach (icontip->buffer, icon_tip_buffer_free, NULL);
-      g_slist_free (icontip->buffer);
+      IconTipBuffer *buffer = l->data;
+
+      if (g_strcmp0 (buffer->text, text) == 0)
+        return TRUE;
     }
-  icontip->buffer = NULL;
 
-  g_free (icontip);
+  return FALSE;
 }
 
-static int
-icon_tip_buffer_compare (gconstpointer a,
-                         gconstpointer b)
+static gboolean
+trays_screen_accept_message (TraysScreen *trays_screen)
 {
-  const IconTipBuffer *buffer_a = a;
-  const IconTipBuffer *buffer_b = b;
+  gint64 now;
 
-  if (buffer_a == NULL || buffer_b == NULL)
-    return !(buffer_a == buffer_b);
+  now = g_get_monotonic_time ();
+  if (now - trays_screen->messages_period_start >= ICON_TIP_RATE_PERIOD)
+    {
+      trays_screen->messages_period_start = now;
+      trays_screen->n_messages_in_period = 0;
+    }
+
+  if (trays_screen->n_messages_in_period >= ICON_TIP_RATE_MAX_MESSAGES)
+    return FALSE;
 
-  return buffer_a->id - buffer_b->id;
+  trays_screen->n_messages_in_period++;
+
+  return TRUE;
 }
 
 static void
@@ -230,7 +279,7 @@ icon_tip_show_next (IconTip *icontip)
 {
   IconTipBuffer *buffer;
 
-  if (icontip->buffer == NULL)
+  if (g_queue_is_empty (&icontip->buffer))
     {
       /* this will also destroy the tip window */
       g_hash_table_remove (icontip->tray->priv->trays_screen->tip_table,
@@ -242,8 +291,8 @@ icon_tip_show_next (IconTip *icontip)
     g_source_remove (icontip->source_id);
   icontip->source_id = 0;
 
-  buffer = icontip->buffer->data;
-  icontip->buffer = g_slist_remove (icontip->buffer, buffer);
+  buffer = g_queue_pop_head (&icontip->buffer);
+  g_hash_table_remove (icontip->buffer_ids, ICON_TIP_ID_KEY (buffer->id));
 
   if (icontip->fixedtip == NULL)
     {
@@ -266,7 +315,12 @@ icon_tip_show_next (IconTip *icontip)
                                                 icon_tip_show_next_timeout,
                                                 icontip);
 
-  icon_tip_buffer_free (buffer, NULL);
+  /* the text is kept to recognize the repeated messages */
+  g_free (icontip->text);
+  icontip->text = buffer->text;
+  buffer->text = NULL;
+
+  icon_tip_buffer_free (buffer);
 }
 
 static void
@@ -278,22 +332,26 @@ message_sent (NaTrayManager *manager,
               TraysScreen   *trays_screen)
 {
   IconTip       *icontip;
-  IconTipBuffer  find_buffer;
   IconTipBuffer *buffer;
   gboolean       show_now;
 
   icontip = g_hash_table_lookup (trays_screen->tip_table, icon);
 
-  find_buffer.id = id;
   if (icontip &&
       (icontip->id == id ||
-       g_slist_find_custom (icontip->buffer, &find_buffer,
-                            icon_tip_buffer_compare) != NULL))
+       g_hash_table_contains (icontip->buffer_ids, ICON_TIP_ID_KEY (id)) ||
+       icon_tip_has_text (icontip, text)))
     /* we already have this message, so ignore it */
     /* FIXME: in an ideal world, we'd remember all the past ids and ignore them
      * too */
     return;
 
+  if (!trays_screen_accept_message (trays_screen))
+    {
+      g_debug ("Too many tray icon messages, dropping \"%s\"", text);
+      return;
+    }
+
   show_now = FALSE;
 
   if (icontip == NULL)
@@ -314,19 +372,27 @@ message_sent (NaTrayManager *manager,
       icontip = g_new0 (IconTip, 1);
       icontip->tray = tray;
       icontip->icon = icon;
+      g_queue_init (&icontip->buffer);
+      icontip->buffer_ids = g_hash_table_new (g_direct_hash, g_direct_equal);
 
       g_hash_table_insert (trays_screen->tip_table, icon, icontip);
 
       show_now = TRUE;
     }
 
+  /* the oldest messages make room for the new ones */
+  while (g_queue_get_length (&icontip->buffer) >= ICON_TIP_MAX_BUFFERED)
+    icon_tip_buffer_remove (icontip, icontip->buffer.head);
+
   buffer = g_new0 (IconTipBuffer, 1);
 
   buffer->text    = g_strdup (text);
   buffer->id      = id;
   buffer->timeout = timeout;
 
-  icontip->buffer = g_slist_append (icontip->buffer, buffer);
+  g_queue_push_tail (&icontip->buffer, buffer);
+  g_hash_table_insert (icontip->buffer_ids, ICON_TIP_ID_KEY (id),
+                       g_queue_peek_tail_link (&icontip->buffer));
 
   if (show_now)
     icon_tip_show_next (icontip);
@@ -338,10 +404,8 @@ message_cancelled (NaTrayManager *manager,
                    glong          id,
                    TraysScreen   *trays_screen)
 {
-  IconTip       *icontip;
-  IconTipBuffer  find_buffer;
-  GSList        *cancel_buffer_l;
-  IconTipBuffer *cancel_buffer;
+  IconTip *icontip;
+  GList   *cancel_link;
 
   icontip = g_hash_table_lookup (trays_screen->tip_table, icon);
   if (icontip == NULL)
@@ -353,17 +417,11 @@ message_cancelled (NaTrayManager *manager,
       return;
     }
 
-  find_buffer.id = id;
-  cancel_buffer_l = g_slist_find_custom (icontip->buffer, &find_buffer,
-                                         icon_tip_buffer_compare);
-  if (cancel_buffer_l == NULL)
+  cancel_link = g_hash_table_lookup (icontip->buffer_ids, ICON_TIP_ID_KEY (id));
+  if (cancel_link == NULL)
     return;
 
-  cancel_buffer = cancel_buffer_l->data;
-  icon_tip_buffer_free (cancel_buffer, NULL);
-
-  icontip->buffer = g_slist_remove_link (icontip->buffer, cancel_buffer_l);
-  g_slist_free_1 (cancel_buffer_l);
+  icon_tip_buffer_remove (icontip, cancel_link);
 }
 
 static void
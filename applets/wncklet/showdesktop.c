@@ -58,6 +58,13 @@ typedef struct {
 	guint button_activate;
 
 	GtkIconTheme* icon_theme;
+
+	/* what the icon shown was loaded for */
+	int icon_size;
+	int icon_scale;
+	GtkOrientation icon_orient;
+	guint icon_theme_gen;
+	guint theme_gen;
 } ShowDesktopData;
 
 static void display_help_dialog(GtkAction* action, ShowDesktopData* sdd);
@@ -173,6 +180,13 @@ static void update_icon(ShowDesktopData* sdd)
 	else if (icon_size < 128)
 		icon_size = 64;
 
+	/* panel animations allocate the button over and over */
+	if (sdd->icon_size == icon_size &&
+	    sdd->icon_scale == icon_scale &&
+	    sdd->icon_orient == sdd->orient &&
+	    sdd->icon_theme_gen == sdd->theme_gen)
+		return;
+
 	error = NULL;
 	icon = gtk_icon_theme_load_surface (sdd->icon_theme, SHOW_DESKTOP_ICON, icon_size, icon_scale, NULL, 0, &error);
 
@@ -190,6 +204,12 @@ static void update_icon(ShowDesktopData* sdd)
 		return;
 	}
 
+	/* only a loaded icon is remembered, the next update tries again */
+	sdd->icon_size = icon_size;
+	sdd->icon_scale = icon_scale;
+	sdd->icon_orient = sdd->orient;
+	sdd->icon_theme_gen = sdd->theme_gen;
+
 	width = cairo_image_surface_get_width (icon);
 	height = cairo_image_surface_get_height (icon);
 
@@ -388,11 +408,13 @@ static void show_desktop_applet_realized(MatePanelApplet* applet, gpointer data)
 	sdd->icon_theme = gtk_icon_theme_get_for_screen (screen);
 	wncklet_connect_while_alive(sdd->icon_theme, "changed", G_CALLBACK(theme_changed_callback), sdd, sdd->applet);
 
+	sdd->theme_gen++;
 	update_icon (sdd);
 }
 
 static void theme_changed_callback(GtkIconTheme* icon_theme, ShowDesktopData* sdd)
 {
+	sdd->theme_gen++;
 	update_icon (sdd);
 }
 
@@ -25,6 +25,7 @@
 #error file should only be compiled when HAVE_WAYLAND is enabled
 #endif
 
+#include <glib/gi18n.h>
 #include <gdk/gdkwayland.h>
 #include <gio/gdesktopappinfo.h>
 
@@ -53,18 +54,46 @@ typedef struct
 	GtkWidget *outer_box;
 	ContextMenu *context_menu;
 	struct zwlr_foreign_toplevel_manager_v1 *manager;
+
+	/* all the ToplevelTask, only the first ones that fit have a button and
+	 * the others are listed in the overflow menu */
+	GQueue tasks;
+	GtkWidget *overflow;
+	GtkWidget *overflow_menu;
+	guint overflow_menu_idle_id;
+	guint sync_id;
 } TasklistManager;
 
+typedef enum
+{
+	TASK_CONTENTS_ICON_AND_LABEL,
+	TASK_CONTENTS_ICON,
+	TASK_CONTENTS_LABEL
+} TaskContents;
+
 typedef struct
 {
+	TasklistManager *tasklist;
+	GList *link;
+
+	/* only while the task has a button */
 	GtkWidget *button;
 	GtkWidget *icon;
 	GtkWidget *label;
+	TaskContents contents;
 	struct zwlr_foreign_toplevel_handle_v1 *toplevel;
 	gboolean active;
 	gboolean maximized;
 	gboolean minimized;
 	gboolean fullscreen;
+
+	/* what changed since the last "done", applied all at once then */
+	gchar *pending_title;
+	gchar *pending_app_id;
+	gboolean pending_state;
+
+	gchar *title;
+	gchar *app_id;
 } ToplevelTask;
 
 static const char *tasklist_manager_key = "tasklist_manager";
@@ -76,8 +105,35 @@ static uint32_t foreign_toplevel_manager_global_id = 0;
 static uint32_t foreign_toplevel_manager_global_version = 0;
 
 static ToplevelTask *toplevel_task_new (TasklistManager *tasklist, struct zwlr_foreign_toplevel_handle_v1 *handle);
+static void toplevel_task_free (ToplevelTask *task);
+static void tasklist_queue_sync (TasklistManager *tasklist);
+static void tasklist_overflow_clicked (GtkButton *button, TasklistManager *tasklist);
+
+/* The box holding the buttons. On a horizontal panel it shares its width
+ * between them, up to max_button_width each, and shows on all of them
+ * what fits: icon and label, the icon only, or the label only. This is
+ * done in one pass when it is allocated, whatever the number of windows
+ * opened or closed since the last time.
+ *
+ * It also tells how many buttons fit, so that the windows beyond are kept
+ * out of it: the widgets and the layout cost stay the same with hundreds
+ * of windows. */
+#define TASKLIST_TYPE_BOX (tasklist_box_get_type ())
+G_DECLARE_FINAL_TYPE (TasklistBox, tasklist_box, TASKLIST, BOX, GtkBox)
+
+struct _TasklistBox
+{
+	GtkBox parent;
+
+	TasklistManager *tasklist;
+	gint capacity;
+};
+
+G_DEFINE_TYPE (TasklistBox, tasklist_box, GTK_TYPE_BOX)
 
-guint buttons, tasklist_width;
+/* app_id -> GIcon, so that looking up the desktop file of an application
+ * is done once and not for each of its windows */
+static GHashTable *app_id_icons = NULL;
 
 static void
 wl_registry_handle_global (void *_data,
@@ -140,8 +196,9 @@ foreign_toplevel_manager_handle_toplevel (void *data,
 					  struct zwlr_foreign_toplevel_handle_v1 *toplevel)
 {
 	TasklistManager *tasklist = data;
-	ToplevelTask *task = toplevel_task_new (tasklist, toplevel);
-	gtk_box_pack_start (GTK_BOX (tasklist->list), task->button, TRUE, TRUE, 0);
+
+	toplevel_task_new (tasklist, toplevel);
+	tasklist_queue_sync (tasklist);
 }
 
 static void
@@ -169,15 +226,37 @@ static const struct zwlr_foreign_toplevel_manager_v1_listener foreign_toplevel_m
 static void
 tasklist_manager_disconnected_from_widget (TasklistManager *tasklist)
 {
+	ToplevelTask *task;
+
+	if (tasklist->sync_id)
+	{
+		g_source_remove (tasklist->sync_id);
+		tasklist->sync_id = 0;
+	}
+
+	if (tasklist->overflow_menu_idle_id)
+	{
+		g_source_remove (tasklist->overflow_menu_idle_id);
+		tasklist->overflow_menu_idle_id = 0;
+	}
+
+	g_clear_pointer (&tasklist->overflow_menu, gtk_widget_destroy);
+
+	while ((task = g_queue_peek_head (&tasklist->tasks)) != NULL)
+		toplevel_task_free (task);
+
 	if (tasklist->list)
 	{
 		GList *children = gtk_container_get_children (GTK_CONTAINER (tasklist->list));
 		for (GList *iter = children; iter != NULL; iter = g_list_next (iter))
 			gtk_widget_destroy (GTK_WIDGET (iter->data));
 		g_list_free(children);
+		TASKLIST_BOX (tasklist->list)->tasklist = NULL;
 		tasklist->list = NULL;
 	}
 
+	tasklist->overflow = NULL;
+
 	if (tasklist->outer_box)
 		tasklist->outer_box = NULL;
 
@@ -260,8 +339,20 @@ tasklist_manager_new (void)
 		return NULL;
 
 	TasklistManager *tasklist = g_new0 (TasklistManager, 1);
-	tasklist->list = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 0);
-	gtk_box_set_homogeneous (GTK_BOX (tasklist->list), TRUE);
+	tasklist->list = g_object_new (TASKLIST_TYPE_BOX,
+				       "orientation", GTK_ORIENTATION_HORIZONTAL,
+				       "homogeneous", TRUE,
+				       NULL);
+	TASKLIST_BOX (tasklist->list)->tasklist = tasklist;
+	g_queue_init (&tasklist->tasks);
+
+	tasklist->overflow = gtk_button_new_from_icon_name ("pan-down-symbolic", GTK_ICON_SIZE_MENU);
+	gtk_button_set_relief (GTK_BUTTON (tasklist->overflow), GTK_RELIEF_NONE);
+	gtk_widget_set_name (tasklist->overflow, "tasklist-button");
+	gtk_widget_set_no_show_all (tasklist->overflow, TRUE);
+	g_signal_connect (tasklist->overflow, "clicked", G_CALLBACK (tasklist_overflow_clicked), tasklist);
+	gtk_box_pack_start (GTK_BOX (tasklist->list), tasklist->overflow, TRUE, TRUE, 0);
+
 	tasklist->outer_box = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 0);
 	gtk_box_pack_start (GTK_BOX (tasklist->outer_box), tasklist->list, FALSE, FALSE, 0);
 	gtk_widget_show (tasklist->list);
@@ -287,10 +378,8 @@ foreign_toplevel_handle_title (void *data,
 {
 	ToplevelTask *task = data;
 
-	if (task->label)
-	{
-		gtk_label_set_label (GTK_LABEL (task->label), title);
-	}
+	g_free (task->pending_title);
+	task->pending_title = g_strdup (title);
 }
 
 static void
@@ -300,25 +389,54 @@ foreign_toplevel_handle_app_id (void *data,
 {
 	ToplevelTask *task = data;
 
-	gchar *app_id_lower = g_utf8_strdown (app_id, -1);
-	gchar *desktop_app_id = g_strdup_printf ("%s.desktop", app_id_lower);
-	GDesktopAppInfo *app_info = g_desktop_app_info_new (desktop_app_id);
+	g_free (task->pending_app_id);
+	task->pending_app_id = g_strdup (app_id);
+}
 
-	if (app_info) {
-		GIcon *icon = g_app_info_get_icon (G_APP_INFO (app_info));
-		if (icon) {
-			gtk_image_set_from_gicon (GTK_IMAGE (task->icon), icon, GTK_ICON_SIZE_MENU);
-			goto cleanup;
-		}
+static void
+app_infos_changed (GAppInfoMonitor *monitor, gpointer user_data)
+{
+	/* new icons are picked up by the windows opened from now on */
+	g_hash_table_remove_all (app_id_icons);
+}
+
+static GIcon *
+app_id_get_icon (const char *app_id)
+{
+	GIcon *icon;
+
+	if (app_id_icons == NULL)
+	{
+		app_id_icons = g_hash_table_new_full (g_str_hash, g_str_equal,
+						      g_free, g_object_unref);
+		g_signal_connect (g_app_info_monitor_get (), "changed",
+				  G_CALLBACK (app_infos_changed), NULL);
 	}
-	gtk_image_set_from_icon_name (GTK_IMAGE (task->icon), app_id_lower, GTK_ICON_SIZE_MENU);
 
-cleanup:
-	if (app_info) {
-		g_object_unref (G_OBJECT (app_info));
+	icon = g_hash_table_lookup (app_id_icons, app_id);
+	if (icon == NULL)
+	{
+		gchar *app_id_lower = g_utf8_strdown (app_id, -1);
+		gchar *desktop_app_id = g_strdup_printf ("%s.desktop", app_id_lower);
+		GDesktopAppInfo *app_info = g_desktop_app_info_new (desktop_app_id);
+
+		if (app_info) {
+			icon = g_app_info_get_icon (G_APP_INFO (app_info));
+			if (icon)
+				g_object_ref (icon);
+			g_object_unref (G_OBJECT (app_info));
+		}
+
+		if (icon == NULL)
+			icon = g_themed_icon_new (app_id_lower);
+
+		g_hash_table_insert (app_id_icons, g_strdup (app_id), icon);
+
+		g_free (app_id_lower);
+		g_free (desktop_app_id);
 	}
-	g_free (app_id_lower);
-	g_free (desktop_app_id);
+
+	return icon;
 }
 
 static void
@@ -371,101 +489,61 @@ foreign_toplevel_handle_state (void *data,
 		}
 	}
 
-	gtk_button_set_relief (GTK_BUTTON (task->button), task->active ? GTK_RELIEF_NORMAL : GTK_RELIEF_NONE);
+	task->pending_state = TRUE;
 }
 
 static void
 foreign_toplevel_handle_done (void *data,
 			      struct zwlr_foreign_toplevel_handle_v1 *toplevel)
-{
-	/* ignore */
-}
-
-static void
-foreign_toplevel_handle_closed (void *data,
-				struct zwlr_foreign_toplevel_handle_v1 *toplevel)
 {
 	ToplevelTask *task = data;
 
-	if (task->button)
+	/* Only what really changed touches the widgets, so that a window
+	 * setting the same title over and over costs nothing */
+	if (task->pending_title)
 	{
-		GtkOrientation orient;
-		GtkWidget *button;
-		GtkWidget  *box;
-		GtkWidget *outer_box = gtk_widget_get_parent (GTK_WIDGET (task->button));
-		gtk_widget_destroy (task->button);
-		buttons = buttons -1;
+		if (task->label &&
+		    g_strcmp0 (task->title, task->pending_title) != 0)
+			gtk_label_set_label (GTK_LABEL (task->label), task->pending_title);
 
-		if (buttons == 0)
-			return;
+		g_free (task->title);
+		task->title = task->pending_title;
+		task->pending_title = NULL;
+	}
 
-		/* We don't need to modify button size on a vertical panel*/
-		orient = gtk_orientable_get_orientation (GTK_ORIENTABLE (outer_box));
-		if (orient == GTK_ORIENTATION_VERTICAL)
-			return;
+	if (task->pending_app_id)
+	{
+		if (task->icon && g_strcmp0 (task->app_id, task->pending_app_id) != 0)
+			gtk_image_set_from_gicon (GTK_IMAGE (task->icon),
+						  app_id_get_icon (task->pending_app_id),
+						  GTK_ICON_SIZE_MENU);
+
+		g_free (task->app_id);
+		task->app_id = task->pending_app_id;
+		task->pending_app_id = NULL;
+	}
 
-		/* Horizontal panel: if buttons can now fit
-		 * with both labels and icons show them
-		 */
-		if (tasklist_width / buttons > icon_size * 3)
-		{
-			GList* children = gtk_container_get_children (GTK_CONTAINER (outer_box));
-			while (children != NULL)
-			{
-				button = GTK_WIDGET (children->data);
+	if (task->pending_state)
+	{
+		if (task->button)
+			gtk_button_set_relief (GTK_BUTTON (task->button),
+					       task->active ? GTK_RELIEF_NORMAL : GTK_RELIEF_NONE);
 
-				/* If maximum width buttons fix, expand to that dimension*/
-				if (buttons * max_button_width < tasklist_width)
-					gtk_widget_set_size_request (button, max_button_width, -1);
+		task->pending_state = FALSE;
+	}
+}
 
-				/* Otherwise expand remaining buttons to fill the tasklist*/
-				else
-					gtk_widget_set_size_request (button, tasklist_width / buttons, -1);
+static void
+foreign_toplevel_handle_closed (void *data,
+				struct zwlr_foreign_toplevel_handle_v1 *toplevel)
+{
+	ToplevelTask *task = data;
+	TasklistManager *tasklist = task->tasklist;
 
-				gtk_widget_show_all (button);
-				children = children->next;
-			}
-		}
-		/* If buttons with icons will fit, bring them back*/
-		else if (tasklist_width / buttons > icon_size * 2)
-		{
-			GtkWidget *widget;
-			GList* children = gtk_container_get_children (GTK_CONTAINER (outer_box));
-			while (children != NULL)
-			{
-				button = GTK_WIDGET (children->data);
-				box = gtk_bin_get_child (GTK_BIN (button));
-				GList* contents = gtk_container_get_children (GTK_CONTAINER (box));
-				while (contents != NULL)
-				{
-					widget = GTK_WIDGET (contents->data);
-					if (GTK_IS_LABEL (widget))
-						gtk_widget_hide (widget);
-
-					if (GTK_IS_IMAGE (widget))
-						gtk_widget_show (widget);
-
-					contents = contents->next;
-					gtk_widget_show (box);
-					gtk_widget_show (button);
-				}
-
-				children = children->next;
-				gtk_widget_set_size_request (button, tasklist_width / buttons, -1);
-			}
-		}
-		/* If we still cannot fit labels or icons, just fill the available space*/
-		else
-		{
-			GList* children = gtk_container_get_children (GTK_CONTAINER (outer_box));
-			while (children != NULL)
-			{
-				button = GTK_WIDGET (children->data);
-				gtk_widget_set_size_request (button, tasklist_width / buttons, -1);
-				children = children->next;
-			}
-		}
-	}
+	/* the box gives the room left to the remaining buttons, or to a
+	 * window that did not fit so far */
+	toplevel_task_free (task);
+	tasklist_queue_sync (tasklist);
 }
 
 static const struct zwlr_foreign_toplevel_handle_v1_listener foreign_toplevel_handle_listener = {
@@ -481,19 +559,44 @@ static const struct zwlr_foreign_toplevel_handle_v1_listener foreign_toplevel_ha
 static void
 toplevel_task_disconnected_from_widget (ToplevelTask *task)
 {
-	struct zwlr_foreign_toplevel_handle_v1 *toplevel = task->toplevel;
-
 	task->button = NULL;
 	task->icon = NULL;
 	task->label = NULL;
-	task->toplevel = NULL;
+}
+
+static void
+toplevel_task_free (ToplevelTask *task)
+{
+	TasklistManager *tasklist = task->tasklist;
+
+	if (task->button)
+		gtk_widget_destroy (task->button);
+	else
+		/* the menu may list it */
+		g_clear_pointer (&tasklist->overflow_menu, gtk_widget_destroy);
 
-	if (toplevel)
-		zwlr_foreign_toplevel_handle_v1_destroy (toplevel);
+	g_queue_delete_link (&tasklist->tasks, task->link);
 
+	if (task->toplevel)
+		zwlr_foreign_toplevel_handle_v1_destroy (task->toplevel);
+
+	g_free (task->pending_title);
+	g_free (task->pending_app_id);
+	g_free (task->title);
+	g_free (task->app_id);
 	g_free (task);
 }
 
+static void
+toplevel_task_activate (ToplevelTask *task, GtkWidget *widget)
+{
+	GdkDisplay *gdk_display = gtk_widget_get_display (widget);
+	GdkSeat *gdk_seat = gdk_display_get_default_seat (gdk_display);
+	struct wl_seat *wl_seat = gdk_wayland_seat_get_wl_seat (gdk_seat);
+
+	zwlr_foreign_toplevel_handle_v1_activate (task->toplevel, wl_seat);
+}
+
 static void
 toplevel_task_handle_clicked (GtkButton *button, ToplevelTask *task)
 {
@@ -505,10 +608,7 @@ toplevel_task_handle_clicked (GtkButton *button, ToplevelTask *task)
 		}
 		else
 		{
-			GdkDisplay *gdk_display = gtk_widget_get_display (GTK_WIDGET (button));
-			GdkSeat *gdk_seat = gdk_display_get_default_seat (gdk_display);
-			struct wl_seat *wl_seat = gdk_wayland_seat_get_wl_seat (gdk_seat);
-			zwlr_foreign_toplevel_handle_v1_activate (task->toplevel, wl_seat);
+			toplevel_task_activate (task, GTK_WIDGET (button));
 		}
 	}
 }
@@ -544,17 +644,33 @@ static ToplevelTask *
 toplevel_task_new (TasklistManager *tasklist, struct zwlr_foreign_toplevel_handle_v1 *toplevel)
 {
 	ToplevelTask *task = g_new0 (ToplevelTask, 1);
-	GtkWidget *button;
-	GtkOrientation orient;
 
-	buttons = buttons + 1;
-	orient = gtk_orientable_get_orientation (GTK_ORIENTABLE (tasklist->outer_box));
+	task->tasklist = tasklist;
+	g_queue_push_tail (&tasklist->tasks, task);
+	task->link = g_queue_peek_tail_link (&tasklist->tasks);
+
+	task->toplevel = toplevel;
+	zwlr_foreign_toplevel_handle_v1_add_listener (toplevel,
+						      &foreign_toplevel_handle_listener,
+						      task);
+
+	return task;
+}
+
+static void
+toplevel_task_add_button (ToplevelTask *task)
+{
+	TasklistManager *tasklist = task->tasklist;
+
 	task->button = gtk_button_new ();
 	g_signal_connect (task->button, "clicked", G_CALLBACK (toplevel_task_handle_clicked), task);
 
-	task->icon = gtk_image_new_from_icon_name ("unknown", icon_size);
+	if (task->app_id)
+		task->icon = gtk_image_new_from_gicon (app_id_get_icon (task->app_id), GTK_ICON_SIZE_MENU);
+	else
+		task->icon = gtk_image_new_from_icon_name ("unknown", icon_size);
 
-	task->label = gtk_label_new ("");
+	task->label = gtk_label_new (task->title ? task->title : "");
 	gtk_label_set_max_width_chars (GTK_LABEL (task->label), TASKLIST_TEXT_MAX_WIDTH);
 	gtk_label_set_ellipsize (GTK_LABEL (task->label), PANGO_ELLIPSIZE_END);
 	gtk_label_set_xalign (GTK_LABEL (task->label), 0.0);
@@ -565,165 +681,355 @@ toplevel_task_new (TasklistManager *tasklist, struct zwlr_foreign_toplevel_handl
 
 	gtk_container_add (GTK_CONTAINER (task->button), box);
 	gtk_widget_set_name (task->button , "tasklist-button");
+	gtk_button_set_relief (GTK_BUTTON (task->button),
+			       task->active ? GTK_RELIEF_NORMAL : GTK_RELIEF_NONE);
 	gtk_widget_show_all (task->button);
+	task->contents = TASK_CONTENTS_ICON_AND_LABEL;
 
-	/* Buttons on a vertical panel are not affected by how many are needed
-	 * GTK handles compressing contents as needed as the window width tells
-	 * GTK how much space to allocate the label and icon. Buttons will use
-	 * the full width of a vertical panel without any special attention
-	 * so break out here instead of breaking the vertical panel case
-	 */
-
-	if (orient == GTK_ORIENTATION_VERTICAL)
-	{
-		gtk_widget_show_all (task->button);
-		task->toplevel = toplevel;
-		zwlr_foreign_toplevel_handle_v1_add_listener (toplevel,
-							      &foreign_toplevel_handle_listener,
-							      task);
-		g_object_set_data_full (G_OBJECT (task->button),
-					toplevel_task_key,
-					task,
-					(GDestroyNotify)toplevel_task_disconnected_from_widget);
+	g_object_set_data_full (G_OBJECT (task->button),
+				toplevel_task_key,
+				task,
+				(GDestroyNotify)toplevel_task_disconnected_from_widget);
 
 	g_signal_connect (task->button, "button-press-event",
 			  G_CALLBACK (on_toplevel_button_press),
 			  tasklist);
 
-	return task;
+	gtk_box_pack_start (GTK_BOX (tasklist->list), task->button, TRUE, TRUE, 0);
+}
+
+/* Gives a button to the first windows that fit, and lists the others in
+ * the overflow menu */
+static gboolean
+tasklist_sync (gpointer user_data)
+{
+	TasklistManager *tasklist = user_data;
+	guint n_tasks, n_buttons, capacity, i;
+	GList *l;
+
+	tasklist->sync_id = 0;
+
+	if (!tasklist->list)
+		return G_SOURCE_REMOVE;
+
+	n_tasks = g_queue_get_length (&tasklist->tasks);
+	capacity = MAX (TASKLIST_BOX (tasklist->list)->capacity, 1);
+
+	/* the overflow button takes the place of one */
+	n_buttons = n_tasks <= capacity ? n_tasks : capacity - 1;
+
+	for (l = tasklist->tasks.head, i = 0; l != NULL; l = l->next, i++)
+	{
+		ToplevelTask *task = l->data;
+
+		if (i < n_buttons && !task->button)
+			toplevel_task_add_button (task);
+		else if (i >= n_buttons && task->button)
+			gtk_widget_destroy (task->button);
 	}
 
-	/* On horizontal panels, GTK does not by default limit the width of the tasklist
-	 * as it does not run out of space in the window until the entire panel is used,
-	 * leaving buttons at full width until then and overflowing all other applets
-	 *
-	 * Thus we must get the tasklist's allocated width when extra space remains,
-	 * which will be most of the distance between the handle and the next applet
-	 * From there, we can expand buttons and/or hide elements as needed
-	 */
+	if (n_buttons < n_tasks)
+	{
+		gchar *tooltip;
+
+		tooltip = g_strdup_printf (ngettext ("%u more window", "%u more windows",
+						     n_tasks - n_buttons),
+					   n_tasks - n_buttons);
+		gtk_widget_set_tooltip_text (tasklist->overflow, tooltip);
+		g_free (tooltip);
+
+		gtk_box_reorder_child (GTK_BOX (tasklist->list), tasklist->overflow, -1);
+		gtk_widget_show (tasklist->overflow);
+	}
+	else
+	{
+		gtk_widget_hide (tasklist->overflow);
+	}
 
+	return G_SOURCE_REMOVE;
+}
 
-	tasklist_width = gtk_widget_get_allocated_width (GTK_WIDGET (tasklist->outer_box));
+static void
+tasklist_queue_sync (TasklistManager *tasklist)
+{
+	if (tasklist->sync_id == 0)
+		tasklist->sync_id = g_idle_add (tasklist_sync, tasklist);
+}
 
-	/* First button can be buggy with this so hardcode it to expand to the limit */
-	if (buttons == 1)
-		gtk_widget_set_size_request (task->button, max_button_width, -1);
+static void
+overflow_item_activate (GtkMenuItem *item, gpointer user_data)
+{
+	ToplevelTask *task = g_object_get_data (G_OBJECT (item), toplevel_task_key);
+
+	if (task->toplevel)
+		toplevel_task_activate (task, GTK_WIDGET (item));
+}
+
+static gboolean
+tasklist_overflow_menu_destroy_idle (gpointer user_data)
+{
+	TasklistManager *tasklist = user_data;
+
+	tasklist->overflow_menu_idle_id = 0;
+	g_clear_pointer (&tasklist->overflow_menu, gtk_widget_destroy);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+tasklist_overflow_menu_deactivate (GtkMenuShell *menu, TasklistManager *tasklist)
+{
+	/* the activated item is told after the menu is deactivated */
+	if (tasklist->overflow_menu_idle_id == 0)
+		tasklist->overflow_menu_idle_id = g_idle_add (tasklist_overflow_menu_destroy_idle, tasklist);
+}
+
+/* The menu is built when shown and thrown away afterwards */
+static void
+tasklist_overflow_clicked (GtkButton *button, TasklistManager *tasklist)
+{
+	GList *l;
 
-	/* if the number of buttons forces width to less than 3x the icon size, shrink them  */
-	if ((buttons != 0) && (tasklist_width > 1 )&& (tasklist_width / buttons < (icon_size * 3)))
+	g_clear_pointer (&tasklist->overflow_menu, gtk_widget_destroy);
+	tasklist->overflow_menu = gtk_menu_new ();
+
+	for (l = tasklist->tasks.head; l != NULL; l = l->next)
 	{
-		/* adjust the current button first or it can be missed */
-		if (tasklist_width / buttons > icon_size * 2)
-		{
-			gtk_widget_hide (task->label);
-			gtk_widget_show (task->icon);
-		}
+		ToplevelTask *task = l->data;
+		GtkWidget *item, *box, *image, *label;
+
+		if (task->button)
+			continue;
+
+		if (task->app_id)
+			image = gtk_image_new_from_gicon (app_id_get_icon (task->app_id), GTK_ICON_SIZE_MENU);
 		else
-		{
-			gtk_widget_show (task->label);
-			gtk_widget_hide (task->icon);
-		}
-		gtk_widget_show (box);
-		gtk_widget_show (task->button);
+			image = gtk_image_new_from_icon_name ("unknown", GTK_ICON_SIZE_MENU);
+
+		label = gtk_label_new (task->title ? task->title : "");
+		gtk_label_set_max_width_chars (GTK_LABEL (label), TASKLIST_TEXT_MAX_WIDTH * 2);
+		gtk_label_set_ellipsize (GTK_LABEL (label), PANGO_ELLIPSIZE_END);
+		gtk_label_set_xalign (GTK_LABEL (label), 0.0);
+
+		box = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 6);
+		gtk_box_pack_start (GTK_BOX (box), image, FALSE, FALSE, 0);
+		gtk_box_pack_start (GTK_BOX (box), label, TRUE, TRUE, 0);
+
+		item = gtk_menu_item_new ();
+		gtk_container_add (GTK_CONTAINER (item), box);
+		g_object_set_data (G_OBJECT (item), toplevel_task_key, task);
+		g_signal_connect (item, "activate", G_CALLBACK (overflow_item_activate), NULL);
+		gtk_menu_shell_append (GTK_MENU_SHELL (tasklist->overflow_menu), item);
+	}
 
-		/* iterate over all the buttons, first hide labels
-		 * then hide icons and bring back labels
-		 */
-		GtkWidget *widget;
+	g_signal_connect (tasklist->overflow_menu, "deactivate",
+			  G_CALLBACK (tasklist_overflow_menu_deactivate), tasklist);
+	gtk_widget_show_all (tasklist->overflow_menu);
+	gtk_menu_attach_to_widget (GTK_MENU (tasklist->overflow_menu), GTK_WIDGET (button), NULL);
+	gtk_menu_popup_at_widget (GTK_MENU (tasklist->overflow_menu), GTK_WIDGET (button),
+				  GDK_GRAVITY_NORTH_WEST, GDK_GRAVITY_SOUTH_WEST, NULL);
+}
 
-		GList* children = gtk_container_get_children (GTK_CONTAINER (tasklist->list));
-		while (children != NULL)
-		{
-			button = GTK_WIDGET (children->data);
-			box = gtk_bin_get_child (GTK_BIN (button));
+static void
+toplevel_task_set_contents (ToplevelTask *task, TaskContents contents)
+{
+	if (task->contents == contents)
+		return;
 
-			/* hide labels of all buttons but show icons if only icons will fit */
-			if (tasklist_width / buttons > icon_size * 2)
-			{
-				/* find the icon and the label, show just the icon */
-				GList* contents = gtk_container_get_children (GTK_CONTAINER (box));
+	gtk_widget_set_visible (task->icon, contents != TASK_CONTENTS_LABEL);
+	gtk_widget_set_visible (task->label, contents != TASK_CONTENTS_ICON);
+	task->contents = contents;
+}
 
-				while (contents != NULL)
-				{
-					widget = GTK_WIDGET (contents->data);
-					if (GTK_IS_LABEL (widget))
-						gtk_widget_hide (widget);
+static gint
+tasklist_box_count_visible (GtkWidget *widget)
+{
+	GList *children, *l;
+	gint n_buttons = 0;
 
-					if (GTK_IS_IMAGE (widget))
-						gtk_widget_show (widget);
+	children = gtk_container_get_children (GTK_CONTAINER (widget));
+	for (l = children; l != NULL; l = l->next)
+		if (gtk_widget_get_visible (l->data))
+			n_buttons++;
+	g_list_free (children);
 
-					contents = contents->next;
-				}
-			}
-			else
+	return n_buttons;
+}
+
+/* All the windows, whether they have a button or not */
+static gint
+tasklist_box_count_tasks (TasklistBox *box)
+{
+	if (box->tasklist)
+		return g_queue_get_length (&box->tasklist->tasks);
+
+	return tasklist_box_count_visible (GTK_WIDGET (box));
+}
+
+static void
+tasklist_box_set_capacity (TasklistBox *box, gint capacity)
+{
+	capacity = MAX (capacity, 1);
+
+	if (box->capacity == capacity)
+		return;
+
+	/* widgets cannot be added or removed while allocating */
+	box->capacity = capacity;
+	if (box->tasklist)
+		tasklist_queue_sync (box->tasklist);
+}
+
+static void
+tasklist_box_get_preferred_width (GtkWidget *widget,
+				  gint      *minimum_width,
+				  gint      *natural_width)
+{
+	gint n_buttons;
+
+	if (gtk_orientable_get_orientation (GTK_ORIENTABLE (widget)) == GTK_ORIENTATION_VERTICAL)
+	{
+		GTK_WIDGET_CLASS (tasklist_box_parent_class)->get_preferred_width (widget,
+										  minimum_width,
+										  natural_width);
+		return;
+	}
+
+	n_buttons = tasklist_box_count_tasks (TASKLIST_BOX (widget));
+
+	/* ask for full width buttons, and make do with what the panel gives */
+	*minimum_width = MIN (n_buttons, 1) * icon_size;
+	*natural_width = n_buttons * max_button_width;
+}
+
+static void
+tasklist_box_get_preferred_height (GtkWidget *widget,
+				   gint      *minimum_height,
+				   gint      *natural_height)
+{
+	gint n_visible, n_tasks;
+
+	GTK_WIDGET_CLASS (tasklist_box_parent_class)->get_preferred_height (widget,
+									   minimum_height,
+									   natural_height);
+
+	if (gtk_orientable_get_orientation (GTK_ORIENTABLE (widget)) == GTK_ORIENTATION_HORIZONTAL)
+		return;
+
+	/* room for the windows without a button too */
+	n_visible = tasklist_box_count_visible (widget);
+	n_tasks = tasklist_box_count_tasks (TASKLIST_BOX (widget));
+	if (n_visible > 0 && n_tasks > n_visible)
+		*natural_height = *natural_height / n_visible * n_tasks;
+}
+
+static void
+tasklist_box_size_allocate (GtkWidget     *widget,
+			    GtkAllocation *allocation)
+{
+	GList *children, *l;
+	TaskContents contents;
+	gint n_buttons = 0;
+	gint button_width;
+	gint x;
+
+	if (gtk_orientable_get_orientation (GTK_ORIENTABLE (widget)) == GTK_ORIENTATION_VERTICAL)
+	{
+		gint row_height = icon_size * 2;
+
+		/* the buttons use the full width of a vertical panel, and GTK
+		 * compresses their contents as needed */
+		GTK_WIDGET_CLASS (tasklist_box_parent_class)->size_allocate (widget, allocation);
+
+		children = gtk_container_get_children (GTK_CONTAINER (widget));
+		for (l = children; l != NULL; l = l->next)
+		{
+			if (gtk_widget_get_visible (l->data))
 			{
-				/* find the icon and the label, show just the label as it is more
-				 * compressable than the icon. Though less meaningful at this size,
-				 * it is enough to keep the tasklist from disappearing on themes
-				 * that do not set borders around tasklist buttons.
-				 * This is same behavior as on x11 save that an extreme number of
-				 * buttons (50+ on 700px of space) can still overflow
-				 */
-
-				GList* contents = gtk_container_get_children (GTK_CONTAINER (box));
-				while (contents != NULL)
-				{
-					widget = GTK_WIDGET (contents->data);
-					if (GTK_IS_LABEL (widget))
-						gtk_widget_show (widget);
-
-					if (GTK_IS_IMAGE (widget))
-						gtk_widget_hide (widget);
-
-					contents = contents->next;
-				}
+				gtk_widget_get_preferred_height_for_width (l->data, allocation->width,
+									   &row_height, NULL);
+				break;
 			}
-			/*expand buttons with labels or everything hidden to fit remaining space*/
-			gtk_widget_set_size_request (button, tasklist_width / buttons, -1);
-			/*show the button and any contents that fit, then get the next button*/
-			gtk_widget_show (box);
-			gtk_widget_show (button);
-
-			children = children->next;
 		}
+		g_list_free (children);
+
+		tasklist_box_set_capacity (TASKLIST_BOX (widget),
+					   allocation->height / MAX (row_height, 1));
+		return;
 	}
+
+	gtk_widget_set_allocation (widget, allocation);
+
+	/* below twice the icon size, buttons only show part of the label */
+	tasklist_box_set_capacity (TASKLIST_BOX (widget),
+				   allocation->width / (icon_size * 2));
+
+	children = gtk_container_get_children (GTK_CONTAINER (widget));
+	for (l = children; l != NULL; l = l->next)
+		if (gtk_widget_get_visible (l->data))
+			n_buttons++;
+
+	if (n_buttons == 0)
+	{
+		g_list_free (children);
+		return;
+	}
+
+	button_width = MIN (max_button_width, allocation->width / n_buttons);
+
+	/* the label is more compressible than the icon: though less meaningful
+	 * at this size, it keeps the tasklist from disappearing on themes that
+	 * do not draw borders around the buttons */
+	if (button_width >= icon_size * 3)
+		contents = TASK_CONTENTS_ICON_AND_LABEL;
+	else if (button_width > icon_size * 2)
+		contents = TASK_CONTENTS_ICON;
 	else
+		contents = TASK_CONTENTS_LABEL;
+
+	x = allocation->x;
+	for (l = children; l != NULL; l = l->next)
 	{
-		GList* children = gtk_container_get_children (GTK_CONTAINER(tasklist->list));
-		while (children != NULL)
-		{
-			button = GTK_WIDGET (children->data);
-			if (((buttons ) * max_button_width < tasklist_width) || (buttons == 1))
+		GtkWidget *button = l->data;
+		ToplevelTask *task;
+		GtkAllocation child_allocation;
+		gint min_height;
 
-				/*Don't let buttons expand over the maximum button size*/
-				gtk_widget_set_size_request (button, max_button_width, -1);
+		if (!gtk_widget_get_visible (button))
+			continue;
 
-			else
-				/*if full width buttons won't fit, size them to just fill the tasklist*/
-				gtk_widget_set_size_request (button, tasklist_width / buttons, -1);
+		task = g_object_get_data (G_OBJECT (button), toplevel_task_key);
+		if (task)
+			toplevel_task_set_contents (task, contents);
 
-			children = children->next;
-		}
-	gtk_widget_show_all (task->button);
+		/* needed before allocating, even if we know better */
+		gtk_widget_get_preferred_height_for_width (button, button_width, &min_height, NULL);
+
+		child_allocation.x = x;
+		child_allocation.y = allocation->y;
+		child_allocation.width = button_width;
+		child_allocation.height = allocation->height;
+		gtk_widget_size_allocate (button, &child_allocation);
+
+		x += button_width;
 	}
 
-	/*Reset the tasklist width after button adjustments*/
-	tasklist_width = gtk_widget_get_allocated_width (GTK_WIDGET (tasklist->outer_box));
+	g_list_free (children);
+}
 
-	task->toplevel = toplevel;
-	zwlr_foreign_toplevel_handle_v1_add_listener (toplevel,
-						      &foreign_toplevel_handle_listener,
-						      task);
-	g_object_set_data_full (G_OBJECT (task->button),
-				toplevel_task_key,
-				task,
-				(GDestroyNotify)toplevel_task_disconnected_from_widget);
+static void
+tasklist_box_class_init (TasklistBoxClass *klass)
+{
+	GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
 
-	g_signal_connect (task->button, "button-press-event",
-			  G_CALLBACK (on_toplevel_button_press),
-			  tasklist);
+	widget_class->get_preferred_width = tasklist_box_get_preferred_width;
+	widget_class->get_preferred_height = tasklist_box_get_preferred_height;
+	widget_class->size_allocate = tasklist_box_size_allocate;
+}
 
-	return task;
+static void
+tasklist_box_init (TasklistBox *box)
+{
 }
 
 GtkWidget*
@@ -35,6 +35,7 @@
 
 #include "wncklet.h"
 #include "window-list.h"
+#include "window-model.h"
 
 #define WINDOW_LIST_ICON "mate-panel-window-list"
 #define WINDOW_LIST_SCHEMA "org.mate.panel.applet.window-list"
@@ -54,6 +55,15 @@ typedef struct {
 	GtkWidget* tasklist;
 #ifdef HAVE_WINDOW_PREVIEWS
 	GtkWidget* preview;
+	gulong preview_xid;
+	struct _GroupPreview* group_preview;
+	gboolean preview_is_group;
+
+	/* xid -> WindowThumbnail */
+	GHashTable* thumbnails;
+	GQueue thumbnail_prefetch;
+	guint thumbnail_prefetch_id;
+	guint windows_watch;
 
 	gboolean show_window_thumbnails;
 	gint thumbnail_size;
@@ -67,6 +77,9 @@ typedef struct {
 
 	GtkOrientation orientation;
 	int size;
+	/* the size hints last given to the panel */
+	int* size_hints;
+	int n_size_hints;
 #if !defined(WNCKLET_INPROCESS) && !GTK_CHECK_VERSION (3, 23, 0)
 	gboolean needs_hints;
 #endif
@@ -105,7 +118,7 @@ static void display_help_dialog(GtkAction* action, TasklistData* tasklist);
 static void display_about_dialog(GtkAction* action, TasklistData* tasklist);
 static void destroy_tasklist(GtkWidget* widget, TasklistData* tasklist);
 
-static void tasklist_update(TasklistData* tasklist)
+static void tasklist_update_size(TasklistData* tasklist)
 {
 	if (tasklist->orientation == GTK_ORIENTATION_HORIZONTAL)
 	{
@@ -115,6 +128,11 @@ static void tasklist_update(TasklistData* tasklist)
 	{
 		gtk_widget_set_size_request(GTK_WIDGET(tasklist->tasklist), tasklist->size, -1);
 	}
+}
+
+static void tasklist_update(TasklistData* tasklist)
+{
+	tasklist_update_size(tasklist);
 
 #ifdef HAVE_X11
 	if (WNCK_IS_TASKLIST(tasklist->tasklist))
@@ -226,7 +244,7 @@ static void applet_change_orient(MatePanelApplet* applet, MatePanelAppletOrient
 	tasklist->orientation = new_orient;
 	tasklist_apply_orientation (tasklist);
 
-	tasklist_update(tasklist);
+	tasklist_update_size(tasklist);
 }
 
 static void applet_change_background(MatePanelApplet* applet, MatePanelAppletBackgroundType type, GdkColor* color, cairo_pattern_t* pattern, TasklistData* tasklist)
@@ -431,24 +449,472 @@ preview_window_reposition (WnckTasklist    *tl,
 	gtk_window_move (GTK_WINDOW (tasklist->preview), x_pos, y_pos);
 }
 
-static gboolean preview_window_draw (GtkWidget *widget, cairo_t *cr, cairo_surface_t *thumbnail)
+/* Thumbnails are kept per window so that hovering a button does not have
+ * to read the whole window from the X server. Those of the windows that can
+ * be hovered are refreshed in the background, one per main loop iteration,
+ * once the pointer is over the tasklist; a thumbnail older than
+ * THUMBNAIL_MAX_AGE is shown while it is being refreshed. */
+#define THUMBNAIL_MAX_AGE (2 * G_USEC_PER_SEC)
+#define THUMBNAIL_CACHE_SIZE 32
+
+typedef struct {
+	cairo_surface_t *surface;
+	int width;
+	int height;
+	int scale;
+	/* size of the window when captured */
+	int window_width;
+	int window_height;
+	gint64 time;
+} WindowThumbnail;
+
+static void window_thumbnail_free (WindowThumbnail *thumbnail)
+{
+	cairo_surface_destroy (thumbnail->surface);
+	g_free (thumbnail);
+}
+
+static WindowThumbnail *
+window_thumbnail_lookup (TasklistData *tasklist,
+                         gulong        xid)
+{
+	return g_hash_table_lookup (tasklist->thumbnails, GSIZE_TO_POINTER ((gsize) xid));
+}
+
+static WindowThumbnail *
+window_thumbnail_update (TasklistData *tasklist,
+                         WnckWindow   *wnck_window)
+{
+	WindowThumbnail *thumbnail;
+	cairo_surface_t *surface;
+	gulong xid;
+	int width, height, scale;
+
+	xid = wnck_window_get_xid (wnck_window);
+
+	surface = preview_window_thumbnail (wnck_window, tasklist, &width, &height, &scale);
+	if (surface == NULL)
+	{
+		g_hash_table_remove (tasklist->thumbnails, GSIZE_TO_POINTER ((gsize) xid));
+		return NULL;
+	}
+
+	thumbnail = window_thumbnail_lookup (tasklist, xid);
+	if (thumbnail == NULL)
+	{
+		/* make room by forgetting the oldest one */
+		if (g_hash_table_size (tasklist->thumbnails) >= THUMBNAIL_CACHE_SIZE)
+		{
+			GHashTableIter iter;
+			gpointer key, value;
+			gpointer oldest_key = NULL;
+			gint64 oldest_time = G_MAXINT64;
+
+			g_hash_table_iter_init (&iter, tasklist->thumbnails);
+			while (g_hash_table_iter_next (&iter, &key, &value))
+			{
+				if (((WindowThumbnail *) value)->time < oldest_time)
+				{
+					oldest_time = ((WindowThumbnail *) value)->time;
+					oldest_key = key;
+				}
+			}
+
+			g_hash_table_remove (tasklist->thumbnails, oldest_key);
+		}
+
+		thumbnail = g_new0 (WindowThumbnail, 1);
+		g_hash_table_insert (tasklist->thumbnails, GSIZE_TO_POINTER ((gsize) xid), thumbnail);
+	}
+	else
+	{
+		cairo_surface_destroy (thumbnail->surface);
+	}
+
+	thumbnail->surface = surface;
+	thumbnail->width = width;
+	thumbnail->height = height;
+	thumbnail->scale = scale;
+	wnck_window_get_client_window_geometry (wnck_window, NULL, NULL,
+	                                        &thumbnail->window_width,
+	                                        &thumbnail->window_height);
+	thumbnail->time = g_get_monotonic_time ();
+
+	return thumbnail;
+}
+
+static gboolean window_thumbnail_is_fresh (WindowThumbnail *thumbnail)
+{
+	return g_get_monotonic_time () - thumbnail->time < THUMBNAIL_MAX_AGE;
+}
+
+static void thumbnail_prefetch_queue (TasklistData *tasklist, gulong xid);
+
+/* A grouped button shows the thumbnails of up to GROUP_PREVIEW_MAX windows
+ * side by side, at half the size of a single one. They are composed once
+ * into one surface, kept until the windows of the group change or one of
+ * their thumbnails is refreshed. */
+#define GROUP_PREVIEW_MAX 6
+
+typedef struct _GroupPreview {
+	gulong xids[GROUP_PREVIEW_MAX];
+	int n_xids;
+	cairo_surface_t *surface;
+	int width;
+	int height;
+	int scale;
+	gint64 time;
+} GroupPreview;
+
+static void group_preview_free (GroupPreview *group)
+{
+	if (group->surface != NULL)
+		cairo_surface_destroy (group->surface);
+	g_free (group);
+}
+
+static void group_preview_clear (TasklistData *tasklist)
+{
+	g_clear_pointer (&tasklist->group_preview, group_preview_free);
+}
+
+static gboolean group_preview_contains (GroupPreview *group, gulong xid)
+{
+	int i;
+
+	for (i = 0; i < group->n_xids; i++)
+		if (group->xids[i] == xid)
+			return TRUE;
+
+	return FALSE;
+}
+
+static void group_preview_compose (TasklistData *tasklist, GroupPreview *group)
+{
+	WindowThumbnail *thumbnails[GROUP_PREVIEW_MAX];
+	double ratios[GROUP_PREVIEW_MAX];
+	int cell_size;
+	int n, i;
+	int width = 0, height = 0, scale = 1;
+	int offset;
+	cairo_t *cr;
+
+	if (group->surface != NULL)
+	{
+		cairo_surface_destroy (group->surface);
+		group->surface = NULL;
+	}
+
+	cell_size = MAX (1, tasklist->thumbnail_size / 2);
+
+	/* the layout: one row, or one column on a vertical panel */
+	for (i = 0, n = 0; i < group->n_xids; i++)
+	{
+		WindowThumbnail *thumbnail;
+		int w, h;
+
+		thumbnail = window_thumbnail_lookup (tasklist, group->xids[i]);
+		if (thumbnail == NULL)
+			continue;
+
+		w = thumbnail->width / thumbnail->scale;
+		h = thumbnail->height / thumbnail->scale;
+		ratios[n] = MIN (1.0, (double) cell_size / MAX (1, MAX (w, h)));
+		w = MAX (1, (int) (w * ratios[n]));
+		h = MAX (1, (int) (h * ratios[n]));
+
+		if (tasklist->orientation == GTK_ORIENTATION_HORIZONTAL)
+		{
+			width += w + (n > 0 ? PREVIEW_PADDING : 0);
+			height = MAX (height, h);
+		}
+		else
+		{
+			height += h + (n > 0 ? PREVIEW_PADDING : 0);
+			width = MAX (width, w);
+		}
+
+		scale = MAX (scale, thumbnail->scale);
+		thumbnails[n++] = thumbnail;
+	}
+
+	group->time = g_get_monotonic_time ();
+
+	if (n == 0)
+		return;
+
+	group->surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width * scale, height * scale);
+	cairo_surface_set_device_scale (group->surface, scale, scale);
+	group->width = width * scale;
+	group->height = height * scale;
+	group->scale = scale;
+
+	cr = cairo_create (group->surface);
+
+	for (i = 0, offset = 0; i < n; i++)
+	{
+		int w = MAX (1, (int) (thumbnails[i]->width / thumbnails[i]->scale * ratios[i]));
+		int h = MAX (1, (int) (thumbnails[i]->height / thumbnails[i]->scale * ratios[i]));
+
+		cairo_save (cr);
+		if (tasklist->orientation == GTK_ORIENTATION_HORIZONTAL)
+		{
+			cairo_translate (cr, offset, (height - h) / 2);
+			offset += w + PREVIEW_PADDING;
+		}
+		else
+		{
+			cairo_translate (cr, (width - w) / 2, offset);
+			offset += h + PREVIEW_PADDING;
+		}
+		cairo_scale (cr, ratios[i], ratios[i]);
+		cairo_set_source_surface (cr, thumbnails[i]->surface, 0, 0);
+		cairo_paint (cr);
+		cairo_restore (cr);
+	}
+
+	cairo_destroy (cr);
+}
+
+static GroupPreview *
+group_preview_get (TasklistData *tasklist, GList *wnck_windows)
+{
+	WnckWorkspace *workspace;
+	GroupPreview *group;
+	gulong xids[GROUP_PREVIEW_MAX];
+	gboolean changed;
+	int n_xids = 0;
+	GList *l;
+	int i;
+
+	workspace = wnck_screen_get_active_workspace (wnck_screen_get_default ());
+
+	for (l = wnck_windows; l != NULL && n_xids < GROUP_PREVIEW_MAX; l = l->next)
+	{
+		if (wnck_window_is_visible_on_workspace (l->data, workspace))
+			xids[n_xids++] = wnck_window_get_xid (l->data);
+	}
+
+	if (n_xids == 0)
+		return NULL;
+
+	group = tasklist->group_preview;
+	changed = (group == NULL || group->n_xids != n_xids ||
+	           memcmp (group->xids, xids, n_xids * sizeof (gulong)) != 0);
+
+	if (changed)
+	{
+		group_preview_clear (tasklist);
+		group = tasklist->group_preview = g_new0 (GroupPreview, 1);
+		memcpy (group->xids, xids, n_xids * sizeof (gulong));
+		group->n_xids = n_xids;
+	}
+
+	/* the windows never seen before are read now, the others later */
+	for (i = 0; i < n_xids; i++)
+	{
+		WindowThumbnail *thumbnail;
+
+		thumbnail = window_thumbnail_lookup (tasklist, xids[i]);
+		if (thumbnail == NULL)
+		{
+			WnckWindow *wnck_window = wnck_window_get (xids[i]);
+
+			if (wnck_window != NULL &&
+			    window_thumbnail_update (tasklist, wnck_window) != NULL)
+				changed = TRUE;
+		}
+		else
+		{
+			if (thumbnail->time > group->time)
+				changed = TRUE;
+			if (!window_thumbnail_is_fresh (thumbnail))
+				thumbnail_prefetch_queue (tasklist, xids[i]);
+		}
+	}
+
+	if (changed)
+		group_preview_compose (tasklist, group);
+
+	return group->surface != NULL ? group : NULL;
+}
+
+static gboolean preview_window_draw (GtkWidget *widget, cairo_t *cr, TasklistData *tasklist)
 {
 	GtkStyleContext *context;
+	WindowThumbnail *thumbnail;
 
 	context = gtk_widget_get_style_context (widget);
-	gtk_render_icon_surface (context, cr, thumbnail, 0, 0);
+
+	if (tasklist->preview_is_group)
+	{
+		if (tasklist->group_preview != NULL && tasklist->group_preview->surface != NULL)
+			gtk_render_icon_surface (context, cr, tasklist->group_preview->surface, 0, 0);
+
+		return FALSE;
+	}
+
+	thumbnail = window_thumbnail_lookup (tasklist, tasklist->preview_xid);
+	if (thumbnail == NULL)
+		return FALSE;
+
+	gtk_render_icon_surface (context, cr, thumbnail->surface, 0, 0);
 
 	return FALSE;
 }
 
+static void preview_window_update (TasklistData *tasklist, int width, int height, int scale)
+{
+	width /= scale;
+	height /= scale;
+
+	gtk_window_resize (GTK_WINDOW (tasklist->preview), width, height);
+	preview_window_reposition (WNCK_TASKLIST (tasklist->tasklist), tasklist, width, height, scale);
+	gtk_widget_queue_draw (tasklist->preview);
+}
+
+static gboolean thumbnail_prefetch_cb (TasklistData *tasklist)
+{
+	WnckWindow *wnck_window;
+	WindowThumbnail *thumbnail;
+	gulong xid;
+
+	if (g_queue_is_empty (&tasklist->thumbnail_prefetch))
+	{
+		tasklist->thumbnail_prefetch_id = 0;
+		return G_SOURCE_REMOVE;
+	}
+
+	xid = (gulong) GPOINTER_TO_SIZE (g_queue_pop_head (&tasklist->thumbnail_prefetch));
+
+	/* it may have gone, moved or been minimized since it was queued */
+	wnck_window = wnck_window_get (xid);
+	if (wnck_window == NULL ||
+	    !wnck_window_is_visible_on_workspace (wnck_window,
+	                                          wnck_screen_get_active_workspace (wnck_screen_get_default ())))
+		return G_SOURCE_CONTINUE;
+
+	thumbnail = window_thumbnail_lookup (tasklist, xid);
+	if (thumbnail != NULL && window_thumbnail_is_fresh (thumbnail))
+		return G_SOURCE_CONTINUE;
+
+	thumbnail = window_thumbnail_update (tasklist, wnck_window);
+
+	if (thumbnail == NULL || tasklist->preview == NULL)
+		return G_SOURCE_CONTINUE;
+
+	if (!tasklist->preview_is_group && tasklist->preview_xid == xid)
+	{
+		preview_window_update (tasklist, thumbnail->width, thumbnail->height, thumbnail->scale);
+	}
+	else if (tasklist->preview_is_group && tasklist->group_preview != NULL &&
+	         group_preview_contains (tasklist->group_preview, xid))
+	{
+		GroupPreview *group = tasklist->group_preview;
+
+		group_preview_compose (tasklist, group);
+		if (group->surface != NULL)
+			preview_window_update (tasklist, group->width, group->height, group->scale);
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void thumbnail_prefetch_queue (TasklistData *tasklist, gulong xid)
+{
+	gpointer data = GSIZE_TO_POINTER ((gsize) xid);
+
+	if (g_queue_find (&tasklist->thumbnail_prefetch, data) == NULL)
+		g_queue_push_tail (&tasklist->thumbnail_prefetch, data);
+
+	if (tasklist->thumbnail_prefetch_id == 0)
+		tasklist->thumbnail_prefetch_id = g_idle_add_full (G_PRIORITY_LOW,
+		                                                   (GSourceFunc) thumbnail_prefetch_cb,
+		                                                   tasklist, NULL);
+}
+
+/* Queues the windows the pointer can reach next: those shown on the
+ * current workspace whose thumbnail is missing or old */
+static void thumbnail_prefetch_start (TasklistData *tasklist, gulong hovered_xid)
+{
+	WnckScreen *screen;
+	WnckWorkspace *workspace;
+	GList *l;
+
+	screen = wnck_screen_get_default ();
+	workspace = wnck_screen_get_active_workspace (screen);
+
+	for (l = wnck_screen_get_windows (screen); l != NULL; l = l->next)
+	{
+		WnckWindow *wnck_window = l->data;
+		WindowThumbnail *thumbnail;
+		gulong xid;
+
+		xid = wnck_window_get_xid (wnck_window);
+		if (xid == hovered_xid ||
+		    wnck_window_is_skip_tasklist (wnck_window) ||
+		    !wnck_window_is_visible_on_workspace (wnck_window, workspace))
+			continue;
+
+		thumbnail = window_thumbnail_lookup (tasklist, xid);
+		if (thumbnail == NULL || !window_thumbnail_is_fresh (thumbnail))
+			thumbnail_prefetch_queue (tasklist, xid);
+	}
+}
+
+static void thumbnail_prefetch_stop (TasklistData *tasklist)
+{
+	g_queue_clear (&tasklist->thumbnail_prefetch);
+
+	if (tasklist->thumbnail_prefetch_id != 0)
+	{
+		g_source_remove (tasklist->thumbnail_prefetch_id);
+		tasklist->thumbnail_prefetch_id = 0;
+	}
+}
+
+static void window_changed (const WnckletWindow *window, WnckletWindowFields changed, TasklistData *tasklist)
+{
+	gulong xid = window->xid;
+
+	if (!(changed & WNCKLET_WINDOW_CLOSED))
+	{
+		WindowThumbnail *thumbnail;
+		int width, height;
+
+		/* a resized window is to be captured again, a moved one is not */
+		thumbnail = window_thumbnail_lookup (tasklist, xid);
+		if (thumbnail == NULL || window->window == NULL)
+			return;
+
+		wnck_window_get_client_window_geometry (window->window, NULL, NULL,
+		                                        &width, &height);
+		if (width != thumbnail->window_width ||
+		    height != thumbnail->window_height)
+			g_hash_table_remove (tasklist->thumbnails, GSIZE_TO_POINTER ((gsize) xid));
+
+		return;
+	}
+
+	g_hash_table_remove (tasklist->thumbnails, GSIZE_TO_POINTER ((gsize) xid));
+
+	if (tasklist->group_preview != NULL &&
+	    group_preview_contains (tasklist->group_preview, xid))
+	{
+		if (tasklist->preview != NULL && tasklist->preview_is_group)
+		{
+			gtk_widget_destroy (tasklist->preview);
+			tasklist->preview = NULL;
+		}
+		group_preview_clear (tasklist);
+	}
+}
+
 static gboolean applet_enter_notify_event (WnckTasklist *tl, GList *wnck_windows, TasklistData *tasklist)
 {
-	cairo_surface_t *thumbnail;
 	WnckWindow *wnck_window = NULL;
-	int n_windows;
-	int thumbnail_width;
-	int thumbnail_height;
-	int thumbnail_scale;
+	int width, height, scale;
+	gulong xid = 0;
 
 	if (tasklist->preview != NULL)
 	{
@@ -459,42 +925,66 @@ static gboolean applet_enter_notify_event (WnckTasklist *tl, GList *wnck_windows
 	if (!tasklist->show_window_thumbnails || wnck_windows == NULL)
 		return FALSE;
 
-	n_windows = g_list_length (wnck_windows);
-	/* TODO: Display a list of stacked thumbnails for grouped windows. */
-	if (n_windows == 1)
+	if (wnck_windows->next != NULL)
 	{
-		GList* l = wnck_windows;
-		if (l != NULL)
-			wnck_window = (WnckWindow*)l->data;
+		GroupPreview *group;
+
+		group = group_preview_get (tasklist, wnck_windows);
+		thumbnail_prefetch_start (tasklist, 0);
+
+		if (group == NULL)
+			return FALSE;
+
+		tasklist->preview_is_group = TRUE;
+		width = group->width;
+		height = group->height;
+		scale = group->scale;
 	}
+	else
+	{
+		WindowThumbnail *thumbnail;
 
-	if (wnck_window == NULL)
-		return FALSE;
+		wnck_window = (WnckWindow*) wnck_windows->data;
 
-	/* Do not show preview if window is not visible nor in current workspace */
-	if (!wnck_window_is_visible_on_workspace (wnck_window,
-						  wnck_screen_get_active_workspace (wnck_screen_get_default ())))
-		return FALSE;
+		/* Do not show preview if window is not visible nor in current workspace */
+		if (!wnck_window_is_visible_on_workspace (wnck_window,
+							  wnck_screen_get_active_workspace (wnck_screen_get_default ())))
+			return FALSE;
 
-	thumbnail = preview_window_thumbnail (wnck_window, tasklist, &thumbnail_width, &thumbnail_height, &thumbnail_scale);
+		xid = wnck_window_get_xid (wnck_window);
 
-	if (thumbnail == NULL)
-		return FALSE;
+		/* Only a window never seen before has to be read now: the others
+		 * show what we have, and are refreshed right after if needed */
+		thumbnail = window_thumbnail_lookup (tasklist, xid);
+		if (thumbnail == NULL)
+			thumbnail = window_thumbnail_update (tasklist, wnck_window);
+		else if (!window_thumbnail_is_fresh (thumbnail))
+			thumbnail_prefetch_queue (tasklist, xid);
+
+		thumbnail_prefetch_start (tasklist, xid);
+
+		if (thumbnail == NULL)
+			return FALSE;
+
+		tasklist->preview_is_group = FALSE;
+		width = thumbnail->width;
+		height = thumbnail->height;
+		scale = thumbnail->scale;
+	}
 
 	/* Create window to display preview */
 	tasklist->preview = gtk_window_new (GTK_WINDOW_POPUP);
+	tasklist->preview_xid = xid;
 
 	gtk_widget_set_app_paintable (tasklist->preview, TRUE);
-	gtk_window_set_default_size (GTK_WINDOW (tasklist->preview), thumbnail_width/thumbnail_scale, thumbnail_height/thumbnail_scale);
+	gtk_window_set_default_size (GTK_WINDOW (tasklist->preview), width/scale, height/scale);
 	gtk_window_set_resizable (GTK_WINDOW (tasklist->preview), TRUE);
-	preview_window_reposition (tl, tasklist, thumbnail_width/thumbnail_scale, thumbnail_height/thumbnail_scale, thumbnail_scale);
+	preview_window_reposition (tl, tasklist, width/scale, height/scale, scale);
 
 	gtk_widget_show (tasklist->preview);
 
-	g_signal_connect_data (tasklist->preview, "draw",
-	                       G_CALLBACK (preview_window_draw), thumbnail,
-	                       (GClosureNotify) G_CALLBACK (cairo_surface_destroy),
-	                       0);
+	g_signal_connect (tasklist->preview, "draw",
+	                  G_CALLBACK (preview_window_draw), tasklist);
 
 	return FALSE;
 }
@@ -519,7 +1009,8 @@ static void applet_change_pixel_size(MatePanelApplet* applet, gint size, Tasklis
 
 	tasklist->size = size;
 
-	tasklist_update(tasklist);
+	/* the other settings did not change */
+	tasklist_update_size(tasklist);
 }
 
 /* TODO: this is sad, should be used a function to retrieve  applications from
@@ -620,6 +1111,12 @@ static void thumbnail_size_changed(GSettings *settings, gchar* key, TasklistData
 {
 	tasklist->thumbnail_size = g_settings_get_int(settings, key);
 	tasklist_update_thumbnail_size_spin(tasklist);
+
+	if (tasklist->thumbnails != NULL)
+		g_hash_table_remove_all (tasklist->thumbnails);
+#ifdef HAVE_X11
+	g_clear_pointer (&tasklist->group_preview, group_preview_free);
+#endif
 }
 #endif
 
@@ -769,9 +1266,22 @@ static void applet_size_allocate(GtkWidget *widget, GtkAllocation *allocation, T
 		}
 	}
 
-	if (tasklist->needs_hints)
+	if (!tasklist->needs_hints)
+		return;
 #endif
-		mate_panel_applet_set_size_hints(MATE_PANEL_APPLET(tasklist->applet), size_hints, len, 0);
+
+	/* the tasklist is allocated on every change of the panel or of the
+	 * windows, while its hints only change with the number of buttons */
+	if (len == tasklist->n_size_hints &&
+	    (len == 0 || memcmp(size_hints, tasklist->size_hints, len * sizeof(int)) == 0))
+		return;
+
+	g_free(tasklist->size_hints);
+	tasklist->size_hints = g_new(int, len);
+	memcpy(tasklist->size_hints, size_hints, len * sizeof(int));
+	tasklist->n_size_hints = len;
+
+	mate_panel_applet_set_size_hints(MATE_PANEL_APPLET(tasklist->applet), size_hints, len, 0);
 }
 
 gboolean window_list_applet_fill(MatePanelApplet* applet)
@@ -848,6 +1358,15 @@ gboolean window_list_applet_fill(MatePanelApplet* applet)
 		g_signal_connect (tasklist->tasklist, "task-leave-notify",
 		                  G_CALLBACK (applet_leave_notify_event),
 		                  tasklist);
+
+		tasklist->thumbnails = g_hash_table_new_full (NULL, NULL, NULL,
+		                                              (GDestroyNotify) window_thumbnail_free);
+		g_queue_init (&tasklist->thumbnail_prefetch);
+		tasklist->windows_watch = wncklet_window_model_watch (wnck_screen_get_default (),
+		                                                      WNCKLET_WINDOW_CLOSED |
+		                                                      WNCKLET_WINDOW_GEOMETRY,
+		                                                      (WnckletWindowFunc) window_changed,
+		                                                      tasklist);
 #endif /* HAVE_WINDOW_PREVIEWS */
 	}
 	else
@@ -1217,12 +1736,24 @@ static void destroy_tasklist(GtkWidget* widget, TasklistData* tasklist)
 
 	g_object_unref(tasklist->settings);
 
+	g_free(tasklist->size_hints);
+
 	if (tasklist->properties_dialog)
 		gtk_widget_destroy(tasklist->properties_dialog);
 
 #ifdef HAVE_WINDOW_PREVIEWS
 	if (tasklist->preview)
 		gtk_widget_destroy(tasklist->preview);
+
+#ifdef HAVE_X11
+	if (tasklist->thumbnails)
+	{
+		wncklet_window_model_unwatch (tasklist->windows_watch);
+		thumbnail_prefetch_stop (tasklist);
+		group_preview_clear (tasklist);
+		g_hash_table_destroy (tasklist->thumbnails);
+	}
+#endif
 #endif
 
 	g_free(tasklist);
@@ -47,14 +47,26 @@
 
 #include "wncklet.h"
 #include "window-menu.h"
+#include "window-model.h"
 
 #define WINDOW_MENU_ICON "mate-panel-window-menu"
+#define WINDOW_MENU_TITLE_MAX_WIDTH 50
 
 typedef struct {
 	GtkWidget* applet;
 	GtkWidget* selector;
 	int size;
 	MatePanelAppletOrient orient;
+
+#ifdef HAVE_X11
+	/* the menu is only filled when shown, and kept until the windows
+	 * change: nothing is done for them meanwhile */
+	WnckScreen* screen;
+	GtkWidget* image;
+	GtkWidget* menu;
+	gboolean menu_valid;
+	guint windows_watch;
+#endif /* HAVE_X11 */
 } WindowMenu;
 
 static void window_menu_help(GtkAction* action, WindowMenu* window_menu)
@@ -119,9 +131,233 @@ static const GtkActionEntry window_menu_actions[] = {
 
 static void window_menu_destroy(GtkWidget* widget, WindowMenu* window_menu)
 {
+#ifdef HAVE_X11
+	wncklet_window_model_unwatch(window_menu->windows_watch);
+#endif /* HAVE_X11 */
+
 	g_free(window_menu);
 }
 
+#ifdef HAVE_X11
+static void window_menu_activate_window(GtkMenuItem* item, WindowMenu* window_menu)
+{
+	WnckWindow* window;
+	WnckWorkspace* workspace;
+	guint32 timestamp;
+
+	/* it may have been closed since the menu was filled */
+	window = wnck_window_get(GPOINTER_TO_SIZE(g_object_get_data(G_OBJECT(item), "xid")));
+	if (!window)
+		return;
+
+	timestamp = gtk_get_current_event_time();
+
+	workspace = wnck_window_get_workspace(window);
+	if (workspace && workspace != wnck_screen_get_active_workspace(window_menu->screen))
+		wnck_workspace_activate(workspace, timestamp);
+
+	wnck_window_activate(window, timestamp);
+}
+
+static void window_menu_append_window(WindowMenu* window_menu, const WnckletWindow* window)
+{
+	GtkWidget* item;
+	GtkWidget* box;
+	GtkWidget* image;
+	GtkWidget* label;
+	char* title;
+
+	if (window->state & WNCK_WINDOW_STATE_MINIMIZED)
+		title = g_strdup_printf("[%s]", window->title ? window->title : "");
+	else
+		title = g_strdup(window->title ? window->title : "");
+
+	label = gtk_label_new(title);
+	gtk_label_set_max_width_chars(GTK_LABEL(label), WINDOW_MENU_TITLE_MAX_WIDTH);
+	gtk_label_set_ellipsize(GTK_LABEL(label), PANGO_ELLIPSIZE_END);
+	gtk_label_set_xalign(GTK_LABEL(label), 0.0);
+	g_free(title);
+
+	image = gtk_image_new_from_pixbuf(wnck_window_get_mini_icon(window->window));
+
+	box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
+	gtk_box_pack_start(GTK_BOX(box), image, FALSE, FALSE, 0);
+	gtk_box_pack_start(GTK_BOX(box), label, TRUE, TRUE, 0);
+
+	item = gtk_menu_item_new();
+	gtk_container_add(GTK_CONTAINER(item), box);
+	g_object_set_data(G_OBJECT(item), "xid", GSIZE_TO_POINTER((gsize) window->xid));
+	g_signal_connect(item, "activate", G_CALLBACK(window_menu_activate_window), window_menu);
+
+	gtk_menu_shell_append(GTK_MENU_SHELL(window_menu->menu), item);
+}
+
+static void window_menu_append_header(WindowMenu* window_menu, const char* name)
+{
+	GtkWidget* item;
+	GtkWidget* label;
+	GList* children;
+	char* markup;
+
+	children = gtk_container_get_children(GTK_CONTAINER(window_menu->menu));
+	if (children != NULL)
+		gtk_menu_shell_append(GTK_MENU_SHELL(window_menu->menu), gtk_separator_menu_item_new());
+	g_list_free(children);
+
+	markup = g_markup_printf_escaped("<b>%s</b>", name);
+	label = gtk_label_new(NULL);
+	gtk_label_set_markup(GTK_LABEL(label), markup);
+	gtk_label_set_xalign(GTK_LABEL(label), 0.0);
+	g_free(markup);
+
+	item = gtk_menu_item_new();
+	gtk_container_add(GTK_CONTAINER(item), label);
+	gtk_widget_set_sensitive(item, FALSE);
+	gtk_menu_shell_append(GTK_MENU_SHELL(window_menu->menu), item);
+}
+
+/* The windows grouped by workspace, then the ones on all of them */
+static void window_menu_fill(WindowMenu* window_menu)
+{
+	GList** spaces;
+	GList* windows;
+	GList* l;
+	int n_spaces;
+	int i;
+
+	gtk_container_foreach(GTK_CONTAINER(window_menu->menu), (GtkCallback) gtk_widget_destroy, NULL);
+
+	n_spaces = wnck_screen_get_workspace_count(window_menu->screen);
+	spaces = g_new0(GList*, n_spaces + 1);
+
+	windows = wncklet_window_model_get_windows(window_menu->screen);
+	for (l = windows; l != NULL; l = l->next)
+	{
+		const WnckletWindow* window = l->data;
+
+		if (window->state & WNCK_WINDOW_STATE_SKIP_TASKLIST)
+			continue;
+
+		i = window->workspace >= 0 && window->workspace < n_spaces ? window->workspace : n_spaces;
+		spaces[i] = g_list_prepend(spaces[i], l->data);
+	}
+
+	for (i = 0; i <= n_spaces; i++)
+	{
+		if (spaces[i] == NULL)
+			continue;
+
+		if (i == n_spaces)
+			window_menu_append_header(window_menu, _("All Workspaces"));
+		else if (n_spaces > 1)
+			window_menu_append_header(window_menu, wnck_workspace_get_name(wnck_screen_get_workspace(window_menu->screen, i)));
+
+		spaces[i] = g_list_reverse(spaces[i]);
+		for (l = spaces[i]; l != NULL; l = l->next)
+			window_menu_append_window(window_menu, l->data);
+
+		g_list_free(spaces[i]);
+	}
+
+	if (windows == NULL)
+	{
+		GtkWidget* item;
+
+		item = gtk_menu_item_new_with_label(_("No Windows Open"));
+		gtk_widget_set_sensitive(item, FALSE);
+		gtk_menu_shell_append(GTK_MENU_SHELL(window_menu->menu), item);
+	}
+
+	g_list_free(windows);
+	g_free(spaces);
+
+	gtk_widget_show_all(window_menu->menu);
+	window_menu->menu_valid = TRUE;
+}
+
+static void window_menu_show(GtkWidget* menu, WindowMenu* window_menu)
+{
+	if (!window_menu->menu_valid)
+		window_menu_fill(window_menu);
+}
+
+static void window_menu_update_icon(WindowMenu* window_menu)
+{
+	WnckWindow* active;
+
+	active = wnck_screen_get_active_window(window_menu->screen);
+
+	if (active && !wnck_window_is_skip_tasklist(active))
+		gtk_image_set_from_pixbuf(GTK_IMAGE(window_menu->image), wnck_window_get_mini_icon(active));
+	else
+		gtk_image_set_from_icon_name(GTK_IMAGE(window_menu->image), WINDOW_MENU_ICON, GTK_ICON_SIZE_MENU);
+}
+
+static void window_menu_window_changed(const WnckletWindow* window, WnckletWindowFields changed, WindowMenu* window_menu)
+{
+	if (changed & ~WNCKLET_WINDOW_ACTIVE)
+		window_menu->menu_valid = FALSE;
+
+	if ((changed & WNCKLET_WINDOW_ACTIVE) || (window->active && (changed & WNCKLET_WINDOW_ICON)))
+		window_menu_update_icon(window_menu);
+}
+
+static void window_menu_workspace_renamed(WnckWorkspace* space, WindowMenu* window_menu)
+{
+	window_menu->menu_valid = FALSE;
+}
+
+static void window_menu_workspace_created(WnckScreen* screen, WnckWorkspace* space, WindowMenu* window_menu)
+{
+	wncklet_connect_while_alive(space, "name-changed", G_CALLBACK(window_menu_workspace_renamed), window_menu, window_menu->applet);
+	window_menu->menu_valid = FALSE;
+}
+
+static void window_menu_workspace_destroyed(WnckScreen* screen, WnckWorkspace* space, WindowMenu* window_menu)
+{
+	window_menu->menu_valid = FALSE;
+}
+
+static GtkWidget* window_menu_selector_new(WindowMenu* window_menu)
+{
+	GtkWidget* selector;
+	GtkWidget* item;
+	GList* l;
+
+	window_menu->screen = wnck_screen_get_default();
+
+	selector = gtk_menu_bar_new();
+	item = gtk_menu_item_new();
+	window_menu->image = gtk_image_new();
+	gtk_container_add(GTK_CONTAINER(item), window_menu->image);
+	gtk_menu_shell_append(GTK_MENU_SHELL(selector), item);
+
+	window_menu->menu = gtk_menu_new();
+	gtk_menu_item_set_submenu(GTK_MENU_ITEM(item), window_menu->menu);
+	g_signal_connect(window_menu->menu, "show", G_CALLBACK(window_menu_show), window_menu);
+
+	window_menu->windows_watch = wncklet_window_model_watch(window_menu->screen,
+	                                                        WNCKLET_WINDOW_OPENED |
+	                                                        WNCKLET_WINDOW_CLOSED |
+	                                                        WNCKLET_WINDOW_TITLE |
+	                                                        WNCKLET_WINDOW_ICON |
+	                                                        WNCKLET_WINDOW_WORKSPACE |
+	                                                        WNCKLET_WINDOW_STATE |
+	                                                        WNCKLET_WINDOW_ACTIVE,
+	                                                        (WnckletWindowFunc) window_menu_window_changed,
+	                                                        window_menu);
+
+	for (l = wnck_screen_get_workspaces(window_menu->screen); l != NULL; l = l->next)
+		wncklet_connect_while_alive(l->data, "name-changed", G_CALLBACK(window_menu_workspace_renamed), window_menu, window_menu->applet);
+	wncklet_connect_while_alive(window_menu->screen, "workspace-created", G_CALLBACK(window_menu_workspace_created), window_menu, window_menu->applet);
+	wncklet_connect_while_alive(window_menu->screen, "workspace-destroyed", G_CALLBACK(window_menu_workspace_destroyed), window_menu, window_menu->applet);
+
+	window_menu_update_icon(window_menu);
+
+	return selector;
+}
+#endif /* HAVE_X11 */
+
 static gboolean window_menu_on_draw (GtkWidget* widget,
 				     cairo_t*   cr,
 				     gpointer   data)
@@ -252,7 +488,7 @@ gboolean window_menu_applet_fill(MatePanelApplet* applet)
 #ifdef HAVE_X11
 	if (GDK_IS_X11_DISPLAY (gdk_display_get_default ()))
 	{
-		window_menu->selector = wnck_selector_new();
+		window_menu->selector = window_menu_selector_new(window_menu);
 	}
 	else
 #endif /* HAVE_X11 */
@@ -0,0 +1,417 @@
+/* window-model.c: windows as seen by all the window navigation applets
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * All the applets of a process share one view of the windows of each
+ * screen: it is the only one to listen to the windows of libwnck, keeps a
+ * small record per window, and tells each applet about the fields it cares
+ * for. Changes are collected and handed out once per main loop iteration,
+ * before GTK draws, however many signals libwnck sent meanwhile.
+ *
+ * Everything here has to be used from the main thread.
+ */
+
+#ifdef HAVE_CONFIG_H
+	#include <config.h>
+#endif
+
+#include <glib.h>
+
+#ifdef HAVE_X11
+#define WNCK_I_KNOW_THIS_IS_UNSTABLE
+#include <libwnck/libwnck.h>
+#endif /* HAVE_X11 */
+
+#include "window-model.h"
+
+#ifdef HAVE_X11
+
+typedef struct {
+	WnckScreen    *screen;
+	GHashTable    *windows;		/* WnckWindow -> WindowRecord */
+	GQueue         pending;		/* WindowRecord */
+	GSList        *watches;		/* watch ids */
+	guint          dispatch_id;
+	WnckWindow    *active;
+} WindowModel;
+
+typedef struct {
+	WnckletWindow        window;
+	WindowModel         *model;
+	WnckletWindowFields  changed;
+	gboolean             queued;
+} WindowRecord;
+
+typedef struct {
+	WindowModel         *model;
+	WnckletWindowFields  fields;
+	WnckletWindowFunc    func;
+	gpointer             user_data;
+} WindowModelWatch;
+
+static GHashTable *window_models = NULL;
+static GHashTable *window_model_watches = NULL;
+static guint       window_model_next_watch_id = 1;
+
+static int
+window_record_get_workspace (WnckWindow *window)
+{
+	WnckWorkspace *workspace;
+
+	if (wnck_window_is_pinned (window))
+		return -1;
+
+	workspace = wnck_window_get_workspace (window);
+
+	return workspace ? wnck_workspace_get_number (workspace) : -1;
+}
+
+static void
+window_record_free (WindowRecord *record)
+{
+	g_free (record->window.title);
+	g_slice_free (WindowRecord, record);
+}
+
+static gboolean
+window_model_dispatch (gpointer user_data)
+{
+	WindowModel  *model = user_data;
+	WindowRecord *record;
+
+	model->dispatch_id = 0;
+
+	while ((record = g_queue_pop_head (&model->pending)) != NULL)
+	{
+		WnckletWindowFields changed;
+		GSList *ids;
+		GSList *l;
+
+		changed = record->changed;
+		record->changed = 0;
+		record->queued = FALSE;
+
+		/* the watches can go away while we notify */
+		ids = g_slist_copy (model->watches);
+
+		for (l = ids; l; l = l->next)
+		{
+			WindowModelWatch *watch;
+
+			watch = g_hash_table_lookup (window_model_watches, l->data);
+			if (watch && (watch->fields & changed))
+				watch->func (&record->window,
+				             watch->fields & changed,
+				             watch->user_data);
+		}
+
+		g_slist_free (ids);
+
+		record->window.last_workspace = record->window.workspace;
+
+		if (changed & WNCKLET_WINDOW_CLOSED)
+			window_record_free (record);
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+window_record_changed (WindowRecord        *record,
+                       WnckletWindowFields  fields)
+{
+	WindowModel *model = record->model;
+
+	record->changed |= fields;
+
+	if (!record->queued)
+	{
+		g_queue_push_tail (&model->pending, record);
+		record->queued = TRUE;
+	}
+
+	/* before GTK lays out and draws */
+	if (model->dispatch_id == 0)
+		model->dispatch_id = g_idle_add_full (G_PRIORITY_HIGH_IDLE,
+		                                      window_model_dispatch,
+		                                      model, NULL);
+}
+
+static void
+window_name_changed (WnckWindow   *window,
+                     WindowRecord *record)
+{
+	g_free (record->window.title);
+	record->window.title = g_strdup (wnck_window_get_name (window));
+
+	window_record_changed (record, WNCKLET_WINDOW_TITLE);
+}
+
+static void
+window_icon_changed (WnckWindow   *window,
+                     WindowRecord *record)
+{
+	record->window.icon_gen++;
+
+	window_record_changed (record, WNCKLET_WINDOW_ICON);
+}
+
+static void
+window_workspace_changed (WnckWindow   *window,
+                          WindowRecord *record)
+{
+	int workspace;
+
+	workspace = window_record_get_workspace (window);
+	if (workspace == record->window.workspace)
+		return;
+
+	record->window.workspace = workspace;
+
+	window_record_changed (record, WNCKLET_WINDOW_WORKSPACE);
+}
+
+static void
+window_state_changed (WnckWindow      *window,
+                      WnckWindowState  changed_mask,
+                      WnckWindowState  new_state,
+                      WindowRecord    *record)
+{
+	record->window.state = new_state;
+
+	window_record_changed (record, WNCKLET_WINDOW_STATE);
+
+	/* sticking a window may move it to all the workspaces */
+	window_workspace_changed (window, record);
+}
+
+static void
+window_geometry_changed (WnckWindow   *window,
+                         WindowRecord *record)
+{
+	window_record_changed (record, WNCKLET_WINDOW_GEOMETRY);
+}
+
+static WindowRecord *
+window_model_add_window (WindowModel *model,
+                         WnckWindow  *window)
+{
+	WindowRecord *record;
+
+	record = g_slice_new0 (WindowRecord);
+	record->model = model;
+	record->window.window = window;
+	record->window.xid = wnck_window_get_xid (window);
+	record->window.title = g_strdup (wnck_window_get_name (window));
+	record->window.workspace = window_record_get_workspace (window);
+	record->window.last_workspace = record->window.workspace;
+	record->window.state = wnck_window_get_state (window);
+	record->window.active = window == model->active;
+
+	g_hash_table_insert (model->windows, window, record);
+
+	g_signal_connect (window, "name-changed",
+	                  G_CALLBACK (window_name_changed), record);
+	g_signal_connect (window, "icon-changed",
+	                  G_CALLBACK (window_icon_changed), record);
+	g_signal_connect (window, "workspace-changed",
+	                  G_CALLBACK (window_workspace_changed), record);
+	g_signal_connect (window, "state-changed",
+	                  G_CALLBACK (window_state_changed), record);
+	g_signal_connect (window, "geometry-changed",
+	                  G_CALLBACK (window_geometry_changed), record);
+
+	return record;
+}
+
+static void
+window_opened (WnckScreen  *screen,
+               WnckWindow  *window,
+               WindowModel *model)
+{
+	WindowRecord *record;
+
+	record = window_model_add_window (model, window);
+
+	window_record_changed (record, WNCKLET_WINDOW_OPENED);
+}
+
+static void
+window_closed (WnckScreen  *screen,
+               WnckWindow  *window,
+               WindowModel *model)
+{
+	WindowRecord *record;
+
+	record = g_hash_table_lookup (model->windows, window);
+	if (!record)
+		return;
+
+	g_signal_handlers_disconnect_by_data (window, record);
+	g_hash_table_remove (model->windows, window);
+
+	if (model->active == window)
+		model->active = NULL;
+
+	/* the record is freed once the watches were told */
+	record->window.window = NULL;
+	window_record_changed (record, WNCKLET_WINDOW_CLOSED);
+}
+
+static void
+active_window_changed (WnckScreen  *screen,
+                       WnckWindow  *previous,
+                       WindowModel *model)
+{
+	WindowRecord *record;
+
+	if (model->active)
+	{
+		record = g_hash_table_lookup (model->windows, model->active);
+		if (record)
+		{
+			record->window.active = FALSE;
+			window_record_changed (record, WNCKLET_WINDOW_ACTIVE);
+		}
+	}
+
+	model->active = wnck_screen_get_active_window (screen);
+
+	if (model->active)
+	{
+		record = g_hash_table_lookup (model->windows, model->active);
+		if (record)
+		{
+			record->window.active = TRUE;
+			window_record_changed (record, WNCKLET_WINDOW_ACTIVE);
+		}
+	}
+}
+
+/* Models are never freed: like the WnckScreen, they are kept for the
+ * lifetime of the process */
+static WindowModel *
+window_model_get (WnckScreen *screen)
+{
+	WindowModel *model;
+	GList       *l;
+
+	if (!window_models)
+		window_models = g_hash_table_new (NULL, NULL);
+
+	model = g_hash_table_lookup (window_models, screen);
+	if (model)
+		return model;
+
+	model = g_new0 (WindowModel, 1);
+	model->screen = screen;
+	model->windows = g_hash_table_new (NULL, NULL);
+	g_queue_init (&model->pending);
+	model->active = wnck_screen_get_active_window (screen);
+
+	for (l = wnck_screen_get_windows (screen); l; l = l->next)
+		window_model_add_window (model, l->data);
+
+	g_signal_connect (screen, "window-opened",
+	                  G_CALLBACK (window_opened), model);
+	g_signal_connect (screen, "window-closed",
+	                  G_CALLBACK (window_closed), model);
+	g_signal_connect (screen, "active-window-changed",
+	                  G_CALLBACK (active_window_changed), model);
+
+	g_hash_table_insert (window_models, screen, model);
+
+	return model;
+}
+
+guint
+wncklet_window_model_watch (WnckScreen          *screen,
+                            WnckletWindowFields  fields,
+                            WnckletWindowFunc    func,
+                            gpointer             user_data)
+{
+	WindowModelWatch *watch;
+	guint             watch_id;
+
+	g_return_val_if_fail (WNCK_IS_SCREEN (screen), 0);
+	g_return_val_if_fail (func != NULL, 0);
+
+	if (!window_model_watches)
+		window_model_watches = g_hash_table_new_full (NULL, NULL,
+		                                              NULL, g_free);
+
+	watch = g_new0 (WindowModelWatch, 1);
+	watch->model = window_model_get (screen);
+	watch->fields = fields;
+	watch->func = func;
+	watch->user_data = user_data;
+
+	watch_id = window_model_next_watch_id++;
+	g_hash_table_insert (window_model_watches,
+	                     GUINT_TO_POINTER (watch_id), watch);
+	watch->model->watches = g_slist_prepend (watch->model->watches,
+	                                         GUINT_TO_POINTER (watch_id));
+
+	return watch_id;
+}
+
+void
+wncklet_window_model_unwatch (guint watch_id)
+{
+	WindowModelWatch *watch;
+
+	if (watch_id == 0 || !window_model_watches)
+		return;
+
+	watch = g_hash_table_lookup (window_model_watches,
+	                             GUINT_TO_POINTER (watch_id));
+	if (!watch)
+		return;
+
+	watch->model->watches = g_slist_remove (watch->model->watches,
+	                                        GUINT_TO_POINTER (watch_id));
+	g_hash_table_remove (window_model_watches,
+	                     GUINT_TO_POINTER (watch_id));
+}
+
+GList *
+wncklet_window_model_get_windows (WnckScreen *screen)
+{
+	WindowModel *model;
+	GList       *windows = NULL;
+	GList       *l;
+
+	g_return_val_if_fail (WNCK_IS_SCREEN (screen), NULL);
+
+	model = window_model_get (screen);
+
+	for (l = wnck_screen_get_windows (screen); l; l = l->next)
+	{
+		WindowRecord *record;
+
+		record = g_hash_table_lookup (model->windows, l->data);
+		if (record)
+			windows = g_list_prepend (windows, &record->window);
+	}
+
+	return g_list_reverse (windows);
+}
+
+#endif /* HAVE_X11 */
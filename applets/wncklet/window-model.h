@@ -0,0 +1,80 @@
+/* window-model.h: windows as seen by all the window navigation applets
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __WINDOW_MODEL_H__
+#define __WINDOW_MODEL_H__
+
+#include <glib.h>
+
+#include "wncklet.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _WnckWindow WnckWindow;
+
+typedef enum {
+	WNCKLET_WINDOW_OPENED    = 1 << 0,
+	WNCKLET_WINDOW_CLOSED    = 1 << 1,
+	WNCKLET_WINDOW_TITLE     = 1 << 2,
+	WNCKLET_WINDOW_ICON      = 1 << 3,
+	WNCKLET_WINDOW_WORKSPACE = 1 << 4,
+	WNCKLET_WINDOW_STATE     = 1 << 5,
+	WNCKLET_WINDOW_GEOMETRY  = 1 << 6,
+	WNCKLET_WINDOW_ACTIVE    = 1 << 7
+} WnckletWindowFields;
+
+typedef struct {
+	/* NULL once closed */
+	WnckWindow *window;
+	gulong      xid;
+
+	char       *title;
+	/* bumped each time the icon changes */
+	guint       icon_gen;
+	/* -1 when on all the workspaces, or none */
+	int         workspace;
+	/* what workspace was when last notified */
+	int         last_workspace;
+	guint       state;		/* WnckWindowState */
+	guint       active : 1;
+} WnckletWindow;
+
+/* Called once per window and main loop iteration, with all the fields
+ * watched that changed meanwhile */
+typedef void (*WnckletWindowFunc) (const WnckletWindow *window,
+                                   WnckletWindowFields  changed,
+                                   gpointer             user_data);
+
+guint wncklet_window_model_watch   (WnckScreen          *screen,
+                                    WnckletWindowFields  fields,
+                                    WnckletWindowFunc    func,
+                                    gpointer             user_data);
+void  wncklet_window_model_unwatch (guint                watch_id);
+
+/* The windows of screen, in stacking order; free the list only */
+GList *wncklet_window_model_get_windows (WnckScreen *screen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
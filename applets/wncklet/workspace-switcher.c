@@ -38,6 +38,7 @@
 #include "workspace-switcher.h"
 
 #include "wncklet.h"
+#include "window-model.h"
 
 /* even 16 is pretty darn dubious. */
 #define MAX_REASONABLE_ROWS 16
@@ -53,9 +54,31 @@
 
 #define WORKSPACE_SWITCHER_ICON "mate-panel-workspace-switcher"
 
+/* smooth scrolling: the deltas making a step, the minimum time between
+ * two steps and between two switches, and the pause ending a gesture */
+#define PAGER_SCROLL_THRESHOLD 1.0
+#define PAGER_SCROLL_STEP_INTERVAL (150 * 1000) /* us */
+#define PAGER_SCROLL_SWITCH_INTERVAL (50 * 1000) /* us */
+#define PAGER_SCROLL_GESTURE_GAP 300 /* ms */
+
 /* Container for the WnckPager to work around the sizing issues we have in the
  * panel.  See
- * https://github.com/mate-desktop/mate-panel/issues/1230#issuecomment-1046235088 */
+ * https://github.com/mate-desktop/mate-panel/issues/1230#issuecomment-1046235088
+ *
+ * It also keeps what the pager last drew: the pager repaints all the
+ * workspaces whenever any window moves, so the container follows the
+ * windows in the shared window model and only lets the pager draw again the cells of the
+ * workspaces that actually changed. The damage piles up until GTK draws the
+ * next frame. While the pointer is over the pager, the pager draws directly
+ * as it highlights what is under it.
+ *
+ * The size the pager asks for only depends on the panel size, the layout and
+ * the workspaces, so it is kept until one of them changes; and a change of
+ * panel size is followed by at most one more layout, on the next frame. */
+
+/* Slack around a workspace cell, the pager may not split its allocation
+ * exactly as we do */
+#define PAGER_CONTAINER_DAMAGE_MARGIN 3
 
 typedef struct _PagerContainer PagerContainer;
 typedef GtkBinClass PagerContainerClass;
@@ -67,20 +90,105 @@ static GType pager_container_get_type (void);
 
 struct _PagerContainer
 {
-	GtkBin          parent;
-	GtkOrientation  orientation;
-	int             size;
+	GtkBin           parent;
+	GtkOrientation   orientation;
+	int              size;
+	guint            resize_tick_id;
+
+	/* what the pager asked for self->size */
+	gboolean         request_valid;
+	int              request_size;
+	int              request_spaces;
+	int              request_minimum;
+	int              request_natural;
+
+	int              n_rows;
+	gboolean         show_all;
+
+	cairo_surface_t *cache;
+	cairo_region_t  *damage;
+	gboolean         pointer_inside;
+
+#ifdef HAVE_X11
+	WnckScreen      *screen;
+	guint            windows_watch;
+#endif /* HAVE_X11 */
 };
 
 G_DEFINE_TYPE (PagerContainer, pager_container, GTK_TYPE_BIN)
 
 static gboolean
-queue_resize_idle_cb (gpointer user_data)
+queue_resize_tick_cb (GtkWidget     *widget,
+                      GdkFrameClock *frame_clock,
+                      gpointer       user_data)
 {
-	gtk_widget_queue_resize (GTK_WIDGET (user_data));
+	PagerContainer *self = PAGER_CONTAINER (widget);
+
+	self->resize_tick_id = 0;
+	gtk_widget_queue_resize (widget);
+
 	return G_SOURCE_REMOVE;
 }
 
+/* Lays out again on the next frame, once however many times it is asked */
+static void
+pager_container_queue_resize_on_tick (PagerContainer *self)
+{
+	if (self->resize_tick_id != 0)
+		return;
+
+	self->resize_tick_id = gtk_widget_add_tick_callback (GTK_WIDGET (self),
+	                                                     queue_resize_tick_cb,
+	                                                     NULL, NULL);
+}
+
+static int
+pager_container_get_n_spaces (PagerContainer *self)
+{
+#ifdef HAVE_X11
+	if (self->screen)
+		return wnck_screen_get_workspace_count (self->screen);
+#endif /* HAVE_X11 */
+
+	return 0;
+}
+
+/* The pager's request along the panel, for the panel size */
+static void
+pager_container_get_child_request (PagerContainer *self,
+                                   int            *minimum,
+                                   int            *natural)
+{
+	GtkWidget *child;
+	int n_spaces;
+
+	child = gtk_bin_get_child (GTK_BIN (self));
+	n_spaces = pager_container_get_n_spaces (self);
+
+	if (!self->request_valid ||
+	    self->request_size != self->size ||
+	    self->request_spaces != n_spaces)
+	{
+		if (self->orientation == GTK_ORIENTATION_VERTICAL)
+			gtk_widget_get_preferred_height_for_width (child,
+			                                           self->size,
+			                                           &self->request_minimum,
+			                                           &self->request_natural);
+		else
+			gtk_widget_get_preferred_width_for_height (child,
+			                                           self->size,
+			                                           &self->request_minimum,
+			                                           &self->request_natural);
+
+		self->request_valid = TRUE;
+		self->request_size = self->size;
+		self->request_spaces = n_spaces;
+	}
+
+	*minimum = self->request_minimum;
+	*natural = self->request_natural;
+}
+
 static void
 pager_container_get_preferred_width (GtkWidget *widget,
                                      int       *minimum_width,
@@ -98,10 +206,7 @@ pager_container_get_preferred_width (GtkWidget *widget,
 	else
 	{
 		/* self->size is panel size/height, that will get allocated to pager, request width for this size */
-		gtk_widget_get_preferred_width_for_height (gtk_bin_get_child (GTK_BIN (self)),
-		                                           self->size,
-		                                           minimum_width,
-		                                           natural_width);
+		pager_container_get_child_request (self, minimum_width, natural_width);
 	}
 }
 
@@ -117,10 +222,7 @@ pager_container_get_preferred_height (GtkWidget *widget,
 	if (self->orientation == GTK_ORIENTATION_VERTICAL)
 	{
 		/* self->size is panel size/width that will get allocated to pager, request height for this size */
-		gtk_widget_get_preferred_height_for_width (gtk_bin_get_child (GTK_BIN (self)),
-		                                           self->size,
-		                                           minimum_height,
-		                                           natural_height);
+		pager_container_get_child_request (self, minimum_height, natural_height);
 	}
 	else
 	{
@@ -148,29 +250,378 @@ pager_container_size_allocate (GtkWidget     *widget,
 	if (self->size != size)
 	{
 		self->size = size;
-		g_idle_add (queue_resize_idle_cb, self);
+		pager_container_queue_resize_on_tick (self);
 		return;
 	}
 
+	/* whatever was cached is drawn at another size */
+	g_clear_pointer (&self->cache, cairo_surface_destroy);
+
 	GTK_WIDGET_CLASS (pager_container_parent_class)->size_allocate (widget,
 	                                                                allocation);
 }
 
+static void
+pager_container_invalidate (PagerContainer *self)
+{
+	g_clear_pointer (&self->cache, cairo_surface_destroy);
+	gtk_widget_queue_draw (GTK_WIDGET (self));
+}
+
+/* The pager will ask for another size */
+static void
+pager_container_layout_changed (PagerContainer *self)
+{
+	self->request_valid = FALSE;
+	gtk_widget_queue_resize (GTK_WIDGET (self));
+	pager_container_invalidate (self);
+}
+
+#ifdef HAVE_X11
+/* Damages the cell of a workspace, or all of them for -1 */
+static void
+pager_container_damage_workspace (PagerContainer *self,
+                                  int             space)
+{
+	GtkWidget *widget = GTK_WIDGET (self);
+	WnckWorkspace *active;
+	cairo_rectangle_int_t rect;
+	int n_spaces;
+	int spaces_per_row;
+	int n_rows;
+	int width, height;
+	int col, row;
+	int n_cols;
+
+	if (!self->cache)
+		return;
+
+	n_spaces = wnck_screen_get_workspace_count (self->screen);
+	active = wnck_screen_get_active_workspace (self->screen);
+
+	width = gtk_widget_get_allocated_width (widget);
+	height = gtk_widget_get_allocated_height (widget);
+
+	if (space < 0 || space >= n_spaces || n_spaces == 1)
+	{
+		rect.x = rect.y = 0;
+		rect.width = width;
+		rect.height = height;
+	}
+	else if (!self->show_all)
+	{
+		/* only the active workspace is shown */
+		if (!active || wnck_workspace_get_number (active) != space)
+			return;
+
+		rect.x = rect.y = 0;
+		rect.width = width;
+		rect.height = height;
+	}
+	else
+	{
+		n_rows = CLAMP (self->n_rows, 1, n_spaces);
+		spaces_per_row = (n_spaces + n_rows - 1) / n_rows;
+
+		/* same layout as the pager: n_rows is the number of columns of
+		 * a vertical pager, filled one after the other */
+		if (self->orientation == GTK_ORIENTATION_VERTICAL)
+		{
+			n_cols = n_rows;
+			n_rows = spaces_per_row;
+			col = space / spaces_per_row;
+			row = space % spaces_per_row;
+		}
+		else
+		{
+			n_cols = spaces_per_row;
+			col = space % spaces_per_row;
+			row = space / spaces_per_row;
+		}
+
+		rect.x = col * width / n_cols - PAGER_CONTAINER_DAMAGE_MARGIN;
+		rect.y = row * height / n_rows - PAGER_CONTAINER_DAMAGE_MARGIN;
+		rect.width = width / n_cols + 2 * PAGER_CONTAINER_DAMAGE_MARGIN;
+		rect.height = height / n_rows + 2 * PAGER_CONTAINER_DAMAGE_MARGIN;
+	}
+
+	cairo_region_union_rectangle (self->damage, &rect);
+	gtk_widget_queue_draw_area (widget, rect.x, rect.y, rect.width, rect.height);
+}
+
+static void
+pager_container_window_changed (const WnckletWindow *window,
+                                WnckletWindowFields  changed,
+                                PagerContainer      *self)
+{
+	pager_container_damage_workspace (self, window->workspace);
+
+	if (window->last_workspace != window->workspace)
+		pager_container_damage_workspace (self, window->last_workspace);
+}
+
+static void
+pager_container_screen_changed (WnckScreen     *screen,
+                                PagerContainer *self)
+{
+	pager_container_invalidate (self);
+}
+
+static void
+pager_container_workspace_created (WnckScreen     *screen,
+                                   WnckWorkspace  *space,
+                                   PagerContainer *self)
+{
+	g_signal_connect_object (space, "name-changed",
+	                         G_CALLBACK (pager_container_layout_changed),
+	                         self, G_CONNECT_SWAPPED);
+	pager_container_layout_changed (self);
+}
+
+static void
+pager_container_unset_screen (PagerContainer *self)
+{
+	GList *l;
+
+	if (!self->screen)
+		return;
+
+	wncklet_window_model_unwatch (self->windows_watch);
+	self->windows_watch = 0;
+
+	for (l = wnck_screen_get_workspaces (self->screen); l; l = l->next)
+		g_signal_handlers_disconnect_by_data (l->data, self);
+
+	g_signal_handlers_disconnect_by_data (self->screen, self);
+	self->screen = NULL;
+}
+
+static void
+pager_container_set_screen (PagerContainer *self,
+                            WnckScreen     *screen)
+{
+	GList *l;
+
+	if (self->screen == screen)
+		return;
+
+	pager_container_unset_screen (self);
+	pager_container_invalidate (self);
+
+	if (!screen)
+		return;
+
+	self->screen = screen;
+
+	self->windows_watch = wncklet_window_model_watch (screen,
+	                                                  WNCKLET_WINDOW_OPENED |
+	                                                  WNCKLET_WINDOW_CLOSED |
+	                                                  WNCKLET_WINDOW_ICON |
+	                                                  WNCKLET_WINDOW_WORKSPACE |
+	                                                  WNCKLET_WINDOW_STATE |
+	                                                  WNCKLET_WINDOW_GEOMETRY |
+	                                                  WNCKLET_WINDOW_ACTIVE,
+	                                                  (WnckletWindowFunc) pager_container_window_changed,
+	                                                  self);
+
+	for (l = wnck_screen_get_workspaces (screen); l; l = l->next)
+		g_signal_connect_object (l->data, "name-changed",
+		                         G_CALLBACK (pager_container_layout_changed),
+		                         self, G_CONNECT_SWAPPED);
+
+	g_signal_connect_object (screen, "workspace-created",
+	                         G_CALLBACK (pager_container_workspace_created),
+	                         self, 0);
+
+	/* these can change any cell */
+	g_signal_connect_object (screen, "window-stacking-changed",
+	                         G_CALLBACK (pager_container_screen_changed),
+	                         self, 0);
+	g_signal_connect_object (screen, "active-workspace-changed",
+	                         G_CALLBACK (pager_container_invalidate),
+	                         self, G_CONNECT_SWAPPED);
+	g_signal_connect_object (screen, "workspace-destroyed",
+	                         G_CALLBACK (pager_container_layout_changed),
+	                         self, G_CONNECT_SWAPPED);
+	g_signal_connect_object (screen, "viewports-changed",
+	                         G_CALLBACK (pager_container_screen_changed),
+	                         self, 0);
+	g_signal_connect_object (screen, "background-changed",
+	                         G_CALLBACK (pager_container_screen_changed),
+	                         self, 0);
+}
+#endif /* HAVE_X11 */
+
+static gboolean
+pager_container_draw (GtkWidget *widget,
+                      cairo_t   *cr)
+{
+	PagerContainer *self;
+	GtkWidget *child;
+	cairo_t *cache_cr;
+
+	self = PAGER_CONTAINER (widget);
+	child = gtk_bin_get_child (GTK_BIN (self));
+
+#ifdef HAVE_X11
+	if (!self->screen || self->pointer_inside || !child)
+#endif /* HAVE_X11 */
+		return GTK_WIDGET_CLASS (pager_container_parent_class)->draw (widget, cr);
+
+	if (!self->cache)
+	{
+		cairo_rectangle_int_t rect;
+
+		self->cache = gdk_window_create_similar_surface (gtk_widget_get_window (widget),
+		                                                 CAIRO_CONTENT_COLOR_ALPHA,
+		                                                 gtk_widget_get_allocated_width (widget),
+		                                                 gtk_widget_get_allocated_height (widget));
+
+		rect.x = rect.y = 0;
+		rect.width = gtk_widget_get_allocated_width (widget);
+		rect.height = gtk_widget_get_allocated_height (widget);
+		cairo_region_destroy (self->damage);
+		self->damage = cairo_region_create_rectangle (&rect);
+	}
+
+	if (!cairo_region_is_empty (self->damage))
+	{
+		cache_cr = cairo_create (self->cache);
+		gdk_cairo_region (cache_cr, self->damage);
+		cairo_clip (cache_cr);
+
+		cairo_set_operator (cache_cr, CAIRO_OPERATOR_CLEAR);
+		cairo_paint (cache_cr);
+		cairo_set_operator (cache_cr, CAIRO_OPERATOR_OVER);
+
+		gtk_container_propagate_draw (GTK_CONTAINER (self), child, cache_cr);
+		cairo_destroy (cache_cr);
+
+		cairo_region_destroy (self->damage);
+		self->damage = cairo_region_create ();
+	}
+
+	cairo_set_source_surface (cr, self->cache, 0, 0);
+	cairo_paint (cr);
+
+	return FALSE;
+}
+
+static gboolean
+pager_container_child_crossing (GtkWidget        *child,
+                                GdkEventCrossing *event,
+                                PagerContainer   *self)
+{
+	if (event->detail == GDK_NOTIFY_INFERIOR)
+		return FALSE;
+
+	self->pointer_inside = event->type == GDK_ENTER_NOTIFY;
+
+	/* the pager drew over the cache meanwhile */
+	if (!self->pointer_inside)
+		pager_container_invalidate (self);
+
+	return FALSE;
+}
+
+static gboolean
+pager_container_child_drag_motion (GtkWidget      *child,
+                                   GdkDragContext *context,
+                                   int             x,
+                                   int             y,
+                                   guint           time,
+                                   PagerContainer *self)
+{
+	self->pointer_inside = TRUE;
+
+	return FALSE;
+}
+
+static void
+pager_container_child_drag_leave (GtkWidget      *child,
+                                  GdkDragContext *context,
+                                  guint           time,
+                                  PagerContainer *self)
+{
+	self->pointer_inside = FALSE;
+	pager_container_invalidate (self);
+}
+
+static void
+pager_container_add (GtkContainer *container,
+                     GtkWidget    *child)
+{
+	PagerContainer *self = PAGER_CONTAINER (container);
+
+	GTK_CONTAINER_CLASS (pager_container_parent_class)->add (container, child);
+
+	g_signal_connect_object (child, "enter-notify-event",
+	                         G_CALLBACK (pager_container_child_crossing),
+	                         self, 0);
+	g_signal_connect_object (child, "leave-notify-event",
+	                         G_CALLBACK (pager_container_child_crossing),
+	                         self, 0);
+	g_signal_connect_object (child, "drag-motion",
+	                         G_CALLBACK (pager_container_child_drag_motion),
+	                         self, 0);
+	g_signal_connect_object (child, "drag-leave",
+	                         G_CALLBACK (pager_container_child_drag_leave),
+	                         self, 0);
+	g_signal_connect_object (child, "style-updated",
+	                         G_CALLBACK (pager_container_layout_changed),
+	                         self, G_CONNECT_SWAPPED);
+}
+
+static void
+pager_container_unrealize (GtkWidget *widget)
+{
+	g_clear_pointer (&PAGER_CONTAINER (widget)->cache, cairo_surface_destroy);
+
+	GTK_WIDGET_CLASS (pager_container_parent_class)->unrealize (widget);
+}
+
+static void
+pager_container_dispose (GObject *object)
+{
+	PagerContainer *self = PAGER_CONTAINER (object);
+
+#ifdef HAVE_X11
+	pager_container_unset_screen (self);
+#endif /* HAVE_X11 */
+	g_clear_pointer (&self->cache, cairo_surface_destroy);
+	g_clear_pointer (&self->damage, cairo_region_destroy);
+
+	G_OBJECT_CLASS (pager_container_parent_class)->dispose (object);
+}
+
 static void
 pager_container_class_init (PagerContainerClass *self_class)
 {
+	GObjectClass *object_class;
 	GtkWidgetClass *widget_class;
+	GtkContainerClass *container_class;
 
+	object_class = G_OBJECT_CLASS (self_class);
 	widget_class = GTK_WIDGET_CLASS (self_class);
+	container_class = GTK_CONTAINER_CLASS (self_class);
+
+	object_class->dispose = pager_container_dispose;
 
 	widget_class->get_preferred_width = pager_container_get_preferred_width;
 	widget_class->get_preferred_height = pager_container_get_preferred_height;
 	widget_class->size_allocate = pager_container_size_allocate;
+	widget_class->draw = pager_container_draw;
+	widget_class->unrealize = pager_container_unrealize;
+
+	container_class->add = pager_container_add;
 }
 
 static void
 pager_container_init (PagerContainer *self)
 {
+	self->n_rows = 1;
+	self->show_all = TRUE;
+	self->damage = cairo_region_create ();
 }
 
 static GtkWidget *
@@ -195,7 +646,19 @@ pager_container_set_orientation (PagerContainer *self,
 
 	self->orientation = orientation;
 
-	gtk_widget_queue_resize (GTK_WIDGET (self));
+	pager_container_layout_changed (self);
+}
+
+/* Tells the container how the pager lays out the workspaces */
+static void
+pager_container_set_layout (PagerContainer *self,
+                            int             n_rows,
+                            gboolean        show_all)
+{
+	self->n_rows = n_rows;
+	self->show_all = show_all;
+
+	pager_container_layout_changed (self);
 }
 
 /* Pager applet itself */
@@ -240,6 +703,16 @@ typedef struct {
 	gboolean display_all;
 	gboolean wrap_workspaces;
 
+	/* scrolling over the pager */
+	gdouble scroll_dx;
+	gdouble scroll_dy;
+	guint32 scroll_event_time;
+	gint64 scroll_step_time;
+	int scroll_target;		/* workspace to switch to, or -1 */
+	guint32 scroll_time;
+	guint scroll_tick_id;
+	gint64 scroll_switch_time;
+
 	GSettings* settings;
 } PagerData;
 
@@ -266,6 +739,8 @@ static void pager_update_wnck(PagerData* pager, WnckPager* wnck_pager)
 	wnck_pager_set_n_rows(wnck_pager, pager->n_rows);
 	wnck_pager_set_show_all(wnck_pager, pager->display_all);
 	wnck_pager_set_display_mode(wnck_pager, display_mode);
+
+	pager_container_set_layout(PAGER_CONTAINER(pager->pager_container), pager->n_rows, pager->display_all);
 }
 #endif /* HAVE_X11 */
 
@@ -401,6 +876,9 @@ static void applet_realized(MatePanelApplet* applet, PagerData* pager)
 	{
 		pager->screen = wncklet_get_screen(GTK_WIDGET(applet));
 		wncklet_connect_while_alive(pager->screen, "window_manager_changed", G_CALLBACK(window_manager_changed), pager, pager->applet);
+
+		if (WNCK_IS_PAGER(pager->pager))
+			pager_container_set_screen(PAGER_CONTAINER(pager->pager_container), pager->screen);
 	}
 #endif /* HAVE_X11 */
 
@@ -410,6 +888,7 @@ static void applet_realized(MatePanelApplet* applet, PagerData* pager)
 static void applet_unrealized(MatePanelApplet* applet, PagerData* pager)
 {
 #ifdef HAVE_X11
+	pager_container_set_screen(PAGER_CONTAINER(pager->pager_container), NULL);
 	pager->screen = NULL;
 #endif /* HAVE_X11 */
 	pager->wm = PAGER_WM_UNKNOWN;
@@ -457,8 +936,13 @@ static void applet_change_background(MatePanelApplet* applet, MatePanelAppletBac
 	{
 		wnck_pager_set_shadow_type (WNCK_PAGER (pager->pager),
 		        type == PANEL_NO_BACKGROUND ? GTK_SHADOW_NONE : GTK_SHADOW_IN);
+		/* the shadow changes the size the pager asks for */
+		pager_container_layout_changed (PAGER_CONTAINER (pager->pager_container));
+		return;
 	}
 #endif /* HAVE_X11 */
+
+	pager_container_invalidate (PAGER_CONTAINER (pager->pager_container));
 }
 
 static void applet_style_updated (MatePanelApplet *applet, GtkStyleContext *context)
@@ -486,36 +970,17 @@ static void applet_style_updated (MatePanelApplet *applet, GtkStyleContext *cont
 	g_object_unref (provider);
 }
 
-/* Replacement for the default scroll handler that also cares about the wrapping property.
- * Alternative: Add behaviour to libwnck (to the WnckPager widget).
- */
-static gboolean applet_scroll(MatePanelApplet* applet, GdkEventScroll* event, PagerData* pager)
-{
 #ifdef HAVE_X11
+/* Returns the workspace next to index in direction, given the layout and
+ * the wrapping property */
+static int pager_scroll_target(PagerData* pager, GtkWidget* widget, int index, GdkScrollDirection direction)
+{
 	GdkScrollDirection absolute_direction;
-	int index;
 	int n_workspaces;
 	int n_columns;
 	int in_last_row;
-#endif /* HAVE_X11 */
-
-	if (event->type != GDK_SCROLL)
-		return FALSE;
 
-	if (event->direction == GDK_SCROLL_SMOOTH)
-		return FALSE;
-
-#ifdef HAVE_X11
-	if (pager->screen)
-	{
-		index = wnck_workspace_get_number(wnck_screen_get_active_workspace(pager->screen));
-		n_workspaces = wnck_screen_get_workspace_count(pager->screen);
-	}
-	else
-	{
-		index = 0;
-		n_workspaces = 1;
-	}
+	n_workspaces = pager->screen ? wnck_screen_get_workspace_count(pager->screen) : 1;
 
 	n_columns = n_workspaces / pager->n_rows;
 
@@ -524,11 +989,11 @@ static gboolean applet_scroll(MatePanelApplet* applet, GdkEventScroll* event, Pa
 
 	in_last_row    = n_workspaces % n_columns;
 
-	absolute_direction = event->direction;
+	absolute_direction = direction;
 
-	if (gtk_widget_get_direction(GTK_WIDGET(applet)) == GTK_TEXT_DIR_RTL)
+	if (gtk_widget_get_direction(widget) == GTK_TEXT_DIR_RTL)
 	{
-		switch (event->direction)
+		switch (direction)
 		{
 			case GDK_SCROLL_RIGHT:
 				absolute_direction = GDK_SCROLL_LEFT;
@@ -602,10 +1067,115 @@ static gboolean applet_scroll(MatePanelApplet* applet, GdkEventScroll* event, Pa
 			break;
 	}
 
-	if (pager->screen)
+	return index;
+}
+
+static gboolean pager_scroll_tick(GtkWidget* widget, GdkFrameClock* frame_clock, gpointer user_data)
+{
+	PagerData* pager = user_data;
+	WnckWorkspace* workspace;
+	gint64 now;
+
+	/* the window manager restacks all the windows on each switch */
+	now = g_get_monotonic_time();
+	if (now - pager->scroll_switch_time < PAGER_SCROLL_SWITCH_INTERVAL)
+		return G_SOURCE_CONTINUE;
+
+	pager->scroll_tick_id = 0;
+
+	workspace = pager->screen ? wnck_screen_get_workspace(pager->screen, pager->scroll_target) : NULL;
+	pager->scroll_target = -1;
+
+	if (workspace && workspace != wnck_screen_get_active_workspace(pager->screen))
+	{
+		wnck_workspace_activate(workspace, pager->scroll_time);
+		pager->scroll_switch_time = now;
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Moves the target of the pending switch one workspace further, the switch
+ * itself is done once per frame */
+static void pager_scroll_step(PagerData* pager, GtkWidget* widget, GdkScrollDirection direction, guint32 time)
+{
+	int index;
+
+	if (pager->scroll_target >= 0)
+		index = pager->scroll_target;
+	else if (pager->screen && wnck_screen_get_active_workspace(pager->screen))
+		index = wnck_workspace_get_number(wnck_screen_get_active_workspace(pager->screen));
+	else
+		index = 0;
+
+	pager->scroll_target = pager_scroll_target(pager, widget, index, direction);
+	pager->scroll_time = time;
+
+	if (pager->scroll_tick_id == 0)
+		pager->scroll_tick_id = gtk_widget_add_tick_callback(widget, pager_scroll_tick, pager, NULL);
+}
+#endif /* HAVE_X11 */
+
+/* Replacement for the default scroll handler that also cares about the wrapping property.
+ * Alternative: Add behaviour to libwnck (to the WnckPager widget).
+ *
+ * Touchpads send many small smooth scroll events per gesture: their deltas
+ * add up to a step of one workspace, and there are at most so many steps
+ * per second.
+ */
+static gboolean applet_scroll(MatePanelApplet* applet, GdkEventScroll* event, PagerData* pager)
+{
+#ifdef HAVE_X11
+	gdouble delta_x;
+	gdouble delta_y;
+	gint64 now;
+#endif /* HAVE_X11 */
+
+	if (event->type != GDK_SCROLL)
+		return FALSE;
+
+#ifdef HAVE_X11
+	if (event->direction != GDK_SCROLL_SMOOTH)
 	{
-		wnck_workspace_activate(wnck_screen_get_workspace(pager->screen, index), event->time);
+		pager_scroll_step(pager, GTK_WIDGET(applet), event->direction, event->time);
+		return TRUE;
 	}
+
+	if (!gdk_event_get_scroll_deltas((GdkEvent*) event, &delta_x, &delta_y))
+		return TRUE;
+
+	/* a new gesture */
+	if (event->time - pager->scroll_event_time > PAGER_SCROLL_GESTURE_GAP)
+	{
+		pager->scroll_dx = 0.0;
+		pager->scroll_dy = 0.0;
+	}
+	pager->scroll_event_time = event->time;
+
+	pager->scroll_dx += delta_x;
+	pager->scroll_dy += delta_y;
+
+	now = g_get_monotonic_time();
+	if (now - pager->scroll_step_time < PAGER_SCROLL_STEP_INTERVAL)
+		return TRUE;
+
+	if (ABS(pager->scroll_dy) >= PAGER_SCROLL_THRESHOLD && ABS(pager->scroll_dy) >= ABS(pager->scroll_dx))
+	{
+		pager_scroll_step(pager, GTK_WIDGET(applet), pager->scroll_dy > 0 ? GDK_SCROLL_DOWN : GDK_SCROLL_UP, event->time);
+	}
+	else if (ABS(pager->scroll_dx) >= PAGER_SCROLL_THRESHOLD)
+	{
+		pager_scroll_step(pager, GTK_WIDGET(applet), pager->scroll_dx > 0 ? GDK_SCROLL_RIGHT : GDK_SCROLL_LEFT, event->time);
+	}
+	else
+	{
+		return TRUE;
+	}
+
+	/* what was scrolled during the interval does not carry over */
+	pager->scroll_dx = 0.0;
+	pager->scroll_dy = 0.0;
+	pager->scroll_step_time = now;
 #endif /* HAVE_X11 */
 
 	return TRUE;
@@ -741,6 +1311,7 @@ gboolean workspace_switcher_applet_fill(MatePanelApplet* applet)
 	pager = g_new0(PagerData, 1);
 
 	pager->applet = GTK_WIDGET(applet);
+	pager->scroll_target = -1;
 
 	mate_panel_applet_set_flags(MATE_PANEL_APPLET(pager->applet), MATE_PANEL_APPLET_EXPAND_MINOR);
 
@@ -803,6 +1374,7 @@ gboolean workspace_switcher_applet_fill(MatePanelApplet* applet)
 	                  pager);
 
 	/* overwrite default WnckPager widget scroll-event */
+	gtk_widget_add_events (pager->pager, GDK_SMOOTH_SCROLL_MASK);
 	g_signal_connect (pager->pager, "scroll-event",
 	                  G_CALLBACK (applet_scroll),
 	                  pager);
@@ -1282,6 +1854,9 @@ static void display_properties_dialog(GtkAction* action, PagerData* pager)
 
 static void destroy_pager(GtkWidget* widget, PagerData* pager)
 {
+	if (pager->scroll_tick_id != 0)
+		gtk_widget_remove_tick_callback(widget, pager->scroll_tick_id);
+
 	g_signal_handlers_disconnect_by_data (pager->settings, pager);
 
 	g_object_unref (pager->settings);
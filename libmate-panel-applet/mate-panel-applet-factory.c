@@ -27,6 +27,8 @@
 
 #include "mate-panel-applet-factory.h"
 
+#include <libpanel-util/panel-perf.h>
+
 #ifdef HAVE_X11
 #include <gdk/gdkx.h>
 #endif
@@ -50,10 +52,13 @@ struct _MatePanelAppletFactory {
 
 #define MATE_PANEL_APPLET_FACTORY_OBJECT_PATH  "/org/mate/panel/applet/%s"
 #define MATE_PANEL_APPLET_FACTORY_SERVICE_NAME "org.mate.panel.applet.%s"
+#define MATE_PANEL_APPLET_PERF_OBJECT_PATH     "/org/mate/panel/applet/Perf"
 
 G_DEFINE_TYPE (MatePanelAppletFactory, mate_panel_applet_factory, G_TYPE_OBJECT)
 
 static GHashTable *factories = NULL;
+/* the counters of the process, shared by all its factories */
+static guint       perf_registration_id = 0;
 
 static void
 mate_panel_applet_factory_finalize (GObject *object)
@@ -305,6 +310,11 @@ on_bus_acquired (GDBusConnection        *connection,
 	}
 
 	g_free (object_path);
+
+	if (!perf_registration_id)
+		perf_registration_id =
+			panel_perf_register (connection,
+			                     MATE_PANEL_APPLET_PERF_OBJECT_PATH);
 }
 
 static void
@@ -29,6 +29,13 @@
 #include "mate-panel-applet.h"
 #include "mate-panel-applet-gsettings.h"
 
+/* schema and path of every GSettings created with
+ * mate_panel_applet_settings_new(): path -> schema */
+static GHashTable *registered_schemas = NULL;
+/* the ones not told to dconf-editor yet */
+static GHashTable *pending_schemas = NULL;
+static guint       register_schemas_id = 0;
+
 static GVariant *
 add_to_dict (GVariant *dict, const gchar *schema, const gchar *path)
 {
@@ -87,22 +94,34 @@ add_to_dict (GVariant *dict, const gchar *schema, const gchar *path)
     }
 }
 
-static void
-register_dconf_editor_relocatable_schema (const gchar *schema, const gchar *path)
+/* Every applet registers its settings when it is created, which is
+ * usually at login by all the applets at once: tell dconf-editor about all
+ * of them with a single write, once the applets are created. */
+static gboolean
+register_pending_schemas (gpointer user_data)
 {
     GSettingsSchemaSource *source;
     GSettingsSchema       *dconf_editor_schema;
     GSettings             *dconf_editor_settings;
+    GHashTable            *pending;
+
+    register_schemas_id = 0;
+    pending = pending_schemas;
+    pending_schemas = NULL;
 
     source = g_settings_schema_source_get_default ();
 
-    if (! source)
-        return;
+    if (! source) {
+        g_hash_table_destroy (pending);
+        return G_SOURCE_REMOVE;
+    }
 
     dconf_editor_schema = g_settings_schema_source_lookup (source, "ca.desrt.dconf-editor.Settings", FALSE);
 
-    if (! dconf_editor_schema)
-        return;
+    if (! dconf_editor_schema) {
+        g_hash_table_destroy (pending);
+        return G_SOURCE_REMOVE;
+    }
 
     dconf_editor_settings = g_settings_new_full (dconf_editor_schema, NULL, NULL);
 
@@ -110,11 +129,23 @@ register_dconf_editor_relocatable_schema (const gchar *schema, const gchar *path
         GVariant *relocatable_schemas = g_settings_get_value (dconf_editor_settings, "relocatable-schemas-user-paths");
 
         if (g_variant_is_of_type (relocatable_schemas, G_VARIANT_TYPE_DICTIONARY)) {
-            GVariant * new_relocatable_schemas = add_to_dict (relocatable_schemas, schema, path);
-            if (new_relocatable_schemas) {
-                g_settings_set_value (dconf_editor_settings, "relocatable-schemas-user-paths", new_relocatable_schemas);
-                g_variant_unref (new_relocatable_schemas);
+            GHashTableIter iter;
+            gpointer       path;
+            gpointer       schema;
+            gboolean       changed = FALSE;
+
+            g_hash_table_iter_init (&iter, pending);
+            while (g_hash_table_iter_next (&iter, &path, &schema)) {
+                GVariant * new_relocatable_schemas = add_to_dict (relocatable_schemas, schema, path);
+                if (new_relocatable_schemas) {
+                    g_variant_unref (relocatable_schemas);
+                    relocatable_schemas = new_relocatable_schemas;
+                    changed = TRUE;
+                }
             }
+
+            if (changed)
+                g_settings_set_value (dconf_editor_settings, "relocatable-schemas-user-paths", relocatable_schemas);
         }
 
         g_variant_unref (relocatable_schemas);
@@ -122,6 +153,31 @@ register_dconf_editor_relocatable_schema (const gchar *schema, const gchar *path
 
     g_object_unref (dconf_editor_settings);
     g_settings_schema_unref (dconf_editor_schema);
+    g_hash_table_destroy (pending);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+register_dconf_editor_relocatable_schema (const gchar *schema, const gchar *path)
+{
+    /* applets create their settings again on each reload: only the
+     * first time can change anything */
+    if (! registered_schemas)
+        registered_schemas = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+    if (g_strcmp0 (g_hash_table_lookup (registered_schemas, path), schema) == 0)
+        return;
+
+    g_hash_table_insert (registered_schemas, g_strdup (path), g_strdup (schema));
+
+    if (! pending_schemas)
+        pending_schemas = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+    g_hash_table_insert (pending_schemas, g_strdup (path), g_strdup (schema));
+
+    if (! register_schemas_id)
+        register_schemas_id = g_idle_add (register_pending_schemas, NULL);
 }
 
 GSettings *
@@ -143,6 +199,69 @@ mate_panel_applet_settings_new (MatePanelApplet *applet, gchar *schema)
     return settings;
 }
 
+static gboolean
+settings_apply (gpointer user_data)
+{
+    GSettings *settings = G_SETTINGS (user_data);
+
+    g_object_set_data (G_OBJECT (settings), "mate-panel-applet-settings-apply-id", NULL);
+    g_settings_apply (settings);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+settings_has_unapplied_changed (GSettings  *settings,
+                                GParamSpec *pspec,
+                                gpointer    user_data)
+{
+    guint id;
+
+    if (! g_settings_get_has_unapplied (settings) ||
+        g_object_get_data (G_OBJECT (settings), "mate-panel-applet-settings-apply-id"))
+        return;
+
+    /* the source keeps the settings alive until they are written */
+    id = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE, settings_apply,
+                          g_object_ref (settings), g_object_unref);
+    g_object_set_data (G_OBJECT (settings), "mate-panel-applet-settings-apply-id",
+                       GUINT_TO_POINTER (id));
+}
+
+/* Applets tend to save their lists on every change of their widgets:
+ * gather the writes done during one main loop iteration into a single
+ * one. Once delayed, settings cannot go back, so any later change to them,
+ * including by the applet itself, is applied the same way. Settings the
+ * applet delayed itself are left alone. */
+static void
+settings_set_strv (GSettings *settings, gchar *key, const gchar * const *value)
+{
+    GVariant *old_value;
+    GVariant *new_value;
+
+    if (! g_object_get_data (G_OBJECT (settings), "mate-panel-applet-settings-delayed")) {
+        gboolean delay_apply;
+
+        g_object_get (settings, "delay-apply", &delay_apply, NULL);
+        if (! delay_apply) {
+            g_object_set_data (G_OBJECT (settings), "mate-panel-applet-settings-delayed",
+                               GINT_TO_POINTER (TRUE));
+            g_settings_delay (settings);
+            g_signal_connect (settings, "notify::has-unapplied",
+                              G_CALLBACK (settings_has_unapplied_changed), NULL);
+        }
+    }
+
+    new_value = g_variant_ref_sink (g_variant_new_strv (value, -1));
+    old_value = g_settings_get_value (settings, key);
+
+    if (! g_variant_equal (old_value, new_value))
+        g_settings_set_value (settings, key, new_value);
+
+    g_variant_unref (old_value);
+    g_variant_unref (new_value);
+}
+
 GList*
 mate_panel_applet_settings_get_glist (GSettings *settings, gchar *key)
 {
@@ -168,7 +287,7 @@ mate_panel_applet_settings_set_glist (GSettings *settings, gchar *key, GList *li
     for (GList *l = list; l; l = l->next) {
         array = g_array_append_val (array, l->data);
     }
-    g_settings_set_strv (settings, key, (const gchar **) array->data);
+    settings_set_strv (settings, key, (const gchar * const *) array->data);
     g_array_free (array, TRUE);
 }
 
@@ -197,6 +316,6 @@ mate_panel_applet_settings_set_gslist (GSettings *settings, gchar *key, GSList *
     for (GSList *l = list; l; l = l->next) {
         array = g_array_append_val (array, l->data);
     }
-    g_settings_set_strv (settings, key, (const gchar **) array->data);
+    settings_set_strv (settings, key, (const gchar * const *) array->data);
     g_array_free (array, TRUE);
 }
@@ -0,0 +1,135 @@
+/*
+ * mate-panel-applet-host.c: runs the factories of several applet modules
+ * in one process.
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Every out-of-process applet normally runs in its own process, with its
+ * own copy of GTK+, of the theme and of the icon theme cache. This loads
+ * applet modules, the same shared libraries the panel can load in-process,
+ * and serves all their factories on the session bus from one process, while
+ * the applets are still embedded in the panel like out-of-process ones.
+ *
+ * To host a factory, point the Exec line of its D-Bus service file to this
+ * program, followed by the modules to host, and mark its
+ * .mate-panel-applet file as out-of-process. A module that fails to load
+ * or to register its factory is skipped; the other ones keep working.
+ */
+
+#include <config.h>
+
+#include <glib/gi18n-lib.h>
+#include <gmodule.h>
+#include <gtk/gtk.h>
+
+#include "mate-panel-applet.h"
+#include "panel-applet-private.h"
+
+typedef gint (* ActivateAppletFunc) (void);
+
+static gboolean
+mate_panel_applet_host_load_module (const char *path)
+{
+	GModule            *module;
+	ActivateAppletFunc  activate_applet;
+
+	module = g_module_open (path, G_MODULE_BIND_LAZY | G_MODULE_BIND_LOCAL);
+	if (!module) {
+		g_warning ("Failed to load applet module %s: %s",
+			   path, g_module_error ());
+		return FALSE;
+	}
+
+	if (!g_module_symbol (module, "_mate_panel_applet_shlib_factory",
+			      (gpointer *) &activate_applet)) {
+		g_warning ("Failed to load applet module %s: %s",
+			   path, g_module_error ());
+		g_module_close (module);
+		return FALSE;
+	}
+
+	if (activate_applet () != 0) {
+		g_warning ("Failed to start the applet factory of %s", path);
+		g_module_close (module);
+		return FALSE;
+	}
+
+	/* applet types are registered static: the module stays loaded */
+	g_module_make_resident (module);
+
+	return TRUE;
+}
+
+int
+main (int argc, char *argv[])
+{
+	GOptionContext  *context;
+	GError          *error = NULL;
+	char           **modules = NULL;
+	guint            n_loaded = 0;
+	guint            i;
+
+	const GOptionEntry options[] = {
+		{ G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &modules, NULL, N_("MODULE...") },
+		{ NULL }
+	};
+
+#ifdef ENABLE_NLS
+	bindtextdomain (GETTEXT_PACKAGE, MATELOCALEDIR);
+	bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
+	textdomain (GETTEXT_PACKAGE);
+#endif
+
+	context = g_option_context_new ("");
+	g_option_context_add_main_entries (context, options, GETTEXT_PACKAGE);
+	g_option_context_add_group (context, gtk_get_option_group (TRUE));
+
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("Cannot parse arguments: %s.\n", error->message);
+		g_error_free (error);
+		g_option_context_free (context);
+		return 1;
+	}
+	g_option_context_free (context);
+
+	if (!modules || !modules[0]) {
+		g_printerr ("No applet module to host.\n");
+		g_strfreev (modules);
+		return 1;
+	}
+
+	gtk_init (&argc, &argv);
+
+	mate_panel_applet_factory_set_hosted ();
+
+	for (i = 0; modules[i]; i++) {
+		if (mate_panel_applet_host_load_module (modules[i]))
+			n_loaded++;
+	}
+	g_strfreev (modules);
+
+	if (n_loaded == 0 || mate_panel_applet_factory_get_n_hosted () == 0)
+		return 1;
+
+	/* quit by the last hosted factory going away */
+	gtk_main ();
+
+	return 0;
+}
@@ -52,6 +52,9 @@
 #include "mate-panel-applet-marshal.h"
 #include "mate-panel-applet-enums.h"
 
+#include <libpanel-util/panel-perf.h>
+#include <libpanel-util/panel-stall-watch.h>
+
 typedef struct {
 	GtkWidget         *plug;
 	GDBusConnection   *connection;
@@ -72,6 +75,12 @@ typedef struct {
 	MatePanelAppletOrient  orient;
 	guint              size;
 	char              *background;
+	/* set by panels that send a typed background, NULL otherwise */
+	GVariant          *background_descriptor;
+#ifdef HAVE_X11
+	cairo_surface_t   *background_surface;
+	Window             background_xid;
+#endif
 
 	int                previous_width;
 	int                previous_height;
@@ -79,10 +88,40 @@ typedef struct {
 	int               *size_hints;
 	int                size_hints_len;
 
+	/* hints not sent to the panel yet */
+	int               *pending_size_hints;
+	int                pending_size_hints_len;
+	guint              size_hints_idle_id;
+	guint              size_hints_shrink_id;
+
 	gboolean           moving_focus_out;
 
 	gboolean           locked;
 	gboolean           locked_down;
+
+	MatePanelAppletPowerProfile power_profile;
+	gboolean           a11y_enabled;
+
+	/* the XID of the panel window, None until the panel sends it */
+	guint32            dock_window;
+#ifdef HAVE_X11
+	/* found in the window tree for the panels that do not send it,
+	 * until the applet is embedded again */
+	Window             found_dock_window_from;
+	Window             found_dock_window;
+#endif
+
+	/* for GetStatistics: the draws are only timed once the statistics
+	 * are enabled, everything else is always counted */
+	guint64            n_draws;
+	guint64            n_timed_draws;
+	guint64            draw_time;
+	guint64            draw_max_time;
+	guint64            n_size_allocates;
+	guint64            n_property_gets;
+	guint64            n_property_sets;
+	guint64            n_property_batches;
+	guint64            n_signals;
 } MatePanelAppletPrivate;
 
 enum {
@@ -95,6 +134,10 @@ enum {
 
 static guint mate_panel_applet_signals[LAST_SIGNAL] = { 0 };
 
+/* MATE_PANEL_APPLET_STATISTICS in the environment, or the first
+ * GetStatistics call, enable them for all the applets of the process */
+static gboolean applet_statistics_enabled = FALSE;
+
 enum {
 	PROP_0,
 	PROP_OUT_OF_PROCESS,
@@ -108,7 +151,11 @@ enum {
 	PROP_FLAGS,
 	PROP_SIZE_HINTS,
 	PROP_LOCKED,
-	PROP_LOCKED_DOWN
+	PROP_LOCKED_DOWN,
+	PROP_BACKGROUND_DESCRIPTOR,
+	PROP_POWER_PROFILE,
+	PROP_A11Y_ENABLED,
+	PROP_DOCK_WINDOW
 };
 
 static void       mate_panel_applet_handle_background   (MatePanelApplet       *applet);
@@ -157,6 +204,9 @@ G_DEFINE_TYPE_WITH_PRIVATE (MatePanelApplet, mate_panel_applet, GTK_TYPE_EVENT_B
 #define MATE_PANEL_APPLET_INTERFACE   "org.mate.panel.applet.Applet"
 #define MATE_PANEL_APPLET_OBJECT_PATH "/org/mate/panel/applet/%s/%d"
 
+/* How long hints asking for less space wait before being sent, in ms */
+#define MATE_PANEL_APPLET_SIZE_HINTS_SHRINK_DELAY 3000
+
 char *
 mate_panel_applet_get_preferences_path (MatePanelApplet *applet)
 {
@@ -231,6 +281,8 @@ mate_panel_applet_set_flags (MatePanelApplet      *applet,
 		g_variant_builder_add (&builder, "{sv}", "Flags",
 				       g_variant_new_uint32 (priv->flags));
 
+		priv->n_signals++;
+
 		g_dbus_connection_emit_signal (priv->connection,
 		                               NULL,
 		                               priv->object_path,
@@ -268,55 +320,54 @@ mate_panel_applet_size_hints_ensure (MatePanelApplet *applet,
 }
 
 static gboolean
-mate_panel_applet_size_hints_changed (MatePanelApplet *applet,
-				 const int   *size_hints,
-				 int          n_elements,
-				 int          base_size)
+mate_panel_applet_size_hints_equal (const int *size_hints,
+				    int        n_elements,
+				    const int *other_hints,
+				    int        other_n_elements)
 {
-	MatePanelAppletPrivate *priv;
-	gint i;
-
-	priv = mate_panel_applet_get_instance_private (applet);
+	if (n_elements != other_n_elements)
+		return FALSE;
 
-	if (!priv->size_hints)
+	if (n_elements == 0)
 		return TRUE;
 
-	if (priv->size_hints_len != n_elements)
+	return memcmp (size_hints, other_hints, n_elements * sizeof (int)) == 0;
+}
+
+/* The first hint is the largest size the applet can use */
+static gboolean
+mate_panel_applet_size_hints_grow (MatePanelAppletPrivate *priv)
+{
+	if (!priv->size_hints || priv->size_hints_len == 0)
 		return TRUE;
 
-	for (i = 0; i < n_elements; i++) {
-		if (size_hints[i] + base_size != priv->size_hints[i])
-			return TRUE;
-	}
+	if (priv->pending_size_hints_len == 0)
+		return FALSE;
 
-	return FALSE;
+	return priv->pending_size_hints[0] >= priv->size_hints[0];
 }
 
-/**
- * mate_panel_applet_set_size_hints:
- * @applet: applet
- * @size_hints: (array length=n_elements): List of integers
- * @n_elements: Length of @size_hints
- * @base_size: base_size
- */
-void
-mate_panel_applet_set_size_hints (MatePanelApplet *applet,
-			     const int   *size_hints,
-			     int          n_elements,
-			     int          base_size)
+static void
+mate_panel_applet_size_hints_publish (MatePanelApplet *applet)
 {
 	MatePanelAppletPrivate *priv;
 	gint i;
 
-	/* Make sure property has really changed to avoid bus traffic */
-	if (!mate_panel_applet_size_hints_changed (applet, size_hints, n_elements, base_size))
-		return;
-
 	priv = mate_panel_applet_get_instance_private (applet);
 
-	mate_panel_applet_size_hints_ensure (applet, n_elements);
-	for (i = 0; i < n_elements; i++)
-		priv->size_hints[i] = size_hints[i] + base_size;
+	if (priv->size_hints_shrink_id) {
+		g_source_remove (priv->size_hints_shrink_id);
+		priv->size_hints_shrink_id = 0;
+	}
+
+	if (!priv->pending_size_hints)
+		return;
+
+	mate_panel_applet_size_hints_ensure (applet, priv->pending_size_hints_len);
+	for (i = 0; i < priv->size_hints_len; i++)
+		priv->size_hints[i] = priv->pending_size_hints[i];
+	g_clear_pointer (&priv->pending_size_hints, g_free);
+	priv->pending_size_hints_len = 0;
 
 	g_object_notify (G_OBJECT (applet), "size-hints");
 
@@ -330,13 +381,15 @@ mate_panel_applet_set_size_hints (MatePanelApplet *applet,
 		g_variant_builder_init (&invalidated_builder, G_VARIANT_TYPE ("as"));
 
 		children = g_new (GVariant *, priv->size_hints_len);
-		for (i = 0; i < n_elements; i++)
+		for (i = 0; i < priv->size_hints_len; i++)
 			children[i] = g_variant_new_int32 (priv->size_hints[i]);
 		g_variant_builder_add (&builder, "{sv}", "SizeHints",
 		                       g_variant_new_array (G_VARIANT_TYPE_INT32,
 		                       children, priv->size_hints_len));
 		g_free (children);
 
+		priv->n_signals++;
+
 		g_dbus_connection_emit_signal (priv->connection,
 		                               NULL,
 		                               priv->object_path,
@@ -357,6 +410,99 @@ mate_panel_applet_set_size_hints (MatePanelApplet *applet,
 	}
 }
 
+static gboolean
+mate_panel_applet_size_hints_shrink_timeout (gpointer user_data)
+{
+	MatePanelApplet        *applet = MATE_PANEL_APPLET (user_data);
+	MatePanelAppletPrivate *priv;
+
+	priv = mate_panel_applet_get_instance_private (applet);
+	priv->size_hints_shrink_id = 0;
+
+	mate_panel_applet_size_hints_publish (applet);
+
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean
+mate_panel_applet_size_hints_idle (gpointer user_data)
+{
+	MatePanelApplet        *applet = MATE_PANEL_APPLET (user_data);
+	MatePanelAppletPrivate *priv;
+
+	priv = mate_panel_applet_get_instance_private (applet);
+	priv->size_hints_idle_id = 0;
+
+	if (!priv->pending_size_hints)
+		return G_SOURCE_REMOVE;
+
+	/* more space is given right away; space is only given back once the
+	 * applet has not needed it for a while, so that applets whose width
+	 * changes all the time (clocks with seconds, network monitors...)
+	 * do not relayout the whole panel every time */
+	if (mate_panel_applet_size_hints_grow (priv))
+		mate_panel_applet_size_hints_publish (applet);
+	else if (!priv->size_hints_shrink_id)
+		priv->size_hints_shrink_id =
+			g_timeout_add (MATE_PANEL_APPLET_SIZE_HINTS_SHRINK_DELAY,
+				       mate_panel_applet_size_hints_shrink_timeout,
+				       applet);
+
+	return G_SOURCE_REMOVE;
+}
+
+/**
+ * mate_panel_applet_set_size_hints:
+ * @applet: applet
+ * @size_hints: (array length=n_elements): List of integers
+ * @n_elements: Length of @size_hints
+ * @base_size: base_size
+ *
+ * The hints set during one main loop iteration are sent to the panel
+ * together. Hints asking for less space than the current ones are only
+ * sent if they did not change for a few seconds.
+ */
+void
+mate_panel_applet_set_size_hints (MatePanelApplet *applet,
+			     const int   *size_hints,
+			     int          n_elements,
+			     int          base_size)
+{
+	MatePanelAppletPrivate *priv;
+	int *hints;
+	gint i;
+
+	priv = mate_panel_applet_get_instance_private (applet);
+
+	hints = g_new (int, MAX (n_elements, 1));
+	for (i = 0; i < n_elements; i++)
+		hints[i] = size_hints[i] + base_size;
+
+	/* Make sure property has really changed to avoid bus traffic */
+	if (priv->size_hints &&
+	    mate_panel_applet_size_hints_equal (hints, n_elements,
+						priv->size_hints, priv->size_hints_len)) {
+		g_free (hints);
+		g_clear_pointer (&priv->pending_size_hints, g_free);
+		priv->pending_size_hints_len = 0;
+		if (priv->size_hints_shrink_id) {
+			g_source_remove (priv->size_hints_shrink_id);
+			priv->size_hints_shrink_id = 0;
+		}
+		return;
+	}
+
+	g_free (priv->pending_size_hints);
+	priv->pending_size_hints = hints;
+	priv->pending_size_hints_len = n_elements;
+
+	if (!priv->size_hints_idle_id)
+		priv->size_hints_idle_id =
+			g_idle_add_full (G_PRIORITY_HIGH_IDLE,
+					 mate_panel_applet_size_hints_idle,
+					 applet, NULL);
+}
+
 guint
 mate_panel_applet_get_size (MatePanelApplet *applet)
 {
@@ -457,6 +603,8 @@ mate_panel_applet_set_locked (MatePanelApplet *applet,
 	if (priv->connection) {
 		GError *error = NULL;
 
+		priv->n_signals++;
+
 		g_dbus_connection_emit_signal (priv->connection,
 		                               NULL,
 		                               priv->object_path,
@@ -504,6 +652,93 @@ mate_panel_applet_set_locked_down (MatePanelApplet *applet,
 	g_object_notify (G_OBJECT (applet), "locked-down");
 }
 
+/**
+ * mate_panel_applet_get_power_profile:
+ * @applet: a #MatePanelApplet
+ *
+ * Applets that animate, tick or poll should do it less often in the
+ * balanced profile, and only when needed in the low-power one. The
+ * "power-profile" property is notified when it changes.
+ *
+ * Returns: the power profile the panel runs with
+ */
+MatePanelAppletPowerProfile
+mate_panel_applet_get_power_profile (MatePanelApplet *applet)
+{
+	MatePanelAppletPrivate *priv;
+
+	g_return_val_if_fail (MATE_PANEL_IS_APPLET (applet), MATE_PANEL_APPLET_POWER_PROFILE_NORMAL);
+
+	priv = mate_panel_applet_get_instance_private (applet);
+
+	return priv->power_profile;
+}
+
+/* Set by the panel only, like the lockdown state */
+static void
+mate_panel_applet_set_power_profile (MatePanelApplet             *applet,
+				     MatePanelAppletPowerProfile  power_profile)
+{
+	MatePanelAppletPrivate *priv;
+
+	g_return_if_fail (MATE_PANEL_IS_APPLET (applet));
+
+	priv = mate_panel_applet_get_instance_private (applet);
+
+	if (power_profile > MATE_PANEL_APPLET_POWER_PROFILE_LAST)
+		power_profile = MATE_PANEL_APPLET_POWER_PROFILE_NORMAL;
+
+	if (priv->power_profile == power_profile)
+		return;
+
+	priv->power_profile = power_profile;
+
+	g_object_notify (G_OBJECT (applet), "power-profile");
+}
+
+/**
+ * mate_panel_applet_get_a11y_enabled:
+ * @applet: a #MatePanelApplet
+ *
+ * Tells whether an assistive technology is running. Applets that update
+ * the accessible names or descriptions of their widgets often, like a
+ * clock, can skip that while it is not, and set them again when the
+ * "a11y-enabled" property is notified.
+ *
+ * Returns: %TRUE if the accessibles of the applet are used
+ */
+gboolean
+mate_panel_applet_get_a11y_enabled (MatePanelApplet *applet)
+{
+	MatePanelAppletPrivate *priv;
+
+	g_return_val_if_fail (MATE_PANEL_IS_APPLET (applet), TRUE);
+
+	priv = mate_panel_applet_get_instance_private (applet);
+
+	return priv->a11y_enabled;
+}
+
+/* Set by the panel only, like the power profile */
+static void
+mate_panel_applet_set_a11y_enabled (MatePanelApplet *applet,
+				    gboolean         a11y_enabled)
+{
+	MatePanelAppletPrivate *priv;
+
+	g_return_if_fail (MATE_PANEL_IS_APPLET (applet));
+
+	priv = mate_panel_applet_get_instance_private (applet);
+
+	a11y_enabled = a11y_enabled != FALSE;
+	if (priv->a11y_enabled == a11y_enabled)
+		return;
+
+	priv->a11y_enabled = a11y_enabled;
+
+	g_object_notify (G_OBJECT (applet), "a11y-enabled");
+}
+
 #ifdef HAVE_X11
 
 static Atom _net_wm_window_type = None;
@@ -533,7 +768,9 @@ static Window
 mate_panel_applet_find_toplevel_dock_window (MatePanelApplet *applet,
 					Display	    *xdisplay)
 {
+	MatePanelAppletPrivate *priv;
 	GtkWidget  *toplevel;
+	Window	    start;
 	Window	    xwin;
 	Window	    root, parent, *child;
 	int	    num_children;
@@ -542,7 +779,11 @@ mate_panel_applet_find_toplevel_dock_window (MatePanelApplet *applet,
 	if (!gtk_widget_get_realized (toplevel))
 		return None;
 
-	xwin = GDK_WINDOW_XID (gtk_widget_get_window (toplevel));
+	priv = mate_panel_applet_get_instance_private (applet);
+
+	xwin = start = GDK_WINDOW_XID (gtk_widget_get_window (toplevel));
+	if (priv->found_dock_window && priv->found_dock_window_from == start)
+		return priv->found_dock_window;
 
 	child = NULL;
 	parent = root = None;
@@ -569,8 +810,11 @@ mate_panel_applet_find_toplevel_dock_window (MatePanelApplet *applet,
 			XFree (data_return);
 			data_return = NULL;
 
-			if (window_type == _net_wm_window_type_dock)
+			if (window_type == _net_wm_window_type_dock) {
+				priv->found_dock_window_from = start;
+				priv->found_dock_window = xwin;
 				return xwin;
+			}
 		}
 
 		if (!XQueryTree (xdisplay,
@@ -603,6 +847,7 @@ mate_panel_applet_request_focus (MatePanelApplet	 *applet,
 			    guint32	  timestamp)
 {
 #ifdef HAVE_X11
+	MatePanelAppletPrivate *priv;
 	GdkScreen  *screen;
 	GdkWindow  *root;
 	GdkDisplay *display;
@@ -625,7 +870,11 @@ mate_panel_applet_request_focus (MatePanelApplet	 *applet,
 
 	mate_panel_applet_init_atoms (xdisplay);
 
-	dock_xwindow = mate_panel_applet_find_toplevel_dock_window (applet, xdisplay);
+	/* sent by the panel, no need to look for it then */
+	priv = mate_panel_applet_get_instance_private (applet);
+	dock_xwindow = priv->dock_window;
+	if (dock_xwindow == None)
+		dock_xwindow = mate_panel_applet_find_toplevel_dock_window (applet, xdisplay);
 	if (dock_xwindow == None)
 		return;
 
@@ -648,6 +897,41 @@ mate_panel_applet_request_focus (MatePanelApplet	 *applet,
 #endif
 }
 
+/**
+ * mate_panel_applet_perf_count:
+ * @name: the name of the counter
+ * @delta: what to add to it
+ *
+ * Adds @delta to a performance counter of the applet process. The
+ * counters are exported over D-Bus with the org.mate.Panel.Perf
+ * interface, at /org/mate/panel/applet/Perf on the name of the factory.
+ */
+void
+mate_panel_applet_perf_count (const gchar *name,
+			      guint64      delta)
+{
+	g_return_if_fail (name != NULL);
+
+	panel_perf_count (g_intern_string (name), delta);
+}
+
+/**
+ * mate_panel_applet_perf_record:
+ * @name: the name of the histogram
+ * @value: the value to record, usually a duration in microseconds
+ *
+ * Records @value in a histogram of the applet process, exported with the
+ * counters.
+ */
+void
+mate_panel_applet_perf_record (const gchar *name,
+			       gint64       value)
+{
+	g_return_if_fail (name != NULL);
+
+	panel_perf_record (g_intern_string (name), value);
+}
+
 static GtkAction *
 mate_panel_applet_menu_get_action (MatePanelApplet *applet,
 			      const gchar *action)
@@ -690,6 +974,8 @@ mate_panel_applet_menu_cmd_remove (GtkAction   *action,
 	if (!priv->connection)
 		return;
 
+	priv->n_signals++;
+
 	g_dbus_connection_emit_signal (priv->connection,
 	                               NULL,
 	                               priv->object_path,
@@ -715,6 +1001,8 @@ mate_panel_applet_menu_cmd_move (GtkAction   *action,
 	if (!priv->connection)
 		return;
 
+	priv->n_signals++;
+
 	g_dbus_connection_emit_signal (priv->connection,
 				       NULL,
 				       priv->object_path,
@@ -854,9 +1142,18 @@ mate_panel_applet_finalize (GObject *object)
 	g_clear_object (&priv->panel_action_group);
 	g_clear_object (&priv->ui_manager);
 
+	if (priv->size_hints_idle_id)
+		g_source_remove (priv->size_hints_idle_id);
+	if (priv->size_hints_shrink_id)
+		g_source_remove (priv->size_hints_shrink_id);
 	g_clear_pointer (&priv->size_hints, g_free);
+	g_clear_pointer (&priv->pending_size_hints, g_free);
 	g_clear_pointer (&priv->prefs_path, g_free);
 	g_clear_pointer (&priv->background, g_free);
+	g_clear_pointer (&priv->background_descriptor, g_variant_unref);
+#ifdef HAVE_X11
+	g_clear_pointer (&priv->background_surface, cairo_surface_destroy);
+#endif
 	g_clear_pointer (&priv->id, g_free);
 
 	/* closure is owned by the factory */
@@ -1188,6 +1485,10 @@ mate_panel_applet_size_allocate (GtkWidget     *widget,
 	applet = MATE_PANEL_APPLET (widget);
 	priv   = mate_panel_applet_get_instance_private (applet);
 
+	priv->n_size_allocates++;
+	if (applet_statistics_enabled)
+		panel_perf_count ("applet-size-allocates", 1);
+
 	if ((priv->previous_height != allocation->height) ||
 	    (priv->previous_width  != allocation->width)) {
 		priv->previous_height = allocation->height;
@@ -1196,13 +1497,39 @@ mate_panel_applet_size_allocate (GtkWidget     *widget,
 	}
 }
 
+static void
+mate_panel_applet_count_draw (MatePanelApplet *applet,
+			      gint64           start)
+{
+	MatePanelAppletPrivate *priv;
+	gint64                  elapsed;
+
+	priv = mate_panel_applet_get_instance_private (applet);
+	priv->n_draws++;
+
+	if (!start)
+		return;
+
+	elapsed = g_get_monotonic_time () - start;
+	priv->n_timed_draws++;
+	priv->draw_time += elapsed;
+	priv->draw_max_time = MAX (priv->draw_max_time, (guint64) elapsed);
+
+	panel_perf_count ("applet-draws", 1);
+	panel_perf_record ("applet-draw-us", elapsed);
+}
+
 static gboolean mate_panel_applet_draw(GtkWidget* widget, cairo_t* cr)
 {
 	GtkStyleContext *context;
 	int border_width;
 	gdouble x, y, width, height;
+	gint64 start;
 
+	/* the parent draws the content of the applet */
+	start = applet_statistics_enabled ? g_get_monotonic_time () : 0;
 	GTK_WIDGET_CLASS (mate_panel_applet_parent_class)->draw(widget, cr);
+	mate_panel_applet_count_draw (MATE_PANEL_APPLET (widget), start);
 
         if (!gtk_widget_has_focus (widget))
 		return FALSE;
@@ -1288,11 +1615,17 @@ mate_panel_applet_parse_color (const gchar *color_str,
 }
 
 #ifdef HAVE_X11
+/* The panel sends "xid,x,y,width,height,serial"; older panels only send
+ * "xid,x,y", in which case width and height are set to -1. The serial is
+ * only there to make the string change with the contents of the pixmap.
+ */
 static gboolean
 mate_panel_applet_parse_pixmap_str (const char *str,
 			       Window          *xid,
 			       int             *x,
-			       int             *y)
+			       int             *y,
+			       int             *width,
+			       int             *height)
 {
 	char **elements;
 	char  *tmp;
@@ -1301,6 +1634,8 @@ mate_panel_applet_parse_pixmap_str (const char *str,
 	g_return_val_if_fail (xid != NULL, FALSE);
 	g_return_val_if_fail (x != NULL, FALSE);
 	g_return_val_if_fail (y != NULL, FALSE);
+	g_return_val_if_fail (width != NULL, FALSE);
+	g_return_val_if_fail (height != NULL, FALSE);
 
 	elements = g_strsplit (str, ",", -1);
 
@@ -1324,6 +1659,20 @@ mate_panel_applet_parse_pixmap_str (const char *str,
 	if (tmp == elements [2])
 		goto ERROR_AND_FREE;
 
+	*width  = -1;
+	*height = -1;
+
+	if (elements [3] && *elements [3] &&
+	    elements [4] && *elements [4]) {
+		*width  = strtol (elements [3], &tmp, 10);
+		if (tmp == elements [3])
+			goto ERROR_AND_FREE;
+
+		*height = strtol (elements [4], &tmp, 10);
+		if (tmp == elements [4])
+			goto ERROR_AND_FREE;
+	}
+
 	g_strfreev (elements);
 	return TRUE;
 
@@ -1335,20 +1684,29 @@ ERROR_AND_FREE:
 static cairo_surface_t *
 mate_panel_applet_create_foreign_surface_for_display (GdkDisplay *display,
                                                       GdkVisual  *visual,
-                                                      Window      xid)
-{
-	Status result = 0;
-	Window window;
-	gint x, y;
-	guint width, height, border, depth;
-
-	gdk_x11_display_error_trap_push (display);
-	result = XGetGeometry (GDK_DISPLAY_XDISPLAY (display), xid, &window,
-	                       &x, &y, &width, &height, &border, &depth);
-	gdk_x11_display_error_trap_pop_ignored (display);
-
-	if (result == 0)
-		return NULL;
+                                                      Window      xid,
+                                                      int         width,
+                                                      int         height)
+{
+	/* the panel told us the size of the pixmap, so there is no need
+	 * for a round trip to the X server */
+	if (width <= 0 || height <= 0) {
+		Status result = 0;
+		Window window;
+		gint x, y;
+		guint w, h, border, depth;
+
+		gdk_x11_display_error_trap_push (display);
+		result = XGetGeometry (GDK_DISPLAY_XDISPLAY (display), xid, &window,
+		                       &x, &y, &w, &h, &border, &depth);
+		gdk_x11_display_error_trap_pop_ignored (display);
+
+		if (result == 0)
+			return NULL;
+
+		width = w;
+		height = h;
+	}
 
 	return cairo_xlib_surface_create (GDK_DISPLAY_XDISPLAY (display),
 	                                  xid, gdk_x11_visual_get_xvisual (visual),
@@ -1359,9 +1717,11 @@ static cairo_pattern_t *
 mate_panel_applet_get_pattern_from_pixmap (MatePanelApplet *applet,
 			 Window           xid,
 			 int              x,
-			 int              y)
+			 int              y,
+			 int              pixmap_width,
+			 int              pixmap_height)
 {
-	cairo_surface_t *background;
+	MatePanelAppletPrivate *priv;
 	cairo_surface_t *surface;
 	GdkWindow       *window;
 	int              width;
@@ -1375,21 +1735,45 @@ mate_panel_applet_get_pattern_from_pixmap (MatePanelApplet *applet,
 	if (!gtk_widget_get_realized (GTK_WIDGET (applet)))
 		return NULL;
 
+	priv = mate_panel_applet_get_instance_private (applet);
+
 	window = gtk_widget_get_window (GTK_WIDGET (applet));
 	display = gdk_window_get_display (window);
 
-	background = mate_panel_applet_create_foreign_surface_for_display (display,
-									   gdk_window_get_visual (window),
-									   xid);
+	/* The panel only creates a new pixmap when its background really
+	 * changes: when it is merely moved or resized, or when only our
+	 * position in it changed, keep using the surface we already have.
+	 * XIDs can be recycled, so also check that the size still matches. */
+	if (priv->background_xid != xid || !priv->background_surface ||
+	    (pixmap_width > 0 &&
+	     cairo_xlib_surface_get_width (priv->background_surface) != pixmap_width) ||
+	    (pixmap_height > 0 &&
+	     cairo_xlib_surface_get_height (priv->background_surface) != pixmap_height)) {
+		g_clear_pointer (&priv->background_surface, cairo_surface_destroy);
+		priv->background_xid = None;
+
+		priv->background_surface =
+			mate_panel_applet_create_foreign_surface_for_display (display,
+									      gdk_window_get_visual (window),
+									      xid,
+									      pixmap_width,
+									      pixmap_height);
+
+		/* background can be NULL if the user changes the background very fast.
+		 * We'll get the next update, so it's not a big deal. */
+		if (!priv->background_surface ||
+		    cairo_surface_status (priv->background_surface) != CAIRO_STATUS_SUCCESS) {
+			g_clear_pointer (&priv->background_surface, cairo_surface_destroy);
+			return NULL;
+		}
 
-	/* background can be NULL if the user changes the background very fast.
-	 * We'll get the next update, so it's not a big deal. */
-	if (!background || cairo_surface_status (background) != CAIRO_STATUS_SUCCESS) {
-		if (background)
-			cairo_surface_destroy (background);
-		return NULL;
+		priv->background_xid = xid;
 	}
 
+	/* The pixmap belongs to the panel and goes away when the panel
+	 * background changes, so we cannot keep a reference to it in our
+	 * window background: copy our part of it, which is done by the X
+	 * server. */
 	width = gdk_window_get_width(window);
 	height = gdk_window_get_height(window);
 	surface = gdk_window_create_similar_surface (window,
@@ -1398,12 +1782,11 @@ mate_panel_applet_get_pattern_from_pixmap (MatePanelApplet *applet,
 	                            height);
 	gdk_x11_display_error_trap_push (display);
 	cr = cairo_create (surface);
-	cairo_set_source_surface (cr, background, -x, -y);
+	cairo_set_source_surface (cr, priv->background_surface, -x, -y);
 	cairo_rectangle (cr, 0, 0, width, height);
 	cairo_fill (cr);
 	gdk_x11_display_error_trap_pop_ignored (display);
 
-	cairo_surface_destroy (background);
 	pattern = NULL;
 
 	if (cairo_status (cr) == CAIRO_STATUS_SUCCESS) {
@@ -1454,10 +1837,11 @@ mate_panel_applet_handle_background_string (MatePanelApplet  *applet,
 		if (GDK_IS_X11_DISPLAY (gdk_display_get_default ())) {
 			Window pixmap_id;
 			int             x, y;
+			int             width, height;
 
 			g_return_val_if_fail (pattern != NULL, PANEL_NO_BACKGROUND);
 
-			if (!mate_panel_applet_parse_pixmap_str (elements [1], &pixmap_id, &x, &y)) {
+			if (!mate_panel_applet_parse_pixmap_str (elements [1], &pixmap_id, &x, &y, &width, &height)) {
 				g_warning ("Incomplete '%s' background type received: %s",
 					elements [0], elements [1]);
 
@@ -1465,7 +1849,7 @@ mate_panel_applet_handle_background_string (MatePanelApplet  *applet,
 				return PANEL_NO_BACKGROUND;
 			}
 
-			*pattern = mate_panel_applet_get_pattern_from_pixmap (applet, pixmap_id, x, y);
+			*pattern = mate_panel_applet_get_pattern_from_pixmap (applet, pixmap_id, x, y, width, height);
 			if (!*pattern) {
 				g_warning ("Failed to get pattern %s", elements [1]);
 				g_strfreev (elements);
@@ -1486,11 +1870,79 @@ mate_panel_applet_handle_background_string (MatePanelApplet  *applet,
 	return retval;
 }
 
+static MatePanelAppletBackgroundType
+mate_panel_applet_handle_background_descriptor (MatePanelApplet  *applet,
+						GdkRGBA          *color,
+						cairo_pattern_t **pattern)
+{
+	MatePanelAppletPrivate *priv;
+	const char             *type;
+
+	priv = mate_panel_applet_get_instance_private (applet);
+
+	if (!gtk_widget_get_realized (GTK_WIDGET (applet)))
+		return PANEL_NO_BACKGROUND;
+
+	if (!g_variant_lookup (priv->background_descriptor, "type", "&s", &type) ||
+	    !strcmp (type, "none"))
+		return PANEL_NO_BACKGROUND;
+
+	if (!strcmp (type, "color")) {
+		g_return_val_if_fail (color != NULL, PANEL_NO_BACKGROUND);
+
+		if (!g_variant_lookup (priv->background_descriptor, "color", "(dddd)",
+				       &color->red, &color->green,
+				       &color->blue, &color->alpha)) {
+			g_warning ("Incomplete '%s' background type received", type);
+			return PANEL_NO_BACKGROUND;
+		}
+
+		return PANEL_COLOR_BACKGROUND;
+	}
+
+	if (!strcmp (type, "pixmap")) {
+#ifdef HAVE_X11
+		if (GDK_IS_X11_DISPLAY (gdk_display_get_default ())) {
+			guint32 pixmap_id;
+			gint32  x, y;
+			gint32  width, height;
+
+			g_return_val_if_fail (pattern != NULL, PANEL_NO_BACKGROUND);
+
+			if (!g_variant_lookup (priv->background_descriptor, "pixmap", "u", &pixmap_id) ||
+			    !g_variant_lookup (priv->background_descriptor, "x", "i", &x) ||
+			    !g_variant_lookup (priv->background_descriptor, "y", "i", &y) ||
+			    !g_variant_lookup (priv->background_descriptor, "width", "i", &width) ||
+			    !g_variant_lookup (priv->background_descriptor, "height", "i", &height)) {
+				g_warning ("Incomplete '%s' background type received", type);
+				return PANEL_NO_BACKGROUND;
+			}
+
+			*pattern = mate_panel_applet_get_pattern_from_pixmap (applet, pixmap_id, x, y, width, height);
+			if (!*pattern) {
+				g_warning ("Failed to get pattern for pixmap %u", pixmap_id);
+				return PANEL_NO_BACKGROUND;
+			}
+
+			return PANEL_PIXMAP_BACKGROUND;
+		}
+#endif
+		g_warning("Received pixmap background type, which is only supported on X11");
+		return PANEL_NO_BACKGROUND;
+	}
+
+	g_warning ("Unknown background type received");
+
+	return PANEL_NO_BACKGROUND;
+}
+
 MatePanelAppletBackgroundType
 mate_panel_applet_get_background (MatePanelApplet  *applet,
 				  GdkRGBA          *color,
 				  cairo_pattern_t **pattern)
 {
+	MatePanelAppletPrivate *priv;
+
 	g_return_val_if_fail (MATE_PANEL_IS_APPLET (applet), PANEL_NO_BACKGROUND);
 
 	/* initial sanity */
@@ -1500,6 +1952,10 @@ mate_panel_applet_get_background (MatePanelApplet  *applet,
 	if (color != NULL)
 		memset (color, 0, sizeof (GdkRGBA));
 
+	priv = mate_panel_applet_get_instance_private (applet);
+	if (priv->background_descriptor)
+		return mate_panel_applet_handle_background_descriptor (applet, color, pattern);
+
 	return mate_panel_applet_handle_background_string (applet, color, pattern);
 }
 
@@ -1514,16 +1970,99 @@ mate_panel_applet_set_background_string (MatePanelApplet *applet,
 	if (priv->background == background)
 		return;
 
-	if (g_strcmp0 (priv->background, background) == 0)
+	if (g_strcmp0 (priv->background, background) == 0 &&
+	    !priv->background_descriptor)
 		return;
 
 	g_free (priv->background);
 	priv->background = background ? g_strdup (background) : NULL;
+	g_clear_pointer (&priv->background_descriptor, g_variant_unref);
 	mate_panel_applet_handle_background (applet);
 
 	g_object_notify (G_OBJECT (applet), "background");
 }
 
+/* The string of the background property, for who reads it */
+static char *
+mate_panel_applet_background_descriptor_to_string (GVariant *descriptor)
+{
+	const char *type = NULL;
+	guint32     generation = 0;
+
+	g_variant_lookup (descriptor, "type", "&s", &type);
+	g_variant_lookup (descriptor, "generation", "u", &generation);
+
+	if (g_strcmp0 (type, "color") == 0) {
+		GdkRGBA  color = { 0., 0., 0., 0. };
+		char    *rgba;
+		char    *retval;
+
+		g_variant_lookup (descriptor, "color", "(dddd)",
+				  &color.red, &color.green, &color.blue, &color.alpha);
+		rgba = gdk_rgba_to_string (&color);
+		retval = g_strdup_printf ("color:%s", rgba);
+		g_free (rgba);
+
+		return retval;
+	} else if (g_strcmp0 (type, "pixmap") == 0) {
+		guint32 pixmap_id = 0;
+		gint32  x = 0, y = 0;
+		gint32  width = 0, height = 0;
+
+		g_variant_lookup (descriptor, "pixmap", "u", &pixmap_id);
+		g_variant_lookup (descriptor, "x", "i", &x);
+		g_variant_lookup (descriptor, "y", "i", &y);
+		g_variant_lookup (descriptor, "width", "i", &width);
+		g_variant_lookup (descriptor, "height", "i", &height);
+		return g_strdup_printf ("pixmap:%u,%d,%d,%d,%d,%u",
+					pixmap_id, x, y, width, height, generation);
+	}
+
+	return g_strdup ("none:");
+}
+
+/* Panels that know about it send the background as a dictionary rather
+ * than as a string, with a generation that changes with the background:
+ * when neither it nor our position in it changed there is nothing to
+ * redraw, and nothing to parse in any case. */
+static void
+mate_panel_applet_set_background_descriptor (MatePanelApplet *applet,
+					     GVariant        *descriptor)
+{
+	MatePanelAppletPrivate *priv;
+	guint32                 generation, old_generation;
+	gint32                  x, y, old_x, old_y;
+
+	priv = mate_panel_applet_get_instance_private (applet);
+
+	if (!descriptor ||
+	    !g_variant_lookup (descriptor, "generation", "u", &generation) ||
+	    !g_variant_lookup (descriptor, "x", "i", &x) ||
+	    !g_variant_lookup (descriptor, "y", "i", &y)) {
+		g_warning ("Invalid background descriptor received");
+		return;
+	}
+
+	if (priv->background_descriptor &&
+	    g_variant_lookup (priv->background_descriptor, "generation", "u", &old_generation) &&
+	    g_variant_lookup (priv->background_descriptor, "x", "i", &old_x) &&
+	    g_variant_lookup (priv->background_descriptor, "y", "i", &old_y) &&
+	    generation == old_generation && x == old_x && y == old_y)
+		return;
+
+	if (priv->background_descriptor)
+		g_variant_unref (priv->background_descriptor);
+	priv->background_descriptor = g_variant_ref_sink (descriptor);
+
+	g_free (priv->background);
+	priv->background = mate_panel_applet_background_descriptor_to_string (descriptor);
+
+	mate_panel_applet_handle_background (applet);
+
+	g_object_notify (G_OBJECT (applet), "background");
+	g_object_notify (G_OBJECT (applet), "background-descriptor");
+}
+
 static void
 mate_panel_applet_handle_background (MatePanelApplet *applet)
 {
@@ -1713,6 +2252,18 @@ mate_panel_applet_get_property (GObject    *object,
 		case PROP_LOCKED_DOWN:
 			g_value_set_boolean (value, priv->locked_down);
 			break;
+		case PROP_BACKGROUND_DESCRIPTOR:
+			g_value_set_variant (value, priv->background_descriptor);
+			break;
+		case PROP_POWER_PROFILE:
+			g_value_set_uint (value, priv->power_profile);
+			break;
+		case PROP_A11Y_ENABLED:
+			g_value_set_boolean (value, priv->a11y_enabled);
+			break;
+		case PROP_DOCK_WINDOW:
+			g_value_set_uint (value, priv->dock_window);
+			break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 	}
@@ -1775,6 +2326,18 @@ mate_panel_applet_set_property (GObject      *object,
 	case PROP_LOCKED_DOWN:
 		mate_panel_applet_set_locked_down (applet, g_value_get_boolean (value));
 		break;
+	case PROP_BACKGROUND_DESCRIPTOR:
+		mate_panel_applet_set_background_descriptor (applet, g_value_get_variant (value));
+		break;
+	case PROP_POWER_PROFILE:
+		mate_panel_applet_set_power_profile (applet, g_value_get_uint (value));
+		break;
+	case PROP_A11Y_ENABLED:
+		mate_panel_applet_set_a11y_enabled (applet, g_value_get_boolean (value));
+		break;
+	case PROP_DOCK_WINDOW:
+		priv->dock_window = g_value_get_uint (value);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 	}
@@ -1894,6 +2457,7 @@ mate_panel_applet_init (MatePanelApplet *applet)
 	priv->flags  = MATE_PANEL_APPLET_FLAGS_NONE;
 	priv->orient = MATE_PANEL_APPLET_ORIENT_UP;
 	priv->size   = 24;
+	priv->a11y_enabled = TRUE;
 
 	priv->panel_action_group = gtk_action_group_new ("PanelActions");
 	gtk_action_group_set_translation_domain (priv->panel_action_group, GETTEXT_PACKAGE);
@@ -1917,6 +2481,20 @@ mate_panel_applet_init (MatePanelApplet *applet)
 			       GDK_BUTTON_RELEASE_MASK);
 }
 
+#ifdef HAVE_X11
+/* the plug may have moved to another window of the panel */
+static void
+mate_panel_applet_plug_embedded (MatePanelApplet *applet)
+{
+	MatePanelAppletPrivate *priv;
+
+	priv = mate_panel_applet_get_instance_private (applet);
+
+	priv->found_dock_window_from = None;
+	priv->found_dock_window = None;
+}
+#endif
+
 static GObject *
 mate_panel_applet_constructor (GType                  type,
                           guint                  n_construct_properties,
@@ -1954,6 +2532,9 @@ mate_panel_applet_constructor (GType                  type,
 		g_signal_connect_swapped (priv->plug, "embedded",
 		                          G_CALLBACK (mate_panel_applet_setup),
 		                          applet);
+		g_signal_connect_swapped (priv->plug, "embedded",
+		                          G_CALLBACK (mate_panel_applet_plug_embedded),
+		                          applet);
 
 		gtk_container_add (GTK_CONTAINER (priv->plug), GTK_WIDGET (applet));
 	} else
@@ -1985,6 +2566,9 @@ mate_panel_applet_class_init (MatePanelAppletClass *klass)
 	GtkWidgetClass *widget_class = (GtkWidgetClass *) klass;
 	GtkBindingSet *binding_set;
 
+	if (g_getenv ("MATE_PANEL_APPLET_STATISTICS"))
+		applet_statistics_enabled = TRUE;
+
 	gobject_class->get_property = mate_panel_applet_get_property;
 	gobject_class->set_property = mate_panel_applet_set_property;
 	gobject_class->constructor = mate_panel_applet_constructor;
@@ -2095,6 +2679,39 @@ mate_panel_applet_class_init (MatePanelAppletClass *klass)
 							       "Whether Panel Applet is locked down",
 							       FALSE,
 							       G_PARAM_READWRITE));
+	g_object_class_install_property (gobject_class,
+					 PROP_BACKGROUND_DESCRIPTOR,
+					 g_param_spec_variant ("background-descriptor",
+							       "BackgroundDescriptor",
+							       "Panel Applet Background, as a dictionary",
+							       G_VARIANT_TYPE_VARDICT,
+							       NULL,
+							       G_PARAM_READWRITE));
+	g_object_class_install_property (gobject_class,
+					 PROP_POWER_PROFILE,
+					 g_param_spec_uint ("power-profile",
+							    "PowerProfile",
+							    "Power profile the panel runs with",
+							    MATE_PANEL_APPLET_POWER_PROFILE_NORMAL,
+							    MATE_PANEL_APPLET_POWER_PROFILE_LAST,
+							    MATE_PANEL_APPLET_POWER_PROFILE_NORMAL,
+							    G_PARAM_READWRITE));
+	/* on by default, for panels that do not know about it */
+	g_object_class_install_property (gobject_class,
+					 PROP_A11Y_ENABLED,
+					 g_param_spec_boolean ("a11y-enabled",
+							       "AccessibilityEnabled",
+							       "Whether an assistive technology is running",
+							       TRUE,
+							       G_PARAM_READWRITE));
+	/* 0 for panels that do not send it */
+	g_object_class_install_property (gobject_class,
+					 PROP_DOCK_WINDOW,
+					 g_param_spec_uint ("dock-window",
+							    "DockWindow",
+							    "The XID of the panel window",
+							    0, G_MAXUINT32, 0,
+							    G_PARAM_READWRITE));
 
 	mate_panel_applet_signals [CHANGE_ORIENT] =
                 g_signal_new ("change-orient",
@@ -2186,6 +2803,114 @@ button_press_event_new (MatePanelApplet *applet,
   return event;
 }
 
+static GDBusNodeInfo *introspection_data = NULL;
+
+static void
+mate_panel_applet_set_dbus_property (MatePanelApplet *applet,
+				     const gchar     *property_name,
+				     GVariant        *value)
+{
+	MatePanelAppletPrivate *priv;
+
+	priv = mate_panel_applet_get_instance_private (applet);
+	priv->n_property_sets++;
+
+	if (g_strcmp0 (property_name, "PrefsPath") == 0) {
+		mate_panel_applet_set_preferences_path (applet, g_variant_get_string (value, NULL));
+	} else if (g_strcmp0 (property_name, "Orient") == 0) {
+		mate_panel_applet_set_orient (applet, g_variant_get_uint32 (value));
+	} else if (g_strcmp0 (property_name, "Size") == 0) {
+		mate_panel_applet_set_size (applet, g_variant_get_uint32 (value));
+	} else if (g_strcmp0 (property_name, "Background") == 0) {
+		mate_panel_applet_set_background_string (applet, g_variant_get_string (value, NULL));
+	} else if (g_strcmp0 (property_name, "BackgroundDescriptor") == 0) {
+		mate_panel_applet_set_background_descriptor (applet, value);
+	} else if (g_strcmp0 (property_name, "Flags") == 0) {
+		mate_panel_applet_set_flags (applet, g_variant_get_uint32 (value));
+	} else if (g_strcmp0 (property_name, "SizeHints") == 0) {
+		const int *size_hints;
+		gsize      n_elements;
+
+		size_hints = g_variant_get_fixed_array (value, &n_elements, sizeof (gint32));
+		mate_panel_applet_set_size_hints (applet, size_hints, n_elements, 0);
+	} else if (g_strcmp0 (property_name, "Locked") == 0) {
+		mate_panel_applet_set_locked (applet, g_variant_get_boolean (value));
+	} else if (g_strcmp0 (property_name, "LockedDown") == 0) {
+		mate_panel_applet_set_locked_down (applet, g_variant_get_boolean (value));
+	} else if (g_strcmp0 (property_name, "PowerProfile") == 0) {
+		mate_panel_applet_set_power_profile (applet, g_variant_get_uint32 (value));
+	} else if (g_strcmp0 (property_name, "AccessibilityEnabled") == 0) {
+		mate_panel_applet_set_a11y_enabled (applet, g_variant_get_boolean (value));
+	} else if (g_strcmp0 (property_name, "DockWindow") == 0) {
+		g_object_set (applet, "dock-window", g_variant_get_uint32 (value), NULL);
+	}
+}
+
+/* The panel sends all the properties changed by one panel update in a
+ * single SetProperties call, so that the applet handles them together
+ * rather than going through a relayout for each of them. */
+static void
+mate_panel_applet_set_dbus_properties (MatePanelApplet *applet,
+				       GVariant        *properties)
+{
+	GDBusInterfaceInfo *interface_info = introspection_data->interfaces[0];
+	GVariantIter        iter;
+	const gchar        *property_name;
+	GVariant           *value;
+	MatePanelAppletPrivate *priv;
+
+	priv = mate_panel_applet_get_instance_private (applet);
+	priv->n_property_batches++;
+
+	g_object_freeze_notify (G_OBJECT (applet));
+
+	g_variant_iter_init (&iter, properties);
+	while (g_variant_iter_loop (&iter, "{&sv}", &property_name, &value)) {
+		GDBusPropertyInfo *info;
+
+		/* nothing checks the values for us, unlike with Set */
+		info = g_dbus_interface_info_lookup_property (interface_info, property_name);
+		if (!info ||
+		    !(info->flags & G_DBUS_PROPERTY_INFO_FLAGS_WRITABLE) ||
+		    g_strcmp0 (g_variant_get_type_string (value), info->signature) != 0) {
+			g_warning ("Ignoring invalid applet property %s", property_name);
+			continue;
+		}
+
+		mate_panel_applet_set_dbus_property (applet, property_name, value);
+	}
+
+	g_object_thaw_notify (G_OBJECT (applet));
+}
+
+/* What the applet cost since it was created: the draws of its content,
+ * with their times in microseconds once the statistics are enabled, its
+ * allocations, and its D-Bus traffic with the panel. Asking for them
+ * enables the statistics, so the first reply has no draw times. */
+static GVariant *
+mate_panel_applet_get_statistics (MatePanelApplet *applet)
+{
+	MatePanelAppletPrivate *priv;
+	GVariantBuilder         builder;
+
+	priv = mate_panel_applet_get_instance_private (applet);
+
+	applet_statistics_enabled = TRUE;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{st}"));
+	g_variant_builder_add (&builder, "{st}", "draws", priv->n_draws);
+	g_variant_builder_add (&builder, "{st}", "timed-draws", priv->n_timed_draws);
+	g_variant_builder_add (&builder, "{st}", "draw-us", priv->draw_time);
+	g_variant_builder_add (&builder, "{st}", "draw-max-us", priv->draw_max_time);
+	g_variant_builder_add (&builder, "{st}", "size-allocates", priv->n_size_allocates);
+	g_variant_builder_add (&builder, "{st}", "property-gets", priv->n_property_gets);
+	g_variant_builder_add (&builder, "{st}", "property-sets", priv->n_property_sets);
+	g_variant_builder_add (&builder, "{st}", "property-batches", priv->n_property_batches);
+	g_variant_builder_add (&builder, "{st}", "signals", priv->n_signals);
+
+	return g_variant_new ("(a{st})", &builder);
+}
+
 static void
 method_call_cb (GDBusConnection       *connection,
                 const gchar           *sender,
@@ -2209,6 +2934,17 @@ method_call_cb (GDBusConnection       *connection,
 		gdk_event_free (event);
 
 		g_dbus_method_invocation_return_value (invocation, NULL);
+	} else if (g_strcmp0 (method_name, "SetProperties") == 0) {
+		GVariant *properties;
+
+		properties = g_variant_get_child_value (parameters, 0);
+		mate_panel_applet_set_dbus_properties (applet, properties);
+		g_variant_unref (properties);
+
+		g_dbus_method_invocation_return_value (invocation, NULL);
+	} else if (g_strcmp0 (method_name, "GetStatistics") == 0) {
+		g_dbus_method_invocation_return_value (invocation,
+						       mate_panel_applet_get_statistics (applet));
 	}
 }
 
@@ -2225,6 +2961,7 @@ get_property_cb (GDBusConnection *connection,
 	GVariant *retval = NULL;
 
 	priv = mate_panel_applet_get_instance_private (MATE_PANEL_APPLET (user_data));
+	priv->n_property_gets++;
 
 	if (g_strcmp0 (property_name, "PrefsPath") == 0) {
 		retval = g_variant_new_string (priv->prefs_path ? priv->prefs_path : "");
@@ -2234,6 +2971,10 @@ get_property_cb (GDBusConnection *connection,
 		retval = g_variant_new_uint32 (priv->size);
 	} else if (g_strcmp0 (property_name, "Background") == 0) {
 		retval = g_variant_new_string (priv->background ? priv->background : "");
+	} else if (g_strcmp0 (property_name, "BackgroundDescriptor") == 0) {
+		retval = priv->background_descriptor ?
+			g_variant_ref (priv->background_descriptor) :
+			g_variant_new ("a{sv}", NULL);
 	} else if (g_strcmp0 (property_name, "Flags") == 0) {
 		retval = g_variant_new_uint32 (priv->flags);
 	} else if (g_strcmp0 (property_name, "SizeHints") == 0) {
@@ -2250,6 +2991,12 @@ get_property_cb (GDBusConnection *connection,
 		retval = g_variant_new_boolean (priv->locked);
 	} else if (g_strcmp0 (property_name, "LockedDown") == 0) {
 		retval = g_variant_new_boolean (priv->locked_down);
+	} else if (g_strcmp0 (property_name, "PowerProfile") == 0) {
+		retval = g_variant_new_uint32 (priv->power_profile);
+	} else if (g_strcmp0 (property_name, "AccessibilityEnabled") == 0) {
+		retval = g_variant_new_boolean (priv->a11y_enabled);
+	} else if (g_strcmp0 (property_name, "DockWindow") == 0) {
+		retval = g_variant_new_uint32 (priv->dock_window);
 	}
 
 	return retval;
@@ -2265,29 +3012,8 @@ set_property_cb (GDBusConnection *connection,
 		 GError         **error,
 		 gpointer         user_data)
 {
-	MatePanelApplet *applet = MATE_PANEL_APPLET (user_data);
-
-	if (g_strcmp0 (property_name, "PrefsPath") == 0) {
-		mate_panel_applet_set_preferences_path (applet, g_variant_get_string (value, NULL));
-	} else if (g_strcmp0 (property_name, "Orient") == 0) {
-		mate_panel_applet_set_orient (applet, g_variant_get_uint32 (value));
-	} else if (g_strcmp0 (property_name, "Size") == 0) {
-		mate_panel_applet_set_size (applet, g_variant_get_uint32 (value));
-	} else if (g_strcmp0 (property_name, "Background") == 0) {
-		mate_panel_applet_set_background_string (applet, g_variant_get_string (value, NULL));
-	} else if (g_strcmp0 (property_name, "Flags") == 0) {
-		mate_panel_applet_set_flags (applet, g_variant_get_uint32 (value));
-	} else if (g_strcmp0 (property_name, "SizeHints") == 0) {
-		const int *size_hints;
-		gsize      n_elements;
-
-		size_hints = g_variant_get_fixed_array (value, &n_elements, sizeof (gint32));
-		mate_panel_applet_set_size_hints (applet, size_hints, n_elements, 0);
-	} else if (g_strcmp0 (property_name, "Locked") == 0) {
-		mate_panel_applet_set_locked (applet, g_variant_get_boolean (value));
-	} else if (g_strcmp0 (property_name, "LockedDown") == 0) {
-		mate_panel_applet_set_locked_down (applet, g_variant_get_boolean (value));
-	}
+	mate_panel_applet_set_dbus_property (MATE_PANEL_APPLET (user_data),
+					     property_name, value);
 
 	return TRUE;
 }
@@ -2299,14 +3025,24 @@ static const gchar introspection_xml[] =
 	      "<arg name='button' type='u' direction='in'/>"
 	      "<arg name='time' type='u' direction='in'/>"
 	    "</method>"
+	    "<method name='SetProperties'>"
+	      "<arg name='properties' type='a{sv}' direction='in'/>"
+	    "</method>"
+	    "<method name='GetStatistics'>"
+	      "<arg name='statistics' type='a{st}' direction='out'/>"
+	    "</method>"
 	    "<property name='PrefsPath' type='s' access='readwrite'/>"
 	    "<property name='Orient' type='u' access='readwrite' />"
 	    "<property name='Size' type='u' access='readwrite'/>"
 	    "<property name='Background' type='s' access='readwrite'/>"
+	    "<property name='BackgroundDescriptor' type='a{sv}' access='readwrite'/>"
 	    "<property name='Flags' type='u' access='readwrite'/>"
 	    "<property name='SizeHints' type='ai' access='readwrite'/>"
 	    "<property name='Locked' type='b' access='readwrite'/>"
 	    "<property name='LockedDown' type='b' access='readwrite'/>"
+	    "<property name='PowerProfile' type='u' access='readwrite'/>"
+	    "<property name='AccessibilityEnabled' type='b' access='readwrite'/>"
+	    "<property name='DockWindow' type='u' access='readwrite'/>"
 	    "<signal name='Move' />"
 	    "<signal name='RemoveFromPanel' />"
 	    "<signal name='Lock' />"
@@ -2321,8 +3057,6 @@ static const GDBusInterfaceVTable interface_vtable = {
 	{ 0 }
 };
 
-static GDBusNodeInfo *introspection_data = NULL;
-
 static void
 mate_panel_applet_register_object (MatePanelApplet *applet)
 {
@@ -2348,6 +3082,31 @@ mate_panel_applet_register_object (MatePanelApplet *applet)
 	}
 }
 
+/* Factories of modules loaded by mate-panel-applet-host */
+static gboolean factory_hosted = FALSE;
+static guint    n_hosted_factories = 0;
+
+static void
+mate_panel_applet_factory_hosted_finalized (gpointer  data,
+					    GObject  *object)
+{
+	n_hosted_factories--;
+	if (n_hosted_factories == 0)
+		gtk_main_quit ();
+}
+
+void
+mate_panel_applet_factory_set_hosted (void)
+{
+	factory_hosted = TRUE;
+}
+
+guint
+mate_panel_applet_factory_get_n_hosted (void)
+{
+	return n_hosted_factories;
+}
+
 static void mate_panel_applet_factory_main_finalized(gpointer data, GObject* object)
 {
 	gtk_main_quit();
@@ -2424,6 +3183,11 @@ _mate_panel_applet_factory_main_internal (const gchar               *factory_id,
 	g_return_val_if_fail(callback != NULL, 1);
 	g_assert(g_type_is_a(applet_type, PANEL_TYPE_APPLET));
 
+	/* the host process embeds the applets of all its modules in the
+	 * panel, like separate applet processes */
+	if (factory_hosted)
+		out_process = TRUE;
+
 #ifdef HAVE_X11
 	if (GDK_IS_X11_DISPLAY (gdk_display_get_default ())) {
 		/*Use this both in and out of process as the tray applet always uses GtkSocket
@@ -2439,13 +3203,23 @@ _mate_panel_applet_factory_main_internal (const gchar               *factory_id,
 		}
 	}
 
+	/* in-process applets are watched with the panel */
+	if (out_process)
+		panel_stall_watch_init ();
+
 	closure = g_cclosure_new(G_CALLBACK(callback), user_data, NULL);
 	factory = mate_panel_applet_factory_new(factory_id, out_process,  applet_type, closure);
 	g_closure_unref(closure);
 
 	if (mate_panel_applet_factory_register_service(factory))
 	{
-		if (out_process)
+		if (factory_hosted)
+		{
+			/* the host runs the main loop for all its factories */
+			n_hosted_factories++;
+			g_object_weak_ref(G_OBJECT(factory), mate_panel_applet_factory_hosted_finalized, NULL);
+		}
+		else if (out_process)
 		{
 			g_object_weak_ref(G_OBJECT(factory), mate_panel_applet_factory_main_finalized, NULL);
 			gtk_main();
@@ -60,6 +60,15 @@ typedef enum {
 #define MATE_PANEL_APPLET_FLAGS_ALL (MATE_PANEL_APPLET_EXPAND_MAJOR|MATE_PANEL_APPLET_EXPAND_MINOR|MATE_PANEL_APPLET_HAS_HANDLE)
 } MatePanelAppletFlags;
 
+/* How much the applet may wake the computer up, set by the panel from
+ * the power profile of the user or from the state of the battery */
+typedef enum {
+    MATE_PANEL_APPLET_POWER_PROFILE_NORMAL,
+    MATE_PANEL_APPLET_POWER_PROFILE_BALANCED,
+    MATE_PANEL_APPLET_POWER_PROFILE_LOW_POWER
+#define MATE_PANEL_APPLET_POWER_PROFILE_LAST MATE_PANEL_APPLET_POWER_PROFILE_LOW_POWER
+} MatePanelAppletPowerProfile;
+
 typedef gboolean (*MatePanelAppletFactoryCallback) (MatePanelApplet *applet, const gchar *iid, gpointer user_data);
 
 struct _MatePanelAppletClass {
@@ -107,10 +116,20 @@ void                    mate_panel_applet_set_size_hints            (MatePanelAp
 
 gboolean                mate_panel_applet_get_locked_down           (MatePanelApplet    *applet);
 
+MatePanelAppletPowerProfile mate_panel_applet_get_power_profile     (MatePanelApplet    *applet);
+
+gboolean                mate_panel_applet_get_a11y_enabled          (MatePanelApplet    *applet);
+
 /* Does nothing when not on X11 */
 void                    mate_panel_applet_request_focus             (MatePanelApplet    *applet,
                                                                      guint32             timestamp);
 
+void                    mate_panel_applet_perf_count                (const gchar        *name,
+                                                                     guint64             delta);
+
+void                    mate_panel_applet_perf_record               (const gchar        *name,
+                                                                     gint64              value);
+
 void                    mate_panel_applet_setup_menu                (MatePanelApplet    *applet,
                                                                      const gchar        *xml,
                                                                      GtkActionGroup     *action_group);
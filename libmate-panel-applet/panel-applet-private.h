@@ -34,6 +34,11 @@ const gchar *mate_panel_applet_get_object_path   (MatePanelApplet *applet);
 GtkWidget   *mate_panel_applet_get_applet_widget (const gchar *factory_id,
                                               guint        uid);
 
+/* Used by mate-panel-applet-host, to run the factories of applet modules
+ * out of process. Returns the number of running factories. */
+void         mate_panel_applet_factory_set_hosted (void);
+guint        mate_panel_applet_factory_get_n_hosted (void);
+
 G_END_DECLS
 
 #endif
@@ -17,6 +17,8 @@
 
 #include <libpanel-util/panel-show.h>
 #include <libpanel-util/panel-gtk.h>
+#include <libpanel-util/panel-scheduler.h>
+#include <libpanel-util/panel-trace.h>
 
 #include "button-widget.h"
 #include "drawer.h"
@@ -28,12 +30,14 @@
 #include "panel-menu-bar.h"
 #include "panel-separator.h"
 #include "panel-toplevel.h"
+#include "panel-arena.h"
 #include "panel-util.h"
 #include "panel-profile.h"
 #include "panel-menu-button.h"
 #include "panel-globals.h"
 #include "panel-properties-dialog.h"
 #include "panel-lockdown.h"
+#include "panel-layout-snapshot.h"
 #include "panel-schemas.h"
 
 static GSList *registered_applets = NULL;
@@ -713,7 +717,11 @@ mate_panel_applet_destroy (GtkWidget  *widget,
 {
 	g_return_if_fail (info != NULL);
 
+	/* the settings are shared with the other users of the same path, and
+	 * outlive the applet: what was connected for it goes away now */
 	g_signal_handlers_disconnect_by_data(info->settings,widget);
+	if (info->data)
+		g_signal_handlers_disconnect_by_data (info->settings, info->data);
 
 	info->widget = NULL;
 
@@ -759,8 +767,8 @@ mate_panel_applet_destroy (GtkWidget  *widget,
 
 	mate_panel_applet_clear_user_menu (info);
 
-	g_free (info->id);
-	g_free (info);
+	panel_arena_free (info->id);
+	panel_arena_free (info);
 }
 
 typedef struct {
@@ -776,12 +784,17 @@ typedef struct {
  * mate_panel_applet_queue_initial_unhide_toplevels() should be called */
 static GSList  *mate_panel_applets_to_load = NULL;
 static GSList  *mate_panel_applets_loading = NULL;
+/* Applets waiting for their toplevel to be shown for the first time */
+static GSList  *mate_panel_applets_deferred = NULL;
 /* We have a timeout to always unhide toplevels after a delay, in case of some
  * blocking applet */
 #define         UNHIDE_TOPLEVELS_TIMEOUT_SECONDS 5
 static guint    mate_panel_applet_unhide_toplevels_timeout = 0;
 
 static gboolean mate_panel_applet_have_load_idle = FALSE;
+static gboolean mate_panel_applet_initial_load = FALSE;
+
+static gboolean mate_panel_applet_load_idle_handler (gpointer dummy);
 
 static void
 free_applet_to_load (MatePanelAppletToLoad *applet)
@@ -805,6 +818,11 @@ mate_panel_applet_on_load_queue (const char *id)
 		if (strcmp (applet->id, id) == 0)
 			return TRUE;
 	}
+	for (li = mate_panel_applets_deferred; li != NULL; li = li->next) {
+		MatePanelAppletToLoad *applet = li->data;
+		if (strcmp (applet->id, id) == 0)
+			return TRUE;
+	}
 	return FALSE;
 }
 
@@ -825,6 +843,62 @@ mate_panel_applet_queue_initial_unhide_toplevels (gpointer user_data)
 	return FALSE;
 }
 
+/* Called each time both loading lists get empty */
+static void
+mate_panel_applet_loading_done (void)
+{
+	panel_trace_instant ("applet", "all objects loaded");
+	panel_trace_write ();
+
+	/* unhide any potential initially hidden toplevel */
+	mate_panel_applet_queue_initial_unhide_toplevels (NULL);
+
+	panel_layout_snapshot_release ();
+}
+
+static void
+mate_panel_applet_queue_load_idle (void)
+{
+	if (mate_panel_applet_have_load_idle)
+		return;
+
+	/* on panel startup, we don't care about redraws of the
+	 * toplevels since they are hidden, so we give a higher
+	 * priority to loading of applets */
+	panel_scheduler_add (mate_panel_applet_initial_load ?
+			     PANEL_SCHEDULER_PRIORITY_HIGH :
+			     PANEL_SCHEDULER_PRIORITY_DEFAULT,
+			     "applet-load",
+			     mate_panel_applet_load_idle_handler,
+			     NULL, NULL);
+
+	mate_panel_applet_have_load_idle = TRUE;
+}
+
+/* Number of out-of-process applets whose activation is still pending */
+static guint
+mate_panel_applet_get_n_activating (void)
+{
+	GSList *l;
+	guint   n = 0;
+
+	for (l = mate_panel_applets_loading; l; l = l->next) {
+		MatePanelAppletToLoad *applet = l->data;
+
+		if (applet->type == PANEL_OBJECT_APPLET)
+			n++;
+	}
+
+	return n;
+}
+
+/* Whether some applets of the layout are not loaded yet */
+gboolean
+mate_panel_applet_is_loading (void)
+{
+	return mate_panel_applets_loading != NULL || mate_panel_applets_to_load != NULL;
+}
+
 void
 mate_panel_applet_stop_loading (const char *id)
 {
@@ -846,48 +920,132 @@ mate_panel_applet_stop_loading (const char *id)
 	}
 
 	if (mate_panel_applets_loading == NULL && mate_panel_applets_to_load == NULL)
-		mate_panel_applet_queue_initial_unhide_toplevels (NULL);
+		mate_panel_applet_loading_done ();
+	else if (mate_panel_applets_to_load != NULL)
+		/* we might have been waiting for a free activation slot */
+		mate_panel_applet_queue_load_idle ();
 }
 
 static gboolean
-mate_panel_applet_load_idle_handler (gpointer dummy)
+mate_panel_applet_load_deferred_idle (PanelToplevel *toplevel)
 {
-	PanelObjectType    applet_type;
-	MatePanelAppletToLoad *applet = NULL;
-	PanelToplevel     *toplevel = NULL;
-	PanelWidget       *panel_widget;
-	GSList            *l;
+	const char *toplevel_id;
+	GSList     *l, *next;
 
-	if (!mate_panel_applets_to_load) {
-		mate_panel_applet_have_load_idle = FALSE;
+	/* The initial animation of auto-hidden toplevels unhides and hides
+	 * them right away: only load the applets if we're still visible */
+	if (panel_toplevel_get_is_hidden (toplevel)) {
+		g_object_unref (toplevel);
 		return FALSE;
 	}
 
-	for (l = mate_panel_applets_to_load; l; l = l->next) {
-		applet = l->data;
+	toplevel_id = panel_profile_get_toplevel_id (toplevel);
 
-		toplevel = panel_profile_get_toplevel_by_id (applet->toplevel_id);
-		if (toplevel)
-			break;
+	for (l = mate_panel_applets_deferred; l; l = next) {
+		MatePanelAppletToLoad *applet = l->data;
+
+		next = l->next;
+
+		if (g_strcmp0 (applet->toplevel_id, toplevel_id) != 0)
+			continue;
+
+		mate_panel_applets_deferred = g_slist_delete_link (mate_panel_applets_deferred, l);
+		mate_panel_applets_to_load = g_slist_prepend (mate_panel_applets_to_load, applet);
 	}
 
-	if (!l) {
-		/* All the remaining applets don't have a panel */
-		for (l = mate_panel_applets_to_load; l; l = l->next)
-			free_applet_to_load (l->data);
-		g_slist_free (mate_panel_applets_to_load);
-		mate_panel_applets_to_load = NULL;
-		mate_panel_applet_have_load_idle = FALSE;
-
-		if (mate_panel_applets_loading == NULL) {
-			/* unhide any potential initially hidden toplevel */
-			mate_panel_applet_queue_initial_unhide_toplevels (NULL);
-		}
+	g_signal_handlers_disconnect_by_data (toplevel, &mate_panel_applets_deferred);
+	g_object_unref (toplevel);
 
-		return FALSE;
+	mate_panel_applet_load_queued_applets (FALSE);
+
+	return FALSE;
+}
+
+static void
+mate_panel_applet_deferred_toplevel_unhiding (PanelToplevel *toplevel)
+{
+	panel_scheduler_add (PANEL_SCHEDULER_PRIORITY_DEFAULT,
+			     "applet-load-deferred",
+			     (GSourceFunc) mate_panel_applet_load_deferred_idle,
+			     g_object_ref (toplevel), NULL);
+}
+
+static void
+mate_panel_applet_deferred_toplevel_destroyed (PanelToplevel *toplevel)
+{
+	const char *toplevel_id;
+	GSList     *l, *next;
+
+	toplevel_id = panel_profile_get_toplevel_id (toplevel);
+
+	for (l = mate_panel_applets_deferred; l; l = next) {
+		MatePanelAppletToLoad *applet = l->data;
+
+		next = l->next;
+
+		if (g_strcmp0 (applet->toplevel_id, toplevel_id) != 0)
+			continue;
+
+		mate_panel_applets_deferred = g_slist_delete_link (mate_panel_applets_deferred, l);
+		free_applet_to_load (applet);
 	}
+}
 
-	mate_panel_applets_to_load = g_slist_delete_link (mate_panel_applets_to_load, l);
+/* Applets on auto-hidden toplevels and in drawers are not visible at login:
+ * if the user asked for it, we wait for the toplevel to be shown before
+ * activating them */
+static gboolean
+mate_panel_applet_should_defer (MatePanelAppletToLoad *applet,
+				PanelToplevel         *toplevel)
+{
+	if (applet->type != PANEL_OBJECT_APPLET)
+		return FALSE;
+
+	if (!panel_global_config_get_lazy_load_hidden_applets ())
+		return FALSE;
+
+	if (!panel_toplevel_get_auto_hide (toplevel) &&
+	    !panel_toplevel_get_is_attached (toplevel))
+		return FALSE;
+
+	return panel_toplevel_get_is_hidden (toplevel) ||
+	       !gtk_widget_get_mapped (GTK_WIDGET (toplevel));
+}
+
+static void
+mate_panel_applet_defer (GSList        *link,
+			 PanelToplevel *toplevel)
+{
+	MatePanelAppletToLoad *applet = link->data;
+
+	mate_panel_applets_to_load = g_slist_delete_link (mate_panel_applets_to_load, link);
+	mate_panel_applets_deferred = g_slist_prepend (mate_panel_applets_deferred, applet);
+
+	if (g_signal_handler_find (toplevel, G_SIGNAL_MATCH_DATA,
+				   0, 0, NULL, NULL,
+				   &mate_panel_applets_deferred) != 0)
+		return;
+
+	g_signal_connect_data (toplevel, "unhiding",
+			       G_CALLBACK (mate_panel_applet_deferred_toplevel_unhiding),
+			       &mate_panel_applets_deferred, NULL,
+			       G_CONNECT_SWAPPED);
+	g_signal_connect_data (toplevel, "destroy",
+			       G_CALLBACK (mate_panel_applet_deferred_toplevel_destroyed),
+			       &mate_panel_applets_deferred, NULL,
+			       G_CONNECT_SWAPPED);
+}
+
+/* Returns TRUE if the object is an applet being activated asynchronously */
+static gboolean
+mate_panel_applet_load_object (GSList        *link,
+			       PanelToplevel *toplevel)
+{
+	PanelObjectType    applet_type;
+	MatePanelAppletToLoad *applet = link->data;
+	PanelWidget       *panel_widget;
+
+	mate_panel_applets_to_load = g_slist_delete_link (mate_panel_applets_to_load, link);
 	mate_panel_applets_loading = g_slist_append (mate_panel_applets_loading, applet);
 
 	panel_widget = panel_toplevel_get_panel_widget (toplevel);
@@ -962,12 +1120,75 @@ mate_panel_applet_load_idle_handler (gpointer dummy)
 	}
 
 	/* Only the real applets will do a late stop_loading */
-	if (applet_type != PANEL_OBJECT_APPLET)
+	if (applet_type != PANEL_OBJECT_APPLET) {
 		mate_panel_applet_stop_loading (applet->id);
+		return FALSE;
+	}
 
 	return TRUE;
 }
 
+static gboolean
+mate_panel_applet_load_idle_handler (gpointer dummy)
+{
+	guint max_activating;
+
+	max_activating = panel_global_config_get_max_loading_applets ();
+
+	/* Out-of-process applets only cost us a D-Bus call here, so we start
+	 * as many activations as allowed in one go and let the factories run
+	 * in parallel. The other objects are built synchronously: we create
+	 * them until the slice of the scheduler is spent, to keep the main
+	 * loop responsive. */
+	while (mate_panel_applets_to_load) {
+		MatePanelAppletToLoad *applet = NULL;
+		PanelToplevel     *toplevel = NULL;
+		GSList            *l;
+
+		for (l = mate_panel_applets_to_load; l; l = l->next) {
+			applet = l->data;
+
+			toplevel = panel_profile_get_toplevel_by_id (applet->toplevel_id);
+			if (toplevel)
+				break;
+		}
+
+		if (!l) {
+			/* All the remaining applets don't have a panel */
+			for (l = mate_panel_applets_to_load; l; l = l->next)
+				free_applet_to_load (l->data);
+			g_slist_free (mate_panel_applets_to_load);
+			mate_panel_applets_to_load = NULL;
+			mate_panel_applet_have_load_idle = FALSE;
+
+			if (mate_panel_applets_loading == NULL)
+				mate_panel_applet_loading_done ();
+
+			return FALSE;
+		}
+
+		if (mate_panel_applet_should_defer (applet, toplevel)) {
+			mate_panel_applet_defer (l, toplevel);
+			continue;
+		}
+
+		if (applet->type == PANEL_OBJECT_APPLET &&
+		    max_activating > 0 &&
+		    mate_panel_applet_get_n_activating () >= max_activating) {
+			/* mate_panel_applet_stop_loading() will requeue us */
+			mate_panel_applet_have_load_idle = FALSE;
+			return FALSE;
+		}
+
+		if (!mate_panel_applet_load_object (l, toplevel) &&
+		    panel_scheduler_should_yield ())
+			return TRUE;
+	}
+
+	mate_panel_applet_have_load_idle = FALSE;
+	return FALSE;
+}
+
 void
 mate_panel_applet_queue_applet_to_load (const char      *id,
 				   PanelObjectType  type,
@@ -1001,6 +1222,11 @@ mate_panel_applet_compare (const MatePanelAppletToLoad *a,
 {
 	int c;
 
+	/* Drawers come first, so that we know which toplevels are attached
+	 * when deciding whether their applets can be loaded later */
+	if ((a->type == PANEL_OBJECT_DRAWER) != (b->type == PANEL_OBJECT_DRAWER))
+		return a->type == PANEL_OBJECT_DRAWER ? -1 : 1;
+
 	if ((c = strcmp (a->toplevel_id, b->toplevel_id)))
 		return c;
 	else if (a->right_stick != b->right_stick)
@@ -1013,7 +1239,7 @@ void
 mate_panel_applet_load_queued_applets (gboolean initial_load)
 {
 	if (!mate_panel_applets_to_load) {
-		mate_panel_applet_queue_initial_unhide_toplevels (NULL);
+		mate_panel_applet_loading_done ();
 		return;
 	}
 
@@ -1029,19 +1255,8 @@ mate_panel_applet_load_queued_applets (gboolean initial_load)
 	mate_panel_applets_to_load = g_slist_sort (mate_panel_applets_to_load,
 					      (GCompareFunc) mate_panel_applet_compare);
 
-	if ( ! mate_panel_applet_have_load_idle) {
-		/* on panel startup, we don't care about redraws of the
-		 * toplevels since they are hidden, so we give a higher
-		 * priority to loading of applets */
-		if (initial_load)
-			g_idle_add_full (G_PRIORITY_HIGH_IDLE,
-					 mate_panel_applet_load_idle_handler,
-					 NULL, NULL);
-		else
-			g_idle_add (mate_panel_applet_load_idle_handler, NULL);
-
-		mate_panel_applet_have_load_idle = TRUE;
-	}
+	mate_panel_applet_initial_load = (initial_load != FALSE);
+	mate_panel_applet_queue_load_idle ();
 }
 
 static const char* mate_panel_applet_get_toplevel_id(AppletInfo* applet)
@@ -1066,14 +1281,23 @@ mate_panel_applet_position_save_timeout (gpointer dummy)
 {
 	GSList *l;
 
+	/* an applet being dragged moves all the time: save everything once
+	 * the drag is over */
+	if (mate_panel_applet_is_in_drag ())
+		return TRUE;
+
 	queued_position_source = 0;
 
+	panel_profile_journal_begin ();
+
 	for (l = queued_position_saves; l; l = l->next) {
 		AppletInfo *info = l->data;
 
 		mate_panel_applet_save_position (info, info->id, TRUE);
 	}
 
+	panel_profile_journal_end ();
+
 	g_slist_free (queued_position_saves);
 	queued_position_saves = NULL;
 
@@ -1086,6 +1310,7 @@ mate_panel_applet_save_position (AppletInfo *applet_info,
 			    gboolean    immediate)
 {
 	PanelWidget       *panel_widget;
+	GSettings         *writer;
 	const char        *toplevel_id;
 	char              *old_toplevel_id;
 	gboolean           right_stick;
@@ -1112,13 +1337,14 @@ mate_panel_applet_save_position (AppletInfo *applet_info,
 		return;
 
 	panel_widget = mate_panel_applet_get_panel_widget (applet_info);
+	writer = panel_profile_journal_settings (applet_info->settings);
 
 	/* FIXME: Instead of getting keys, comparing and setting, there
 	   should be a dirty flag */
 
 	old_toplevel_id = g_settings_get_string (applet_info->settings, PANEL_OBJECT_TOPLEVEL_ID_KEY);
 	if (old_toplevel_id == NULL || strcmp (old_toplevel_id, toplevel_id) != 0)
-		g_settings_set_string (applet_info->settings, PANEL_OBJECT_TOPLEVEL_ID_KEY, toplevel_id);
+		g_settings_set_string (writer, PANEL_OBJECT_TOPLEVEL_ID_KEY, toplevel_id);
 	g_free (old_toplevel_id);
 
 	/* Note: changing some properties of the panel that may not be locked down
@@ -1128,7 +1354,7 @@ mate_panel_applet_save_position (AppletInfo *applet_info,
 
 	locked = panel_widget_get_applet_locked (panel_widget, applet_info->widget) ? 1 : 0;
 	if (g_settings_get_boolean (applet_info->settings, PANEL_OBJECT_LOCKED_KEY) ? 1 : 0 != locked)
-		g_settings_set_boolean (applet_info->settings, PANEL_OBJECT_LOCKED_KEY, locked);
+		g_settings_set_boolean (writer, PANEL_OBJECT_LOCKED_KEY, locked);
 
 	if (locked) {
 		/* Until position calculations are refactored to fix the issue of the panel applets
@@ -1140,7 +1366,7 @@ mate_panel_applet_save_position (AppletInfo *applet_info,
 	right_stick = panel_is_applet_right_stick (applet_info->widget) ? 1 : 0;
 	if (g_settings_is_writable (applet_info->settings, PANEL_OBJECT_PANEL_RIGHT_STICK_KEY) &&
 	    (g_settings_get_boolean (applet_info->settings, PANEL_OBJECT_PANEL_RIGHT_STICK_KEY) ? 1 : 0) != right_stick)
-		g_settings_set_boolean (applet_info->settings, PANEL_OBJECT_PANEL_RIGHT_STICK_KEY, right_stick);
+		g_settings_set_boolean (writer, PANEL_OBJECT_PANEL_RIGHT_STICK_KEY, right_stick);
 
 	position = mate_panel_applet_get_position (applet_info);
 	if (right_stick && !panel_widget->packed)
@@ -1148,7 +1374,7 @@ mate_panel_applet_save_position (AppletInfo *applet_info,
 
 	if (g_settings_is_writable (applet_info->settings, PANEL_OBJECT_POSITION_KEY) &&
 	    g_settings_get_int (applet_info->settings, PANEL_OBJECT_POSITION_KEY) != position)
-		g_settings_set_int (applet_info->settings, PANEL_OBJECT_POSITION_KEY, position);
+		g_settings_set_int (writer, PANEL_OBJECT_POSITION_KEY, position);
 }
 
 const char *
@@ -1231,18 +1457,23 @@ mate_panel_applet_register (GtkWidget       *applet,
 		       const char      *id)
 {
 	AppletInfo *info;
+	PanelArena *arena;
 	gchar *path;
 	gchar *locked_changed;
 
 	g_return_val_if_fail (applet != NULL && panel != NULL, NULL);
 
-	if (gtk_widget_get_has_window (applet))
+	/* separators only have an input window */
+	if (gtk_widget_get_has_window (applet) || PANEL_IS_SEPARATOR (applet))
 		gtk_widget_set_events (applet, (gtk_widget_get_events (applet) |
 						APPLET_EVENT_MASK) &
 				       ~( GDK_POINTER_MOTION_MASK |
 					  GDK_POINTER_MOTION_HINT_MASK));
 
-	info = g_new0 (AppletInfo, 1);
+	/* freed in mate_panel_applet_destroy(), wherever the applet is then */
+	arena = panel_arena_get (panel->toplevel);
+
+	info = panel_arena_new0 (arena, AppletInfo);
 	info->type         = type;
 	info->widget       = applet;
 	info->menu         = NULL;
@@ -1250,10 +1481,10 @@ mate_panel_applet_register (GtkWidget       *applet,
 	info->data_destroy = data_destroy;
 	info->user_menu    = NULL;
 	info->move_item    = NULL;
-	info->id           = g_strdup (id);
+	info->id           = panel_arena_strdup (arena, id);
 
 	path = g_strdup_printf (PANEL_OBJECT_PATH "%s/", id);
-	info->settings = g_settings_new_with_path (PANEL_OBJECT_SCHEMA, path);
+	info->settings = panel_profile_get_settings (PANEL_OBJECT_SCHEMA, path);
 	g_free (path);
 
 	g_object_set_data (G_OBJECT (applet), "applet_info", info);
@@ -1306,6 +1537,7 @@ mate_panel_applet_register (GtkWidget       *applet,
 	}
 
 	if (BUTTON_IS_WIDGET (applet) ||
+	    PANEL_IS_SEPARATOR (applet) ||
 	    gtk_widget_get_has_window (applet)) {
 		g_signal_connect (applet, "button-press-event",
 				  G_CALLBACK (applet_button_press),
@@ -57,6 +57,7 @@ AppletInfo *mate_panel_applet_register    (GtkWidget       *applet,
 				      PanelObjectType  type,
 				      const char      *id);
 void mate_panel_applet_stop_loading (const char *id);
+gboolean mate_panel_applet_is_loading (void);
 
 const char *mate_panel_applet_get_id           (AppletInfo      *info);
 const char *mate_panel_applet_get_id_by_widget (GtkWidget       *widget);
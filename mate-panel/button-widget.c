@@ -7,6 +7,12 @@
 #include <gdk/gdk.h>
 #include <gdk/gdkx.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #include "button-widget.h"
 #include "panel-widget.h"
 #include "panel-types.h"
@@ -17,12 +23,35 @@
 #include "panel-globals.h"
 #include "panel-enums.h"
 #include "panel-enums-gsettings.h"
+#include "panel-theme.h"
+
+/* What the button looks like in a given state, rendered once and then
+ * blitted on each draw as long as the button keeps its size. */
+typedef enum {
+    BUTTON_RENDER_NORMAL,
+    BUTTON_RENDER_PRELIT,
+    BUTTON_RENDER_PRESSED,
+    BUTTON_RENDER_LAST
+} ButtonRenderState;
+
+typedef struct {
+    cairo_surface_t  *surface;
+    int               width;
+    int               height;
+    int               scale;
+    PanelOrientation  orientation;
+    GtkStateFlags     state_flags;
+    guint             arrow         : 1;
+    guint             dnd_highlight : 1;
+} ButtonRenderCache;
 
 struct _ButtonWidgetPrivate {
     GtkIconTheme     *icon_theme;
     cairo_surface_t  *surface;
     cairo_surface_t  *surface_hc;
 
+    ButtonRenderCache render_cache[BUTTON_RENDER_LAST];
+
     char             *filename;
 
     PanelOrientation  orientation;
@@ -36,7 +65,7 @@ struct _ButtonWidgetPrivate {
     gboolean          needs_move;
 };
 
-static void button_widget_icon_theme_changed (ButtonWidget *button);
+static void button_widget_theme_changed (ButtonWidget *button);
 static void button_widget_reload_surface (ButtonWidget *button);
 
 enum {
@@ -53,18 +82,42 @@ enum {
 
 G_DEFINE_TYPE_WITH_PRIVATE (ButtonWidget, button_widget, GTK_TYPE_BUTTON)
 
-/* colorshift a surface */
+/* colorshift a surface
+ *
+ * Image surfaces always use 32 bits per pixel, with the alpha (or unused)
+ * channel in the most significant byte of the native endian word: the
+ * color channels are shifted with saturation and the alpha channel is
+ * copied unchanged. When the compiler targets SSE2 or NEON, 4 pixels are
+ * handled at a time.
+ */
+static inline guint32
+colorshift_pixel (guint32 pixel, int shift)
+{
+    guint32 result = pixel & 0xff000000;
+    int     c;
+
+    for (c = 0; c < 24; c += 8) {
+        int val = ((pixel >> c) & 0xff) + shift;
+        result |= (guint32) CLAMP (val, 0, 255) << c;
+    }
+
+    return result;
+}
+
 static void
 do_colorshift (cairo_surface_t *dest, cairo_surface_t *src, int shift)
 {
     gint    i, j;
-    gint    width, height, has_alpha, srcrowstride, destrowstride;
+    gint    width, height, srcrowstride, destrowstride;
     guchar *target_pixels;
     guchar *original_pixels;
-    int     val;
-    guchar  r,g,b;
+    guint32 amount;
+
+    shift = CLAMP (shift, -255, 255);
+    amount = (guint32) ABS (shift) * 0x00010101;
+
+    cairo_surface_flush (src);
 
-    has_alpha = cairo_surface_get_content (src) != CAIRO_CONTENT_COLOR;
     width = cairo_image_surface_get_width (src);
     height = cairo_image_surface_get_height (src);
     srcrowstride = cairo_image_surface_get_stride (src);
@@ -73,22 +126,38 @@ do_colorshift (cairo_surface_t *dest, cairo_surface_t *src, int shift)
     target_pixels = cairo_image_surface_get_data (dest);
 
     for (i = 0; i < height; i++) {
-        guchar *pixdest = target_pixels + i*destrowstride;
-        guchar *pixsrc = original_pixels + i*srcrowstride;
-        for (j = 0; j < width; j++) {
-            r = *(pixsrc++);
-            g = *(pixsrc++);
-            b = *(pixsrc++);
-            val = r + shift;
-            *(pixdest++) = CLAMP(val, 0, 255);
-            val = g + shift;
-            *(pixdest++) = CLAMP(val, 0, 255);
-            val = b + shift;
-            *(pixdest++) = CLAMP(val, 0, 255);
-            if (has_alpha)
-                *(pixdest++) = *(pixsrc++);
+        guint32 *pixdest = (guint32 *) (target_pixels + i*destrowstride);
+        guint32 *pixsrc = (guint32 *) (original_pixels + i*srcrowstride);
+
+        j = 0;
+#if defined(__SSE2__)
+        {
+            __m128i v_amount = _mm_set1_epi32 ((int) amount);
+
+            for (; j + 4 <= width; j += 4) {
+                __m128i v = _mm_loadu_si128 ((const __m128i *) (pixsrc + j));
+                v = shift >= 0 ? _mm_adds_epu8 (v, v_amount) : _mm_subs_epu8 (v, v_amount);
+                _mm_storeu_si128 ((__m128i *) (pixdest + j), v);
+            }
+        }
+#elif defined(__ARM_NEON) && G_BYTE_ORDER == G_LITTLE_ENDIAN
+        {
+            uint8x16_t v_amount = vreinterpretq_u8_u32 (vdupq_n_u32 (amount));
+
+            for (; j + 4 <= width; j += 4) {
+                uint8x16_t v = vld1q_u8 ((const uint8_t *) (pixsrc + j));
+                v = shift >= 0 ? vqaddq_u8 (v, v_amount) : vqsubq_u8 (v, v_amount);
+                vst1q_u8 ((uint8_t *) (pixdest + j), v);
+            }
         }
+#else
+        (void) amount;
+#endif
+        for (; j < width; j++)
+            pixdest[j] = colorshift_pixel (pixsrc[j], shift);
     }
+
+    cairo_surface_mark_dirty (dest);
 }
 
 static cairo_surface_t *
@@ -115,6 +184,16 @@ make_hc_surface (cairo_surface_t *surface)
     return new;
 }
 
+static void
+button_widget_clear_render_cache (ButtonWidget *button)
+{
+    int i;
+
+    for (i = 0; i < BUTTON_RENDER_LAST; i++)
+        g_clear_pointer (&button->priv->render_cache[i].surface,
+                         cairo_surface_destroy);
+}
+
 static void
 button_widget_realize(GtkWidget *widget)
 {
@@ -125,11 +204,7 @@ button_widget_realize(GtkWidget *widget)
     GTK_WIDGET_CLASS (button_widget_parent_class)->realize (widget);
 
     BUTTON_WIDGET (widget)->priv->icon_theme = gtk_icon_theme_get_for_screen (gtk_widget_get_screen (widget));
-    g_signal_connect_object (BUTTON_WIDGET (widget)->priv->icon_theme,
-                             "changed",
-                             G_CALLBACK (button_widget_icon_theme_changed),
-                             widget,
-                             G_CONNECT_SWAPPED);
+    panel_theme_notify_add (G_CALLBACK (button_widget_theme_changed), widget);
 
     button_widget_reload_surface (BUTTON_WIDGET (widget));
 }
@@ -137,16 +212,26 @@ button_widget_realize(GtkWidget *widget)
 static void
 button_widget_unrealize (GtkWidget *widget)
 {
-    g_signal_handlers_disconnect_by_func (BUTTON_WIDGET (widget)->priv->icon_theme,
-                                          G_CALLBACK (button_widget_icon_theme_changed),
-                                          widget);
+    panel_theme_notify_remove (G_CALLBACK (button_widget_theme_changed), widget);
+
+    button_widget_clear_render_cache (BUTTON_WIDGET (widget));
 
     GTK_WIDGET_CLASS (button_widget_parent_class)->unrealize (widget);
 }
 
+static void
+button_widget_style_updated (GtkWidget *widget)
+{
+    GTK_WIDGET_CLASS (button_widget_parent_class)->style_updated (widget);
+
+    button_widget_clear_render_cache (BUTTON_WIDGET (widget));
+}
+
 static void
 button_widget_unset_surfaces (ButtonWidget *button)
 {
+    button_widget_clear_render_cache (button);
+
     if (button->priv->surface)
         cairo_surface_destroy (button->priv->surface);
 
@@ -158,6 +243,226 @@ button_widget_unset_surfaces (ButtonWidget *button)
     button->priv->surface_hc = NULL;
 }
 
+/* Icons are shared between all the buttons: most launchers use icons of
+ * the same size, and several buttons often use the same icon. The cache
+ * does not own the surfaces, an entry goes away with the last button
+ * using it. */
+
+typedef enum {
+    BUTTON_ICON_NORMAL,
+    BUTTON_ICON_HIGH_CONTRAST
+} ButtonIconVariant;
+
+typedef struct {
+    char            *key;
+    cairo_surface_t *surface;
+    gboolean         needs_move;
+} ButtonIconCacheEntry;
+
+static GHashTable *icon_cache = NULL;
+static guint       icon_cache_generation = 0;
+
+/* The icons of the scale the buttons just left are kept for a while, and
+ * so is their cache entry: dragging a panel between monitors of different
+ * scales, or undocking and docking again, finds them there */
+#define BUTTON_ICON_RETIRE_SECONDS 30
+
+static GPtrArray  *retired_icons = NULL;
+static guint       retired_icons_timeout = 0;
+static const cairo_user_data_key_t icon_cache_entry_key;
+
+static char *
+button_icon_cache_make_key (ButtonWidget      *button,
+                            int                scale,
+                            ButtonIconVariant  variant)
+{
+    return g_strdup_printf ("%d:%d:%d:%d:%s",
+                            button->priv->size, scale,
+                            button->priv->orientation & PANEL_VERTICAL_MASK ? 1 : 0,
+                            variant,
+                            button->priv->filename);
+}
+
+static void
+button_icon_cache_entry_free (ButtonIconCacheEntry *entry)
+{
+    if (icon_cache != NULL &&
+        g_hash_table_lookup (icon_cache, entry->key) == entry->surface)
+        g_hash_table_remove (icon_cache, entry->key);
+
+    g_free (entry->key);
+    g_free (entry);
+}
+
+static cairo_surface_t *
+button_icon_cache_lookup (ButtonWidget      *button,
+                          int                scale,
+                          ButtonIconVariant  variant,
+                          gboolean          *needs_move)
+{
+    cairo_surface_t      *surface;
+    ButtonIconCacheEntry *entry;
+    char                 *key;
+
+    if (icon_cache == NULL)
+        return NULL;
+
+    key = button_icon_cache_make_key (button, scale, variant);
+    surface = g_hash_table_lookup (icon_cache, key);
+    g_free (key);
+
+    if (surface == NULL)
+        return NULL;
+
+    entry = cairo_surface_get_user_data (surface, &icon_cache_entry_key);
+    if (needs_move)
+        *needs_move = entry->needs_move;
+
+    return cairo_surface_reference (surface);
+}
+
+static void
+button_icon_cache_insert (ButtonWidget      *button,
+                          int                scale,
+                          ButtonIconVariant  variant,
+                          cairo_surface_t   *surface,
+                          gboolean           needs_move)
+{
+    ButtonIconCacheEntry *entry;
+
+    if (surface == NULL ||
+        cairo_surface_get_user_data (surface, &icon_cache_entry_key) != NULL)
+        return;
+
+    if (icon_cache == NULL)
+        icon_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                            g_free, NULL);
+
+    entry = g_new0 (ButtonIconCacheEntry, 1);
+    entry->key = button_icon_cache_make_key (button, scale, variant);
+    entry->surface = surface;
+    entry->needs_move = needs_move;
+
+    if (cairo_surface_set_user_data (surface, &icon_cache_entry_key, entry,
+                                     (cairo_destroy_func_t) button_icon_cache_entry_free) != CAIRO_STATUS_SUCCESS) {
+        g_free (entry->key);
+        g_free (entry);
+        return;
+    }
+
+    g_hash_table_replace (icon_cache, g_strdup (entry->key), surface);
+}
+
+static gboolean
+button_icon_retired_expired (gpointer data)
+{
+    retired_icons_timeout = 0;
+
+    g_ptr_array_set_size (retired_icons, 0);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+button_icon_retire (cairo_surface_t *surface)
+{
+    if (surface == NULL)
+        return;
+
+    if (retired_icons == NULL)
+        retired_icons = g_ptr_array_new_with_free_func ((GDestroyNotify) cairo_surface_destroy);
+
+    g_ptr_array_add (retired_icons, cairo_surface_reference (surface));
+
+    if (retired_icons_timeout != 0)
+        g_source_remove (retired_icons_timeout);
+    retired_icons_timeout = g_timeout_add_seconds (BUTTON_ICON_RETIRE_SECONDS,
+                                                   button_icon_retired_expired,
+                                                   NULL);
+}
+
+static void
+button_icon_cache_clear (void)
+{
+    /* every button gets the theme change notification: only empty the
+     * cache for the first one, so that the following buttons can share
+     * the icons reloaded by the first ones */
+    if (icon_cache_generation == panel_theme_get_generation ())
+        return;
+
+    icon_cache_generation = panel_theme_get_generation ();
+
+    if (icon_cache != NULL)
+        g_hash_table_remove_all (icon_cache);
+}
+
+/* fell_back tells whether the icon was not found and image-missing was
+ * loaded instead */
+static cairo_surface_t *
+button_widget_load_surface (ButtonWidget *button,
+                            int           scale,
+                            gboolean     *fell_back)
+{
+    cairo_surface_t *surface;
+    GdkDisplay      *display;
+    char            *error = NULL;
+
+    *fell_back = FALSE;
+
+    /* icons findable in the icon theme can be handled by gtk directly*/
+    display = gdk_display_get_default ();
+    GtkIconTheme *icon_theme = gtk_icon_theme_get_default();
+    surface =
+        gtk_icon_theme_load_surface (icon_theme,
+                                     button->priv->filename,
+                                     button->priv->size,
+                                     scale,
+                                     NULL,
+                                     GTK_ICON_LOOKUP_FORCE_SIZE | GTK_ICON_LOOKUP_FORCE_SVG,
+                                     NULL);
+
+    /*fallback to catch the case of custom icons in x11*/
+    if (!surface && GDK_IS_X11_DISPLAY (display)) {
+        surface =
+            panel_load_icon (button->priv->icon_theme,
+                             button->priv->filename,
+                             button->priv->size * scale,
+                             (button->priv->orientation & PANEL_VERTICAL_MASK)   ? button->priv->size * scale : -1,
+                             (button->priv->orientation & PANEL_HORIZONTAL_MASK) ? button->priv->size * scale: -1,
+                             &error);
+    }
+    else if (!surface) {
+        /*fallback to catch the case of custom icons not in x11*/
+        button->priv->needs_move = TRUE;
+        surface =
+            panel_load_icon (button->priv->icon_theme,
+                             button->priv->filename,
+                             button->priv->size * scale,
+                             (button->priv->orientation & PANEL_VERTICAL_MASK)   ? button->priv->size  : -1,
+                             (button->priv->orientation & PANEL_HORIZONTAL_MASK) ? button->priv->size  : -1,
+                             &error);
+    }
+    if (error) {
+        /*Last fallback for case of icon not found
+        * FIXME: this is not rendered at button->priv->size
+        */
+        button->priv->needs_move = FALSE;
+        *fell_back = TRUE;
+        surface =
+            gtk_icon_theme_load_surface (icon_theme,
+                                         "image-missing",
+                                         GTK_ICON_SIZE_BUTTON,
+                                         scale,
+                                         NULL,
+                                         GTK_ICON_LOOKUP_FORCE_SVG | GTK_ICON_LOOKUP_USE_BUILTIN,
+                                         NULL);
+
+        g_free (error);
+    }
+
+    return surface;
+}
+
 static void
 button_widget_reload_surface (ButtonWidget *button)
 {
@@ -168,69 +473,58 @@ button_widget_reload_surface (ButtonWidget *button)
         return;
 
     if (button->priv->filename != NULL && button->priv->filename [0] != '\0') {
-        GdkDisplay *display;
-        gint        scale;
-        char       *error = NULL;
-        /* icons findable in the icon theme can be handled by gtk directly*/
-        display = gdk_display_get_default ();
+        gboolean needs_move = FALSE;
+        gboolean fell_back = FALSE;
+        gint     scale;
+
         scale = gtk_widget_get_scale_factor (GTK_WIDGET (button));
-        GtkIconTheme *icon_theme = gtk_icon_theme_get_default();
-        button->priv->surface =
-            gtk_icon_theme_load_surface (icon_theme,
-                                         button->priv->filename,
-                                         button->priv->size,
-                                         scale,
-                                         NULL,
-                                         GTK_ICON_LOOKUP_FORCE_SIZE | GTK_ICON_LOOKUP_FORCE_SVG,
-                                         NULL);
 
-        /*fallback to catch the case of custom icons in x11*/
-        if (!button->priv->surface && GDK_IS_X11_DISPLAY (display)) {
-            button->priv->surface =
-                panel_load_icon (button->priv->icon_theme,
-                                 button->priv->filename,
-                                 button->priv->size * scale,
-                                 (button->priv->orientation & PANEL_VERTICAL_MASK)   ? button->priv->size * scale : -1,
-                                 (button->priv->orientation & PANEL_HORIZONTAL_MASK) ? button->priv->size * scale: -1,
-                                 &error);
-        }
-        else if (!button->priv->surface) {
-            /*fallback to catch the case of custom icons not in x11*/
-            button->priv->needs_move = TRUE;
-            button->priv->surface =
-                panel_load_icon (button->priv->icon_theme,
-                                 button->priv->filename,
-                                 button->priv->size * scale,
-                                 (button->priv->orientation & PANEL_VERTICAL_MASK)   ? button->priv->size  : -1,
-                                 (button->priv->orientation & PANEL_HORIZONTAL_MASK) ? button->priv->size  : -1,
-                                 &error);
+        button->priv->surface =
+            button_icon_cache_lookup (button, scale, BUTTON_ICON_NORMAL, &needs_move);
+        if (button->priv->surface) {
+            button->priv->needs_move = needs_move;
+        } else {
+            button->priv->surface = button_widget_load_surface (button, scale,
+                                                                &fell_back);
+            /* the icon can be installed later: only what was found is
+             * shared, the next load looks for it again */
+            if (!fell_back)
+                button_icon_cache_insert (button, scale, BUTTON_ICON_NORMAL,
+                                          button->priv->surface,
+                                          button->priv->needs_move);
         }
-        if (error) {
-            /*Last fallback for case of icon not found
-            * FIXME: this is not rendered at button->priv->size
-            */
-            button->priv->needs_move = FALSE;
-            button->priv->surface =
-                gtk_icon_theme_load_surface (icon_theme,
-                                             "image-missing",
-                                             GTK_ICON_SIZE_BUTTON,
-                                             scale,
-                                             NULL,
-                                             GTK_ICON_LOOKUP_FORCE_SVG | GTK_ICON_LOOKUP_USE_BUILTIN,
-                                             NULL);
-
-            g_free (error);
+
+        if (!fell_back)
+            button->priv->surface_hc =
+                button_icon_cache_lookup (button, scale, BUTTON_ICON_HIGH_CONTRAST, NULL);
+        if (!button->priv->surface_hc) {
+            button->priv->surface_hc = make_hc_surface (button->priv->surface);
+            if (!fell_back)
+                button_icon_cache_insert (button, scale, BUTTON_ICON_HIGH_CONTRAST,
+                                          button->priv->surface_hc, FALSE);
         }
     }
 
-    button->priv->surface_hc = make_hc_surface (button->priv->surface);
-
     gtk_widget_queue_resize (GTK_WIDGET (button));
 }
 
 static void
-button_widget_icon_theme_changed (ButtonWidget *button)
+button_widget_scale_factor_changed (ButtonWidget *button)
+{
+    if (button->priv->filename == NULL)
+        return;
+
+    button_icon_retire (button->priv->surface);
+    button_icon_retire (button->priv->surface_hc);
+
+    button_widget_reload_surface (button);
+}
+
+static void
+button_widget_theme_changed (ButtonWidget *button)
 {
+    button_icon_cache_clear ();
+
     if (button->priv->filename != NULL)
         button_widget_reload_surface (button);
 }
@@ -373,36 +667,23 @@ calc_arrow (PanelOrientation  orientation,
     return retval;
 }
 
-static gboolean
-button_widget_draw (GtkWidget *widget,
-                    cairo_t   *cr)
+static void
+button_widget_render (GtkWidget       *widget,
+                      cairo_t         *cr,
+                      int              width,
+                      int              height,
+                      GtkStateFlags    state_flags,
+                      cairo_surface_t *surface,
+                      int              off)
 {
     ButtonWidget    *button_widget;
-    int              width;
-    int              height;
     GtkStyleContext *context;
-    GtkStateFlags    state_flags;
-    int              off;
     int              x, y, w, h;
     int              scale;
 
-    g_return_val_if_fail (BUTTON_IS_WIDGET (widget), FALSE);
-
     button_widget = BUTTON_WIDGET (widget);
-
-    if (!button_widget->priv->surface_hc && !button_widget->priv->surface)
-        return FALSE;
-
-    state_flags = gtk_widget_get_state_flags (widget);
-    width = gtk_widget_get_allocated_width (widget);
-    height = gtk_widget_get_allocated_height (widget);
     scale = gtk_widget_get_scale_factor (widget);
 
-    /* offset for pressed buttons */
-    off = (button_widget->priv->activatable &&
-        (state_flags & GTK_STATE_FLAG_PRELIGHT) && (state_flags & GTK_STATE_FLAG_ACTIVE)) ?
-        BUTTON_WIDGET_DISPLACEMENT * height / 48.0 : 0;
-
     if (button_widget->priv->needs_move) {
         /*This is for custom icons using the older code in wayland*/
         w = cairo_image_surface_get_width (button_widget->priv->surface);
@@ -423,12 +704,8 @@ button_widget_draw (GtkWidget *widget,
         cairo_set_operator (cr, CAIRO_OPERATOR_HSL_SATURATION);
         cairo_set_source_rgba (cr, 0, 0, 0, 0.2);
     }
-    else if (panel_global_config_get_highlight_when_over () &&
-        (state_flags & GTK_STATE_FLAG_PRELIGHT || gtk_widget_has_focus (widget))) {
-        cairo_set_source_surface (cr, button_widget->priv->surface_hc, x, y);
-    }
     else {
-        cairo_set_source_surface (cr, button_widget->priv->surface, x, y);
+        cairo_set_source_surface (cr, surface, x, y);
     }
 
     cairo_paint (cr);
@@ -461,8 +738,98 @@ button_widget_draw (GtkWidget *widget,
         cairo_stroke (cr);
         cairo_restore (cr);
     }
+}
 
+static gboolean
+button_widget_draw (GtkWidget *widget,
+                    cairo_t   *cr)
+{
+    ButtonWidget      *button_widget;
+    ButtonRenderCache *cache;
+    ButtonRenderState  render_state;
+    cairo_surface_t   *surface;
+    int                width;
+    int                height;
+    GtkStyleContext   *context;
+    GtkStateFlags      state_flags;
+    int                off;
+    int                scale;
+
+    g_return_val_if_fail (BUTTON_IS_WIDGET (widget), FALSE);
+
+    button_widget = BUTTON_WIDGET (widget);
+
+    if (!button_widget->priv->surface_hc && !button_widget->priv->surface)
+        return FALSE;
+
+    state_flags = gtk_widget_get_state_flags (widget);
+    width = gtk_widget_get_allocated_width (widget);
+    height = gtk_widget_get_allocated_height (widget);
+    scale = gtk_widget_get_scale_factor (widget);
+
+    /* offset for pressed buttons */
+    off = (button_widget->priv->activatable &&
+        (state_flags & GTK_STATE_FLAG_PRELIGHT) && (state_flags & GTK_STATE_FLAG_ACTIVE)) ?
+        BUTTON_WIDGET_DISPLACEMENT * height / 48.0 : 0;
+
+    if (panel_global_config_get_highlight_when_over () &&
+        (state_flags & GTK_STATE_FLAG_PRELIGHT || gtk_widget_has_focus (widget))) {
+        surface = button_widget->priv->surface_hc;
+        render_state = off ? BUTTON_RENDER_PRESSED : BUTTON_RENDER_PRELIT;
+    }
+    else {
+        surface = button_widget->priv->surface;
+        render_state = off ? BUTTON_RENDER_PRESSED : BUTTON_RENDER_NORMAL;
+    }
+
+    /* the desaturation of insensitive buttons also applies to what is
+     * below the button, so it cannot be rendered offscreen */
+    if (!button_widget->priv->activatable) {
+        button_widget_render (widget, cr, width, height, state_flags,
+                              button_widget->priv->surface, off);
+        goto draw_focus;
+    }
+
+    cache = &button_widget->priv->render_cache[render_state];
+
+    if (cache->surface == NULL ||
+        cache->width != width ||
+        cache->height != height ||
+        cache->scale != scale ||
+        cache->orientation != button_widget->priv->orientation ||
+        cache->state_flags != state_flags ||
+        cache->arrow != button_widget->priv->arrow ||
+        cache->dnd_highlight != button_widget->priv->dnd_highlight) {
+        cairo_t *cache_cr;
+
+        g_clear_pointer (&cache->surface, cairo_surface_destroy);
+
+        cache->surface = gdk_window_create_similar_surface (gtk_widget_get_window (widget),
+                                                            CAIRO_CONTENT_COLOR_ALPHA,
+                                                            width, height);
+        cache->width = width;
+        cache->height = height;
+        cache->scale = scale;
+        cache->orientation = button_widget->priv->orientation;
+        cache->state_flags = state_flags;
+        cache->arrow = button_widget->priv->arrow;
+        cache->dnd_highlight = button_widget->priv->dnd_highlight;
+
+        cache_cr = cairo_create (cache->surface);
+        button_widget_render (widget, cache_cr, width, height, state_flags,
+                              surface, off);
+        cairo_destroy (cache_cr);
+    }
+
+    cairo_save (cr);
+    cairo_set_source_surface (cr, cache->surface, 0, 0);
+    cairo_paint (cr);
+    cairo_restore (cr);
+
+draw_focus:
     if (gtk_widget_has_focus (widget)) {
+        context = gtk_widget_get_style_context (widget);
+
         gtk_style_context_save (context);
         gtk_style_context_set_state (context, state_flags);
 
@@ -656,6 +1023,9 @@ button_widget_init (ButtonWidget *button)
     button->priv->ignore_leave  = FALSE;
     button->priv->arrow         = FALSE;
     button->priv->dnd_highlight = FALSE;
+
+    g_signal_connect (button, "notify::scale-factor",
+                      G_CALLBACK (button_widget_scale_factor_changed), NULL);
 }
 
 static void
@@ -675,6 +1045,7 @@ button_widget_class_init (ButtonWidgetClass *klass)
     widget_class->get_preferred_width  = button_widget_get_preferred_width;
     widget_class->get_preferred_height = button_widget_get_preferred_height;
     widget_class->draw                 = button_widget_draw;
+    widget_class->style_updated        = button_widget_style_updated;
     widget_class->button_press_event   = button_widget_button_press;
     widget_class->enter_notify_event   = button_widget_enter_notify;
     widget_class->leave_notify_event   = button_widget_leave_notify;
@@ -930,3 +1301,37 @@ button_widget_get_surface (ButtonWidget *button)
 
     return cairo_surface_reference (button->priv->surface);
 }
+
+static guint64
+button_widget_get_surface_size (cairo_surface_t *surface)
+{
+    if (!surface || cairo_surface_get_type (surface) != CAIRO_SURFACE_TYPE_IMAGE)
+        return 0;
+
+    return (guint64) cairo_image_surface_get_stride (surface) *
+           cairo_image_surface_get_height (surface);
+}
+
+/* The icons, and the rendered states, that may be similar surfaces of the
+ * X server: those are estimated from their dimensions */
+guint64
+button_widget_get_memory_size (ButtonWidget *button)
+{
+    guint64 size;
+    int     i;
+
+    g_return_val_if_fail (BUTTON_IS_WIDGET (button), 0);
+
+    size = button_widget_get_surface_size (button->priv->surface) +
+           button_widget_get_surface_size (button->priv->surface_hc);
+
+    for (i = 0; i < BUTTON_RENDER_LAST; i++) {
+        ButtonRenderCache *cache = &button->priv->render_cache[i];
+
+        if (cache->surface)
+            size += (guint64) cache->width * cache->scale *
+                    cache->height * cache->scale * 4;
+    }
+
+    return size;
+}
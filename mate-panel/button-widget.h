@@ -52,6 +52,7 @@ void             button_widget_set_ignore_leave  (ButtonWidget     *button,
 gboolean         button_widget_get_ignore_leave  (ButtonWidget     *button);
 GtkIconTheme    *button_widget_get_icon_theme    (ButtonWidget     *button);
 cairo_surface_t *button_widget_get_surface       (ButtonWidget     *button);
+guint64          button_widget_get_memory_size   (ButtonWidget     *button);
 
 #ifdef __cplusplus
 }
@@ -21,11 +21,16 @@
 #include <gdk/gdkkeysyms.h>
 #include <gio/gio.h>
 
+#ifdef HAVE_X11
+#include <gtk/gtkx.h> /* for GTK_IS_SOCKET */
+#endif
+
 #include "drawer.h"
 #include "drawer-private.h"
 
 #include "applet.h"
 #include "button-widget.h"
+#include "panel-arena.h"
 #include "panel-config-global.h"
 #include "panel-profile.h"
 #include "panel-util.h"
@@ -34,6 +39,10 @@
 #include "panel-icon-names.h"
 #include "panel-schemas.h"
 
+/* closed drawers are released after this delay, so that opening and closing
+ * a drawer quickly does not create its windows over and over */
+#define DRAWER_RELEASE_DELAY 10 /* seconds */
+
 /* Internal functions */
 /* event handlers */
 
@@ -279,6 +288,82 @@ drag_leave_cb (GtkWidget      *widget,
     button_widget_set_dnd_highlight (BUTTON_WIDGET (widget), FALSE);
 }
 
+#ifdef HAVE_X11
+/* The windows of a closed drawer can be released: its widgets stay and keep
+ * their geometry, only their X windows and surfaces go away until the drawer
+ * is opened again. */
+static void
+drawer_find_socket (GtkWidget *widget,
+                    gpointer   data)
+{
+    gboolean *found = data;
+
+    if (*found)
+        return;
+
+    if (GTK_IS_SOCKET (widget)) {
+        *found = TRUE;
+        return;
+    }
+
+    if (GTK_IS_CONTAINER (widget))
+        gtk_container_forall (GTK_CONTAINER (widget), drawer_find_socket, data);
+}
+
+static gboolean
+drawer_release_toplevel (gpointer data)
+{
+    Drawer    *drawer = (Drawer *) data;
+    GtkWidget *toplevel;
+    gboolean   has_socket = FALSE;
+
+    drawer->release_id = 0;
+
+    if (!drawer->toplevel)
+        return FALSE;
+
+    toplevel = GTK_WIDGET (drawer->toplevel);
+    if (gtk_widget_get_visible (toplevel) ||
+        !gtk_widget_get_realized (toplevel) ||
+        !panel_toplevel_get_is_hidden (drawer->toplevel))
+        return FALSE;
+
+    /* out-of-process applets live in the window of their socket:
+     * unrealizing it would unembed them */
+    drawer_find_socket (toplevel, &has_socket);
+    if (has_socket)
+        return FALSE;
+
+    gtk_widget_unrealize (toplevel);
+
+    return FALSE;
+}
+
+static void
+drawer_toplevel_unmapped (GtkWidget *widget,
+                          Drawer    *drawer)
+{
+    if (!panel_global_config_get_release_closed_drawers () ||
+        !GDK_IS_X11_DISPLAY (gtk_widget_get_display (widget)))
+        return;
+
+    if (!drawer->release_id)
+        drawer->release_id = g_timeout_add_seconds (DRAWER_RELEASE_DELAY,
+                                                    drawer_release_toplevel,
+                                                    drawer);
+}
+
+static void
+drawer_toplevel_mapped (GtkWidget *widget,
+                        Drawer    *drawer)
+{
+    if (drawer->release_id) {
+        g_source_remove (drawer->release_id);
+        drawer->release_id = 0;
+    }
+}
+#endif
+
     /* load_drawer_applet handlers */
 
 static void
@@ -340,6 +425,11 @@ toplevel_destroyed (GtkWidget *widget,
 {
     drawer->toplevel = NULL;
 
+    if (drawer->release_id) {
+        g_source_remove (drawer->release_id);
+        drawer->release_id = 0;
+    }
+
     if (drawer->button) {
         gtk_widget_destroy (drawer->button);
         drawer->button = NULL;
@@ -359,6 +449,11 @@ destroy_drawer (GtkWidget *widget,
         g_source_remove (drawer->close_timeout_id);
         drawer->close_timeout_id = 0;
     }
+
+    if (drawer->release_id) {
+        g_source_remove (drawer->release_id);
+        drawer->release_id = 0;
+    }
 }
 
 static void
@@ -422,7 +517,7 @@ create_drawer_applet (PanelToplevel    *toplevel,
     Drawer *drawer;
     AtkObject *atk_obj;
 
-    drawer = g_new0 (Drawer, 1);
+    drawer = panel_arena_new0 (panel_arena_get (parent_toplevel), Drawer);
 
     drawer->toplevel = toplevel;
 
@@ -433,7 +528,7 @@ create_drawer_applet (PanelToplevel    *toplevel,
     }
 
     if (!drawer->button) {
-        g_free (drawer);
+        panel_arena_free (drawer);
         return NULL;
     }
 
@@ -456,6 +551,10 @@ create_drawer_applet (PanelToplevel    *toplevel,
 
     g_signal_connect (drawer->button, "destroy", G_CALLBACK (destroy_drawer), drawer);
     g_signal_connect (drawer->toplevel, "destroy", G_CALLBACK (toplevel_destroyed), drawer);
+#ifdef HAVE_X11
+    g_signal_connect (drawer->toplevel, "unmap", G_CALLBACK (drawer_toplevel_unmapped), drawer);
+    g_signal_connect (drawer->toplevel, "map", G_CALLBACK (drawer_toplevel_mapped), drawer);
+#endif
 
     gtk_widget_show (drawer->button);
 
@@ -524,7 +623,7 @@ load_drawer_applet (char          *toplevel_id,
     panel_widget = panel_toplevel_get_panel_widget (parent_toplevel);
 
     drawer->info = mate_panel_applet_register (drawer->button, drawer,
-                                          (GDestroyNotify) g_free,
+                                          (GDestroyNotify) panel_arena_free,
                                           panel_widget,
                                           locked, pos, exactpos,
                                           PANEL_OBJECT_DRAWER, id);
@@ -572,7 +671,7 @@ panel_drawer_prepare (const char  *drawer_id,
     char *path;
 
     path = g_strdup_printf ("%s%s/", PANEL_OBJECT_PATH, drawer_id);
-    settings = g_settings_new_with_path (PANEL_OBJECT_SCHEMA, path);
+    settings = panel_profile_get_settings (PANEL_OBJECT_SCHEMA, path);
     g_free (path);
 
     if (tooltip) {
@@ -597,7 +696,7 @@ panel_drawer_prepare (const char  *drawer_id,
 
         toplevel_path = g_strdup_printf (PANEL_TOPLEVEL_PATH "%s/", toplevel_id);
 
-        toplevel_settings = g_settings_new_with_path (PANEL_TOPLEVEL_SCHEMA, toplevel_path);
+        toplevel_settings = panel_profile_get_settings (PANEL_TOPLEVEL_SCHEMA, toplevel_path);
 
         g_settings_set_string (settings, PANEL_OBJECT_ATTACHED_TOPLEVEL_ID_KEY, toplevel_id);
         g_settings_set_boolean (toplevel_settings, PANEL_TOPLEVEL_ENABLE_BUTTONS_KEY, TRUE);
@@ -669,7 +768,7 @@ drawer_load_from_gsettings (PanelWidget *panel_widget,
     g_return_if_fail (id != NULL);
 
     path = g_strdup_printf ("%s%s/", PANEL_OBJECT_PATH, id);
-    settings = g_settings_new_with_path (PANEL_OBJECT_SCHEMA, path);
+    settings = panel_profile_get_settings (PANEL_OBJECT_SCHEMA, path);
     g_free (path);
 
     toplevel_id = g_settings_get_string (settings, PANEL_OBJECT_ATTACHED_TOPLEVEL_ID_KEY);
@@ -727,7 +826,7 @@ drawer_query_deletion (Drawer *drawer)
         PanelWidget *panel_widget = panel_toplevel_get_panel_widget (drawer->toplevel);
 
         if (!panel_global_config_get_confirm_panel_remove () ||
-            !g_list_length (panel_widget->applet_list)) {
+            panel_widget->applets->len == 0) {
                 panel_profile_delete_object (drawer->info);
                 return;
         }
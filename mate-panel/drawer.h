@@ -15,6 +15,7 @@ typedef struct {
 
     gboolean       opened_for_drag;
     guint          close_timeout_id;
+    guint          release_id;
 
     AppletInfo    *info;
 } Drawer;
@@ -22,6 +22,7 @@
 #include <glib/gi18n.h>
 #include <gio/gio.h>
 
+#include <libpanel-util/panel-desktop-cache.h>
 #include <libpanel-util/panel-error.h>
 #include <libpanel-util/panel-glib.h>
 #include <libpanel-util/panel-keyfile.h>
@@ -38,15 +39,19 @@
 #include "xstuff.h"
 #endif
 #include "panel-toplevel.h"
+#include "panel-arena.h"
 #include "panel-a11y.h"
 #include "panel-globals.h"
 #include "panel-lockdown.h"
+#include "panel-power.h"
 #include "panel-ditem-editor.h"
 #include "panel-icon-names.h"
 #include "panel-schemas.h"
 
 static gboolean
 launcher_properties_enabled (void);
+static void
+launcher_watch_location (Launcher *launcher);
 
 static GdkScreen *
 launcher_get_screen (Launcher *launcher)
@@ -186,7 +191,10 @@ drag_data_received_cb (GtkWidget        *widget,
 
 	/* The animation uses X specific functionality */
 #ifdef HAVE_X11
-	if (is_using_x11 () && panel_global_config_get_enable_animations ()) {
+	if (is_using_x11 () &&
+	    panel_global_config_get_enable_animations () &&
+	    panel_global_config_get_enable_launch_animation () &&
+	    panel_power_get_animate ()) {
 		cairo_surface_t *surface;
 		surface = button_widget_get_surface (BUTTON_WIDGET (widget));
 		xstuff_zoom_animate (widget,
@@ -249,15 +257,14 @@ free_launcher (gpointer data)
 {
 	Launcher *launcher = data;
 
+	panel_desktop_cache_unwatch (launcher->watch_id);
+
 	if (launcher->key_file)
-		g_key_file_free (launcher->key_file);
+		g_key_file_unref (launcher->key_file);
 
 	g_free (launcher->location);
 
-	if (launcher->monitor != NULL)
-		g_object_unref (launcher->monitor);
-
-	g_free (launcher);
+	panel_arena_free (launcher);
 }
 
 void
@@ -405,7 +412,10 @@ clicked_cb (Launcher  *launcher,
 {
 
 #ifdef HAVE_X11
-	if (is_using_x11 () && panel_global_config_get_enable_animations ()) {
+	if (is_using_x11 () &&
+	    panel_global_config_get_enable_animations () &&
+	    panel_global_config_get_enable_launch_animation () &&
+	    panel_power_get_animate ()) {
 		cairo_surface_t *surface;
 		surface = button_widget_get_surface (BUTTON_WIDGET (widget));
 		xstuff_zoom_animate (widget,
@@ -437,12 +447,80 @@ clicked_cb (Launcher  *launcher,
 	}
 }
 
+/* Returns the local path of the launcher desktop file, or NULL if it is
+ * not a local file */
+static char *
+launcher_get_path (const char *location)
+{
+	if (!strchr (location, G_DIR_SEPARATOR))
+		return panel_make_full_path (NULL, location);
+
+	if (g_path_is_absolute (location))
+		return g_strdup (location);
+
+	return g_filename_from_uri (location, NULL, NULL);
+}
+
+/* Local desktop files come from the desktop file cache and are shared with
+ * everyone else using them, until launcher_ensure_private_key_file(). */
+static GKeyFile *
+launcher_load_key_file (const char  *location,
+			gboolean    *shared,
+			GError     **error)
+{
+	GKeyFile *key_file;
+	char     *path;
+
+	path = launcher_get_path (location);
+
+	if (path) {
+		key_file = panel_desktop_cache_lookup (path, error);
+		*shared = TRUE;
+		g_free (path);
+		return key_file;
+	}
+
+	key_file = g_key_file_new ();
+	*shared = FALSE;
+
+	if (!panel_key_file_load_from_uri (key_file, location,
+					   G_KEY_FILE_KEEP_COMMENTS|G_KEY_FILE_KEEP_TRANSLATIONS,
+					   error)) {
+		g_key_file_unref (key_file);
+		return NULL;
+	}
+
+	return key_file;
+}
+
+static void
+launcher_ensure_private_key_file (Launcher *launcher)
+{
+	GKeyFile *key_file;
+	char     *data;
+	gsize     length;
+
+	if (!launcher->key_file_shared)
+		return;
+
+	data = g_key_file_to_data (launcher->key_file, &length, NULL);
+	key_file = g_key_file_new ();
+	g_key_file_load_from_data (key_file, data, length,
+				   G_KEY_FILE_KEEP_COMMENTS|G_KEY_FILE_KEEP_TRANSLATIONS,
+				   NULL);
+	g_free (data);
+
+	g_key_file_unref (launcher->key_file);
+	launcher->key_file = key_file;
+	launcher->key_file_shared = FALSE;
+}
+
 static Launcher *
-create_launcher (const char *location)
+create_launcher (PanelArena *arena,
+		 const char *location)
 {
 	GKeyFile *key_file;
-	g_autoptr(GFile) file = NULL;
-	gboolean  loaded = FALSE;
+	gboolean  shared;
 	Launcher *launcher;
 	GError   *error = NULL;
 	char     *new_location;
@@ -453,7 +531,6 @@ create_launcher (const char *location)
 	}
 
 	new_location = NULL;
-	key_file = g_key_file_new ();
 
 	if (!strchr (location, G_DIR_SEPARATOR)) {
 		/* try to first load a file in our config directory, and if it
@@ -462,31 +539,24 @@ create_launcher (const char *location)
 
 		path = panel_make_full_path (NULL, location);
 
-		if (!g_file_test (path, G_FILE_TEST_EXISTS)) {
-			g_free (path);
-			path = panel_g_lookup_in_applications_dirs (location);
+		if (!g_file_test (path, G_FILE_TEST_EXISTS))
 			/* it's important to keep the full path if the desktop
 			 * file comes from a data dir: when the user will edit
 			 * it, we'll want to save it in PANEL_LAUNCHERS_PATH
 			 * with a random name (and not evolution.desktop, eg)
 			 * and having only a basename as location will make
 			 * this impossible */
-			if (path)
-				new_location = g_strdup (path);
-		}
+			new_location = panel_g_lookup_in_applications_dirs (location);
 
-		if (path) {
-			loaded = g_key_file_load_from_file (key_file, path,
-							    G_KEY_FILE_KEEP_COMMENTS|G_KEY_FILE_KEEP_TRANSLATIONS,
-							    &error);
-			g_free (path);
-		}
-	} else
-		loaded = panel_key_file_load_from_uri (key_file, location,
-						       G_KEY_FILE_KEEP_COMMENTS|G_KEY_FILE_KEEP_TRANSLATIONS,
-						       &error);
+		g_free (path);
+	}
 
-	if (!loaded) {
+	if (!new_location)
+		new_location = g_strdup (location);
+
+	key_file = launcher_load_key_file (new_location, &shared, &error);
+
+	if (!key_file) {
 		g_printerr (_("Unable to open desktop file %s for panel launcher%s%s\n"),
 			    location,
 			    error ? ": " : "",
@@ -494,21 +564,18 @@ create_launcher (const char *location)
 		if (error)
 			g_error_free (error);
 
-		g_key_file_free (key_file);
 		g_free (new_location);
 		return NULL; /*button is null*/
 	}
 
-	if (!new_location)
-		new_location = g_strdup (location);
-	file = g_file_new_for_path (new_location);
-
-	launcher = g_new0 (Launcher, 1);
+	launcher = panel_arena_new0 (arena, Launcher);
 
 	launcher->info = NULL;
 	launcher->button = NULL;
 	launcher->location = new_location;
 	launcher->key_file = key_file;
+	launcher->key_file_shared = shared;
+	launcher->watch_id = 0;
 	launcher->prop_dialog = NULL;
 	launcher->destroy_handler = 0;
 
@@ -517,10 +584,6 @@ create_launcher (const char *location)
 					      FALSE,
 					      PANEL_ORIENTATION_TOP);
 
-	launcher->monitor = g_file_monitor_file (file,
-	                                         G_FILE_MONITOR_NONE,
-	                                         NULL,
-	                                         NULL);
 	gtk_widget_show (launcher->button);
 
 	/*gtk_drag_dest_set (GTK_WIDGET (launcher->button),
@@ -588,6 +651,7 @@ setup_button (Launcher *launcher)
 	char *str;
 	char *icon;
 	char *unescaped_str;
+	char *type;
 
 	g_return_if_fail (launcher != NULL);
 
@@ -659,6 +723,18 @@ setup_button (Launcher *launcher)
 	g_free (icon);
 	g_free (name);
 	g_free (comment);
+
+	/* Find out what opens a link before it is clicked */
+	type = panel_key_file_get_string (launcher->key_file, "Type");
+	if (type && !strcmp (type, "Link")) {
+		char *url;
+
+		url = panel_key_file_get_string (launcher->key_file, "URL");
+		if (url && *url)
+			panel_show_uri_prefetch (url);
+		g_free (url);
+	}
+	g_free (type);
 }
 
 static char *
@@ -778,6 +854,7 @@ launcher_saved (GtkWidget *dialog,
 			g_free (launcher->location);
 
 		launcher->location = g_strdup (uri);
+		launcher_watch_location (launcher);
 	}
 
 	if (filename)
@@ -805,6 +882,9 @@ launcher_properties (Launcher  *launcher)
 		return;
 	}
 
+	/* the editor modifies the key file in place */
+	launcher_ensure_private_key_file (launcher);
+
 	launcher->prop_dialog = panel_ditem_editor_new (NULL,
 							launcher->key_file,
 							launcher->location,
@@ -848,33 +928,49 @@ launcher_properties_enabled (void)
 }
 
 static void
-app_desktop_file_changed (GFileMonitor      *monitor,
-                          GFile             *file,
-                          GFile             *other_file,
-                          GFileMonitorEvent  event_type,
-                          Launcher          *launcher)
+app_desktop_file_changed (const char *path,
+			  gpointer    data)
 {
-	if (event_type != G_FILE_MONITOR_EVENT_CHANGED &&
-		event_type != G_FILE_MONITOR_EVENT_CREATED)
-	{
-		return;
-	}
+	Launcher *launcher = data;
 
-	if (!strchr (launcher->location, G_DIR_SEPARATOR))
-	{
-		g_key_file_load_from_file (launcher->key_file, launcher->location,
-		                           G_KEY_FILE_KEEP_COMMENTS|G_KEY_FILE_KEEP_TRANSLATIONS,
-		                           NULL);
-	}
-	else
-	{
-		panel_key_file_load_from_uri (launcher->key_file, launcher->location,
-		                              G_KEY_FILE_KEEP_COMMENTS|G_KEY_FILE_KEEP_TRANSLATIONS,
-		                              NULL);
+	if (!launcher->key_file_shared) {
+		/* the properties dialog is editing this key file: reload it
+		 * in place so that the dialog follows */
+		g_key_file_load_from_file (launcher->key_file, path,
+					   G_KEY_FILE_KEEP_COMMENTS|G_KEY_FILE_KEEP_TRANSLATIONS,
+					   NULL);
+	} else {
+		GKeyFile *key_file;
+
+		key_file = panel_desktop_cache_lookup (path, NULL);
+		if (!key_file)
+			return;
+
+		g_key_file_unref (launcher->key_file);
+		launcher->key_file = key_file;
 	}
+
 	setup_button (launcher);
 }
 
+static void
+launcher_watch_location (Launcher *launcher)
+{
+	char *path;
+
+	panel_desktop_cache_unwatch (launcher->watch_id);
+	launcher->watch_id = 0;
+
+	path = launcher_get_path (launcher->location);
+	if (!path)
+		return;
+
+	launcher->watch_id = panel_desktop_cache_watch (path,
+							app_desktop_file_changed,
+							launcher);
+	g_free (path);
+}
+
 static Launcher *
 load_launcher_applet (const char       *location,
 		      PanelWidget      *panel,
@@ -885,7 +981,7 @@ load_launcher_applet (const char       *location,
 {
 	Launcher *launcher;
 
-	launcher = create_launcher (location);
+	launcher = create_launcher (panel_arena_get (panel->toplevel), location);
 
 	if (!launcher)
 		return NULL;
@@ -902,10 +998,7 @@ load_launcher_applet (const char       *location,
 	panel_widget_set_applet_expandable (panel, GTK_WIDGET (launcher->button), FALSE, TRUE);
 	panel_widget_set_applet_size_constrained (panel, GTK_WIDGET (launcher->button), TRUE);
 
-	g_signal_connect (launcher->monitor,
-	                  "changed",
-	                  G_CALLBACK (app_desktop_file_changed),
-	                  launcher);
+	launcher_watch_location (launcher);
 
 	/* setup button according to ditem */
 	setup_button (launcher);
@@ -928,7 +1021,7 @@ launcher_load_from_gsettings (PanelWidget *panel_widget,
 	g_return_if_fail (id != NULL);
 
 	path = g_strdup_printf ("%s%s/", PANEL_OBJECT_PATH, id);
-	settings = g_settings_new_with_path (PANEL_OBJECT_SCHEMA, path);
+	settings = panel_profile_get_settings (PANEL_OBJECT_SCHEMA, path);
 	g_free (path);
 
 	launcher_location = g_settings_get_string (settings, PANEL_OBJECT_LAUNCHER_LOCATION_KEY);
@@ -1097,7 +1190,7 @@ panel_launcher_create_with_id (const char    *toplevel_id,
 						   FALSE);
 
 	path = g_strdup_printf ("%s%s/", PANEL_OBJECT_PATH, id);
-	settings = g_settings_new_with_path (PANEL_OBJECT_SCHEMA, path);
+	settings = panel_profile_get_settings (PANEL_OBJECT_SCHEMA, path);
 	g_free (path);
 
 	no_uri = NULL;
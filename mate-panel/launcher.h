@@ -25,8 +25,9 @@ typedef struct {
 
 	char              *location;
 	GKeyFile          *key_file;
+	gboolean           key_file_shared;
 
-	GFileMonitor      *monitor;
+	guint              watch_id;
 	GtkWidget         *prop_dialog;
 	GSList            *error_dialogs;
 
@@ -23,6 +23,7 @@
 
 #include <config.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <gtk/gtk.h>
 
@@ -30,12 +31,15 @@
 #include <gtk/gtkx.h>
 #endif
 
+#include <libpanel-util/panel-trace.h>
 #include <panel-applets-manager.h>
 #include "panel-applet-container.h"
 #include "panel-marshal.h"
 
 struct _MatePanelAppletContainerPrivate {
 	GDBusProxy *applet_proxy;
+	/* in applet_containers while the proxy is there */
+	gchar      *signal_key;
 
 	guint       name_watcher_id;
 	gchar      *bus_name;
@@ -47,6 +51,30 @@ struct _MatePanelAppletContainerPrivate {
 	GtkWidget  *socket;
 
 	GHashTable *pending_ops;
+
+	/* the applet was built before SetProperties existed */
+	gboolean    no_set_properties;
+
+	/* properties fetched with GetAll as soon as the applet exists, and
+	 * not read yet: D-Bus name -> GVariant */
+	GHashTable *initial_properties;
+	gboolean    prefetching;
+	GList      *prefetch_waiting;
+	/* D-Bus names of all the properties the applet has */
+	GHashTable *property_names;
+
+	/* for mate_panel_applet_container_get_stats() */
+	guint       n_messages_out;
+	guint       n_messages_in;
+	guint32     pid;
+	/* monotonic times of the activation stages, 0 until reached */
+	gint64      activation_start;
+	gint64      stage_times[MATE_PANEL_APPLET_CONTAINER_N_STAGES];
+	/* the last reply of GetStatistics: a{st}, NULL until there is one */
+	GVariant   *applet_statistics;
+
+	/* in-process applets are talked to directly */
+	GtkWidget  *applet;
 };
 
 enum {
@@ -60,6 +88,14 @@ enum {
 
 static guint signals[LAST_SIGNAL] = { 0 };
 
+/* The signals of all the applets come through two subscriptions on the
+ * session bus, shared by the containers, rather than through a few per
+ * applet: sender and object path -> MatePanelAppletContainer */
+static GHashTable      *applet_containers = NULL;
+static GDBusConnection *applet_signals_connection = NULL;
+static guint            applet_signals_id = 0;
+static guint            applet_properties_id = 0;
+
 typedef struct {
 	const gchar *name;
 	const gchar *dbus_name;
@@ -71,9 +107,21 @@ static const AppletPropertyInfo applet_properties [] = {
 	{ "size",        "Size" },
 	{ "size-hints",  "SizeHints" },
 	{ "background",  "Background" },
+	{ "background-descriptor", "BackgroundDescriptor" },
 	{ "flags",       "Flags" },
 	{ "locked",      "Locked" },
-	{ "locked-down", "LockedDown" }
+	{ "locked-down", "LockedDown" },
+	{ "power-profile", "PowerProfile" },
+	{ "a11y-enabled", "AccessibilityEnabled" },
+	{ "dock-window", "DockWindow" }
+};
+
+static const gchar *stage_names [MATE_PANEL_APPLET_CONTAINER_N_STAGES] = {
+	"factory",
+	"get-applet",
+	"ready",
+	"plug-added",
+	"allocated"
 };
 
 #define MATE_PANEL_APPLET_BUS_NAME            "org.mate.panel.applet.%s"
@@ -83,7 +131,9 @@ static const AppletPropertyInfo applet_properties [] = {
 
 #ifdef HAVE_X11
 static gboolean mate_panel_applet_container_plug_removed (MatePanelAppletContainer *container);
+static void     mate_panel_applet_container_plug_added   (MatePanelAppletContainer *container);
 #endif
+static void     mate_panel_applet_container_unwatch_signals (MatePanelAppletContainer *container);
 
 G_DEFINE_TYPE_WITH_PRIVATE (MatePanelAppletContainer, mate_panel_applet_container, GTK_TYPE_EVENT_BOX);
 
@@ -92,6 +142,14 @@ GQuark mate_panel_applet_container_error_quark (void)
 	return g_quark_from_static_string ("mate-panel-applet-container-error-quark");
 }
 
+static void
+mate_panel_applet_container_reach_stage (MatePanelAppletContainer      *container,
+					 MatePanelAppletContainerStage  stage)
+{
+	if (container->priv->activation_start && !container->priv->stage_times[stage])
+		container->priv->stage_times[stage] = g_get_monotonic_time ();
+}
+
 static void mate_panel_applet_container_init(MatePanelAppletContainer* container)
 {
 	container->priv = mate_panel_applet_container_get_instance_private (container);
@@ -102,6 +160,86 @@ static void mate_panel_applet_container_init(MatePanelAppletContainer* container
 							      (GDestroyNotify) g_object_unref);
 }
 
+/* In-process applets live in the panel and are added to the container
+ * directly: their properties are read and written on the applet object
+ * itself rather than as D-Bus messages sent to ourselves. The applet
+ * properties have the same names as the child properties. */
+static GVariant *
+mate_panel_applet_container_get_direct (MatePanelAppletContainer *container,
+					const gchar              *property_name)
+{
+	GParamSpec *pspec;
+	GValue      value = G_VALUE_INIT;
+	GVariant   *retval = NULL;
+
+	pspec = g_object_class_find_property (G_OBJECT_GET_CLASS (container->priv->applet),
+					      property_name);
+	if (!pspec)
+		return NULL;
+
+	g_value_init (&value, G_PARAM_SPEC_VALUE_TYPE (pspec));
+	g_object_get_property (G_OBJECT (container->priv->applet), property_name, &value);
+
+	switch (G_VALUE_TYPE (&value)) {
+	case G_TYPE_UINT:
+		retval = g_variant_new_uint32 (g_value_get_uint (&value));
+		break;
+	case G_TYPE_BOOLEAN:
+		retval = g_variant_new_boolean (g_value_get_boolean (&value));
+		break;
+	case G_TYPE_STRING:
+		retval = g_variant_new_string (g_value_get_string (&value) ?
+					       g_value_get_string (&value) : "");
+		break;
+	case G_TYPE_POINTER:
+		/* size-hints, a new floating GVariant */
+		retval = g_value_get_pointer (&value);
+		break;
+	default:
+		if (G_VALUE_HOLDS_VARIANT (&value))
+			retval = g_value_get_variant (&value);
+		break;
+	}
+	g_value_unset (&value);
+
+	return retval ? g_variant_ref_sink (retval) : NULL;
+}
+
+static void
+mate_panel_applet_container_set_direct (MatePanelAppletContainer *container,
+					const gchar              *property_name,
+					GVariant                 *value)
+{
+	GValue gvalue = G_VALUE_INIT;
+
+	if (g_variant_is_of_type (value, G_VARIANT_TYPE ("ai"))) {
+		g_value_init (&gvalue, G_TYPE_POINTER);
+		g_value_set_pointer (&gvalue, value);
+	} else {
+		g_dbus_gvariant_to_gvalue (value, &gvalue);
+	}
+
+	g_object_set_property (G_OBJECT (container->priv->applet), property_name, &gvalue);
+	g_value_unset (&gvalue);
+}
+
+static void
+mate_panel_applet_container_applet_notify (GObject                  *applet,
+					   GParamSpec               *pspec,
+					   MatePanelAppletContainer *container)
+{
+	GVariant *value;
+
+	value = mate_panel_applet_container_get_direct (container, pspec->name);
+	if (!value)
+		return;
+
+	g_signal_emit (container, signals[CHILD_PROPERTY_CHANGED],
+		       g_quark_from_string (pspec->name),
+		       pspec->name, value);
+	g_variant_unref (value);
+}
+
 static void
 panel_applet_container_setup (MatePanelAppletContainer *container)
 {
@@ -114,6 +252,10 @@ panel_applet_container_setup (MatePanelAppletContainer *container)
 						"plug-removed",
 						G_CALLBACK (mate_panel_applet_container_plug_removed),
 						container);
+			g_signal_connect_swapped (container->priv->socket,
+						"plug-added",
+						G_CALLBACK (mate_panel_applet_container_plug_added),
+						container);
 
 			gtk_container_add (GTK_CONTAINER (container), container->priv->socket);
 			gtk_widget_show (container->priv->socket);
@@ -127,6 +269,18 @@ panel_applet_container_setup (MatePanelAppletContainer *container)
 		GtkWidget *applet;
 
 		applet = mate_panel_applets_manager_get_applet_widget (container->priv->iid, container->priv->uid);
+		if (!applet)
+			return;
+
+		container->priv->applet = applet;
+		g_object_add_weak_pointer (G_OBJECT (applet),
+					   (gpointer *) &container->priv->applet);
+		g_signal_connect_object (applet, "notify::flags",
+					 G_CALLBACK (mate_panel_applet_container_applet_notify),
+					 container, 0);
+		g_signal_connect_object (applet, "notify::size-hints",
+					 G_CALLBACK (mate_panel_applet_container_applet_notify),
+					 container, 0);
 
 		gtk_container_add (GTK_CONTAINER (container), applet);
 	}
@@ -155,6 +309,22 @@ mate_panel_applet_container_dispose (GObject *object)
 {
 	MatePanelAppletContainer *container = MATE_PANEL_APPLET_CONTAINER (object);
 
+	if (container->priv->prefetch_waiting) {
+		GList *waiting = container->priv->prefetch_waiting;
+		GList *l;
+
+		container->priv->prefetch_waiting = NULL;
+		for (l = waiting; l; l = l->next) {
+			g_task_return_new_error (l->data, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+						 "Applet container destroyed");
+			g_object_unref (l->data);
+		}
+		g_list_free (waiting);
+	}
+	g_clear_pointer (&container->priv->initial_properties, g_hash_table_destroy);
+	g_clear_pointer (&container->priv->property_names, g_hash_table_destroy);
+	g_clear_pointer (&container->priv->applet_statistics, g_variant_unref);
+
 	if (container->priv->pending_ops) {
 		mate_panel_applet_container_cancel_pending_operations (container);
 		g_hash_table_destroy (container->priv->pending_ops);
@@ -169,17 +339,39 @@ mate_panel_applet_container_dispose (GObject *object)
 		container->priv->name_watcher_id = 0;
 	}
 
+	mate_panel_applet_container_unwatch_signals (container);
 	g_clear_object (&container->priv->applet_proxy);
 
+	if (container->priv->applet) {
+		g_object_remove_weak_pointer (G_OBJECT (container->priv->applet),
+					      (gpointer *) &container->priv->applet);
+		container->priv->applet = NULL;
+	}
+
 	G_OBJECT_CLASS (mate_panel_applet_container_parent_class)->dispose (object);
 }
 
+static void
+mate_panel_applet_container_size_allocate (GtkWidget     *widget,
+					   GtkAllocation *allocation)
+{
+	MatePanelAppletContainer *container = MATE_PANEL_APPLET_CONTAINER (widget);
+
+	GTK_WIDGET_CLASS (mate_panel_applet_container_parent_class)->size_allocate (widget, allocation);
+
+	if (container->priv->stage_times[MATE_PANEL_APPLET_CONTAINER_STAGE_READY] &&
+	    gtk_bin_get_child (GTK_BIN (container)))
+		mate_panel_applet_container_reach_stage (container, MATE_PANEL_APPLET_CONTAINER_STAGE_ALLOCATED);
+}
+
 static void
 mate_panel_applet_container_class_init (MatePanelAppletContainerClass *klass)
 {
-	GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+	GObjectClass   *gobject_class = G_OBJECT_CLASS (klass);
+	GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
 
 	gobject_class->dispose = mate_panel_applet_container_dispose;
+	widget_class->size_allocate = mate_panel_applet_container_size_allocate;
 
 	signals[APPLET_BROKEN] =
 		g_signal_new ("applet-broken",
@@ -276,6 +468,7 @@ mate_panel_applet_container_plug_removed (MatePanelAppletContainer *container)
 		container->priv->name_watcher_id = 0;
 	}
 
+	mate_panel_applet_container_unwatch_signals (container);
 	g_object_unref (container->priv->applet_proxy);
 	container->priv->applet_proxy = NULL;
 
@@ -286,15 +479,20 @@ mate_panel_applet_container_plug_removed (MatePanelAppletContainer *container)
 	 */
 	return FALSE;
 }
+
+static void
+mate_panel_applet_container_plug_added (MatePanelAppletContainer *container)
+{
+	mate_panel_applet_container_reach_stage (container, MATE_PANEL_APPLET_CONTAINER_STAGE_PLUG_ADDED);
+}
 #endif /* HAVE_X11 */
 
 static void
-mate_panel_applet_container_child_signal (GDBusProxy           *proxy,
-				     gchar                *sender_name,
-				     gchar                *signal_name,
-				     GVariant             *parameters,
-				     MatePanelAppletContainer *container)
+mate_panel_applet_container_child_signal (MatePanelAppletContainer *container,
+					  const gchar              *signal_name)
 {
+	container->priv->n_messages_in++;
+
 	if (g_strcmp0 (signal_name, "Move") == 0) {
 		g_signal_emit (container, signals[APPLET_MOVE], 0);
 	} else if (g_strcmp0 (signal_name, "RemoveFromPanel") == 0) {
@@ -307,23 +505,26 @@ mate_panel_applet_container_child_signal (GDBusProxy           *proxy,
 }
 
 static void
-on_property_changed (GDBusConnection      *connection,
-		     const gchar          *sender_name,
-		     const gchar          *object_path,
-		     const gchar          *interface_name,
-		     const gchar          *signal_name,
-		     GVariant             *parameters,
-		     MatePanelAppletContainer *container)
+mate_panel_applet_container_property_changed (MatePanelAppletContainer *container,
+					      GVariant                 *parameters)
 {
 	GVariant    *props;
 	GVariantIter iter;
 	GVariant    *value;
 	gchar       *key;
 
+	container->priv->n_messages_in++;
+
 	g_variant_get (parameters, "(s@a{sv}*)", NULL, &props, NULL);
 
 	g_variant_iter_init (&iter, props);
 	while (g_variant_iter_loop (&iter, "{sv}", &key, &value)) {
+		/* keep the prefetched values current until they are read */
+		if (container->priv->initial_properties &&
+		    g_hash_table_contains (container->priv->initial_properties, key))
+			g_hash_table_insert (container->priv->initial_properties,
+					     g_strdup (key), g_variant_ref (value));
+
 		if (g_strcmp0 (key, "Flags") == 0) {
 			g_signal_emit (container, signals[CHILD_PROPERTY_CHANGED],
 				       g_quark_from_string ("flags"),
@@ -338,6 +539,132 @@ on_property_changed (GDBusConnection      *connection,
 	g_variant_unref (props);
 }
 
+static MatePanelAppletContainer *
+mate_panel_applet_container_lookup (const gchar *sender_name,
+				    const gchar *object_path)
+{
+	MatePanelAppletContainer *container;
+	gchar                    *key;
+
+	if (!applet_containers || !sender_name || !object_path)
+		return NULL;
+
+	/* unique names have no '/' */
+	key = g_strconcat (sender_name, object_path, NULL);
+	container = g_hash_table_lookup (applet_containers, key);
+	g_free (key);
+
+	return container;
+}
+
+static void
+on_applet_signal (GDBusConnection *connection,
+		  const gchar     *sender_name,
+		  const gchar     *object_path,
+		  const gchar     *interface_name,
+		  const gchar     *signal_name,
+		  GVariant        *parameters,
+		  gpointer         user_data)
+{
+	MatePanelAppletContainer *container;
+
+	container = mate_panel_applet_container_lookup (sender_name, object_path);
+	if (container)
+		mate_panel_applet_container_child_signal (container, signal_name);
+}
+
+static void
+on_property_changed (GDBusConnection *connection,
+		     const gchar     *sender_name,
+		     const gchar     *object_path,
+		     const gchar     *interface_name,
+		     const gchar     *signal_name,
+		     GVariant        *parameters,
+		     gpointer         user_data)
+{
+	MatePanelAppletContainer *container;
+
+	container = mate_panel_applet_container_lookup (sender_name, object_path);
+
+	/* in-process applets notify us directly */
+	if (container && container->priv->out_of_process)
+		mate_panel_applet_container_property_changed (container, parameters);
+}
+
+static void
+mate_panel_applet_container_watch_signals (MatePanelAppletContainer *container)
+{
+	GDBusProxy *proxy = container->priv->applet_proxy;
+
+	if (!applet_containers) {
+		applet_containers = g_hash_table_new (g_str_hash, g_str_equal);
+
+		applet_signals_connection = g_object_ref (g_dbus_proxy_get_connection (proxy));
+		applet_signals_id =
+			g_dbus_connection_signal_subscribe (applet_signals_connection,
+							    NULL,
+							    MATE_PANEL_APPLET_INTERFACE,
+							    NULL, NULL, NULL,
+							    G_DBUS_SIGNAL_FLAGS_NONE,
+							    on_applet_signal,
+							    NULL, NULL);
+		applet_properties_id =
+			g_dbus_connection_signal_subscribe (applet_signals_connection,
+							    NULL,
+							    "org.freedesktop.DBus.Properties",
+							    "PropertiesChanged",
+							    NULL,
+							    MATE_PANEL_APPLET_INTERFACE,
+							    G_DBUS_SIGNAL_FLAGS_NONE,
+							    on_property_changed,
+							    NULL, NULL);
+	}
+
+	container->priv->signal_key = g_strconcat (g_dbus_proxy_get_name (proxy),
+						   g_dbus_proxy_get_object_path (proxy),
+						   NULL);
+	g_hash_table_replace (applet_containers, container->priv->signal_key, container);
+}
+
+static void
+mate_panel_applet_container_unwatch_signals (MatePanelAppletContainer *container)
+{
+	if (!container->priv->signal_key)
+		return;
+
+	/* another container may have the same key once this one is broken */
+	if (g_hash_table_lookup (applet_containers, container->priv->signal_key) == container)
+		g_hash_table_remove (applet_containers, container->priv->signal_key);
+	g_clear_pointer (&container->priv->signal_key, g_free);
+
+	if (g_hash_table_size (applet_containers) > 0)
+		return;
+
+	g_dbus_connection_signal_unsubscribe (applet_signals_connection, applet_signals_id);
+	g_dbus_connection_signal_unsubscribe (applet_signals_connection, applet_properties_id);
+	applet_signals_id = 0;
+	applet_properties_id = 0;
+	g_clear_object (&applet_signals_connection);
+	g_clear_pointer (&applet_containers, g_hash_table_destroy);
+}
+
+static void
+get_applet_pid_cb (GObject      *source_object,
+		   GAsyncResult *res,
+		   gpointer      user_data)
+{
+	MatePanelAppletContainer *container = MATE_PANEL_APPLET_CONTAINER (user_data);
+	GVariant                 *retvals;
+
+	retvals = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object), res, NULL);
+	if (retvals) {
+		g_variant_get (retvals, "(u)", &container->priv->pid);
+		g_variant_unref (retvals);
+	}
+
+	g_object_unref (container);
+}
+
 static void
 on_proxy_appeared (GObject      *source_object,
 		   GAsyncResult *res,
@@ -358,19 +685,24 @@ on_proxy_appeared (GObject      *source_object,
 
 	container = MATE_PANEL_APPLET_CONTAINER (g_async_result_get_source_object (G_ASYNC_RESULT (task)));
 	container->priv->applet_proxy = proxy;
-	g_signal_connect (container->priv->applet_proxy, "g-signal",
-			  G_CALLBACK (mate_panel_applet_container_child_signal),
-			  container);
-	g_dbus_connection_signal_subscribe (g_dbus_proxy_get_connection (proxy),
-					    g_dbus_proxy_get_name (proxy),
-					    "org.freedesktop.DBus.Properties",
-					    "PropertiesChanged",
-					    g_dbus_proxy_get_object_path (proxy),
-					    MATE_PANEL_APPLET_INTERFACE,
-					    G_DBUS_SIGNAL_FLAGS_NONE,
-					    (GDBusSignalCallback) on_property_changed,
-					    container, NULL);
+	mate_panel_applet_container_watch_signals (container);
+
+	if (container->priv->out_of_process)
+		g_dbus_connection_call (g_dbus_proxy_get_connection (proxy),
+					"org.freedesktop.DBus",
+					"/org/freedesktop/DBus",
+					"org.freedesktop.DBus",
+					"GetConnectionUnixProcessID",
+					g_variant_new ("(s)", container->priv->bus_name),
+					G_VARIANT_TYPE ("(u)"),
+					G_DBUS_CALL_FLAGS_NONE,
+					-1, NULL,
+					get_applet_pid_cb,
+					g_object_ref (container));
+	else
+		container->priv->pid = getpid ();
 
+	mate_panel_applet_container_reach_stage (container, MATE_PANEL_APPLET_CONTAINER_STAGE_READY);
 	g_task_return_boolean (task,TRUE);
 	g_object_unref (task);
 
@@ -388,6 +720,10 @@ on_proxy_appeared (GObject      *source_object,
 	g_object_unref (container);
 }
 
+static void prefetch_properties_cb (GObject      *source_object,
+				    GAsyncResult *res,
+				    gpointer      user_data);
+
 static void
 get_applet_cb (GObject      *source_object,
 	       GAsyncResult *res,
@@ -400,15 +736,21 @@ get_applet_cb (GObject      *source_object,
 	const gchar          *applet_path;
 	GError               *error = NULL;
 
+	container = MATE_PANEL_APPLET_CONTAINER (g_async_result_get_source_object (G_ASYNC_RESULT (task)));
+	panel_trace_async_end ("applet", container->priv->iid, container);
+
 	retvals = g_dbus_connection_call_finish (connection, res, &error);
 	if (!retvals) {
 		g_task_return_error (task, error);
 		g_object_unref (task);
+		g_object_unref (container);
 
 		return;
 	}
 
-	container = MATE_PANEL_APPLET_CONTAINER (g_async_result_get_source_object (G_ASYNC_RESULT (task)));
+	container->priv->n_messages_in++;
+	mate_panel_applet_container_reach_stage (container, MATE_PANEL_APPLET_CONTAINER_STAGE_GET_APPLET);
+
 	g_variant_get (retvals,
 	               "(&obuu)",
 	               &applet_path,
@@ -416,8 +758,31 @@ get_applet_cb (GObject      *source_object,
 	               &container->priv->xid,
 	               &container->priv->uid);
 
+	/* the frame needs the flags and size hints before it can lay the
+	 * applet out: ask for them now, in parallel with setting up the
+	 * proxy, with one round trip for all of them. In-process applets
+	 * are read directly. */
+	if (container->priv->out_of_process) {
+		container->priv->prefetching = TRUE;
+		container->priv->n_messages_out++;
+		g_dbus_connection_call (connection,
+					container->priv->bus_name,
+					applet_path,
+					"org.freedesktop.DBus.Properties",
+					"GetAll",
+					g_variant_new ("(s)", MATE_PANEL_APPLET_INTERFACE),
+					G_VARIANT_TYPE ("(a{sv})"),
+					G_DBUS_CALL_FLAGS_NO_AUTO_START,
+					-1, NULL,
+					prefetch_properties_cb,
+					g_object_ref (container));
+	}
+
+	/* only used for the calls: the properties are read with GetAll
+	 * and the signals come through applet_containers */
 	g_dbus_proxy_new (connection,
-			  G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+			  G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+			  G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
 			  NULL,
 			  container->priv->bus_name,
 			  applet_path,
@@ -460,8 +825,11 @@ on_factory_appeared (GDBusConnection   *connection,
 
 	data = g_task_get_task_data (task);
 	container = MATE_PANEL_APPLET_CONTAINER (g_async_result_get_source_object (G_ASYNC_RESULT (task)));
+	panel_trace_instant ("applet", name);
+	mate_panel_applet_container_reach_stage (container, MATE_PANEL_APPLET_CONTAINER_STAGE_FACTORY);
 	container->priv->bus_name = g_strdup (name_owner);
 	object_path = g_strdup_printf (MATE_PANEL_APPLET_FACTORY_OBJECT_PATH, data->factory_id);
+	container->priv->n_messages_out++;
 	g_dbus_connection_call (connection,
 				name_owner,
 				object_path,
@@ -530,6 +898,9 @@ mate_panel_applet_container_get_applet (MatePanelAppletContainer *container,
 	bus_name = g_strdup_printf (MATE_PANEL_APPLET_BUS_NAME, factory_id);
 
 	container->priv->iid = g_strdup (iid);
+	panel_trace_async_begin ("applet", iid, container);
+	memset (container->priv->stage_times, 0, sizeof (container->priv->stage_times));
+	container->priv->activation_start = g_get_monotonic_time ();
 	container->priv->name_watcher_id =
 		g_bus_watch_name (G_BUS_TYPE_SESSION,
 				  bus_name,
@@ -570,6 +941,15 @@ mate_panel_applet_container_add_finish (MatePanelAppletContainer *container,
 	return g_task_propagate_boolean (G_TASK (result), error);
 }
 
+static void
+mate_panel_applet_container_count_reply (GTask *task)
+{
+	MatePanelAppletContainer *container;
+
+	container = MATE_PANEL_APPLET_CONTAINER (g_task_get_source_object (task));
+	container->priv->n_messages_in++;
+}
+
 /* Child Properties */
 static void
 set_applet_property_cb (GObject      *source_object,
@@ -589,6 +969,7 @@ set_applet_property_cb (GObject      *source_object,
 		g_task_return_error (task, error);
 		return;
 	} else {
+		mate_panel_applet_container_count_reply (task);
 		g_variant_unref (retvals);
 	}
 
@@ -633,12 +1014,21 @@ mate_panel_applet_container_child_set (MatePanelAppletContainer *container,
 			   user_data);
 	g_task_set_source_tag (task,mate_panel_applet_container_child_set);
 
+	if (container->priv->applet) {
+		mate_panel_applet_container_set_direct (container, info->name,
+							(GVariant *) value);
+		g_task_return_boolean (task, TRUE);
+		g_object_unref (task);
+		return NULL;
+	}
+
 	if (cancellable)
 		g_object_ref (cancellable);
 	else
 		cancellable = g_cancellable_new ();
 	g_hash_table_insert (container->priv->pending_ops, task, cancellable);
 
+	container->priv->n_messages_out++;
 	g_dbus_connection_call (g_dbus_proxy_get_connection (proxy),
 				g_dbus_proxy_get_name (proxy),
 				g_dbus_proxy_get_object_path (proxy),
@@ -667,6 +1057,266 @@ mate_panel_applet_container_child_set_finish (MatePanelAppletContainer *containe
 	return g_task_propagate_boolean (G_TASK (result), error);
 }
 
+typedef struct {
+	GTask  *task;
+	guint   n_pending;
+	GError *error;
+} SetOneByOneData;
+
+static void
+set_one_property_cb (GObject      *source_object,
+		     GAsyncResult *res,
+		     gpointer      user_data)
+{
+	SetOneByOneData          *data = user_data;
+	MatePanelAppletContainer *container;
+	GVariant                 *retvals;
+	GError                   *error = NULL;
+
+	retvals = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object),
+						 res, &error);
+	if (retvals) {
+		mate_panel_applet_container_count_reply (data->task);
+		g_variant_unref (retvals);
+	} else if (!data->error) {
+		data->error = error;
+	} else {
+		g_error_free (error);
+	}
+
+	if (--data->n_pending > 0)
+		return;
+
+	container = MATE_PANEL_APPLET_CONTAINER (g_task_get_source_object (data->task));
+	if (container->priv->pending_ops)
+		g_hash_table_remove (container->priv->pending_ops, data->task);
+
+	if (data->error) {
+		if (!g_error_matches (data->error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			g_warning ("Error setting properties: %s\n", data->error->message);
+		g_task_return_error (data->task, data->error);
+	} else {
+		g_task_return_boolean (data->task, TRUE);
+	}
+
+	g_object_unref (data->task);
+	g_free (data);
+}
+
+/* Applets built before SetProperties existed get one Set per property;
+ * task, in the pending operations with cancellable, returns after the
+ * last one */
+static void
+mate_panel_applet_container_set_one_by_one (MatePanelAppletContainer *container,
+					    GVariant                 *properties,
+					    GTask                    *task,
+					    GCancellable             *cancellable)
+{
+	GDBusProxy      *proxy = container->priv->applet_proxy;
+	SetOneByOneData *data;
+	GVariantIter     iter;
+	const gchar     *key;
+	GVariant        *value;
+
+	if (!proxy || g_variant_n_children (properties) == 0) {
+		g_hash_table_remove (container->priv->pending_ops, task);
+		if (proxy)
+			g_task_return_boolean (task, TRUE);
+		else
+			g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NOT_CONNECTED,
+						 "%s: Applet is not running", G_STRLOC);
+		g_object_unref (task);
+		return;
+	}
+
+	data = g_new0 (SetOneByOneData, 1);
+	data->task = task;
+	data->n_pending = g_variant_n_children (properties);
+
+	g_variant_iter_init (&iter, properties);
+	while (g_variant_iter_loop (&iter, "{&sv}", &key, &value)) {
+		container->priv->n_messages_out++;
+		g_dbus_connection_call (g_dbus_proxy_get_connection (proxy),
+					g_dbus_proxy_get_name (proxy),
+					g_dbus_proxy_get_object_path (proxy),
+					"org.freedesktop.DBus.Properties",
+					"Set",
+					g_variant_new ("(ssv)",
+						       g_dbus_proxy_get_interface_name (proxy),
+						       key,
+						       value),
+					NULL,
+					G_DBUS_CALL_FLAGS_NO_AUTO_START,
+					-1, cancellable,
+					set_one_property_cb,
+					data);
+	}
+}
+
+static void
+set_applet_properties_cb (GObject      *source_object,
+			  GAsyncResult *res,
+			  gpointer      user_data)
+{
+	GDBusConnection          *connection = G_DBUS_CONNECTION (source_object);
+	GTask                    *task = G_TASK (user_data);
+	MatePanelAppletContainer *container;
+	GVariant                 *retvals;
+	GError                   *error = NULL;
+
+	container = MATE_PANEL_APPLET_CONTAINER (g_async_result_get_source_object (G_ASYNC_RESULT (task)));
+
+	retvals = g_dbus_connection_call_finish (connection, res, &error);
+	if (!retvals &&
+	    g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD) &&
+	    container->priv->pending_ops) {
+		container->priv->no_set_properties = TRUE;
+		g_clear_error (&error);
+
+		/* the task stays pending until the last Set is answered */
+		mate_panel_applet_container_set_one_by_one (container,
+							    g_task_get_task_data (task),
+							    task,
+							    g_hash_table_lookup (container->priv->pending_ops, task));
+
+		/* g_async_result_get_source_object returns new ref */
+		g_object_unref (container);
+		return;
+	}
+
+	if (container->priv->pending_ops)
+		g_hash_table_remove (container->priv->pending_ops, task);
+
+	if (error) {
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			g_warning ("Error setting properties: %s\n", error->message);
+		g_task_return_error (task, error);
+	} else {
+		if (retvals) {
+			container->priv->n_messages_in++;
+			g_variant_unref (retvals);
+		}
+		g_task_return_boolean (task, TRUE);
+	}
+	g_object_unref (task);
+
+	/* g_async_result_get_source_object returns new ref */
+	g_object_unref (container);
+}
+
+/* Applies several child properties, a{sv} keyed by child property name,
+ * with one SetProperties call: the applet gets all of them in a single
+ * message and processes them together, instead of relayouting after each
+ * one. */
+gconstpointer
+mate_panel_applet_container_child_set_properties (MatePanelAppletContainer *container,
+						  GVariant                 *properties,
+						  GCancellable             *cancellable,
+						  GAsyncReadyCallback       callback,
+						  gpointer                  user_data)
+{
+	GDBusProxy      *proxy = container->priv->applet_proxy;
+	GVariantBuilder  builder;
+	GVariantIter     iter;
+	GVariant        *dbus_properties;
+	const gchar     *key;
+	GVariant        *value;
+	GTask           *task;
+
+	g_variant_ref_sink (properties);
+
+	if (!proxy) {
+		g_variant_unref (properties);
+		g_task_report_new_error (G_OBJECT (container),
+					 callback, user_data,
+					 mate_panel_applet_container_child_set_properties,
+					 G_IO_ERROR, G_IO_ERROR_NOT_CONNECTED,
+					 "%s: Applet is not running", G_STRLOC);
+		return NULL;
+	}
+
+	if (container->priv->applet) {
+		GObject *applet = G_OBJECT (container->priv->applet);
+
+		g_object_freeze_notify (applet);
+		g_variant_iter_init (&iter, properties);
+		while (g_variant_iter_loop (&iter, "{&sv}", &key, &value)) {
+			if (mate_panel_applet_container_child_property_get_info (key))
+				mate_panel_applet_container_set_direct (container, key, value);
+		}
+		g_object_thaw_notify (applet);
+		g_variant_unref (properties);
+
+		task = g_task_new (G_OBJECT (container), cancellable, callback, user_data);
+		g_task_set_source_tag (task, mate_panel_applet_container_child_set_properties);
+		g_task_return_boolean (task, TRUE);
+		g_object_unref (task);
+		return NULL;
+	}
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+	g_variant_iter_init (&iter, properties);
+	while (g_variant_iter_loop (&iter, "{&sv}", &key, &value)) {
+		const AppletPropertyInfo *info;
+
+		info = mate_panel_applet_container_child_property_get_info (key);
+		if (!info) {
+			g_warning ("%s: Applet has no child property named `%s'",
+				   G_STRLOC, key);
+			continue;
+		}
+
+		g_variant_builder_add (&builder, "{sv}", info->dbus_name, value);
+	}
+	dbus_properties = g_variant_ref_sink (g_variant_builder_end (&builder));
+	g_variant_unref (properties);
+
+	task = g_task_new (G_OBJECT (container),
+			   cancellable,
+			   callback,
+			   user_data);
+	g_task_set_source_tag (task, mate_panel_applet_container_child_set_properties);
+
+	g_task_set_task_data (task, dbus_properties, (GDestroyNotify) g_variant_unref);
+
+	if (cancellable)
+		g_object_ref (cancellable);
+	else
+		cancellable = g_cancellable_new ();
+	g_hash_table_insert (container->priv->pending_ops, task, cancellable);
+
+	if (container->priv->no_set_properties) {
+		mate_panel_applet_container_set_one_by_one (container, dbus_properties,
+							    task, cancellable);
+		return task;
+	}
+
+	container->priv->n_messages_out++;
+	g_dbus_connection_call (g_dbus_proxy_get_connection (proxy),
+				g_dbus_proxy_get_name (proxy),
+				g_dbus_proxy_get_object_path (proxy),
+				MATE_PANEL_APPLET_INTERFACE,
+				"SetProperties",
+				g_variant_new ("(@a{sv})", dbus_properties),
+				NULL,
+				G_DBUS_CALL_FLAGS_NO_AUTO_START,
+				-1, cancellable,
+				set_applet_properties_cb,
+				task);
+
+	return task;
+}
+
+gboolean
+mate_panel_applet_container_child_set_properties_finish (MatePanelAppletContainer *container,
+							 GAsyncResult             *result,
+							 GError                  **error)
+{
+	g_return_val_if_fail (g_task_is_valid (result, container), FALSE);
+	g_warn_if_fail (g_task_get_source_tag (G_TASK (result)) == mate_panel_applet_container_child_set_properties);
+	return g_task_propagate_boolean (G_TASK (result), error);
+}
+
 static void
 get_applet_property_cb (GObject      *source_object,
 			GAsyncResult *res,
@@ -687,19 +1337,149 @@ get_applet_property_cb (GObject      *source_object,
 		return;
 	}
 
+	mate_panel_applet_container_count_reply (task);
+
 	item = g_variant_get_child_value (retvals, 0);
 	value = g_variant_get_variant (item);
 	g_variant_unref (item);
 	g_variant_unref (retvals);
 
 	container = MATE_PANEL_APPLET_CONTAINER (g_async_result_get_source_object (G_ASYNC_RESULT (task)));
-	g_hash_table_remove (container->priv->pending_ops, task);
+	if (container->priv->pending_ops)
+		g_hash_table_remove (container->priv->pending_ops, task);
 	g_task_return_pointer (task,value,(GDestroyNotify) g_variant_unref);
 	g_object_unref (task);
 
 	g_object_unref (container);
 }
 
+static void
+mate_panel_applet_container_send_get (MatePanelAppletContainer *container,
+				      GTask                    *task,
+				      const AppletPropertyInfo *info)
+{
+	GDBusProxy   *proxy = container->priv->applet_proxy;
+	GCancellable *cancellable;
+
+	cancellable = g_hash_table_lookup (container->priv->pending_ops, task);
+
+	if (!proxy) {
+		g_hash_table_remove (container->priv->pending_ops, task);
+		g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NOT_CONNECTED,
+					 "Applet is not running");
+		g_object_unref (task);
+		return;
+	}
+
+	container->priv->n_messages_out++;
+	g_dbus_connection_call (g_dbus_proxy_get_connection (proxy),
+				g_dbus_proxy_get_name (proxy),
+				g_dbus_proxy_get_object_path (proxy),
+				"org.freedesktop.DBus.Properties",
+				"Get",
+				g_variant_new ("(ss)",
+					       g_dbus_proxy_get_interface_name (proxy),
+					       info->dbus_name),
+				G_VARIANT_TYPE ("(v)"),
+				G_DBUS_CALL_FLAGS_NO_AUTO_START,
+				-1, cancellable,
+				get_applet_property_cb,
+				task);
+}
+
+/* Returns FALSE when the property was not prefetched, or was read already */
+static gboolean
+mate_panel_applet_container_return_prefetched (MatePanelAppletContainer *container,
+					       GTask                    *task,
+					       const AppletPropertyInfo *info)
+{
+	GVariant *value;
+
+	if (!container->priv->initial_properties)
+		return FALSE;
+
+	value = g_hash_table_lookup (container->priv->initial_properties, info->dbus_name);
+	if (!value)
+		return FALSE;
+
+	g_variant_ref (value);
+	g_hash_table_remove (container->priv->initial_properties, info->dbus_name);
+
+	/* later values are only known by asking the applet */
+	if (g_hash_table_size (container->priv->initial_properties) == 0)
+		g_clear_pointer (&container->priv->initial_properties, g_hash_table_destroy);
+
+	g_task_return_pointer (task, value, (GDestroyNotify) g_variant_unref);
+	g_object_unref (task);
+
+	return TRUE;
+}
+
+static void
+prefetch_properties_cb (GObject      *source_object,
+			GAsyncResult *res,
+			gpointer      user_data)
+{
+	GDBusConnection          *connection = G_DBUS_CONNECTION (source_object);
+	MatePanelAppletContainer *container = MATE_PANEL_APPLET_CONTAINER (user_data);
+	GVariant                 *retvals;
+	GList                    *waiting;
+	GList                    *l;
+	GError                   *error = NULL;
+
+	container->priv->prefetching = FALSE;
+
+	retvals = g_dbus_connection_call_finish (connection, res, &error);
+	if (!retvals) {
+		/* the properties are asked one by one instead */
+		g_error_free (error);
+	} else if (container->priv->pending_ops) {
+		GVariant     *props;
+		GVariantIter  iter;
+		gchar        *key;
+		GVariant     *value;
+
+		container->priv->n_messages_in++;
+
+		container->priv->initial_properties =
+			g_hash_table_new_full (g_str_hash, g_str_equal,
+					       g_free, (GDestroyNotify) g_variant_unref);
+		container->priv->property_names =
+			g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+		props = g_variant_get_child_value (retvals, 0);
+		g_variant_iter_init (&iter, props);
+		while (g_variant_iter_next (&iter, "{sv}", &key, &value)) {
+			g_hash_table_add (container->priv->property_names, g_strdup (key));
+			g_hash_table_insert (container->priv->initial_properties, key, value);
+		}
+		g_variant_unref (props);
+	}
+	g_clear_pointer (&retvals, g_variant_unref);
+
+	waiting = g_list_reverse (container->priv->prefetch_waiting);
+	container->priv->prefetch_waiting = NULL;
+
+	for (l = waiting; l; l = l->next) {
+		GTask                    *task = l->data;
+		const AppletPropertyInfo *info = g_task_get_task_data (task);
+
+		if (g_task_return_error_if_cancelled (task)) {
+			g_hash_table_remove (container->priv->pending_ops, task);
+			g_object_unref (task);
+			continue;
+		}
+
+		if (mate_panel_applet_container_return_prefetched (container, task, info))
+			g_hash_table_remove (container->priv->pending_ops, task);
+		else
+			mate_panel_applet_container_send_get (container, task, info);
+	}
+	g_list_free (waiting);
+
+	g_object_unref (container);
+}
+
 gconstpointer
 mate_panel_applet_container_child_get (MatePanelAppletContainer *container,
 				  const gchar          *property_name,
@@ -725,25 +1505,40 @@ mate_panel_applet_container_child_get (MatePanelAppletContainer *container,
 			   callback,
 			   user_data);
 	g_task_set_source_tag (task,mate_panel_applet_container_child_get);
+
+	if (container->priv->applet) {
+		GVariant *value;
+
+		value = mate_panel_applet_container_get_direct (container, info->name);
+		if (value)
+			g_task_return_pointer (task, value, (GDestroyNotify) g_variant_unref);
+		else
+			g_task_return_new_error (task,
+						 MATE_PANEL_APPLET_CONTAINER_ERROR,
+						 MATE_PANEL_APPLET_CONTAINER_INVALID_CHILD_PROPERTY,
+						 "%s: Applet has no property named `%s'",
+						 G_STRLOC, info->name);
+		g_object_unref (task);
+		return NULL;
+	}
+
+	if (mate_panel_applet_container_return_prefetched (container, task, info))
+		return NULL;
+
 	if (cancellable)
 		g_object_ref (cancellable);
 	else
 		cancellable = g_cancellable_new ();
 	g_hash_table_insert (container->priv->pending_ops, task, cancellable);
 
-	g_dbus_connection_call (g_dbus_proxy_get_connection (proxy),
-				g_dbus_proxy_get_name (proxy),
-				g_dbus_proxy_get_object_path (proxy),
-				"org.freedesktop.DBus.Properties",
-				"Get",
-				g_variant_new ("(ss)",
-					       g_dbus_proxy_get_interface_name (proxy),
-					       info->dbus_name),
-				G_VARIANT_TYPE ("(v)"),
-				G_DBUS_CALL_FLAGS_NO_AUTO_START,
-				-1, cancellable,
-				get_applet_property_cb,
-				task);
+	if (container->priv->prefetching) {
+		/* info points to the static table */
+		g_task_set_task_data (task, (gpointer) info, NULL);
+		container->priv->prefetch_waiting =
+			g_list_prepend (container->priv->prefetch_waiting, task);
+	} else {
+		mate_panel_applet_container_send_get (container, task, info);
+	}
 
 	return task;
 }
@@ -774,6 +1569,7 @@ child_popup_menu_cb (GObject      *source_object,
 		g_task_return_error (task, error);
 		return;
 	} else {
+		mate_panel_applet_container_count_reply (task);
 		g_variant_unref (retvals);
 		g_task_return_boolean (task,TRUE);
 	}
@@ -800,6 +1596,7 @@ mate_panel_applet_container_child_popup_menu (MatePanelAppletContainer *containe
 			   user_data);
 	g_task_set_source_tag (task,mate_panel_applet_container_child_popup_menu);
 
+	container->priv->n_messages_out++;
 	g_dbus_connection_call (g_dbus_proxy_get_connection (proxy),
 				g_dbus_proxy_get_name (proxy),
 				g_dbus_proxy_get_object_path (proxy),
@@ -823,6 +1620,84 @@ mate_panel_applet_container_child_popup_menu_finish (MatePanelAppletContainer *c
 	return g_task_propagate_boolean (G_TASK (result), error);
 }
 
+static void
+update_statistics_cb (GObject      *source_object,
+		      GAsyncResult *res,
+		      gpointer      user_data)
+{
+	GDBusConnection          *connection = G_DBUS_CONNECTION (source_object);
+	GTask                    *task = G_TASK (user_data);
+	MatePanelAppletContainer *container;
+	GVariant                 *retvals;
+	GError                   *error = NULL;
+
+	retvals = g_dbus_connection_call_finish (connection, res, &error);
+	if (!retvals) {
+		g_task_return_error (task, error);
+		g_object_unref (task);
+		return;
+	}
+
+	mate_panel_applet_container_count_reply (task);
+
+	container = MATE_PANEL_APPLET_CONTAINER (g_task_get_source_object (task));
+	g_clear_pointer (&container->priv->applet_statistics, g_variant_unref);
+	container->priv->applet_statistics = g_variant_get_child_value (retvals, 0);
+	g_variant_unref (retvals);
+
+	g_task_return_boolean (task, TRUE);
+	g_object_unref (task);
+}
+
+/* Asks the applet for its statistics, which the next calls to
+ * mate_panel_applet_container_get_stats() add with an "applet-" prefix.
+ * Fails with the applets built before GetStatistics existed. */
+void
+mate_panel_applet_container_update_statistics (MatePanelAppletContainer *container,
+					       GCancellable             *cancellable,
+					       GAsyncReadyCallback       callback,
+					       gpointer                  user_data)
+{
+	GTask      *task;
+	GDBusProxy *proxy = container->priv->applet_proxy;
+
+	task = g_task_new (G_OBJECT (container),
+			   cancellable,
+			   callback,
+			   user_data);
+	g_task_set_source_tag (task, mate_panel_applet_container_update_statistics);
+
+	if (!proxy) {
+		g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NOT_CONNECTED,
+					 "The applet is not running");
+		g_object_unref (task);
+		return;
+	}
+
+	container->priv->n_messages_out++;
+	g_dbus_connection_call (g_dbus_proxy_get_connection (proxy),
+				g_dbus_proxy_get_name (proxy),
+				g_dbus_proxy_get_object_path (proxy),
+				MATE_PANEL_APPLET_INTERFACE,
+				"GetStatistics",
+				NULL,
+				G_VARIANT_TYPE ("(a{st})"),
+				G_DBUS_CALL_FLAGS_NO_AUTO_START,
+				-1, cancellable,
+				update_statistics_cb,
+				task);
+}
+
+gboolean
+mate_panel_applet_container_update_statistics_finish (MatePanelAppletContainer *container,
+						      GAsyncResult             *result,
+						      GError                  **error)
+{
+	g_return_val_if_fail (g_task_is_valid (result, container), FALSE);
+	g_warn_if_fail (g_task_get_source_tag (G_TASK (result)) == mate_panel_applet_container_update_statistics);
+	return g_task_propagate_boolean (G_TASK (result), error);
+}
+
 void
 mate_panel_applet_container_cancel_operation (MatePanelAppletContainer *container,
                                               gconstpointer             operation)
@@ -833,3 +1708,145 @@ mate_panel_applet_container_cancel_operation (MatePanelAppletContainer *containe
 
 	g_cancellable_cancel (G_CANCELLABLE (value));
 }
+
+/* CPU time and resident memory of the process running the applet, which
+ * is the panel itself for in-process applets */
+static void
+mate_panel_applet_container_get_process_stats (guint32       pid,
+					       GVariantDict *stats)
+{
+	char   *path;
+	char   *contents;
+	char   *p;
+
+	path = g_strdup_printf ("/proc/%u/stat", pid);
+	if (g_file_get_contents (path, &contents, NULL, NULL)) {
+		/* the command name can contain spaces and parentheses */
+		p = strrchr (contents, ')');
+		if (p) {
+			char **fields = g_strsplit (p + 2, " ", -1);
+
+			/* utime and stime, the 14th and 15th fields */
+			if (g_strv_length (fields) > 12) {
+				guint64 ticks;
+
+				ticks = g_ascii_strtoull (fields[11], NULL, 10) +
+					g_ascii_strtoull (fields[12], NULL, 10);
+				g_variant_dict_insert (stats, "cpu-time-ms", "t",
+						       ticks * 1000 / sysconf (_SC_CLK_TCK));
+			}
+			g_strfreev (fields);
+		}
+		g_free (contents);
+	}
+	g_free (path);
+
+	path = g_strdup_printf ("/proc/%u/statm", pid);
+	if (g_file_get_contents (path, &contents, NULL, NULL)) {
+		char **fields = g_strsplit (contents, " ", -1);
+
+		if (g_strv_length (fields) > 1)
+			g_variant_dict_insert (stats, "rss-kb", "t",
+					       g_ascii_strtoull (fields[1], NULL, 10) *
+					       (sysconf (_SC_PAGESIZE) / 1024));
+		g_strfreev (fields);
+		g_free (contents);
+	}
+	g_free (path);
+}
+
+/* Whether the applet knows the child property: applets built against an
+ * older library lack the newer ones. Out-of-process applets are only known
+ * once their properties were prefetched, until then this returns FALSE. */
+gboolean
+mate_panel_applet_container_child_has_property (MatePanelAppletContainer *container,
+						const gchar              *property_name)
+{
+	const AppletPropertyInfo *info;
+
+	g_return_val_if_fail (PANEL_IS_APPLET_CONTAINER (container), FALSE);
+
+	info = mate_panel_applet_container_child_property_get_info (property_name);
+	if (!info)
+		return FALSE;
+
+	if (container->priv->applet)
+		return g_object_class_find_property (G_OBJECT_GET_CLASS (container->priv->applet),
+						     info->name) != NULL;
+
+	return container->priv->property_names &&
+	       g_hash_table_contains (container->priv->property_names, info->dbus_name);
+}
+
+const gchar *
+mate_panel_applet_container_stage_get_name (MatePanelAppletContainerStage stage)
+{
+	g_return_val_if_fail (stage < MATE_PANEL_APPLET_CONTAINER_N_STAGES, NULL);
+
+	return stage_names[stage];
+}
+
+/* Time in microseconds it took the last activation of the applet to reach
+ * the stage, or -1 if it did not (yet). In-process applets have no plug. */
+gint64
+mate_panel_applet_container_get_stage_time (MatePanelAppletContainer      *container,
+					    MatePanelAppletContainerStage  stage)
+{
+	g_return_val_if_fail (PANEL_IS_APPLET_CONTAINER (container), -1);
+	g_return_val_if_fail (stage < MATE_PANEL_APPLET_CONTAINER_N_STAGES, -1);
+
+	if (!container->priv->stage_times[stage])
+		return -1;
+
+	return container->priv->stage_times[stage] - container->priv->activation_start;
+}
+
+void
+mate_panel_applet_container_get_stats (MatePanelAppletContainer *container,
+				       GVariantDict             *stats)
+{
+	MatePanelAppletContainerStage stage;
+
+	g_variant_dict_insert (stats, "out-of-process", "b",
+			       container->priv->out_of_process);
+	g_variant_dict_insert (stats, "running", "b",
+			       container->priv->applet_proxy != NULL);
+	g_variant_dict_insert (stats, "messages-out", "u",
+			       container->priv->n_messages_out);
+	g_variant_dict_insert (stats, "messages-in", "u",
+			       container->priv->n_messages_in);
+
+	for (stage = 0; stage < MATE_PANEL_APPLET_CONTAINER_N_STAGES; stage++) {
+		gint64  time;
+		gchar  *key;
+
+		time = mate_panel_applet_container_get_stage_time (container, stage);
+		if (time < 0)
+			continue;
+
+		key = g_strdup_printf ("activation-%s-us", stage_names[stage]);
+		g_variant_dict_insert (stats, key, "x", time);
+		g_free (key);
+	}
+
+	if (container->priv->applet_statistics) {
+		GVariantIter  iter;
+		const gchar  *name;
+		guint64       value;
+
+		g_variant_iter_init (&iter, container->priv->applet_statistics);
+		while (g_variant_iter_next (&iter, "{&st}", &name, &value)) {
+			gchar *key;
+
+			key = g_strconcat ("applet-", name, NULL);
+			g_variant_dict_insert (stats, key, "t", value);
+			g_free (key);
+		}
+	}
+
+	if (container->priv->pid == 0)
+		return;
+
+	g_variant_dict_insert (stats, "pid", "u", container->priv->pid);
+	mate_panel_applet_container_get_process_stats (container->priv->pid, stats);
+}
@@ -46,6 +46,16 @@ typedef enum {
 	MATE_PANEL_APPLET_CONTAINER_INVALID_CHILD_PROPERTY
 } MatePanelAppletContainerError;
 
+/* Stages of the activation of an applet, in order */
+typedef enum {
+	MATE_PANEL_APPLET_CONTAINER_STAGE_FACTORY,    /* the factory is on the bus */
+	MATE_PANEL_APPLET_CONTAINER_STAGE_GET_APPLET, /* the factory created the applet */
+	MATE_PANEL_APPLET_CONTAINER_STAGE_READY,      /* the applet can be talked to */
+	MATE_PANEL_APPLET_CONTAINER_STAGE_PLUG_ADDED, /* the applet window is embedded */
+	MATE_PANEL_APPLET_CONTAINER_STAGE_ALLOCATED,  /* the applet got its first allocation */
+	MATE_PANEL_APPLET_CONTAINER_N_STAGES
+} MatePanelAppletContainerStage;
+
 typedef struct _MatePanelAppletContainer        MatePanelAppletContainer;
 typedef struct _MatePanelAppletContainerClass   MatePanelAppletContainerClass;
 typedef struct _MatePanelAppletContainerPrivate MatePanelAppletContainerPrivate;
@@ -93,6 +103,13 @@ void       mate_panel_applet_container_child_popup_menu        (MatePanelAppletC
 gboolean   mate_panel_applet_container_child_popup_menu_finish (MatePanelAppletContainer *container,
 							   GAsyncResult         *result,
 							   GError              **error);
+void       mate_panel_applet_container_update_statistics   (MatePanelAppletContainer *container,
+							   GCancellable         *cancellable,
+							   GAsyncReadyCallback   callback,
+							   gpointer              user_data);
+gboolean   mate_panel_applet_container_update_statistics_finish (MatePanelAppletContainer *container,
+							   GAsyncResult         *result,
+							   GError              **error);
 
 gconstpointer  mate_panel_applet_container_child_set           (MatePanelAppletContainer *container,
 							   const gchar          *property_name,
@@ -103,6 +120,22 @@ gconstpointer  mate_panel_applet_container_child_set           (MatePanelAppletC
 gboolean   mate_panel_applet_container_child_set_finish        (MatePanelAppletContainer *container,
 							   GAsyncResult         *result,
 							   GError              **error);
+gconstpointer  mate_panel_applet_container_child_set_properties (MatePanelAppletContainer *container,
+							   GVariant             *properties,
+							   GCancellable         *cancellable,
+							   GAsyncReadyCallback   callback,
+							   gpointer              user_data);
+gboolean   mate_panel_applet_container_child_set_properties_finish (MatePanelAppletContainer *container,
+							   GAsyncResult         *result,
+							   GError              **error);
+gboolean   mate_panel_applet_container_child_has_property (MatePanelAppletContainer *container,
+							   const gchar          *property_name);
+const gchar *mate_panel_applet_container_stage_get_name       (MatePanelAppletContainerStage stage);
+gint64     mate_panel_applet_container_get_stage_time      (MatePanelAppletContainer *container,
+							   MatePanelAppletContainerStage stage);
+void       mate_panel_applet_container_get_stats           (MatePanelAppletContainer *container,
+							   GVariantDict         *stats);
+
 gconstpointer  mate_panel_applet_container_child_get           (MatePanelAppletContainer *container,
 							   const gchar          *property_name,
 							   GCancellable         *cancellable,
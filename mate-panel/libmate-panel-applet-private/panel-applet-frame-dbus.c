@@ -30,8 +30,14 @@
 
 #include <string.h>
 
+#ifdef HAVE_X11
+#include <gdk/gdkx.h>
+#endif
+
+#include <panel-a11y.h>
 #include <panel-applet-frame.h>
 #include <panel-applets-manager.h>
+#include <panel-power.h>
 
 #include "panel-applet-container.h"
 #include "panel-applet-frame-dbus.h"
@@ -39,9 +45,40 @@
 struct _MatePanelAppletFrameDBusPrivate
 {
 	MatePanelAppletContainer *container;
-	gconstpointer             bg_operation;
+	char                     *bg_string;
+
+	/* last background descriptor sent, for applets that know them */
+	gboolean                  bg_descriptor_sent;
+	guint32                   bg_generation;
+	gint32                    bg_x;
+	gint32                    bg_y;
+
+	/* properties waiting to be sent to the applet */
+	GVariantDict             *pending;
+	guint                     flush_id;
+
+	/* last power profile sent, watched once the applet is there */
+	guint32                   power_profile;
+	gboolean                  power_notify;
+
+	/* last accessibility state sent, watched with the power profile */
+	gboolean                  a11y_enabled;
+
+	/* last XID of the panel window sent, for the focus requests */
+	guint32                   dock_window;
+
+	/* for mate_panel_applet_frame_get_stats() */
+	guint                     n_size_hints_changes;
+	guint                     n_relayouts;
+	guint                     n_background_pushes;
 };
 
+typedef struct {
+	MatePanelAppletFrameDBus *frame;
+	guint                     orient : 1;
+	guint                     background : 1;
+} FlushData;
+
 /* Keep in sync with mate-panel-applet.h. Uggh. */
 typedef enum {
 	APPLET_FLAGS_NONE   = 0,
@@ -74,6 +111,21 @@ get_mate_panel_applet_orient (PanelOrientation orientation)
 	}
 }
 
+/* The MatePanelAppletPowerProfile values, which have no automatic one */
+static guint32
+get_mate_panel_applet_power_profile (PanelPowerProfile profile)
+{
+	switch (profile) {
+	case PANEL_POWER_PROFILE_BALANCED:
+		return 1;
+	case PANEL_POWER_PROFILE_LOW_POWER:
+		return 2;
+	case PANEL_POWER_PROFILE_NORMAL:
+	default:
+		return 0;
+	}
+}
+
 static void
 mate_panel_applet_frame_dbus_update_flags (MatePanelAppletFrame *frame,
 				      GVariant         *value)
@@ -107,6 +159,7 @@ mate_panel_applet_frame_dbus_get_flags_cb (MatePanelAppletContainer *container,
 		return;
 	}
 
+	MATE_PANEL_APPLET_FRAME_DBUS (frame)->priv->n_relayouts++;
 	mate_panel_applet_frame_dbus_update_flags (frame, value);
 	g_variant_unref (value);
 }
@@ -135,6 +188,8 @@ mate_panel_applet_frame_dbus_get_size_hints_cb (MatePanelAppletContainer *contai
 		memcpy (size_hints, sz, n_elements * sizeof (gint32));
 	}
 
+	MATE_PANEL_APPLET_FRAME_DBUS (frame)->priv->n_size_hints_changes++;
+	MATE_PANEL_APPLET_FRAME_DBUS (frame)->priv->n_relayouts++;
 	_mate_panel_applet_frame_update_size_hints (frame, size_hints, n_elements);
 	g_variant_unref (value);
 }
@@ -152,6 +207,138 @@ mate_panel_applet_frame_dbus_init_properties (MatePanelAppletFrame *frame)
 					  frame);
 }
 
+static void
+properties_set_cb (GObject      *source_object,
+		   GAsyncResult *res,
+		   gpointer      user_data)
+{
+	MatePanelAppletContainer *container = MATE_PANEL_APPLET_CONTAINER (source_object);
+	FlushData                *data = user_data;
+	GError                   *error = NULL;
+
+	if (!mate_panel_applet_container_child_set_properties_finish (container, res, &error)) {
+		/* send the background again on the next change */
+		if (data->background &&
+		    !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			g_clear_pointer (&data->frame->priv->bg_string, g_free);
+			data->frame->priv->bg_descriptor_sent = FALSE;
+		}
+		g_error_free (error);
+	} else if (data->orient) {
+		data->frame->priv->n_relayouts++;
+		gtk_widget_queue_resize (GTK_WIDGET (data->frame));
+	}
+
+	g_object_unref (data->frame);
+	g_slice_free (FlushData, data);
+}
+
+static gboolean
+mate_panel_applet_frame_dbus_flush (gpointer user_data)
+{
+	MatePanelAppletFrameDBus        *frame = MATE_PANEL_APPLET_FRAME_DBUS (user_data);
+	MatePanelAppletFrameDBusPrivate *priv = frame->priv;
+	FlushData                       *data;
+
+	priv->flush_id = 0;
+
+	data = g_slice_new0 (FlushData);
+	data->frame = g_object_ref (frame);
+	data->orient = g_variant_dict_contains (priv->pending, "orient");
+	data->background = g_variant_dict_contains (priv->pending, "background") ||
+			   g_variant_dict_contains (priv->pending, "background-descriptor");
+
+	mate_panel_applet_container_child_set_properties (priv->container,
+							  g_variant_dict_end (priv->pending),
+							  NULL,
+							  properties_set_cb,
+							  data);
+	g_clear_pointer (&priv->pending, g_variant_dict_unref);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* A panel change usually touches several properties of every applet at
+ * once: collect them and send each applet a single message, once the
+ * panel has been laid out. */
+static void
+mate_panel_applet_frame_dbus_queue (MatePanelAppletFrameDBus *frame,
+				    const gchar              *property_name,
+				    GVariant                 *value)
+{
+	MatePanelAppletFrameDBusPrivate *priv = frame->priv;
+
+	if (!priv->pending)
+		priv->pending = g_variant_dict_new (NULL);
+	g_variant_dict_insert_value (priv->pending, property_name, value);
+
+	if (!priv->flush_id)
+		priv->flush_id = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+						  mate_panel_applet_frame_dbus_flush,
+						  frame, NULL);
+}
+
+static void
+mate_panel_applet_frame_dbus_power_profile_changed (MatePanelAppletFrameDBus *frame)
+{
+	guint32 power_profile;
+
+	power_profile = get_mate_panel_applet_power_profile (panel_power_get_profile ());
+	if (frame->priv->power_profile == power_profile)
+		return;
+
+	frame->priv->power_profile = power_profile;
+	mate_panel_applet_frame_dbus_queue (frame, "power-profile",
+					    g_variant_new_uint32 (power_profile));
+}
+
+static void
+mate_panel_applet_frame_dbus_a11y_changed (MatePanelAppletFrameDBus *frame)
+{
+	gboolean a11y_enabled;
+
+	a11y_enabled = panel_a11y_get_is_a11y_enabled (GTK_WIDGET (frame));
+	if (frame->priv->a11y_enabled == a11y_enabled)
+		return;
+
+	frame->priv->a11y_enabled = a11y_enabled;
+	mate_panel_applet_frame_dbus_queue (frame, "a11y-enabled",
+					    g_variant_new_boolean (a11y_enabled));
+}
+
+/* The applets ask the window manager to focus the panel window when they
+ * want the keyboard focus: tell them which one it is, so that they do
+ * not look for it in the window tree. It changes when the applet moves
+ * to another panel. */
+static void
+mate_panel_applet_frame_dbus_dock_window_changed (MatePanelAppletFrameDBus *frame)
+{
+#ifdef HAVE_X11
+	GtkWidget *toplevel;
+	GdkWindow *window;
+	guint32    dock_window;
+
+	if (!gtk_widget_get_realized (GTK_WIDGET (frame)))
+		return;
+
+	toplevel = gtk_widget_get_toplevel (GTK_WIDGET (frame));
+	if (!gtk_widget_is_toplevel (toplevel))
+		return;
+
+	window = gtk_widget_get_window (toplevel);
+	if (!window || !GDK_IS_X11_WINDOW (window))
+		return;
+
+	dock_window = GDK_WINDOW_XID (window);
+	if (frame->priv->dock_window == dock_window)
+		return;
+
+	frame->priv->dock_window = dock_window;
+	mate_panel_applet_frame_dbus_queue (frame, "dock-window",
+					    g_variant_new_uint32 (dock_window));
+#endif
+}
+
 static void
 mate_panel_applet_frame_dbus_sync_menu_state (MatePanelAppletFrame *frame,
 					 gboolean          movable,
@@ -162,12 +349,10 @@ mate_panel_applet_frame_dbus_sync_menu_state (MatePanelAppletFrame *frame,
 {
 	MatePanelAppletFrameDBus *dbus_frame = MATE_PANEL_APPLET_FRAME_DBUS (frame);
 
-	mate_panel_applet_container_child_set (dbus_frame->priv->container,
-					  "locked", g_variant_new_boolean (lockable && locked),
-					  NULL, NULL, NULL);
-	mate_panel_applet_container_child_set (dbus_frame->priv->container,
-					  "locked-down", g_variant_new_boolean (locked_down),
-					  NULL, NULL, NULL);
+	mate_panel_applet_frame_dbus_queue (dbus_frame, "locked",
+					    g_variant_new_boolean (lockable && locked));
+	mate_panel_applet_frame_dbus_queue (dbus_frame, "locked-down",
+					    g_variant_new_boolean (locked_down));
 }
 
 static void
@@ -182,35 +367,14 @@ mate_panel_applet_frame_dbus_popup_menu (MatePanelAppletFrame *frame,
 						 NULL, NULL, NULL);
 }
 
-static void
-change_orientation_cb (MatePanelAppletContainer *container,
-		       GAsyncResult         *res,
-		       MatePanelAppletFrame     *frame)
-{
-	GError *error = NULL;
-
-	if (!mate_panel_applet_container_child_set_finish (container, res, &error)) {
-		g_warning ("%s\n", error->message);
-		g_error_free (error);
-
-		return;
-	}
-
-	gtk_widget_queue_resize (GTK_WIDGET (frame));
-}
-
 static void
 mate_panel_applet_frame_dbus_change_orientation (MatePanelAppletFrame *frame,
 					    PanelOrientation  orientation)
 {
 	MatePanelAppletFrameDBus *dbus_frame = MATE_PANEL_APPLET_FRAME_DBUS (frame);
 
-	mate_panel_applet_container_child_set (dbus_frame->priv->container,
-					  "orient",
-					  g_variant_new_uint32 (get_mate_panel_applet_orient (orientation)),
-					  NULL,
-					  (GAsyncReadyCallback)change_orientation_cb,
-					  frame);
+	mate_panel_applet_frame_dbus_queue (dbus_frame, "orient",
+					    g_variant_new_uint32 (get_mate_panel_applet_orient (orientation)));
 }
 
 static void
@@ -219,22 +383,8 @@ mate_panel_applet_frame_dbus_change_size (MatePanelAppletFrame *frame,
 {
 	MatePanelAppletFrameDBus *dbus_frame = MATE_PANEL_APPLET_FRAME_DBUS (frame);
 
-	mate_panel_applet_container_child_set (dbus_frame->priv->container,
-					  "size", g_variant_new_uint32 (size),
-					  NULL, NULL, NULL);
-}
-
-static void
-container_child_background_set (GObject      *source_object,
-				GAsyncResult *res,
-				gpointer      user_data)
-{
-	MatePanelAppletContainer *container = MATE_PANEL_APPLET_CONTAINER (source_object);
-	MatePanelAppletFrameDBus *frame = MATE_PANEL_APPLET_FRAME_DBUS (user_data);
-
-	mate_panel_applet_container_child_set_finish (container, res, NULL);
-
-	frame->priv->bg_operation = NULL;
+	mate_panel_applet_frame_dbus_queue (dbus_frame, "size",
+					    g_variant_new_uint32 (size));
 }
 
 static void
@@ -245,30 +395,115 @@ mate_panel_applet_frame_dbus_change_background (MatePanelAppletFrame    *frame,
 	MatePanelAppletFrameDBusPrivate *priv = dbus_frame->priv;
 	char *bg_str;
 
+	if (mate_panel_applet_container_child_has_property (priv->container,
+							    "background-descriptor")) {
+		GVariant *descriptor;
+		guint32   generation = 0;
+		gint32    x = 0;
+		gint32    y = 0;
+
+		descriptor = _mate_panel_applet_frame_get_background_descriptor (
+				frame, PANEL_WIDGET (gtk_widget_get_parent (GTK_WIDGET (frame))), type);
+		if (!descriptor)
+			return;
+
+		g_variant_ref_sink (descriptor);
+		g_variant_lookup (descriptor, "generation", "u", &generation);
+		g_variant_lookup (descriptor, "x", "i", &x);
+		g_variant_lookup (descriptor, "y", "i", &y);
+
+		/* the applet already has this background, at this position */
+		if (priv->bg_descriptor_sent &&
+		    generation == priv->bg_generation &&
+		    x == priv->bg_x && y == priv->bg_y) {
+			g_variant_unref (descriptor);
+			return;
+		}
+
+		priv->n_background_pushes++;
+		mate_panel_applet_frame_dbus_queue (dbus_frame, "background-descriptor",
+						    descriptor);
+		g_variant_unref (descriptor);
+
+		priv->bg_descriptor_sent = TRUE;
+		priv->bg_generation = generation;
+		priv->bg_x = x;
+		priv->bg_y = y;
+		return;
+	}
+
 	bg_str = _mate_panel_applet_frame_get_background_string (
 			frame, PANEL_WIDGET (gtk_widget_get_parent (GTK_WIDGET (frame))), type);
 
-	if (bg_str != NULL) {
-		if (priv->bg_operation)
-			mate_panel_applet_container_cancel_operation (priv->container, priv->bg_operation);
+	/* The string describes both our position in the panel background and
+	 * its contents: when neither changed, e.g. because another applet
+	 * moved, there is nothing to tell the applet. */
+	if (bg_str != NULL && g_strcmp0 (bg_str, priv->bg_string) == 0) {
+		g_free (bg_str);
+		return;
+	}
 
-		priv->bg_operation = mate_panel_applet_container_child_set (priv->container,
-						  "background",
-						  g_variant_new_string (bg_str),
-						  NULL,
-						  container_child_background_set,
-						  dbus_frame);
+	if (bg_str != NULL) {
+		priv->n_background_pushes++;
+		mate_panel_applet_frame_dbus_queue (dbus_frame, "background",
+						    g_variant_new_string (bg_str));
 
-		g_free (bg_str);
+		g_free (priv->bg_string);
+		priv->bg_string = bg_str;
 	}
 }
 
+static void
+mate_panel_applet_frame_dbus_get_stats (MatePanelAppletFrame *frame,
+					GVariantDict         *stats)
+{
+	MatePanelAppletFrameDBusPrivate *priv = MATE_PANEL_APPLET_FRAME_DBUS (frame)->priv;
+
+	mate_panel_applet_container_get_stats (priv->container, stats);
+
+	g_variant_dict_insert (stats, "size-hints-changes", "u", priv->n_size_hints_changes);
+	/* the size hints and the flags of the applet, and its orientation,
+	 * all make the panel lay its applets out again */
+	g_variant_dict_insert (stats, "relayouts", "u", priv->n_relayouts);
+	g_variant_dict_insert (stats, "background-pushes", "u", priv->n_background_pushes);
+}
+
+static void
+mate_panel_applet_frame_dbus_statistics_updated (GObject      *source_object,
+						 GAsyncResult *res,
+						 gpointer      user_data)
+{
+	GTask  *task = G_TASK (user_data);
+	GError *error = NULL;
+
+	if (mate_panel_applet_container_update_statistics_finish (MATE_PANEL_APPLET_CONTAINER (source_object),
+								  res, &error))
+		g_task_return_boolean (task, TRUE);
+	else
+		g_task_return_error (task, error);
+
+	g_object_unref (task);
+}
+
+static void
+mate_panel_applet_frame_dbus_update_stats (MatePanelAppletFrame *frame,
+					   GTask                *task)
+{
+	MatePanelAppletFrameDBus *dbus_frame = MATE_PANEL_APPLET_FRAME_DBUS (frame);
+
+	mate_panel_applet_container_update_statistics (dbus_frame->priv->container,
+						       NULL,
+						       mate_panel_applet_frame_dbus_statistics_updated,
+						       task);
+}
+
 static void
 mate_panel_applet_frame_dbus_flags_changed (MatePanelAppletContainer *container,
 				       const gchar          *prop_name,
 				       GVariant             *value,
 				       MatePanelAppletFrame     *frame)
 {
+	MATE_PANEL_APPLET_FRAME_DBUS (frame)->priv->n_relayouts++;
 	mate_panel_applet_frame_dbus_update_flags (frame, value);
 }
 
@@ -288,6 +523,8 @@ mate_panel_applet_frame_dbus_size_hints_changed (MatePanelAppletContainer *conta
 		memcpy (size_hints, sz, n_elements * sizeof (gint32));
 	}
 
+	MATE_PANEL_APPLET_FRAME_DBUS (frame)->priv->n_size_hints_changes++;
+	MATE_PANEL_APPLET_FRAME_DBUS (frame)->priv->n_relayouts++;
 	_mate_panel_applet_frame_update_size_hints (frame, size_hints, n_elements);
 }
 
@@ -320,12 +557,34 @@ mate_panel_applet_frame_dbus_applet_lock (MatePanelAppletContainer *container,
 	_mate_panel_applet_frame_applet_lock (frame, locked);
 }
 
+static void
+mate_panel_applet_frame_dbus_dispose (GObject *object)
+{
+	MatePanelAppletFrameDBus *frame = MATE_PANEL_APPLET_FRAME_DBUS (object);
+
+	if (frame->priv->power_notify) {
+		panel_power_notify_remove (G_CALLBACK (mate_panel_applet_frame_dbus_power_profile_changed),
+					   frame);
+		panel_a11y_notify_remove (G_CALLBACK (mate_panel_applet_frame_dbus_a11y_changed),
+					  frame);
+		frame->priv->power_notify = FALSE;
+	}
+
+	if (frame->priv->flush_id) {
+		g_source_remove (frame->priv->flush_id);
+		frame->priv->flush_id = 0;
+	}
+	g_clear_pointer (&frame->priv->pending, g_variant_dict_unref);
+
+	G_OBJECT_CLASS (mate_panel_applet_frame_dbus_parent_class)->dispose (object);
+}
+
 static void
 mate_panel_applet_frame_dbus_finalize (GObject *object)
 {
 	MatePanelAppletFrameDBus *frame = MATE_PANEL_APPLET_FRAME_DBUS (object);
 
-	frame->priv->bg_operation = NULL;
+	g_clear_pointer (&frame->priv->bg_string, g_free);
 
 	G_OBJECT_CLASS (mate_panel_applet_frame_dbus_parent_class)->finalize (object);
 }
@@ -341,7 +600,6 @@ mate_panel_applet_frame_dbus_init (MatePanelAppletFrameDBus *frame)
 	gtk_widget_show (container);
 	gtk_container_add (GTK_CONTAINER (frame), container);
 	frame->priv->container = MATE_PANEL_APPLET_CONTAINER (container);
-	frame->priv->bg_operation = NULL;
 
 	g_signal_connect (container, "child-property-changed::flags",
 			  G_CALLBACK (mate_panel_applet_frame_dbus_flags_changed),
@@ -369,6 +627,7 @@ mate_panel_applet_frame_dbus_class_init (MatePanelAppletFrameDBusClass *class)
 	GObjectClass *gobject_class = G_OBJECT_CLASS (class);
 	MatePanelAppletFrameClass *frame_class = MATE_PANEL_APPLET_FRAME_CLASS (class);
 
+	gobject_class->dispose = mate_panel_applet_frame_dbus_dispose;
 	gobject_class->finalize = mate_panel_applet_frame_dbus_finalize;
 
 	frame_class->init_properties = mate_panel_applet_frame_dbus_init_properties;
@@ -377,6 +636,8 @@ mate_panel_applet_frame_dbus_class_init (MatePanelAppletFrameDBusClass *class)
 	frame_class->change_orientation = mate_panel_applet_frame_dbus_change_orientation;
 	frame_class->change_size = mate_panel_applet_frame_dbus_change_size;
 	frame_class->change_background = mate_panel_applet_frame_dbus_change_background;
+	frame_class->get_stats = mate_panel_applet_frame_dbus_get_stats;
+	frame_class->update_stats = mate_panel_applet_frame_dbus_update_stats;
 
 	GtkWidgetClass *widget_class  = GTK_WIDGET_CLASS (class);
 	gtk_widget_class_set_css_name (widget_class, "MatePanelAppletFrameDBus");
@@ -396,6 +657,25 @@ mate_panel_applet_frame_dbus_activated (MatePanelAppletContainer *container,
 	frame_act = g_object_get_data (G_OBJECT (frame), "mate-panel-applet-frame-activating");
 	g_object_set_data (G_OBJECT (frame), "mate-panel-applet-frame-activating", NULL);
 
+	if (!error) {
+		MatePanelAppletFrameDBus *dbus_frame = MATE_PANEL_APPLET_FRAME_DBUS (frame);
+
+		/* the profile may have changed while the applet was loading */
+		mate_panel_applet_frame_dbus_power_profile_changed (dbus_frame);
+		panel_power_notify_add (G_CALLBACK (mate_panel_applet_frame_dbus_power_profile_changed),
+					dbus_frame);
+		mate_panel_applet_frame_dbus_a11y_changed (dbus_frame);
+		panel_a11y_notify_add (G_CALLBACK (mate_panel_applet_frame_dbus_a11y_changed),
+				       dbus_frame);
+		dbus_frame->priv->power_notify = TRUE;
+
+		/* once moved to another panel, the frame is realized again */
+		mate_panel_applet_frame_dbus_dock_window_changed (dbus_frame);
+		g_signal_connect_after (frame, "realize",
+					G_CALLBACK (mate_panel_applet_frame_dbus_dock_window_changed),
+					NULL);
+	}
+
 	_mate_panel_applet_frame_activated (frame, frame_act, error);
 }
 
@@ -444,6 +724,14 @@ mate_panel_applet_frame_dbus_load (const gchar                 *iid,
 	g_variant_builder_add (&builder, "{sv}",
 			       "locked-down",
 			       g_variant_new_boolean (mate_panel_applet_frame_activating_get_locked_down (frame_act)));
+	dbus_frame->priv->power_profile = get_mate_panel_applet_power_profile (panel_power_get_profile ());
+	g_variant_builder_add (&builder, "{sv}",
+			       "power-profile",
+			       g_variant_new_uint32 (dbus_frame->priv->power_profile));
+	dbus_frame->priv->a11y_enabled = panel_a11y_get_is_a11y_enabled (GTK_WIDGET (dbus_frame));
+	g_variant_builder_add (&builder, "{sv}",
+			       "a11y-enabled",
+			       g_variant_new_boolean (dbus_frame->priv->a11y_enabled));
 	/*since background has just been set to NULL, this block never executes
 	if (background) {
 		g_variant_builder_add (&builder, "{sv}",
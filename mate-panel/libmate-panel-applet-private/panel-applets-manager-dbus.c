@@ -23,6 +23,7 @@
 
 #include <config.h>
 
+#include <errno.h>
 #include <gio/gio.h>
 #include <gmodule.h>
 #include <string.h>
@@ -43,6 +44,15 @@ struct _MatePanelAppletsManagerDBusPrivate
 {
 	GHashTable *applet_factories;
 	GList      *monitors;
+
+	/* iid -> MatePanelAppletInfo and old id -> MatePanelAppletInfo, for
+	 * the applets of applet_factories */
+	GHashTable *applet_infos;
+	GHashTable *old_ids;
+
+	/* directory -> MatePanelAppletsDirCache */
+	GHashTable *dir_caches;
+	guint       save_cache_id;
 };
 
 G_DEFINE_TYPE_WITH_CODE (MatePanelAppletsManagerDBus,
@@ -73,9 +83,36 @@ typedef struct _MatePanelAppletFactoryInfo {
 	gboolean            has_old_ids;
 } MatePanelAppletFactoryInfo;
 
+/* The parsed content of the applets directories is kept in a cache file, so
+ * that we don't have to read every .mate-panel-applet file on startup. A
+ * directory whose modification time did not change since the cache was
+ * written is not even listed, only its cached files are checked: editing a
+ * file in place does not change the time of its directory. */
+typedef struct {
+	gint64      mtime;
+	/* file basename -> MatePanelAppletsFileCache */
+	GHashTable *files;
+} MatePanelAppletsDirCache;
+
+typedef struct {
+	gint64    mtime;
+	guint64   size;
+	GVariant *factory;
+} MatePanelAppletsFileCache;
+
 #define MATE_PANEL_APPLET_FACTORY_GROUP "Applet Factory"
 #define MATE_PANEL_APPLETS_EXTENSION    ".mate-panel-applet"
 
+#define MATE_PANEL_APPLETS_CACHE_FILE    "applets.cache"
+#define MATE_PANEL_APPLETS_CACHE_VERSION 2
+
+/* (group, name, description, icon, old ids, x11, wayland) */
+#define MATE_PANEL_APPLET_VARIANT_TYPE "(smsmsmsasbb)"
+/* (id, location, in process, applets) */
+#define MATE_PANEL_APPLET_FACTORY_VARIANT_TYPE "(smsba" MATE_PANEL_APPLET_VARIANT_TYPE ")"
+/* (version, languages, [(dir, mtime, [(file, mtime, size, factory)])]) */
+#define MATE_PANEL_APPLETS_CACHE_VARIANT_TYPE "(usa(sxa(sxt" MATE_PANEL_APPLET_FACTORY_VARIANT_TYPE ")))"
+
 static void
 mate_panel_applet_factory_info_free (MatePanelAppletFactoryInfo *info)
 {
@@ -91,13 +128,100 @@ mate_panel_applet_factory_info_free (MatePanelAppletFactoryInfo *info)
 	g_slice_free (MatePanelAppletFactoryInfo, info);
 }
 
-static MatePanelAppletInfo *
-_mate_panel_applets_manager_get_applet_info (GKeyFile    *applet_file,
-					const gchar *group,
-					const gchar *factory_id)
+static void
+mate_panel_applets_file_cache_free (MatePanelAppletsFileCache *file_cache)
+{
+	g_variant_unref (file_cache->factory);
+	g_slice_free (MatePanelAppletsFileCache, file_cache);
+}
+
+static MatePanelAppletsDirCache *
+mate_panel_applets_dir_cache_new (gint64 mtime)
+{
+	MatePanelAppletsDirCache *dir_cache;
+
+	dir_cache = g_slice_new (MatePanelAppletsDirCache);
+	dir_cache->mtime = mtime;
+	dir_cache->files = g_hash_table_new_full (g_str_hash,
+						  g_str_equal,
+						  (GDestroyNotify) g_free,
+						  (GDestroyNotify) mate_panel_applets_file_cache_free);
+
+	return dir_cache;
+}
+
+static void
+mate_panel_applets_dir_cache_free (MatePanelAppletsDirCache *dir_cache)
+{
+	g_hash_table_destroy (dir_cache->files);
+	g_slice_free (MatePanelAppletsDirCache, dir_cache);
+}
+
+static void
+mate_panel_applets_dir_cache_set_file (MatePanelAppletsDirCache *dir_cache,
+				       const gchar              *basename,
+				       gint64                    mtime,
+				       guint64                   size,
+				       GVariant                 *factory)
+{
+	MatePanelAppletsFileCache *file_cache;
+
+	file_cache = g_slice_new (MatePanelAppletsFileCache);
+	file_cache->mtime = mtime;
+	file_cache->size = size;
+	file_cache->factory = g_variant_ref (factory);
+
+	g_hash_table_replace (dir_cache->files, g_strdup (basename), file_cache);
+}
+
+/* The modification time is -1 and the size 0 when path does not exist */
+static void
+mate_panel_applets_get_stamp (const gchar *path,
+			      gint64      *mtime,
+			      guint64     *size)
+{
+	GFile     *file;
+	GFileInfo *file_info;
+
+	file = g_file_new_for_path (path);
+	file_info = g_file_query_info (file,
+				       G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+				       G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC ","
+				       G_FILE_ATTRIBUTE_STANDARD_SIZE,
+				       G_FILE_QUERY_INFO_NONE,
+				       NULL, NULL);
+	g_object_unref (file);
+
+	if (!file_info) {
+		*mtime = -1;
+		if (size)
+			*size = 0;
+		return;
+	}
+
+	*mtime = g_file_info_get_attribute_uint64 (file_info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC +
+		 g_file_info_get_attribute_uint32 (file_info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+	if (size)
+		*size = g_file_info_get_attribute_uint64 (file_info, G_FILE_ATTRIBUTE_STANDARD_SIZE);
+	g_object_unref (file_info);
+}
+
+static gint64
+mate_panel_applets_get_mtime (const gchar *path)
 {
-	MatePanelAppletInfo  *info;
-	char             *iid;
+	gint64 mtime;
+
+	mate_panel_applets_get_stamp (path, &mtime, NULL);
+
+	return mtime;
+}
+
+static void
+_mate_panel_applets_manager_add_applet_variant (GVariantBuilder *builder,
+					       GKeyFile        *applet_file,
+					       const gchar     *group)
+{
+	static const gchar *no_old_ids[] = { NULL };
 	char             *name;
 	char             *comment;
 	char             *icon;
@@ -106,7 +230,6 @@ _mate_panel_applets_manager_get_applet_info (GKeyFile    *applet_file,
 	gboolean          x11_supported;
 	gboolean          wayland_supported;
 
-	iid = g_strdup_printf ("%s::%s", factory_id, group);
 	name = g_key_file_get_locale_string (applet_file, group,
 					     "Name", NULL, NULL);
 	comment = g_key_file_get_locale_string (applet_file, group,
@@ -141,24 +264,29 @@ _mate_panel_applets_manager_get_applet_info (GKeyFile    *applet_file,
 		}
 	}
 
-	info = mate_panel_applet_info_new (iid, name, comment, icon, (const char **) old_ids,
-					   x11_supported, wayland_supported);
+	g_variant_builder_add (builder, "(smsmsms^asbb)",
+			       group, name, comment, icon,
+			       old_ids ? (const gchar **) old_ids : no_old_ids,
+			       x11_supported, wayland_supported);
 
-	g_free (iid);
 	g_free (name);
 	g_free (comment);
 	g_free (icon);
 	g_strfreev (old_ids);
 	g_strfreev (supported_platforms);
-
-	return info;
 }
 
-static MatePanelAppletFactoryInfo *
-mate_panel_applets_manager_get_applet_factory_info_from_file (const gchar *filename)
+/* Returns a new reference to the parsed content of filename, or NULL */
+static GVariant *
+mate_panel_applets_manager_parse_applet_factory_file (const gchar *filename)
 {
-	MatePanelAppletFactoryInfo *info;
 	GKeyFile               *applet_file;
+	GVariantBuilder         applets;
+	GVariant               *retval;
+	gchar                  *id;
+	gchar                  *location = NULL;
+	gboolean                in_process;
+	gboolean                has_applets = FALSE;
 	gchar                 **groups;
 	gsize                   n_groups;
 	gsize                   i;
@@ -174,72 +302,363 @@ mate_panel_applets_manager_get_applet_factory_info_from_file (const gchar *filen
 		return NULL;
 	}
 
-	info = g_slice_new0 (MatePanelAppletFactoryInfo);
-	info->id = g_key_file_get_string (applet_file, MATE_PANEL_APPLET_FACTORY_GROUP, "Id", NULL);
-	if (!info->id) {
+	id = g_key_file_get_string (applet_file, MATE_PANEL_APPLET_FACTORY_GROUP, "Id", NULL);
+	if (!id) {
 		g_warning ("Bad panel applet file %s: Could not find 'Id' in group '%s'",
 			   filename, MATE_PANEL_APPLET_FACTORY_GROUP);
-		mate_panel_applet_factory_info_free (info);
 		g_key_file_free (applet_file);
 
 		return NULL;
 	}
 
-	info->in_process = g_key_file_get_boolean (applet_file, MATE_PANEL_APPLET_FACTORY_GROUP,
-						   "InProcess", NULL);
-	if (info->in_process) {
-		const char *lib_prefix;
-
-		info->location = g_key_file_get_string (applet_file, MATE_PANEL_APPLET_FACTORY_GROUP,
-							"Location", NULL);
-		if (!info->location) {
+	in_process = g_key_file_get_boolean (applet_file, MATE_PANEL_APPLET_FACTORY_GROUP,
+					     "InProcess", NULL);
+	if (in_process) {
+		location = g_key_file_get_string (applet_file, MATE_PANEL_APPLET_FACTORY_GROUP,
+						  "Location", NULL);
+		if (!location) {
 			g_warning ("Bad panel applet file %s: In-process applet without 'Location'",
 				   filename);
-			mate_panel_applet_factory_info_free (info);
+			g_free (id);
 			g_key_file_free (applet_file);
 
 			return NULL;
 		}
+	}
+
+	g_variant_builder_init (&applets, G_VARIANT_TYPE ("a" MATE_PANEL_APPLET_VARIANT_TYPE));
+
+	groups = g_key_file_get_groups (applet_file, &n_groups);
+	for (i = 0; i < n_groups; i++) {
+		if (g_strcmp0 (groups[i], MATE_PANEL_APPLET_FACTORY_GROUP) == 0)
+			continue;
+
+		_mate_panel_applets_manager_add_applet_variant (&applets, applet_file, groups[i]);
+		has_applets = TRUE;
+	}
+	g_strfreev (groups);
+
+	g_key_file_free (applet_file);
+
+	if (!has_applets) {
+		g_variant_builder_clear (&applets);
+		g_free (id);
+		g_free (location);
+
+		return NULL;
+	}
+
+	retval = g_variant_new (MATE_PANEL_APPLET_FACTORY_VARIANT_TYPE,
+				id, location, in_process, &applets);
+	g_free (id);
+	g_free (location);
+
+	return g_variant_ref_sink (retval);
+}
+
+static MatePanelAppletFactoryInfo *
+mate_panel_applets_manager_get_applet_factory_info_from_variant (GVariant    *factory,
+								 const gchar *srcdir)
+{
+	MatePanelAppletFactoryInfo *info;
+	GVariantIter           *applets;
+	const gchar            *id;
+	const gchar            *location;
+	gboolean                in_process;
+	const gchar            *group;
+	const gchar            *name;
+	const gchar            *comment;
+	const gchar            *icon;
+	const gchar           **old_ids;
+	gboolean                x11_supported;
+	gboolean                wayland_supported;
+
+	g_variant_get (factory, "(&sm&sba" MATE_PANEL_APPLET_VARIANT_TYPE ")",
+		       &id, &location, &in_process, &applets);
+
+	info = g_slice_new0 (MatePanelAppletFactoryInfo);
+	info->id = g_strdup (id);
+	info->in_process = in_process;
+	if (info->in_process) {
+		const char *lib_prefix;
+
+		info->location = g_strdup (location);
+
 		lib_prefix = g_getenv ("MATE_PANEL_APPLET_LIB_PREFIX");
 		if (lib_prefix && g_strcmp0 (lib_prefix, "") != 0) {
-			char *location;
+			char *prefixed_location;
 			int location_len = strlen (lib_prefix) + strlen (info->location) + 1;
-			location = g_strnfill (location_len, 0);
-			g_strlcat (location, lib_prefix, location_len);
-			g_strlcat (location, info->location, location_len);
+			prefixed_location = g_strnfill (location_len, 0);
+			g_strlcat (prefixed_location, lib_prefix, location_len);
+			g_strlcat (prefixed_location, info->location, location_len);
 			g_free (info->location);
-			info->location = location;
+			info->location = prefixed_location;
 		}
 	}
 
 	info->has_old_ids = FALSE;
 
-	groups = g_key_file_get_groups (applet_file, &n_groups);
-	for (i = 0; i < n_groups; i++) {
+	while (g_variant_iter_loop (applets, "(&sm&sm&sm&s^a&sbb)",
+				    &group, &name, &comment, &icon, &old_ids,
+				    &x11_supported, &wayland_supported)) {
 		MatePanelAppletInfo *ainfo;
+		const gchar        **ids = NULL;
+		char                *iid;
 
-		if (g_strcmp0 (groups[i], MATE_PANEL_APPLET_FACTORY_GROUP) == 0)
-			continue;
-
-		ainfo = _mate_panel_applets_manager_get_applet_info (applet_file,
-								groups[i], info->id);
-		if (mate_panel_applet_info_get_old_ids (ainfo) != NULL)
+		if (old_ids[0] != NULL) {
+			ids = old_ids;
 			info->has_old_ids = TRUE;
+		}
+
+		iid = g_strdup_printf ("%s::%s", info->id, group);
+		ainfo = mate_panel_applet_info_new (iid, name, comment, icon, ids,
+						    x11_supported, wayland_supported);
+		g_free (iid);
 
 		info->applet_list = g_list_prepend (info->applet_list, ainfo);
 	}
-	g_strfreev (groups);
+	g_variant_iter_free (applets);
 
-	g_key_file_free (applet_file);
+	info->srcdir = g_strdup (srcdir);
 
-	if (!info->applet_list) {
-		mate_panel_applet_factory_info_free (info);
-		return NULL;
+	return info;
+}
+
+static gchar *
+mate_panel_applets_cache_get_filename (void)
+{
+	return g_build_filename (g_get_user_cache_dir (), "mate-panel",
+				 MATE_PANEL_APPLETS_CACHE_FILE, NULL);
+}
+
+/* Translated names get cached, so the cache is only valid for a given
+ * locale */
+static gchar *
+mate_panel_applets_cache_get_languages (void)
+{
+	return g_strjoinv (":", (gchar **) g_get_language_names ());
+}
+
+static void
+mate_panel_applets_manager_dbus_load_cache (MatePanelAppletsManagerDBus *manager)
+{
+	GMappedFile  *mapped;
+	GBytes       *bytes;
+	GVariant     *cache;
+	GVariantIter *dirs;
+	GVariantIter *files;
+	gchar        *filename;
+	gchar        *languages;
+	const gchar  *cached_languages;
+	const gchar  *path;
+	gint64        mtime;
+	guint32       version;
+
+	filename = mate_panel_applets_cache_get_filename ();
+	mapped = g_mapped_file_new (filename, FALSE, NULL);
+	g_free (filename);
+
+	if (!mapped)
+		return;
+
+	bytes = g_mapped_file_get_bytes (mapped);
+	g_mapped_file_unref (mapped);
+
+	cache = g_variant_new_from_bytes (G_VARIANT_TYPE (MATE_PANEL_APPLETS_CACHE_VARIANT_TYPE),
+					  bytes, FALSE);
+	g_variant_ref_sink (cache);
+	g_bytes_unref (bytes);
+
+	g_variant_get (cache, "(u&sa(sxa(sxt" MATE_PANEL_APPLET_FACTORY_VARIANT_TYPE ")))",
+		       &version, &cached_languages, &dirs);
+
+	languages = mate_panel_applets_cache_get_languages ();
+
+	if (version == MATE_PANEL_APPLETS_CACHE_VERSION &&
+	    g_strcmp0 (languages, cached_languages) == 0) {
+		while (g_variant_iter_next (dirs, "(&sxa(sxt" MATE_PANEL_APPLET_FACTORY_VARIANT_TYPE "))",
+					    &path, &mtime, &files)) {
+			MatePanelAppletsDirCache *dir_cache;
+			const gchar              *basename;
+			gint64                    file_mtime;
+			guint64                   file_size;
+			GVariant                 *factory;
+
+			dir_cache = mate_panel_applets_dir_cache_new (mtime);
+
+			while (g_variant_iter_next (files, "(&sxt@" MATE_PANEL_APPLET_FACTORY_VARIANT_TYPE ")",
+						    &basename, &file_mtime, &file_size, &factory)) {
+				mate_panel_applets_dir_cache_set_file (dir_cache, basename,
+								       file_mtime, file_size,
+								       factory);
+				g_variant_unref (factory);
+			}
+			g_variant_iter_free (files);
+
+			g_hash_table_replace (manager->priv->dir_caches,
+					      g_strdup (path), dir_cache);
+		}
 	}
 
-	info->srcdir = g_path_get_dirname (filename);
+	g_variant_iter_free (dirs);
+	g_free (languages);
+	g_variant_unref (cache);
+}
+
+static void
+mate_panel_applets_manager_dbus_save_cache (MatePanelAppletsManagerDBus *manager)
+{
+	GVariantBuilder  dirs;
+	GHashTableIter   dir_iter;
+	gpointer         key, value;
+	GVariant        *cache;
+	gchar           *filename;
+	gchar           *dirname;
+	gchar           *languages;
+	GError          *error = NULL;
+
+	g_variant_builder_init (&dirs, G_VARIANT_TYPE ("a(sxa(sxt" MATE_PANEL_APPLET_FACTORY_VARIANT_TYPE "))"));
+
+	g_hash_table_iter_init (&dir_iter, manager->priv->dir_caches);
+	while (g_hash_table_iter_next (&dir_iter, &key, &value)) {
+		MatePanelAppletsDirCache *dir_cache = value;
+		GVariantBuilder           files;
+		GHashTableIter            file_iter;
+		gpointer                  file_key, file_value;
+
+		g_variant_builder_init (&files, G_VARIANT_TYPE ("a(sxt" MATE_PANEL_APPLET_FACTORY_VARIANT_TYPE ")"));
+
+		g_hash_table_iter_init (&file_iter, dir_cache->files);
+		while (g_hash_table_iter_next (&file_iter, &file_key, &file_value)) {
+			MatePanelAppletsFileCache *file_cache = file_value;
+
+			g_variant_builder_add (&files, "(sxt@" MATE_PANEL_APPLET_FACTORY_VARIANT_TYPE ")",
+					       (const gchar *) file_key,
+					       file_cache->mtime,
+					       file_cache->size,
+					       file_cache->factory);
+		}
+
+		g_variant_builder_add (&dirs, "(sxa(sxt" MATE_PANEL_APPLET_FACTORY_VARIANT_TYPE "))",
+				       (const gchar *) key, dir_cache->mtime, &files);
+	}
 
-	return info;
+	languages = mate_panel_applets_cache_get_languages ();
+	cache = g_variant_new ("(usa(sxa(sxt" MATE_PANEL_APPLET_FACTORY_VARIANT_TYPE ")))",
+			       MATE_PANEL_APPLETS_CACHE_VERSION, languages, &dirs);
+	g_variant_ref_sink (cache);
+	g_free (languages);
+
+	filename = mate_panel_applets_cache_get_filename ();
+	dirname = g_path_get_dirname (filename);
+
+	if (g_mkdir_with_parents (dirname, 0700) != 0 ||
+	    !g_file_set_contents (filename,
+				  g_variant_get_data (cache),
+				  g_variant_get_size (cache),
+				  &error)) {
+		g_debug ("Cannot write applets cache %s: %s", filename,
+			 error ? error->message : g_strerror (errno));
+		g_clear_error (&error);
+	}
+
+	g_free (dirname);
+	g_free (filename);
+	g_variant_unref (cache);
+}
+
+static gboolean
+mate_panel_applets_manager_dbus_save_cache_idle (gpointer user_data)
+{
+	MatePanelAppletsManagerDBus *manager = MATE_PANEL_APPLETS_MANAGER_DBUS (user_data);
+
+	manager->priv->save_cache_id = 0;
+	mate_panel_applets_manager_dbus_save_cache (manager);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+mate_panel_applets_manager_dbus_queue_save_cache (MatePanelAppletsManagerDBus *manager)
+{
+	if (manager->priv->save_cache_id != 0)
+		return;
+
+	manager->priv->save_cache_id =
+		g_idle_add_full (G_PRIORITY_LOW,
+				 mate_panel_applets_manager_dbus_save_cache_idle,
+				 manager, NULL);
+}
+
+/* Updates the cache entry of a file after a change notification. A NULL
+ * factory removes the entry. */
+static void
+mate_panel_applets_manager_dbus_set_cached_file (MatePanelAppletsManagerDBus *manager,
+						 const gchar                 *filename,
+						 GVariant                    *factory)
+{
+	MatePanelAppletsDirCache *dir_cache;
+	gchar                    *dirname;
+	gchar                    *basename;
+
+	dirname = g_path_get_dirname (filename);
+	basename = g_path_get_basename (filename);
+
+	dir_cache = g_hash_table_lookup (manager->priv->dir_caches, dirname);
+	if (dir_cache) {
+		if (factory) {
+			gint64  mtime;
+			guint64 size;
+
+			mate_panel_applets_get_stamp (filename, &mtime, &size);
+			mate_panel_applets_dir_cache_set_file (dir_cache, basename,
+							       mtime, size, factory);
+		} else
+			g_hash_table_remove (dir_cache->files, basename);
+
+		dir_cache->mtime = mate_panel_applets_get_mtime (dirname);
+		mate_panel_applets_manager_dbus_queue_save_cache (manager);
+	}
+
+	g_free (dirname);
+	g_free (basename);
+}
+
+/* To be called each time applet_factories changes */
+static void
+mate_panel_applets_manager_dbus_index_applets (MatePanelAppletsManagerDBus *manager)
+{
+	GHashTableIter iter;
+	gpointer       value;
+
+	g_hash_table_remove_all (manager->priv->applet_infos);
+	g_hash_table_remove_all (manager->priv->old_ids);
+
+	g_hash_table_iter_init (&iter, manager->priv->applet_factories);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		MatePanelAppletFactoryInfo *info = value;
+		GList                      *l;
+
+		for (l = info->applet_list; l; l = g_list_next (l)) {
+			MatePanelAppletInfo *ainfo = l->data;
+			const gchar * const *old_ids;
+			gint                 i;
+
+			g_hash_table_insert (manager->priv->applet_infos,
+					     (gpointer) mate_panel_applet_info_get_iid (ainfo),
+					     ainfo);
+
+			if (!info->has_old_ids)
+				continue;
+
+			old_ids = mate_panel_applet_info_get_old_ids (ainfo);
+			for (i = 0; old_ids && old_ids[i]; i++) {
+				if (!g_hash_table_contains (manager->priv->old_ids, old_ids[i]))
+					g_hash_table_insert (manager->priv->old_ids,
+							     (gpointer) old_ids[i], ainfo);
+			}
+		}
+	}
 }
 
 static GSList *
@@ -280,7 +699,9 @@ applets_directory_changed (GFileMonitor     *monitor,
 	case G_FILE_MONITOR_EVENT_CREATED: {
 		MatePanelAppletFactoryInfo *info;
 		MatePanelAppletFactoryInfo *old_info;
+		GVariant               *factory;
 		gchar                  *filename;
+		gchar                  *srcdir;
 		GSList                 *dirs, *d;
 
 		filename = g_file_get_path (file);
@@ -289,16 +710,25 @@ applets_directory_changed (GFileMonitor     *monitor,
 			return;
 		}
 
-		info = mate_panel_applets_manager_get_applet_factory_info_from_file (filename);
+		factory = mate_panel_applets_manager_parse_applet_factory_file (filename);
+		mate_panel_applets_manager_dbus_set_cached_file (manager, filename, factory);
+		srcdir = g_path_get_dirname (filename);
 		g_free (filename);
 
-		if (!info)
+		if (!factory) {
+			g_free (srcdir);
 			return;
+		}
+
+		info = mate_panel_applets_manager_get_applet_factory_info_from_variant (factory, srcdir);
+		g_variant_unref (factory);
+		g_free (srcdir);
 
 		old_info = g_hash_table_lookup (manager->priv->applet_factories, info->id);
 		if (!old_info) {
 			/* New applet, just insert it */
 			g_hash_table_insert (manager->priv->applet_factories, g_strdup (info->id), info);
+			mate_panel_applets_manager_dbus_index_applets (manager);
 			return;
 		}
 
@@ -307,6 +737,7 @@ applets_directory_changed (GFileMonitor     *monitor,
 		 * current one */
 		if (g_strcmp0 (info->srcdir, old_info->srcdir) == 0) {
 			g_hash_table_replace (manager->priv->applet_factories, g_strdup (info->id), info);
+			mate_panel_applets_manager_dbus_index_applets (manager);
 			return;
 		}
 
@@ -320,6 +751,7 @@ applets_directory_changed (GFileMonitor     *monitor,
 				break;
 			} else if (g_strcmp0 (path, info->srcdir) == 0) {
 				g_hash_table_replace (manager->priv->applet_factories, g_strdup (info->id), info);
+				mate_panel_applets_manager_dbus_index_applets (manager);
 				break;
 			}
 		}
@@ -327,30 +759,174 @@ applets_directory_changed (GFileMonitor     *monitor,
 		g_slist_free_full (dirs, g_free);
 	}
 		break;
+	case G_FILE_MONITOR_EVENT_DELETED: {
+		gchar *filename;
+
+		/* Loaded applets are kept, they are only dropped from the
+		 * cache */
+		filename = g_file_get_path (file);
+		if (g_str_has_suffix (filename, MATE_PANEL_APPLETS_EXTENSION))
+			mate_panel_applets_manager_dbus_set_cached_file (manager, filename, NULL);
+		g_free (filename);
+	}
+		break;
 	default:
 		/* Ignore any other change */
 		break;
 	}
 }
 
+/* Parses again the cached files of an unchanged directory that were edited
+ * in place, and drops the ones that are gone */
+static void
+mate_panel_applets_manager_dbus_check_dir_cache (MatePanelAppletsDirCache *dir_cache,
+						 const gchar              *path,
+						 gboolean                 *updated)
+{
+	GHashTableIter iter;
+	gpointer       key, value;
+
+	g_hash_table_iter_init (&iter, dir_cache->files);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		MatePanelAppletsFileCache *file_cache = value;
+		GVariant                  *factory;
+		gchar                     *file;
+		gint64                     mtime;
+		guint64                    size;
+
+		file = g_build_filename (path, (const gchar *) key, NULL);
+		mate_panel_applets_get_stamp (file, &mtime, &size);
+
+		if (mtime >= 0 && file_cache->mtime == mtime && file_cache->size == size) {
+			g_free (file);
+			continue;
+		}
+
+		*updated = TRUE;
+
+		factory = mtime >= 0 ? mate_panel_applets_manager_parse_applet_factory_file (file) : NULL;
+		g_free (file);
+
+		if (!factory) {
+			g_hash_table_iter_remove (&iter);
+			continue;
+		}
+
+		g_variant_unref (file_cache->factory);
+		file_cache->factory = factory;
+		file_cache->mtime = mtime;
+		file_cache->size = size;
+	}
+}
+
+/* Returns the cache for path, rescanning the directory if it changed since
+ * the cache was written */
+static MatePanelAppletsDirCache *
+mate_panel_applets_manager_dbus_get_dir_cache (MatePanelAppletsManagerDBus *manager,
+					       const gchar                 *path,
+					       gboolean                    *updated)
+{
+	MatePanelAppletsDirCache *old_cache;
+	MatePanelAppletsDirCache *dir_cache;
+	GDir                     *dir;
+	const gchar              *dirent;
+	gint64                    mtime;
+	GError                   *error = NULL;
+
+	mtime = mate_panel_applets_get_mtime (path);
+	old_cache = g_hash_table_lookup (manager->priv->dir_caches, path);
+
+	if (old_cache && mtime >= 0 && old_cache->mtime == mtime) {
+		mate_panel_applets_manager_dbus_check_dir_cache (old_cache, path, updated);
+		return old_cache;
+	}
+
+	dir = g_dir_open (path, 0, &error);
+	if (!dir) {
+		g_warning ("%s", error->message);
+		g_error_free (error);
+
+		if (old_cache) {
+			g_hash_table_remove (manager->priv->dir_caches, path);
+			*updated = TRUE;
+		}
+
+		return NULL;
+	}
+
+	dir_cache = mate_panel_applets_dir_cache_new (mtime);
+
+	while ((dirent = g_dir_read_name (dir))) {
+		MatePanelAppletsFileCache *file_cache = NULL;
+		GVariant                  *factory;
+		gchar                     *file;
+		gint64                     file_mtime;
+		guint64                    file_size;
+
+		if (!g_str_has_suffix (dirent, MATE_PANEL_APPLETS_EXTENSION))
+			continue;
+
+		file = g_build_filename (path, dirent, NULL);
+		mate_panel_applets_get_stamp (file, &file_mtime, &file_size);
+
+		if (old_cache)
+			file_cache = g_hash_table_lookup (old_cache->files, dirent);
+
+		/* Only parse the files that changed */
+		if (file_cache && file_mtime >= 0 &&
+		    file_cache->mtime == file_mtime && file_cache->size == file_size)
+			factory = g_variant_ref (file_cache->factory);
+		else
+			factory = mate_panel_applets_manager_parse_applet_factory_file (file);
+		g_free (file);
+
+		if (!factory)
+			continue;
+
+		mate_panel_applets_dir_cache_set_file (dir_cache, dirent,
+						       file_mtime, file_size, factory);
+		g_variant_unref (factory);
+	}
+
+	g_dir_close (dir);
+
+	g_hash_table_replace (manager->priv->dir_caches, g_strdup (path), dir_cache);
+	*updated = TRUE;
+
+	return dir_cache;
+}
+
 static void
 mate_panel_applets_manager_dbus_load_applet_infos (MatePanelAppletsManagerDBus *manager)
 {
-	GSList *dirs;
+	GSList         *dirs;
+	gboolean        cache_updated = FALSE;
+	GHashTableIter  cache_iter;
+	gpointer        cache_path;
+
+	mate_panel_applets_manager_dbus_load_cache (manager);
 
 	dirs = mate_panel_applets_manager_get_applets_dirs ();
+
+	/* the directories that are not looked in anymore */
+	g_hash_table_iter_init (&cache_iter, manager->priv->dir_caches);
+	while (g_hash_table_iter_next (&cache_iter, &cache_path, NULL)) {
+		if (!g_slist_find_custom (dirs, cache_path, (GCompareFunc) g_strcmp0)) {
+			g_hash_table_iter_remove (&cache_iter);
+			cache_updated = TRUE;
+		}
+	}
 	for (GSList *d = dirs; d; d = g_slist_next (d)) {
-		GDir         *dir;
-		const gchar  *dirent;
-		GFileMonitor *monitor;
-		GFile        *dir_file;
-		GError       *error = NULL;
-		gchar        *path = (gchar *) d->data;
-
-		dir = g_dir_open (path, 0, &error);
-		if (!dir) {
-			g_warning ("%s", error->message);
-			g_error_free (error);
+		MatePanelAppletsDirCache *dir_cache;
+		GHashTableIter            iter;
+		gpointer                  value;
+		GFileMonitor             *monitor;
+		GFile                    *dir_file;
+		gchar                    *path = (gchar *) d->data;
+
+		dir_cache = mate_panel_applets_manager_dbus_get_dir_cache (manager, path,
+									   &cache_updated);
+		if (!dir_cache) {
 			g_free (path);
 
 			continue;
@@ -369,19 +945,13 @@ mate_panel_applets_manager_dbus_load_applet_infos (MatePanelAppletsManagerDBus *
 		}
 		g_object_unref (dir_file);
 
-		while ((dirent = g_dir_read_name (dir))) {
+		g_hash_table_iter_init (&iter, dir_cache->files);
+		while (g_hash_table_iter_next (&iter, NULL, &value)) {
+			MatePanelAppletsFileCache  *file_cache = value;
 			MatePanelAppletFactoryInfo *info;
-			gchar                  *file;
 
-			if (!g_str_has_suffix (dirent, MATE_PANEL_APPLETS_EXTENSION))
-				continue;
-
-			file = g_build_filename (path, dirent, NULL);
-			info = mate_panel_applets_manager_get_applet_factory_info_from_file (file);
-			g_free (file);
-
-			if (!info)
-				continue;
+			info = mate_panel_applets_manager_get_applet_factory_info_from_variant (file_cache->factory,
+												 path);
 
 			if (g_hash_table_lookup (manager->priv->applet_factories, info->id)) {
 				mate_panel_applet_factory_info_free (info);
@@ -391,11 +961,15 @@ mate_panel_applets_manager_dbus_load_applet_infos (MatePanelAppletsManagerDBus *
 			g_hash_table_insert (manager->priv->applet_factories, g_strdup (info->id), info);
 		}
 
-		g_dir_close (dir);
 		g_free (path);
 	}
 
 	g_slist_free (dirs);
+
+	mate_panel_applets_manager_dbus_index_applets (manager);
+
+	if (cache_updated)
+		mate_panel_applets_manager_dbus_queue_save_cache (manager);
 }
 
 static GList *
@@ -563,21 +1137,9 @@ static MatePanelAppletInfo *
 mate_panel_applets_manager_dbus_get_applet_info (MatePanelAppletsManager *manager,
 					    const gchar         *iid)
 {
-	MatePanelAppletFactoryInfo *info;
-	GList                  *l;
-
-	info = get_applet_factory_info (manager, iid);
-	if (!info)
-		return NULL;
-
-	for (l = info->applet_list; l; l = g_list_next (l)) {
-		MatePanelAppletInfo *ainfo = (MatePanelAppletInfo *) l->data;
-
-		if (g_strcmp0 (mate_panel_applet_info_get_iid (ainfo), iid) == 0)
-			return ainfo;
-	}
+	MatePanelAppletsManagerDBus *dbus_manager = MATE_PANEL_APPLETS_MANAGER_DBUS (manager);
 
-	return NULL;
+	return g_hash_table_lookup (dbus_manager->priv->applet_infos, iid);
 }
 
 static MatePanelAppletInfo *
@@ -586,39 +1148,7 @@ mate_panel_applets_manager_dbus_get_applet_info_from_old_id (MatePanelAppletsMan
 {
 	MatePanelAppletsManagerDBus *dbus_manager = MATE_PANEL_APPLETS_MANAGER_DBUS (manager);
 
-	GHashTableIter iter;
-	gpointer       key, value;
-
-	g_hash_table_iter_init (&iter, dbus_manager->priv->applet_factories);
-	while (g_hash_table_iter_next (&iter, &key, &value)) {
-		MatePanelAppletFactoryInfo *info;
-		GList                  *l;
-
-		info = (MatePanelAppletFactoryInfo *) value;
-		if (!info->has_old_ids)
-			continue;
-
-		for (l = info->applet_list; l; l = g_list_next (l)) {
-			MatePanelAppletInfo *ainfo;
-			gint             i = 0;
-			const gchar * const *old_ids;
-
-			ainfo = (MatePanelAppletInfo *) l->data;
-
-			old_ids = mate_panel_applet_info_get_old_ids (ainfo);
-
-			if (old_ids == NULL)
-				continue;
-
-			while (old_ids[i]) {
-				if (g_strcmp0 (old_ids[i], iid) == 0)
-					return ainfo;
-				i++;
-			}
-		}
-	}
-
-	return NULL;
+	return g_hash_table_lookup (dbus_manager->priv->old_ids, iid);
 }
 
 static gboolean
@@ -653,11 +1183,32 @@ mate_panel_applets_manager_dbus_finalize (GObject *object)
 		manager->priv->monitors = NULL;
 	}
 
+	if (manager->priv->applet_infos) {
+		g_hash_table_destroy (manager->priv->applet_infos);
+		manager->priv->applet_infos = NULL;
+	}
+
+	if (manager->priv->old_ids) {
+		g_hash_table_destroy (manager->priv->old_ids);
+		manager->priv->old_ids = NULL;
+	}
+
 	if (manager->priv->applet_factories) {
 		g_hash_table_destroy (manager->priv->applet_factories);
 		manager->priv->applet_factories = NULL;
 	}
 
+	if (manager->priv->save_cache_id != 0) {
+		g_source_remove (manager->priv->save_cache_id);
+		manager->priv->save_cache_id = 0;
+		mate_panel_applets_manager_dbus_save_cache (manager);
+	}
+
+	if (manager->priv->dir_caches) {
+		g_hash_table_destroy (manager->priv->dir_caches);
+		manager->priv->dir_caches = NULL;
+	}
+
 	G_OBJECT_CLASS (mate_panel_applets_manager_dbus_parent_class)->finalize (object);
 }
 
@@ -670,6 +1221,12 @@ mate_panel_applets_manager_dbus_init (MatePanelAppletsManagerDBus *manager)
 								 g_str_equal,
 								 (GDestroyNotify) g_free,
 								 (GDestroyNotify) mate_panel_applet_factory_info_free);
+	manager->priv->applet_infos = g_hash_table_new (g_str_hash, g_str_equal);
+	manager->priv->old_ids = g_hash_table_new (g_str_hash, g_str_equal);
+	manager->priv->dir_caches = g_hash_table_new_full (g_str_hash,
+							   g_str_equal,
+							   (GDestroyNotify) g_free,
+							   (GDestroyNotify) mate_panel_applets_dir_cache_free);
 
 	mate_panel_applets_manager_dbus_load_applet_infos (manager);
 }
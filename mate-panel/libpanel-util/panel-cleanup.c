@@ -28,72 +28,188 @@
 
 #include "panel-cleanup.h"
 
+/* The cleanups are kept in an array, in the order they were registered:
+ * the last registered is cleaned first. A removed one leaves a hole, and
+ * the holes are dropped once they are half of the array. A handle is an
+ * id never given twice; the ids grow along the array, which is searched
+ * for them. */
 typedef struct {
+	guint          id;
 	PanelCleanFunc func;
 	gpointer       data;
+	gboolean       memory_only;
 } PanelClean;
 
-static GSList *cleaner;
+static GArray *cleaner = NULL;
+static guint   cleaner_n_holes = 0;
+static guint   cleaner_last_id = 0;
 
-void
-panel_cleanup_do (void)
+static void
+panel_cleanup_run (gboolean with_memory)
 {
-	GSList *l;
+	GArray *cleanups;
+	guint   i;
 
 	if (!cleaner)
 		return;
 
-	for (l = cleaner; l; l = l->next) {
-		PanelClean *clean;
+	/* a cleanup can register or remove other ones */
+	cleanups = cleaner;
+	cleaner = NULL;
+	cleaner_n_holes = 0;
+
+	/* the last registered is cleaned first */
+	for (i = cleanups->len; i > 0; i--) {
+		PanelClean *clean = &g_array_index (cleanups, PanelClean, i - 1);
+
+		if (!clean->func)
+			continue;
+		if (clean->memory_only && !with_memory)
+			continue;
 
-		clean = l->data;
 		clean->func (clean->data);
-		g_slice_free (PanelClean, clean);
 	}
 
-	g_slist_free (cleaner);
-	cleaner = NULL;
+	g_array_unref (cleanups);
 }
 
 void
+panel_cleanup_do (void)
+{
+	panel_cleanup_run (TRUE);
+}
+
+/**
+ * panel_cleanup_do_for_exit:
+ *
+ * Runs the cleanups that matter outside of the process, like writing
+ * files, but not the ones registered with panel_cleanup_register_memory():
+ * the memory is given back by the exit, without going through
+ * every cache. With G_DEBUG=gc-friendly, like for memory checkers,
+ * everything is freed as with panel_cleanup_do().
+ */
+void
+panel_cleanup_do_for_exit (void)
+{
+	panel_cleanup_run (g_mem_gc_friendly);
+}
+
+static guint
+panel_cleanup_add (PanelCleanFunc func,
+		   gpointer       data,
+		   gboolean       memory_only)
+{
+	PanelClean clean = { 0, func, data, memory_only };
+
+	if (!cleaner)
+		cleaner = g_array_new (FALSE, FALSE, sizeof (PanelClean));
+
+	clean.id = ++cleaner_last_id;
+	g_array_append_val (cleaner, clean);
+
+	return clean.id;
+}
+
+static void
+panel_cleanup_compact (void)
+{
+	guint i, j;
+
+	for (i = 0, j = 0; i < cleaner->len; i++) {
+		PanelClean *clean = &g_array_index (cleaner, PanelClean, i);
+
+		if (!clean->func)
+			continue;
+		if (i != j)
+			g_array_index (cleaner, PanelClean, j) = *clean;
+		j++;
+	}
+
+	g_array_set_size (cleaner, j);
+	cleaner_n_holes = 0;
+}
+
+/* Returns a handle for panel_cleanup_remove() */
+guint
 panel_cleanup_register (PanelCleanFunc func,
 			gpointer       data)
+{
+	g_return_val_if_fail (func != NULL, 0);
+
+	return panel_cleanup_add (func, data, FALSE);
+}
+
+/* For a cleanup that only frees memory, skipped by
+ * panel_cleanup_do_for_exit() */
+guint
+panel_cleanup_register_memory (PanelCleanFunc func,
+			       gpointer       data)
+{
+	g_return_val_if_fail (func != NULL, 0);
+
+	return panel_cleanup_add (func, data, TRUE);
+}
+
+/* The handle is not valid anymore after that */
+void
+panel_cleanup_remove (guint id)
 {
 	PanelClean *clean;
+	guint       low, high;
 
-	g_return_if_fail (func != NULL);
+	g_return_if_fail (id != 0);
+
+	if (!cleaner)
+		return;
 
-	clean = g_slice_new (PanelClean);
-	clean->func = func;
-	clean->data = data;
+	low = 0;
+	high = cleaner->len;
+	while (low < high) {
+		guint middle = low + (high - low) / 2;
 
-	cleaner = g_slist_prepend (cleaner, clean);
+		if (g_array_index (cleaner, PanelClean, middle).id < id)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	if (low == cleaner->len)
+		return;
+
+	clean = &g_array_index (cleaner, PanelClean, low);
+	if (clean->id != id || !clean->func)
+		return;
+
+	clean->func = NULL;
+	clean->data = NULL;
+
+	if (++cleaner_n_holes > cleaner->len / 2)
+		panel_cleanup_compact ();
 }
 
 void
 panel_cleanup_unregister (PanelCleanFunc func,
 			  gpointer       data)
 {
-	GSList *l, *next;
+	guint i;
 
 	g_return_if_fail (func != NULL);
 
 	if (!cleaner)
 		return;
 
-	l = cleaner;
-
-	do {
-		next = l->next;
+	for (i = 0; i < cleaner->len; i++) {
+		PanelClean *clean = &g_array_index (cleaner, PanelClean, i);
 
-		PanelClean *clean = l->data;
 		if (clean->func == func && clean->data == data) {
-			g_slice_free (PanelClean, clean);
-			cleaner = g_slist_delete_link (cleaner, l);
+			clean->func = NULL;
+			clean->data = NULL;
+			cleaner_n_holes++;
 		}
+	}
 
-		l = next;
-	} while (l);
+	if (cleaner_n_holes > cleaner->len / 2)
+		panel_cleanup_compact ();
 }
 
 void
@@ -38,12 +38,16 @@ typedef void  (*PanelCleanFunc) (gpointer data);
 
 void panel_cleanup_unref_and_nullify (gpointer data);
 
-void panel_cleanup_do         (void);
-
-void panel_cleanup_register   (PanelCleanFunc func,
-			       gpointer       data);
-void panel_cleanup_unregister (PanelCleanFunc func,
-			       gpointer       data);
+void  panel_cleanup_do              (void);
+void  panel_cleanup_do_for_exit     (void);
+
+guint panel_cleanup_register        (PanelCleanFunc func,
+				     gpointer       data);
+guint panel_cleanup_register_memory (PanelCleanFunc func,
+				     gpointer       data);
+void  panel_cleanup_remove          (guint          id);
+void  panel_cleanup_unregister      (PanelCleanFunc func,
+				     gpointer       data);
 
 #ifdef __cplusplus
 }
@@ -197,4 +197,63 @@ gtk_style_shade (GdkRGBA *a, GdkRGBA *b, gdouble k)
 	b->red = red;
 	b->green = green;
 	b->blue = blue;
+	b->alpha = a->alpha;
+}
+
+/* the factors of gtk_style_shade() of the shades, by index */
+static const gdouble panel_color_shade_factors[PANEL_COLOR_SHADE_LAST] = {
+	0.7, /* PANEL_COLOR_SHADE_DARK */
+	1.3  /* PANEL_COLOR_SHADE_LIGHT */
+};
+
+/**
+ * panel_color_palette_get:
+ * @palette: the palette of @base, or a zeroed one
+ * @base: the colour to shade
+ * @shade: the shade wanted
+ *
+ * Returns the shade of @base, like gtk_style_shade() would compute it.
+ * All the shades of a colour are computed at once, converting it to HLS
+ * only once, the first time @palette is asked for a shade of it: the
+ * next calls for the same colour are lookups.
+ *
+ * Returns: (transfer none): the shade, owned by @palette.
+ */
+const GdkRGBA *
+panel_color_palette_get (PanelColorPalette *palette,
+			 const GdkRGBA     *base,
+			 PanelColorShade    shade)
+{
+	g_return_val_if_fail (palette != NULL, NULL);
+	g_return_val_if_fail (base != NULL, NULL);
+	g_return_val_if_fail (shade < PANEL_COLOR_SHADE_LAST, NULL);
+
+	if (!palette->valid || !gdk_rgba_equal (&palette->base, base)) {
+		gdouble h, l, s;
+		int     i;
+
+		h = base->red;
+		l = base->green;
+		s = base->blue;
+		rgb_to_hls (&h, &l, &s);
+
+		for (i = 0; i < PANEL_COLOR_SHADE_LAST; i++) {
+			gdouble red, green, blue;
+
+			red   = h;
+			green = CLAMP (l * panel_color_shade_factors[i], 0.0, 1.0);
+			blue  = CLAMP (s * panel_color_shade_factors[i], 0.0, 1.0);
+			hls_to_rgb (&red, &green, &blue);
+
+			palette->shades[i].red   = red;
+			palette->shades[i].green = green;
+			palette->shades[i].blue  = blue;
+			palette->shades[i].alpha = base->alpha;
+		}
+
+		palette->base  = *base;
+		palette->valid = TRUE;
+	}
+
+	return &palette->shades[shade];
 }
@@ -7,6 +7,22 @@ G_BEGIN_DECLS
 
 void gtk_style_shade (GdkRGBA *a, GdkRGBA *b, gdouble k);
 
+typedef enum {
+	PANEL_COLOR_SHADE_DARK,
+	PANEL_COLOR_SHADE_LIGHT,
+	PANEL_COLOR_SHADE_LAST
+} PanelColorShade;
+
+typedef struct {
+	GdkRGBA  base;
+	GdkRGBA  shades[PANEL_COLOR_SHADE_LAST];
+	gboolean valid;
+} PanelColorPalette;
+
+const GdkRGBA *panel_color_palette_get (PanelColorPalette *palette,
+					const GdkRGBA     *base,
+					PanelColorShade    shade);
+
 G_END_DECLS
 
 #endif
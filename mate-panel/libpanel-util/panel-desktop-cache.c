@@ -0,0 +1,283 @@
+/*
+ * panel-desktop-cache.c: cache of parsed desktop files
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * The same desktop files are parsed again and again: by every launcher
+ * pointing to them, by the menu items and by the run dialog. This keeps one
+ * parsed GKeyFile per path, reused as long as the mtime and size of the file
+ * do not change. The returned key files are shared and must not be modified;
+ * callers release them with g_key_file_unref().
+ *
+ * Callers interested in changes to a file add a watch: all the watches on a
+ * path share one file monitor, which also drops the parsed file on change.
+ *
+ * Everything here has to be used from the main thread.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "panel-desktop-cache.h"
+
+/* Unwatched entries are forgotten once there are that many entries */
+#define PANEL_DESKTOP_CACHE_MAX_ENTRIES 256
+
+typedef struct {
+	char         *path;
+	GKeyFile     *key_file;
+	time_t        mtime;
+	goffset       size;
+
+	GFileMonitor *monitor;
+	GSList       *watches;
+} PanelDesktopCacheEntry;
+
+typedef struct {
+	PanelDesktopCacheEntry *entry;
+	PanelDesktopCacheFunc   func;
+	gpointer                user_data;
+} PanelDesktopCacheWatch;
+
+static GHashTable *panel_desktop_cache_entries = NULL;
+static GHashTable *panel_desktop_cache_watches = NULL;
+static guint       panel_desktop_cache_next_watch_id = 1;
+
+static void
+panel_desktop_cache_entry_free (PanelDesktopCacheEntry *entry)
+{
+	/* entries with watches are never removed */
+	g_assert (entry->watches == NULL);
+	g_assert (entry->monitor == NULL);
+
+	if (entry->key_file)
+		g_key_file_unref (entry->key_file);
+	g_free (entry->path);
+	g_slice_free (PanelDesktopCacheEntry, entry);
+}
+
+static gboolean
+panel_desktop_cache_entry_is_unwatched (gpointer key,
+					gpointer value,
+					gpointer user_data)
+{
+	PanelDesktopCacheEntry *entry = value;
+
+	return entry->watches == NULL;
+}
+
+static PanelDesktopCacheEntry *
+panel_desktop_cache_get_entry (const char *path)
+{
+	PanelDesktopCacheEntry *entry;
+
+	if (!panel_desktop_cache_entries)
+		panel_desktop_cache_entries = g_hash_table_new_full (g_str_hash,
+								     g_str_equal,
+								     NULL,
+								     (GDestroyNotify) panel_desktop_cache_entry_free);
+
+	entry = g_hash_table_lookup (panel_desktop_cache_entries, path);
+	if (entry)
+		return entry;
+
+	if (g_hash_table_size (panel_desktop_cache_entries) >= PANEL_DESKTOP_CACHE_MAX_ENTRIES)
+		g_hash_table_foreach_remove (panel_desktop_cache_entries,
+					     panel_desktop_cache_entry_is_unwatched,
+					     NULL);
+
+	entry = g_slice_new0 (PanelDesktopCacheEntry);
+	entry->path = g_strdup (path);
+	g_hash_table_insert (panel_desktop_cache_entries, entry->path, entry);
+
+	return entry;
+}
+
+GKeyFile *
+panel_desktop_cache_lookup (const char  *path,
+			    GError     **error)
+{
+	PanelDesktopCacheEntry *entry;
+	GKeyFile               *key_file;
+	GStatBuf                buf;
+
+	g_return_val_if_fail (path != NULL, NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+	if (g_stat (path, &buf) != 0) {
+		int errsv = errno;
+
+		if (panel_desktop_cache_entries) {
+			entry = g_hash_table_lookup (panel_desktop_cache_entries, path);
+			if (entry)
+				g_clear_pointer (&entry->key_file, g_key_file_unref);
+		}
+
+		g_set_error (error, G_FILE_ERROR,
+			     g_file_error_from_errno (errsv),
+			     _("Could not access desktop file %s: %s"),
+			     path, g_strerror (errsv));
+		return NULL;
+	}
+
+	entry = panel_desktop_cache_get_entry (path);
+
+	if (entry->key_file &&
+	    entry->mtime == buf.st_mtime &&
+	    entry->size == buf.st_size)
+		return g_key_file_ref (entry->key_file);
+
+	key_file = g_key_file_new ();
+	if (!g_key_file_load_from_file (key_file, path,
+					G_KEY_FILE_KEEP_COMMENTS|G_KEY_FILE_KEEP_TRANSLATIONS,
+					error)) {
+		g_key_file_unref (key_file);
+		g_clear_pointer (&entry->key_file, g_key_file_unref);
+		return NULL;
+	}
+
+	if (entry->key_file)
+		g_key_file_unref (entry->key_file);
+	entry->key_file = key_file;
+	entry->mtime = buf.st_mtime;
+	entry->size = buf.st_size;
+
+	return g_key_file_ref (key_file);
+}
+
+static void
+panel_desktop_cache_file_changed (GFileMonitor           *monitor,
+				  GFile                  *file,
+				  GFile                  *other_file,
+				  GFileMonitorEvent       event_type,
+				  PanelDesktopCacheEntry *entry)
+{
+	GSList *ids;
+	GSList *l;
+	char   *path;
+
+	if (event_type == G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED ||
+	    event_type == G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT)
+		return;
+
+	/* do not wait for the mtime to tell: it has a one second resolution */
+	g_clear_pointer (&entry->key_file, g_key_file_unref);
+
+	if (event_type != G_FILE_MONITOR_EVENT_CHANGED &&
+	    event_type != G_FILE_MONITOR_EVENT_CREATED)
+		return;
+
+	/* the watches can go away, and the entry with them, while we notify */
+	path = g_strdup (entry->path);
+	ids = g_slist_copy (entry->watches);
+
+	for (l = ids; l; l = l->next) {
+		PanelDesktopCacheWatch *watch;
+
+		watch = g_hash_table_lookup (panel_desktop_cache_watches, l->data);
+		if (watch)
+			watch->func (path, watch->user_data);
+	}
+
+	g_slist_free (ids);
+	g_free (path);
+}
+
+guint
+panel_desktop_cache_watch (const char            *path,
+			   PanelDesktopCacheFunc  func,
+			   gpointer               user_data)
+{
+	PanelDesktopCacheEntry *entry;
+	PanelDesktopCacheWatch *watch;
+	guint                   watch_id;
+
+	g_return_val_if_fail (path != NULL, 0);
+	g_return_val_if_fail (func != NULL, 0);
+
+	entry = panel_desktop_cache_get_entry (path);
+
+	if (!entry->monitor) {
+		GFile *file;
+
+		file = g_file_new_for_path (path);
+		entry->monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE,
+						      NULL, NULL);
+		g_object_unref (file);
+
+		if (entry->monitor)
+			g_signal_connect (entry->monitor, "changed",
+					  G_CALLBACK (panel_desktop_cache_file_changed),
+					  entry);
+	}
+
+	if (!panel_desktop_cache_watches)
+		panel_desktop_cache_watches = g_hash_table_new_full (g_direct_hash,
+								     g_direct_equal,
+								     NULL,
+								     g_free);
+
+	watch = g_new0 (PanelDesktopCacheWatch, 1);
+	watch->entry = entry;
+	watch->func = func;
+	watch->user_data = user_data;
+
+	watch_id = panel_desktop_cache_next_watch_id++;
+	g_hash_table_insert (panel_desktop_cache_watches,
+			     GUINT_TO_POINTER (watch_id), watch);
+	entry->watches = g_slist_prepend (entry->watches,
+					  GUINT_TO_POINTER (watch_id));
+
+	return watch_id;
+}
+
+void
+panel_desktop_cache_unwatch (guint watch_id)
+{
+	PanelDesktopCacheEntry *entry;
+	PanelDesktopCacheWatch *watch;
+
+	if (watch_id == 0 || !panel_desktop_cache_watches)
+		return;
+
+	watch = g_hash_table_lookup (panel_desktop_cache_watches,
+				     GUINT_TO_POINTER (watch_id));
+	if (!watch)
+		return;
+
+	entry = watch->entry;
+	entry->watches = g_slist_remove (entry->watches,
+					 GUINT_TO_POINTER (watch_id));
+	g_hash_table_remove (panel_desktop_cache_watches,
+			     GUINT_TO_POINTER (watch_id));
+
+	if (entry->watches == NULL && entry->monitor) {
+		g_signal_handlers_disconnect_by_func (entry->monitor,
+						      panel_desktop_cache_file_changed,
+						      entry);
+		g_file_monitor_cancel (entry->monitor);
+		g_clear_object (&entry->monitor);
+	}
+}
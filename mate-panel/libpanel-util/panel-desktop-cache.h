@@ -0,0 +1,46 @@
+/*
+ * panel-desktop-cache.h: cache of parsed desktop files
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef PANEL_DESKTOP_CACHE_H
+#define PANEL_DESKTOP_CACHE_H
+
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*PanelDesktopCacheFunc) (const char *path,
+				       gpointer    user_data);
+
+GKeyFile *panel_desktop_cache_lookup  (const char            *path,
+				       GError               **error);
+
+guint     panel_desktop_cache_watch   (const char            *path,
+				       PanelDesktopCacheFunc  func,
+				       gpointer               user_data);
+void      panel_desktop_cache_unwatch (guint                  watch_id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PANEL_DESKTOP_CACHE_H */
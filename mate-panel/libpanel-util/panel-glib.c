@@ -31,7 +31,9 @@
 #include <string.h>
 
 #include <glib.h>
+#include <gio/gio.h>
 
+#include "panel-cleanup.h"
 #include "panel-glib.h"
 
 typedef char * (*LookupInDir) (const char *basename, const char *dir);
@@ -66,8 +68,120 @@ _lookup_in_applications_subdir (const char *basename,
 	return path;
 }
 
+/* The same files are looked for again and again: by the launchers, the
+ * menus, every launch. What was found, or not found, is remembered for
+ * each basename, and forgotten when a file of that name appears in, or
+ * goes away from, one of the directories. */
+typedef struct {
+	const char *subdir;
+	GHashTable *paths;    /* basename -> path, or "" if there is none */
+	GList      *monitors;
+} PanelGLookupCache;
+
+static PanelGLookupCache data_dirs_cache    = { NULL, NULL, NULL };
+static PanelGLookupCache applications_cache = { "applications", NULL, NULL };
+
+G_LOCK_DEFINE_STATIC (panel_g_lookup);
+
+static void
+_panel_g_lookup_cache_forget (PanelGLookupCache *cache,
+			      GFile             *file)
+{
+	char *basename;
+
+	if (!file)
+		return;
+
+	basename = g_file_get_basename (file);
+
+	G_LOCK (panel_g_lookup);
+	if (cache->paths)
+		g_hash_table_remove (cache->paths, basename);
+	G_UNLOCK (panel_g_lookup);
+
+	g_free (basename);
+}
+
+static void
+_panel_g_lookup_cache_dir_changed (GFileMonitor      *monitor,
+				   GFile             *file,
+				   GFile             *other_file,
+				   GFileMonitorEvent  event_type,
+				   PanelGLookupCache *cache)
+{
+	switch (event_type) {
+	case G_FILE_MONITOR_EVENT_CHANGED:
+	case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+	case G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED:
+		/* the file is still there */
+		return;
+	default:
+		break;
+	}
+
+	_panel_g_lookup_cache_forget (cache, file);
+	_panel_g_lookup_cache_forget (cache, other_file);
+}
+
+static void
+_panel_g_lookup_cache_free (PanelGLookupCache *cache)
+{
+	G_LOCK (panel_g_lookup);
+	g_clear_pointer (&cache->paths, g_hash_table_destroy);
+	G_UNLOCK (panel_g_lookup);
+
+	g_list_free_full (cache->monitors, g_object_unref);
+	cache->monitors = NULL;
+}
+
+static void
+_panel_g_lookup_cache_watch (PanelGLookupCache *cache,
+			     const char        *data_dir)
+{
+	GFileMonitor *monitor;
+	GFile        *dir;
+	char         *path;
+
+	path = g_build_filename (data_dir, cache->subdir, NULL);
+	dir = g_file_new_for_path (path);
+	g_free (path);
+
+	/* a directory that does not exist yet is watched too */
+	monitor = g_file_monitor_directory (dir, G_FILE_MONITOR_WATCH_MOVES,
+					    NULL, NULL);
+	g_object_unref (dir);
+
+	if (!monitor)
+		return;
+
+	g_signal_connect (monitor, "changed",
+			  G_CALLBACK (_panel_g_lookup_cache_dir_changed),
+			  cache);
+	cache->monitors = g_list_prepend (cache->monitors, monitor);
+}
+
+/* Called with the lock held; the monitors report to the main context */
+static void
+_panel_g_lookup_cache_init (PanelGLookupCache *cache)
+{
+	const char * const *system_data_dirs;
+	int                  i;
+
+	cache->paths = g_hash_table_new_full (g_str_hash, g_str_equal,
+					      g_free, g_free);
+
+	_panel_g_lookup_cache_watch (cache, g_get_user_data_dir ());
+
+	system_data_dirs = g_get_system_data_dirs ();
+	for (i = 0; system_data_dirs[i]; i++)
+		_panel_g_lookup_cache_watch (cache, system_data_dirs[i]);
+
+	panel_cleanup_register_memory (PANEL_CLEAN_FUNC (_panel_g_lookup_cache_free),
+				       cache);
+}
+
 static char *
-_panel_g_lookup_in_data_dirs_internal (const char *basename,
+_panel_g_lookup_in_data_dirs_uncached (const char *basename,
 				       LookupInDir lookup)
 {
 	const char * const *system_data_dirs;
@@ -88,18 +202,55 @@ _panel_g_lookup_in_data_dirs_internal (const char *basename,
 	return NULL;
 }
 
+static char *
+_panel_g_lookup_in_data_dirs_internal (const char        *basename,
+				       LookupInDir        lookup,
+				       PanelGLookupCache *cache)
+{
+	const char *cached;
+	char       *retval;
+	gboolean    found;
+
+	/* the monitors only see the files directly in the directories */
+	if (strchr (basename, G_DIR_SEPARATOR))
+		return _panel_g_lookup_in_data_dirs_uncached (basename, lookup);
+
+	G_LOCK (panel_g_lookup);
+	if (!cache->paths)
+		_panel_g_lookup_cache_init (cache);
+	found = g_hash_table_lookup_extended (cache->paths, basename,
+					      NULL, (gpointer *) &cached);
+	retval = (found && cached[0]) ? g_strdup (cached) : NULL;
+	G_UNLOCK (panel_g_lookup);
+
+	if (found)
+		return retval;
+
+	retval = _panel_g_lookup_in_data_dirs_uncached (basename, lookup);
+
+	G_LOCK (panel_g_lookup);
+	if (cache->paths)
+		g_hash_table_replace (cache->paths, g_strdup (basename),
+				      g_strdup (retval ? retval : ""));
+	G_UNLOCK (panel_g_lookup);
+
+	return retval;
+}
+
 char *
 panel_g_lookup_in_data_dirs (const char *basename)
 {
 	return _panel_g_lookup_in_data_dirs_internal (basename,
-						      _lookup_in_dir);
+						      _lookup_in_dir,
+						      &data_dirs_cache);
 }
 
 char *
 panel_g_lookup_in_applications_dirs (const char *basename)
 {
 	return _panel_g_lookup_in_data_dirs_internal (basename,
-						      _lookup_in_applications_subdir);
+						      _lookup_in_applications_subdir,
+						      &applications_cache);
 }
 
 /* Copied from evolution-data-server/libedataserver/e-util.c:
@@ -111,31 +262,79 @@ _unicode_get_utf8 (const char *text, gunichar *out)
 	return (*out == (gunichar)-1) ? NULL : g_utf8_next_char (text);
 }
 
-/* Copied from evolution-data-server/libedataserver/e-util.c:
- * e_util_utf8_strstrcase() */
-const char *
-panel_g_utf8_strstrcase (const char *haystack, const char *needle)
+struct _PanelGUtf8Needle {
+	/* the characters of the needle, lowered; NULL if it is not valid */
+	gunichar *chars;
+	gint      len;
+
+	/* the needle, lowered, if it is only made of ASCII characters */
+	char     *ascii;
+};
+
+/**
+ * panel_g_utf8_needle_new:
+ * @needle: the UTF-8 string to look for
+ *
+ * Prepares @needle to be looked for, case insensitively, in many strings
+ * with panel_g_utf8_needle_find(): it is decoded and lowered only once.
+ *
+ * Returns: a new #PanelGUtf8Needle, to free with panel_g_utf8_needle_free().
+ */
+PanelGUtf8Needle *
+panel_g_utf8_needle_new (const char *needle)
 {
-	gunichar *nuni;
-	gunichar unival;
-	gint nlen;
-	const char *o, *p;
+	PanelGUtf8Needle *compiled;
+	gunichar          unival;
+	const char       *p;
+	gboolean          is_ascii = TRUE;
 
-	if (haystack == NULL) return NULL;
-	if (needle == NULL) return NULL;
-	if (strlen (needle) == 0) return haystack;
-	if (strlen (haystack) == 0) return NULL;
+	g_return_val_if_fail (needle != NULL, NULL);
 
-	nuni = g_alloca (sizeof (gunichar) * strlen (needle));
+	compiled = g_new0 (PanelGUtf8Needle, 1);
+	compiled->chars = g_new (gunichar, strlen (needle) + 1);
 
-	nlen = 0;
 	for (p = _unicode_get_utf8 (needle, &unival);
 	     p && unival;
 	     p = _unicode_get_utf8 (p, &unival)) {
-		nuni[nlen++] = g_unichar_tolower (unival);
+		compiled->chars[compiled->len++] = g_unichar_tolower (unival);
+		if (unival >= 0x80)
+			is_ascii = FALSE;
 	}
+
 	/* NULL means there was illegal utf-8 sequence */
-	if (!p) return NULL;
+	if (!p) {
+		g_clear_pointer (&compiled->chars, g_free);
+		compiled->len = 0;
+		return compiled;
+	}
+
+	if (is_ascii)
+		compiled->ascii = g_ascii_strdown (needle, -1);
+
+	return compiled;
+}
+
+void
+panel_g_utf8_needle_free (PanelGUtf8Needle *needle)
+{
+	if (!needle)
+		return;
+
+	g_free (needle->chars);
+	g_free (needle->ascii);
+	g_free (needle);
+}
+
+/* Copied from evolution-data-server/libedataserver/e-util.c:
+ * e_util_utf8_strstrcase() */
+static const char *
+_panel_g_utf8_needle_find_unicode (PanelGUtf8Needle *needle,
+				   const char       *haystack)
+{
+	gunichar *nuni = needle->chars;
+	gunichar unival;
+	gint nlen = needle->len;
+	const char *o, *p;
 
 	o = haystack;
 	for (p = _unicode_get_utf8 (o, &unival);
@@ -163,3 +362,75 @@ panel_g_utf8_strstrcase (const char *haystack, const char *needle)
 
 	return NULL;
 }
+
+/* An ASCII needle in an ASCII haystack only needs bytes to be compared.
+ * Some other characters are lowered to ASCII ones (the Kelvin sign is
+ * lowered to 'k'): the first byte that is not ASCII sends the search to
+ * the Unicode version, which finds the same first match. */
+static const char *
+_panel_g_utf8_needle_find_ascii (PanelGUtf8Needle *needle,
+				 const char       *haystack)
+{
+	const char *ascii = needle->ascii;
+	const char *h;
+	char        first = ascii[0];
+
+	for (h = haystack; *h; h++) {
+		gint i;
+
+		if ((guchar) *h >= 0x80)
+			return _panel_g_utf8_needle_find_unicode (needle, haystack);
+
+		if (g_ascii_tolower (*h) != first)
+			continue;
+
+		for (i = 1; ascii[i] && g_ascii_tolower (h[i]) == ascii[i]; i++)
+			;
+		if (!ascii[i])
+			return h;
+	}
+
+	return NULL;
+}
+
+/**
+ * panel_g_utf8_needle_find:
+ * @needle: a #PanelGUtf8Needle
+ * @haystack: the UTF-8 string to look into
+ *
+ * Looks for @needle in @haystack, ignoring the case.
+ *
+ * Returns: the first occurrence of @needle in @haystack, or %NULL.
+ */
+const char *
+panel_g_utf8_needle_find (PanelGUtf8Needle *needle,
+			  const char       *haystack)
+{
+	g_return_val_if_fail (needle != NULL, NULL);
+
+	if (haystack == NULL) return NULL;
+	if (needle->chars == NULL) return NULL;
+	if (needle->len == 0) return haystack;
+	if (haystack[0] == '\0') return NULL;
+
+	if (needle->ascii)
+		return _panel_g_utf8_needle_find_ascii (needle, haystack);
+
+	return _panel_g_utf8_needle_find_unicode (needle, haystack);
+}
+
+const char *
+panel_g_utf8_strstrcase (const char *haystack, const char *needle)
+{
+	PanelGUtf8Needle *compiled;
+	const char       *retval;
+
+	if (haystack == NULL) return NULL;
+	if (needle == NULL) return NULL;
+
+	compiled = panel_g_utf8_needle_new (needle);
+	retval = panel_g_utf8_needle_find (compiled, haystack);
+	panel_g_utf8_needle_free (compiled);
+
+	return retval;
+}
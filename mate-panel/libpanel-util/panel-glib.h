@@ -40,6 +40,13 @@ char       *panel_g_lookup_in_applications_dirs (const char *basename);
 const char *panel_g_utf8_strstrcase             (const char *haystack,
 						 const char *needle);
 
+typedef struct _PanelGUtf8Needle PanelGUtf8Needle;
+
+PanelGUtf8Needle *panel_g_utf8_needle_new       (const char       *needle);
+void              panel_g_utf8_needle_free      (PanelGUtf8Needle *needle);
+const char       *panel_g_utf8_needle_find      (PanelGUtf8Needle *needle,
+						 const char       *haystack);
+
 #ifdef __cplusplus
 }
 #endif
@@ -28,6 +28,7 @@
 
 #include "panel-gtk.h"
 #include "panel-cleanup.h"
+#include "panel-thumbnail.h"
 
 /*
  * Originally based on code from panel-properties-dialog.c. This part of the
@@ -40,31 +41,72 @@
  */
 static GSettings *icon_settings = NULL;
 
+#define PANEL_GTK_FILE_CHOOSER_PREVIEW_SIZE 128
+
+static void
+panel_gtk_file_chooser_cancel_preview (GCancellable *cancellable)
+{
+	g_cancellable_cancel (cancellable);
+	g_object_unref (cancellable);
+}
+
+static void
+panel_gtk_file_chooser_preview_loaded (GObject      *source_object,
+				       GAsyncResult *result,
+				       gpointer      data)
+{
+	GtkFileChooser *chooser;
+	GtkWidget      *preview;
+	GdkPixbuf      *pixbuf;
+	GError         *error = NULL;
+
+	pixbuf = panel_thumbnail_load_finish (result, &error);
+
+	/* replaced by another preview, or the chooser is gone */
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		g_error_free (error);
+		return;
+	}
+	g_clear_error (&error);
+
+	chooser = GTK_FILE_CHOOSER (data);
+	preview = gtk_file_chooser_get_preview_widget (chooser);
+
+	gtk_image_set_from_pixbuf (GTK_IMAGE (preview), pixbuf);
+	gtk_file_chooser_set_preview_widget_active (chooser, pixbuf != NULL);
+
+	if (pixbuf)
+		g_object_unref (pixbuf);
+}
+
+/* Decoding the image is done in a thread: browsing a directory of photos
+ * or of big icons must not stall the chooser */
 static void
 panel_gtk_file_chooser_preview_update (GtkFileChooser *chooser,
 				       gpointer data)
 {
-	GtkWidget *preview;
-	char      *filename;
-	GdkPixbuf *pixbuf;
-	gboolean   have_preview;
+	GCancellable *cancellable;
+	char         *filename;
 
-	preview = GTK_WIDGET (data);
 	filename = gtk_file_chooser_get_preview_filename (chooser);
 
 	if (filename == NULL)
 		return;
 
-	pixbuf = gdk_pixbuf_new_from_file_at_size (filename, 128, 128, NULL);
-	have_preview = (pixbuf != NULL);
-	g_free (filename);
+	cancellable = g_cancellable_new ();
+	/* cancels the previous preview, if still loading */
+	g_object_set_data_full (G_OBJECT (chooser), "panel-preview-cancellable",
+				g_object_ref (cancellable),
+				(GDestroyNotify) panel_gtk_file_chooser_cancel_preview);
 
-	gtk_image_set_from_pixbuf (GTK_IMAGE (preview), pixbuf);
-	if (pixbuf)
-		g_object_unref (pixbuf);
+	panel_thumbnail_load_async (filename,
+				    PANEL_GTK_FILE_CHOOSER_PREVIEW_SIZE,
+				    cancellable,
+				    panel_gtk_file_chooser_preview_loaded,
+				    chooser);
 
-	gtk_file_chooser_set_preview_widget_active (chooser,
-						    have_preview);
+	g_object_unref (cancellable);
+	g_free (filename);
 }
 
 void
@@ -174,8 +216,8 @@ ensure_icon_settings (void)
 
 	icon_settings = g_settings_new ("org.mate.interface");
 
-	panel_cleanup_register (panel_cleanup_unref_and_nullify,
-					&icon_settings);
+	panel_cleanup_register_memory (panel_cleanup_unref_and_nullify,
+				       &icon_settings);
 }
 
 GtkWidget *
@@ -277,3 +319,29 @@ panel_check_menu_item_new (GtkWidget *widget_check)
 
 	return menuitem;
 }
+
+#define PANEL_GDK_PIXBUF_SURFACE_KEY "panel-cairo-surface"
+
+/*
+ * Converting a pixbuf to a cairo surface has to swizzle and premultiply
+ * every pixel; a pixbuf that is painted again and again, and never
+ * modified, better keeps what it converted to. The pixbuf owns the
+ * surface.
+ */
+cairo_surface_t *
+panel_gdk_pixbuf_peek_surface (GdkPixbuf *pixbuf)
+{
+	cairo_surface_t *surface;
+
+	g_return_val_if_fail (GDK_IS_PIXBUF (pixbuf), NULL);
+
+	surface = g_object_get_data (G_OBJECT (pixbuf), PANEL_GDK_PIXBUF_SURFACE_KEY);
+	if (surface)
+		return surface;
+
+	surface = gdk_cairo_surface_create_from_pixbuf (pixbuf, 1, NULL);
+	g_object_set_data_full (G_OBJECT (pixbuf), PANEL_GDK_PIXBUF_SURFACE_KEY,
+				surface, (GDestroyNotify) cairo_surface_destroy);
+
+	return surface;
+}
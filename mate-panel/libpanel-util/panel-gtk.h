@@ -55,6 +55,8 @@ GtkWidget* panel_image_menu_item_new_from_gicon (GIcon       *gicon,
 
 GtkWidget* panel_check_menu_item_new (GtkWidget *widget_check);
 
+cairo_surface_t *panel_gdk_pixbuf_peek_surface (GdkPixbuf *pixbuf);
+
 #ifdef __cplusplus
 }
 #endif
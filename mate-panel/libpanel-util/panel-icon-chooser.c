@@ -27,6 +27,7 @@
 #include <gtk/gtk.h>
 
 #include "panel-gtk.h"
+#include "panel-thumbnail.h"
 #include "panel-xdg.h"
 
 #include "panel-icon-chooser.h"
@@ -41,6 +42,8 @@ struct _PanelIconChooserPrivate
 	char *icon_theme_dir;
 
 	GtkWidget *image;
+	/* loading the image of an absolute icon path */
+	GCancellable *cancellable;
 
 	GtkWidget *filechooser;
 };
@@ -153,6 +156,11 @@ panel_icon_chooser_dispose (GObject *object)
 
 	/* remember, destroy can be run multiple times! */
 
+	if (chooser->priv->cancellable) {
+		g_cancellable_cancel (chooser->priv->cancellable);
+		g_clear_object (&chooser->priv->cancellable);
+	}
+
 	g_clear_pointer (&chooser->priv->fallback_icon_name, g_free);
 	g_clear_pointer (&chooser->priv->icon, g_free);
 	g_clear_pointer (&chooser->priv->icon_theme_dir, g_free);
@@ -230,9 +238,45 @@ panel_icon_chooser_init (PanelIconChooser *chooser)
 
 /* internal code */
 
+static void
+_panel_icon_chooser_image_loaded (GObject      *source_object,
+				  GAsyncResult *result,
+				  gpointer      data)
+{
+	PanelIconChooser *chooser;
+	GdkPixbuf        *pixbuf;
+	GError           *error = NULL;
+
+	pixbuf = panel_thumbnail_load_finish (result, &error);
+
+	/* another icon was set, or the chooser is gone */
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		g_error_free (error);
+		return;
+	}
+	g_clear_error (&error);
+
+	chooser = PANEL_ICON_CHOOSER (data);
+	g_clear_object (&chooser->priv->cancellable);
+
+	if (pixbuf) {
+		gtk_image_set_from_pixbuf (GTK_IMAGE (chooser->priv->image),
+					   pixbuf);
+		g_object_unref (pixbuf);
+	} else
+		gtk_image_set_from_icon_name (GTK_IMAGE (chooser->priv->image),
+					      chooser->priv->fallback_icon_name,
+					      PANEL_ICON_CHOOSER_ICON_SIZE);
+}
+
 static void
 _panel_icon_chooser_update (PanelIconChooser *chooser)
 {
+	if (chooser->priv->cancellable) {
+		g_cancellable_cancel (chooser->priv->cancellable);
+		g_clear_object (&chooser->priv->cancellable);
+	}
+
 	if (!chooser->priv->icon) {
 		gtk_image_set_from_icon_name (GTK_IMAGE (chooser->priv->image),
 					      chooser->priv->fallback_icon_name,
@@ -244,22 +288,20 @@ _panel_icon_chooser_update (PanelIconChooser *chooser)
 		fallback = TRUE;
 
 		if (g_file_test (chooser->priv->icon, G_FILE_TEST_EXISTS)) {
-			/* we pass via a pixbuf to force the size we want */
-			GdkPixbuf *pixbuf;
-			int        width, height;
+			/* we pass via a pixbuf to force the size we want; the
+			 * current image stays until it is loaded */
+			int width, height;
 
 			gtk_icon_size_lookup (PANEL_ICON_CHOOSER_ICON_SIZE,
 					      &width, &height);
-			pixbuf = gdk_pixbuf_new_from_file_at_size (chooser->priv->icon,
-								   width, height,
-								   NULL);
-
-			if (pixbuf) {
-				gtk_image_set_from_pixbuf (GTK_IMAGE (chooser->priv->image),
-							   pixbuf);
-				g_object_unref (pixbuf);
-				fallback = FALSE;
-			}
+
+			chooser->priv->cancellable = g_cancellable_new ();
+			panel_thumbnail_load_async (chooser->priv->icon,
+						    MAX (width, height),
+						    chooser->priv->cancellable,
+						    _panel_icon_chooser_image_loaded,
+						    chooser);
+			fallback = FALSE;
 		}
 
 		if (fallback) {
@@ -89,45 +89,27 @@ _panel_key_file_make_executable (const gchar *path)
 	g_object_unref (file);
 }
 
-/* FIXME: kill this when bug #309224 is fixed */
-gboolean
-panel_key_file_to_file (GKeyFile     *keyfile,
-			const gchar  *file,
-			GError      **error)
+/* Desktop files get a shebang, so that file managers consider them trusted
+ * once they are executable */
+gchar *
+panel_key_file_to_data (GKeyFile  *keyfile,
+			gsize     *length,
+			GError   **error)
 {
-	gchar   *filename;
-	GError  *write_error;
-	gchar   *data;
-	gsize    length;
-	gboolean res;
-
-	g_return_val_if_fail (keyfile != NULL, FALSE);
-	g_return_val_if_fail (file != NULL, FALSE);
-
-	write_error = NULL;
-	data = g_key_file_to_data (keyfile, &length, &write_error);
-	if (write_error) {
-		g_propagate_error (error, write_error);
-		return FALSE;
-	}
+	gchar *data;
+	gsize  data_length;
 
-	if (!g_path_is_absolute (file))
-		filename = g_filename_from_uri (file, NULL, &write_error);
-	else
-		filename = g_filename_from_utf8 (file, -1, NULL, NULL,
-						 &write_error);
+	g_return_val_if_fail (keyfile != NULL, NULL);
 
-	if (write_error) {
-		g_propagate_error (error, write_error);
-		g_free (data);
-		return FALSE;
-	}
+	data = g_key_file_to_data (keyfile, &data_length, error);
+	if (!data)
+		return NULL;
 
 	if (!g_str_has_prefix (data, "#!")) {
 		gchar *new_data;
 		gsize  new_length;
 
-		new_length = length + strlen (KEYFILE_TRUSTED_SHEBANG);
+		new_length = data_length + strlen (KEYFILE_TRUSTED_SHEBANG);
 		new_data = g_malloc (new_length + 1);
 
 		g_strlcpy (new_data, KEYFILE_TRUSTED_SHEBANG, new_length + 1);
@@ -135,26 +117,227 @@ panel_key_file_to_file (GKeyFile     *keyfile,
 
 		g_free (data);
 		data = new_data;
-		length = new_length;
+		data_length = new_length;
 	}
 
-	res = g_file_set_contents (filename, data, length, &write_error);
+	if (length)
+		*length = data_length;
+
+	return data;
+}
+
+static gchar *
+_panel_key_file_get_filename (const gchar  *file,
+			      GError      **error)
+{
+	if (!g_path_is_absolute (file))
+		return g_filename_from_uri (file, NULL, error);
+	else
+		return g_filename_from_utf8 (file, -1, NULL, NULL, error);
+}
+
+/* All the writes are done with this lock held: a write queued by
+ * panel_key_file_write_data_async() cannot rename its temporary file over
+ * the one of a later write. Each write of a file gets a generation, and
+ * the table maps the filename to the generation of the last write asked
+ * for; a queued write whose generation is not there anymore was superseded
+ * and is skipped. The entry goes away once the last write is done. */
+G_LOCK_DEFINE_STATIC (panel_key_file_write);
+static GHashTable *_panel_key_file_generations = NULL;
+static guint64     _panel_key_file_last_generation = 0;
+
+/* Called with the lock held */
+static guint64
+_panel_key_file_new_generation (const gchar *filename)
+{
+	guint64 *generation;
+
+	if (_panel_key_file_generations == NULL)
+		_panel_key_file_generations = g_hash_table_new_full (g_str_hash,
+								     g_str_equal,
+								     g_free,
+								     g_free);
+
+	generation = g_new (guint64, 1);
+	*generation = ++_panel_key_file_last_generation;
+	g_hash_table_insert (_panel_key_file_generations,
+			     g_strdup (filename), generation);
+
+	return *generation;
+}
+
+/* Called with the lock held; forgets the generation of the file if it is
+ * the last one, and tells whether it was */
+static gboolean
+_panel_key_file_end_generation (const gchar *filename,
+				guint64      generation)
+{
+	guint64 *current;
+
+	current = g_hash_table_lookup (_panel_key_file_generations, filename);
+	if (current == NULL || *current != generation)
+		return FALSE;
+
+	g_hash_table_remove (_panel_key_file_generations, filename);
+
+	return TRUE;
+}
+
+/* g_file_set_contents() writes to a temporary file renamed over the old
+ * one: the launcher is never seen half written */
+static gboolean
+_panel_key_file_write_data (const gchar  *filename,
+			    const gchar  *data,
+			    gsize         length,
+			    GError      **error)
+{
+	if (!g_file_set_contents (filename, data, length, error))
+		return FALSE;
+
+	_panel_key_file_make_executable (filename);
+
+	return TRUE;
+}
+
+/* FIXME: kill this when bug #309224 is fixed */
+gboolean
+panel_key_file_to_file (GKeyFile     *keyfile,
+			const gchar  *file,
+			GError      **error)
+{
+	gchar    *filename;
+	gchar    *data;
+	gsize     length;
+	gboolean  res;
+
+	g_return_val_if_fail (keyfile != NULL, FALSE);
+	g_return_val_if_fail (file != NULL, FALSE);
+
+	data = panel_key_file_to_data (keyfile, &length, error);
+	if (!data)
+		return FALSE;
 
-	if (write_error) {
-		g_propagate_error (error, write_error);
+	filename = _panel_key_file_get_filename (file, error);
+	if (!filename) {
 		g_free (data);
-		g_free (filename);
 		return FALSE;
 	}
 
-	g_free (data);
+	G_LOCK (panel_key_file_write);
+	_panel_key_file_end_generation (filename,
+					_panel_key_file_new_generation (filename));
+	res = _panel_key_file_write_data (filename, data, length, error);
+	G_UNLOCK (panel_key_file_write);
 
-	_panel_key_file_make_executable (filename);
+	g_free (data);
 	g_free (filename);
 
 	return res;
 }
 
+static void
+_panel_key_file_write_data_thread (GTask        *task,
+				   gpointer      source_object,
+				   gpointer      task_data,
+				   GCancellable *cancellable)
+{
+	GBytes   *data = task_data;
+	gchar    *filename;
+	guint64  *generation;
+	gboolean  written;
+	GError   *error = NULL;
+
+	if (g_task_return_error_if_cancelled (task))
+		return;
+
+	filename = g_object_get_data (G_OBJECT (task), "panel-key-file-filename");
+	generation = g_object_get_data (G_OBJECT (task), "panel-key-file-generation");
+
+	G_LOCK (panel_key_file_write);
+
+	if (!_panel_key_file_end_generation (filename, *generation)) {
+		G_UNLOCK (panel_key_file_write);
+		g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+					 "The file was written again since");
+		return;
+	}
+
+	written = _panel_key_file_write_data (filename,
+					      g_bytes_get_data (data, NULL),
+					      g_bytes_get_size (data),
+					      &error);
+
+	G_UNLOCK (panel_key_file_write);
+
+	if (written)
+		g_task_return_boolean (task, TRUE);
+	else
+		g_task_return_error (task, error);
+}
+
+/**
+ * panel_key_file_write_data_async:
+ * @file: the path or the URI of the file to write
+ * @data: the contents, as returned by panel_key_file_to_data()
+ * @cancellable: a #GCancellable, or %NULL
+ * @callback: called once the file is written
+ * @user_data: data for @callback
+ *
+ * Writes @data like panel_key_file_to_file() does, in a worker thread:
+ * a slow home directory does not block the caller. The write is skipped,
+ * with %G_IO_ERROR_CANCELLED, if the file is written again before it
+ * starts, so the older contents never replace the newer ones.
+ */
+void
+panel_key_file_write_data_async (const gchar         *file,
+				 GBytes              *data,
+				 GCancellable        *cancellable,
+				 GAsyncReadyCallback  callback,
+				 gpointer             user_data)
+{
+	GTask   *task;
+	gchar   *filename;
+	guint64 *generation;
+	GError  *error = NULL;
+
+	g_return_if_fail (file != NULL);
+	g_return_if_fail (data != NULL);
+
+	task = g_task_new (NULL, cancellable, callback, user_data);
+	g_task_set_source_tag (task, panel_key_file_write_data_async);
+
+	filename = _panel_key_file_get_filename (file, &error);
+	if (!filename) {
+		g_task_return_error (task, error);
+		g_object_unref (task);
+		return;
+	}
+
+	generation = g_new (guint64, 1);
+	G_LOCK (panel_key_file_write);
+	*generation = _panel_key_file_new_generation (filename);
+	G_UNLOCK (panel_key_file_write);
+
+	g_object_set_data_full (G_OBJECT (task), "panel-key-file-generation",
+				generation, g_free);
+	g_object_set_data_full (G_OBJECT (task), "panel-key-file-filename",
+				filename, g_free);
+	g_task_set_task_data (task, g_bytes_ref (data),
+			      (GDestroyNotify) g_bytes_unref);
+
+	g_task_run_in_thread (task, _panel_key_file_write_data_thread);
+	g_object_unref (task);
+}
+
+gboolean
+panel_key_file_write_data_finish (GAsyncResult  *result,
+				  GError       **error)
+{
+	g_return_val_if_fail (g_task_is_valid (result, NULL), FALSE);
+
+	return g_task_propagate_boolean (G_TASK (result), error);
+}
+
 gboolean
 panel_key_file_load_from_uri (GKeyFile       *keyfile,
 			      const gchar    *uri,
@@ -29,6 +29,7 @@
 #define PANEL_KEYFILE_H
 
 #include <glib.h>
+#include <gio/gio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -38,6 +39,16 @@ GKeyFile *panel_key_file_new_desktop  (void);
 gboolean  panel_key_file_to_file      (GKeyFile       *keyfile,
 				       const gchar    *file,
 				       GError        **error);
+gchar    *panel_key_file_to_data      (GKeyFile       *keyfile,
+				       gsize          *length,
+				       GError        **error);
+void      panel_key_file_write_data_async  (const gchar         *file,
+					    GBytes              *data,
+					    GCancellable        *cancellable,
+					    GAsyncReadyCallback  callback,
+					    gpointer             user_data);
+gboolean  panel_key_file_write_data_finish (GAsyncResult        *result,
+					    GError             **error);
 gboolean panel_key_file_load_from_uri (GKeyFile       *keyfile,
 				       const gchar    *uri,
 				       GKeyFileFlags   flags,
@@ -0,0 +1,600 @@
+/*
+ * panel-launch-stats.c: opt-in statistics on application start up times
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * For each launch, the time from the activation to the spawn of the
+ * process, to the end of its startup notification and to the mapping of
+ * its first window is measured. The last samples of each application are
+ * kept in memory and their percentiles written, in milliseconds, to the
+ * key file named by MATE_PANEL_LAUNCH_STATS after each launch.
+ *
+ * The end of the startup notification and the first window are only
+ * known on X11: they come from the _NET_STARTUP_INFO messages and from
+ * _NET_CLIENT_LIST, matched with the startup id and the pid.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include <glib.h>
+#include <gdk/gdk.h>
+
+#ifdef HAVE_X11
+#include <gdk/gdkx.h>
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#endif
+
+#include "panel-cleanup.h"
+#include "panel-trace.h"
+
+#include "panel-launch-stats.h"
+
+/* give up on the steps that did not happen after that many seconds */
+#define PANEL_LAUNCH_STATS_TIMEOUT 30
+
+/* samples kept per application and step */
+#define PANEL_LAUNCH_STATS_SAMPLES 200
+
+struct _PanelLaunchStats {
+	char   *name;
+	char   *startup_id;
+	GPid    pid;
+
+	gint64  began;
+	gint64  spawned;
+	gint64  startup_done;
+	gint64  window_mapped;
+
+	guint   timeout_id;
+};
+
+typedef struct {
+	guint   launches;
+	GArray *spawn;
+	GArray *startup;
+	GArray *window;
+} PanelLaunchSamples;
+
+static gboolean    panel_launch_stats_initialized = FALSE;
+static char       *panel_launch_stats_filename = NULL;
+static GHashTable *panel_launch_stats_samples = NULL;
+static GList      *panel_launch_stats_pending = NULL;
+
+#ifdef HAVE_X11
+static Atom        atom_net_startup_info_begin;
+static Atom        atom_net_startup_info;
+static Atom        atom_net_client_list;
+static Atom        atom_net_wm_pid;
+static Atom        atom_net_startup_id;
+static Atom        atom_utf8_string;
+
+/* startup messages come in chunks of 20 bytes, per sending window */
+static GHashTable *startup_messages = NULL;
+static GHashTable *known_clients = NULL;
+#endif
+
+static void
+panel_launch_samples_free (PanelLaunchSamples *samples)
+{
+	g_array_free (samples->spawn, TRUE);
+	g_array_free (samples->startup, TRUE);
+	g_array_free (samples->window, TRUE);
+	g_free (samples);
+}
+
+static void
+panel_launch_stats_free (PanelLaunchStats *stats)
+{
+	if (stats->timeout_id)
+		g_source_remove (stats->timeout_id);
+
+	g_free (stats->name);
+	g_free (stats->startup_id);
+	g_free (stats);
+}
+
+static void
+panel_launch_stats_cleanup (gpointer data)
+{
+	g_list_free_full (panel_launch_stats_pending,
+			  (GDestroyNotify) panel_launch_stats_free);
+	panel_launch_stats_pending = NULL;
+
+	g_clear_pointer (&panel_launch_stats_samples, g_hash_table_destroy);
+	g_clear_pointer (&panel_launch_stats_filename, g_free);
+
+#ifdef HAVE_X11
+	g_clear_pointer (&startup_messages, g_hash_table_destroy);
+	g_clear_pointer (&known_clients, g_hash_table_destroy);
+#endif
+}
+
+static void
+panel_launch_samples_add (GArray *array,
+			  gint64  from,
+			  gint64  to)
+{
+	guint ms;
+
+	if (!from || !to)
+		return;
+
+	if (array->len >= PANEL_LAUNCH_STATS_SAMPLES)
+		g_array_remove_index (array, 0);
+
+	ms = (guint) ((to - from) / 1000);
+	g_array_append_val (array, ms);
+}
+
+static int
+compare_samples (gconstpointer a,
+		 gconstpointer b)
+{
+	guint ua = *(const guint *) a;
+	guint ub = *(const guint *) b;
+
+	return ua < ub ? -1 : (ua > ub ? 1 : 0);
+}
+
+static void
+panel_launch_samples_set_percentiles (GKeyFile   *keyfile,
+				      const char *group,
+				      const char *key,
+				      GArray     *array)
+{
+	GArray *sorted;
+	int     percentiles[3];
+
+	if (array->len == 0)
+		return;
+
+	sorted = g_array_sized_new (FALSE, FALSE, sizeof (guint), array->len);
+	g_array_append_vals (sorted, array->data, array->len);
+	g_array_sort (sorted, compare_samples);
+
+	percentiles[0] = g_array_index (sorted, guint, (sorted->len - 1) * 50 / 100);
+	percentiles[1] = g_array_index (sorted, guint, (sorted->len - 1) * 90 / 100);
+	percentiles[2] = g_array_index (sorted, guint, (sorted->len - 1) * 99 / 100);
+
+	g_key_file_set_integer_list (keyfile, group, key, percentiles, 3);
+
+	g_array_free (sorted, TRUE);
+}
+
+static void
+panel_launch_stats_write (void)
+{
+	GHashTableIter  iter;
+	gpointer        key, value;
+	GKeyFile       *keyfile;
+	GError         *error = NULL;
+
+	keyfile = g_key_file_new ();
+
+	g_key_file_set_comment (keyfile, NULL, NULL,
+				" p50;p90;p99 in milliseconds, from the activation"
+				" to the spawn, to the end of the startup"
+				" notification and to the first window",
+				NULL);
+
+	g_hash_table_iter_init (&iter, panel_launch_stats_samples);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		PanelLaunchSamples *samples = value;
+		const char         *group = key;
+
+		g_key_file_set_integer (keyfile, group, "Launches",
+					samples->launches);
+		panel_launch_samples_set_percentiles (keyfile, group, "Spawn",
+						      samples->spawn);
+		panel_launch_samples_set_percentiles (keyfile, group, "StartupNotification",
+						      samples->startup);
+		panel_launch_samples_set_percentiles (keyfile, group, "FirstWindow",
+						      samples->window);
+	}
+
+	if (!g_key_file_save_to_file (keyfile, panel_launch_stats_filename, &error)) {
+		g_warning ("Cannot write launch statistics to '%s': %s",
+			   panel_launch_stats_filename, error->message);
+		g_error_free (error);
+	}
+
+	g_key_file_free (keyfile);
+}
+
+static void
+panel_launch_stats_finish (PanelLaunchStats *stats)
+{
+	PanelLaunchSamples *samples;
+
+	panel_launch_stats_pending = g_list_remove (panel_launch_stats_pending,
+						    stats);
+
+	panel_trace_async_end ("launch", stats->name, stats);
+
+	samples = g_hash_table_lookup (panel_launch_stats_samples, stats->name);
+	if (!samples) {
+		samples = g_new0 (PanelLaunchSamples, 1);
+		samples->spawn = g_array_new (FALSE, FALSE, sizeof (guint));
+		samples->startup = g_array_new (FALSE, FALSE, sizeof (guint));
+		samples->window = g_array_new (FALSE, FALSE, sizeof (guint));
+		g_hash_table_insert (panel_launch_stats_samples,
+				     g_strdup (stats->name), samples);
+	}
+
+	samples->launches++;
+	panel_launch_samples_add (samples->spawn, stats->began, stats->spawned);
+	panel_launch_samples_add (samples->startup, stats->began, stats->startup_done);
+	panel_launch_samples_add (samples->window, stats->began, stats->window_mapped);
+
+	panel_launch_stats_free (stats);
+
+	panel_launch_stats_write ();
+}
+
+static void
+panel_launch_stats_check_done (PanelLaunchStats *stats)
+{
+	if (!stats->window_mapped)
+		return;
+	if (stats->startup_id && !stats->startup_done)
+		return;
+
+	panel_launch_stats_finish (stats);
+}
+
+static gboolean
+panel_launch_stats_timeout (PanelLaunchStats *stats)
+{
+	stats->timeout_id = 0;
+	panel_launch_stats_finish (stats);
+
+	return G_SOURCE_REMOVE;
+}
+
+#ifdef HAVE_X11
+static void
+startup_message_free (GString *message)
+{
+	g_string_free (message, TRUE);
+}
+
+static PanelLaunchStats *
+find_pending (GPid        pid,
+	      const char *startup_id)
+{
+	GList *l;
+
+	for (l = panel_launch_stats_pending; l; l = l->next) {
+		PanelLaunchStats *stats = l->data;
+
+		if (pid && stats->pid == pid)
+			return stats;
+		if (startup_id && g_strcmp0 (stats->startup_id, startup_id) == 0)
+			return stats;
+	}
+
+	return NULL;
+}
+
+/* the ID of a "remove: ID=..." message, with its quoting undone */
+static char *
+parse_startup_message_id (const char *message)
+{
+	const char *p;
+	GString    *id;
+	gboolean    quoted;
+
+	if (!g_str_has_prefix (message, "remove:"))
+		return NULL;
+
+	p = strstr (message, " ID=");
+	if (!p)
+		return NULL;
+
+	id = g_string_new (NULL);
+	quoted = FALSE;
+
+	for (p += strlen (" ID="); *p; p++) {
+		if (*p == '"')
+			quoted = !quoted;
+		else if (*p == '\\' && p[1])
+			g_string_append_c (id, *++p);
+		else if (*p == ' ' && !quoted)
+			break;
+		else
+			g_string_append_c (id, *p);
+	}
+
+	return g_string_free (id, FALSE);
+}
+
+static void
+handle_startup_message (XClientMessageEvent *xclient)
+{
+	GString          *message;
+	gpointer          key = GSIZE_TO_POINTER (xclient->window);
+	int               i;
+
+	message = g_hash_table_lookup (startup_messages, key);
+
+	if (xclient->message_type == atom_net_startup_info_begin || !message) {
+		message = g_string_new (NULL);
+		g_hash_table_replace (startup_messages, key, message);
+	}
+
+	for (i = 0; i < 20; i++) {
+		char             *id;
+		PanelLaunchStats *stats;
+
+		if (xclient->data.b[i] != '\0') {
+			g_string_append_c (message, xclient->data.b[i]);
+			continue;
+		}
+
+		id = parse_startup_message_id (message->str);
+		stats = id ? find_pending (0, id) : NULL;
+		if (stats && !stats->startup_done) {
+			stats->startup_done = g_get_monotonic_time ();
+			panel_launch_stats_check_done (stats);
+		}
+		g_free (id);
+
+		g_hash_table_remove (startup_messages, key);
+		break;
+	}
+}
+
+static gboolean
+get_window_property (Display        *xdisplay,
+		     Window          xwindow,
+		     Atom            property,
+		     Atom            type,
+		     int             format,
+		     unsigned long  *n_items,
+		     guchar        **data)
+{
+	Atom          actual_type;
+	int           actual_format;
+	unsigned long bytes_after;
+	int           result;
+
+	*data = NULL;
+
+	result = XGetWindowProperty (xdisplay, xwindow, property,
+				     0, G_MAXLONG, False, type,
+				     &actual_type, &actual_format,
+				     n_items, &bytes_after, data);
+
+	if (result != Success || actual_type != type ||
+	    actual_format != format) {
+		if (*data)
+			XFree (*data);
+		*data = NULL;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void
+handle_new_client (GdkDisplay *display,
+		   Window      xwindow)
+{
+	Display          *xdisplay = GDK_DISPLAY_XDISPLAY (display);
+	PanelLaunchStats *stats;
+	unsigned long     n_items;
+	guchar           *data;
+	GPid              pid = 0;
+	char             *startup_id = NULL;
+
+	gdk_x11_display_error_trap_push (display);
+
+	if (get_window_property (xdisplay, xwindow, atom_net_wm_pid,
+				 XA_CARDINAL, 32, &n_items, &data)) {
+		if (n_items > 0)
+			pid = (GPid) ((unsigned long *) data)[0];
+		XFree (data);
+	}
+
+	if (get_window_property (xdisplay, xwindow, atom_net_startup_id,
+				 atom_utf8_string, 8, &n_items, &data)) {
+		startup_id = g_strndup ((char *) data, n_items);
+		XFree (data);
+	}
+
+	gdk_x11_display_error_trap_pop_ignored (display);
+
+	stats = find_pending (pid, startup_id);
+	if (stats && !stats->window_mapped) {
+		stats->window_mapped = g_get_monotonic_time ();
+		panel_launch_stats_check_done (stats);
+	}
+
+	g_free (startup_id);
+}
+
+static void
+update_client_list (GdkDisplay *display,
+		    gboolean    initial)
+{
+	Display       *xdisplay = GDK_DISPLAY_XDISPLAY (display);
+	GHashTable    *clients;
+	unsigned long  n_items;
+	unsigned long  i;
+	guchar        *data;
+	gboolean       result;
+
+	gdk_x11_display_error_trap_push (display);
+	result = get_window_property (xdisplay, DefaultRootWindow (xdisplay),
+				      atom_net_client_list, XA_WINDOW, 32,
+				      &n_items, &data);
+	gdk_x11_display_error_trap_pop_ignored (display);
+
+	if (!result)
+		return;
+
+	clients = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	for (i = 0; i < n_items; i++) {
+		Window xwindow = ((Window *) data)[i];
+
+		g_hash_table_add (clients, GSIZE_TO_POINTER (xwindow));
+
+		if (!initial && panel_launch_stats_pending &&
+		    !g_hash_table_contains (known_clients, GSIZE_TO_POINTER (xwindow)))
+			handle_new_client (display, xwindow);
+	}
+
+	XFree (data);
+
+	g_hash_table_destroy (known_clients);
+	known_clients = clients;
+}
+
+static GdkFilterReturn
+panel_launch_stats_filter (GdkXEvent *gdk_xevent,
+			   GdkEvent  *event,
+			   gpointer   data)
+{
+	XEvent *xevent = (XEvent *) gdk_xevent;
+
+	if (xevent->type == ClientMessage &&
+	    (xevent->xclient.message_type == atom_net_startup_info_begin ||
+	     xevent->xclient.message_type == atom_net_startup_info) &&
+	    xevent->xclient.format == 8)
+		handle_startup_message (&xevent->xclient);
+	else if (xevent->type == PropertyNotify &&
+		 xevent->xproperty.atom == atom_net_client_list)
+		update_client_list (gdk_display_get_default (), FALSE);
+
+	return GDK_FILTER_CONTINUE;
+}
+
+static void
+panel_launch_stats_init_x11 (void)
+{
+	GdkDisplay *display;
+	GdkWindow  *root;
+	Display    *xdisplay;
+
+	display = gdk_display_get_default ();
+	if (!GDK_IS_X11_DISPLAY (display))
+		return;
+
+	xdisplay = GDK_DISPLAY_XDISPLAY (display);
+
+	atom_net_startup_info_begin = XInternAtom (xdisplay, "_NET_STARTUP_INFO_BEGIN", False);
+	atom_net_startup_info       = XInternAtom (xdisplay, "_NET_STARTUP_INFO", False);
+	atom_net_client_list        = XInternAtom (xdisplay, "_NET_CLIENT_LIST", False);
+	atom_net_wm_pid             = XInternAtom (xdisplay, "_NET_WM_PID", False);
+	atom_net_startup_id         = XInternAtom (xdisplay, "_NET_STARTUP_ID", False);
+	atom_utf8_string            = XInternAtom (xdisplay, "UTF8_STRING", False);
+
+	startup_messages = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+						  NULL, (GDestroyNotify) startup_message_free);
+	known_clients = g_hash_table_new (g_direct_hash, g_direct_equal);
+	update_client_list (display, TRUE);
+
+	/* startup messages are sent to the root window with this mask */
+	root = gdk_screen_get_root_window (gdk_display_get_default_screen (display));
+	gdk_window_set_events (root,
+			       gdk_window_get_events (root) | GDK_PROPERTY_CHANGE_MASK);
+	gdk_window_add_filter (root, panel_launch_stats_filter, NULL);
+}
+#endif /* HAVE_X11 */
+
+static gboolean
+panel_launch_stats_init (void)
+{
+	const char *filename;
+
+	if (panel_launch_stats_initialized)
+		return panel_launch_stats_filename != NULL;
+
+	panel_launch_stats_initialized = TRUE;
+
+	filename = g_getenv (PANEL_LAUNCH_STATS_ENV);
+	if (!filename || !filename[0])
+		return FALSE;
+
+	panel_launch_stats_filename = g_strdup (filename);
+	panel_launch_stats_samples = g_hash_table_new_full (g_str_hash, g_str_equal,
+							    g_free,
+							    (GDestroyNotify) panel_launch_samples_free);
+
+#ifdef HAVE_X11
+	panel_launch_stats_init_x11 ();
+#endif
+
+	panel_cleanup_register_memory (panel_launch_stats_cleanup, NULL);
+
+	return TRUE;
+}
+
+/* Returns NULL when the statistics are disabled; all the functions
+ * accept NULL. */
+PanelLaunchStats *
+panel_launch_stats_begin (const char *name)
+{
+	PanelLaunchStats *stats;
+
+	if (!panel_launch_stats_init ())
+		return NULL;
+
+	stats = g_new0 (PanelLaunchStats, 1);
+	stats->name = g_strdup (name ? name : "unknown");
+	stats->began = g_get_monotonic_time ();
+
+	panel_trace_async_begin ("launch", stats->name, stats);
+
+	return stats;
+}
+
+void
+panel_launch_stats_spawned (PanelLaunchStats *stats,
+			    GPid              pid,
+			    const char       *startup_id)
+{
+	if (!stats)
+		return;
+
+	stats->spawned = g_get_monotonic_time ();
+	stats->pid = pid;
+	stats->startup_id = g_strdup (startup_id);
+
+	panel_launch_stats_pending = g_list_prepend (panel_launch_stats_pending,
+						     stats);
+	stats->timeout_id = g_timeout_add_seconds (PANEL_LAUNCH_STATS_TIMEOUT,
+						   (GSourceFunc) panel_launch_stats_timeout,
+						   stats);
+}
+
+void
+panel_launch_stats_failed (PanelLaunchStats *stats)
+{
+	if (!stats)
+		return;
+
+	panel_trace_async_end ("launch", stats->name, stats);
+	panel_launch_stats_free (stats);
+}
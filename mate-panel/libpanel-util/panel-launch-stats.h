@@ -0,0 +1,47 @@
+/*
+ * panel-launch-stats.h: opt-in statistics on application start up times
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef PANEL_LAUNCH_STATS_H
+#define PANEL_LAUNCH_STATS_H
+
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Name of the environment variable giving the file the statistics are
+ * written to; nothing is measured when it is not set */
+#define PANEL_LAUNCH_STATS_ENV "MATE_PANEL_LAUNCH_STATS"
+
+typedef struct _PanelLaunchStats PanelLaunchStats;
+
+PanelLaunchStats *panel_launch_stats_begin   (const char       *name);
+void              panel_launch_stats_spawned (PanelLaunchStats *stats,
+					      GPid              pid,
+					      const char       *startup_id);
+void              panel_launch_stats_failed  (PanelLaunchStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PANEL_LAUNCH_STATS_H */
@@ -23,6 +23,10 @@
  *	Vincent Untz <vuntz@gnome.org>
  */
 
+#include <config.h>
+
+#include <string.h>
+
 #include <glib/gi18n.h>
 #include <gio/gio.h>
 #include <gio/gdesktopappinfo.h>
@@ -30,8 +34,14 @@
 #include <gdk/gdk.h>
 #include <gtk/gtk.h>
 
+#ifdef HAVE_X11
+#include <gdk/gdkx.h>
+#endif
+
 #include "panel-error.h"
 #include "panel-glib.h"
+#include "panel-launch-stats.h"
+#include "panel-spawn.h"
 
 #include "panel-launch.h"
 
@@ -95,6 +105,95 @@ gather_pid_callback (GDesktopAppInfo   *gapp,
 	g_child_watch_add (pid, dummy_child_watch, NULL);
 }
 
+static void
+launched_callback (GAppLaunchContext  *context,
+		   GAppInfo           *info,
+		   GVariant           *platform_data,
+		   PanelLaunchStats  **stats)
+{
+	gint32      pid = 0;
+	const char *startup_id = NULL;
+
+	/* only the first process of the launch is followed */
+	if (!*stats)
+		return;
+
+	g_variant_lookup (platform_data, "pid", "i", &pid);
+	g_variant_lookup (platform_data, "startup-notification-id", "&s", &startup_id);
+
+	panel_launch_stats_spawned (*stats, (GPid) pid, startup_id);
+	*stats = NULL;
+}
+
+static gboolean
+_panel_app_info_launch_uris_as_manager (GDesktopAppInfo    *appinfo,
+					GList              *uris,
+					GAppLaunchContext  *context,
+					GError            **error)
+{
+	return g_desktop_app_info_launch_uris_as_manager (appinfo, uris,
+							  context,
+							  G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
+							  NULL, NULL, gather_pid_callback, appinfo,
+							  error);
+}
+
+/* Whether all the URIs go to one process: the command line takes a list
+ * of them, or they are sent over D-Bus. Otherwise there is one process per
+ * URI, as the desktop entry specification says. */
+static gboolean
+_panel_app_info_opens_uris_at_once (GDesktopAppInfo *appinfo)
+{
+	const char *commandline;
+
+	if (g_desktop_app_info_get_boolean (appinfo, "DBusActivatable"))
+		return TRUE;
+
+	commandline = g_app_info_get_commandline (G_APP_INFO (appinfo));
+
+	return (commandline == NULL ||
+		strstr (commandline, "%F") != NULL ||
+		strstr (commandline, "%U") != NULL);
+}
+
+/* Launches @uris one process each, with one startup notification for
+ * them all: it is given to the first one only, so that dropping many
+ * files does not start as many busy cursors. */
+static gboolean
+_panel_app_info_launch_uris_one_by_one (GDesktopAppInfo    *appinfo,
+					GList              *uris,
+					GdkScreen          *screen,
+					GAppLaunchContext  *context,
+					GError            **error)
+{
+	GAppLaunchContext *quiet_context;
+	GList             *first;
+	gboolean           retval;
+
+	first = g_list_prepend (NULL, uris->data);
+	retval = _panel_app_info_launch_uris_as_manager (appinfo, first,
+							 context, error);
+	g_list_free (first);
+
+	if (!retval)
+		return FALSE;
+
+	/* no startup notification, but the same display */
+	quiet_context = g_app_launch_context_new ();
+#ifdef HAVE_X11
+	if (GDK_IS_X11_DISPLAY (gdk_screen_get_display (screen)))
+		g_app_launch_context_setenv (quiet_context, "DISPLAY",
+					     gdk_display_get_name (gdk_screen_get_display (screen)));
+#endif
+
+	retval = _panel_app_info_launch_uris_as_manager (appinfo, uris->next,
+							 quiet_context, error);
+
+	g_object_unref (quiet_context);
+
+	return retval;
+}
+
 gboolean
 panel_app_info_launch_uris (GDesktopAppInfo   *appinfo,
 			    GList      *uris,
@@ -106,23 +205,33 @@ panel_app_info_launch_uris (GDesktopAppInfo   *appinfo,
 	GdkAppLaunchContext *context;
 	GError              *local_error;
 	gboolean             retval;
+	PanelLaunchStats    *stats;
 
 	g_return_val_if_fail (G_IS_DESKTOP_APP_INFO (appinfo), FALSE);
 	g_return_val_if_fail (GDK_IS_SCREEN (screen), FALSE);
 	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
+	stats = panel_launch_stats_begin (g_app_info_get_name (G_APP_INFO (appinfo)));
+
 	GdkDisplay *display = gdk_display_get_default ();
 	context = gdk_display_get_app_launch_context (display);
 	gdk_app_launch_context_set_screen (context, screen);
 	gdk_app_launch_context_set_timestamp (context, timestamp);
 
+	if (stats)
+		g_signal_connect (context, "launched",
+				  G_CALLBACK (launched_callback), &stats);
+
 	local_error = NULL;
-	if (action == NULL) {
-		retval = g_desktop_app_info_launch_uris_as_manager (appinfo, uris,
-						   G_APP_LAUNCH_CONTEXT (context),
-						   G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
-						   NULL, NULL, gather_pid_callback, appinfo,
-						   &local_error);
+	if (action == NULL && uris && uris->next &&
+	    !_panel_app_info_opens_uris_at_once (appinfo)) {
+		retval = _panel_app_info_launch_uris_one_by_one (appinfo, uris, screen,
+								 G_APP_LAUNCH_CONTEXT (context),
+								 &local_error);
+	} else if (action == NULL) {
+		retval = _panel_app_info_launch_uris_as_manager (appinfo, uris,
+								 G_APP_LAUNCH_CONTEXT (context),
+								 &local_error);
 	} else {
 		g_desktop_app_info_launch_action (appinfo, action, G_APP_LAUNCH_CONTEXT (context));
 		retval = TRUE;
@@ -130,8 +239,13 @@ panel_app_info_launch_uris (GDesktopAppInfo   *appinfo,
 
 	g_object_unref (context);
 
-	if ((local_error == NULL) && (retval == TRUE))
+	if ((local_error == NULL) && (retval == TRUE)) {
+		/* D-Bus activation does not tell the pid */
+		panel_launch_stats_spawned (stats, 0, NULL);
 		return TRUE;
+	}
+
+	panel_launch_stats_failed (stats);
 
 	return _panel_launch_handle_error (g_app_info_get_name (G_APP_INFO(appinfo)),
 					   screen, local_error, error);
@@ -228,15 +342,6 @@ panel_launch_desktop_file (const char  *desktop_file,
 	return retval;
 }
 
-/*
- * Set the DISPLAY variable, to be use by g_spawn_async.
- */
-static void
-set_environment (gpointer display)
-{
-	g_setenv ("DISPLAY", display, TRUE);
-}
-
 gboolean
 panel_launch_desktop_file_with_fallback (const char  *desktop_file,
 					 const char  *fallback_exec,
@@ -246,9 +351,8 @@ panel_launch_desktop_file_with_fallback (const char  *desktop_file,
 	char       *argv[2] = { (char *) fallback_exec, NULL };
 	GError     *local_error;
 	gboolean    retval;
-	GPid        pid;
 	GdkDisplay *display;
-	char       *display_name;
+	char      **envp;
 
 	g_return_val_if_fail (desktop_file != NULL, FALSE);
 	g_return_val_if_fail (fallback_exec != NULL, FALSE);
@@ -266,20 +370,13 @@ panel_launch_desktop_file_with_fallback (const char  *desktop_file,
 	}
 
 	display = gdk_screen_get_display (screen);
-	display_name = g_strdup (gdk_display_get_name (display));
-	retval = g_spawn_async (NULL, /* working directory */
-				argv,
-				NULL, /* envp */
-				G_SPAWN_SEARCH_PATH,
-				set_environment,
-				&display_name,
-				&pid,
-				&local_error);
-				g_free (display_name);
-
-        if (local_error == NULL && retval == TRUE) {
-		g_child_watch_add (pid, dummy_child_watch, NULL);
-		}
+	envp = g_environ_setenv (g_get_environ (), "DISPLAY",
+				 gdk_display_get_name (display), TRUE);
+	retval = panel_spawn_async (NULL, /* working directory */
+				    argv, envp, NULL, &local_error);
+	g_strfreev (envp);
+
+	if (retval)
 		return TRUE;
 
 	return _panel_launch_handle_error (fallback_exec,
@@ -1,5 +1,5 @@
 /*
- * panel-list.c: GList & GSList extensions
+ * panel-list.c: GSList & GPtrArray extensions
  *
  * Copyright (C) 2008 Novell, Inc.
  * Copyright (C) 2012-2021 MATE Developers
@@ -27,187 +27,174 @@
  *	Vincent Untz <vuntz@gnome.org>
  */
 
+#include <string.h>
+
 #include <glib.h>
 
 #include "panel-list.h"
 
-GList *
-panel_g_list_insert_before (GList *list,
-			    GList *sibling,
-			    GList *link)
+/* Removes the duplicates from list, keeping the last of them: sorting a
+ * copy finds them, and they are all unlinked in one walk of the list. */
+GSList *
+panel_g_slist_make_unique (GSList       *list,
+			   GCompareFunc  compare,
+			   gboolean      free_data)
 {
-	if (!list) {
-		g_return_val_if_fail (sibling == NULL, list);
-		return link;
-	} else if (sibling) {
-		if (sibling->prev) {
-			link->prev = sibling->prev;
-			link->prev->next = link;
-			link->next = sibling;
-			sibling->prev = link;
-			return list;
-		} else {
-			link->next = sibling;
-			sibling->prev = link;
-			g_return_val_if_fail (sibling == list, link);
-			return link;
-		}
-	} else {
-		GList *last;
+	GHashTable *duplicates;
+	GSList     *sorted, *l;
 
-		last = list;
-		while (last->next)
-			last = last->next;
+	g_return_val_if_fail (compare != NULL, list);
 
-		last->next = link;
-		link->prev = last;
-		return list;
-	}
-}
+	if (!list)
+		return NULL;
 
-GList *
-panel_g_list_insert_after (GList *list,
-			   GList *sibling,
-			   GList *link)
-{
-	if (!list) {
-		g_return_val_if_fail (sibling == NULL, link);
-		return link;
-	} else if (sibling) {
-		if (sibling->next) {
-			link->next = sibling->next;
-			link->next->prev = link;
-			link->prev = sibling;
-			sibling->next = link;
-			return list;
-		} else {
-			sibling->next = link;
-			link->prev = sibling;
-			return list;
-		}
+	sorted = g_slist_copy (list);
+	sorted = g_slist_sort (sorted, compare);
+
+	duplicates = g_hash_table_new (NULL, NULL);
 
-	} else {
-		link->next = list;
-		list->prev = link;
-		return link;
+	for (l = sorted; l; l = l->next) {
+		GSList *next;
+
+		next = l->next;
+		if (l->data && next && next->data)
+			if (!compare (l->data, next->data))
+				g_hash_table_add (duplicates, l->data);
 	}
-}
 
-GList *
-panel_g_list_swap_next (GList *list,
-			GList *dl)
-{
-	GList *t;
+	g_slist_free (sorted);
 
-	if (!dl)
-		return list;
+	if (g_hash_table_size (duplicates) > 0) {
+		l = list;
+		while (l) {
+			GSList *next = l->next;
 
-	if (!dl->next)
-		return list;
+			if (g_hash_table_contains (duplicates, l->data)) {
+				if (free_data)
+					g_free (l->data);
+				list = g_slist_delete_link (list, l);
+			}
 
-	if (dl->prev)
-		dl->prev->next = dl->next;
-	t = dl->prev;
-	dl->prev = dl->next;
-	dl->next->prev = t;
-	if (dl->next->next)
-		dl->next->next->prev = dl;
-	t = dl->next->next;
-	dl->next->next = dl;
-	dl->next = t;
+			l = next;
+		}
+	}
 
-	if (list == dl)
-		return dl->prev;
+	g_hash_table_destroy (duplicates);
 
 	return list;
 }
 
-GList *
-panel_g_list_swap_prev (GList *list,
-			GList *dl)
-{
-	GList *t;
-
-	if (!dl)
-		return list;
-
-	if (!dl->prev)
-		return list;
+/*
+ * The GPtrArray helpers below keep an array sorted by compare, which is
+ * given the items themselves, like for a GList, and not pointers to them
+ * like g_ptr_array_sort() does. Finding where an item goes is a binary
+ * search, and moving it is one memmove().
+ */
 
-	if (dl->next)
-		dl->next->prev = dl->prev;
-	t = dl->next;
-	dl->next = dl->prev;
-	dl->prev->next = t;
-	if (dl->prev->prev)
-		dl->prev->prev->next = dl;
-	t = dl->prev->prev;
-	dl->prev->prev = dl;
-	dl->prev = t;
+/* The index of the first item in [low, high) that is not before data */
+static guint
+panel_g_ptr_array_lower_bound_range (GPtrArray     *array,
+				     gconstpointer  data,
+				     GCompareFunc   compare,
+				     guint          low,
+				     guint          high)
+{
+	while (low < high) {
+		guint middle = low + (high - low) / 2;
 
-	if (list == dl->next)
-		return dl;
+		if (compare (g_ptr_array_index (array, middle), data) < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
 
-	return list;
+	return low;
 }
 
-/*maybe this should be a glib function?
- it resorts a single item in the list*/
-GList *
-panel_g_list_resort_item (GList        *list,
-			  gpointer      data,
-			  GCompareFunc  func)
+/* The index of the first item in [low, high) that is after data */
+static guint
+panel_g_ptr_array_upper_bound_range (GPtrArray     *array,
+				     gconstpointer  data,
+				     GCompareFunc   compare,
+				     guint          low,
+				     guint          high)
 {
-	GList *dl;
-
-	g_return_val_if_fail (func != NULL, list);
+	while (low < high) {
+		guint middle = low + (high - low) / 2;
 
-	if (!list)
-		return NULL;
-
-	dl = g_list_find (list, data);
-
-	if (dl == NULL)
-		return list;
-
-	while (dl->next &&
-	       (*func)(dl->data, dl->next->data) > 0)
-		list = panel_g_list_swap_next (list, dl);
-	while (dl->prev &&
-	       (*func) (dl->data, dl->prev->data) < 0)
-		list = panel_g_list_swap_prev (list, dl);
+		if (compare (g_ptr_array_index (array, middle), data) <= 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
 
-	return list;
+	return low;
 }
 
-GSList *
-panel_g_slist_make_unique (GSList       *list,
-			   GCompareFunc  compare,
-			   gboolean      free_data)
+guint
+panel_g_ptr_array_lower_bound (GPtrArray     *array,
+			       gconstpointer  data,
+			       GCompareFunc   compare)
 {
-	GSList *sorted, *l;
-
-	g_return_val_if_fail (compare != NULL, list);
+	g_return_val_if_fail (array != NULL, 0);
+	g_return_val_if_fail (compare != NULL, 0);
 
-	if (!list)
-		return NULL;
+	return panel_g_ptr_array_lower_bound_range (array, data, compare,
+						    0, array->len);
+}
 
-	sorted = g_slist_copy (list);
-	sorted = g_slist_sort (sorted, compare);
+/* Inserts data before the items that compare equal to it, and returns
+ * its index */
+guint
+panel_g_ptr_array_insert_sorted (GPtrArray    *array,
+				 gpointer      data,
+				 GCompareFunc  compare)
+{
+	guint index;
 
-	for (l = sorted; l; l = l->next) {
-		GSList *next;
+	g_return_val_if_fail (array != NULL, 0);
+	g_return_val_if_fail (compare != NULL, 0);
 
-		next = l->next;
-		if (l->data && next && next->data)
-			if (!compare (l->data, next->data)) {
-				list = g_slist_remove (list, l->data);
-				if (free_data)
-					g_free (l->data);
-			}
-	}
+	index = panel_g_ptr_array_lower_bound_range (array, data, compare,
+						     0, array->len);
+	g_ptr_array_insert (array, index, data);
 
-	g_slist_free (sorted);
+	return index;
+}
 
-	return list;
+/* Moves the item at index, whose key changed, back to its place in the
+ * otherwise sorted array, and returns its new index. It does not pass the
+ * items equal to it. */
+guint
+panel_g_ptr_array_resort_index (GPtrArray    *array,
+				guint         index,
+				GCompareFunc  compare)
+{
+	gpointer data;
+	guint    to;
+
+	g_return_val_if_fail (array != NULL, index);
+	g_return_val_if_fail (compare != NULL, index);
+	g_return_val_if_fail (index < array->len, index);
+
+	data = g_ptr_array_index (array, index);
+
+	if (index + 1 < array->len &&
+	    compare (data, g_ptr_array_index (array, index + 1)) > 0) {
+		to = panel_g_ptr_array_lower_bound_range (array, data, compare,
+							  index + 1, array->len) - 1;
+		memmove (&array->pdata[index], &array->pdata[index + 1],
+			 (to - index) * sizeof (gpointer));
+	} else if (index > 0 &&
+		   compare (data, g_ptr_array_index (array, index - 1)) < 0) {
+		to = panel_g_ptr_array_upper_bound_range (array, data, compare,
+							  0, index);
+		memmove (&array->pdata[to + 1], &array->pdata[to],
+			 (index - to) * sizeof (gpointer));
+	} else
+		return index;
+
+	array->pdata[to] = data;
+
+	return to;
 }
@@ -1,5 +1,5 @@
 /*
- * panel-list.h: GList & GSList extensions
+ * panel-list.h: GSList & GPtrArray extensions
  *
  * Copyright (C) 2008 Novell, Inc.
  * Copyright (C) 2012-2021 MATE Developers
@@ -32,24 +32,20 @@
 extern "C" {
 #endif
 
-GList *panel_g_list_insert_before (GList        *list,
-				   GList        *sibling,
-				   GList        *link);
-GList *panel_g_list_insert_after  (GList        *list,
-				   GList        *sibling,
-				   GList        *link);
-GList *panel_g_list_swap_next     (GList        *list,
-				   GList        *dl);
-GList *panel_g_list_swap_prev     (GList        *list,
-				   GList        *dl);
-GList *panel_g_list_resort_item   (GList        *list,
-				   gpointer      data,
-				   GCompareFunc  func);
-
 GSList *panel_g_slist_make_unique (GSList       *list,
 				   GCompareFunc  compare,
 				   gboolean      free_data);
 
+guint   panel_g_ptr_array_lower_bound   (GPtrArray     *array,
+					 gconstpointer  data,
+					 GCompareFunc   compare);
+guint   panel_g_ptr_array_insert_sorted (GPtrArray     *array,
+					 gpointer       data,
+					 GCompareFunc   compare);
+guint   panel_g_ptr_array_resort_index  (GPtrArray     *array,
+					 guint          index,
+					 GCompareFunc   compare);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,270 @@
+/*
+ * panel-perf.c: performance counters, exported over D-Bus
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Counters count events, like layout passes or menu builds. Histograms
+ * record values, usually durations in microseconds, in power of two
+ * buckets: bucket 0 holds the values up to 0, bucket i the values from
+ * 2^(i-1) to 2^i - 1, and the last one everything above. Both are
+ * created the first time they are used, and named with static strings.
+ *
+ * Each process has its own set (the panel and each out-of-process applet
+ * factory), exported on its connection to the session bus with the
+ * org.mate.Panel.Perf interface:
+ *
+ *   gdbus call --session --dest org.mate.Panel \
+ *              --object-path /org/mate/Panel \
+ *              --method org.mate.Panel.Perf.GetCounters
+ *
+ * The counters are only updated from the main thread.
+ */
+
+#include <config.h>
+
+#include <gio/gio.h>
+
+#include "panel-perf.h"
+
+#define PANEL_PERF_N_BUCKETS 32
+
+typedef struct {
+	guint64 count;
+	guint64 sum;
+	guint64 max;
+	guint64 buckets [PANEL_PERF_N_BUCKETS];
+} PanelPerfHistogram;
+
+/* name -> guint64 */
+static GHashTable *perf_counters = NULL;
+/* name -> PanelPerfHistogram */
+static GHashTable *perf_histograms = NULL;
+
+/* GetCounters returns the counters, GetHistograms the (count, sum, max,
+ * buckets) of each histogram. Reset sets everything back to 0. */
+static const gchar panel_perf_introspection_xml[] =
+	"<node>"
+	  "<interface name='org.mate.Panel.Perf'>"
+	    "<method name='GetCounters'>"
+	      "<arg name='counters' type='a{st}' direction='out'/>"
+	    "</method>"
+	    "<method name='GetHistograms'>"
+	      "<arg name='histograms' type='a{s(tttat)}' direction='out'/>"
+	    "</method>"
+	    "<method name='Reset'/>"
+	  "</interface>"
+	"</node>";
+
+/**
+ * panel_perf_count:
+ * @name: a static string naming the counter
+ * @delta: what to add to it
+ *
+ * Adds @delta to a counter.
+ */
+void
+panel_perf_count (const char *name,
+		  guint64     delta)
+{
+	guint64 *value;
+
+	g_return_if_fail (name != NULL);
+
+	if (!perf_counters)
+		perf_counters = g_hash_table_new_full (g_str_hash, g_str_equal,
+						       NULL, g_free);
+
+	value = g_hash_table_lookup (perf_counters, name);
+	if (!value) {
+		value = g_new0 (guint64, 1);
+		g_hash_table_insert (perf_counters, (gpointer) name, value);
+	}
+
+	*value += delta;
+}
+
+/**
+ * panel_perf_record:
+ * @name: a static string naming the histogram
+ * @value: the value to record, usually a duration in microseconds
+ *
+ * Records @value in a histogram.
+ */
+void
+panel_perf_record (const char *name,
+		   gint64      value)
+{
+	PanelPerfHistogram *histogram;
+	guint               bucket;
+
+	g_return_if_fail (name != NULL);
+
+	if (!perf_histograms)
+		perf_histograms = g_hash_table_new_full (g_str_hash, g_str_equal,
+							 NULL, g_free);
+
+	histogram = g_hash_table_lookup (perf_histograms, name);
+	if (!histogram) {
+		histogram = g_new0 (PanelPerfHistogram, 1);
+		g_hash_table_insert (perf_histograms, (gpointer) name, histogram);
+	}
+
+	if (value < 0)
+		value = 0;
+
+	bucket = value > 0 ? g_bit_storage ((gulong) value) : 0;
+	if (bucket >= PANEL_PERF_N_BUCKETS)
+		bucket = PANEL_PERF_N_BUCKETS - 1;
+
+	histogram->count++;
+	histogram->sum += value;
+	histogram->max = MAX (histogram->max, (guint64) value);
+	histogram->buckets [bucket]++;
+}
+
+static GVariant *
+panel_perf_get_counters (void)
+{
+	GVariantBuilder builder;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{st}"));
+
+	if (perf_counters) {
+		GHashTableIter iter;
+		gpointer       key, value;
+
+		g_hash_table_iter_init (&iter, perf_counters);
+		while (g_hash_table_iter_next (&iter, &key, &value))
+			g_variant_builder_add (&builder, "{st}",
+					       (const char *) key,
+					       *(guint64 *) value);
+	}
+
+	return g_variant_new ("(a{st})", &builder);
+}
+
+static GVariant *
+panel_perf_get_histograms (void)
+{
+	GVariantBuilder builder;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{s(tttat)}"));
+
+	if (perf_histograms) {
+		GHashTableIter iter;
+		gpointer       key, value;
+
+		g_hash_table_iter_init (&iter, perf_histograms);
+		while (g_hash_table_iter_next (&iter, &key, &value)) {
+			PanelPerfHistogram *histogram = value;
+			GVariant           *buckets;
+
+			buckets = g_variant_new_fixed_array (G_VARIANT_TYPE_UINT64,
+							     histogram->buckets,
+							     PANEL_PERF_N_BUCKETS,
+							     sizeof (guint64));
+			g_variant_builder_add (&builder, "{s(ttt@at)}",
+					       (const char *) key,
+					       histogram->count,
+					       histogram->sum,
+					       histogram->max,
+					       buckets);
+		}
+	}
+
+	return g_variant_new ("(a{s(tttat)})", &builder);
+}
+
+static void
+panel_perf_reset (void)
+{
+	if (perf_counters)
+		g_hash_table_remove_all (perf_counters);
+	if (perf_histograms)
+		g_hash_table_remove_all (perf_histograms);
+}
+
+static void
+panel_perf_method_call (GDBusConnection       *connection,
+			const gchar           *sender,
+			const gchar           *object_path,
+			const gchar           *interface_name,
+			const gchar           *method_name,
+			GVariant              *parameters,
+			GDBusMethodInvocation *invocation,
+			gpointer               user_data)
+{
+	if (g_strcmp0 (method_name, "GetCounters") == 0)
+		g_dbus_method_invocation_return_value (invocation,
+						       panel_perf_get_counters ());
+	else if (g_strcmp0 (method_name, "GetHistograms") == 0)
+		g_dbus_method_invocation_return_value (invocation,
+						       panel_perf_get_histograms ());
+	else if (g_strcmp0 (method_name, "Reset") == 0) {
+		panel_perf_reset ();
+		g_dbus_method_invocation_return_value (invocation, NULL);
+	}
+}
+
+static const GDBusInterfaceVTable panel_perf_interface_vtable = {
+	panel_perf_method_call,
+	NULL,
+	NULL,
+	{ 0 }
+};
+
+/**
+ * panel_perf_register:
+ * @connection: a connection to the session bus
+ * @object_path: where to export the counters
+ *
+ * Exports the counters of the process with the org.mate.Panel.Perf
+ * interface.
+ *
+ * Returns: the registration id, for g_dbus_connection_unregister_object(),
+ * or 0 on failure.
+ */
+guint
+panel_perf_register (GDBusConnection *connection,
+		     const char      *object_path)
+{
+	GDBusNodeInfo *node_info;
+	GError        *error = NULL;
+	guint          registration_id;
+
+	g_return_val_if_fail (G_IS_DBUS_CONNECTION (connection), 0);
+	g_return_val_if_fail (object_path != NULL, 0);
+
+	node_info = g_dbus_node_info_new_for_xml (panel_perf_introspection_xml, NULL);
+	registration_id =
+		g_dbus_connection_register_object (connection,
+						   object_path,
+						   node_info->interfaces[0],
+						   &panel_perf_interface_vtable,
+						   NULL, NULL, &error);
+	if (!registration_id) {
+		g_warning ("Cannot register the performance counters: %s",
+			   error->message);
+		g_error_free (error);
+	}
+	g_dbus_node_info_unref (node_info);
+
+	return registration_id;
+}
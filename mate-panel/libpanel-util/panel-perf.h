@@ -0,0 +1,48 @@
+/*
+ * panel-perf.h: performance counters, exported over D-Bus
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef PANEL_PERF_H
+#define PANEL_PERF_H
+
+#include <gio/gio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Linked into the applet library too, which has its own API for the
+ * applets: not part of its ABI */
+G_GNUC_INTERNAL
+void  panel_perf_count    (const char      *name,
+			   guint64          delta);
+G_GNUC_INTERNAL
+void  panel_perf_record   (const char      *name,
+			   gint64           value);
+
+G_GNUC_INTERNAL
+guint panel_perf_register (GDBusConnection *connection,
+			   const char      *object_path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PANEL_PERF_H */
@@ -0,0 +1,304 @@
+/*
+ * panel-scheduler.c: prioritized, time-budgeted idle work
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * The deferred work of the panel shares one idle source per priority
+ * instead of having one source per job. Each dispatch of a source is a
+ * slice of about 4 ms: the tasks queued at that priority run one after
+ * the other until the slice is spent, and the main loop then gets to
+ * handle input and redraws before the next slice. A task returning
+ * G_SOURCE_CONTINUE goes to the back of its queue, so that a long job
+ * does not starve the other ones. Long jobs can also split themselves
+ * with panel_scheduler_should_yield().
+ *
+ * The tasks have a name, for the traces and for the debug interface of
+ * the panel, which lists the queued work.
+ */
+
+#include <config.h>
+
+#include <glib.h>
+
+#include "panel-perf.h"
+#include "panel-trace.h"
+
+#include "panel-scheduler.h"
+
+#define PANEL_SCHEDULER_SLICE_US 4000
+
+typedef struct {
+	guint                   id;
+	const char             *name;
+	PanelSchedulerPriority  priority;
+
+	GSourceFunc             func;
+	gpointer                data;
+	GDestroyNotify          notify;
+
+	/* in the queue of the priority, NULL while the task runs */
+	GList                  *link;
+	gboolean                removed;
+
+	gint64                  queued_time;
+	guint                   n_runs;
+	gint64                  run_us;
+} PanelSchedulerTask;
+
+typedef struct {
+	GQueue tasks;
+	guint  source_id;
+} PanelSchedulerQueue;
+
+static const int scheduler_source_priorities [PANEL_SCHEDULER_N_PRIORITIES] = {
+	G_PRIORITY_HIGH_IDLE,
+	G_PRIORITY_DEFAULT_IDLE,
+	G_PRIORITY_LOW
+};
+
+static const char *scheduler_priority_names [PANEL_SCHEDULER_N_PRIORITIES] = {
+	"high",
+	"default",
+	"low"
+};
+
+static PanelSchedulerQueue  scheduler_queues [PANEL_SCHEDULER_N_PRIORITIES];
+/* id -> PanelSchedulerTask, until the task is removed */
+static GHashTable          *scheduler_tasks = NULL;
+static guint                scheduler_next_id = 1;
+/* end of the slice being dispatched, 0 outside of a slice */
+static gint64               scheduler_slice_end = 0;
+
+static void
+panel_scheduler_task_free (PanelSchedulerTask *task)
+{
+	if (task->notify)
+		task->notify (task->data);
+
+	g_free (task);
+}
+
+static gboolean
+panel_scheduler_dispatch (gpointer data)
+{
+	PanelSchedulerQueue *queue = data;
+	gint64               previous_slice_end;
+	guint                n_tasks;
+
+	/* a task can run a nested main loop, which dispatches slices too */
+	previous_slice_end = scheduler_slice_end;
+	scheduler_slice_end = g_get_monotonic_time () + PANEL_SCHEDULER_SLICE_US;
+
+	/* the tasks queued when the slice begins run at most once in it: a
+	 * task waiting for something by returning G_SOURCE_CONTINUE does
+	 * not spin for the whole slice */
+	n_tasks = g_queue_get_length (&queue->tasks);
+
+	while (n_tasks-- > 0 && !g_queue_is_empty (&queue->tasks)) {
+		PanelSchedulerTask *task;
+		gboolean            again;
+		gint64              start;
+		gint64              duration;
+
+		task = g_queue_pop_head (&queue->tasks);
+		task->link = NULL;
+
+		panel_trace_begin ("idle", task->name);
+		start = g_get_monotonic_time ();
+
+		again = task->func (task->data);
+
+		duration = g_get_monotonic_time () - start;
+		task->run_us += duration;
+		task->n_runs++;
+		panel_perf_record ("idle-task-us", duration);
+		panel_trace_end ("idle", task->name);
+
+		if (again && !task->removed) {
+			g_queue_push_tail (&queue->tasks, task);
+			task->link = g_queue_peek_tail_link (&queue->tasks);
+		} else {
+			if (!task->removed)
+				g_hash_table_remove (scheduler_tasks,
+						     GUINT_TO_POINTER (task->id));
+			panel_scheduler_task_free (task);
+		}
+
+		if (g_get_monotonic_time () >= scheduler_slice_end)
+			break;
+	}
+
+	scheduler_slice_end = previous_slice_end;
+
+	if (!g_queue_is_empty (&queue->tasks))
+		return G_SOURCE_CONTINUE;
+
+	queue->source_id = 0;
+	return G_SOURCE_REMOVE;
+}
+
+/**
+ * panel_scheduler_add:
+ * @priority: when @func runs, relative to the redraws and the other tasks
+ * @name: a static string naming the task, for debugging
+ * @func: called in the idle time of the main loop, until it returns
+ * %G_SOURCE_REMOVE
+ * @data: data for @func
+ * @notify: called with @data when the task is done or removed
+ *
+ * Queues @func like g_idle_add_full() would, but in a shared idle source
+ * where it gets a part of a time budget.
+ *
+ * Returns: the id of the task, for panel_scheduler_remove(), never 0.
+ */
+guint
+panel_scheduler_add (PanelSchedulerPriority  priority,
+		     const char             *name,
+		     GSourceFunc             func,
+		     gpointer                data,
+		     GDestroyNotify          notify)
+{
+	PanelSchedulerQueue *queue;
+	PanelSchedulerTask  *task;
+
+	g_return_val_if_fail (priority < PANEL_SCHEDULER_N_PRIORITIES, 0);
+	g_return_val_if_fail (func != NULL, 0);
+
+	if (!scheduler_tasks)
+		scheduler_tasks = g_hash_table_new (NULL, NULL);
+
+	task = g_new0 (PanelSchedulerTask, 1);
+	task->id = scheduler_next_id++;
+	/* the ids are kept in guints by the callers, 0 meaning none */
+	if (scheduler_next_id == 0)
+		scheduler_next_id = 1;
+	task->name = name ? name : "unnamed";
+	task->priority = priority;
+	task->func = func;
+	task->data = data;
+	task->notify = notify;
+	task->queued_time = g_get_monotonic_time ();
+
+	queue = &scheduler_queues [priority];
+	g_queue_push_tail (&queue->tasks, task);
+	task->link = g_queue_peek_tail_link (&queue->tasks);
+
+	g_hash_table_insert (scheduler_tasks, GUINT_TO_POINTER (task->id), task);
+
+	if (queue->source_id == 0) {
+		queue->source_id = g_idle_add_full (scheduler_source_priorities [priority],
+						    panel_scheduler_dispatch,
+						    queue, NULL);
+		g_source_set_name_by_id (queue->source_id, "[mate-panel] scheduler");
+	}
+
+	return task->id;
+}
+
+/**
+ * panel_scheduler_remove:
+ * @id: a task id returned by panel_scheduler_add()
+ *
+ * Cancels a task that did not finish yet. A task can remove itself while
+ * it runs: it is then not run again, whatever it returns.
+ */
+void
+panel_scheduler_remove (guint id)
+{
+	PanelSchedulerTask *task;
+
+	if (!scheduler_tasks)
+		return;
+
+	task = g_hash_table_lookup (scheduler_tasks, GUINT_TO_POINTER (id));
+	if (!task)
+		return;
+
+	g_hash_table_remove (scheduler_tasks, GUINT_TO_POINTER (id));
+
+	if (!task->link) {
+		/* running: the dispatch frees it when it returns */
+		task->removed = TRUE;
+		return;
+	}
+
+	g_queue_delete_link (&scheduler_queues [task->priority].tasks, task->link);
+	panel_scheduler_task_free (task);
+}
+
+/**
+ * panel_scheduler_should_yield:
+ *
+ * For a task doing a long job a piece at a time: tells whether the slice
+ * it runs in is spent, and the task should return %G_SOURCE_CONTINUE to
+ * be resumed later. Always %FALSE outside of a task.
+ *
+ * Returns: %TRUE if the task should return.
+ */
+gboolean
+panel_scheduler_should_yield (void)
+{
+	if (scheduler_slice_end == 0)
+		return FALSE;
+
+	return g_get_monotonic_time () >= scheduler_slice_end;
+}
+
+/**
+ * panel_scheduler_get_queued:
+ *
+ * Describes the queued tasks, by priority and in the order they will run:
+ * one (name, stats) entry per task.
+ *
+ * Returns: (transfer floating): a #GVariant of type a(sa{sv})
+ */
+GVariant *
+panel_scheduler_get_queued (void)
+{
+	GVariantBuilder builder;
+	gint64          now;
+	guint           i;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sa{sv})"));
+	now = g_get_monotonic_time ();
+
+	for (i = 0; i < PANEL_SCHEDULER_N_PRIORITIES; i++) {
+		GList *l;
+
+		for (l = scheduler_queues [i].tasks.head; l; l = l->next) {
+			PanelSchedulerTask *task = l->data;
+			GVariantDict        stats;
+
+			g_variant_dict_init (&stats, NULL);
+			g_variant_dict_insert (&stats, "id", "u", task->id);
+			g_variant_dict_insert (&stats, "priority", "s",
+					       scheduler_priority_names [task->priority]);
+			g_variant_dict_insert (&stats, "queued-us", "x",
+					       now - task->queued_time);
+			g_variant_dict_insert (&stats, "runs", "u", task->n_runs);
+			g_variant_dict_insert (&stats, "run-us", "x", task->run_us);
+
+			g_variant_builder_add (&builder, "(s@a{sv})",
+					       task->name, g_variant_dict_end (&stats));
+		}
+	}
+
+	return g_variant_builder_end (&builder);
+}
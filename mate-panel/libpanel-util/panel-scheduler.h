@@ -0,0 +1,53 @@
+/*
+ * panel-scheduler.h: prioritized, time-budgeted idle work
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef PANEL_SCHEDULER_H
+#define PANEL_SCHEDULER_H
+
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	PANEL_SCHEDULER_PRIORITY_HIGH,    /* before redraws */
+	PANEL_SCHEDULER_PRIORITY_DEFAULT, /* after redraws */
+	PANEL_SCHEDULER_PRIORITY_LOW,     /* when nothing else is pending */
+	PANEL_SCHEDULER_N_PRIORITIES
+} PanelSchedulerPriority;
+
+guint     panel_scheduler_add          (PanelSchedulerPriority  priority,
+					const char             *name,
+					GSourceFunc             func,
+					gpointer                data,
+					GDestroyNotify          notify);
+void      panel_scheduler_remove       (guint                   id);
+
+gboolean  panel_scheduler_should_yield (void);
+
+GVariant *panel_scheduler_get_queued   (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PANEL_SCHEDULER_H */
@@ -27,9 +27,22 @@
 #include "panel-cleanup.h"
 #include "panel-session-manager.h"
 
+/* how long the answer of CanShutdown is used before asking again, in the
+ * background: the session manager has no signal for its changes */
+#define PANEL_SESSION_MANAGER_SHUTDOWN_CACHE_US (60 * G_USEC_PER_SEC)
+
 struct _PanelSessionManager {
-	GObject     parent;
-	GDBusProxy *proxy;
+	GObject       parent;
+	GDBusProxy   *proxy;
+
+	gboolean      shutdown_available;
+	gint64        shutdown_checked;   /* 0 until the first answer */
+	GCancellable *shutdown_cancellable; /* set while asking */
+};
+
+enum {
+	PROP_0,
+	PROP_SHUTDOWN_AVAILABLE
 };
 
 G_DEFINE_TYPE (PanelSessionManager, panel_session_manager, G_TYPE_OBJECT)
@@ -39,11 +52,33 @@ panel_session_manager_finalize (GObject *object)
 {
 	PanelSessionManager *manager = PANEL_SESSION_MANAGER (object);
 
+	if (manager->shutdown_cancellable)
+		g_cancellable_cancel (manager->shutdown_cancellable);
+	g_clear_object (&manager->shutdown_cancellable);
+
 	g_clear_object (&manager->proxy);
 
 	G_OBJECT_CLASS (panel_session_manager_parent_class)->finalize (object);
 }
 
+static void
+panel_session_manager_get_property (GObject    *object,
+				    guint       prop_id,
+				    GValue     *value,
+				    GParamSpec *pspec)
+{
+	PanelSessionManager *manager = PANEL_SESSION_MANAGER (object);
+
+	switch (prop_id) {
+	case PROP_SHUTDOWN_AVAILABLE:
+		g_value_set_boolean (value, manager->shutdown_available);
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+		break;
+	}
+}
+
 static void
 panel_session_manager_class_init (PanelSessionManagerClass *klass)
 {
@@ -52,6 +87,91 @@ panel_session_manager_class_init (PanelSessionManagerClass *klass)
 	object_class = G_OBJECT_CLASS (klass);
 
 	object_class->finalize = panel_session_manager_finalize;
+	object_class->get_property = panel_session_manager_get_property;
+
+	g_object_class_install_property (object_class,
+					 PROP_SHUTDOWN_AVAILABLE,
+					 g_param_spec_boolean ("shutdown-available",
+							       "Shutdown available",
+							       "Whether the session manager can shut down the computer",
+							       FALSE,
+							       G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+}
+
+static void
+panel_session_manager_set_shutdown_available (PanelSessionManager *manager,
+					      gboolean             available)
+{
+	manager->shutdown_checked = g_get_monotonic_time ();
+
+	if (manager->shutdown_available == available)
+		return;
+
+	manager->shutdown_available = available;
+	g_object_notify (G_OBJECT (manager), "shutdown-available");
+}
+
+static void
+panel_session_manager_can_shutdown_done (GObject      *source_object,
+					 GAsyncResult *res,
+					 gpointer      user_data)
+{
+	PanelSessionManager *manager;
+	GError              *error = NULL;
+	GVariant            *ret;
+	gboolean             available;
+
+	ret = g_dbus_proxy_call_finish (G_DBUS_PROXY (source_object), res, &error);
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		g_error_free (error);
+		return;
+	}
+
+	manager = PANEL_SESSION_MANAGER (user_data);
+	g_clear_object (&manager->shutdown_cancellable);
+
+	if (ret == NULL) {
+		g_warning ("Could not ask session manager if shut down is available: %s",
+			   error->message);
+		g_error_free (error);
+		panel_session_manager_set_shutdown_available (manager, FALSE);
+		return;
+	}
+
+	g_variant_get (ret, "(b)", &available);
+	g_variant_unref (ret);
+
+	panel_session_manager_set_shutdown_available (manager, available);
+}
+
+static void
+panel_session_manager_refresh_shutdown_available (PanelSessionManager *manager)
+{
+	if (manager->proxy == NULL || manager->shutdown_cancellable)
+		return;
+
+	manager->shutdown_cancellable = g_cancellable_new ();
+	g_dbus_proxy_call (manager->proxy, "CanShutdown",
+			   g_variant_new ("()"),
+			   G_DBUS_CALL_FLAGS_NONE,
+			   -1,
+			   manager->shutdown_cancellable,
+			   panel_session_manager_can_shutdown_done,
+			   manager);
+}
+
+/* a new session manager can answer differently */
+static void
+panel_session_manager_name_owner_changed (GObject             *proxy,
+					  GParamSpec          *pspec,
+					  PanelSessionManager *manager)
+{
+	if (manager->shutdown_cancellable) {
+		g_cancellable_cancel (manager->shutdown_cancellable);
+		g_clear_object (&manager->shutdown_cancellable);
+	}
+
+	panel_session_manager_refresh_shutdown_available (manager);
 }
 
 static void
@@ -70,7 +190,15 @@ panel_session_manager_init (PanelSessionManager *manager)
 	if (manager->proxy == NULL) {
 		g_warning ("Unable to contact session manager daemon: %s\n", error->message);
 		g_error_free (error);
+		return;
 	}
+
+	g_signal_connect (manager->proxy, "notify::g-name-owner",
+			  G_CALLBACK (panel_session_manager_name_owner_changed),
+			  manager);
+
+	/* answered long before the first menu is built */
+	panel_session_manager_refresh_shutdown_available (manager);
 }
 
 void
@@ -126,6 +254,9 @@ panel_session_manager_request_shutdown (PanelSessionManager *manager)
 	}
 }
 
+/* Answers from the cache, which "shutdown-available" notifications tell
+ * about: building the menus does not wait for the session manager. Only a
+ * call made before the first answer arrived asks synchronously. */
 gboolean
 panel_session_manager_is_shutdown_available (PanelSessionManager *manager)
 {
@@ -138,6 +269,14 @@ panel_session_manager_is_shutdown_available (PanelSessionManager *manager)
 	if (manager->proxy == NULL)
 		return FALSE;
 
+	if (manager->shutdown_checked != 0) {
+		if (g_get_monotonic_time () - manager->shutdown_checked >
+		    PANEL_SESSION_MANAGER_SHUTDOWN_CACHE_US)
+			panel_session_manager_refresh_shutdown_available (manager);
+
+		return manager->shutdown_available;
+	}
+
 	ret = g_dbus_proxy_call_sync (manager->proxy, "CanShutdown",
 				      g_variant_new ("()"),
 				      G_DBUS_CALL_FLAGS_NONE,
@@ -154,6 +293,8 @@ panel_session_manager_is_shutdown_available (PanelSessionManager *manager)
 		g_variant_unref (ret);
 	}
 
+	panel_session_manager_set_shutdown_available (manager, is_shutdown_available);
+
 	return is_shutdown_available;
 }
 
@@ -164,8 +305,8 @@ panel_session_manager_get (void)
 
 	if (manager == NULL) {
 		manager = g_object_new (PANEL_TYPE_SESSION_MANAGER, NULL);
-		panel_cleanup_register (panel_cleanup_unref_and_nullify,
-					&manager);
+		panel_cleanup_register_memory (panel_cleanup_unref_and_nullify,
+					       &manager);
 	}
 
 	return manager;
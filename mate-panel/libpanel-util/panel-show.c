@@ -23,6 +23,8 @@
  *	Vincent Untz <vuntz@gnome.org>
  */
 
+#include <string.h>
+
 #include <glib/gi18n.h>
 #include <gio/gio.h>
 #include <gio/gdesktopappinfo.h>
@@ -32,6 +34,7 @@
 #include "panel-error.h"
 #include "panel-glib.h"
 #include "panel-launch.h"
+#include "panel-scheduler.h"
 
 #include "panel-show.h"
 
@@ -49,95 +52,379 @@ _panel_show_error_dialog (const gchar *uri,
 	g_free (primary);
 }
 
+/* Looking at a file to find out what opens it can take forever when it is
+ * on a server that does not answer: all of it is done asynchronously,
+ * and given up after a while. Waiting for the user to mount the location
+ * does not count. */
+#define PANEL_SHOW_TIMEOUT 30 /* seconds */
+
 typedef struct {
+	GdkScreen       *screen;
+	char            *uri;
+	guint32          timestamp;
+
+	GFile           *file;
+	GCancellable    *cancellable;
+	guint            timeout_id;
+	gboolean         timed_out;
+	gboolean         mounted;
 	GMountOperation *mount_op;
+} PanelShowRequest;
+
+/* the requests still looking at their file */
+static GList *panel_show_requests = NULL;
+
+static void _panel_show_request_query (PanelShowRequest *request);
+
+static void
+_panel_show_request_stop_timeout (PanelShowRequest *request)
+{
+	if (request->timeout_id)
+		g_source_remove (request->timeout_id);
+	request->timeout_id = 0;
+}
+
+static void
+_panel_show_request_free (PanelShowRequest *request)
+{
+	panel_show_requests = g_list_remove (panel_show_requests, request);
+
+	_panel_show_request_stop_timeout (request);
+
+	g_clear_object (&request->mount_op);
+	g_object_unref (request->cancellable);
+	g_object_unref (request->file);
+	g_object_unref (request->screen);
+	g_free (request->uri);
+	g_slice_free (PanelShowRequest, request);
+}
+
+static void
+_panel_show_request_failed (PanelShowRequest *request,
+			    GError           *error)
+{
+	if (request->timed_out)
+		_panel_show_error_dialog (request->uri, request->screen,
+					  _("The location did not answer in time."));
+	else if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED) &&
+		 !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_PERMISSION_DENIED) &&
+		 !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_FAILED_HANDLED))
+		_panel_show_error_dialog (request->uri, request->screen,
+					  error->message);
+
+	_panel_show_request_free (request);
+}
+
+static gboolean
+_panel_show_launch (GAppInfo    *appinfo,
+		    const gchar *uri,
+		    GdkScreen   *screen,
+		    guint32      timestamp,
+		    GError     **error)
+{
+	GdkAppLaunchContext *context;
+	GList               *uris;
+	gboolean             ret;
+
+	uris = g_list_append (NULL, (gpointer) uri);
+	context = gdk_display_get_app_launch_context (gdk_screen_get_display (screen));
+	gdk_app_launch_context_set_screen (context, screen);
+	gdk_app_launch_context_set_timestamp (context, timestamp);
+
+	ret = g_app_info_launch_uris (appinfo, uris, G_APP_LAUNCH_CONTEXT (context), error);
+
+	g_object_unref (context);
+	g_list_free (uris);
+
+	return ret;
+}
+
+#if GLIB_CHECK_VERSION(2,60,0)
+typedef struct {
 	GdkScreen *screen;
-} PanelShowMountOperationHandle;
+	char      *uri;
+} PanelShowLaunch;
+
+static void
+_panel_show_launch_async_callback (GObject      *source_object,
+				   GAsyncResult *result,
+				   gpointer      user_data)
+{
+	PanelShowLaunch *launch = user_data;
+	GError          *error = NULL;
+
+	if (!g_app_info_launch_uris_finish (G_APP_INFO (source_object),
+					    result, &error)) {
+		_panel_show_error_dialog (launch->uri, launch->screen,
+					  error->message);
+		g_error_free (error);
+	}
+
+	g_object_unref (launch->screen);
+	g_free (launch->uri);
+	g_slice_free (PanelShowLaunch, launch);
+}
+
+/* Launching a D-Bus activatable application waits for it to answer: the
+ * errors are shown in a dialog once it did */
+static void
+_panel_show_launch_async (GAppInfo    *appinfo,
+			  const gchar *uri,
+			  GdkScreen   *screen,
+			  guint32      timestamp)
+{
+	GdkAppLaunchContext *context;
+	PanelShowLaunch     *launch;
+	GList               *uris;
+
+	launch = g_slice_new (PanelShowLaunch);
+	launch->screen = g_object_ref (screen);
+	launch->uri = g_strdup (uri);
+
+	uris = g_list_append (NULL, (gpointer) uri);
+	context = gdk_display_get_app_launch_context (gdk_screen_get_display (screen));
+	gdk_app_launch_context_set_screen (context, screen);
+	gdk_app_launch_context_set_timestamp (context, timestamp);
+
+	g_app_info_launch_uris_async (appinfo, uris, G_APP_LAUNCH_CONTEXT (context),
+				      NULL, _panel_show_launch_async_callback,
+				      launch);
+
+	g_object_unref (context);
+	g_list_free (uris);
+}
+#endif
+
+static gboolean
+_panel_show_request_timeout (gpointer data)
+{
+	PanelShowRequest *request = data;
+
+	request->timeout_id = 0;
+	request->timed_out = TRUE;
+	g_cancellable_cancel (request->cancellable);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+_panel_show_request_start_timeout (PanelShowRequest *request)
+{
+	_panel_show_request_stop_timeout (request);
+	request->timeout_id = g_timeout_add_seconds (PANEL_SHOW_TIMEOUT,
+						     _panel_show_request_timeout,
+						     request);
+}
 
 static void
 _panel_show_mount_async_callback (GObject      *source_object,
 				  GAsyncResult *result,
 				  gpointer      user_data)
 {
-	GError *error = NULL;
-	GFile *file;
-	PanelShowMountOperationHandle *handle = user_data;
-
-	file = G_FILE (source_object);
-
-	error = NULL;
-	if (g_file_mount_enclosing_volume_finish (file, result, &error)) {
-		char *uri = g_file_get_uri (file);
-
-		panel_show_uri (handle->screen, uri,
-				gtk_get_current_event_time (), NULL);
-		g_free (uri);
-	} else {
-		if (!g_error_matches (error, G_IO_ERROR,
-				      G_IO_ERROR_PERMISSION_DENIED) &&
-		    !g_error_matches (error, G_IO_ERROR,
-			    	      G_IO_ERROR_FAILED_HANDLED)) {
-			char *uri;
-
-			uri = g_file_get_uri (file);
-			_panel_show_error_dialog (uri, handle->screen,
-						  error->message);
-			g_free (uri);
-		}
+	PanelShowRequest *request = user_data;
+	GError           *error = NULL;
+
+	if (!g_file_mount_enclosing_volume_finish (G_FILE (source_object),
+						   result, &error)) {
+		_panel_show_request_failed (request, error);
 		g_error_free (error);
+		return;
 	}
 
-	if (handle->mount_op)
-		g_object_unref (handle->mount_op);
+	_panel_show_request_start_timeout (request);
+	_panel_show_request_query (request);
+}
+
+static void
+_panel_show_request_mount (PanelShowRequest *request)
+{
+	request->mounted = TRUE;
+
+	/* the user may have to type a password */
+	_panel_show_request_stop_timeout (request);
 
-	g_slice_free (PanelShowMountOperationHandle, handle);
+	request->mount_op = gtk_mount_operation_new (NULL);
+	gtk_mount_operation_set_screen (GTK_MOUNT_OPERATION (request->mount_op),
+					request->screen);
+
+	g_file_mount_enclosing_volume (request->file, G_MOUNT_MOUNT_NONE,
+				       request->mount_op, request->cancellable,
+				       _panel_show_mount_async_callback,
+				       request);
 }
 
-static gboolean _panel_show_handle_error(const gchar* uri, GdkScreen* screen, GError* local_error, GError** error)
+static void
+_panel_show_query_callback (GObject      *source_object,
+			    GAsyncResult *result,
+			    gpointer      user_data)
 {
-	if (local_error == NULL)
-	{
-		return TRUE;
+	PanelShowRequest *request = user_data;
+	GFileInfo        *info;
+	GAppInfo         *appinfo = NULL;
+	GError           *error = NULL;
+	const char       *content_type;
+
+	info = g_file_query_info_finish (G_FILE (source_object), result, &error);
+	if (!info) {
+		/* If it's not mounted, try to mount it ourselves */
+		if (!request->mounted &&
+		    g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_MOUNTED))
+			_panel_show_request_mount (request);
+		else
+			_panel_show_request_failed (request, error);
+
+		g_error_free (error);
+		return;
 	}
 
-	else if (g_error_matches (local_error,
-				  G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
-		g_error_free (local_error);
-		return TRUE;
+	_panel_show_request_stop_timeout (request);
+
+	content_type = g_file_info_get_content_type (info);
+	if (content_type)
+		appinfo = g_app_info_get_default_for_type (content_type,
+							   !g_file_is_native (request->file));
+
+	if (!appinfo)
+		_panel_show_error_dialog (request->uri, request->screen,
+					  _("No application is registered as handling this file"));
+	else if (!_panel_show_launch (appinfo, request->uri, request->screen,
+				      request->timestamp, &error)) {
+		_panel_show_error_dialog (request->uri, request->screen,
+					  error->message);
+		g_error_free (error);
 	}
 
-	else if (g_error_matches (local_error,
-				  G_IO_ERROR, G_IO_ERROR_NOT_MOUNTED)) {
-		GFile *file;
-		PanelShowMountOperationHandle *handle;
+	g_clear_object (&appinfo);
+	g_object_unref (info);
 
-		handle = g_slice_new (PanelShowMountOperationHandle);
-		file = g_file_new_for_uri (uri);
+	_panel_show_request_free (request);
+}
 
-		/* If it's not mounted, try to mount it ourselves */
-		handle->mount_op = gtk_mount_operation_new (NULL);
-		gtk_mount_operation_set_screen (GTK_MOUNT_OPERATION (handle->mount_op),
-						screen);
-		handle->screen = screen;
+static void
+_panel_show_request_query (PanelShowRequest *request)
+{
+	g_file_query_info_async (request->file,
+				 G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE,
+				 G_FILE_QUERY_INFO_NONE,
+				 G_PRIORITY_DEFAULT,
+				 request->cancellable,
+				 _panel_show_query_callback,
+				 request);
+}
 
-		g_file_mount_enclosing_volume (file, G_MOUNT_MOUNT_NONE,
-					       handle->mount_op, NULL,
-					       _panel_show_mount_async_callback,
-					       handle);
-		g_object_unref (file);
+static void
+_panel_show_uri_async (GdkScreen   *screen,
+		       const gchar *uri,
+		       guint32      timestamp)
+{
+	PanelShowRequest *request;
+	GList            *l;
 
-		return TRUE;
+	/* a second click gives up on the first one */
+	for (l = panel_show_requests; l; l = l->next) {
+		PanelShowRequest *pending = l->data;
+
+		if (strcmp (pending->uri, uri) == 0)
+			g_cancellable_cancel (pending->cancellable);
 	}
 
-	else if (error != NULL)
-		g_propagate_error (error, local_error);
+	request = g_slice_new0 (PanelShowRequest);
+	request->screen      = g_object_ref (screen);
+	request->uri         = g_strdup (uri);
+	request->timestamp   = timestamp;
+	request->file        = g_file_new_for_uri (uri);
+	request->cancellable = g_cancellable_new ();
 
-	else {
-		_panel_show_error_dialog (uri, screen, local_error->message);
-		g_error_free (local_error);
+	panel_show_requests = g_list_prepend (panel_show_requests, request);
+
+	_panel_show_request_start_timeout (request);
+	_panel_show_request_query (request);
+}
+
+/* The handlers of the URI schemes, so that a click on a link launcher
+ * does not have to read the MIME configuration. A scheme without handler
+ * maps to NULL. All of it is forgotten when the installed applications or
+ * the defaults change. */
+static GHashTable      *panel_show_scheme_handlers = NULL;
+static GAppInfoMonitor *panel_show_app_info_monitor = NULL;
+
+static void
+_panel_show_scheme_handler_free (gpointer data)
+{
+	if (data)
+		g_object_unref (data);
+}
+
+static void
+_panel_show_app_infos_changed (GAppInfoMonitor *monitor,
+			       gpointer         user_data)
+{
+	g_hash_table_remove_all (panel_show_scheme_handlers);
+}
+
+/* Returns a new reference to the handler of scheme, or NULL */
+static GAppInfo *
+_panel_show_get_scheme_handler (const char *scheme)
+{
+	GAppInfo *appinfo;
+
+	if (!panel_show_scheme_handlers) {
+		panel_show_scheme_handlers = g_hash_table_new_full (g_str_hash, g_str_equal,
+								    g_free,
+								    _panel_show_scheme_handler_free);
+		panel_show_app_info_monitor = g_app_info_monitor_get ();
+		g_signal_connect (panel_show_app_info_monitor, "changed",
+				  G_CALLBACK (_panel_show_app_infos_changed),
+				  NULL);
 	}
 
-	return FALSE;
+	if (!g_hash_table_lookup_extended (panel_show_scheme_handlers, scheme,
+					   NULL, (gpointer *) &appinfo)) {
+		appinfo = g_app_info_get_default_for_uri_scheme (scheme);
+		g_hash_table_insert (panel_show_scheme_handlers,
+				     g_strdup (scheme), appinfo);
+	}
+
+	return appinfo ? g_object_ref (appinfo) : NULL;
+}
+
+static gboolean
+_panel_show_prefetch_task (gpointer data)
+{
+	GAppInfo *appinfo;
+
+	appinfo = _panel_show_get_scheme_handler (data);
+	g_clear_object (&appinfo);
+
+	return G_SOURCE_REMOVE;
+}
+
+/**
+ * panel_show_uri_prefetch:
+ * @uri: a location that will likely be shown
+ *
+ * Looks for the application handling the scheme of @uri in the idle time
+ * of the main loop, so that panel_show_uri() finds it right away.
+ */
+void
+panel_show_uri_prefetch (const gchar *uri)
+{
+	char *scheme;
+
+	g_return_if_fail (uri != NULL);
+
+	scheme = g_uri_parse_scheme (uri);
+	if (!scheme || scheme[0] == '\0' ||
+	    (panel_show_scheme_handlers &&
+	     g_hash_table_contains (panel_show_scheme_handlers, scheme))) {
+		g_free (scheme);
+		return;
+	}
+
+	panel_scheduler_add (PANEL_SCHEDULER_PRIORITY_LOW,
+			     "show-uri-prefetch",
+			     _panel_show_prefetch_task,
+			     scheme, g_free);
 }
 
 static gboolean panel_show_caja_search_uri(GdkScreen* screen, const gchar* uri, guint32 timestamp, GError** error)
@@ -166,9 +453,27 @@ static gboolean panel_show_caja_search_uri(GdkScreen* screen, const gchar* uri,
 	return ret;
 }
 
+/**
+ * panel_show_uri:
+ * @screen: the screen to show @uri on
+ * @uri: the location to show
+ * @timestamp: the timestamp of the event that asked for it
+ * @error: return location for an error, or %NULL for an error dialog
+ *
+ * Opens @uri with the application handling its URI scheme, or else the
+ * one handling its content type. The content type is looked for
+ * asynchronously, mounting the location if needed; the errors found then
+ * are always shown in a dialog. Without @error, the application is
+ * launched asynchronously too.
+ *
+ * Returns: %FALSE if @uri could not be opened right away.
+ */
 gboolean panel_show_uri(GdkScreen* screen, const gchar* uri, guint32 timestamp, GError** error)
 {
-	GError* local_error = NULL;
+	GError   *local_error = NULL;
+	GAppInfo *appinfo = NULL;
+	char     *scheme;
+	gboolean  ret;
 
 	g_return_val_if_fail(GDK_IS_SCREEN (screen), FALSE);
 	g_return_val_if_fail(uri != NULL, FALSE);
@@ -179,9 +484,40 @@ gboolean panel_show_uri(GdkScreen* screen, const gchar* uri, guint32 timestamp,
 		return panel_show_caja_search_uri(screen, uri, timestamp, error);
 	}
 
-	gtk_show_uri_on_window (NULL, uri,timestamp, &local_error);
+	/* like g_app_info_launch_default_for_uri(), which would look at
+	 * the file synchronously */
+	scheme = g_uri_parse_scheme (uri);
+	if (scheme && scheme[0] != '\0')
+		appinfo = _panel_show_get_scheme_handler (scheme);
+	g_free (scheme);
 
-	return _panel_show_handle_error(uri, screen, local_error, error);
+	if (!appinfo) {
+		_panel_show_uri_async (screen, uri, timestamp);
+		return TRUE;
+	}
+
+#if GLIB_CHECK_VERSION(2,60,0)
+	if (error == NULL) {
+		_panel_show_launch_async (appinfo, uri, screen, timestamp);
+		g_object_unref (appinfo);
+		return TRUE;
+	}
+#endif
+
+	ret = _panel_show_launch (appinfo, uri, screen, timestamp, &local_error);
+	g_object_unref (appinfo);
+
+	if (ret)
+		return TRUE;
+
+	if (error != NULL)
+		g_propagate_error (error, local_error);
+	else {
+		_panel_show_error_dialog (uri, screen, local_error->message);
+		g_error_free (local_error);
+	}
+
+	return FALSE;
 }
 
 gboolean
@@ -194,9 +530,6 @@ panel_show_uri_force_mime_type (GdkScreen    *screen,
 	GFile    *file;
 	GAppInfo *appinfo;
 	gboolean  ret;
-	GdkDisplay *display;
-	GdkAppLaunchContext *context;
-	GList    *uris;
 
 	g_return_val_if_fail (GDK_IS_SCREEN (screen), FALSE);
 	g_return_val_if_fail (uri != NULL, FALSE);
@@ -214,12 +547,7 @@ panel_show_uri_force_mime_type (GdkScreen    *screen,
 		return panel_show_uri (screen, uri, timestamp, error);
 	}
 
-	uris = g_list_append (NULL, (gpointer)uri);
-	display = gdk_screen_get_display (screen);
-	context = gdk_display_get_app_launch_context (display);
-	ret = g_app_info_launch_uris (appinfo, uris, G_APP_LAUNCH_CONTEXT(context), error);
-	g_object_unref (context);
-	g_list_free (uris);
+	ret = _panel_show_launch (appinfo, uri, screen, timestamp, error);
 	g_object_unref (appinfo);
 
 	return ret;
@@ -38,6 +38,8 @@ gboolean panel_show_uri (GdkScreen    *screen,
 			 guint32       timestamp,
 			 GError      **error);
 
+void     panel_show_uri_prefetch (const gchar *uri);
+
 gboolean panel_show_uri_force_mime_type (GdkScreen    *screen,
 					 const gchar  *uri,
 					 const gchar  *mime_type,
@@ -0,0 +1,307 @@
+/*
+ * panel-spawn.c: spawn applications, optionally from a helper process
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * With the helper, the applications are spawned by mate-panel-spawn-helper,
+ * a small process started once, so that launching does not fork the whole
+ * panel. See panel-spawn-helper.c for the protocol. When the helper cannot
+ * be used, the applications are spawned directly.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <glib/gi18n.h>
+#include <gio/gio.h>
+
+#include "panel-spawn.h"
+
+#define PANEL_SPAWN_HELPER LIBEXECDIR "/mate-panel-spawn-helper"
+#define PANEL_SPAWN_HELPER_FD 3
+/* how long the helper has to take a request and answer it */
+#define PANEL_SPAWN_HELPER_TIMEOUT 2000 /* ms */
+
+static gboolean     panel_spawn_use_helper = FALSE;
+static gboolean     panel_spawn_helper_broken = FALSE;
+static GSubprocess *panel_spawn_helper = NULL;
+static int          panel_spawn_helper_fd = -1;
+
+static void
+dummy_child_watch (GPid     pid,
+		   gint     status,
+		   gpointer user_data)
+{
+	/* Nothing, this is just to ensure we don't double fork
+	 * and break pkexec:
+	 * https://bugzilla.gnome.org/show_bug.cgi?id=675789
+	 */
+}
+
+static void
+panel_spawn_stop_helper (void)
+{
+	/* the helper exits when its end of the socket is closed */
+	if (panel_spawn_helper_fd >= 0)
+		close (panel_spawn_helper_fd);
+	panel_spawn_helper_fd = -1;
+
+	g_clear_object (&panel_spawn_helper);
+}
+
+static gboolean
+panel_spawn_start_helper (void)
+{
+	GSubprocessLauncher *launcher;
+	GError              *error = NULL;
+	int                  fds[2];
+
+	if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+		g_warning ("Cannot create a socket for the spawn helper: %s",
+			   g_strerror (errno));
+		return FALSE;
+	}
+
+	launcher = g_subprocess_launcher_new (G_SUBPROCESS_FLAGS_NONE);
+	g_subprocess_launcher_take_fd (launcher, fds[1], PANEL_SPAWN_HELPER_FD);
+	panel_spawn_helper = g_subprocess_launcher_spawn (launcher, &error,
+							  PANEL_SPAWN_HELPER,
+							  NULL);
+	g_object_unref (launcher);
+
+	if (!panel_spawn_helper) {
+		g_warning ("Cannot start %s: %s", PANEL_SPAWN_HELPER,
+			   error->message);
+		g_error_free (error);
+		close (fds[0]);
+		return FALSE;
+	}
+
+	panel_spawn_helper_fd = fds[0];
+
+	return TRUE;
+}
+
+void
+panel_spawn_set_use_helper (gboolean use_helper)
+{
+	panel_spawn_use_helper = use_helper != FALSE;
+
+	if (!panel_spawn_use_helper)
+		panel_spawn_stop_helper ();
+}
+
+/* The socket is only used once poll says it is ready, so that a helper
+ * which is alive but stuck cannot block the main loop past the deadline */
+static gboolean
+wait_fd (int     fd,
+	 gushort events,
+	 gint64  deadline)
+{
+	GPollFD poll_fd;
+
+	poll_fd.fd = fd;
+	poll_fd.events = events;
+
+	for (;;) {
+		gint64 timeout;
+		int    n;
+
+		timeout = (deadline - g_get_monotonic_time ()) / 1000;
+		if (timeout <= 0)
+			return FALSE;
+
+		poll_fd.revents = 0;
+		n = g_poll (&poll_fd, 1, timeout);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return FALSE;
+
+		/* a hangup still lets the reads see the end of the stream */
+		return (poll_fd.revents & (events | G_IO_HUP)) != 0;
+	}
+}
+
+static gboolean
+send_all (int         fd,
+	  const char *buf,
+	  gsize       len,
+	  gint64      deadline)
+{
+	while (len > 0) {
+		gssize n;
+
+		if (!wait_fd (fd, G_IO_OUT, deadline))
+			return FALSE;
+
+		/* a dead helper must not kill the panel with SIGPIPE */
+		n = send (fd, buf, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+		if (n < 0 && (errno == EINTR || errno == EAGAIN))
+			continue;
+		if (n <= 0)
+			return FALSE;
+
+		buf += n;
+		len -= n;
+	}
+
+	return TRUE;
+}
+
+static gboolean
+recv_all (int     fd,
+	  char   *buf,
+	  gsize   len,
+	  gint64  deadline)
+{
+	while (len > 0) {
+		gssize n;
+
+		if (!wait_fd (fd, G_IO_IN, deadline))
+			return FALSE;
+
+		n = recv (fd, buf, len, MSG_DONTWAIT);
+
+		if (n < 0 && (errno == EINTR || errno == EAGAIN))
+			continue;
+		if (n <= 0)
+			return FALSE;
+
+		buf += n;
+		len -= n;
+	}
+
+	return TRUE;
+}
+
+/* Returns the pid, minus the errno of a failure of the spawn, or 0 if the
+ * helper did not answer in time. */
+static gint32
+panel_spawn_with_helper (const char  *working_directory,
+			 char       **argv,
+			 char       **envp)
+{
+	GString *request;
+	guint32  len;
+	gint32   reply;
+	gint64   deadline;
+	int      i;
+
+	request = g_string_new (NULL);
+	g_string_append_len (request, "\0\0\0\0", sizeof (len));
+
+	g_string_append (request, working_directory ? working_directory : "");
+	g_string_append_c (request, '\0');
+	for (i = 0; argv[i]; i++)
+		g_string_append_len (request, argv[i], strlen (argv[i]) + 1);
+	g_string_append_c (request, '\0');
+	for (i = 0; envp[i]; i++)
+		g_string_append_len (request, envp[i], strlen (envp[i]) + 1);
+	g_string_append_c (request, '\0');
+
+	len = request->len - sizeof (len);
+	memcpy (request->str, &len, sizeof (len));
+
+	deadline = g_get_monotonic_time () + PANEL_SPAWN_HELPER_TIMEOUT * 1000;
+
+	if (!send_all (panel_spawn_helper_fd, request->str, request->len, deadline) ||
+	    !recv_all (panel_spawn_helper_fd, (char *) &reply, sizeof (reply), deadline))
+		reply = 0;
+
+	g_string_free (request, TRUE);
+
+	return reply;
+}
+
+/* Like g_spawn_async() with G_SPAWN_SEARCH_PATH, the child being reaped
+ * by someone else: child_pid is only informative. */
+gboolean
+panel_spawn_async (const char  *working_directory,
+		   char       **argv,
+		   char       **envp,
+		   GPid        *child_pid,
+		   GError     **error)
+{
+	GPid     pid;
+	gboolean retval;
+
+	g_return_val_if_fail (argv != NULL && argv[0] != NULL, FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	if (panel_spawn_use_helper && !panel_spawn_helper_broken &&
+	    (panel_spawn_helper_fd >= 0 || panel_spawn_start_helper ())) {
+		char   **environ_ = NULL;
+		gint32   reply;
+
+		if (!envp)
+			envp = environ_ = g_get_environ ();
+
+		reply = panel_spawn_with_helper (working_directory, argv, envp);
+
+		g_strfreev (environ_);
+
+		if (reply > 0) {
+			if (child_pid)
+				*child_pid = (GPid) reply;
+			return TRUE;
+		}
+
+		if (reply < 0) {
+			int errnum = -reply;
+
+			g_set_error (error, G_SPAWN_ERROR,
+				     errnum == ENOENT ? G_SPAWN_ERROR_NOENT :
+				     errnum == EACCES ? G_SPAWN_ERROR_ACCES :
+				     errnum == ENOTDIR ? G_SPAWN_ERROR_NOTDIR :
+				     G_SPAWN_ERROR_FAILED,
+				     _("Failed to execute child process \"%s\" (%s)"),
+				     argv[0], g_strerror (errnum));
+			return FALSE;
+		}
+
+		g_warning ("The spawn helper stopped answering, "
+			   "applications are now spawned by the panel");
+		/* it could be stuck rather than dead */
+		if (panel_spawn_helper)
+			g_subprocess_force_exit (panel_spawn_helper);
+		panel_spawn_stop_helper ();
+		panel_spawn_helper_broken = TRUE;
+	}
+
+	retval = g_spawn_async (working_directory, argv, envp,
+				G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
+				NULL, NULL, &pid, error);
+
+	if (retval) {
+		g_child_watch_add (pid, dummy_child_watch, NULL);
+		if (child_pid)
+			*child_pid = pid;
+	}
+
+	return retval;
+}
@@ -0,0 +1,43 @@
+/*
+ * panel-spawn.h: spawn applications, optionally from a helper process
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef PANEL_SPAWN_H
+#define PANEL_SPAWN_H
+
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void     panel_spawn_set_use_helper (gboolean     use_helper);
+
+gboolean panel_spawn_async          (const char  *working_directory,
+				     char       **argv,
+				     char       **envp,
+				     GPid        *child_pid,
+				     GError     **error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PANEL_SPAWN_H */
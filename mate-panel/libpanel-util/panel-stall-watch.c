@@ -0,0 +1,321 @@
+/*
+ * panel-stall-watch.c: log the long dispatches of the main loop
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * The poll function of the main context is wrapped: the time between the
+ * return of a poll and the next one is what the main loop spent
+ * dispatching, when it could not redraw nor handle input. A watchdog
+ * thread sleeps while the main loop polls. When a dispatch goes past the
+ * threshold, it interrupts the main thread with a signal; the handler
+ * notes the name of the source being dispatched and a backtrace. Once the
+ * dispatch is over, the stall is logged with them as structured fields,
+ * which end up in the journal when the process logs there:
+ *
+ *   journalctl MESSAGE_ID=6d1f0b3c2a8e4f7a9c5b1e0d3f2a7c64
+ *
+ * The reports are rate limited; the stalls that are not reported are
+ * counted in the next report. MATE_PANEL_STALL_THRESHOLD sets the
+ * threshold in milliseconds, 0 disables the watch. All the stalls are
+ * counted in the performance counters, reported or not.
+ *
+ * This is linked both in the panel and in the applet library.
+ */
+
+#include <config.h>
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_EXECINFO_H
+#include <execinfo.h>
+#endif
+
+#include <glib.h>
+
+#include "panel-perf.h"
+#include "panel-stall-watch.h"
+
+#define PANEL_STALL_DEFAULT_THRESHOLD 250 /* ms */
+#define PANEL_STALL_LOG_INTERVAL      30  /* s between two reports */
+#define PANEL_STALL_MAX_FRAMES        32
+#define PANEL_STALL_SKIP_FRAMES       2   /* the handler and the trampoline */
+#define PANEL_STALL_SOURCE_SIZE       128
+
+#define PANEL_STALL_MESSAGE_ID "6d1f0b3c2a8e4f7a9c5b1e0d3f2a7c64"
+
+#ifdef SIGRTMIN
+#define PANEL_STALL_SIGNAL (SIGRTMIN + 2)
+#endif
+
+static GPollFunc  stall_default_poll = NULL;
+static gint64     stall_threshold = 0;
+static pthread_t  stall_main_thread;
+
+/* shared with the watchdog thread */
+static GMutex     stall_lock;
+static GCond      stall_cond;
+static gint64     stall_dispatch_start = 0;    /* 0 while polling */
+static guint64    stall_dispatch = 0;
+static gboolean   stall_watchdog_waiting = FALSE;
+
+/* written by the signal handler, in the main thread */
+static volatile sig_atomic_t stall_sampled = 0;
+static guint64    stall_sample_dispatch;
+static void      *stall_sample_frames [PANEL_STALL_MAX_FRAMES];
+static int        stall_sample_n_frames = 0;
+static char       stall_sample_source [PANEL_STALL_SOURCE_SIZE];
+
+static gint64     stall_last_report = 0;
+static guint      stall_n_unreported = 0;
+static gint64     stall_unreported_max = 0;
+
+#ifdef PANEL_STALL_SIGNAL
+static void
+panel_stall_watch_sample (int signum)
+{
+	GSource    *source;
+	const char *name = NULL;
+
+	stall_sample_dispatch = stall_dispatch;
+
+#ifdef HAVE_EXECINFO_H
+	stall_sample_n_frames = backtrace (stall_sample_frames,
+					   PANEL_STALL_MAX_FRAMES);
+#endif
+
+	source = g_main_current_source ();
+	if (source)
+		name = g_source_get_name (source);
+
+	g_strlcpy (stall_sample_source, name ? name : "unnamed",
+		   sizeof (stall_sample_source));
+
+	stall_sampled = 1;
+}
+#endif
+
+static char *
+panel_stall_watch_format_backtrace (void)
+{
+#ifdef HAVE_EXECINFO_H
+	GString  *string;
+	char    **symbols;
+	int       i;
+
+	if (stall_sample_n_frames <= PANEL_STALL_SKIP_FRAMES)
+		return g_strdup ("");
+
+	symbols = backtrace_symbols (stall_sample_frames, stall_sample_n_frames);
+	if (!symbols)
+		return g_strdup ("");
+
+	string = g_string_new (NULL);
+	for (i = PANEL_STALL_SKIP_FRAMES; i < stall_sample_n_frames; i++) {
+		if (string->len > 0)
+			g_string_append_c (string, '\n');
+		g_string_append (string, symbols [i]);
+	}
+	free (symbols);
+
+	return g_string_free (string, FALSE);
+#else
+	return g_strdup ("");
+#endif
+}
+
+static void
+panel_stall_watch_report (gint64 duration)
+{
+	const char *source = "unknown";
+	char       *backtrace_string = NULL;
+	char       *duration_string;
+	char       *unreported_string;
+	gint64      now;
+
+	panel_perf_count ("main-loop-stalls", 1);
+	panel_perf_record ("main-loop-stall-us", duration);
+
+	/* the sample is only valid for the dispatch it was taken in */
+	if (stall_sampled && stall_sample_dispatch == stall_dispatch) {
+		source = stall_sample_source;
+		backtrace_string = panel_stall_watch_format_backtrace ();
+	}
+	stall_sampled = 0;
+
+	now = g_get_monotonic_time ();
+	if (stall_last_report &&
+	    now - stall_last_report < PANEL_STALL_LOG_INTERVAL * G_USEC_PER_SEC) {
+		stall_n_unreported++;
+		stall_unreported_max = MAX (stall_unreported_max, duration);
+		g_free (backtrace_string);
+		return;
+	}
+	stall_last_report = now;
+
+	duration_string = g_strdup_printf ("%" G_GINT64_FORMAT, duration);
+	unreported_string = g_strdup_printf ("%u", stall_n_unreported);
+
+	g_log_structured (G_LOG_DOMAIN, G_LOG_LEVEL_MESSAGE,
+			  "MESSAGE_ID", PANEL_STALL_MESSAGE_ID,
+			  "MATE_PANEL_STALL_SOURCE", source,
+			  "MATE_PANEL_STALL_US", duration_string,
+			  "MATE_PANEL_STALL_UNREPORTED", unreported_string,
+			  "MATE_PANEL_STALL_BACKTRACE", backtrace_string ? backtrace_string : "",
+			  "MESSAGE", "Main loop of %s blocked for %" G_GINT64_FORMAT " ms in '%s'"
+			  " (%u more stalls since the last report, up to %" G_GINT64_FORMAT " ms)",
+			  g_get_prgname (), duration / 1000, source,
+			  stall_n_unreported, stall_unreported_max / 1000);
+
+	stall_n_unreported = 0;
+	stall_unreported_max = 0;
+
+	g_free (unreported_string);
+	g_free (duration_string);
+	g_free (backtrace_string);
+}
+
+static gint
+panel_stall_watch_poll (GPollFD *fds,
+			guint    nfds,
+			gint     timeout)
+{
+	gint64 start;
+	gint64 now;
+	gint   retval;
+
+	now = g_get_monotonic_time ();
+
+	g_mutex_lock (&stall_lock);
+	start = stall_dispatch_start;
+	stall_dispatch_start = 0;
+	g_mutex_unlock (&stall_lock);
+
+	/* a nested main loop polls in the middle of a dispatch: the time
+	 * before is a stall too, the time it spends polling is not */
+	if (start && now - start >= stall_threshold)
+		panel_stall_watch_report (now - start);
+
+	retval = stall_default_poll (fds, nfds, timeout);
+
+	g_mutex_lock (&stall_lock);
+	stall_dispatch++;
+	stall_dispatch_start = g_get_monotonic_time ();
+	if (stall_watchdog_waiting)
+		g_cond_signal (&stall_cond);
+	g_mutex_unlock (&stall_lock);
+
+	return retval;
+}
+
+/* Only wakes up when the main loop dispatches, and at most once per
+ * threshold: an idle panel costs it nothing */
+static gpointer
+panel_stall_watch_thread (gpointer data)
+{
+	g_mutex_lock (&stall_lock);
+
+	for (;;) {
+		guint64 dispatch;
+		gint64  deadline;
+
+		stall_watchdog_waiting = TRUE;
+		while (stall_dispatch_start == 0)
+			g_cond_wait (&stall_cond, &stall_lock);
+		stall_watchdog_waiting = FALSE;
+
+		dispatch = stall_dispatch;
+		deadline = stall_dispatch_start + stall_threshold;
+
+		while (g_get_monotonic_time () < deadline)
+			g_cond_wait_until (&stall_cond, &stall_lock, deadline);
+
+		if (stall_dispatch != dispatch || stall_dispatch_start == 0)
+			continue;
+
+#ifdef PANEL_STALL_SIGNAL
+		pthread_kill (stall_main_thread, PANEL_STALL_SIGNAL);
+#endif
+
+		/* one sample per dispatch */
+		stall_watchdog_waiting = TRUE;
+		while (stall_dispatch == dispatch)
+			g_cond_wait (&stall_cond, &stall_lock);
+	}
+
+	g_mutex_unlock (&stall_lock);
+
+	return NULL;
+}
+
+/**
+ * panel_stall_watch_init:
+ *
+ * Starts logging the dispatches of the default main context that take
+ * longer than the threshold. To be called from the thread running the
+ * main loop, before it runs.
+ */
+void
+panel_stall_watch_init (void)
+{
+	static gboolean  initialized = FALSE;
+	const char      *threshold;
+	GThread         *thread;
+
+	if (initialized)
+		return;
+	initialized = TRUE;
+
+	stall_threshold = PANEL_STALL_DEFAULT_THRESHOLD;
+	threshold = g_getenv ("MATE_PANEL_STALL_THRESHOLD");
+	if (threshold)
+		stall_threshold = g_ascii_strtoll (threshold, NULL, 10);
+	if (stall_threshold <= 0)
+		return;
+	stall_threshold *= 1000;
+
+#ifdef PANEL_STALL_SIGNAL
+	{
+		struct sigaction action;
+
+#ifdef HAVE_EXECINFO_H
+		/* loads what backtrace() needs, which is not safe to do in
+		 * a signal handler */
+		backtrace (stall_sample_frames, 1);
+#endif
+
+		memset (&action, 0, sizeof (action));
+		action.sa_handler = panel_stall_watch_sample;
+		action.sa_flags = SA_RESTART;
+		sigemptyset (&action.sa_mask);
+		sigaction (PANEL_STALL_SIGNAL, &action, NULL);
+	}
+#endif
+
+	stall_main_thread = pthread_self ();
+
+	stall_default_poll = g_main_context_get_poll_func (NULL);
+	g_main_context_set_poll_func (NULL, panel_stall_watch_poll);
+
+	thread = g_thread_new ("panel-stall-watch", panel_stall_watch_thread, NULL);
+	g_thread_unref (thread);
+}
@@ -0,0 +1,286 @@
+/*
+ * panel-thumbnail.c: asynchronous image previews, with a thumbnail cache
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Decoding an image to preview it can take a long time: a photo, or a big
+ * SVG picked by mistake. The previews are loaded in the thread pool of GIO
+ * instead, and a request that is not needed anymore is cancelled.
+ *
+ * Previews that fit in a thumbnail are read from, and written to, the
+ * thumbnail cache shared by the desktop (the freedesktop.org thumbnail
+ * managing standard): the original is only decoded once for all the
+ * applications, as long as it does not change.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#include "panel-thumbnail.h"
+
+#define PANEL_THUMBNAIL_NORMAL_SIZE 128
+#define PANEL_THUMBNAIL_LARGE_SIZE  256
+
+typedef struct {
+	char *filename;
+	int   size;
+} PanelThumbnailRequest;
+
+static void
+panel_thumbnail_request_free (PanelThumbnailRequest *request)
+{
+	g_free (request->filename);
+	g_free (request);
+}
+
+static char *
+panel_thumbnail_get_path (const char *uri,
+			  int         thumbnail_size)
+{
+	char *md5;
+	char *basename;
+	char *path;
+
+	md5 = g_compute_checksum_for_string (G_CHECKSUM_MD5, uri, -1);
+	basename = g_strconcat (md5, ".png", NULL);
+
+	path = g_build_filename (g_get_user_cache_dir (),
+				 "thumbnails",
+				 thumbnail_size == PANEL_THUMBNAIL_NORMAL_SIZE ? "normal" : "large",
+				 basename,
+				 NULL);
+
+	g_free (basename);
+	g_free (md5);
+
+	return path;
+}
+
+/* A thumbnail is only valid for the file it was made of, as it was then */
+static GdkPixbuf *
+panel_thumbnail_load_cached (const char *path,
+			     const char *uri,
+			     const char *mtime)
+{
+	GdkPixbuf  *pixbuf;
+	const char *thumb_uri;
+	const char *thumb_mtime;
+
+	pixbuf = gdk_pixbuf_new_from_file (path, NULL);
+	if (!pixbuf)
+		return NULL;
+
+	thumb_uri   = gdk_pixbuf_get_option (pixbuf, "tEXt::Thumb::URI");
+	thumb_mtime = gdk_pixbuf_get_option (pixbuf, "tEXt::Thumb::MTime");
+
+	if (g_strcmp0 (thumb_uri, uri) != 0 ||
+	    g_strcmp0 (thumb_mtime, mtime) != 0) {
+		g_object_unref (pixbuf);
+		return NULL;
+	}
+
+	return pixbuf;
+}
+
+/* Written to a temporary file first, so that no one reads half of it */
+static void
+panel_thumbnail_save (GdkPixbuf  *pixbuf,
+		      const char *path,
+		      const char *uri,
+		      const char *mtime)
+{
+	char *dir;
+	char *tmp_path;
+	int   fd;
+
+	dir = g_path_get_dirname (path);
+	if (g_mkdir_with_parents (dir, 0700) != 0) {
+		g_free (dir);
+		return;
+	}
+	g_free (dir);
+
+	tmp_path = g_strconcat (path, ".XXXXXX", NULL);
+	fd = g_mkstemp_full (tmp_path, O_RDWR, 0600);
+	if (fd < 0) {
+		g_free (tmp_path);
+		return;
+	}
+	close (fd);
+
+	if (gdk_pixbuf_save (pixbuf, tmp_path, "png", NULL,
+			     "tEXt::Thumb::URI", uri,
+			     "tEXt::Thumb::MTime", mtime,
+			     NULL))
+		g_rename (tmp_path, path);
+	else
+		g_unlink (tmp_path);
+
+	g_free (tmp_path);
+}
+
+static GdkPixbuf *
+panel_thumbnail_scale (GdkPixbuf *pixbuf,
+		       int        size)
+{
+	GdkPixbuf *scaled;
+	int        width, height;
+
+	width  = gdk_pixbuf_get_width (pixbuf);
+	height = gdk_pixbuf_get_height (pixbuf);
+
+	if (width <= size && height <= size)
+		return pixbuf;
+
+	if (width > height) {
+		height = MAX (1, height * size / width);
+		width  = size;
+	} else {
+		width  = MAX (1, width * size / height);
+		height = size;
+	}
+
+	scaled = gdk_pixbuf_scale_simple (pixbuf, width, height, GDK_INTERP_BILINEAR);
+	g_object_unref (pixbuf);
+
+	return scaled;
+}
+
+static void
+panel_thumbnail_load_thread (GTask        *task,
+			     gpointer      source_object,
+			     gpointer      task_data,
+			     GCancellable *cancellable)
+{
+	PanelThumbnailRequest *request = task_data;
+	GdkPixbuf             *pixbuf = NULL;
+	GError                *error = NULL;
+	GStatBuf               buf;
+	char                  *uri = NULL;
+	char                  *path = NULL;
+	char                  *mtime = NULL;
+	int                    load_size;
+	int                    width, height;
+
+	if (g_stat (request->filename, &buf) != 0) {
+		int errsv = errno;
+
+		g_task_return_new_error (task, G_IO_ERROR,
+					 g_io_error_from_errno (errsv),
+					 "%s", g_strerror (errsv));
+		return;
+	}
+
+	/* the original is decoded at the size of its thumbnail, so that the
+	 * thumbnail serves all the previews up to that size */
+	load_size = request->size;
+
+	if (request->size <= PANEL_THUMBNAIL_LARGE_SIZE) {
+		load_size = (request->size <= PANEL_THUMBNAIL_NORMAL_SIZE) ?
+			PANEL_THUMBNAIL_NORMAL_SIZE : PANEL_THUMBNAIL_LARGE_SIZE;
+
+		uri = g_filename_to_uri (request->filename, NULL, NULL);
+		if (uri) {
+			path = panel_thumbnail_get_path (uri, load_size);
+			mtime = g_strdup_printf ("%" G_GINT64_FORMAT, (gint64) buf.st_mtime);
+			pixbuf = panel_thumbnail_load_cached (path, uri, mtime);
+		}
+	}
+
+	if (!pixbuf && g_task_return_error_if_cancelled (task))
+		goto out;
+
+	if (!pixbuf) {
+		pixbuf = gdk_pixbuf_new_from_file_at_size (request->filename,
+							   load_size, load_size,
+							   &error);
+		if (!pixbuf) {
+			g_task_return_error (task, error);
+			goto out;
+		}
+
+		/* images that are not bigger than a thumbnail are not
+		 * worth one */
+		if (path &&
+		    gdk_pixbuf_get_file_info (request->filename, &width, &height) &&
+		    (width > load_size || height > load_size))
+			panel_thumbnail_save (pixbuf, path, uri, mtime);
+	}
+
+	g_task_return_pointer (task,
+			       panel_thumbnail_scale (pixbuf, request->size),
+			       g_object_unref);
+
+out:
+	g_free (uri);
+	g_free (path);
+	g_free (mtime);
+}
+
+/**
+ * panel_thumbnail_load_async:
+ * @filename: the image to preview
+ * @size: the size, in pixels, the preview must fit in
+ * @cancellable: a #GCancellable, to drop a request not needed anymore
+ * @callback: called in the thread default main context of the caller
+ * @user_data: data for @callback
+ *
+ * Loads a preview of @filename, keeping its aspect ratio, in a worker
+ * thread.
+ */
+void
+panel_thumbnail_load_async (const char          *filename,
+			    int                  size,
+			    GCancellable        *cancellable,
+			    GAsyncReadyCallback  callback,
+			    gpointer             user_data)
+{
+	PanelThumbnailRequest *request;
+	GTask                 *task;
+
+	g_return_if_fail (filename != NULL);
+	g_return_if_fail (size > 0);
+
+	request = g_new0 (PanelThumbnailRequest, 1);
+	request->filename = g_strdup (filename);
+	request->size = size;
+
+	task = g_task_new (NULL, cancellable, callback, user_data);
+	g_task_set_source_tag (task, panel_thumbnail_load_async);
+	g_task_set_task_data (task, request,
+			      (GDestroyNotify) panel_thumbnail_request_free);
+	/* a cancelled request does not wait for the decoder */
+	g_task_set_return_on_cancel (task, TRUE);
+
+	g_task_run_in_thread (task, panel_thumbnail_load_thread);
+	g_object_unref (task);
+}
+
+GdkPixbuf *
+panel_thumbnail_load_finish (GAsyncResult  *result,
+			     GError       **error)
+{
+	g_return_val_if_fail (g_task_is_valid (result, NULL), NULL);
+
+	return g_task_propagate_pointer (G_TASK (result), error);
+}
@@ -0,0 +1,44 @@
+/*
+ * panel-thumbnail.h: asynchronous image previews, with a thumbnail cache
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef PANEL_THUMBNAIL_H
+#define PANEL_THUMBNAIL_H
+
+#include <gio/gio.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void       panel_thumbnail_load_async  (const char           *filename,
+					int                   size,
+					GCancellable         *cancellable,
+					GAsyncReadyCallback   callback,
+					gpointer              user_data);
+GdkPixbuf *panel_thumbnail_load_finish (GAsyncResult         *result,
+					GError              **error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PANEL_THUMBNAIL_H */
@@ -0,0 +1,225 @@
+/*
+ * panel-trace.c: opt-in timeline tracing
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * The events are kept in memory and dumped in the Trace Event Format
+ * understood by chrome://tracing and Perfetto, so that the file can be
+ * loaded as is. Timestamps come from the monotonic clock.
+ */
+
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "panel-cleanup.h"
+
+#include "panel-trace.h"
+
+typedef struct {
+	const char    *category;
+	char          *name;
+	gconstpointer  id;
+	gint64         timestamp;
+	char           phase;
+	guint          main_thread : 1;
+} PanelTraceEvent;
+
+G_LOCK_DEFINE_STATIC (panel_trace);
+
+static char   *panel_trace_filename = NULL;
+static GArray *panel_trace_events = NULL;
+
+static void
+panel_trace_event_clear (PanelTraceEvent *event)
+{
+	g_free (event->name);
+}
+
+static void
+panel_trace_cleanup (gpointer data)
+{
+	panel_trace_write ();
+
+	g_array_free (panel_trace_events, TRUE);
+	panel_trace_events = NULL;
+
+	g_free (panel_trace_filename);
+	panel_trace_filename = NULL;
+}
+
+void
+panel_trace_init (const char *filename)
+{
+	if (panel_trace_filename)
+		return;
+
+	if (!filename || !filename[0])
+		filename = g_getenv (PANEL_TRACE_ENV);
+
+	if (!filename || !filename[0])
+		return;
+
+	panel_trace_filename = g_strdup (filename);
+	panel_trace_events = g_array_sized_new (FALSE, FALSE,
+						sizeof (PanelTraceEvent), 256);
+	g_array_set_clear_func (panel_trace_events,
+				(GDestroyNotify) panel_trace_event_clear);
+
+	panel_cleanup_register (panel_trace_cleanup, NULL);
+}
+
+gboolean
+panel_trace_is_enabled (void)
+{
+	return panel_trace_filename != NULL;
+}
+
+static void
+panel_trace_add (char           phase,
+		 const char    *category,
+		 const char    *name,
+		 gconstpointer  id)
+{
+	PanelTraceEvent event;
+
+	if (!panel_trace_filename)
+		return;
+
+	event.category    = category;
+	event.name        = g_strdup (name);
+	event.id          = id;
+	event.timestamp   = g_get_monotonic_time ();
+	event.phase       = phase;
+	event.main_thread = g_main_context_is_owner (g_main_context_default ());
+
+	G_LOCK (panel_trace);
+	g_array_append_val (panel_trace_events, event);
+	G_UNLOCK (panel_trace);
+}
+
+void
+panel_trace_begin (const char *category,
+		   const char *name)
+{
+	panel_trace_add ('B', category, name, NULL);
+}
+
+void
+panel_trace_end (const char *category,
+		 const char *name)
+{
+	panel_trace_add ('E', category, name, NULL);
+}
+
+void
+panel_trace_instant (const char *category,
+		     const char *name)
+{
+	panel_trace_add ('i', category, name, NULL);
+}
+
+void
+panel_trace_async_begin (const char    *category,
+			 const char    *name,
+			 gconstpointer  id)
+{
+	panel_trace_add ('b', category, name, id);
+}
+
+void
+panel_trace_async_end (const char    *category,
+		       const char    *name,
+		       gconstpointer  id)
+{
+	panel_trace_add ('e', category, name, id);
+}
+
+static void
+panel_trace_append_string (GString    *json,
+			   const char *str)
+{
+	const char *p;
+
+	g_string_append_c (json, '"');
+
+	for (p = str ? str : ""; *p; p++) {
+		if (*p == '"' || *p == '\\')
+			g_string_append_printf (json, "\\%c", *p);
+		else if ((guchar) *p < 0x20)
+			g_string_append_printf (json, "\\u%04x", (guchar) *p);
+		else
+			g_string_append_c (json, *p);
+	}
+
+	g_string_append_c (json, '"');
+}
+
+void
+panel_trace_write (void)
+{
+	GString *json;
+	GError  *error = NULL;
+	guint    i;
+	pid_t    pid;
+
+	if (!panel_trace_filename)
+		return;
+
+	pid = getpid ();
+	json = g_string_new ("{\"traceEvents\":[\n");
+
+	G_LOCK (panel_trace);
+
+	for (i = 0; i < panel_trace_events->len; i++) {
+		PanelTraceEvent *event;
+
+		event = &g_array_index (panel_trace_events, PanelTraceEvent, i);
+
+		g_string_append (json, "{\"name\":");
+		panel_trace_append_string (json, event->name);
+		g_string_append (json, ",\"cat\":");
+		panel_trace_append_string (json, event->category);
+		g_string_append_printf (json,
+					",\"ph\":\"%c\",\"ts\":%" G_GINT64_FORMAT
+					",\"pid\":%d,\"tid\":%d",
+					event->phase, event->timestamp,
+					(int) pid, event->main_thread ? 1 : 2);
+
+		if (event->phase == 'b' || event->phase == 'e')
+			g_string_append_printf (json, ",\"id\":\"%p\"", event->id);
+		else if (event->phase == 'i')
+			g_string_append (json, ",\"s\":\"p\"");
+
+		g_string_append (json, i + 1 < panel_trace_events->len ? "},\n" : "}\n");
+	}
+
+	G_UNLOCK (panel_trace);
+
+	g_string_append (json, "],\"displayTimeUnit\":\"ms\"}\n");
+
+	if (!g_file_set_contents (panel_trace_filename, json->str, json->len, &error)) {
+		g_warning ("Cannot write trace to '%s': %s",
+			   panel_trace_filename, error->message);
+		g_error_free (error);
+	}
+
+	g_string_free (json, TRUE);
+}
@@ -0,0 +1,56 @@
+/*
+ * panel-trace.h: opt-in timeline tracing
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef PANEL_TRACE_H
+#define PANEL_TRACE_H
+
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Name of the environment variable used when no file is given to
+ * panel_trace_init() */
+#define PANEL_TRACE_ENV "MATE_PANEL_TRACE"
+
+void     panel_trace_init        (const char    *filename);
+gboolean panel_trace_is_enabled  (void);
+void     panel_trace_write       (void);
+
+void     panel_trace_begin       (const char    *category,
+				  const char    *name);
+void     panel_trace_end         (const char    *category,
+				  const char    *name);
+void     panel_trace_instant     (const char    *category,
+				  const char    *name);
+void     panel_trace_async_begin (const char    *category,
+				  const char    *name,
+				  gconstpointer  id);
+void     panel_trace_async_end   (const char    *category,
+				  const char    *name,
+				  gconstpointer  id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PANEL_TRACE_H */
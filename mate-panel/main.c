@@ -20,6 +20,8 @@
 
 #include <libpanel-util/panel-cleanup.h>
 #include <libpanel-util/panel-glib.h>
+#include <libpanel-util/panel-stall-watch.h>
+#include <libpanel-util/panel-trace.h>
 
 #include "panel-profile.h"
 #include "panel-config-global.h"
@@ -29,9 +31,15 @@
 #include "panel-schemas.h"
 #include "panel-stock-icons.h"
 #include "panel-lockdown.h"
+#include "panel-power.h"
+#include "panel-a11y.h"
+#include "panel-theme.h"
 #include "panel-icon-names.h"
 #include "panel-reset.h"
 #include "panel-run-dialog.h"
+#include "panel-menu-benchmark.h"
+#include "panel-search-benchmark.h"
+#include "panel-interaction-benchmark.h"
 
 #ifdef HAVE_X11
 #include "panel-action-protocol.h"
@@ -50,6 +58,10 @@ static char*    layout;
 static gboolean replace = FALSE;
 static gboolean reset = FALSE;
 static gboolean run_dialog = FALSE;
+static char*    trace_file = NULL;
+static char*    benchmark_menus = NULL;
+static int      benchmark_search = 0;
+static char*    benchmark_interactions = NULL;
 
 static const GOptionEntry options[] = {
   { "replace", 0, 0, G_OPTION_ARG_NONE, &replace, N_("Replace a currently running panel"), NULL },
@@ -59,6 +71,14 @@ static const GOptionEntry options[] = {
   { "run-dialog", 0, 0, G_OPTION_ARG_NONE, &run_dialog, N_("Execute the run dialog"), NULL },
   /* default panels layout */
   { "layout", 0, 0, G_OPTION_ARG_STRING, &layout, N_("Set the default panel layout"), NULL },
+  /* startup timeline, can also be enabled with MATE_PANEL_TRACE */
+  { "trace", 0, 0, G_OPTION_ARG_FILENAME, &trace_file, N_("Write a timeline of the panel startup to FILE"), N_("FILE") },
+  /* measure the menus on a synthetic tree and exit */
+  { "benchmark-menus", 0, 0, G_OPTION_ARG_STRING, &benchmark_menus, N_("Measure the construction of a menu with CATEGORIES categories of ENTRIES entries and print the results"), N_("CATEGORIESxENTRIES") },
+  /* measure the case insensitive search of the dialog filters and exit */
+  { "benchmark-search", 0, 0, G_OPTION_ARG_INT, &benchmark_search, N_("Measure the search of the dialog filters in STRINGS strings and print the results"), N_("STRINGS") },
+  /* replay interactions with the running panel and exit */
+  { "benchmark-interactions", 0, 0, G_OPTION_ARG_FILENAME, &benchmark_interactions, N_("Replay the interactions of SCRIPT, or of a default sequence, and print how long the frames took"), N_("SCRIPT|default") },
   { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
 };
 
@@ -126,6 +146,10 @@ main (int argc, char **argv)
 
 	g_option_context_free (context);
 
+	panel_trace_init (trace_file);
+	panel_trace_instant ("main", "main");
+	panel_stall_watch_init ();
+
 	/* set the default layout */
 	if (layout != NULL && layout[0] != 0)
 	{
@@ -163,6 +187,26 @@ main (int argc, char **argv)
 		return 0;
 	}
 
+	/* run the search benchmark and exit */
+	if (benchmark_search != 0)
+		return panel_search_benchmark_run (benchmark_search);
+
+	/* run the menu benchmark and exit */
+	if (benchmark_menus != NULL)
+	{
+		int retval;
+
+		panel_init_stock_icons_and_items ();
+		panel_multimonitor_init ();
+		panel_global_config_load ();
+		panel_lockdown_init ();
+		panel_profile_settings_load ();
+		retval = panel_menu_benchmark_run (benchmark_menus);
+		panel_lockdown_finalize ();
+		panel_cleanup_do ();
+		return retval;
+	}
+
 	if (!egg_get_desktop_file ()) {
 		g_set_application_name (_("Panel"));
 		gtk_window_set_default_icon_name (PANEL_ICON_PANEL);
@@ -185,6 +229,9 @@ main (int argc, char **argv)
 
 	panel_global_config_load ();
 	panel_lockdown_init ();
+	panel_power_init ();
+	panel_a11y_init ();
+	panel_theme_init ();
 	panel_profile_load ();
 
 	/*add forbidden lists to ALL panels*/
@@ -220,11 +267,22 @@ main (int argc, char **argv)
 
 	g_object_unref (provider);
 
+	/* replays the interactions once the applets are loaded, then quits */
+	if (benchmark_interactions != NULL &&
+	    !panel_interaction_benchmark_start (benchmark_interactions)) {
+		panel_lockdown_finalize ();
+		panel_cleanup_do_for_exit ();
+		return 1;
+	}
+
 	gtk_main ();
 
 	panel_lockdown_finalize ();
 
-	panel_cleanup_do ();
+	panel_cleanup_do_for_exit ();
+
+	if (benchmark_interactions != NULL)
+		return panel_interaction_benchmark_get_status ();
 
 	return 0;
 }
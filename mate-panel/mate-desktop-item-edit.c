@@ -19,25 +19,17 @@ gboolean panel_global_config_get_tooltips_enabled (void) { return FALSE; }
 #include "panel-lockdown.h"
 gboolean panel_lockdown_get_disable_lock_screen (void) { return FALSE; }
 
-static int dialogs = 0;
-static gboolean create_new = FALSE;
-static char **desktops = NULL;
+/* The editors are windows of one application: launching this again while
+ * an editor is open hands the files to the running instance over D-Bus,
+ * and the new process exits without even initializing GTK+. */
+#define DESKTOP_ITEM_EDIT_APPLICATION_ID "org.mate.panel.DesktopItemEdit"
 
 static GOptionEntry options[] = {
-	{ "create-new", 0, 0, G_OPTION_ARG_NONE, &create_new, N_("Create new file in the given directory"), NULL },
-	{ G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &desktops, NULL, N_("[FILE...]") },
+	{ "create-new", 0, 0, G_OPTION_ARG_NONE, NULL, N_("Create new file in the given directory"), NULL },
+	{ G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, NULL, NULL, N_("[FILE...]") },
 	{ NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
 };
 
-static void
-dialog_destroyed (GtkWidget *dialog, gpointer data)
-{
-	dialogs --;
-
-	if (dialogs <= 0)
-		gtk_main_quit ();
-}
-
 static void
 validate_for_filename (char *file)
 {
@@ -92,133 +84,176 @@ error_reported (GtkWidget  *dialog,
 			    primary, secondary);
 }
 
-int
-main (int argc, char * argv[])
+static GtkWidget *
+edit_file (GApplicationCommandLine *command_line,
+	   GFile                   *file,
+	   gboolean                 create_new)
 {
-	GError *error = NULL;
-	int i;
-
-	bindtextdomain (GETTEXT_PACKAGE, MATELOCALEDIR);
-	bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
-	textdomain (GETTEXT_PACKAGE);
+	GFileInfo *info;
+	char      *uri;
+	char      *path;
+	char      *basename;
+	GtkWidget *dlg = NULL;
+
+	uri  = g_file_get_uri (file);
+	path = g_file_get_path (file);
+	basename = g_file_get_basename (file);
+	info = g_file_query_info (file, "standard::type",
+				  G_FILE_QUERY_INFO_NONE, NULL, NULL);
+
+	if (info) {
+		GFileType type = g_file_info_get_file_type (info);
+
+		if (type == G_FILE_TYPE_DIRECTORY && create_new) {
+
+			dlg = panel_ditem_editor_new (NULL, NULL, NULL,
+						     _("Create Launcher"));
+			g_object_set_data_full (G_OBJECT (dlg), "dir",
+						g_strdup (path),
+						(GDestroyNotify)g_free);
+
+			panel_ditem_register_save_uri_func (PANEL_DITEM_EDITOR (dlg),
+							    find_uri_on_save,
+							    NULL);
+
+		} else if (type == G_FILE_TYPE_DIRECTORY) {
+			GFile *directory;
+
+			/* Edit the .directory file instead */
+			directory = g_file_get_child (file, ".directory");
+			dlg = edit_file (command_line, directory, create_new);
+			g_object_unref (directory);
+		} else if (type == G_FILE_TYPE_REGULAR
+			   && g_str_has_suffix (basename, ".directory")
+			   && !create_new) {
+			dlg = panel_ditem_editor_new_directory (NULL,
+								NULL,
+								uri,
+								_("Directory Properties"));
+		} else if (type == G_FILE_TYPE_REGULAR
+			   && g_str_has_suffix (basename, ".desktop")
+			   && !create_new) {
+			dlg = panel_ditem_editor_new (NULL, NULL, uri,
+						      _("Launcher Properties"));
+		} else if (type == G_FILE_TYPE_REGULAR
+			   && create_new) {
+			g_application_command_line_printerr (command_line,
+							     "mate-desktop-item-edit: %s "
+							     "already exists\n", uri);
+		} else {
+			g_application_command_line_printerr (command_line,
+							     "mate-desktop-item-edit: %s "
+							     "does not look like a desktop "
+							     "item\n", uri);
+		}
 
-	if (!gtk_init_with_args (&argc, &argv,
-	                         _("- Edit .desktop files"),
-	                         options,
-	                         GETTEXT_PACKAGE,
-	                         &error)) {
-		g_printerr ("%s\n", error->message);
-		g_error_free (error);
-		return 1;
+		g_object_unref (info);
+
+	} else if (g_str_has_suffix (basename, ".directory")) {
+		/* a non-existant file.  Well we can still edit that
+		 * sort of.  We will just create it new */
+		dlg = panel_ditem_editor_new_directory (NULL, NULL, uri,
+							_("Directory Properties"));
+
+	} else if (g_str_has_suffix (basename, ".desktop")) {
+		/* a non-existant file.  Well we can still edit that
+		 * sort of.  We will just create it new */
+		dlg = panel_ditem_editor_new (NULL, NULL, uri,
+					      _("Create Launcher"));
+
+	} else {
+		g_application_command_line_printerr (command_line,
+						     "mate-desktop-item-edit: %s does not "
+						     "have a .desktop or .directory "
+						     "suffix\n", uri);
 	}
 
-	gtk_window_set_default_icon_name (PANEL_ICON_LAUNCHER);
+	g_free (basename);
+	g_free (uri);
+	g_free (path);
+
+	return dlg;
+}
+
+static int
+command_line_cb (GApplication            *application,
+		 GApplicationCommandLine *command_line,
+		 gpointer                 data)
+{
+	GVariantDict  *options_dict;
+	const char   **desktops = NULL;
+	gboolean       create_new = FALSE;
+	int            i;
+
+	options_dict = g_application_command_line_get_options_dict (command_line);
+	g_variant_dict_lookup (options_dict, "create-new", "b", &create_new);
+	g_variant_dict_lookup (options_dict, G_OPTION_REMAINING, "^a&ay", &desktops);
 
 	if (desktops == NULL ||
 	    desktops[0] == NULL) {
-		g_printerr ("mate-desktop-item-edit: no file to edit\n");
+		g_application_command_line_printerr (command_line,
+						     "mate-desktop-item-edit: no file to edit\n");
+		g_free (desktops);
 		return 0;
 	}
 
 	for (i = 0; desktops[i] != NULL; i++) {
 		GFile     *file;
-		GFileInfo *info;
-		char      *uri;
-		char      *path;
-		GtkWidget *dlg = NULL;
-
-		file = g_file_new_for_commandline_arg (desktops[i]);
-		uri  = g_file_get_uri (file);
-		path = g_file_get_path (file);
-		info = g_file_query_info (file, "standard::type",
-					  G_FILE_QUERY_INFO_NONE, NULL, NULL);
-		g_object_unref (file);
+		GtkWidget *dlg;
 
-		if (info) {
-			GFileType type = g_file_info_get_file_type (info);
-
-			if (type == G_FILE_TYPE_DIRECTORY && create_new) {
-
-				dlg = panel_ditem_editor_new (NULL, NULL, NULL,
-							     _("Create Launcher"));
-				g_object_set_data_full (G_OBJECT (dlg), "dir",
-							g_strdup (path),
-							(GDestroyNotify)g_free);
-
-				panel_ditem_register_save_uri_func (PANEL_DITEM_EDITOR (dlg),
-								    find_uri_on_save,
-								    NULL);
-
-			} else if (type == G_FILE_TYPE_DIRECTORY) {
-				/* Rerun this iteration with the .directory
-				 * file
-				 * Note: No need to free, for one we can't free
-				 * an individual member of desktops and
-				 * secondly we will soon exit */
-			        desktops[i] = g_build_path ("/", uri,
-							    ".directory", NULL);
-				i--;
-			} else if (type == G_FILE_TYPE_REGULAR
-				   && g_str_has_suffix (desktops [i],
-					   		".directory")
-				   && !create_new) {
-				dlg = panel_ditem_editor_new_directory (NULL,
-									NULL,
-									uri,
-									_("Directory Properties"));
-			} else if (type == G_FILE_TYPE_REGULAR
-				   && g_str_has_suffix (desktops [i],
-					   		".desktop")
-				   && !create_new) {
-				dlg = panel_ditem_editor_new (NULL, NULL, uri,
-							      _("Launcher Properties"));
-			} else if (type == G_FILE_TYPE_REGULAR
-				   && create_new) {
-				g_printerr ("mate-desktop-item-edit: %s "
-					    "already exists\n", uri);
-			} else {
-				g_printerr ("mate-desktop-item-edit: %s "
-					    "does not look like a desktop "
-					    "item\n", uri);
-			}
-
-			g_object_unref (info);
-
-		} else if (g_str_has_suffix (desktops [i], ".directory")) {
-			/* a non-existant file.  Well we can still edit that
-			 * sort of.  We will just create it new */
-			dlg = panel_ditem_editor_new_directory (NULL, NULL, uri,
-								_("Directory Properties"));
-
-		} else if (g_str_has_suffix (desktops [i], ".desktop")) {
-			/* a non-existant file.  Well we can still edit that
-			 * sort of.  We will just create it new */
-			dlg = panel_ditem_editor_new (NULL, NULL, uri,
-						      _("Create Launcher"));
-
-		} else {
-			g_printerr ("mate-desktop-item-edit: %s does not "
-				    "have a .desktop or .directory "
-				    "suffix\n", uri);
-		}
+		file = g_application_command_line_create_file_for_arg (command_line,
+								       desktops[i]);
+		dlg = edit_file (command_line, file, create_new);
+		g_object_unref (file);
 
 		if (dlg != NULL) {
-			dialogs ++;
-			g_signal_connect (dlg, "destroy",
-			                  G_CALLBACK (dialog_destroyed),
-			                  NULL);
+			/* the application runs as long as it has windows */
+			gtk_application_add_window (GTK_APPLICATION (application),
+						    GTK_WINDOW (dlg));
 			g_signal_connect (dlg, "error-reported",
 			                  G_CALLBACK (error_reported),
 			                  NULL);
-			gtk_widget_show (dlg);
+			gtk_window_present (GTK_WINDOW (dlg));
 		}
-
-		g_free (uri);
-		g_free (path);
 	}
 
-	if (dialogs > 0)
-		gtk_main ();
+	g_free (desktops);
+
+	return 0;
+}
+
+static void
+startup_cb (GApplication *application,
+	    gpointer      data)
+{
+	gtk_window_set_default_icon_name (PANEL_ICON_LAUNCHER);
+}
+
+int
+main (int argc, char * argv[])
+{
+	GtkApplication *application;
+	int             retval;
+
+	bindtextdomain (GETTEXT_PACKAGE, MATELOCALEDIR);
+	bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
+	textdomain (GETTEXT_PACKAGE);
+
+	application = gtk_application_new (DESKTOP_ITEM_EDIT_APPLICATION_ID,
+					   G_APPLICATION_HANDLES_COMMAND_LINE);
+	g_application_add_main_option_entries (G_APPLICATION (application), options);
+#if GLIB_CHECK_VERSION(2,56,0)
+	g_application_set_option_context_parameter_string (G_APPLICATION (application),
+							   _("- Edit .desktop files"));
+#endif
+
+	g_signal_connect (application, "startup",
+			  G_CALLBACK (startup_cb), NULL);
+	g_signal_connect (application, "command-line",
+			  G_CALLBACK (command_line_cb), NULL);
+
+	retval = g_application_run (G_APPLICATION (application), argc, argv);
+	g_object_unref (application);
 
-        return 0;
+	return retval;
 }
@@ -36,6 +36,9 @@
 #include <matemenu-tree.h>
 
 #include <libpanel-util/panel-keyfile.h>
+#include <libpanel-util/panel-perf.h>
+#include <libpanel-util/panel-scheduler.h>
+#include <libpanel-util/panel-trace.h>
 #include <libpanel-util/panel-xdg.h>
 
 #include "launcher.h"
@@ -48,17 +51,21 @@
 #include "panel-profile.h"
 #include "panel-menu-button.h"
 #include "panel-menu-items.h"
+#include "panel-menu-index.h"
 #include "panel-globals.h"
 #include "panel-run-dialog.h"
 #include "panel-lockdown.h"
 #include "panel-icon-names.h"
 #include "panel-schemas.h"
+#include "panel-theme.h"
 
 static GtkWidget *populate_menu_from_directory (GtkWidget          *menu,
 						MateMenuTreeDirectory *directory);
 
 static gboolean panel_menu_key_press_handler (GtkWidget   *widget,
 					      GdkEventKey *event);
+static void menu_icon_prioritize (GtkWidget *menu,
+				  gpointer   data);
 
 static inline gboolean desktop_is_home_dir(void)
 {
@@ -172,6 +179,9 @@ panel_create_menu (void)
 	g_signal_connect (retval, "key-press-event",
 			  G_CALLBACK (panel_menu_key_press_handler),
 			  NULL);
+	g_signal_connect_after (retval, "show",
+				G_CALLBACK (menu_icon_prioritize),
+				NULL);
 
 	return retval;
 }
@@ -586,6 +596,54 @@ menu_dummy_button_press_event (GtkWidget      *menuitem,
 	return FALSE;
 }
 
+static void
+panel_menu_add_widget_size (GtkWidget *widget,
+			    gpointer   data)
+{
+	guint64   *sizes = data;
+	GTypeQuery query;
+
+	g_type_query (G_OBJECT_TYPE (widget), &query);
+	sizes[0]++;
+	sizes[1] += query.instance_size;
+
+	if (GTK_IS_IMAGE (widget) &&
+	    gtk_image_get_storage_type (GTK_IMAGE (widget)) == GTK_IMAGE_PIXBUF) {
+		GdkPixbuf *pixbuf = gtk_image_get_pixbuf (GTK_IMAGE (widget));
+
+		sizes[1] += gdk_pixbuf_get_byte_length (pixbuf);
+	}
+
+	if (GTK_IS_MENU_ITEM (widget)) {
+		GtkWidget *submenu = gtk_menu_item_get_submenu (GTK_MENU_ITEM (widget));
+
+		if (submenu)
+			panel_menu_add_widget_size (submenu, sizes);
+	}
+
+	if (GTK_IS_CONTAINER (widget))
+		gtk_container_forall (GTK_CONTAINER (widget),
+				      panel_menu_add_widget_size, sizes);
+}
+
+/* An estimate of what a built menu costs: the widget instances, and the
+ * icons set as pixbufs; the icons loaded from the theme are shared. */
+void
+panel_menu_get_memory_size (GtkWidget *menu,
+			    guint     *n_widgets,
+			    guint64   *bytes)
+{
+	guint64 sizes[2] = { 0, 0 };
+
+	if (menu)
+		panel_menu_add_widget_size (menu, sizes);
+
+	if (n_widgets)
+		*n_widgets = sizes[0];
+	if (bytes)
+		*bytes = sizes[1];
+}
+
 static gboolean
 menuitem_button_press_event (GtkWidget      *menuitem,
 			     GdkEventButton *event)
@@ -712,6 +770,313 @@ menu_escape_underscores_and_prepend (const char *text)
 	return g_string_free (escaped_text, FALSE);
 }
 
+/* Menu item icons are loaded in the background, so that showing a menu for
+ * the first time does not wait for the icon theme: items get an empty image
+ * of the right size, which is filled once the icon is loaded. The images of
+ * the menu being shown go first, and loaded icons are shared by all the
+ * items showing them. */
+
+#define MENU_ICON_MAX_LOADS 4
+
+typedef struct {
+	GIcon *gicon;
+	int    size;
+	GList *link;   /* in menu_icon_queue while waiting */
+} MenuIconRequest;
+
+typedef struct {
+	GtkWidget       *image;
+	MenuIconRequest *request;
+	char            *key;
+	int              scale;
+	guint            theme_gen;
+} MenuIconLoad;
+
+static GQueue      menu_icon_queue = G_QUEUE_INIT;
+static guint       menu_icon_queue_id = 0;
+static int         menu_icon_loads = 0;
+static GHashTable *menu_icon_cache = NULL;
+static GHashTable *menu_icon_images = NULL;
+/* bumped when the icon theme changes: older loads are dropped */
+static guint       menu_icon_theme_gen = 0;
+
+static void menu_icon_queue_image (GtkWidget *image);
+
+static char *
+menu_icon_make_key (GIcon *gicon,
+		    int    size,
+		    int    scale)
+{
+	char *icon;
+	char *key;
+
+	icon = g_icon_to_string (gicon);
+	if (!icon)
+		return NULL;
+
+	key = g_strdup_printf ("%d@%d:%s", size, scale, icon);
+	g_free (icon);
+
+	return key;
+}
+
+static void
+menu_icon_request_free (MenuIconRequest *request)
+{
+	if (request->link)
+		g_queue_delete_link (&menu_icon_queue, request->link);
+
+	g_object_unref (request->gicon);
+	g_free (request);
+}
+
+static void
+menu_icon_theme_changed (gpointer data)
+{
+	GHashTableIter iter;
+	gpointer       image;
+
+	menu_icon_theme_gen++;
+	g_hash_table_remove_all (menu_icon_cache);
+
+	g_hash_table_iter_init (&iter, menu_icon_images);
+	while (g_hash_table_iter_next (&iter, &image, NULL))
+		menu_icon_queue_image (image);
+}
+
+static gboolean
+menu_icon_set_from_cache (GtkWidget  *image,
+			  const char *key)
+{
+	cairo_surface_t *surface;
+
+	surface = g_hash_table_lookup (menu_icon_cache, key);
+	if (!surface)
+		return FALSE;
+
+	gtk_image_set_from_surface (GTK_IMAGE (image), surface);
+
+	return TRUE;
+}
+
+/* What gtk_image_set_from_gicon() shows for an icon it cannot find */
+static void
+menu_icon_set_fallback (GtkWidget *image)
+{
+	GtkIconSize icon_size;
+
+	g_object_get (image, "icon-size", &icon_size, NULL);
+	gtk_image_set_from_icon_name (GTK_IMAGE (image), PANEL_ICON_UNKNOWN,
+				      icon_size);
+}
+
+static gboolean menu_icon_queue_dispatch (gpointer data);
+
+static void
+menu_icon_loaded_cb (GObject      *source_object,
+		     GAsyncResult *result,
+		     gpointer      user_data)
+{
+	MenuIconLoad *load = user_data;
+	GdkPixbuf    *pixbuf;
+
+	menu_icon_loads--;
+
+	pixbuf = gtk_icon_info_load_icon_finish (GTK_ICON_INFO (source_object),
+						 result, NULL);
+
+	/* loaded from the old theme: the image was queued again since */
+	if (load->theme_gen != menu_icon_theme_gen) {
+		g_clear_object (&pixbuf);
+	} else if (pixbuf) {
+		cairo_surface_t *surface;
+
+		surface = gdk_cairo_surface_create_from_pixbuf (pixbuf, load->scale, NULL);
+		g_hash_table_replace (menu_icon_cache, g_strdup (load->key), surface);
+		g_object_unref (pixbuf);
+
+		/* the image may have been given another icon in the meantime */
+		if (g_object_get_data (G_OBJECT (load->image), "panel-menu-icon-request") == load->request)
+			gtk_image_set_from_surface (GTK_IMAGE (load->image), surface);
+	} else if (g_object_get_data (G_OBJECT (load->image), "panel-menu-icon-request") == load->request) {
+		menu_icon_set_fallback (load->image);
+	}
+
+	g_object_unref (load->image);
+	g_free (load->key);
+	g_free (load);
+
+	if (menu_icon_queue_id == 0 && !g_queue_is_empty (&menu_icon_queue))
+		menu_icon_queue_id = panel_scheduler_add (PANEL_SCHEDULER_PRIORITY_DEFAULT,
+							  "menu-icons",
+							  menu_icon_queue_dispatch,
+							  NULL, NULL);
+}
+
+static void
+menu_icon_load (GtkWidget *image)
+{
+	MenuIconRequest *request;
+	MenuIconLoad    *load;
+	GtkIconInfo     *info;
+	char            *key;
+	int              scale;
+
+	request = g_object_get_data (G_OBJECT (image), "panel-menu-icon-request");
+	scale = gtk_widget_get_scale_factor (image);
+
+	key = menu_icon_make_key (request->gicon, request->size, scale);
+	if (menu_icon_set_from_cache (image, key)) {
+		g_free (key);
+		return;
+	}
+
+	info = gtk_icon_theme_lookup_by_gicon_for_scale (gtk_icon_theme_get_for_screen (gtk_widget_get_screen (image)),
+							 request->gicon,
+							 request->size, scale,
+							 GTK_ICON_LOOKUP_FORCE_SIZE);
+	if (!info) {
+		g_free (key);
+		menu_icon_set_fallback (image);
+		return;
+	}
+
+	load = g_new0 (MenuIconLoad, 1);
+	load->image = g_object_ref (image);
+	load->request = request;
+	load->key = key;
+	load->scale = scale;
+	load->theme_gen = menu_icon_theme_gen;
+
+	menu_icon_loads++;
+	gtk_icon_info_load_icon_async (info, NULL, menu_icon_loaded_cb, load);
+	g_object_unref (info);
+}
+
+static gboolean
+menu_icon_queue_dispatch (gpointer data)
+{
+	menu_icon_queue_id = 0;
+
+	while (menu_icon_loads < MENU_ICON_MAX_LOADS &&
+	       !g_queue_is_empty (&menu_icon_queue)) {
+		GtkWidget       *image;
+		MenuIconRequest *request;
+
+		image = g_queue_pop_head (&menu_icon_queue);
+		request = g_object_get_data (G_OBJECT (image), "panel-menu-icon-request");
+		request->link = NULL;
+
+		menu_icon_load (image);
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+menu_icon_queue_image (GtkWidget *image)
+{
+	MenuIconRequest *request;
+	char            *key;
+
+	request = g_object_get_data (G_OBJECT (image), "panel-menu-icon-request");
+	if (request->link)
+		return;
+
+	/* icons already loaded for another item are used right away */
+	key = menu_icon_make_key (request->gicon, request->size,
+				  gtk_widget_get_scale_factor (image));
+	if (menu_icon_set_from_cache (image, key)) {
+		g_free (key);
+		return;
+	}
+	g_free (key);
+
+	g_queue_push_tail (&menu_icon_queue, image);
+	request->link = menu_icon_queue.tail;
+
+	if (menu_icon_queue_id == 0)
+		menu_icon_queue_id = panel_scheduler_add (PANEL_SCHEDULER_PRIORITY_DEFAULT,
+							  "menu-icons",
+							  menu_icon_queue_dispatch,
+							  NULL, NULL);
+}
+
+/* Runs after the menu got its items: their icons are loaded first */
+static void
+menu_icon_prioritize (GtkWidget *menu,
+		      gpointer   data)
+{
+	GList *l;
+	GList *next;
+
+	for (l = menu_icon_queue.head; l; l = next) {
+		GtkWidget *image = l->data;
+
+		next = l->next;
+
+		if (gtk_widget_get_ancestor (image, GTK_TYPE_MENU) != menu)
+			continue;
+
+		g_queue_unlink (&menu_icon_queue, l);
+		g_queue_push_head_link (&menu_icon_queue, l);
+	}
+}
+
+static void
+menu_icon_image_destroyed (GtkWidget *image,
+			   gpointer   data)
+{
+	g_hash_table_remove (menu_icon_images, image);
+	g_object_set_data (G_OBJECT (image), "panel-menu-icon-request", NULL);
+}
+
+static void
+menu_icon_set_image (GtkWidget   *image,
+		     GIcon       *gicon,
+		     GtkIconSize  icon_size)
+{
+	MenuIconRequest *request;
+	int              width, height;
+	char            *key;
+
+	g_object_set (image, "icon-size", icon_size, NULL);
+
+	if (!gicon)
+		return;
+
+	/* icons that cannot be named are not worth sharing */
+	key = menu_icon_make_key (gicon, 0, 0);
+	if (!key || !gtk_icon_size_lookup (icon_size, &width, &height)) {
+		g_free (key);
+		gtk_image_set_from_gicon (GTK_IMAGE (image), gicon, icon_size);
+		return;
+	}
+	g_free (key);
+
+	gtk_widget_set_size_request (image, width, height);
+
+	if (!menu_icon_cache) {
+		menu_icon_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+							 g_free,
+							 (GDestroyNotify) cairo_surface_destroy);
+		menu_icon_images = g_hash_table_new (g_direct_hash, g_direct_equal);
+		panel_theme_notify_add (G_CALLBACK (menu_icon_theme_changed), NULL);
+	}
+
+	request = g_new0 (MenuIconRequest, 1);
+	request->gicon = g_object_ref (gicon);
+	request->size = MIN (width, height);
+	g_object_set_data_full (G_OBJECT (image), "panel-menu-icon-request",
+				request, (GDestroyNotify) menu_icon_request_free);
+
+	g_hash_table_add (menu_icon_images, image);
+	g_signal_connect (image, "destroy",
+			  G_CALLBACK (menu_icon_image_destroyed), NULL);
+
+	menu_icon_queue_image (image);
+}
+
 void
 setup_menuitem_with_icon (GtkWidget   *menuitem,
 			  GtkIconSize  icon_size,
@@ -723,14 +1088,13 @@ setup_menuitem_with_icon (GtkWidget   *menuitem,
 	GIcon *icon = NULL;
 
 	image = gtk_image_new ();
-	g_object_set (image, "icon-size", icon_size, NULL);
 
 	if (gicon)
 		icon = g_object_ref (gicon);
 	else if (image_filename)
 		icon = panel_gicon_from_icon_name (image_filename);
 
-	gtk_image_set_from_gicon (GTK_IMAGE(image), icon, icon_size);
+	menu_icon_set_image (image, icon, icon_size);
 	g_clear_object (&icon);
 
 	gtk_widget_show (image);
@@ -863,8 +1227,6 @@ submenu_to_display (GtkWidget *menu)
 	if (!g_object_get_data (G_OBJECT (menu), "panel-menu-needs-loading"))
 		return;
 
-	g_object_set_data (G_OBJECT (menu), "panel-menu-needs-loading", NULL);
-
 	MateMenuTreeDirectory *directory =
 		g_object_get_data (G_OBJECT (menu),
 		                   "panel-menu-tree-directory");
@@ -875,6 +1237,8 @@ submenu_to_display (GtkWidget *menu)
 		if (!menu_path)
 			return;
 
+		/* the tree is still being loaded: the menu will be
+		 * populated once it is ready */
 		MateMenuTree *tree =
 			g_object_get_data (G_OBJECT (menu),
 			                   "panel-menu-tree");
@@ -889,9 +1253,17 @@ submenu_to_display (GtkWidget *menu)
 					(GDestroyNotify) matemenu_tree_item_unref);
 	}
 
-	if (directory)
+	g_object_set_data (G_OBJECT (menu), "panel-menu-needs-loading", NULL);
+
+	if (directory) {
+		gint64 start = g_get_monotonic_time ();
+
 		populate_menu_from_directory (menu, directory);
 
+		panel_perf_count ("menu-builds", 1);
+		panel_perf_record ("menu-build-us", g_get_monotonic_time () - start);
+	}
+
 	append_callback = g_object_get_data (G_OBJECT (menu),
 					     "panel-menu-append-callback");
 	append_data     = g_object_get_data (G_OBJECT (menu),
@@ -920,6 +1292,12 @@ remove_submenu_to_display_idle (gpointer data)
 	g_source_remove (idle_id);
 }
 
+static void
+remove_submenu_to_display_task (gpointer data)
+{
+	panel_scheduler_remove (GPOINTER_TO_UINT (data));
+}
+
 static GtkWidget *
 create_fake_menu (MateMenuTreeDirectory *directory)
 {
@@ -940,14 +1318,15 @@ create_fake_menu (MateMenuTreeDirectory *directory)
 	g_signal_connect (menu, "show",
 			  G_CALLBACK (submenu_to_display), NULL);
 
-	idle_id = g_idle_add_full (G_PRIORITY_LOW,
-				   submenu_to_display_in_idle,
-				   menu,
-				   NULL);
+	idle_id = panel_scheduler_add (PANEL_SCHEDULER_PRIORITY_LOW,
+				       "menu-fill-submenu",
+				       submenu_to_display_in_idle,
+				       menu,
+				       NULL);
 	g_object_set_data_full (G_OBJECT (menu),
 				"panel-menu-idle-id",
 				GUINT_TO_POINTER (idle_id),
-				remove_submenu_to_display_idle);
+				remove_submenu_to_display_task);
 
 	g_signal_connect (menu, "button-press-event",
 			  G_CALLBACK (menu_dummy_button_press_event), NULL);
@@ -1043,7 +1422,7 @@ create_header (GtkWidget       *menu,
 			  G_CALLBACK (gtk_false), NULL);
 }
 
-static void
+static GtkWidget *
 create_menuitem (GtkWidget          *menu,
 		 MateMenuTreeEntry     *entry,
 		 MateMenuTreeDirectory *alias_directory)
@@ -1137,6 +1516,8 @@ create_menuitem (GtkWidget          *menu,
 			  G_CALLBACK (activate_app_def), entry);
 
 	gtk_widget_show (menuitem);
+
+	return menuitem;
 }
 
 static void
@@ -1165,49 +1546,466 @@ create_menuitem_from_alias (GtkWidget      *menu,
 	}
 }
 
+/* Menu trees are loaded in a worker thread, so that parsing all the
+ * .desktop files does not block the main loop. A loaded tree is never
+ * reloaded: when it changes, a new tree is loaded in the background and
+ * replaces the old one once it is ready, so opening the menu only has to
+ * create the widgets.
+ *
+ * All the menus showing the same menu file share one tree, and so one load
+ * and one monitor. Shares are kept for the lifetime of the panel. */
+
+G_LOCK_DEFINE_STATIC (menu_tree_load);
+
+typedef struct {
+	char         *menu_file;
+	MateMenuTree *tree;
+	GCancellable *cancellable;
+	GSList       *menus;
+} MenuTreeShare;
+
+static GHashTable *menu_tree_shares = NULL;
+
+static void menu_tree_share_load (MenuTreeShare *share);
+static void menu_search_update   (GtkWidget     *menu);
+
+/* Can be called from any thread. */
+MateMenuTree *
+panel_menu_tree_load (const char  *menu_file,
+		      GError     **error)
+{
+	MateMenuTree *tree;
+	gboolean      loaded;
+
+	if (g_path_is_absolute (menu_file))
+		tree = matemenu_tree_new_for_path (menu_file, MATEMENU_TREE_FLAGS_SORT_DISPLAY_NAME);
+	else
+		tree = matemenu_tree_new (menu_file, MATEMENU_TREE_FLAGS_SORT_DISPLAY_NAME);
+
+	/* libmate-menu keeps a global cache of the directories it scans,
+	 * so do not load several trees at the same time */
+	G_LOCK (menu_tree_load);
+	panel_trace_begin ("menu", menu_file);
+	loaded = matemenu_tree_load_sync (tree, error);
+	panel_trace_end ("menu", menu_file);
+	G_UNLOCK (menu_tree_load);
+
+	if (!loaded) {
+		g_object_unref (tree);
+		return NULL;
+	}
+
+	return tree;
+}
+
 static void
-handle_matemenu_tree_changed (MateMenuTree *tree,
-			   GtkWidget *menu)
+menu_tree_load_thread (GTask        *task,
+		       gpointer      source_object,
+		       gpointer      task_data,
+		       GCancellable *cancellable)
 {
-	GError *error = NULL;
-	guint idle_id;
+	MateMenuTree *tree;
+	GError       *error = NULL;
 
-	GList *list, *l;
-	list = gtk_container_get_children (GTK_CONTAINER (menu));
-	for (l = list; l; l = l->next)
-		gtk_widget_destroy (l->data);
-	g_list_free (list);
+	tree = panel_menu_tree_load (task_data, &error);
+	if (!tree) {
+		g_task_return_error (task, error);
+		return;
+	}
 
-	if (! matemenu_tree_load_sync (tree, &error)) {
-		g_warning("Menu tree reload got error:%s\n", error->message);
-		g_error_free(error);
+	/* searched by typing in the menu: build it while still off the
+	 * main thread */
+	g_object_set_data_full (G_OBJECT (tree),
+				"panel-menu-index",
+				panel_menu_index_new (tree),
+				(GDestroyNotify) panel_menu_index_unref);
+
+	g_task_return_pointer (task, tree, g_object_unref);
+}
+
+/* Gives a new tree to a menu: its items are built again the next time it is
+ * shown, or right away if it is open. */
+static void
+menu_set_tree (GtkWidget    *menu,
+	       MateMenuTree *tree)
+{
+	void        (*loaded_callback) (GtkWidget *, gpointer);
+
+	if (g_object_get_data (G_OBJECT (menu), "panel-menu-tree")) {
+		GList *list, *l;
+
+		list = gtk_container_get_children (GTK_CONTAINER (menu));
+		for (l = list; l; l = l->next)
+			gtk_widget_destroy (l->data);
+		g_list_free (list);
 	}
 
 	g_object_set_data_full (G_OBJECT (menu),
 				"panel-menu-tree-directory",
 				NULL, NULL);
+	g_object_set_data_full (G_OBJECT (menu),
+				"panel-menu-tree",
+				g_object_ref (tree),
+				(GDestroyNotify) g_object_unref);
+
+	g_object_set_data (G_OBJECT (menu),
+			   "panel-menu-needs-loading",
+			   GUINT_TO_POINTER (TRUE));
+
+	if (gtk_widget_get_visible (menu)) {
+		submenu_to_display (menu);
+		menu_search_update (menu);
+	}
+
+	loaded_callback = g_object_get_data (G_OBJECT (menu),
+					     "panel-menu-tree-loaded-callback");
+	if (loaded_callback)
+		loaded_callback (menu,
+				 g_object_get_data (G_OBJECT (menu),
+						    "panel-menu-tree-loaded-callback-data"));
+}
+
+static void
+handle_matemenu_tree_changed (MateMenuTree  *tree,
+			      MenuTreeShare *share)
+{
+	menu_tree_share_load (share);
+}
+
+static void
+menu_tree_loaded_cb (GObject      *source_object,
+		     GAsyncResult *result,
+		     gpointer      user_data)
+{
+	MenuTreeShare *share = user_data;
+	MateMenuTree  *tree;
+	GError        *error = NULL;
+	GSList        *menus;
+	GSList        *l;
+
+	tree = g_task_propagate_pointer (G_TASK (result), &error);
+	if (!tree) {
+		/* a newer load took over */
+		if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			g_error_free (error);
+			return;
+		}
+
+		g_warning ("Menu tree loading got error:%s\n", error->message);
+		g_error_free (error);
+		g_clear_object (&share->cancellable);
+		return;
+	}
+
+	g_clear_object (&share->cancellable);
+
+	if (share->tree) {
+		g_signal_handlers_disconnect_by_func (share->tree,
+						      G_CALLBACK (handle_matemenu_tree_changed),
+						      share);
+		g_object_unref (share->tree);
+	}
+
+	share->tree = tree;
+	g_signal_connect (tree, "changed",
+			  G_CALLBACK (handle_matemenu_tree_changed), share);
+
+	/* the loaded callbacks can destroy menus */
+	menus = g_slist_copy (share->menus);
+	for (l = menus; l; l = l->next)
+		if (g_slist_find (share->menus, l->data))
+			menu_set_tree (l->data, tree);
+	g_slist_free (menus);
+}
+
+static void
+menu_tree_share_load (MenuTreeShare *share)
+{
+	GTask *task;
+
+	/* this cancels the previous load, if any */
+	if (share->cancellable) {
+		g_cancellable_cancel (share->cancellable);
+		g_object_unref (share->cancellable);
+	}
+	share->cancellable = g_cancellable_new ();
+
+	task = g_task_new (NULL, share->cancellable, menu_tree_loaded_cb, share);
+	g_task_set_task_data (task, g_strdup (share->menu_file), g_free);
+	g_task_run_in_thread (task, menu_tree_load_thread);
+	g_object_unref (task);
+}
+
+static void
+add_matemenu_tree_monitor (GtkWidget  *menu,
+			   const char *menu_file)
+{
+	MenuTreeShare *share;
+
+	if (!menu_tree_shares)
+		menu_tree_shares = g_hash_table_new (g_str_hash, g_str_equal);
+
+	share = g_hash_table_lookup (menu_tree_shares, menu_file);
+	if (!share) {
+		share = g_new0 (MenuTreeShare, 1);
+		share->menu_file = g_strdup (menu_file);
+		g_hash_table_insert (menu_tree_shares, share->menu_file, share);
+
+		menu_tree_share_load (share);
+	}
+
+	share->menus = g_slist_prepend (share->menus, menu);
+
+	if (share->tree)
+		menu_set_tree (menu, share->tree);
+}
+
+static void
+remove_matemenu_tree_monitor (GtkWidget *menu,
+			      gpointer   data)
+{
+	MenuTreeShare *share;
+	const char    *menu_file;
+
+	menu_file = g_object_get_data (G_OBJECT (menu), "panel-menu-tree-file");
+	if (!menu_file || !menu_tree_shares)
+		return;
+
+	share = g_hash_table_lookup (menu_tree_shares, menu_file);
+	if (share)
+		share->menus = g_slist_remove (share->menus, menu);
+}
+
+/* The widgets of an applications menu are released once it has not been
+ * used for a while; they are built again from the shared tree the next time
+ * the menu is shown. */
+static gboolean
+release_applications_menu (gpointer data)
+{
+	GtkWidget *menu = GTK_WIDGET (data);
+	GList     *list, *l;
+
+	g_object_set_data (G_OBJECT (menu), "panel-menu-release-id", NULL);
+
+	if (gtk_widget_get_visible (menu) ||
+	    g_object_get_data (G_OBJECT (menu), "panel-menu-needs-loading") ||
+	    !g_object_get_data (G_OBJECT (menu), "panel-menu-tree"))
+		return FALSE;
+
+	list = gtk_container_get_children (GTK_CONTAINER (menu));
+	for (l = list; l; l = l->next)
+		gtk_widget_destroy (l->data);
+	g_list_free (list);
 
 	g_object_set_data (G_OBJECT (menu),
 			   "panel-menu-needs-loading",
 			   GUINT_TO_POINTER (TRUE));
 
-	idle_id = g_idle_add_full (G_PRIORITY_LOW,
-				   submenu_to_display_in_idle,
-				   menu,
-				   NULL);
+	return FALSE;
+}
+
+static void
+applications_menu_hidden (GtkWidget *menu)
+{
+	static GSettings *settings = NULL;
+	guint             delay;
+	guint             release_id;
+
+	if (!settings)
+		settings = g_settings_new (PANEL_MENU_BAR_SCHEMA);
+
+	delay = g_settings_get_uint (settings, PANEL_MENU_BAR_MENU_RELEASE_DELAY_KEY);
+	if (delay == 0)
+		return;
+
+	release_id = g_timeout_add_seconds (delay, release_applications_menu, menu);
 	g_object_set_data_full (G_OBJECT (menu),
-				"panel-menu-idle-id",
-				GUINT_TO_POINTER (idle_id),
+				"panel-menu-release-id",
+				GUINT_TO_POINTER (release_id),
 				remove_submenu_to_display_idle);
 }
 
 static void
-remove_matemenu_tree_monitor (GtkWidget *menu,
-                          MateMenuTree  *tree)
+applications_menu_shown (GtkWidget *menu)
+{
+	g_object_set_data (G_OBJECT (menu), "panel-menu-release-id", NULL);
+}
+
+/* Typing in the root of an applications menu searches the whole tree: the
+ * results are shown on top of the menu until the query is cleared or the
+ * menu is hidden. */
+#define MENU_SEARCH_MAX_RESULTS 10
+
+static void
+menu_search_clear_results (GtkWidget *menu)
+{
+	GList *list, *l;
+
+	list = gtk_container_get_children (GTK_CONTAINER (menu));
+	for (l = list; l; l = l->next)
+		if (g_object_get_data (G_OBJECT (l->data), "panel-menu-search-item"))
+			gtk_widget_destroy (l->data);
+	g_list_free (list);
+}
+
+static void
+menu_search_insert (GtkWidget *menu,
+		    GtkWidget *item,
+		    int       *position)
+{
+	g_object_set_data (G_OBJECT (item),
+			   "panel-menu-search-item",
+			   GINT_TO_POINTER (TRUE));
+
+	if (!gtk_widget_get_parent (item))
+		gtk_menu_shell_append (GTK_MENU_SHELL (menu), item);
+	gtk_menu_reorder_child (GTK_MENU (menu), item, (*position)++);
+	gtk_widget_show (item);
+}
+
+static void
+menu_search_update (GtkWidget *menu)
+{
+	GString        *query;
+	MateMenuTree   *tree;
+	PanelMenuIndex *index = NULL;
+	GList          *results = NULL;
+	GList          *l;
+	GtkWidget      *item;
+	GtkWidget      *first = NULL;
+	char           *text;
+	int             position = 0;
+
+	menu_search_clear_results (menu);
+
+	query = g_object_get_data (G_OBJECT (menu), "panel-menu-search-query");
+	if (!query || !query->len)
+		return;
+
+	tree = g_object_get_data (G_OBJECT (menu), "panel-menu-tree");
+	if (tree)
+		index = g_object_get_data (G_OBJECT (tree), "panel-menu-index");
+	if (index)
+		results = panel_menu_index_search (index, query->str,
+						   MENU_SEARCH_MAX_RESULTS);
+
+	text = g_strdup_printf (_("Results for \"%s\""), query->str);
+	item = gtk_menu_item_new_with_label (text);
+	gtk_widget_set_sensitive (item, FALSE);
+	menu_search_insert (menu, item, &position);
+	g_free (text);
+
+	for (l = results; l; l = l->next) {
+		item = create_menuitem (menu, l->data, NULL);
+		menu_search_insert (menu, item, &position);
+
+		if (!first)
+			first = item;
+	}
+	g_list_free (results);
+
+	if (!first) {
+		item = gtk_menu_item_new_with_label (_("No matches"));
+		gtk_widget_set_sensitive (item, FALSE);
+		menu_search_insert (menu, item, &position);
+	}
+
+	item = gtk_separator_menu_item_new ();
+	menu_search_insert (menu, item, &position);
+
+	if (first)
+		gtk_menu_shell_select_item (GTK_MENU_SHELL (menu), first);
+	else
+		gtk_menu_shell_deselect (GTK_MENU_SHELL (menu));
+
+	menu_icon_prioritize (menu, NULL);
+}
+
+static void
+menu_search_query_free (gpointer data)
+{
+	g_string_free (data, TRUE);
+}
+
+static gboolean
+menu_search_key_press (GtkWidget   *menu,
+		       GdkEventKey *event)
+{
+	GString  *query;
+	gunichar  c;
+
+	if (event->state & (GDK_CONTROL_MASK | GDK_MOD1_MASK | GDK_SUPER_MASK))
+		return FALSE;
+
+	query = g_object_get_data (G_OBJECT (menu), "panel-menu-search-query");
+	if (!query) {
+		query = g_string_new (NULL);
+		g_object_set_data_full (G_OBJECT (menu),
+					"panel-menu-search-query",
+					query,
+					menu_search_query_free);
+	}
+
+	switch (event->keyval) {
+	case GDK_KEY_BackSpace:
+		if (!query->len)
+			return FALSE;
+		g_string_truncate (query,
+				   g_utf8_prev_char (query->str + query->len) - query->str);
+		break;
+
+	case GDK_KEY_Escape:
+		if (!query->len)
+			return FALSE;
+		g_string_truncate (query, 0);
+		break;
+
+	default:
+		c = gdk_keyval_to_unicode (event->keyval);
+		/* space activates the selected item until something is typed */
+		if (!g_unichar_isprint (c) || (c == ' ' && !query->len))
+			return FALSE;
+		g_string_append_unichar (query, c);
+		break;
+	}
+
+	menu_search_update (menu);
+
+	return TRUE;
+}
+
+static void
+menu_search_reset (GtkWidget *menu,
+		   gpointer   data)
 {
-        g_signal_handlers_disconnect_by_func (tree,
-                                              G_CALLBACK (handle_matemenu_tree_changed),
-                                              menu);
+	GString *query;
+
+	query = g_object_get_data (G_OBJECT (menu), "panel-menu-search-query");
+	if (!query || !query->len)
+		return;
+
+	g_string_truncate (query, 0);
+	menu_search_clear_results (menu);
+}
+
+/* Builds the items of a menu before it is shown, so that the menu bar can
+ * prepare the menu the pointer is heading to. */
+void
+panel_menu_prefetch (GtkWidget *menu)
+{
+	g_return_if_fail (GTK_IS_MENU (menu));
+
+	if (!g_object_get_data (G_OBJECT (menu), "panel-menu-needs-loading") ||
+	    gtk_widget_get_visible (menu))
+		return;
+
+	submenu_to_display (menu);
+
+	/* released again if it does not get opened after all */
+	if (!g_object_get_data (G_OBJECT (menu), "panel-menu-needs-loading") &&
+	    g_object_get_data (G_OBJECT (menu), "panel-menu-tree-file") &&
+	    !g_object_get_data (G_OBJECT (menu), "panel-menu-release-id"))
+		applications_menu_hidden (menu);
 }
 
 GtkWidget *
@@ -1215,10 +2013,7 @@ create_applications_menu (const char *menu_file,
 			  const char *menu_path,
 			  gboolean    always_show_image)
 {
-	MateMenuTree *tree;
 	GtkWidget *menu;
-	guint      idle_id;
-	GError *error = NULL;
 
 	menu = create_empty_menu ();
 
@@ -1227,18 +2022,10 @@ create_applications_menu (const char *menu_file,
 				   "panel-menu-force-icon-for-categories",
 				   GINT_TO_POINTER (TRUE));
 
-	tree = matemenu_tree_new (menu_file, MATEMENU_TREE_FLAGS_SORT_DISPLAY_NAME);
-	if (! matemenu_tree_load_sync (tree, &error)) {
-		g_warning("Menu tree loading got error:%s\n", error->message);
-		g_error_free(error);
-		g_object_unref(tree);
-		tree = NULL;
-	}
-
 	g_object_set_data_full (G_OBJECT (menu),
-				"panel-menu-tree",
-				g_object_ref(tree),
-				(GDestroyNotify) g_object_unref);
+				"panel-menu-tree-file",
+				g_strdup (menu_file),
+				(GDestroyNotify) g_free);
 
 	g_object_set_data_full (G_OBJECT (menu),
 				"panel-menu-tree-path",
@@ -1252,22 +2039,25 @@ create_applications_menu (const char *menu_file,
 	g_signal_connect (menu, "show",
 			  G_CALLBACK (submenu_to_display), NULL);
 
-	idle_id = g_idle_add_full (G_PRIORITY_LOW,
-				   submenu_to_display_in_idle,
-				   menu,
-				   NULL);
-	g_object_set_data_full (G_OBJECT (menu),
-				"panel-menu-idle-id",
-				GUINT_TO_POINTER (idle_id),
-				remove_submenu_to_display_idle);
-
 	g_signal_connect (menu, "button-press-event",
 			  G_CALLBACK (menu_dummy_button_press_event), NULL);
 
-	g_signal_connect (tree, "changed", G_CALLBACK (handle_matemenu_tree_changed), menu);
-	g_signal_connect (menu, "destroy", G_CALLBACK (remove_matemenu_tree_monitor), tree);
+	g_signal_connect (menu, "show",
+			  G_CALLBACK (applications_menu_shown), NULL);
+	g_signal_connect (menu, "hide",
+			  G_CALLBACK (applications_menu_hidden), NULL);
+
+	if (!menu_path || !strcmp (menu_path, "/")) {
+		g_object_set_data (G_OBJECT (menu),
+				   "panel-menu-searchable",
+				   GINT_TO_POINTER (TRUE));
+		g_signal_connect (menu, "hide",
+				  G_CALLBACK (menu_search_reset), NULL);
+	}
+
+	g_signal_connect (menu, "destroy", G_CALLBACK (remove_matemenu_tree_monitor), NULL);
 
-	g_object_unref(tree);
+	add_matemenu_tree_monitor (menu, menu_file);
 
 /*HACK Fix any failures of compiz/other wm's to communicate with gtk for transparency */
 	GtkWidget *toplevel = gtk_widget_get_toplevel (menu);
@@ -1403,5 +2193,9 @@ panel_menu_key_press_handler (GtkWidget   *widget,
 		if (active_menu_item && gtk_menu_item_get_submenu (GTK_MENU_ITEM (active_menu_item)) == NULL)
 			retval = show_item_menu (active_menu_item, (GdkEvent *) event);
 	}
+
+	if (!retval && g_object_get_data (G_OBJECT (widget), "panel-menu-searchable"))
+		retval = menu_search_key_press (widget, event);
+
 	return retval;
 }
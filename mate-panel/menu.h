@@ -27,6 +27,7 @@
 #include "panel-widget.h"
 #include "applet.h"
 #include <gio/gio.h>
+#include <matemenu-tree.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -47,6 +48,10 @@ GtkWidget      *create_applications_menu  (const char  *menu_file,
 					   const char  *menu_path,
 					   gboolean    always_show_image);
 GtkWidget      *create_main_menu          (PanelWidget *panel);
+void            panel_menu_prefetch       (GtkWidget   *menu);
+
+MateMenuTree   *panel_menu_tree_load      (const char  *menu_file,
+					   GError     **error);
 
 void		setup_internal_applet_drag (GtkWidget             *menuitem,
 					    PanelActionButtonType  type);
@@ -72,6 +77,10 @@ GtkWidget      *add_menu_separator   (GtkWidget *menu);
 gboolean menu_dummy_button_press_event (GtkWidget      *menuitem,
 					GdkEventButton *event);
 
+void     panel_menu_get_memory_size    (GtkWidget *menu,
+					guint     *n_widgets,
+					guint64   *bytes);
+
 #ifdef __cplusplus
 }
 #endif
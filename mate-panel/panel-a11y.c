@@ -19,20 +19,329 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+/*
+ * Creating the accessible of a widget, and keeping its name up to date,
+ * is only useful when an assistive technology listens. The launcher of
+ * the accessibility bus tells whether one does: until it does, the names,
+ * descriptions and relations are kept on the widgets and the accessibles
+ * are not created. They are all pushed when an assistive technology
+ * shows up. While the launcher is not running, nothing tells: the
+ * accessibles are created, as they were before.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+
+#include <gio/gio.h>
+
+#include <libpanel-util/panel-cleanup.h>
+
 #include "panel-a11y.h"
 
+#define A11Y_BUS_NAME         "org.a11y.Bus"
+#define A11Y_BUS_PATH         "/org/a11y/bus"
+#define A11Y_STATUS_INTERFACE "org.a11y.Status"
+
+typedef struct {
+	GCallback func;
+	gpointer  data;
+} PanelA11yNotify;
+
+typedef struct {
+	gboolean      initialized;
+	gboolean      enabled;
+
+	GCancellable *cancellable;
+	GDBusProxy   *status;
+
+	/* widgets with a name, a description or a relation not pushed to
+	 * their accessible yet */
+	GHashTable   *pending;
+
+	GSList       *notifies;
+} PanelA11y;
+
+static PanelA11y panel_a11y = { 0, };
+
+static void
+panel_a11y_push (GtkWidget  *widget,
+		 const char *name,
+		 const char *desc)
+{
+	AtkObject *aobj;
+
+	aobj = gtk_widget_get_accessible (widget);
+	if (!GTK_IS_ACCESSIBLE (aobj))
+		return;
+
+	if (name)
+		atk_object_set_name (aobj, name);
+
+	if (desc)
+		atk_object_set_description (aobj, desc);
+}
+
+static void
+panel_a11y_push_relation (GtkWidget *widget,
+			  GtkLabel  *label)
+{
+	AtkObject      *aobject;
+	AtkRelationSet *relation_set;
+	AtkRelation    *relation;
+	AtkObject      *targets [1];
+
+	aobject = gtk_widget_get_accessible (widget);
+	if (!GTK_IS_ACCESSIBLE (aobject))
+		return;
+
+	targets [0] = gtk_widget_get_accessible (GTK_WIDGET (label));
+
+	relation_set = atk_object_ref_relation_set (aobject);
+
+	relation = atk_relation_new (targets, 1, ATK_RELATION_LABELLED_BY);
+	atk_relation_set_add (relation_set, relation);
+	g_object_unref (relation);
+	g_object_unref (relation_set);
+}
+
+static void
+panel_a11y_pending_widget_finalized (gpointer  data,
+				     GObject  *where_the_object_was)
+{
+	g_hash_table_remove (panel_a11y.pending, where_the_object_was);
+}
+
+static void
+panel_a11y_add_pending (GtkWidget *widget)
+{
+	if (!panel_a11y.pending)
+		panel_a11y.pending = g_hash_table_new (NULL, NULL);
+
+	if (g_hash_table_contains (panel_a11y.pending, widget))
+		return;
+
+	g_hash_table_add (panel_a11y.pending, widget);
+	g_object_weak_ref (G_OBJECT (widget),
+			   panel_a11y_pending_widget_finalized, NULL);
+}
+
+static void
+panel_a11y_push_pending (GtkWidget *widget)
+{
+	GObject  *object = G_OBJECT (widget);
+	GtkLabel *label;
+
+	g_object_weak_unref (object, panel_a11y_pending_widget_finalized, NULL);
+
+	panel_a11y_push (widget,
+			 g_object_get_data (object, "panel-a11y-name"),
+			 g_object_get_data (object, "panel-a11y-desc"));
+
+	label = g_object_get_data (object, "panel-a11y-labelled-by");
+	if (label)
+		panel_a11y_push_relation (widget, label);
+
+	g_object_set_data (object, "panel-a11y-name", NULL);
+	g_object_set_data (object, "panel-a11y-desc", NULL);
+	g_object_set_data (object, "panel-a11y-labelled-by", NULL);
+}
+
+static void
+panel_a11y_set_enabled (gboolean enabled)
+{
+	GSList *l;
+
+	if (panel_a11y.enabled == enabled)
+		return;
+
+	panel_a11y.enabled = enabled;
+
+	if (enabled && panel_a11y.pending) {
+		GHashTableIter  iter;
+		gpointer        widget;
+
+		g_hash_table_iter_init (&iter, panel_a11y.pending);
+		while (g_hash_table_iter_next (&iter, &widget, NULL)) {
+			panel_a11y_push_pending (widget);
+			g_hash_table_iter_remove (&iter);
+		}
+	}
+
+	for (l = panel_a11y.notifies; l; l = l->next) {
+		PanelA11yNotify *notify = l->data;
+
+		((void (*) (gpointer)) notify->func) (notify->data);
+	}
+}
+
+static void
+panel_a11y_update (void)
+{
+	GVariant *is_enabled;
+	GVariant *screen_reader_enabled;
+	gboolean  enabled = FALSE;
+	char     *name_owner;
+
+	/* the proxy does not start the launcher, so it exists even when
+	 * nothing owns the name, without any property */
+	name_owner = g_dbus_proxy_get_name_owner (panel_a11y.status);
+	if (!name_owner) {
+		panel_a11y_set_enabled (TRUE);
+		return;
+	}
+	g_free (name_owner);
+
+	is_enabled = g_dbus_proxy_get_cached_property (panel_a11y.status,
+						       "IsEnabled");
+	screen_reader_enabled = g_dbus_proxy_get_cached_property (panel_a11y.status,
+								  "ScreenReaderEnabled");
+
+	if (is_enabled &&
+	    g_variant_is_of_type (is_enabled, G_VARIANT_TYPE_BOOLEAN) &&
+	    g_variant_get_boolean (is_enabled))
+		enabled = TRUE;
+
+	if (screen_reader_enabled &&
+	    g_variant_is_of_type (screen_reader_enabled, G_VARIANT_TYPE_BOOLEAN) &&
+	    g_variant_get_boolean (screen_reader_enabled))
+		enabled = TRUE;
+
+	g_clear_pointer (&is_enabled, g_variant_unref);
+	g_clear_pointer (&screen_reader_enabled, g_variant_unref);
+
+	panel_a11y_set_enabled (enabled);
+}
+
+static void
+panel_a11y_properties_changed (GDBusProxy *proxy,
+			       GVariant   *changed_properties,
+			       GStrv       invalidated_properties,
+			       gpointer    user_data)
+{
+	panel_a11y_update ();
+}
+
+static void
+panel_a11y_name_owner_changed (GObject    *object,
+			       GParamSpec *pspec,
+			       gpointer    user_data)
+{
+	panel_a11y_update ();
+}
+
+static void
+panel_a11y_proxy_ready (GObject      *source_object,
+			GAsyncResult *res,
+			gpointer      user_data)
+{
+	GError *error = NULL;
+
+	panel_a11y.status = g_dbus_proxy_new_for_bus_finish (res, &error);
+	if (!panel_a11y.status) {
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			/* without the launcher, nothing tells us: better
+			 * be accessible for nothing than not at all */
+			g_debug ("Cannot watch the accessibility bus: %s", error->message);
+			panel_a11y_set_enabled (TRUE);
+		}
+		g_error_free (error);
+		return;
+	}
+
+	g_signal_connect (panel_a11y.status, "g-properties-changed",
+			  G_CALLBACK (panel_a11y_properties_changed), NULL);
+	g_signal_connect (panel_a11y.status, "notify::g-name-owner",
+			  G_CALLBACK (panel_a11y_name_owner_changed), NULL);
+
+	panel_a11y_update ();
+}
+
+static void
+panel_a11y_cleanup (gpointer data)
+{
+	if (panel_a11y.cancellable) {
+		g_cancellable_cancel (panel_a11y.cancellable);
+		g_clear_object (&panel_a11y.cancellable);
+	}
+
+	g_clear_object (&panel_a11y.status);
+
+	g_slist_free_full (panel_a11y.notifies, g_free);
+	panel_a11y.notifies = NULL;
+}
+
+void
+panel_a11y_init (void)
+{
+	const char *env;
+
+	if (panel_a11y.initialized)
+		return;
+
+	panel_a11y.initialized = TRUE;
+
+	/* forced on, like GTK+ does */
+	env = g_getenv ("GNOME_ACCESSIBILITY");
+	if (env && atoi (env) == 1) {
+		panel_a11y.enabled = TRUE;
+		return;
+	}
+
+	panel_a11y.cancellable = g_cancellable_new ();
+
+	g_dbus_proxy_new_for_bus (G_BUS_TYPE_SESSION,
+				  G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START |
+				  G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+				  NULL,
+				  A11Y_BUS_NAME,
+				  A11Y_BUS_PATH,
+				  A11Y_STATUS_INTERFACE,
+				  panel_a11y.cancellable,
+				  panel_a11y_proxy_ready,
+				  NULL);
+
+	panel_cleanup_register (PANEL_CLEAN_FUNC (panel_a11y_cleanup), NULL);
+}
+
+/* Without panel_a11y_init(), the accessibles are always kept up to date */
 gboolean
 panel_a11y_get_is_a11y_enabled (GtkWidget *widget)
 {
-	static gboolean initialised  = FALSE;
-	static gboolean a11y_enabled = FALSE;
+	if (!panel_a11y.initialized)
+		return TRUE;
 
-	if (!initialised) {
-		a11y_enabled = GTK_IS_ACCESSIBLE (gtk_widget_get_accessible (widget));
-		initialised = TRUE;
-	}
+	return panel_a11y.enabled;
+}
+
+void
+panel_a11y_notify_add (GCallback callback_func,
+		       gpointer  user_data)
+{
+	PanelA11yNotify *notify;
 
-	return a11y_enabled;
+	notify = g_new0 (PanelA11yNotify, 1);
+	notify->func = callback_func;
+	notify->data = user_data;
+
+	panel_a11y.notifies = g_slist_append (panel_a11y.notifies, notify);
+}
+
+void
+panel_a11y_notify_remove (GCallback callback_func,
+			  gpointer  user_data)
+{
+	GSList *l;
+
+	for (l = panel_a11y.notifies; l; l = l->next) {
+		PanelA11yNotify *notify = l->data;
+
+		if (notify->func == callback_func && notify->data == user_data) {
+			panel_a11y.notifies = g_slist_delete_link (panel_a11y.notifies, l);
+			g_free (notify);
+			return;
+		}
+	}
 }
 
 void
@@ -40,20 +349,21 @@ panel_a11y_set_atk_name_desc (GtkWidget  *widget,
 			      const char *name,
 			      const char *desc)
 {
-	AtkObject *aobj;
-
 	g_return_if_fail (GTK_IS_WIDGET (widget));
 
-	if (!panel_a11y_get_is_a11y_enabled (widget))
+	if (panel_a11y_get_is_a11y_enabled (widget)) {
+		panel_a11y_push (widget, name, desc);
 		return;
-
-	aobj = gtk_widget_get_accessible (widget);
+	}
 
 	if (name)
-		atk_object_set_name (aobj, name);
-
+		g_object_set_data_full (G_OBJECT (widget), "panel-a11y-name",
+					g_strdup (name), g_free);
 	if (desc)
-		atk_object_set_description (aobj, desc);
+		g_object_set_data_full (G_OBJECT (widget), "panel-a11y-desc",
+					g_strdup (desc), g_free);
+
+	panel_a11y_add_pending (widget);
 }
 
 /**
@@ -68,28 +378,20 @@ void
 panel_a11y_set_atk_relation (GtkWidget *widget,
 			     GtkLabel  *label)
 {
-	AtkObject      *aobject;
-	AtkRelationSet *relation_set;
-	AtkRelation    *relation;
-	AtkObject      *targets [1];
-
 	g_return_if_fail (GTK_IS_WIDGET(widget));
 	g_return_if_fail (GTK_IS_LABEL(label));
 
-	if (!panel_a11y_get_is_a11y_enabled (widget))
-		return;
-
-	aobject = gtk_widget_get_accessible (widget);
-
 	gtk_label_set_mnemonic_widget (label, widget);
 
-	targets [0] = gtk_widget_get_accessible (GTK_WIDGET (label));
+	if (panel_a11y_get_is_a11y_enabled (widget)) {
+		panel_a11y_push_relation (widget, label);
+		return;
+	}
 
-	relation_set = atk_object_ref_relation_set (aobject);
+	g_object_set_data_full (G_OBJECT (widget), "panel-a11y-labelled-by",
+				g_object_ref (label), g_object_unref);
 
-	relation = atk_relation_new (targets, 1, ATK_RELATION_LABELLED_BY);
-	atk_relation_set_add (relation_set, relation);
-	g_object_unref (relation);
+	panel_a11y_add_pending (widget);
 }
 
 /**
@@ -28,7 +28,12 @@
 extern "C" {
 #endif
 
+void     panel_a11y_init                         (void);
 gboolean panel_a11y_get_is_a11y_enabled          (GtkWidget  *widget);
+void     panel_a11y_notify_add                   (GCallback   callback_func,
+						  gpointer    user_data);
+void     panel_a11y_notify_remove                (GCallback   callback_func,
+						  gpointer    user_data);
 void     panel_a11y_set_atk_name_desc            (GtkWidget  *widget,
 						  const char *name,
 						  const char *desc);
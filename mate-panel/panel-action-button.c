@@ -868,7 +868,7 @@ panel_action_button_connect_to_gsettings (PanelActionButton *button)
 	gchar *signal_name;
 
 	settings_path = g_strdup_printf (PANEL_OBJECT_PATH "%s/", button->priv->info->id);
-	button->priv->settings = g_settings_new_with_path (PANEL_OBJECT_SCHEMA, settings_path);
+	button->priv->settings = panel_profile_get_settings (PANEL_OBJECT_SCHEMA, settings_path);
 
 	signal_name = g_strdup_printf ("changed::%s", PANEL_OBJECT_ACTION_TYPE_KEY);
 	g_signal_connect (button->priv->settings,
@@ -881,6 +881,10 @@ panel_action_button_connect_to_gsettings (PanelActionButton *button)
 
 	panel_lockdown_notify_add (G_CALLBACK (panel_action_button_update_sensitivity),
 				   button);
+
+	g_signal_connect_object (panel_session_manager_get (), "notify::shutdown-available",
+				 G_CALLBACK (panel_action_button_update_sensitivity),
+				 button, G_CONNECT_SWAPPED);
 }
 
 static void
@@ -943,7 +947,7 @@ panel_action_button_create (PanelToplevel         *toplevel,
 	id = panel_profile_prepare_object (PANEL_OBJECT_ACTION, toplevel, position, FALSE);
 
 	path = g_strdup_printf (PANEL_OBJECT_PATH "%s/", id);
-	settings = g_settings_new_with_path (PANEL_OBJECT_SCHEMA, path);
+	settings = panel_profile_get_settings (PANEL_OBJECT_SCHEMA, path);
 
 	g_settings_set_enum (settings,
 						 PANEL_OBJECT_ACTION_TYPE_KEY,
@@ -968,7 +972,7 @@ panel_action_button_load_from_gsettings (PanelWidget *panel,
 	char                  *path;
 
 	path = g_strdup_printf (PANEL_OBJECT_PATH "%s/", id);
-	settings = g_settings_new_with_path (PANEL_OBJECT_SCHEMA, path);
+	settings = panel_profile_get_settings (PANEL_OBJECT_SCHEMA, path);
 
 	type = g_settings_get_enum (settings, PANEL_OBJECT_ACTION_TYPE_KEY);
 
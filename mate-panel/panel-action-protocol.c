@@ -53,6 +53,9 @@ static Atom atom_gnome_panel_action_main_menu  = None;
 static Atom atom_gnome_panel_action_run_dialog = None;
 static Atom atom_mate_panel_action_kill_dialog = None;
 
+static GdkFilterFunc input_filter      = NULL;
+static gpointer      input_filter_data = NULL;
+
 static void
 panel_action_protocol_main_menu (GdkScreen *screen,
 				 guint32    activate_time, GdkEvent  *event)
@@ -118,32 +121,12 @@ panel_action_protocol_kill_dialog (GdkScreen *screen,
 }
 
 static GdkFilterReturn
-panel_action_protocol_filter (GdkXEvent *gdk_xevent,
-			      GdkEvent  *event,
-			      gpointer   data)
+panel_action_protocol_handle_message (XEvent   *xevent,
+				      GdkEvent *event)
 {
-	GdkWindow *window;
 	GdkScreen *screen;
-	GdkDisplay *display;
-	XEvent    *xevent = (XEvent *) gdk_xevent;
-
-	if (xevent->type != ClientMessage)
-		return GDK_FILTER_CONTINUE;
-
-	if ((xevent->xclient.message_type != atom_mate_panel_action) &&
-	   (xevent->xclient.message_type != atom_gnome_panel_action))
-		return GDK_FILTER_CONTINUE;
 
 	screen = gdk_event_get_screen (event);
-	display = gdk_screen_get_display (screen);
-	if (!GDK_IS_X11_DISPLAY (display))
-		return GDK_FILTER_CONTINUE;
-	window = gdk_x11_window_lookup_for_display (display, xevent->xclient.window);
-	if (!window)
-		return GDK_FILTER_CONTINUE;
-
-	if (window != gdk_screen_get_root_window (screen))
-		return GDK_FILTER_CONTINUE;
 
 	if (xevent->xclient.data.l [0] < 0)
 		return GDK_FILTER_CONTINUE;
@@ -164,10 +147,50 @@ panel_action_protocol_filter (GdkXEvent *gdk_xevent,
 	return GDK_FILTER_REMOVE;
 }
 
+/* The one filter of the panel on the root window: the window manager and
+ * the other clients keep changing its properties, so leave early what is
+ * neither an action message nor the input of a grab. */
+static GdkFilterReturn
+panel_action_protocol_filter (GdkXEvent *gdk_xevent,
+			      GdkEvent  *event,
+			      gpointer   data)
+{
+	XEvent *xevent = (XEvent *) gdk_xevent;
+
+	switch (xevent->type) {
+	case ClientMessage:
+		if (xevent->xclient.message_type == atom_mate_panel_action ||
+		    xevent->xclient.message_type == atom_gnome_panel_action)
+			return panel_action_protocol_handle_message (xevent, event);
+		break;
+	case KeyPress:
+	case ButtonPress:
+	case GenericEvent:
+		if (input_filter)
+			return input_filter (gdk_xevent, event, input_filter_data);
+		break;
+	default:
+		break;
+	}
+
+	return GDK_FILTER_CONTINUE;
+}
+
+/* Lets a grab of the root window, like the one of the force quit popup,
+ * see the key and button presses on it. Pass NULL to remove the filter. */
+void
+panel_action_protocol_set_input_filter (GdkFilterFunc filter,
+					gpointer      data)
+{
+	input_filter      = filter;
+	input_filter_data = data;
+}
+
 void
 panel_action_protocol_init (void)
 {
 	GdkDisplay *display;
+	GdkWindow  *root;
 
 	display = gdk_display_get_default ();
 	g_assert(GDK_IS_X11_DISPLAY (display));
@@ -201,6 +224,8 @@ panel_action_protocol_init (void)
 			     "_MATE_PANEL_ACTION_KILL_DIALOG",
 			     FALSE);
 
-	/* We'll filter event sent on non-root windows later */
-	gdk_window_add_filter (NULL, panel_action_protocol_filter, NULL);
+	/* the messages are sent to the root window: a filter on it does not
+	 * see the events of all the other windows */
+	root = gdk_screen_get_root_window (gdk_display_get_default_screen (display));
+	gdk_window_add_filter (root, panel_action_protocol_filter, NULL);
 }
@@ -33,10 +33,14 @@
 #endif
 
 #include <glib.h>
+#include <gdk/gdk.h>
 
 G_BEGIN_DECLS
 
-void panel_action_protocol_init (void);
+void panel_action_protocol_init             (void);
+
+void panel_action_protocol_set_input_filter (GdkFilterFunc filter,
+					     gpointer      data);
 
 G_END_DECLS
 
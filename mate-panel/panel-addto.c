@@ -53,6 +53,7 @@
 #include "panel-icon-names.h"
 #include "panel-schemas.h"
 #include "panel-stock-icons.h"
+#include "menu.h"
 
 #ifdef HAVE_X11
 #include "xstuff.h"
@@ -81,7 +82,13 @@ typedef struct {
 	GSList       *application_list;
 	GSList       *settings_list;
 
+	GCancellable *cancellable;
+	GSList       *pending_applets;
+	GSList       *pending_frames;
+	guint         populate_id;
+
 	gchar        *search_text;
+	gchar        *search_key;
 	gchar        *applet_search_text;
 
 	int           insertion_position;
@@ -113,6 +120,7 @@ typedef struct {
 	char                  *iid;
 	gboolean               enabled;
 	gboolean               static_data;
+	char                  *search_key;
 } PanelAddtoItemInfo;
 
 typedef struct {
@@ -120,6 +128,23 @@ typedef struct {
 	PanelAddtoItemInfo  item_info;
 } PanelAddtoAppList;
 
+/* The models are filled in batches from an idle, so that the dialog
+ * appears right away: a frame is a list of rows still to be added to the
+ * application model, under a given parent row. */
+typedef struct {
+	GSList      *next;
+	GtkTreeIter  parent;
+	gboolean     has_parent;
+	gboolean     separator;
+} PanelAddtoPopulateFrame;
+
+typedef struct {
+	GSList *application_list;
+	GSList *settings_list;
+} PanelAddtoApplications;
+
+#define PANEL_ADDTO_BATCH_SIZE 50
+
 static PanelAddtoItemInfo special_addto_items [] = {
 
 	{ PANEL_ADDTO_LAUNCHER_NEW,
@@ -219,6 +244,24 @@ static gboolean panel_addto_filter_func (GtkTreeModel *model,
 					 GtkTreeIter  *iter,
 					 gpointer      data);
 
+static void panel_addto_dialog_free_application_list (GSList *application_list);
+
+static void
+panel_addto_item_info_make_search_key (PanelAddtoItemInfo *item_info)
+{
+	char *text;
+
+	if (item_info->search_key != NULL)
+		return;
+
+	/* the newline avoids matching across the name and the description */
+	text = g_strconcat (item_info->name ? item_info->name : "", "\n",
+			    item_info->description ? item_info->description : "",
+			    NULL);
+	item_info->search_key = g_utf8_strdown (text, -1);
+	g_free (text);
+}
+
 static int
 panel_addto_applet_info_sort_func (PanelAddtoItemInfo *a,
 				   PanelAddtoItemInfo *b)
@@ -454,27 +497,26 @@ panel_addto_append_item (PanelAddtoDialog *dialog,
 	GtkTreeIter iter;
 
 	if (applet == NULL) {
-		gtk_list_store_append (model, &iter);
-		gtk_list_store_set (model, &iter,
-				    COLUMN_ICON_NAME, NULL,
-				    COLUMN_TEXT, NULL,
-				    COLUMN_DATA, NULL,
-				    COLUMN_SEARCH, NULL,
-				    COLUMN_ENABLED, TRUE,
-				    -1);
+		gtk_list_store_insert_with_values (model, &iter, -1,
+						   COLUMN_ICON_NAME, NULL,
+						   COLUMN_TEXT, NULL,
+						   COLUMN_DATA, NULL,
+						   COLUMN_SEARCH, NULL,
+						   COLUMN_ENABLED, TRUE,
+						   -1);
 	} else {
-		gtk_list_store_append (model, &iter);
-
 		char *text = panel_addto_make_text (applet->name,
 		                                    applet->description);
 
-		gtk_list_store_set (model, &iter,
-				    COLUMN_ICON_NAME, applet->icon,
-				    COLUMN_TEXT, text,
-				    COLUMN_DATA, applet,
-				    COLUMN_SEARCH, applet->name,
-				    COLUMN_ENABLED, applet->enabled,
-				    -1);
+		panel_addto_item_info_make_search_key (applet);
+
+		gtk_list_store_insert_with_values (model, &iter, -1,
+						   COLUMN_ICON_NAME, applet->icon,
+						   COLUMN_TEXT, text,
+						   COLUMN_DATA, applet,
+						   COLUMN_SEARCH, applet->name,
+						   COLUMN_ENABLED, applet->enabled,
+						   -1);
 
 		g_free (text);
 	}
@@ -503,11 +545,108 @@ panel_addto_append_special_applets (PanelAddtoDialog *dialog,
 	translated = TRUE;
 }
 
+static void
+panel_addto_populate_application_row (PanelAddtoDialog *dialog)
+{
+	PanelAddtoPopulateFrame *frame;
+	PanelAddtoAppList       *data;
+	GtkTreeStore            *store;
+	GtkTreeIter              iter;
+	char                    *text;
+
+	frame = dialog->pending_frames->data;
+	store = GTK_TREE_STORE (dialog->application_model);
+
+	if (frame->separator) {
+		frame->separator = FALSE;
+		gtk_tree_store_insert_with_values (store, &iter, NULL, -1,
+						   COLUMN_ICON_NAME, NULL,
+						   COLUMN_TEXT, NULL,
+						   COLUMN_DATA, NULL,
+						   COLUMN_SEARCH, NULL,
+						   COLUMN_ENABLED, TRUE,
+						   -1);
+		return;
+	}
+
+	if (frame->next == NULL) {
+		dialog->pending_frames = g_slist_delete_link (dialog->pending_frames,
+							      dialog->pending_frames);
+		g_free (frame);
+		return;
+	}
+
+	data = frame->next->data;
+	frame->next = frame->next->next;
+
+	text = panel_addto_make_text (data->item_info.name,
+				      data->item_info.description);
+	gtk_tree_store_insert_with_values (store, &iter,
+					   frame->has_parent ? &frame->parent : NULL,
+					   -1,
+					   COLUMN_ICON_NAME, data->item_info.icon,
+					   COLUMN_TEXT, text,
+					   COLUMN_DATA, &(data->item_info),
+					   COLUMN_SEARCH, data->item_info.name,
+					   COLUMN_ENABLED, data->item_info.enabled,
+					   -1);
+	g_free (text);
+
+	if (data->children != NULL) {
+		/* the children go right after their parent */
+		frame = g_new0 (PanelAddtoPopulateFrame, 1);
+		frame->next = data->children;
+		frame->parent = iter;
+		frame->has_parent = TRUE;
+		dialog->pending_frames = g_slist_prepend (dialog->pending_frames,
+							  frame);
+	}
+}
+
+static gboolean
+panel_addto_populate_idle (gpointer user_data)
+{
+	PanelAddtoDialog *dialog = user_data;
+	int               i;
+
+	for (i = 0; i < PANEL_ADDTO_BATCH_SIZE; i++) {
+		if (dialog->pending_applets != NULL) {
+			panel_addto_append_item (dialog,
+						 GTK_LIST_STORE (dialog->applet_model),
+						 dialog->pending_applets->data);
+			dialog->pending_applets = dialog->pending_applets->next;
+		} else if (dialog->pending_frames != NULL) {
+			panel_addto_populate_application_row (dialog);
+		} else {
+			break;
+		}
+	}
+
+	if (dialog->pending_applets != NULL || dialog->pending_frames != NULL)
+		return G_SOURCE_CONTINUE;
+
+	dialog->populate_id = 0;
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+panel_addto_queue_populate (PanelAddtoDialog *dialog)
+{
+	if (dialog->populate_id != 0)
+		return;
+
+	/* run below the redraw priority, so that the dialog gets
+	 * painted between two batches */
+	dialog->populate_id = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+					       panel_addto_populate_idle,
+					       dialog, NULL);
+}
+
 static void
 panel_addto_make_applet_model (PanelAddtoDialog *dialog)
 {
 	GtkListStore *model;
-	GSList       *l;
 
 	if (dialog->filter_applet_model != NULL)
 		return;
@@ -533,15 +672,15 @@ panel_addto_make_applet_model (PanelAddtoDialog *dialog)
 			panel_addto_append_item (dialog, model, NULL);
 	}
 
-	for (l = dialog->applet_list; l; l = l->next)
-		panel_addto_append_item (dialog, model, l->data);
-
 	dialog->applet_model = GTK_TREE_MODEL (model);
 	dialog->filter_applet_model = gtk_tree_model_filter_new (GTK_TREE_MODEL (dialog->applet_model),
 								 NULL);
 	gtk_tree_model_filter_set_visible_func (GTK_TREE_MODEL_FILTER (dialog->filter_applet_model),
 						panel_addto_filter_func,
 						dialog, NULL);
+
+	dialog->pending_applets = dialog->applet_list;
+	panel_addto_queue_populate (dialog);
 }
 
 static void panel_addto_make_application_list (GSList             **parent_list,
@@ -568,6 +707,8 @@ panel_addto_prepend_directory (GSList             **parent_list,
 	data->item_info.enabled       = TRUE;
 	data->item_info.static_data   = FALSE;
 
+	panel_addto_item_info_make_search_key (&data->item_info);
+
 	/* We should set the iid here to something and do
 	 * iid = g_strdup_printf ("MENU:%s", tfr->name)
 	 * but this means we'd have to free the iid later
@@ -603,6 +744,8 @@ panel_addto_prepend_entry (GSList         **parent_list,
 	data->item_info.enabled       = TRUE;
 	data->item_info.static_data   = FALSE;
 
+	panel_addto_item_info_make_search_key (&data->item_info);
+
 	*parent_list = g_slist_prepend (*parent_list, data);
 }
 
@@ -673,97 +816,119 @@ panel_addto_make_application_list (GSList             **parent_list,
 }
 
 static void
-panel_addto_populate_application_model (GtkTreeStore *store,
-                                        GtkTreeIter  *parent,
-                                        GSList       *app_list)
+panel_addto_applications_free (PanelAddtoApplications *applications)
 {
-	GtkTreeIter  iter;
-	GSList      *app;
-
-	for (app = app_list; app != NULL; app = app->next) {
-		PanelAddtoAppList *data = app->data;
-
-		gtk_tree_store_append (store, &iter, parent);
-		char *text = panel_addto_make_text (data->item_info.name,
-		                                    data->item_info.description);
-		gtk_tree_store_set (store, &iter,
-				    COLUMN_ICON_NAME, data->item_info.icon,
-				    COLUMN_TEXT, text,
-				    COLUMN_DATA, &(data->item_info),
-				    COLUMN_SEARCH, data->item_info.name,
-				    COLUMN_ENABLED, data->item_info.enabled,
-				    -1);
+	panel_addto_dialog_free_application_list (applications->application_list);
+	panel_addto_dialog_free_application_list (applications->settings_list);
+	g_free (applications);
+}
 
-		g_free (text);
+static GSList *
+panel_addto_load_application_list (const char *menu_file)
+{
+	MateMenuTree          *tree;
+	MateMenuTreeDirectory *root;
+	GSList                *list = NULL;
+	GError                *error = NULL;
+
+	tree = panel_menu_tree_load (menu_file, &error);
+	if (tree == NULL) {
+		g_warning ("Menu tree %s loading got error:%s\n", menu_file, error->message);
+		g_error_free (error);
+		return NULL;
+	}
 
-		if (data->children != NULL)
-			panel_addto_populate_application_model (store,
-								&iter,
-								data->children);
+	if ((root = matemenu_tree_get_root_directory (tree)) != NULL) {
+		panel_addto_make_application_list (&list, root, menu_file);
+		matemenu_tree_item_unref (root);
 	}
+
+	g_object_unref (tree);
+
+	return list;
 }
 
-static void panel_addto_make_application_model(PanelAddtoDialog* dialog)
+static void
+panel_addto_load_applications_thread (GTask        *task,
+				      gpointer      source_object,
+				      gpointer      task_data,
+				      GCancellable *cancellable)
 {
-	GtkTreeStore* store;
-	MateMenuTree* tree;
-	MateMenuTreeDirectory* root;
-	GError *error = NULL;
+	PanelAddtoApplications *applications;
 
-	if (dialog->filter_application_model != NULL)
-		return;
+	applications = g_new0 (PanelAddtoApplications, 1);
+	applications->application_list = panel_addto_load_application_list ("mate-applications.menu");
+	applications->settings_list = panel_addto_load_application_list ("mate-settings.menu");
 
-	store = gtk_tree_store_new (NUMBER_COLUMNS,
-				    G_TYPE_STRING,
-				    G_TYPE_STRING,
-				    G_TYPE_POINTER,
-				    G_TYPE_STRING,
-				    G_TYPE_BOOLEAN);
+	g_task_return_pointer (task, applications,
+			       (GDestroyNotify) panel_addto_applications_free);
+}
 
-	tree = matemenu_tree_new ("mate-applications.menu", MATEMENU_TREE_FLAGS_SORT_DISPLAY_NAME);
-	if (! matemenu_tree_load_sync (tree, &error)) {
-		g_warning("Applications menu tree loading got error:%s\n", error->message);
-		g_error_free(error);
-		g_clear_object(&tree);
-	}
+static void panel_addto_make_application_model (PanelAddtoDialog *dialog);
+
+static void
+panel_addto_applications_loaded (GObject      *source_object,
+				 GAsyncResult *result,
+				 gpointer      user_data)
+{
+	PanelAddtoDialog        *dialog;
+	PanelAddtoApplications  *applications;
+	PanelAddtoPopulateFrame *frame;
 
-	if ((root = matemenu_tree_get_root_directory (tree)) != NULL )
-	{
-		panel_addto_make_application_list(&dialog->application_list, root, "mate-applications.menu");
-		panel_addto_populate_application_model(store, NULL, dialog->application_list);
+	/* NULL when the dialog has been destroyed in the meantime */
+	applications = g_task_propagate_pointer (G_TASK (result), NULL);
+	if (applications == NULL)
+		return;
 
-		matemenu_tree_item_unref(root);
-	}
+	dialog = user_data;
+	dialog->application_list = applications->application_list;
+	dialog->settings_list = applications->settings_list;
+	g_free (applications);
 
-	g_clear_object(&tree);
+	panel_addto_make_application_model (dialog);
 
-	tree = matemenu_tree_new ("mate-settings.menu", MATEMENU_TREE_FLAGS_SORT_DISPLAY_NAME);
-	if (! matemenu_tree_load_sync (tree, &error)) {
-		g_warning("Settings menu tree loading got error:%s\n", error->message);
-		g_error_free(error);
-		g_clear_object(&tree);
+	/* frames are processed from the head of the list */
+	if (dialog->settings_list != NULL) {
+		frame = g_new0 (PanelAddtoPopulateFrame, 1);
+		frame->next = dialog->settings_list;
+		frame->separator = TRUE;
+		dialog->pending_frames = g_slist_prepend (dialog->pending_frames,
+							  frame);
 	}
 
-	if ((root = matemenu_tree_get_root_directory(tree)))
-	{
-		GtkTreeIter iter;
+	frame = g_new0 (PanelAddtoPopulateFrame, 1);
+	frame->next = dialog->application_list;
+	dialog->pending_frames = g_slist_prepend (dialog->pending_frames, frame);
 
-		gtk_tree_store_append(store, &iter, NULL);
-		gtk_tree_store_set (store, &iter,
-				    COLUMN_ICON_NAME, NULL,
-				    COLUMN_TEXT, NULL,
-				    COLUMN_DATA, NULL,
-				    COLUMN_SEARCH, NULL,
-				    COLUMN_ENABLED, TRUE,
-				    -1);
+	panel_addto_queue_populate (dialog);
+}
 
-		panel_addto_make_application_list(&dialog->settings_list, root, "mate-settings.menu");
-		panel_addto_populate_application_model(store, NULL, dialog->settings_list);
+static void
+panel_addto_load_applications_async (PanelAddtoDialog *dialog)
+{
+	GTask *task;
 
-		matemenu_tree_item_unref(root);
-	}
+	dialog->cancellable = g_cancellable_new ();
 
-	g_object_unref(tree);
+	task = g_task_new (NULL, dialog->cancellable,
+			   panel_addto_applications_loaded, dialog);
+	g_task_run_in_thread (task, panel_addto_load_applications_thread);
+	g_object_unref (task);
+}
+
+static void panel_addto_make_application_model(PanelAddtoDialog* dialog)
+{
+	GtkTreeStore* store;
+
+	if (dialog->filter_application_model != NULL)
+		return;
+
+	store = gtk_tree_store_new (NUMBER_COLUMNS,
+				    G_TYPE_STRING,
+				    G_TYPE_STRING,
+				    G_TYPE_POINTER,
+				    G_TYPE_STRING,
+				    G_TYPE_BOOLEAN);
 
 	dialog->application_model = GTK_TREE_MODEL(store);
 	dialog->filter_application_model = gtk_tree_model_filter_new(GTK_TREE_MODEL(dialog->application_model), NULL);
@@ -932,6 +1097,7 @@ panel_addto_dialog_free_item_info (PanelAddtoItemInfo *item_info)
 	g_clear_pointer (&item_info->launcher_path, g_free);
 	g_clear_pointer (&item_info->menu_filename, g_free);
 	g_clear_pointer (&item_info->menu_path, g_free);
+	g_clear_pointer (&item_info->search_key, g_free);
 }
 
 static void
@@ -968,7 +1134,15 @@ panel_addto_dialog_free (PanelAddtoDialog *dialog)
 					     G_CALLBACK (panel_addto_name_notify),
 					     dialog);
 
+	g_cancellable_cancel (dialog->cancellable);
+	g_clear_object (&dialog->cancellable);
+
+	if (dialog->populate_id != 0)
+		g_source_remove (dialog->populate_id);
+	g_slist_free_full (dialog->pending_frames, g_free);
+
 	g_free (dialog->search_text);
+	g_free (dialog->search_key);
 	g_free (dialog->applet_search_text);
 
 	if (dialog->addto_dialog)
@@ -1048,7 +1222,7 @@ panel_addto_filter_func (GtkTreeModel *model,
 
 	dialog = (PanelAddtoDialog *) userdata;
 
-	if (!dialog->search_text || !dialog->search_text[0])
+	if (!dialog->search_key || !dialog->search_key[0])
 		return TRUE;
 
 	gtk_tree_model_get (model, iter, COLUMN_DATA, &data, -1);
@@ -1062,10 +1236,8 @@ panel_addto_filter_func (GtkTreeModel *model,
 	    gtk_tree_store_iter_depth (GTK_TREE_STORE (model), iter) == 0)
 		return TRUE;
 
-	return (panel_g_utf8_strstrcase (data->name,
-					 dialog->search_text) != NULL ||
-	        panel_g_utf8_strstrcase (data->description,
-					 dialog->search_text) != NULL);
+	return (data->search_key != NULL &&
+		strstr (data->search_key, dialog->search_key) != NULL);
 }
 
 static void
@@ -1089,6 +1261,9 @@ panel_addto_search_entry_changed (GtkWidget        *entry,
 	g_free (dialog->search_text);
 	dialog->search_text = new_text;
 
+	g_free (dialog->search_key);
+	dialog->search_key = g_utf8_strdown (new_text, -1);
+
 	model = gtk_tree_view_get_model (GTK_TREE_VIEW (dialog->tree_view));
 	gtk_tree_model_filter_refilter (GTK_TREE_MODEL_FILTER (model));
 
@@ -1246,6 +1421,7 @@ panel_addto_dialog_new (PanelWidget *panel_widget)
 	GtkCellRenderer *renderer;
 	GtkTreeSelection *selection;
 	GtkTreeViewColumn *column;
+	int icon_width;
 
 	dialog = g_new0 (PanelAddtoDialog, 1);
 
@@ -1374,6 +1550,14 @@ panel_addto_dialog_new (PanelWidget *panel_widget)
 					   COLUMN_TEXT);
 	gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_FIXED);
 
+	/* with a fixed height, only the rows being displayed are measured
+	 * and rendered, so icons are only loaded for the visible rows */
+	gtk_icon_size_lookup (panel_add_to_icon_get_size (), &icon_width, NULL);
+	column = gtk_tree_view_get_column (GTK_TREE_VIEW (dialog->tree_view), 0);
+	gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_FIXED);
+	gtk_tree_view_column_set_fixed_width (column, icon_width + 2 * 4);
+	gtk_tree_view_set_fixed_height_mode (GTK_TREE_VIEW (dialog->tree_view), TRUE);
+
 	gtk_tree_selection_set_select_function (selection, panel_addto_selection_func, NULL, NULL);
 
 	g_signal_connect (selection, "changed",
@@ -1395,6 +1579,10 @@ panel_addto_dialog_new (PanelWidget *panel_widget)
 	panel_addto_name_change (dialog,
 				 panel_toplevel_get_name (dialog->panel_widget->toplevel));
 
+	/* walk the menus in the background, so that the application list
+	 * is ready by the time it is needed */
+	panel_addto_load_applications_async (dialog);
+
 	return dialog;
 }
 
@@ -34,6 +34,7 @@
 #include <gdk/gdk.h>
 
 #include <libpanel-util/panel-gtk.h>
+#include <libpanel-util/panel-perf.h>
 
 #include "panel-applets-manager.h"
 #include "panel-profile.h"
@@ -54,12 +55,25 @@
 #define PANEL_RESPONSE_DONT_RELOAD  1
 #define PANEL_RESPONSE_RELOAD       2
 
+/* A crashed applet is restarted after PANEL_APPLET_RESPAWN_DELAY seconds,
+ * doubled at each crash; after PANEL_APPLET_RESPAWN_MAX crashes, each one
+ * less than PANEL_APPLET_RESPAWN_RESET seconds after the previous one, the
+ * user is asked what to do. */
+#define PANEL_APPLET_RESPAWN_DELAY  1
+#define PANEL_APPLET_RESPAWN_MAX    5
+#define PANEL_APPLET_RESPAWN_RESET  300
+/* How long a restarted applet keeps the size of the crashed one */
+#define PANEL_APPLET_RESPAWN_HOLD   2
+
 static void mate_panel_applet_frame_activating_free (MatePanelAppletFrameActivating *frame_act);
 
 static void mate_panel_applet_frame_loading_failed  (const char  *iid,
 					        PanelWidget *panel,
 					        const char  *id);
 
+static void mate_panel_applet_frame_restore_respawn (MatePanelAppletFrame *frame,
+						const char           *id);
+
 static void mate_panel_applet_frame_load            (const gchar *iid,
 						PanelWidget *panel,
 						gboolean     locked,
@@ -73,6 +87,7 @@ struct _MatePanelAppletFrameActivating {
 	int          position;
 	gboolean     exactpos;
 	char        *id;
+	gint64       load_time;
 };
 
 /* MatePanelAppletFrame implementation */
@@ -91,9 +106,29 @@ struct _MatePanelAppletFramePrivate {
 	GtkAllocation    child_allocation;
 	GdkRectangle     handle_rect;
 
+	/* the last size hints from the applet, without the handle */
+	gint            *size_hints;
+	gsize            n_size_hints;
+
+	/* from mate_panel_applet_frame_load() to the applet being registered */
+	gint64           activation_time;
+
 	guint            has_handle : 1;
 };
 
+/* What is remembered of a crashed applet, by applet id */
+typedef struct {
+	guint   n_crashes;
+	gint64  last_crash;
+
+	int     width;
+	int     height;
+	gint   *size_hints;
+	gsize   n_size_hints;
+} MatePanelAppletRespawn;
+
+static GHashTable *respawns = NULL;
+
 G_DEFINE_TYPE_WITH_PRIVATE (MatePanelAppletFrame, mate_panel_applet_frame, GTK_TYPE_EVENT_BOX)
 
 static gboolean
@@ -104,6 +139,7 @@ mate_panel_applet_frame_draw (GtkWidget *widget,
 	GtkStyleContext *context;
 	GtkStateFlags     state;
 	PanelBackground  *background;
+	GdkRectangle      clip;
 
 	if (GTK_WIDGET_CLASS (mate_panel_applet_frame_parent_class)->draw)
 		GTK_WIDGET_CLASS (mate_panel_applet_frame_parent_class)->draw (widget, cr);
@@ -111,6 +147,11 @@ mate_panel_applet_frame_draw (GtkWidget *widget,
 	if (!frame->priv->has_handle)
 		return FALSE;
 
+	/* nothing to do when only the applet itself needs to be redrawn */
+	if (gdk_cairo_get_clip_rectangle (cr, &clip) &&
+	    !gdk_rectangle_intersect (&clip, &frame->priv->handle_rect, NULL))
+		return FALSE;
+
 	context = gtk_widget_get_style_context (widget);
 	state = gtk_widget_get_state_flags (widget);
 	gtk_style_context_save (context);
@@ -439,6 +480,7 @@ mate_panel_applet_frame_finalize (GObject *object)
 				      frame);
 
 	g_clear_pointer (&frame->priv->iid, g_free);
+	g_clear_pointer (&frame->priv->size_hints, g_free);
 
 	G_OBJECT_CLASS (mate_panel_applet_frame_parent_class)->finalize (object);
 }
@@ -547,6 +589,56 @@ mate_panel_applet_frame_set_panel (MatePanelAppletFrame *frame,
 	frame->priv->panel = panel;
 }
 
+/* Adds what is known of the resources used by the applet to @stats */
+void
+mate_panel_applet_frame_get_stats (MatePanelAppletFrame *frame,
+			      GVariantDict     *stats)
+{
+	g_return_if_fail (PANEL_IS_APPLET_FRAME (frame));
+
+	if (frame->priv->iid)
+		g_variant_dict_insert (stats, "iid", "s", frame->priv->iid);
+	if (frame->priv->activation_time > 0)
+		g_variant_dict_insert (stats, "activation-us", "x", frame->priv->activation_time);
+
+	if (MATE_PANEL_APPLET_FRAME_GET_CLASS (frame)->get_stats)
+		MATE_PANEL_APPLET_FRAME_GET_CLASS (frame)->get_stats (frame, stats);
+}
+
+/* Fetches what the applet counts itself, for the next calls to
+ * mate_panel_applet_frame_get_stats(). The implementations returning
+ * the task with an error keep the previous statistics. */
+void
+mate_panel_applet_frame_update_stats (MatePanelAppletFrame *frame,
+				      GAsyncReadyCallback   callback,
+				      gpointer              user_data)
+{
+	GTask *task;
+
+	g_return_if_fail (PANEL_IS_APPLET_FRAME (frame));
+
+	task = g_task_new (frame, NULL, callback, user_data);
+	g_task_set_source_tag (task, mate_panel_applet_frame_update_stats);
+
+	if (MATE_PANEL_APPLET_FRAME_GET_CLASS (frame)->update_stats) {
+		MATE_PANEL_APPLET_FRAME_GET_CLASS (frame)->update_stats (frame, task);
+		return;
+	}
+
+	g_task_return_boolean (task, TRUE);
+	g_object_unref (task);
+}
+
+gboolean
+mate_panel_applet_frame_update_stats_finish (MatePanelAppletFrame  *frame,
+					     GAsyncResult          *result,
+					     GError               **error)
+{
+	g_return_val_if_fail (g_task_is_valid (result, frame), FALSE);
+
+	return g_task_propagate_boolean (G_TASK (result), error);
+}
+
 void
 _mate_panel_applet_frame_set_iid (MatePanelAppletFrame *frame,
 			     const gchar      *iid)
@@ -569,6 +661,7 @@ _mate_panel_applet_frame_activated (MatePanelAppletFrame           *frame,
 			   frame->priv->iid, error->message);
 		g_error_free (error);
 
+		panel_perf_count ("applet-activation-failures", 1);
 		mate_panel_applet_frame_loading_failed (frame->priv->iid,
 						   frame_act->panel,
 						   frame_act->id);
@@ -587,10 +680,16 @@ _mate_panel_applet_frame_activated (MatePanelAppletFrame           *frame,
 				      frame_act->exactpos, PANEL_OBJECT_APPLET,
 				      frame_act->id);
 	frame->priv->applet_info = info;
+	frame->priv->activation_time = g_get_monotonic_time () - frame_act->load_time;
+
+	panel_perf_count ("applet-activations", 1);
+	panel_perf_record ("applet-activation-us", frame->priv->activation_time);
 
 	panel_widget_set_applet_size_constrained (frame->priv->panel,
 						  GTK_WIDGET (frame), TRUE);
 
+	mate_panel_applet_frame_restore_respawn (frame, frame_act->id);
+
 	mate_panel_applet_frame_sync_menu_state (frame);
 	mate_panel_applet_frame_init_properties (frame);
 
@@ -630,6 +729,11 @@ _mate_panel_applet_frame_update_size_hints (MatePanelAppletFrame *frame,
                                             gint                 *size_hints,
                                             gsize                 n_elements)
 {
+	g_free (frame->priv->size_hints);
+	frame->priv->size_hints = g_new (gint, n_elements);
+	memcpy (frame->priv->size_hints, size_hints, n_elements * sizeof (gint));
+	frame->priv->n_size_hints = n_elements;
+
 	if (frame->priv->has_handle) {
 		gint extra_size = HANDLE_SIZE + 1;
 		gsize i;
@@ -645,19 +749,18 @@ _mate_panel_applet_frame_update_size_hints (MatePanelAppletFrame *frame,
 					    n_elements);
 }
 
-char *
-_mate_panel_applet_frame_get_background_string (MatePanelAppletFrame    *frame,
-					   PanelWidget         *panel,
-					   PanelBackgroundType  type)
+/* Where the applet is in the panel background */
+static void
+mate_panel_applet_frame_get_background_position (MatePanelAppletFrame *frame,
+						 int                  *x,
+						 int                  *y)
 {
 	GtkAllocation allocation;
-	int x;
-	int y;
 
 	gtk_widget_get_allocation (GTK_WIDGET (frame), &allocation);
 
-	x = allocation.x;
-	y = allocation.y;
+	*x = allocation.x;
+	*y = allocation.y;
 
 	if (frame->priv->has_handle) {
 		switch (frame->priv->orientation) {
@@ -665,21 +768,72 @@ _mate_panel_applet_frame_get_background_string (MatePanelAppletFrame    *frame,
 		case PANEL_ORIENTATION_BOTTOM:
 			if (gtk_widget_get_direction (GTK_WIDGET (frame)) !=
 			    GTK_TEXT_DIR_RTL)
-				x += frame->priv->handle_rect.width;
+				*x += frame->priv->handle_rect.width;
 			break;
 		case PANEL_ORIENTATION_LEFT:
 		case PANEL_ORIENTATION_RIGHT:
-			y += frame->priv->handle_rect.height;
+			*y += frame->priv->handle_rect.height;
 			break;
 		default:
 			g_assert_not_reached ();
 			break;
 		}
 	}
+}
+
+char *
+_mate_panel_applet_frame_get_background_string (MatePanelAppletFrame    *frame,
+					   PanelWidget         *panel,
+					   PanelBackgroundType  type)
+{
+	int x;
+	int y;
+
+	mate_panel_applet_frame_get_background_position (frame, &x, &y);
 
 	return panel_background_make_string (&panel->toplevel->background, x, y);
 }
 
+GVariant *
+_mate_panel_applet_frame_get_background_descriptor (MatePanelAppletFrame    *frame,
+						    PanelWidget         *panel,
+						    PanelBackgroundType  type)
+{
+	int x;
+	int y;
+
+	mate_panel_applet_frame_get_background_position (frame, &x, &y);
+
+	return panel_background_make_descriptor (&panel->toplevel->background, x, y);
+}
+
+static void
+mate_panel_applet_frame_reload (MatePanelAppletFrame *frame)
+{
+	AppletInfo  *info = frame->priv->applet_info;
+	PanelWidget *panel;
+	char        *iid;
+	char        *id = NULL;
+	int          position = -1;
+	gboolean     locked = FALSE;
+
+	panel = frame->priv->panel;
+	iid   = g_strdup (frame->priv->iid);
+
+	if (info) {
+		id = g_strdup (info->id);
+		position  = mate_panel_applet_get_position (info);
+		locked = panel_widget_get_applet_locked (panel, info->widget);
+		mate_panel_applet_clean (info);
+	}
+
+	mate_panel_applet_frame_load (iid, panel, locked,
+				 position, TRUE, id);
+
+	g_free (iid);
+	g_free (id);
+}
+
 static void
 mate_panel_applet_frame_reload_response (GtkWidget        *dialog,
 				    int               response,
@@ -698,28 +852,15 @@ mate_panel_applet_frame_reload_response (GtkWidget        *dialog,
 	info = frame->priv->applet_info;
 
 	if (response == PANEL_RESPONSE_RELOAD) {
-		PanelWidget *panel;
-		char        *iid;
-		char        *id = NULL;
-		int          position = -1;
-		gboolean     locked = FALSE;
-
-		panel = frame->priv->panel;
-		iid   = g_strdup (frame->priv->iid);
-
-		if (info) {
-			id = g_strdup (info->id);
-			position  = mate_panel_applet_get_position (info);
-			locked = panel_widget_get_applet_locked (panel, info->widget);
-			mate_panel_applet_clean (info);
-		}
+		MatePanelAppletRespawn *respawn = NULL;
 
-		mate_panel_applet_frame_load (iid, panel, locked,
-					 position, TRUE, id);
-
-		g_free (iid);
-		g_free (id);
+		/* the user asked for it: start counting crashes again */
+		if (respawns && info)
+			respawn = g_hash_table_lookup (respawns, info->id);
+		if (respawn)
+			respawn->n_crashes = 0;
 
+		mate_panel_applet_frame_reload (frame);
 	} else if (response == PANEL_RESPONSE_DELETE) {
 		/* if we can't write to applets list we can't really delete
 		   it, so we'll just ignore this.  FIXME: handle this
@@ -732,6 +873,124 @@ mate_panel_applet_frame_reload_response (GtkWidget        *dialog,
 	gtk_widget_destroy (dialog);
 }
 
+static void
+mate_panel_applet_respawn_free (MatePanelAppletRespawn *respawn)
+{
+	g_free (respawn->size_hints);
+	g_slice_free (MatePanelAppletRespawn, respawn);
+}
+
+static gboolean
+mate_panel_applet_frame_respawn_timeout (gpointer user_data)
+{
+	MatePanelAppletFrame *frame = MATE_PANEL_APPLET_FRAME (user_data);
+
+	/* the applet was removed in the meantime */
+	if (!gtk_widget_get_parent (GTK_WIDGET (frame)) ||
+	    !frame->priv->iid || !frame->priv->panel)
+		return G_SOURCE_REMOVE;
+
+	mate_panel_applet_frame_reload (frame);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Returns FALSE when the applet crashed too often to be restarted */
+static gboolean
+mate_panel_applet_frame_respawn (MatePanelAppletFrame *frame)
+{
+	MatePanelAppletRespawn *respawn;
+	GtkAllocation           allocation;
+	AppletInfo             *info = frame->priv->applet_info;
+	gint64                  now;
+
+	if (!info || !frame->priv->iid || !frame->priv->panel)
+		return FALSE;
+
+	if (!respawns)
+		respawns = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+						  (GDestroyNotify) mate_panel_applet_respawn_free);
+
+	respawn = g_hash_table_lookup (respawns, info->id);
+	if (!respawn) {
+		respawn = g_slice_new0 (MatePanelAppletRespawn);
+		g_hash_table_insert (respawns, g_strdup (info->id), respawn);
+	}
+
+	now = g_get_monotonic_time ();
+	if (now - respawn->last_crash > PANEL_APPLET_RESPAWN_RESET * G_USEC_PER_SEC)
+		respawn->n_crashes = 0;
+	respawn->last_crash = now;
+
+	if (respawn->n_crashes >= PANEL_APPLET_RESPAWN_MAX)
+		return FALSE;
+
+	/* keep the place of the applet, so that the panel does not relayout
+	 * while it is down and again once it is back */
+	gtk_widget_get_allocation (GTK_WIDGET (frame), &allocation);
+	respawn->width = allocation.width;
+	respawn->height = allocation.height;
+	g_free (respawn->size_hints);
+	respawn->size_hints = g_new (gint, frame->priv->n_size_hints);
+	memcpy (respawn->size_hints, frame->priv->size_hints,
+		frame->priv->n_size_hints * sizeof (gint));
+	respawn->n_size_hints = frame->priv->n_size_hints;
+
+	gtk_widget_set_size_request (GTK_WIDGET (frame),
+				     respawn->width, respawn->height);
+
+	g_timeout_add_seconds_full (G_PRIORITY_DEFAULT,
+				    PANEL_APPLET_RESPAWN_DELAY << respawn->n_crashes,
+				    mate_panel_applet_frame_respawn_timeout,
+				    g_object_ref (frame), g_object_unref);
+	respawn->n_crashes++;
+
+	return TRUE;
+}
+
+static gboolean
+mate_panel_applet_frame_release_size (gpointer user_data)
+{
+	gtk_widget_set_size_request (GTK_WIDGET (user_data), -1, -1);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Gives a restarted applet the size of the crashed one until it had the
+ * time to tell its own */
+static void
+mate_panel_applet_frame_restore_respawn (MatePanelAppletFrame *frame,
+					 const char           *id)
+{
+	MatePanelAppletRespawn *respawn;
+
+	if (!respawns)
+		return;
+
+	respawn = g_hash_table_lookup (respawns, id);
+	if (!respawn || respawn->n_crashes == 0)
+		return;
+
+	/* the snapshot is only used once */
+	if (respawn->n_size_hints > 0) {
+		_mate_panel_applet_frame_update_size_hints (frame,
+							    respawn->size_hints,
+							    respawn->n_size_hints);
+		respawn->size_hints = NULL;
+		respawn->n_size_hints = 0;
+	}
+
+	if (respawn->width > 1 && respawn->height > 1) {
+		gtk_widget_set_size_request (GTK_WIDGET (frame),
+					     respawn->width, respawn->height);
+		g_timeout_add_seconds_full (G_PRIORITY_DEFAULT,
+					    PANEL_APPLET_RESPAWN_HOLD,
+					    mate_panel_applet_frame_release_size,
+					    g_object_ref (frame), g_object_unref);
+		respawn->width = respawn->height = 0;
+	}
+}
+
 void
 _mate_panel_applet_frame_applet_broken (MatePanelAppletFrame *frame)
 {
@@ -747,6 +1006,9 @@ _mate_panel_applet_frame_applet_broken (MatePanelAppletFrame *frame)
 		return;
 #endif
 
+	if (mate_panel_applet_frame_respawn (frame))
+		return;
+
 	if (frame->priv->iid) {
 		MatePanelAppletInfo *info;
 
@@ -1022,6 +1284,7 @@ mate_panel_applet_frame_load (const gchar *iid,
 	frame_act->position = position;
 	frame_act->exactpos = exactpos;
 	frame_act->id       = g_strdup (id);
+	frame_act->load_time = g_get_monotonic_time ();
 
 	if (!mate_panel_applets_manager_load_applet (iid, frame_act)) {
 		mate_panel_applet_frame_loading_failed (iid, panel, id);
@@ -1043,7 +1306,7 @@ mate_panel_applet_frame_load_from_gsettings (PanelWidget *panel_widget,
 	g_return_if_fail (id != NULL);
 
 	path = g_strdup_printf (PANEL_OBJECT_PATH "%s/", id);
-	settings = g_settings_new_with_path (PANEL_OBJECT_SCHEMA, path);
+	settings = panel_profile_get_settings (PANEL_OBJECT_SCHEMA, path);
 	applet_iid = g_settings_get_string (settings, PANEL_OBJECT_APPLET_IID_KEY);
 	g_object_unref (settings);
 	g_free (path);
@@ -1073,7 +1336,7 @@ mate_panel_applet_frame_create (PanelToplevel *toplevel,
 	id = panel_profile_prepare_object (PANEL_OBJECT_APPLET, toplevel, position, FALSE);
 
 	path = g_strdup_printf (PANEL_OBJECT_PATH "%s/", id);
-	settings = g_settings_new_with_path (PANEL_OBJECT_SCHEMA, path);
+	settings = panel_profile_get_settings (PANEL_OBJECT_SCHEMA, path);
 	g_settings_set_string (settings, PANEL_OBJECT_APPLET_IID_KEY, iid);
 
 	panel_profile_add_to_list (PANEL_GSETTINGS_OBJECTS, id);
@@ -69,6 +69,12 @@ struct _MatePanelAppletFrameClass {
 
 	void     (*change_background)     (MatePanelAppletFrame    *frame,
 					   PanelBackgroundType  type);
+
+	void     (*get_stats)             (MatePanelAppletFrame    *frame,
+					   GVariantDict        *stats);
+
+	void     (*update_stats)          (MatePanelAppletFrame    *frame,
+					   GTask               *task);
 };
 
 struct _MatePanelAppletFrame {
@@ -102,6 +108,16 @@ void  mate_panel_applet_frame_change_background  (MatePanelAppletFrame    *frame
 void  mate_panel_applet_frame_set_panel          (MatePanelAppletFrame    *frame,
 					     PanelWidget         *panel);
 
+void  mate_panel_applet_frame_get_stats          (MatePanelAppletFrame    *frame,
+					     GVariantDict        *stats);
+
+void      mate_panel_applet_frame_update_stats        (MatePanelAppletFrame    *frame,
+						  GAsyncReadyCallback  callback,
+						  gpointer             user_data);
+gboolean  mate_panel_applet_frame_update_stats_finish (MatePanelAppletFrame    *frame,
+						  GAsyncResult        *result,
+						  GError             **error);
+
 /* For module implementations only */
 
 typedef struct _MatePanelAppletFrameActivating        MatePanelAppletFrameActivating;
@@ -132,6 +148,9 @@ void  _mate_panel_applet_frame_update_size_hints     (MatePanelAppletFrame *fram
 char *_mate_panel_applet_frame_get_background_string (MatePanelAppletFrame    *frame,
 						 PanelWidget         *panel,
 						 PanelBackgroundType  type);
+GVariant *_mate_panel_applet_frame_get_background_descriptor (MatePanelAppletFrame    *frame,
+						 PanelWidget         *panel,
+						 PanelBackgroundType  type);
 
 void  _mate_panel_applet_frame_applet_broken         (MatePanelAppletFrame *frame);
 
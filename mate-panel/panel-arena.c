@@ -0,0 +1,247 @@
+/*
+ * panel-arena.c: per-panel allocation of the objects bookkeeping
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/* The small structures kept for each object of a panel (the applet info,
+ * the layout data, the launcher and drawer state) come from the arena of
+ * the panel instead of one allocation each. The arena carves slots of a
+ * few sizes out of large chunks, and reuses the slots of the objects that
+ * go away, so that loading and removing objects over a long session does
+ * not scatter them over the heap.
+ *
+ * Every allocation remembers its arena, so it can be freed after being
+ * moved to another panel. The chunks are released in one go once the panel
+ * is destroyed and its last object freed: if objects outlive the panel,
+ * which only happens when they were moved away or leaked, this is logged,
+ * and the "arena-allocations" and "arena-frees" performance counters
+ * tell whether the difference keeps growing. */
+
+#include <config.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <libpanel-util/panel-perf.h>
+
+#include "panel-arena.h"
+#include "panel-profile.h"
+
+#define PANEL_ARENA_CHUNK_SIZE 4096
+#define PANEL_ARENA_GRAIN      16
+#define PANEL_ARENA_N_CLASSES  16	/* slots up to 256 bytes */
+#define PANEL_ARENA_LARGE      G_MAXUINT
+#define PANEL_ARENA_MAGIC      0x70617261
+
+/* in front of each allocation */
+typedef struct {
+	PanelArena *arena;
+	guint       size_class;	/* in grains, or PANEL_ARENA_LARGE */
+	guint       magic;	/* 0 once freed */
+} PanelArenaHeader;
+
+#define PANEL_ARENA_HEADER_SIZE \
+	((sizeof (PanelArenaHeader) + PANEL_ARENA_GRAIN - 1) & ~(gsize) (PANEL_ARENA_GRAIN - 1))
+
+#define PANEL_ARENA_HEADER(mem) \
+	((PanelArenaHeader *) ((char *) (mem) - PANEL_ARENA_HEADER_SIZE))
+#define PANEL_ARENA_MEM(header) \
+	((gpointer) ((char *) (header) + PANEL_ARENA_HEADER_SIZE))
+
+struct _PanelArena {
+	char     *name;
+
+	GSList   *chunks;
+	char     *chunk_pos;
+	gsize     chunk_left;
+
+	/* the freed slots of each size, linked through their first bytes */
+	gpointer  free_slots [PANEL_ARENA_N_CLASSES + 1];
+
+	guint     n_live;
+	guint     closed : 1;
+};
+
+static void
+panel_arena_release (PanelArena *arena)
+{
+	g_slist_free_full (arena->chunks, g_free);
+	g_free (arena->name);
+	g_free (arena);
+}
+
+static void
+panel_arena_close (PanelArena *arena)
+{
+	arena->closed = TRUE;
+
+	if (arena->n_live == 0) {
+		panel_arena_release (arena);
+		return;
+	}
+
+	g_debug ("%u objects of panel '%s' outlive it",
+		 arena->n_live, arena->name);
+}
+
+/**
+ * panel_arena_get:
+ * @toplevel: a panel
+ *
+ * Returns the arena of @toplevel, created the first time, and released
+ * with the panel.
+ */
+PanelArena *
+panel_arena_get (PanelToplevel *toplevel)
+{
+	PanelArena *arena;
+	const char *id;
+
+	g_return_val_if_fail (PANEL_IS_TOPLEVEL (toplevel), NULL);
+
+	arena = g_object_get_data (G_OBJECT (toplevel), "panel-arena");
+	if (arena)
+		return arena;
+
+	id = panel_profile_get_toplevel_id (toplevel);
+
+	arena = g_new0 (PanelArena, 1);
+	arena->name = g_strdup (id ? id : "unknown");
+
+	g_object_set_data_full (G_OBJECT (toplevel), "panel-arena", arena,
+				(GDestroyNotify) panel_arena_close);
+
+	return arena;
+}
+
+/**
+ * panel_arena_alloc0:
+ * @arena: an arena
+ * @size: the size of the allocation
+ *
+ * Allocates @size bytes, set to 0, from @arena.
+ *
+ * Returns: the memory, to free with panel_arena_free().
+ */
+gpointer
+panel_arena_alloc0 (PanelArena *arena,
+		    gsize       size)
+{
+	PanelArenaHeader *header;
+	gsize             slot_size;
+	guint             size_class;
+
+	g_return_val_if_fail (arena != NULL, NULL);
+
+	size_class = (MAX (size, 1) + PANEL_ARENA_GRAIN - 1) / PANEL_ARENA_GRAIN;
+
+	if (size_class > PANEL_ARENA_N_CLASSES) {
+		header = g_malloc0 (PANEL_ARENA_HEADER_SIZE + size);
+		header->size_class = PANEL_ARENA_LARGE;
+	} else {
+		slot_size = PANEL_ARENA_HEADER_SIZE + size_class * PANEL_ARENA_GRAIN;
+
+		if (arena->free_slots [size_class]) {
+			header = arena->free_slots [size_class];
+			arena->free_slots [size_class] = *(gpointer *) PANEL_ARENA_MEM (header);
+		} else {
+			if (arena->chunk_left < slot_size) {
+				arena->chunk_pos = g_malloc (PANEL_ARENA_CHUNK_SIZE);
+				arena->chunk_left = PANEL_ARENA_CHUNK_SIZE;
+				arena->chunks = g_slist_prepend (arena->chunks,
+								 arena->chunk_pos);
+			}
+
+			header = (PanelArenaHeader *) arena->chunk_pos;
+			arena->chunk_pos += slot_size;
+			arena->chunk_left -= slot_size;
+		}
+
+		memset (header, 0, slot_size);
+		header->size_class = size_class;
+	}
+
+	header->arena = arena;
+	header->magic = PANEL_ARENA_MAGIC;
+
+	arena->n_live++;
+	panel_perf_count ("arena-allocations", 1);
+
+	return PANEL_ARENA_MEM (header);
+}
+
+/**
+ * panel_arena_strdup:
+ * @arena: an arena
+ * @str: (allow-none): a string
+ *
+ * Returns: a copy of @str allocated from @arena, to free with
+ * panel_arena_free().
+ */
+char *
+panel_arena_strdup (PanelArena *arena,
+		    const char *str)
+{
+	char  *copy;
+	gsize  len;
+
+	if (!str)
+		return NULL;
+
+	len = strlen (str) + 1;
+	copy = panel_arena_alloc0 (arena, len);
+	memcpy (copy, str, len);
+
+	return copy;
+}
+
+/**
+ * panel_arena_free:
+ * @mem: (allow-none): memory from panel_arena_alloc0()
+ *
+ * Gives @mem back to its arena, whichever panel the object is on now.
+ */
+void
+panel_arena_free (gpointer mem)
+{
+	PanelArenaHeader *header;
+	PanelArena       *arena;
+
+	if (!mem)
+		return;
+
+	header = PANEL_ARENA_HEADER (mem);
+	g_return_if_fail (header->magic == PANEL_ARENA_MAGIC);
+
+	arena = header->arena;
+	header->magic = 0;
+
+	if (header->size_class == PANEL_ARENA_LARGE) {
+		g_free (header);
+	} else {
+		*(gpointer *) mem = arena->free_slots [header->size_class];
+		arena->free_slots [header->size_class] = header;
+	}
+
+	arena->n_live--;
+	panel_perf_count ("arena-frees", 1);
+
+	if (arena->closed && arena->n_live == 0)
+		panel_arena_release (arena);
+}
@@ -0,0 +1,46 @@
+/*
+ * panel-arena.h: per-panel allocation of the objects bookkeeping
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __PANEL_ARENA_H__
+#define __PANEL_ARENA_H__
+
+#include <glib.h>
+
+#include "panel-toplevel.h"
+
+G_BEGIN_DECLS
+
+typedef struct _PanelArena PanelArena;
+
+PanelArena *panel_arena_get     (PanelToplevel *toplevel);
+
+gpointer    panel_arena_alloc0  (PanelArena    *arena,
+				 gsize          size);
+char       *panel_arena_strdup  (PanelArena    *arena,
+				 const char    *str);
+void        panel_arena_free    (gpointer       mem);
+
+#define panel_arena_new0(arena, struct_type) \
+	((struct_type *) panel_arena_alloc0 ((arena), sizeof (struct_type)))
+
+G_END_DECLS
+
+#endif /* __PANEL_ARENA_H__ */
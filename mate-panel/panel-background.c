@@ -28,20 +28,27 @@
 #include "panel-background.h"
 
 #include <string.h>
+#include <glib/gstdio.h>
 #include <gdk/gdk.h>
 #include <gtk/gtk.h>
 #include <cairo.h>
 
 #ifdef HAVE_X11
+#include <X11/Xatom.h>
 #include <xstuff.h>
 #include <cairo-xlib.h>
 #endif
 
+#include <libpanel-util/panel-gtk.h>
+#include <libpanel-util/panel-perf.h>
+
 #include "panel-util.h"
 
 static gboolean panel_background_composite (PanelBackground *background);
 static void load_background_file (PanelBackground *background);
 
+static guint panel_background_generation = 0;
+
 void panel_background_apply_css (PanelBackground *background, GtkWidget *widget)
 {
 	GtkStyleContext     *context;
@@ -82,6 +89,88 @@ panel_background_prepare_css (void)
 	g_object_unref (provider);
 }
 
+/* The applets are only told about a background once it is complete, with
+ * a new generation, so that they never look at a half drawn pixmap. */
+static void
+panel_background_notify (PanelBackground *background)
+{
+	/* unique among all the panels, for applets moved to another one */
+	background->generation = ++panel_background_generation;
+	background->notify_changed (background, background->user_data);
+}
+
+#ifdef HAVE_X11
+#define PANEL_BACKGROUND_FENCE_ATOM "_MATE_PANEL_BACKGROUND_FENCE"
+
+/* The X server handles the requests of a client in order, and the property
+ * change of a fence comes after the drawing of the pixmap: when its
+ * PropertyNotify arrives, the pixmap is complete. */
+static GdkFilterReturn
+panel_background_fence_filter (GdkXEvent *gdk_xevent,
+			       GdkEvent  *event,
+			       gpointer   data)
+{
+	PanelBackground *background = data;
+	XEvent          *xevent = (XEvent *) gdk_xevent;
+
+	if (xevent->type != PropertyNotify ||
+	    xevent->xproperty.atom != gdk_x11_get_xatom_by_name_for_display (gdk_window_get_display (background->window),
+									      PANEL_BACKGROUND_FENCE_ATOM))
+		return GDK_FILTER_CONTINUE;
+
+	/* a burst of changes, like during a slide, is notified once */
+	if (background->fences_pending > 0 &&
+	    --background->fences_pending == 0)
+		panel_background_notify (background);
+
+	return GDK_FILTER_REMOVE;
+}
+
+static void
+panel_background_remove_fence_filter (PanelBackground *background)
+{
+	if (background->fence_filter)
+		gdk_window_remove_filter (background->window,
+					  panel_background_fence_filter,
+					  background);
+	background->fence_filter = FALSE;
+	background->fences_pending = 0;
+}
+
+/* Instead of a gdk_display_sync(), which blocks the main loop on a round
+ * trip to the X server, the notification waits for the event of a fence */
+static gboolean
+panel_background_send_fence (PanelBackground *background)
+{
+	GdkDisplay *display;
+	long        value;
+
+	display = gdk_window_get_display (background->window);
+	if (!GDK_IS_X11_DISPLAY (display))
+		return FALSE;
+
+	if (!background->fence_filter) {
+		gdk_window_set_events (background->window,
+				       gdk_window_get_events (background->window) |
+				       GDK_PROPERTY_CHANGE_MASK);
+		gdk_window_add_filter (background->window,
+				       panel_background_fence_filter,
+				       background);
+		background->fence_filter = TRUE;
+	}
+
+	value = ++background->fences_pending;
+	XChangeProperty (GDK_DISPLAY_XDISPLAY (display),
+			 GDK_WINDOW_XID (background->window),
+			 gdk_x11_get_xatom_by_name_for_display (display, PANEL_BACKGROUND_FENCE_ATOM),
+			 XA_CARDINAL, 32, PropModeReplace,
+			 (guchar *) &value, 1);
+	gdk_display_flush (display);
+
+	return TRUE;
+}
+#endif
+
 static gboolean
 panel_background_prepare (PanelBackground *background)
 {
@@ -91,6 +180,8 @@ panel_background_prepare (PanelBackground *background)
 	if (!background->transformed)
 		return FALSE;
 
+	panel_perf_count ("background-rebuilds", 1);
+
 	effective_type = panel_background_effective_type (background);
 
 	switch (effective_type) {
@@ -153,12 +244,6 @@ panel_background_prepare (PanelBackground *background)
 		break;
 	}
 
-	/* Panel applets may use the panel's background pixmap to
-	 * decide how to draw themselves.  Therefore, we need to
-	 * make sure that all drawing has been completed before
-	 * the applet looks at the pixmap. */
-	gdk_display_sync (gdk_window_get_display (background->window));
-
 	gdk_window_get_user_data (GDK_WINDOW (background->window),
 				  (gpointer) &widget);
 
@@ -168,7 +253,24 @@ panel_background_prepare (PanelBackground *background)
 		gtk_widget_queue_draw (widget);
 	}
 
-	background->notify_changed (background, background->user_data);
+	/* Panel applets may use the panel's background pixmap to
+	 * decide how to draw themselves.  Therefore, we need to
+	 * make sure that all drawing has been completed before
+	 * the applet looks at the pixmap. Colors are sent by value
+	 * and have nothing to wait for. */
+#ifdef HAVE_X11
+	if (effective_type == PANEL_BACK_IMAGE) {
+		cairo_surface_t *surface;
+
+		if (cairo_pattern_get_surface (background->composited_pattern, &surface) == CAIRO_STATUS_SUCCESS)
+			cairo_surface_flush (surface);
+
+		if (panel_background_send_fence (background))
+			return TRUE;
+	}
+#endif
+
+	panel_background_notify (background);
 
 	return TRUE;
 }
@@ -204,7 +306,8 @@ composite_image_onto_desktop (PanelBackground *background)
 
 	cr = cairo_create (surface);
 
-	gdk_cairo_set_source_pixbuf (cr, background->transformed_image, 0, 0);
+	/* the transformed images are shared through the transform cache */
+	cairo_set_source_surface (cr, panel_gdk_pixbuf_peek_surface (background->transformed_image), 0, 0);
 	pattern = cairo_get_source (cr);
 	cairo_pattern_set_extend (pattern, CAIRO_EXTEND_REPEAT);
 
@@ -234,6 +337,7 @@ panel_background_composite (PanelBackground *background)
         if (background->transformed_image) {
 			background->composited_pattern =
 				composite_image_onto_desktop (background);
+			background->composited_serial++;
 		}
 		break;
 	default:
@@ -263,18 +367,140 @@ free_transformed_resources (PanelBackground *background)
 	background->transformed_image = NULL;
 }
 
+/* Transformed images are kept in a small LRU shared by every panel, so
+ * that going back and forth between known sizes and orientations (auto-hide,
+ * orientation flips, several panels using the same image) does not scale
+ * and rotate the image again.
+ */
+#define TRANSFORM_CACHE_SIZE 8
+
+typedef struct {
+	char      *key;
+	GdkPixbuf *pixbuf;
+} TransformCacheEntry;
+
+static GHashTable *transform_cache = NULL;
+static GQueue      transform_cache_lru = G_QUEUE_INIT;
+
+static void
+transform_cache_entry_free (TransformCacheEntry *entry)
+{
+	g_object_unref (entry->pixbuf);
+	g_free (entry->key);
+	g_free (entry);
+}
+
+static char *
+transform_cache_make_key (PanelBackground *background)
+{
+	GStatBuf  buf;
+	gint64    mtime = 0;
+	int       width, height;
+	int       scale = 1;
+	gboolean  rotate;
+
+	if (g_stat (background->image, &buf) == 0)
+		mtime = (gint64) buf.st_mtime;
+
+	/* the size of the panel only matters when fitting or stretching */
+	if (background->fit_image || background->stretch_image) {
+		width  = background->region.width;
+		height = background->region.height;
+	} else {
+		width  = 0;
+		height = 0;
+	}
+
+	rotate = background->rotate_image &&
+		 background->orientation == GTK_ORIENTATION_VERTICAL;
+
+	if (background->window)
+		scale = gdk_window_get_scale_factor (background->window);
+
+	return g_strdup_printf ("%d:%d:%d:%d:%d:%d:%d:%" G_GINT64_FORMAT ":%s",
+				width, height,
+				background->orientation,
+				background->fit_image,
+				background->stretch_image,
+				rotate, scale, mtime,
+				background->image);
+}
+
+static GdkPixbuf *
+transform_cache_lookup (const char *key)
+{
+	TransformCacheEntry *entry;
+	GList               *link;
+
+	if (!transform_cache)
+		return NULL;
+
+	entry = g_hash_table_lookup (transform_cache, key);
+	if (!entry)
+		return NULL;
+
+	link = g_queue_find (&transform_cache_lru, entry);
+	g_queue_unlink (&transform_cache_lru, link);
+	g_queue_push_head_link (&transform_cache_lru, link);
+
+	return g_object_ref (entry->pixbuf);
+}
+
+static void
+transform_cache_insert (char      *key,
+			GdkPixbuf *pixbuf)
+{
+	TransformCacheEntry *entry;
+
+	if (!transform_cache)
+		transform_cache = g_hash_table_new (g_str_hash, g_str_equal);
+
+	entry = g_hash_table_lookup (transform_cache, key);
+	if (entry) {
+		g_free (key);
+		return;
+	}
+
+	entry = g_new0 (TransformCacheEntry, 1);
+	entry->key = key;
+	entry->pixbuf = g_object_ref (pixbuf);
+
+	g_hash_table_insert (transform_cache, entry->key, entry);
+	g_queue_push_head (&transform_cache_lru, entry);
+
+	while (g_queue_get_length (&transform_cache_lru) > TRANSFORM_CACHE_SIZE) {
+		entry = g_queue_pop_tail (&transform_cache_lru);
+		g_hash_table_remove (transform_cache, entry->key);
+		transform_cache_entry_free (entry);
+	}
+}
+
 static GdkPixbuf *
 get_scaled_and_rotated_pixbuf (PanelBackground *background)
 {
 	GdkPixbuf *scaled;
 	GdkPixbuf *retval;
+	char      *key;
 	int        orig_width, orig_height;
 	int        panel_width, panel_height;
 	int        width, height;
 
+	if (!background->image)
+		return NULL;
+
+	key = transform_cache_make_key (background);
+	retval = transform_cache_lookup (key);
+	if (retval) {
+		g_free (key);
+		background->has_alpha = gdk_pixbuf_get_has_alpha (retval);
+		return retval;
+	}
+
 	load_background_file (background);
-	if (!background->loaded_image)
+	if (!background->loaded_image) {
+		g_free (key);
 		return NULL;
+	}
 
 	orig_width  = gdk_pixbuf_get_width  (background->loaded_image);
 	orig_height = gdk_pixbuf_get_height (background->loaded_image);
@@ -383,6 +609,8 @@ get_scaled_and_rotated_pixbuf (PanelBackground *background)
 	} else
 		retval = scaled;
 
+	transform_cache_insert (key, retval);
+
 	return retval;
 }
 
@@ -417,6 +645,10 @@ panel_background_update_has_alpha (PanelBackground *background)
 		 background->loaded_image)
 		has_alpha = gdk_pixbuf_get_has_alpha (background->loaded_image);
 
+	else if (background->type == PANEL_BACK_IMAGE &&
+		 background->transformed_image)
+		has_alpha = gdk_pixbuf_get_has_alpha (background->transformed_image);
+
 	background->has_alpha = (has_alpha != FALSE);
 }
 
@@ -431,6 +663,7 @@ load_background_file (PanelBackground *background)
 	/* FIXME add a monitor on the file so that we reload the background
 	 * when it changes
 	 */
+	g_clear_object (&background->loaded_image);
 	background->loaded_image =
 		gdk_pixbuf_new_from_file (background->image, &error);
 	if (!background->loaded_image) {
@@ -603,6 +836,11 @@ panel_background_set_default_style (PanelBackground *background,
 {
 	g_return_if_fail (color != NULL);
 
+	/* the style is updated several times for one theme change */
+	if (gdk_rgba_equal (&background->default_color, color) &&
+	    background->default_pattern == pattern)
+		return;
+
 	background->default_color = *color;
 
 	if (pattern)
@@ -635,6 +873,10 @@ panel_background_realized (PanelBackground *background,
 void
 panel_background_unrealized (PanelBackground *background)
 {
+#ifdef HAVE_X11
+	panel_background_remove_fence_filter (background);
+#endif
+
 	if (background->window)
 		g_object_unref (background->window);
 	background->window = NULL;
@@ -658,6 +900,19 @@ panel_background_change_region (PanelBackground *background,
 	    background->orientation == orientation)
 		return;
 
+	/* the rendered background does not depend on the position of the
+	   panel, so a plain move does not need to touch the background nor
+	   to notify the applets */
+	if (background->region.width == width &&
+	    background->region.height == height &&
+	    background->orientation == orientation &&
+	    background->transformed &&
+	    background->composited) {
+		background->region.x = x;
+		background->region.y = y;
+		return;
+	}
+
 	/* we only need to retransform anything
 	   on size/orientation changes if the
 	   background is an image and some
@@ -728,6 +983,9 @@ panel_background_init (PanelBackground              *background,
 	background->region.height     = -1;
 	background->transformed_image = NULL;
 	background->composited_pattern = NULL;
+	background->composited_serial = 0;
+	background->generation = 0;
+	background->fences_pending = 0;
 
 	background->window   = NULL;
 
@@ -746,6 +1004,7 @@ panel_background_init (PanelBackground              *background,
 
 	background->transformed = FALSE;
 	background->composited  = FALSE;
+	background->fence_filter = FALSE;
 }
 
 void
@@ -756,6 +1015,9 @@ panel_background_free (PanelBackground *background)
 	g_clear_pointer (&background->image, g_free);
 
 	g_clear_object (&background->loaded_image);
+#ifdef HAVE_X11
+	panel_background_remove_fence_filter (background);
+#endif
 	g_clear_object (&background->window);
 
 	if (background->default_pattern)
@@ -763,6 +1025,23 @@ panel_background_free (PanelBackground *background)
 	background->default_pattern = NULL;
 }
 
+/* Estimated from the dimensions: the composited pattern lives in a
+ * surface of the X server, of the size of the region */
+guint64
+panel_background_get_memory_size (PanelBackground *background)
+{
+	guint64 size = 0;
+
+	if (background->loaded_image)
+		size += gdk_pixbuf_get_byte_length (background->loaded_image);
+	if (background->transformed_image)
+		size += gdk_pixbuf_get_byte_length (background->transformed_image);
+	if (background->composited_pattern)
+		size += (guint64) background->region.width * background->region.height * 4;
+
+	return size;
+}
+
 char *
 panel_background_make_string (PanelBackground *background,
 			      int              x,
@@ -787,7 +1066,13 @@ panel_background_make_string (PanelBackground *background,
 		if (cairo_surface_get_type (surface) != CAIRO_SURFACE_TYPE_XLIB)
 			return NULL;
 
-		retval = g_strdup_printf ("pixmap:%d,%d,%d", (guint32)cairo_xlib_surface_get_drawable (surface), x, y);
+		/* the serial makes the string change whenever the contents
+		 * change, even if the X server recycled the pixmap id */
+		retval = g_strdup_printf ("pixmap:%d,%d,%d,%d,%d,%u",
+					  (guint32)cairo_xlib_surface_get_drawable (surface), x, y,
+					  cairo_xlib_surface_get_width (surface),
+					  cairo_xlib_surface_get_height (surface),
+					  background->composited_serial);
 	} else if (effective_type == PANEL_BACK_COLOR) {
 		gchar *rgba = gdk_rgba_to_string (&background->color);
 		retval = g_strdup_printf (
@@ -800,6 +1085,61 @@ panel_background_make_string (PanelBackground *background,
 	return retval;
 }
 
+/* The same as panel_background_make_string(), as an a{sv} dictionary that
+ * applets can use without parsing it. The generation tells whether the
+ * background itself changed, the position whether only our part of it
+ * did. */
+GVariant *
+panel_background_make_descriptor (PanelBackground *background,
+				  int              x,
+				  int              y)
+{
+	PanelBackgroundType  effective_type;
+	GVariantBuilder      builder;
+
+	effective_type = panel_background_effective_type (background);
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+	g_variant_builder_add (&builder, "{sv}", "generation",
+			       g_variant_new_uint32 (background->generation));
+	g_variant_builder_add (&builder, "{sv}", "x", g_variant_new_int32 (x));
+	g_variant_builder_add (&builder, "{sv}", "y", g_variant_new_int32 (y));
+
+	if (effective_type == PANEL_BACK_IMAGE) {
+		cairo_surface_t *surface;
+
+		if (!background->composited_pattern ||
+		    cairo_pattern_get_surface (background->composited_pattern, &surface) != CAIRO_STATUS_SUCCESS ||
+		    cairo_surface_get_type (surface) != CAIRO_SURFACE_TYPE_XLIB) {
+			g_variant_builder_clear (&builder);
+			return NULL;
+		}
+
+		g_variant_builder_add (&builder, "{sv}", "type",
+				       g_variant_new_string ("pixmap"));
+		g_variant_builder_add (&builder, "{sv}", "pixmap",
+				       g_variant_new_uint32 ((guint32) cairo_xlib_surface_get_drawable (surface)));
+		g_variant_builder_add (&builder, "{sv}", "width",
+				       g_variant_new_int32 (cairo_xlib_surface_get_width (surface)));
+		g_variant_builder_add (&builder, "{sv}", "height",
+				       g_variant_new_int32 (cairo_xlib_surface_get_height (surface)));
+	} else if (effective_type == PANEL_BACK_COLOR) {
+		g_variant_builder_add (&builder, "{sv}", "type",
+				       g_variant_new_string ("color"));
+		g_variant_builder_add (&builder, "{sv}", "color",
+				       g_variant_new ("(dddd)",
+						      background->color.red,
+						      background->color.green,
+						      background->color.blue,
+						      background->color.alpha));
+	} else {
+		g_variant_builder_add (&builder, "{sv}", "type",
+				       g_variant_new_string ("none"));
+	}
+
+	return g_variant_builder_end (&builder);
+}
+
 PanelBackgroundType
 panel_background_get_type (PanelBackground *background)
 {
@@ -55,6 +55,11 @@ struct _PanelBackground {
 	GdkRectangle            region;
 	GdkPixbuf              *transformed_image;
 	cairo_pattern_t        *composited_pattern;
+	guint                   composited_serial;
+	/* changes whenever what applets get from us changes */
+	guint                   generation;
+	/* fences sent to the X server and not seen back yet */
+	guint                   fences_pending;
 
 	GdkWindow              *window;
 	cairo_pattern_t        *default_pattern;
@@ -69,6 +74,7 @@ struct _PanelBackground {
 	guint                   loaded : 1;
 	guint                   transformed : 1;
 	guint                   composited : 1;
+	guint                   fence_filter : 1;
 };
 
 void  panel_background_init              (PanelBackground     *background,
@@ -109,6 +115,11 @@ void  panel_background_change_region     (PanelBackground     *background,
 char *panel_background_make_string       (PanelBackground     *background,
 					  int                  x,
 					  int                  y);
+GVariant *panel_background_make_descriptor (PanelBackground   *background,
+					  int                  x,
+					  int                  y);
+
+guint64 panel_background_get_memory_size (PanelBackground *background);
 
 PanelBackgroundType  panel_background_get_type   (PanelBackground *background);
 const GdkRGBA       *panel_background_get_color  (PanelBackground *background);
@@ -32,14 +32,20 @@
 #include <string.h>
 #include <gio/gio.h>
 
+#include <libpanel-util/panel-spawn.h>
+
 #include "panel-globals.h"
 
 typedef struct {
 	guint               tooltips_enabled : 1;
 	guint               enable_animations : 1;
+	guint               enable_launch_animation : 1;
 	guint               drawer_auto_close : 1;
+	guint               release_closed_drawers : 1;
 	guint               confirm_panel_remove : 1;
 	guint               highlight_when_over : 1;
+	guint               lazy_load_hidden_applets : 1;
+	guint               max_loading_applets;
 } GlobalConfig;
 
 static GlobalConfig global_config = { 0, };
@@ -62,6 +68,14 @@ panel_global_config_get_enable_animations (void)
 	return global_config.enable_animations;
 }
 
+gboolean
+panel_global_config_get_enable_launch_animation (void)
+{
+	g_assert (global_config_initialised == TRUE);
+
+	return global_config.enable_launch_animation;
+}
+
 gboolean
 panel_global_config_get_drawer_auto_close (void)
 {
@@ -70,6 +84,14 @@ panel_global_config_get_drawer_auto_close (void)
 	return global_config.drawer_auto_close;
 }
 
+gboolean
+panel_global_config_get_release_closed_drawers (void)
+{
+	g_assert (global_config_initialised == TRUE);
+
+	return global_config.release_closed_drawers;
+}
+
 gboolean
 panel_global_config_get_tooltips_enabled (void)
 {
@@ -86,6 +108,22 @@ panel_global_config_get_confirm_panel_remove (void)
 	return global_config.confirm_panel_remove;
 }
 
+gboolean
+panel_global_config_get_lazy_load_hidden_applets (void)
+{
+	g_assert (global_config_initialised == TRUE);
+
+	return global_config.lazy_load_hidden_applets;
+}
+
+guint
+panel_global_config_get_max_loading_applets (void)
+{
+	g_assert (global_config_initialised == TRUE);
+
+	return global_config.max_loading_applets;
+}
+
 static void
 panel_global_config_set_entry (GSettings *settings, gchar *key)
 {
@@ -100,10 +138,18 @@ panel_global_config_set_entry (GSettings *settings, gchar *key)
 		global_config.enable_animations =
 			(g_settings_get_boolean (settings, key) != FALSE);
 
+	else if (strcmp (key, "enable-launch-animation") == 0)
+		global_config.enable_launch_animation =
+			(g_settings_get_boolean (settings, key) != FALSE);
+
 	else if (strcmp (key, "drawer-autoclose") == 0)
 		global_config.drawer_auto_close =
 			(g_settings_get_boolean (settings, key) != FALSE);
 
+	else if (strcmp (key, "release-closed-drawers") == 0)
+		global_config.release_closed_drawers =
+			(g_settings_get_boolean (settings, key) != FALSE);
+
 	else if (strcmp (key, "confirm-panel-remove") == 0)
 		global_config.confirm_panel_remove =
 			(g_settings_get_boolean (settings, key) != FALSE);
@@ -111,6 +157,17 @@ panel_global_config_set_entry (GSettings *settings, gchar *key)
 	else if (strcmp (key, "highlight-launchers-on-mouseover") == 0)
 		global_config.highlight_when_over =
 			(g_settings_get_boolean (settings, key) != FALSE);
+
+	else if (strcmp (key, "lazy-load-hidden-applets") == 0)
+		global_config.lazy_load_hidden_applets =
+			(g_settings_get_boolean (settings, key) != FALSE);
+
+	else if (strcmp (key, "max-loading-applets") == 0)
+		global_config.max_loading_applets =
+			g_settings_get_uint (settings, key);
+
+	else if (strcmp (key, "enable-spawn-helper") == 0)
+		panel_spawn_set_use_helper (g_settings_get_boolean (settings, key));
 }
 
 static void
@@ -37,9 +37,13 @@ void panel_global_config_load (void);
 
 gboolean panel_global_config_get_highlight_when_over  (void);
 gboolean panel_global_config_get_enable_animations    (void);
+gboolean panel_global_config_get_enable_launch_animation (void);
 gboolean panel_global_config_get_drawer_auto_close    (void);
+gboolean panel_global_config_get_release_closed_drawers (void);
 gboolean panel_global_config_get_tooltips_enabled     (void);
 gboolean panel_global_config_get_confirm_panel_remove (void);
+gboolean panel_global_config_get_lazy_load_hidden_applets (void);
+guint    panel_global_config_get_max_loading_applets  (void);
 
 #ifdef __cplusplus
 }
@@ -38,6 +38,7 @@
 #include <libpanel-util/panel-error.h>
 #include <libpanel-util/panel-show.h>
 #include <libpanel-util/panel-gtk.h>
+#include <libpanel-util/panel-perf.h>
 
 #include "panel-util.h"
 #include "panel.h"
@@ -179,6 +180,36 @@ panel_context_menu_setup_delete_panel_item (GtkWidget *menu,
 	gtk_widget_set_sensitive (menuitem, sensitive);
 }
 
+/* The menu is kept between the popups: what depends on the lockdown and
+ * on the writability of the profile is updated each time it is shown */
+static void
+panel_context_menu_update_edition (GtkWidget *menu)
+{
+	GList     *items;
+	GList     *l;
+	GtkWidget *menuitem;
+	gboolean   locked_down;
+	gboolean   writable;
+
+	locked_down = panel_lockdown_get_locked_down ();
+	writable = panel_profile_id_lists_are_writable ();
+
+	items = g_object_get_data (G_OBJECT (menu), "panel-context-menu-edition");
+	for (l = items; l; l = l->next)
+		gtk_widget_set_visible (l->data, !locked_down);
+
+	if (locked_down)
+		return;
+
+	menuitem = g_object_get_data (G_OBJECT (menu), "panel-context-menu-add");
+	if (menuitem)
+		gtk_widget_set_sensitive (menuitem, writable);
+
+	menuitem = g_object_get_data (G_OBJECT (menu), "panel-context-menu-new");
+	if (menuitem)
+		gtk_widget_set_sensitive (menuitem, writable);
+}
+
 static void
 panel_reset_response (GtkWidget     *dialog,
 			 int            response)
@@ -241,9 +272,7 @@ panel_context_menu_build_edition (PanelWidget *panel_widget,
         g_signal_connect (menuitem, "activate",
 	      	       	  G_CALLBACK (panel_addto_present),
                           panel_widget);
-
-	if (!panel_profile_id_lists_are_writable ())
-		gtk_widget_set_sensitive (menuitem, FALSE);
+	g_object_set_data (G_OBJECT (menu), "panel-context-menu-add", menuitem);
 
 	menuitem = panel_image_menu_item_new_from_icon ("document-properties", _("_Properties"));
 
@@ -282,10 +311,18 @@ panel_context_menu_build_edition (PanelWidget *panel_widget,
 	g_signal_connect (menuitem, "activate",
 	                  G_CALLBACK (panel_context_menu_create_new_panel),
 	                  NULL);
-	gtk_widget_set_sensitive (menuitem,
-				  panel_profile_id_lists_are_writable ());
+	g_object_set_data (G_OBJECT (menu), "panel-context-menu-new", menuitem);
 
 	add_menu_separator (menu);
+
+	/* the edition items are the first ones of the menu */
+	g_object_set_data_full (G_OBJECT (menu), "panel-context-menu-edition",
+				gtk_container_get_children (GTK_CONTAINER (menu)),
+				(GDestroyNotify) g_list_free);
+	g_signal_connect (menu, "show",
+			  G_CALLBACK (panel_context_menu_update_edition),
+			  NULL);
+	panel_context_menu_update_edition (menu);
 }
 
 GtkWidget *
@@ -311,11 +348,12 @@ panel_context_menu_create (PanelWidget *panel)
 		return info->menu;
 	}
 
+	panel_perf_count ("menu-builds", 1);
+
 	retval = create_empty_menu ();
 	gtk_widget_set_name (retval, "mate-panel-context-menu");
 
-	if (!panel_lockdown_get_locked_down ())
-		panel_context_menu_build_edition (panel, retval);
+	panel_context_menu_build_edition (panel, retval);
 
 	menuitem = panel_image_menu_item_new_from_icon ("help-browser", _("_Help"));
 
@@ -56,6 +56,12 @@ struct _PanelDItemEditorPrivate
 	gboolean  reverting;
 	gboolean  dirty;
 	guint     save_timeout;
+	/* what the file contains, as far as we know: a save that would not
+	 * change anything is skipped */
+	GBytes       *saved_data;
+	/* the autosave running in a thread, if any */
+	GCancellable *save_cancellable;
+	gboolean      save_again;
 
 	char     *uri; /* file location */
 	gboolean  type_directory;
@@ -186,6 +192,8 @@ static void setup_icon_chooser (PanelDItemEditor *dialog,
 static gboolean panel_ditem_editor_save         (PanelDItemEditor *dialog,
 						 gboolean          report_errors);
 static gboolean panel_ditem_editor_save_timeout (gpointer data);
+static void panel_ditem_editor_cancel_write (PanelDItemEditor *dialog);
+static void panel_ditem_editor_remember_saved (PanelDItemEditor *dialog);
 static void panel_ditem_editor_revert (PanelDItemEditor *dialog);
 
 static void panel_ditem_editor_key_file_loaded (PanelDItemEditor  *dialog);
@@ -355,9 +363,13 @@ panel_ditem_editor_dispose (GObject *object)
 	dialog = PANEL_DITEM_EDITOR (object);
 
 	/* If there was a timeout, then something changed after last save,
-	 * so we must save again now */
-	if (dialog->priv->save_timeout) {
-		g_source_remove (dialog->priv->save_timeout);
+	 * so we must save again now. An autosave still running might not
+	 * have reached the disk: it is replaced by a last save, done now */
+	if (dialog->priv->save_timeout ||
+	    (dialog->priv->save_cancellable &&
+	     !g_cancellable_is_cancelled (dialog->priv->save_cancellable))) {
+		if (dialog->priv->save_timeout)
+			g_source_remove (dialog->priv->save_timeout);
 		dialog->priv->save_timeout = 0;
 		panel_ditem_editor_save (dialog, FALSE);
 	}
@@ -373,6 +385,7 @@ panel_ditem_editor_dispose (GObject *object)
 	dialog->priv->revert_key_file = NULL;
 
 	g_clear_pointer (&dialog->priv->uri, g_free);
+	g_clear_pointer (&dialog->priv->saved_data, g_bytes_unref);
 
 	G_OBJECT_CLASS (panel_ditem_editor_parent_class)->dispose (object);
 }
@@ -651,7 +664,8 @@ panel_ditem_editor_setup_ui (PanelDItemEditor *dialog)
 /*
  * Will save after SAVE_FREQUENCY milliseconds of no changes. If something is
  * changed, the save is postponed to another SAVE_FREQUENCY seconds. This seems
- * to be a saner behaviour than just saving every N seconds.
+ * to be a saner behaviour than just saving every N seconds. The file is
+ * written in a thread, and only if its contents would change.
  */
 static void
 panel_ditem_editor_changed (PanelDItemEditor *dialog)
@@ -983,6 +997,9 @@ panel_ditem_editor_init (PanelDItemEditor *dialog)
 	dialog->priv->reverting = FALSE;
 	dialog->priv->dirty = FALSE;
 	dialog->priv->save_timeout = 0;
+	dialog->priv->saved_data = NULL;
+	dialog->priv->save_cancellable = NULL;
+	dialog->priv->save_again = FALSE;
 	dialog->priv->uri = NULL;
 	dialog->priv->type_directory = FALSE;
 	dialog->priv->new_file = TRUE;
@@ -1148,24 +1165,16 @@ panel_ditem_editor_sync_display (PanelDItemEditor *dialog)
 	}
 }
 
-static gboolean
-panel_ditem_editor_save (PanelDItemEditor *dialog,
-			 gboolean          report_errors)
+/* The contents of the file as the editor shows them, or NULL if they
+ * cannot be saved */
+static GBytes *
+panel_ditem_editor_get_save_data (PanelDItemEditor *dialog,
+				  gboolean          report_errors)
 {
 	GKeyFile   *key_file;
 	const char *const_buf;
-	GError     *error;
-
-	g_return_val_if_fail (dialog != NULL, FALSE);
-	g_return_val_if_fail (dialog->priv->save_uri != NULL ||
-	                      dialog->priv->uri != NULL, FALSE);
-
-	if (dialog->priv->save_timeout != 0)
-		g_source_remove (dialog->priv->save_timeout);
-	dialog->priv->save_timeout = 0;
-
-	if (!dialog->priv->dirty)
-		return TRUE;
+	char       *data;
+	gsize       length;
 
 	/* Verify that the required informations are set */
 	const_buf = gtk_entry_get_text (GTK_ENTRY (dialog->priv->name_entry));
@@ -1182,7 +1191,7 @@ panel_ditem_editor_save (PanelDItemEditor *dialog,
 					       _("Could not save directory properties"),
 					       _("The name of the directory is not set."));
 		}
-		return FALSE;
+		return NULL;
 	}
 
 	const_buf = gtk_entry_get_text (GTK_ENTRY (dialog->priv->command_entry));
@@ -1209,7 +1218,7 @@ panel_ditem_editor_save (PanelDItemEditor *dialog,
 			g_signal_emit (G_OBJECT (dialog),
 				       ditem_edit_signals[ERROR_REPORTED], 0,
 				       _("Could not save launcher"), err);
-		return FALSE;
+		return NULL;
 	}
 
 	key_file = dialog->priv->key_file;
@@ -1229,6 +1238,83 @@ panel_ditem_editor_save (PanelDItemEditor *dialog,
 		}
 	}
 
+	if (dialog->priv->uri == NULL)
+		return NULL;
+
+	data = panel_key_file_to_data (key_file, &length, NULL);
+	if (data == NULL)
+		return NULL;
+
+	return g_bytes_new_take (data, length);
+}
+
+static void
+panel_ditem_editor_remember_saved (PanelDItemEditor *dialog)
+{
+	char  *data;
+	gsize  length;
+
+	g_clear_pointer (&dialog->priv->saved_data, g_bytes_unref);
+
+	data = panel_key_file_to_data (dialog->priv->key_file, &length, NULL);
+	if (data != NULL)
+		dialog->priv->saved_data = g_bytes_new_take (data, length);
+}
+
+static gboolean
+panel_ditem_editor_is_saved (PanelDItemEditor *dialog,
+			     GBytes           *data)
+{
+	return dialog->priv->saved_data != NULL &&
+	       g_bytes_equal (dialog->priv->saved_data, data);
+}
+
+/* A cancelled autosave may or may not have reached the disk; if it did
+ * not start yet, the synchronous save that follows makes it skip its
+ * write, see panel_key_file_write_data_async() */
+static void
+panel_ditem_editor_cancel_write (PanelDItemEditor *dialog)
+{
+	if (dialog->priv->save_cancellable == NULL ||
+	    g_cancellable_is_cancelled (dialog->priv->save_cancellable))
+		return;
+
+	g_cancellable_cancel (dialog->priv->save_cancellable);
+	g_clear_pointer (&dialog->priv->saved_data, g_bytes_unref);
+	dialog->priv->save_again = FALSE;
+	dialog->priv->dirty = TRUE;
+}
+
+static gboolean
+panel_ditem_editor_save (PanelDItemEditor *dialog,
+			 gboolean          report_errors)
+{
+	GBytes *data;
+	GError *error;
+
+	g_return_val_if_fail (dialog != NULL, FALSE);
+	g_return_val_if_fail (dialog->priv->save_uri != NULL ||
+	                      dialog->priv->uri != NULL, FALSE);
+
+	if (dialog->priv->save_timeout != 0)
+		g_source_remove (dialog->priv->save_timeout);
+	dialog->priv->save_timeout = 0;
+
+	panel_ditem_editor_cancel_write (dialog);
+
+	if (!dialog->priv->dirty)
+		return TRUE;
+
+	data = panel_ditem_editor_get_save_data (dialog, report_errors);
+	if (data == NULL)
+		return FALSE;
+
+	if (panel_ditem_editor_is_saved (dialog, data)) {
+		g_bytes_unref (data);
+		dialog->priv->dirty = FALSE;
+		return TRUE;
+	}
+
 	/* And now, try to save */
 	error = NULL;
 	panel_key_file_to_file (dialog->priv->key_file,
@@ -1241,24 +1327,108 @@ panel_ditem_editor_save (PanelDItemEditor *dialog,
 				       _("Could not save launcher"),
 				       error->message);
 		g_error_free (error);
+		g_bytes_unref (data);
 		return FALSE;
 	} else {
 		g_signal_emit (G_OBJECT (dialog),
 			       ditem_edit_signals[SAVED], 0);
 	}
 
+	g_clear_pointer (&dialog->priv->saved_data, g_bytes_unref);
+	dialog->priv->saved_data = data;
 	dialog->priv->dirty = FALSE;
 
 	return TRUE;
 }
 
+static void panel_ditem_editor_autosave (PanelDItemEditor *dialog);
+
+static void
+panel_ditem_editor_autosave_done (GObject      *source_object,
+				  GAsyncResult *result,
+				  gpointer      user_data)
+{
+	PanelDItemEditor *dialog;
+	gboolean          cancelled;
+	gboolean          written;
+	GError           *error = NULL;
+
+	dialog = PANEL_DITEM_EDITOR (user_data);
+
+	written = panel_key_file_write_data_finish (result, &error);
+	g_clear_error (&error);
+
+	cancelled = g_cancellable_is_cancelled (dialog->priv->save_cancellable);
+	g_clear_object (&dialog->priv->save_cancellable);
+
+	/* whoever cancelled the autosave saved the launcher itself */
+	if (cancelled) {
+		g_object_unref (dialog);
+		return;
+	}
+
+	if (!written) {
+		/* the changes are still to be saved */
+		g_clear_pointer (&dialog->priv->saved_data, g_bytes_unref);
+		dialog->priv->dirty = TRUE;
+	} else {
+		g_signal_emit (G_OBJECT (dialog),
+			       ditem_edit_signals[SAVED], 0);
+	}
+
+	if (dialog->priv->save_again) {
+		dialog->priv->save_again = FALSE;
+		panel_ditem_editor_autosave (dialog);
+	}
+
+	g_object_unref (dialog);
+}
+
+/* Saves in a thread what changed since the last save, if anything did */
+static void
+panel_ditem_editor_autosave (PanelDItemEditor *dialog)
+{
+	GBytes *data;
+
+	/* the contents will be compared again once this write is done */
+	if (dialog->priv->save_cancellable != NULL) {
+		dialog->priv->save_again = TRUE;
+		return;
+	}
+
+	if (!dialog->priv->dirty)
+		return;
+
+	data = panel_ditem_editor_get_save_data (dialog, FALSE);
+	if (data == NULL)
+		return;
+
+	dialog->priv->dirty = FALSE;
+
+	if (panel_ditem_editor_is_saved (dialog, data)) {
+		g_bytes_unref (data);
+		return;
+	}
+
+	g_clear_pointer (&dialog->priv->saved_data, g_bytes_unref);
+	dialog->priv->saved_data = g_bytes_ref (data);
+
+	dialog->priv->save_cancellable = g_cancellable_new ();
+	panel_key_file_write_data_async (dialog->priv->uri, data,
+					 dialog->priv->save_cancellable,
+					 panel_ditem_editor_autosave_done,
+					 g_object_ref (dialog));
+	g_bytes_unref (data);
+}
+
 static gboolean
 panel_ditem_editor_save_timeout (gpointer data)
 {
 	PanelDItemEditor *dialog;
 
 	dialog = PANEL_DITEM_EDITOR (data);
-	panel_ditem_editor_save (dialog, FALSE);
+	dialog->priv->save_timeout = 0;
+	panel_ditem_editor_autosave (dialog);
 
 	return FALSE;
 }
@@ -1451,6 +1621,8 @@ panel_ditem_editor_key_file_loaded (PanelDItemEditor  *dialog)
 						   TRUE);
 	else
 		panel_ditem_editor_set_revert (dialog);
+
+	panel_ditem_editor_remember_saved (dialog);
 }
 
 static gboolean
@@ -1558,6 +1730,9 @@ panel_ditem_editor_set_uri (PanelDItemEditor *dialog,
 	else
 		dialog->priv->uri = NULL;
 
+	/* nothing is known about the contents of another file */
+	g_clear_pointer (&dialog->priv->saved_data, g_bytes_unref);
+
 	g_object_notify (G_OBJECT (dialog), "uri");
 }
 
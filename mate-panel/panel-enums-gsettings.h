@@ -72,6 +72,13 @@ typedef enum {
 	PANEL_ACTION_LAST
 } PanelActionButtonType;
 
+typedef enum {
+	PANEL_POWER_PROFILE_AUTO = 0,
+	PANEL_POWER_PROFILE_NORMAL,
+	PANEL_POWER_PROFILE_BALANCED,
+	PANEL_POWER_PROFILE_LOW_POWER
+} PanelPowerProfile;
+
 G_END_DECLS
 
 #endif /* __PANEL_ENUMS_GSETTINGS_H__ */
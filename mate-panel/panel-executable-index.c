@@ -0,0 +1,317 @@
+/*
+ * panel-executable-index.c: index of the executables found in $PATH
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/* The run dialog completes command names against every executable of
+ * $PATH. Listing and testing thousands of files is too slow to do when
+ * the dialog opens, so the panel keeps a sorted array of their names:
+ * it is built in a worker thread the first time it is needed, rebuilt
+ * when one of the $PATH directories changes, and searched by binary
+ * search. */
+
+#include <config.h>
+
+#include <string.h>
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "panel-executable-index.h"
+
+/* let package managers finish their work before listing again */
+#define PANEL_EXECUTABLE_INDEX_REBUILD_DELAY 2 /* seconds */
+
+static GPtrArray *index_names      = NULL;
+static GList     *index_monitors   = NULL;
+static gboolean   index_building   = FALSE;
+static gboolean   index_outdated   = FALSE;
+static guint      index_rebuild_id = 0;
+
+static int
+compare_names (gconstpointer a,
+	       gconstpointer b)
+{
+	return strcmp (*(const char **) a, *(const char **) b);
+}
+
+static void
+panel_executable_index_build_thread (GTask        *task,
+				     gpointer      source_object,
+				     gpointer      task_data,
+				     GCancellable *cancellable)
+{
+	char       **pathv = task_data;
+	GPtrArray   *names;
+	GHashTable  *seen;
+	int          i;
+
+	names = g_ptr_array_new_with_free_func (g_free);
+	seen = g_hash_table_new (g_str_hash, g_str_equal);
+
+	for (i = 0; pathv [i]; i++) {
+		const char *file;
+		GDir       *dir;
+
+		dir = g_dir_open (pathv [i], 0, NULL);
+
+		if (!dir)
+			continue;
+
+		while ((file = g_dir_read_name (dir))) {
+			char *filename;
+
+			/* only the first one in $PATH would be run anyway */
+			if (g_hash_table_contains (seen, file))
+				continue;
+
+			filename = g_build_filename (pathv [i], file, NULL);
+
+			if (g_file_test (filename, G_FILE_TEST_IS_REGULAR) &&
+			    g_file_test (filename, G_FILE_TEST_IS_EXECUTABLE)) {
+				char *name = g_strdup (file);
+
+				g_ptr_array_add (names, name);
+				g_hash_table_add (seen, name);
+			}
+
+			g_free (filename);
+		}
+
+		g_dir_close (dir);
+	}
+
+	g_hash_table_destroy (seen);
+
+	g_ptr_array_sort (names, compare_names);
+
+	g_task_return_pointer (task, names, (GDestroyNotify) g_ptr_array_unref);
+}
+
+static void panel_executable_index_build (void);
+
+static void
+panel_executable_index_built (GObject      *source_object,
+			      GAsyncResult *result,
+			      gpointer      user_data)
+{
+	GPtrArray *names;
+
+	index_building = FALSE;
+
+	names = g_task_propagate_pointer (G_TASK (result), NULL);
+	if (names) {
+		if (index_names)
+			g_ptr_array_unref (index_names);
+		index_names = names;
+	}
+
+	/* something changed while we were listing */
+	if (index_outdated)
+		panel_executable_index_build ();
+}
+
+static char **
+get_pathv (void)
+{
+	const char *path;
+
+	path = g_getenv ("PATH");
+
+	if (!path || !path [0])
+		return NULL;
+
+	return g_strsplit (path, ":", 0);
+}
+
+static void
+panel_executable_index_build (void)
+{
+	GTask  *task;
+	char  **pathv;
+
+	if (index_building) {
+		index_outdated = TRUE;
+		return;
+	}
+
+	index_outdated = FALSE;
+
+	pathv = get_pathv ();
+	if (!pathv) {
+		g_clear_pointer (&index_names, g_ptr_array_unref);
+		index_names = g_ptr_array_new_with_free_func (g_free);
+		return;
+	}
+
+	index_building = TRUE;
+
+	task = g_task_new (NULL, NULL, panel_executable_index_built, NULL);
+	g_task_set_task_data (task, pathv, (GDestroyNotify) g_strfreev);
+	g_task_run_in_thread (task, panel_executable_index_build_thread);
+	g_object_unref (task);
+}
+
+static gboolean
+panel_executable_index_rebuild_timeout (gpointer data)
+{
+	index_rebuild_id = 0;
+
+	panel_executable_index_build ();
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+panel_executable_index_path_changed (GFileMonitor      *monitor,
+				     GFile             *file,
+				     GFile             *other_file,
+				     GFileMonitorEvent  event_type,
+				     gpointer           data)
+{
+	switch (event_type) {
+	case G_FILE_MONITOR_EVENT_CHANGED:
+	case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+		/* the content of an executable is not our business */
+		return;
+	default:
+		break;
+	}
+
+	if (index_rebuild_id)
+		return;
+
+	index_rebuild_id = g_timeout_add_seconds (PANEL_EXECUTABLE_INDEX_REBUILD_DELAY,
+						  panel_executable_index_rebuild_timeout,
+						  NULL);
+}
+
+void
+panel_executable_index_init (void)
+{
+	char **pathv;
+	int    i;
+
+	if (index_names || index_building)
+		return;
+
+	panel_executable_index_build ();
+
+	pathv = get_pathv ();
+	if (!pathv)
+		return;
+
+	for (i = 0; pathv [i]; i++) {
+		GFileMonitor *monitor;
+		GFile        *dir;
+
+		if (!pathv [i][0])
+			continue;
+
+		dir = g_file_new_for_path (pathv [i]);
+		monitor = g_file_monitor_directory (dir, G_FILE_MONITOR_NONE,
+						    NULL, NULL);
+		g_object_unref (dir);
+
+		if (!monitor)
+			continue;
+
+		g_signal_connect (monitor, "changed",
+				  G_CALLBACK (panel_executable_index_path_changed),
+				  NULL);
+		index_monitors = g_list_prepend (index_monitors, monitor);
+	}
+
+	g_strfreev (pathv);
+}
+
+gboolean
+panel_executable_index_is_ready (void)
+{
+	return index_names != NULL;
+}
+
+/* Whether @name is an executable of $PATH, as of the last listing */
+gboolean
+panel_executable_index_contains (const char *name)
+{
+	guint low, high;
+
+	g_return_val_if_fail (name != NULL, FALSE);
+
+	if (!index_names)
+		return FALSE;
+
+	low = 0;
+	high = index_names->len;
+	while (low < high) {
+		guint middle = low + (high - low) / 2;
+		int   cmp;
+
+		cmp = strcmp (g_ptr_array_index (index_names, middle), name);
+		if (cmp == 0)
+			return TRUE;
+		else if (cmp < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	return FALSE;
+}
+
+/* Returns the names starting with @prefix, that the caller owns */
+GList *
+panel_executable_index_complete (const char *prefix)
+{
+	GList *list;
+	guint  low, high;
+	gsize  len;
+
+	g_return_val_if_fail (prefix != NULL, NULL);
+
+	if (!index_names)
+		return NULL;
+
+	/* find the first name not sorting before prefix */
+	low = 0;
+	high = index_names->len;
+	while (low < high) {
+		guint middle = low + (high - low) / 2;
+
+		if (strcmp (g_ptr_array_index (index_names, middle), prefix) < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	len = strlen (prefix);
+	list = NULL;
+
+	for (; low < index_names->len; low++) {
+		const char *name = g_ptr_array_index (index_names, low);
+
+		if (strncmp (name, prefix, len) != 0)
+			break;
+
+		list = g_list_prepend (list, g_strdup (name));
+	}
+
+	return g_list_reverse (list);
+}
@@ -31,16 +31,20 @@
 
 #include "panel-force-quit.h"
 
+#include <stdlib.h>
 #include <glib/gi18n.h>
 #include <gtk/gtk.h>
 #include <gdk/gdkx.h>
 #include <X11/Xlib.h>
+#include <X11/Xlib-xcb.h>
 #include <X11/keysym.h>
+#include <xcb/xcb.h>
 
 #include <X11/extensions/XInput2.h>
 
 #include <libpanel-util/panel-gtk.h>
 
+#include "panel-action-protocol.h"
 #include "panel-icon-names.h"
 #include "panel-stock-icons.h"
 
@@ -124,7 +128,7 @@ remove_popup (GtkWidget *popup)
 
 	root = gdk_screen_get_root_window (
 			gtk_window_get_screen (GTK_WINDOW (popup)));
-	gdk_window_remove_filter (root, (GdkFilterFunc) popup_filter, popup);
+	panel_action_protocol_set_input_filter (NULL, NULL);
 
 	gtk_widget_destroy (popup);
 
@@ -134,75 +138,82 @@ remove_popup (GtkWidget *popup)
 	gdk_seat_ungrab (seat);
 }
 
-static gboolean
-wm_state_set (Display *xdisplay,
-	      Window   window)
+/*
+ * Looks for the window with WM_STATE set, the client window managed by
+ * the window manager, below the window that was clicked, which usually
+ * is a frame of the window manager. The tree is walked breadth first with
+ * XCB: the WM_STATE and children queries of all the windows at one depth
+ * are sent together and their replies collected afterwards, so that the
+ * lookup takes one round trip per level of the tree rather than two per
+ * window, which is what makes a difference over a remote connection.
+ */
+static Window
+find_managed_window (Display *xdisplay,
+		     Window   window)
 {
-	GdkDisplay *display;
-	gulong  nitems;
-	gulong  bytes_after;
-	gulong *prop;
-	Atom    ret_type = None;
-	int     ret_format;
-	int     result;
+	xcb_connection_t *connection;
+	GArray           *level;
+	xcb_window_t      top = window;
+	Window            retval = None;
 
-	display = gdk_display_get_default ();
-	gdk_x11_display_error_trap_push (display);
-	result = XGetWindowProperty (xdisplay, window, wm_state_atom,
-				     0, G_MAXLONG, False, wm_state_atom,
-				     &ret_type, &ret_format, &nitems,
-				     &bytes_after, (gpointer) &prop);
+	connection = XGetXCBConnection (xdisplay);
 
-	if (gdk_x11_display_error_trap_pop (display))
-		return FALSE;
+	level = g_array_new (FALSE, FALSE, sizeof (xcb_window_t));
+	g_array_append_val (level, top);
 
-	if (result != Success)
-		return FALSE;
+	while (level->len > 0 && retval == None) {
+		xcb_get_property_cookie_t *property_cookies;
+		xcb_query_tree_cookie_t   *tree_cookies;
+		GArray                    *next_level;
+		guint                      i;
 
-	XFree (prop);
+		property_cookies = g_new (xcb_get_property_cookie_t, level->len);
+		tree_cookies = g_new (xcb_query_tree_cookie_t, level->len);
 
-	if (ret_type != wm_state_atom)
-		return FALSE;
+		for (i = 0; i < level->len; i++) {
+			xcb_window_t kid = g_array_index (level, xcb_window_t, i);
 
-	return TRUE;
-}
+			property_cookies [i] = xcb_get_property (connection, FALSE, kid,
+								 wm_state_atom, wm_state_atom,
+								 0, 0);
+			tree_cookies [i] = xcb_query_tree (connection, kid);
+		}
 
-static Window
-find_managed_window (Display *xdisplay,
-		     Window   window)
-{
-	GdkDisplay *display;
-	Window  root;
-	Window  parent;
-	Window *kids = NULL;
-	Window  retval;
-	guint   nkids;
-	int     i, result;
-
-	if (wm_state_set (xdisplay, window))
-		return window;
-
-	display = gdk_display_get_default ();
-	gdk_x11_display_error_trap_push (display);
-	result = XQueryTree (xdisplay, window, &root, &parent, &kids, &nkids);
-	if (gdk_x11_display_error_trap_pop (display) || !result)
-		return None;
-
-	retval = None;
-
-	for (i = 0; i < nkids; i++) {
-		if (wm_state_set (xdisplay, kids [i])) {
-			retval = kids [i];
-			break;
+		next_level = g_array_new (FALSE, FALSE, sizeof (xcb_window_t));
+
+		/* every reply is collected, even once the window is found:
+		 * the ones left would leak in the connection */
+		for (i = 0; i < level->len; i++) {
+			xcb_get_property_reply_t *property;
+			xcb_query_tree_reply_t   *tree;
+
+			/* the window can be gone already, the error is then
+			 * returned here instead of going to the error handler */
+			property = xcb_get_property_reply (connection, property_cookies [i], NULL);
+			if (property) {
+				if (retval == None && property->type == wm_state_atom)
+					retval = g_array_index (level, xcb_window_t, i);
+				free (property);
+			}
+
+			tree = xcb_query_tree_reply (connection, tree_cookies [i], NULL);
+			if (tree) {
+				if (retval == None)
+					g_array_append_vals (next_level,
+							     xcb_query_tree_children (tree),
+							     xcb_query_tree_children_length (tree));
+				free (tree);
+			}
 		}
 
-		retval = find_managed_window (xdisplay, kids [i]);
-		if (retval != None)
-			break;
+		g_free (property_cookies);
+		g_free (tree_cookies);
+
+		g_array_free (level, TRUE);
+		level = next_level;
 	}
 
-	if (kids)
-		XFree (kids);
+	g_array_free (level, TRUE);
 
 	return retval;
 }
@@ -354,7 +365,7 @@ panel_force_quit (GdkScreen *screen,
 
 	root = gdk_screen_get_root_window (screen);
 
-	gdk_window_add_filter (root, (GdkFilterFunc) popup_filter, popup);
+	panel_action_protocol_set_input_filter ((GdkFilterFunc) popup_filter, popup);
 	cross = gdk_cursor_new_for_display (gdk_display_get_default (),
 	                                    GDK_CROSS);
 	caps = GDK_SEAT_CAPABILITY_POINTER | GDK_SEAT_CAPABILITY_KEYBOARD;
@@ -168,13 +168,14 @@ panel_frame_draw (GtkWidget      *widget,
 		  cairo_t *cr,
 		  PanelFrameEdge  edges)
 {
-	PanelFrame       *frame = (PanelFrame *) widget;
-	GtkStyleContext  *context;
-	GtkStateFlags     state;
-	GdkRGBA          *bg;
-	GdkRGBA           dark, light;
-	GtkBorder         padding;
-	int               x, y, width, height;
+	PanelFrame        *frame = (PanelFrame *) widget;
+	GtkStyleContext   *context;
+	GtkStateFlags      state;
+	GdkRGBA           *bg;
+	GdkRGBA            dark, light;
+	PanelColorPalette *palette;
+	GtkBorder          padding;
+	int                x, y, width, height;
 
 	if (edges == PANEL_EDGE_NONE)
 		return;
@@ -189,8 +190,16 @@ panel_frame_draw (GtkWidget      *widget,
 	                       "background-color", &bg,
 	                       NULL);
 
-	gtk_style_shade (bg, &dark, 0.7);
-	gtk_style_shade (bg, &light, 1.3);
+	/* the shades only change with the theme */
+	palette = g_object_get_data (G_OBJECT (widget), "panel-frame-palette");
+	if (!palette) {
+		palette = g_new0 (PanelColorPalette, 1);
+		g_object_set_data_full (G_OBJECT (widget), "panel-frame-palette",
+					palette, g_free);
+	}
+
+	dark  = *panel_color_palette_get (palette, bg, PANEL_COLOR_SHADE_DARK);
+	light = *panel_color_palette_get (palette, bg, PANEL_COLOR_SHADE_LIGHT);
 
 	gtk_style_context_get_padding (context, state, &padding);
 
@@ -0,0 +1,1101 @@
+/*
+ * panel-interaction-benchmark.c: replay interactions with the panel
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/* mate-panel --benchmark-interactions=SCRIPT starts the panel as usual,
+ * waits for its applets to be loaded, replays the interactions of SCRIPT
+ * one after the other and quits. SCRIPT is a file, or "default" for a
+ * sequence going through each of the interactions once.
+ *
+ * A script has one interaction per line, with optional key=value
+ * arguments quoted like in a shell; empty lines and lines starting with
+ * '#' are ignored:
+ *
+ *   wait ms=1000
+ *   menu-open frames=30
+ *   applet-drag panel=top object=object-3 distance=200
+ *   auto-hide panel=bottom cycles=3
+ *   properties panel=top steps=8
+ *   run-dialog text="mate-terminal" frames=30
+ *   layout panel=top passes=200
+ *
+ * "panel" is the id of a toplevel in the configuration, the first one by
+ * default. menu-open pops up the main menu like the key binding does and
+ * keeps it up for some frames. applet-drag drags an applet, the first one
+ * that can move by default, along the panel and back, one motion of the
+ * pointer per frame. auto-hide hides and unhides the panel, auto-hiding it
+ * for the time of the interaction if it does not. properties opens the
+ * properties dialog of the panel and changes the size of the panel one
+ * pixel per frame, like the size spin button does, then sets it back.
+ * run-dialog types the text in the Run dialog, one key per frame. layout
+ * runs the size allocation of the applets of the panel once per frame,
+ * without anything changing, and adds the time of the passes to the
+ * results: the layout itself, without the drawing that follows it.
+ *
+ * The interactions drive the real panel, with real pointer motions: run
+ * the benchmark in a nested or virtual X server, such as Xvfb, with a
+ * configuration of its own. The drags and the edits move things like a
+ * user would, and put them back afterwards.
+ *
+ * The results are printed as one line of key=value pairs per step, and a
+ * line for the whole run, like the menu benchmark does. All times are in
+ * microseconds. The frame times are the intervals between the frames of
+ * the panel, which keeps drawing frames during a step; the paint time is
+ * the longest layout and paint of any window of the panel. The CPU time
+ * is the one of the panel process: the out-of-process applets are not
+ * counted. */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include <glib.h>
+#include <gtk/gtk.h>
+
+#include "applet.h"
+#include "menu.h"
+#include "panel-menu-bar.h"
+#include "panel-menu-button.h"
+#include "panel-profile.h"
+#include "panel-properties-dialog.h"
+#include "panel-run-dialog.h"
+#include "panel-toplevel.h"
+#include "panel-widget.h"
+#include "panel-interaction-benchmark.h"
+
+#define BENCHMARK_STEP_TIMEOUT 20 /* seconds */
+#define BENCHMARK_START_POLL   250 /* ms */
+#define BENCHMARK_DRAG_STEP    4 /* pixels per frame */
+#define BENCHMARK_LAYOUT_PASSES 16 /* per frame */
+
+typedef enum {
+	BENCHMARK_ACTION_WAIT,
+	BENCHMARK_ACTION_MENU_OPEN,
+	BENCHMARK_ACTION_APPLET_DRAG,
+	BENCHMARK_ACTION_AUTO_HIDE,
+	BENCHMARK_ACTION_PROPERTIES,
+	BENCHMARK_ACTION_RUN_DIALOG,
+	BENCHMARK_ACTION_LAYOUT,
+	BENCHMARK_N_ACTIONS
+} BenchmarkAction;
+
+/* the count of each action has a name of its own in the scripts */
+static const struct {
+	const char *name;
+	const char *count_key;
+	int         default_count;
+} benchmark_actions [BENCHMARK_N_ACTIONS] = {
+	{ "wait",        "ms",       1000 },
+	{ "menu-open",   "frames",   30 },
+	{ "applet-drag", "distance", 200 },
+	{ "auto-hide",   "cycles",   3 },
+	{ "properties",  "steps",    8 },
+	{ "run-dialog",  "frames",   30 },
+	{ "layout",      "passes",   200 }
+};
+
+static const char benchmark_default_script [] =
+	"menu-open\n"
+	"applet-drag\n"
+	"auto-hide\n"
+	"properties\n"
+	"run-dialog text=terminal\n"
+	"layout\n";
+
+typedef struct {
+	BenchmarkAction  action;
+	char            *panel;
+	char            *object;
+	char            *text;
+	int              count;
+} BenchmarkStep;
+
+typedef struct {
+	GdkFrameClock *clock;
+	gulong         before_paint_id;
+	gulong         after_paint_id;
+	gint64         paint_start;
+} BenchmarkClock;
+
+typedef struct {
+	GPtrArray     *steps;
+	guint          current;
+	guint          start_id;
+	guint          next_id;
+
+	/* the step being replayed */
+	BenchmarkStep *step;
+	PanelToplevel *toplevel;
+	PanelWidget   *panel;
+	GtkWidget     *menu;
+	GtkWidget     *menu_shell;
+	guint          tick_id;
+	guint          timeout_id;
+	guint          frame;
+	int            phase;
+	int            progress;
+	int            x, y;
+	int            original_size;
+	gboolean       original_auto_hide;
+	gboolean       in_journal;
+
+	/* what the step measured */
+	GPtrArray     *clocks;
+	GdkFrameClock *frame_clock;
+	gulong         frame_id;
+	gint64         last_frame;
+	GArray        *frame_times;
+	gint64         paint_max;
+	gint64         layout_time;
+	gint64         step_start;
+	gint64         step_cpu_start;
+
+	gint64         run_start;
+	gint64         run_cpu_start;
+	guint          n_failed;
+	int            status;
+} InteractionBenchmark;
+
+static InteractionBenchmark benchmark;
+
+static void benchmark_step_finish (gboolean skipped,
+				   gboolean timed_out);
+
+static gint64
+benchmark_get_cpu_time (void)
+{
+	struct rusage usage;
+
+	if (getrusage (RUSAGE_SELF, &usage) != 0)
+		return 0;
+
+	return (gint64) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * G_USEC_PER_SEC +
+	       usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static void
+benchmark_step_free (BenchmarkStep *step)
+{
+	g_free (step->panel);
+	g_free (step->object);
+	g_free (step->text);
+	g_free (step);
+}
+
+static BenchmarkStep *
+benchmark_parse_line (const char  *line,
+		      GError     **error)
+{
+	BenchmarkStep  *step;
+	char          **argv;
+	int             argc;
+	int             i;
+
+	if (!g_shell_parse_argv (line, &argc, &argv, error))
+		return NULL;
+
+	step = g_new0 (BenchmarkStep, 1);
+
+	for (i = 0; i < BENCHMARK_N_ACTIONS; i++)
+		if (strcmp (argv [0], benchmark_actions [i].name) == 0)
+			break;
+
+	if (i == BENCHMARK_N_ACTIONS) {
+		g_set_error (error, G_SHELL_ERROR, G_SHELL_ERROR_FAILED,
+			     "unknown interaction '%s'", argv [0]);
+		goto error;
+	}
+
+	step->action = i;
+	step->count = benchmark_actions [i].default_count;
+
+	for (i = 1; i < argc; i++) {
+		const char *value;
+		char       *key;
+		char       *end;
+
+		value = strchr (argv [i], '=');
+		if (!value) {
+			g_set_error (error, G_SHELL_ERROR, G_SHELL_ERROR_FAILED,
+				     "'%s' is not a key=value argument", argv [i]);
+			goto error;
+		}
+
+		key = g_strndup (argv [i], value - argv [i]);
+		value++;
+
+		if (strcmp (key, "panel") == 0) {
+			g_free (step->panel);
+			step->panel = g_strdup (value);
+		} else if (strcmp (key, "object") == 0) {
+			g_free (step->object);
+			step->object = g_strdup (value);
+		} else if (strcmp (key, "text") == 0) {
+			g_free (step->text);
+			step->text = g_strdup (value);
+		} else if (strcmp (key, benchmark_actions [step->action].count_key) == 0) {
+			step->count = strtol (value, &end, 10);
+			if (*value == '\0' || *end != '\0' || step->count <= 0) {
+				g_set_error (error, G_SHELL_ERROR, G_SHELL_ERROR_FAILED,
+					     "'%s' must be a positive number", key);
+				g_free (key);
+				goto error;
+			}
+		} else {
+			g_set_error (error, G_SHELL_ERROR, G_SHELL_ERROR_FAILED,
+				     "unknown argument '%s' for '%s'",
+				     key, benchmark_actions [step->action].name);
+			g_free (key);
+			goto error;
+		}
+
+		g_free (key);
+	}
+
+	if (step->action == BENCHMARK_ACTION_RUN_DIALOG && !step->text)
+		step->text = g_strdup ("terminal");
+
+	g_strfreev (argv);
+
+	return step;
+
+error:
+	g_strfreev (argv);
+	benchmark_step_free (step);
+
+	return NULL;
+}
+
+static GPtrArray *
+benchmark_parse_script (const char *script)
+{
+	GPtrArray  *steps;
+	char       *contents;
+	char      **lines;
+	GError     *error = NULL;
+	guint       i;
+
+	if (strcmp (script, "default") == 0) {
+		contents = g_strdup (benchmark_default_script);
+	} else if (!g_file_get_contents (script, &contents, NULL, &error)) {
+		g_printerr ("Cannot read the interactions: %s\n", error->message);
+		g_error_free (error);
+		return NULL;
+	}
+
+	steps = g_ptr_array_new_with_free_func ((GDestroyNotify) benchmark_step_free);
+	lines = g_strsplit (contents, "\n", -1);
+	g_free (contents);
+
+	for (i = 0; lines [i] != NULL; i++) {
+		BenchmarkStep *step;
+		char          *line = g_strstrip (lines [i]);
+
+		if (line [0] == '\0' || line [0] == '#')
+			continue;
+
+		step = benchmark_parse_line (line, &error);
+		if (!step) {
+			g_printerr ("%s:%u: %s\n", script, i + 1, error->message);
+			g_error_free (error);
+			g_ptr_array_unref (steps);
+			g_strfreev (lines);
+			return NULL;
+		}
+
+		g_ptr_array_add (steps, step);
+	}
+
+	g_strfreev (lines);
+
+	if (steps->len == 0) {
+		g_printerr ("%s: no interactions to replay\n", script);
+		g_ptr_array_unref (steps);
+		return NULL;
+	}
+
+	return steps;
+}
+
+static void
+benchmark_before_paint (GdkFrameClock  *clock,
+			BenchmarkClock *watched)
+{
+	watched->paint_start = g_get_monotonic_time ();
+}
+
+static void
+benchmark_after_paint (GdkFrameClock  *clock,
+		       BenchmarkClock *watched)
+{
+	if (watched->paint_start)
+		benchmark.paint_max = MAX (benchmark.paint_max,
+					   g_get_monotonic_time () - watched->paint_start);
+	watched->paint_start = 0;
+}
+
+static void
+benchmark_frame (GdkFrameClock *clock,
+		 gpointer       data)
+{
+	gint64 now = g_get_monotonic_time ();
+
+	if (benchmark.last_frame) {
+		gint64 frame_time = now - benchmark.last_frame;
+
+		g_array_append_val (benchmark.frame_times, frame_time);
+	}
+
+	benchmark.last_frame = now;
+}
+
+/* The menus and the dialogs have frame clocks of their own */
+static void
+benchmark_watch_windows (void)
+{
+	GList *toplevels, *l;
+
+	toplevels = gtk_window_list_toplevels ();
+
+	for (l = toplevels; l; l = l->next) {
+		GdkFrameClock  *clock;
+		BenchmarkClock *watched;
+		guint           i;
+
+		if (!gtk_widget_get_mapped (l->data))
+			continue;
+
+		clock = gtk_widget_get_frame_clock (l->data);
+		if (!clock)
+			continue;
+
+		for (i = 0; i < benchmark.clocks->len; i++)
+			if (((BenchmarkClock *) g_ptr_array_index (benchmark.clocks, i))->clock == clock)
+				break;
+		if (i < benchmark.clocks->len)
+			continue;
+
+		watched = g_new0 (BenchmarkClock, 1);
+		watched->clock = g_object_ref (clock);
+		watched->before_paint_id =
+			g_signal_connect (clock, "before-paint",
+					  G_CALLBACK (benchmark_before_paint), watched);
+		watched->after_paint_id =
+			g_signal_connect (clock, "after-paint",
+					  G_CALLBACK (benchmark_after_paint), watched);
+		g_ptr_array_add (benchmark.clocks, watched);
+	}
+
+	g_list_free (toplevels);
+}
+
+static void
+benchmark_clock_free (BenchmarkClock *watched)
+{
+	g_signal_handler_disconnect (watched->clock, watched->before_paint_id);
+	g_signal_handler_disconnect (watched->clock, watched->after_paint_id);
+	g_object_unref (watched->clock);
+	g_free (watched);
+}
+
+static void
+benchmark_warp_pointer (int x,
+			int y)
+{
+	GdkDisplay *display;
+	GdkDevice  *pointer;
+
+	display = gtk_widget_get_display (GTK_WIDGET (benchmark.toplevel));
+	pointer = gdk_seat_get_pointer (gdk_display_get_default_seat (display));
+
+	gdk_device_warp (pointer,
+			 gtk_widget_get_screen (GTK_WIDGET (benchmark.toplevel)),
+			 x, y);
+}
+
+/* Away from the panel, so that it can hide */
+static void
+benchmark_warp_pointer_away (void)
+{
+	GdkDisplay   *display;
+	GdkMonitor   *monitor;
+	GdkRectangle  geometry;
+
+	display = gtk_widget_get_display (GTK_WIDGET (benchmark.toplevel));
+	monitor = gdk_display_get_monitor_at_window (display,
+						      gtk_widget_get_window (GTK_WIDGET (benchmark.toplevel)));
+	if (!monitor)
+		return;
+
+	gdk_monitor_get_geometry (monitor, &geometry);
+	benchmark_warp_pointer (geometry.x + geometry.width / 2,
+				geometry.y + geometry.height / 2);
+}
+
+static void
+benchmark_send_key (GtkWidget *window,
+		    gunichar   c)
+{
+	GdkEvent     *event;
+	GdkKeymapKey *keys = NULL;
+	GdkKeymap    *keymap;
+	GdkDevice    *keyboard;
+	guint         keyval;
+	int           n_keys = 0;
+	char          string [7];
+
+	keyval = gdk_unicode_to_keyval (c);
+	string [g_unichar_to_utf8 (c, string)] = '\0';
+
+	keymap = gdk_keymap_get_for_display (gtk_widget_get_display (window));
+	gdk_keymap_get_entries_for_keyval (keymap, keyval, &keys, &n_keys);
+	keyboard = gdk_seat_get_keyboard (gdk_display_get_default_seat (gtk_widget_get_display (window)));
+
+	event = gdk_event_new (GDK_KEY_PRESS);
+	event->key.window = g_object_ref (gtk_widget_get_window (window));
+	event->key.send_event = TRUE;
+	event->key.time = GDK_CURRENT_TIME;
+	event->key.keyval = keyval;
+	event->key.string = g_strdup (string);
+	event->key.length = strlen (string);
+	if (n_keys > 0) {
+		event->key.hardware_keycode = keys [0].keycode;
+		event->key.group = keys [0].group;
+	}
+	gdk_event_set_device (event, keyboard);
+
+	gtk_widget_event (window, event);
+
+	event->key.type = GDK_KEY_RELEASE;
+	gtk_widget_event (window, event);
+
+	gdk_event_free (event);
+	g_free (keys);
+}
+
+static void
+benchmark_popdown_menus (void)
+{
+	/* the submenus are popped down with the menu shells they are in */
+	if (benchmark.menu_shell) {
+		gtk_menu_shell_cancel (GTK_MENU_SHELL (benchmark.menu_shell));
+		benchmark.menu_shell = NULL;
+	}
+
+	if (benchmark.menu) {
+		gtk_widget_destroy (benchmark.menu);
+		g_object_unref (benchmark.menu);
+		benchmark.menu = NULL;
+	}
+}
+
+/* Like the Main Menu key binding does */
+static gboolean
+benchmark_menu_open_start (void)
+{
+	GdkScreen  *screen;
+	AppletInfo *info;
+
+	screen = gtk_widget_get_screen (GTK_WIDGET (benchmark.toplevel));
+
+	info = mate_panel_applet_get_by_type (PANEL_OBJECT_MENU_BAR, screen);
+	if (info) {
+		panel_menu_bar_popup_menu (PANEL_MENU_BAR (info->widget),
+					   GDK_CURRENT_TIME);
+		benchmark.menu_shell = info->widget;
+		return TRUE;
+	}
+
+	info = mate_panel_applet_get_by_type (PANEL_OBJECT_MENU, screen);
+	if (info && !panel_menu_button_get_use_menu_path (PANEL_MENU_BUTTON (info->widget))) {
+		panel_menu_button_popup_menu (PANEL_MENU_BUTTON (info->widget),
+					      1, GDK_CURRENT_TIME);
+		benchmark.menu_shell = panel_menu_button_peek_menu (PANEL_MENU_BUTTON (info->widget));
+		return TRUE;
+	}
+
+	benchmark.menu = create_main_menu (benchmark.panel);
+	g_object_ref_sink (benchmark.menu);
+	benchmark.menu_shell = benchmark.menu;
+	gtk_menu_popup_at_widget (GTK_MENU (benchmark.menu),
+				  GTK_WIDGET (benchmark.toplevel),
+				  GDK_GRAVITY_SOUTH_WEST,
+				  GDK_GRAVITY_NORTH_WEST,
+				  NULL);
+
+	return TRUE;
+}
+
+static GtkWidget *
+benchmark_find_applet (void)
+{
+	guint i;
+
+	if (benchmark.step->object) {
+		AppletInfo *info;
+
+		info = mate_panel_applet_get_by_id (benchmark.step->object);
+		if (!info || gtk_widget_get_parent (info->widget) != GTK_WIDGET (benchmark.panel))
+			return NULL;
+
+		return info->widget;
+	}
+
+	for (i = 0; i < benchmark.panel->applets->len; i++) {
+		AppletData *ad = g_ptr_array_index (benchmark.panel->applets, i);
+		AppletInfo *info;
+
+		info = g_object_get_data (G_OBJECT (ad->applet), "applet_info");
+		if (!ad->locked && info && mate_panel_applet_can_freely_move (info))
+			return ad->applet;
+	}
+
+	return NULL;
+}
+
+static gboolean
+benchmark_applet_drag_start (void)
+{
+	GtkWidget     *applet;
+	GtkAllocation  allocation;
+	int            x, y;
+
+	applet = benchmark_find_applet ();
+	if (!applet)
+		return FALSE;
+
+	gtk_widget_get_allocation (applet, &allocation);
+	if (!gtk_widget_translate_coordinates (applet, GTK_WIDGET (benchmark.toplevel),
+					       allocation.width / 2, allocation.height / 2,
+					       &x, &y))
+		return FALSE;
+
+	gdk_window_get_origin (gtk_widget_get_window (GTK_WIDGET (benchmark.toplevel)),
+			       &benchmark.x, &benchmark.y);
+	benchmark.x += x;
+	benchmark.y += y;
+
+	benchmark_warp_pointer (benchmark.x, benchmark.y);
+	panel_widget_applet_drag_start (benchmark.panel, applet,
+					PW_DRAG_OFF_CENTER, GDK_CURRENT_TIME);
+
+	return benchmark.panel->currently_dragged_applet != NULL;
+}
+
+static gboolean
+benchmark_applet_drag_tick (void)
+{
+	/* the applet can have moved to another panel */
+	if (benchmark.panel->currently_dragged_applet == NULL)
+		return TRUE;
+
+	if (benchmark.phase == 0) {
+		benchmark.progress = MIN (benchmark.progress + BENCHMARK_DRAG_STEP,
+					  benchmark.step->count);
+		if (benchmark.progress == benchmark.step->count)
+			benchmark.phase = 1;
+	} else {
+		benchmark.progress = MAX (benchmark.progress - BENCHMARK_DRAG_STEP, 0);
+	}
+
+	if (panel_toplevel_get_orientation (benchmark.toplevel) & PANEL_HORIZONTAL_MASK)
+		benchmark_warp_pointer (benchmark.x + benchmark.progress, benchmark.y);
+	else
+		benchmark_warp_pointer (benchmark.x, benchmark.y + benchmark.progress);
+
+	return benchmark.phase == 1 && benchmark.progress == 0;
+}
+
+static gboolean
+benchmark_auto_hide_start (void)
+{
+	benchmark.original_auto_hide = panel_toplevel_get_auto_hide (benchmark.toplevel);
+	if (!benchmark.original_auto_hide)
+		panel_toplevel_set_auto_hide (benchmark.toplevel, TRUE);
+
+	benchmark_warp_pointer_away ();
+
+	return TRUE;
+}
+
+static gboolean
+benchmark_auto_hide_tick (void)
+{
+	PanelState state;
+
+	if (panel_toplevel_get_is_animating (benchmark.toplevel))
+		return FALSE;
+
+	state = panel_toplevel_get_state (benchmark.toplevel);
+
+	if (benchmark.phase == 0) {
+		if (state == PANEL_STATE_AUTO_HIDDEN)
+			benchmark.phase = 1;
+		else
+			panel_toplevel_queue_auto_hide (benchmark.toplevel);
+	} else {
+		if (state == PANEL_STATE_NORMAL) {
+			benchmark.phase = 0;
+			benchmark.progress++;
+		} else {
+			panel_toplevel_queue_auto_unhide (benchmark.toplevel);
+		}
+	}
+
+	return benchmark.progress == benchmark.step->count;
+}
+
+static gboolean
+benchmark_properties_start (void)
+{
+	benchmark.original_size = panel_toplevel_get_size (benchmark.toplevel);
+	panel_properties_dialog_present (benchmark.toplevel);
+
+	/* saved once, like the edits of the size spin button */
+	panel_profile_journal_begin ();
+	benchmark.in_journal = TRUE;
+
+	return TRUE;
+}
+
+static gboolean
+benchmark_properties_tick (void)
+{
+	GtkWidget *dialog;
+	int        size;
+
+	if (benchmark.phase == 0) {
+		dialog = panel_properties_dialog_peek_window (benchmark.toplevel);
+		if (dialog && gtk_widget_get_mapped (dialog))
+			benchmark.phase = 1;
+		return FALSE;
+	}
+
+	if (benchmark.phase == 1) {
+		benchmark.progress++;
+		if (benchmark.progress == benchmark.step->count)
+			benchmark.phase = 2;
+	} else {
+		benchmark.progress--;
+	}
+
+	size = MIN (benchmark.original_size + benchmark.progress,
+		    panel_toplevel_get_maximum_size (benchmark.toplevel));
+	panel_toplevel_set_size (benchmark.toplevel, size);
+
+	return benchmark.phase == 2 && benchmark.progress == 0;
+}
+
+static gboolean
+benchmark_run_dialog_start (void)
+{
+	panel_run_dialog_present (gtk_widget_get_screen (GTK_WIDGET (benchmark.toplevel)),
+				  GDK_CURRENT_TIME);
+
+	return TRUE;
+}
+
+static gboolean
+benchmark_run_dialog_tick (void)
+{
+	GtkWidget  *dialog;
+	const char *p;
+
+	dialog = panel_run_dialog_peek_window ();
+	if (!dialog)
+		return TRUE;
+
+	if (benchmark.phase == 0) {
+		if (gtk_widget_get_mapped (dialog))
+			benchmark.phase = 1;
+		return FALSE;
+	}
+
+	if (benchmark.phase == 1) {
+		p = g_utf8_offset_to_pointer (benchmark.step->text, benchmark.progress);
+		if (*p != '\0') {
+			benchmark_send_key (dialog, g_utf8_get_char (p));
+			benchmark.progress++;
+			return FALSE;
+		}
+
+		/* then the completion and the filter of the program list */
+		benchmark.phase = 2;
+		benchmark.progress = 0;
+	}
+
+	return ++benchmark.progress >= benchmark.step->count;
+}
+
+/* The allocation of the panel does not change, so this calls the
+ * implementation directly: gtk_widget_size_allocate() would skip it */
+static gboolean
+benchmark_layout_tick (void)
+{
+	GtkWidget     *widget = GTK_WIDGET (benchmark.panel);
+	GtkAllocation  allocation;
+	gint64         start;
+	int            i;
+
+	gtk_widget_get_allocation (widget, &allocation);
+
+	for (i = 0; i < BENCHMARK_LAYOUT_PASSES && benchmark.progress < benchmark.step->count; i++) {
+		start = g_get_monotonic_time ();
+		GTK_WIDGET_GET_CLASS (widget)->size_allocate (widget, &allocation);
+		benchmark.layout_time += g_get_monotonic_time () - start;
+		benchmark.progress++;
+	}
+
+	return benchmark.progress == benchmark.step->count;
+}
+
+static gboolean
+benchmark_step_start (void)
+{
+	switch (benchmark.step->action) {
+	case BENCHMARK_ACTION_MENU_OPEN:
+		return benchmark_menu_open_start ();
+	case BENCHMARK_ACTION_APPLET_DRAG:
+		return benchmark_applet_drag_start ();
+	case BENCHMARK_ACTION_AUTO_HIDE:
+		return benchmark_auto_hide_start ();
+	case BENCHMARK_ACTION_PROPERTIES:
+		return benchmark_properties_start ();
+	case BENCHMARK_ACTION_RUN_DIALOG:
+		return benchmark_run_dialog_start ();
+	default:
+		return TRUE;
+	}
+}
+
+/* Called once per frame: returns TRUE when the step is over */
+static gboolean
+benchmark_step_tick (void)
+{
+	switch (benchmark.step->action) {
+	case BENCHMARK_ACTION_WAIT:
+		return g_get_monotonic_time () - benchmark.step_start >=
+			(gint64) benchmark.step->count * 1000;
+	case BENCHMARK_ACTION_MENU_OPEN:
+		return benchmark.frame >= (guint) benchmark.step->count;
+	case BENCHMARK_ACTION_APPLET_DRAG:
+		return benchmark_applet_drag_tick ();
+	case BENCHMARK_ACTION_AUTO_HIDE:
+		return benchmark_auto_hide_tick ();
+	case BENCHMARK_ACTION_PROPERTIES:
+		return benchmark_properties_tick ();
+	case BENCHMARK_ACTION_RUN_DIALOG:
+		return benchmark_run_dialog_tick ();
+	case BENCHMARK_ACTION_LAYOUT:
+		return benchmark_layout_tick ();
+	default:
+		return TRUE;
+	}
+}
+
+/* Puts back what the step changed, whether it finished or not */
+static void
+benchmark_step_cleanup (void)
+{
+	GtkWidget *dialog;
+
+	switch (benchmark.step->action) {
+	case BENCHMARK_ACTION_MENU_OPEN:
+		benchmark_popdown_menus ();
+		break;
+	case BENCHMARK_ACTION_APPLET_DRAG:
+		if (benchmark.panel->currently_dragged_applet)
+			panel_widget_applet_drag_end (benchmark.panel);
+		break;
+	case BENCHMARK_ACTION_AUTO_HIDE:
+		if (!benchmark.original_auto_hide)
+			panel_toplevel_set_auto_hide (benchmark.toplevel, FALSE);
+		break;
+	case BENCHMARK_ACTION_PROPERTIES:
+		panel_toplevel_set_size (benchmark.toplevel, benchmark.original_size);
+		if (benchmark.in_journal) {
+			benchmark.in_journal = FALSE;
+			panel_profile_journal_end ();
+		}
+		dialog = panel_properties_dialog_peek_window (benchmark.toplevel);
+		if (dialog)
+			gtk_dialog_response (GTK_DIALOG (dialog), GTK_RESPONSE_CLOSE);
+		break;
+	case BENCHMARK_ACTION_RUN_DIALOG:
+		dialog = panel_run_dialog_peek_window ();
+		if (dialog && gtk_widget_get_visible (dialog))
+			gtk_dialog_response (GTK_DIALOG (dialog), GTK_RESPONSE_CANCEL);
+		break;
+	default:
+		break;
+	}
+}
+
+static gboolean
+benchmark_tick (GtkWidget     *widget,
+		GdkFrameClock *frame_clock,
+		gpointer       data)
+{
+	benchmark_watch_windows ();
+	benchmark.frame++;
+
+	if (!benchmark_step_tick ())
+		return G_SOURCE_CONTINUE;
+
+	benchmark.tick_id = 0;
+	benchmark_step_finish (FALSE, FALSE);
+
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean
+benchmark_step_timeout (gpointer data)
+{
+	benchmark.timeout_id = 0;
+	benchmark_step_finish (FALSE, TRUE);
+
+	return G_SOURCE_REMOVE;
+}
+
+static gint
+benchmark_compare_times (gconstpointer a,
+			 gconstpointer b)
+{
+	gint64 ta = *(const gint64 *) a;
+	gint64 tb = *(const gint64 *) b;
+
+	return ta < tb ? -1 : (ta > tb ? 1 : 0);
+}
+
+static void
+benchmark_print_step (gboolean skipped,
+		      gboolean timed_out)
+{
+	gint64 total = 0;
+	gint64 avg = -1, p95 = -1, max = -1;
+	guint  n = benchmark.frame_times->len;
+	guint  i;
+
+	if (n > 0) {
+		g_array_sort (benchmark.frame_times, benchmark_compare_times);
+		for (i = 0; i < n; i++)
+			total += g_array_index (benchmark.frame_times, gint64, i);
+
+		avg = total / n;
+		p95 = g_array_index (benchmark.frame_times, gint64, (n - 1) * 95 / 100);
+		max = g_array_index (benchmark.frame_times, gint64, n - 1);
+	}
+
+	g_print ("interaction step=%u action=%s frames=%u"
+		 " frame_avg_us=%" G_GINT64_FORMAT
+		 " frame_p95_us=%" G_GINT64_FORMAT
+		 " frame_max_us=%" G_GINT64_FORMAT
+		 " paint_max_us=%" G_GINT64_FORMAT
+		 " cpu_us=%" G_GINT64_FORMAT
+		 " wall_us=%" G_GINT64_FORMAT
+		 " skipped=%d timeout=%d",
+		 benchmark.current + 1,
+		 benchmark_actions [benchmark.step->action].name,
+		 n, avg, p95, max,
+		 skipped ? -1 : benchmark.paint_max,
+		 benchmark_get_cpu_time () - benchmark.step_cpu_start,
+		 g_get_monotonic_time () - benchmark.step_start,
+		 skipped, timed_out);
+
+	if (benchmark.step->action == BENCHMARK_ACTION_LAYOUT) {
+		guint n_applets = benchmark.toplevel ? benchmark.panel->applets->len : 0;
+		int   passes = benchmark.progress;
+
+		g_print (" passes=%d applets=%u layout_us=%" G_GINT64_FORMAT
+			 " layout_applet_ns=%" G_GINT64_FORMAT,
+			 passes, n_applets, benchmark.layout_time,
+			 passes > 0 && n_applets > 0 ?
+				 benchmark.layout_time * 1000 / (passes * (gint64) n_applets) : -1);
+	}
+
+	g_print ("\n");
+}
+
+static gboolean benchmark_next_step (gpointer data);
+
+static void
+benchmark_step_finish (gboolean skipped,
+		       gboolean timed_out)
+{
+	if (benchmark.timeout_id) {
+		g_source_remove (benchmark.timeout_id);
+		benchmark.timeout_id = 0;
+	}
+
+	if (benchmark.tick_id) {
+		gtk_widget_remove_tick_callback (GTK_WIDGET (benchmark.toplevel),
+						 benchmark.tick_id);
+		benchmark.tick_id = 0;
+	}
+
+	if (!skipped)
+		benchmark_step_cleanup ();
+
+	if (benchmark.frame_id) {
+		g_signal_handler_disconnect (benchmark.frame_clock, benchmark.frame_id);
+		benchmark.frame_id = 0;
+	}
+	g_clear_object (&benchmark.frame_clock);
+
+	benchmark_print_step (skipped, timed_out);
+
+	if (skipped || timed_out) {
+		benchmark.n_failed++;
+		benchmark.status = 1;
+	}
+
+	g_ptr_array_set_size (benchmark.clocks, 0);
+	g_array_set_size (benchmark.frame_times, 0);
+
+	/* not from the frame clock of the panel */
+	benchmark.current++;
+	benchmark.next_id = g_idle_add (benchmark_next_step, NULL);
+}
+
+static PanelToplevel *
+benchmark_find_toplevel (const char *id)
+{
+	GSList *l;
+
+	for (l = panel_toplevel_list_toplevels (); l; l = l->next) {
+		if (!id || g_strcmp0 (panel_profile_get_toplevel_id (l->data), id) == 0)
+			return l->data;
+	}
+
+	return NULL;
+}
+
+static void
+benchmark_finish (void)
+{
+	g_print ("interactions steps=%u failed=%u"
+		 " cpu_us=%" G_GINT64_FORMAT
+		 " wall_us=%" G_GINT64_FORMAT "\n",
+		 benchmark.steps->len, benchmark.n_failed,
+		 benchmark_get_cpu_time () - benchmark.run_cpu_start,
+		 g_get_monotonic_time () - benchmark.run_start);
+
+	g_ptr_array_unref (benchmark.steps);
+	benchmark.steps = NULL;
+	g_ptr_array_unref (benchmark.clocks);
+	g_array_unref (benchmark.frame_times);
+
+	gtk_main_quit ();
+}
+
+static gboolean
+benchmark_next_step (gpointer data)
+{
+	benchmark.next_id = 0;
+
+	if (benchmark.current >= benchmark.steps->len) {
+		benchmark_finish ();
+		return G_SOURCE_REMOVE;
+	}
+
+	benchmark.step = g_ptr_array_index (benchmark.steps, benchmark.current);
+	benchmark.frame = 0;
+	benchmark.phase = 0;
+	benchmark.progress = 0;
+	benchmark.paint_max = 0;
+	benchmark.layout_time = 0;
+	benchmark.last_frame = 0;
+	benchmark.step_start = g_get_monotonic_time ();
+	benchmark.step_cpu_start = benchmark_get_cpu_time ();
+
+	benchmark.toplevel = benchmark_find_toplevel (benchmark.step->panel);
+	if (!benchmark.toplevel ||
+	    !gtk_widget_get_mapped (GTK_WIDGET (benchmark.toplevel))) {
+		if (!benchmark.toplevel)
+			g_printerr ("No panel '%s' to replay step %u on\n",
+				    benchmark.step->panel, benchmark.current + 1);
+		benchmark.toplevel = NULL;
+		benchmark_step_finish (TRUE, FALSE);
+		return G_SOURCE_REMOVE;
+	}
+	benchmark.panel = panel_toplevel_get_panel_widget (benchmark.toplevel);
+
+	/* the frames of the panel are counted from the first one of the
+	 * step, which the tick callback keeps coming */
+	benchmark.frame_clock = g_object_ref (gtk_widget_get_frame_clock (GTK_WIDGET (benchmark.toplevel)));
+	benchmark.frame_id = g_signal_connect (benchmark.frame_clock, "after-paint",
+					       G_CALLBACK (benchmark_frame), NULL);
+
+	if (!benchmark_step_start ()) {
+		benchmark_step_finish (TRUE, FALSE);
+		return G_SOURCE_REMOVE;
+	}
+
+	benchmark_watch_windows ();
+
+	benchmark.tick_id = gtk_widget_add_tick_callback (GTK_WIDGET (benchmark.toplevel),
+							  benchmark_tick, NULL, NULL);
+	benchmark.timeout_id = g_timeout_add_seconds (BENCHMARK_STEP_TIMEOUT,
+						      benchmark_step_timeout, NULL);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* The panel is measured once it has loaded its applets */
+static gboolean
+benchmark_wait_for_panel (gpointer data)
+{
+	if (mate_panel_applet_is_loading () ||
+	    panel_toplevel_list_toplevels () == NULL)
+		return G_SOURCE_CONTINUE;
+
+	benchmark.start_id = 0;
+	benchmark.run_start = g_get_monotonic_time ();
+	benchmark.run_cpu_start = benchmark_get_cpu_time ();
+	benchmark_next_step (NULL);
+
+	return G_SOURCE_REMOVE;
+}
+
+gboolean
+panel_interaction_benchmark_start (const char *script)
+{
+	benchmark.steps = benchmark_parse_script (script);
+	if (!benchmark.steps) {
+		benchmark.status = 1;
+		return FALSE;
+	}
+
+	benchmark.clocks = g_ptr_array_new_with_free_func ((GDestroyNotify) benchmark_clock_free);
+	benchmark.frame_times = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+	benchmark.start_id = g_timeout_add (BENCHMARK_START_POLL,
+					    benchmark_wait_for_panel, NULL);
+
+	return TRUE;
+}
+
+int
+panel_interaction_benchmark_get_status (void)
+{
+	return benchmark.status;
+}
@@ -0,0 +1,239 @@
+/*
+ * panel-layout-snapshot.c: remember the size of the panels between sessions
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/* A non-expanded panel gets its length from its applets, which are loaded
+ * asynchronously: without help, such a panel would start tiny and grow as
+ * its applets appear. At exit, the resolved size of every panel is written
+ * to a small binary file; on the next start, panels whose settings did not
+ * change get that size as a minimum until all the applets are loaded, and
+ * then shrink to their real size if needed. */
+
+#include <config.h>
+#include <errno.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+
+#include "panel-layout-snapshot.h"
+#include "panel-profile.h"
+
+#define PANEL_LAYOUT_SNAPSHOT_FILE    "layout.snapshot"
+#define PANEL_LAYOUT_SNAPSHOT_VERSION 1
+
+/* (version, [(toplevel id, orientation, size, monitor, width, height)]) */
+#define PANEL_LAYOUT_SNAPSHOT_VARIANT_TYPE "(ua(siiiii))"
+
+typedef struct {
+	PanelOrientation orientation;
+	int              size;
+	int              monitor;
+	int              width;
+	int              height;
+} PanelLayoutSnapshotEntry;
+
+static GHashTable *snapshot_entries = NULL;
+static GSList     *snapshot_applied = NULL;
+
+static char *
+panel_layout_snapshot_get_filename (void)
+{
+	return g_build_filename (g_get_user_cache_dir (), "mate-panel",
+				 PANEL_LAYOUT_SNAPSHOT_FILE, NULL);
+}
+
+void
+panel_layout_snapshot_load (void)
+{
+	GMappedFile  *mapped;
+	GBytes       *bytes;
+	GVariant     *snapshot;
+	GVariantIter *toplevels;
+	char         *filename;
+	const char   *id;
+	guint32       version;
+	int           orientation, size, monitor, width, height;
+
+	if (snapshot_entries != NULL)
+		return;
+
+	filename = panel_layout_snapshot_get_filename ();
+	mapped = g_mapped_file_new (filename, FALSE, NULL);
+	g_free (filename);
+
+	if (!mapped)
+		return;
+
+	bytes = g_mapped_file_get_bytes (mapped);
+	g_mapped_file_unref (mapped);
+
+	snapshot = g_variant_new_from_bytes (G_VARIANT_TYPE (PANEL_LAYOUT_SNAPSHOT_VARIANT_TYPE),
+					     bytes, FALSE);
+	g_variant_ref_sink (snapshot);
+	g_bytes_unref (bytes);
+
+	g_variant_get (snapshot, "(ua(siiiii))", &version, &toplevels);
+
+	if (version == PANEL_LAYOUT_SNAPSHOT_VERSION) {
+		snapshot_entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+							  g_free, g_free);
+
+		while (g_variant_iter_next (toplevels, "(&siiiii)", &id,
+					    &orientation, &size, &monitor,
+					    &width, &height)) {
+			PanelLayoutSnapshotEntry *entry;
+
+			entry = g_new0 (PanelLayoutSnapshotEntry, 1);
+			entry->orientation = orientation;
+			entry->size        = size;
+			entry->monitor     = monitor;
+			entry->width       = width;
+			entry->height      = height;
+
+			g_hash_table_replace (snapshot_entries, g_strdup (id), entry);
+		}
+	}
+
+	g_variant_iter_free (toplevels);
+	g_variant_unref (snapshot);
+}
+
+void
+panel_layout_snapshot_apply (PanelToplevel *toplevel)
+{
+	PanelLayoutSnapshotEntry *entry;
+	PanelWidget              *panel_widget;
+	const char               *id;
+
+	if (snapshot_entries == NULL)
+		return;
+
+	if (panel_toplevel_get_expand (toplevel) ||
+	    panel_toplevel_get_is_attached (toplevel))
+		return;
+
+	id = panel_profile_get_toplevel_id (toplevel);
+	if (id == NULL)
+		return;
+
+	entry = g_hash_table_lookup (snapshot_entries, id);
+	if (entry == NULL)
+		return;
+
+	/* the settings changed since the snapshot was taken */
+	if (entry->orientation != panel_toplevel_get_orientation (toplevel) ||
+	    entry->size != panel_toplevel_get_size (toplevel) ||
+	    entry->monitor != panel_toplevel_get_monitor (toplevel))
+		return;
+
+	panel_widget = panel_toplevel_get_panel_widget (toplevel);
+
+	/* only the length comes from the applets, the toplevel takes care
+	 * of the other dimension */
+	if (entry->orientation & PANEL_HORIZONTAL_MASK)
+		gtk_widget_set_size_request (GTK_WIDGET (panel_widget),
+					     entry->width, -1);
+	else
+		gtk_widget_set_size_request (GTK_WIDGET (panel_widget),
+					     -1, entry->height);
+
+	snapshot_applied = g_slist_prepend (snapshot_applied, panel_widget);
+	g_object_add_weak_pointer (G_OBJECT (panel_widget),
+				   &snapshot_applied->data);
+}
+
+/* Called once the applets are loaded: from now on, the panels get their
+ * real size. */
+void
+panel_layout_snapshot_release (void)
+{
+	GSList *l;
+
+	for (l = snapshot_applied; l != NULL; l = l->next) {
+		if (l->data == NULL)
+			continue;
+
+		g_object_remove_weak_pointer (G_OBJECT (l->data), &l->data);
+		gtk_widget_set_size_request (GTK_WIDGET (l->data), -1, -1);
+	}
+
+	g_slist_free (snapshot_applied);
+	snapshot_applied = NULL;
+
+	g_clear_pointer (&snapshot_entries, g_hash_table_destroy);
+}
+
+void
+panel_layout_snapshot_save (void)
+{
+	GVariantBuilder  toplevels;
+	GVariant        *snapshot;
+	GSList          *l;
+	GError          *error = NULL;
+	char            *filename;
+	char            *dirname;
+
+	g_variant_builder_init (&toplevels, G_VARIANT_TYPE ("a(siiiii)"));
+
+	for (l = panel_toplevel_list_toplevels (); l != NULL; l = l->next) {
+		PanelToplevel *toplevel = l->data;
+		GtkWidget     *panel_widget;
+		const char    *id;
+
+		if (panel_toplevel_get_expand (toplevel) ||
+		    panel_toplevel_get_is_attached (toplevel))
+			continue;
+
+		id = panel_profile_get_toplevel_id (toplevel);
+		panel_widget = GTK_WIDGET (panel_toplevel_get_panel_widget (toplevel));
+
+		if (id == NULL || !gtk_widget_get_realized (panel_widget))
+			continue;
+
+		g_variant_builder_add (&toplevels, "(siiiii)", id,
+				       panel_toplevel_get_orientation (toplevel),
+				       panel_toplevel_get_size (toplevel),
+				       panel_toplevel_get_monitor (toplevel),
+				       gtk_widget_get_allocated_width (panel_widget),
+				       gtk_widget_get_allocated_height (panel_widget));
+	}
+
+	snapshot = g_variant_new ("(ua(siiiii))", PANEL_LAYOUT_SNAPSHOT_VERSION,
+				  &toplevels);
+	g_variant_ref_sink (snapshot);
+
+	filename = panel_layout_snapshot_get_filename ();
+	dirname = g_path_get_dirname (filename);
+
+	if (g_mkdir_with_parents (dirname, 0700) != 0 ||
+	    !g_file_set_contents (filename,
+				  g_variant_get_data (snapshot),
+				  g_variant_get_size (snapshot),
+				  &error)) {
+		g_debug ("Cannot write layout snapshot %s: %s", filename,
+			 error ? error->message : g_strerror (errno));
+		g_clear_error (&error);
+	}
+
+	g_free (dirname);
+	g_free (filename);
+	g_variant_unref (snapshot);
+}
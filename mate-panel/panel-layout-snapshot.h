@@ -0,0 +1,38 @@
+/*
+ * panel-layout-snapshot.h: remember the size of the panels between sessions
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __PANEL_LAYOUT_SNAPSHOT_H__
+#define __PANEL_LAYOUT_SNAPSHOT_H__
+
+#include <glib.h>
+
+#include "panel-toplevel.h"
+
+G_BEGIN_DECLS
+
+void panel_layout_snapshot_load    (void);
+void panel_layout_snapshot_apply   (PanelToplevel *toplevel);
+void panel_layout_snapshot_release (void);
+void panel_layout_snapshot_save    (void);
+
+G_END_DECLS
+
+#endif /* __PANEL_LAYOUT_SNAPSHOT_H__ */
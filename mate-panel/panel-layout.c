@@ -34,6 +34,8 @@
 #include <gdk/gdkx.h>
 #endif
 
+#include <dconf.h>
+
 #include <libmate-desktop/mate-dconf.h>
 #include <libmate-desktop/mate-gsettings.h>
 
@@ -121,6 +123,233 @@ panel_layout_filename (void)
     }
 }
 
+/* The objects keys that are applied to a running object: the other ones
+ * make a different object */
+static const char *panel_layout_object_in_place_keys[] = {
+        PANEL_OBJECT_LOCKED_KEY,
+        PANEL_OBJECT_TOOLTIP_KEY,
+        PANEL_OBJECT_USE_CUSTOM_ICON_KEY,
+        PANEL_OBJECT_CUSTOM_ICON_KEY,
+        PANEL_OBJECT_HAS_ARROW_KEY
+};
+
+/* Try to extract an id from the group, by stripping the prefix. Returns
+ * FALSE if the id is not valid; *id is NULL if the group has none. */
+static gboolean
+panel_layout_get_group_id (const char  *group,
+                           const char  *group_prefix,
+                           int          set_screen_to,
+                           char       **id)
+{
+    GError     *error = NULL;
+    const char *group_id;
+
+    *id = NULL;
+
+    group_id = group + strlen (group_prefix);
+    while (g_ascii_isspace (*group_id))
+        group_id++;
+
+    if (!*group_id)
+        return TRUE;
+
+    if (!mate_gsettings_is_valid_keyname (group_id, &error)) {
+        g_warning ("Invalid id name in layout '%s' (%s)", group_id, error->message);
+        g_error_free (error);
+        return FALSE;
+    }
+
+    if (set_screen_to > 0)
+        *id = g_strdup_printf ("%s-screen%d", group_id, set_screen_to);
+    else
+        *id = g_strdup (group_id);
+
+    return TRUE;
+}
+
+static PanelLayoutKeyDefinition *
+panel_layout_find_key_definition (const char                *key,
+                                  PanelLayoutKeyDefinition  *key_definitions,
+                                  int                        key_definitions_len)
+{
+    int j;
+
+    for (j = 0; j < key_definitions_len; j++) {
+        if (g_strcmp0 (key, key_definitions[j].name) == 0)
+            return &key_definitions[j];
+    }
+
+    return NULL;
+}
+
+/* Returns a new reference, or NULL if the group does not set the key */
+static GVariant *
+panel_layout_get_group_value (GKeyFile                 *keyfile,
+                              const char               *group,
+                              PanelLayoutKeyDefinition *key_definition)
+{
+    GVariant *value = NULL;
+
+    if (!g_key_file_has_key (keyfile, group, key_definition->name, NULL))
+        return NULL;
+
+    switch (key_definition->type) {
+        case G_TYPE_STRING: {
+            char *value_str =
+                g_key_file_get_string (keyfile,
+                                       group, key_definition->name,
+                                       NULL);
+            if (value_str)
+                value = g_variant_new_string (value_str);
+            g_free (value_str);
+            break;
+        }
+        case G_TYPE_INT:
+            value = g_variant_new_int32 (g_key_file_get_integer (keyfile,
+                                                                 group, key_definition->name,
+                                                                 NULL));
+            break;
+        case G_TYPE_BOOLEAN:
+            value = g_variant_new_boolean (g_key_file_get_boolean (keyfile,
+                                                                   group, key_definition->name,
+                                                                   NULL));
+            break;
+        default:
+            g_assert_not_reached ();
+            break;
+    }
+
+    return value ? g_variant_ref_sink (value) : NULL;
+}
+
+/* In place, a key is only written if its value changes */
+static void
+panel_layout_set_value (GSettings  *settings,
+                        const char *key,
+                        GVariant   *value,
+                        gboolean    in_place)
+{
+    g_variant_ref_sink (value);
+
+    if (in_place) {
+        GVariant *current;
+        gboolean  same;
+
+        current = g_settings_get_value (settings, key);
+        same = g_variant_equal (current, value);
+        g_variant_unref (current);
+
+        if (same) {
+            g_variant_unref (value);
+            return;
+        }
+    }
+
+    g_settings_set_value (settings, key, value);
+    g_variant_unref (value);
+}
+
+/* Resets the keys that do not have their default value, except the ones
+ * set by the group and @except_key, which the caller sets itself */
+static void
+panel_layout_reset_user_values (GSettings  *settings,
+                                GKeyFile   *keyfile,
+                                const char *group,
+                                const char *except_key)
+{
+    GSettingsSchema  *schema;
+    char            **keys;
+    int               i;
+
+    g_object_get (settings, "settings-schema", &schema, NULL);
+    keys = g_settings_schema_list_keys (schema);
+
+    for (i = 0; keys[i] != NULL; i++) {
+        GVariant *user_value;
+        GVariant *default_value;
+        gboolean  is_default;
+
+        if (keyfile && g_key_file_has_key (keyfile, group, keys[i], NULL))
+            continue;
+        if (g_strcmp0 (keys[i], except_key) == 0)
+            continue;
+
+        user_value = g_settings_get_user_value (settings, keys[i]);
+        if (!user_value)
+            continue;
+
+        default_value = g_settings_get_default_value (settings, keys[i]);
+        is_default = default_value && g_variant_equal (user_value, default_value);
+
+        if (!is_default)
+            g_settings_reset (settings, keys[i]);
+
+        g_variant_unref (user_value);
+        if (default_value)
+            g_variant_unref (default_value);
+    }
+
+    g_strfreev (keys);
+    g_settings_schema_unref (schema);
+}
+
+static gboolean
+panel_layout_write_group_keys (GKeyFile                  *keyfile,
+                               const char                *group,
+                               GSettings                 *settings,
+                               PanelLayoutKeyDefinition  *key_definitions,
+                               int                        key_definitions_len,
+                               const char                *id,
+                               gboolean                   in_place,
+                               const char                *except_key)
+{
+    char **keyfile_keys;
+    int    i;
+
+    keyfile_keys = g_key_file_get_keys (keyfile, group, NULL, NULL);
+    if (!keyfile_keys)
+        return FALSE;
+
+    /* validate the keys from the keyfile */
+    for (i = 0; keyfile_keys[i] != NULL; i++) {
+        if (!panel_layout_find_key_definition (keyfile_keys[i],
+                                               key_definitions,
+                                               key_definitions_len)) {
+            g_warning ("Unknown key '%s' for %s",
+                       keyfile_keys[i],
+                       id);
+            g_strfreev (keyfile_keys);
+            return FALSE;
+        }
+    }
+
+    /* add them */
+    for (i = 0; keyfile_keys[i] != NULL; i++) {
+        PanelLayoutKeyDefinition *key_definition;
+        GVariant                 *value;
+
+        key_definition = panel_layout_find_key_definition (keyfile_keys[i],
+                                                           key_definitions,
+                                                           key_definitions_len);
+
+        value = panel_layout_get_group_value (keyfile, group, key_definition);
+        if (!value)
+            continue;
+
+        panel_layout_set_value (settings, key_definition->name, value, in_place);
+        g_variant_unref (value);
+    }
+
+    g_strfreev (keyfile_keys);
+
+    /* what the group does not set gets its default value, as in a new
+     * directory */
+    if (in_place)
+        panel_layout_reset_user_values (settings, keyfile, group, except_key);
+
+    return TRUE;
+}
+
 static gboolean
 panel_layout_append_group_helper (GKeyFile                  *keyfile,
                                   const char                *group,
@@ -135,31 +364,19 @@ panel_layout_append_group_helper (GKeyFile                  *keyfile,
                                   const char                *type_for_error_message)
 {
     gboolean     retval       = FALSE;
-    GError      *error        = NULL;
     gboolean     existing_id  = FALSE;
     const gchar *dconf_path;
-    const char  *id;
+    char        *id;
     gchar      **existing_ids;
     char        *unique_id;
-    char       **keyfile_keys;
+    char        *path;
     GSettings   *settings;
 
     PanelGSettingsKeyType type;
 
-    /* Try to extract an id from the group, by stripping the prefix,
-     * and create a unique id out of that */
-    id = group + strlen (group_prefix);
-    while (g_ascii_isspace (*id))
-        id++;
-
-    if (!*id)
-        id = NULL;
-
-    if (id && !mate_gsettings_is_valid_keyname (id, &error)) {
-        g_warning ("Invalid id name in layout '%s' (%s)", id, error->message);
-        g_error_free (error);
+    /* create a unique id out of the id of the group */
+    if (!panel_layout_get_group_id (group, group_prefix, set_screen_to, &id))
         return FALSE;
-    }
 
     if (g_strcmp0 (id_list_key, PANEL_TOPLEVEL_ID_LIST_KEY) == 0) {
         dconf_path = PANEL_RESOURCE_PATH "/toplevels";
@@ -171,7 +388,8 @@ panel_layout_append_group_helper (GKeyFile                  *keyfile,
     }
     else {
         g_critical ("Unknown key \"%s\"", id_list_key);
-	return FALSE;
+        g_free (id);
+        return FALSE;
     }
 
     existing_ids = mate_dconf_list_subdirs (dconf_path, TRUE);
@@ -179,9 +397,6 @@ panel_layout_append_group_helper (GKeyFile                  *keyfile,
     if (id) {
         int i;
 
-        if (set_screen_to > 0)
-            id = g_strdup_printf ("%s-screen%d", id, set_screen_to);
-
         for (i = 0; existing_ids[i]; i++) {
                 if (!strcmp (existing_ids[i], id)) {
                     existing_id = TRUE;
@@ -195,75 +410,15 @@ panel_layout_append_group_helper (GKeyFile                  *keyfile,
         unique_id = panel_profile_find_new_id (type);
     else
         unique_id = g_strdup (id);
+    g_free (id);
 
-    char *path = g_strdup_printf ("%s%s/", path_prefix, unique_id);
-    settings = g_settings_new_with_path (schema, path);
+    path = g_strdup_printf ("%s%s/", path_prefix, unique_id);
+    settings = panel_profile_get_settings (schema, path);
     g_free (path);
 
-    keyfile_keys = g_key_file_get_keys (keyfile, group, NULL, NULL);
-
-    if (keyfile_keys) {
-        int i;
-
-        /* validate/add keys from the keyfile */
-        for (i = 0; keyfile_keys[i] != NULL; i++) {
-            gboolean found = FALSE;
-            int j;
-
-            for (j = 0; j < key_definitions_len; j++) {
-                if (g_strcmp0 (keyfile_keys[i],
-                               key_definitions[j].name) == 0) {
-                    found = TRUE;
-                    break;
-                }
-            }
-
-            if (!found) {
-                g_warning ("Unknown key '%s' for %s",
-                           keyfile_keys[i],
-                           unique_id);
-                return FALSE;
-            }
-
-            switch (key_definitions[j].type) {
-                case G_TYPE_STRING: {
-                    char *value_str =
-                        g_key_file_get_string (keyfile,
-                                               group, keyfile_keys[i],
-                                               NULL);
-                    if (value_str)
-                        g_settings_set_string (settings,
-                                               key_definitions[j].name,
-                                               value_str);
-                    g_free (value_str);
-                    break;
-                }
-                case G_TYPE_INT: {
-                    gint value_int =
-                        g_key_file_get_integer (keyfile,
-                                                group, keyfile_keys[i],
-                                                NULL);
-                    g_settings_set_int (settings,
-                                        key_definitions[j].name,
-                                        value_int);
-                    break;
-                }
-                case G_TYPE_BOOLEAN: {
-                    gboolean value_boolean =
-                        g_key_file_get_boolean (keyfile,
-                                                group, keyfile_keys[i],
-                                                NULL);
-                    g_settings_set_boolean (settings,
-                                            key_definitions[j].name,
-                                            value_boolean);
-                    break;
-                }
-                default:
-                    g_assert_not_reached ();
-                    break;
-            }
-        }
-
+    if (panel_layout_write_group_keys (keyfile, group, settings,
+                                       key_definitions, key_definitions_len,
+                                       unique_id, FALSE, NULL)) {
         if (set_screen_to != -1 &&
                 g_strcmp0 (schema, PANEL_TOPLEVEL_SCHEMA) == 0)
             g_settings_set_int (settings,
@@ -279,14 +434,8 @@ panel_layout_append_group_helper (GKeyFile                  *keyfile,
         retval = TRUE;
     }
 
-    if (keyfile_keys)
-        g_strfreev (keyfile_keys);
-
-    if (settings)
-        g_object_unref (settings);
-
-    if (unique_id)
-        g_free (unique_id);
+    g_object_unref (settings);
+    g_free (unique_id);
 
     return retval;
 }
@@ -321,6 +470,247 @@ panel_layout_apply_minimal_default (int          set_screen_to,
     g_object_unref (settings);
 }
 
+/*
+ * At first login, the layout is written to dconf as a single change,
+ * instead of one write per key: dconf applies it in one go, and the id
+ * lists only change once, when everything they point to is there.
+ */
+
+/* We write dconf directly, which is only right if GSettings does */
+static gboolean
+panel_layout_backend_is_dconf (void)
+{
+    GSettingsBackend *backend;
+    gboolean          is_dconf;
+
+    backend = g_settings_backend_get_default ();
+    is_dconf = g_strcmp0 (G_OBJECT_TYPE_NAME (backend), "DConfSettingsBackend") == 0;
+    g_object_unref (backend);
+
+    return is_dconf;
+}
+
+static GHashTable *
+panel_layout_get_existing_ids (const char *dir)
+{
+    GHashTable  *ids;
+    gchar      **existing_ids;
+    int          i;
+
+    ids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+    existing_ids = mate_dconf_list_subdirs (dir, TRUE);
+    for (i = 0; existing_ids[i]; i++)
+        g_hash_table_add (ids, g_strdup (existing_ids[i]));
+    g_strfreev (existing_ids);
+
+    return ids;
+}
+
+/* Like panel_profile_find_new_id(), but the ids of the change being built
+ * are not in dconf yet */
+static char *
+panel_layout_find_new_id (const char *prefix,
+                          GHashTable *taken_ids)
+{
+    char *retval;
+    int   i;
+
+    for (i = 0; ; i++) {
+        retval = g_strdup_printf ("%s-%d", prefix, i);
+        if (!g_hash_table_contains (taken_ids, retval))
+            return retval;
+        g_free (retval);
+    }
+}
+
+static void
+panel_layout_add_group_to_changeset (DConfChangeset            *changeset,
+                                     GKeyFile                  *keyfile,
+                                     const char                *group,
+                                     int                        set_screen_to,
+                                     const char                *group_prefix,
+                                     const char                *path_prefix,
+                                     const char                *default_prefix,
+                                     PanelLayoutKeyDefinition  *key_definitions,
+                                     int                        key_definitions_len,
+                                     GHashTable                *taken_ids,
+                                     GPtrArray                 *added_ids)
+{
+    char  *id;
+    char **keyfile_keys;
+    int    i;
+
+    if (!panel_layout_get_group_id (group, group_prefix, set_screen_to, &id))
+        return;
+
+    keyfile_keys = g_key_file_get_keys (keyfile, group, NULL, NULL);
+    if (!keyfile_keys) {
+        g_free (id);
+        return;
+    }
+
+    for (i = 0; keyfile_keys[i] != NULL; i++) {
+        if (!panel_layout_find_key_definition (keyfile_keys[i],
+                                               key_definitions,
+                                               key_definitions_len)) {
+            g_warning ("Unknown key '%s' for %s",
+                       keyfile_keys[i],
+                       id ? id : group);
+            g_strfreev (keyfile_keys);
+            g_free (id);
+            return;
+        }
+    }
+
+    if (!id || g_hash_table_contains (taken_ids, id)) {
+        g_free (id);
+        id = panel_layout_find_new_id (default_prefix, taken_ids);
+    }
+    g_hash_table_add (taken_ids, id);
+    g_ptr_array_add (added_ids, id);
+
+    for (i = 0; keyfile_keys[i] != NULL; i++) {
+        PanelLayoutKeyDefinition *key_definition;
+        GVariant                 *value;
+        char                     *key;
+
+        key_definition = panel_layout_find_key_definition (keyfile_keys[i],
+                                                           key_definitions,
+                                                           key_definitions_len);
+
+        value = panel_layout_get_group_value (keyfile, group, key_definition);
+        if (!value)
+            continue;
+
+        key = g_strconcat (path_prefix, id, "/", key_definition->name, NULL);
+        dconf_changeset_set (changeset, key, value);
+        g_free (key);
+        g_variant_unref (value);
+    }
+
+    if (set_screen_to != -1) {
+        char *key;
+
+        key = g_strconcat (path_prefix, id, "/", PANEL_TOPLEVEL_SCREEN_KEY, NULL);
+        dconf_changeset_set (changeset, key, g_variant_new_int32 (set_screen_to));
+        g_free (key);
+    }
+
+    g_strfreev (keyfile_keys);
+}
+
+/* The ids are appended to the list, as mate_gsettings_append_strv() does */
+static void
+panel_layout_add_id_list_to_changeset (DConfChangeset *changeset,
+                                       GSettings      *panel_settings,
+                                       const char     *id_list_key,
+                                       GPtrArray      *added_ids)
+{
+    GPtrArray  *ids;
+    char      **current_ids;
+    char       *key;
+    guint       i;
+
+    ids = g_ptr_array_new ();
+
+    current_ids = g_settings_get_strv (panel_settings, id_list_key);
+    for (i = 0; current_ids[i]; i++)
+        g_ptr_array_add (ids, current_ids[i]);
+    for (i = 0; i < added_ids->len; i++)
+        g_ptr_array_add (ids, g_ptr_array_index (added_ids, i));
+
+    key = g_strconcat (PANEL_GENERAL_PATH, id_list_key, NULL);
+    dconf_changeset_set (changeset, key,
+                         g_variant_new_strv ((const gchar * const *) ids->pdata,
+                                             ids->len));
+    g_free (key);
+
+    g_ptr_array_free (ids, TRUE);
+    g_strfreev (current_ids);
+}
+
+static gboolean
+panel_layout_apply_groups_at_once (GKeyFile  *keyfile,
+                                   gchar    **groups,
+                                   int        screen_n)
+{
+    DConfChangeset *changeset;
+    DConfClient    *client;
+    GSettings      *panel_settings;
+    GHashTable     *toplevel_ids;
+    GHashTable     *object_ids;
+    GPtrArray      *added_toplevel_ids;
+    GPtrArray      *added_object_ids;
+    GError         *error = NULL;
+    gboolean        retval;
+    int             i;
+
+    if (!panel_layout_backend_is_dconf ())
+        return FALSE;
+
+    changeset = dconf_changeset_new ();
+
+    toplevel_ids = panel_layout_get_existing_ids (PANEL_TOPLEVEL_PATH);
+    object_ids = panel_layout_get_existing_ids (PANEL_OBJECT_PATH);
+    added_toplevel_ids = g_ptr_array_new ();
+    added_object_ids = g_ptr_array_new ();
+
+    for (i = 0; groups[i] != NULL; i++) {
+        if (g_strcmp0 (groups[i], "Toplevel") == 0 ||
+                g_str_has_prefix (groups[i], "Toplevel "))
+            panel_layout_add_group_to_changeset (changeset, keyfile, groups[i],
+                                                 screen_n,
+                                                 "Toplevel",
+                                                 PANEL_TOPLEVEL_PATH,
+                                                 PANEL_TOPLEVEL_DEFAULT_PREFIX,
+                                                 panel_layout_toplevel_keys,
+                                                 G_N_ELEMENTS (panel_layout_toplevel_keys),
+                                                 toplevel_ids,
+                                                 added_toplevel_ids);
+        else if (g_strcmp0 (groups[i], "Object") == 0 ||
+                g_str_has_prefix (groups[i], "Object "))
+            panel_layout_add_group_to_changeset (changeset, keyfile, groups[i],
+                                                 -1,
+                                                 "Object",
+                                                 PANEL_OBJECT_PATH,
+                                                 PANEL_OBJECT_DEFAULT_PREFIX,
+                                                 panel_layout_object_keys,
+                                                 G_N_ELEMENTS (panel_layout_object_keys),
+                                                 object_ids,
+                                                 added_object_ids);
+        else
+            g_warning ("Unknown group in default layout: '%s'",
+                       groups[i]);
+    }
+
+    panel_settings = g_settings_new (PANEL_SCHEMA);
+    panel_layout_add_id_list_to_changeset (changeset, panel_settings,
+                                           PANEL_TOPLEVEL_ID_LIST_KEY,
+                                           added_toplevel_ids);
+    panel_layout_add_id_list_to_changeset (changeset, panel_settings,
+                                           PANEL_OBJECT_ID_LIST_KEY,
+                                           added_object_ids);
+    g_object_unref (panel_settings);
+
+    client = dconf_client_new ();
+    retval = dconf_client_change_sync (client, changeset, NULL, NULL, &error);
+    if (!retval) {
+        g_warning ("Could not write the default layout at once: %s",
+                   error->message);
+        g_error_free (error);
+    }
+    g_object_unref (client);
+
+    g_ptr_array_free (added_object_ids, TRUE);
+    g_ptr_array_free (added_toplevel_ids, TRUE);
+    g_hash_table_destroy (object_ids);
+    g_hash_table_destroy (toplevel_ids);
+    dconf_changeset_unref (changeset);
+
+    return retval;
+}
+
 void
 panel_layout_apply_default_from_gkeyfile (GdkScreen *screen)
 {
@@ -346,11 +736,15 @@ panel_layout_apply_default_from_gkeyfile (GdkScreen *screen)
                                        G_KEY_FILE_NONE,
                                        &error))
         {
+            gboolean applied;
             int i;
 
             groups = g_key_file_get_groups (keyfile, NULL);
 
-            for (i = 0; groups[i] != NULL; i++) {
+            applied = panel_layout_apply_groups_at_once (keyfile, groups, screen_n);
+
+            /* key by key, if dconf could not take the layout at once */
+            for (i = 0; !applied && groups[i] != NULL; i++) {
 
                 if (g_strcmp0 (groups[i], "Toplevel") == 0 ||
                         g_str_has_prefix (groups[i], "Toplevel "))
@@ -414,3 +808,459 @@ panel_layout_apply_default_from_gkeyfile (GdkScreen *screen)
     if (layout_file)
         g_free (layout_file);
 }
+
+/*
+ * Applying a layout in place: instead of deleting the whole profile and
+ * loading the layout in an empty one, the toplevels and objects of the
+ * profile that the layout has too are kept, and changed in place. Only the
+ * ones that differ are removed from the id lists, or added to them, and
+ * the panel diffs the lists to destroy or create just these.
+ */
+
+typedef struct {
+        const char *group;
+        char       *id;
+        gboolean    reused;
+        gboolean    needs_id;
+} PanelLayoutEntry;
+
+static void
+panel_layout_entry_free (PanelLayoutEntry *entry)
+{
+    g_free (entry->id);
+    g_free (entry);
+}
+
+static gboolean
+panel_layout_is_group (const char *group,
+                       const char *group_prefix)
+{
+    return g_str_has_prefix (group, group_prefix) &&
+           (group[strlen (group_prefix)] == '\0' ||
+            group[strlen (group_prefix)] == ' ');
+}
+
+static GHashTable *
+panel_layout_strv_to_set (char **strv)
+{
+    GHashTable *set;
+    int         i;
+
+    set = g_hash_table_new (g_str_hash, g_str_equal);
+    for (i = 0; strv && strv[i]; i++)
+        g_hash_table_add (set, strv[i]);
+
+    return set;
+}
+
+static char *
+panel_layout_get_path (PanelGSettingsKeyType  type,
+                       const char            *id)
+{
+    if (type == PANEL_GSETTINGS_TOPLEVELS)
+        return g_strdup_printf (PANEL_TOPLEVEL_PATH "%s/", id);
+    else
+        return g_strdup_printf (PANEL_OBJECT_PATH "%s/", id);
+}
+
+/* An object is kept if only the keys that it applies itself change, and
+ * if it stays on a toplevel that is kept */
+static gboolean
+panel_layout_object_is_same (GKeyFile   *keyfile,
+                             const char *group,
+                             GSettings  *settings,
+                             GHashTable *reused_toplevel_ids)
+{
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS (panel_layout_object_keys); i++) {
+        PanelLayoutKeyDefinition *key_definition = &panel_layout_object_keys[i];
+        GVariant                 *value;
+        GVariant                 *current;
+        gboolean                  same;
+        gboolean                  in_place = FALSE;
+        guint                     j;
+
+        for (j = 0; j < G_N_ELEMENTS (panel_layout_object_in_place_keys); j++) {
+            if (g_strcmp0 (key_definition->name,
+                           panel_layout_object_in_place_keys[j]) == 0) {
+                in_place = TRUE;
+                break;
+            }
+        }
+
+        if (in_place)
+            continue;
+
+        value = panel_layout_get_group_value (keyfile, group, key_definition);
+        if (!value)
+            value = g_settings_get_default_value (settings, key_definition->name);
+        if (!value)
+            return FALSE;
+
+        current = g_settings_get_value (settings, key_definition->name);
+        same = g_variant_equal (current, value);
+
+        if (same && g_strcmp0 (key_definition->name, PANEL_OBJECT_TOPLEVEL_ID_KEY) == 0)
+            same = g_hash_table_contains (reused_toplevel_ids,
+                                          g_variant_get_string (value, NULL));
+
+        g_variant_unref (current);
+        g_variant_unref (value);
+
+        if (!same)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void
+panel_layout_change_in_place (GKeyFile              *keyfile,
+                              PanelLayoutEntry      *entry,
+                              PanelGSettingsKeyType  type,
+                              int                    set_screen_to)
+{
+    GSettings *settings;
+    char      *path;
+
+    path = panel_layout_get_path (type, entry->id);
+
+    if (type == PANEL_GSETTINGS_TOPLEVELS) {
+        GSettings *background_settings;
+        char      *background_path;
+
+        settings = panel_profile_get_settings (PANEL_TOPLEVEL_SCHEMA, path);
+        panel_layout_write_group_keys (keyfile, entry->group, settings,
+                                       panel_layout_toplevel_keys,
+                                       G_N_ELEMENTS (panel_layout_toplevel_keys),
+                                       entry->id, TRUE,
+                                       PANEL_TOPLEVEL_SCREEN_KEY);
+        panel_layout_set_value (settings, PANEL_TOPLEVEL_SCREEN_KEY,
+                                g_variant_new_int32 (set_screen_to), TRUE);
+
+        /* the layouts do not set backgrounds */
+        background_path = g_strdup_printf ("%sbackground/", path);
+        background_settings = panel_profile_get_settings (PANEL_TOPLEVEL_BACKGROUND_SCHEMA,
+                                                          background_path);
+        panel_layout_reset_user_values (background_settings, NULL, NULL, NULL);
+        g_object_unref (background_settings);
+        g_free (background_path);
+    } else {
+        char *prefs_path;
+
+        settings = panel_profile_get_settings (PANEL_OBJECT_SCHEMA, path);
+        panel_layout_write_group_keys (keyfile, entry->group, settings,
+                                       panel_layout_object_keys,
+                                       G_N_ELEMENTS (panel_layout_object_keys),
+                                       entry->id, TRUE, NULL);
+
+        /* the preferences of the applet go back to their defaults too,
+         * as when its directory was deleted; the applet is notified */
+        prefs_path = g_strdup_printf ("%sprefs/", path);
+        mate_dconf_recursive_reset (prefs_path, NULL);
+        g_free (prefs_path);
+    }
+
+    g_object_unref (settings);
+    g_free (path);
+}
+
+static void
+panel_layout_write_new (GKeyFile              *keyfile,
+                        PanelLayoutEntry      *entry,
+                        PanelGSettingsKeyType  type,
+                        int                    set_screen_to)
+{
+    GSettings *settings;
+    gboolean   new_id = FALSE;
+    gboolean   written;
+    char      *path;
+
+    if (!entry->id) {
+        entry->id = panel_profile_find_new_id (type);
+        new_id = TRUE;
+    }
+
+    path = panel_layout_get_path (type, entry->id);
+
+    /* what a previous profile left there */
+    if (!new_id)
+        mate_dconf_recursive_reset (path, NULL);
+
+    if (type == PANEL_GSETTINGS_TOPLEVELS) {
+        settings = panel_profile_get_settings (PANEL_TOPLEVEL_SCHEMA, path);
+        written = panel_layout_write_group_keys (keyfile, entry->group, settings,
+                                                 panel_layout_toplevel_keys,
+                                                 G_N_ELEMENTS (panel_layout_toplevel_keys),
+                                                 entry->id, FALSE, NULL);
+        if (written)
+            g_settings_set_int (settings, PANEL_TOPLEVEL_SCREEN_KEY, set_screen_to);
+    } else {
+        settings = panel_profile_get_settings (PANEL_OBJECT_SCHEMA, path);
+        written = panel_layout_write_group_keys (keyfile, entry->group, settings,
+                                                 panel_layout_object_keys,
+                                                 G_N_ELEMENTS (panel_layout_object_keys),
+                                                 entry->id, FALSE, NULL);
+    }
+
+    g_object_unref (settings);
+    g_free (path);
+
+    if (!written)
+        g_clear_pointer (&entry->id, g_free);
+
+    /* so that the next new id is another one */
+    if (new_id)
+        g_settings_sync ();
+}
+
+static void
+panel_layout_set_id_list (GSettings  *panel_settings,
+                          const char *key,
+                          GPtrArray  *entries,
+                          gboolean    reused_only)
+{
+    GPtrArray *ids;
+    guint      i;
+
+    ids = g_ptr_array_new ();
+
+    for (i = 0; i < entries->len; i++) {
+        PanelLayoutEntry *entry = g_ptr_array_index (entries, i);
+
+        if (entry->id && (entry->reused || !reused_only))
+            g_ptr_array_add (ids, entry->id);
+    }
+    g_ptr_array_add (ids, NULL);
+
+    g_settings_set_strv (panel_settings, key, (const gchar * const *) ids->pdata);
+    g_settings_sync ();
+
+    g_ptr_array_free (ids, TRUE);
+}
+
+static void
+panel_layout_collect_entries (GKeyFile   *keyfile,
+                              char      **groups,
+                              const char *group_prefix,
+                              int         set_screen_to,
+                              GPtrArray  *entries)
+{
+    GHashTable *ids;
+    int         i;
+
+    ids = g_hash_table_new (g_str_hash, g_str_equal);
+
+    for (i = 0; groups[i] != NULL; i++) {
+        PanelLayoutEntry *entry;
+        char             *id;
+
+        if (!panel_layout_is_group (groups[i], group_prefix))
+            continue;
+
+        if (!panel_layout_get_group_id (groups[i], group_prefix, set_screen_to, &id))
+            continue;
+
+        /* a second group with the same id gets a new one */
+        if (id && g_hash_table_contains (ids, id))
+            g_clear_pointer (&id, g_free);
+
+        entry = g_new0 (PanelLayoutEntry, 1);
+        entry->group = groups[i];
+        entry->id = id;
+        g_ptr_array_add (entries, entry);
+
+        if (id)
+            g_hash_table_add (ids, id);
+    }
+
+    g_hash_table_destroy (ids);
+}
+
+/**
+ * panel_layout_apply_in_place:
+ * @screen: the screen of the panels
+ *
+ * Replaces the profile by the default layout, keeping the toplevels and
+ * objects it has in common with the layout.
+ *
+ * Returns: %FALSE if the layout could not be read, in which case the
+ * profile is not changed.
+ */
+gboolean
+panel_layout_apply_in_place (GdkScreen *screen)
+{
+    int          screen_n;
+    gchar       *layout_file;
+    GKeyFile    *keyfile;
+    gchar      **groups;
+    GError      *error = NULL;
+    GSettings   *panel_settings;
+    char       **current_toplevel_ids;
+    char       **current_object_ids;
+    GHashTable  *current_toplevels;
+    GHashTable  *current_objects;
+    GHashTable  *reused_toplevels;
+    GPtrArray   *toplevels;
+    GPtrArray   *objects;
+    guint        i;
+
+    screen_n = 0;
+#ifdef HAVE_X11
+    if (screen && GDK_IS_X11_SCREEN (screen))
+        screen_n = gdk_x11_screen_get_screen_number (screen);
+#endif /* HAVE_X11 */
+
+    layout_file = panel_layout_filename ();
+    if (!layout_file)
+        return FALSE;
+
+    keyfile = g_key_file_new ();
+    if (!g_key_file_load_from_file (keyfile, layout_file, G_KEY_FILE_NONE, &error)) {
+        g_warning ("Error while parsing default layout from '%s': %s\n",
+                   layout_file, error->message);
+        g_error_free (error);
+        g_key_file_free (keyfile);
+        g_free (layout_file);
+        return FALSE;
+    }
+    g_free (layout_file);
+
+    groups = g_key_file_get_groups (keyfile, NULL);
+
+    for (i = 0; groups[i] != NULL; i++) {
+        if (!panel_layout_is_group (groups[i], "Toplevel") &&
+            !panel_layout_is_group (groups[i], "Object"))
+            g_warning ("Unknown group in default layout: '%s'", groups[i]);
+    }
+
+    toplevels = g_ptr_array_new_with_free_func ((GDestroyNotify) panel_layout_entry_free);
+    objects = g_ptr_array_new_with_free_func ((GDestroyNotify) panel_layout_entry_free);
+
+    panel_layout_collect_entries (keyfile, groups, "Toplevel", screen_n, toplevels);
+    panel_layout_collect_entries (keyfile, groups, "Object", -1, objects);
+
+    if (toplevels->len == 0) {
+        g_ptr_array_free (objects, TRUE);
+        g_ptr_array_free (toplevels, TRUE);
+        g_strfreev (groups);
+        g_key_file_free (keyfile);
+        return FALSE;
+    }
+
+    panel_settings = g_settings_new (PANEL_SCHEMA);
+    current_toplevel_ids = g_settings_get_strv (panel_settings, PANEL_TOPLEVEL_ID_LIST_KEY);
+    current_object_ids = g_settings_get_strv (panel_settings, PANEL_OBJECT_ID_LIST_KEY);
+    current_toplevels = panel_layout_strv_to_set (current_toplevel_ids);
+    current_objects = panel_layout_strv_to_set (current_object_ids);
+    reused_toplevels = g_hash_table_new (g_str_hash, g_str_equal);
+
+    /* a toplevel can be changed in place as a whole */
+    for (i = 0; i < toplevels->len; i++) {
+        PanelLayoutEntry *entry = g_ptr_array_index (toplevels, i);
+
+        entry->reused = entry->id &&
+                        g_hash_table_contains (current_toplevels, entry->id);
+        if (entry->reused)
+            g_hash_table_add (reused_toplevels, entry->id);
+    }
+
+    for (i = 0; i < objects->len; i++) {
+        PanelLayoutEntry *entry = g_ptr_array_index (objects, i);
+        GSettings        *settings;
+        char             *path;
+
+        if (!entry->id || !g_hash_table_contains (current_objects, entry->id))
+            continue;
+
+        path = panel_layout_get_path (PANEL_GSETTINGS_OBJECTS, entry->id);
+        settings = panel_profile_get_settings (PANEL_OBJECT_SCHEMA, path);
+        entry->reused = panel_layout_object_is_same (keyfile, entry->group,
+                                                     settings, reused_toplevels);
+        g_object_unref (settings);
+        g_free (path);
+
+        /* the directory of the object it replaces is going away */
+        if (!entry->reused)
+            g_clear_pointer (&entry->id, g_free);
+    }
+
+    for (i = 0; i < toplevels->len; i++) {
+        PanelLayoutEntry *entry = g_ptr_array_index (toplevels, i);
+        entry->needs_id = !entry->id;
+    }
+    for (i = 0; i < objects->len; i++) {
+        PanelLayoutEntry *entry = g_ptr_array_index (objects, i);
+        entry->needs_id = !entry->id;
+    }
+
+    /* 1. the objects that are not kept go away */
+    panel_layout_set_id_list (panel_settings, PANEL_OBJECT_ID_LIST_KEY, objects, TRUE);
+
+    /* 2. the ones that are kept are changed in place */
+    for (i = 0; i < toplevels->len; i++) {
+        PanelLayoutEntry *entry = g_ptr_array_index (toplevels, i);
+
+        if (entry->reused)
+            panel_layout_change_in_place (keyfile, entry,
+                                          PANEL_GSETTINGS_TOPLEVELS, screen_n);
+    }
+    for (i = 0; i < objects->len; i++) {
+        PanelLayoutEntry *entry = g_ptr_array_index (objects, i);
+
+        if (entry->reused)
+            panel_layout_change_in_place (keyfile, entry,
+                                          PANEL_GSETTINGS_OBJECTS, -1);
+    }
+
+    /* 3. the new ones are written, the ones with an id of their own first,
+     * so that the new ids do not take theirs */
+    for (i = 0; i < toplevels->len; i++) {
+        PanelLayoutEntry *entry = g_ptr_array_index (toplevels, i);
+
+        if (!entry->reused && !entry->needs_id)
+            panel_layout_write_new (keyfile, entry,
+                                    PANEL_GSETTINGS_TOPLEVELS, screen_n);
+    }
+    for (i = 0; i < objects->len; i++) {
+        PanelLayoutEntry *entry = g_ptr_array_index (objects, i);
+
+        if (!entry->reused && !entry->needs_id)
+            panel_layout_write_new (keyfile, entry,
+                                    PANEL_GSETTINGS_OBJECTS, -1);
+    }
+    g_settings_sync ();
+
+    for (i = 0; i < toplevels->len; i++) {
+        PanelLayoutEntry *entry = g_ptr_array_index (toplevels, i);
+
+        if (entry->needs_id)
+            panel_layout_write_new (keyfile, entry,
+                                    PANEL_GSETTINGS_TOPLEVELS, screen_n);
+    }
+    for (i = 0; i < objects->len; i++) {
+        PanelLayoutEntry *entry = g_ptr_array_index (objects, i);
+
+        if (entry->needs_id)
+            panel_layout_write_new (keyfile, entry,
+                                    PANEL_GSETTINGS_OBJECTS, -1);
+    }
+
+    /* 4. the toplevels are replaced, then the objects are put on them */
+    panel_layout_set_id_list (panel_settings, PANEL_TOPLEVEL_ID_LIST_KEY, toplevels, FALSE);
+    panel_layout_set_id_list (panel_settings, PANEL_OBJECT_ID_LIST_KEY, objects, FALSE);
+
+    g_hash_table_destroy (reused_toplevels);
+    g_hash_table_destroy (current_objects);
+    g_hash_table_destroy (current_toplevels);
+    g_strfreev (current_object_ids);
+    g_strfreev (current_toplevel_ids);
+    g_object_unref (panel_settings);
+    g_ptr_array_free (objects, TRUE);
+    g_ptr_array_free (toplevels, TRUE);
+    g_strfreev (groups);
+    g_key_file_free (keyfile);
+
+    return TRUE;
+}
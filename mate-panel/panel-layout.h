@@ -33,6 +33,7 @@
 G_BEGIN_DECLS
 
 void        panel_layout_apply_default_from_gkeyfile (GdkScreen *screen);
+gboolean    panel_layout_apply_in_place              (GdkScreen *screen);
 
 G_END_DECLS
 
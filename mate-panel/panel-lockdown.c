@@ -27,7 +27,6 @@
 
 #include "panel-lockdown.h"
 
-#include <string.h>
 #include <gio/gio.h>
 #include "panel-schemas.h"
 
@@ -40,7 +39,9 @@ typedef struct {
         guint   disable_log_out : 1;
         guint   disable_force_quit : 1;
 
-        gchar **disabled_applets;
+        /* set of the disabled IIDs: never changed once built, only
+         * replaced when the key changes */
+        GHashTable *disabled_applets;
 
         GSList *closures;
 
@@ -104,13 +105,37 @@ disable_force_quit_notify (GSettings     *settings,
         panel_lockdown_invoke_closures (lockdown);
 }
 
+static GHashTable *
+panel_lockdown_build_disabled_applets (GSettings  *settings,
+                                       const char *key)
+{
+        GHashTable  *retval;
+        gchar      **iids;
+
+        iids = g_settings_get_strv (settings, key);
+
+        retval = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+        for (gint i = 0; iids[i]; i++)
+                g_hash_table_add (retval, iids[i]);
+
+        /* the strings now belong to the set */
+        g_free (iids);
+
+        return retval;
+}
+
 static void
 disabled_applets_notify (GSettings     *settings,
                          gchar         *key,
                          PanelLockdown *lockdown)
 {
-        g_strfreev (lockdown->disabled_applets);
-        lockdown->disabled_applets = g_settings_get_strv (settings, key);
+        GHashTable *old_disabled_applets;
+
+        old_disabled_applets = lockdown->disabled_applets;
+        lockdown->disabled_applets =
+                panel_lockdown_build_disabled_applets (settings, key);
+        g_hash_table_destroy (old_disabled_applets);
+
         panel_lockdown_invoke_closures (lockdown);
 }
 
@@ -137,14 +162,14 @@ panel_lockdown_load_bool (PanelLockdown         *lockdown,
         return retval;
 }
 
-static gchar **
+static GHashTable *
 panel_lockdown_load_disabled_applets (PanelLockdown *lockdown,
                                       GSettings     *settings)
 {
-        gchar **retval;
+        GHashTable *retval;
 
-        retval = g_settings_get_strv (settings,
-                                      PANEL_DISABLED_APPLETS_KEY);
+        retval = panel_lockdown_build_disabled_applets (settings,
+                                                        PANEL_DISABLED_APPLETS_KEY);
 
         g_signal_connect (settings,
                           "changed::" PANEL_DISABLED_APPLETS_KEY,
@@ -205,7 +230,7 @@ panel_lockdown_finalize (void)
         g_assert (panel_lockdown.initialized != FALSE);
 
         if (panel_lockdown.disabled_applets) {
-                g_strfreev (panel_lockdown.disabled_applets);
+                g_hash_table_destroy (panel_lockdown.disabled_applets);
                 panel_lockdown.disabled_applets = NULL;
         }
 
@@ -271,12 +296,7 @@ panel_lockdown_is_applet_disabled (const char *iid)
 {
         g_assert (panel_lockdown.initialized != FALSE);
 
-        if (panel_lockdown.disabled_applets)
-                for (gint i = 0; panel_lockdown.disabled_applets[i]; i++)
-                        if (!strcmp (panel_lockdown.disabled_applets[i], iid))
-                                return TRUE;
-
-        return FALSE;
+        return g_hash_table_contains (panel_lockdown.disabled_applets, iid);
 }
 
 static GClosure *
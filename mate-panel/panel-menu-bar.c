@@ -64,8 +64,17 @@ struct _PanelMenuBarPrivate {
 	GSettings* settings;
 
 	PanelOrientation orientation;
+
+	GtkWidget* prefetch_item;
+	guint prefetch_id;
+	double last_x;
+	double last_y;
+	guint32 last_time;
 };
 
+/* how far ahead of the pointer the prefetched item is looked for */
+#define PANEL_MENU_BAR_PREFETCH_LOOKAHEAD 150 /* ms */
+
 enum {
 	PROP_0,
 	PROP_ORIENTATION,
@@ -111,6 +120,118 @@ static void panel_menu_bar_setup_tooltip(PanelMenuBar* menubar)
 	g_signal_connect(menubar, "deactivate", G_CALLBACK (panel_menu_bar_reinit_tooltip), menubar);
 }
 
+static gboolean panel_menu_bar_prefetch_idle(PanelMenuBar* menubar)
+{
+	GtkWidget* item = menubar->priv->prefetch_item;
+	GtkWidget* submenu;
+
+	menubar->priv->prefetch_id = 0;
+	menubar->priv->prefetch_item = NULL;
+
+	if (item == menubar->priv->places_item)
+	{
+		panel_place_menu_item_prefetch(item);
+	}
+	else
+	{
+		submenu = gtk_menu_item_get_submenu(GTK_MENU_ITEM(item));
+		if (submenu)
+			panel_menu_prefetch(submenu);
+	}
+
+	return FALSE;
+}
+
+static GtkWidget* panel_menu_bar_item_at(PanelMenuBar* menubar, double x_root, double y_root)
+{
+	GtkWidget* items[3];
+	guint i;
+
+	items[0] = menubar->priv->applications_item;
+	items[1] = menubar->priv->places_item;
+	items[2] = menubar->priv->desktop_item;
+
+	for (i = 0; i < G_N_ELEMENTS(items); i++)
+	{
+		GtkAllocation allocation;
+		int x, y;
+
+		if (!gtk_widget_get_visible(items[i]) || !gtk_widget_get_realized(items[i]))
+			continue;
+
+		/* the items do not have a window of their own */
+		gdk_window_get_origin(gtk_widget_get_window(items[i]), &x, &y);
+		gtk_widget_get_allocation(items[i], &allocation);
+		x += allocation.x;
+		y += allocation.y;
+
+		if (x_root >= x && x_root < x + allocation.width &&
+		    y_root >= y && y_root < y + allocation.height)
+			return items[i];
+	}
+
+	return NULL;
+}
+
+/* Builds the menu the pointer is heading to while it moves over the menu
+ * bar: the menus are neither built at startup nor on their first opening.
+ * The pointer position is extrapolated a little from its last moves. */
+static void panel_menu_bar_queue_prefetch(PanelMenuBar* menubar, double x_root, double y_root, guint32 time)
+{
+	GtkWidget* item = NULL;
+
+	if (menubar->priv->last_time && time > menubar->priv->last_time)
+	{
+		double factor = (double) PANEL_MENU_BAR_PREFETCH_LOOKAHEAD / (time - menubar->priv->last_time);
+
+		item = panel_menu_bar_item_at(menubar,
+					      x_root + (x_root - menubar->priv->last_x) * factor,
+					      y_root + (y_root - menubar->priv->last_y) * factor);
+	}
+
+	if (!item)
+		item = panel_menu_bar_item_at(menubar, x_root, y_root);
+
+	menubar->priv->last_x = x_root;
+	menubar->priv->last_y = y_root;
+	menubar->priv->last_time = time;
+
+	if (!item || item == menubar->priv->prefetch_item)
+		return;
+
+	menubar->priv->prefetch_item = item;
+	if (!menubar->priv->prefetch_id)
+		menubar->priv->prefetch_id = g_idle_add_full(G_PRIORITY_LOW, (GSourceFunc) panel_menu_bar_prefetch_idle, menubar, NULL);
+}
+
+static gboolean panel_menu_bar_motion_notify(GtkWidget* widget, GdkEventMotion* event, PanelMenuBar* menubar)
+{
+	panel_menu_bar_queue_prefetch(menubar, event->x_root, event->y_root, event->time);
+
+	return FALSE;
+}
+
+static gboolean panel_menu_bar_enter_notify(GtkWidget* widget, GdkEventCrossing* event, PanelMenuBar* menubar)
+{
+	menubar->priv->last_time = 0;
+	panel_menu_bar_queue_prefetch(menubar, event->x_root, event->y_root, event->time);
+
+	return FALSE;
+}
+
+static gboolean panel_menu_bar_leave_notify(GtkWidget* widget, GdkEventCrossing* event, PanelMenuBar* menubar)
+{
+	/* the pointer went elsewhere */
+	if (event->detail != GDK_NOTIFY_INFERIOR && menubar->priv->prefetch_id)
+	{
+		g_source_remove(menubar->priv->prefetch_id);
+		menubar->priv->prefetch_id = 0;
+		menubar->priv->prefetch_item = NULL;
+	}
+
+	return FALSE;
+}
+
 static void
 panel_menu_bar_update_visibility (GSettings    *settings,
                                   gchar        *key,
@@ -187,6 +308,11 @@ static void panel_menu_bar_init(PanelMenuBar* menubar)
 
 	panel_menu_bar_update_text_gravity(menubar);
 	g_signal_connect(menubar, "screen-changed", G_CALLBACK(panel_menu_bar_update_text_gravity), NULL);
+
+	gtk_widget_add_events(GTK_WIDGET(menubar), GDK_POINTER_MOTION_MASK | GDK_ENTER_NOTIFY_MASK | GDK_LEAVE_NOTIFY_MASK);
+	g_signal_connect(menubar, "motion-notify-event", G_CALLBACK(panel_menu_bar_motion_notify), menubar);
+	g_signal_connect(menubar, "enter-notify-event", G_CALLBACK(panel_menu_bar_enter_notify), menubar);
+	g_signal_connect(menubar, "leave-notify-event", G_CALLBACK(panel_menu_bar_leave_notify), menubar);
 }
 
 static void panel_menu_bar_get_property(GObject* object, guint prop_id, GValue* value, GParamSpec* pspec)
@@ -289,6 +415,12 @@ static void panel_menu_bar_finalize (GObject* object)
 
 	menubar = PANEL_MENU_BAR (object);
 
+	if (menubar->priv->prefetch_id != 0)
+	{
+		g_source_remove (menubar->priv->prefetch_id);
+		menubar->priv->prefetch_id = 0;
+	}
+
 	if (menubar->priv->settings != NULL)
 	{
 		g_object_unref (menubar->priv->settings);
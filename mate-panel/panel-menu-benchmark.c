@@ -0,0 +1,467 @@
+/*
+ * panel-menu-benchmark.c: measure the construction of the menus
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/* mate-panel --benchmark-menus=CATEGORIESxENTRIES writes a synthetic menu
+ * tree with that many categories and entries per category in a temporary
+ * directory, and goes through the code the panel uses for its own menus:
+ * the tree is loaded like the one of a menu bar, then every submenu is
+ * built, a Places menu is created and the applications menu pops up.
+ *
+ * The results are printed as one line of key=value pairs so that they can
+ * easily be parsed by scripts. All times are in microseconds; a value of -1
+ * means that the event did not happen before the benchmark gave up. The
+ * menu has to pop up on a real display: in automated runs, use a virtual
+ * X server such as Xvfb. */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+
+#include "menu.h"
+#include "panel-menu-items.h"
+#include "panel-menu-benchmark.h"
+
+#define BENCHMARK_TIMEOUT 30 /* seconds */
+
+static const char *benchmark_icons [] = {
+	"accessories-text-editor",
+	"applications-games",
+	"applications-graphics",
+	"applications-multimedia",
+	"preferences-desktop",
+	"system-file-manager",
+	"utilities-terminal",
+	"web-browser"
+};
+
+typedef struct {
+	guint          n_categories;
+	guint          n_entries;
+	char          *dir;
+
+	GtkWidget     *menu;
+	GtkWidget     *menubar;
+	GtkWidget     *window;
+	GdkFrameClock *frame_clock;
+	gulong         after_paint_id;
+	guint          timeout_id;
+	guint          n_items;
+
+	gint64         start;
+	gint64         tree_loaded;
+	gint64         build_start;
+	gint64         build_end;
+	gint64         places_end;
+	gint64         popup_start;
+	gint64         popup_end;
+	gint64         mapped;
+	gint64         first_draw;
+	gint64         first_frame;
+
+	int            status;
+} MenuBenchmark;
+
+static MenuBenchmark benchmark;
+
+static glong
+benchmark_get_rss (void)
+{
+	char  *contents;
+	glong  size, resident;
+	glong  rss = -1;
+
+	if (!g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL))
+		return -1;
+
+	if (sscanf (contents, "%ld %ld", &size, &resident) == 2)
+		rss = resident * (sysconf (_SC_PAGESIZE) / 1024);
+
+	g_free (contents);
+
+	return rss;
+}
+
+static gint64
+benchmark_delta (gint64 start,
+		 gint64 end)
+{
+	return start && end ? end - start : -1;
+}
+
+static void
+benchmark_finish (int status)
+{
+	if (benchmark.timeout_id) {
+		g_source_remove (benchmark.timeout_id);
+		benchmark.timeout_id = 0;
+	}
+
+	if (benchmark.after_paint_id) {
+		g_signal_handler_disconnect (benchmark.frame_clock,
+					     benchmark.after_paint_id);
+		benchmark.after_paint_id = 0;
+	}
+
+	benchmark.status = status;
+
+	gtk_main_quit ();
+}
+
+static gboolean
+benchmark_timeout (gpointer data)
+{
+	benchmark.timeout_id = 0;
+
+	g_printerr ("The menu benchmark did not finish in %d seconds\n",
+		    BENCHMARK_TIMEOUT);
+	benchmark_finish (1);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+benchmark_after_paint (GdkFrameClock *frame_clock,
+		       gpointer       data)
+{
+	benchmark.first_frame = g_get_monotonic_time ();
+	benchmark_finish (0);
+}
+
+static gboolean
+benchmark_menu_draw (GtkWidget *menu,
+		     cairo_t   *cr,
+		     gpointer   data)
+{
+	if (benchmark.first_draw)
+		return FALSE;
+
+	benchmark.first_draw = g_get_monotonic_time ();
+
+	/* the frame is complete once it has been painted */
+	benchmark.frame_clock = gtk_widget_get_frame_clock (menu);
+	if (benchmark.frame_clock)
+		benchmark.after_paint_id =
+			g_signal_connect (benchmark.frame_clock, "after-paint",
+					  G_CALLBACK (benchmark_after_paint), NULL);
+	else
+		benchmark_finish (0);
+
+	return FALSE;
+}
+
+static void
+benchmark_menu_map (GtkWidget *menu,
+		    gpointer   data)
+{
+	if (!benchmark.mapped)
+		benchmark.mapped = g_get_monotonic_time ();
+}
+
+static gboolean
+benchmark_build (gpointer data)
+{
+	GdkRectangle  rect = { 0, 0, 1, 1 };
+	GList        *children, *l;
+	GtkWidget    *item;
+
+	/* all the submenus, as if the user went through every category */
+	benchmark.build_start = g_get_monotonic_time ();
+
+	panel_menu_prefetch (benchmark.menu);
+
+	children = gtk_container_get_children (GTK_CONTAINER (benchmark.menu));
+	for (l = children; l; l = l->next) {
+		GtkWidget *submenu;
+		GList     *items;
+
+		benchmark.n_items++;
+
+		if (!GTK_IS_MENU_ITEM (l->data))
+			continue;
+
+		submenu = gtk_menu_item_get_submenu (GTK_MENU_ITEM (l->data));
+		if (!submenu)
+			continue;
+
+		panel_menu_prefetch (submenu);
+
+		items = gtk_container_get_children (GTK_CONTAINER (submenu));
+		benchmark.n_items += g_list_length (items);
+		g_list_free (items);
+	}
+	g_list_free (children);
+
+	benchmark.build_end = g_get_monotonic_time ();
+
+	benchmark.menubar = gtk_menu_bar_new ();
+	g_object_ref_sink (benchmark.menubar);
+	item = panel_place_menu_item_new (FALSE);
+	gtk_menu_shell_append (GTK_MENU_SHELL (benchmark.menubar), item);
+
+	benchmark.places_end = g_get_monotonic_time ();
+
+	benchmark.window = gtk_window_new (GTK_WINDOW_POPUP);
+	gtk_window_move (GTK_WINDOW (benchmark.window), 0, 0);
+	gtk_window_resize (GTK_WINDOW (benchmark.window), 1, 1);
+	gtk_widget_show (benchmark.window);
+
+	g_signal_connect (benchmark.menu, "map",
+			  G_CALLBACK (benchmark_menu_map), NULL);
+	g_signal_connect_after (benchmark.menu, "draw",
+				G_CALLBACK (benchmark_menu_draw), NULL);
+
+	benchmark.popup_start = g_get_monotonic_time ();
+	gtk_menu_popup_at_rect (GTK_MENU (benchmark.menu),
+				gtk_widget_get_window (benchmark.window),
+				&rect,
+				GDK_GRAVITY_SOUTH_WEST,
+				GDK_GRAVITY_NORTH_WEST,
+				NULL);
+	benchmark.popup_end = g_get_monotonic_time ();
+
+	if (!gtk_widget_get_visible (benchmark.menu)) {
+		g_printerr ("The menu could not pop up\n");
+		benchmark_finish (1);
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+benchmark_tree_loaded (GtkWidget *menu,
+		       gpointer   data)
+{
+	/* also called when the tree changes */
+	if (benchmark.tree_loaded)
+		return;
+
+	benchmark.tree_loaded = g_get_monotonic_time ();
+
+	/* let the menu code finish its own work with the new tree first */
+	g_idle_add (benchmark_build, NULL);
+}
+
+static gboolean
+benchmark_write_file (const char  *dir,
+		      const char  *basename,
+		      const char  *contents,
+		      GError     **error)
+{
+	char     *path;
+	gboolean  retval;
+
+	path = g_build_filename (dir, basename, NULL);
+	retval = g_file_set_contents (path, contents, -1, error);
+	g_free (path);
+
+	return retval;
+}
+
+static char *
+benchmark_write_tree (GError **error)
+{
+	GString  *menu;
+	char     *apps_dir;
+	char     *dirs_dir;
+	char     *menu_file = NULL;
+	guint     c, e;
+
+	benchmark.dir = g_dir_make_tmp ("mate-panel-menu-benchmark-XXXXXX", error);
+	if (!benchmark.dir)
+		return NULL;
+
+	apps_dir = g_build_filename (benchmark.dir, "applications", NULL);
+	dirs_dir = g_build_filename (benchmark.dir, "desktop-directories", NULL);
+	g_mkdir (apps_dir, 0700);
+	g_mkdir (dirs_dir, 0700);
+
+	menu = g_string_new ("<!DOCTYPE Menu PUBLIC \"-//freedesktop//DTD Menu 1.0//EN\"\n"
+			     " \"http://www.freedesktop.org/standards/menu-spec/menu-1.0.dtd\">\n"
+			     "<Menu>\n"
+			     "  <Name>Benchmark</Name>\n");
+	g_string_append_printf (menu,
+				"  <AppDir>%s</AppDir>\n"
+				"  <DirectoryDir>%s</DirectoryDir>\n",
+				apps_dir, dirs_dir);
+
+	for (c = 0; c < benchmark.n_categories; c++) {
+		char *basename;
+		char *contents;
+
+		basename = g_strdup_printf ("category-%u.directory", c);
+		contents = g_strdup_printf ("[Desktop Entry]\n"
+					    "Type=Directory\n"
+					    "Name=Category %u\n"
+					    "Icon=%s\n",
+					    c,
+					    benchmark_icons [c % G_N_ELEMENTS (benchmark_icons)]);
+		if (!benchmark_write_file (dirs_dir, basename, contents, error)) {
+			g_free (basename);
+			g_free (contents);
+			goto out;
+		}
+		g_free (contents);
+
+		g_string_append_printf (menu,
+					"  <Menu>\n"
+					"    <Name>Category %u</Name>\n"
+					"    <Directory>%s</Directory>\n"
+					"    <Include><Category>X-Benchmark-%u</Category></Include>\n"
+					"  </Menu>\n",
+					c, basename, c);
+		g_free (basename);
+
+		for (e = 0; e < benchmark.n_entries; e++) {
+			basename = g_strdup_printf ("benchmark-%u-%u.desktop", c, e);
+			contents = g_strdup_printf ("[Desktop Entry]\n"
+						    "Type=Application\n"
+						    "Name=Entry %u of category %u\n"
+						    "GenericName=Benchmark Application\n"
+						    "Comment=Synthetic entry of the menu benchmark\n"
+						    "Keywords=benchmark;synthetic;\n"
+						    "Exec=true\n"
+						    "Icon=%s\n"
+						    "Categories=X-Benchmark-%u;\n",
+						    e, c,
+						    benchmark_icons [(c + e) % G_N_ELEMENTS (benchmark_icons)],
+						    c);
+			if (!benchmark_write_file (apps_dir, basename, contents, error)) {
+				g_free (basename);
+				g_free (contents);
+				goto out;
+			}
+			g_free (basename);
+			g_free (contents);
+		}
+	}
+
+	g_string_append (menu, "</Menu>\n");
+
+	if (benchmark_write_file (benchmark.dir, "benchmark.menu", menu->str, error))
+		menu_file = g_build_filename (benchmark.dir, "benchmark.menu", NULL);
+
+ out:
+	g_string_free (menu, TRUE);
+	g_free (apps_dir);
+	g_free (dirs_dir);
+
+	return menu_file;
+}
+
+static void
+benchmark_remove_dir (const char *path)
+{
+	GDir       *dir;
+	const char *name;
+
+	dir = g_dir_open (path, 0, NULL);
+	if (dir) {
+		while ((name = g_dir_read_name (dir))) {
+			char *child;
+
+			child = g_build_filename (path, name, NULL);
+			if (g_file_test (child, G_FILE_TEST_IS_DIR))
+				benchmark_remove_dir (child);
+			else
+				g_unlink (child);
+			g_free (child);
+		}
+		g_dir_close (dir);
+	}
+
+	g_rmdir (path);
+}
+
+int
+panel_menu_benchmark_run (const char *spec)
+{
+	GError *error = NULL;
+	char   *menu_file;
+
+	if (sscanf (spec, "%ux%u", &benchmark.n_categories, &benchmark.n_entries) != 2 ||
+	    benchmark.n_categories == 0 || benchmark.n_entries == 0) {
+		g_printerr ("Invalid menu size '%s', expected CATEGORIESxENTRIES\n", spec);
+		return 1;
+	}
+
+	menu_file = benchmark_write_tree (&error);
+	if (!menu_file) {
+		g_printerr ("Cannot write the benchmark menu: %s\n", error->message);
+		g_error_free (error);
+		if (benchmark.dir)
+			benchmark_remove_dir (benchmark.dir);
+		g_free (benchmark.dir);
+		return 1;
+	}
+
+	benchmark.start = g_get_monotonic_time ();
+
+	benchmark.menu = create_applications_menu (menu_file, NULL, TRUE);
+	g_object_ref_sink (benchmark.menu);
+	g_object_set_data (G_OBJECT (benchmark.menu),
+			   "panel-menu-tree-loaded-callback",
+			   benchmark_tree_loaded);
+
+	benchmark.timeout_id = g_timeout_add_seconds (BENCHMARK_TIMEOUT,
+						      benchmark_timeout, NULL);
+
+	gtk_main ();
+
+	g_print ("menus categories=%u entries=%u items=%u"
+		 " tree_load_us=%" G_GINT64_FORMAT
+		 " build_us=%" G_GINT64_FORMAT
+		 " places_us=%" G_GINT64_FORMAT
+		 " popup_us=%" G_GINT64_FORMAT
+		 " map_us=%" G_GINT64_FORMAT
+		 " first_draw_us=%" G_GINT64_FORMAT
+		 " first_frame_us=%" G_GINT64_FORMAT
+		 " rss_kb=%ld\n",
+		 benchmark.n_categories, benchmark.n_entries, benchmark.n_items,
+		 benchmark_delta (benchmark.start, benchmark.tree_loaded),
+		 benchmark_delta (benchmark.build_start, benchmark.build_end),
+		 benchmark_delta (benchmark.build_end, benchmark.places_end),
+		 benchmark_delta (benchmark.popup_start, benchmark.popup_end),
+		 benchmark_delta (benchmark.popup_start, benchmark.mapped),
+		 benchmark_delta (benchmark.popup_start, benchmark.first_draw),
+		 benchmark_delta (benchmark.popup_start, benchmark.first_frame),
+		 benchmark_get_rss ());
+
+	gtk_widget_destroy (benchmark.menu);
+	g_object_unref (benchmark.menu);
+	if (benchmark.menubar) {
+		gtk_widget_destroy (benchmark.menubar);
+		g_object_unref (benchmark.menubar);
+	}
+	if (benchmark.window)
+		gtk_widget_destroy (benchmark.window);
+
+	benchmark_remove_dir (benchmark.dir);
+	g_free (benchmark.dir);
+	g_free (menu_file);
+
+	return benchmark.status;
+}
@@ -387,6 +387,13 @@ panel_menu_button_menu_detacher (GtkWidget *attach_widget,
 	button->priv->menu = NULL;
 }
 
+static void
+panel_menu_button_menu_tree_loaded (GtkWidget       *menu,
+				    PanelMenuButton *button)
+{
+	panel_menu_button_set_icon (button);
+}
+
 static GtkWidget *
 panel_menu_button_create_menu (PanelMenuButton *button)
 {
@@ -409,6 +416,15 @@ panel_menu_button_create_menu (PanelMenuButton *button)
 		button->priv->menu = create_applications_menu (filename,
 							       button->priv->menu_path,
 							       TRUE);
+
+		/* the icon comes from the menu tree, which is loaded
+		 * asynchronously */
+		g_object_set_data (G_OBJECT (button->priv->menu),
+				   "panel-menu-tree-loaded-callback",
+				   panel_menu_button_menu_tree_loaded);
+		g_object_set_data (G_OBJECT (button->priv->menu),
+				   "panel-menu-tree-loaded-callback-data",
+				   button);
 	} else
 		button->priv->menu = create_main_menu (panel_widget);
 
@@ -425,6 +441,15 @@ panel_menu_button_create_menu (PanelMenuButton *button)
 	return button->priv->menu;
 }
 
+/* The menu, if it was already built: it is not built just to look at it */
+GtkWidget *
+panel_menu_button_peek_menu (PanelMenuButton *button)
+{
+	g_return_val_if_fail (PANEL_IS_MENU_BUTTON (button), NULL);
+
+	return button->priv->menu;
+}
+
 static void
 panel_menu_button_recreate_menu (PanelMenuButton *button)
 {
@@ -638,7 +663,7 @@ panel_menu_button_connect_to_gsettings (PanelMenuButton *button)
 {
 	gchar *path;
 	path = g_strdup_printf (PANEL_OBJECT_PATH "%s/", button->priv->applet_id);
-	button->priv->settings = g_settings_new_with_path (PANEL_OBJECT_SCHEMA, path);
+	button->priv->settings = panel_profile_get_settings (PANEL_OBJECT_SCHEMA, path);
 	g_signal_connect (button->priv->settings,
 					  "changed",
 					  G_CALLBACK (panel_menu_button_gsettings_notify),
@@ -928,7 +953,7 @@ panel_menu_button_load_from_gsettings (PanelWidget *panel,
 	gboolean     has_arrow;
 
 	path = g_strdup_printf (PANEL_OBJECT_PATH "%s/", id);
-	settings = g_settings_new_with_path (PANEL_OBJECT_SCHEMA, path);
+	settings = panel_profile_get_settings (PANEL_OBJECT_SCHEMA, path);
 
 	menu_path = g_settings_get_string (settings, PANEL_OBJECT_MENU_PATH_KEY);
 	custom_icon = g_settings_get_string (settings, PANEL_OBJECT_CUSTOM_ICON_KEY);
@@ -972,7 +997,7 @@ panel_menu_button_create (PanelToplevel *toplevel,
 	id = panel_profile_prepare_object (PANEL_OBJECT_MENU, toplevel, position, FALSE);
 
 	path = g_strdup_printf (PANEL_OBJECT_PATH "%s/", id);
-	settings = g_settings_new_with_path (PANEL_OBJECT_SCHEMA, path);
+	settings = panel_profile_get_settings (PANEL_OBJECT_SCHEMA, path);
 
 	g_settings_set_boolean (settings, PANEL_OBJECT_USE_MENU_PATH_KEY, use_menu_path);
 
@@ -1216,7 +1241,8 @@ panel_menu_button_get_accessible (GtkWidget *widget)
 
 	g_return_val_if_fail (widget != NULL, NULL);
 
-	if (first_time && panel_a11y_get_is_a11y_enabled (widget))
+	/* only asked for once something uses the accessibles */
+	if (first_time)
 		atk_registry_set_factory_type (atk_get_default_registry (),
 					       PANEL_TYPE_MENU_BUTTON,
 					       panel_menu_button_accessible_factory_get_type ());
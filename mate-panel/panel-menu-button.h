@@ -93,6 +93,8 @@ void       panel_menu_button_popup_menu          (PanelMenuButton  *button,
 void       panel_menu_button_set_dnd_enabled     (PanelMenuButton  *button,
 						  gboolean          dnd_enabled);
 
+GtkWidget *panel_menu_button_peek_menu           (PanelMenuButton  *button);
+
 #ifdef __cplusplus
 }
 #endif
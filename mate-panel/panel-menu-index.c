@@ -0,0 +1,495 @@
+/*
+ * panel-menu-index.c: search index of the entries of a menu tree
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/* Typing in the applications menu searches its entries. Every entry of the
+ * tree is indexed once, right after the tree is loaded: the words of its
+ * name, generic name, keywords and executable are casefolded and kept in
+ * a sorted array, so that the first word of a query is looked up by binary
+ * search; the other words only have to be found in the few entries that
+ * matched the first one.
+ *
+ * An index does not change once built and can be built in any thread. */
+
+#include <config.h>
+
+#include <string.h>
+
+#include <glib.h>
+#include <gio/gdesktopappinfo.h>
+#include <matemenu-tree.h>
+
+#include "panel-menu-index.h"
+
+typedef struct {
+	MateMenuTreeEntry *entry;
+	char              *name;     /* casefolded */
+	char              *haystack; /* all the casefolded fields */
+} PanelMenuIndexEntry;
+
+typedef struct {
+	const char *word;
+	guint       entry;
+} PanelMenuIndexWord;
+
+typedef struct {
+	guint score;
+	guint entry;
+} PanelMenuIndexMatch;
+
+struct _PanelMenuIndex {
+	gint          ref_count;
+
+	GArray       *entries; /* sorted by name */
+	GArray       *words;   /* sorted by word */
+	GStringChunk *strings;
+};
+
+static char *
+panel_menu_index_fold (const char *str)
+{
+	char *normalized;
+	char *folded;
+
+	normalized = g_utf8_normalize (str, -1, G_NORMALIZE_ALL);
+	if (!normalized)
+		return NULL;
+
+	folded = g_utf8_casefold (normalized, -1);
+	g_free (normalized);
+
+	return folded;
+}
+
+/* Calls func on each word of a casefolded string; the words are the runs
+ * of letters and digits. */
+static void
+panel_menu_index_foreach_word (const char *str,
+			       void      (*func) (const char *word,
+						  gsize       len,
+						  gpointer    data),
+			       gpointer    data)
+{
+	const char *start = NULL;
+	const char *p;
+
+	for (p = str; *p; p = g_utf8_next_char (p)) {
+		if (g_unichar_isalnum (g_utf8_get_char (p))) {
+			if (!start)
+				start = p;
+		} else if (start) {
+			func (start, p - start, data);
+			start = NULL;
+		}
+	}
+
+	if (start)
+		func (start, p - start, data);
+}
+
+typedef struct {
+	PanelMenuIndex *index;
+	guint           entry;
+	GHashTable     *seen;
+} PanelMenuIndexAddData;
+
+static void
+panel_menu_index_add_word (const char *word,
+			   gsize       len,
+			   gpointer    user_data)
+{
+	PanelMenuIndexAddData *data = user_data;
+	PanelMenuIndexWord     index_word;
+	char                  *str;
+
+	str = g_strndup (word, len);
+
+	if (!g_hash_table_contains (data->seen, str)) {
+		index_word.word = g_string_chunk_insert_const (data->index->strings, str);
+		index_word.entry = data->entry;
+		g_array_append_val (data->index->words, index_word);
+
+		g_hash_table_add (data->seen, (gpointer) index_word.word);
+	}
+
+	g_free (str);
+}
+
+static void
+panel_menu_index_collect (GHashTable            *seen_ids,
+			  GPtrArray             *entries,
+			  MateMenuTreeDirectory *directory)
+{
+	MateMenuTreeIter     *iter;
+	MateMenuTreeItemType  type;
+
+	iter = matemenu_tree_directory_iter (directory);
+	while ((type = matemenu_tree_iter_next (iter)) != MATEMENU_TREE_ITEM_INVALID) {
+		gpointer    item = NULL;
+		const char *id;
+
+		switch (type) {
+		case MATEMENU_TREE_ITEM_DIRECTORY:
+			item = matemenu_tree_iter_get_directory (iter);
+			panel_menu_index_collect (seen_ids, entries, item);
+			matemenu_tree_item_unref (item);
+			item = NULL;
+			break;
+
+		case MATEMENU_TREE_ITEM_ENTRY:
+			item = matemenu_tree_iter_get_entry (iter);
+			break;
+
+		case MATEMENU_TREE_ITEM_ALIAS: {
+			MateMenuTreeAlias *alias;
+
+			alias = matemenu_tree_iter_get_alias (iter);
+			if (matemenu_tree_alias_get_aliased_item_type (alias) == MATEMENU_TREE_ITEM_ENTRY)
+				item = matemenu_tree_alias_get_aliased_entry (alias);
+			matemenu_tree_item_unref (alias);
+			break;
+		}
+
+		default:
+			break;
+		}
+
+		if (!item)
+			continue;
+
+		/* the same application can be in several directories */
+		id = matemenu_tree_entry_get_desktop_file_id (item);
+		if (id && g_hash_table_contains (seen_ids, id)) {
+			matemenu_tree_item_unref (item);
+			continue;
+		}
+
+		if (id)
+			g_hash_table_add (seen_ids, (gpointer) id);
+		g_ptr_array_add (entries, item);
+	}
+	matemenu_tree_iter_unref (iter);
+}
+
+static int
+compare_entries (gconstpointer a,
+		 gconstpointer b)
+{
+	return strcmp (((const PanelMenuIndexEntry *) a)->name,
+		       ((const PanelMenuIndexEntry *) b)->name);
+}
+
+static int
+compare_words (gconstpointer a,
+	       gconstpointer b)
+{
+	const PanelMenuIndexWord *wa = a;
+	const PanelMenuIndexWord *wb = b;
+	int                       cmp;
+
+	cmp = strcmp (wa->word, wb->word);
+	if (cmp != 0)
+		return cmp;
+
+	return wa->entry < wb->entry ? -1 : wa->entry > wb->entry;
+}
+
+static void
+panel_menu_index_add_field (GString    *haystack,
+			    const char *field)
+{
+	char *folded;
+
+	if (!field || !field[0])
+		return;
+
+	folded = panel_menu_index_fold (field);
+	if (!folded)
+		return;
+
+	if (haystack->len)
+		g_string_append_c (haystack, '\n');
+	g_string_append (haystack, folded);
+	g_free (folded);
+}
+
+PanelMenuIndex *
+panel_menu_index_new (MateMenuTree *tree)
+{
+	PanelMenuIndex        *index;
+	MateMenuTreeDirectory *root;
+	GHashTable            *seen_ids;
+	GPtrArray             *items;
+	guint                  i;
+
+	g_return_val_if_fail (MATEMENU_IS_TREE (tree), NULL);
+
+	index = g_new0 (PanelMenuIndex, 1);
+	index->ref_count = 1;
+	index->entries = g_array_new (FALSE, FALSE, sizeof (PanelMenuIndexEntry));
+	index->words = g_array_new (FALSE, FALSE, sizeof (PanelMenuIndexWord));
+	index->strings = g_string_chunk_new (4096);
+
+	items = g_ptr_array_new ();
+	seen_ids = g_hash_table_new (g_str_hash, g_str_equal);
+
+	root = matemenu_tree_get_root_directory (tree);
+	if (root) {
+		panel_menu_index_collect (seen_ids, items, root);
+		matemenu_tree_item_unref (root);
+	}
+
+	g_hash_table_destroy (seen_ids);
+
+	for (i = 0; i < items->len; i++) {
+		MateMenuTreeEntry   *entry = g_ptr_array_index (items, i);
+		GDesktopAppInfo     *info;
+		PanelMenuIndexEntry  index_entry;
+		GString             *haystack;
+		const char * const  *keywords;
+		const char          *executable;
+
+		info = matemenu_tree_entry_get_app_info (entry);
+		if (!info || !g_app_info_get_name (G_APP_INFO (info))) {
+			matemenu_tree_item_unref (entry);
+			continue;
+		}
+
+		haystack = g_string_new (NULL);
+		panel_menu_index_add_field (haystack,
+					    g_app_info_get_name (G_APP_INFO (info)));
+		panel_menu_index_add_field (haystack,
+					    g_desktop_app_info_get_generic_name (info));
+
+		keywords = g_desktop_app_info_get_keywords (info);
+		while (keywords && *keywords)
+			panel_menu_index_add_field (haystack, *keywords++);
+
+		executable = g_app_info_get_executable (G_APP_INFO (info));
+		if (executable) {
+			char *basename;
+
+			basename = g_path_get_basename (executable);
+			panel_menu_index_add_field (haystack, basename);
+			g_free (basename);
+		}
+
+		index_entry.entry = entry;
+		index_entry.name = panel_menu_index_fold (g_app_info_get_name (G_APP_INFO (info)));
+		index_entry.haystack = g_string_free (haystack, FALSE);
+
+		if (!index_entry.name)
+			index_entry.name = g_strdup ("");
+
+		g_array_append_val (index->entries, index_entry);
+	}
+
+	g_ptr_array_free (items, TRUE);
+
+	/* words point to entries by position: sort the entries first */
+	g_array_sort (index->entries, compare_entries);
+
+	for (i = 0; i < index->entries->len; i++) {
+		PanelMenuIndexEntry   *index_entry;
+		PanelMenuIndexAddData  data;
+
+		index_entry = &g_array_index (index->entries, PanelMenuIndexEntry, i);
+
+		data.index = index;
+		data.entry = i;
+		data.seen = g_hash_table_new (g_str_hash, g_str_equal);
+
+		panel_menu_index_foreach_word (index_entry->haystack,
+					       panel_menu_index_add_word,
+					       &data);
+
+		g_hash_table_destroy (data.seen);
+	}
+
+	g_array_sort (index->words, compare_words);
+
+	return index;
+}
+
+PanelMenuIndex *
+panel_menu_index_ref (PanelMenuIndex *index)
+{
+	g_return_val_if_fail (index != NULL, NULL);
+
+	g_atomic_int_inc (&index->ref_count);
+
+	return index;
+}
+
+void
+panel_menu_index_unref (PanelMenuIndex *index)
+{
+	guint i;
+
+	g_return_if_fail (index != NULL);
+
+	if (!g_atomic_int_dec_and_test (&index->ref_count))
+		return;
+
+	for (i = 0; i < index->entries->len; i++) {
+		PanelMenuIndexEntry *index_entry;
+
+		index_entry = &g_array_index (index->entries, PanelMenuIndexEntry, i);
+		matemenu_tree_item_unref (index_entry->entry);
+		g_free (index_entry->name);
+		g_free (index_entry->haystack);
+	}
+
+	g_array_free (index->entries, TRUE);
+	g_array_free (index->words, TRUE);
+	g_string_chunk_free (index->strings);
+	g_free (index);
+}
+
+static void
+panel_menu_index_split_word (const char *word,
+			     gsize       len,
+			     gpointer    data)
+{
+	g_ptr_array_add (data, g_strndup (word, len));
+}
+
+static int
+compare_matches (gconstpointer a,
+		 gconstpointer b)
+{
+	const PanelMenuIndexMatch *ma = a;
+	const PanelMenuIndexMatch *mb = b;
+
+	if (ma->score != mb->score)
+		return ma->score < mb->score ? -1 : 1;
+
+	return ma->entry < mb->entry ? -1 : ma->entry > mb->entry;
+}
+
+/* Returns the entries matching all the words of query, the ones whose
+ * name starts with the query first. The entries belong to the index, the
+ * list has to be freed with g_list_free(). */
+GList *
+panel_menu_index_search (PanelMenuIndex *index,
+			 const char     *query,
+			 guint           max_results)
+{
+	GPtrArray *words;
+	GArray    *matches;
+	GList     *retval = NULL;
+	char      *folded;
+	const char *first;
+	gsize      first_len;
+	guint8    *taken;
+	guint      low, high;
+	guint      i;
+
+	g_return_val_if_fail (index != NULL, NULL);
+	g_return_val_if_fail (query != NULL, NULL);
+
+	folded = panel_menu_index_fold (query);
+	if (!folded)
+		return NULL;
+
+	words = g_ptr_array_new_with_free_func (g_free);
+	panel_menu_index_foreach_word (folded, panel_menu_index_split_word, words);
+
+	if (words->len == 0) {
+		g_ptr_array_free (words, TRUE);
+		g_free (folded);
+		return NULL;
+	}
+
+	first = g_ptr_array_index (words, 0);
+	first_len = strlen (first);
+
+	/* lower bound of the first word */
+	low = 0;
+	high = index->words->len;
+	while (low < high) {
+		guint mid = low + (high - low) / 2;
+
+		if (strcmp (g_array_index (index->words, PanelMenuIndexWord, mid).word,
+			    first) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	matches = g_array_new (FALSE, FALSE, sizeof (PanelMenuIndexMatch));
+
+	/* an entry has one word per matching prefix, "fi" finds both
+	 * "file" and "firefox" words of the same entry */
+	taken = g_new0 (guint8, index->entries->len);
+
+	for (i = low; i < index->words->len; i++) {
+		PanelMenuIndexWord  *word;
+		PanelMenuIndexEntry *index_entry;
+		PanelMenuIndexMatch  match;
+		gboolean             found = TRUE;
+		guint                j;
+
+		word = &g_array_index (index->words, PanelMenuIndexWord, i);
+		if (strncmp (word->word, first, first_len) != 0)
+			break;
+
+		if (taken[word->entry])
+			continue;
+		taken[word->entry] = TRUE;
+
+		index_entry = &g_array_index (index->entries, PanelMenuIndexEntry, word->entry);
+
+		for (j = 1; j < words->len && found; j++)
+			found = strstr (index_entry->haystack,
+					g_ptr_array_index (words, j)) != NULL;
+		if (!found)
+			continue;
+
+		match.entry = word->entry;
+		if (g_str_has_prefix (index_entry->name, folded))
+			match.score = 0;
+		else if (g_str_has_prefix (index_entry->name, first))
+			match.score = 1;
+		else
+			match.score = 2;
+
+		g_array_append_val (matches, match);
+	}
+
+	g_array_sort (matches, compare_matches);
+
+	for (i = 0; i < matches->len && i < max_results; i++) {
+		PanelMenuIndexMatch *match;
+
+		match = &g_array_index (matches, PanelMenuIndexMatch, i);
+		retval = g_list_prepend (retval,
+					 g_array_index (index->entries,
+							PanelMenuIndexEntry,
+							match->entry).entry);
+	}
+
+	g_free (taken);
+	g_array_free (matches, TRUE);
+	g_ptr_array_free (words, TRUE);
+	g_free (folded);
+
+	return g_list_reverse (retval);
+}
@@ -0,0 +1,42 @@
+/*
+ * panel-menu-index.h: search index of the entries of a menu tree
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __PANEL_MENU_INDEX_H__
+#define __PANEL_MENU_INDEX_H__
+
+#include <glib.h>
+#include <matemenu-tree.h>
+
+G_BEGIN_DECLS
+
+typedef struct _PanelMenuIndex PanelMenuIndex;
+
+PanelMenuIndex *panel_menu_index_new    (MateMenuTree   *tree);
+PanelMenuIndex *panel_menu_index_ref    (PanelMenuIndex *index);
+void            panel_menu_index_unref  (PanelMenuIndex *index);
+
+GList          *panel_menu_index_search (PanelMenuIndex *index,
+					 const char     *query,
+					 guint           max_results);
+
+G_END_DECLS
+
+#endif /* __PANEL_MENU_INDEX_H__ */
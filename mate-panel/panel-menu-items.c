@@ -43,6 +43,7 @@
 #include <libmate-desktop/mate-gsettings.h>
 #include <libmate-desktop/mate-image-menu-item.h>
 
+#include <libpanel-util/panel-desktop-cache.h>
 #include <libpanel-util/panel-error.h>
 #include <libpanel-util/panel-glib.h>
 #include <libpanel-util/panel-keyfile.h>
@@ -62,6 +63,29 @@
 #define MAX_BOOKMARK_ITEMS      100
 #define N_MENU_ITEM_SIGNALS       9
 
+typedef enum {
+	PANEL_PLACES_SECTION_BOOKMARKS,
+	PANEL_PLACES_SECTION_LOCAL,
+	PANEL_PLACES_SECTION_REMOTE,
+	N_PANEL_PLACES_SECTIONS
+} PanelPlacesSectionType;
+
+#define PANEL_PLACES_SECTION_FLAG(type) (1 << (type))
+
+typedef struct {
+	char      *key;
+	char      *fingerprint;
+	GtkWidget *widget;
+} PanelPlacesEntry;
+
+/* The items of the places menu that follow the bookmarks file or the volume
+ * monitor, right after the anchor item or in a submenu there */
+typedef struct {
+	GtkWidget  *anchor;
+	GtkWidget  *submenu_item;
+	GHashTable *entries;
+} PanelPlacesSection;
+
 struct _PanelPlaceMenuItemPrivate {
 	GtkWidget   *menu;
 	PanelWidget *panel;
@@ -77,6 +101,10 @@ struct _PanelPlaceMenuItemPrivate {
 	GVolumeMonitor *volume_monitor;
 	gulong       signal_id [N_MENU_ITEM_SIGNALS];
 
+	PanelPlacesSection sections [N_PANEL_PLACES_SECTIONS];
+	guint        dirty_sections;
+	guint        update_id;
+
 	guint        use_image : 1;
 };
 
@@ -136,7 +164,6 @@ panel_menu_items_append_from_desktop (GtkWidget *menu,
                                       gboolean   use_icon)
 {
 	GKeyFile  *key_file;
-	gboolean   loaded;
 	GtkWidget *item;
 	char      *path_freeme;
 	char      *full_path;
@@ -149,14 +176,9 @@ panel_menu_items_append_from_desktop (GtkWidget *menu,
 
 	path_freeme = NULL;
 
-	key_file = g_key_file_new ();
-
 	if (g_path_is_absolute (path)) {
-		loaded = g_key_file_load_from_file (key_file, path,
-						    G_KEY_FILE_NONE, NULL);
 		full_path = path;
 	} else {
-		char *lookup_file;
 		char *desktop_path;
 
 		if (!g_str_has_suffix (path, ".desktop")) {
@@ -165,21 +187,18 @@ panel_menu_items_append_from_desktop (GtkWidget *menu,
 			desktop_path = path;
 		}
 
-		lookup_file = g_strconcat ("applications", G_DIR_SEPARATOR_S,
-					   desktop_path, NULL);
-		loaded = g_key_file_load_from_data_dirs (key_file, lookup_file,
-							 &path_freeme,
-							 G_KEY_FILE_NONE,
-							 NULL);
+		path_freeme = panel_g_lookup_in_applications_dirs (desktop_path);
 		full_path = path_freeme;
-		g_free (lookup_file);
 
 		if (desktop_path != path)
 			g_free (desktop_path);
+
+		if (!full_path)
+			return;
 	}
 
-	if (!loaded) {
-		g_key_file_free (key_file);
+	key_file = panel_desktop_cache_lookup (full_path, NULL);
+	if (!key_file) {
 		if (path_freeme)
 			g_free (path_freeme);
 		return;
@@ -188,7 +207,7 @@ panel_menu_items_append_from_desktop (GtkWidget *menu,
 	/* For Application desktop files, respect TryExec */
 	type = panel_key_file_get_string (key_file, "Type");
 	if (!type) {
-		g_key_file_free (key_file);
+		g_key_file_unref (key_file);
 		if (path_freeme)
 			g_free (path_freeme);
 		return;
@@ -209,7 +228,7 @@ panel_menu_items_append_from_desktop (GtkWidget *menu,
 				 * so that the menu items appears when the
 				 * program appears, but that's really complex
 				 * for not a huge benefit */
-				g_key_file_free (key_file);
+				g_key_file_unref (key_file);
 				if (path_freeme)
 					g_free (path_freeme);
 				return;
@@ -253,7 +272,7 @@ panel_menu_items_append_from_desktop (GtkWidget *menu,
 	setup_uri_drag (item, uri, icon, GDK_ACTION_COPY);
 	g_free (uri);
 
-	g_key_file_free (key_file);
+	g_key_file_unref (key_file);
 
 	if (icon)
 		g_free (icon);
@@ -268,7 +287,7 @@ panel_menu_items_append_from_desktop (GtkWidget *menu,
 		g_free (path_freeme);
 }
 
-static void
+static GtkWidget *
 panel_menu_items_append_place_item (const char *icon_name,
 				    GIcon      *gicon,
 				    const char *title,
@@ -300,6 +319,8 @@ panel_menu_items_append_place_item (const char *icon_name,
 
 	if (g_str_has_prefix (uri, "file:")) /*Links only work for local files*/
 		setup_uri_drag (item, uri, icon_name, GDK_ACTION_LINK);
+
+	return item;
 }
 
 static GtkWidget *
@@ -342,22 +363,158 @@ panel_menu_items_create_action_item (PanelActionButtonType action_type)
 							 NULL, NULL);
 }
 
+typedef enum {
+	PANEL_GIO_DRIVE,
+	PANEL_GIO_VOLUME,
+	PANEL_GIO_MOUNT,
+	PANEL_GIO_BOOKMARK
+} PanelGioItemType;
+
+typedef struct {
+	PanelGioItemType type;
+	union {
+		GDrive *drive;
+		GVolume *volume;
+		GMount *mount;
+		char *uri;
+	} u;
+
+	/* what the item shows, set by panel_gio_item_prepare() for the
+	 * volume monitor objects */
+	char  *label;
+	char  *icon;
+	GIcon *gicon;
+	char  *uri;        /* mounts only */
+	char  *tooltip;    /* bookmarks only */
+
+	char  *key;
+	char  *fingerprint;
+} PanelGioItem;
+
+static void
+panel_gio_item_free (PanelGioItem *item)
+{
+	switch (item->type) {
+	case PANEL_GIO_DRIVE:
+		g_object_unref (item->u.drive);
+		break;
+	case PANEL_GIO_VOLUME:
+		g_object_unref (item->u.volume);
+		break;
+	case PANEL_GIO_MOUNT:
+		g_object_unref (item->u.mount);
+		break;
+	case PANEL_GIO_BOOKMARK:
+		g_free (item->u.uri);
+		break;
+	default:
+		g_assert_not_reached ();
+	}
+
+	g_free (item->label);
+	g_free (item->icon);
+	g_clear_object (&item->gicon);
+	g_free (item->uri);
+	g_free (item->tooltip);
+	g_free (item->key);
+	g_free (item->fingerprint);
+	g_slice_free (PanelGioItem, item);
+}
+
+/* The bookmarks file is parsed once per change, and shared by all the
+ * places menus. What it takes to show a bookmark is cached per URI: finding
+ * it can mean talking to gvfs, so it is done in a thread for anything but
+ * local files, and the menus show a fallback until the result is in. */
+typedef struct {
+	char *uri;
+	char *label;
+} PanelBookmark;
+
+typedef struct {
+	char  *label;   /* NULL if only the file label was needed */
+	char  *icon;
+	char  *tooltip;
+
+	guint  resolving : 1;
+	guint  stale : 1; /* resolved again the next time it is used */
+} PanelBookmarkInfo;
+
+static GSList     *panel_bookmarks = NULL;
+static gboolean    panel_bookmarks_loaded = FALSE;
+static GHashTable *panel_bookmark_infos = NULL;
+static GSList     *panel_place_menu_items = NULL;
+
+static void
+panel_place_menu_item_queue_update (PanelPlaceMenuItem *place_item,
+				    guint               sections);
+
+static void
+panel_bookmark_free (PanelBookmark *bookmark)
+{
+	g_free (bookmark->uri);
+	g_free (bookmark->label);
+	g_slice_free (PanelBookmark, bookmark);
+}
+
+static void
+panel_bookmark_info_free (PanelBookmarkInfo *info)
+{
+	g_free (info->label);
+	g_free (info->icon);
+	g_free (info->tooltip);
+	g_slice_free (PanelBookmarkInfo, info);
+}
+
+static void
+panel_bookmark_info_mark_stale (gpointer key,
+				gpointer value,
+				gpointer user_data)
+{
+	PanelBookmarkInfo *info = value;
+
+	info->stale = TRUE;
+}
+
+static gboolean
+panel_bookmark_info_is_unused (gpointer key,
+			       gpointer value,
+			       gpointer user_data)
+{
+	PanelBookmarkInfo *info = value;
+	GHashTable        *uris = user_data;
+
+	return !info->resolving && !g_hash_table_contains (uris, key);
+}
+
+/* The labels of remote bookmarks come from their mount, if any */
 static void
-panel_place_menu_item_append_gtk_bookmarks (GtkWidget *menu, guint max_items_or_submenu)
+panel_bookmarks_invalidate_infos (void)
 {
-	typedef struct {
-		char *full_uri;
-		char *label;
-	} PanelBookmark;
+	if (panel_bookmark_infos)
+		g_hash_table_foreach (panel_bookmark_infos,
+				      panel_bookmark_info_mark_stale, NULL);
+}
 
-	GtkWidget   *add_menu;
+static void
+panel_bookmarks_invalidate (void)
+{
+	g_slist_free_full (panel_bookmarks, (GDestroyNotify) panel_bookmark_free);
+	panel_bookmarks = NULL;
+	panel_bookmarks_loaded = FALSE;
+
+	panel_bookmarks_invalidate_infos ();
+}
+
+static void
+panel_bookmarks_load (void)
+{
 	char        *filename;
 	GIOChannel  *io_channel;
 	GHashTable  *table;
 	int          i;
-	GSList      *lines = NULL;
-	GSList      *add_bookmarks, *l;
-	PanelBookmark *bookmark;
+	GSList      *bookmarks;
+
+	panel_bookmarks_loaded = TRUE;
 
 	filename = g_build_filename (g_get_user_config_dir (),
 				     "gtk-3.0", "bookmarks", NULL);
@@ -365,176 +522,285 @@ panel_place_menu_item_append_gtk_bookmarks (GtkWidget *menu, guint max_items_or_
 	io_channel = g_io_channel_new_file (filename, "r", NULL);
 	g_free (filename);
 
-	if (!io_channel)
-		return;
+	table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	bookmarks = NULL;
 
 	/* We use a hard limit to avoid having users shooting their
 	 * own feet, and to avoid crashing the system if a misbehaving
 	 * application creates a big bookmarks file.
 	 */
-	for (i = 0; i < MAX_BOOKMARK_ITEMS; i++) {
-		char      *contents;
+	for (i = 0; io_channel && i < MAX_BOOKMARK_ITEMS; i++) {
+		PanelBookmark *bookmark;
+		char      *line;
+		char      *space;
 		gsize      length;
 		gsize      terminator_pos;
 		GIOStatus  status;
 
-		status = g_io_channel_read_line (io_channel, &contents, &length, &terminator_pos, NULL);
+		status = g_io_channel_read_line (io_channel, &line, &length, &terminator_pos, NULL);
 
 		if (status != G_IO_STATUS_NORMAL)
 			break;
 
-		if (length == 0)
+		if (length == 0) {
+			g_free (line);
 			break;
+		}
 
 		/* Clear the line terminator (\n), if any */
 		if (terminator_pos > 0)
-			contents[terminator_pos] = '\0';
+			line[terminator_pos] = '\0';
+
+		space = strchr (line, ' ');
+		if (space)
+			*space = '\0';
 
-		lines = g_slist_prepend (lines, contents);
+		if (!line[0] || g_hash_table_contains (table, line)) {
+			g_free (line);
+			continue;
+		}
+
+		bookmark = g_slice_new0 (PanelBookmark);
+		bookmark->uri = g_strdup (line);
+		if (space) {
+			bookmark->label = g_strdup (g_strstrip (space + 1));
+			if (!bookmark->label [0])
+				g_clear_pointer (&bookmark->label, g_free);
+		}
+		bookmarks = g_slist_prepend (bookmarks, bookmark);
+
+		g_hash_table_add (table, line);
 	}
 
-	g_io_channel_shutdown (io_channel, FALSE, NULL);
-	g_io_channel_unref (io_channel);
+	if (io_channel) {
+		g_io_channel_shutdown (io_channel, FALSE, NULL);
+		g_io_channel_unref (io_channel);
+	}
 
-	if (!lines)
-		return;
+	panel_bookmarks = g_slist_reverse (bookmarks);
 
-	lines = g_slist_reverse (lines);
+	/* forget about the places that are not bookmarked anymore */
+	if (panel_bookmark_infos)
+		g_hash_table_foreach_remove (panel_bookmark_infos,
+					     panel_bookmark_info_is_unused,
+					     table);
 
-	table = g_hash_table_new (g_str_hash, g_str_equal);
-	add_bookmarks = NULL;
+	g_hash_table_destroy (table);
+}
 
-	for (l = lines; l; l = l->next) {
-		char *line = (char*) l->data;
+static void
+panel_bookmark_resolve (const char  *uri,
+			gboolean     need_label,
+			char       **label,
+			char       **icon,
+			char       **tooltip)
+{
+	GFile *file;
+	char  *display_name;
 
-		if (line[0] && !g_hash_table_lookup (table, line)) {
-			char     *space;
-			char     *label;
-			gboolean  keep;
+	file = g_file_new_for_uri (uri);
+	display_name = g_file_get_parse_name (file);
+	g_object_unref (file);
+	/* Translators: %s is a URI */
+	*tooltip = g_strdup_printf (_("Open '%s'"), display_name);
+	g_free (display_name);
 
-			g_hash_table_insert (table, line, line);
+	*label = need_label ? panel_util_get_label_for_uri (uri) : NULL;
 
-			space = strchr (line, ' ');
-			if (space) {
-				*space = '\0';
-				label = g_strdup (space + 1);
-			} else {
-				label = NULL;
-			}
+	*icon = panel_util_get_icon_for_uri (uri);
+	/*FIXME: we should probably get a GIcon if possible, so that we
+	 * have customized icons for cd-rom, eg */
+	if (!*icon)
+		*icon = g_strdup (PANEL_ICON_FOLDER);
+}
 
-			keep = FALSE;
+/* Only the GFile queries run in the thread: the mounts and the icon theme
+ * are looked at in panel_bookmark_resolved_cb() */
+static void
+panel_bookmark_resolve_thread (GTask        *task,
+			       gpointer      source_object,
+			       gpointer      task_data,
+			       GCancellable *cancellable)
+{
+	const char *uri = task_data;
 
-			if (g_str_has_prefix (line, "x-caja-search:"))
-				keep = TRUE;
+	g_task_return_pointer (task, panel_util_uri_info_query (uri),
+			       (GDestroyNotify) panel_util_uri_info_free);
+}
 
-			if (!keep) {
-				GFile *file = g_file_new_for_uri (line);
-				keep = !g_file_is_native (file) ||
-				       g_file_query_exists (file, NULL);
-				g_object_unref (file);
-			}
+static void
+panel_bookmark_resolved_cb (GObject      *source_object,
+			    GAsyncResult *res,
+			    gpointer      user_data)
+{
+	PanelUriInfo      *uri_info;
+	PanelBookmarkInfo *info;
+	const char        *uri;
+	gboolean           need_label;
+	GFile             *file;
+	char              *display_name;
+	GSList            *l;
 
-			if (!keep) {
-				if (label)
-					g_free (label);
-				continue;
-			}
+	uri = g_task_get_task_data (G_TASK (res));
+	need_label = GPOINTER_TO_INT (g_object_get_data (G_OBJECT (res), "need-label"));
+	uri_info = g_task_propagate_pointer (G_TASK (res), NULL);
 
-			bookmark = g_malloc (sizeof (PanelBookmark));
-			bookmark->full_uri = g_strdup (line);
-			bookmark->label = label;
-			add_bookmarks = g_slist_prepend (add_bookmarks, bookmark);
-		}
+	info = g_hash_table_lookup (panel_bookmark_infos, uri);
+	g_assert (info != NULL);
+
+	info->resolving = FALSE;
+
+	g_free (info->label);
+	info->label = need_label ? panel_util_uri_info_get_label (uri_info) : NULL;
+
+	g_free (info->icon);
+	info->icon = panel_util_uri_info_get_icon (uri_info);
+	if (!info->icon)
+		info->icon = g_strdup (PANEL_ICON_FOLDER);
+
+	file = g_file_new_for_uri (uri);
+	display_name = g_file_get_parse_name (file);
+	g_object_unref (file);
+	g_free (info->tooltip);
+	/* Translators: %s is a URI */
+	info->tooltip = g_strdup_printf (_("Open '%s'"), display_name);
+	g_free (display_name);
+
+	panel_util_uri_info_free (uri_info);
+
+	for (l = panel_place_menu_items; l; l = l->next)
+		panel_place_menu_item_queue_update (l->data,
+						    PANEL_PLACES_SECTION_FLAG (PANEL_PLACES_SECTION_BOOKMARKS));
+}
+
+static PanelBookmarkInfo *
+panel_bookmark_get_info (PanelBookmark *bookmark)
+{
+	PanelBookmarkInfo *info;
+	gboolean           need_label;
+
+	if (!panel_bookmark_infos)
+		panel_bookmark_infos = g_hash_table_new_full (g_str_hash, g_str_equal,
+							      g_free,
+							      (GDestroyNotify) panel_bookmark_info_free);
+
+	need_label = (bookmark->label == NULL);
+
+	info = g_hash_table_lookup (panel_bookmark_infos, bookmark->uri);
+	if (!info) {
+		info = g_slice_new0 (PanelBookmarkInfo);
+		info->stale = TRUE;
+		g_hash_table_insert (panel_bookmark_infos,
+				     g_strdup (bookmark->uri), info);
 	}
 
-	g_hash_table_destroy (table);
-	g_slist_free_full (lines, g_free);
+	if (info->resolving)
+		return info;
 
-	add_bookmarks = g_slist_reverse (add_bookmarks);
+	if (!info->stale && (info->label || !need_label))
+		return info;
 
-	if (g_slist_length (add_bookmarks) <= max_items_or_submenu) {
-		add_menu = menu;
-	} else {
-		GtkWidget *item;
+	info->stale = FALSE;
 
-		item = mate_image_menu_item_new ();
-		setup_menuitem_with_icon (item, panel_menu_icon_get_size (),
-					  NULL, PANEL_ICON_BOOKMARKS,
-					  _("Bookmarks"));
+	if (g_str_has_prefix (bookmark->uri, "file:") ||
+	    g_str_has_prefix (bookmark->uri, "x-caja-search:")) {
+		g_free (info->label);
+		g_free (info->icon);
+		g_free (info->tooltip);
+		panel_bookmark_resolve (bookmark->uri, need_label,
+					&info->label, &info->icon, &info->tooltip);
+	} else {
+		GTask *task;
 
-		gtk_menu_shell_append (GTK_MENU_SHELL (menu), item);
-		gtk_widget_show (item);
+		info->resolving = TRUE;
 
-		add_menu = create_empty_menu ();
-		gtk_menu_item_set_submenu (GTK_MENU_ITEM (item), add_menu);
+		task = g_task_new (NULL, NULL, panel_bookmark_resolved_cb, NULL);
+		g_task_set_task_data (task, g_strdup (bookmark->uri), g_free);
+		g_object_set_data (G_OBJECT (task), "need-label",
+				   GINT_TO_POINTER (need_label));
+		g_task_run_in_thread (task, panel_bookmark_resolve_thread);
+		g_object_unref (task);
 	}
 
-	for (l = add_bookmarks; l; l = l->next) {
-		char *display_name;
-		char *tooltip;
-		char *label;
-		char *icon;
-		GFile *file;
-		GIcon *gicon;
+	return info;
+}
 
-		bookmark = l->data;
+static GSList *
+panel_place_menu_item_get_gtk_bookmarks (void)
+{
+	GSList       *add_bookmarks, *l;
+	PanelGioItem *item;
 
-		file = g_file_new_for_uri (bookmark->full_uri);
-		display_name = g_file_get_parse_name (file);
-		g_object_unref (file);
-		/* Translators: %s is a URI */
-		tooltip = g_strdup_printf (_("Open '%s'"), display_name);
-		g_free (display_name);
-
-		label = NULL;
-		if (bookmark->label) {
-			label = g_strdup (g_strstrip (bookmark->label));
-			if (!label [0]) {
-				g_free (label);
-				label = NULL;
-			}
-		}
+	if (!panel_bookmarks_loaded)
+		panel_bookmarks_load ();
 
-		if (!label) {
-			label = panel_util_get_label_for_uri (bookmark->full_uri);
+	add_bookmarks = NULL;
 
-			if (!label) {
-				g_free (tooltip);
-				g_free (bookmark->full_uri);
-				if (bookmark->label)
-					g_free (bookmark->label);
-				g_free (bookmark);
-				continue;
-			}
-		}
+	for (l = panel_bookmarks; l; l = l->next) {
+		PanelBookmark     *bookmark = l->data;
+		PanelBookmarkInfo *info;
+		char              *label;
 
-		icon = panel_util_get_icon_for_uri (bookmark->full_uri);
-		/*FIXME: we should probably get a GIcon if possible, so that we
-		 * have customized icons for cd-rom, eg */
-		if (!icon)
-			icon = g_strdup (PANEL_ICON_FOLDER);
+		if (!g_str_has_prefix (bookmark->uri, "x-caja-search:")) {
+			GFile    *file;
+			gboolean  keep;
+
+			file = g_file_new_for_uri (bookmark->uri);
+			keep = !g_file_is_native (file) ||
+			       g_file_query_exists (file, NULL);
+			g_object_unref (file);
 
-		gicon = g_themed_icon_new_with_default_fallbacks (icon);
+			if (!keep)
+				continue;
+		}
 
-		/* FIXME: drag and drop will be broken for x-caja-search uris */
-		panel_menu_items_append_place_item (icon, gicon,
-						    label,
-						    tooltip,
-						    add_menu,
-						    G_CALLBACK (activate_uri),
-						    bookmark->full_uri);
+		info = panel_bookmark_get_info (bookmark);
 
-		g_free (icon);
-		g_object_unref (gicon);
-		g_free (tooltip);
-		g_free (label);
-		g_free (bookmark->full_uri);
 		if (bookmark->label)
-			g_free (bookmark->label);
-		g_free (bookmark);
+			label = g_strdup (bookmark->label);
+		else if (info->label)
+			label = g_strdup (info->label);
+		else if (info->resolving) {
+			GFile *file;
+
+			file = g_file_new_for_uri (bookmark->uri);
+			label = g_file_get_parse_name (file);
+			g_object_unref (file);
+		} else
+			continue;
+
+		item = g_slice_new0 (PanelGioItem);
+		item->type = PANEL_GIO_BOOKMARK;
+		item->u.uri = g_strdup (bookmark->uri);
+		item->label = label;
+		item->icon = g_strdup (info->icon ? info->icon : PANEL_ICON_FOLDER);
+		item->tooltip = g_strdup (info->tooltip);
+		add_bookmarks = g_slist_prepend (add_bookmarks, item);
 	}
 
-	g_slist_free (add_bookmarks);
+	return g_slist_reverse (add_bookmarks);
+}
+
+static GtkWidget *
+panel_menu_item_append_bookmark (GtkWidget    *menu,
+				 PanelGioItem *bookmark)
+{
+	GtkWidget *item;
+	GIcon     *gicon;
+
+	gicon = g_themed_icon_new_with_default_fallbacks (bookmark->icon);
+
+	/* FIXME: drag and drop will be broken for x-caja-search uris */
+	item = panel_menu_items_append_place_item (bookmark->icon, gicon,
+						   bookmark->label,
+						   bookmark->tooltip,
+						   menu,
+						   G_CALLBACK (activate_uri),
+						   bookmark->u.uri);
+
+	g_object_unref (gicon);
+
+	return item;
 }
 
 static void
@@ -580,31 +846,25 @@ panel_menu_item_rescan_drive (GtkWidget *menuitem,
 				menuitem_to_screen (menuitem));
 }
 
-static void
-panel_menu_item_append_drive (GtkWidget *menu,
-			      GDrive    *drive)
+static GtkWidget *
+panel_menu_item_append_drive (GtkWidget  *menu,
+			      GDrive     *drive,
+			      const char *title,
+			      GIcon      *icon)
 {
 	GtkWidget *item;
-	GIcon     *icon;
-	char      *title;
 	char      *tooltip;
 
-	icon = g_drive_get_icon (drive);
-	title = g_drive_get_name (drive);
-
 	item = panel_image_menu_item_new ();
 	setup_menuitem_with_icon (item,
 				  panel_menu_icon_get_size (),
 				  icon, NULL,
 				  title);
-	g_object_unref (icon);
 
 	tooltip = g_strdup_printf (_("Rescan %s"), title);
 	panel_util_set_tooltip_text (item, tooltip);
 	g_free (tooltip);
 
-	g_free (title);
-
 	gtk_menu_shell_append (GTK_MENU_SHELL (menu), item);
 
 	g_signal_connect_data (item, "activate",
@@ -615,6 +875,8 @@ panel_menu_item_append_drive (GtkWidget *menu,
 	g_signal_connect (item, "button-press-event",
 	                  G_CALLBACK (menu_dummy_button_press_event),
 	                  NULL);
+
+	return item;
 }
 
 typedef struct {
@@ -681,31 +943,25 @@ panel_menu_item_mount_volume (GtkWidget *menuitem,
 			volume_mount_cb, mount_data);
 }
 
-static void
-panel_menu_item_append_volume (GtkWidget *menu,
-			       GVolume   *volume)
+static GtkWidget *
+panel_menu_item_append_volume (GtkWidget  *menu,
+			       GVolume    *volume,
+			       const char *title,
+			       GIcon      *icon)
 {
 	GtkWidget *item;
-	GIcon     *icon;
-	char      *title;
 	char      *tooltip;
 
-	icon = g_volume_get_icon (volume);
-	title = g_volume_get_name (volume);
-
 	item = panel_image_menu_item_new ();
 	setup_menuitem_with_icon (item,
 				  panel_menu_icon_get_size (),
 				  icon, NULL,
 				  title);
-	g_object_unref (icon);
 
 	tooltip = g_strdup_printf (_("Mount %s"), title);
 	panel_util_set_tooltip_text (item, tooltip);
 	g_free (tooltip);
 
-	g_free (title);
-
 	gtk_menu_shell_append (GTK_MENU_SHELL (menu), item);
 
 	g_signal_connect_data (item, "activate",
@@ -716,55 +972,63 @@ panel_menu_item_append_volume (GtkWidget *menu,
 	g_signal_connect (item, "button-press-event",
 	                  G_CALLBACK (menu_dummy_button_press_event),
 	                  NULL);
+
+	return item;
 }
 
-static void
-panel_menu_item_append_mount (GtkWidget *menu,
-			      GMount    *mount)
+static GtkWidget *
+panel_menu_item_append_mount (GtkWidget  *menu,
+			      const char *display_name,
+			      GIcon      *icon,
+			      const char *activation_uri)
 {
-	GFile  *root;
-	GIcon  *icon;
-	char   *display_name;
-	char   *activation_uri;
+	return panel_menu_items_append_place_item (NULL, icon,
+						   display_name,
+						   display_name, /* FIXME tooltip */
+						   menu,
+						   G_CALLBACK (activate_uri),
+						   activation_uri);
+}
+
+/* Loop devices and snap packages can add hundreds of volumes and mounts,
+ * and these are no places anybody wants to go to: they are left out before
+ * anything else is done with them. Loop devices that are mounted stay, as
+ * those are disk images the user asked for. */
+static gboolean
+panel_place_menu_item_volume_is_hidden (GVolume *volume)
+{
+	char     *device;
+	gboolean  hidden;
+
+	device = g_volume_get_identifier (volume,
+					  G_VOLUME_IDENTIFIER_KIND_UNIX_DEVICE);
+	hidden = device && g_str_has_prefix (device, "/dev/loop");
+	g_free (device);
+
+	return hidden;
+}
 
-	icon = g_mount_get_icon (mount);
-	display_name = g_mount_get_name (mount);
+static gboolean
+panel_place_menu_item_mount_is_hidden (GMount *mount)
+{
+	GFile    *root;
+	char     *path;
+	gboolean  hidden;
 
 	root = g_mount_get_root (mount);
-	activation_uri = g_file_get_uri (root);
+	path = g_file_get_path (root);
 	g_object_unref (root);
 
-	panel_menu_items_append_place_item (NULL, icon,
-					    display_name,
-					    display_name, /* FIXME tooltip */
-					    menu,
-					    G_CALLBACK (activate_uri),
-					    activation_uri);
+	hidden = path && (g_str_has_prefix (path, "/snap/") ||
+			  g_str_has_prefix (path, "/var/lib/snapd/"));
+	g_free (path);
 
-	g_object_unref (icon);
-	g_free (display_name);
-	g_free (activation_uri);
+	return hidden;
 }
 
-typedef enum {
-	PANEL_GIO_DRIVE,
-	PANEL_GIO_VOLUME,
-	PANEL_GIO_MOUNT
-} PanelGioItemType;
-
-typedef struct {
-	PanelGioItemType type;
-	union {
-		GDrive *drive;
-		GVolume *volume;
-		GMount *mount;
-	} u;
-} PanelGioItem;
-
 /* this is loosely based on update_places() from caja-places-sidebar.c */
-static void
-panel_place_menu_item_append_local_gio (PanelPlaceMenuItem *place_item,
-					GtkWidget          *menu)
+static GSList *
+panel_place_menu_item_get_local_gio (PanelPlaceMenuItem *place_item)
 {
 	GList   *l;
 	GList   *ll;
@@ -775,9 +1039,7 @@ panel_place_menu_item_append_local_gio (PanelPlaceMenuItem *place_item,
 	GList   *mounts;
 	GMount  *mount;
 	GSList       *items;
-	GSList       *sl;
 	PanelGioItem *item;
-	GtkWidget *add_menu;
 
 	items = NULL;
 
@@ -791,7 +1053,14 @@ panel_place_menu_item_append_local_gio (PanelPlaceMenuItem *place_item,
 			for (ll = volumes; ll != NULL; ll = ll->next) {
 				volume = ll->data;
 				mount = g_volume_get_mount (volume);
-				item = g_slice_new (PanelGioItem);
+				if (mount != NULL ?
+				    panel_place_menu_item_mount_is_hidden (mount) :
+				    panel_place_menu_item_volume_is_hidden (volume)) {
+					g_clear_object (&mount);
+					g_object_unref (volume);
+					continue;
+				}
+				item = g_slice_new0 (PanelGioItem);
 				if (mount != NULL) {
 					item->type = PANEL_GIO_MOUNT;
 					item->u.mount = mount;
@@ -827,7 +1096,7 @@ panel_place_menu_item_append_local_gio (PanelPlaceMenuItem *place_item,
 				 * off media detection in the OS to save
 				 * battery juice.
 				 */
-				item = g_slice_new (PanelGioItem);
+				item = g_slice_new0 (PanelGioItem);
 				item->type = PANEL_GIO_DRIVE;
 				item->u.drive = g_object_ref (drive);
 				items = g_slist_prepend (items, item);
@@ -848,7 +1117,14 @@ panel_place_menu_item_append_local_gio (PanelPlaceMenuItem *place_item,
 			continue;
 		}
 		mount = g_volume_get_mount (volume);
-		item = g_slice_new (PanelGioItem);
+		if (mount != NULL ?
+		    panel_place_menu_item_mount_is_hidden (mount) :
+		    panel_place_menu_item_volume_is_hidden (volume)) {
+			g_clear_object (&mount);
+			g_object_unref (volume);
+			continue;
+		}
+		item = g_slice_new0 (PanelGioItem);
 		if (mount != NULL) {
 			item->type = PANEL_GIO_MOUNT;
 			item->u.mount = mount;
@@ -883,78 +1159,36 @@ panel_place_menu_item_append_local_gio (PanelPlaceMenuItem *place_item,
 		}
 
 		root = g_mount_get_root (mount);
-		if (!g_file_is_native (root)) {
+		if (!g_file_is_native (root) ||
+		    panel_place_menu_item_mount_is_hidden (mount)) {
 			g_object_unref (root);
 			g_object_unref (mount);
 			continue;
 		}
 		g_object_unref (root);
 
-		item = g_slice_new (PanelGioItem);
+		item = g_slice_new0 (PanelGioItem);
 		item->type = PANEL_GIO_MOUNT;
 		item->u.mount = mount;
 		items = g_slist_prepend (items, item);
 	}
 	g_list_free (mounts);
 
-	/* now that we have everything, add the items inline or in a submenu */
-	items = g_slist_reverse (items);
-
-	if (g_slist_length (items) <= g_settings_get_uint (place_item->priv->menubar_settings, PANEL_MENU_BAR_MAX_ITEMS_OR_SUBMENU)) {
-		add_menu = menu;
-	} else {
-		GtkWidget  *menu_item;
-
-		menu_item = mate_image_menu_item_new ();
-		setup_menuitem_with_icon (menu_item, panel_menu_icon_get_size (),
-		                          NULL,
-		                          PANEL_ICON_REMOVABLE_MEDIA,
-		                          _("Removable Media"));
-
-		gtk_menu_shell_append (GTK_MENU_SHELL (menu), menu_item);
-		gtk_widget_show (menu_item);
-
-		add_menu = create_empty_menu ();
-		gtk_menu_item_set_submenu (GTK_MENU_ITEM (menu_item), add_menu);
-	}
-
-	for (sl = items; sl; sl = sl->next) {
-		item = sl->data;
-		switch (item->type) {
-		case PANEL_GIO_DRIVE:
-			panel_menu_item_append_drive (add_menu, item->u.drive);
-			g_object_unref (item->u.drive);
-			break;
-		case PANEL_GIO_VOLUME:
-			panel_menu_item_append_volume (add_menu, item->u.volume);
-			g_object_unref (item->u.volume);
-			break;
-		case PANEL_GIO_MOUNT:
-			panel_menu_item_append_mount (add_menu, item->u.mount);
-			g_object_unref (item->u.mount);
-			break;
-		default:
-			g_assert_not_reached ();
-		}
-		g_slice_free (PanelGioItem, item);
-	}
-
-	g_slist_free (items);
+	return g_slist_reverse (items);
 }
 
 /* this is loosely based on update_places() from caja-places-sidebar.c */
-static void
-panel_place_menu_item_append_remote_gio (PanelPlaceMenuItem *place_item,
-					 GtkWidget          *menu)
+static GSList *
+panel_place_menu_item_get_remote_gio (PanelPlaceMenuItem *place_item)
 {
-	GtkWidget *add_menu;
-	GList     *mounts, *l;
-	GMount    *mount;
-	GSList    *add_mounts, *sl;
+	GList        *mounts, *l;
+	GMount       *mount;
+	GSList       *items;
+	PanelGioItem *item;
 
 	/* add mounts that has no volume (/etc/mtab mounts, ftp, sftp,...) */
 	mounts = g_volume_monitor_get_mounts (place_item->priv->volume_monitor);
-	add_mounts = NULL;
+	items = NULL;
 
 	for (l = mounts; l; l = l->next) {
 		GVolume *volume;
@@ -982,61 +1216,406 @@ panel_place_menu_item_append_remote_gio (PanelPlaceMenuItem *place_item,
 		}
 		g_object_unref (root);
 
-		add_mounts = g_slist_prepend (add_mounts, mount);
+		item = g_slice_new0 (PanelGioItem);
+		item->type = PANEL_GIO_MOUNT;
+		item->u.mount = mount;
+		items = g_slist_prepend (items, item);
 	}
-	add_mounts = g_slist_reverse (add_mounts);
+	g_list_free (mounts);
 
-	if (g_slist_length (add_mounts) <= g_settings_get_uint (place_item->priv->menubar_settings, PANEL_MENU_BAR_MAX_ITEMS_OR_SUBMENU)) {
-		add_menu = menu;
-	} else {
-		GtkWidget  *item;
+	return g_slist_reverse (items);
+}
 
+/* Takes what the item shows out of its object: the result does not change
+ * anymore, whatever the volume monitor does in the meantime. The key tells
+ * which item of the menu shows this place, the fingerprint whether that item
+ * still shows it right. Drive and volume items hold a reference on their
+ * object, so their address cannot be reused while the item is around. */
+static void
+panel_gio_item_prepare (PanelGioItem *item)
+{
+	GFile *root;
+
+	switch (item->type) {
+	case PANEL_GIO_DRIVE:
+		item->key = g_strdup_printf ("drive:%p", item->u.drive);
+		item->label = g_drive_get_name (item->u.drive);
+		item->gicon = g_drive_get_icon (item->u.drive);
+		break;
+	case PANEL_GIO_VOLUME:
+		item->key = g_strdup_printf ("volume:%p", item->u.volume);
+		item->label = g_volume_get_name (item->u.volume);
+		item->gicon = g_volume_get_icon (item->u.volume);
+		break;
+	case PANEL_GIO_MOUNT:
+		item->key = g_strdup_printf ("mount:%p", item->u.mount);
+		item->label = g_mount_get_name (item->u.mount);
+		item->gicon = g_mount_get_icon (item->u.mount);
+		root = g_mount_get_root (item->u.mount);
+		item->uri = g_file_get_uri (root);
+		g_object_unref (root);
+		break;
+	case PANEL_GIO_BOOKMARK:
+		item->key = g_strconcat ("bookmark:", item->u.uri, NULL);
+		break;
+	default:
+		g_assert_not_reached ();
+	}
+
+	if (item->gicon)
+		item->icon = g_icon_to_string (item->gicon);
+
+	item->fingerprint = g_strdup_printf ("%s\n%s\n%s\n%s",
+					     item->label ? item->label : "",
+					     item->icon ? item->icon : "",
+					     item->uri ? item->uri : "",
+					     item->tooltip ? item->tooltip : "");
+}
+
+static GtkWidget *
+panel_gio_item_append (PanelGioItem *item,
+		       GtkWidget    *menu)
+{
+	switch (item->type) {
+	case PANEL_GIO_DRIVE:
+		return panel_menu_item_append_drive (menu, item->u.drive,
+						     item->label, item->gicon);
+	case PANEL_GIO_VOLUME:
+		return panel_menu_item_append_volume (menu, item->u.volume,
+						      item->label, item->gicon);
+	case PANEL_GIO_MOUNT:
+		return panel_menu_item_append_mount (menu, item->label,
+						     item->gicon, item->uri);
+	case PANEL_GIO_BOOKMARK:
+		return panel_menu_item_append_bookmark (menu, item);
+	default:
+		g_assert_not_reached ();
+	}
+
+	return NULL;
+}
+
+static GSList *
+panel_place_menu_item_get_section_items (PanelPlaceMenuItem     *place_item,
+					 PanelPlacesSectionType  type)
+{
+	GSList *items;
+	GSList *l;
+
+	switch (type) {
+	case PANEL_PLACES_SECTION_BOOKMARKS:
+		items = panel_place_menu_item_get_gtk_bookmarks ();
+		break;
+	case PANEL_PLACES_SECTION_LOCAL:
+		items = panel_place_menu_item_get_local_gio (place_item);
+		break;
+	case PANEL_PLACES_SECTION_REMOTE:
+		items = panel_place_menu_item_get_remote_gio (place_item);
+		break;
+	default:
+		g_assert_not_reached ();
+	}
+
+	for (l = items; l; l = l->next)
+		panel_gio_item_prepare (l->data);
+
+	return items;
+}
+
+static GtkWidget *
+panel_place_menu_item_create_section_submenu (PanelPlacesSectionType type)
+{
+	GtkWidget *item;
+
+	switch (type) {
+	case PANEL_PLACES_SECTION_BOOKMARKS:
+		item = mate_image_menu_item_new ();
+		setup_menuitem_with_icon (item, panel_menu_icon_get_size (),
+					  NULL, PANEL_ICON_BOOKMARKS,
+					  _("Bookmarks"));
+		break;
+	case PANEL_PLACES_SECTION_LOCAL:
+		item = mate_image_menu_item_new ();
+		setup_menuitem_with_icon (item, panel_menu_icon_get_size (),
+		                          NULL,
+		                          PANEL_ICON_REMOVABLE_MEDIA,
+		                          _("Removable Media"));
+		break;
+	case PANEL_PLACES_SECTION_REMOTE:
 		item = panel_image_menu_item_new ();
 		setup_menuitem_with_icon (item, panel_menu_icon_get_size (),
 					  NULL,
 					  PANEL_ICON_NETWORK_SERVER,
 					  _("Network Places"));
+		break;
+	default:
+		g_assert_not_reached ();
+	}
 
-		gtk_menu_shell_append (GTK_MENU_SHELL (menu), item);
-		gtk_widget_show (item);
+	gtk_widget_show (item);
+	gtk_menu_item_set_submenu (GTK_MENU_ITEM (item), create_empty_menu ());
+
+	return item;
+}
+
+static PanelPlacesEntry *
+panel_places_entry_new (const char *key,
+			const char *fingerprint,
+			GtkWidget  *widget)
+{
+	PanelPlacesEntry *entry;
+
+	entry = g_slice_new (PanelPlacesEntry);
+	entry->key = g_strdup (key);
+	entry->fingerprint = g_strdup (fingerprint);
+	entry->widget = widget;
+
+	return entry;
+}
+
+static void
+panel_places_entry_free (PanelPlacesEntry *entry)
+{
+	g_free (entry->key);
+	g_free (entry->fingerprint);
+	g_slice_free (PanelPlacesEntry, entry);
+}
 
-		add_menu = create_empty_menu ();
-		gtk_menu_item_set_submenu (GTK_MENU_ITEM (item), add_menu);
+static void
+panel_places_entry_destroy_widget (gpointer key,
+				   gpointer value,
+				   gpointer user_data)
+{
+	PanelPlacesEntry *entry = value;
+
+	gtk_widget_destroy (entry->widget);
+}
+
+/* Forgets the items of the section; when destroy_widgets is FALSE, the menu
+ * holding them is about to go away anyway. */
+static void
+panel_places_section_clear (PanelPlacesSection *section,
+			    gboolean            destroy_widgets)
+{
+	if (destroy_widgets) {
+		/* the submenu item takes its items with it */
+		if (section->submenu_item)
+			gtk_widget_destroy (section->submenu_item);
+		else
+			g_hash_table_foreach (section->entries,
+					      panel_places_entry_destroy_widget,
+					      NULL);
 	}
 
-	for (sl = add_mounts; sl; sl = sl->next) {
-		mount = sl->data;
-		panel_menu_item_append_mount (add_menu, mount);
-		g_object_unref (mount);
+	section->submenu_item = NULL;
+	g_hash_table_remove_all (section->entries);
+}
+
+static int
+panel_places_menu_get_child_position (GtkWidget *menu,
+				      GtkWidget *child)
+{
+	GList *children;
+	int    position;
+
+	children = gtk_container_get_children (GTK_CONTAINER (menu));
+	position = g_list_index (children, child);
+	g_list_free (children);
+
+	return position;
+}
+
+/* Brings the items of a section in line with the places it should show:
+ * items whose place went away or changed are destroyed, new places get an
+ * item, and the others are only moved in place. The section is rebuilt
+ * only when it moves in or out of its submenu. */
+static void
+panel_place_menu_item_update_section (PanelPlaceMenuItem     *place_item,
+				      GtkWidget              *places_menu,
+				      PanelPlacesSectionType  type)
+{
+	PanelPlacesSection *section;
+	GHashTable         *old_entries;
+	GSList             *items;
+	GSList             *l;
+	GtkWidget          *menu;
+	gboolean            use_submenu;
+	int                 position;
+
+	section = &place_item->priv->sections [type];
+	g_return_if_fail (section->anchor != NULL);
+
+	items = panel_place_menu_item_get_section_items (place_item, type);
+	use_submenu = g_slist_length (items) > g_settings_get_uint (place_item->priv->menubar_settings,
+								    PANEL_MENU_BAR_MAX_ITEMS_OR_SUBMENU);
+
+	if (use_submenu != (section->submenu_item != NULL))
+		panel_places_section_clear (section, TRUE);
+
+	position = panel_places_menu_get_child_position (places_menu,
+							 section->anchor) + 1;
+
+	if (use_submenu) {
+		if (!section->submenu_item) {
+			section->submenu_item = panel_place_menu_item_create_section_submenu (type);
+			gtk_menu_shell_insert (GTK_MENU_SHELL (places_menu),
+					       section->submenu_item, position);
+		}
+
+		menu = gtk_menu_item_get_submenu (GTK_MENU_ITEM (section->submenu_item));
+		position = 0;
+	} else {
+		menu = places_menu;
 	}
 
-	g_slist_free (add_mounts);
-	g_list_free (mounts);
+	/* keep the items that still show their place right, and drop the
+	 * others before placing anything */
+	old_entries = section->entries;
+	section->entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+						  NULL,
+						  (GDestroyNotify) panel_places_entry_free);
+
+	for (l = items; l; l = l->next) {
+		PanelGioItem     *item = l->data;
+		PanelPlacesEntry *entry;
+
+		entry = g_hash_table_lookup (old_entries, item->key);
+		if (entry && strcmp (entry->fingerprint, item->fingerprint) == 0) {
+			g_hash_table_steal (old_entries, item->key);
+			g_hash_table_insert (section->entries, entry->key, entry);
+		}
+	}
+
+	g_hash_table_foreach (old_entries, panel_places_entry_destroy_widget, NULL);
+	g_hash_table_destroy (old_entries);
+
+	for (l = items; l; l = l->next) {
+		PanelGioItem     *item = l->data;
+		PanelPlacesEntry *entry;
+
+		entry = g_hash_table_lookup (section->entries, item->key);
+		if (!entry) {
+			GtkWidget *widget;
+
+			widget = panel_gio_item_append (item, menu);
+			if (!widget)
+				continue;
+
+			entry = panel_places_entry_new (item->key,
+							item->fingerprint,
+							widget);
+			g_hash_table_insert (section->entries, entry->key, entry);
+		}
+
+		gtk_menu_reorder_child (GTK_MENU (menu), entry->widget, position++);
+	}
+
+	g_slist_free_full (items, (GDestroyNotify) panel_gio_item_free);
+}
+
+static void
+panel_place_menu_item_apply_updates (PanelPlaceMenuItem *place_item)
+{
+	guint dirty_sections;
+	int   i;
+
+	dirty_sections = place_item->priv->dirty_sections;
+	place_item->priv->dirty_sections = 0;
+
+	if (!dirty_sections || !place_item->priv->menu)
+		return;
+
+	for (i = 0; i < N_PANEL_PLACES_SECTIONS; i++)
+		if (dirty_sections & PANEL_PLACES_SECTION_FLAG (i))
+			panel_place_menu_item_update_section (place_item,
+							      place_item->priv->menu,
+							      i);
+
+	/* new submenus need to know their panel too */
+	mate_panel_applet_menu_set_recurse (GTK_MENU (place_item->priv->menu),
+				       "menu_panel",
+				       place_item->priv->panel);
+}
+
+static void
+panel_place_menu_item_menu_show (GtkWidget          *menu,
+				 PanelPlaceMenuItem *place_item)
+{
+	panel_place_menu_item_apply_updates (place_item);
+}
+
+static void
+panel_place_menu_item_menu_destroyed (GtkWidget          *menu,
+				      PanelPlaceMenuItem *place_item)
+{
+	if (place_item->priv->menu == menu)
+		place_item->priv->menu = NULL;
+}
+
+static gboolean
+panel_place_menu_item_update_idle (gpointer user_data)
+{
+	PanelPlaceMenuItem *place_item = user_data;
+
+	place_item->priv->update_id = 0;
+
+	/* a hidden menu catches up when it is shown */
+	if (place_item->priv->menu &&
+	    gtk_widget_get_visible (place_item->priv->menu))
+		panel_place_menu_item_apply_updates (place_item);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Volume monitor and bookmarks events come in bursts: a device with a few
+ * partitions emits a dozen of them. They only mark their sections, which
+ * are updated once the burst is over. */
+static void
+panel_place_menu_item_queue_update (PanelPlaceMenuItem *place_item,
+				    guint               sections)
+{
+	place_item->priv->dirty_sections |= sections;
+
+	if (place_item->priv->update_id == 0)
+		place_item->priv->update_id = g_idle_add (panel_place_menu_item_update_idle,
+							  place_item);
 }
 
 static GtkWidget *
 panel_place_menu_item_create_menu (PanelPlaceMenuItem *place_item)
 {
 	GtkWidget *places_menu;
+	GtkWidget *item;
 	char      *gsettings_name = NULL;
 	char      *name;
 	char      *uri;
 	GFile     *file;
 	int        recent_items_limit;
+	int        i;
+
+	for (i = 0; i < N_PANEL_PLACES_SECTIONS; i++)
+		panel_places_section_clear (&place_item->priv->sections [i], FALSE);
+	place_item->priv->dirty_sections = 0;
 
 	places_menu = panel_create_menu ();
+	g_signal_connect (places_menu, "show",
+			  G_CALLBACK (panel_place_menu_item_menu_show),
+			  place_item);
+	g_signal_connect (places_menu, "destroy",
+			  G_CALLBACK (panel_place_menu_item_menu_destroyed),
+			  place_item);
 
 	file = g_file_new_for_path (g_get_home_dir ());
 	uri = g_file_get_uri (file);
 	name = panel_util_get_label_for_uri (uri);
 	g_object_unref (file);
 
-	panel_menu_items_append_place_item (PANEL_ICON_HOME, NULL,
-					    name,
-					    _("Open your personal folder"),
-					    places_menu,
-					    G_CALLBACK (activate_home_uri),
-					    uri);
+	item = panel_menu_items_append_place_item (PANEL_ICON_HOME, NULL,
+						   name,
+						   _("Open your personal folder"),
+						   places_menu,
+						   G_CALLBACK (activate_home_uri),
+						   uri);
 	g_free (name);
 	g_free (uri);
 
@@ -1047,7 +1626,7 @@ panel_place_menu_item_create_menu (PanelPlaceMenuItem *place_item)
 		uri = g_file_get_uri (file);
 		g_object_unref (file);
 
-		panel_menu_items_append_place_item (
+		item = panel_menu_items_append_place_item (
 				PANEL_ICON_DESKTOP, NULL,
 				/* Translators: Desktop is used here as in
 				 * "Desktop Folder" (this is not the Desktop
@@ -1061,7 +1640,9 @@ panel_place_menu_item_create_menu (PanelPlaceMenuItem *place_item)
 		g_free (uri);
 	}
 
-	panel_place_menu_item_append_gtk_bookmarks (places_menu, g_settings_get_uint (place_item->priv->menubar_settings, PANEL_MENU_BAR_MAX_ITEMS_OR_SUBMENU));
+	place_item->priv->sections [PANEL_PLACES_SECTION_BOOKMARKS].anchor = item;
+	panel_place_menu_item_update_section (place_item, places_menu,
+					      PANEL_PLACES_SECTION_BOOKMARKS);
 	add_menu_separator (places_menu);
 
 	if (place_item->priv->caja_desktop_settings != NULL)
@@ -1073,7 +1654,7 @@ panel_place_menu_item_create_menu (PanelPlaceMenuItem *place_item)
 		gsettings_name = g_strdup (_("Computer"));
 	}
 
-	panel_menu_items_append_place_item (
+	item = panel_menu_items_append_place_item (
 			PANEL_ICON_COMPUTER, NULL,
 			gsettings_name,
 			_("Browse all local and remote disks and folders accessible from this computer"),
@@ -1084,22 +1665,26 @@ panel_place_menu_item_create_menu (PanelPlaceMenuItem *place_item)
 	if (gsettings_name)
 		g_free (gsettings_name);
 
-	panel_place_menu_item_append_local_gio (place_item, places_menu);
+	place_item->priv->sections [PANEL_PLACES_SECTION_LOCAL].anchor = item;
+	panel_place_menu_item_update_section (place_item, places_menu,
+					      PANEL_PLACES_SECTION_LOCAL);
 	add_menu_separator (places_menu);
 
-	panel_menu_items_append_place_item (
+	item = panel_menu_items_append_place_item (
 			PANEL_ICON_NETWORK, NULL,
 			_("Network"),
 			_("Browse bookmarked and local network locations"),
 			places_menu,
 			G_CALLBACK (activate_uri),
 			"network://");
-	panel_place_menu_item_append_remote_gio (place_item, places_menu);
+	place_item->priv->sections [PANEL_PLACES_SECTION_REMOTE].anchor = item;
+	panel_place_menu_item_update_section (place_item, places_menu,
+					      PANEL_PLACES_SECTION_REMOTE);
 
 	if (panel_is_program_in_path ("caja-connect-server") ||
 	    panel_is_program_in_path ("nautilus-connect-server") ||
 	    panel_is_program_in_path ("nemo-connect-server")) {
-		GtkWidget *item = panel_menu_items_create_action_item (PANEL_ACTION_CONNECT_SERVER);
+		item = panel_menu_items_create_action_item (PANEL_ACTION_CONNECT_SERVER);
 		if (item != NULL)
 			gtk_menu_shell_append (GTK_MENU_SHELL (places_menu),
 					       item);
@@ -1169,7 +1754,9 @@ panel_place_menu_item_gtk_bookmarks_changed (GFileMonitor *handle,
 					     GFileMonitorEvent event,
 					     gpointer      user_data)
 {
-	panel_place_menu_item_recreate_menu (GTK_WIDGET (user_data));
+	panel_bookmarks_invalidate ();
+	panel_place_menu_item_queue_update (PANEL_PLACE_MENU_ITEM (user_data),
+					    PANEL_PLACES_SECTION_FLAG (PANEL_PLACES_SECTION_BOOKMARKS));
 }
 
 static void
@@ -1177,7 +1764,8 @@ panel_place_menu_item_drives_changed (GVolumeMonitor *monitor,
 				      GDrive         *drive,
 				      GtkWidget      *place_menu)
 {
-	panel_place_menu_item_recreate_menu (place_menu);
+	panel_place_menu_item_queue_update (PANEL_PLACE_MENU_ITEM (place_menu),
+					    PANEL_PLACES_SECTION_FLAG (PANEL_PLACES_SECTION_LOCAL));
 }
 
 static void
@@ -1185,7 +1773,8 @@ panel_place_menu_item_volumes_changed (GVolumeMonitor *monitor,
 				       GVolume        *volume,
 				       GtkWidget      *place_menu)
 {
-	panel_place_menu_item_recreate_menu (place_menu);
+	panel_place_menu_item_queue_update (PANEL_PLACE_MENU_ITEM (place_menu),
+					    PANEL_PLACES_SECTION_FLAG (PANEL_PLACES_SECTION_LOCAL));
 }
 
 static void
@@ -1193,7 +1782,11 @@ panel_place_menu_item_mounts_changed (GVolumeMonitor *monitor,
 				      GMount         *mount,
 				      GtkWidget      *place_menu)
 {
-	panel_place_menu_item_recreate_menu (place_menu);
+	panel_bookmarks_invalidate_infos ();
+	panel_place_menu_item_queue_update (PANEL_PLACE_MENU_ITEM (place_menu),
+					    PANEL_PLACES_SECTION_FLAG (PANEL_PLACES_SECTION_BOOKMARKS) |
+					    PANEL_PLACES_SECTION_FLAG (PANEL_PLACES_SECTION_LOCAL) |
+					    PANEL_PLACES_SECTION_FLAG (PANEL_PLACES_SECTION_REMOTE));
 }
 
 static void
@@ -1288,6 +1881,16 @@ panel_place_menu_item_finalize (GObject *object)
 
 	g_clear_object (&menuitem->priv->volume_monitor);
 
+	if (menuitem->priv->update_id != 0) {
+		g_source_remove (menuitem->priv->update_id);
+		menuitem->priv->update_id = 0;
+	}
+
+	for (i = 0; i < N_PANEL_PLACES_SECTIONS; i++)
+		g_hash_table_destroy (menuitem->priv->sections [i].entries);
+
+	panel_place_menu_items = g_slist_remove (panel_place_menu_items, menuitem);
+
 	G_OBJECT_CLASS (panel_place_menu_item_parent_class)->finalize (object);
 }
 
@@ -1312,6 +1915,14 @@ panel_place_menu_item_init (PanelPlaceMenuItem *menuitem)
 
 	menuitem->priv = panel_place_menu_item_get_instance_private (menuitem);
 
+	for (i = 0; i < N_PANEL_PLACES_SECTIONS; i++)
+		menuitem->priv->sections [i].entries =
+			g_hash_table_new_full (g_str_hash, g_str_equal,
+					       NULL,
+					       (GDestroyNotify) panel_places_entry_free);
+
+	panel_place_menu_items = g_slist_prepend (panel_place_menu_items, menuitem);
+
 	if (mate_gsettings_schema_exists (CAJA_DESKTOP_SCHEMA)) {
 		menuitem->priv->caja_desktop_settings = g_settings_new (CAJA_DESKTOP_SCHEMA);
 		g_signal_connect (menuitem->priv->caja_desktop_settings,
@@ -1510,6 +2121,19 @@ panel_place_menu_item_set_panel (GtkWidget   *item,
 				       "menu_panel", panel);
 }
 
+/* Applies the pending section updates before the menu is shown */
+void
+panel_place_menu_item_prefetch (GtkWidget *item)
+{
+	PanelPlaceMenuItem *place_item;
+
+	place_item = PANEL_PLACE_MENU_ITEM (item);
+
+	if (place_item->priv->menu &&
+	    !gtk_widget_get_visible (place_item->priv->menu))
+		panel_place_menu_item_apply_updates (place_item);
+}
+
 void
 panel_desktop_menu_item_set_panel (GtkWidget   *item,
 				   PanelWidget *panel)
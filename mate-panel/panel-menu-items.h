@@ -86,6 +86,8 @@ void panel_place_menu_item_set_panel   (GtkWidget   *item,
 void panel_desktop_menu_item_set_panel (GtkWidget   *item,
 					PanelWidget *panel);
 
+void panel_place_menu_item_prefetch    (GtkWidget   *item);
+
 void panel_menu_items_append_lock_logout (GtkWidget *menu);
 void panel_menu_item_activate_desktop_file (GtkWidget  *menuitem,
 					    const char *path);
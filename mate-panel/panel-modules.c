@@ -24,6 +24,11 @@
  */
 
 #include <config.h>
+
+#include <string.h>
+#include <sys/stat.h>
+
+#include <glib/gstdio.h>
 #include <gio/gio.h>
 
 #include <libmate-panel-applet-private/panel-applets-manager-dbus.h>
@@ -43,6 +48,95 @@ panel_modules_ensure_extension_points_registered (void)
 	}
  }
 
+/*
+ * The giomodule.cache written by gio-querymodules in a modules directory
+ * lists the extension points each module implements: with it, only the
+ * modules implementing the applets manager extension point are opened,
+ * instead of all of them. Without it, or when it is older than the
+ * directory, the whole directory is loaded as before.
+ */
+static gboolean
+panel_modules_load_from_cache (const char *dirname)
+{
+	GStatBuf   dir_stat;
+	GStatBuf   cache_stat;
+	char      *cache_path;
+	char      *contents;
+	char     **lines;
+	int        i, j;
+
+	cache_path = g_build_filename (dirname, "giomodule.cache", NULL);
+
+	if (g_stat (dirname, &dir_stat) != 0 ||
+	    g_stat (cache_path, &cache_stat) != 0 ||
+	    dir_stat.st_mtime > cache_stat.st_mtime ||
+	    !g_file_get_contents (cache_path, &contents, NULL, NULL)) {
+		g_free (cache_path);
+		return FALSE;
+	}
+
+	g_free (cache_path);
+
+	lines = g_strsplit (contents, "\n", -1);
+	g_free (contents);
+
+	for (i = 0; lines[i] != NULL; i++) {
+		char       *colon;
+		char      **extension_points;
+		GIOModule  *module;
+		char       *path;
+
+		colon = strchr (lines[i], ':');
+		if (!colon || colon == lines[i])
+			continue;
+
+		*colon = '\0';
+		extension_points = g_strsplit (colon + 1, ",", -1);
+		g_strstrip (lines[i]);
+
+		for (j = 0; extension_points[j] != NULL; j++)
+			g_strstrip (extension_points[j]);
+
+		if (!g_strv_contains ((const char * const *) extension_points,
+				      MATE_PANEL_APPLETS_MANAGER_EXTENSION_POINT_NAME)) {
+			g_strfreev (extension_points);
+			continue;
+		}
+		g_strfreev (extension_points);
+
+		path = g_build_filename (dirname, lines[i], NULL);
+		module = g_io_module_new (path);
+		g_free (path);
+
+		/* like g_io_modules_load_all_in_directory(), the module stays
+		 * used and is never unloaded */
+		if (!g_type_module_use (G_TYPE_MODULE (module))) {
+			g_printerr ("Failed to load module: %s\n", lines[i]);
+			g_object_unref (module);
+		}
+	}
+
+	g_strfreev (lines);
+
+	return TRUE;
+}
+
+static void
+panel_modules_load_directory (const char *dirname)
+{
+	GList *modules;
+
+	if (panel_modules_load_from_cache (dirname))
+		return;
+
+	/* We load the modules explicitly instead of using scan_all
+	 * so that we can leak a reference to them.  This prevents them
+	 * from getting unloaded later (something they aren't designed
+	 * to cope with) */
+	modules = g_io_modules_load_all_in_directory (dirname);
+	g_list_free (modules);
+}
+
 void
 panel_modules_ensure_loaded (void)
 {
@@ -52,15 +146,9 @@ panel_modules_ensure_loaded (void)
 
 	if (!loaded_dirs) {
 		const char *module_path;
-		GList *modules;
 		loaded_dirs = TRUE;
 
-		/* We load the modules explicitly instead of using scan_all
-		 * so that we can leak a reference to them.  This prevents them
-		 * from getting unloaded later (something they aren't designed
-		 * to cope with) */
-		modules = g_io_modules_load_all_in_directory (PANEL_MODULES_DIR);
-		g_list_free (modules);
+		panel_modules_load_directory (PANEL_MODULES_DIR);
 
 		module_path = g_getenv ("MATE_PANEL_EXTRA_MODULES");
 
@@ -70,10 +158,8 @@ panel_modules_ensure_loaded (void)
 
 			paths = g_strsplit (module_path, ":", 0);
 
-			for (i = 0; paths[i] != NULL; i++) {
-				modules = g_io_modules_load_all_in_directory (paths[i]);
-				g_list_free (modules);
-			}
+			for (i = 0; paths[i] != NULL; i++)
+				panel_modules_load_directory (paths[i]);
 
 			g_strfreev (paths);
 		}
@@ -0,0 +1,231 @@
+/*
+ * panel-multimonitor-compress.c: Merging of the overlapping monitors.
+ *
+ * Copyright (C) 2001 George Lebl <jirka@5z.com>
+ *               2002 Sun Microsystems Inc.
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ * USA
+ *
+ * Authors: George Lebl <jirka@5z.com>,
+ *          Mark McLoughlin <mark@skynet.ie>
+ */
+
+/* Kept apart from panel-multimonitor.c, which needs a display, so that
+ * test-multimonitor-compress can run it on made up layouts. */
+
+#include <config.h>
+
+#include <string.h>
+
+#include "panel-multimonitor-compress.h"
+
+static inline gboolean
+rectangle_overlaps (GdkRectangle *a,
+		    GdkRectangle *b)
+{
+	return gdk_rectangle_intersect (a, b, NULL);
+}
+
+static long
+pixels_in_rectangle (GdkRectangle *r)
+{
+	return (long) (r->width * r->height);
+}
+
+static gint
+compare_monitors_left (gconstpointer a,
+		       gconstpointer b,
+		       gpointer      user_data)
+{
+	GdkRectangle *geometries_array = user_data;
+	int           index_a = *(const int *) a;
+	int           index_b = *(const int *) b;
+
+	if (geometries_array[index_a].x != geometries_array[index_b].x)
+		return geometries_array[index_a].x < geometries_array[index_b].x ? -1 : 1;
+
+	return index_a - index_b;
+}
+
+static int
+monitor_sets_find (int *parents,
+		   int  i)
+{
+	while (parents[i] != i) {
+		parents[i] = parents[parents[i]];
+		i = parents[i];
+	}
+
+	return i;
+}
+
+static void
+monitor_sets_join (int *parents,
+		   int  a,
+		   int  b)
+{
+	a = monitor_sets_find (parents, a);
+	b = monitor_sets_find (parents, b);
+
+	/* the set is named after its first monitor */
+	if (a < b)
+		parents[b] = a;
+	else if (b < a)
+		parents[a] = b;
+}
+
+void
+panel_multimonitor_compress_overlapping_monitors (int           *num_monitors_inout,
+						  GdkRectangle **geometries_inout)
+{
+	int           num_monitors;
+	GdkRectangle *geometries_array;
+	GdkRectangle *compressed;
+	int          *order;
+	int          *active;
+	int          *parents;
+	int          *largest;
+	int           n_active;
+	int           n_compressed;
+	int           i;
+
+	num_monitors = *num_monitors_inout;
+	geometries_array = *geometries_inout;
+
+	/* http://bugzilla.gnome.org/show_bug.cgi?id=530969
+	 * https://bugzilla.novell.com/show_bug.cgi?id=310208
+	 * and many other such bugs...
+	 *
+	 * RANDR sometimes gives us monitors that overlap (i.e. outputs whose
+	 * bounding rectangles overlap). This is sometimes right and sometimes
+	 * wrong:
+	 *
+	 *   * Right - two 1024x768 outputs at the same offset (0, 0) that show
+	 *     the same thing.  Think "laptop plus projector with the same
+	 *     resolution".
+	 *
+	 *   * Wrong - one 1280x1024 output ("laptop internal LCD") and another
+	 *     1024x768 output ("external monitor"), both at offset (0, 0).
+	 *     There is no way for the monitor with the small resolution to
+	 *     show the complete image from the laptop's LCD, unless one uses
+	 *     panning (but nobody wants panning, right!?).
+	 *
+	 * With overlapping monitors, we may end up placing the panel with
+	 * respect to the "wrong" one.  This is always wrong, as the panel
+	 * appears "in the middle of the screen" of the monitor with the
+	 * smaller resolution, instead of at the edge.
+	 *
+	 * Our strategy is to find the subsets of overlapping monitors, and
+	 * "compress" each such set to being like if there were a single
+	 * monitor with the biggest resolution of each of that set's monitors.
+	 * Say we have four monitors
+	 *
+	 *      A, B, C, D
+	 *
+	 * where B and D overlap.  In that case, we'll generate a new list that
+	 * looks like
+	 *
+	 *      A, MAX(B, D), C
+	 *
+	 * with three monitors.
+	 *
+	 * NOTE FOR THE FUTURE: We could avoid most of this mess if we had a
+	 * concept of a "primary monitor". Also, we could look at each
+	 * output's name or properties to see if it is the built-in LCD in a
+	 * laptop. However, with GTK+ 2.14.x we don't get output names, since
+	 * it gets the list outputs from Xinerama, not RANDR (and Xinerama
+	 * doesn't provide output names).
+	 */
+
+	if (num_monitors < 2)
+		return;
+
+	/* The overlapping pairs are found by sweeping the monitors from left
+	 * to right: a monitor can only overlap the ones that start to its
+	 * left and are not over yet. The pairs are joined in sets, each set
+	 * taking the place of its first monitor. */
+	order = g_new (int, num_monitors);
+	active = g_new (int, num_monitors);
+	parents = g_new (int, num_monitors);
+	largest = g_new (int, num_monitors);
+
+	for (i = 0; i < num_monitors; i++) {
+		order[i] = i;
+		parents[i] = i;
+		largest[i] = -1;
+	}
+
+	g_qsort_with_data (order, num_monitors, sizeof (int),
+			   compare_monitors_left, geometries_array);
+
+	n_active = 0;
+	for (i = 0; i < num_monitors; i++) {
+		GdkRectangle *monitor = &geometries_array[order[i]];
+		int           j = 0;
+
+		while (j < n_active) {
+			GdkRectangle *other = &geometries_array[active[j]];
+
+			if (other->x + other->width <= monitor->x) {
+				active[j] = active[--n_active];
+				continue;
+			}
+
+			if (rectangle_overlaps (monitor, other))
+				monitor_sets_join (parents, order[i], active[j]);
+			j++;
+		}
+
+		active[n_active++] = order[i];
+	}
+
+	/* keep the biggest monitor of each set, the first one of the
+	 * biggest ones */
+	for (i = 0; i < num_monitors; i++) {
+		int set = monitor_sets_find (parents, i);
+
+		if (largest[set] < 0 ||
+		    pixels_in_rectangle (&geometries_array[i]) >
+		    pixels_in_rectangle (&geometries_array[largest[set]]))
+			largest[set] = i;
+	}
+
+	compressed = g_new (GdkRectangle, num_monitors);
+	n_compressed = 0;
+	for (i = 0; i < num_monitors; i++) {
+		int set = monitor_sets_find (parents, i);
+
+		if (largest[set] < 0)
+			continue;
+
+		compressed[n_compressed++] = geometries_array[largest[set]];
+		largest[set] = -1;
+	}
+
+	g_free (order);
+	g_free (active);
+	g_free (parents);
+	g_free (largest);
+
+	memcpy (geometries_array, compressed,
+		sizeof (geometries_array[0]) * n_compressed);
+	num_monitors = n_compressed;
+	g_free (compressed);
+
+	*num_monitors_inout = num_monitors;
+	*geometries_inout = geometries_array;
+}
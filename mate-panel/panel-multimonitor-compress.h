@@ -0,0 +1,39 @@
+/*
+ * panel-multimonitor-compress.h: Merging of the overlapping monitors.
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ * USA
+ */
+
+#ifndef __PANEL_MULTIMONITOR_COMPRESS_H__
+#define __PANEL_MULTIMONITOR_COMPRESS_H__
+
+#include <gdk/gdk.h>
+
+G_BEGIN_DECLS
+
+/* Replaces each set of overlapping monitors by its biggest monitor, in
+ * place. The overlap is transitive: A, B and C are one set when A overlaps
+ * B and B overlaps C, even if A and C do not overlap. Each set takes the
+ * place of its first monitor; the biggest monitor of a set is its first
+ * one with the most pixels. */
+void panel_multimonitor_compress_overlapping_monitors (int           *num_monitors_inout,
+						       GdkRectangle **geometries_inout);
+
+G_END_DECLS
+
+#endif /* __PANEL_MULTIMONITOR_COMPRESS_H__ */
@@ -33,14 +33,21 @@
 #include <gdk/gdkx.h>
 #endif /* HAVE_X11 */
 
+#include <libpanel-util/panel-scheduler.h>
+#include <libpanel-util/panel-trace.h>
+
 #include "panel-multimonitor.h"
+#include "panel-multimonitor-compress.h"
+#include "panel-toplevel.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 /*
  * The number of logical monitors we are keeping track of
  * May be different than gdk_display_get_n_monitors()
- * (see comment in panel_multimonitor_compress_overlapping_monitors for details)
+ * (see comment in panel_multimonitor_compress_overlapping_monitors, in
+ * panel-multimonitor-compress.c, for details)
  */
 static int            monitor_count = 0;
 
@@ -50,6 +57,22 @@ static int            monitor_count = 0;
  */
 static GdkRectangle  *geometries = NULL;
 
+/*
+ * Lookup structures built from the geometries, as they are asked for on
+ * each motion event while a panel is dragged: the distinct monitor edges
+ * sorted along each axis cut the screen in cells, each of them either
+ * covered by a monitor or not. The edges of the screen each monitor
+ * touches, and the bounds of all of them, are computed once too.
+ */
+static int           *edges_x = NULL;
+static int            n_edges_x = 0;
+static int           *edges_y = NULL;
+static int            n_edges_y = 0;
+static int           *cells = NULL;
+/* leftmost, rightmost, topmost, bottommost of each monitor */
+static gboolean      *extremes = NULL;
+static GdkRectangle   bounds = { 0, 0, 0, 0 };
+
 static gboolean       initialized = FALSE;
 static gboolean       have_randr  = FALSE;
 static guint          reinit_id   = 0;
@@ -259,112 +282,6 @@ panel_multimonitor_get_raw_monitors (int           *monitors_ret,
 	panel_multimonitor_get_gdk_monitors (monitors_ret, geometries_ret);
 }
 
-static inline gboolean
-rectangle_overlaps (GdkRectangle *a,
-		    GdkRectangle *b)
-{
-	return gdk_rectangle_intersect (a, b, NULL);
-}
-
-static long
-pixels_in_rectangle (GdkRectangle *r)
-{
-	return (long) (r->width * r->height);
-}
-
-static void
-panel_multimonitor_compress_overlapping_monitors (int           *num_monitors_inout,
-						  GdkRectangle **geometries_inout)
-{
-	int           num_monitors;
-	GdkRectangle *geometries_array;
-	int           i;
-
-	num_monitors = *num_monitors_inout;
-	geometries_array = *geometries_inout;
-
-	/* http://bugzilla.gnome.org/show_bug.cgi?id=530969
-	 * https://bugzilla.novell.com/show_bug.cgi?id=310208
-	 * and many other such bugs...
-	 *
-	 * RANDR sometimes gives us monitors that overlap (i.e. outputs whose
-	 * bounding rectangles overlap). This is sometimes right and sometimes
-	 * wrong:
-	 *
-	 *   * Right - two 1024x768 outputs at the same offset (0, 0) that show
-	 *     the same thing.  Think "laptop plus projector with the same
-	 *     resolution".
-	 *
-	 *   * Wrong - one 1280x1024 output ("laptop internal LCD") and another
-	 *     1024x768 output ("external monitor"), both at offset (0, 0).
-	 *     There is no way for the monitor with the small resolution to
-	 *     show the complete image from the laptop's LCD, unless one uses
-	 *     panning (but nobody wants panning, right!?).
-	 *
-	 * With overlapping monitors, we may end up placing the panel with
-	 * respect to the "wrong" one.  This is always wrong, as the panel
-	 * appears "in the middle of the screen" of the monitor with the
-	 * smaller resolution, instead of at the edge.
-	 *
-	 * Our strategy is to find the subsets of overlapping monitors, and
-	 * "compress" each such set to being like if there were a single
-	 * monitor with the biggest resolution of each of that set's monitors.
-	 * Say we have four monitors
-	 *
-	 *      A, B, C, D
-	 *
-	 * where B and D overlap.  In that case, we'll generate a new list that
-	 * looks like
-	 *
-	 *      A, MAX(B, D), C
-	 *
-	 * with three monitors.
-	 *
-	 * NOTE FOR THE FUTURE: We could avoid most of this mess if we had a
-	 * concept of a "primary monitor". Also, we could look at each
-	 * output's name or properties to see if it is the built-in LCD in a
-	 * laptop. However, with GTK+ 2.14.x we don't get output names, since
-	 * it gets the list outputs from Xinerama, not RANDR (and Xinerama
-	 * doesn't provide output names).
-	 */
-
-	for (i = 0; i < num_monitors; i++) {
-		long max_pixels;
-		int  j;
-
-		max_pixels = pixels_in_rectangle (&geometries_array[i]);
-
-		j = i + 1;
-
-		while (j < num_monitors) {
-			if (rectangle_overlaps (&geometries_array[i],
-						&geometries_array[j])) {
-				long pixels;
-
-				pixels = pixels_in_rectangle (&geometries_array[j]);
-				if (pixels > max_pixels) {
-					max_pixels = pixels;
-					/* keep the maximum */
-					geometries_array[i] = geometries_array[j];
-				}
-
-				/* Shift the remaining monitors to the left */
-				if (num_monitors - j - 1 > 0)
-					memmove (&geometries_array[j],
-						 &geometries_array[j + 1],
-						 sizeof (geometries_array[0]) * (num_monitors - j - 1));
-
-				num_monitors--;
-				g_assert (num_monitors > 0);
-			} else
-				j++;
-		}
-	}
-
-	*num_monitors_inout = num_monitors;
-	*geometries_inout = geometries_array;
-}
-
 static gboolean
 panel_multimonitor_reinit_idle (gpointer data)
 {
@@ -381,7 +298,10 @@ panel_multimonitor_handle_screen_changed (GdkScreen *screen,
 	if (reinit_id)
 		return;
 
-	reinit_id = g_idle_add (panel_multimonitor_reinit_idle, NULL);
+	reinit_id = panel_scheduler_add (PANEL_SCHEDULER_PRIORITY_HIGH,
+					 "multimonitor-reinit",
+					 panel_multimonitor_reinit_idle,
+					 NULL, NULL);
 }
 
 static void
@@ -392,7 +312,10 @@ panel_multimonitor_handle_monitor_changed (GdkDisplay *display,
 	if (reinit_id)
 		return;
 
-	reinit_id = g_idle_add (panel_multimonitor_reinit_idle, NULL);
+	reinit_id = panel_scheduler_add (PANEL_SCHEDULER_PRIORITY_HIGH,
+					 "multimonitor-reinit",
+					 panel_multimonitor_reinit_idle,
+					 NULL, NULL);
 }
 
 static void
@@ -402,7 +325,10 @@ panel_multimonitor_handle_monitor_invalidate (GdkMonitor *monitor,
 	if (reinit_id)
 		return;
 
-	reinit_id = g_idle_add (panel_multimonitor_reinit_idle, NULL);
+	reinit_id = panel_scheduler_add (PANEL_SCHEDULER_PRIORITY_HIGH,
+					 "multimonitor-reinit",
+					 panel_multimonitor_reinit_idle,
+					 NULL, NULL);
 }
 
 #ifdef HAVE_X11
@@ -437,6 +363,123 @@ panel_multimonitor_init_randr (GdkDisplay *display)
 #endif /* HAVE_RANDR */
 #endif /* HAVE_X11 */
 
+static int
+compare_ints (gconstpointer a,
+	      gconstpointer b)
+{
+	int int_a = *(const int *) a;
+	int int_b = *(const int *) b;
+
+	return int_a < int_b ? -1 : int_a > int_b ? 1 : 0;
+}
+
+/* Sorts the edges and removes the duplicates, returns how many are left */
+static int
+sort_edges (int *edges,
+	    int  n_edges)
+{
+	int i, j;
+
+	qsort (edges, n_edges, sizeof (int), compare_ints);
+
+	for (i = 0, j = 0; i < n_edges; i++) {
+		if (j == 0 || edges[j - 1] != edges[i])
+			edges[j++] = edges[i];
+	}
+
+	return j;
+}
+
+static void
+panel_multimonitor_compute_extremes (int       n_monitor,
+				     gboolean *leftmost,
+				     gboolean *rightmost,
+				     gboolean *topmost,
+				     gboolean *bottommost);
+
+static void
+panel_multimonitor_build_index (void)
+{
+	int i, cx, cy;
+
+	g_free (edges_x);
+	g_free (edges_y);
+	g_free (cells);
+	g_free (extremes);
+
+	edges_x = g_new (int, 2 * MAX (monitor_count, 1));
+	edges_y = g_new (int, 2 * MAX (monitor_count, 1));
+
+	for (i = 0; i < monitor_count; i++) {
+		edges_x[2 * i]     = geometries[i].x;
+		edges_x[2 * i + 1] = geometries[i].x + geometries[i].width;
+		edges_y[2 * i]     = geometries[i].y;
+		edges_y[2 * i + 1] = geometries[i].y + geometries[i].height;
+	}
+
+	n_edges_x = sort_edges (edges_x, 2 * monitor_count);
+	n_edges_y = sort_edges (edges_y, 2 * monitor_count);
+
+	/* the first monitor covering a cell wins, as with a linear search */
+	cells = g_new (int, MAX (n_edges_x - 1, 1) * MAX (n_edges_y - 1, 1));
+	for (cy = 0; cy < n_edges_y - 1; cy++) {
+		for (cx = 0; cx < n_edges_x - 1; cx++) {
+			int *cell = &cells[cy * (n_edges_x - 1) + cx];
+
+			*cell = -1;
+			for (i = 0; i < monitor_count && *cell < 0; i++) {
+				if (edges_x[cx] >= geometries[i].x &&
+				    edges_x[cx + 1] <= geometries[i].x + geometries[i].width &&
+				    edges_y[cy] >= geometries[i].y &&
+				    edges_y[cy + 1] <= geometries[i].y + geometries[i].height)
+					*cell = i;
+			}
+		}
+	}
+
+	extremes = g_new (gboolean, 4 * MAX (monitor_count, 1));
+	for (i = 0; i < monitor_count; i++)
+		panel_multimonitor_compute_extremes (i,
+						     &extremes[4 * i],
+						     &extremes[4 * i + 1],
+						     &extremes[4 * i + 2],
+						     &extremes[4 * i + 3]);
+
+	if (monitor_count > 0) {
+		bounds.x = edges_x[0];
+		bounds.y = edges_y[0];
+		bounds.width = edges_x[n_edges_x - 1] - edges_x[0];
+		bounds.height = edges_y[n_edges_y - 1] - edges_y[0];
+	} else {
+		bounds.x = bounds.y = bounds.width = bounds.height = 0;
+	}
+}
+
+/* The last edge at or before p, or -1 if p is out of the edges */
+static int
+find_cell (const int *edges,
+	   int        n_edges,
+	   int        p)
+{
+	int low, high;
+
+	if (n_edges < 2 || p < edges[0] || p >= edges[n_edges - 1])
+		return -1;
+
+	low = 0;
+	high = n_edges - 1;
+	while (high - low > 1) {
+		int middle = (low + high) / 2;
+
+		if (edges[middle] <= p)
+			low = middle;
+		else
+			high = middle;
+	}
+
+	return low;
+}
+
 void
 panel_multimonitor_init (void)
 {
@@ -480,34 +523,98 @@ panel_multimonitor_init (void)
 		GdkMonitor *monitor;
 
 		monitor = gdk_display_get_monitor (display, i);
-		g_signal_handlers_disconnect_by_func (display, panel_multimonitor_handle_monitor_invalidate, NULL);
+		g_signal_handlers_disconnect_by_func (monitor, panel_multimonitor_handle_monitor_invalidate, NULL);
 		g_signal_connect (monitor, "invalidate",
 			  G_CALLBACK (panel_multimonitor_handle_monitor_invalidate), NULL);
 	}
 
 	panel_multimonitor_get_raw_monitors (&monitor_count, &geometries);
 	panel_multimonitor_compress_overlapping_monitors (&monitor_count, &geometries);
+	panel_multimonitor_build_index ();
 
 	initialized = TRUE;
 }
 
+/* The monitors are compared with what we had before: docking a laptop or
+ * waking up a screen fires many signals, most of them for no change at
+ * all, and each change only matters to the panels of the monitors that
+ * were added, removed or moved. A change of the bounds of the screen
+ * matters to every panel, as their struts are relative to them. */
 void
 panel_multimonitor_reinit (void)
 {
-	GList      *toplevels, *l;
+	GdkRectangle *old_geometries;
+	int           old_monitor_count;
+	GdkRectangle  old_bounds;
+	gboolean     *old_extremes;
+	gboolean     *changed;
+	int           n_changed = 0;
+	int           max_count;
+	int           i;
+	GSList       *l;
 
-	if (geometries)
-		g_free (geometries);
+	old_extremes = extremes;
+	old_geometries = geometries;
+	old_monitor_count = monitor_count;
+	old_bounds = bounds;
+	extremes = NULL;
+	geometries = NULL;
 
 	initialized = FALSE;
 	panel_multimonitor_init ();
 
-	toplevels = gtk_window_list_toplevels ();
+	max_count = MAX (old_monitor_count, monitor_count);
+	changed = g_new0 (gboolean, max_count);
+
+	for (i = 0; i < max_count; i++) {
+		/* other monitors moving can change which are at the edges,
+		 * and so the struts of their panels */
+		if (i >= old_monitor_count || i >= monitor_count ||
+		    !gdk_rectangle_equal (&old_geometries[i], &geometries[i]) ||
+		    memcmp (&old_extremes[4 * i], &extremes[4 * i], 4 * sizeof (gboolean)) != 0) {
+			changed[i] = TRUE;
+			n_changed++;
+		}
+	}
+
+	g_free (old_geometries);
+	g_free (old_extremes);
+
+	if (n_changed == 0) {
+		g_free (changed);
+		return;
+	}
+
+	if (panel_trace_is_enabled ()) {
+		char *name;
+
+		name = g_strdup_printf ("monitors changed: %d of %d, was %d",
+					n_changed, monitor_count, old_monitor_count);
+		panel_trace_instant ("multimonitor", name);
+		g_free (name);
+	}
+
+	if (!gdk_rectangle_equal (&old_bounds, &bounds)) {
+		GList *toplevels, *t;
+
+		toplevels = gtk_window_list_toplevels ();
+
+		for (t = toplevels; t; t = t->next)
+			gtk_widget_queue_resize (t->data);
+
+		g_list_free (toplevels);
+		g_free (changed);
+		return;
+	}
 
-	for (l = toplevels; l; l = l->next)
-		gtk_widget_queue_resize (l->data);
+	for (l = panel_toplevel_list_toplevels (); l; l = l->next) {
+		int monitor = panel_toplevel_get_monitor (l->data);
 
-	g_list_free (toplevels);
+		if (monitor < 0 || monitor >= max_count || changed[monitor])
+			gtk_widget_queue_resize (l->data);
+	}
+
+	g_free (changed);
 }
 
 int
@@ -579,7 +686,14 @@ panel_multimonitor_get_monitor_at_point (int x, int y)
 	int i;
 	int min_dist_squared;
 	int closest_monitor;
+	int cx, cy;
 
+	cx = find_cell (edges_x, n_edges_x, x);
+	cy = find_cell (edges_y, n_edges_y, y);
+	if (cx >= 0 && cy >= 0 && cells[cy * (n_edges_x - 1) + cx] >= 0)
+		return cells[cy * (n_edges_x - 1) + cx];
+
+	/* out of all monitors: look for the closest one */
 	min_dist_squared = G_MAXINT32;
 	closest_monitor = 0;
 
@@ -627,12 +741,12 @@ get_monitor_bounds (int            n_monitor,
 /* determines whether a given monitor is along the visible
  * edge of the logical screen.
  */
-void
-panel_multimonitor_is_at_visible_extreme (int        n_monitor,
-					  gboolean  *leftmost,
-					  gboolean  *rightmost,
-					  gboolean  *topmost,
-					  gboolean  *bottommost)
+static void
+panel_multimonitor_compute_extremes (int       n_monitor,
+				     gboolean *leftmost,
+				     gboolean *rightmost,
+				     gboolean *topmost,
+				     gboolean *bottommost)
 {
 	MonitorBounds monitor;
 	int           i;
@@ -675,21 +789,34 @@ panel_multimonitor_is_at_visible_extreme (int        n_monitor,
 	}
 }
 
+void
+panel_multimonitor_is_at_visible_extreme (int        n_monitor,
+					  gboolean  *leftmost,
+					  gboolean  *rightmost,
+					  gboolean  *topmost,
+					  gboolean  *bottommost)
+{
+	*leftmost   = TRUE;
+	*rightmost  = TRUE;
+	*topmost    = TRUE;
+	*bottommost = TRUE;
+
+	g_return_if_fail (n_monitor >= 0 && n_monitor < monitor_count);
+
+	*leftmost   = extremes[4 * n_monitor];
+	*rightmost  = extremes[4 * n_monitor + 1];
+	*topmost    = extremes[4 * n_monitor + 2];
+	*bottommost = extremes[4 * n_monitor + 3];
+}
+
 void
 panel_multimonitor_get_bounds (GdkPoint *min,
 			       GdkPoint *max)
 {
-	int i;
-
 	g_return_if_fail (monitor_count > 0);
 
-	min->x = min->y = G_MAXINT;
-	max->x = max->y = G_MININT;
-
-	for (i = 0; i < monitor_count; i++) {
-		min->x = MIN (min->x, geometries[i].x);
-		min->y = MIN (min->y, geometries[i].y);
-		max->x = MAX (max->x, geometries[i].x + geometries[i].width);
-		max->y = MAX (max->y, geometries[i].y + geometries[i].height);
-	}
+	min->x = bounds.x;
+	min->y = bounds.y;
+	max->x = bounds.x + bounds.width;
+	max->y = bounds.y + bounds.height;
 }
@@ -0,0 +1,287 @@
+/*
+ * panel-power.c: the power profile of the panel and its applets
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * The power-profile key picks how much the panel and its applets may wake
+ * the computer up: animations, ticks and polling. In the automatic
+ * profile, UPower tells whether we run on battery (balanced), or on a
+ * battery that is almost empty (low-power). The applets get the resulting
+ * profile as one of their properties, see panel-applet-frame-dbus.c.
+ *
+ * UPower is only watched while the profile is automatic, and it is not
+ * started for us: without it, we run as if on AC.
+ */
+
+#include <config.h>
+
+#include <gio/gio.h>
+
+#include <libpanel-util/panel-cleanup.h>
+
+#include "panel-power.h"
+#include "panel-schemas.h"
+
+#define UPOWER_BUS_NAME            "org.freedesktop.UPower"
+#define UPOWER_OBJECT_PATH         "/org/freedesktop/UPower"
+#define UPOWER_INTERFACE           "org.freedesktop.UPower"
+#define UPOWER_DISPLAY_DEVICE_PATH "/org/freedesktop/UPower/devices/DisplayDevice"
+#define UPOWER_DEVICE_INTERFACE    "org.freedesktop.UPower.Device"
+
+/* UP_DEVICE_LEVEL_LOW, the battery is almost empty */
+#define UPOWER_WARNING_LEVEL_LOW   3
+
+#define PANEL_POWER_PROFILE_KEY    "power-profile"
+
+typedef struct {
+	GCallback func;
+	gpointer  data;
+} PanelPowerNotify;
+
+typedef struct {
+	gboolean           initialized;
+
+	GSettings         *settings;
+	PanelPowerProfile  setting;
+	PanelPowerProfile  profile;
+
+	GCancellable      *cancellable;
+	GDBusProxy        *upower;
+	GDBusProxy        *display_device;
+
+	GSList            *notifies;
+} PanelPower;
+
+static PanelPower panel_power = { 0, };
+
+static void
+panel_power_update (void)
+{
+	PanelPowerProfile profile;
+	GSList           *l;
+
+	profile = panel_power.setting;
+
+	if (profile == PANEL_POWER_PROFILE_AUTO) {
+		GVariant *on_battery = NULL;
+		GVariant *warning_level = NULL;
+
+		profile = PANEL_POWER_PROFILE_NORMAL;
+
+		if (panel_power.upower)
+			on_battery = g_dbus_proxy_get_cached_property (panel_power.upower,
+								       "OnBattery");
+		if (panel_power.display_device)
+			warning_level = g_dbus_proxy_get_cached_property (panel_power.display_device,
+									  "WarningLevel");
+
+		if (on_battery &&
+		    g_variant_is_of_type (on_battery, G_VARIANT_TYPE_BOOLEAN) &&
+		    g_variant_get_boolean (on_battery))
+			profile = PANEL_POWER_PROFILE_BALANCED;
+
+		if (warning_level &&
+		    g_variant_is_of_type (warning_level, G_VARIANT_TYPE_UINT32) &&
+		    g_variant_get_uint32 (warning_level) >= UPOWER_WARNING_LEVEL_LOW)
+			profile = PANEL_POWER_PROFILE_LOW_POWER;
+
+		g_clear_pointer (&on_battery, g_variant_unref);
+		g_clear_pointer (&warning_level, g_variant_unref);
+	}
+
+	if (panel_power.profile == profile)
+		return;
+
+	panel_power.profile = profile;
+
+	for (l = panel_power.notifies; l; l = l->next) {
+		PanelPowerNotify *notify = l->data;
+
+		((void (*) (gpointer)) notify->func) (notify->data);
+	}
+}
+
+static void
+panel_power_properties_changed (GDBusProxy *proxy,
+				GVariant   *changed_properties,
+				GStrv       invalidated_properties,
+				gpointer    user_data)
+{
+	panel_power_update ();
+}
+
+static void
+panel_power_proxy_ready (GObject      *source_object,
+			 GAsyncResult *res,
+			 gpointer      user_data)
+{
+	GDBusProxy **proxy = user_data;
+	GError      *error = NULL;
+
+	*proxy = g_dbus_proxy_new_for_bus_finish (res, &error);
+	if (!*proxy) {
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			g_debug ("Cannot watch UPower: %s", error->message);
+		g_error_free (error);
+		return;
+	}
+
+	g_signal_connect (*proxy, "g-properties-changed",
+			  G_CALLBACK (panel_power_properties_changed), NULL);
+
+	panel_power_update ();
+}
+
+static void
+panel_power_watch_upower (void)
+{
+	if (panel_power.cancellable)
+		return;
+
+	panel_power.cancellable = g_cancellable_new ();
+
+	g_dbus_proxy_new_for_bus (G_BUS_TYPE_SYSTEM,
+				  G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START |
+				  G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+				  NULL,
+				  UPOWER_BUS_NAME,
+				  UPOWER_OBJECT_PATH,
+				  UPOWER_INTERFACE,
+				  panel_power.cancellable,
+				  panel_power_proxy_ready,
+				  &panel_power.upower);
+	g_dbus_proxy_new_for_bus (G_BUS_TYPE_SYSTEM,
+				  G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START |
+				  G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+				  NULL,
+				  UPOWER_BUS_NAME,
+				  UPOWER_DISPLAY_DEVICE_PATH,
+				  UPOWER_DEVICE_INTERFACE,
+				  panel_power.cancellable,
+				  panel_power_proxy_ready,
+				  &panel_power.display_device);
+}
+
+static void
+panel_power_unwatch_upower (void)
+{
+	if (panel_power.cancellable) {
+		g_cancellable_cancel (panel_power.cancellable);
+		g_clear_object (&panel_power.cancellable);
+	}
+
+	g_clear_object (&panel_power.upower);
+	g_clear_object (&panel_power.display_device);
+}
+
+static void
+panel_power_setting_changed (GSettings *settings,
+			     gchar     *key,
+			     gpointer   user_data)
+{
+	panel_power.setting = g_settings_get_enum (settings, PANEL_POWER_PROFILE_KEY);
+
+	if (panel_power.setting == PANEL_POWER_PROFILE_AUTO)
+		panel_power_watch_upower ();
+	else
+		panel_power_unwatch_upower ();
+
+	panel_power_update ();
+}
+
+static void
+panel_power_cleanup (gpointer data)
+{
+	panel_power_unwatch_upower ();
+
+	g_clear_object (&panel_power.settings);
+
+	g_slist_free_full (panel_power.notifies, g_free);
+	panel_power.notifies = NULL;
+
+	panel_power.initialized = FALSE;
+}
+
+void
+panel_power_init (void)
+{
+	if (panel_power.initialized)
+		return;
+
+	panel_power.initialized = TRUE;
+	panel_power.profile = PANEL_POWER_PROFILE_NORMAL;
+
+	panel_power.settings = g_settings_new (PANEL_SCHEMA);
+	g_signal_connect (panel_power.settings,
+			  "changed::" PANEL_POWER_PROFILE_KEY,
+			  G_CALLBACK (panel_power_setting_changed),
+			  NULL);
+	panel_power_setting_changed (panel_power.settings,
+				     PANEL_POWER_PROFILE_KEY, NULL);
+
+	panel_cleanup_register (PANEL_CLEAN_FUNC (panel_power_cleanup), NULL);
+}
+
+/* The modes of mate-panel that exit right away run in the normal one */
+PanelPowerProfile
+panel_power_get_profile (void)
+{
+	if (!panel_power.initialized)
+		return PANEL_POWER_PROFILE_NORMAL;
+
+	return panel_power.profile;
+}
+
+/* Panels slide and launchers zoom, unless in the low-power profile */
+gboolean
+panel_power_get_animate (void)
+{
+	return panel_power_get_profile () != PANEL_POWER_PROFILE_LOW_POWER;
+}
+
+void
+panel_power_notify_add (GCallback callback_func,
+			gpointer  user_data)
+{
+	PanelPowerNotify *notify;
+
+	notify = g_new0 (PanelPowerNotify, 1);
+	notify->func = callback_func;
+	notify->data = user_data;
+
+	panel_power.notifies = g_slist_append (panel_power.notifies, notify);
+}
+
+void
+panel_power_notify_remove (GCallback callback_func,
+			   gpointer  user_data)
+{
+	GSList *l;
+
+	for (l = panel_power.notifies; l; l = l->next) {
+		PanelPowerNotify *notify = l->data;
+
+		if (notify->func == callback_func && notify->data == user_data) {
+			panel_power.notifies = g_slist_delete_link (panel_power.notifies, l);
+			g_free (notify);
+			return;
+		}
+	}
+}
@@ -0,0 +1,49 @@
+/*
+ * panel-power.h: the power profile of the panel and its applets
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __PANEL_POWER_H__
+#define __PANEL_POWER_H__
+
+#include <glib.h>
+#include <glib-object.h>
+
+#include "panel-enums-gsettings.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void              panel_power_init          (void);
+
+/* never PANEL_POWER_PROFILE_AUTO */
+PanelPowerProfile panel_power_get_profile   (void);
+gboolean          panel_power_get_animate   (void);
+
+void              panel_power_notify_add    (GCallback callback_func,
+					     gpointer  user_data);
+void              panel_power_notify_remove (GCallback callback_func,
+					     gpointer  user_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PANEL_POWER_H__ */
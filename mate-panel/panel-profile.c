@@ -27,16 +27,23 @@
 
 #include "panel-profile.h"
 #include "panel-layout.h"
+#include "panel-layout-snapshot.h"
 
 #include <string.h>
 #include <glib/gi18n.h>
 #include <gio/gio.h>
+#define G_SETTINGS_ENABLE_BACKEND
+#include <gio/gsettingsbackend.h>
+#include <dconf.h>
 
 #ifdef HAVE_X11
 #include <gdk/gdkx.h>
+#include "panel-struts.h"
 #endif
 
 #include <libpanel-util/panel-list.h>
+#include <libpanel-util/panel-scheduler.h>
+#include <libpanel-util/panel-trace.h>
 #include <libmate-desktop/mate-dconf.h>
 #include <libmate-desktop/mate-gsettings.h>
 
@@ -48,6 +55,7 @@
 #include "panel-toplevel.h"
 #include "panel-lockdown.h"
 #include "panel-schemas.h"
+#include "panel-typebuiltins.h"
 
 typedef struct {
 	GdkScreen       *screen;
@@ -80,11 +88,34 @@ typedef void        (*PanelProfileDestroyFunc) (const char        *id);
 
 static GSettings *profile_settings = NULL;
 
+/* All the object keys, read in a single pass while loading the profile.
+ * Reading them through a transient GSettings per object would also add
+ * (and remove) a dconf watch on each object path. */
+static GHashTable      *profile_objects_snapshot = NULL;
+static GSettingsSchema *profile_object_schema = NULL;
+
 static GQuark toplevel_id_quark = 0;
 #if 0
 static GQuark queued_changes_quark = 0;
 #endif
-static GQuark commit_timeout_quark = 0;
+
+/* The writes to the profile during one interaction, like moving a panel or
+ * dropping applets on it, are collected in delayed copies of the settings
+ * they are for, and applied together at its end: dconf merges the changes
+ * made while its first write is in flight, so an interaction costs one or
+ * two writes instead of one per key. Outside an interaction, the journal
+ * only gets the location changes of the panels, applied after a moment. */
+static GQuark echoes_quark = 0;
+
+static GHashTable *profile_journal = NULL;
+static guint       profile_journal_depth = 0;
+static guint       profile_journal_commit_id = 0;
+
+/* The settings of the objects and toplevels, shared by all the code using
+ * the same path: each GSettings subscribes to the changes of its path, and
+ * creating one for a short lookup costs a dconf watch and its removal. The
+ * pool does not own them: an entry goes away with its last reference. */
+static GHashTable *profile_settings_pool = NULL;
 
 static void panel_profile_object_id_list_update (gchar **objects);
 static void panel_profile_ensure_toplevel_per_screen (void);
@@ -172,38 +203,171 @@ panel_profile_find_new_id (PanelGSettingsKeyType type)
 }
 
 static void
-panel_profile_remove_commit_timeout (guint timeout)
+panel_profile_journal_commit (void)
+{
+	GHashTable     *journal;
+	GHashTableIter  iter;
+	gpointer        settings;
+
+	if (profile_journal_commit_id) {
+		g_source_remove (profile_journal_commit_id);
+		profile_journal_commit_id = 0;
+	}
+
+	journal = profile_journal;
+	profile_journal = NULL;
+
+	if (!journal)
+		return;
+
+	g_hash_table_iter_init (&iter, journal);
+	while (g_hash_table_iter_next (&iter, NULL, &settings))
+		if (g_settings_get_has_unapplied (settings))
+			g_settings_apply (settings);
+
+	g_hash_table_destroy (journal);
+}
+
+static gboolean
+panel_profile_journal_commit_timeout (gpointer data)
+{
+	profile_journal_commit_id = 0;
+
+	panel_profile_journal_commit ();
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Returns the delayed copy of @settings in the journal. */
+static GSettings *
+panel_profile_journal_get_delayed (GSettings *settings)
+{
+	GSettingsSchema *schema;
+	GSettings       *delayed;
+	char            *path;
+
+	g_object_get (settings,
+		      "settings-schema", &schema,
+		      "path", &path,
+		      NULL);
+
+	if (!profile_journal)
+		profile_journal = g_hash_table_new_full (g_str_hash, g_str_equal,
+							 g_free, g_object_unref);
+
+	delayed = g_hash_table_lookup (profile_journal, path);
+	if (!delayed) {
+		delayed = g_settings_new_full (schema, NULL,
+					       g_settings_schema_get_path (schema) ? NULL : path);
+		g_settings_delay (delayed);
+		g_hash_table_insert (profile_journal, path, delayed);
+	} else
+		g_free (path);
+
+	g_settings_schema_unref (schema);
+
+	if (profile_journal_depth == 0 && !profile_journal_commit_id)
+		profile_journal_commit_id =
+			g_timeout_add (500, panel_profile_journal_commit_timeout, NULL);
+
+	return delayed;
+}
+
+static gboolean
+panel_profile_journal_remove_dir (gpointer key,
+				  gpointer value,
+				  gpointer dir)
 {
-	g_source_remove (timeout);
+	if (!g_str_has_prefix (key, dir))
+		return FALSE;
+
+	g_settings_revert (value);
+
+	return TRUE;
 }
 
+/* Drops the pending writes to a directory that is being deleted */
 static void
-panel_profile_set_commit_timeout (PanelToplevel *toplevel,
-				  guint          timeout)
+panel_profile_journal_forget (const char *dir)
 {
-	GDestroyNotify destroy_notify;
+	if (profile_journal)
+		g_hash_table_foreach_remove (profile_journal,
+					     panel_profile_journal_remove_dir,
+					     (gpointer) dir);
+}
 
-	if (!commit_timeout_quark)
-		commit_timeout_quark = g_quark_from_static_string ("panel-queued-timeout");
+void
+panel_profile_journal_begin (void)
+{
+	profile_journal_depth++;
 
-	if (timeout)
-		destroy_notify = (GDestroyNotify) panel_profile_remove_commit_timeout;
-	else
-		destroy_notify = NULL;
+	if (profile_journal_commit_id) {
+		g_source_remove (profile_journal_commit_id);
+		profile_journal_commit_id = 0;
+	}
+}
 
-	g_object_set_qdata_full (G_OBJECT (toplevel),
-				 commit_timeout_quark,
-				 GUINT_TO_POINTER (timeout),
-				 destroy_notify);
+void
+panel_profile_journal_end (void)
+{
+	g_return_if_fail (profile_journal_depth > 0);
+
+	if (--profile_journal_depth == 0)
+		panel_profile_journal_commit ();
+}
+
+static void
+panel_profile_settings_pool_remove (gpointer  data,
+				    GObject  *where_the_object_was)
+{
+	g_hash_table_remove (profile_settings_pool, data);
+}
+
+/**
+ * panel_profile_get_settings:
+ * @schema_id: the id of a relocatable schema
+ * @path: the path of the settings
+ *
+ * Returns: (transfer full): the settings of @path, shared with the other
+ * users of the same path. They must not be put in delay-apply mode.
+ */
+GSettings *
+panel_profile_get_settings (const char *schema_id,
+			    const char *path)
+{
+	GSettings *settings;
+	char      *key;
+
+	g_return_val_if_fail (schema_id != NULL, NULL);
+	g_return_val_if_fail (path != NULL, NULL);
+
+	if (!profile_settings_pool)
+		profile_settings_pool = g_hash_table_new_full (g_str_hash, g_str_equal,
+							       g_free, NULL);
+
+	key = g_strconcat (schema_id, ":", path, NULL);
+
+	settings = g_hash_table_lookup (profile_settings_pool, key);
+	if (settings) {
+		g_free (key);
+		return g_object_ref (settings);
+	}
+
+	settings = g_settings_new_with_path (schema_id, path);
+	g_hash_table_insert (profile_settings_pool, key, settings);
+	g_object_weak_ref (G_OBJECT (settings),
+			   panel_profile_settings_pool_remove, key);
+
+	return settings;
 }
 
-static guint
-panel_profile_get_commit_timeout (GObject *object)
+GSettings *
+panel_profile_journal_settings (GSettings *settings)
 {
-	if (!commit_timeout_quark)
-		return 0;
+	if (profile_journal_depth == 0)
+		return settings;
 
-	return GPOINTER_TO_UINT (g_object_get_qdata (object, commit_timeout_quark));
+	return panel_profile_journal_get_delayed (settings);
 }
 
 gboolean
@@ -220,7 +384,7 @@ void
 panel_profile_set_background_type (PanelToplevel       *toplevel,
 				   PanelBackgroundType  background_type)
 {
-	g_settings_set_enum (toplevel->background_settings,
+	g_settings_set_enum (panel_profile_journal_settings (toplevel->background_settings),
 						 "type",
 						 background_type);
 }
@@ -242,7 +406,8 @@ panel_profile_set_background_color (PanelToplevel *toplevel,
 
 	color_str = gdk_rgba_to_string (color);
 
-	g_settings_set_string (toplevel->background_settings, "color", color_str);
+	g_settings_set_string (panel_profile_journal_settings (toplevel->background_settings),
+			       "color", color_str);
 
 	g_free (color_str);
 }
@@ -286,10 +451,14 @@ void
 panel_profile_set_background_image (PanelToplevel *toplevel,
 				    const char    *image)
 {
+	GSettings *settings;
+
+	settings = panel_profile_journal_settings (toplevel->background_settings);
+
 	if (image && image [0])
-		g_settings_set_string (toplevel->background_settings, "image", image);
+		g_settings_set_string (settings, "image", image);
 	else
-		g_settings_reset (toplevel->background_settings, "image");
+		g_settings_reset (settings, "image");
 }
 
 char *
@@ -302,10 +471,14 @@ void
 panel_profile_set_toplevel_name (PanelToplevel *toplevel,
 				 const char    *name)
 {
+	GSettings *settings;
+
+	settings = panel_profile_journal_settings (toplevel->settings);
+
 	if (name && name [0])
-		g_settings_set_string (toplevel->settings, "name", name);
+		g_settings_set_string (settings, "name", name);
 	else
-		g_settings_reset (toplevel->settings, "name");
+		g_settings_reset (settings, "name");
 }
 
 char *
@@ -318,7 +491,8 @@ void
 panel_profile_set_toplevel_orientation (PanelToplevel    *toplevel,
 					PanelOrientation  orientation)
 {
-	g_settings_set_enum (toplevel->settings, "orientation", orientation);
+	g_settings_set_enum (panel_profile_journal_settings (toplevel->settings),
+			     "orientation", orientation);
 }
 
 PanelOrientation
@@ -333,7 +507,7 @@ panel_profile_get_toplevel_orientation (PanelToplevel *toplevel)
 	void                                                          \
 	panel_profile_set_##p##_##s (PanelToplevel *toplevel, a s)    \
 	{                                                             \
-		g_settings_set_##t (toplevel->settings, k, s);            \
+		g_settings_set_##t (panel_profile_journal_settings (toplevel->settings), k, s); \
 	}                                                             \
 	a                                                             \
 	panel_profile_get_##p##_##s (PanelToplevel *toplevel)         \
@@ -353,7 +527,7 @@ TOPLEVEL_GET_SET_FUNCS ("enable-arrows",      toplevel,   boolean, enable_arrows
 	void                                                          \
 	panel_profile_set_##p##_##s (PanelToplevel *toplevel, a s)    \
 	{                                                             \
-		g_settings_set_##t (toplevel->background_settings, k, s);            \
+		g_settings_set_##t (panel_profile_journal_settings (toplevel->background_settings), k, s); \
 	}                                                             \
 	a                                                             \
 	panel_profile_get_##p##_##s (PanelToplevel *toplevel)         \
@@ -383,7 +557,7 @@ panel_profile_get_attached_object_settings (PanelToplevel *toplevel)
 		return NULL;
 
 	path = g_strdup_printf (PANEL_OBJECT_PATH "%s/", id);
-	settings = g_settings_new_with_path (PANEL_OBJECT_SCHEMA, path);
+	settings = panel_profile_get_settings (PANEL_OBJECT_SCHEMA, path);
 	g_free (path);
 
 	return settings;
@@ -394,10 +568,12 @@ panel_profile_set_attached_custom_icon (PanelToplevel *toplevel,
 					const char    *custom_icon)
 {
 	GSettings *settings;
+	GSettings *writer;
 	settings = panel_profile_get_attached_object_settings (toplevel);
+	writer = panel_profile_journal_settings (settings);
 
-	g_settings_set_boolean (settings, PANEL_OBJECT_USE_CUSTOM_ICON_KEY, custom_icon != NULL);
-	g_settings_set_string (settings, PANEL_OBJECT_CUSTOM_ICON_KEY, sure_string (custom_icon));
+	g_settings_set_boolean (writer, PANEL_OBJECT_USE_CUSTOM_ICON_KEY, custom_icon != NULL);
+	g_settings_set_string (writer, PANEL_OBJECT_CUSTOM_ICON_KEY, sure_string (custom_icon));
 
 	g_object_unref (settings);
 }
@@ -446,7 +622,8 @@ panel_profile_set_attached_tooltip (PanelToplevel *toplevel,
 {
 	GSettings *settings;
 	settings = panel_profile_get_attached_object_settings (toplevel);
-	g_settings_set_string (settings, PANEL_OBJECT_TOOLTIP_KEY, tooltip);
+	g_settings_set_string (panel_profile_journal_settings (settings),
+			       PANEL_OBJECT_TOOLTIP_KEY, tooltip);
 	g_object_unref (settings);
 }
 
@@ -524,86 +701,170 @@ panel_profile_load_background (PanelToplevel *toplevel)
 	g_free (image);
 }
 
+/* The location of a toplevel is written back from its own state: the
+ * notifies of these writes would only set the same values again, or worse,
+ * values that the toplevel left while they were being written. Each
+ * written value is kept until its notify arrives, to skip it, but only
+ * for a moment: dconf does not notify a write that changes nothing, and a
+ * later change made elsewhere to the same value must not be taken for the
+ * echo. */
+#define PANEL_PROFILE_ECHO_TIMEOUT (2 * G_USEC_PER_SEC)
+
+typedef struct {
+	GVariant *value;
+	gint64    expires;
+} PanelProfileEcho;
+
+static void
+panel_profile_echo_free (PanelProfileEcho *echo)
+{
+	g_variant_unref (echo->value);
+	g_free (echo);
+}
+
+static void
+panel_profile_expect_echo (PanelToplevel *toplevel,
+			   GSettings     *settings,
+			   const char    *key)
+{
+	GHashTable       *echoes;
+	PanelProfileEcho *echo;
+
+	if (!echoes_quark)
+		echoes_quark = g_quark_from_static_string ("panel-profile-echoes");
+
+	echoes = g_object_get_qdata (G_OBJECT (toplevel), echoes_quark);
+	if (!echoes) {
+		echoes = g_hash_table_new_full (g_str_hash, g_str_equal,
+						g_free, (GDestroyNotify) panel_profile_echo_free);
+		g_object_set_qdata_full (G_OBJECT (toplevel), echoes_quark,
+					 echoes, (GDestroyNotify) g_hash_table_destroy);
+	}
+
+	/* the journal applies this write within its commit timeout, or at
+	 * the end of the interaction, which expects the key again on each
+	 * change it makes */
+	echo = g_new (PanelProfileEcho, 1);
+	echo->value = g_settings_get_value (settings, key);
+	echo->expires = g_get_monotonic_time () + PANEL_PROFILE_ECHO_TIMEOUT;
+
+	g_hash_table_replace (echoes, g_strdup (key), echo);
+}
+
 static gboolean
-panel_profile_commit_toplevel_changes (PanelToplevel *toplevel)
+panel_profile_is_echo (PanelToplevel *toplevel,
+		       GSettings     *settings,
+		       const char    *key)
 {
-	if (g_settings_get_has_unapplied (toplevel->queued_settings))
-		g_settings_apply (toplevel->queued_settings);
+	GHashTable       *echoes;
+	PanelProfileEcho *expected;
+	GVariant         *value;
+	gboolean          retval;
 
-	panel_profile_set_commit_timeout (toplevel, 0);
+	if (!echoes_quark)
+		return FALSE;
 
-	return FALSE;
+	echoes = g_object_get_qdata (G_OBJECT (toplevel), echoes_quark);
+	if (!echoes)
+		return FALSE;
+
+	expected = g_hash_table_lookup (echoes, key);
+	if (!expected)
+		return FALSE;
+
+	if (g_get_monotonic_time () > expected->expires) {
+		g_hash_table_remove (echoes, key);
+		return FALSE;
+	}
+
+	value = g_settings_get_value (settings, key);
+	retval = g_variant_equal (value, expected->value);
+	g_variant_unref (value);
+
+	g_hash_table_remove (echoes, key);
+
+	return retval;
 }
 
 static void
 panel_profile_queue_toplevel_location_change (PanelToplevel          *toplevel,
 					      ToplevelLocationChange *change)
 {
-	guint commit_timeout;
+	GSettings *settings;
 
-	g_settings_delay (toplevel->queued_settings);
+	settings = panel_profile_journal_get_delayed (toplevel->settings);
 
 #ifdef HAVE_X11
 	if (change->screen_changed &&
 	    GDK_IS_X11_SCREEN (change->screen)) {
-		g_settings_set_int (toplevel->queued_settings,
+		g_settings_set_int (settings,
 							"screen",
 							gdk_x11_screen_get_screen_number (change->screen));
+		panel_profile_expect_echo (toplevel, settings, "screen");
 	}
 #endif
 
-	if (change->monitor_changed)
-		g_settings_set_int (toplevel->queued_settings,
+	if (change->monitor_changed) {
+		g_settings_set_int (settings,
 							"monitor",
 							change->monitor);
+		panel_profile_expect_echo (toplevel, settings, "monitor");
+	}
 
-	if (change->size_changed)
-		g_settings_set_int (toplevel->queued_settings,
+	if (change->size_changed) {
+		g_settings_set_int (settings,
 									 "size",
 									 change->size);
+		panel_profile_expect_echo (toplevel, settings, "size");
+	}
 
-	if (change->orientation_changed)
-		g_settings_set_enum (toplevel->queued_settings,
+	if (change->orientation_changed) {
+		g_settings_set_enum (settings,
 										"orientation",
 										change->orientation);
+		panel_profile_expect_echo (toplevel, settings, "orientation");
+	}
 
-	if (change->x_changed)
-		g_settings_set_int (toplevel->queued_settings,
+	if (change->x_changed) {
+		g_settings_set_int (settings,
 							"x",
 							change->x);
+		panel_profile_expect_echo (toplevel, settings, "x");
+	}
 
-	if (change->x_right_changed)
-		g_settings_set_int (toplevel->queued_settings,
+	if (change->x_right_changed) {
+		g_settings_set_int (settings,
 							"x-right",
 							change->x_right);
+		panel_profile_expect_echo (toplevel, settings, "x-right");
+	}
 
-	if (change->x_centered_changed)
-		g_settings_set_boolean (toplevel->queued_settings,
+	if (change->x_centered_changed) {
+		g_settings_set_boolean (settings,
 								"x-centered",
 								change->x_centered);
+		panel_profile_expect_echo (toplevel, settings, "x-centered");
+	}
 
-	if (change->y_changed)
-		g_settings_set_int (toplevel->queued_settings,
+	if (change->y_changed) {
+		g_settings_set_int (settings,
 							"y",
 							change->y);
+		panel_profile_expect_echo (toplevel, settings, "y");
+	}
 
-	if (change->y_bottom_changed)
-		g_settings_set_int (toplevel->queued_settings,
+	if (change->y_bottom_changed) {
+		g_settings_set_int (settings,
 							"y-bottom",
 							change->y_bottom);
+		panel_profile_expect_echo (toplevel, settings, "y-bottom");
+	}
 
-	if (change->y_centered_changed)
-		g_settings_set_boolean (toplevel->queued_settings,
+	if (change->y_centered_changed) {
+		g_settings_set_boolean (settings,
 								"y-centered",
 								change->y_centered);
-
-	commit_timeout = panel_profile_get_commit_timeout (G_OBJECT (toplevel));
-	if (!commit_timeout) {
-		commit_timeout =
-			g_timeout_add (500,
-				       (GSourceFunc) panel_profile_commit_toplevel_changes,
-				       toplevel);
-		panel_profile_set_commit_timeout (toplevel, commit_timeout);
+		panel_profile_expect_echo (toplevel, settings, "y-centered");
 	}
 }
 
@@ -686,6 +947,9 @@ panel_profile_toplevel_change_notify (GSettings *settings,
 	if (toplevel == NULL || !PANEL_IS_TOPLEVEL (toplevel))
 		return;
 
+	if (panel_profile_is_echo (toplevel, settings, key))
+		return;
+
 #define UPDATE_STRING(k, n)                                                     \
 		if (!strcmp (key, k)) {                                                 \
 			gchar *value = g_settings_get_string (settings, key);               \
@@ -1007,7 +1271,7 @@ panel_profile_create_toplevel (GdkScreen *screen)
 
 	path = g_strdup_printf (PANEL_TOPLEVEL_PATH "%s/", id);
 
-	settings = g_settings_new_with_path (PANEL_TOPLEVEL_SCHEMA, path);
+	settings = panel_profile_get_settings (PANEL_TOPLEVEL_SCHEMA, path);
 	g_free (path);
 
 	screen_number = 0;
@@ -1046,7 +1310,7 @@ panel_profile_delete_toplevel_objects (const char *toplevel_id)
 		GSettings *settings;
 
 		path = g_strdup_printf (PANEL_OBJECT_PATH "%s/", list[i]);
-		settings = g_settings_new_with_path (PANEL_OBJECT_SCHEMA, path);
+		settings = panel_profile_get_settings (PANEL_OBJECT_SCHEMA, path);
 		parent_toplevel_id = g_settings_get_string (settings, PANEL_OBJECT_TOPLEVEL_ID_KEY);
 		g_free (path);
 		g_object_unref (settings);
@@ -1098,16 +1362,17 @@ panel_profile_load_toplevel (const char *toplevel_id)
 		return NULL;
 	}
 
+	panel_trace_begin ("profile", toplevel_id);
+
 	toplevel = g_object_new (PANEL_TYPE_TOPLEVEL,
 				 "screen", screen,
 				 NULL);
 
 	panel_toplevel_set_settings_path (toplevel, toplevel_path);
-	toplevel->settings = g_settings_new_with_path (PANEL_TOPLEVEL_SCHEMA, toplevel_path);
-	toplevel->queued_settings = g_settings_new_with_path (PANEL_TOPLEVEL_SCHEMA, toplevel_path);
+	toplevel->settings = panel_profile_get_settings (PANEL_TOPLEVEL_SCHEMA, toplevel_path);
 
 	toplevel_background_path = g_strdup_printf ("%sbackground/", toplevel_path);
-	toplevel->background_settings = g_settings_new_with_path (PANEL_TOPLEVEL_BACKGROUND_SCHEMA, toplevel_background_path);
+	toplevel->background_settings = panel_profile_get_settings (PANEL_TOPLEVEL_BACKGROUND_SCHEMA, toplevel_background_path);
 
 #define GET_INT(k, fn)                                              \
 	{                                                               \
@@ -1186,6 +1451,8 @@ panel_profile_load_toplevel (const char *toplevel_id)
 
 	panel_setup (toplevel);
 
+	panel_trace_end ("profile", toplevel_id);
+
 	return toplevel;
 }
 
@@ -1222,13 +1489,47 @@ panel_profile_load_and_show_toplevel (char *toplevel_id)
 	g_object_unref (panel_settings);
 }
 
+/* The toplevels loaded at startup, shown together once all are loaded */
+static GSList *startup_toplevels = NULL;
+
 static void
 panel_profile_load_and_show_toplevel_startup (const char *toplevel_id)
 {
 	PanelToplevel *toplevel;
 	toplevel = panel_profile_load_toplevel (toplevel_id);
-	if (toplevel)
-		gtk_widget_show (GTK_WIDGET (toplevel));
+	if (toplevel) {
+		panel_layout_snapshot_apply (toplevel);
+		startup_toplevels = g_slist_prepend (startup_toplevels, toplevel);
+	}
+}
+
+/* Showing the toplevels one at a time resolved the struts again for each
+ * of them, and moved the ones shown before: they are all laid out with a
+ * single resolution of their struts, and mapped in the same iteration of
+ * the main loop. */
+static void
+panel_profile_show_startup_toplevels (void)
+{
+	GSList *l;
+#ifdef HAVE_X11
+	gboolean x11 = GDK_IS_X11_DISPLAY (gdk_display_get_default ());
+
+	if (x11)
+		panel_struts_freeze ();
+#endif
+
+	startup_toplevels = g_slist_reverse (startup_toplevels);
+
+	for (l = startup_toplevels; l; l = l->next)
+		gtk_widget_show (GTK_WIDGET (l->data));
+
+#ifdef HAVE_X11
+	if (x11)
+		panel_struts_thaw ();
+#endif
+
+	g_slist_free (startup_toplevels);
+	startup_toplevels = NULL;
 }
 
 static void
@@ -1258,7 +1559,7 @@ panel_profile_prepare_object_with_id (PanelObjectType  object_type,
 
 	settings_path = g_strdup_printf (PANEL_OBJECT_PATH "%s/", id);
 
-	settings = g_settings_new_with_path (PANEL_OBJECT_SCHEMA, settings_path);
+	settings = panel_profile_get_settings (PANEL_OBJECT_SCHEMA, settings_path);
 
 	g_settings_set_enum (settings, PANEL_OBJECT_TYPE_KEY, object_type);
 	g_settings_set_string (settings, PANEL_OBJECT_TOPLEVEL_ID_KEY, toplevel_id);
@@ -1300,6 +1601,155 @@ panel_profile_delete_object (AppletInfo *applet_info)
 	panel_profile_remove_from_list (type, id);
 }
 
+static void
+panel_profile_snapshot_objects (void)
+{
+	GSettingsSchemaSource  *source;
+	GSettingsBackend       *backend;
+	DConfClient            *client;
+	gchar                 **dirs;
+	gint                    n_dirs;
+	gint                    i;
+
+	/* We read dconf directly, which is only right if GSettings does */
+	backend = g_settings_backend_get_default ();
+	if (g_strcmp0 (G_OBJECT_TYPE_NAME (backend), "DConfSettingsBackend") != 0) {
+		g_object_unref (backend);
+		return;
+	}
+	g_object_unref (backend);
+
+	source = g_settings_schema_source_get_default ();
+	profile_object_schema = g_settings_schema_source_lookup (source, PANEL_OBJECT_SCHEMA, TRUE);
+	if (!profile_object_schema)
+		return;
+
+	profile_objects_snapshot = g_hash_table_new_full (g_str_hash,
+							  g_str_equal,
+							  (GDestroyNotify) g_free,
+							  (GDestroyNotify) g_variant_unref);
+
+	client = dconf_client_new ();
+
+	dirs = dconf_client_list (client, PANEL_OBJECT_PATH, &n_dirs);
+	for (i = 0; i < n_dirs; i++) {
+		gchar  *dir;
+		gchar **keys;
+		gint    n_keys;
+		gint    j;
+
+		if (!g_str_has_suffix (dirs[i], "/"))
+			continue;
+
+		dir = g_strconcat (PANEL_OBJECT_PATH, dirs[i], NULL);
+
+		keys = dconf_client_list (client, dir, &n_keys);
+		for (j = 0; j < n_keys; j++) {
+			GVariant *value;
+			gchar    *key;
+
+			/* skip the prefs/ subdir of applets */
+			if (g_str_has_suffix (keys[j], "/"))
+				continue;
+
+			key = g_strconcat (dir, keys[j], NULL);
+			value = dconf_client_read (client, key);
+
+			if (value)
+				g_hash_table_insert (profile_objects_snapshot, key, value);
+			else
+				g_free (key);
+		}
+		g_strfreev (keys);
+
+		g_free (dir);
+	}
+	g_strfreev (dirs);
+
+	g_object_unref (client);
+}
+
+static void
+panel_profile_snapshot_free (void)
+{
+	g_clear_pointer (&profile_objects_snapshot, g_hash_table_destroy);
+	g_clear_pointer (&profile_object_schema, g_settings_schema_unref);
+}
+
+/* Returns the value of an object key from the snapshot, falling back to the
+ * schema default like GSettings does */
+static GVariant *
+panel_profile_snapshot_get_value (const char *id,
+				  const char *key)
+{
+	GSettingsSchemaKey *schema_key;
+	GVariant           *value;
+	char               *path;
+
+	schema_key = g_settings_schema_get_key (profile_object_schema, key);
+
+	path = g_strdup_printf (PANEL_OBJECT_PATH "%s/%s", id, key);
+	value = g_hash_table_lookup (profile_objects_snapshot, path);
+	g_free (path);
+
+	if (value &&
+	    g_variant_is_of_type (value, g_settings_schema_key_get_value_type (schema_key)) &&
+	    g_settings_schema_key_range_check (schema_key, value))
+		value = g_variant_ref (value);
+	else
+		value = g_settings_schema_key_get_default_value (schema_key);
+
+	g_settings_schema_key_unref (schema_key);
+
+	return value;
+}
+
+static void
+panel_profile_load_object_from_snapshot (const char *id)
+{
+	PanelObjectType  object_type = PANEL_OBJECT_APPLET;
+	GEnumClass      *enum_class;
+	GEnumValue      *enum_value;
+	GVariant        *value;
+	const char      *toplevel_id;
+	GVariant        *toplevel_id_value;
+	int              position;
+	gboolean         right_stick;
+	gboolean         locked;
+
+	value = panel_profile_snapshot_get_value (id, PANEL_OBJECT_TYPE_KEY);
+	enum_class = g_type_class_ref (PANEL_TYPE_OBJECT_TYPE);
+	enum_value = g_enum_get_value_by_nick (enum_class, g_variant_get_string (value, NULL));
+	if (enum_value)
+		object_type = enum_value->value;
+	g_type_class_unref (enum_class);
+	g_variant_unref (value);
+
+	value = panel_profile_snapshot_get_value (id, PANEL_OBJECT_POSITION_KEY);
+	position = g_variant_get_int32 (value);
+	g_variant_unref (value);
+
+	value = panel_profile_snapshot_get_value (id, PANEL_OBJECT_PANEL_RIGHT_STICK_KEY);
+	right_stick = g_variant_get_boolean (value);
+	g_variant_unref (value);
+
+	value = panel_profile_snapshot_get_value (id, PANEL_OBJECT_LOCKED_KEY);
+	locked = g_variant_get_boolean (value);
+	g_variant_unref (value);
+
+	toplevel_id_value = panel_profile_snapshot_get_value (id, PANEL_OBJECT_TOPLEVEL_ID_KEY);
+	toplevel_id = g_variant_get_string (toplevel_id_value, NULL);
+
+	mate_panel_applet_queue_applet_to_load (id,
+					   object_type,
+					   toplevel_id,
+					   position,
+					   right_stick,
+					   locked);
+
+	g_variant_unref (toplevel_id_value);
+}
+
 static void
 panel_profile_load_object (char *id)
 {
@@ -1311,8 +1761,13 @@ panel_profile_load_object (char *id)
 	gboolean         locked;
 	GSettings       *settings;
 
+	if (profile_objects_snapshot) {
+		panel_profile_load_object_from_snapshot (id);
+		return;
+	}
+
 	object_path = g_strdup_printf (PANEL_OBJECT_PATH "%s/", id);
-	settings = g_settings_new_with_path (PANEL_OBJECT_SCHEMA, object_path);
+	settings = panel_profile_get_settings (PANEL_OBJECT_SCHEMA, object_path);
 
 	object_type = g_settings_get_enum (settings, PANEL_OBJECT_TYPE_KEY);
 	position = g_settings_get_int (settings, PANEL_OBJECT_POSITION_KEY);
@@ -1360,6 +1815,8 @@ panel_profile_delete_dir (PanelGSettingsKeyType  type,
 			break;
 	}
 
+	panel_profile_journal_forget (dir);
+
 	if (type == PANEL_GSETTINGS_TOPLEVELS) {
 		gchar *subdir;
 		subdir = g_strdup_printf (PANEL_TOPLEVEL_PATH "%s/background/", id);
@@ -1380,46 +1837,41 @@ panel_profile_delete_dir (PanelGSettingsKeyType  type,
 	}
 }
 
-static gboolean
-panel_profile_object_exists (GSList                *list,
-			     const char            *id,
+/* The id lists are diffed through sets: a new layout can change the
+ * whole list, which would make a pairwise comparison quadratic. */
+static GHashTable *
+panel_profile_object_id_set (GSList                *list,
 			     PanelProfileGetIdFunc  get_id_func)
 {
-	GSList *l;
+	GHashTable *set;
+	GSList     *l;
 
-	if (!list || !id)
-		return FALSE;
+	set = g_hash_table_new (g_str_hash, g_str_equal);
 
 	for (l = list; l; l = l->next) {
-		const char *check_id;
+		const char *id;
 
-		check_id = get_id_func (l->data);
-		g_assert (check_id != NULL);
+		id = get_id_func (l->data);
+		g_assert (id != NULL);
 
-		if (!strcmp (check_id, id))
-			return TRUE;
+		g_hash_table_add (set, (gpointer) id);
 	}
 
-	return FALSE;
+	return set;
 }
 
-static gboolean
-panel_profile_id_exists (GSList     *id_list,
-			 const char *id)
+static GHashTable *
+panel_profile_id_set (GSList *id_list)
 {
-	GSList *l;
-
-	if (!id_list || !id)
-		return FALSE;
+	GHashTable *set;
+	GSList     *l;
 
-	for (l = id_list; l; l = l->next) {
-		const char *check_id = l->data;
+	set = g_hash_table_new (g_str_hash, g_str_equal);
 
-		if (!strcmp (id, check_id))
-			return TRUE;
-	}
+	for (l = id_list; l; l = l->next)
+		g_hash_table_add (set, l->data);
 
-	return FALSE;
+	return set;
 }
 
 static void
@@ -1429,17 +1881,22 @@ panel_profile_load_added_ids (GSList                 *list,
 							  PanelProfileLoadFunc    load_handler,
 							  PanelProfileOnLoadQueue on_load_queue)
 {
-	GSList *added_ids = NULL;
-	GSList *l;
+	GHashTable *existing_ids;
+	GSList     *added_ids = NULL;
+	GSList     *l;
+
+	existing_ids = panel_profile_object_id_set (list, get_id_func);
 
 	for (l = id_list; l; l = l->next) {
 		const char *id = l->data;
 
-		if (!panel_profile_object_exists (list, id, get_id_func) &&
+		if (!g_hash_table_contains (existing_ids, id) &&
 		    (on_load_queue == NULL || !on_load_queue (id)))
 			added_ids = g_slist_prepend (added_ids, g_strdup (id));
 	}
 
+	g_hash_table_destroy (existing_ids);
+
 	for (l = added_ids; l; l = l->next) {
 		char *id;
 		id = (char *) l->data;
@@ -1460,18 +1917,23 @@ panel_profile_delete_removed_ids (PanelGSettingsKeyType    type,
 								  PanelProfileGetIdFunc    get_id_func,
 								  PanelProfileDestroyFunc  destroy_handler)
 {
-	GSList *removed_ids = NULL;
-	GSList *l;
+	GHashTable *ids;
+	GSList     *removed_ids = NULL;
+	GSList     *l;
+
+	ids = panel_profile_id_set (id_list);
 
 	for (l = list; l; l = l->next) {
 		const char *id;
 
 		id = get_id_func (l->data);
 
-		if (!panel_profile_id_exists (id_list, id))
+		if (!g_hash_table_contains (ids, id))
 			removed_ids = g_slist_prepend (removed_ids, g_strdup (id));
 	}
 
+	g_hash_table_destroy (ids);
+
 	for (l = removed_ids; l; l = l->next) {
 		const char *id = l->data;
 
@@ -1537,7 +1999,10 @@ panel_profile_toplevel_id_list_notify (GSettings *settings,
 
 	/* if there are no panels, reset layout to default */
 	if (g_slist_length (toplevel_ids) == 0)
-		g_idle_add (load_default_layout_idle, NULL);
+		panel_scheduler_add (PANEL_SCHEDULER_PRIORITY_DEFAULT,
+				     "profile-load-default-layout",
+				     load_default_layout_idle,
+				     NULL, NULL);
 
 	g_slist_free (existing_toplevels);
 	g_slist_free_full (toplevel_ids, g_free);
@@ -1653,20 +2118,28 @@ panel_profile_settings_load (void)
 void
 panel_profile_load (void)
 {
+	panel_trace_begin ("profile", "panel_profile_load");
+
 	panel_profile_settings_load();
+	panel_layout_snapshot_load ();
 
 	panel_profile_load_list (profile_settings,
 				 PANEL_GSETTINGS_TOPLEVELS,
 				 (PanelProfileLoadFunc)panel_profile_load_and_show_toplevel_startup,
 				 G_CALLBACK (panel_profile_toplevel_id_list_notify));
+	panel_profile_show_startup_toplevels ();
+	panel_profile_snapshot_objects ();
 	panel_profile_load_list (profile_settings,
 				 PANEL_GSETTINGS_OBJECTS,
 				 (PanelProfileLoadFunc)panel_profile_load_object,
 				 G_CALLBACK (panel_profile_object_id_list_notify));
+	panel_profile_snapshot_free ();
 
 	panel_profile_ensure_toplevel_per_screen ();
 
 	mate_panel_applet_load_queued_applets (TRUE);
+
+	panel_trace_end ("profile", "panel_profile_load");
 }
 
 static gboolean
@@ -68,6 +68,14 @@ char          *panel_profile_prepare_object_with_id (PanelObjectType    object_t
 						     gboolean           right_stick);
 void           panel_profile_delete_object          (AppletInfo        *applet_info);
 
+/* Collects the writes of one interaction, to apply them together */
+void        panel_profile_journal_begin    (void);
+void        panel_profile_journal_end      (void);
+GSettings  *panel_profile_journal_settings (GSettings *settings);
+
+GSettings  *panel_profile_get_settings     (const char *schema_id,
+					    const char *path);
+
 gboolean    panel_profile_key_is_writable            (PanelToplevel *toplevel,
 						      gchar         *key);
 gboolean    panel_profile_background_key_is_writable (PanelToplevel *toplevel,
@@ -42,6 +42,9 @@
 #include "panel-globals.h"
 #include "panel-icon-names.h"
 
+/* how long the size and the opacity must stay still to be saved */
+#define PANEL_PROPERTIES_SETTLE_TIMEOUT 300
+
 typedef struct {
 	PanelToplevel *toplevel;
 	GSettings     *settings;
@@ -81,21 +84,128 @@ typedef struct {
 
 	/* FIXME: This is a workaround for GTK+ bug #327243 */
 	int            selection_emitted;
+
+	/* the size spin and the opacity scale are previewed on the panel
+	 * once per frame, and only saved when they settle */
+	guint          preview_tick;
+	guint          settle_timeout;
+	int            preview_size;
+	gdouble        preview_opacity;
+	guint          preview_size_pending : 1;
+	guint          preview_opacity_pending : 1;
+	guint          in_journal : 1;
 } PanelPropertiesDialog;
 
 static GQuark panel_properties_dialog_quark = 0;
 
 static void panel_properties_dialog_opacity_changed (PanelPropertiesDialog *dialog);
 
+static void
+panel_properties_dialog_apply_preview (PanelPropertiesDialog *dialog)
+{
+	if (dialog->preview_size_pending) {
+		dialog->preview_size_pending = FALSE;
+		/* the toplevel saves its size itself */
+		panel_toplevel_set_size (dialog->toplevel, dialog->preview_size);
+	}
+
+	if (dialog->preview_opacity_pending) {
+		GdkRGBA color;
+
+		dialog->preview_opacity_pending = FALSE;
+
+		panel_profile_get_background_color (dialog->toplevel, &color);
+		color.alpha = dialog->preview_opacity / 100.0;
+		panel_background_set_color (&dialog->toplevel->background, &color);
+
+		/* only goes to the journal until the scale settles */
+		panel_profile_set_background_opacity (dialog->toplevel,
+						      dialog->preview_opacity);
+	}
+}
+
+static gboolean
+panel_properties_dialog_preview_tick (GtkWidget     *widget,
+				      GdkFrameClock *frame_clock,
+				      gpointer       data)
+{
+	PanelPropertiesDialog *dialog = data;
+
+	dialog->preview_tick = 0;
+	panel_properties_dialog_apply_preview (dialog);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+panel_properties_dialog_settle (PanelPropertiesDialog *dialog)
+{
+	if (dialog->settle_timeout) {
+		g_source_remove (dialog->settle_timeout);
+		dialog->settle_timeout = 0;
+	}
+
+	if (dialog->preview_tick) {
+		gtk_widget_remove_tick_callback (dialog->properties_dialog,
+						 dialog->preview_tick);
+		dialog->preview_tick = 0;
+	}
+
+	panel_properties_dialog_apply_preview (dialog);
+
+	if (dialog->in_journal) {
+		dialog->in_journal = FALSE;
+		panel_profile_journal_end ();
+	}
+}
+
+static gboolean
+panel_properties_dialog_settle_timeout (gpointer data)
+{
+	PanelPropertiesDialog *dialog = data;
+
+	dialog->settle_timeout = 0;
+	panel_properties_dialog_settle (dialog);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+panel_properties_dialog_queue_preview (PanelPropertiesDialog *dialog)
+{
+	if (!dialog->in_journal) {
+		dialog->in_journal = TRUE;
+		panel_profile_journal_begin ();
+	}
+
+	if (!dialog->preview_tick)
+		dialog->preview_tick =
+			gtk_widget_add_tick_callback (dialog->properties_dialog,
+						      panel_properties_dialog_preview_tick,
+						      dialog, NULL);
+
+	if (dialog->settle_timeout)
+		g_source_remove (dialog->settle_timeout);
+	dialog->settle_timeout =
+		g_timeout_add (PANEL_PROPERTIES_SETTLE_TIMEOUT,
+			       panel_properties_dialog_settle_timeout,
+			       dialog);
+}
+
 static void
 panel_properties_dialog_free (PanelPropertiesDialog *dialog)
 {
-	if (dialog->settings)
+	/* the settings are the ones of the toplevel too */
+	if (dialog->settings) {
+		g_signal_handlers_disconnect_by_data (dialog->settings, dialog);
 		g_object_unref (dialog->settings);
+	}
 	dialog->settings = NULL;
 
-	if (dialog->background_settings)
+	if (dialog->background_settings) {
+		g_signal_handlers_disconnect_by_data (dialog->background_settings, dialog);
 		g_object_unref (dialog->background_settings);
+	}
 	dialog->background_settings = NULL;
 
 	if (dialog->properties_dialog)
@@ -215,8 +325,9 @@ static void
 panel_properties_dialog_size_changed (PanelPropertiesDialog *dialog,
 				      GtkSpinButton         *spin_button)
 {
-	panel_profile_set_toplevel_size (dialog->toplevel,
-					 gtk_spin_button_get_value_as_int (spin_button));
+	dialog->preview_size = gtk_spin_button_get_value_as_int (spin_button);
+	dialog->preview_size_pending = TRUE;
+	panel_properties_dialog_queue_preview (dialog);
 }
 
 static void
@@ -428,7 +539,9 @@ panel_properties_dialog_opacity_changed (PanelPropertiesDialog *dialog)
 	else if (percentage <= 2)
 		percentage = 0;
 
-	panel_profile_set_background_opacity (dialog->toplevel, percentage);
+	dialog->preview_opacity = percentage;
+	dialog->preview_opacity_pending = TRUE;
+	panel_properties_dialog_queue_preview (dialog);
 }
 
 static void
@@ -594,6 +707,8 @@ panel_properties_dialog_response (PanelPropertiesDialog *dialog,
 static void
 panel_properties_dialog_destroy (PanelPropertiesDialog *dialog)
 {
+	panel_properties_dialog_settle (dialog);
+
 	panel_toplevel_pop_autohide_disabler (PANEL_TOPLEVEL (dialog->toplevel));
 	g_object_set_qdata (G_OBJECT (dialog->toplevel),
 			    panel_properties_dialog_quark,
@@ -899,12 +1014,12 @@ panel_properties_dialog_new (PanelToplevel *toplevel)
 				  dialog);
 
 	g_object_get (toplevel, "settings-path", &toplevel_settings_path, NULL);
-	dialog->settings = g_settings_new_with_path (PANEL_TOPLEVEL_SCHEMA,
-						     toplevel_settings_path);
+	dialog->settings = panel_profile_get_settings (PANEL_TOPLEVEL_SCHEMA,
+						       toplevel_settings_path);
 	gchar *toplevel_background_path;
 	toplevel_background_path = g_strdup_printf ("%sbackground/", toplevel_settings_path);
-	dialog->background_settings = g_settings_new_with_path (PANEL_TOPLEVEL_BACKGROUND_SCHEMA,
-								toplevel_background_path);
+	dialog->background_settings = panel_profile_get_settings (PANEL_TOPLEVEL_BACKGROUND_SCHEMA,
+								  toplevel_background_path);
 	g_free (toplevel_background_path);
 	g_free (toplevel_settings_path);
 
@@ -952,3 +1067,16 @@ panel_properties_dialog_present (PanelToplevel *toplevel)
 		gtk_widget_show (dialog->properties_dialog);
 	}
 }
+
+GtkWidget *
+panel_properties_dialog_peek_window (PanelToplevel *toplevel)
+{
+	PanelPropertiesDialog *dialog;
+
+	if (!panel_properties_dialog_quark)
+		return NULL;
+
+	dialog = g_object_get_qdata (G_OBJECT (toplevel), panel_properties_dialog_quark);
+
+	return dialog ? dialog->properties_dialog : NULL;
+}
@@ -32,7 +32,8 @@
 extern "C" {
 #endif
 
-void panel_properties_dialog_present (PanelToplevel *toplevel);
+void       panel_properties_dialog_present     (PanelToplevel *toplevel);
+GtkWidget *panel_properties_dialog_peek_window (PanelToplevel *toplevel);
 
 #ifdef __cplusplus
 }
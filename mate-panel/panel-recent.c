@@ -52,21 +52,31 @@ show_uri (const char *uri, const char *mime_type, GdkScreen *screen,
 					       error);
 }
 
+/* The recent documents menu only holds the most recently used documents,
+ * up to the limit. GtkRecentManager tells about every change of the list,
+ * which can be huge: the menu items are only built again when the menu is
+ * shown after a change, and only for the documents that make it into the
+ * menu. */
+typedef struct {
+	GtkRecentManager *manager;
+	GList            *items;
+	int               limit;
+	guint             dirty : 1;
+} PanelRecentMenu;
+
 static void
-recent_documents_activate_cb (GtkRecentChooser *chooser,
-			      gpointer          data)
+recent_documents_activate_cb (GtkWidget *menu_item,
+			      gpointer   data)
 {
-	GtkRecentInfo *recent_info;
 	const char    *uri;
 	const char    *mime_type;
 	GdkScreen     *screen;
 	GError        *error = NULL;
 
-	screen = gtk_widget_get_screen (GTK_WIDGET (chooser));
+	screen = gtk_widget_get_screen (menu_item);
 
-	recent_info = gtk_recent_chooser_get_current_item (chooser);
-	uri = gtk_recent_info_get_uri (recent_info);
-	mime_type = gtk_recent_info_get_mime_type (recent_info);
+	uri = g_object_get_data (G_OBJECT (menu_item), "panel-recent-uri");
+	mime_type = g_object_get_data (G_OBJECT (menu_item), "panel-recent-mime-type");
 	/* FIXME gtk_recent_info_get_application_info() could be useful */
 
 	if (show_uri (uri, mime_type, screen, &error) != TRUE) {
@@ -100,9 +110,155 @@ recent_documents_activate_cb (GtkRecentChooser *chooser,
 
 		g_free (uri_utf8);
 	}
+}
+
+static int
+panel_recent_info_compare_mru (GtkRecentInfo *a,
+			       GtkRecentInfo *b)
+{
+	time_t modified_a = gtk_recent_info_get_modified (a);
+	time_t modified_b = gtk_recent_info_get_modified (b);
+
+	if (modified_a == modified_b)
+		return 0;
+
+	return modified_a > modified_b ? -1 : 1;
+}
+
+/* Keeps the limit most recently used documents out of the whole list, in
+ * one pass and without sorting it all */
+static GPtrArray *
+panel_recent_get_most_recent (GtkRecentManager *manager,
+			      int               limit)
+{
+	GPtrArray *recent;
+	GList     *infos;
+	GList     *l;
+
+	recent = g_ptr_array_new_with_free_func ((GDestroyNotify) gtk_recent_info_unref);
+	if (limit <= 0)
+		return recent;
+
+	infos = gtk_recent_manager_get_items (manager);
+
+	for (l = infos; l; l = l->next) {
+		GtkRecentInfo *info = l->data;
+		guint          i;
+
+		if (gtk_recent_info_get_private_hint (info)) {
+			gtk_recent_info_unref (info);
+			continue;
+		}
+
+		if (recent->len == (guint) limit &&
+		    panel_recent_info_compare_mru (info, g_ptr_array_index (recent, limit - 1)) >= 0) {
+			gtk_recent_info_unref (info);
+			continue;
+		}
+
+		if (recent->len == (guint) limit)
+			g_ptr_array_remove_index (recent, limit - 1);
+
+		for (i = recent->len; i > 0; i--)
+			if (panel_recent_info_compare_mru (info, g_ptr_array_index (recent, i - 1)) >= 0)
+				break;
+
+		g_ptr_array_insert (recent, i, info);
+	}
 
-	/* we can unref it only after having used the data we fetched from it */
-	gtk_recent_info_unref (recent_info);
+	g_list_free (infos);
+
+	return recent;
+}
+
+static GtkWidget *
+panel_recent_create_item (GtkRecentInfo *info)
+{
+	GtkWidget *menu_item;
+	GIcon     *icon;
+	char      *tooltip;
+
+	icon = gtk_recent_info_get_gicon (info);
+
+	menu_item = panel_image_menu_item_new ();
+	setup_menuitem_with_icon (menu_item,
+				  panel_menu_icon_get_size (),
+				  icon, NULL,
+				  gtk_recent_info_get_display_name (info));
+	if (icon)
+		g_object_unref (icon);
+
+	tooltip = gtk_recent_info_get_uri_display (info);
+	panel_util_set_tooltip_text (menu_item, tooltip);
+	g_free (tooltip);
+
+	g_object_set_data_full (G_OBJECT (menu_item), "panel-recent-uri",
+				g_strdup (gtk_recent_info_get_uri (info)),
+				g_free);
+	g_object_set_data_full (G_OBJECT (menu_item), "panel-recent-mime-type",
+				g_strdup (gtk_recent_info_get_mime_type (info)),
+				g_free);
+
+	g_signal_connect (menu_item, "activate",
+			  G_CALLBACK (recent_documents_activate_cb),
+			  NULL);
+	g_signal_connect (menu_item, "button-press-event",
+			  G_CALLBACK (menu_dummy_button_press_event),
+			  NULL);
+
+	return menu_item;
+}
+
+static void
+panel_recent_menu_update (GtkWidget       *menu,
+			  PanelRecentMenu *recent_menu)
+{
+	GPtrArray *recent;
+	GList     *l;
+	guint      i;
+
+	if (!recent_menu->dirty)
+		return;
+
+	recent_menu->dirty = FALSE;
+
+	for (l = recent_menu->items; l; l = l->next)
+		gtk_widget_destroy (l->data);
+	g_list_free (recent_menu->items);
+	recent_menu->items = NULL;
+
+	recent = panel_recent_get_most_recent (recent_menu->manager,
+					       recent_menu->limit);
+
+	for (i = 0; i < recent->len; i++) {
+		GtkWidget *menu_item;
+
+		menu_item = panel_recent_create_item (g_ptr_array_index (recent, i));
+		gtk_menu_shell_insert (GTK_MENU_SHELL (menu), menu_item, i);
+		recent_menu->items = g_list_prepend (recent_menu->items, menu_item);
+	}
+
+	g_ptr_array_unref (recent);
+}
+
+static void
+panel_recent_menu_changed_cb (GtkRecentManager *manager,
+			      GtkWidget        *menu)
+{
+	PanelRecentMenu *recent_menu;
+
+	recent_menu = g_object_get_data (G_OBJECT (menu), "panel-recent-menu");
+	recent_menu->dirty = TRUE;
+
+	if (gtk_widget_get_visible (menu))
+		panel_recent_menu_update (menu, recent_menu);
+}
+
+static void
+panel_recent_menu_free (PanelRecentMenu *recent_menu)
+{
+	g_list_free (recent_menu->items);
+	g_slice_free (PanelRecentMenu, recent_menu);
 }
 
 static void
@@ -192,6 +348,7 @@ panel_recent_append_documents_menu (GtkWidget        *top_menu,
 {
 	GtkWidget      *recent_menu;
 	GtkWidget      *menu_item;
+	PanelRecentMenu *data;
 	int             size;
 
 	menu_item = mate_image_menu_item_new ();
@@ -200,12 +357,9 @@ panel_recent_append_documents_menu (GtkWidget        *top_menu,
 				  NULL,
 				  PANEL_ICON_RECENT,
 				  _("Recent Documents"));
-	recent_menu = gtk_recent_chooser_menu_new_for_manager (manager);
+	recent_menu = panel_create_menu ();
 	gtk_menu_item_set_submenu (GTK_MENU_ITEM (menu_item), recent_menu);
 
-	gtk_recent_chooser_set_limit (GTK_RECENT_CHOOSER (recent_menu),
-				      recent_items_limit);
-
 	g_signal_connect (recent_menu, "button-press-event",
 			  G_CALLBACK (menu_dummy_button_press_event),
 	                  NULL);
@@ -213,19 +367,20 @@ panel_recent_append_documents_menu (GtkWidget        *top_menu,
 	gtk_menu_shell_append (GTK_MENU_SHELL (top_menu), menu_item);
 	gtk_widget_show_all (menu_item);
 
-	gtk_recent_chooser_set_local_only (GTK_RECENT_CHOOSER (recent_menu),
-					   FALSE);
-	gtk_recent_chooser_set_show_tips (GTK_RECENT_CHOOSER (recent_menu),
-					  TRUE);
-	gtk_recent_chooser_set_sort_type (GTK_RECENT_CHOOSER (recent_menu),
-					  GTK_RECENT_SORT_MRU);
+	data = g_slice_new0 (PanelRecentMenu);
+	data->manager = manager;
+	data->limit = recent_items_limit;
+	data->dirty = TRUE;
+	g_object_set_data_full (G_OBJECT (recent_menu), "panel-recent-menu",
+				data, (GDestroyNotify) panel_recent_menu_free);
 
-	g_signal_connect (recent_menu, "item-activated",
-			  G_CALLBACK (recent_documents_activate_cb),
-			  NULL);
-
-	/* FIXME this is not possible with GtkRecent...: egg_recent_view_gtk_set_icon_size (view, panel_menu_icon_get_size ()); */
+	g_signal_connect (recent_menu, "show",
+			  G_CALLBACK (panel_recent_menu_update),
+			  data);
 
+	g_signal_connect_object (manager, "changed",
+				 G_CALLBACK (panel_recent_menu_changed_cb),
+				 recent_menu, 0);
 	g_signal_connect_object (manager, "changed",
 				 G_CALLBACK (panel_recent_manager_changed_cb),
 				 menu_item, 0);
@@ -29,7 +29,9 @@
 
 #include <stdlib.h>
 #include <gio/gio.h>
+#include <gdk/gdk.h>
 #include "panel-reset.h"
+#include "panel-layout.h"
 #include "panel-schemas.h"
 
 void
@@ -37,6 +39,11 @@ panel_reset()
 {
 	GSettings *settings;
 
+	/* the panels and objects of the default layout that are there already
+	 * are kept: only the other ones are destroyed or created */
+	if (panel_layout_apply_in_place (gdk_screen_get_default ()))
+		return;
+
 	settings = g_settings_new (PANEL_SCHEMA);
 	g_settings_set_strv (settings, PANEL_OBJECT_ID_LIST_KEY, NULL);
 	g_settings_sync ();
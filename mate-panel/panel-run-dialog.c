@@ -33,7 +33,6 @@
 #include "panel-run-dialog.h"
 
 #include <string.h>
-#include <dirent.h>
 #include <errno.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -47,13 +46,19 @@
 #define MATE_DESKTOP_USE_UNSTABLE_API
 #include <libmate-desktop/mate-desktop-utils.h>
 
+#include <libpanel-util/panel-desktop-cache.h>
 #include <libpanel-util/panel-error.h>
 #include <libpanel-util/panel-glib.h>
 #include <libpanel-util/panel-gtk.h>
 #include <libpanel-util/panel-keyfile.h>
+#include <libpanel-util/panel-launch-stats.h>
+#include <libpanel-util/panel-scheduler.h>
 #include <libpanel-util/panel-show.h>
+#include <libpanel-util/panel-spawn.h>
 
 #include "panel-util.h"
+#include "panel-executable-index.h"
+#include "panel-run-frecency.h"
 #include "panel-globals.h"
 #include "panel-enums.h"
 #include "panel-profile.h"
@@ -68,6 +73,8 @@
 #include "xstuff.h"
 #endif
 
+typedef struct _DirectoryListing DirectoryListing;
+
 typedef struct {
 	GtkWidget        *run_dialog;
 
@@ -77,6 +84,7 @@ typedef struct {
 	GtkWidget        *combobox;
 	GtkWidget        *pixmap;
 	GtkWidget        *run_button;
+	GtkWidget        *execute_spinner;
 	GtkWidget        *file_button;
 	GtkWidget        *list_expander;
 	GtkWidget        *terminal_checkbox;
@@ -86,16 +94,27 @@ typedef struct {
 	long              changed_id;
 
 	GtkListStore     *program_list_store;
+	GArray           *program_index;
+	char             *program_query;
 
-	GHashTable       *dir_hash;
-	GList		 *possible_executables;
-	GList		 *completion_items;
 	GtkEntryCompletion *completion;
-
-	int	          add_items_idle_id;
+	DirectoryListing *completion_dir;
+	char             *completion_key;
+	guint             completion_serial;
+
+	MateMenuTree     *menu_tree;
+	GCancellable     *menu_tree_cancellable;
+	GCancellable     *execute_cancellable;
+
+	/* the list being built after a change of the tree */
+	GtkListStore     *pending_store;
+	GArray           *pending_index;
+	GSList           *pending_applications;
+	guint             pending_fill_id;
 	int		  find_command_idle_id;
 	gboolean	  use_program_list;
 	gboolean	  completion_started;
+	gboolean	  resident;
 
 	GIcon		 *icon;
 	char             *desktop_path;
@@ -138,6 +157,25 @@ const AcceleratorKeyMapping accelerator_key_mapping[] =
 
 static GHashTable *accelerator_keys_to_tree_iter_map = NULL;
 
+/* What the search of the program list needs to know about a row of
+ * program_list_store, with the strings already lowered for matching */
+typedef struct {
+	GtkTreeIter  iter;
+	GIcon       *icon;
+	char        *name;
+	char        *exec;
+	char        *exec_basename;
+	char        *exec_key;
+	char        *name_key;
+	char        *comment_key;
+
+	/* what the row currently holds */
+	guint        visible : 1;
+	guint        matches : 1;
+	gint         accel_mask;
+	guint        accel_key;
+} ProgramIndexEntry;
+
 static PanelRunDialog *static_dialog = NULL;
 
 static void panel_run_dialog_disconnect_pixmap (PanelRunDialog *dialog);
@@ -234,11 +272,12 @@ _panel_run_save_recent_programs_list (PanelRunDialog   *dialog,
 	}
 }
 
+static void panel_run_dialog_stop_completion (PanelRunDialog *dialog);
+static void panel_run_dialog_cancel_fill_program_list (PanelRunDialog *dialog);
+
 static void
 panel_run_dialog_destroy (PanelRunDialog *dialog)
 {
-	GList *l;
-
 	dialog->changed_id = 0;
 
 	g_object_unref (dialog->program_list_box);
@@ -247,34 +286,40 @@ panel_run_dialog_destroy (PanelRunDialog *dialog)
 	g_clear_pointer (&dialog->desktop_path, g_free);
 	g_clear_pointer (&dialog->item_name, g_free);
 
-	if (dialog->add_items_idle_id)
-		g_source_remove (dialog->add_items_idle_id);
-	dialog->add_items_idle_id = 0;
+	if (dialog->menu_tree_cancellable) {
+		g_cancellable_cancel (dialog->menu_tree_cancellable);
+		g_clear_object (&dialog->menu_tree_cancellable);
+	}
+
+	if (dialog->execute_cancellable) {
+		g_cancellable_cancel (dialog->execute_cancellable);
+		g_clear_object (&dialog->execute_cancellable);
+	}
+
+	if (dialog->menu_tree) {
+		g_signal_handlers_disconnect_by_data (dialog->menu_tree, dialog);
+		g_clear_object (&dialog->menu_tree);
+	}
+
+	panel_run_dialog_cancel_fill_program_list (dialog);
+	g_clear_object (&dialog->program_list_store);
 
 	if (dialog->find_command_idle_id)
-		g_source_remove (dialog->find_command_idle_id);
+		panel_scheduler_remove (dialog->find_command_idle_id);
 	dialog->find_command_idle_id = 0;
 
+	g_clear_pointer (&dialog->program_index, g_array_unref);
+	g_clear_pointer (&dialog->program_query, g_free);
+
 	g_clear_object (&dialog->settings);
 
-	if (dialog->dir_hash)
-		g_hash_table_destroy (dialog->dir_hash);
-	dialog->dir_hash = NULL;
+	panel_run_dialog_stop_completion (dialog);
+	g_clear_pointer (&dialog->completion_key, g_free);
 
 	if (accelerator_keys_to_tree_iter_map)
 		g_hash_table_destroy (accelerator_keys_to_tree_iter_map);
 	accelerator_keys_to_tree_iter_map = NULL;
 
-	for (l = dialog->possible_executables; l; l = l->next)
-		g_free (l->data);
-	g_list_free (dialog->possible_executables);
-	dialog->possible_executables = NULL;
-
-	for (l = dialog->completion_items; l; l = l->next)
-		g_free (l->data);
-	g_list_free (dialog->completion_items);
-	dialog->completion_items = NULL;
-
 	panel_run_dialog_disconnect_pixmap (dialog);
 
 	g_free (dialog);
@@ -349,16 +394,15 @@ panel_run_dialog_set_icon (PanelRunDialog *dialog,
 }
 
 static gboolean
-command_is_executable (const char   *command,
-		       int          *argcp,
-		       char       ***argvp)
+command_parse_argv (const char   *command,
+		    int          *argcp,
+		    char       ***argvp)
 {
 	gboolean   result;
 	GRegex    *regex = NULL;
 	gsize      argv_len;
 	g_autofree gchar *home_path = NULL;
 	char     **argv;
-	char      *path;
 	int        argc;
 
 	result = g_shell_parse_argv (command, &argc, &argv, NULL);
@@ -378,6 +422,35 @@ command_is_executable (const char   *command,
 		argv[i] = tmp_argv;
 	}
 	g_regex_unref (regex);
+
+	*argcp = argc;
+	*argvp = argv;
+
+	return TRUE;
+}
+
+/* Answers without touching the file system: only a command found in the
+ * index of $PATH is known to be executable this way. The index belongs to
+ * the main thread. */
+static gboolean
+command_argv_is_indexed (char **argv)
+{
+	return strchr (argv[0], G_DIR_SEPARATOR) == NULL &&
+	       panel_executable_index_contains (argv[0]);
+}
+
+static gboolean
+command_is_executable (const char   *command,
+		       int          *argcp,
+		       char       ***argvp)
+{
+	char     **argv;
+	char      *path;
+	int        argc;
+
+	if (!command_parse_argv (command, &argc, &argv))
+		return FALSE;
+
 	path = g_find_program_in_path (argv[0]);
 
 	if (!path) {
@@ -403,46 +476,52 @@ command_is_executable (const char   *command,
 		*argcp = argc;
 	if (argvp)
 		*argvp = argv;
+	else
+		g_strfreev (argv);
 
 	return TRUE;
 }
 
-static void
-dummy_child_watch (GPid         pid,
-		   		   gint         status,
-		  		   gpointer user_data)
+/* The drag data has to be provided right away: use the index when it knows
+ * the command, and only search $PATH otherwise */
+static gboolean
+command_is_executable_cached (const char *command)
 {
-	/* Nothing, this is just to ensure we don't double fork
-	 * and break pkexec:
-	 * https://bugzilla.gnome.org/show_bug.cgi?id=675789
-	 */
+	gboolean   indexed;
+	char     **argv;
+	int        argc;
+
+	if (!command_parse_argv (command, &argc, &argv))
+		return FALSE;
+
+	indexed = command_argv_is_indexed (argv);
+	g_strfreev (argv);
+
+	return indexed || command_is_executable (command, NULL, NULL);
 }
 
+/* Takes ownership of @argv */
 static gboolean
 panel_run_dialog_launch_command (PanelRunDialog *dialog,
 				 const char     *command,
-				 const char     *locale_command)
+				 int             argc,
+				 char          **argv)
 {
 	gboolean    result;
 	GError     *error = NULL;
-	char      **argv;
-	int         argc;
 	GPid        pid;
+	PanelLaunchStats *stats;
 
-	if (!command_is_executable (locale_command, &argc, &argv))
-		return FALSE;
+	stats = panel_launch_stats_begin (argv[0]);
 
 	if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (dialog->terminal_checkbox)))
 		mate_desktop_prepend_terminal_to_vector (&argc, &argv);
 
-	result = g_spawn_async (NULL, /* working directory */
-				argv,
-				NULL, /* envp */
-				G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
-				NULL,
-				NULL,
-				&pid,
-				&error);
+	result = panel_spawn_async (NULL, /* working directory */
+				    argv,
+				    NULL, /* envp */
+				    &pid,
+				    &error);
 
 	if (!result) {
 		char *primary;
@@ -455,8 +534,9 @@ panel_run_dialog_launch_command (PanelRunDialog *dialog,
 		g_free (primary);
 
 		g_error_free (error);
+		panel_launch_stats_failed (stats);
 	} else {
-		g_child_watch_add (pid, dummy_child_watch, NULL);
+		panel_launch_stats_spawned (stats, pid, NULL);
 	}
 
 	g_strfreev (argv);
@@ -464,47 +544,107 @@ panel_run_dialog_launch_command (PanelRunDialog *dialog,
 	return result;
 }
 
+static void panel_run_dialog_cancel_execute (PanelRunDialog *dialog);
+
+/* A resident dialog is only hidden, so that presenting it again does not
+ * have to build the UI and the list of applications again. */
 static void
-panel_run_dialog_execute (PanelRunDialog *dialog)
+panel_run_dialog_close (PanelRunDialog *dialog)
 {
-	GError   *error;
-	gboolean  result;
-	char     *command;
-	char     *disk;
-	char     *scheme;
+	GtkWidget        *entry;
+	GtkTreeSelection *selection;
+	GtkTreeModel     *history;
 
-	command = g_strdup (panel_run_dialog_get_combo_text (dialog));
-	command = g_strchug (command);
+	panel_run_dialog_cancel_execute (dialog);
 
-	if (!command || !command [0]) {
-		g_free (command);
+	if (!dialog->resident) {
+		gtk_widget_destroy (dialog->run_dialog);
 		return;
 	}
 
-	error = NULL;
-	disk = g_locale_from_utf8 (command, -1, NULL, NULL, &error);
+	gtk_widget_hide (dialog->run_dialog);
 
-	if (!disk || error) {
-		char *primary;
+	dialog->use_program_list = FALSE;
+	if (panel_profile_get_enable_program_list ()) {
+		selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (dialog->program_list));
+		gtk_tree_selection_unselect_all (selection);
+	}
 
-		primary = g_strdup_printf (_("Could not convert '%s' from UTF-8"),
-					   command);
-		panel_error_dialog (GTK_WINDOW (dialog->run_dialog), NULL,
-				    "cannot_convert_command_from_utf8", TRUE,
-				    primary, error->message);
-		g_free (primary);
+	/* pick up the command that was just saved */
+	history = _panel_run_get_recent_programs_list (dialog);
+	gtk_combo_box_set_model (GTK_COMBO_BOX (dialog->combobox), history);
+	g_object_unref (history);
 
-		g_error_free (error);
+	entry = gtk_bin_get_child (GTK_BIN (dialog->combobox));
+	gtk_entry_set_text (GTK_ENTRY (entry), "");
+
+	gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (dialog->terminal_checkbox),
+				      FALSE);
+}
+
+static gboolean
+panel_run_dialog_delete_event (GtkWidget      *run_dialog,
+			       GdkEvent       *event,
+			       PanelRunDialog *dialog)
+{
+	if (!dialog->resident)
+		return FALSE;
+
+	panel_run_dialog_close (dialog);
+
+	return TRUE;
+}
+
+typedef struct {
+	char *command;
+	char *disk;
+} ExecuteData;
+
+static void
+execute_data_free (ExecuteData *data)
+{
+	g_free (data->command);
+	g_free (data->disk);
+	g_slice_free (ExecuteData, data);
+}
+
+static void
+panel_run_dialog_set_executing (PanelRunDialog *dialog,
+				gboolean        executing)
+{
+	gtk_widget_set_visible (dialog->execute_spinner, executing);
+	if (executing)
+		gtk_spinner_start (GTK_SPINNER (dialog->execute_spinner));
+	else
+		gtk_spinner_stop (GTK_SPINNER (dialog->execute_spinner));
+
+	gtk_widget_set_sensitive (dialog->run_button, !executing);
+}
+
+static void
+panel_run_dialog_cancel_execute (PanelRunDialog *dialog)
+{
+	if (!dialog->execute_cancellable)
 		return;
-	}
 
-	result = FALSE;
+	g_cancellable_cancel (dialog->execute_cancellable);
+	g_clear_object (&dialog->execute_cancellable);
 
-	scheme = g_uri_parse_scheme (disk);
-	/* if it's an absolute path or not a URI, it's possibly an executable,
-	 * so try it before displaying it */
-	if (g_path_is_absolute (disk) || !scheme)
-		result = panel_run_dialog_launch_command (dialog, command, disk);
+	panel_run_dialog_set_executing (dialog, FALSE);
+}
+
+/* Takes ownership of @argv, which is NULL if @disk is not a command */
+static void
+panel_run_dialog_execute_finish (PanelRunDialog *dialog,
+				 const char     *command,
+				 int             argc,
+				 char          **argv)
+{
+	gboolean result = FALSE;
+
+	if (argv)
+		result = panel_run_dialog_launch_command (dialog, command,
+							  argc, argv);
 
 	if (!result) {
 		GFile     *file;
@@ -526,15 +666,140 @@ panel_run_dialog_execute (PanelRunDialog *dialog)
 		/* only save working commands in history */
 		_panel_run_save_recent_programs_list
 			(dialog, GTK_COMBO_BOX (dialog->combobox), command);
+		panel_run_frecency_record (command);
 
 		/* only close the dialog if we successfully showed or launched
 		 * something */
-		gtk_widget_destroy (dialog->run_dialog);
+		panel_run_dialog_close (dialog);
 	}
+}
+
+static void
+panel_run_dialog_execute_thread (GTask        *task,
+				 gpointer      source_object,
+				 gpointer      task_data,
+				 GCancellable *cancellable)
+{
+	ExecuteData  *data = task_data;
+	char        **argv;
+
+	/* the path search and the tests can block on slow or automounted
+	 * file systems */
+	if (!command_is_executable (data->disk, NULL, &argv))
+		argv = NULL;
+
+	g_task_return_pointer (task, argv, (GDestroyNotify) g_strfreev);
+}
+
+static void
+panel_run_dialog_execute_done (GObject      *source_object,
+			       GAsyncResult *result,
+			       gpointer      user_data)
+{
+	PanelRunDialog  *dialog;
+	ExecuteData     *data;
+	char           **argv;
+	GError          *error = NULL;
+
+	argv = g_task_propagate_pointer (G_TASK (result), &error);
+
+	if (error) {
+		/* a cancelled check means the dialog may be gone */
+		g_error_free (error);
+		return;
+	}
+
+	dialog = user_data;
+	data = g_task_get_task_data (G_TASK (result));
+
+	g_clear_object (&dialog->execute_cancellable);
+	panel_run_dialog_set_executing (dialog, FALSE);
+
+	panel_run_dialog_execute_finish (dialog, data->command,
+					 argv ? g_strv_length (argv) : 0, argv);
+}
+
+static void
+panel_run_dialog_execute (PanelRunDialog *dialog)
+{
+	GError      *error;
+	char        *command;
+	char        *disk;
+	char        *scheme;
+	char       **argv;
+	int          argc;
+	gboolean     maybe_command;
+	ExecuteData *data;
+	GTask       *task;
+
+	/* still checking the previous command */
+	if (dialog->execute_cancellable)
+		return;
+
+	command = g_strdup (panel_run_dialog_get_combo_text (dialog));
+	command = g_strchug (command);
+
+	if (!command || !command [0]) {
+		g_free (command);
+		return;
+	}
+
+	error = NULL;
+	disk = g_locale_from_utf8 (command, -1, NULL, NULL, &error);
+
+	if (!disk || error) {
+		char *primary;
+
+		primary = g_strdup_printf (_("Could not convert '%s' from UTF-8"),
+					   command);
+		panel_error_dialog (GTK_WINDOW (dialog->run_dialog), NULL,
+				    "cannot_convert_command_from_utf8", TRUE,
+				    primary, error->message);
+		g_free (primary);
+
+		g_error_free (error);
+		return;
+	}
+
+	scheme = g_uri_parse_scheme (disk);
+	/* if it's an absolute path or not a URI, it's possibly an executable,
+	 * so try it before displaying it */
+	maybe_command = g_path_is_absolute (disk) || !scheme;
+	g_free (scheme);
 
+	if (!maybe_command || !command_parse_argv (disk, &argc, &argv)) {
+		panel_run_dialog_execute_finish (dialog, command, 0, NULL);
+		goto out;
+	}
+
+	if (command_argv_is_indexed (argv)) {
+		panel_run_dialog_execute_finish (dialog, command, argc, argv);
+		goto out;
+	}
+
+	g_strfreev (argv);
+
+	/* the dialog stays responsive while the file system answers, and
+	 * editing the command or cancelling the dialog abandons the check */
+	data = g_slice_new0 (ExecuteData);
+	data->command = command;
+	data->disk = disk;
+
+	dialog->execute_cancellable = g_cancellable_new ();
+	panel_run_dialog_set_executing (dialog, TRUE);
+
+	task = g_task_new (NULL, dialog->execute_cancellable,
+			   panel_run_dialog_execute_done, dialog);
+	g_task_set_task_data (task, data, (GDestroyNotify) execute_data_free);
+	g_task_set_return_on_cancel (task, TRUE);
+	g_task_run_in_thread (task, panel_run_dialog_execute_thread);
+	g_object_unref (task);
+
+	return;
+
+ out:
 	g_free (command);
 	g_free (disk);
-	g_free (scheme);
 }
 
 static void
@@ -550,7 +815,7 @@ panel_run_dialog_response (PanelRunDialog *dialog,
 		panel_run_dialog_execute (dialog);
 		break;
 	case GTK_RESPONSE_CANCEL:
-		gtk_widget_destroy (dialog->run_dialog);
+		panel_run_dialog_close (dialog);
 		break;
 	case GTK_RESPONSE_HELP:
 		panel_show_help (gtk_window_get_screen (GTK_WINDOW (run_dialog)),
@@ -622,152 +887,187 @@ panel_run_dialog_append_file (PanelRunDialog *dialog,
 	g_free (utf8_file);
 }
 
-static gboolean
-fuzzy_command_match (const char *cmd1,
-		     const char *cmd2,
-		     gboolean   *fuzzy)
+/* basename of the command, without its arguments */
+static char *
+get_command_basename (const char *command)
 {
 	char **tokens;
-	char  *word1, *word2;
+	char  *basename;
 
-	g_return_val_if_fail (cmd1 && cmd2, TRUE);
-
-	*fuzzy = FALSE;
-
-	if (!strcmp (cmd1, cmd2))
-		return TRUE;
-
-	/* find basename of exec from desktop item.
-	   strip of all arguments after the initial command */
-	tokens = g_strsplit (cmd1, " ", -1);
+	tokens = g_strsplit (command, " ", -1);
 	if (!tokens || !tokens [0]) {
 		g_strfreev (tokens);
-		return FALSE;
+		return NULL;
 	}
 
-	word1 = g_path_get_basename (tokens [0]);
+	basename = g_path_get_basename (tokens [0]);
 	g_strfreev (tokens);
 
-	/* same for the user command */
-	tokens = g_strsplit (cmd2, " ", -1);
-	if (!tokens || !tokens [0]) {
-		g_free (word1);
-		g_strfreev (tokens);
-		return FALSE;
-	}
+	return basename;
+}
 
-	word2 = g_path_get_basename (tokens [0]);
-	g_strfreev (tokens);
+/* Lowers every character like panel_g_utf8_strstrcase() does, so that a
+ * plain strstr() on the results gives the same answer */
+static char *
+get_search_key (const char *str)
+{
+	GString    *key;
+	const char *p;
 
-	if (!strcmp (word1, word2)) {
-		g_free (word1);
-		g_free (word2);
-		*fuzzy = TRUE;
-		return TRUE;
-	}
+	if (!str || !g_utf8_validate (str, -1, NULL))
+		return NULL;
 
-	g_free (word1);
-	g_free (word2);
+	key = g_string_sized_new (strlen (str));
+	for (p = str; *p; p = g_utf8_next_char (p))
+		g_string_append_unichar (key, g_unichar_tolower (g_utf8_get_char (p)));
 
-	return FALSE;
+	return g_string_free (key, FALSE);
+}
+
+static void
+program_index_entry_clear (ProgramIndexEntry *entry)
+{
+	g_clear_object (&entry->icon);
+	g_free (entry->name);
+	g_free (entry->exec);
+	g_free (entry->exec_basename);
+	g_free (entry->exec_key);
+	g_free (entry->name_key);
+	g_free (entry->comment_key);
+}
+
+static void
+program_index_entry_init (ProgramIndexEntry *entry,
+			  GtkTreeIter       *iter,
+			  GIcon             *icon,
+			  const char        *name,
+			  const char        *comment,
+			  const char        *exec)
+{
+	entry->iter          = *iter;
+	entry->icon          = icon ? g_object_ref (icon) : NULL;
+	entry->name          = g_strdup (name);
+	entry->exec          = g_strdup (exec);
+	entry->exec_basename = exec ? get_command_basename (exec) : NULL;
+	entry->exec_key      = get_search_key (exec);
+	entry->name_key      = get_search_key (name);
+	entry->comment_key   = get_search_key (comment);
+}
+
+static gboolean
+program_index_entry_matches (ProgramIndexEntry *entry,
+			     const char        *query)
+{
+	return ((entry->exec_key && strstr (entry->exec_key, query)) ||
+		(entry->name_key && strstr (entry->name_key, query)) ||
+		(entry->comment_key && strstr (entry->comment_key, query)));
+}
+
+/* Only writes the columns that change: every write makes the filter
+ * model re-evaluate the row */
+static void
+program_index_entry_update (PanelRunDialog    *dialog,
+			    ProgramIndexEntry *entry,
+			    gboolean           visible,
+			    gint               accel_mask,
+			    guint              accel_key)
+{
+	if (entry->visible != visible)
+		gtk_list_store_set (dialog->program_list_store, &entry->iter,
+				    COLUMN_VISIBLE, visible,
+				    -1);
+
+	if (entry->accel_mask != accel_mask || entry->accel_key != accel_key)
+		gtk_list_store_set (dialog->program_list_store, &entry->iter,
+				    COLUMN_ACCELERATOR_MASK, accel_mask,
+				    COLUMN_ACCELERATOR_KEY_VALUE, accel_key,
+				    -1);
+
+	entry->visible = visible;
+	entry->accel_mask = accel_mask;
+	entry->accel_key = accel_key;
 }
 
 static gboolean
 panel_run_dialog_find_command_idle (PanelRunDialog *dialog)
 {
 	GtkTreeIter   iter;
-	GtkTreeModel *model;
 	GtkTreePath  *path;
-	char         *text;
+	const char   *text;
+	char         *text_basename;
+	char         *query;
 	GIcon        *found_icon;
 	char         *found_name;
 	gboolean      fuzzy;
+	gboolean      narrowing;
 	gint          visible_program_idx = 0;
+	guint         i;
 
-	model = GTK_TREE_MODEL (dialog->program_list_store);
-	path = gtk_tree_path_new_first ();
-
-	if (!path || !gtk_tree_model_get_iter (model, &iter, path)) {
-		if (path)
-			gtk_tree_path_free (path);
-
+	if (!dialog->program_index || dialog->program_index->len == 0) {
 		panel_run_dialog_set_icon (dialog, NULL, FALSE);
 
 		dialog->find_command_idle_id = 0;
 		return FALSE;
 	}
 
-	text = g_strdup (panel_run_dialog_get_combo_text (dialog));
+	text = panel_run_dialog_get_combo_text (dialog);
+	text_basename = get_command_basename (text);
+	query = get_search_key (text);
 	found_icon = NULL;
 	found_name = NULL;
 	fuzzy = FALSE;
 	g_hash_table_remove_all (accelerator_keys_to_tree_iter_map);
 
-	do {
-		char *exec = NULL;
-		GIcon *icon = NULL;
-		char *name = NULL;
-		char *comment = NULL;
-		gboolean visible = FALSE;
-
-		gtk_tree_model_get (model, &iter,
-				    COLUMN_EXEC,      &exec,
-				    COLUMN_GICON,     &icon,
-				    COLUMN_NAME,      &name,
-				    COLUMN_COMMENT,   &comment,
-				    -1);
+	/* when the query only grew, rows that did not match before cannot
+	 * match now */
+	narrowing = (query && dialog->program_query &&
+		     strstr (query, dialog->program_query) != NULL);
+
+	for (i = 0; i < dialog->program_index->len; i++) {
+		ProgramIndexEntry *entry;
+		gboolean           visible;
+
+		entry = &g_array_index (dialog->program_index, ProgramIndexEntry, i);
+
+		if (!query)
+			entry->matches = FALSE;
+		else if (!narrowing || entry->matches)
+			entry->matches = program_index_entry_matches (entry, query);
+
+		if (!fuzzy && entry->exec && entry->icon &&
+		    (strcmp (text, entry->exec) == 0 ||
+		     (text_basename && entry->exec_basename &&
+		      strcmp (text_basename, entry->exec_basename) == 0))) {
+			/* an exact match lets a later row give the icon */
+			fuzzy = strcmp (text, entry->exec) != 0;
 
-		if (!fuzzy && exec && icon &&
-		    fuzzy_command_match (text, exec, &fuzzy)) {
 			g_clear_object (&found_icon);
 			g_free (found_name);
 
-			found_icon = g_object_ref (icon);
-			found_name = g_strdup (name);
+			found_icon = g_object_ref (entry->icon);
+			found_name = g_strdup (entry->name);
 
-			gtk_list_store_set (dialog->program_list_store,
-					    &iter,
-					    COLUMN_VISIBLE, TRUE,
-					    -1);
-		} else if (panel_g_utf8_strstrcase (exec, text) != NULL ||
-			   panel_g_utf8_strstrcase (name, text) != NULL ||
-			   panel_g_utf8_strstrcase (comment, text) != NULL) {
-			gtk_list_store_set (dialog->program_list_store,
-					    &iter,
-					    COLUMN_VISIBLE, TRUE,
-					    -1);
+			visible = TRUE;
 		} else {
-			gtk_list_store_set (dialog->program_list_store,
-					    &iter,
-					    COLUMN_VISIBLE, FALSE,
-					    -1);
+			visible = entry->matches;
 		}
 
-		gtk_tree_model_get (model, &iter, COLUMN_VISIBLE, &visible, -1);
 		if (visible && visible_program_idx < G_N_ELEMENTS (accelerator_key_mapping)) {
-			gtk_list_store_set (dialog->program_list_store,
-					    &iter,
-					    COLUMN_ACCELERATOR_MASK, (gint)accelerator_key_mapping[visible_program_idx].modifier,
-					    COLUMN_ACCELERATOR_KEY_VALUE, accelerator_key_mapping[visible_program_idx].key_id,
-					    -1);
+			program_index_entry_update (dialog, entry, TRUE,
+						    (gint)accelerator_key_mapping[visible_program_idx].modifier,
+						    accelerator_key_mapping[visible_program_idx].key_id);
 			g_hash_table_insert (accelerator_keys_to_tree_iter_map, GUINT_TO_POINTER(accelerator_key_mapping[visible_program_idx].key_id), GINT_TO_POINTER(visible_program_idx));
 			visible_program_idx++;
 		} else {
-			gtk_list_store_set (dialog->program_list_store,
-					    &iter,
-					    COLUMN_ACCELERATOR_MASK, 0,
-					    COLUMN_ACCELERATOR_KEY_VALUE, 0,
-					    -1);
+			program_index_entry_update (dialog, entry, visible, 0, 0);
 		}
+	}
 
-		g_free (exec);
-		if (icon != NULL)
-			g_object_unref (icon);
-		g_free (name);
-		g_free (comment);
-
-        } while (gtk_tree_model_iter_next (model, &iter));
+	g_free (dialog->program_query);
+	dialog->program_query = query;
+	g_free (text_basename);
 
+	path = gtk_tree_path_new_first ();
 	if (gtk_tree_model_get_iter (gtk_tree_view_get_model (GTK_TREE_VIEW (dialog->program_list)),
 				     &iter, path))
 		gtk_tree_view_scroll_to_cell (GTK_TREE_VIEW (dialog->program_list),
@@ -779,7 +1079,6 @@ panel_run_dialog_find_command_idle (PanelRunDialog *dialog)
 	/* FIXME update dialog->program_label */
 
 	g_clear_object (&found_icon);
-	g_free (text);
 
 	g_free (dialog->item_name);
 	dialog->item_name = found_name;
@@ -805,6 +1104,57 @@ compare_applications (MateMenuTreeEntry *a,
 	return compare;
 }
 
+/* The score of an item is looked up once before sorting, not once per
+ * comparison */
+typedef struct {
+	gpointer data;
+	gdouble  score;
+	guint    position;
+} FrecencyItem;
+
+/* most used first; items with the same score keep their order */
+static int
+compare_frecency_items (const FrecencyItem *a,
+			const FrecencyItem *b,
+			gpointer            user_data)
+{
+	if (a->score > b->score)
+		return -1;
+	if (a->score < b->score)
+		return 1;
+	return a->position < b->position ? -1 : (a->position > b->position);
+}
+
+/* Sorts in place a list of applications sorted by name */
+static void
+sort_applications_by_frecency (GSList *list)
+{
+	FrecencyItem *items;
+	GSList       *l;
+	guint         n_items;
+	guint         i;
+
+	n_items = g_slist_length (list);
+	items = g_new (FrecencyItem, n_items);
+
+	for (l = list, i = 0; l; l = l->next, i++) {
+		const char *exec;
+
+		exec = g_app_info_get_commandline (G_APP_INFO (matemenu_tree_entry_get_app_info (l->data)));
+		items[i].data = l->data;
+		items[i].score = exec ? panel_run_frecency_get_score (exec) : 0;
+		items[i].position = i;
+	}
+
+	g_qsort_with_data (items, n_items, sizeof (FrecencyItem),
+			   (GCompareDataFunc) compare_frecency_items, NULL);
+
+	for (l = list, i = 0; l; l = l->next, i++)
+		l->data = items[i].data;
+
+	g_free (items);
+}
+
 static GSList *get_all_applications_from_dir (MateMenuTreeDirectory *directory,
 					      GSList            *list);
 
@@ -860,65 +1210,180 @@ get_all_applications_from_dir (MateMenuTreeDirectory *directory,
 			default:
 				break;
 		}
-	}
-	matemenu_tree_iter_unref (iter);
-	return list;
-}
-
-static GSList* get_all_applications(void)
-{
-	MateMenuTree* tree;
-	MateMenuTreeDirectory* root;
-	GError        *error = NULL;
-	GSList* retval;
+	}
+	matemenu_tree_iter_unref (iter);
+	return list;
+}
+
+static GSList *
+get_all_applications (MateMenuTree *tree)
+{
+	MateMenuTreeDirectory* root;
+	GSList* retval;
+
+	root = matemenu_tree_get_root_directory (tree);
+	if (root == NULL)
+		return NULL;
+
+	retval = get_all_applications_from_dir(root, NULL);
+
+	matemenu_tree_item_unref(root);
+
+	retval = g_slist_sort(retval, (GCompareFunc) compare_applications);
+
+	return retval;
+}
+
+static void
+panel_run_dialog_cancel_fill_program_list (PanelRunDialog *dialog)
+{
+	if (dialog->pending_fill_id)
+		panel_scheduler_remove (dialog->pending_fill_id);
+	dialog->pending_fill_id = 0;
+
+	g_slist_free_full (dialog->pending_applications, matemenu_tree_item_unref);
+	dialog->pending_applications = NULL;
+
+	g_clear_object (&dialog->pending_store);
+	g_clear_pointer (&dialog->pending_index, g_array_unref);
+}
+
+static void
+panel_run_dialog_finish_fill_program_list (PanelRunDialog *dialog)
+{
+	GtkTreeModel      *model_filter;
+	guint              i;
+
+	/* the tree changed: replace the list now that the new one is
+	 * complete */
+	g_clear_object (&dialog->program_list_store);
+	g_clear_pointer (&dialog->program_index, g_array_unref);
+	g_clear_pointer (&dialog->program_query, g_free);
+
+	dialog->program_list_store = dialog->pending_store;
+	dialog->program_index = dialog->pending_index;
+	dialog->pending_store = NULL;
+	dialog->pending_index = NULL;
+
+	g_hash_table_remove_all (accelerator_keys_to_tree_iter_map);
+	for (i = 0; i < MIN (dialog->program_index->len, G_N_ELEMENTS (accelerator_key_mapping)); i++)
+		g_hash_table_insert (accelerator_keys_to_tree_iter_map, GUINT_TO_POINTER(accelerator_key_mapping[i].key_id), GINT_TO_POINTER(i));
+
+	model_filter = gtk_tree_model_filter_new (GTK_TREE_MODEL (dialog->program_list_store),
+						  NULL);
+	gtk_tree_model_filter_set_visible_column (GTK_TREE_MODEL_FILTER (model_filter),
+						  COLUMN_VISIBLE);
+
+	gtk_tree_view_set_model (GTK_TREE_VIEW (dialog->program_list),
+				 model_filter);
+	g_object_unref (model_filter);
+	/* FIXME use the same search than the fuzzy one? */
+	gtk_tree_view_set_search_column (GTK_TREE_VIEW (dialog->program_list),
+					 COLUMN_NAME);
+
+	/* filter the new list with what is already typed */
+	if (panel_run_dialog_get_combo_text (dialog) [0] != '\0' &&
+	    !dialog->use_program_list &&
+	    !dialog->find_command_idle_id)
+		dialog->find_command_idle_id =
+			panel_scheduler_add (PANEL_SCHEDULER_PRIORITY_DEFAULT,
+					     "run-dialog-find-command",
+					     (GSourceFunc) panel_run_dialog_find_command_idle,
+					     dialog, NULL);
+}
+
+/* Appends the applications until the slice of the scheduler is spent, so
+ * that a menu with thousands of entries does not block the main loop. */
+static gboolean
+panel_run_dialog_fill_program_list_idle (PanelRunDialog *dialog)
+{
+	int n;
+
+	for (n = 0; dialog->pending_applications; n++) {
+		MateMenuTreeEntry *entry = dialog->pending_applications->data;
+		GtkTreeIter    iter;
+		GDesktopAppInfo *ginfo;
+		GIcon *gicon = NULL;
+		ProgramIndexEntry index_entry = { 0 };
+		guint i = dialog->pending_index->len;
+
+		if (n > 0 && panel_scheduler_should_yield ())
+			break;
+
+		dialog->pending_applications = g_slist_delete_link (dialog->pending_applications,
+								    dialog->pending_applications);
+
+		ginfo = matemenu_tree_entry_get_app_info (entry);
+		gicon = g_app_info_get_icon(G_APP_INFO(ginfo));
+
+		gtk_list_store_append (dialog->pending_store, &iter);
+		gtk_list_store_set (dialog->pending_store, &iter,
+				    COLUMN_GICON,     gicon,
+				    COLUMN_NAME,      g_app_info_get_display_name(G_APP_INFO(ginfo)),
+				    COLUMN_COMMENT,   g_app_info_get_description(G_APP_INFO(ginfo)),
+				    COLUMN_EXEC,      g_app_info_get_commandline(G_APP_INFO(ginfo)),
+				    COLUMN_PATH,      matemenu_tree_entry_get_desktop_file_path (entry),
+				    COLUMN_VISIBLE,   TRUE,
+				    -1);
+
+		program_index_entry_init (&index_entry, &iter, gicon,
+					  g_app_info_get_display_name (G_APP_INFO (ginfo)),
+					  g_app_info_get_description (G_APP_INFO (ginfo)),
+					  g_app_info_get_commandline (G_APP_INFO (ginfo)));
+		index_entry.visible = TRUE;
+
+		if (i < G_N_ELEMENTS (accelerator_key_mapping)) {
+			gtk_list_store_set (dialog->pending_store, &iter,
+					    COLUMN_ACCELERATOR_MASK, (gint)accelerator_key_mapping[i].modifier,
+					    COLUMN_ACCELERATOR_KEY_VALUE, accelerator_key_mapping[i].key_id,
+					    -1);
+			index_entry.accel_mask = (gint)accelerator_key_mapping[i].modifier;
+			index_entry.accel_key = accelerator_key_mapping[i].key_id;
+		} else {
+			gtk_list_store_set (dialog->pending_store, &iter,
+					    COLUMN_ACCELERATOR_MASK, (gint)GDK_MOD1_MASK,
+					    COLUMN_ACCELERATOR_KEY_VALUE, 0,
+					    -1);
+			index_entry.accel_mask = (gint)GDK_MOD1_MASK;
+			index_entry.accel_key = 0;
+		}
 
-	tree = matemenu_tree_new ("mate-applications.menu", MATEMENU_TREE_FLAGS_SORT_DISPLAY_NAME);
-	if (!matemenu_tree_load_sync (tree, &error)) {
-		g_printerr ("Failed to load tree: %s\n", error->message);
-		g_error_free(error);
-		g_object_unref(tree);
-		return NULL;
-	}
+		g_array_append_val (dialog->pending_index, index_entry);
 
-	root = matemenu_tree_get_root_directory (tree);
-	if (root == NULL){
-		g_object_unref(tree);
-		return NULL;
+		matemenu_tree_item_unref (entry);
 	}
 
-	retval = get_all_applications_from_dir(root, NULL);
-
-	matemenu_tree_item_unref(root);
-	g_object_unref(tree);
+	if (dialog->pending_applications)
+		return G_SOURCE_CONTINUE;
 
-	retval = g_slist_sort(retval, (GCompareFunc) compare_applications);
+	dialog->pending_fill_id = 0;
+	panel_run_dialog_finish_fill_program_list (dialog);
 
-	return retval;
+	return G_SOURCE_REMOVE;
 }
 
-static gboolean
-panel_run_dialog_add_items_idle (PanelRunDialog *dialog)
+static void
+panel_run_dialog_fill_program_list (PanelRunDialog *dialog)
 {
-	GtkCellRenderer   *renderer;
-	GtkTreeViewColumn *column;
-	GtkTreeModel      *model_filter;
 	GSList            *all_applications;
 	GSList            *l;
 	GSList            *next;
 	const char        *prev_name;
 
+	panel_run_dialog_cancel_fill_program_list (dialog);
+
 	/* create list store */
-	dialog->program_list_store = gtk_list_store_new (NUM_COLUMNS,
-							 G_TYPE_ICON,
-							 G_TYPE_STRING,
-							 G_TYPE_INT, // For accelerator modifier mask
-							 G_TYPE_UINT, // For accelerator key value
-							 G_TYPE_STRING,
-							 G_TYPE_STRING,
-							 G_TYPE_STRING,
-							 G_TYPE_BOOLEAN);
-
-	all_applications = get_all_applications ();
+	dialog->pending_store = gtk_list_store_new (NUM_COLUMNS,
+						    G_TYPE_ICON,
+						    G_TYPE_STRING,
+						    G_TYPE_INT, // For accelerator modifier mask
+						    G_TYPE_UINT, // For accelerator key value
+						    G_TYPE_STRING,
+						    G_TYPE_STRING,
+						    G_TYPE_STRING,
+						    G_TYPE_BOOLEAN);
+
+	all_applications = get_all_applications (dialog->menu_tree);
 
 	/* Strip duplicates */
 	prev_name = NULL;
@@ -940,53 +1405,109 @@ panel_run_dialog_add_items_idle (PanelRunDialog *dialog)
 		}
 	}
 
-	gint i = 0;
-	g_hash_table_remove_all (accelerator_keys_to_tree_iter_map);
+	sort_applications_by_frecency (all_applications);
 
-	for (l = all_applications; l; l = l->next) {
-		MateMenuTreeEntry *entry = l->data;
-		GtkTreeIter    iter;
-		GDesktopAppInfo *ginfo;
-		GIcon *gicon = NULL;
+	dialog->pending_index = g_array_sized_new (FALSE, TRUE,
+						   sizeof (ProgramIndexEntry),
+						   g_slist_length (all_applications));
+	g_array_set_clear_func (dialog->pending_index,
+				(GDestroyNotify) program_index_entry_clear);
 
-		ginfo = matemenu_tree_entry_get_app_info (entry);
-		gicon = g_app_info_get_icon(G_APP_INFO(ginfo));
+	dialog->pending_applications = all_applications;
+	dialog->pending_fill_id =
+		panel_scheduler_add (PANEL_SCHEDULER_PRIORITY_LOW,
+				     "run-dialog-fill-program-list",
+				     (GSourceFunc) panel_run_dialog_fill_program_list_idle,
+				     dialog, NULL);
+}
 
-		gtk_list_store_append (dialog->program_list_store, &iter);
-		gtk_list_store_set (dialog->program_list_store, &iter,
-				    COLUMN_GICON,     gicon,
-				    COLUMN_NAME,      g_app_info_get_display_name(G_APP_INFO(ginfo)),
-				    COLUMN_COMMENT,   g_app_info_get_description(G_APP_INFO(ginfo)),
-				    COLUMN_EXEC,      g_app_info_get_commandline(G_APP_INFO(ginfo)),
-				    COLUMN_PATH,      matemenu_tree_entry_get_desktop_file_path (entry),
-				    COLUMN_VISIBLE,   TRUE,
-				    -1);
-		if (i < G_N_ELEMENTS (accelerator_key_mapping)) {
-			gtk_list_store_set (dialog->program_list_store, &iter,
-					    COLUMN_ACCELERATOR_MASK, (gint)accelerator_key_mapping[i].modifier,
-					    COLUMN_ACCELERATOR_KEY_VALUE, accelerator_key_mapping[i].key_id,
-					    -1);
-			g_hash_table_insert (accelerator_keys_to_tree_iter_map, GUINT_TO_POINTER(accelerator_key_mapping[i].key_id), GINT_TO_POINTER(i));
-			i++;
-		} else {
-			gtk_list_store_set (dialog->program_list_store, &iter,
-					    COLUMN_ACCELERATOR_MASK, (gint)GDK_MOD1_MASK,
-					    COLUMN_ACCELERATOR_KEY_VALUE, 0,
-					    -1);
-		}
+static void
+panel_run_dialog_load_applications_thread (GTask        *task,
+					   gpointer      source_object,
+					   gpointer      task_data,
+					   GCancellable *cancellable)
+{
+	MateMenuTree *tree;
+	GError       *error = NULL;
+
+	tree = panel_menu_tree_load ("mate-applications.menu", &error);
+
+	if (tree)
+		g_task_return_pointer (task, tree, g_object_unref);
+	else
+		g_task_return_error (task, error);
+}
+
+static void panel_run_dialog_load_applications (PanelRunDialog *dialog);
+
+static void
+panel_run_dialog_menu_tree_changed (MateMenuTree   *tree,
+				    PanelRunDialog *dialog)
+{
+	panel_run_dialog_load_applications (dialog);
+}
+
+static void
+panel_run_dialog_load_applications_done (GObject      *source_object,
+					 GAsyncResult *result,
+					 gpointer      user_data)
+{
+	PanelRunDialog *dialog;
+	MateMenuTree   *tree;
+	GError         *error = NULL;
+
+	tree = g_task_propagate_pointer (G_TASK (result), &error);
+
+	if (!tree) {
+		/* a cancelled load means the dialog may be gone */
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			g_printerr ("Failed to load tree: %s\n", error->message);
+		g_error_free (error);
+		return;
 	}
-	g_slist_free_full (all_applications, matemenu_tree_item_unref);
 
-	model_filter = gtk_tree_model_filter_new (GTK_TREE_MODEL (dialog->program_list_store),
-						  NULL);
-	gtk_tree_model_filter_set_visible_column (GTK_TREE_MODEL_FILTER (model_filter),
-						  COLUMN_VISIBLE);
+	dialog = user_data;
+	g_clear_object (&dialog->menu_tree_cancellable);
 
-	gtk_tree_view_set_model (GTK_TREE_VIEW (dialog->program_list),
-				 model_filter);
-	/* FIXME use the same search than the fuzzy one? */
-	gtk_tree_view_set_search_column (GTK_TREE_VIEW (dialog->program_list),
-					 COLUMN_NAME);
+	if (dialog->menu_tree) {
+		g_signal_handlers_disconnect_by_data (dialog->menu_tree, dialog);
+		g_object_unref (dialog->menu_tree);
+	}
+
+	dialog->menu_tree = tree;
+	g_signal_connect (dialog->menu_tree, "changed",
+			  G_CALLBACK (panel_run_dialog_menu_tree_changed),
+			  dialog);
+
+	panel_run_dialog_fill_program_list (dialog);
+}
+
+/* The tree is loaded in a thread, like the menus, and kept so that the
+ * list is only built again when the tree changes. */
+static void
+panel_run_dialog_load_applications (PanelRunDialog *dialog)
+{
+	GTask *task;
+
+	if (dialog->menu_tree_cancellable) {
+		g_cancellable_cancel (dialog->menu_tree_cancellable);
+		g_object_unref (dialog->menu_tree_cancellable);
+	}
+
+	dialog->menu_tree_cancellable = g_cancellable_new ();
+
+	task = g_task_new (NULL, dialog->menu_tree_cancellable,
+			   panel_run_dialog_load_applications_done, dialog);
+	g_task_run_in_thread (task, panel_run_dialog_load_applications_thread);
+	g_object_unref (task);
+}
+
+static void
+panel_run_dialog_setup_program_list_columns (PanelRunDialog *dialog)
+{
+	GtkCellRenderer   *renderer;
+	GtkTreeViewColumn *column;
+	int                width;
 
 	renderer = gtk_cell_renderer_pixbuf_new ();
 	g_object_set (renderer, "stock-size", panel_menu_icon_get_size(), NULL);
@@ -1002,8 +1523,11 @@ panel_run_dialog_add_items_idle (PanelRunDialog *dialog)
                                              "text", COLUMN_NAME,
                                              NULL);
 
-	gtk_tree_view_column_set_sizing (column, 
-	                                 GTK_TREE_VIEW_COLUMN_AUTOSIZE);
+	/* with fixed sizes, only the rows on screen are measured and
+	 * rendered, so only their icons get loaded */
+	gtk_tree_view_column_set_sizing (column,
+	                                 GTK_TREE_VIEW_COLUMN_FIXED);
+	gtk_tree_view_column_set_expand (column, TRUE);
 
 	gtk_tree_view_append_column (GTK_TREE_VIEW (dialog->program_list), column);
 
@@ -1011,13 +1535,24 @@ panel_run_dialog_add_items_idle (PanelRunDialog *dialog)
 	g_object_set (renderer, "accel-mode", GTK_CELL_RENDERER_ACCEL_MODE_GTK,
 	             "editable", FALSE, NULL);
 
+	/* wide enough for the longest shortcut */
+	g_object_set (renderer,
+		      "accel-mods", GDK_MOD1_MASK,
+		      "accel-key", GDK_KEY_0,
+		      NULL);
+	gtk_cell_renderer_get_preferred_width (renderer, dialog->program_list,
+					       NULL, &width);
+
 	column = gtk_tree_view_column_new_with_attributes ("Shortcut", renderer,
 	                                                  "accel-mods", COLUMN_ACCELERATOR_MASK, "accel-key",
 	                                                  COLUMN_ACCELERATOR_KEY_VALUE, NULL);
+	gtk_tree_view_column_set_sizing (column,
+	                                 GTK_TREE_VIEW_COLUMN_FIXED);
+	gtk_tree_view_column_set_fixed_width (column, width);
 	gtk_tree_view_append_column (GTK_TREE_VIEW (dialog->program_list), column);
 
-	dialog->add_items_idle_id = 0;
-	return G_SOURCE_REMOVE;
+	gtk_tree_view_set_fixed_height_mode (GTK_TREE_VIEW (dialog->program_list),
+					     TRUE);
 }
 
 static char *
@@ -1090,11 +1625,8 @@ program_list_selection_changed (GtkTreeSelection *selection,
 	if (!path)
 		return;
 
-	key_file = g_key_file_new ();
-
-	if (!g_key_file_load_from_file (key_file, path,
-					G_KEY_FILE_NONE, NULL)) {
-		g_key_file_free (key_file);
+	key_file = panel_desktop_cache_lookup (path, NULL);
+	if (!key_file) {
 		g_free (path);
 		return;
 	}
@@ -1137,7 +1669,7 @@ program_list_selection_changed (GtkTreeSelection *selection,
 	gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (dialog->terminal_checkbox),
 				      terminal);
 
-	g_key_file_free (key_file);
+	g_key_file_unref (key_file);
 
 	g_free (path);
 }
@@ -1188,10 +1720,10 @@ panel_run_dialog_setup_program_list (PanelRunDialog *dialog,
 				  G_CALLBACK (program_list_selection_activated),
 				  dialog);
 
+		panel_run_dialog_setup_program_list_columns (dialog);
+
 		/* start loading the list of applications */
-		dialog->add_items_idle_id =
-			g_idle_add_full (G_PRIORITY_LOW, (GSourceFunc) panel_run_dialog_add_items_idle,
-					 dialog, NULL);
+		panel_run_dialog_load_applications (dialog);
 	}
 }
 
@@ -1342,128 +1874,341 @@ panel_run_dialog_setup_file_button (PanelRunDialog *dialog,
 			  dialog);
 }
 
-static GList *
-fill_files_from (const char *dirname,
-		 const char *dirprefix,
-		 char        prefix,
-		 GList      *existing_items)
+/* Directory listings for completion are shared between dialogs and read
+ * asynchronously, so that typing a path on a slow file system does not
+ * block; a monitor drops the listing when the directory changes. */
+#define DIRECTORY_CACHE_SIZE 32
+
+typedef struct {
+	DirectoryListing *listing;
+	GCancellable     *cancellable;
+	GList            *names;
+	gboolean          dirty;
+} DirectoryLoad;
+
+struct _DirectoryListing {
+	int             ref_count;
+	char           *dirname;
+	GList          *names;	/* directories have a trailing '/' */
+	gboolean        loaded;
+
+	DirectoryLoad  *load;
+	GFileMonitor   *monitor;
+	PanelRunDialog *waiting_dialog;
+};
+
+static GHashTable *directory_cache = NULL;
+static guint       directory_cache_serial = 0;
+
+static void directory_listing_load (DirectoryListing *listing);
+static void panel_run_dialog_refresh_completion (PanelRunDialog *dialog);
+
+static DirectoryListing *
+directory_listing_ref (DirectoryListing *listing)
 {
-	GList         *list;
-	DIR           *dir;
-	struct dirent *dent;
+	listing->ref_count++;
 
-	list = NULL;
-	dir = opendir (dirname);
+	return listing;
+}
 
-	if (!dir)
-		return list;
+static void
+directory_listing_unref (DirectoryListing *listing)
+{
+	if (--listing->ref_count > 0)
+		return;
 
-	while ((dent = readdir (dir))) {
-		char       *file;
-		char       *item;
-		const char *suffix;
+	g_free (listing->dirname);
+	g_list_free_full (listing->names, g_free);
+	g_free (listing);
+}
 
-		if (dent->d_name [0] != prefix)
-			continue;
+static void
+directory_listing_cancel_load (DirectoryListing *listing)
+{
+	if (!listing->load)
+		return;
 
-		file = g_build_filename (dirname, dent->d_name, NULL);
-
-		suffix = NULL;
-		if (
-#ifdef HAVE_STRUCT_DIRENT_D_TYPE
-		/* don't use g_file_test at first so we don't stat() */
-		    dent->d_type == DT_DIR ||
-		    (dent->d_type == DT_LNK &&
-		     g_file_test (file, G_FILE_TEST_IS_DIR))
-#else
-		    g_file_test (file, G_FILE_TEST_IS_DIR)
-#endif
-		   )
-			suffix = "/";
+	/* the pending callback frees the load */
+	g_cancellable_cancel (listing->load->cancellable);
+	listing->load = NULL;
+}
 
-		g_free (file);
+static void
+directory_listing_evict (DirectoryListing *listing)
+{
+	directory_listing_cancel_load (listing);
+
+	if (listing->monitor) {
+		g_signal_handlers_disconnect_by_data (listing->monitor, listing);
+		g_file_monitor_cancel (listing->monitor);
+		g_clear_object (&listing->monitor);
+	}
+
+	directory_listing_unref (listing);
+}
 
-		item = g_build_filename (dirprefix, dent->d_name, suffix, NULL);
+static void
+directory_listing_changed (GFileMonitor      *monitor,
+			   GFile             *file,
+			   GFile             *other_file,
+			   GFileMonitorEvent  event_type,
+			   DirectoryListing  *listing)
+{
+	switch (event_type) {
+	case G_FILE_MONITOR_EVENT_CREATED:
+	case G_FILE_MONITOR_EVENT_DELETED:
+	case G_FILE_MONITOR_EVENT_RENAMED:
+	case G_FILE_MONITOR_EVENT_MOVED_IN:
+	case G_FILE_MONITOR_EVENT_MOVED_OUT:
+		break;
+	default:
+		return;
+	}
 
-		list = g_list_prepend (list, item);
+	if (listing->load) {
+		listing->load->dirty = TRUE;
+	} else if (listing->loaded) {
+		g_list_free_full (listing->names, g_free);
+		listing->names = NULL;
+		listing->loaded = FALSE;
+		directory_cache_serial++;
 	}
+}
 
-	closedir (dir);
+static void
+directory_load_free (DirectoryLoad *load)
+{
+	directory_listing_unref (load->listing);
+	g_object_unref (load->cancellable);
+	g_list_free_full (load->names, g_free);
+	g_free (load);
+}
 
-	return list;
+static void
+directory_load_finish (DirectoryLoad *load,
+		       GError        *error)
+{
+	DirectoryListing *listing = load->listing;
+	PanelRunDialog   *dialog;
+
+	if (listing->load != load ||
+	    g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		directory_load_free (load);
+		return;
+	}
+
+	listing->load = NULL;
+
+	if (load->dirty) {
+		directory_load_free (load);
+		directory_listing_load (listing);
+		return;
+	}
+
+	/* an unreadable directory just has nothing to complete */
+	if (error)
+		g_debug ("Cannot list %s: %s", listing->dirname, error->message);
+
+	g_list_free_full (listing->names, g_free);
+	listing->names = load->names;
+	listing->loaded = TRUE;
+	load->names = NULL;
+	directory_cache_serial++;
+
+	if (!listing->monitor) {
+		GFile *file;
+
+		file = g_file_new_for_path (listing->dirname);
+		listing->monitor = g_file_monitor_directory (file,
+							     G_FILE_MONITOR_NONE,
+							     NULL, NULL);
+		if (listing->monitor)
+			g_signal_connect (listing->monitor, "changed",
+					  G_CALLBACK (directory_listing_changed),
+					  listing);
+		g_object_unref (file);
+	}
+
+	dialog = listing->waiting_dialog;
+	directory_load_free (load);
+
+	if (dialog)
+		panel_run_dialog_refresh_completion (dialog);
 }
 
-static GList *
-fill_possible_executables (void)
+static void
+directory_load_next_files_cb (GObject      *source,
+			      GAsyncResult *result,
+			      gpointer      user_data)
 {
-	GList         *list;
-	const char    *path;
-	char         **pathv;
-	int            i;
+	GFileEnumerator *enumerator = G_FILE_ENUMERATOR (source);
+	DirectoryLoad   *load = user_data;
+	GError          *error = NULL;
+	GList           *files;
+	GList           *l;
 
-	list = NULL;
-	path = g_getenv ("PATH");
+	files = g_file_enumerator_next_files_finish (enumerator, result, &error);
 
-	if (!path || !path [0])
-		return list;
+	for (l = files; l; l = l->next) {
+		GFileInfo *info = l->data;
 
-	pathv = g_strsplit (path, ":", 0);
+		if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
+			load->names = g_list_prepend (load->names,
+						      g_strconcat (g_file_info_get_name (info),
+								   "/", NULL));
+		else
+			load->names = g_list_prepend (load->names,
+						      g_strdup (g_file_info_get_name (info)));
+	}
 
-	for (i = 0; pathv [i]; i++) {
-		const char *file;
-		GDir       *dir;
+	if (files) {
+		g_list_free_full (files, g_object_unref);
+		g_file_enumerator_next_files_async (enumerator, 64,
+						    G_PRIORITY_DEFAULT,
+						    load->cancellable,
+						    directory_load_next_files_cb,
+						    load);
+		return;
+	}
 
-		dir = g_dir_open (pathv [i], 0, NULL);
+	g_file_enumerator_close_async (enumerator, G_PRIORITY_DEFAULT,
+				       NULL, NULL, NULL);
+	g_object_unref (enumerator);
 
-		if (!dir)
-			continue;
+	directory_load_finish (load, error);
+	g_clear_error (&error);
+}
 
-		while ((file = g_dir_read_name (dir))) {
-			list = g_list_prepend (list, g_build_filename (pathv [i], file, NULL));
-		}
+static void
+directory_load_enumerate_cb (GObject      *source,
+			     GAsyncResult *result,
+			     gpointer      user_data)
+{
+	GFileEnumerator *enumerator;
+	DirectoryLoad   *load = user_data;
+	GError          *error = NULL;
+
+	enumerator = g_file_enumerate_children_finish (G_FILE (source),
+						       result, &error);
+	if (!enumerator) {
+		directory_load_finish (load, error);
+		g_error_free (error);
+		return;
+	}
+
+	g_file_enumerator_next_files_async (enumerator, 64,
+					    G_PRIORITY_DEFAULT,
+					    load->cancellable,
+					    directory_load_next_files_cb,
+					    load);
+}
+
+static void
+directory_listing_load (DirectoryListing *listing)
+{
+	DirectoryLoad *load;
+	GFile         *file;
+
+	load = g_new0 (DirectoryLoad, 1);
+	load->listing = directory_listing_ref (listing);
+	load->cancellable = g_cancellable_new ();
+	listing->load = load;
+
+	/* the type is the one of the symlink target, as with the
+	 * g_file_test() this replaces */
+	file = g_file_new_for_path (listing->dirname);
+	g_file_enumerate_children_async (file,
+					 G_FILE_ATTRIBUTE_STANDARD_NAME ","
+					 G_FILE_ATTRIBUTE_STANDARD_TYPE,
+					 G_FILE_QUERY_INFO_NONE,
+					 G_PRIORITY_DEFAULT,
+					 load->cancellable,
+					 directory_load_enumerate_cb,
+					 load);
+	g_object_unref (file);
+}
+
+/* A dialog waiting for a listing holds a reference on it and is only
+ * refreshed by its load: the listing has to stay in the cache, or its load
+ * would be cancelled and the dialog never completed */
+static gboolean
+directory_cache_can_evict (gpointer          key,
+			   DirectoryListing *listing,
+			   gpointer          user_data)
+{
+	return listing->waiting_dialog == NULL;
+}
 
-		g_dir_close (dir);
+static DirectoryListing *
+directory_cache_get (const char *dirname)
+{
+	DirectoryListing *listing;
+
+	if (!directory_cache)
+		directory_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+							 NULL,
+							 (GDestroyNotify) directory_listing_evict);
+
+	listing = g_hash_table_lookup (directory_cache, dirname);
+
+	if (!listing) {
+		/* keep the number of monitors bounded */
+		if (g_hash_table_size (directory_cache) >= DIRECTORY_CACHE_SIZE)
+			g_hash_table_foreach_remove (directory_cache,
+						     (GHRFunc) directory_cache_can_evict,
+						     NULL);
+
+		listing = g_new0 (DirectoryListing, 1);
+		listing->ref_count = 1;
+		listing->dirname = g_strdup (dirname);
+		g_hash_table_insert (directory_cache, listing->dirname, listing);
 	}
 
-	g_strfreev (pathv);
+	if (!listing->loaded && !listing->load)
+		directory_listing_load (listing);
 
-	return list;
+	return listing;
 }
 
 static GList *
-fill_executables (GList *possible_executables,
-		  GList *existing_items,
-		  char   prefix)
+directory_listing_complete (DirectoryListing *listing,
+			    const char       *dirprefix,
+			    char              prefix)
 {
 	GList *list;
 	GList *l;
 
 	list = NULL;
 
-	for (l = possible_executables; l; l = l->next) {
-		const char *filename;
-		char       *basename;
+	for (l = listing->names; l; l = l->next) {
+		const char *name = l->data;
 
-		filename = l->data;
-		basename = g_path_get_basename (filename);
+		if (name [0] != prefix)
+			continue;
 
-		if (basename [0] == prefix &&
-		    g_file_test (filename, G_FILE_TEST_IS_REGULAR) &&
-		    g_file_test (filename, G_FILE_TEST_IS_EXECUTABLE)) {
+		list = g_list_prepend (list,
+				       g_build_filename (dirprefix, name, NULL));
+	}
 
-			if (g_list_find_custom (existing_items, basename,
-						(GCompareFunc) strcmp)) {
-				g_free (basename);
-				return NULL;
-			}
+	return list;
+}
+
+static void
+panel_run_dialog_stop_completion (PanelRunDialog *dialog)
+{
+	DirectoryListing *listing = dialog->completion_dir;
+
+	if (!listing)
+		return;
 
-			list = g_list_prepend (list, basename);
-		 } else {
-			g_free (basename);
-		 }
+	if (listing->waiting_dialog == dialog) {
+		listing->waiting_dialog = NULL;
+		/* the user moved on before the listing was read */
+		directory_listing_cancel_load (listing);
 	}
 
-	return list;
+	dialog->completion_dir = NULL;
+	directory_listing_unref (listing);
 }
 
 static GtkTreeModel *
@@ -1483,6 +2228,33 @@ create_completion_model (GList *list)
 	return GTK_TREE_MODEL (store);
 }
 
+/* Sorts in place a list of completions */
+static void
+sort_completion_by_frecency (GList *list)
+{
+	FrecencyItem *items;
+	GList        *l;
+	guint         n_items;
+	guint         i;
+
+	n_items = g_list_length (list);
+	items = g_new (FrecencyItem, n_items);
+
+	for (l = list, i = 0; l; l = l->next, i++) {
+		items[i].data = l->data;
+		items[i].score = panel_run_frecency_get_score (l->data);
+		items[i].position = i;
+	}
+
+	g_qsort_with_data (items, n_items, sizeof (FrecencyItem),
+			   (GCompareDataFunc) compare_frecency_items, NULL);
+
+	for (l = list, i = 0; l; l = l->next, i++)
+		l->data = items[i].data;
+
+	g_free (items);
+}
+
 static void
 completion_add_items (GtkEntryCompletion *completion, GList *list)
 {
@@ -1497,18 +2269,19 @@ static void
 panel_run_dialog_update_completion (PanelRunDialog *dialog,
 				    const char     *text)
 {
-	GList *list;
-	GList *executables;
-	char   prefix;
-	char  *buf;
-	char  *dirname;
-	char  *dirprefix;
-	char  *key;
+	DirectoryListing *listing;
+	GList            *list;
+	gboolean          complete;
+	char              prefix;
+	char             *buf;
+	char             *dirname;
+	char             *dirprefix;
+	char             *key;
 
 	g_assert (text != NULL && *text != '\0' && !g_ascii_isspace (*text));
 
 	list = NULL;
-	executables = NULL;
+	complete = TRUE;
 
 	buf = g_path_get_basename (text);
 	prefix = buf[0];
@@ -1523,9 +2296,15 @@ panel_run_dialog_update_completion (PanelRunDialog *dialog,
 	} else {
 		/* complete against relative path and executable name */
 		if (!strchr (text, '/')) {
-			executables = fill_executables (dialog->possible_executables,
-							dialog->completion_items,
-							text [0]);
+			char exec_prefix [2] = { prefix, '\0' };
+
+			/* until the index is ready, try again on the next
+			 * key press */
+			if (panel_executable_index_is_ready ())
+				list = panel_executable_index_complete (exec_prefix);
+			else
+				complete = FALSE;
+
 			dirprefix = g_strdup ("");
 		} else {
 			dirprefix = g_path_get_dirname (text);
@@ -1536,26 +2315,67 @@ panel_run_dialog_update_completion (PanelRunDialog *dialog,
 
 	key = g_strdup_printf ("%s%c%c", dirprefix, G_DIR_SEPARATOR, prefix);
 
-	if (!g_hash_table_lookup (dialog->dir_hash, key)) {
-		g_hash_table_insert (dialog->dir_hash, key, dialog);
-
-		list = fill_files_from (dirname, dirprefix, prefix,
-					dialog->completion_items);
-	} else {
+	if (complete &&
+	    dialog->completion_serial == directory_cache_serial &&
+	    g_strcmp0 (key, dialog->completion_key) == 0) {
+		g_list_free_full (list, g_free);
 		g_free (key);
+		g_free (dirname);
+		g_free (dirprefix);
+		return;
+	}
+
+	listing = directory_cache_get (dirname);
+
+	if (dialog->completion_dir != listing) {
+		panel_run_dialog_stop_completion (dialog);
+		dialog->completion_dir = directory_listing_ref (listing);
 	}
 
-	list = g_list_concat (list, executables);
+	if (listing->loaded) {
+		listing->waiting_dialog = NULL;
+		list = g_list_concat (directory_listing_complete (listing,
+								  dirprefix,
+								  prefix),
+				      list);
+	} else {
+		/* completed again once the directory is read */
+		listing->waiting_dialog = dialog;
+		complete = FALSE;
+	}
 
 	g_free (dirname);
 	g_free (dirprefix);
 
-	if (list == NULL)
-		return;
+	g_free (dialog->completion_key);
+	dialog->completion_key = complete ? key : NULL;
+	dialog->completion_serial = directory_cache_serial;
+	if (!complete)
+		g_free (key);
+
+	/* suggest the most used commands first */
+	sort_completion_by_frecency (list);
 
 	completion_add_items (dialog->completion, list);
-	dialog->completion_items = g_list_concat (dialog->completion_items,
-						  list);
+	g_list_free_full (list, g_free);
+}
+
+static void
+panel_run_dialog_refresh_completion (PanelRunDialog *dialog)
+{
+	const char *text;
+
+	if (!panel_profile_get_enable_autocompletion ())
+		return;
+
+	text = panel_run_dialog_get_combo_text (dialog);
+	while (*text != '\0' && g_ascii_isspace (*text))
+		text++;
+	if (*text == '\0')
+		return;
+
+	panel_run_dialog_update_completion (dialog, text);
+	gtk_entry_completion_complete (dialog->completion);
 }
 
 static gboolean
@@ -1642,6 +2462,9 @@ combobox_changed (GtkComboBox    *combobox,
 	char *text = g_strdup (panel_run_dialog_get_combo_text (dialog));
 	char *start = text;
 
+	/* the command being checked is not the one in the entry anymore */
+	panel_run_dialog_cancel_execute (dialog);
+
 	while (*start != '\0' && g_ascii_isspace (*start))
 		start++;
 
@@ -1671,37 +2494,36 @@ combobox_changed (GtkComboBox    *combobox,
 		panel_run_dialog_set_default_icon (dialog, FALSE);
 
 		if (dialog->find_command_idle_id) {
-			g_source_remove (dialog->find_command_idle_id);
+			panel_scheduler_remove (dialog->find_command_idle_id);
 			dialog->find_command_idle_id = 0;
 		}
 
-		if (panel_profile_get_enable_program_list ()) {
+		if (panel_profile_get_enable_program_list () &&
+		    dialog->program_index) {
 			GtkTreeIter   iter;
 			GtkTreePath  *path;
-			GtkTreeModel *model;
-			gint          i = 0;
-			gboolean      valid = FALSE;
+			guint         i;
 
 			g_hash_table_remove_all (accelerator_keys_to_tree_iter_map);
-			model = GTK_TREE_MODEL (dialog->program_list_store);
-			for (valid = gtk_tree_model_get_iter_first (model, &iter); valid; valid = gtk_tree_model_iter_next (model, &iter)) {
+			for (i = 0; i < dialog->program_index->len; i++) {
+				ProgramIndexEntry *entry;
+
+				entry = &g_array_index (dialog->program_index, ProgramIndexEntry, i);
+
 				if (i < G_N_ELEMENTS (accelerator_key_mapping)) {
-					gtk_list_store_set (GTK_LIST_STORE (GTK_TREE_MODEL (dialog->program_list_store)), &iter,
-							    COLUMN_VISIBLE, TRUE,
-							    COLUMN_ACCELERATOR_MASK, (gint)accelerator_key_mapping[i].modifier,
-							    COLUMN_ACCELERATOR_KEY_VALUE, accelerator_key_mapping[i].key_id,
-							    -1);
+					program_index_entry_update (dialog, entry, TRUE,
+								    (gint)accelerator_key_mapping[i].modifier,
+								    accelerator_key_mapping[i].key_id);
 					g_hash_table_insert (accelerator_keys_to_tree_iter_map, GUINT_TO_POINTER (accelerator_key_mapping[i].key_id), GINT_TO_POINTER(i));
-					i++;
 				} else {
-					gtk_list_store_set (GTK_LIST_STORE (GTK_TREE_MODEL (dialog->program_list_store)), &iter,
-							    COLUMN_VISIBLE, TRUE,
-							    COLUMN_ACCELERATOR_MASK, (gint)GDK_MOD1_MASK,
-							    COLUMN_ACCELERATOR_KEY_VALUE, 0,
-							    -1);
+					program_index_entry_update (dialog, entry, TRUE,
+								    (gint)GDK_MOD1_MASK, 0);
 				}
 			}
 
+			/* the next search starts from scratch */
+			g_clear_pointer (&dialog->program_query, g_free);
+
 			path = gtk_tree_path_new_first ();
 			if (gtk_tree_model_get_iter (gtk_tree_view_get_model (GTK_TREE_VIEW (dialog->program_list)),
 						     &iter, path))
@@ -1734,9 +2556,10 @@ combobox_changed (GtkComboBox    *combobox,
 	    !dialog->use_program_list &&
 	    !dialog->find_command_idle_id)
 		dialog->find_command_idle_id =
-			g_idle_add_full (G_PRIORITY_LOW,
-					 (GSourceFunc) panel_run_dialog_find_command_idle,
-					 dialog, NULL);
+			panel_scheduler_add (PANEL_SCHEDULER_PRIORITY_DEFAULT,
+					     "run-dialog-find-command",
+					     (GSourceFunc) panel_run_dialog_find_command_idle,
+					     dialog, NULL);
 
 	g_free (text);
 }
@@ -1795,8 +2618,7 @@ panel_run_dialog_setup_entry (PanelRunDialog *dialog,
 	GtkWidget             *entry;
 
 	dialog->combobox = PANEL_GTK_BUILDER_GET (gui, "comboboxentry");
-	dialog->possible_executables = fill_possible_executables ();
-	dialog->dir_hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	panel_executable_index_init ();
 
 	entry = gtk_bin_get_child (GTK_BIN (dialog->combobox));
 	gtk_entry_set_activates_default (GTK_ENTRY (entry), TRUE);
@@ -1861,7 +2683,7 @@ panel_run_dialog_create_desktop_file (PanelRunDialog *dialog)
 	scheme = g_uri_parse_scheme (disk);
 	/* if it's an absolute path or not a URI, it's possibly an executable */
 	if (g_path_is_absolute (disk) || !scheme)
-		exec = command_is_executable (disk, NULL, NULL);
+		exec = command_is_executable_cached (disk);
 	g_free (scheme);
 
 	if (exec) {
@@ -2043,6 +2865,9 @@ panel_run_dialog_new (GdkScreen  *screen,
 	g_signal_connect_swapped (dialog->run_dialog, "destroy",
 				  G_CALLBACK (panel_run_dialog_destroy), dialog);
 
+	g_signal_connect (dialog->run_dialog, "delete-event",
+			  G_CALLBACK (panel_run_dialog_delete_event), dialog);
+
 	GtkAccelGroup* accel_group = gtk_accel_group_new ();
 	gtk_window_add_accel_group (GTK_WINDOW(dialog->run_dialog), accel_group);
 	g_object_unref (accel_group);
@@ -2058,6 +2883,7 @@ panel_run_dialog_new (GdkScreen  *screen,
 	}
 
 	dialog->run_button = PANEL_GTK_BUILDER_GET (gui, "run_button");
+	dialog->execute_spinner = PANEL_GTK_BUILDER_GET (gui, "execute_spinner");
 	dialog->terminal_checkbox = PANEL_GTK_BUILDER_GET (gui, "terminal_checkbox");
 
 	dialog->settings = g_settings_new (PANEL_RUN_SCHEMA);
@@ -2118,7 +2944,9 @@ panel_run_dialog_present (GdkScreen *screen,
 			  guint32    activate_time)
 {
 	GtkBuilder *gui;
-	accelerator_keys_to_tree_iter_map = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, NULL);
+
+	if (!accelerator_keys_to_tree_iter_map)
+		accelerator_keys_to_tree_iter_map = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, NULL);
 
 	if (panel_lockdown_get_disable_command_line ())
 		return;
@@ -2138,6 +2966,7 @@ panel_run_dialog_present (GdkScreen *screen,
 	                               NULL);
 
 	static_dialog = panel_run_dialog_new (screen, gui, activate_time);
+	static_dialog->resident = TRUE;
 
 	g_signal_connect_swapped (static_dialog->run_dialog, "destroy",
 				  G_CALLBACK (panel_run_dialog_static_dialog_destroyed),
@@ -2149,9 +2978,62 @@ panel_run_dialog_present (GdkScreen *screen,
 	g_object_unref (gui);
 }
 
+static guint64
+program_index_entry_get_size (ProgramIndexEntry *entry)
+{
+	const char *strings[] = { entry->name, entry->exec, entry->exec_basename,
+				  entry->exec_key, entry->name_key, entry->comment_key };
+	guint64     size = 0;
+	guint       i;
+
+	for (i = 0; i < G_N_ELEMENTS (strings); i++)
+		if (strings[i])
+			size += strlen (strings[i]) + 1;
+
+	return size;
+}
+
+/* The program list is the biggest thing the dialog keeps while hidden:
+ * the rows are counted, and the search index is estimated from its
+ * strings. */
+void
+panel_run_dialog_get_memory_stats (GVariantDict *stats)
+{
+	guint64 index_size = 0;
+	guint   n_rows = 0;
+	guint   i;
+
+	if (static_dialog && static_dialog->program_list_store)
+		n_rows = gtk_tree_model_iter_n_children (GTK_TREE_MODEL (static_dialog->program_list_store),
+							 NULL);
+
+	if (static_dialog && static_dialog->program_index) {
+		GArray *index = static_dialog->program_index;
+
+		index_size = (guint64) index->len * sizeof (ProgramIndexEntry);
+		for (i = 0; i < index->len; i++)
+			index_size += program_index_entry_get_size (&g_array_index (index, ProgramIndexEntry, i));
+	}
+
+	g_variant_dict_insert (stats, "exists", "b", static_dialog != NULL);
+	g_variant_dict_insert (stats, "rows", "u", n_rows);
+	g_variant_dict_insert (stats, "index-bytes", "t", index_size);
+}
+
 void
 panel_run_dialog_quit_on_destroy (void)
 {
+	/* closing the dialog quits, so it must really go away */
+	static_dialog->resident = FALSE;
+
 	g_signal_connect(static_dialog->run_dialog, "destroy",
 			 G_CALLBACK(gtk_main_quit), NULL);
 }
+
+/* The window of the dialog, if it was presented, for the interaction
+ * benchmark */
+GtkWidget *
+panel_run_dialog_peek_window (void)
+{
+	return static_dialog ? static_dialog->run_dialog : NULL;
+}
@@ -26,7 +26,8 @@
 #ifndef __PANEL_RUN_DIALOG_H__
 #define __PANEL_RUN_DIALOG_H__
 
-#include <gdk/gdk.h>
+#include <gtk/gtk.h>
+#include <gio/gio.h>
 
 G_BEGIN_DECLS
 
@@ -35,6 +36,10 @@ void panel_run_dialog_present           (GdkScreen  *screen,
 
 void panel_run_dialog_quit_on_destroy (void);
 
+void panel_run_dialog_get_memory_stats (GVariantDict *stats);
+
+GtkWidget *panel_run_dialog_peek_window (void);
+
 G_END_DECLS
 
 #endif /* __PANEL_RUN_DIALOG_H__ */
@@ -0,0 +1,299 @@
+/*
+ * panel-run-frecency.c: rank the commands of the run dialog by use
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/* Every command launched from the run dialog is appended to a small text
+ * file, one "last use<TAB>count<TAB>program" line per launch, so that
+ * recording a launch is a single write done off the main thread. Reading
+ * the file sums up the lines of each program; when there are many more
+ * lines than programs, the file is rewritten with one line per program.
+ *
+ * Programs are the basename of the first word of the command, so that
+ * "firefox", "/usr/bin/firefox" and the "firefox %u" of a desktop file
+ * share their score. */
+
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "panel-run-frecency.h"
+
+#define PANEL_RUN_FRECENCY_FILE "run-frecency"
+
+/* compact the file when it has that many more lines than programs */
+#define PANEL_RUN_FRECENCY_SLACK 256
+
+typedef struct {
+	gint64 last_used; /* seconds since the epoch */
+	guint  count;
+} PanelRunFrecency;
+
+static GHashTable *frecency_table = NULL;
+
+static char *
+panel_run_frecency_get_filename (void)
+{
+	return g_build_filename (g_get_user_cache_dir (), "mate-panel",
+				 PANEL_RUN_FRECENCY_FILE, NULL);
+}
+
+static char *
+panel_run_frecency_get_program (const char *command)
+{
+	const char *start, *end;
+	char       *word;
+	char       *program;
+
+	while (g_ascii_isspace (*command))
+		command++;
+
+	start = command;
+	end = start;
+	while (*end && !g_ascii_isspace (*end))
+		end++;
+
+	if (end == start)
+		return NULL;
+
+	word = g_strndup (start, end - start);
+	program = g_path_get_basename (word);
+	g_free (word);
+
+	/* the program name is the last field of a line */
+	if (strchr (program, '\n')) {
+		g_free (program);
+		return NULL;
+	}
+
+	return program;
+}
+
+static void
+panel_run_frecency_add (const char *program,
+			gint64      last_used,
+			guint       count)
+{
+	PanelRunFrecency *frecency;
+
+	frecency = g_hash_table_lookup (frecency_table, program);
+	if (!frecency) {
+		frecency = g_new0 (PanelRunFrecency, 1);
+		g_hash_table_insert (frecency_table, g_strdup (program), frecency);
+	}
+
+	frecency->last_used = MAX (frecency->last_used, last_used);
+	frecency->count += count;
+}
+
+static void
+panel_run_frecency_compact (const char *filename)
+{
+	GHashTableIter    iter;
+	gpointer          key, value;
+	GString          *contents;
+	GError           *error = NULL;
+
+	contents = g_string_new (NULL);
+
+	g_hash_table_iter_init (&iter, frecency_table);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		PanelRunFrecency *frecency = value;
+
+		g_string_append_printf (contents,
+					"%" G_GINT64_FORMAT "\t%u\t%s\n",
+					frecency->last_used, frecency->count,
+					(const char *) key);
+	}
+
+	if (!g_file_set_contents (filename, contents->str, contents->len,
+				  &error)) {
+		g_debug ("Cannot compact %s: %s", filename, error->message);
+		g_error_free (error);
+	}
+
+	g_string_free (contents, TRUE);
+}
+
+static void
+panel_run_frecency_load (void)
+{
+	GMappedFile  *mapped;
+	const char   *contents;
+	const char   *end;
+	char         *filename;
+	guint         lines;
+
+	if (frecency_table)
+		return;
+
+	frecency_table = g_hash_table_new_full (g_str_hash, g_str_equal,
+						g_free, g_free);
+
+	filename = panel_run_frecency_get_filename ();
+	mapped = g_mapped_file_new (filename, FALSE, NULL);
+
+	if (!mapped) {
+		g_free (filename);
+		return;
+	}
+
+	contents = g_mapped_file_get_contents (mapped);
+	end = contents + g_mapped_file_get_length (mapped);
+	lines = 0;
+
+	while (contents && contents < end) {
+		const char *eol;
+		char       *line;
+		char      **fields;
+
+		eol = memchr (contents, '\n', end - contents);
+		if (!eol)
+			break;
+
+		line = g_strndup (contents, eol - contents);
+		fields = g_strsplit (line, "\t", 3);
+
+		if (g_strv_length (fields) == 3 && fields [2][0])
+			panel_run_frecency_add (fields [2],
+						g_ascii_strtoll (fields [0], NULL, 10),
+						(guint) g_ascii_strtoull (fields [1], NULL, 10));
+
+		g_strfreev (fields);
+		g_free (line);
+
+		contents = eol + 1;
+		lines++;
+	}
+
+	g_mapped_file_unref (mapped);
+
+	if (lines > g_hash_table_size (frecency_table) + PANEL_RUN_FRECENCY_SLACK)
+		panel_run_frecency_compact (filename);
+
+	g_free (filename);
+}
+
+static void
+panel_run_frecency_append_thread (GTask        *task,
+				  gpointer      source_object,
+				  gpointer      task_data,
+				  GCancellable *cancellable)
+{
+	const char *line = task_data;
+	char       *filename;
+	char       *dirname;
+	int         fd;
+
+	filename = panel_run_frecency_get_filename ();
+	dirname = g_path_get_dirname (filename);
+
+	if (g_mkdir_with_parents (dirname, 0700) != 0 ||
+	    (fd = g_open (filename, O_WRONLY | O_CREAT | O_APPEND, 0600)) < 0) {
+		g_debug ("Cannot open %s: %s", filename, g_strerror (errno));
+	} else {
+		/* lines are short enough to be appended in one write */
+		if (write (fd, line, strlen (line)) < 0)
+			g_debug ("Cannot write to %s: %s", filename,
+				 g_strerror (errno));
+		close (fd);
+	}
+
+	g_free (dirname);
+	g_free (filename);
+
+	g_task_return_boolean (task, TRUE);
+}
+
+void
+panel_run_frecency_record (const char *command)
+{
+	GTask  *task;
+	char   *program;
+	gint64  now;
+
+	g_return_if_fail (command != NULL);
+
+	program = panel_run_frecency_get_program (command);
+	if (!program)
+		return;
+
+	panel_run_frecency_load ();
+
+	now = g_get_real_time () / G_USEC_PER_SEC;
+	panel_run_frecency_add (program, now, 1);
+
+	task = g_task_new (NULL, NULL, NULL, NULL);
+	g_task_set_task_data (task,
+			      g_strdup_printf ("%" G_GINT64_FORMAT "\t1\t%s\n",
+					       now, program),
+			      g_free);
+	g_task_run_in_thread (task, panel_run_frecency_append_thread);
+	g_object_unref (task);
+
+	g_free (program);
+}
+
+/* The number of launches, weighted by how long ago the program was last
+ * used: a program used a lot last year should not win against the one
+ * used this morning. */
+gdouble
+panel_run_frecency_get_score (const char *command)
+{
+	PanelRunFrecency *frecency;
+	char             *program;
+	gint64            age;
+	gdouble           weight;
+
+	g_return_val_if_fail (command != NULL, 0);
+
+	panel_run_frecency_load ();
+
+	program = panel_run_frecency_get_program (command);
+	if (!program)
+		return 0;
+
+	frecency = g_hash_table_lookup (frecency_table, program);
+	g_free (program);
+
+	if (!frecency)
+		return 0;
+
+	age = g_get_real_time () / G_USEC_PER_SEC - frecency->last_used;
+
+	if (age < 4 * 24 * 3600)
+		weight = 1.0;
+	else if (age < 14 * 24 * 3600)
+		weight = 0.7;
+	else if (age < 31 * 24 * 3600)
+		weight = 0.5;
+	else if (age < 90 * 24 * 3600)
+		weight = 0.3;
+	else
+		weight = 0.1;
+
+	return frecency->count * weight;
+}
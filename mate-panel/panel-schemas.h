@@ -67,6 +67,7 @@
 #define PANEL_MENU_BAR_ICON_NAME_KEY          "icon-name"
 #define PANEL_MENU_BAR_MAX_ITEMS_OR_SUBMENU   "max-items-or-submenu"
 #define PANEL_MENU_BAR_MAX_RECENT_ITEMS       "max-recent-items"
+#define PANEL_MENU_BAR_MENU_RELEASE_DELAY_KEY "menu-release-delay"
 
 /* external schemas */
 
@@ -0,0 +1,249 @@
+/*
+ * panel-search-benchmark.c: measure the case insensitive search
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/* mate-panel --benchmark-search=STRINGS makes that many strings looking
+ * like the names and descriptions of applications, some of them not in
+ * ASCII, and looks for the prefixes of a few words in all of them, like
+ * the filters of the Run and Add to Panel dialogs do while typing. It
+ * compares the search the panel had before (decoding and lowering the
+ * needle for every string), panel_g_utf8_strstrcase() and a needle
+ * prepared once with panel_g_utf8_needle_new(), and checks that they all
+ * find the same matches.
+ *
+ * The results are printed as one line of key=value pairs, like the menu
+ * benchmark does. All times are in microseconds. */
+
+#include <config.h>
+
+#include <string.h>
+
+#include <glib.h>
+
+#include <libpanel-util/panel-glib.h>
+
+#include "panel-search-benchmark.h"
+
+#define BENCHMARK_ROUNDS 5
+
+static const char *benchmark_words [] = {
+	"Terminal", "Text", "Editor", "Files", "Browser", "Web", "Mail",
+	"Calculator", "Image", "Viewer", "Music", "Player", "Video",
+	"System", "Monitor", "Settings", "Archive", "Manager", "Office",
+	"Document", "Spreadsheet", "Presentation", "Screenshot", "Disk",
+	"Café", "Éditeur", "Größe", "Ñandú", "Пошта", "終端"
+};
+
+static const char *benchmark_needles [] = {
+	"terminal", "ed", "mon", "web browser", "zzz", "éd", "grö", "终"
+};
+
+/* The search of panel_g_utf8_strstrcase() before the needle could be
+ * prepared, as the reference to compare with */
+static const char *
+benchmark_reference_strstrcase (const char *haystack,
+				const char *needle)
+{
+	gunichar   *nuni;
+	gunichar    unival;
+	gint        nlen;
+	const char *o, *p;
+
+	if (haystack == NULL) return NULL;
+	if (needle == NULL) return NULL;
+	if (strlen (needle) == 0) return haystack;
+	if (strlen (haystack) == 0) return NULL;
+
+	nuni = g_alloca (sizeof (gunichar) * strlen (needle));
+
+	nlen = 0;
+	for (p = needle; (unival = g_utf8_get_char (p)) != (gunichar) -1 && unival; p = g_utf8_next_char (p))
+		nuni[nlen++] = g_unichar_tolower (unival);
+	if (unival == (gunichar) -1)
+		return NULL;
+
+	o = haystack;
+	for (p = haystack; (unival = g_utf8_get_char (p)) != (gunichar) -1 && unival; p = g_utf8_next_char (p)) {
+		if (g_unichar_tolower (unival) == nuni[0]) {
+			const char *q = g_utf8_next_char (p);
+			gint npos = 1;
+
+			while (npos < nlen) {
+				unival = g_utf8_get_char (q);
+				if (unival == (gunichar) -1 || !unival) return NULL;
+				if (g_unichar_tolower (unival) != nuni[npos]) break;
+				q = g_utf8_next_char (q);
+				npos++;
+			}
+			if (npos == nlen)
+				return o;
+		}
+		o = g_utf8_next_char (p);
+	}
+
+	return NULL;
+}
+
+static GPtrArray *
+benchmark_make_strings (guint n_strings)
+{
+	GPtrArray *strings;
+	GRand     *rand;
+	guint      i;
+
+	/* the same strings on every run */
+	rand = g_rand_new_with_seed (42);
+	strings = g_ptr_array_new_with_free_func (g_free);
+
+	for (i = 0; i < n_strings; i++) {
+		GString *string;
+		guint    n_words, j;
+
+		string = g_string_new (NULL);
+		n_words = g_rand_int_range (rand, 1, 8);
+
+		for (j = 0; j < n_words; j++) {
+			if (j > 0)
+				g_string_append_c (string, ' ');
+			g_string_append (string,
+					 benchmark_words [g_rand_int_range (rand, 0, G_N_ELEMENTS (benchmark_words))]);
+		}
+
+		g_ptr_array_add (strings, g_string_free (string, FALSE));
+	}
+
+	g_rand_free (rand);
+
+	return strings;
+}
+
+/* Every prefix of the needles, as typed one key after the other */
+static GPtrArray *
+benchmark_make_queries (void)
+{
+	GPtrArray *queries;
+	guint      i;
+
+	queries = g_ptr_array_new_with_free_func (g_free);
+
+	for (i = 0; i < G_N_ELEMENTS (benchmark_needles); i++) {
+		const char *p;
+
+		for (p = g_utf8_next_char (benchmark_needles [i]); ; p = g_utf8_next_char (p)) {
+			g_ptr_array_add (queries,
+					 g_strndup (benchmark_needles [i], p - benchmark_needles [i]));
+			if (*p == '\0')
+				break;
+		}
+	}
+
+	return queries;
+}
+
+int
+panel_search_benchmark_run (int n_strings)
+{
+	GPtrArray *strings;
+	GPtrArray *queries;
+	gint64     reference_us = G_MAXINT64;
+	gint64     strstrcase_us = G_MAXINT64;
+	gint64     needle_us = G_MAXINT64;
+	guint      n_matches = 0;
+	guint      n_mismatches = 0;
+	guint      round, i, j;
+
+	if (n_strings <= 0) {
+		g_printerr ("The number of strings of the search benchmark must be positive.\n");
+		return 1;
+	}
+
+	strings = benchmark_make_strings (n_strings);
+	queries = benchmark_make_queries ();
+
+	/* the results are compared once, the best of the rounds is kept */
+	for (i = 0; i < queries->len; i++) {
+		const char *query = g_ptr_array_index (queries, i);
+		PanelGUtf8Needle *needle = panel_g_utf8_needle_new (query);
+
+		for (j = 0; j < strings->len; j++) {
+			const char *string = g_ptr_array_index (strings, j);
+			const char *expected;
+
+			expected = benchmark_reference_strstrcase (string, query);
+			if (expected)
+				n_matches++;
+
+			if (panel_g_utf8_strstrcase (string, query) != expected ||
+			    panel_g_utf8_needle_find (needle, string) != expected)
+				n_mismatches++;
+		}
+
+		panel_g_utf8_needle_free (needle);
+	}
+
+	for (round = 0; round < BENCHMARK_ROUNDS; round++) {
+		gint64 start;
+		guint  found = 0;
+
+		start = g_get_monotonic_time ();
+		for (i = 0; i < queries->len; i++)
+			for (j = 0; j < strings->len; j++)
+				if (benchmark_reference_strstrcase (g_ptr_array_index (strings, j),
+								    g_ptr_array_index (queries, i)))
+					found++;
+		reference_us = MIN (reference_us, g_get_monotonic_time () - start);
+
+		start = g_get_monotonic_time ();
+		for (i = 0; i < queries->len; i++)
+			for (j = 0; j < strings->len; j++)
+				if (panel_g_utf8_strstrcase (g_ptr_array_index (strings, j),
+							     g_ptr_array_index (queries, i)))
+					found++;
+		strstrcase_us = MIN (strstrcase_us, g_get_monotonic_time () - start);
+
+		start = g_get_monotonic_time ();
+		for (i = 0; i < queries->len; i++) {
+			PanelGUtf8Needle *needle;
+
+			needle = panel_g_utf8_needle_new (g_ptr_array_index (queries, i));
+			for (j = 0; j < strings->len; j++)
+				if (panel_g_utf8_needle_find (needle, g_ptr_array_index (strings, j)))
+					found++;
+			panel_g_utf8_needle_free (needle);
+		}
+		needle_us = MIN (needle_us, g_get_monotonic_time () - start);
+
+		/* keeps the searches from being optimized away */
+		if (found != 3 * n_matches)
+			n_mismatches++;
+	}
+
+	g_print ("search strings=%u queries=%u matches=%u mismatches=%u"
+		 " reference_us=%" G_GINT64_FORMAT
+		 " strstrcase_us=%" G_GINT64_FORMAT
+		 " needle_us=%" G_GINT64_FORMAT "\n",
+		 strings->len, queries->len, n_matches, n_mismatches,
+		 reference_us, strstrcase_us, needle_us);
+
+	g_ptr_array_unref (queries);
+	g_ptr_array_unref (strings);
+
+	return n_mismatches == 0 ? 0 : 1;
+}
@@ -26,7 +26,6 @@
 #include <config.h>
 
 #include "panel-separator.h"
-#include "panel-background.h"
 #include "panel-profile.h"
 
 #define SEPARATOR_SIZE 10
@@ -131,37 +130,6 @@ panel_separator_get_preferred_height (GtkWidget *widget,
 		*minimal_height = *natural_height = size;
 }
 
-static void
-panel_separator_size_allocate (GtkWidget     *widget,
-			       GtkAllocation *allocation)
-{
-	GtkAllocation    old_allocation;
-	GtkAllocation    widget_allocation;
-	PanelBackground *background;
-
-	gtk_widget_get_allocation (widget, &widget_allocation);
-
-	old_allocation.x      = widget_allocation.x;
-	old_allocation.y      = widget_allocation.y;
-	old_allocation.width  = widget_allocation.width;
-	old_allocation.height = widget_allocation.height;
-
-	GTK_WIDGET_CLASS (panel_separator_parent_class)->size_allocate (widget, allocation);
-
-	if (old_allocation.x      == allocation->x &&
-	    old_allocation.y      == allocation->y &&
-	    old_allocation.width  == allocation->width &&
-	    old_allocation.height == allocation->height)
-		return;
-
-	background = &PANEL_SEPARATOR (widget)->priv->panel->toplevel->background;
-	if (background->type == PANEL_BACK_NONE ||
-	   (background->type == PANEL_BACK_COLOR && !background->has_alpha))
-		return;
-
-	panel_separator_change_background (PANEL_SEPARATOR (widget));
-}
-
 static void
 panel_separator_parent_set (GtkWidget *widget,
 			   GtkWidget *previous_parent)
@@ -185,7 +153,6 @@ panel_separator_class_init (PanelSeparatorClass *klass)
 	widget_class->draw                 = panel_separator_draw;
 	widget_class->get_preferred_width  = panel_separator_get_preferred_width;
 	widget_class->get_preferred_height = panel_separator_get_preferred_height;
-	widget_class->size_allocate = panel_separator_size_allocate;
 	widget_class->parent_set    = panel_separator_parent_set;
 
 	gtk_widget_class_set_css_name (widget_class, "PanelSeparator");
@@ -199,6 +166,11 @@ panel_separator_init (PanelSeparator *separator)
 	separator->priv->info  = NULL;
 	separator->priv->panel = NULL;
 	separator->priv->orientation = GTK_ORIENTATION_HORIZONTAL;
+
+	/* The line is drawn straight on the panel, over its background:
+	 * the separator only keeps an input window, to be moved and to get
+	 * its context menu like any other object. */
+	gtk_event_box_set_visible_window (GTK_EVENT_BOX (separator), FALSE);
 }
 
 void
@@ -267,9 +239,3 @@ panel_separator_create (PanelToplevel *toplevel,
 	panel_profile_add_to_list (PANEL_GSETTINGS_OBJECTS, id);
 	g_free (id);
 }
-
-void
-panel_separator_change_background (PanelSeparator *separator)
-{
-	panel_background_apply_css(&separator->priv->panel->toplevel->background, GTK_WIDGET(separator));
-}
@@ -63,7 +63,6 @@ void   panel_separator_load_from_gsettings   (PanelWidget      *panel_widget,
 					  const char       *id);
 void   panel_separator_set_orientation   (PanelSeparator   *separator,
 					  PanelOrientation  orientation);
-void   panel_separator_change_background (PanelSeparator   *separator);
 
 #ifdef __cplusplus
 }
@@ -29,18 +29,374 @@
  */
 
 #include <config.h>
+
+#include <string.h>
+
 #include <glib/gi18n.h>
 
 #include <libpanel-util/panel-cleanup.h>
+#include <libpanel-util/panel-perf.h>
+#include <libpanel-util/panel-scheduler.h>
 
+#include "applet.h"
+#include "button-widget.h"
+#include "menu.h"
+#include "panel-applet-frame.h"
+#include "panel-background.h"
+#include "panel-layout-snapshot.h"
+#include "panel-menu-button.h"
 #include "panel-profile.h"
+#include "panel-run-dialog.h"
 #include "panel-session.h"
+#include "panel-toplevel.h"
+#include "panel-widget.h"
 
 #include "panel-shell.h"
 
-#define PANEL_DBUS_SERVICE "org.mate.Panel"
+#define PANEL_DBUS_SERVICE     "org.mate.Panel"
+#define PANEL_DBUS_OBJECT_PATH "/org/mate/Panel"
 
 static GDBusConnection *dbus_connection = NULL;
+static guint            debug_registration_id = 0;
+static guint            perf_registration_id = 0;
+
+/* What the applets cost to the panel and to the session, for
+ * monitoring: one (id, stats) entry per applet. The stats are described
+ * in the frame and container implementations; the "applet-" ones are
+ * counted by the applets themselves, and fetched from all of them before
+ * replying.
+ *
+ * GetAppletCounters adds up the "applet-" stats of all the applets, over
+ * all the factories; the "-max-" ones are the maximum instead.
+ *
+ * GetMemoryStats estimates what the panel itself keeps in memory, to
+ * find out what grows in a long session: one entry per toplevel
+ * ("toplevel:<id>") and per object ("object:<id>"), then "run-dialog"
+ * and "applet-info". The sizes are in bytes.
+ *
+ * GetIdleWork lists the tasks queued in the idle scheduler, in the order
+ * they will run. The times are in microseconds. */
+static const gchar panel_shell_introspection_xml[] =
+	"<node>"
+	  "<interface name='org.mate.Panel.Debug'>"
+	    "<method name='GetAppletStats'>"
+	      "<arg name='applets' type='a(sa{sv})' direction='out'/>"
+	    "</method>"
+	    "<method name='GetAppletCounters'>"
+	      "<arg name='counters' type='a{st}' direction='out'/>"
+	    "</method>"
+	    "<method name='GetMemoryStats'>"
+	      "<arg name='entries' type='a(sa{sv})' direction='out'/>"
+	    "</method>"
+	    "<method name='GetIdleWork'>"
+	      "<arg name='tasks' type='a(sa{sv})' direction='out'/>"
+	    "</method>"
+	  "</interface>"
+	"</node>";
+
+static GVariant *
+panel_shell_get_applet_stats (void)
+{
+	GVariantBuilder  builder;
+	GSList          *l;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sa{sv})"));
+
+	for (l = mate_panel_applet_list_applets (); l; l = l->next) {
+		AppletInfo   *info = l->data;
+		GVariantDict  stats;
+
+		if (info->type != PANEL_OBJECT_APPLET ||
+		    !PANEL_IS_APPLET_FRAME (info->widget))
+			continue;
+
+		g_variant_dict_init (&stats, NULL);
+		mate_panel_applet_frame_get_stats (MATE_PANEL_APPLET_FRAME (info->widget),
+						   &stats);
+		g_variant_builder_add (&builder, "(s@a{sv})",
+				       info->id, g_variant_dict_end (&stats));
+	}
+
+	return g_variant_new ("(a(sa{sv}))", &builder);
+}
+
+static GVariant *
+panel_shell_get_applet_counters (void)
+{
+	GVariantBuilder  builder;
+	GHashTable      *counters;
+	GHashTableIter   hash_iter;
+	gpointer         key, value;
+	GSList          *l;
+
+	/* name -> guint64 */
+	counters = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+	for (l = mate_panel_applet_list_applets (); l; l = l->next) {
+		AppletInfo   *info = l->data;
+		GVariantDict  stats;
+		GVariant     *dict;
+		GVariantIter  iter;
+		const char   *name;
+		GVariant     *stat;
+
+		if (info->type != PANEL_OBJECT_APPLET ||
+		    !PANEL_IS_APPLET_FRAME (info->widget))
+			continue;
+
+		g_variant_dict_init (&stats, NULL);
+		mate_panel_applet_frame_get_stats (MATE_PANEL_APPLET_FRAME (info->widget),
+						   &stats);
+		dict = g_variant_ref_sink (g_variant_dict_end (&stats));
+
+		g_variant_iter_init (&iter, dict);
+		while (g_variant_iter_next (&iter, "{&sv}", &name, &stat)) {
+			guint64 *total;
+			guint64  count;
+
+			if (!g_str_has_prefix (name, "applet-") ||
+			    !g_variant_is_of_type (stat, G_VARIANT_TYPE_UINT64)) {
+				g_variant_unref (stat);
+				continue;
+			}
+
+			count = g_variant_get_uint64 (stat);
+			g_variant_unref (stat);
+
+			total = g_hash_table_lookup (counters, name);
+			if (!total) {
+				total = g_new0 (guint64, 1);
+				g_hash_table_insert (counters, g_strdup (name), total);
+			}
+
+			if (strstr (name, "-max-"))
+				*total = MAX (*total, count);
+			else
+				*total += count;
+		}
+
+		g_variant_unref (dict);
+	}
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{st}"));
+
+	g_hash_table_iter_init (&hash_iter, counters);
+	while (g_hash_table_iter_next (&hash_iter, &key, &value))
+		g_variant_builder_add (&builder, "{st}",
+				       (const char *) key, *(guint64 *) value);
+
+	g_hash_table_destroy (counters);
+
+	return g_variant_new ("(a{st})", &builder);
+}
+
+typedef struct {
+	GDBusMethodInvocation *invocation;
+	gboolean               counters;
+	guint                  n_pending;
+} PanelShellStatsRequest;
+
+static void
+panel_shell_stats_request_done (PanelShellStatsRequest *request)
+{
+	if (--request->n_pending > 0)
+		return;
+
+	g_dbus_method_invocation_return_value (request->invocation,
+					       request->counters ?
+					       panel_shell_get_applet_counters () :
+					       panel_shell_get_applet_stats ());
+	g_free (request);
+}
+
+static void
+panel_shell_applet_stats_updated (GObject      *source_object,
+				  GAsyncResult *res,
+				  gpointer      user_data)
+{
+	/* the applets that do not count anything just have no "applet-"
+	 * stats, nothing worth failing the call for */
+	mate_panel_applet_frame_update_stats_finish (MATE_PANEL_APPLET_FRAME (source_object),
+						     res, NULL);
+
+	panel_shell_stats_request_done (user_data);
+}
+
+/* Replies once all the applets sent their statistics, or failed to */
+static void
+panel_shell_return_applet_stats (GDBusMethodInvocation *invocation,
+				 gboolean               counters)
+{
+	PanelShellStatsRequest *request;
+	GSList                 *l;
+
+	request = g_new0 (PanelShellStatsRequest, 1);
+	request->invocation = invocation;
+	request->counters = counters;
+	request->n_pending = 1;
+
+	for (l = mate_panel_applet_list_applets (); l; l = l->next) {
+		AppletInfo *info = l->data;
+
+		if (info->type != PANEL_OBJECT_APPLET ||
+		    !PANEL_IS_APPLET_FRAME (info->widget))
+			continue;
+
+		request->n_pending++;
+		mate_panel_applet_frame_update_stats (MATE_PANEL_APPLET_FRAME (info->widget),
+						      panel_shell_applet_stats_updated,
+						      request);
+	}
+
+	panel_shell_stats_request_done (request);
+}
+
+static void
+panel_shell_add_memory_entry (GVariantBuilder *builder,
+			      const char      *kind,
+			      const char      *id,
+			      GVariantDict    *stats)
+{
+	char *name;
+
+	name = id ? g_strconcat (kind, ":", id, NULL) : g_strdup (kind);
+	g_variant_builder_add (builder, "(s@a{sv})",
+			       name, g_variant_dict_end (stats));
+	g_free (name);
+}
+
+static void
+panel_shell_get_object_memory_stats (AppletInfo   *info,
+				     GVariantDict *stats)
+{
+	GtkWidget *menu = NULL;
+	guint64    icon_size = 0;
+	guint64    menu_size = 0;
+	guint      n_menu_widgets = 0;
+
+	if (BUTTON_IS_WIDGET (info->widget))
+		icon_size = button_widget_get_memory_size (BUTTON_WIDGET (info->widget));
+
+	if (PANEL_IS_MENU_BUTTON (info->widget))
+		menu = panel_menu_button_peek_menu (PANEL_MENU_BUTTON (info->widget));
+	else if (GTK_IS_MENU_SHELL (info->widget))
+		menu = info->widget;
+
+	panel_menu_get_memory_size (menu, &n_menu_widgets, &menu_size);
+
+	g_variant_dict_insert (stats, "type", "u", (guint32) info->type);
+	g_variant_dict_insert (stats, "icon-bytes", "t", icon_size);
+	g_variant_dict_insert (stats, "menu-widgets", "u", n_menu_widgets);
+	g_variant_dict_insert (stats, "menu-bytes", "t", menu_size);
+
+	/* the context menu of the object, once it was shown */
+	panel_menu_get_memory_size (info->menu, &n_menu_widgets, &menu_size);
+	g_variant_dict_insert (stats, "context-menu-bytes", "t", menu_size);
+}
+
+static GVariant *
+panel_shell_get_memory_stats (void)
+{
+	GVariantBuilder  builder;
+	GVariantDict     stats;
+	GSList          *l;
+	guint64          info_size = 0;
+	guint            n_infos = 0;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sa{sv})"));
+
+	for (l = panel_toplevel_list_toplevels (); l; l = l->next) {
+		PanelToplevel *toplevel = l->data;
+		PanelWidget   *panel_widget;
+		guint64        size;
+
+		panel_widget = panel_toplevel_get_panel_widget (toplevel);
+		size = panel_background_get_memory_size (&toplevel->background);
+		if (panel_widget)
+			size += panel_background_get_memory_size (&panel_widget->background);
+
+		g_variant_dict_init (&stats, NULL);
+		g_variant_dict_insert (&stats, "background-bytes", "t", size);
+		panel_shell_add_memory_entry (&builder, "toplevel",
+					      panel_profile_get_toplevel_id (toplevel),
+					      &stats);
+	}
+
+	for (l = mate_panel_applet_list_applets (); l; l = l->next) {
+		AppletInfo *info = l->data;
+
+		n_infos++;
+		info_size += sizeof (AppletInfo);
+		if (info->id)
+			info_size += strlen (info->id) + 1;
+
+		g_variant_dict_init (&stats, NULL);
+		panel_shell_get_object_memory_stats (info, &stats);
+		panel_shell_add_memory_entry (&builder, "object", info->id, &stats);
+	}
+
+	g_variant_dict_init (&stats, NULL);
+	panel_run_dialog_get_memory_stats (&stats);
+	panel_shell_add_memory_entry (&builder, "run-dialog", NULL, &stats);
+
+	g_variant_dict_init (&stats, NULL);
+	g_variant_dict_insert (&stats, "entries", "u", n_infos);
+	g_variant_dict_insert (&stats, "bytes", "t", info_size);
+	panel_shell_add_memory_entry (&builder, "applet-info", NULL, &stats);
+
+	return g_variant_new ("(a(sa{sv}))", &builder);
+}
+
+static void
+panel_shell_method_call (GDBusConnection       *connection,
+			 const gchar           *sender,
+			 const gchar           *object_path,
+			 const gchar           *interface_name,
+			 const gchar           *method_name,
+			 GVariant              *parameters,
+			 GDBusMethodInvocation *invocation,
+			 gpointer               user_data)
+{
+	if (g_strcmp0 (method_name, "GetAppletStats") == 0)
+		panel_shell_return_applet_stats (invocation, FALSE);
+	else if (g_strcmp0 (method_name, "GetAppletCounters") == 0)
+		panel_shell_return_applet_stats (invocation, TRUE);
+	else if (g_strcmp0 (method_name, "GetMemoryStats") == 0)
+		g_dbus_method_invocation_return_value (invocation,
+						       panel_shell_get_memory_stats ());
+	else if (g_strcmp0 (method_name, "GetIdleWork") == 0)
+		g_dbus_method_invocation_return_value (invocation,
+						       g_variant_new ("(@a(sa{sv}))",
+								      panel_scheduler_get_queued ()));
+}
+
+static const GDBusInterfaceVTable panel_shell_interface_vtable = {
+	panel_shell_method_call,
+	NULL,
+	NULL,
+	{ 0 }
+};
+
+static void
+panel_shell_register_debug_interface (void)
+{
+	GDBusNodeInfo *node_info;
+	GError        *error = NULL;
+
+	node_info = g_dbus_node_info_new_for_xml (panel_shell_introspection_xml, NULL);
+	debug_registration_id =
+		g_dbus_connection_register_object (dbus_connection,
+						   PANEL_DBUS_OBJECT_PATH,
+						   node_info->interfaces[0],
+						   &panel_shell_interface_vtable,
+						   NULL, NULL, &error);
+	if (!debug_registration_id) {
+		g_warning ("Cannot register the panel debug interface: %s",
+			   error->message);
+		g_error_free (error);
+	}
+	g_dbus_node_info_unref (node_info);
+}
 
 static void
 panel_shell_on_name_lost (GDBusConnection *connection,
@@ -63,6 +419,16 @@ static void
 panel_shell_cleanup (gpointer data)
 {
 	if (dbus_connection != NULL) {
+		if (debug_registration_id) {
+			g_dbus_connection_unregister_object (dbus_connection,
+							     debug_registration_id);
+			debug_registration_id = 0;
+		}
+		if (perf_registration_id) {
+			g_dbus_connection_unregister_object (dbus_connection,
+							     perf_registration_id);
+			perf_registration_id = 0;
+		}
 		g_object_unref (dbus_connection);
 		dbus_connection = NULL;
 	}
@@ -130,6 +496,9 @@ panel_shell_register (gboolean replace)
 						    G_DBUS_SIGNAL_FLAGS_NONE,
 						    (GDBusSignalCallback)panel_shell_on_name_lost,
 						    NULL, NULL);
+		panel_shell_register_debug_interface ();
+		perf_registration_id = panel_perf_register (dbus_connection,
+							    PANEL_DBUS_OBJECT_PATH);
 		break;
 	case 2: /* DBUS_REQUEST_NAME_REPLY_IN_QUEUE */
 	case 3: /* DBUS_REQUEST_NAME_REPLY_EXISTS */
@@ -156,6 +525,8 @@ panel_shell_quit (void)
 {
 	GSList *toplevels_to_destroy, *l;
 
+	panel_layout_snapshot_save ();
+
         toplevels_to_destroy = g_slist_copy (panel_toplevel_list_toplevels ());
         for (l = toplevels_to_destroy; l; l = l->next)
 		gtk_widget_destroy (l->data);
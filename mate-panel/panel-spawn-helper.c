@@ -0,0 +1,224 @@
+/*
+ * panel-spawn-helper.c: small process spawning applications for the panel
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Forking the panel copies the page tables of a large process for each
+ * launch. This helper is started once by the panel and spawns the
+ * applications instead; it does not link to any library, so that it stays
+ * small.
+ *
+ * The panel talks to it on file descriptor 3. A request is a 32-bit
+ * length followed by NUL-terminated strings: the working directory
+ * (empty for none), the arguments and an empty string, the environment
+ * and an empty string. The reply is a 32-bit pid, or minus the errno of
+ * the failure. The helper exits when the panel closes its end.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SPAWN_HELPER_FD          3
+#define SPAWN_HELPER_MAX_REQUEST (1024 * 1024)
+
+static int
+read_all (int     fd,
+	  void   *buf,
+	  size_t  len)
+{
+	char *p = buf;
+
+	while (len > 0) {
+		ssize_t n = read (fd, p, len);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int
+write_all (int         fd,
+	   const void *buf,
+	   size_t      len)
+{
+	const char *p = buf;
+
+	while (len > 0) {
+		ssize_t n = write (fd, p, len);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/* Points vector at the strings starting at *p, up to the empty one, and
+ * moves *p after it. */
+static char **
+parse_strings (char **p,
+	       char  *end)
+{
+	char   **vector;
+	size_t   n, i;
+	char    *s;
+
+	n = 0;
+	for (s = *p; s < end && *s; s += strlen (s) + 1)
+		n++;
+
+	if (s >= end)
+		return NULL;
+
+	vector = calloc (n + 1, sizeof (char *));
+	if (!vector)
+		return NULL;
+
+	for (i = 0, s = *p; i < n; s += strlen (s) + 1)
+		vector[i++] = s;
+
+	*p = s + 1;
+
+	return vector;
+}
+
+static int32_t
+spawn_request (char   *request,
+	       size_t  len,
+	       const posix_spawnattr_t *attr)
+{
+	char   *end = request + len;
+	char   *p = request;
+	char   *cwd;
+	char  **argv;
+	char  **envp;
+	pid_t   pid;
+	int     result;
+
+	/* the request must end with a NUL for parsing to stop */
+	if (len == 0 || end[-1] != '\0')
+		return -EINVAL;
+
+	cwd = p;
+	p += strlen (p) + 1;
+
+	argv = parse_strings (&p, end);
+	envp = argv ? parse_strings (&p, end) : NULL;
+
+	if (!argv || !envp || !argv[0]) {
+		free (argv);
+		free (envp);
+		return -EINVAL;
+	}
+
+	result = 0;
+	if (cwd[0] && chdir (cwd) != 0)
+		result = errno;
+
+	if (result == 0)
+		result = posix_spawnp (&pid, argv[0], NULL, attr, argv, envp);
+
+	if (cwd[0] && chdir ("/") != 0)
+		result = result ? result : errno;
+
+	free (argv);
+	free (envp);
+
+	return result == 0 ? (int32_t) pid : -result;
+}
+
+int
+main (void)
+{
+	posix_spawnattr_t attr;
+	sigset_t          mask;
+
+	if (fcntl (SPAWN_HELPER_FD, F_SETFD, FD_CLOEXEC) != 0)
+		return 1;
+
+	if (chdir ("/") != 0)
+		return 1;
+
+	/* the applications are not ours to wait for */
+	signal (SIGCHLD, SIG_IGN);
+	signal (SIGPIPE, SIG_IGN);
+
+	/* but they must see the default dispositions and no blocked signal */
+	posix_spawnattr_init (&attr);
+	sigemptyset (&mask);
+	sigaddset (&mask, SIGCHLD);
+	sigaddset (&mask, SIGPIPE);
+	posix_spawnattr_setsigdefault (&attr, &mask);
+	sigemptyset (&mask);
+	posix_spawnattr_setsigmask (&attr, &mask);
+	posix_spawnattr_setflags (&attr, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+
+	for (;;) {
+		uint32_t  len;
+		int32_t   reply;
+		char     *request;
+
+		if (read_all (SPAWN_HELPER_FD, &len, sizeof (len)) != 0)
+			break;
+
+		if (len > SPAWN_HELPER_MAX_REQUEST)
+			break;
+
+		request = malloc (len + 1);
+		if (!request)
+			break;
+
+		if (read_all (SPAWN_HELPER_FD, request, len) != 0) {
+			free (request);
+			break;
+		}
+		request[len] = '\0';
+
+		reply = spawn_request (request, len, &attr);
+		free (request);
+
+		if (write_all (SPAWN_HELPER_FD, &reply, sizeof (reply)) != 0)
+			break;
+	}
+
+	posix_spawnattr_destroy (&attr);
+
+	return 0;
+}
@@ -30,9 +30,13 @@
 
 #include <gdk/gdkx.h>
 
+#include <libpanel-util/panel-perf.h>
+#include <libpanel-util/panel-trace.h>
+
 #include "panel-struts.h"
 
 #include "panel-multimonitor.h"
+#include "panel-profile.h"
 #include "panel-xutils.h"
 
 typedef struct {
@@ -53,8 +57,89 @@ typedef struct {
     int               allocated_strut_end;
 } PanelStrut;
 
+/* What was last written on the window of a toplevel */
+typedef struct {
+    PanelOrientation  orientation;
+    int               strut_size;
+    int               strut_start;
+    int               strut_end;
+    GdkRectangle      geometry;
+    int               scale;
+} PanelStrutHint;
+
 static GSList *panel_struts_list = NULL;
 
+/* Toplevels whose window hint has to be set (TRUE) or unset (FALSE) */
+static GHashTable *panel_struts_dirty_hints = NULL;
+static guint       panel_struts_flush_id = 0;
+
+/* While frozen, the conflicts between the struts are not resolved: each
+ * one gets what it asks for until they are all resolved on thaw */
+static guint       panel_struts_freeze_count = 0;
+
+/* Why the struts are being changed, for the trace */
+static const char *panel_struts_trace_cause = NULL;
+
+static const char *
+orientation_to_string (PanelOrientation orientation)
+{
+    switch (orientation) {
+    case PANEL_ORIENTATION_TOP:
+        return "top";
+    case PANEL_ORIENTATION_BOTTOM:
+        return "bottom";
+    case PANEL_ORIENTATION_LEFT:
+        return "left";
+    case PANEL_ORIENTATION_RIGHT:
+        return "right";
+    default:
+        return "unknown";
+    }
+}
+
+/* Changes of the struts make the window manager lay out all the windows
+ * again: with tracing enabled, each of them is recorded with the values
+ * before and after, and what caused it. */
+static void panel_struts_trace (PanelToplevel *toplevel,
+                                const char    *format,
+                                ...) G_GNUC_PRINTF (2, 3);
+
+static void
+panel_struts_trace (PanelToplevel *toplevel,
+                    const char    *format,
+                    ...)
+{
+    va_list     args;
+    const char *id;
+    char       *message;
+    char       *name;
+
+    id = panel_profile_get_toplevel_id (toplevel);
+
+    va_start (args, format);
+    message = g_strdup_vprintf (format, args);
+    va_end (args);
+
+    name = g_strdup_printf ("%s %s (%s)",
+                            id ? id : "panel",
+                            message,
+                            panel_struts_trace_cause ? panel_struts_trace_cause : "unknown");
+    panel_trace_instant ("struts", name);
+
+    g_free (name);
+    g_free (message);
+}
+
+const char *
+panel_struts_set_trace_cause (const char *cause)
+{
+    const char *previous = panel_struts_trace_cause;
+
+    panel_struts_trace_cause = cause;
+
+    return previous;
+}
+
 static inline PanelStrut *
 panel_struts_find_strut (PanelToplevel *toplevel)
 {
@@ -249,26 +334,47 @@ panel_struts_allocate_struts (PanelToplevel *toplevel,
     return toplevel_changed;
 }
 
-void
-panel_struts_set_window_hint (PanelToplevel *toplevel)
+static void
+panel_struts_clear_window_hint (PanelToplevel *toplevel)
 {
-    GtkWidget  *widget;
-    PanelStrut *strut;
-    int         strut_size;
-    int         monitor_x, monitor_y, monitor_width, monitor_height;
-    int         screen_width, screen_height;
-    int         leftmost, rightmost, topmost, bottommost;
-    int         scale;
+    GdkWindow *window;
 
-    widget = GTK_WIDGET (toplevel);
+    if (!gtk_widget_get_realized (GTK_WIDGET (toplevel)))
+        return;
+
+    window = gtk_widget_get_window (GTK_WIDGET (toplevel));
+    if (!g_object_get_data (G_OBJECT (window), "panel-struts-hint"))
+        return;
 
-    g_return_if_fail (GDK_IS_X11_DISPLAY (gtk_widget_get_display (widget)));
+    if (panel_trace_is_enabled ())
+        panel_struts_trace (toplevel, "clear window hint");
+
+    panel_perf_count ("strut-updates", 1);
+
+    g_object_set_data (G_OBJECT (window), "panel-struts-hint", NULL);
+    panel_xutils_unset_strut (window);
+}
+
+static void
+panel_struts_write_window_hint (PanelToplevel *toplevel)
+{
+    GtkWidget      *widget;
+    GdkWindow      *window;
+    PanelStrut     *strut;
+    PanelStrutHint *hint;
+    int             strut_size;
+    int             monitor_x, monitor_y, monitor_width, monitor_height;
+    int             screen_width, screen_height;
+    int             leftmost, rightmost, topmost, bottommost;
+    int             scale;
+
+    widget = GTK_WIDGET (toplevel);
 
     if (!gtk_widget_get_realized (widget))
         return;
 
     if (!(strut = panel_struts_find_strut (toplevel))) {
-        panel_struts_unset_window_hint (toplevel);
+        panel_struts_clear_window_hint (toplevel);
         return;
     }
 
@@ -316,7 +422,52 @@ panel_struts_set_window_hint (PanelToplevel *toplevel)
         break;
     }
 
-    panel_xutils_set_strut (gtk_widget_get_window (widget),
+    /* every change of the struts makes the window manager lay the
+     * windows out again: only tell it about real changes. The hint
+     * lives on the window, so that a new window gets it again. */
+    window = gtk_widget_get_window (widget);
+    hint = g_object_get_data (G_OBJECT (window), "panel-struts-hint");
+
+    if (hint &&
+        hint->orientation == strut->orientation &&
+        hint->strut_size  == strut_size &&
+        hint->strut_start == strut->allocated_strut_start &&
+        hint->strut_end   == strut->allocated_strut_end &&
+        hint->scale       == scale &&
+        gdk_rectangle_equal (&hint->geometry, &strut->allocated_geometry))
+        return;
+
+    if (panel_trace_is_enabled ()) {
+        if (hint)
+            panel_struts_trace (toplevel,
+                                "window hint %s %d [%d, %d], was %s %d [%d, %d]",
+                                orientation_to_string (strut->orientation), strut_size,
+                                strut->allocated_strut_start, strut->allocated_strut_end,
+                                orientation_to_string (hint->orientation), hint->strut_size,
+                                hint->strut_start, hint->strut_end);
+        else
+            panel_struts_trace (toplevel,
+                                "window hint %s %d [%d, %d], was none",
+                                orientation_to_string (strut->orientation), strut_size,
+                                strut->allocated_strut_start, strut->allocated_strut_end);
+    }
+
+    if (!hint) {
+        hint = g_new0 (PanelStrutHint, 1);
+        g_object_set_data_full (G_OBJECT (window), "panel-struts-hint",
+                                hint, g_free);
+    }
+
+    hint->orientation = strut->orientation;
+    hint->strut_size  = strut_size;
+    hint->strut_start = strut->allocated_strut_start;
+    hint->strut_end   = strut->allocated_strut_end;
+    hint->geometry    = strut->allocated_geometry;
+    hint->scale       = scale;
+
+    panel_perf_count ("strut-updates", 1);
+
+    panel_xutils_set_strut (window,
                             strut->orientation,
                             strut_size,
                             strut->allocated_strut_start,
@@ -325,15 +476,70 @@ panel_struts_set_window_hint (PanelToplevel *toplevel)
                             scale);
 }
 
+static gboolean
+panel_struts_flush_window_hints (gpointer user_data)
+{
+    GHashTable     *dirty;
+    GHashTableIter  iter;
+    gpointer        toplevel;
+    gpointer        set;
+    const char     *cause;
+
+    panel_struts_flush_id = 0;
+
+    dirty = panel_struts_dirty_hints;
+    panel_struts_dirty_hints = NULL;
+
+    if (!dirty)
+        return G_SOURCE_REMOVE;
+
+    cause = panel_struts_set_trace_cause ("queued write");
+
+    g_hash_table_iter_init (&iter, dirty);
+    while (g_hash_table_iter_next (&iter, &toplevel, &set)) {
+        if (GPOINTER_TO_INT (set))
+            panel_struts_write_window_hint (toplevel);
+        else
+            panel_struts_clear_window_hint (toplevel);
+    }
+
+    panel_struts_set_trace_cause (cause);
+
+    g_hash_table_destroy (dirty);
+
+    return G_SOURCE_REMOVE;
+}
+
+/* A change of one panel, or of the monitors, makes all the panels update
+ * their struts, often several times: only write the final hints, once
+ * everything has been laid out. */
+static void
+panel_struts_queue_window_hint (PanelToplevel *toplevel,
+                                gboolean       set)
+{
+    if (!panel_struts_dirty_hints)
+        panel_struts_dirty_hints = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+    g_hash_table_insert (panel_struts_dirty_hints, toplevel, GINT_TO_POINTER (set));
+
+    if (!panel_struts_flush_id)
+        panel_struts_flush_id = g_idle_add (panel_struts_flush_window_hints, NULL);
+}
+
 void
-panel_struts_unset_window_hint (PanelToplevel *toplevel)
+panel_struts_set_window_hint (PanelToplevel *toplevel)
 {
     g_return_if_fail (GDK_IS_X11_DISPLAY (gtk_widget_get_display (GTK_WIDGET (toplevel))));
 
-    if (!gtk_widget_get_realized (GTK_WIDGET (toplevel)))
-        return;
+    panel_struts_queue_window_hint (toplevel, TRUE);
+}
+
+void
+panel_struts_unset_window_hint (PanelToplevel *toplevel)
+{
+    g_return_if_fail (GDK_IS_X11_DISPLAY (gtk_widget_get_display (GTK_WIDGET (toplevel))));
 
-    panel_xutils_unset_strut (gtk_widget_get_window (GTK_WIDGET (toplevel)));
+    panel_struts_queue_window_hint (toplevel, FALSE);
 }
 
 static inline int
@@ -433,6 +639,21 @@ panel_struts_register_strut (PanelToplevel    *toplevel,
                strut->strut_end   == strut_end)
         return FALSE;
 
+    if (panel_trace_is_enabled ()) {
+        if (new_strut)
+            panel_struts_trace (toplevel,
+                                "register %s %d [%d, %d] on monitor %d, was none",
+                                orientation_to_string (orientation), strut_size,
+                                strut_start, strut_end, monitor);
+        else
+            panel_struts_trace (toplevel,
+                                "register %s %d [%d, %d] on monitor %d, was %s %d [%d, %d] on monitor %d",
+                                orientation_to_string (orientation), strut_size,
+                                strut_start, strut_end, monitor,
+                                orientation_to_string (strut->orientation), strut->strut_size,
+                                strut->strut_start, strut->strut_end, strut->monitor);
+    }
+
     strut->toplevel    = toplevel;
     strut->orientation = orientation;
     strut->screen      = screen;
@@ -478,6 +699,15 @@ panel_struts_register_strut (PanelToplevel    *toplevel,
     panel_struts_list = g_slist_sort (panel_struts_list,
                                       (GCompareFunc) panel_struts_compare);
 
+    if (panel_struts_freeze_count > 0) {
+        strut->allocated_strut_size  = strut->strut_size;
+        strut->allocated_strut_start = strut->strut_start;
+        strut->allocated_strut_end   = strut->strut_end;
+        strut->allocated_geometry    = strut->geometry;
+
+        return FALSE;
+    }
+
     return panel_struts_allocate_struts (toplevel, screen, monitor);
 }
 
@@ -490,16 +720,64 @@ panel_struts_unregister_strut (PanelToplevel *toplevel)
 
     g_return_if_fail (GDK_IS_X11_DISPLAY (gtk_widget_get_display (GTK_WIDGET (toplevel))));
 
+    /* the toplevel may be going away */
+    if (panel_struts_dirty_hints)
+        g_hash_table_remove (panel_struts_dirty_hints, toplevel);
+
     if (!(strut = panel_struts_find_strut (toplevel)))
         return;
 
     screen  = strut->screen;
     monitor = strut->monitor;
 
+    if (panel_trace_is_enabled ())
+        panel_struts_trace (toplevel,
+                            "unregister, was %s %d [%d, %d] on monitor %d",
+                            orientation_to_string (strut->orientation), strut->strut_size,
+                            strut->strut_start, strut->strut_end, strut->monitor);
+
     panel_struts_list = g_slist_remove (panel_struts_list, strut);
     g_free (strut);
 
-    panel_struts_allocate_struts (toplevel, screen, monitor);
+    if (panel_struts_freeze_count == 0)
+        panel_struts_allocate_struts (toplevel, screen, monitor);
+}
+
+/* Showing several panels at once would resolve the struts of a monitor
+ * again for each of them, and lay out again the panels registered before
+ * each time one moves them: the struts registered between the freeze and
+ * the thaw are resolved together, and only the panels that end up
+ * somewhere else than they asked for are laid out again. */
+void
+panel_struts_freeze (void)
+{
+    panel_struts_freeze_count++;
+}
+
+void
+panel_struts_thaw (void)
+{
+    GSList    *l;
+    GdkScreen *screen = NULL;
+    int        monitor = -1;
+
+    g_return_if_fail (panel_struts_freeze_count > 0);
+
+    if (--panel_struts_freeze_count > 0)
+        return;
+
+    /* the list is sorted by screen and monitor */
+    for (l = panel_struts_list; l; l = l->next) {
+        PanelStrut *strut = l->data;
+
+        if (strut->screen == screen && strut->monitor == monitor)
+            continue;
+
+        screen  = strut->screen;
+        monitor = strut->monitor;
+
+        panel_struts_allocate_struts (NULL, screen, monitor);
+    }
 }
 
 gboolean
@@ -47,6 +47,9 @@ gboolean panel_struts_register_strut           (PanelToplevel    *toplevel,
 
 void     panel_struts_unregister_strut         (PanelToplevel    *toplevel);
 
+void     panel_struts_freeze                   (void);
+void     panel_struts_thaw                     (void);
+
 void     panel_struts_set_window_hint          (PanelToplevel    *toplevel);
 void     panel_struts_unset_window_hint        (PanelToplevel    *toplevel);
 
@@ -56,6 +59,8 @@ gboolean panel_struts_update_toplevel_geometry (PanelToplevel    *toplevel,
                                                 int              *w,
                                                 int              *h);
 
+const char *panel_struts_set_trace_cause       (const char       *cause);
+
 #ifdef __cplusplus
 }
 #endif
@@ -11,6 +11,9 @@
  */
 
 #include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include <glib/gi18n.h>
 #include <gtk/gtk.h>
 #include <gio/gio.h>
@@ -35,12 +38,18 @@ static char *cli_iid = NULL;
 static char *cli_prefs_path = NULL;
 static char *cli_size = NULL;
 static char *cli_orient = NULL;
+static char *cli_layout = NULL;
+static int   cli_benchmark = 0;
+static int   cli_cycles = 0;
 
 static const GOptionEntry options [] = {
 	{ "iid", 0, 0, G_OPTION_ARG_STRING, &cli_iid, N_("Specify an applet IID to load"), NULL},
 	{ "prefs-path", 0, 0, G_OPTION_ARG_STRING, &cli_prefs_path, N_("Specify a gsettings path in which the applet preferences should be stored"), NULL},
 	{ "size", 0, 0, G_OPTION_ARG_STRING, &cli_size, N_("Specify the initial size of the applet (xx-small, medium, large etc.)"), NULL},
 	{ "orient", 0, 0, G_OPTION_ARG_STRING, &cli_orient, N_("Specify the initial orientation of the applet (top, bottom, left or right)"), NULL},
+	{ "benchmark", 0, 0, G_OPTION_ARG_INT, &cli_benchmark, N_("Load N copies of the applet off-screen and print timing results"), N_("N")},
+	{ "layout", 0, 0, G_OPTION_ARG_FILENAME, &cli_layout, N_("Load the applets of a panel layout file off-screen and print timing results"), N_("FILE")},
+	{ "cycles", 0, 0, G_OPTION_ARG_INT, &cli_cycles, N_("Activate and destroy each applet N times off-screen and print activation latency percentiles"), N_("N")},
 	{ NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
 };
 
@@ -175,37 +184,670 @@ load_applet_into_window (const char *title,
 }
 
 static void
-load_applet_from_command_line (void)
+get_size_and_orient_from_command_line (guint *size,
+				       guint *orient)
 {
-	guint size = 24, orient = PANEL_ORIENTATION_TOP;
-
-	g_assert (cli_iid != NULL);
+	*size = 24;
+	*orient = PANEL_ORIENTATION_TOP;
 
-	if (cli_size || cli_orient) {
-		if (cli_size) {
-			for (gsize i = 0; i < G_N_ELEMENTS (size_items); i++) {
-				if (strcmp (g_dpgettext2 (NULL, "Size", size_items[i].name), cli_size) == 0) {
-					size = size_items[i].value;
-					break;
-				}
+	if (cli_size) {
+		for (gsize i = 0; i < G_N_ELEMENTS (size_items); i++) {
+			if (strcmp (g_dpgettext2 (NULL, "Size", size_items[i].name), cli_size) == 0) {
+				*size = size_items[i].value;
+				break;
 			}
 		}
+	}
 
-		if (cli_orient) {
-			for (gsize i = 0; i < G_N_ELEMENTS (orient_items); i++) {
-				if (strcmp (g_dpgettext2 (NULL, "Orientation", orient_items[i].name), cli_orient) == 0) {
-					orient = orient_items[i].value;
-					break;
-				}
+	if (cli_orient) {
+		for (gsize i = 0; i < G_N_ELEMENTS (orient_items); i++) {
+			if (strcmp (g_dpgettext2 (NULL, "Orientation", orient_items[i].name), cli_orient) == 0) {
+				*orient = orient_items[i].value;
+				break;
 			}
 		}
 	}
+}
+
+static void
+load_applet_from_command_line (void)
+{
+	guint size, orient;
+
+	g_assert (cli_iid != NULL);
+
+	get_size_and_orient_from_command_line (&size, &orient);
 
 	g_print ("Loading %s\n", cli_iid);
 
 	load_applet_into_window (cli_iid, cli_prefs_path, size, orient);
 }
 
+/* Benchmark mode: every applet is loaded into the same window, which is
+ * kept off-screen, and the results are printed as key=value lines so that
+ * they can easily be parsed by scripts. All times are in microseconds,
+ * relative to the moment the applet was requested. A value of -1 means
+ * that the event did not happen before the benchmark finished. */
+
+#define BENCHMARK_TIMEOUT          30
+#define BENCHMARK_RELAYOUT_LOOPS   100
+
+typedef struct {
+	GtkWidget *container;
+	char      *iid;
+	gint64     start;
+	gint64     activated;
+	gint64     first_draw;
+	guint      done : 1;
+	guint      failed : 1;
+} BenchmarkApplet;
+
+static GPtrArray *benchmark_applets = NULL;
+static GtkWidget *benchmark_window = NULL;
+static GtkWidget *benchmark_box = NULL;
+static gint64     benchmark_start = 0;
+static guint      benchmark_timeout_id = 0;
+static gboolean   benchmark_finished = FALSE;
+
+static glong
+benchmark_get_rss (void)
+{
+	char  *contents;
+	glong  size, resident;
+	glong  rss = -1;
+
+	if (!g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL))
+		return -1;
+
+	if (sscanf (contents, "%ld %ld", &size, &resident) == 2)
+		rss = resident * (sysconf (_SC_PAGESIZE) / 1024);
+
+	g_free (contents);
+
+	return rss;
+}
+
+static gint64
+benchmark_delta (BenchmarkApplet *applet,
+		 gint64           time)
+{
+	return time ? time - applet->start : -1;
+}
+
+static gint64
+benchmark_measure_size_allocate (GtkWidget *widget)
+{
+	GtkRequisition req;
+	GtkAllocation  allocation;
+	gint64         start;
+	int            i;
+
+	if (!gtk_widget_get_visible (widget))
+		return -1;
+
+	gtk_widget_get_allocation (widget, &allocation);
+
+	start = g_get_monotonic_time ();
+
+	for (i = 0; i < BENCHMARK_RELAYOUT_LOOPS; i++) {
+		gtk_widget_queue_resize (widget);
+		gtk_widget_get_preferred_size (widget, NULL, &req);
+
+		allocation.width = MAX (req.width, 1);
+		allocation.height = MAX (req.height, 1);
+		gtk_widget_size_allocate (widget, &allocation);
+	}
+
+	return (g_get_monotonic_time () - start) / BENCHMARK_RELAYOUT_LOOPS;
+}
+
+static void
+benchmark_finish (void)
+{
+	guint i, n_failed = 0;
+
+	if (benchmark_finished)
+		return;
+	benchmark_finished = TRUE;
+
+	if (benchmark_timeout_id) {
+		g_source_remove (benchmark_timeout_id);
+		benchmark_timeout_id = 0;
+	}
+
+	for (i = 0; i < benchmark_applets->len; i++) {
+		BenchmarkApplet *applet = g_ptr_array_index (benchmark_applets, i);
+
+		if (applet->failed || !applet->activated)
+			n_failed++;
+
+		g_print ("applet index=%u iid=%s status=%s activation_us=%" G_GINT64_FORMAT
+			 " first_draw_us=%" G_GINT64_FORMAT " size_allocate_us=%" G_GINT64_FORMAT "\n",
+			 i, applet->iid,
+			 applet->failed ? "failed" : applet->activated ? "ok" : "timeout",
+			 benchmark_delta (applet, applet->activated),
+			 benchmark_delta (applet, applet->first_draw),
+			 benchmark_measure_size_allocate (applet->container));
+	}
+
+	g_print ("summary applets=%u failed=%u total_us=%" G_GINT64_FORMAT
+		 " relayout_us=%" G_GINT64_FORMAT " rss_kb=%ld\n",
+		 benchmark_applets->len, n_failed,
+		 g_get_monotonic_time () - benchmark_start,
+		 benchmark_measure_size_allocate (benchmark_box),
+		 benchmark_get_rss ());
+
+	gtk_main_quit ();
+}
+
+static void
+benchmark_check_finished (void)
+{
+	guint i;
+
+	for (i = 0; i < benchmark_applets->len; i++) {
+		BenchmarkApplet *applet = g_ptr_array_index (benchmark_applets, i);
+
+		if (!applet->done)
+			return;
+	}
+
+	benchmark_finish ();
+}
+
+static gboolean
+benchmark_timeout (gpointer data)
+{
+	benchmark_timeout_id = 0;
+	benchmark_finish ();
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+benchmark_applet_free (BenchmarkApplet *applet)
+{
+	g_free (applet->iid);
+	g_free (applet);
+}
+
+static gboolean
+benchmark_draw_cb (GtkWidget       *container,
+		   cairo_t         *cr,
+		   BenchmarkApplet *applet)
+{
+	if (applet->activated && !applet->first_draw) {
+		applet->first_draw = g_get_monotonic_time ();
+		applet->done = TRUE;
+		benchmark_check_finished ();
+	}
+
+	return FALSE;
+}
+
+static void
+benchmark_applet_broken_cb (GtkWidget       *container,
+			    BenchmarkApplet *applet)
+{
+	applet->failed = TRUE;
+	applet->done = TRUE;
+	benchmark_check_finished ();
+}
+
+static void
+benchmark_applet_activated_cb (GObject         *source_object,
+			       GAsyncResult    *res,
+			       BenchmarkApplet *applet)
+{
+	GError *error = NULL;
+
+	if (!mate_panel_applet_container_add_finish (MATE_PANEL_APPLET_CONTAINER (source_object),
+						     res, &error)) {
+		g_printerr ("Failed to load applet %s: %s\n", applet->iid, error->message);
+		g_error_free (error);
+		applet->failed = TRUE;
+		applet->done = TRUE;
+		benchmark_check_finished ();
+		return;
+	}
+
+	applet->activated = g_get_monotonic_time ();
+	gtk_widget_show (applet->container);
+}
+
+static GVariant *
+benchmark_get_properties (guint index,
+			  guint size,
+			  guint orient)
+{
+	GVariantBuilder  builder;
+	char            *prefs_path;
+
+	if (cli_prefs_path)
+		prefs_path = g_strdup_printf ("%s%u/", cli_prefs_path, index);
+	else
+		prefs_path = g_strdup_printf ("/tmp/mate-panel-test-applets-benchmark/%u/",
+					      index);
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+	g_variant_builder_add (&builder, "{sv}",
+			       "prefs-path", g_variant_new_string (prefs_path));
+	g_variant_builder_add (&builder, "{sv}",
+			       "size", g_variant_new_uint32 (size));
+	g_variant_builder_add (&builder, "{sv}",
+			       "orient", g_variant_new_uint32 (orient));
+	g_free (prefs_path);
+
+	return g_variant_builder_end (&builder);
+}
+
+static void
+benchmark_add_applet (const char *iid,
+		      guint       size,
+		      guint       orient)
+{
+	BenchmarkApplet *applet;
+
+	applet = g_new0 (BenchmarkApplet, 1);
+	applet->iid = g_strdup (iid);
+	applet->container = mate_panel_applet_container_new ();
+	g_ptr_array_add (benchmark_applets, applet);
+
+	gtk_box_pack_start (GTK_BOX (benchmark_box), applet->container,
+			    FALSE, FALSE, 0);
+
+	g_signal_connect (applet->container, "applet-broken",
+			  G_CALLBACK (benchmark_applet_broken_cb), applet);
+	g_signal_connect_after (applet->container, "draw",
+				G_CALLBACK (benchmark_draw_cb), applet);
+
+	applet->start = g_get_monotonic_time ();
+	mate_panel_applet_container_add (MATE_PANEL_APPLET_CONTAINER (applet->container),
+					 gtk_widget_get_screen (benchmark_window),
+					 iid, NULL,
+					 (GAsyncReadyCallback) benchmark_applet_activated_cb,
+					 applet,
+					 benchmark_get_properties (benchmark_applets->len - 1,
+								   size, orient));
+}
+
+typedef void (* BenchmarkAddAppletFunc) (const char *iid,
+					 guint       size,
+					 guint       orient);
+
+static gboolean
+benchmark_add_layout_applets (const char            *filename,
+			      guint                  size,
+			      guint                  orient,
+			      BenchmarkAddAppletFunc add_applet)
+{
+	GKeyFile  *keyfile;
+	GError    *error = NULL;
+	char     **groups;
+	int        i;
+
+	keyfile = g_key_file_new ();
+	if (!g_key_file_load_from_file (keyfile, filename, G_KEY_FILE_NONE, &error)) {
+		g_printerr ("Cannot load layout file %s: %s\n", filename, error->message);
+		g_error_free (error);
+		g_key_file_free (keyfile);
+		return FALSE;
+	}
+
+	groups = g_key_file_get_groups (keyfile, NULL);
+	for (i = 0; groups[i] != NULL; i++) {
+		char *type;
+		char *iid;
+
+		if (!g_str_has_prefix (groups[i], "Object "))
+			continue;
+
+		type = g_key_file_get_string (keyfile, groups[i], "object-type", NULL);
+		iid = g_key_file_get_string (keyfile, groups[i], "applet-iid", NULL);
+
+		if (g_strcmp0 (type, "applet") == 0 && iid != NULL)
+			add_applet (iid, size, orient);
+
+		g_free (type);
+		g_free (iid);
+	}
+
+	g_strfreev (groups);
+	g_key_file_free (keyfile);
+
+	return TRUE;
+}
+
+static void
+benchmark_create_window (guint orient)
+{
+	/* The applets are out-of-process and embedded with GtkSocket, which
+	 * needs a native X window: a GtkOffscreenWindow would not work, so
+	 * use a popup moved outside of the visible area instead. */
+	benchmark_window = gtk_window_new (GTK_WINDOW_POPUP);
+	gtk_window_move (GTK_WINDOW (benchmark_window), -10000, -10000);
+
+	if (orient == PANEL_ORIENTATION_LEFT || orient == PANEL_ORIENTATION_RIGHT)
+		benchmark_box = gtk_box_new (GTK_ORIENTATION_VERTICAL, 0);
+	else
+		benchmark_box = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 0);
+	gtk_container_add (GTK_CONTAINER (benchmark_window), benchmark_box);
+	gtk_widget_show (benchmark_box);
+	gtk_widget_show (benchmark_window);
+}
+
+static gboolean
+run_benchmark (void)
+{
+	guint size, orient;
+	int   i;
+
+	get_size_and_orient_from_command_line (&size, &orient);
+
+	benchmark_applets = g_ptr_array_new_with_free_func ((GDestroyNotify) benchmark_applet_free);
+
+	benchmark_create_window (orient);
+
+	benchmark_start = g_get_monotonic_time ();
+
+	if (cli_layout) {
+		if (!benchmark_add_layout_applets (cli_layout, size, orient,
+						   benchmark_add_applet))
+			return FALSE;
+	} else {
+		for (i = 0; i < cli_benchmark; i++)
+			benchmark_add_applet (cli_iid, size, orient);
+	}
+
+	if (benchmark_applets->len == 0) {
+		g_printerr ("No applet to load\n");
+		return FALSE;
+	}
+
+	benchmark_timeout_id = g_timeout_add_seconds (BENCHMARK_TIMEOUT,
+						      benchmark_timeout, NULL);
+
+	return TRUE;
+}
+
+/* With --cycles, every applet is activated and destroyed again N times in a
+ * row, one activation at a time, so that each includes starting its
+ * factory. The time each activation took to reach every stage, and to be
+ * drawn, is printed for each applet IID as p50/p95/p99 percentiles, in
+ * microseconds, on key=value lines like the benchmark results. */
+
+#define CYCLES_STAGE_DRAWN MATE_PANEL_APPLET_CONTAINER_N_STAGES
+
+typedef struct {
+	char   *iid;
+	GArray *samples[CYCLES_STAGE_DRAWN + 1];
+	guint   n_failed;
+} CyclesApplet;
+
+static GPtrArray *cycles_applets = NULL;
+static guint      cycles_applet_index = 0;
+static int        cycles_done = 0;
+static GtkWidget *cycles_container = NULL;
+static GtkWidget *cycles_old_container = NULL;
+static gint64     cycles_start = 0;
+static guint      cycles_timeout_id = 0;
+
+static gboolean cycles_next (gpointer data);
+
+static void
+cycles_applet_free (CyclesApplet *applet)
+{
+	int i;
+
+	for (i = 0; i <= CYCLES_STAGE_DRAWN; i++)
+		g_array_free (applet->samples[i], TRUE);
+	g_free (applet->iid);
+	g_free (applet);
+}
+
+static void
+cycles_add_applet (const char *iid,
+		   guint       size,
+		   guint       orient)
+{
+	CyclesApplet *applet;
+	guint         i;
+	int           j;
+
+	for (i = 0; i < cycles_applets->len; i++) {
+		applet = g_ptr_array_index (cycles_applets, i);
+		if (g_strcmp0 (applet->iid, iid) == 0)
+			return;
+	}
+
+	applet = g_new0 (CyclesApplet, 1);
+	applet->iid = g_strdup (iid);
+	for (j = 0; j <= CYCLES_STAGE_DRAWN; j++)
+		applet->samples[j] = g_array_new (FALSE, FALSE, sizeof (gint64));
+	g_ptr_array_add (cycles_applets, applet);
+}
+
+static gint
+cycles_compare_samples (gconstpointer a,
+			gconstpointer b)
+{
+	gint64 sample_a = *(const gint64 *) a;
+	gint64 sample_b = *(const gint64 *) b;
+
+	return sample_a < sample_b ? -1 : sample_a > sample_b ? 1 : 0;
+}
+
+/* nearest-rank percentile of sorted samples */
+static gint64
+cycles_percentile (GArray *samples,
+		   guint   percent)
+{
+	guint rank;
+
+	if (samples->len == 0)
+		return -1;
+
+	rank = (samples->len * percent + 99) / 100;
+
+	return g_array_index (samples, gint64, MAX (rank, 1) - 1);
+}
+
+static void
+cycles_print_results (void)
+{
+	guint i;
+	int   j;
+
+	for (i = 0; i < cycles_applets->len; i++) {
+		CyclesApplet *applet = g_ptr_array_index (cycles_applets, i);
+
+		for (j = 0; j <= CYCLES_STAGE_DRAWN; j++) {
+			GArray *samples = applet->samples[j];
+
+			if (samples->len == 0)
+				continue;
+
+			g_array_sort (samples, cycles_compare_samples);
+			g_print ("latency iid=%s stage=%s samples=%u p50_us=%" G_GINT64_FORMAT
+				 " p95_us=%" G_GINT64_FORMAT " p99_us=%" G_GINT64_FORMAT "\n",
+				 applet->iid,
+				 j == CYCLES_STAGE_DRAWN ? "drawn" : mate_panel_applet_container_stage_get_name (j),
+				 samples->len,
+				 cycles_percentile (samples, 50),
+				 cycles_percentile (samples, 95),
+				 cycles_percentile (samples, 99));
+		}
+
+		g_print ("latency iid=%s cycles=%d failed=%u\n",
+			 applet->iid, cli_cycles, applet->n_failed);
+	}
+}
+
+static void
+cycles_end_cycle (GtkWidget *container,
+		  gboolean   failed)
+{
+	CyclesApplet *applet = g_ptr_array_index (cycles_applets, cycles_applet_index);
+
+	/* late callbacks of a previous cycle */
+	if (!container || container != cycles_container)
+		return;
+
+	if (cycles_timeout_id) {
+		g_source_remove (cycles_timeout_id);
+		cycles_timeout_id = 0;
+	}
+
+	if (failed) {
+		applet->n_failed++;
+	} else {
+		gint64 time;
+		int    i;
+
+		for (i = 0; i < MATE_PANEL_APPLET_CONTAINER_N_STAGES; i++) {
+			time = mate_panel_applet_container_get_stage_time (MATE_PANEL_APPLET_CONTAINER (container), i);
+			if (time >= 0)
+				g_array_append_val (applet->samples[i], time);
+		}
+
+		time = g_get_monotonic_time () - cycles_start;
+		g_array_append_val (applet->samples[CYCLES_STAGE_DRAWN], time);
+	}
+
+	/* we can be in a signal handler of the container: destroy it, and let
+	 * the applet go away, before activating it again */
+	cycles_old_container = cycles_container;
+	cycles_container = NULL;
+	cycles_done++;
+
+	g_idle_add (cycles_next, NULL);
+}
+
+static gboolean
+cycles_timeout (gpointer data)
+{
+	cycles_timeout_id = 0;
+	cycles_end_cycle (cycles_container, TRUE);
+
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean
+cycles_draw_cb (GtkWidget *container,
+		cairo_t   *cr,
+		gpointer   data)
+{
+	if (mate_panel_applet_container_get_stage_time (MATE_PANEL_APPLET_CONTAINER (container),
+							MATE_PANEL_APPLET_CONTAINER_STAGE_READY) >= 0)
+		cycles_end_cycle (container, FALSE);
+
+	return FALSE;
+}
+
+static void
+cycles_applet_broken_cb (GtkWidget *container,
+			 gpointer   data)
+{
+	cycles_end_cycle (container, TRUE);
+}
+
+static void
+cycles_applet_activated_cb (GObject      *source_object,
+			    GAsyncResult *res,
+			    gpointer      data)
+{
+	GError *error = NULL;
+
+	if (!mate_panel_applet_container_add_finish (MATE_PANEL_APPLET_CONTAINER (source_object),
+						     res, &error)) {
+		if (GTK_WIDGET (source_object) == cycles_container)
+			g_printerr ("Failed to load applet: %s\n", error->message);
+		g_error_free (error);
+		cycles_end_cycle (GTK_WIDGET (source_object), TRUE);
+		return;
+	}
+
+	gtk_widget_show (GTK_WIDGET (source_object));
+}
+
+static gboolean
+cycles_next (gpointer data)
+{
+	CyclesApplet *applet;
+	guint         size, orient;
+
+	if (cycles_old_container) {
+		gtk_widget_destroy (cycles_old_container);
+		cycles_old_container = NULL;
+	}
+
+	if (cycles_done >= cli_cycles) {
+		cycles_applet_index++;
+		cycles_done = 0;
+	}
+
+	if (cycles_applet_index >= cycles_applets->len) {
+		cycles_print_results ();
+		gtk_main_quit ();
+		return G_SOURCE_REMOVE;
+	}
+
+	applet = g_ptr_array_index (cycles_applets, cycles_applet_index);
+	get_size_and_orient_from_command_line (&size, &orient);
+
+	cycles_container = mate_panel_applet_container_new ();
+	gtk_box_pack_start (GTK_BOX (benchmark_box), cycles_container,
+			    FALSE, FALSE, 0);
+
+	g_signal_connect (cycles_container, "applet-broken",
+			  G_CALLBACK (cycles_applet_broken_cb), NULL);
+	g_signal_connect_after (cycles_container, "draw",
+				G_CALLBACK (cycles_draw_cb), NULL);
+
+	cycles_timeout_id = g_timeout_add_seconds (BENCHMARK_TIMEOUT,
+						   cycles_timeout, NULL);
+
+	cycles_start = g_get_monotonic_time ();
+	mate_panel_applet_container_add (MATE_PANEL_APPLET_CONTAINER (cycles_container),
+					 gtk_widget_get_screen (benchmark_window),
+					 applet->iid, NULL,
+					 cycles_applet_activated_cb,
+					 NULL,
+					 benchmark_get_properties (cycles_applet_index,
+								   size, orient));
+
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean
+run_cycles (void)
+{
+	guint size, orient;
+
+	get_size_and_orient_from_command_line (&size, &orient);
+
+	cycles_applets = g_ptr_array_new_with_free_func ((GDestroyNotify) cycles_applet_free);
+
+	benchmark_create_window (orient);
+
+	if (cli_layout) {
+		if (!benchmark_add_layout_applets (cli_layout, size, orient,
+						   cycles_add_applet))
+			return FALSE;
+	} else {
+		cycles_add_applet (cli_iid, size, orient);
+	}
+
+	if (cycles_applets->len == 0) {
+		g_printerr ("No applet to load\n");
+		return FALSE;
+	}
+
+	cycles_next (NULL);
+
+	return TRUE;
+}
+
 G_GNUC_UNUSED void
 on_execute_button_clicked (GtkButton *button,
 			   gpointer   dummy)
@@ -356,6 +998,34 @@ main (int argc, char **argv)
 	if (g_file_test ("../libmate-panel-applet", G_FILE_TEST_IS_DIR))
 		g_setenv ("MATE_PANEL_APPLETS_DIR", MATE_PANEL_APPLETS_DIR ":../libmate-panel-applet", FALSE);
 
+	if (cli_cycles > 0 && (cli_layout || cli_iid)) {
+		gboolean ret;
+
+		ret = run_cycles ();
+		if (ret)
+			gtk_main ();
+
+		gtk_widget_destroy (benchmark_window);
+		g_ptr_array_free (cycles_applets, TRUE);
+		panel_cleanup_do ();
+
+		return ret ? 0 : 1;
+	}
+
+	if (cli_layout || (cli_iid && cli_benchmark > 0)) {
+		gboolean ret;
+
+		ret = run_benchmark ();
+		if (ret)
+			gtk_main ();
+
+		gtk_widget_destroy (benchmark_window);
+		g_ptr_array_free (benchmark_applets, TRUE);
+		panel_cleanup_do ();
+
+		return ret ? 0 : 1;
+	}
+
 	if (cli_iid) {
 		load_applet_from_command_line ();
 		gtk_main ();
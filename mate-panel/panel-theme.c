@@ -0,0 +1,176 @@
+/*
+ * panel-theme.c: one notification per theme change
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * A theme switch reaches us in several steps: the GtkSettings properties
+ * change, then the icon theme emits "changed" from an idle of its own, and
+ * the style of every widget is updated, sometimes more than once. What the
+ * panel renders from the theme (the icons of the buttons and of the menus)
+ * is reloaded once, after the burst: the first change starts a short
+ * delay, the following ones are folded into it, and the generation is
+ * bumped before the notifications so that the caches shared by several
+ * widgets are only emptied by the first of them.
+ */
+
+#include <config.h>
+
+#include <gtk/gtk.h>
+
+#include <libpanel-util/panel-cleanup.h>
+
+#include "panel-theme.h"
+
+/* in milliseconds, long enough for the idle of the icon theme */
+#define PANEL_THEME_CHANGED_DELAY 100
+
+typedef struct {
+	GCallback func;
+	gpointer  data;
+} PanelThemeNotify;
+
+typedef struct {
+	gboolean      initialized;
+	guint         generation;
+	guint         changed_id;
+
+	GtkSettings  *settings;
+	GtkIconTheme *icon_theme;
+
+	GSList       *notifies;
+} PanelTheme;
+
+static PanelTheme panel_theme = { 0, };
+
+static gboolean
+panel_theme_changed_timeout (gpointer data)
+{
+	GSList *l, *next;
+
+	panel_theme.changed_id = 0;
+	panel_theme.generation++;
+
+	for (l = panel_theme.notifies; l; l = next) {
+		PanelThemeNotify *notify = l->data;
+
+		/* a notification may remove itself */
+		next = l->next;
+
+		((void (*) (gpointer)) notify->func) (notify->data);
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+panel_theme_queue_changed (void)
+{
+	if (panel_theme.changed_id)
+		return;
+
+	panel_theme.changed_id = g_timeout_add (PANEL_THEME_CHANGED_DELAY,
+						panel_theme_changed_timeout,
+						NULL);
+	g_source_set_name_by_id (panel_theme.changed_id, "[mate-panel] theme changed");
+}
+
+static void
+panel_theme_cleanup (gpointer data)
+{
+	if (panel_theme.changed_id)
+		g_source_remove (panel_theme.changed_id);
+	panel_theme.changed_id = 0;
+
+	if (panel_theme.settings)
+		g_signal_handlers_disconnect_by_func (panel_theme.settings,
+						      G_CALLBACK (panel_theme_queue_changed),
+						      NULL);
+	if (panel_theme.icon_theme)
+		g_signal_handlers_disconnect_by_func (panel_theme.icon_theme,
+						      G_CALLBACK (panel_theme_queue_changed),
+						      NULL);
+	panel_theme.settings = NULL;
+	panel_theme.icon_theme = NULL;
+
+	g_slist_free_full (panel_theme.notifies, g_free);
+	panel_theme.notifies = NULL;
+
+	panel_theme.initialized = FALSE;
+}
+
+void
+panel_theme_init (void)
+{
+	if (panel_theme.initialized)
+		return;
+
+	panel_theme.initialized = TRUE;
+
+	panel_theme.settings = gtk_settings_get_default ();
+	g_signal_connect_swapped (panel_theme.settings, "notify::gtk-theme-name",
+				  G_CALLBACK (panel_theme_queue_changed), NULL);
+	g_signal_connect_swapped (panel_theme.settings, "notify::gtk-icon-theme-name",
+				  G_CALLBACK (panel_theme_queue_changed), NULL);
+	g_signal_connect_swapped (panel_theme.settings, "notify::gtk-application-prefer-dark-theme",
+				  G_CALLBACK (panel_theme_queue_changed), NULL);
+
+	/* also changes when icons are installed or removed */
+	panel_theme.icon_theme = gtk_icon_theme_get_default ();
+	g_signal_connect_swapped (panel_theme.icon_theme, "changed",
+				  G_CALLBACK (panel_theme_queue_changed), NULL);
+
+	panel_cleanup_register (PANEL_CLEAN_FUNC (panel_theme_cleanup), NULL);
+}
+
+guint
+panel_theme_get_generation (void)
+{
+	return panel_theme.generation;
+}
+
+void
+panel_theme_notify_add (GCallback callback_func,
+			gpointer  user_data)
+{
+	PanelThemeNotify *notify;
+
+	notify = g_new0 (PanelThemeNotify, 1);
+	notify->func = callback_func;
+	notify->data = user_data;
+
+	panel_theme.notifies = g_slist_append (panel_theme.notifies, notify);
+}
+
+void
+panel_theme_notify_remove (GCallback callback_func,
+			   gpointer  user_data)
+{
+	GSList *l;
+
+	for (l = panel_theme.notifies; l; l = l->next) {
+		PanelThemeNotify *notify = l->data;
+
+		if (notify->func == callback_func && notify->data == user_data) {
+			panel_theme.notifies = g_slist_delete_link (panel_theme.notifies, l);
+			g_free (notify);
+			return;
+		}
+	}
+}
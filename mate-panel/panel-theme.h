@@ -0,0 +1,46 @@
+/*
+ * panel-theme.h: one notification per theme change
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __PANEL_THEME_H__
+#define __PANEL_THEME_H__
+
+#include <glib.h>
+#include <glib-object.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void  panel_theme_init           (void);
+
+/* bumped once per theme change, before the notifications */
+guint panel_theme_get_generation (void);
+
+void  panel_theme_notify_add     (GCallback callback_func,
+				  gpointer  user_data);
+void  panel_theme_notify_remove  (GCallback callback_func,
+				  gpointer  user_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PANEL_THEME_H__ */
@@ -40,6 +40,9 @@
 #include <gdk/gdkx.h>
 #endif
 
+#include <libpanel-util/panel-scheduler.h>
+#include <libpanel-util/panel-trace.h>
+
 #include "panel-util.h"
 #include "panel-profile.h"
 #include "panel-frame.h"
@@ -51,6 +54,7 @@
 #include "panel-bindings.h"
 #include "panel-config-global.h"
 #include "panel-lockdown.h"
+#include "panel-power.h"
 #include "panel-schemas.h"
 
 #ifdef HAVE_X11
@@ -136,6 +140,20 @@ struct _PanelToplevelPrivate {
 	int                     drag_offset_x;
 	int                     drag_offset_y;
 
+	/* The last pointer motion of the grab op, handled on the next frame */
+	int                     motion_x;
+	int                     motion_y;
+	GdkModifierType         motion_state;
+	guint                   motion_tick_id;
+
+	/* The parent panel or the button of a drawer moved: the drawer
+	 * follows them on the next frame */
+	guint                   attach_tick_id;
+
+	/* GTK+ updates the style several times in a row on a theme switch:
+	 * what depends on it is updated once, after the last time */
+	guint                   style_update_id;
+
 	/* Saved state before for cancelled grab op */
 	int                     orig_monitor;
 	int                     orig_x;
@@ -146,13 +164,18 @@ struct _PanelToplevelPrivate {
 	int                     orig_orientation;
 
 	/* relative to the monitor origin */
+	int                     animation_start_x;
+	int                     animation_start_y;
+	int                     animation_start_width;
+	int                     animation_start_height;
 	int                     animation_end_x;
 	int                     animation_end_y;
 	int                     animation_end_width;
 	int                     animation_end_height;
 	gint64                  animation_start_time; /* monotonic start time in microseconds */
+	gint64                  animation_frame_time; /* monotonic time of the current frame */
 	GTimeSpan               animation_duration_time; /* monotonic duration time in microseconds */
-	guint                   animation_timeout;
+	guint                   animation_tick_id;
 
 	PanelWidget            *panel_widget;
 	PanelFrame             *inner_frame;
@@ -207,6 +230,18 @@ struct _PanelToplevelPrivate {
 	guint                   updated_geometry_initial : 1;
 	/* flag to see if we have done the initial animation */
 	guint                   initial_animation_done : 1;
+	/* flag to see if the first allocation got traced */
+	guint                   allocation_traced : 1;
+
+	/* While a motion of a move is handled, changes of x and y only move
+	 * the window; a relayout is pending until the next size request */
+	guint                   move_position_only : 1;
+	guint                   move_position_changed : 1;
+	guint                   move_relayout_pending : 1;
+
+	/* Going from or to the auto-hidden state: the panel keeps its size
+	 * and content, and is only moved */
+	guint                   hide_move_only : 1;
 };
 
 enum {
@@ -383,6 +418,11 @@ static void panel_toplevel_init_resize_drag_offsets(PanelToplevel* toplevel, Pan
 	toplevel->priv->drag_offset_x = 0;
 	toplevel->priv->drag_offset_y = 0;
 
+	toplevel->priv->motion_x       = 0;
+	toplevel->priv->motion_y       = 0;
+	toplevel->priv->motion_state   = 0;
+	toplevel->priv->motion_tick_id = 0;
+
 	switch (grab_op) {
 	case PANEL_GRAB_OP_RESIZE_DOWN:
 		toplevel->priv->drag_offset_y = toplevel->priv->geometry.y;
@@ -508,6 +548,9 @@ static void panel_toplevel_begin_grab_op(PanelToplevel* toplevel, PanelGrabOpTyp
 	toplevel->priv->grab_op          = op_type;
 	toplevel->priv->grab_is_keyboard = (grab_keyboard != FALSE);
 
+	/* save the new location once, when the grab is over */
+	panel_profile_journal_begin ();
+
 	toplevel->priv->orig_monitor     = toplevel->priv->monitor;
 	toplevel->priv->orig_x           = toplevel->priv->x;
 	toplevel->priv->orig_x_right     = toplevel->priv->x_right;
@@ -544,6 +587,9 @@ static void panel_toplevel_begin_grab_op(PanelToplevel* toplevel, PanelGrabOpTyp
 	g_object_unref (cursor);
 }
 
+static void panel_toplevel_flush_pending_motion (PanelToplevel *toplevel);
+static void panel_toplevel_drop_pending_motion (PanelToplevel *toplevel);
+
 static void panel_toplevel_end_grab_op (PanelToplevel* toplevel, guint32 time_)
 {
 	GtkWidget *widget;
@@ -554,6 +600,8 @@ static void panel_toplevel_end_grab_op (PanelToplevel* toplevel, guint32 time_)
 
 	widget = GTK_WIDGET (toplevel);
 
+	panel_toplevel_flush_pending_motion (toplevel);
+
 	toplevel->priv->grab_op          = PANEL_GRAB_OP_NONE;
 	toplevel->priv->grab_is_keyboard = FALSE;
 
@@ -563,10 +611,14 @@ static void panel_toplevel_end_grab_op (PanelToplevel* toplevel, guint32 time_)
 	seat = gdk_display_get_default_seat (display);
 
 	gdk_seat_ungrab (seat);
+
+	panel_profile_journal_end ();
 }
 
 static void panel_toplevel_cancel_grab_op(PanelToplevel* toplevel, guint32 time_)
 {
+	panel_toplevel_drop_pending_motion (toplevel);
+
 	panel_toplevel_set_orientation (toplevel, toplevel->priv->orig_orientation);
 	panel_toplevel_set_monitor (toplevel, toplevel->priv->orig_monitor);
 	panel_toplevel_set_size (toplevel, toplevel->priv->orig_size);
@@ -1037,33 +1089,155 @@ static gboolean panel_toplevel_handle_grab_op_key_event(PanelToplevel* toplevel,
 	return retval;
 }
 
-static gboolean panel_toplevel_handle_grab_op_motion_event(PanelToplevel* toplevel, GdkEventMotion* event)
+static void panel_toplevel_update_placement (PanelToplevel *toplevel);
+static void panel_toplevel_move_resize_window (PanelToplevel *toplevel,
+					       gboolean       move,
+					       gboolean       resize);
+
+/* Updates the position of the panel and moves its window there, without
+ * a size request and allocation of the whole panel: only valid when the
+ * content keeps its size. If the size of the panel still changes, like
+ * when reaching another edge, a resize is queued as usual. */
+static void panel_toplevel_move_to_placement(PanelToplevel* toplevel)
+{
+	GdkRectangle old_geometry;
+
+	old_geometry = toplevel->priv->geometry;
+	panel_toplevel_update_placement (toplevel);
+
+	if (old_geometry.width  != toplevel->priv->geometry.width ||
+	    old_geometry.height != toplevel->priv->geometry.height) {
+		toplevel->priv->move_relayout_pending = TRUE;
+		gtk_widget_queue_resize (GTK_WIDGET (toplevel));
+	} else if (old_geometry.x != toplevel->priv->geometry.x ||
+		   old_geometry.y != toplevel->priv->geometry.y) {
+		panel_toplevel_move_resize_window (toplevel, TRUE, FALSE);
+	}
+}
+
+/* Moves the panel along the same edge of the same monitor */
+static void panel_toplevel_move_position_only(PanelToplevel* toplevel, int pointer_x, int pointer_y)
+{
+	PanelOrientation orientation;
+	int              monitor;
+
+	orientation = toplevel->priv->orientation;
+	monitor = toplevel->priv->monitor;
+
+	toplevel->priv->move_position_only = TRUE;
+	toplevel->priv->move_position_changed = FALSE;
+	panel_toplevel_move_to_pointer (toplevel, pointer_x, pointer_y);
+	toplevel->priv->move_position_only = FALSE;
+
+	if (!toplevel->priv->move_position_changed)
+		return;
+
+	if (toplevel->priv->move_relayout_pending ||
+	    toplevel->priv->animating ||
+	    !gtk_widget_get_realized (GTK_WIDGET (toplevel)) ||
+	    orientation != toplevel->priv->orientation ||
+	    monitor != toplevel->priv->monitor) {
+		toplevel->priv->move_relayout_pending = TRUE;
+		gtk_widget_queue_resize (GTK_WIDGET (toplevel));
+		return;
+	}
+
+	panel_toplevel_move_to_placement (toplevel);
+}
+
+static void panel_toplevel_handle_grab_op_motion(PanelToplevel* toplevel, int pointer_x, int pointer_y, GdkModifierType state)
 {
 	switch (toplevel->priv->grab_op) {
 	case PANEL_GRAB_OP_MOVE:
 		if (toplevel->priv->expand)
 			panel_toplevel_calc_new_orientation (
-					toplevel, event->x_root, event->y_root);
+					toplevel, pointer_x, pointer_y);
 
-		else if ((event->state & gtk_accelerator_get_default_mod_mask ()) == GDK_CONTROL_MASK)
+		else if ((state & gtk_accelerator_get_default_mod_mask ()) == GDK_CONTROL_MASK)
 			panel_toplevel_rotate_to_pointer (
-					toplevel, event->x_root, event->y_root);
+					toplevel, pointer_x, pointer_y);
 
 		else
-			panel_toplevel_move_to_pointer (
-					toplevel, event->x_root, event->y_root);
-		return TRUE;
+			panel_toplevel_move_position_only (
+					toplevel, pointer_x, pointer_y);
+		break;
 	case PANEL_GRAB_OP_RESIZE_UP:
 	case PANEL_GRAB_OP_RESIZE_DOWN:
 	case PANEL_GRAB_OP_RESIZE_LEFT:
 	case PANEL_GRAB_OP_RESIZE_RIGHT:
-		panel_toplevel_resize_to_pointer (toplevel, event->x_root, event->y_root);
-		return TRUE;
+		panel_toplevel_resize_to_pointer (toplevel, pointer_x, pointer_y);
+		break;
 	default:
 		break;
 	}
+}
 
-	return FALSE;
+static gboolean
+panel_toplevel_motion_tick (GtkWidget     *widget,
+			    GdkFrameClock *frame_clock,
+			    gpointer       user_data)
+{
+	PanelToplevel *toplevel = PANEL_TOPLEVEL (widget);
+
+	toplevel->priv->motion_tick_id = 0;
+	panel_toplevel_handle_grab_op_motion (toplevel,
+					      toplevel->priv->motion_x,
+					      toplevel->priv->motion_y,
+					      toplevel->priv->motion_state);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Pointer motions of a grab op can come much faster than the panel can be
+ * laid out: only the last one before each frame is handled. */
+static gboolean panel_toplevel_handle_grab_op_motion_event(PanelToplevel* toplevel, GdkEventMotion* event)
+{
+	switch (toplevel->priv->grab_op) {
+	case PANEL_GRAB_OP_MOVE:
+	case PANEL_GRAB_OP_RESIZE_UP:
+	case PANEL_GRAB_OP_RESIZE_DOWN:
+	case PANEL_GRAB_OP_RESIZE_LEFT:
+	case PANEL_GRAB_OP_RESIZE_RIGHT:
+		break;
+	default:
+		return FALSE;
+	}
+
+	toplevel->priv->motion_x = event->x_root;
+	toplevel->priv->motion_y = event->y_root;
+	toplevel->priv->motion_state = event->state;
+
+	if (!toplevel->priv->motion_tick_id)
+		toplevel->priv->motion_tick_id =
+			gtk_widget_add_tick_callback (GTK_WIDGET (toplevel),
+						      panel_toplevel_motion_tick,
+						      NULL, NULL);
+
+	return TRUE;
+}
+
+static void
+panel_toplevel_drop_pending_motion (PanelToplevel *toplevel)
+{
+	if (toplevel->priv->motion_tick_id)
+		gtk_widget_remove_tick_callback (GTK_WIDGET (toplevel),
+						 toplevel->priv->motion_tick_id);
+	toplevel->priv->motion_tick_id = 0;
+}
+
+/* The panel ends up where the pointer was released, even if the frame
+ * did not come yet */
+static void
+panel_toplevel_flush_pending_motion (PanelToplevel *toplevel)
+{
+	if (!toplevel->priv->motion_tick_id)
+		return;
+
+	panel_toplevel_drop_pending_motion (toplevel);
+	panel_toplevel_handle_grab_op_motion (toplevel,
+					      toplevel->priv->motion_x,
+					      toplevel->priv->motion_y,
+					      toplevel->priv->motion_state);
 }
 
 static void panel_toplevel_calc_floating(PanelToplevel* toplevel)
@@ -1429,7 +1603,7 @@ static inline int panel_toplevel_get_effective_auto_hide_size(PanelToplevel* top
 	return (size <= 0) ? DEFAULT_AUTO_HIDE_SIZE : size;
 }
 
-static gboolean panel_toplevel_update_struts(PanelToplevel* toplevel, gboolean end_of_animation)
+static gboolean panel_toplevel_update_struts_real(PanelToplevel* toplevel, gboolean end_of_animation)
 {
 	PanelOrientation  orientation;
 	gboolean          geometry_changed = FALSE;
@@ -1552,12 +1726,40 @@ static gboolean panel_toplevel_update_struts(PanelToplevel* toplevel, gboolean e
 
 #ifdef HAVE_WAYLAND
 	if (GDK_IS_WAYLAND_DISPLAY (gtk_widget_get_display (GTK_WIDGET (toplevel)))) {
+		/* a panel hidden to a side reserves no space, as on X11 */
+		if (toplevel->priv->state == PANEL_STATE_NORMAL ||
+		    toplevel->priv->state == PANEL_STATE_AUTO_HIDDEN ||
+		    toplevel->priv->animating)
+			wayland_panel_toplevel_set_exclusive_zone (toplevel, strut);
+		else
+			wayland_panel_toplevel_set_exclusive_zone (toplevel, 0);
 		wayland_panel_toplevel_update_placement (toplevel);
 	}
 #endif /* HAVE_WAYLAND */
 	return geometry_changed;
 }
 
+static gboolean panel_toplevel_update_struts(PanelToplevel* toplevel, gboolean end_of_animation)
+{
+	const char *previous;
+	gboolean    geometry_changed;
+
+	/* a cause set by the caller is more precise */
+	previous = panel_struts_set_trace_cause (NULL);
+	if (previous)
+		panel_struts_set_trace_cause (previous);
+	else if (end_of_animation || toplevel->priv->animating)
+		panel_struts_set_trace_cause ("animation");
+	else
+		panel_struts_set_trace_cause ("geometry");
+
+	geometry_changed = panel_toplevel_update_struts_real (toplevel, end_of_animation);
+
+	panel_struts_set_trace_cause (previous);
+
+	return geometry_changed;
+}
+
 void panel_toplevel_update_edges(PanelToplevel* toplevel)
 {
 	GtkWidget       *widget;
@@ -1982,6 +2184,7 @@ static void
 panel_toplevel_update_animating_position (PanelToplevel *toplevel)
 {
 	GTimeSpan  animation_elapsed_time;
+	gint64     now;
 	int        deltax, deltay, deltaw = 0, deltah = 0;
 	int        monitor_offset_x, monitor_offset_y;
 
@@ -1989,32 +2192,47 @@ panel_toplevel_update_animating_position (PanelToplevel *toplevel)
 	    (toplevel->priv->animation_duration_time <= 0))
 		return;
 
-	animation_elapsed_time = g_get_monotonic_time () - toplevel->priv->animation_start_time;
+	/* Interpolate from the start of the animation, so that the position
+	 * only depends on the time of the frame: slow frames simply make the
+	 * panel jump ahead, and several size requests in the same frame give
+	 * the same result. */
+	now = toplevel->priv->animation_frame_time;
+	if (now <= 0)
+		now = g_get_monotonic_time ();
+	animation_elapsed_time = now - toplevel->priv->animation_start_time;
 
 	monitor_offset_x = panel_multimonitor_x (toplevel->priv->monitor);
 	monitor_offset_y = panel_multimonitor_y (toplevel->priv->monitor);
 
 	if (toplevel->priv->animation_end_width != -1)
-		deltaw = get_delta (toplevel->priv->geometry.width,
+		deltaw = toplevel->priv->animation_start_width +
+			 get_delta (toplevel->priv->animation_start_width,
 				    toplevel->priv->animation_end_width,
 				    animation_elapsed_time,
-				    toplevel->priv->animation_duration_time);
+				    toplevel->priv->animation_duration_time) -
+			 toplevel->priv->geometry.width;
 
 	if (toplevel->priv->animation_end_height != -1)
-		deltah = get_delta (toplevel->priv->geometry.height,
+		deltah = toplevel->priv->animation_start_height +
+			 get_delta (toplevel->priv->animation_start_height,
 				    toplevel->priv->animation_end_height,
 				    animation_elapsed_time,
-				    toplevel->priv->animation_duration_time);
+				    toplevel->priv->animation_duration_time) -
+			 toplevel->priv->geometry.height;
 
-	deltax = get_delta (toplevel->priv->geometry.x - monitor_offset_x,
+	deltax = toplevel->priv->animation_start_x +
+		 get_delta (toplevel->priv->animation_start_x,
 			    toplevel->priv->animation_end_x,
 			    animation_elapsed_time,
-			    toplevel->priv->animation_duration_time);
+			    toplevel->priv->animation_duration_time) -
+		 (toplevel->priv->geometry.x - monitor_offset_x);
 
-	deltay = get_delta (toplevel->priv->geometry.y - monitor_offset_y,
+	deltay = toplevel->priv->animation_start_y +
+		 get_delta (toplevel->priv->animation_start_y,
 			    toplevel->priv->animation_end_y,
 			    animation_elapsed_time,
-			    toplevel->priv->animation_duration_time);
+			    toplevel->priv->animation_duration_time) -
+		 (toplevel->priv->geometry.y - monitor_offset_y);
 
 	if (deltaw != 0 && abs (deltaw) > abs (deltax))
 		deltax = deltaw;
@@ -2037,7 +2255,7 @@ panel_toplevel_update_animating_position (PanelToplevel *toplevel)
 
 		if (toplevel->priv->attached && panel_toplevel_get_is_hidden (toplevel))
 			gtk_widget_unmap (GTK_WIDGET (toplevel));
-		else
+		else if (!toplevel->priv->hide_move_only)
 			gtk_widget_queue_resize (GTK_WIDGET (toplevel));
 
 		if (toplevel->priv->state == PANEL_STATE_NORMAL)
@@ -2495,12 +2713,11 @@ panel_toplevel_update_size (PanelToplevel  *toplevel,
 	toplevel->priv->original_height = toplevel->priv->geometry.height;
 }
 
+/* The part of the geometry update that does not depend on the size
+ * requested by the content of the panel */
 static void
-panel_toplevel_update_geometry (PanelToplevel  *toplevel,
-				GtkRequisition *requisition)
+panel_toplevel_update_placement (PanelToplevel *toplevel)
 {
-	toplevel->priv->updated_geometry_initial = TRUE;
-	panel_toplevel_update_size (toplevel, requisition);
 	panel_toplevel_update_position (toplevel);
 
 	panel_toplevel_update_struts (toplevel, FALSE);
@@ -2527,16 +2744,65 @@ panel_toplevel_update_geometry (PanelToplevel  *toplevel,
 	panel_toplevel_update_description (toplevel);
 }
 
+static void
+panel_toplevel_update_geometry (PanelToplevel  *toplevel,
+				GtkRequisition *requisition)
+{
+	toplevel->priv->updated_geometry_initial = TRUE;
+	panel_toplevel_update_size (toplevel, requisition);
+	panel_toplevel_update_placement (toplevel);
+}
+
 static void
 panel_toplevel_attach_widget_destroyed (PanelToplevel *toplevel)
 {
 	panel_toplevel_detach (toplevel);
 }
 
+static gboolean
+panel_toplevel_attach_tick (GtkWidget     *widget,
+			    GdkFrameClock *frame_clock,
+			    gpointer       user_data)
+{
+	PanelToplevel *toplevel = PANEL_TOPLEVEL (widget);
+
+	toplevel->priv->attach_tick_id = 0;
+
+	if (toplevel->priv->attached)
+		panel_toplevel_move_to_placement (toplevel);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+panel_toplevel_drop_pending_attach (PanelToplevel *toplevel)
+{
+	if (toplevel->priv->attach_tick_id)
+		gtk_widget_remove_tick_callback (GTK_WIDGET (toplevel),
+						 toplevel->priv->attach_tick_id);
+	toplevel->priv->attach_tick_id = 0;
+}
+
+/* The parent panel and the drawer button get configured on each step of
+ * an animation or a drag: the drawer is moved once per frame, and only
+ * laid out again if its size changes too. A closed or animating drawer
+ * gets its geometry from the next layout anyway. */
 static gboolean
 panel_toplevel_attach_widget_configure (PanelToplevel *toplevel)
 {
-	gtk_widget_queue_resize (GTK_WIDGET (toplevel));
+	if (!gtk_widget_get_mapped (GTK_WIDGET (toplevel)) ||
+	    toplevel->priv->animating ||
+	    toplevel->priv->move_relayout_pending) {
+		panel_toplevel_drop_pending_attach (toplevel);
+		gtk_widget_queue_resize (GTK_WIDGET (toplevel));
+		return FALSE;
+	}
+
+	if (!toplevel->priv->attach_tick_id)
+		toplevel->priv->attach_tick_id =
+			gtk_widget_add_tick_callback (GTK_WIDGET (toplevel),
+						      panel_toplevel_attach_tick,
+						      NULL, NULL);
 
 	return FALSE;
 }
@@ -2588,7 +2854,7 @@ panel_toplevel_attach_widget_parent_set (PanelToplevel *toplevel,
 
 	toplevel->priv->attach_toplevel = PANEL_WIDGET (panel_widget)->toplevel;
 	panel_toplevel_update_attach_orientation (toplevel);
-	gtk_widget_queue_resize (GTK_WIDGET (toplevel));
+	panel_toplevel_attach_widget_configure (toplevel);
 }
 
 static void
@@ -2786,6 +3052,7 @@ panel_toplevel_detach (PanelToplevel *toplevel)
 		panel_toplevel_pop_autohide_disabler (toplevel->priv->attach_toplevel);
 
 	panel_toplevel_disconnect_attached (toplevel);
+	panel_toplevel_drop_pending_attach (toplevel);
 
 	panel_toplevel_reverse_arrows (toplevel);
 
@@ -2897,7 +3164,8 @@ panel_toplevel_move_resize_window (PanelToplevel *toplevel,
 {
 	GtkWidget *widget;
 
-	GList *list;
+	PanelWidget *panel_widget;
+	guint i;
 	gboolean stick;
 
 	widget = GTK_WIDGET (toplevel);
@@ -2920,8 +3188,9 @@ panel_toplevel_move_resize_window (PanelToplevel *toplevel,
 				   toplevel->priv->geometry.height);
 
 	if (resize || move) {
-		for (list = toplevel->priv->panel_widget->applet_list; list != NULL; list = g_list_next (list)) {
-			AppletData *ad = list->data;
+		panel_widget = toplevel->priv->panel_widget;
+		for (i = 0; i < panel_widget->applets->len; i++) {
+			AppletData *ad = g_ptr_array_index (panel_widget->applets, i);
 			const char *id = mate_panel_applet_get_id_by_widget (ad->applet);
 
 			if (!id)
@@ -3043,9 +3312,17 @@ panel_toplevel_disconnect_timeouts (PanelToplevel *toplevel)
 		g_source_remove (toplevel->priv->unhide_timeout);
 	toplevel->priv->unhide_timeout = 0;
 
-	if (toplevel->priv->animation_timeout)
-		g_source_remove (toplevel->priv->animation_timeout);
-	toplevel->priv->animation_timeout = 0;
+	if (toplevel->priv->animation_tick_id)
+		gtk_widget_remove_tick_callback (GTK_WIDGET (toplevel),
+						 toplevel->priv->animation_tick_id);
+	toplevel->priv->animation_tick_id = 0;
+
+	if (toplevel->priv->style_update_id)
+		panel_scheduler_remove (toplevel->priv->style_update_id);
+	toplevel->priv->style_update_id = 0;
+
+	panel_toplevel_drop_pending_motion (toplevel);
+	panel_toplevel_drop_pending_attach (toplevel);
 }
 
 static void
@@ -3065,13 +3342,17 @@ panel_toplevel_dispose (GObject *widget)
 
 	g_clear_pointer (&toplevel->priv->settings_path, g_free);
 
+	/* destroyed in the middle of a move */
+	if (toplevel->priv->grab_op != PANEL_GRAB_OP_NONE) {
+		toplevel->priv->grab_op = PANEL_GRAB_OP_NONE;
+		panel_profile_journal_end ();
+	}
+
 	if (toplevel->settings) {
 		g_signal_handlers_disconnect_by_data (toplevel->settings, toplevel);
 		g_clear_object (&toplevel->settings);
 	}
 
-	g_clear_object (&toplevel->queued_settings);
-
 	if (toplevel->background_settings) {
 		g_signal_handlers_disconnect_by_data (toplevel->background_settings, toplevel);
 		g_clear_object (&toplevel->background_settings);
@@ -3150,6 +3431,7 @@ panel_toplevel_size_request (GtkWidget      *widget,
 
 	old_geometry = toplevel->priv->geometry;
 
+	toplevel->priv->move_relayout_pending = FALSE;
 	panel_toplevel_update_geometry (toplevel, requisition);
 
 	requisition->width  = toplevel->priv->geometry.width;
@@ -3166,6 +3448,21 @@ panel_toplevel_size_request (GtkWidget      *widget,
 	    old_geometry.y != toplevel->priv->geometry.y)
 		position_changed = TRUE;
 
+	if ((position_changed || size_changed) && panel_trace_is_enabled ()) {
+		char *name;
+
+		name = g_strdup_printf ("geometry %s %d,%d %dx%d, was %d,%d %dx%d",
+					toplevel->priv->settings_path,
+					toplevel->priv->geometry.x,
+					toplevel->priv->geometry.y,
+					toplevel->priv->geometry.width,
+					toplevel->priv->geometry.height,
+					old_geometry.x, old_geometry.y,
+					old_geometry.width, old_geometry.height);
+		panel_trace_instant ("toplevel", name);
+		g_free (name);
+	}
+
 	panel_toplevel_move_resize_window (toplevel, position_changed, size_changed);
 }
 
@@ -3235,6 +3532,16 @@ panel_toplevel_size_allocate (GtkWidget     *widget,
 
 	gtk_widget_set_allocation (widget, allocation);
 
+	if (!toplevel->priv->allocation_traced && panel_trace_is_enabled ()) {
+		char *name;
+
+		toplevel->priv->allocation_traced = TRUE;
+		name = g_strdup_printf ("first size_allocate %s",
+					toplevel->priv->settings_path);
+		panel_trace_instant ("toplevel", name);
+		g_free (name);
+	}
+
 	if (toplevel->priv->expand ||
 	    toplevel->priv->buttons_enabled ||
 	    toplevel->priv->attached)
@@ -3506,10 +3813,40 @@ panel_toplevel_motion_notify_event (GtkWidget      *widget,
 		return FALSE;
 }
 
+/* Whether the animation only moves the window: in that case there is no
+ * need to go through a size request/allocation of the panel for each
+ * frame. */
 static gboolean
-panel_toplevel_animation_timeout (PanelToplevel *toplevel)
+panel_toplevel_animation_is_move_only (PanelToplevel *toplevel)
 {
-	gtk_widget_queue_resize (GTK_WIDGET (toplevel));
+	return ((toplevel->priv->animation_end_width == -1 ||
+		 toplevel->priv->animation_end_width == toplevel->priv->animation_start_width) &&
+		(toplevel->priv->animation_end_height == -1 ||
+		 toplevel->priv->animation_end_height == toplevel->priv->animation_start_height));
+}
+
+static gboolean
+panel_toplevel_animation_tick (GtkWidget     *widget,
+			       GdkFrameClock *frame_clock,
+			       gpointer       user_data)
+{
+	PanelToplevel *toplevel = PANEL_TOPLEVEL (widget);
+
+	toplevel->priv->animation_frame_time = gdk_frame_clock_get_frame_time (frame_clock);
+
+	if (panel_toplevel_animation_is_move_only (toplevel)) {
+		/* this queues a resize itself at the end of the animation,
+		 * unless the panel is only auto-hidden or unhidden */
+		panel_toplevel_update_animating_position (toplevel);
+		gdk_window_move (gtk_widget_get_window (widget),
+				 toplevel->priv->geometry.x,
+				 toplevel->priv->geometry.y);
+
+		if (!toplevel->priv->animating && toplevel->priv->hide_move_only)
+			panel_toplevel_move_to_placement (toplevel);
+	} else {
+		gtk_widget_queue_resize (widget);
+	}
 
 	if (!toplevel->priv->animating) {
 		toplevel->priv->animation_end_x              = 0xdead;
@@ -3517,12 +3854,20 @@ panel_toplevel_animation_timeout (PanelToplevel *toplevel)
 		toplevel->priv->animation_end_width          = 0xdead;
 		toplevel->priv->animation_end_height         = 0xdead;
 		toplevel->priv->animation_start_time         = 0xdead;
+		toplevel->priv->animation_frame_time         = 0;
 		toplevel->priv->animation_duration_time      = 0xdead;
-		toplevel->priv->animation_timeout            = 0;
+		toplevel->priv->animation_tick_id            = 0;
 		toplevel->priv->initial_animation_done       = TRUE;
 	}
 
-	return toplevel->priv->animating;
+	return toplevel->priv->animating ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+}
+
+/* The low-power profile does not slide the panels */
+static gboolean
+panel_toplevel_get_effective_animate (PanelToplevel *toplevel)
+{
+	return toplevel->priv->animate && panel_power_get_animate ();
 }
 
 static GTimeSpan
@@ -3534,9 +3879,15 @@ panel_toplevel_get_animation_time (PanelToplevel *toplevel)
 #define ANIMATION_TIME_MEDIUM 1200
 #define ANIMATION_TIME_SLOW   2000
 
+	PanelAnimationSpeed speed;
 	GTimeSpan t;
 
-	switch (toplevel->priv->animation_speed) {
+	/* the balanced profile draws fewer frames */
+	speed = toplevel->priv->animation_speed;
+	if (panel_power_get_profile () == PANEL_POWER_PROFILE_BALANCED)
+		speed = PANEL_ANIMATION_FAST;
+
+	switch (speed) {
 	case PANEL_ANIMATION_SLOW:
 		t = ANIMATION_TIME_SLOW * G_TIME_SPAN_MILLISECOND;
 		break;
@@ -3665,12 +4016,43 @@ panel_toplevel_start_animation (PanelToplevel *toplevel)
 		gtk_window_present (GTK_WINDOW (toplevel->priv->attach_toplevel));
 	}
 
+	toplevel->priv->animation_start_x      = cur_x;
+	toplevel->priv->animation_start_y      = cur_y;
+	toplevel->priv->animation_start_width  = requisition.width;
+	toplevel->priv->animation_start_height = requisition.height;
+
 	toplevel->priv->animation_start_time = g_get_monotonic_time ();
+	toplevel->priv->animation_frame_time = 0;
 	toplevel->priv->animation_duration_time = panel_toplevel_get_animation_time (toplevel);
 
-	if (!toplevel->priv->animation_timeout)
-		toplevel->priv->animation_timeout =
-			g_timeout_add (20, (GSourceFunc) panel_toplevel_animation_timeout, toplevel);
+	if (!toplevel->priv->animation_tick_id)
+		toplevel->priv->animation_tick_id =
+			gtk_widget_add_tick_callback (GTK_WIDGET (toplevel),
+						      panel_toplevel_animation_tick,
+						      NULL, NULL);
+}
+
+/* Auto-hiding only changes the position of the panel, which keeps its
+ * full size and is moved partly off the screen: there is no need to
+ * negotiate its size and allocate the applets again. This does not apply
+ * to drawers, whose window is hidden, nor to the initial animation. */
+static gboolean
+panel_toplevel_can_hide_by_moving (PanelToplevel *toplevel)
+{
+	return !toplevel->priv->attached &&
+	       toplevel->priv->initial_animation_done &&
+	       toplevel->priv->updated_geometry_initial &&
+	       gtk_widget_get_realized (GTK_WIDGET (toplevel));
+}
+
+static void
+panel_toplevel_queue_hide_move (PanelToplevel *toplevel)
+{
+	if (!toplevel->priv->hide_move_only)
+		gtk_widget_queue_resize (GTK_WIDGET (toplevel));
+	else if (!toplevel->priv->animating)
+		panel_toplevel_move_to_placement (toplevel);
+	/* else the animation moves the window */
 }
 
 void
@@ -3683,6 +4065,9 @@ panel_toplevel_hide (PanelToplevel    *toplevel,
 	if (toplevel->priv->state != PANEL_STATE_NORMAL)
 		return;
 
+	toplevel->priv->hide_move_only = auto_hide &&
+		panel_toplevel_can_hide_by_moving (toplevel);
+
 	g_signal_emit (toplevel, toplevel_signals [HIDE_SIGNAL], 0);
 
 	if (toplevel->priv->attach_toplevel)
@@ -3727,7 +4112,7 @@ panel_toplevel_hide (PanelToplevel    *toplevel,
 		panel_toplevel_update_hide_buttons (toplevel);
 	}
 
-	if (toplevel->priv->animate && gtk_widget_get_realized (GTK_WIDGET (toplevel))) {
+	if (panel_toplevel_get_effective_animate (toplevel) && gtk_widget_get_realized (GTK_WIDGET (toplevel))) {
 		panel_toplevel_start_animation (toplevel);
 	}
 
@@ -3737,7 +4122,7 @@ panel_toplevel_hide (PanelToplevel    *toplevel,
 		gtk_widget_hide (GTK_WIDGET (toplevel));
         }
 
-	gtk_widget_queue_resize (GTK_WIDGET (toplevel));
+	panel_toplevel_queue_hide_move (toplevel);
 }
 
 static gboolean
@@ -3773,6 +4158,10 @@ panel_toplevel_unhide (PanelToplevel *toplevel)
 	if (toplevel->priv->state == PANEL_STATE_NORMAL)
 		return;
 
+	toplevel->priv->hide_move_only =
+		toplevel->priv->state == PANEL_STATE_AUTO_HIDDEN &&
+		panel_toplevel_can_hide_by_moving (toplevel);
+
 	toplevel->priv->state = PANEL_STATE_NORMAL;
 
 	panel_toplevel_update_hide_buttons (toplevel);
@@ -3780,7 +4169,7 @@ panel_toplevel_unhide (PanelToplevel *toplevel)
 	if (toplevel->priv->attach_toplevel)
 		panel_toplevel_push_autohide_disabler (toplevel->priv->attach_toplevel);
 
-	if (toplevel->priv->animate && gtk_widget_get_realized (GTK_WIDGET (toplevel))) {
+	if (panel_toplevel_get_effective_animate (toplevel) && gtk_widget_get_realized (GTK_WIDGET (toplevel))) {
 		panel_toplevel_start_animation (toplevel);
 	}
 
@@ -3790,9 +4179,9 @@ panel_toplevel_unhide (PanelToplevel *toplevel)
 		gtk_widget_show (GTK_WIDGET (toplevel));
 	}
 
-	gtk_widget_queue_resize (GTK_WIDGET (toplevel));
+	panel_toplevel_queue_hide_move (toplevel);
 
-	if (!toplevel->priv->animate)
+	if (!panel_toplevel_get_effective_animate (toplevel))
 		g_signal_emit (toplevel, toplevel_signals [UNHIDE_SIGNAL], 0);
 }
 
@@ -3809,7 +4198,7 @@ panel_toplevel_auto_unhide_timeout_handler (PanelToplevel *toplevel)
 	if (toplevel->priv->animating)
 		return TRUE;
 
-	if (!toplevel->priv->animate)
+	if (!panel_toplevel_get_effective_animate (toplevel))
 		toplevel->priv->initial_animation_done = TRUE;
 
 	/* initial animation for auto-hidden panels: we need to unhide and hide
@@ -3977,15 +4366,32 @@ panel_toplevel_focus_out_event (GtkWidget     *widget,
 	return FALSE;
 }
 
+/* Runs before the redraws, which then use the new background */
+static gboolean
+panel_toplevel_style_update_idle (PanelToplevel *toplevel)
+{
+	toplevel->priv->style_update_id = 0;
+
+	panel_toplevel_update_hide_buttons (toplevel);
+	set_background_default_style (GTK_WIDGET (toplevel));
+
+	return G_SOURCE_REMOVE;
+}
+
 static void
 panel_toplevel_style_updated (GtkWidget *widget)
 {
-	panel_toplevel_update_hide_buttons (PANEL_TOPLEVEL (widget));
+	PanelToplevel *toplevel = PANEL_TOPLEVEL (widget);
 
 	if (GTK_WIDGET_CLASS (panel_toplevel_parent_class)->style_updated)
 		GTK_WIDGET_CLASS (panel_toplevel_parent_class)->style_updated (widget);
 
-	set_background_default_style (widget);
+	if (!toplevel->priv->style_update_id)
+		toplevel->priv->style_update_id =
+			panel_scheduler_add (PANEL_SCHEDULER_PRIORITY_HIGH,
+					     "toplevel-style-update",
+					     (GSourceFunc) panel_toplevel_style_update_idle,
+					     toplevel, NULL);
 }
 
 static void
@@ -4681,6 +5087,21 @@ background_changed (PanelBackground *background,
 	panel_widget_emit_background_changed (toplevel->priv->panel_widget);
 }
 
+/* Moved to a monitor with another scale: the panel widget measures its
+ * applets in device pixels, and the size hints are scaled back with it */
+static void
+panel_toplevel_scale_factor_changed (PanelToplevel *toplevel)
+{
+	int scale;
+
+	scale = gtk_widget_get_scale_factor (GTK_WIDGET (toplevel));
+	if (toplevel->priv->scale == scale)
+		return;
+
+	toplevel->priv->scale = scale;
+	gtk_widget_queue_resize (GTK_WIDGET (toplevel));
+}
+
 static void
 panel_toplevel_init (PanelToplevel *toplevel)
 {
@@ -4732,9 +5153,14 @@ panel_toplevel_init (PanelToplevel *toplevel)
 	toplevel->priv->animation_end_y              = 0;
 	toplevel->priv->animation_end_width          = 0;
 	toplevel->priv->animation_end_height         = 0;
+	toplevel->priv->animation_start_x            = 0;
+	toplevel->priv->animation_start_y            = 0;
+	toplevel->priv->animation_start_width        = 0;
+	toplevel->priv->animation_start_height       = 0;
 	toplevel->priv->animation_start_time         = 0;
+	toplevel->priv->animation_frame_time         = 0;
 	toplevel->priv->animation_duration_time      = 0;
-	toplevel->priv->animation_timeout            = 0;
+	toplevel->priv->animation_tick_id            = 0;
 
 	toplevel->priv->panel_widget       = NULL;
 	toplevel->priv->inner_frame        = NULL;
@@ -4787,6 +5213,9 @@ panel_toplevel_init (PanelToplevel *toplevel)
 	 */
 	g_signal_connect (toplevel, "delete-event", G_CALLBACK(gtk_true), NULL);
 
+	g_signal_connect (toplevel, "notify::scale-factor",
+			  G_CALLBACK (panel_toplevel_scale_factor_changed), NULL);
+
 	panel_background_init (&toplevel->background,
 			       (PanelBackgroundChangedNotify) background_changed,
 			       toplevel);
@@ -5098,8 +5527,15 @@ panel_toplevel_set_auto_hide_size (PanelToplevel *toplevel,
 	toplevel->priv->auto_hide_size = auto_hide_size;
 
 	if (toplevel->priv->state == PANEL_STATE_AUTO_HIDDEN) {
-		if (panel_toplevel_update_struts (toplevel, FALSE)) {
-			if (toplevel->priv->animate) {
+		const char *cause;
+		gboolean    changed;
+
+		cause = panel_struts_set_trace_cause ("auto-hide size");
+		changed = panel_toplevel_update_struts (toplevel, FALSE);
+		panel_struts_set_trace_cause (cause);
+
+		if (changed) {
+			if (panel_toplevel_get_effective_animate (toplevel)) {
 				panel_toplevel_unhide (toplevel);
 				panel_toplevel_hide (toplevel, TRUE, -1);
 			} else
@@ -5150,7 +5586,9 @@ panel_toplevel_set_x (PanelToplevel *toplevel,
 		g_object_notify (G_OBJECT (toplevel), "x-centered");
 	}
 
-	if (changed)
+	if (changed && toplevel->priv->move_position_only)
+		toplevel->priv->move_position_changed = TRUE;
+	else if (changed)
 		gtk_widget_queue_resize (GTK_WIDGET (toplevel));
 
 	g_object_thaw_notify (G_OBJECT (toplevel));
@@ -5188,7 +5626,9 @@ panel_toplevel_set_y (PanelToplevel *toplevel,
 		g_object_notify (G_OBJECT (toplevel), "y-centered");
 	}
 
-	if (changed)
+	if (changed && toplevel->priv->move_position_only)
+		toplevel->priv->move_position_changed = TRUE;
+	else if (changed)
 		gtk_widget_queue_resize (GTK_WIDGET (toplevel));
 
 	g_object_thaw_notify (G_OBJECT (toplevel));
@@ -5319,6 +5759,9 @@ void
 panel_toplevel_set_auto_hide (PanelToplevel *toplevel,
 			      gboolean       auto_hide)
 {
+	const char *cause;
+	gboolean    changed;
+
 	g_return_if_fail (PANEL_IS_TOPLEVEL (toplevel));
 
 	auto_hide = auto_hide != FALSE;
@@ -5333,7 +5776,11 @@ panel_toplevel_set_auto_hide (PanelToplevel *toplevel,
 	else
 		panel_toplevel_queue_auto_unhide (toplevel);
 
-	if (panel_toplevel_update_struts (toplevel, FALSE))
+	cause = panel_struts_set_trace_cause ("auto-hide");
+	changed = panel_toplevel_update_struts (toplevel, FALSE);
+	panel_struts_set_trace_cause (cause);
+
+	if (changed)
 		gtk_widget_queue_resize (GTK_WIDGET (toplevel));
 
 	g_object_notify (G_OBJECT (toplevel), "auto-hide");
@@ -5527,6 +5974,14 @@ panel_toplevel_get_state (PanelToplevel *toplevel)
 	return toplevel->priv->state;
 }
 
+gboolean
+panel_toplevel_get_is_animating (PanelToplevel *toplevel)
+{
+	g_return_val_if_fail (PANEL_IS_TOPLEVEL (toplevel), FALSE);
+
+	return toplevel->priv->animating;
+}
+
 gboolean
 panel_toplevel_get_is_hidden (PanelToplevel *toplevel)
 {
@@ -56,7 +56,6 @@ typedef struct _PanelToplevelPrivate PanelToplevelPrivate;
 struct _PanelToplevel {
     GtkWindow              window_instance;
     GSettings             *settings;
-    GSettings             *queued_settings;
     GSettings             *background_settings;
     PanelBackground        background;
     PanelToplevelPrivate  *priv;
@@ -135,6 +134,7 @@ gboolean             panel_toplevel_get_is_floating       (PanelToplevel       *
 
 gboolean             panel_toplevel_get_is_hidden          (PanelToplevel       *toplevel);
 PanelState           panel_toplevel_get_state              (PanelToplevel       *toplevel);
+gboolean             panel_toplevel_get_is_animating       (PanelToplevel       *toplevel);
 
 void                 panel_toplevel_hide                   (PanelToplevel       *toplevel,
                                                             gboolean             auto_hide,
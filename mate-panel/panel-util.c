@@ -1164,6 +1164,134 @@ panel_util_get_icon_for_uri (const char *text_uri)
 	return retval;
 }
 
+/* What panel_util_get_label_for_uri() and panel_util_get_icon_for_uri()
+ * read with blocking calls, for the URIs that are not file: nor
+ * x-caja-search: ones. They are queried in a thread: the mounts and the
+ * icon theme are only looked at from the main thread, by
+ * panel_util_uri_info_get_label() and panel_util_uri_info_get_icon(). */
+struct _PanelUriInfo {
+	char     *uri;
+	char     *description;
+	char     *root_display;
+	char     *display_name;
+	gboolean  is_root;
+	GIcon    *icon;
+};
+
+PanelUriInfo *
+panel_util_uri_info_query (const char *text_uri)
+{
+	PanelUriInfo *uri_info;
+	GFile        *file;
+	GFile        *root;
+	GFile        *icon_file;
+	GFileInfo    *info;
+
+	uri_info = g_slice_new0 (PanelUriInfo);
+	uri_info->uri = g_strdup (text_uri);
+
+	file = g_file_new_for_uri (text_uri);
+	root = panel_util_get_gfile_root (file);
+
+	uri_info->description = panel_util_get_file_description (file);
+	uri_info->root_display = panel_util_get_file_description (root);
+	if (!uri_info->root_display)
+		uri_info->root_display = panel_util_get_file_display_name (root, FALSE);
+	if (!uri_info->root_display)
+		/* can happen with URI schemes non supported by gvfs */
+		uri_info->root_display = g_file_get_uri_scheme (root);
+	uri_info->is_root = g_file_equal (file, root);
+	if (!uri_info->is_root)
+		uri_info->display_name = panel_util_get_file_display_name (file, TRUE);
+
+	/* gvfs doesn't give us a nice icon for subfolders of the trash, so
+	 * overriding */
+	icon_file = g_str_has_prefix (text_uri, "trash:") ? root : file;
+	info = g_file_query_info (icon_file, "standard::icon",
+				  G_FILE_QUERY_INFO_NONE, NULL, NULL);
+	if (info) {
+		GIcon *gicon = g_file_info_get_icon (info);
+
+		if (gicon)
+			uri_info->icon = g_object_ref (gicon);
+		g_object_unref (info);
+	}
+
+	g_object_unref (root);
+	g_object_unref (file);
+
+	return uri_info;
+}
+
+void
+panel_util_uri_info_free (PanelUriInfo *uri_info)
+{
+	g_free (uri_info->uri);
+	g_free (uri_info->description);
+	g_free (uri_info->root_display);
+	g_free (uri_info->display_name);
+	g_clear_object (&uri_info->icon);
+	g_slice_free (PanelUriInfo, uri_info);
+}
+
+/* Same as panel_util_get_label_for_uri(), from the main thread */
+char *
+panel_util_uri_info_get_label (PanelUriInfo *uri_info)
+{
+	GFile *file;
+	char  *label;
+
+	if (g_str_has_prefix (uri_info->uri, "file:") ||
+	    g_str_has_prefix (uri_info->uri, "x-caja-search:"))
+		return panel_util_get_label_for_uri (uri_info->uri);
+
+	file = g_file_new_for_uri (uri_info->uri);
+	label = panel_util_get_file_display_name_if_mount (file);
+	g_object_unref (file);
+	if (label)
+		return label;
+
+	if (uri_info->description)
+		return g_strdup (uri_info->description);
+
+	if (uri_info->is_root)
+		return g_strdup (uri_info->root_display);
+
+	/* Translators: the first string is the name of a gvfs method, and
+	 * the second string is a path. For example, "Trash: some-directory".
+	 * It means that the directory called "some-directory" is in the
+	 * trash. */
+	return g_strdup_printf (_("%1$s: %2$s"),
+				uri_info->root_display, uri_info->display_name);
+}
+
+/* Same as panel_util_get_icon_for_uri(), from the main thread */
+char *
+panel_util_uri_info_get_icon (PanelUriInfo *uri_info)
+{
+	GFile *file;
+	char  *retval;
+
+	if (g_str_has_prefix (uri_info->uri, "file:") ||
+	    g_str_has_prefix (uri_info->uri, "x-caja-search:"))
+		return panel_util_get_icon_for_uri (uri_info->uri);
+
+	/* gvfs doesn't give us a nice icon, so overriding */
+	if (g_str_has_prefix (uri_info->uri, "burn:"))
+		return g_strdup (PANEL_ICON_BURNER);
+
+	file = g_file_new_for_uri (uri_info->uri);
+	retval = panel_util_get_file_icon_name_if_mount (file);
+	g_object_unref (file);
+	if (retval)
+		return retval;
+
+	if (!uri_info->icon)
+		return NULL;
+
+	return panel_util_get_icon_name_from_g_icon (uri_info->icon);
+}
+
 static gboolean
 panel_util_query_tooltip_cb (GtkWidget  *widget,
 			     gint        x,
@@ -61,6 +61,13 @@ const char *panel_util_get_vfs_method_display_name (const char *method);
 char *panel_util_get_label_for_uri (const char *text_uri);
 char *panel_util_get_icon_for_uri (const char *text_uri);
 
+typedef struct _PanelUriInfo PanelUriInfo;
+
+PanelUriInfo *panel_util_uri_info_query     (const char   *text_uri);
+void          panel_util_uri_info_free      (PanelUriInfo *uri_info);
+char         *panel_util_uri_info_get_label (PanelUriInfo *uri_info);
+char         *panel_util_uri_info_get_icon  (PanelUriInfo *uri_info);
+
 void panel_util_set_tooltip_text (GtkWidget  *widget,
 				  const char *text);
 
@@ -17,10 +17,13 @@
 #include <gtk/gtkx.h> /* for GTK_IS_SOCKET */
 #endif
 
+
 #include <libpanel-util/panel-list.h>
+#include <libpanel-util/panel-perf.h>
 
 #include "applet.h"
 #include "panel-widget.h"
+#include "panel-arena.h"
 #include "button-widget.h"
 #include "panel.h"
 #include "panel-util.h"
@@ -79,6 +82,8 @@ static void panel_widget_cadd           (GtkContainer     *container,
 					 GtkWidget        *widget);
 static void panel_widget_cremove        (GtkContainer     *container,
 					 GtkWidget        *widget);
+static void panel_widget_invalidate_size (PanelWidget     *panel);
+static void panel_widget_queue_resize   (PanelWidget      *panel);
 static void panel_widget_dispose        (GObject *obj);
 static void panel_widget_finalize       (GObject          *obj);
 
@@ -95,10 +100,10 @@ static gboolean panel_widget_real_focus     (GtkWidget        *widget,
                                              GtkDirectionType  direction);
 
 static gboolean panel_widget_push_applet_right (PanelWidget *panel,
-						GList       *list,
+						int          i,
 						int          push);
 static gboolean panel_widget_push_applet_left  (PanelWidget *panel,
-						GList       *list,
+						int          i,
 						int          push);
 
 /************************
@@ -110,6 +115,103 @@ applet_data_compare (AppletData *ad1, AppletData *ad2)
 	return ad1->pos - ad2->pos;
 }
 
+#define APPLET_AT(panel, i) ((AppletData *) g_ptr_array_index ((panel)->applets, (i)))
+
+/* The layout runs along the major axis of the panel, its width when it
+ * is horizontal, and centers the applets on the minor one. These are the
+ * offsets of the fields of each axis in the requisitions and allocations,
+ * so that the layout loops run the same code for both orientations
+ * instead of testing it for each applet. */
+typedef struct {
+	glong req_major;	/* in GtkRequisition */
+	glong req_minor;
+	glong alloc_major;	/* in GtkAllocation */
+	glong alloc_minor;
+	glong alloc_major_pos;
+	glong alloc_minor_pos;
+} PanelWidgetAxes;
+
+static const PanelWidgetAxes panel_widget_axes [] = {
+	[GTK_ORIENTATION_HORIZONTAL] = {
+		G_STRUCT_OFFSET (GtkRequisition, width),
+		G_STRUCT_OFFSET (GtkRequisition, height),
+		G_STRUCT_OFFSET (GtkAllocation, width),
+		G_STRUCT_OFFSET (GtkAllocation, height),
+		G_STRUCT_OFFSET (GtkAllocation, x),
+		G_STRUCT_OFFSET (GtkAllocation, y)
+	},
+	[GTK_ORIENTATION_VERTICAL] = {
+		G_STRUCT_OFFSET (GtkRequisition, height),
+		G_STRUCT_OFFSET (GtkRequisition, width),
+		G_STRUCT_OFFSET (GtkAllocation, height),
+		G_STRUCT_OFFSET (GtkAllocation, width),
+		G_STRUCT_OFFSET (GtkAllocation, y),
+		G_STRUCT_OFFSET (GtkAllocation, x)
+	}
+};
+
+#define AXIS(structp, offset) G_STRUCT_MEMBER (int, (structp), (offset))
+
+/* The index of the first applet whose position is not before pos */
+static guint
+panel_widget_lower_bound (PanelWidget *panel,
+			  int          pos)
+{
+	AppletData key;
+
+	key.pos = pos;
+
+	return panel_g_ptr_array_lower_bound (panel->applets, &key,
+					      (GCompareFunc) applet_data_compare);
+}
+
+/* The applets are sorted by position, except while a move reorders them:
+ * fall back to a linear search then. */
+static int
+panel_widget_find_applet (PanelWidget      *panel,
+			  const AppletData *ad)
+{
+	guint i;
+
+	for (i = panel_widget_lower_bound (panel, ad->pos);
+	     i < panel->applets->len && APPLET_AT (panel, i)->pos == ad->pos;
+	     i++) {
+		if (APPLET_AT (panel, i) == ad)
+			return i;
+	}
+
+	for (i = 0; i < panel->applets->len; i++) {
+		if (APPLET_AT (panel, i) == ad)
+			return i;
+	}
+
+	return -1;
+}
+
+static void
+panel_widget_swap_applets (PanelWidget *panel,
+			   guint        i,
+			   guint        j)
+{
+	gpointer tmp;
+
+	tmp = panel->applets->pdata[i];
+	panel->applets->pdata[i] = panel->applets->pdata[j];
+	panel->applets->pdata[j] = tmp;
+}
+
+/* Moves the applet at index from so that it ends up at index to */
+static void
+panel_widget_move_applet_index (PanelWidget *panel,
+				guint        from,
+				guint        to)
+{
+	gpointer ad;
+
+	ad = g_ptr_array_remove_index (panel->applets, from);
+	g_ptr_array_insert (panel->applets, to, ad);
+}
+
 static void
 emit_applet_moved (PanelWidget *panel_widget,
 		   AppletData  *applet)
@@ -485,12 +587,12 @@ static void
 run_up_forbidden(PanelWidget *panel,
 		 void (*runfunc)(PanelWidget *,PanelWidget *))
 {
-	GList *list;
+	guint i;
 
 	g_return_if_fail(PANEL_IS_WIDGET(panel));
 
-	for(list = panel->applet_list;list!=NULL;list = g_list_next(list)) {
-		const AppletData *ad = list->data;
+	for(i = 0; i < panel->applets->len; i++) {
+		const AppletData *ad = APPLET_AT (panel, i);
 		PanelWidget *p =
 			g_object_get_data (G_OBJECT(ad->applet),
 					   MATE_PANEL_APPLET_ASSOC_PANEL_KEY);
@@ -593,7 +695,8 @@ panel_widget_cremove (GtkContainer *container, GtkWidget *widget)
 		(* GTK_CONTAINER_CLASS (panel_widget_parent_class)->remove) (container,
 								widget);
 	if (ad)
-		panel->applet_list = g_list_remove (panel->applet_list, ad);
+		g_ptr_array_remove (panel->applets, (gpointer) ad);
+	panel_widget_invalidate_size (panel);
 
 	g_signal_emit (G_OBJECT (container),
 		       panel_widget_signals[APPLET_REMOVED_SIGNAL],
@@ -601,26 +704,26 @@ panel_widget_cremove (GtkContainer *container, GtkWidget *widget)
 	g_object_unref (widget);
 }
 
-/*get the list item of the data on the position pos*/
-static GList *
-get_applet_list_pos (PanelWidget *panel,
+/*get the index of the applet on the position pos, or -1*/
+static int
+get_applet_index_at (PanelWidget *panel,
 		     int          pos)
 {
-	GList *l;
+	guint i;
 
-	g_return_val_if_fail (PANEL_IS_WIDGET (panel), NULL);
+	g_return_val_if_fail (PANEL_IS_WIDGET (panel), -1);
 
-	for (l = panel->applet_list; l; l = l->next) {
-		const AppletData *ad = l->data;
+	/* applets can overlap, and be out of order, while one is moved: the
+	 * first one covering pos is the one, so they are all looked at; this
+	 * is only used when adding an applet and when the panel is resized */
+	for (i = 0; i < panel->applets->len; i++) {
+		const AppletData *ad = APPLET_AT (panel, i);
 
-		if (ad->pos <= pos) {
-		       if (ad->pos + ad->cells > pos)
-			       return l;
-		} else
-			return NULL;
+		if (ad->pos <= pos && ad->pos + ad->cells > pos)
+			return (int) i;
 	}
 
-	return NULL;
+	return -1;
 }
 
 /*tells us if an applet is "stuck" on the right side*/
@@ -635,13 +738,13 @@ panel_widget_is_applet_stuck (PanelWidget *panel_widget,
 
 	applet = g_object_get_data (G_OBJECT (widget), MATE_PANEL_APPLET_DATA);
 	if (applet) {
-		GList *applet_list, *l;
-		int    end_pos = -1;
+		int i;
+		int end_pos = -1;
 
-		applet_list = g_list_find (panel_widget->applet_list, applet);
+		i = panel_widget_find_applet (panel_widget, applet);
 
-		for (l = applet_list; l; l = l->next) {
-			applet = l->data;
+		for (; i >= 0 && (guint) i < panel_widget->applets->len; i++) {
+			applet = APPLET_AT (panel_widget, i);
 
 			if (end_pos != -1 && applet->pos != end_pos)
 				break;
@@ -676,18 +779,41 @@ get_size_from_hints (AppletData *ad, int cells)
 	return MAX (cells, ad->min_cells);
 }
 
+/* the applet after the one at index i, or NULL */
+static AppletData *
+panel_widget_next_applet (PanelWidget *panel,
+			  int          i)
+{
+	if (i + 1 < (int) panel->applets->len)
+		return APPLET_AT (panel, i + 1);
+
+	return NULL;
+}
+
+/* the applet before the one at index i, or NULL */
+static AppletData *
+panel_widget_prev_applet (PanelWidget *panel,
+			  int          i)
+{
+	if (i > 0)
+		return APPLET_AT (panel, i - 1);
+
+	return NULL;
+}
+
+/* an index past the end of the applets means there is no next one */
 static void
 panel_widget_jump_applet_right (PanelWidget *panel,
-				GList       *list,
-				GList       *next,
+				int          i,
+				int          next,
 				int          pos)
 {
 	AppletData *ad;
 	const AppletData *nad = NULL;
 
-	ad = list->data;
-	if (next)
-		nad = next->data;
+	ad = APPLET_AT (panel, i);
+	if (next < (int) panel->applets->len)
+		nad = APPLET_AT (panel, next);
 
 	if (pos >= panel->size)
 		return;
@@ -697,73 +823,73 @@ panel_widget_jump_applet_right (PanelWidget *panel,
 
 	if (!panel_widget_push_applet_right (panel, next, pos + ad->min_cells - nad->constrained)) {
 		panel_widget_jump_applet_right (panel,
-						list,
-						next->next,
+						i,
+						next + 1,
 						nad->constrained + nad->min_cells);
 		return;
 	}
 
  jump_right:
 	ad->pos = ad->constrained = pos;
-	panel->applet_list = g_list_remove_link (panel->applet_list, list);
-	panel->applet_list = panel_g_list_insert_before (panel->applet_list, next, list);
-	gtk_widget_queue_resize (GTK_WIDGET (panel));
+	/* insert before next, which comes after the applet */
+	panel_widget_move_applet_index (panel, i, next - 1);
+	panel_widget_queue_resize (panel);
 	emit_applet_moved (panel, ad);
 }
 
 static void
 panel_widget_switch_applet_right (PanelWidget *panel,
-				  GList       *list)
+				  int          i)
 {
 	AppletData *ad;
-	AppletData *nad = NULL;
+	AppletData *nad;
 
-	g_assert (list != NULL);
+	g_assert (i >= 0);
 
-	ad = list->data;
+	ad = APPLET_AT (panel, i);
 	if (ad->constrained + ad->min_cells >= panel->size)
 		return;
 
-	if (list->next)
-		nad = list->next->data;
+	nad = panel_widget_next_applet (panel, i);
 
 	if (!nad || nad->constrained >= ad->constrained + ad->min_cells + MOVE_INCREMENT) {
 		ad->pos = ad->constrained += MOVE_INCREMENT;
-		gtk_widget_queue_resize (GTK_WIDGET (panel));
+		panel_widget_queue_resize (panel);
 		emit_applet_moved (panel, ad);
 		return;
 	}
 
 	if (nad->locked) {
 		panel_widget_jump_applet_right (panel,
-						list,
-						list->next->next,
+						i,
+						i + 2,
 						nad->constrained + nad->min_cells);
 		return;
 	}
 
 	nad->constrained = nad->pos = ad->constrained;
 	ad->constrained = ad->pos = ad->constrained + nad->min_cells;
-	panel->applet_list = panel_g_list_swap_next (panel->applet_list, list);
+	panel_widget_swap_applets (panel, i, i + 1);
 
-	gtk_widget_queue_resize (GTK_WIDGET (panel));
+	panel_widget_queue_resize (panel);
 
 	emit_applet_moved (panel, ad);
 	emit_applet_moved (panel, nad);
 }
 
+/* an index of -1 means there is no previous applet */
 static void
 panel_widget_jump_applet_left (PanelWidget *panel,
-			       GList       *list,
-			       GList       *prev,
+			       int          i,
+			       int          prev,
 			       int          pos)
 {
 	AppletData *ad;
 	const AppletData *pad = NULL;
 
-	ad = list->data;
-	if (prev)
-		pad = prev->data;
+	ad = APPLET_AT (panel, i);
+	if (prev >= 0)
+		pad = APPLET_AT (panel, prev);
 
 	if (pos < 0)
 		return;
@@ -773,54 +899,53 @@ panel_widget_jump_applet_left (PanelWidget *panel,
 
 	if (!panel_widget_push_applet_left (panel, prev, pad->constrained + pad->min_cells - pos)) {
 		panel_widget_jump_applet_left (panel,
-					       list,
-					       prev->prev,
+					       i,
+					       prev - 1,
 					       pad->constrained - ad->min_cells);
 		return;
 	}
 
  jump_left:
 	ad->pos = ad->constrained = pos;
-	panel->applet_list = g_list_remove_link (panel->applet_list, list);
-	panel->applet_list = panel_g_list_insert_after (panel->applet_list, prev, list);
-	gtk_widget_queue_resize (GTK_WIDGET (panel));
+	/* insert after prev, which comes before the applet */
+	panel_widget_move_applet_index (panel, i, prev + 1);
+	panel_widget_queue_resize (panel);
 	emit_applet_moved (panel, ad);
 }
 
 static void
 panel_widget_switch_applet_left (PanelWidget *panel,
-				 GList       *list)
+				 int          i)
 {
 	AppletData *ad;
-	AppletData *pad = NULL;
+	AppletData *pad;
 
-	ad = list->data;
+	ad = APPLET_AT (panel, i);
 	if (ad->constrained <= 0)
 		return;
 
-	if (list->prev)
-		pad = list->prev->data;
+	pad = panel_widget_prev_applet (panel, i);
 
 	if (!pad || pad->constrained + pad->min_cells <= ad->constrained - MOVE_INCREMENT) {
 		ad->pos = ad->constrained -= MOVE_INCREMENT;
-		gtk_widget_queue_resize (GTK_WIDGET (panel));
+		panel_widget_queue_resize (panel);
 		emit_applet_moved (panel, ad);
 		return;
 	}
 
 	if (pad->locked) {
 		panel_widget_jump_applet_left (panel,
-					       list,
-					       list->prev->prev,
+					       i,
+					       i - 2,
 					       pad->constrained - ad->min_cells);
 		return;
 	}
 
 	ad->constrained = ad->pos = pad->constrained;
 	pad->constrained = pad->pos = ad->constrained + ad->min_cells;
-	panel->applet_list = panel_g_list_swap_prev (panel->applet_list, list);
+	panel_widget_swap_applets (panel, i, i - 1);
 
-	gtk_widget_queue_resize (GTK_WIDGET (panel));
+	panel_widget_queue_resize (panel);
 
 	emit_applet_moved (panel, ad);
 	emit_applet_moved (panel, pad);
@@ -828,17 +953,16 @@ panel_widget_switch_applet_left (PanelWidget *panel,
 
 static gboolean
 panel_widget_try_push_right (PanelWidget *panel,
-			     GList       *list,
+			     int          i,
 			     int          push)
 {
 	AppletData *ad;
-	const AppletData *nad = NULL;
+	const AppletData *nad;
 
-	g_assert (list != NULL);
+	g_assert (i >= 0);
 
-	ad = list->data;
-	if (list->next)
-		nad = list->next->data;
+	ad = APPLET_AT (panel, i);
+	nad = panel_widget_next_applet (panel, i);
 
 	if (ad->locked)
 		return FALSE;
@@ -849,19 +973,19 @@ panel_widget_try_push_right (PanelWidget *panel,
 	if (!nad || nad->constrained >= ad->constrained + ad->min_cells + push)
 		return TRUE;
 
-	return panel_widget_try_push_right (panel, list->next, push);
+	return panel_widget_try_push_right (panel, i + 1, push);
 }
 
 static int
 panel_widget_get_right_jump_pos (PanelWidget *panel,
 				 AppletData  *ad,
-				 GList       *next,
+				 int          next,
 				 int          pos)
 {
 	const AppletData *nad = NULL;
 
-	if (next)
-		nad = next->data;
+	if (next < (int) panel->applets->len)
+		nad = APPLET_AT (panel, next);
 
 	if (!nad || nad->constrained >= pos + ad->min_cells)
 		return pos;
@@ -871,22 +995,21 @@ panel_widget_get_right_jump_pos (PanelWidget *panel,
 
 	return panel_widget_get_right_jump_pos (panel,
 						ad,
-						next->next,
+						next + 1,
 						nad->constrained + nad->min_cells);
 }
 
 static int
 panel_widget_get_right_switch_pos (PanelWidget *panel,
-				   GList       *list)
+				   int          i)
 {
 	AppletData *ad;
-	const AppletData *nad = NULL;
+	const AppletData *nad;
 
-	g_assert (list != NULL);
+	g_assert (i >= 0);
 
-	ad = list->data;
-	if (list->next)
-		nad = list->next->data;
+	ad = APPLET_AT (panel, i);
+	nad = panel_widget_next_applet (panel, i);
 
 	if (!nad || nad->constrained >= ad->constrained + ad->min_cells + MOVE_INCREMENT)
 		return ad->constrained + MOVE_INCREMENT;
@@ -894,7 +1017,7 @@ panel_widget_get_right_switch_pos (PanelWidget *panel,
 	if (nad->locked)
 		return panel_widget_get_right_jump_pos (panel,
 							ad,
-							list->next->next,
+							i + 2,
 							nad->constrained + nad->min_cells);
 
 	return nad->constrained + nad->min_cells - ad->cells;
@@ -902,17 +1025,16 @@ panel_widget_get_right_switch_pos (PanelWidget *panel,
 
 static gboolean
 panel_widget_try_push_left (PanelWidget *panel,
-			    GList       *list,
+			    int          i,
 			    int          push)
 {
 	AppletData *ad;
-	const AppletData *pad = NULL;
+	const AppletData *pad;
 
-	g_assert (list != NULL);
+	g_assert (i >= 0);
 
-	ad = list->data;
-	if (list->prev)
-		pad = list->prev->data;
+	ad = APPLET_AT (panel, i);
+	pad = panel_widget_prev_applet (panel, i);
 
 	if (ad->locked)
 		return FALSE;
@@ -923,19 +1045,19 @@ panel_widget_try_push_left (PanelWidget *panel,
 	if (!pad || pad->constrained + pad->min_cells <= ad->constrained - push)
 		return TRUE;
 
-	return panel_widget_try_push_left (panel, list->prev, push);
+	return panel_widget_try_push_left (panel, i - 1, push);
 }
 
 static int
 panel_widget_get_left_jump_pos (PanelWidget *panel,
 				AppletData  *ad,
-				GList       *prev,
+				int          prev,
 				int          pos)
 {
 	const AppletData *pad = NULL;
 
-	if (prev)
-		pad = prev->data;
+	if (prev >= 0)
+		pad = APPLET_AT (panel, prev);
 
 	if (!pad || pad->constrained + pad->min_cells <= pos)
 		return pos;
@@ -945,22 +1067,21 @@ panel_widget_get_left_jump_pos (PanelWidget *panel,
 
 	return panel_widget_get_left_jump_pos (panel,
 					       ad,
-					       prev->prev,
+					       prev - 1,
 					       pad->constrained - ad->min_cells);
 }
 
 static int
 panel_widget_get_left_switch_pos (PanelWidget *panel,
-				  GList       *list)
+				  int          i)
 {
 	AppletData *ad;
-	const AppletData *pad = NULL;
+	const AppletData *pad;
 
-	g_assert (list != NULL);
+	g_assert (i >= 0);
 
-	ad = list->data;
-	if (list->prev)
-		pad = list->prev->data;
+	ad = APPLET_AT (panel, i);
+	pad = panel_widget_prev_applet (panel, i);
 
 	if (!pad || pad->constrained + pad->min_cells <= ad->constrained - MOVE_INCREMENT)
 		return ad->constrained - MOVE_INCREMENT;
@@ -968,18 +1089,21 @@ panel_widget_get_left_switch_pos (PanelWidget *panel,
 	if (pad->locked)
 		return panel_widget_get_left_jump_pos (panel,
 						       ad,
-						       list->prev->prev,
+						       i - 2,
 						       pad->constrained - ad->min_cells);
 
 	return pad->constrained;
 }
 
+/* switching reorders the applets: the index of the moved one is looked up
+ * again after each step */
 static void
 panel_widget_switch_move (PanelWidget *panel,
 			  AppletData  *ad,
 			  int          moveby)
 {
-	GList *list;
+	const AppletData *other;
+	int    i;
 	int    finalpos;
 	int    pos;
 
@@ -989,50 +1113,43 @@ panel_widget_switch_move (PanelWidget *panel,
 	if (moveby == 0)
 		return;
 
-	list = g_list_find (panel->applet_list, ad);
-	g_return_if_fail (list != NULL);
+	i = panel_widget_find_applet (panel, ad);
+	g_return_if_fail (i >= 0);
 
 	finalpos = ad->constrained + moveby;
 
 	if (ad->constrained < finalpos) {
-		const AppletData *pad;
-
-		if (list->prev) {
-			pad = list->prev->data;
-			if (pad->expand_major)
-				gtk_widget_queue_resize (GTK_WIDGET (panel));
-		}
+		other = panel_widget_prev_applet (panel, i);
+		if (other && other->expand_major)
+			panel_widget_queue_resize (panel);
 
 		while (ad->constrained < finalpos) {
-			pos = panel_widget_get_right_switch_pos (panel, list);
+			pos = panel_widget_get_right_switch_pos (panel, i);
 
 			if (abs (pos - finalpos) >= abs (ad->constrained - finalpos) ||
 			    pos + ad->min_cells > panel->size)
 				break;
 
-			panel_widget_switch_applet_right (panel, list);
+			panel_widget_switch_applet_right (panel, i);
+			i = panel_widget_find_applet (panel, ad);
 		}
 
-		if (list->prev) {
-			pad = list->prev->data;
-			if (pad->expand_major)
-				gtk_widget_queue_resize (GTK_WIDGET (panel));
-		}
+		other = panel_widget_prev_applet (panel, i);
+		if (other && other->expand_major)
+			panel_widget_queue_resize (panel);
 	} else {
-
-		if (list->next) {
-			const AppletData *nad = list->next->data;
-			if (nad->expand_major)
-				gtk_widget_queue_resize (GTK_WIDGET (panel));
-		}
+		other = panel_widget_next_applet (panel, i);
+		if (other && other->expand_major)
+			panel_widget_queue_resize (panel);
 
 		while (ad->constrained > finalpos) {
-			pos = panel_widget_get_left_switch_pos (panel, list);
+			pos = panel_widget_get_left_switch_pos (panel, i);
 
 			if (abs (pos - finalpos) >= abs (ad->constrained - finalpos) || pos < 0)
 				break;
 
-			panel_widget_switch_applet_left (panel, list);
+			panel_widget_switch_applet_left (panel, i);
+			i = panel_widget_find_applet (panel, ad);
 		}
 
 	}
@@ -1040,38 +1157,35 @@ panel_widget_switch_move (PanelWidget *panel,
 
 static int
 panel_widget_push_applet_right (PanelWidget *panel,
-				GList       *list,
+				int          i,
 				int          push)
 {
 	AppletData *ad;
-	const AppletData *nad = NULL;
+	const AppletData *nad;
 
-	g_assert (list != NULL);
+	g_assert (i >= 0);
 
-	ad = list->data;
+	ad = APPLET_AT (panel, i);
 	if (ad->constrained + ad->min_cells + push >= panel->size)
 		return FALSE;
 
 	if (ad->locked)
 		return FALSE;
 
-	if (list->next)
-		nad = list->next->data;
+	nad = panel_widget_next_applet (panel, i);
 
 	if (!nad || nad->constrained >= ad->constrained + ad->min_cells + push) {
 		ad->pos = ad->constrained += push;
-		gtk_widget_queue_resize (GTK_WIDGET (panel));
+		panel_widget_queue_resize (panel);
 		emit_applet_moved (panel, ad);
 		return TRUE;
 	}
 
-	g_assert (list->next != NULL);
-
-	if (!panel_widget_push_applet_right (panel, list->next, push))
+	if (!panel_widget_push_applet_right (panel, i + 1, push))
 		return FALSE;
 
-	ad->pos = ad->constrained += push;;
-	gtk_widget_queue_resize (GTK_WIDGET (panel));
+	ad->pos = ad->constrained += push;
+	panel_widget_queue_resize (panel);
 	emit_applet_moved (panel, ad);
 
 	return TRUE;
@@ -1079,38 +1193,35 @@ panel_widget_push_applet_right (PanelWidget *panel,
 
 static int
 panel_widget_push_applet_left (PanelWidget *panel,
-			       GList       *list,
+			       int          i,
 			       int          push)
 {
 	AppletData *ad;
-	const AppletData *pad = NULL;
+	const AppletData *pad;
 
-	g_assert (list != NULL);
+	g_assert (i >= 0);
 
-	ad = list->data;
+	ad = APPLET_AT (panel, i);
 	if (ad->constrained - push < 0)
 		return FALSE;
 
 	if (ad->locked)
 		return FALSE;
 
-	if (list->prev)
-		pad = list->prev->data;
+	pad = panel_widget_prev_applet (panel, i);
 
 	if (!pad || pad->constrained + pad->min_cells <= ad->constrained - push) {
 		ad->pos = ad->constrained -= push;
-		gtk_widget_queue_resize (GTK_WIDGET (panel));
+		panel_widget_queue_resize (panel);
 		emit_applet_moved (panel, ad);
 		return TRUE;
 	}
 
-	g_assert (list->prev != NULL);
-
-	if (!panel_widget_push_applet_left (panel, list->prev, push))
+	if (!panel_widget_push_applet_left (panel, i - 1, push))
 		return FALSE;
 
 	ad->pos = ad->constrained -= push;
-	gtk_widget_queue_resize (GTK_WIDGET (panel));
+	panel_widget_queue_resize (panel);
 	emit_applet_moved (panel, ad);
 
 	return TRUE;
@@ -1122,7 +1233,7 @@ panel_widget_push_move (PanelWidget *panel,
 			int          moveby)
 {
 	int finalpos;
-	GList *list;
+	int i;
 
 	g_return_if_fail (ad != NULL);
 	g_return_if_fail (PANEL_IS_WIDGET (panel));
@@ -1130,24 +1241,24 @@ panel_widget_push_move (PanelWidget *panel,
 	if (moveby == 0)
 		return;
 
-	list = g_list_find (panel->applet_list, ad);
-	g_return_if_fail (list != NULL);
+	i = panel_widget_find_applet (panel, ad);
+	g_return_if_fail (i >= 0);
 
 	finalpos = ad->constrained + moveby;
 
 	if (ad->constrained < finalpos) {
+		const AppletData *pad;
+
 		while (ad->constrained < finalpos)
-			if (!panel_widget_push_applet_right (panel, list, 1))
+			if (!panel_widget_push_applet_right (panel, i, 1))
 				break;
 
-                if (list->prev) {
-			const AppletData *pad = list->prev->data;
-			if (pad->expand_major)
-				gtk_widget_queue_resize (GTK_WIDGET (panel));
-		}
+		pad = panel_widget_prev_applet (panel, i);
+		if (pad && pad->expand_major)
+			panel_widget_queue_resize (panel);
 	} else {
-                while (ad->constrained > finalpos)
-			if (!panel_widget_push_applet_left (panel, list, 1))
+		while (ad->constrained > finalpos)
+			if (!panel_widget_push_applet_left (panel, i, 1))
 				break;
 	}
 }
@@ -1159,7 +1270,7 @@ static void
 panel_widget_right_stick(PanelWidget *panel,int old_size)
 {
 	int i,pos;
-	GList *list,*prev;
+	int index, first;
 	AppletData *ad;
 
 	g_return_if_fail(PANEL_IS_WIDGET(panel));
@@ -1169,27 +1280,27 @@ panel_widget_right_stick(PanelWidget *panel,int old_size)
 	   panel->packed)
 	   	return;
 
-	list = get_applet_list_pos(panel,old_size-1);
+	index = get_applet_index_at(panel,old_size-1);
 
-	if(!list)
+	if(index < 0)
 		return;
 
 	pos = panel->size-1;
 
-	ad = list->data;
+	ad = APPLET_AT (panel, index);
 	do {
 		i = ad->pos;
 		ad->pos = ad->constrained = pos--;
 		ad->cells = 1;
-		prev = list;
-		list = g_list_previous(list);
-		if(!list)
+		first = index;
+		index--;
+		if(index < 0)
 			break;
-		ad = list->data;
+		ad = APPLET_AT (panel, index);
 	} while(ad->pos + ad->cells == i);
 
-	for (list = prev; list; list = list->next)
-		emit_applet_moved (panel, list->data);
+	for (index = first; (guint) index < panel->applets->len; index++)
+		emit_applet_moved (panel, APPLET_AT (panel, index));
 }
 
 static void
@@ -1202,71 +1313,52 @@ panel_widget_get_preferred_size(GtkWidget	     *widget,
 	GList *ad_with_hints;
 	gboolean dont_fill;
 	gint scale;
+	guint n;
+	const PanelWidgetAxes *axes;
 
 	g_return_if_fail(PANEL_IS_WIDGET(widget));
 	g_return_if_fail(minimum_size != NULL);
 
 	panel = PANEL_WIDGET(widget);
+	axes = &panel_widget_axes [panel->orient];
 
-	if (panel->orient == GTK_ORIENTATION_HORIZONTAL) {
-		minimum_size->width = 0;
-		minimum_size->height = panel->sz;
-	} else {
-		minimum_size->height = 0;
-		minimum_size->width = panel->sz;
-	}
-	natural_size->width = minimum_size->width;
-	natural_size->height = minimum_size->height;
+	AXIS (minimum_size, axes->req_major) = 0;
+	AXIS (minimum_size, axes->req_minor) = panel->sz;
+	*natural_size = *minimum_size;
 
 	ad_with_hints = NULL;
 	scale = gtk_widget_get_scale_factor(widget);
 
-	for (list = panel->applet_list; list!=NULL; list = g_list_next(list)) {
-		AppletData *ad = list->data;
+	for (n = 0; n < panel->applets->len; n++) {
+		AppletData *ad = APPLET_AT (panel, n);
 		GtkRequisition child_min_size;
 		GtkRequisition child_natural_size;
 		gtk_widget_get_preferred_size(ad->applet,
 		                              &child_min_size,
 		                              &child_natural_size);
 
-		if (panel->orient == GTK_ORIENTATION_HORIZONTAL) {
-			if (minimum_size->height < child_min_size.height &&
-			    !ad->size_constrained)
-				minimum_size->height = child_min_size.height;
-			if (natural_size->height < child_natural_size.height &&
-			    !ad->size_constrained)
-				natural_size->height = child_natural_size.height;
-
-			if (panel->packed && ad->expand_major && ad->size_hints)
-				ad_with_hints = g_list_prepend (ad_with_hints,
-								ad);
-
-			else if (panel->packed)
-			{
-				/* Just because everything is bigger when scaled up doesn't mean
-				 * that the applets need any less room when the panel is packed. */
-				minimum_size->width += child_min_size.width * scale;
-				natural_size->width += child_natural_size.width * scale;
-			}
-		} else {
-			if (minimum_size->width < child_min_size.width &&
-			    !ad->size_constrained)
-				minimum_size->width = child_min_size.width;
-			if (natural_size->width < child_min_size.width &&
-			    !ad->size_constrained)
-				natural_size->width = child_min_size.width;
-
-			if (panel->packed && ad->expand_major && ad->size_hints)
-				ad_with_hints = g_list_prepend (ad_with_hints,
-								ad);
-
-			else if (panel->packed)
-			{
-				/* Just because everything is bigger when scaled up doesn't mean
-				 * that the applets need any less room when the panel is packed. */
-				minimum_size->height += child_min_size.height * scale;
-				natural_size->height += child_natural_size.height * scale;
-			}
+		ad->requisition = child_min_size;
+		ad->requisition_valid = TRUE;
+
+		if (!ad->size_constrained) {
+			AXIS (minimum_size, axes->req_minor) =
+				MAX (AXIS (minimum_size, axes->req_minor),
+				     AXIS (&child_min_size, axes->req_minor));
+			AXIS (natural_size, axes->req_minor) =
+				MAX (AXIS (natural_size, axes->req_minor),
+				     AXIS (&child_natural_size, axes->req_minor));
+		}
+
+		if (panel->packed && ad->expand_major && ad->size_hints)
+			ad_with_hints = g_list_prepend (ad_with_hints,
+							ad);
+
+		else if (panel->packed)
+		{
+			/* Just because everything is bigger when scaled up doesn't mean
+			 * that the applets need any less room when the panel is packed. */
+			AXIS (minimum_size, axes->req_major) += AXIS (&child_min_size, axes->req_major) * scale;
+			AXIS (natural_size, axes->req_major) += AXIS (&child_natural_size, axes->req_major) * scale;
 		}
 	}
 
@@ -1301,25 +1393,73 @@ panel_widget_get_preferred_size(GtkWidget	     *widget,
 
 	dont_fill = panel->packed && panel->nb_applets_size_hints != 0;
 
-	if (panel->orient == GTK_ORIENTATION_HORIZONTAL) {
-		if (minimum_size->width < 12 && !dont_fill)
-			minimum_size->width = 12;
-		if (minimum_size->height < 12)
-			minimum_size->height = 12;
-		if (natural_size->width < 12 && !dont_fill)
-			natural_size->width = 12;
-		if (natural_size->height < 12)
-			natural_size->height = 12;
-	} else {
-		if (minimum_size->width < 12)
-			minimum_size->width = 12;
-		if (minimum_size->height < 12 && !dont_fill)
-			minimum_size->height = 12;
-		if (natural_size->width < 12)
-			natural_size->width = 12;
-		if (natural_size->height < 12 && !dont_fill)
-			natural_size->height = 12;
+	if (!dont_fill) {
+		AXIS (minimum_size, axes->req_major) = MAX (AXIS (minimum_size, axes->req_major), 12);
+		AXIS (natural_size, axes->req_major) = MAX (AXIS (natural_size, axes->req_major), 12);
 	}
+	AXIS (minimum_size, axes->req_minor) = MAX (AXIS (minimum_size, axes->req_minor), 12);
+	AXIS (natural_size, axes->req_minor) = MAX (AXIS (natural_size, axes->req_minor), 12);
+}
+
+static gint64
+panel_widget_get_frame_counter (PanelWidget *panel)
+{
+	GdkFrameClock *frame_clock;
+
+	frame_clock = gtk_widget_get_frame_clock (GTK_WIDGET (panel));
+	if (!frame_clock)
+		return -1;
+
+	return gdk_frame_clock_get_frame_counter (frame_clock);
+}
+
+static void
+panel_widget_invalidate_size (PanelWidget *panel)
+{
+	panel->size_cached = FALSE;
+}
+
+/* Whatever changes the size of the panel goes through here, so that the
+ * next request does not get the cached size */
+static void
+panel_widget_queue_resize (PanelWidget *panel)
+{
+	panel_widget_invalidate_size (panel);
+	gtk_widget_queue_resize (GTK_WIDGET (panel));
+}
+
+/* GTK+ only asks for our size after something queued a resize, but it
+ * then asks for the width and for the height separately: walk the applets
+ * for the first one, and reuse the result for the other one if it comes
+ * in the same frame. The same orientation asked for again means that GTK+
+ * dropped its own cache since, a child having queued a resize. */
+static void
+panel_widget_get_cached_preferred_size (GtkWidget      *widget,
+					gboolean        for_width,
+					GtkRequisition *minimum_size,
+					GtkRequisition *natural_size)
+{
+	PanelWidget *panel = PANEL_WIDGET (widget);
+	gint64       frame;
+
+	frame = panel_widget_get_frame_counter (panel);
+
+	if (panel->size_cached && frame != -1 &&
+	    panel->cached_size_frame == frame &&
+	    panel->size_cached_for_width != (for_width != FALSE)) {
+		*minimum_size = panel->cached_minimum_size;
+		*natural_size = panel->cached_natural_size;
+		panel->size_cached = FALSE;
+		return;
+	}
+
+	panel_widget_get_preferred_size (widget, minimum_size, natural_size);
+
+	panel->cached_minimum_size = *minimum_size;
+	panel->cached_natural_size = *natural_size;
+	panel->cached_size_frame = frame;
+	panel->size_cached_for_width = (for_width != FALSE);
+	panel->size_cached = TRUE;
 }
 
 static void
@@ -1328,7 +1468,7 @@ panel_widget_get_preferred_width(GtkWidget *widget,
 				 gint	   *natural_width)
 {
 	GtkRequisition req_min, req_natural;
-	panel_widget_get_preferred_size(widget, &req_min, &req_natural);
+	panel_widget_get_cached_preferred_size(widget, TRUE, &req_min, &req_natural);
 	*minimum_width = req_min.width;
 	*natural_width = req_natural.width;
 }
@@ -1339,7 +1479,7 @@ panel_widget_get_preferred_height(GtkWidget *widget,
 				  gint	    *natural_height)
 {
 	GtkRequisition req_min, req_natural;
-	panel_widget_get_preferred_size(widget, &req_min, &req_natural);
+	panel_widget_get_cached_preferred_size(widget, FALSE, &req_min, &req_natural);
 	*minimum_height = req_min.height;
 	*natural_height = req_natural.height;
 }
@@ -1347,30 +1487,76 @@ panel_widget_get_preferred_height(GtkWidget *widget,
 static void
 queue_resize_on_all_applets(PanelWidget *panel)
 {
-	GList *li;
-	for(li = panel->applet_list; li != NULL;
-	    li = g_list_next(li)) {
-		const AppletData *ad = li->data;
+	guint n;
+	panel_widget_invalidate_size (panel);
+	for(n = 0; n < panel->applets->len; n++) {
+		const AppletData *ad = APPLET_AT (panel, n);
 		gtk_widget_queue_resize (ad->applet);
 	}
 }
 
+/* The minimum sizes are queried for every applet in size_request(), which
+ * always runs after one of them queued a resize: reuse them instead of
+ * asking each applet again, twice, while allocating. */
+static void
+panel_widget_get_applet_requisition (AppletData     *ad,
+				     GtkRequisition *requisition)
+{
+	if (!ad->requisition_valid) {
+		gtk_widget_get_preferred_size (ad->applet, &ad->requisition, NULL);
+		ad->requisition_valid = TRUE;
+	}
+
+	*requisition = ad->requisition;
+}
+
+/* Only allocate the applets whose allocation changed: when a single applet
+ * changes size, the ones before it keep their place. GTK+ still allocates
+ * the applets that queued a resize with their current allocation. Returns
+ * whether the allocation changed. */
+static gboolean
+panel_widget_allocate_applet (AppletData    *ad,
+			      GtkAllocation *challoc)
+{
+	GtkAllocation old_allocation;
+
+	gtk_widget_get_allocation (ad->applet, &old_allocation);
+
+	if (old_allocation.x == challoc->x &&
+	    old_allocation.y == challoc->y &&
+	    old_allocation.width == challoc->width &&
+	    old_allocation.height == challoc->height)
+		return FALSE;
+
+	gtk_widget_size_allocate (ad->applet, challoc);
+
+	return TRUE;
+}
+
 static void
 panel_widget_size_allocate(GtkWidget *widget, GtkAllocation *allocation)
 {
 	PanelWidget *panel;
-	GList *list;
+	guint n;
 	int i;
 	int old_size;
-	gboolean ltr;
+	int minor_size;
+	gboolean mirror;
+	gboolean changed = FALSE;
+	const PanelWidgetAxes *axes;
 
 	g_return_if_fail(PANEL_IS_WIDGET(widget));
 	g_return_if_fail(allocation!=NULL);
 
 	panel = PANEL_WIDGET(widget);
+	axes = &panel_widget_axes [panel->orient];
+
+	panel_perf_count ("layout-passes", 1);
 
 	old_size = panel->size;
-	ltr = gtk_widget_get_direction (widget) == GTK_TEXT_DIR_LTR;
+	/* only horizontal panels are laid out from the right in RTL */
+	mirror = panel->orient == GTK_ORIENTATION_HORIZONTAL &&
+		 gtk_widget_get_direction (widget) != GTK_TEXT_DIR_LTR;
 
 	gtk_widget_set_allocation (widget, allocation);
 	if (gtk_widget_get_realized (widget))
@@ -1380,10 +1566,8 @@ panel_widget_size_allocate(GtkWidget *widget, GtkAllocation *allocation)
 					allocation->width,
 					allocation->height);
 
-	if(panel->orient == GTK_ORIENTATION_HORIZONTAL)
-		panel->size = allocation->width;
-	else
-		panel->size = allocation->height;
+	panel->size = AXIS (allocation, axes->alloc_major);
+	minor_size = AXIS (allocation, axes->alloc_minor);
 	if(old_size<panel->size)
 		panel_widget_right_stick(panel,old_size);
 
@@ -1393,47 +1577,33 @@ panel_widget_size_allocate(GtkWidget *widget, GtkAllocation *allocation)
 		int applet_using_hint_index = 0;
 
 		i = 0;
-		for(list = panel->applet_list;
-		    list!=NULL;
-		    list = g_list_next(list)) {
-			AppletData *ad = list->data;
+		for(n = 0; n < panel->applets->len; n++) {
+			AppletData *ad = APPLET_AT (panel, n);
 			GtkAllocation challoc;
 			GtkRequisition chreq;
-			gtk_widget_get_preferred_size (ad->applet, &chreq, NULL);
+			panel_widget_get_applet_requisition (ad, &chreq);
 
 			ad->constrained = i;
 
-			challoc.width = chreq.width;
-			challoc.height = chreq.height;
-			if(panel->orient == GTK_ORIENTATION_HORIZONTAL) {
-				if (ad->expand_minor)
-					challoc.height = allocation->height;
+			AXIS (&challoc, axes->alloc_major) = AXIS (&chreq, axes->req_major);
+			AXIS (&challoc, axes->alloc_minor) = AXIS (&chreq, axes->req_minor);
+			if (ad->expand_minor)
+				AXIS (&challoc, axes->alloc_minor) = minor_size;
 
-				if (ad->expand_major && ad->size_hints) {
-					int width = panel->applets_using_hint[applet_using_hint_index].size;
-					applet_using_hint_index++;
-					challoc.width = MIN (width, allocation->width - i);
-				}
-
-				ad->cells = challoc.width;
-				challoc.x = ltr ? ad->constrained : panel->size - ad->constrained - challoc.width;
-				challoc.y = allocation->height / 2 - challoc.height / 2;
-			} else {
-				if (ad->expand_minor)
-					challoc.width = allocation->width;
-
-				if (ad->expand_major && ad->size_hints) {
-					int height = panel->applets_using_hint[applet_using_hint_index].size;
-					applet_using_hint_index++;
-					challoc.height = MIN (height, allocation->height - i);
-				}
-
-				ad->cells = challoc.height;
-				challoc.x = allocation->width / 2 - challoc.width / 2;
-				challoc.y = ad->constrained;
+			if (ad->expand_major && ad->size_hints) {
+				int size = panel->applets_using_hint[applet_using_hint_index].size;
+				applet_using_hint_index++;
+				AXIS (&challoc, axes->alloc_major) = MIN (size, panel->size - i);
 			}
+
+			ad->cells = AXIS (&challoc, axes->alloc_major);
+			AXIS (&challoc, axes->alloc_major_pos) =
+				mirror ? panel->size - ad->constrained - ad->cells : ad->constrained;
+			AXIS (&challoc, axes->alloc_minor_pos) =
+				minor_size / 2 - AXIS (&challoc, axes->alloc_minor) / 2;
 			ad->min_cells  = ad->cells;
-			gtk_widget_size_allocate(ad->applet,&challoc);
+			if (panel_widget_allocate_applet (ad, &challoc))
+				changed = TRUE;
 			i += ad->cells;
 		}
 
@@ -1444,19 +1614,13 @@ panel_widget_size_allocate(GtkWidget *widget, GtkAllocation *allocation)
 
 		/* First make sure there's enough room on the left */
 		i = 0;
-		for (list = panel->applet_list;
-		     list != NULL;
-		     list = g_list_next (list)) {
-			AppletData *ad = list->data;
+		for (n = 0; n < panel->applets->len; n++) {
+			AppletData *ad = APPLET_AT (panel, n);
 			GtkRequisition chreq;
-			gtk_widget_get_preferred_size (ad->applet, &chreq, NULL);
+			panel_widget_get_applet_requisition (ad, &chreq);
 
 			if (!ad->expand_major || !ad->size_hints) {
-				if(panel->orient == GTK_ORIENTATION_HORIZONTAL)
-					ad->cells = chreq.width;
-				else
-					ad->cells = chreq.height;
-
+				ad->cells = AXIS (&chreq, axes->req_major);
 				ad->min_cells = ad->cells;
 			} else {
 				ad->cells = ad->size_hints [ad->size_hints_len - 1];
@@ -1472,10 +1636,8 @@ panel_widget_size_allocate(GtkWidget *widget, GtkAllocation *allocation)
 
 		/* Now expand from the right */
 		i = panel->size;
-		for(list = g_list_last(panel->applet_list);
-		    list!=NULL;
-		    list = g_list_previous(list)) {
-			AppletData *ad = list->data;
+		for(n = panel->applets->len; n > 0; n--) {
+			AppletData *ad = APPLET_AT (panel, n - 1);
 
 			if (ad->constrained + ad->min_cells > i)
 				ad->constrained = MAX (i - ad->min_cells, 0);
@@ -1499,10 +1661,8 @@ panel_widget_size_allocate(GtkWidget *widget, GtkAllocation *allocation)
 		 * right if there is no free space in the middle */
 		if(i < 0) {
 			i = 0;
-			for(list = panel->applet_list;
-			    list!=NULL;
-			    list = g_list_next(list)) {
-				AppletData *ad = list->data;
+			for(n = 0; n < panel->applets->len; n++) {
+				AppletData *ad = APPLET_AT (panel, n);
 
 				if (ad->constrained < i)
 					ad->constrained = i;
@@ -1511,40 +1671,32 @@ panel_widget_size_allocate(GtkWidget *widget, GtkAllocation *allocation)
 			}
 		}
 
-		for(list = panel->applet_list;
-		    list!=NULL;
-		    list = g_list_next(list)) {
-			AppletData *ad = list->data;
+		for(n = 0; n < panel->applets->len; n++) {
+			AppletData *ad = APPLET_AT (panel, n);
 			GtkAllocation challoc;
 			GtkRequisition chreq;
-			gtk_widget_get_preferred_size (ad->applet, &chreq, NULL);
-
-			challoc.width = chreq.width;
-			challoc.height = chreq.height;
-			if(panel->orient == GTK_ORIENTATION_HORIZONTAL) {
-				challoc.width = ad->cells;
-				if (ad->expand_minor) {
-					challoc.height = allocation->height;
-				}
-				challoc.x = ltr ? ad->constrained : panel->size - ad->constrained - challoc.width;
-				challoc.y = allocation->height / 2 - challoc.height / 2;
-			} else {
-				challoc.height = ad->cells;
-				if (ad->expand_minor) {
-					challoc.width = allocation->width;
-				}
-				challoc.x = allocation->width / 2 - challoc.width / 2;
-				challoc.y = ad->constrained;
-			}
+			panel_widget_get_applet_requisition (ad, &chreq);
+
+			AXIS (&challoc, axes->alloc_major) = ad->cells;
+			AXIS (&challoc, axes->alloc_minor) =
+				ad->expand_minor ? minor_size : AXIS (&chreq, axes->req_minor);
+			AXIS (&challoc, axes->alloc_major_pos) =
+				mirror ? panel->size - ad->constrained - ad->cells : ad->constrained;
+			AXIS (&challoc, axes->alloc_minor_pos) =
+				minor_size / 2 - AXIS (&challoc, axes->alloc_minor) / 2;
 
 			challoc.width = MAX(challoc.width, 1);
 			challoc.height = MAX(challoc.height, 1);
 
-			gtk_widget_size_allocate(ad->applet,&challoc);
+			if (panel_widget_allocate_applet (ad, &challoc))
+				changed = TRUE;
 		}
 	}
 
-	gtk_widget_queue_resize(widget);
+	/* the layout of expanded applets may depend on their neighbours:
+	 * run another pass, until nothing moves anymore */
+	if (changed || old_size != panel->size)
+		panel_widget_queue_resize (panel);
 }
 
 gboolean
@@ -1591,6 +1743,7 @@ panel_widget_finalize (GObject *obj)
 
 	g_clear_pointer (&panel->applets_hints, g_free);
 	g_clear_pointer (&panel->applets_using_hint, g_free);
+	g_ptr_array_free (panel->applets, TRUE);
 
 	G_OBJECT_CLASS (panel_widget_parent_class)->finalize (obj);
 }
@@ -1659,7 +1812,7 @@ panel_widget_init (PanelWidget *panel)
 	panel->packed        = FALSE;
 	panel->orient        = GTK_ORIENTATION_HORIZONTAL;
 	panel->size          = 0;
-	panel->applet_list   = NULL;
+	panel->applets       = g_ptr_array_new ();
 	panel->master_widget = NULL;
 	panel->drop_widget   = widget;
 	panel->open_dialogs  = NULL;
@@ -1696,10 +1849,34 @@ panel_widget_new (PanelToplevel  *toplevel,
 	return GTK_WIDGET (panel);
 }
 
-static guint moving_timeout = 0;
+/* applet drags are handled on the frame clock of the panel */
+static guint moving_tick = 0;
+static GtkWidget *moving_tick_widget = NULL;
 static gboolean been_moved = FALSE;
 static gboolean repeat_if_outside = FALSE;
 
+/* a tick removed from its own callback, when the drag goes to another
+ * panel, is only destroyed once the new one is installed */
+static void
+moving_tick_destroyed (gpointer data)
+{
+	if (moving_tick_widget != data)
+		return;
+
+	moving_tick = 0;
+	moving_tick_widget = NULL;
+}
+
+static void
+panel_widget_stop_moving (void)
+{
+	if (moving_tick != 0)
+		gtk_widget_remove_tick_callback (moving_tick_widget, moving_tick);
+	moving_tick = 0;
+	moving_tick_widget = NULL;
+	been_moved = FALSE;
+}
+
 static gboolean
 panel_widget_applet_drag_start_no_grab (PanelWidget *panel,
 					GtkWidget *applet,
@@ -1724,11 +1901,7 @@ panel_widget_applet_drag_start_no_grab (PanelWidget *panel,
 	    ! mate_panel_applet_can_freely_move (info))
 		return FALSE;
 
-	if (moving_timeout != 0) {
-		g_source_remove (moving_timeout);
-		moving_timeout = 0;
-		been_moved = FALSE;
-	}
+	panel_widget_stop_moving ();
 
 #ifdef PANEL_WIDGET_DEBUG
 	g_message("Starting drag on a %s at %p\n",
@@ -1762,11 +1935,7 @@ panel_widget_applet_drag_end_no_grab (PanelWidget *panel)
 	mate_panel_applet_in_drag = FALSE;
 
 	remove_all_move_bindings (panel);
-	if (moving_timeout != 0) {
-		g_source_remove (moving_timeout);
-		moving_timeout = 0;
-		been_moved = FALSE;
-	}
+	panel_widget_stop_moving ();
 }
 
 void
@@ -1870,29 +2039,27 @@ panel_widget_get_moveby (PanelWidget *panel, int pos, int offset)
 	return panel_widget_get_cursorloc (panel) - offset - pos;
 }
 
-static GList *
-walk_up_to (int pos, GList *list)
+static int
+walk_up_to (PanelWidget *panel, int pos, int i)
 {
 	const AppletData *ad;
 
-	g_return_val_if_fail (list != NULL, NULL);
+	g_return_val_if_fail (i >= 0 && (guint) i < panel->applets->len, 0);
 
-	ad = list->data;
+	ad = APPLET_AT (panel, i);
 
 	if (ad->constrained <= pos &&
 	    ad->constrained + ad->cells > pos)
-		return list;
-	while (list->next != NULL &&
+		return i;
+	while ((guint) i + 1 < panel->applets->len &&
 	       ad->constrained + ad->cells <= pos) {
-		list = list->next;
-		ad = list->data;
+		ad = APPLET_AT (panel, ++i);
 	}
-	while (list->prev != NULL &&
+	while (i > 0 &&
 	       ad->constrained > pos) {
-		list = list->prev;
-		ad = list->data;
+		ad = APPLET_AT (panel, --i);
 	}
-	return list;
+	return i;
 }
 
 static GtkWidget *
@@ -1906,15 +2073,19 @@ is_in_applet (int pos, const AppletData *ad)
 	return NULL;
 }
 
+/* The applets are sorted by position: instead of testing each cell of the
+ * panel, walk the gaps between the other applets, keeping the first one at
+ * or after the right start that is large enough and the last one before
+ * the left start. */
 static int
 panel_widget_get_free_spot (PanelWidget *panel,
 			    AppletData  *ad,
 			    int          place)
 {
-	int i, e;
-	int start;
+	int right_start, left_end;
 	int right = -1, left = -1;
-	GList *list;
+	int gap_start;
+	guint n;
 
 	g_return_val_if_fail (PANEL_IS_WIDGET (panel), -1);
 	g_return_val_if_fail (ad != NULL, -1);
@@ -1922,54 +2093,50 @@ panel_widget_get_free_spot (PanelWidget *panel,
 	if (ad->constrained >= panel->size)
 		return -1;
 
-	if (panel->applet_list == NULL) {
+	if (panel->applets->len == 0) {
 		if (place + ad->min_cells > panel->size)
 			return panel->size-ad->min_cells;
 		else
 			return place;
 	}
 
-	list = panel->applet_list;
-
-	start = place - ad->drag_off;
-	if (start < 0)
-		start = 0;
-	for (e = 0, i = start; i < panel->size; i++) {
-		const GtkWidget *applet;
-		list = walk_up_to (i, list);
-		applet = is_in_applet (i, list->data);
-		if (applet == NULL ||
-		    applet == ad->applet) {
-			e++;
-			if (e >= ad->min_cells) {
-				right = i - e + 1;
-				break;
-			}
-		} else {
-			e = 0;
-		}
-	}
+	right_start = MAX (place - ad->drag_off, 0);
+	left_end = MIN (place + ad->drag_off, panel->size - 1) + 1;
 
-	start = place + ad->drag_off;
-	if (start >= panel->size)
-		start = panel->size - 1;
-	for (e = 0, i = start; i >= 0; i--) {
-		const GtkWidget *applet;
-		list = walk_up_to (i, list);
-		applet = is_in_applet (i, list->data);
-		if (applet == NULL ||
-		    applet == ad->applet) {
-			e++;
-			if (e >= ad->min_cells) {
-				left = i;
-				break;
-			}
-		} else {
-			e=0;
+	gap_start = 0;
+	for (n = 0; ; n++) {
+		const AppletData *other;
+		int gap_end;
+		int spot;
+
+		other = n < panel->applets->len ? APPLET_AT (panel, n) : NULL;
+
+		if (other == ad)
+			continue;
+
+		gap_end = other ? MIN (other->constrained, panel->size) : panel->size;
+
+		if (right == -1) {
+			spot = MAX (gap_start, right_start);
+			if (spot + ad->min_cells <= gap_end)
+				right = spot;
 		}
+
+		spot = MIN (gap_end, left_end) - ad->min_cells;
+		if (spot >= gap_start)
+			left = spot;
+
+		if (!other)
+			break;
+
+		gap_start = MAX (gap_start, other->constrained + other->cells);
+
+		if (right != -1 && gap_start >= left_end)
+			break;
 	}
 
-	start = place - ad->drag_off;
+	/* compare with where the drag started, as before */
+	right_start = place - ad->drag_off;
 
 	if (left == -1) {
 		if (right == -1)
@@ -1980,7 +2147,7 @@ panel_widget_get_free_spot (PanelWidget *panel,
 		if (right == -1)
 			return left;
 		else
-			return abs (left - start) > abs (right - start) ?
+			return abs (left - right_start) > abs (right - right_start) ?
 				right : left;
 	}
 }
@@ -1990,6 +2157,8 @@ panel_widget_nice_move (PanelWidget *panel,
 			AppletData  *ad,
 			int          pos)
 {
+	int i;
+
 	g_return_if_fail (PANEL_IS_WIDGET (panel));
 	g_return_if_fail (ad != NULL);
 
@@ -1997,13 +2166,15 @@ panel_widget_nice_move (PanelWidget *panel,
 	if (pos < 0 || pos == ad->pos)
 		return;
 
+	i = panel_widget_find_applet (panel, ad);
 	ad->pos = ad->constrained = pos;
 
-	panel->applet_list =
-		panel_g_list_resort_item (panel->applet_list, ad,
-					  (GCompareFunc)applet_data_compare);
+	/* resort the applet */
+	if (i >= 0)
+		panel_g_ptr_array_resort_index (panel->applets, i,
+						(GCompareFunc) applet_data_compare);
 
-	gtk_widget_queue_resize (GTK_WIDGET (panel));
+	panel_widget_queue_resize (panel);
 
 	emit_applet_moved (panel, ad);
 }
@@ -2106,18 +2277,18 @@ panel_widget_applet_move_to_cursor (PanelWidget *panel)
 	}
 }
 
-static int
-move_timeout_handler(gpointer data)
+static gboolean
+move_tick_handler (GtkWidget     *widget,
+		   GdkFrameClock *frame_clock,
+		   gpointer       data)
 {
-	PanelWidget *panel = data;
-
-	g_return_val_if_fail(PANEL_IS_WIDGET(data),FALSE);
+	PanelWidget *panel = PANEL_WIDGET (widget);
 
 	if(been_moved &&
 	   panel->currently_dragged_applet) {
-		panel_widget_applet_move_to_cursor(panel);
 		been_moved = FALSE;
-		return TRUE;
+		panel_widget_applet_move_to_cursor(panel);
+		return G_SOURCE_CONTINUE;
 	}
 	been_moved = FALSE;
 
@@ -2138,12 +2309,10 @@ move_timeout_handler(gpointer data)
 		 * kept inside the timeout until we hit the damn widget
 		 * or the drag ends */
 		if(!(x>=0 && x<=w && y>=0 && y<=h))
-			return TRUE;
+			return G_SOURCE_CONTINUE;
 	}
 
-	moving_timeout = 0;
-
-	return FALSE;
+	return G_SOURCE_REMOVE;
 }
 
 static void
@@ -2152,11 +2321,19 @@ schedule_try_move(PanelWidget *panel, gboolean repeater)
 	if (!panel->currently_dragged_applet)
 		return;
 	repeat_if_outside = repeater;
-	if(moving_timeout == 0) {
+	if(moving_tick == 0) {
 		been_moved = FALSE;
 		panel_widget_applet_move_to_cursor(panel);
-		moving_timeout =
-			g_timeout_add (50, move_timeout_handler, panel);
+		/* moving the cursor to another panel restarts the drag
+		 * there, and it schedules its own move */
+		if (moving_tick == 0 && panel->currently_dragged_applet) {
+			moving_tick_widget = GTK_WIDGET (panel);
+			moving_tick =
+				gtk_widget_add_tick_callback (moving_tick_widget,
+							      move_tick_handler,
+							      moving_tick_widget,
+							      moving_tick_destroyed);
+		}
 	} else
 		been_moved = TRUE;
 }
@@ -2339,12 +2516,12 @@ panel_widget_applet_destroy (GtkWidget *applet, gpointer data)
 		if (panel->currently_dragged_applet == ad)
 			panel_widget_applet_drag_end (panel);
 
-		panel->applet_list = g_list_remove (panel->applet_list,ad);
+		g_ptr_array_remove (panel->applets, ad);
 	}
 
 	g_free (ad->size_hints);
 
-	g_free (ad);
+	panel_arena_free (ad);
 }
 
 static void
@@ -2388,7 +2565,7 @@ panel_widget_find_empty_pos(PanelWidget *panel, int pos)
 {
 	int i;
 	int right=-1,left=-1;
-	GList *list;
+	int index;
 
 	g_return_val_if_fail(PANEL_IS_WIDGET(panel),-1);
 
@@ -2398,22 +2575,22 @@ panel_widget_find_empty_pos(PanelWidget *panel, int pos)
 	if (pos <= 0)
 		pos = 0;
 
-	if(!panel->applet_list)
+	if(panel->applets->len == 0)
 		return pos;
 
-	list = panel->applet_list;
+	index = 0;
 
 	for (i = pos; i < panel->size; i++) {
-		list = walk_up_to (i, list);
-		if ( ! is_in_applet (i, list->data)) {
+		index = walk_up_to (panel, i, index);
+		if ( ! is_in_applet (i, APPLET_AT (panel, index))) {
 			right = i;
 			break;
 		}
 	}
 
 	for(i = pos; i >= 0; i--) {
-		list = walk_up_to (i, list);
-		if ( ! is_in_applet (i, list->data)) {
+		index = walk_up_to (panel, i, index);
+		if ( ! is_in_applet (i, APPLET_AT (panel, index))) {
 			left = i;
 			break;
 		}
@@ -2461,7 +2638,7 @@ panel_widget_add (PanelWidget *panel,
 
 	if (!insert_at_pos || pos < 0) {
 		if (panel->packed) {
-			if (get_applet_list_pos (panel, pos))
+			if (get_applet_index_at (panel, pos) >= 0)
 				/*this is a slight hack so that this applet
 				  is inserted AFTER an applet with this pos
 				  number*/
@@ -2470,7 +2647,7 @@ panel_widget_add (PanelWidget *panel,
 			int newpos = panel_widget_find_empty_pos (panel, pos);
 			if (newpos >= 0)
 				pos = newpos;
-			else if (get_applet_list_pos (panel, pos))
+			else if (get_applet_index_at (panel, pos) >= 0)
 				/*this is a slight hack so that this applet
 				  is inserted AFTER an applet with this pos
 				  number*/
@@ -2481,7 +2658,7 @@ panel_widget_add (PanelWidget *panel,
 	if(pos==-1) return -1;
 
 	if (ad == NULL) {
-		ad = g_new (AppletData, 1);
+		ad = panel_arena_new0 (panel_arena_get (panel->toplevel), AppletData);
 		ad->applet = applet;
 		ad->cells = 1;
 		ad->min_cells = 1;
@@ -2493,6 +2670,7 @@ panel_widget_add (PanelWidget *panel,
 		ad->expand_minor = FALSE;
 		ad->locked = (locked != FALSE);
 		ad->size_hints = NULL;
+		ad->requisition_valid = FALSE;
 		g_object_set_data (G_OBJECT (applet),
 				   MATE_PANEL_APPLET_DATA, ad);
 
@@ -2500,9 +2678,9 @@ panel_widget_add (PanelWidget *panel,
 		bind_top_applet_events (applet);
 	}
 
-	panel->applet_list =
-		g_list_insert_sorted(panel->applet_list,ad,
-				     (GCompareFunc)applet_data_compare);
+	panel_g_ptr_array_insert_sorted (panel->applets, ad,
+					 (GCompareFunc) applet_data_compare);
+	panel_widget_invalidate_size (panel);
 
 	/*this will get done right on size allocate!*/
 	if(panel->orient == GTK_ORIENTATION_HORIZONTAL)
@@ -2512,7 +2690,7 @@ panel_widget_add (PanelWidget *panel,
 		gtk_fixed_put(GTK_FIXED(panel),applet,
 			      0,pos);
 
-	gtk_widget_queue_resize(GTK_WIDGET(panel));
+	panel_widget_queue_resize (panel);
 
 	g_signal_emit (G_OBJECT(panel),
 		       panel_widget_signals[APPLET_ADDED_SIGNAL],
@@ -2555,8 +2733,8 @@ panel_widget_reparent (PanelWidget *old_panel,
 	if (ad->pos == -1)
 		ad->pos = ad->constrained = 0;
 
-	gtk_widget_queue_resize (GTK_WIDGET (new_panel));
-	gtk_widget_queue_resize (GTK_WIDGET (old_panel));
+	panel_widget_queue_resize (new_panel);
+	panel_widget_queue_resize (old_panel);
 
 	panel_widget_reset_saved_focus (old_panel);
 	if (gtk_container_get_focus_child (GTK_CONTAINER (old_panel)) == applet)
@@ -2598,8 +2776,7 @@ panel_widget_set_packed (PanelWidget *panel_widget,
 			 gboolean     packed)
 {
 	panel_widget->packed = (packed != FALSE);
-
-	gtk_widget_queue_resize (GTK_WIDGET (panel_widget));
+	panel_widget_queue_resize (panel_widget);
 }
 
 void
@@ -2607,8 +2784,7 @@ panel_widget_set_orientation (PanelWidget    *panel_widget,
 			      GtkOrientation  orientation)
 {
 	panel_widget->orient = orientation;
-
-	gtk_widget_queue_resize (GTK_WIDGET (panel_widget));
+	panel_widget_queue_resize (panel_widget);
 }
 
 void
@@ -2621,12 +2797,13 @@ panel_widget_set_size (PanelWidget *panel_widget,
 		return;
 
 	panel_widget->sz = size;
+	panel_widget_invalidate_size (panel_widget);
 
 	queue_resize_on_all_applets (panel_widget);
 
 	g_signal_emit (panel_widget, panel_widget_signals [SIZE_CHANGE_SIGNAL], 0);
 
-	gtk_widget_queue_resize (GTK_WIDGET (panel_widget));
+	panel_widget_queue_resize (panel_widget);
 }
 
 void
@@ -2666,22 +2843,22 @@ panel_widget_switch_move_applet (PanelWidget      *panel,
                                  GtkDirectionType  dir)
 {
 	AppletData *applet;
-	GList      *list;
+	int         i;
 
 	applet = panel->currently_dragged_applet;
 	g_return_if_fail (applet != NULL);
 
-	list = g_list_find (panel->applet_list, applet);
-	g_return_if_fail (list != NULL);
+	i = panel_widget_find_applet (panel, applet);
+	g_return_if_fail (i >= 0);
 
 	switch (dir) {
 	case GTK_DIR_LEFT:
 	case GTK_DIR_UP:
-		panel_widget_switch_applet_left (panel, list);
+		panel_widget_switch_applet_left (panel, i);
 		break;
 	case GTK_DIR_RIGHT:
 	case GTK_DIR_DOWN:
-		panel_widget_switch_applet_right (panel, list);
+		panel_widget_switch_applet_right (panel, i);
 		break;
 	default:
 		return;
@@ -2821,8 +2998,8 @@ panel_widget_set_applet_size_constrained (PanelWidget *panel,
 		return;
 
 	ad->size_constrained = (size_constrained != FALSE);
-
-	gtk_widget_queue_resize (GTK_WIDGET (panel));
+	ad->requisition_valid = FALSE;
+	panel_widget_queue_resize (panel);
 }
 
 void
@@ -2845,8 +3022,8 @@ panel_widget_set_applet_expandable (PanelWidget *panel,
 
 	ad->expand_major = (major != FALSE);
 	ad->expand_minor = (minor != FALSE);
-
-	gtk_widget_queue_resize (GTK_WIDGET (panel));
+	ad->requisition_valid = FALSE;
+	panel_widget_queue_resize (panel);
 }
 
 void
@@ -2870,8 +3047,8 @@ panel_widget_set_applet_size_hints (PanelWidget *panel,
 		g_free (size_hints);
 		ad->size_hints = NULL;
 	}
-
-	gtk_widget_queue_resize (GTK_WIDGET (panel));
+	ad->requisition_valid = FALSE;
+	panel_widget_queue_resize (panel);
 }
 
 void
@@ -76,10 +76,14 @@ struct _AppletData
 	int *           size_hints;
 	int             size_hints_len;
 
+	/* minimum size, as last queried in size_request() */
+	GtkRequisition  requisition;
+
 	guint           size_constrained : 1;
 	guint           expand_major : 1;
 	guint           expand_minor : 1;
 	guint           locked : 1;
+	guint           requisition_valid : 1;
 
 };
 
@@ -87,7 +91,7 @@ struct _PanelWidget
 {
 	GtkFixed        fixed;
 
-	GList          *applet_list;
+	GPtrArray      *applets;         /* AppletData, sorted by position */
 
 	GSList         *open_dialogs;
 
@@ -116,7 +120,15 @@ struct _PanelWidget
 	AppletSizeHints      *applets_hints;
 	AppletSizeHintsAlloc *applets_using_hint;
 
+	/* size computed by the last size_request(), shared by the width and
+	 * height requests of a same layout pass */
+	GtkRequisition  cached_minimum_size;
+	GtkRequisition  cached_natural_size;
+	gint64          cached_size_frame;
+
 	guint           packed : 1;
+	guint           size_cached : 1;
+	guint           size_cached_for_width : 1;
 };
 
 struct _PanelWidgetClass
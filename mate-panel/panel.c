@@ -164,9 +164,6 @@ back_change (AppletInfo  *info,
 	case PANEL_OBJECT_MENU_BAR:
 		panel_menu_bar_change_background (PANEL_MENU_BAR (info->widget));
 		break;
-	case PANEL_OBJECT_SEPARATOR:
-		panel_separator_change_background (PANEL_SEPARATOR (info->widget));
-		break;
 	default:
 		break;
 	}
@@ -253,9 +250,17 @@ context_menu_show (GtkWidget *w,
 	panel_toplevel_push_autohide_disabler (PANEL_TOPLEVEL (pd->panel));
 }
 
+/* The context menu of a panel updates itself when it is shown, but the
+ * one of a drawer is the menu of its applet, which is rebuilt */
 static void
 panel_recreate_context_menu (PanelData *pd)
 {
+	PanelWidget *panel_widget;
+
+	panel_widget = panel_toplevel_get_panel_widget (PANEL_TOPLEVEL (pd->panel));
+	if (!panel_widget->master_widget)
+		return;
+
 	if (pd->menu)
 		g_object_unref (pd->menu);
 	pd->menu = NULL;
@@ -1099,11 +1104,11 @@ do_highlight (GtkWidget *widget, gboolean highlight)
 	}
 }
 
-gboolean
-panel_check_drop_forbidden (PanelWidget    *panel,
-			    GdkDragContext *context,
-			    guint           info,
-			    guint           time_)
+static gboolean
+panel_get_drop_action (PanelWidget    *panel,
+		       GdkDragContext *context,
+		       guint           info,
+		       GdkDragAction  *action)
 {
 	if (!panel)
 		return FALSE;
@@ -1130,21 +1135,66 @@ panel_check_drop_forbidden (PanelWidget    *panel,
 	if (info == TARGET_ICON_INTERNAL ||
 	    info == TARGET_APPLET_INTERNAL) {
 		if (gdk_drag_context_get_actions (context) & GDK_ACTION_MOVE)
-			gdk_drag_status (context, GDK_ACTION_MOVE, time_);
+			*action = GDK_ACTION_MOVE;
 		else
-			gdk_drag_status (context,
-					 gdk_drag_context_get_suggested_action (context),
-					 time_);
+			*action = gdk_drag_context_get_suggested_action (context);
 
 	} else if (gdk_drag_context_get_actions (context) & GDK_ACTION_COPY)
-		gdk_drag_status (context, GDK_ACTION_COPY, time_);
+		*action = GDK_ACTION_COPY;
 	else
-		gdk_drag_status (context,
-				 gdk_drag_context_get_suggested_action (context),
-				 time_);
+		*action = gdk_drag_context_get_suggested_action (context);
 
 	return TRUE;
+}
 
+gboolean
+panel_check_drop_forbidden (PanelWidget    *panel,
+			    GdkDragContext *context,
+			    guint           info,
+			    guint           time_)
+{
+	GdkDragAction action;
+
+	if (!panel_get_drop_action (panel, context, info, &action))
+		return FALSE;
+
+	gdk_drag_status (context, action, time_);
+
+	return TRUE;
+}
+
+/* What a drag over a panel can do does not change while it is over the
+ * panel: it is decided on the first motion and kept until it leaves,
+ * instead of walking the targets and the forbidden panels on every
+ * motion event. */
+typedef struct {
+	GdkDragContext *context;
+	gboolean        accepted;
+	GdkDragAction   action;
+} PanelDragDecision;
+
+static PanelDragDecision *
+panel_get_drag_decision (PanelToplevel  *toplevel,
+			 GdkDragContext *context)
+{
+	PanelDragDecision *decision;
+	guint              info;
+
+	decision = g_object_get_data (G_OBJECT (toplevel), "panel-drag-decision");
+	if (decision && decision->context == context)
+		return decision;
+
+	decision = g_new0 (PanelDragDecision, 1);
+	decision->context = context;
+	decision->accepted =
+		panel_check_dnd_target_data (GTK_WIDGET (toplevel), context, &info, NULL) &&
+		panel_get_drop_action (panel_toplevel_get_panel_widget (toplevel),
+				       context, info, &decision->action);
+
+	g_object_set_data_full (G_OBJECT (toplevel), "panel-drag-decision",
+				decision, g_free);
+
+	return decision;
 }
 
 static gboolean
@@ -1154,21 +1204,20 @@ drag_motion_cb (GtkWidget	   *widget,
 		gint                y,
 		guint               time)
 {
-	PanelToplevel *toplevel;
-	PanelWidget   *panel_widget;
-	guint          info;
+	PanelToplevel     *toplevel;
+	PanelDragDecision *decision;
 
 	g_return_val_if_fail (PANEL_IS_TOPLEVEL (widget), FALSE);
 
-	if (!panel_check_dnd_target_data (widget, context, &info, NULL))
-		return FALSE;
-
 	toplevel = PANEL_TOPLEVEL (widget);
-	panel_widget = panel_toplevel_get_panel_widget (toplevel);
 
-	if (!panel_check_drop_forbidden (panel_widget, context, info, time))
+	decision = panel_get_drag_decision (toplevel, context);
+	if (!decision->accepted)
 		return FALSE;
 
+	/* every motion still needs its status */
+	gdk_drag_status (context, decision->action, time);
+
 	do_highlight (widget, TRUE);
 
 	panel_toplevel_unhide (toplevel);
@@ -1204,6 +1253,9 @@ drag_leave_cb (GtkWidget	*widget,
 
 	do_highlight (widget, FALSE);
 
+	/* a drag coming back is decided again */
+	g_object_set_data (G_OBJECT (widget), "panel-drag-decision", NULL);
+
 	toplevel = PANEL_TOPLEVEL (widget);
 	panel_toplevel_queue_auto_hide (toplevel);
 }
@@ -1549,7 +1601,7 @@ panel_delete (PanelToplevel *toplevel)
 	panel_widget = panel_toplevel_get_panel_widget (toplevel);
 
 	if (!panel_global_config_get_confirm_panel_remove () ||
-	    !g_list_length (panel_widget->applet_list)) {
+	    panel_widget->applets->len == 0) {
 		panel_delete_without_query (toplevel);
 		return;
 	}
@@ -0,0 +1,149 @@
+/* Test for the merging of the overlapping monitors
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* Runs panel_multimonitor_compress_overlapping_monitors() on the layouts
+ * RANDR is known to give, and prints one line per layout:
+ *
+ *   compress case=clone monitors=2 result=1 ok=1
+ *
+ * The program fails when a layout does not compress to what is expected. */
+
+#include <config.h>
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "panel-multimonitor-compress.h"
+
+#define MAX_MONITORS 8
+
+typedef struct {
+	const char   *name;
+	int           n_monitors;
+	GdkRectangle  monitors[MAX_MONITORS];
+	int           n_expected;
+	GdkRectangle  expected[MAX_MONITORS];
+} CompressCase;
+
+static const CompressCase cases[] = {
+	/* one monitor is left alone */
+	{ "single", 1,
+	  { { 0, 0, 1024, 768 } },
+	  1,
+	  { { 0, 0, 1024, 768 } } },
+
+	/* laptop plus projector with the same resolution */
+	{ "clone", 2,
+	  { { 0, 0, 1024, 768 }, { 0, 0, 1024, 768 } },
+	  1,
+	  { { 0, 0, 1024, 768 } } },
+
+	/* laptop LCD plus a smaller external monitor at the same offset: the
+	 * biggest one wins, wherever it is in the list */
+	{ "clone-smaller", 2,
+	  { { 0, 0, 1024, 768 }, { 0, 0, 1280, 1024 } },
+	  1,
+	  { { 0, 0, 1280, 1024 } } },
+
+	/* monitors side by side only share an edge */
+	{ "side-by-side", 3,
+	  { { 0, 0, 1024, 768 }, { 1024, 0, 1280, 1024 },
+	    { 0, 768, 1024, 768 } },
+	  3,
+	  { { 0, 0, 1024, 768 }, { 1024, 0, 1280, 1024 },
+	    { 0, 768, 1024, 768 } } },
+
+	/* A, B, C, D where B and D overlap give A, MAX (B, D), C */
+	{ "one-pair", 4,
+	  { { 0, 0, 1024, 768 }, { 1024, 0, 800, 600 },
+	    { 2048, 0, 1024, 768 }, { 1024, 0, 1024, 768 } },
+	  3,
+	  { { 0, 0, 1024, 768 }, { 1024, 0, 1024, 768 },
+	    { 2048, 0, 1024, 768 } } },
+
+	/* A overlaps B and B overlaps C, but A and C do not overlap: the
+	 * overlap is transitive, the three of them are one set */
+	{ "chain", 3,
+	  { { 0, 0, 1024, 768 }, { 800, 0, 1280, 1024 },
+	    { 1900, 0, 1024, 768 } },
+	  1,
+	  { { 800, 0, 1280, 1024 } } },
+
+	/* the same chain, in another order and next to a monitor of its own */
+	{ "chain-unsorted", 4,
+	  { { 1900, 0, 1024, 768 }, { 4000, 0, 800, 600 },
+	    { 0, 0, 1024, 768 }, { 800, 0, 1280, 1024 } },
+	  2,
+	  { { 800, 0, 1280, 1024 }, { 4000, 0, 800, 600 } } },
+
+	/* monitors of the same size: the first one of the set is kept */
+	{ "same-size", 2,
+	  { { 0, 0, 1024, 768 }, { 512, 0, 1024, 768 } },
+	  1,
+	  { { 0, 0, 1024, 768 } } }
+};
+
+static gboolean
+run_case (const CompressCase *test)
+{
+	GdkRectangle *geometries;
+	int           n_monitors;
+	gboolean      ok;
+	int           i;
+
+	n_monitors = test->n_monitors;
+	geometries = g_new (GdkRectangle, n_monitors);
+	memcpy (geometries, test->monitors, sizeof (GdkRectangle) * n_monitors);
+
+	panel_multimonitor_compress_overlapping_monitors (&n_monitors,
+							  &geometries);
+
+	ok = n_monitors == test->n_expected;
+	for (i = 0; ok && i < n_monitors; i++)
+		ok = gdk_rectangle_equal (&geometries[i], &test->expected[i]);
+
+	g_print ("compress case=%s monitors=%d result=%d ok=%d\n",
+		 test->name, test->n_monitors, n_monitors, ok);
+
+	if (!ok) {
+		for (i = 0; i < n_monitors; i++)
+			g_printerr ("  got %dx%d+%d+%d\n",
+				    geometries[i].width, geometries[i].height,
+				    geometries[i].x, geometries[i].y);
+	}
+
+	g_free (geometries);
+
+	return ok;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+	gboolean ok = TRUE;
+	guint    i;
+
+	for (i = 0; i < G_N_ELEMENTS (cases); i++)
+		if (!run_case (&cases[i]))
+			ok = FALSE;
+
+	return ok ? 0 : 1;
+}
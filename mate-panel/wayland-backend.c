@@ -27,30 +27,45 @@
 
 #include <gtk-layer-shell.h>
 
+#include <libpanel-util/panel-scheduler.h>
+
 #include "wayland-backend.h"
 
-void
-wayland_panel_toplevel_init (PanelToplevel* toplevel)
+/* Every call to gtk-layer-shell commits the surface, and the compositor
+ * lays the other windows out again for a new exclusive zone. The placement
+ * is only recorded when the panel changes, and sent once before the next
+ * frame, with only the values that differ from what was sent before. */
+typedef struct {
+	PanelToplevel *toplevel;
+	guint          flush_id;
+
+	gboolean       anchor[GTK_LAYER_SHELL_EDGE_ENTRY_NUMBER];
+	int            exclusive_zone;
+	int            sent_exclusive_zone;
+} WaylandPlacement;
+
+static void
+wayland_placement_free (WaylandPlacement* placement)
 {
-	GtkWindow* window;
+	if (placement->flush_id)
+		panel_scheduler_remove (placement->flush_id);
 
-	window = GTK_WINDOW (toplevel);
-	gtk_layer_init_for_window (window);
-	gtk_layer_set_layer (window, GTK_LAYER_SHELL_LAYER_TOP);
-	gtk_layer_set_namespace (window, "panel");
-	gtk_layer_auto_exclusive_zone_enable (window);
-	wayland_panel_toplevel_update_placement (toplevel);
+	g_free (placement);
 }
 
-void
-wayland_panel_toplevel_update_placement (PanelToplevel* toplevel)
+static WaylandPlacement*
+wayland_placement_get (PanelToplevel* toplevel)
+{
+	return g_object_get_data (G_OBJECT (toplevel), "wayland-panel-placement");
+}
+
+static void
+wayland_placement_compute_anchors (PanelToplevel* toplevel,
+				   gboolean      *anchor)
 {
-	GtkWindow* window;
 	gboolean expand;
 	PanelOrientation orientation;
-	gboolean anchor[GTK_LAYER_SHELL_EDGE_ENTRY_NUMBER];
 
-	window = GTK_WINDOW (toplevel);
 	expand = panel_toplevel_get_expand (toplevel);
 	orientation = panel_toplevel_get_orientation (toplevel);
 	for (int i = 0; i < GTK_LAYER_SHELL_EDGE_ENTRY_NUMBER; i++)
@@ -76,7 +91,104 @@ wayland_panel_toplevel_update_placement (PanelToplevel* toplevel)
 	default:
 		g_warning ("Invalid panel orientation %d", orientation);
 	}
+}
 
-	for (int i = 0; i < GTK_LAYER_SHELL_EDGE_ENTRY_NUMBER; i++)
+static void
+wayland_placement_flush (WaylandPlacement* placement)
+{
+	GtkWindow* window;
+	gboolean anchor[GTK_LAYER_SHELL_EDGE_ENTRY_NUMBER];
+
+	window = GTK_WINDOW (placement->toplevel);
+	wayland_placement_compute_anchors (placement->toplevel, anchor);
+
+	for (int i = 0; i < GTK_LAYER_SHELL_EDGE_ENTRY_NUMBER; i++) {
+		if (anchor[i] == placement->anchor[i])
+			continue;
+
+		placement->anchor[i] = anchor[i];
 		gtk_layer_set_anchor (window, i, anchor[i]);
+	}
+
+	if (placement->exclusive_zone != placement->sent_exclusive_zone) {
+		placement->sent_exclusive_zone = placement->exclusive_zone;
+		gtk_layer_set_exclusive_zone (window, placement->exclusive_zone);
+	}
+}
+
+static gboolean
+wayland_placement_flush_idle (gpointer data)
+{
+	WaylandPlacement* placement = data;
+
+	placement->flush_id = 0;
+	wayland_placement_flush (placement);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+wayland_placement_queue_flush (WaylandPlacement* placement)
+{
+	if (placement->flush_id)
+		return;
+
+	/* runs before the redraws, so that the frame shows the new placement */
+	placement->flush_id =
+		panel_scheduler_add (PANEL_SCHEDULER_PRIORITY_HIGH,
+				     "wayland-placement",
+				     wayland_placement_flush_idle,
+				     placement, NULL);
+}
+
+void
+wayland_panel_toplevel_init (PanelToplevel* toplevel)
+{
+	GtkWindow* window;
+	WaylandPlacement* placement;
+
+	window = GTK_WINDOW (toplevel);
+	gtk_layer_init_for_window (window);
+	gtk_layer_set_layer (window, GTK_LAYER_SHELL_LAYER_TOP);
+	gtk_layer_set_namespace (window, "panel");
+
+	/* the exclusive zone follows the struts of the panel instead of each
+	 * allocation of the window, see wayland_panel_toplevel_set_exclusive_zone() */
+	placement = g_new0 (WaylandPlacement, 1);
+	placement->toplevel = toplevel;
+	g_object_set_data_full (G_OBJECT (toplevel), "wayland-panel-placement",
+				placement, (GDestroyNotify) wayland_placement_free);
+
+	/* before the window is mapped, for its first configure */
+	wayland_placement_flush (placement);
+}
+
+void
+wayland_panel_toplevel_update_placement (PanelToplevel* toplevel)
+{
+	WaylandPlacement* placement;
+
+	placement = wayland_placement_get (toplevel);
+	if (!placement)
+		return;
+
+	wayland_placement_queue_flush (placement);
+}
+
+/* The space the panel reserves on its edge, as resolved for the struts on
+ * X11: the size of the hidden panel when it auto hides, 0 when it is not
+ * on an edge. */
+void
+wayland_panel_toplevel_set_exclusive_zone (PanelToplevel* toplevel,
+					   int            exclusive_zone)
+{
+	WaylandPlacement* placement;
+
+	placement = wayland_placement_get (toplevel);
+	if (!placement)
+		return;
+
+	placement->exclusive_zone = MAX (exclusive_zone, 0);
+	if (placement->exclusive_zone != placement->sent_exclusive_zone)
+		wayland_placement_queue_flush (placement);
 }
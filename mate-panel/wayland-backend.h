@@ -39,5 +39,7 @@
 
 void wayland_panel_toplevel_init (PanelToplevel* toplevel);
 void wayland_panel_toplevel_update_placement (PanelToplevel* toplevel);
+void wayland_panel_toplevel_set_exclusive_zone (PanelToplevel* toplevel,
+						int            exclusive_zone);
 
 #endif /* __WAYLAND_BACKEND_H__ */
@@ -46,6 +46,8 @@ static gboolean xstuff_display_is_dead = FALSE;
 #define ZOOM_FACTOR 5
 #define ZOOM_STEPS  14
 #define ZOOM_DELAY 10
+/* duration of the composited animation, in microseconds */
+#define ZOOM_DURATION (ZOOM_STEPS * ZOOM_DELAY * G_TIME_SPAN_MILLISECOND)
 
 gboolean is_using_x11 ()
 {
@@ -53,20 +55,23 @@ gboolean is_using_x11 ()
 }
 
 typedef struct {
-	int size;
 	int size_start;
 	int size_end;
 	PanelOrientation orientation;
-	double opacity;
-	GdkPixbuf *pixbuf;
-	guint timeout_id;
+	/* the icon, uploaded once in a surface similar to the window: each
+	 * frame only scales it, which the X server does for us */
+	cairo_surface_t *surface;
+	double surface_width;
+	double surface_height;
+	gint64 start_time;
+	double progress;
 } CompositedZoomData;
 
-static gboolean
-zoom_timeout (GtkWidget *window)
+static void
+composited_zoom_data_free (CompositedZoomData *zoom)
 {
-	gtk_widget_queue_draw (window);
-	return TRUE;
+	g_clear_pointer (&zoom->surface, cairo_surface_destroy);
+	g_slice_free (CompositedZoomData, zoom);
 }
 
 static gboolean
@@ -77,101 +82,116 @@ idle_destroy (gpointer data)
 	return FALSE;
 }
 
+static gboolean
+zoom_tick (GtkWidget     *widget,
+	   GdkFrameClock *frame_clock,
+	   gpointer       user_data)
+{
+	CompositedZoomData *zoom;
+	gint64 now;
+
+	zoom = user_data;
+	now = gdk_frame_clock_get_frame_time (frame_clock);
+
+	if (zoom->start_time == 0)
+		zoom->start_time = now;
+
+	zoom->progress = (double) (now - zoom->start_time) / ZOOM_DURATION;
+
+	if (zoom->progress >= 1.0) {
+		gtk_widget_hide (widget);
+		g_idle_add (idle_destroy, widget);
+
+		return G_SOURCE_REMOVE;
+	}
+
+	gtk_widget_queue_draw (widget);
+
+	return G_SOURCE_CONTINUE;
+}
+
 static gboolean
 zoom_draw (GtkWidget *widget,
 	     cairo_t *cr,
 	     gpointer        user_data)
 {
 	CompositedZoomData *zoom;
+	int width, height;
+	int x = 0, y = 0;
+	int size;
+	double opacity;
 
 	zoom = user_data;
 
-	if (zoom->size >= zoom->size_end) {
-		if (zoom->timeout_id)
-			g_source_remove (zoom->timeout_id);
-		zoom->timeout_id = 0;
+	cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_rgba (cr, 0, 0, 0, 0.0);
+	cairo_paint (cr);
 
-		gtk_widget_hide (widget);
-		g_idle_add (idle_destroy, widget);
+	if (!zoom->surface)
+		return FALSE;
 
-		g_object_unref (zoom->pixbuf);
-		zoom->pixbuf = NULL;
+	gtk_window_get_size (GTK_WINDOW (widget), &width, &height);
 
-		g_slice_free (CompositedZoomData, zoom);
-	} else {
-		GdkPixbuf *scaled;
-		int width, height;
-		int x = 0, y = 0;
-
-		gtk_window_get_size (GTK_WINDOW (widget), &width, &height);
-
-		zoom->size += MAX ((zoom->size_end - zoom->size_start) / ZOOM_STEPS, 1);
-		zoom->opacity -= 1.0 / ((double) ZOOM_STEPS + 1);
-
-		scaled = gdk_pixbuf_scale_simple (zoom->pixbuf,
-						  zoom->size, zoom->size,
-						  GDK_INTERP_BILINEAR);
-
-		switch (zoom->orientation) {
-		case PANEL_ORIENTATION_TOP:
-			x = (width - gdk_pixbuf_get_width (scaled)) / 2;
-			y = 0;
-			break;
-
-		case PANEL_ORIENTATION_RIGHT:
-			x = width - gdk_pixbuf_get_width (scaled);
-			y = (height - gdk_pixbuf_get_height (scaled)) / 2;
-			break;
-
-		case PANEL_ORIENTATION_BOTTOM:
-			x = (width - gdk_pixbuf_get_width (scaled)) / 2;
-			y = height - gdk_pixbuf_get_height (scaled);
-			break;
-
-		case PANEL_ORIENTATION_LEFT:
-			x = 0;
-			y = (height - gdk_pixbuf_get_height (scaled)) / 2;
-			break;
-		}
+	size = zoom->size_start + (zoom->size_end - zoom->size_start) * zoom->progress;
+	opacity = 1.0 - zoom->progress * ZOOM_STEPS / ((double) ZOOM_STEPS + 1);
 
-		cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
-		cairo_set_source_rgba (cr, 0, 0, 0, 0.0);
-		cairo_rectangle (cr, 0, 0, width, height);
-		cairo_fill (cr);
+	switch (zoom->orientation) {
+	case PANEL_ORIENTATION_TOP:
+		x = (width - size) / 2;
+		y = 0;
+		break;
 
-		gdk_cairo_set_source_pixbuf (cr, scaled, x, y);
-		cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
-		cairo_paint_with_alpha (cr, MAX (zoom->opacity, 0));
+	case PANEL_ORIENTATION_RIGHT:
+		x = width - size;
+		y = (height - size) / 2;
+		break;
 
-		g_object_unref (scaled);
+	case PANEL_ORIENTATION_BOTTOM:
+		x = (width - size) / 2;
+		y = height - size;
+		break;
+
+	case PANEL_ORIENTATION_LEFT:
+		x = 0;
+		y = (height - size) / 2;
+		break;
 	}
 
+	cairo_translate (cr, x, y);
+	cairo_scale (cr,
+		     size / zoom->surface_width,
+		     size / zoom->surface_height);
+	cairo_set_source_surface (cr, zoom->surface, 0, 0);
+	cairo_pattern_set_filter (cairo_get_source (cr), CAIRO_FILTER_BILINEAR);
+	cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
+	cairo_paint_with_alpha (cr, MAX (opacity, 0));
+
 	return FALSE;
 }
 
 static void
 draw_zoom_animation_composited (GdkScreen *gscreen,
 				int x, int y, int w, int h,
-				GdkPixbuf *pixbuf,
+				cairo_surface_t *surface,
 				PanelOrientation orientation)
 {
 	GtkWidget *win;
 	CompositedZoomData *zoom;
 	int wx = 0, wy = 0;
+	double x_scale, y_scale;
+	cairo_t *cr;
 
 	w += 2;
 	h += 2;
 
-	zoom = g_slice_new (CompositedZoomData);
-	zoom->size = w;
+	zoom = g_slice_new0 (CompositedZoomData);
 	zoom->size_start = w;
 	zoom->size_end = w * ZOOM_FACTOR;
 	zoom->orientation = orientation;
-	zoom->opacity = 1.0;
-	zoom->pixbuf = g_object_ref (pixbuf);
-	zoom->timeout_id = 0;
 
 	win = gtk_window_new (GTK_WINDOW_POPUP);
+	g_object_set_data_full (G_OBJECT (win), "zoom-data", zoom,
+				(GDestroyNotify) composited_zoom_data_free);
 
 	gtk_window_set_screen (GTK_WINDOW (win), gscreen);
 	gtk_window_set_keep_above (GTK_WINDOW (win), TRUE);
@@ -214,11 +234,22 @@ draw_zoom_animation_composited (GdkScreen *gscreen,
 	/* see doc for gtk_widget_set_app_paintable() */
 	gtk_widget_realize (win);
 	gdk_window_set_background_pattern (gtk_widget_get_window (win), NULL);
+
+	cairo_surface_get_device_scale (surface, &x_scale, &y_scale);
+	zoom->surface_width = cairo_image_surface_get_width (surface) / x_scale;
+	zoom->surface_height = cairo_image_surface_get_height (surface) / y_scale;
+	zoom->surface = gdk_window_create_similar_surface (gtk_widget_get_window (win),
+							   CAIRO_CONTENT_COLOR_ALPHA,
+							   zoom->surface_width,
+							   zoom->surface_height);
+	cr = cairo_create (zoom->surface);
+	cairo_set_source_surface (cr, surface, 0, 0);
+	cairo_paint (cr);
+	cairo_destroy (cr);
+
 	gtk_widget_show (win);
 
-	zoom->timeout_id = g_timeout_add (ZOOM_DELAY,
-					  (GSourceFunc) zoom_timeout,
-					  win);
+	gtk_widget_add_tick_callback (win, zoom_tick, zoom, NULL);
 }
 
 static void
@@ -365,15 +396,10 @@ xstuff_zoom_animate (GtkWidget *widget,
 	gscreen = gtk_widget_get_screen (widget);
 
 	if (gdk_screen_is_composited (gscreen) && surface) {
-		GdkPixbuf *pixbuf = gdk_pixbuf_get_from_surface (surface,
-				0, 0,
-				cairo_image_surface_get_width (surface),
-				cairo_image_surface_get_height (surface));
 		draw_zoom_animation_composited (gscreen,
 				rect.x, rect.y,
 				rect.width, rect.height,
-				pixbuf, orientation);
-		g_object_unref (pixbuf);
+				surface, orientation);
 	} else {
 		GdkDisplay *display = gdk_screen_get_display (gscreen);
 		GdkMonitor *monitor = gdk_display_get_monitor_at_window (display,